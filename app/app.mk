@@ -17,10 +17,39 @@ SRC = main.c blob.c
 ifeq ($(CRYPTO_HW), true)
 SRC += se_provisioning.c
 endif
+ifeq ($(TARGET_OS), linux)
+SRC += metrics.c
+endif
 OBJS = $(addprefix $(OBJDIR)/,$(notdir $(SRC:.c=.o)))
 
 all: mkdir $(OBJS)
 
+FLEET_OBJS = $(OBJDIR)/fleet.o $(OBJDIR)/blob.o $(OBJDIR)/fileutil.o
+
+.PHONY: fleet
+fleet: mkdir $(FLEET_OBJS)
+
+BENCH_OBJS = $(OBJDIR)/bench.o $(OBJDIR)/blob.o $(OBJDIR)/benchutil.o
+
+.PHONY: bench
+bench: mkdir $(BENCH_OBJS)
+
+CRYPTOBENCH_OBJS = $(OBJDIR)/cryptobench.o $(OBJDIR)/blob.o \
+		   $(OBJDIR)/benchutil.o
+
+.PHONY: cryptobench
+cryptobench: mkdir $(CRYPTOBENCH_OBJS)
+
+STORAGEBENCH_OBJS = $(OBJDIR)/storagebench.o $(OBJDIR)/benchutil.o
+
+.PHONY: storagebench
+storagebench: mkdir $(STORAGEBENCH_OBJS)
+
+REPLAY_OBJS = $(OBJDIR)/replay.o $(OBJDIR)/fileutil.o
+
+.PHONY: replay
+replay: mkdir $(REPLAY_OBJS)
+
 mkdir:
 	mkdir -p $(OBJDIR)
 
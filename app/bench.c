@@ -0,0 +1,611 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Microbenchmarks of the JSON block codec (lib/sdoblockio.c), base64
+ * and the protocol types read and written by the messages, over payloads
+ * shaped like those of the reference servers: a rendezvous list with an IP
+ * and a DNS entry, an RSA-2048 owner key, the OV header of TO2.ProveOVHdr
+ * and the owner service info of TO2.OwnerServiceInfo.
+ *
+ * Each case runs for at least the given time. Its ns/op, the bytes of
+ * payload it reads or writes per op with their throughput and, with
+ * ALLOC_STATS=true, the heap allocations and bytes per op are reported, so
+ * that a codec change can be compared with the tree it is made against.
+ */
+
+#include "sdo.h"
+#include "sdomodules.h"
+#include "sdoblockio.h"
+#include "sdotypes.h"
+#include "sdocred.h"
+#include "sdoCryptoApi.h"
+#include "base64.h"
+#include "safe_lib.h"
+#include "benchutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_UINTS 64
+#define BENCH_STRINGS 16
+#define BENCH_B64_BYTES 1024
+#define BENCH_SI_BYTES 512 /* file chunk of a sdo_sys:write */
+#define BENCH_RSA_BYTES 256
+#define BENCH_OVKEY_BYTES 32
+#define BENCH_BUF_MAX 4096
+
+/* TO1 and TO2 rendezvous list: an IP entry for the device, a DNS entry */
+static const char benchRvList[] =
+    "[2,[5,{\"only\":\"dev\",\"ip\":[4,\"wKgBCg==\"],\"po\":8040,"
+    "\"pow\":8040,\"pr\":\"http\"}],[5,{\"dn\":\"rv.sdo.example.com\","
+    "\"po\":443,\"pow\":443,\"pr\":\"https\",\"delaysec\":30}]]";
+
+/* Pre-service info of TO2.GetNextDeviceServiceInfo, set by the owner */
+static const char benchPsi[] =
+    "sdo_sys:maxver~1,sdo_sys:minver~1,sdo_sys:active~1";
+
+static const char *const benchStrings[BENCH_STRINGS] = {
+    "sdo_sys:filedesc", "setup.sh",
+    "sdo_sys:exec",     "/bin/sh setup.sh",
+    "devconfig:name",   "line-7-cell-2",
+    "devconfig:tz",     "Europe/Berlin",
+    "keypair:gen",      "RSA2048",
+    "keypair:type",     "1",
+    "sdo_sys:active",   "1",
+    "sdo_sys:maxver",   "1"};
+
+typedef struct {
+	const char *name;
+	int (*run)(void); /* bytes read or written, -1 on failure */
+} benchCase_t;
+
+static struct {
+	unsigned ms;
+} cfg = {200};
+
+static SDOW_t benchW;
+static SDOR_t uintR, strR, baR, rvR, pkR, ohR, osiR;
+static uint8_t bin[BENCH_B64_BYTES];
+static uint8_t b64[BENCH_B64_BYTES * 2];
+static int b64Len;
+static uint8_t scratch[BENCH_BUF_MAX];
+static char osiMsg[BENCH_BUF_MAX];
+static SDORendezvousList_t *rvList;
+static SDOPublicKey_t *ownerPk;
+
+static int benchModuleCb(sdoSdkSiType type, int *count, sdoSdkSiKeyValue *si)
+{
+	(void)type;
+	(void)count;
+	(void)si;
+	return SDO_SI_SUCCESS;
+}
+
+static sdoSdkServiceInfoModuleList_t benchModules = {
+    .module = {"sdo_sys", benchModuleCb}};
+
+/* Make buf the block of sdor, as if it had been received */
+static bool benchLoad(SDOR_t *sdor, const uint8_t *buf, int len)
+{
+	if (!sdoRInit(sdor, NULL, NULL) || !sdoRReserve(sdor, len + 4))
+		return false;
+	if (memcpy_s(sdor->b.block, sdor->b.blockMax, buf, len) != 0 ||
+	    memset_s(&sdor->b.block[len], 4, 0) != 0)
+		return false;
+	sdor->b.blockSize = len;
+	sdor->haveBlock = true;
+	return true;
+}
+
+static SDOR_t *benchRewind(SDOR_t *sdor)
+{
+	sdor->b.cursor = 0;
+	sdor->needComma = false;
+	return sdor;
+}
+
+static SDOW_t *benchWriter(void)
+{
+	sdoWBlockReset(&benchW);
+	return &benchW;
+}
+
+//----------------------------------------------------------------------
+// Block codec
+//
+
+static uint32_t benchUint(int i)
+{
+	/* Message types, lengths, ports, nonces: 1 to 10 digits */
+	static const uint32_t v[] = {0,    7,      41,      255,
+				     8040, 65535,  1000000, 4294967295u};
+
+	return v[i % (sizeof(v) / sizeof(v[0]))];
+}
+
+static int benchWriteUint(void)
+{
+	SDOW_t *w = benchWriter();
+	int i;
+
+	sdoWBeginSequence(w);
+	for (i = 0; i < BENCH_UINTS; i++)
+		sdoWriteUInt(w, benchUint(i));
+	sdoWEndSequence(w);
+	return w->b.blockSize;
+}
+
+static int benchReadUint(void)
+{
+	SDOR_t *r = benchRewind(&uintR);
+	int i;
+
+	if (!sdoRBeginSequence(r))
+		return -1;
+	for (i = 0; i < BENCH_UINTS; i++) {
+		if (sdoReadUInt(r) != benchUint(i))
+			return -1;
+	}
+	if (!sdoREndSequence(r))
+		return -1;
+	return r->b.blockSize;
+}
+
+static int benchWriteString(void)
+{
+	SDOW_t *w = benchWriter();
+	int i;
+
+	sdoWBeginObject(w);
+	for (i = 0; i < BENCH_STRINGS; i += 2) {
+		sdoWriteTag(w, (char *)benchStrings[i]);
+		sdoWriteString(w, benchStrings[i + 1]);
+	}
+	sdoWEndObject(w);
+	return w->b.blockSize;
+}
+
+static int benchReadString(void)
+{
+	SDOR_t *r = benchRewind(&strR);
+	char *buf = (char *)scratch;
+	int i, len;
+
+	if (!sdoRBeginObject(r))
+		return -1;
+	for (i = 0; i < BENCH_STRINGS; i += 2) {
+		if (!sdoReadExpectedTag(r, (char *)benchStrings[i]))
+			return -1;
+		len = sdoReadStringSz(r);
+		if (len < 0 || len >= BENCH_BUF_MAX ||
+		    sdoReadString(r, buf, BENCH_BUF_MAX) != len)
+			return -1;
+	}
+	if (!sdoREndObject(r))
+		return -1;
+	return r->b.blockSize;
+}
+
+/* A nonce, a hash and a key, as [len,"base64"] */
+static int benchWriteByteArray(void)
+{
+	SDOW_t *w = benchWriter();
+
+	sdoWBeginSequence(w);
+	sdoWriteByteArray(w, bin, 16);
+	sdoWriteByteArray(w, bin, 32);
+	sdoWriteByteArray(w, bin, BENCH_RSA_BYTES);
+	sdoWEndSequence(w);
+	return w->b.blockSize;
+}
+
+static int benchReadByteArray(void)
+{
+	static const int lens[] = {16, 32, BENCH_RSA_BYTES};
+	SDOR_t *r = benchRewind(&baR);
+	unsigned i;
+	int len;
+
+	if (!sdoRBeginSequence(r))
+		return -1;
+	for (i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		if (!sdoRBeginSequence(r))
+			return -1;
+		len = sdoReadUInt(r);
+		if (len != lens[i] ||
+		    sdoReadByteArrayField(r, binToB64Length(len), scratch,
+					  BENCH_BUF_MAX) != len ||
+		    !sdoREndSequence(r))
+			return -1;
+	}
+	if (!sdoREndSequence(r))
+		return -1;
+	return r->b.blockSize;
+}
+
+/* Body of an encrypted message: its length is known once it is written */
+static int benchWriteFixup(void)
+{
+	SDOW_t *w = benchWriter();
+	int fixup, start;
+
+	sdoWBeginObject(w);
+	sdoWriteTag(w, "sz");
+	fixup = sdoWCreateFixup(w);
+	sdoWriteTag(w, "ct");
+	start = w->b.cursor;
+	sdoWriteByteArray(w, bin, BENCH_RSA_BYTES);
+	sdoWFixFixup(w, fixup, w->b.cursor - start);
+	sdoWEndObject(w);
+	return w->b.blockSize;
+}
+
+//----------------------------------------------------------------------
+// Base64
+//
+
+static int benchB64Encode(void)
+{
+	int len = binToB64(BENCH_B64_BYTES, bin, 0, sizeof(b64), b64, 0);
+
+	return len == b64Len ? len : -1;
+}
+
+static int benchB64Decode(void)
+{
+	int len = b64ToBin(b64Len, b64, 0, sizeof(scratch), scratch, 0);
+
+	return len == BENCH_B64_BYTES ? b64Len : -1;
+}
+
+//----------------------------------------------------------------------
+// Protocol types
+//
+
+static int benchRvRead(void)
+{
+	SDOR_t *r = benchRewind(&rvR);
+	SDORendezvousList_t *list = sdoRendezvousListAlloc();
+	int ret = -1;
+
+	if (list && sdoRendezvousListRead(r, list) && list->numEntries == 2)
+		ret = r->b.blockSize;
+	sdoRendezvousListFree(list);
+	return ret;
+}
+
+static int benchRvWrite(void)
+{
+	SDOW_t *w = benchWriter();
+
+	if (!sdoRendezvousListWrite(w, rvList))
+		return -1;
+	return w->b.blockSize;
+}
+
+static int benchPkRead(void)
+{
+	SDOR_t *r = benchRewind(&pkR);
+	SDOPublicKey_t *pk = sdoPublicKeyRead(r);
+	int ret = -1;
+
+	if (pk && pk->key1 && pk->key1->byteSz == BENCH_RSA_BYTES)
+		ret = r->b.blockSize;
+	if (pk)
+		sdoPublicKeyFree(pk);
+	return ret;
+}
+
+static int benchPkWrite(void)
+{
+	SDOW_t *w = benchWriter();
+
+	sdoPublicKeyWrite(w, ownerPk);
+	return w->b.blockSize;
+}
+
+/* With the hashes of the header (hp) and of the device (hc) of msg41 */
+static int benchOvHdrRead(void)
+{
+	SDOR_t *r = benchRewind(&ohR);
+	SDOOwnershipVoucher_t *ov;
+	SDOHash_t *hmac = NULL;
+
+	if (!sdoRBeginObject(r) || !sdoReadExpectedTag(r, "oh"))
+		return -1;
+	ov = sdoOvHdrRead(r, &hmac, true);
+	if (hmac)
+		sdoHashFree(hmac);
+	if (!ov)
+		return -1;
+	sdoOvFree(ov);
+	return r->b.blockSize;
+}
+
+/* The service info of one TO2.OwnerServiceInfo, as msg49 reads it */
+static int benchOsiParse(void)
+{
+	SDOR_t *r = benchRewind(&osiR);
+	sdoSdkSiKeyValue kv;
+	int cbRet;
+
+	if (!sdoRBeginObject(r) || !sdoReadExpectedTag(r, "nn"))
+		return -1;
+	sdoReadUInt(r);
+	if (!sdoReadExpectedTag(r, "sv") || !sdoRBeginObject(r))
+		return -1;
+	if (!sdoOsiParsing(r, &benchModules, NULL, &kv, &cbRet) ||
+	    cbRet != SDO_SI_SUCCESS)
+		return -1;
+	return r->b.blockSize;
+}
+
+static int benchPsiParse(void)
+{
+	int cbRet;
+
+	/* Tokenized in place, parse a copy */
+	if (memcpy_s(scratch, sizeof(scratch), benchPsi, sizeof(benchPsi)))
+		return -1;
+	if (!sdoPsiParsing(&benchModules, (char *)scratch, sizeof(benchPsi),
+			   &cbRet) ||
+	    cbRet != SDO_SI_SUCCESS)
+		return -1;
+	return sizeof(benchPsi) - 1;
+}
+
+static const benchCase_t benchCases[] = {
+    {"blockio-write-uint", benchWriteUint},
+    {"blockio-read-uint", benchReadUint},
+    {"blockio-write-string", benchWriteString},
+    {"blockio-read-string", benchReadString},
+    {"blockio-write-bytearray", benchWriteByteArray},
+    {"blockio-read-bytearray", benchReadByteArray},
+    {"blockio-write-fixup", benchWriteFixup},
+    {"b64-encode-1k", benchB64Encode},
+    {"b64-decode-1k", benchB64Decode},
+    {"rv-list-read", benchRvRead},
+    {"rv-list-write", benchRvWrite},
+    {"pubkey-read-rsa2048", benchPkRead},
+    {"pubkey-write-rsa2048", benchPkWrite},
+    {"ovhdr-read", benchOvHdrRead},
+    {"osi-parse", benchOsiParse},
+    {"psi-parse", benchPsiParse},
+};
+
+#define BENCH_CASES (sizeof(benchCases) / sizeof(benchCases[0]))
+
+/* Write the message of a write case and load it in a reader */
+static bool benchLoadWritten(SDOR_t *sdor, int (*write)(void))
+{
+	if (write() < 0)
+		return false;
+	return benchLoad(sdor, benchW.b.block, benchW.b.blockSize);
+}
+
+static bool benchSetupOvHdr(void)
+{
+	SDOW_t *w = benchWriter();
+	SDOByteArray_t *guid = sdoByteArrayAlloc(SDO_GUID_BYTES);
+	SDOHash_t *hmac = sdoHashAlloc(SDO_CRYPTO_HMAC_TYPE_USED,
+				       SDO_SHA_DIGEST_SIZE_USED);
+	SDOHash_t *hdc = sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED,
+				      SDO_SHA_DIGEST_SIZE_USED);
+	bool ret = false;
+
+	if (!guid || !hmac || !hdc)
+		goto end;
+	benchFill(guid->bytes, guid->byteSz);
+	benchFill(hmac->hash->bytes, hmac->hash->byteSz);
+	benchFill(hdc->hash->bytes, hdc->hash->byteSz);
+
+	sdoWBeginObject(w);
+	sdoWriteTag(w, "oh");
+	sdoWBeginObject(w);
+	sdoWriteTag(w, "pv");
+	sdoWriteUInt(w, 113);
+	sdoWriteTag(w, "pe");
+	sdoWriteUInt(w, ownerPk->pkenc);
+	sdoWriteTag(w, "r");
+	sdoRendezvousListWrite(w, rvList);
+	sdoWriteTag(w, "g");
+	sdoByteArrayWriteChars(w, guid);
+	sdoWriteTag(w, "d");
+	sdoWriteString(w, "intel-1.0");
+	sdoWriteTag(w, "pk");
+	sdoPublicKeyWrite(w, ownerPk);
+#if defined(ECDSA256_DA) || defined(ECDSA384_DA)
+	sdoWriteTag(w, "hdc");
+	sdoHashWrite(w, hdc);
+#endif
+	sdoWEndObject(w);
+	sdoWriteTag(w, "hmac");
+	sdoHashWrite(w, hmac);
+	sdoWEndObject(w);
+	ret = benchLoad(&ohR, benchW.b.block, benchW.b.blockSize);
+end:
+	if (guid)
+		sdoByteArrayFree(guid);
+	if (hmac)
+		sdoHashFree(hmac);
+	if (hdc)
+		sdoHashFree(hdc);
+	return ret;
+}
+
+static bool benchSetupOsi(void)
+{
+	uint8_t chunk[BENCH_SI_BYTES];
+	char *data = (char *)scratch;
+	int len;
+
+	benchFill(chunk, sizeof(chunk));
+	len = binToB64(sizeof(chunk), chunk, 0, sizeof(scratch) - 1, scratch,
+		       0);
+	if (len <= 0)
+		return false;
+	data[len] = 0;
+	len = snprintf(osiMsg, sizeof(osiMsg),
+		       "{\"nn\":3,\"sv\":{\"sdo_sys:filedesc\":\"setup.sh\","
+		       "\"sdo_sys:write\":\"%s\","
+		       "\"sdo_sys:exec\":\"/bin/sh setup.sh\"}}",
+		       data);
+	if (len <= 0 || len >= (int)sizeof(osiMsg))
+		return false;
+	return benchLoad(&osiR, (uint8_t *)osiMsg, len);
+}
+
+static bool benchSetup(void)
+{
+	uint8_t mod[BENCH_RSA_BYTES];
+	uint8_t exp[] = {0x01, 0x00, 0x01};
+	SDOByteArray_t *ovKey = sdoByteArrayAlloc(BENCH_OVKEY_BYTES);
+
+	/* The OV header HMAC is computed as it is read */
+	if (sdoCryptoRequire(SDO_CRYPTO_ENGINE) || !ovKey)
+		return false;
+	benchFill(ovKey->bytes, ovKey->byteSz);
+	if (setOVKey(ovKey, BENCH_OVKEY_BYTES)) {
+		sdoByteArrayFree(ovKey);
+		return false;
+	}
+	sdoByteArrayFree(ovKey);
+
+	if (!sdoWInit(&benchW))
+		return false;
+
+	benchFill(bin, sizeof(bin));
+	b64Len = binToB64(sizeof(bin), bin, 0, sizeof(b64), b64, 0);
+	if (b64Len <= 0)
+		return false;
+
+	benchFill(mod, sizeof(mod));
+	mod[0] |= 0x80;
+	ownerPk = sdoPublicKeyAlloc(SDO_CRYPTO_PUB_KEY_ALGO_RSA,
+				    SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
+				    sizeof(mod), mod);
+	if (!ownerPk || !ownerPk->key1)
+		return false;
+	ownerPk->key2 = sdoByteArrayAllocWithByteArray(exp, sizeof(exp));
+	if (!ownerPk->key2)
+		return false;
+
+	if (!benchLoad(&rvR, (const uint8_t *)benchRvList,
+		       sizeof(benchRvList) - 1))
+		return false;
+	rvList = sdoRendezvousListAlloc();
+	if (!rvList || !sdoRendezvousListRead(benchRewind(&rvR), rvList))
+		return false;
+
+	return benchLoadWritten(&uintR, benchWriteUint) &&
+	       benchLoadWritten(&strR, benchWriteString) &&
+	       benchLoadWritten(&baR, benchWriteByteArray) &&
+	       benchLoadWritten(&pkR, benchPkWrite) && benchSetupOvHdr() &&
+	       benchSetupOsi();
+}
+
+static uint64_t benchAllocs(sdoSdkAllocStats *s, uint64_t *bytes)
+{
+	uint64_t allocs = 0;
+	int t;
+
+	*bytes = 0;
+	for (t = 0; t < SDO_ALLOC_TAGS; t++) {
+		allocs += s->tag[t].allocs;
+		*bytes += s->tag[t].bytes;
+	}
+	return allocs;
+}
+
+static bool benchRun(const benchCase_t *c)
+{
+	sdoSdkAllocStats a0, a1;
+	uint64_t n = 1, ops = 0, start, ns;
+	uint64_t allocs0, allocs1, heap0, heap1;
+	bool alloc;
+	int bytes;
+	uint64_t i;
+
+	/* Once, to warm up the caches and the blocks */
+	bytes = c->run();
+	if (bytes < 0) {
+		printf("%-24s failed\n", c->name);
+		return false;
+	}
+
+	alloc = sdoSdkGetAllocStats(&a0) == SDO_SUCCESS;
+	start = benchNowNs();
+	do {
+		for (i = 0; i < n; i++) {
+			if (c->run() < 0) {
+				printf("%-24s failed\n", c->name);
+				return false;
+			}
+		}
+		ops += n;
+		ns = benchNowNs() - start;
+		if (n < (1u << 20))
+			n <<= 1;
+	} while (ns < (uint64_t)cfg.ms * 1000000);
+
+	printf("%-24s %10llu %10.1f %8d %9.1f", c->name,
+	       (unsigned long long)ops, (double)ns / ops, bytes,
+	       (double)bytes * ops * 1000 / ns);
+	if (alloc && sdoSdkGetAllocStats(&a1) == SDO_SUCCESS) {
+		allocs0 = benchAllocs(&a0, &heap0);
+		allocs1 = benchAllocs(&a1, &heap1);
+		printf(" %9.2f %9.1f\n", (double)(allocs1 - allocs0) / ops,
+		       (double)(heap1 - heap0) / ops);
+	} else {
+		printf(" %9s %9s\n", "-", "-");
+	}
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned c;
+	int opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "t:lh")) != -1) {
+		switch (opt) {
+		case 't':
+			cfg.ms = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			for (c = 0; c < BENCH_CASES; c++)
+				printf("%s\n", benchCases[c].name);
+			return EXIT_SUCCESS;
+		default:
+			benchUsage(argv[0], cfg.ms, "",
+				   "Heap allocations are reported with "
+				   "ALLOC_STATS=true.\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!benchSetup()) {
+		printf("Setting up the payloads failed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("%-24s %10s %10s %8s %9s %9s %9s\n", "case", "ops", "ns/op",
+	       "bytes/op", "MB/s", "allocs/op", "heap B/op");
+	for (c = 0; c < BENCH_CASES; c++) {
+		if (!benchSelected(benchCases[c].name, argc, argv))
+			continue;
+		if (!benchRun(&benchCases[c]))
+			ret = EXIT_FAILURE;
+	}
+
+	sdoRendezvousListFree(rvList);
+	sdoPublicKeyFree(ownerPk);
+	sdoCryptoClose();
+	return ret;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Clock, inputs and command line of the benchmarks.
+ */
+
+#include "benchutil.h"
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static uint32_t benchSeed = 0x2545f491;
+
+/**
+ * Monotonic time, in ns.
+ */
+uint64_t benchNowNs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Fill a buffer with fixed pseudo random bytes, the inputs being the same
+ * from run to run.
+ * @param buf - the buffer.
+ * @param len - its length.
+ */
+void benchFill(uint8_t *buf, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		benchSeed ^= benchSeed << 13;
+		benchSeed ^= benchSeed >> 17;
+		benchSeed ^= benchSeed << 5;
+		buf[i] = (uint8_t)benchSeed;
+	}
+}
+
+/**
+ * Print the usage of a benchmark.
+ * @param prog - name of the binary.
+ * @param ms - default minimum run time of a case.
+ * @param options - lines of the options of the benchmark, "" for none.
+ * @param notes - lines after those of the case selection, "" for none.
+ */
+void benchUsage(const char *prog, unsigned ms, const char *options,
+		const char *notes)
+{
+	printf("Usage: %s [options] [case...]\n"
+	       "  -t MS       minimum run time of each case (default %u)\n"
+	       "%s"
+	       "  -l          list the cases\n"
+	       "Cases are selected by a part of their name, all by default.\n"
+	       "%s",
+	       prog, ms, options, notes);
+}
+
+/**
+ * Tell if a case is selected by the arguments left after the options.
+ * @param name - name of the case.
+ * @return true if one is a part of the name, or there are none.
+ */
+bool benchSelected(const char *name, int argc, char **argv)
+{
+	int i;
+
+	if (optind >= argc)
+		return true;
+	for (i = optind; i < argc; i++) {
+		if (strstr(name, argv[i]))
+			return true;
+	}
+	return false;
+}
@@ -31,6 +31,7 @@
 #include "mbedtls/md.h"
 #endif
 #include "storage_al.h"
+#include "platform_utils.h"
 #include "blob.h"
 #include "sdoCryptoApi.h"
 #if defined(DEVICE_TPM20_ENABLED)
@@ -98,6 +99,7 @@ int32_t configureNormalBlob(void)
 				       " properly!\n");
 			goto err;
 		}
+		clearPlatformKeys();
 	}
 
 	if (sdoBlobRead((const char *)PLATFORM_HMAC_KEY, SDO_SDK_RAW_DATA,
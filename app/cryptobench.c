@@ -0,0 +1,652 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Benchmark of the primitives of the crypto HAL (sdoCryptoHal.h), to
+ * compare the OpenSSL and mbedTLS backends: hashes, HMAC, AES of the
+ * configured mode and AES-GCM at several sizes, ECDSA signing with the
+ * device key and verification, RSA-2048 encryption and verification, the
+ * configured key exchange, base64 and the DER codec.
+ *
+ * The primitives a build has are those crypto/conf.mk and crypto/build.mk
+ * select for its TLS, KEX, DA, PK_ENC and AES_MODE, so the backends are
+ * compared by building the benchmark with each: make cryptobench-compare
+ * builds build/linux-cryptobench-openssl and -mbedtls with the same options.
+ * Each case runs for at least the given time and reports ops/s, the bytes
+ * it processes per op with their throughput, and cycles/byte: from the TSC
+ * on x86, else from the clock given with -f.
+ */
+
+#include "sdo.h"
+#include "sdotypes.h"
+#include "sdoCryptoHal.h"
+#include "sdoCryptoApi.h"
+#include "platform_utils.h"
+#include "base64.h"
+#include "safe_lib.h"
+#include "benchutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_BUF_MAX 16384
+#define BENCH_AES_IV_GCM 12
+#define BENCH_RSA_BYTES 256
+#define BENCH_DEC_BYTES 1024
+
+#if defined(KEX_DH_ENABLED) || defined(KEX_ASYM_ENABLED) ||                   \
+    defined(KEX_ECDH_ENABLED) || defined(KEX_ECDH384_ENABLED)
+#define BENCH_KEX
+#endif
+#if defined(PK_ENC_ECDSA) && !defined(SECURE_ELEMENT)
+/* a SDO_SINGLE_SUITE build verifies on the curve of its suite only */
+#if !defined(SDO_SINGLE_SUITE) ||                                             \
+    SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256
+#define BENCH_P256_VERIFY
+#endif
+#if !defined(SDO_SINGLE_SUITE) ||                                             \
+    SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384
+#define BENCH_P384_VERIFY
+#endif
+#endif
+
+/* Signed with data/ecdsa256privkey.pem and data/ecdsa384privkey.pem, with
+ * SHA-256 and SHA-384, and with a fixed RSA-2048 key, PKCS#1 v1.5 SHA-256 */
+static const char benchSigMsg[] =
+    "sdo-cryptobench: signed by the test keys of data/ and a fixed RSA key";
+
+/* DER public keys and signatures of benchSigMsg */
+#if defined(BENCH_P256_VERIFY) || defined(SECURE_ELEMENT)
+static const uint8_t benchP256Pub[] = {
+    0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02,
+    0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01, 0x07, 0x03,
+    0x42, 0x00, 0x04, 0xb8, 0x2a, 0x1e, 0x9f, 0xf9, 0x88, 0xe5, 0xa3, 0x09,
+    0x86, 0xae, 0x51, 0x67, 0xaa, 0xad, 0x7a, 0x15, 0x16, 0x50, 0xd2, 0x64,
+    0xb9, 0x9e, 0x23, 0x64, 0x34, 0xb4, 0xfd, 0xef, 0xd6, 0x91, 0x8d, 0x8e,
+    0x01, 0x87, 0x8a, 0x6e, 0x85, 0x81, 0x36, 0xd9, 0xc3, 0x6c, 0xad, 0x66,
+    0x75, 0xd6, 0x54, 0x64, 0xd6, 0x64, 0x1e, 0x2f, 0x31, 0x1a, 0x77, 0x26,
+    0x1f, 0xbe, 0xd2, 0xa2, 0xad, 0x71, 0x4e};
+
+static const uint8_t benchP256Sig[] = {
+    0x30, 0x45, 0x02, 0x21, 0x00, 0xab, 0x99, 0x90, 0x0a, 0x12, 0xcc, 0xde,
+    0x5d, 0xc2, 0x40, 0x13, 0xd9, 0x37, 0x6f, 0x67, 0xa2, 0xd4, 0x4f, 0x46,
+    0x72, 0x85, 0x54, 0x09, 0xe5, 0xc7, 0x64, 0x27, 0x95, 0x78, 0x64, 0xc8,
+    0x9c, 0x02, 0x20, 0x78, 0xf7, 0xaf, 0x28, 0xf3, 0x0c, 0xad, 0xee, 0x7f,
+    0xb9, 0xe4, 0xca, 0x1b, 0x54, 0x86, 0x0d, 0x6a, 0xf0, 0x89, 0xe1, 0x31,
+    0x17, 0x96, 0x96, 0x77, 0x2a, 0x4b, 0x3f, 0x90, 0x8e, 0x0d, 0x9c};
+
+#endif
+
+#ifdef BENCH_P384_VERIFY
+static const uint8_t benchP384Pub[] = {
+    0x30, 0x76, 0x30, 0x10, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02,
+    0x01, 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22, 0x03, 0x62, 0x00, 0x04,
+    0x4d, 0x51, 0xe9, 0x3d, 0x0e, 0xaa, 0xc0, 0xbc, 0x93, 0xef, 0x0a, 0x04,
+    0xdd, 0x6b, 0xdc, 0xf9, 0xb6, 0xe8, 0xcd, 0xc7, 0x98, 0x0d, 0x48, 0x39,
+    0xb3, 0x28, 0x10, 0x48, 0xa5, 0xbf, 0xe9, 0xa4, 0x78, 0x7a, 0x3d, 0x75,
+    0xe8, 0x34, 0x07, 0x09, 0xeb, 0xa5, 0x43, 0xdc, 0x6b, 0x25, 0x5c, 0x57,
+    0x81, 0xf7, 0xfe, 0x58, 0x54, 0x96, 0xaa, 0x8d, 0x5e, 0x89, 0x91, 0x69,
+    0x54, 0x08, 0x11, 0x17, 0xce, 0x4b, 0xd3, 0x33, 0x8d, 0x6e, 0x51, 0xdf,
+    0xd3, 0xce, 0x26, 0x71, 0x68, 0xae, 0xd4, 0x68, 0x1f, 0x65, 0xe8, 0x68,
+    0x85, 0x9e, 0x71, 0xfa, 0x3a, 0x18, 0xd9, 0x4a, 0xcb, 0xd3, 0x7b, 0xd7};
+
+static const uint8_t benchP384Sig[] = {
+    0x30, 0x65, 0x02, 0x30, 0x75, 0xc9, 0x72, 0x7a, 0x43, 0xa2, 0x3f, 0x65,
+    0x70, 0x24, 0x51, 0x45, 0xc8, 0xc8, 0x96, 0x49, 0x09, 0xb1, 0x5e, 0x95,
+    0xf9, 0xee, 0x50, 0xba, 0x72, 0xf9, 0x6a, 0xd8, 0x18, 0xf6, 0xb1, 0x1a,
+    0xdb, 0x0d, 0xef, 0xf6, 0x8f, 0x48, 0x92, 0xf6, 0xe7, 0xb3, 0x21, 0x05,
+    0xea, 0xf7, 0x6f, 0xa1, 0x02, 0x31, 0x00, 0xb5, 0x9b, 0xb8, 0x1e, 0xbb,
+    0x29, 0xf0, 0x1e, 0xde, 0xcf, 0x2d, 0x00, 0x37, 0xd4, 0xe9, 0x6d, 0x84,
+    0x43, 0xf3, 0x14, 0xe7, 0xe8, 0xcc, 0x73, 0x8d, 0xaa, 0x47, 0x6c, 0x12,
+    0x3a, 0x4a, 0x44, 0xf5, 0x2e, 0xd6, 0x8d, 0xba, 0x6f, 0x19, 0x3b, 0x03,
+    0xaf, 0xcf, 0xca, 0x77, 0x59, 0x0c, 0xe3};
+
+#endif
+
+static const uint8_t benchRsaMod[] = {
+    0x9b, 0x59, 0x3b, 0x6d, 0x05, 0xfe, 0xc2, 0x93, 0x7e, 0x02, 0x65, 0xfa,
+    0x85, 0xb5, 0x2f, 0x60, 0xbf, 0x38, 0x78, 0xdb, 0xed, 0xc0, 0xc7, 0x57,
+    0xab, 0x35, 0x7d, 0xba, 0x72, 0xf3, 0x48, 0xae, 0xfd, 0xef, 0xd3, 0xd0,
+    0x38, 0xbb, 0x1e, 0x88, 0x62, 0x98, 0xd7, 0xde, 0xb7, 0x6d, 0xf1, 0xac,
+    0xee, 0xdb, 0x83, 0x7e, 0x85, 0x7d, 0xce, 0x9c, 0xe5, 0xba, 0xcc, 0x42,
+    0xc1, 0x3f, 0xdf, 0x2f, 0x86, 0xf8, 0x52, 0xe9, 0xd8, 0x72, 0x34, 0x49,
+    0xa9, 0xb2, 0xed, 0x39, 0x62, 0x1b, 0x4f, 0xf3, 0xf4, 0xd3, 0x16, 0x23,
+    0x0c, 0x3a, 0xf2, 0x22, 0xd0, 0xf9, 0x36, 0xc5, 0x6f, 0x87, 0x6d, 0x6d,
+    0x43, 0x26, 0xf4, 0x54, 0x8e, 0xd8, 0xee, 0xdf, 0xaf, 0x20, 0x7c, 0x97,
+    0x35, 0x5b, 0x9c, 0x97, 0x49, 0xf4, 0x69, 0x9b, 0xc7, 0x8d, 0x8d, 0x8e,
+    0x29, 0x13, 0x5b, 0x15, 0xac, 0x59, 0xe7, 0xd6, 0xe6, 0x83, 0x5e, 0xcf,
+    0x83, 0x06, 0x14, 0xb0, 0xdd, 0x47, 0x77, 0xb1, 0xe1, 0x3f, 0xf5, 0x09,
+    0x8f, 0xb8, 0x47, 0x50, 0x38, 0xb5, 0x90, 0x67, 0xf9, 0x34, 0x6c, 0xc8,
+    0x6c, 0x5a, 0x8e, 0x5f, 0x01, 0x15, 0x4c, 0x08, 0x2d, 0x42, 0xb9, 0x69,
+    0x52, 0x2c, 0xb2, 0x1d, 0x9c, 0x3a, 0x8a, 0x69, 0x30, 0xbd, 0xd4, 0x2f,
+    0x7c, 0x1b, 0xec, 0x4a, 0x91, 0x4c, 0x5d, 0x14, 0xbd, 0x5f, 0xa9, 0xba,
+    0x66, 0xfd, 0x01, 0x84, 0x9d, 0x4b, 0xf6, 0xd4, 0x53, 0x82, 0x04, 0x84,
+    0x69, 0x17, 0xbd, 0x5e, 0xfe, 0xc3, 0xb1, 0xee, 0x3b, 0xcd, 0x39, 0x06,
+    0xcb, 0xd1, 0x4c, 0x95, 0xd3, 0xbd, 0x35, 0xb4, 0xd2, 0x24, 0xa0, 0x1c,
+    0x93, 0x99, 0x71, 0x5e, 0x00, 0x0e, 0x34, 0xa8, 0xec, 0x04, 0x90, 0x6e,
+    0x9c, 0x10, 0x73, 0xd6, 0x50, 0x7f, 0xb9, 0x0f, 0x25, 0xd8, 0x7c, 0xee,
+    0x36, 0x3a, 0x4e, 0x19};
+
+#ifdef PK_ENC_RSA
+static const uint8_t benchRsaSig[] = {
+    0x47, 0xaa, 0x66, 0x53, 0x57, 0xd5, 0xb9, 0x4f, 0x4f, 0x92, 0xef, 0xe8,
+    0x50, 0xc5, 0x8c, 0xbc, 0x40, 0xb8, 0x86, 0x58, 0xf2, 0xf9, 0x96, 0x78,
+    0xc6, 0x54, 0xea, 0x12, 0x5e, 0xf1, 0x15, 0xfd, 0x4e, 0x5a, 0x2c, 0xf1,
+    0x8e, 0x42, 0x2f, 0x32, 0x15, 0x73, 0x2b, 0x09, 0xee, 0x09, 0x6c, 0xb3,
+    0x91, 0x43, 0x45, 0xb5, 0xc9, 0x2e, 0x1e, 0x7d, 0x0c, 0xeb, 0x6d, 0xc5,
+    0x8f, 0x57, 0x02, 0x66, 0x94, 0x4c, 0xa8, 0xef, 0x5b, 0x34, 0x81, 0xed,
+    0x8f, 0x68, 0x8c, 0x50, 0x79, 0x5d, 0x09, 0xe1, 0x8b, 0x36, 0x16, 0x8e,
+    0x83, 0xb7, 0xa8, 0x2d, 0x48, 0xbf, 0x6a, 0xbf, 0xba, 0x74, 0xeb, 0xf9,
+    0x0d, 0xb8, 0xdb, 0x9b, 0x06, 0x39, 0x80, 0x5e, 0xb2, 0xcb, 0xc7, 0xfe,
+    0xb7, 0x36, 0x75, 0x72, 0xc1, 0x76, 0x03, 0x7a, 0x52, 0x38, 0x63, 0xc2,
+    0x79, 0x99, 0x5f, 0x6e, 0x6d, 0xe9, 0x2e, 0xef, 0xfa, 0x4b, 0x13, 0x56,
+    0xb6, 0x30, 0xf7, 0xae, 0x4d, 0x04, 0xe7, 0x02, 0x44, 0xef, 0xab, 0x70,
+    0x47, 0x7c, 0x12, 0x03, 0xea, 0xb3, 0x95, 0x17, 0x3f, 0x63, 0x74, 0x3d,
+    0x71, 0x29, 0x44, 0x85, 0x35, 0x97, 0x35, 0xb0, 0x9b, 0x4f, 0xf2, 0xd2,
+    0x72, 0x60, 0x0c, 0x4a, 0x91, 0x54, 0x64, 0x36, 0xe3, 0x70, 0x90, 0xa0,
+    0x8d, 0xf4, 0x98, 0x00, 0x58, 0xc7, 0xc0, 0xff, 0x78, 0x88, 0xa7, 0x4b,
+    0x6e, 0x98, 0x50, 0x0a, 0xcc, 0x98, 0x98, 0x7f, 0x29, 0xd9, 0x56, 0x57,
+    0xbc, 0x13, 0x90, 0x77, 0xca, 0xd7, 0xd0, 0x5d, 0x4e, 0x97, 0x00, 0xbd,
+    0xa4, 0x0e, 0x7f, 0xa9, 0x9e, 0x05, 0x98, 0x09, 0x82, 0xcd, 0xe7, 0xbb,
+    0xe4, 0x95, 0x71, 0xfb, 0x1e, 0xde, 0xf9, 0xe8, 0x66, 0xde, 0x7c, 0x3e,
+    0xa6, 0x59, 0xe7, 0x80, 0x25, 0x10, 0xcc, 0xc9, 0xa1, 0x0a, 0x4d, 0x48,
+    0x4a, 0x79, 0xc1, 0x8d};
+#endif
+
+typedef struct {
+	const char *name;
+	int (*run)(int len); /* bytes processed, -1 on failure */
+	int len;
+} benchCase_t;
+
+static struct {
+	unsigned ms;
+	unsigned mhz; /* clock for cycles/byte without a TSC, 0 for none */
+} cfg = {500, 0};
+
+static uint8_t bin[BENCH_BUF_MAX];
+static uint8_t out[BENCH_BUF_MAX + SDO_AES_BLOCK_SIZE];
+static uint8_t scratch[BENCH_BUF_MAX + SDO_AES_BLOCK_SIZE];
+static uint8_t digest[SHA512_DIGEST_SIZE];
+static uint8_t key[SHA384_DIGEST_SIZE];
+static uint8_t iv[SDO_AES_IV_SIZE];
+static uint8_t b64[BENCH_BUF_MAX * 2];
+/* Inputs of the decrypting cases, made by the setup */
+static uint8_t aesCt[BENCH_DEC_BYTES + SDO_AES_BLOCK_SIZE];
+static uint32_t aesCtLen;
+#ifndef SECURE_ELEMENT
+static uint8_t tag[AES_GCM_TAG_LEN];
+static uint8_t gcmCt[BENCH_DEC_BYTES];
+static uint8_t gcmTag[AES_GCM_TAG_LEN];
+#endif
+static int b64Len;
+static SDOPublicKey_t *rsaPk;
+#ifdef BENCH_KEX
+static uint8_t kexPeer[BENCH_BUF_MAX];
+static uint32_t kexPeerLen;
+#endif
+#ifdef SECURE_ELEMENT
+static uint8_t rawSig[BUFF_SIZE_64_BYTES];
+#endif
+
+/* Time stamp counter, 0 where there is none */
+static uint64_t benchCycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+//----------------------------------------------------------------------
+// Hashes and HMAC
+//
+
+static int benchSha256(int len)
+{
+	if (_sdoCryptoHash(SDO_CRYPTO_HASH_TYPE_SHA_256, bin, len, digest,
+			   SHA256_DIGEST_SIZE))
+		return -1;
+	return len;
+}
+
+static int benchSha384(int len)
+{
+	if (_sdoCryptoHash(SDO_CRYPTO_HASH_TYPE_SHA_384, bin, len, digest,
+			   SHA384_DIGEST_SIZE))
+		return -1;
+	return len;
+}
+
+static int benchHmac256(int len)
+{
+	if (sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, bin, len, digest,
+			  SHA256_DIGEST_SIZE, key, HMACSHA256_KEY_SIZE))
+		return -1;
+	return len;
+}
+
+static int benchHmac384(int len)
+{
+	if (sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_384, bin, len, digest,
+			  SHA384_DIGEST_SIZE, key, SHA384_DIGEST_SIZE))
+		return -1;
+	return len;
+}
+
+//----------------------------------------------------------------------
+// AES
+//
+
+static int benchAesEncrypt(int len)
+{
+	uint32_t outLen = sizeof(out);
+
+	if (sdoCryptoAESEncrypt(bin, len, out, &outLen, SDO_AES_BLOCK_SIZE, iv,
+				key, SDO_AES_KEY_LENGTH))
+		return -1;
+	return len;
+}
+
+static int benchAesDecrypt(int len)
+{
+	uint32_t clearLen = sizeof(scratch);
+
+	if (sdoCryptoAESDecrypt(scratch, &clearLen, aesCt, aesCtLen,
+				SDO_AES_BLOCK_SIZE, iv, key,
+				SDO_AES_KEY_LENGTH) ||
+	    clearLen != (uint32_t)len)
+		return -1;
+	return len;
+}
+
+#ifndef SECURE_ELEMENT
+static int benchGcmEncrypt(int len)
+{
+	if (sdoCryptoAESGcmEncrypt(bin, len, out, len, iv, BENCH_AES_IV_GCM,
+				   key, PLATFORM_AES_KEY_DEFAULT_LEN, tag,
+				   AES_GCM_TAG_LEN))
+		return -1;
+	return len;
+}
+
+static int benchGcmDecrypt(int len)
+{
+	if (sdoCryptoAESGcmDecrypt(scratch, len, gcmCt, len, iv,
+				   BENCH_AES_IV_GCM, key,
+				   PLATFORM_AES_KEY_DEFAULT_LEN, gcmTag,
+				   AES_GCM_TAG_LEN))
+		return -1;
+	return len;
+}
+#endif
+
+//----------------------------------------------------------------------
+// Signatures
+//
+
+#if defined(ECDSA256_DA) || defined(ECDSA384_DA)
+/* With the device key, loaded by the backend as the DA signing does */
+static int benchEcdsaSign(int len)
+{
+	size_t sigLen = sizeof(scratch);
+
+	if (sdoECDSASign((const uint8_t *)benchSigMsg, len, scratch, &sigLen))
+		return -1;
+	return len;
+}
+#endif
+
+#ifdef BENCH_P256_VERIFY
+static int benchEcdsa256Verify(int len)
+{
+	if (sdoCryptoSigVerify(SDO_CRYPTO_PUB_KEY_ENCODING_X509,
+			       SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256,
+			       (const uint8_t *)benchSigMsg, len, benchP256Sig,
+			       sizeof(benchP256Sig), benchP256Pub,
+			       sizeof(benchP256Pub), NULL, 0))
+		return -1;
+	return len;
+}
+#endif
+
+#ifdef BENCH_P384_VERIFY
+static int benchEcdsa384Verify(int len)
+{
+	if (sdoCryptoSigVerify(SDO_CRYPTO_PUB_KEY_ENCODING_X509,
+			       SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384,
+			       (const uint8_t *)benchSigMsg, len, benchP384Sig,
+			       sizeof(benchP384Sig), benchP384Pub,
+			       sizeof(benchP384Pub), NULL, 0))
+		return -1;
+	return len;
+}
+#endif
+
+#ifdef PK_ENC_RSA
+static int benchRsaVerify(int len)
+{
+	if (sdoCryptoSigVerify(SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
+			       SDO_CRYPTO_PUB_KEY_ALGO_RSA,
+			       (const uint8_t *)benchSigMsg, len, benchRsaSig,
+			       sizeof(benchRsaSig), rsaPk->key1->bytes,
+			       rsaPk->key1->byteSz, rsaPk->key2->bytes,
+			       rsaPk->key2->byteSz))
+		return -1;
+	return len;
+}
+#endif
+
+/* OAEP, as the ASYMKEX secret is encrypted to the owner */
+static int benchRsaEncrypt(int len)
+{
+	if (sdoCryptoRSAEncrypt(SDO_CRYPTO_HASH_TYPE_SHA_256,
+				SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
+				SDO_CRYPTO_PUB_KEY_ALGO_RSA, bin, len, out,
+				BENCH_RSA_BYTES, rsaPk->key1->bytes,
+				rsaPk->key1->byteSz, rsaPk->key2->bytes,
+				rsaPk->key2->byteSz))
+		return -1;
+	return len;
+}
+
+//----------------------------------------------------------------------
+// Key exchange
+//
+
+#ifdef BENCH_KEX
+/*
+ * A whole exchange of the device: its random, then the secret from the
+ * owner's. The owner's is that of another device context, which has the
+ * format of the owner's for DH and ECDH and is a plain random for ASYMKEX.
+ * Its bytes are those of the device random.
+ */
+static int benchKexRun(uint8_t *devRand, uint32_t *devRandLen, bool secret)
+{
+	void *ctx = NULL;
+	uint32_t secretLen = sizeof(scratch);
+	int ret = -1;
+
+	if (sdoCryptoKEXInit(&ctx))
+		return -1;
+#ifdef KEX_ASYM_ENABLED
+	if (setEncryptKeyAsym(ctx, rsaPk))
+		goto end;
+#endif
+	if (sdoCryptoGetDeviceRandom(ctx, NULL, devRandLen) ||
+	    *devRandLen > BENCH_BUF_MAX ||
+	    sdoCryptoGetDeviceRandom(ctx, devRand, devRandLen))
+		goto end;
+	if (secret && (sdoCryptoSetPeerRandom(ctx, kexPeer, kexPeerLen) ||
+		       sdoCryptoGetSecret(ctx, scratch, &secretLen)))
+		goto end;
+	ret = (int)*devRandLen;
+end:
+	sdoCryptoKEXClose(&ctx);
+	return ret;
+}
+
+static int benchKex(int len)
+{
+	uint32_t devRandLen = 0;
+
+	(void)len;
+	return benchKexRun(out, &devRandLen, true);
+}
+#endif
+
+//----------------------------------------------------------------------
+// Base64 and DER
+//
+
+static int benchB64Encode(int len)
+{
+	int b = binToB64(len, bin, 0, sizeof(b64), b64, 0);
+
+	return b == b64Len ? len : -1;
+}
+
+static int benchB64Decode(int len)
+{
+	int b = b64ToBin(b64Len, b64, 0, sizeof(scratch), scratch, 0);
+
+	return b == len ? len : -1;
+}
+
+#ifdef SECURE_ELEMENT
+static int benchDerEncode(int len)
+{
+	size_t derLen = sizeof(scratch);
+
+	if (DEREncode(rawSig, len, scratch, &derLen))
+		return -1;
+	return len;
+}
+
+static int benchDerDecode(int len)
+{
+	uint8_t rawKey[BUFF_SIZE_64_BYTES];
+	uint8_t sig[BUFF_SIZE_64_BYTES];
+
+	if (DERDecode(rawKey, sig, benchP256Pub, sizeof(benchP256Pub),
+		      benchP256Sig, sizeof(benchP256Sig), sizeof(rawKey),
+		      sizeof(sig)))
+		return -1;
+	return len;
+}
+#endif
+
+#if defined(AES_MODE_CTR_ENABLED)
+#define BENCH_AES "aes-ctr"
+#else
+#define BENCH_AES "aes-cbc"
+#endif
+
+#if defined(KEX_DH_ENABLED)
+#define BENCH_KEX_NAME "kex-dh"
+#elif defined(KEX_ASYM_ENABLED)
+#define BENCH_KEX_NAME "kex-asym"
+#elif defined(KEX_ECDH384_ENABLED)
+#define BENCH_KEX_NAME "kex-ecdh384"
+#else
+#define BENCH_KEX_NAME "kex-ecdh"
+#endif
+
+#define BENCH_MSG (int)(sizeof(benchSigMsg) - 1)
+
+static const benchCase_t benchCases[] = {
+    {"sha256-64", benchSha256, 64},
+    {"sha256-1k", benchSha256, 1024},
+    {"sha256-16k", benchSha256, 16384},
+    {"sha384-64", benchSha384, 64},
+    {"sha384-1k", benchSha384, 1024},
+    {"sha384-16k", benchSha384, 16384},
+    {"hmac-sha256-64", benchHmac256, 64},
+    {"hmac-sha256-1k", benchHmac256, 1024},
+    {"hmac-sha256-16k", benchHmac256, 16384},
+    {"hmac-sha384-64", benchHmac384, 64},
+    {"hmac-sha384-1k", benchHmac384, 1024},
+    {"hmac-sha384-16k", benchHmac384, 16384},
+    {BENCH_AES "-enc-64", benchAesEncrypt, 64},
+    {BENCH_AES "-enc-1k", benchAesEncrypt, 1024},
+    {BENCH_AES "-enc-16k", benchAesEncrypt, 16384},
+    {BENCH_AES "-dec-1k", benchAesDecrypt, BENCH_DEC_BYTES},
+#ifndef SECURE_ELEMENT
+    {"aes-gcm-enc-64", benchGcmEncrypt, 64},
+    {"aes-gcm-enc-1k", benchGcmEncrypt, 1024},
+    {"aes-gcm-enc-16k", benchGcmEncrypt, 16384},
+    {"aes-gcm-dec-1k", benchGcmDecrypt, BENCH_DEC_BYTES},
+#endif
+#if defined(ECDSA256_DA)
+    {"ecdsa-p256-sign", benchEcdsaSign, BENCH_MSG},
+#elif defined(ECDSA384_DA)
+    {"ecdsa-p384-sign", benchEcdsaSign, BENCH_MSG},
+#endif
+#ifdef BENCH_P256_VERIFY
+    {"ecdsa-p256-verify", benchEcdsa256Verify, BENCH_MSG},
+#endif
+#ifdef BENCH_P384_VERIFY
+    {"ecdsa-p384-verify", benchEcdsa384Verify, BENCH_MSG},
+#endif
+#ifdef PK_ENC_RSA
+    {"rsa2048-verify", benchRsaVerify, BENCH_MSG},
+#endif
+    {"rsa2048-encrypt", benchRsaEncrypt, 32},
+#ifdef BENCH_KEX
+    {BENCH_KEX_NAME, benchKex, 0},
+#endif
+    {"b64-encode-1k", benchB64Encode, 1024},
+    {"b64-decode-1k", benchB64Decode, 1024},
+#ifdef SECURE_ELEMENT
+    {"der-encode-p256", benchDerEncode, BUFF_SIZE_64_BYTES},
+    {"der-decode-p256", benchDerDecode, sizeof(benchP256Sig)},
+#endif
+};
+
+#define BENCH_CASES (sizeof(benchCases) / sizeof(benchCases[0]))
+
+static bool benchSetup(void)
+{
+	uint8_t exp[] = {0x01, 0x00, 0x01};
+
+	if (sdoCryptoRequire(SDO_CRYPTO_ENGINE))
+		return false;
+
+	benchFill(bin, sizeof(bin));
+	benchFill(key, sizeof(key));
+	benchFill(iv, sizeof(iv));
+
+	rsaPk = sdoPublicKeyAlloc(SDO_CRYPTO_PUB_KEY_ALGO_RSA,
+				  SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
+				  sizeof(benchRsaMod), (uint8_t *)benchRsaMod);
+	if (!rsaPk || !rsaPk->key1)
+		return false;
+	rsaPk->key2 = sdoByteArrayAllocWithByteArray(exp, sizeof(exp));
+	if (!rsaPk->key2)
+		return false;
+
+	aesCtLen = sizeof(aesCt);
+	if (sdoCryptoAESEncrypt(bin, BENCH_DEC_BYTES, aesCt, &aesCtLen,
+				SDO_AES_BLOCK_SIZE, iv, key,
+				SDO_AES_KEY_LENGTH))
+		return false;
+#ifndef SECURE_ELEMENT
+	if (sdoCryptoAESGcmEncrypt(bin, BENCH_DEC_BYTES, gcmCt, BENCH_DEC_BYTES,
+				   iv, BENCH_AES_IV_GCM, key,
+				   PLATFORM_AES_KEY_DEFAULT_LEN, gcmTag,
+				   AES_GCM_TAG_LEN))
+		return false;
+#endif
+#ifdef BENCH_KEX
+	if (benchKexRun(kexPeer, &kexPeerLen, false) < 0)
+		return false;
+#endif
+#ifdef SECURE_ELEMENT
+	if (sdoDERSigToRaw(benchP256Sig, sizeof(benchP256Sig), rawSig,
+			   sizeof(rawSig)))
+		return false;
+#endif
+	b64Len = binToB64(1024, bin, 0, sizeof(b64), b64, 0);
+	return b64Len > 0;
+}
+
+static bool benchRun(const benchCase_t *c)
+{
+	uint64_t n = 1, ops = 0, start, ns, cyc0, cyc;
+	double cpb = 0;
+	int bytes;
+	uint64_t i;
+
+	/* Once, to warm up the caches and the keys of the backend */
+	bytes = c->run(c->len);
+	if (bytes < 0) {
+		printf("%-20s failed\n", c->name);
+		return false;
+	}
+
+	start = benchNowNs();
+	cyc0 = benchCycles();
+	do {
+		for (i = 0; i < n; i++) {
+			if (c->run(c->len) < 0) {
+				printf("%-20s failed\n", c->name);
+				return false;
+			}
+		}
+		ops += n;
+		ns = benchNowNs() - start;
+		if (n < (1u << 20))
+			n <<= 1;
+	} while (ns < (uint64_t)cfg.ms * 1000000);
+	cyc = benchCycles() - cyc0;
+
+	if (!cyc && cfg.mhz)
+		cyc = ns * cfg.mhz / 1000;
+	if (c->len)
+		cpb = (double)cyc / ops / bytes;
+
+	printf("%-20s %10llu %12.1f %8d %9.1f", c->name,
+	       (unsigned long long)ops, (double)ops * 1000000000 / ns, bytes,
+	       (double)bytes * ops * 1000 / ns);
+	if (cpb)
+		printf(" %10.2f\n", cpb);
+	else
+		printf(" %10s\n", "-");
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned c;
+	int opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "t:f:lh")) != -1) {
+		switch (opt) {
+		case 't':
+			cfg.ms = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			cfg.mhz = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'l':
+			for (c = 0; c < BENCH_CASES; c++)
+				printf("%s\n", benchCases[c].name);
+			return EXIT_SUCCESS;
+		default:
+			benchUsage(argv[0], cfg.ms,
+				   "  -f MHZ      CPU clock for cycles/byte, "
+				   "where there is no TSC\n",
+				   "");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!benchSetup()) {
+		printf("Setting up the keys and inputs failed\n");
+		return EXIT_FAILURE;
+	}
+
+#if defined(USE_OPENSSL)
+	printf("backend: openssl\n");
+#else
+	printf("backend: mbedtls\n");
+#endif
+	printf("%-20s %10s %12s %8s %9s %10s\n", "case", "ops", "ops/s",
+	       "bytes/op", "MB/s", "cycles/B");
+	for (c = 0; c < BENCH_CASES; c++) {
+		if (!benchSelected(benchCases[c].name, argc, argv))
+			continue;
+		if (!benchRun(&benchCases[c]))
+			ret = EXIT_FAILURE;
+	}
+
+	sdoPublicKeyFree(rsaPk);
+	sdoCryptoClose();
+	return ret;
+}
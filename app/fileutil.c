@@ -0,0 +1,48 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief File helpers of the fleet and replay tools.
+ */
+
+#include "fileutil.h"
+#include <stdio.h>
+#include <stddef.h>
+
+/**
+ * Copy a file, replacing the destination.
+ * @param from - path of the file.
+ * @param to - path of the copy.
+ * @return true on success.
+ */
+bool appCopyFile(const char *from, const char *to)
+{
+	char buf[4096];
+	size_t n;
+	bool ok = true;
+	FILE *in = fopen(from, "rb");
+	FILE *out;
+
+	if (!in)
+		return false;
+	out = fopen(to, "wb");
+	if (!out) {
+		fclose(in);
+		return false;
+	}
+	while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+		if (fwrite(buf, 1, n, out) != n) {
+			ok = false;
+			break;
+		}
+	}
+	if (ferror(in))
+		ok = false;
+	fclose(in);
+	if (fclose(out) == EOF)
+		ok = false;
+	return ok;
+}
@@ -0,0 +1,965 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Fleet load generator. Simulates many devices onboarding at the same
+ * time against the manufacturer, rendezvous and owner servers, one SDK
+ * instance per device run, on a pool of worker threads. Devices arrive at a
+ * configured rate and the latency and throughput of the protocol messages
+ * and of the device runs are reported.
+ *
+ * Each device has a directory of its own under the work directory, set up
+ * from the template data directory: the credentials and platform keys start
+ * out pristine (as after make clean) and, with .dat ECDSA keys, a fresh
+ * device key is generated, so that DI gives every device its own identity.
+ *
+ * With -p, DI runs as on a manufacturing line: each device goes through a
+ * prepare stage (its files, SDK instance, CSR and OV HMAC key), an exchange
+ * stage (DI with the manufacturer) and a commit stage (its credentials made
+ * durable), each on threads of its own, so that the keys of the next
+ * devices are generated and the credentials of the previous ones written
+ * while a device talks to the manufacturer.
+ */
+
+#include "sdo.h"
+#include "sdomodules.h"
+#include "util.h"
+#include "storage_al.h"
+#include "blob.h"
+#include "fileutil.h"
+#include "safe_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define FLEET_PATH_MAX 1024
+#define FLEET_MAX_THREADS 1024
+#define FLEET_ERROR_RETRY_COUNT 3
+#define FLEET_HIST_BUCKETS 32 /* log2 of ms */
+#define FLEET_MSG_TYPES 256
+#define FLEET_MSG_ERROR 255 /* response of a server which failed */
+
+#if defined(ECDSA_PEM)
+/* PEM device keys are copied from the template, as is */
+#elif defined(ECDSA256_DA)
+#define FLEET_DEVKEY_LEN 32
+#elif defined(ECDSA384_DA)
+#define FLEET_DEVKEY_LEN 48
+#endif
+
+/* Device attestation with one key per process */
+#if defined(EPID_DA) || defined(DEVICE_TPM20_ENABLED)
+#define FLEET_SINGLE_INSTANCE
+#endif
+
+enum fleetMode { FLEET_DI, FLEET_TO, FLEET_ALL };
+
+enum fleetPhase {
+	FLEET_PHASE_PROVISION,
+	FLEET_PHASE_QUEUE,
+	FLEET_PHASE_PREPARE,
+	FLEET_PHASE_HANDOFF,
+	FLEET_PHASE_DI,
+	FLEET_PHASE_TO,
+	FLEET_PHASE_COMMIT,
+	FLEET_PHASE_DEVICE,
+	FLEET_PHASES
+};
+
+static const char *const phaseNames[FLEET_PHASES] = {
+    "provision", "queue",   "prepare", "handoff",
+    "DI",	 "TO1+TO2", "commit",  "device"};
+
+/* Latencies of one kind of operation */
+typedef struct {
+	uint64_t count;
+	uint64_t fail;
+	uint64_t sumMs;
+	uint32_t minMs;
+	uint32_t maxMs;
+	uint64_t txBytes;
+	uint64_t rxBytes;
+	uint64_t hist[FLEET_HIST_BUCKETS];
+} fleetStat_t;
+
+static struct {
+	const char *templateDir;
+	const char *workDir;
+	enum fleetMode mode;
+	unsigned devices;
+	unsigned threads;
+	double rate;
+	unsigned interval;
+	bool pipeline;
+	unsigned stageThreads; /* of the prepare and commit stages */
+} cfg = {"data", "fleet", FLEET_ALL, 100, 8, 0, 5, false, 2};
+
+/* Devices that have arrived, and not yet taken by a worker */
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	unsigned *id;
+	uint64_t *arrival;
+	unsigned head;
+	unsigned tail;
+	bool closed;
+} queue = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER};
+
+/* A device on its way through the stages of the DI pipeline */
+typedef struct {
+	unsigned id;
+	uint64_t start;	 /* taken off the arrival queue */
+	uint64_t queued; /* handed to the next stage */
+	sdoSdkCtx_t *ctx;
+	bool ok;
+} fleetItem_t;
+
+/* Bounded queue between two stages of the DI pipeline */
+typedef struct {
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+	fleetItem_t *items;
+	unsigned cap;
+	unsigned head;
+	unsigned count;
+	unsigned producers; /* threads still handing devices in */
+} fleetPipe_t;
+
+/* prepare -> exchange, exchange -> commit */
+static fleetPipe_t pipes[2];
+
+static struct {
+	pthread_mutex_t lock;
+	fleetStat_t msg[FLEET_MSG_TYPES];
+	fleetStat_t phase[FLEET_PHASES];
+	unsigned done;
+	unsigned failed;
+} stats = {PTHREAD_MUTEX_INITIALIZER};
+
+static __thread unsigned errorCount;
+
+static uint64_t fleetNowMs(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void fleetStatAdd(fleetStat_t *s, uint32_t ms, bool ok)
+{
+	unsigned b = 0;
+
+	while (b < FLEET_HIST_BUCKETS - 1 && (1u << b) <= ms)
+		b++;
+	if (!s->count || ms < s->minMs)
+		s->minMs = ms;
+	if (ms > s->maxMs)
+		s->maxMs = ms;
+	s->count++;
+	s->sumMs += ms;
+	s->hist[b]++;
+	if (!ok)
+		s->fail++;
+}
+
+/* Upper bound of the histogram bucket holding the pct percentile */
+static uint32_t fleetStatPct(const fleetStat_t *s, unsigned pct)
+{
+	uint64_t want = (s->count * pct + 99) / 100;
+	uint64_t seen = 0;
+	unsigned b;
+
+	for (b = 0; b < FLEET_HIST_BUCKETS; b++) {
+		seen += s->hist[b];
+		if (seen >= want && seen)
+			break;
+	}
+	if (b >= FLEET_HIST_BUCKETS)
+		return s->maxMs;
+	return b ? (1u << b) - 1 : 0;
+}
+
+static void fleetPhaseDone(enum fleetPhase p, uint64_t start, bool ok)
+{
+	uint32_t ms = (uint32_t)(fleetNowMs() - start);
+
+	pthread_mutex_lock(&stats.lock);
+	fleetStatAdd(&stats.phase[p], ms, ok);
+	pthread_mutex_unlock(&stats.lock);
+}
+
+static void fleetMsgCB(int msgType, int respType, uint32_t elapsedMs,
+		       uint32_t txBytes, uint32_t rxBytes)
+{
+	fleetStat_t *s;
+
+	if (msgType < 0 || msgType >= FLEET_MSG_TYPES)
+		return;
+
+	pthread_mutex_lock(&stats.lock);
+	s = &stats.msg[msgType];
+	fleetStatAdd(s, elapsedMs, respType != FLEET_MSG_ERROR);
+	s->txBytes += txBytes;
+	s->rxBytes += rxBytes;
+	pthread_mutex_unlock(&stats.lock);
+}
+
+static int fleetErrorCB(sdoSdkStatus type, sdoSdkError errorcode)
+{
+	(void)type;
+	(void)errorcode;
+
+	/* Give up on the device quickly, the fleet goes on */
+	if (++errorCount > FLEET_ERROR_RETRY_COUNT)
+		return SDO_ABORT;
+	return SDO_SUCCESS;
+}
+
+static const char *fleetBaseName(const char *path)
+{
+	const char *s = strrchr(path, '/');
+
+	return s ? s + 1 : path;
+}
+
+static bool fleetDevDir(unsigned id, char *dir, size_t len)
+{
+	int n = snprintf(dir, len, "%s/dev-%06u", cfg.workDir, id);
+
+	return n > 0 && (size_t)n < len;
+}
+
+static bool fleetWriteFile(const char *dir, const char *name,
+			   const void *data, size_t len)
+{
+	char path[FLEET_PATH_MAX];
+	FILE *fp;
+	bool ok;
+	int n = snprintf(path, sizeof(path), "%s/%s", dir, fleetBaseName(name));
+
+	if (n <= 0 || (size_t)n >= sizeof(path))
+		return false;
+	fp = fopen(path, "wb");
+	if (!fp)
+		return false;
+	ok = !len || fwrite(data, 1, len, fp) == len;
+	if (fclose(fp) == EOF)
+		ok = false;
+	return ok;
+}
+
+/* State files of a device, which are not copied from the template */
+static bool fleetIsStateFile(const char *name)
+{
+	static const char *const state[] = {
+	    PLATFORM_IV,     PLATFORM_HMAC_KEY, PLATFORM_AES_KEY,
+	    SDO_CRED_MFG,    SDO_CRED_NORMAL,   SDO_CRED_SECURE,
+	    RAW_BLOB,
+#ifdef SDO_BLOB_JOURNAL
+	    SDO_BLOB_JOURNAL,
+#endif
+#ifdef TLS_SESSION_BLOB
+	    TLS_SESSION_BLOB,
+#endif
+#ifdef EPID_PRECOMP_BLOB
+	    EPID_PRECOMP_BLOB,
+#endif
+#ifdef EPID_SIGRL_BLOB
+	    EPID_SIGRL_BLOB,
+#endif
+#ifdef DEVICE_CSR_BLOB
+	    DEVICE_CSR_BLOB,
+#endif
+#ifdef RV_REDIRECT_BLOB
+	    RV_REDIRECT_BLOB,
+#endif
+#ifdef OSI_APPLIED_BLOB
+	    OSI_APPLIED_BLOB,
+#endif
+#ifdef OV_PREFIX_BLOB
+	    OV_PREFIX_BLOB,
+#endif
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(state) / sizeof(state[0]); i++) {
+		if (!strcmp(name, fleetBaseName(state[i])))
+			return true;
+	}
+	return false;
+}
+
+/* Copy the template into dir, leaving out the device state */
+static bool fleetCopyTemplate(const char *dir)
+{
+	char from[FLEET_PATH_MAX];
+	char to[FLEET_PATH_MAX];
+	struct dirent *e;
+	struct stat st;
+	bool ok = true;
+	DIR *d = opendir(cfg.templateDir);
+
+	if (!d)
+		return false;
+	while (ok && (e = readdir(d)) != NULL) {
+		if (fleetIsStateFile(e->d_name))
+			continue;
+		if (snprintf(from, sizeof(from), "%s/%s", cfg.templateDir,
+			     e->d_name) >= (int)sizeof(from) ||
+		    snprintf(to, sizeof(to), "%s/%s", dir, e->d_name) >=
+			(int)sizeof(to))
+			ok = false;
+		else if (!stat(from, &st) && S_ISREG(st.st_mode))
+			ok = appCopyFile(from, to);
+	}
+	closedir(d);
+	return ok;
+}
+
+#ifdef FLEET_DEVKEY_LEN
+/* A fresh device key, in [1, 2^(8 * len - 1)), below the curve order */
+static bool fleetNewDevKey(uint8_t *key, size_t len)
+{
+	FILE *fp = fopen("/dev/urandom", "rb");
+	bool ok;
+
+	if (!fp)
+		return false;
+	do {
+		ok = fread(key, 1, len, fp) == len;
+		key[0] &= 0x7f;
+	} while (ok && !key[0]);
+	fclose(fp);
+	return ok;
+}
+#endif
+
+/* Set up the directory of a device, ready for DI */
+static bool fleetProvision(unsigned id)
+{
+	static const char pristineNormal[] = "{\"ST\":1}\n";
+	char dir[FLEET_PATH_MAX];
+	sdoStorageCtx_t *storage;
+	bool ok;
+
+	if (!fleetDevDir(id, dir, sizeof(dir)))
+		return false;
+	if (mkdir(dir, 0700) && errno != EEXIST) {
+		LOG(LOG_ERROR, "Failed to create %s\n", dir);
+		return false;
+	}
+
+	ok = fleetCopyTemplate(dir) &&
+	     fleetWriteFile(dir, PLATFORM_IV, NULL, 0) &&
+	     fleetWriteFile(dir, PLATFORM_HMAC_KEY, NULL, 0) &&
+	     fleetWriteFile(dir, PLATFORM_AES_KEY, NULL, 0) &&
+	     fleetWriteFile(dir, SDO_CRED_MFG, NULL, 0) &&
+	     fleetWriteFile(dir, SDO_CRED_SECURE, NULL, 0) &&
+	     fleetWriteFile(dir, RAW_BLOB, NULL, 0) &&
+	     fleetWriteFile(dir, SDO_CRED_NORMAL, pristineNormal,
+			    sizeof(pristineNormal) - 1);
+	if (!ok) {
+		LOG(LOG_ERROR, "Failed to set up the files of %s\n", dir);
+		return false;
+	}
+
+	storage = sdoStorageCtxAlloc(dir);
+	if (!storage)
+		return false;
+	sdoStorageCtxBind(storage);
+	ok = configureNormalBlob() == 0;
+#ifdef FLEET_DEVKEY_LEN
+	if (ok) {
+		uint8_t key[FLEET_DEVKEY_LEN];
+
+		ok = fleetNewDevKey(key, sizeof(key)) &&
+		     sdoBlobWrite(ECDSA_PRIVKEY, SDO_SDK_RAW_DATA, key,
+				  sizeof(key)) == (int32_t)sizeof(key);
+		if (memset_s(key, sizeof(key), 0) != 0)
+			ok = false;
+	}
+#endif
+	sdoStorageCtxBind(NULL);
+	sdoStorageCtxFree(storage);
+	if (!ok)
+		LOG(LOG_ERROR, "Failed to configure the blobs of %s\n", dir);
+	return ok;
+}
+
+/* Set up the SDK instance of a device, which prepares DI ahead */
+static sdoSdkCtx_t *fleetCreate(unsigned id)
+{
+	sdoSdkServiceInfoModule *moduleInfo = NULL;
+	char dir[FLEET_PATH_MAX];
+	sdoSdkCtx_t *ctx;
+	uint64_t start = fleetNowMs();
+
+	if (!fleetDevDir(id, dir, sizeof(dir)))
+		return NULL;
+
+#ifdef MODULES_ENABLED
+	sdoSdkServiceInfoModule module[1];
+
+	if (strncpy_s(module[0].moduleName, SDO_MODULE_NAME_LEN, "sdo_sys",
+		      SDO_MODULE_NAME_LEN) != 0)
+		return NULL;
+	module[0].serviceInfoCallback = sdo_sys;
+	moduleInfo = module;
+#endif
+
+	ctx = sdoSdkCreate(fleetErrorCB, moduleInfo ? 1 : 0, moduleInfo, dir);
+	fleetPhaseDone(FLEET_PHASE_PREPARE, start, ctx != NULL);
+	if (!ctx)
+		LOG(LOG_ERROR, "Device %u: SDK instance not set up\n", id);
+	return ctx;
+}
+
+/* One protocol run of a device, on its SDK instance */
+static bool fleetRun(unsigned id, sdoSdkCtx_t *ctx, enum fleetPhase phase)
+{
+	uint64_t start = fleetNowMs();
+	bool ok;
+
+	errorCount = 0;
+	ok = sdoSdkCtxRun(ctx) == SDO_SUCCESS;
+	fleetPhaseDone(phase, start, ok);
+	if (!ok)
+		LOG(LOG_ERROR, "Device %u: %s failed\n", id,
+		    phaseNames[phase]);
+	return ok;
+}
+
+/* Wait for the credentials of a device to be durable, release its instance */
+static bool fleetCommit(unsigned id, sdoSdkCtx_t *ctx)
+{
+	uint64_t start = fleetNowMs();
+	bool ok;
+
+	if (!ctx)
+		return false;
+	ok = sdoSdkCtxCredSync(ctx) == SDO_SUCCESS;
+	sdoSdkDestroy(ctx);
+	fleetPhaseDone(FLEET_PHASE_COMMIT, start, ok);
+	if (!ok)
+		LOG(LOG_ERROR, "Device %u: credentials not stored\n", id);
+	return ok;
+}
+
+static void fleetDeviceDone(uint64_t start, bool ok)
+{
+	pthread_mutex_lock(&stats.lock);
+	fleetStatAdd(&stats.phase[FLEET_PHASE_DEVICE],
+		     (uint32_t)(fleetNowMs() - start), ok);
+	stats.done++;
+	if (!ok)
+		stats.failed++;
+	pthread_mutex_unlock(&stats.lock);
+}
+
+static void fleetDevice(unsigned id, uint64_t arrival)
+{
+	uint64_t start = fleetNowMs();
+	bool ok = true;
+
+	fleetPhaseDone(FLEET_PHASE_QUEUE, arrival, true);
+
+	if (cfg.mode != FLEET_TO) {
+		uint64_t t = fleetNowMs();
+		sdoSdkCtx_t *ctx = NULL;
+
+		ok = fleetProvision(id);
+		fleetPhaseDone(FLEET_PHASE_PROVISION, t, ok);
+		if (ok)
+			ctx = fleetCreate(id);
+		ok = ctx && fleetRun(id, ctx, FLEET_PHASE_DI);
+		if (ctx && !fleetCommit(id, ctx))
+			ok = false;
+	}
+	if (ok && cfg.mode != FLEET_DI) {
+		sdoSdkCtx_t *ctx = fleetCreate(id);
+
+		ok = ctx && fleetRun(id, ctx, FLEET_PHASE_TO);
+		if (ctx && !fleetCommit(id, ctx))
+			ok = false;
+	}
+
+	fleetDeviceDone(start, ok);
+}
+
+/* Take the next device off the arrival queue, false once all are taken */
+static bool fleetTake(unsigned *id, uint64_t *arrival)
+{
+	pthread_mutex_lock(&queue.lock);
+	while (queue.head == queue.tail && !queue.closed)
+		pthread_cond_wait(&queue.cond, &queue.lock);
+	if (queue.head == queue.tail) {
+		pthread_mutex_unlock(&queue.lock);
+		return false;
+	}
+	*id = queue.id[queue.head];
+	*arrival = queue.arrival[queue.head];
+	queue.head++;
+	pthread_mutex_unlock(&queue.lock);
+	return true;
+}
+
+static void *fleetWorker(void *arg)
+{
+	unsigned id;
+	uint64_t arrival;
+
+	(void)arg;
+	while (fleetTake(&id, &arrival))
+		fleetDevice(id, arrival);
+	return NULL;
+}
+
+static bool fleetPipeInit(fleetPipe_t *p, unsigned cap, unsigned producers)
+{
+	p->items = calloc(cap, sizeof(*p->items));
+	if (!p->items || pthread_mutex_init(&p->lock, NULL) ||
+	    pthread_cond_init(&p->notEmpty, NULL) ||
+	    pthread_cond_init(&p->notFull, NULL))
+		return false;
+	p->cap = cap;
+	p->producers = producers;
+	return true;
+}
+
+/* Hand a device to the next stage, waiting while that one is behind */
+static void fleetPipePut(fleetPipe_t *p, fleetItem_t *item)
+{
+	pthread_mutex_lock(&p->lock);
+	while (p->count == p->cap)
+		pthread_cond_wait(&p->notFull, &p->lock);
+	item->queued = fleetNowMs();
+	p->items[(p->head + p->count) % p->cap] = *item;
+	p->count++;
+	pthread_cond_signal(&p->notEmpty);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Take the next device, false once all producers are done and it is empty */
+static bool fleetPipeGet(fleetPipe_t *p, fleetItem_t *item)
+{
+	pthread_mutex_lock(&p->lock);
+	while (!p->count && p->producers)
+		pthread_cond_wait(&p->notEmpty, &p->lock);
+	if (!p->count) {
+		pthread_mutex_unlock(&p->lock);
+		return false;
+	}
+	*item = p->items[p->head];
+	p->head = (p->head + 1) % p->cap;
+	p->count--;
+	pthread_cond_signal(&p->notFull);
+	pthread_mutex_unlock(&p->lock);
+
+	fleetPhaseDone(FLEET_PHASE_HANDOFF, item->queued, true);
+	return true;
+}
+
+/* A producer of p is done */
+static void fleetPipeClose(fleetPipe_t *p)
+{
+	pthread_mutex_lock(&p->lock);
+	p->producers--;
+	pthread_cond_broadcast(&p->notEmpty);
+	pthread_mutex_unlock(&p->lock);
+}
+
+/* Pipeline stage: the files and the SDK instance of the next devices */
+static void *fleetPrepareWorker(void *arg)
+{
+	fleetItem_t item;
+	uint64_t arrival;
+
+	(void)arg;
+	while (fleetTake(&item.id, &arrival)) {
+		fleetPhaseDone(FLEET_PHASE_QUEUE, arrival, true);
+		item.start = fleetNowMs();
+		item.ctx = NULL;
+		item.ok = fleetProvision(item.id);
+		fleetPhaseDone(FLEET_PHASE_PROVISION, item.start, item.ok);
+		if (item.ok)
+			item.ctx = fleetCreate(item.id);
+		item.ok = item.ctx != NULL;
+		fleetPipePut(&pipes[0], &item);
+	}
+	fleetPipeClose(&pipes[0]);
+	return NULL;
+}
+
+/* Pipeline stage: DI with the manufacturer */
+static void *fleetExchangeWorker(void *arg)
+{
+	fleetItem_t item;
+
+	(void)arg;
+	while (fleetPipeGet(&pipes[0], &item)) {
+		if (item.ok)
+			item.ok = fleetRun(item.id, item.ctx, FLEET_PHASE_DI);
+		fleetPipePut(&pipes[1], &item);
+	}
+	fleetPipeClose(&pipes[1]);
+	return NULL;
+}
+
+/* Pipeline stage: the credentials of the devices done with DI */
+static void *fleetCommitWorker(void *arg)
+{
+	fleetItem_t item;
+
+	(void)arg;
+	while (fleetPipeGet(&pipes[1], &item)) {
+		if (item.ctx && !fleetCommit(item.id, item.ctx))
+			item.ok = false;
+		fleetDeviceDone(item.start, item.ok);
+	}
+	return NULL;
+}
+
+/* Background credential writes are waited for by fleetCommit */
+static void fleetCredWriteCB(sdoSdkStatus status)
+{
+	(void)status;
+}
+
+static void fleetArrive(unsigned id)
+{
+	pthread_mutex_lock(&queue.lock);
+	queue.id[queue.tail] = id;
+	queue.arrival[queue.tail] = fleetNowMs();
+	queue.tail++;
+	pthread_cond_signal(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+}
+
+static void fleetSleepMs(uint64_t ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = (time_t)(ms / 1000);
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) && errno == EINTR)
+		;
+}
+
+static void fleetProgress(uint64_t start)
+{
+	double sec = (double)(fleetNowMs() - start) / 1000;
+	unsigned done, failed, arrived, waiting;
+
+	pthread_mutex_lock(&stats.lock);
+	done = stats.done;
+	failed = stats.failed;
+	pthread_mutex_unlock(&stats.lock);
+	pthread_mutex_lock(&queue.lock);
+	arrived = queue.tail;
+	waiting = queue.tail - queue.head;
+	pthread_mutex_unlock(&queue.lock);
+
+	printf("[%8.1fs] arrived %u, waiting %u, done %u, failed %u, "
+	       "%.2f devices/s\n",
+	       sec, arrived, waiting, done, failed,
+	       sec > 0 ? done / sec : 0);
+}
+
+/* Release the devices at the configured rate, report on the way */
+static void fleetGenerate(uint64_t start)
+{
+	uint64_t next = start;
+	uint64_t report = start + (uint64_t)cfg.interval * 1000;
+	unsigned id;
+
+	srand((unsigned)time(NULL));
+	for (id = 0; id < cfg.devices; id++) {
+		uint64_t now = fleetNowMs();
+
+		while (now < next) {
+			uint64_t wake = next;
+
+			if (cfg.interval && report < wake)
+				wake = report;
+			fleetSleepMs(wake - now);
+			now = fleetNowMs();
+			if (cfg.interval && now >= report) {
+				fleetProgress(start);
+				report += (uint64_t)cfg.interval * 1000;
+			}
+		}
+		fleetArrive(id);
+
+		/* Poisson arrivals: exponential inter-arrival times */
+		if (cfg.rate > 0) {
+			double u = (rand() + 1.0) / ((double)RAND_MAX + 2.0);
+
+			next += (uint64_t)(-log(u) * 1000 / cfg.rate);
+		}
+	}
+
+	pthread_mutex_lock(&queue.lock);
+	queue.closed = true;
+	pthread_cond_broadcast(&queue.cond);
+	pthread_mutex_unlock(&queue.lock);
+
+	/* Keep reporting until the last device is done */
+	while (cfg.interval) {
+		unsigned done;
+
+		pthread_mutex_lock(&stats.lock);
+		done = stats.done;
+		pthread_mutex_unlock(&stats.lock);
+		if (done >= cfg.devices)
+			break;
+		fleetSleepMs(report > fleetNowMs() ? report - fleetNowMs()
+						   : 0);
+		if (fleetNowMs() >= report) {
+			fleetProgress(start);
+			report += (uint64_t)cfg.interval * 1000;
+		}
+	}
+}
+
+static void fleetPrintStat(const char *name, const fleetStat_t *s,
+			   double sec)
+{
+	printf("%-10s %8llu %6llu %8.1f %6u %6u %6u %6u %6u %8.2f\n", name,
+	       (unsigned long long)s->count, (unsigned long long)s->fail,
+	       (double)s->sumMs / s->count, s->minMs, fleetStatPct(s, 50),
+	       fleetStatPct(s, 90), fleetStatPct(s, 99), s->maxMs,
+	       sec > 0 ? s->count / sec : 0);
+}
+
+static void fleetReport(uint64_t start)
+{
+	double sec = (double)(fleetNowMs() - start) / 1000;
+	const char *hdr = "%-10s %8s %6s %8s %6s %6s %6s %6s %6s %8s\n";
+	char name[16];
+	int t;
+
+	printf("\n%u devices, %u failed, in %.1fs: %.2f devices/s\n",
+	       stats.done, stats.failed, sec,
+	       sec > 0 ? (stats.done - stats.failed) / sec : 0);
+	if (cfg.mode == FLEET_DI)
+		printf("DI%s: %.1f units/min\n",
+		       cfg.pipeline ? " pipelined" : "",
+		       sec > 0 ? (stats.done - stats.failed) * 60 / sec : 0);
+
+	printf("\nPer protocol message (ms, from sending to the response; "
+	       "percentiles are histogram bucket bounds)\n");
+	printf(hdr, "msg", "count", "fail", "mean", "min", "p50", "p90",
+	       "p99", "max", "msg/s");
+	for (t = 0; t < FLEET_MSG_TYPES; t++) {
+		if (!stats.msg[t].count)
+			continue;
+		snprintf(name, sizeof(name), "%d", t);
+		fleetPrintStat(name, &stats.msg[t], sec);
+	}
+
+	printf("\nPer device phase (ms)\n");
+	printf(hdr, "phase", "count", "fail", "mean", "min", "p50", "p90",
+	       "p99", "max", "/s");
+	for (t = 0; t < FLEET_PHASES; t++) {
+		if (stats.phase[t].count)
+			fleetPrintStat(phaseNames[t], &stats.phase[t], sec);
+	}
+
+	printf("\nBytes per message type (sent / received)\n");
+	for (t = 0; t < FLEET_MSG_TYPES; t++) {
+		if (!stats.msg[t].count)
+			continue;
+		printf("%-10d %12llu %12llu\n", t,
+		       (unsigned long long)stats.msg[t].txBytes,
+		       (unsigned long long)stats.msg[t].rxBytes);
+	}
+}
+
+static void fleetUsage(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+	       "  -n DEVICES  devices to simulate (default %u)\n"
+	       "  -t THREADS  worker threads, devices in flight (default %u)\n"
+	       "  -r RATE     device arrivals per second, Poisson; 0 for all "
+	       "at once (default)\n"
+	       "  -m MODE     di, to (devices of an earlier di run) or all "
+	       "(default)\n"
+	       "  -d DIR      template data directory (default %s)\n"
+	       "  -w DIR      work directory of the devices (default %s)\n"
+	       "  -i SEC      progress report interval, 0 for none "
+	       "(default %u)\n"
+	       "  -p          DI on a pipeline of prepare, exchange (-t "
+	       "threads) and commit stages\n"
+	       "  -s THREADS  threads of the prepare and of the commit stage "
+	       "with -p (default %u)\n",
+	       prog, cfg.devices, cfg.threads, cfg.templateDir, cfg.workDir,
+	       cfg.interval, cfg.stageThreads);
+}
+
+static bool fleetOptions(int argc, char **argv)
+{
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:t:r:m:d:w:i:ps:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			cfg.devices = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			cfg.threads = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'r':
+			cfg.rate = strtod(optarg, NULL);
+			break;
+		case 'm':
+			if (!strcmp(optarg, "di"))
+				cfg.mode = FLEET_DI;
+			else if (!strcmp(optarg, "to"))
+				cfg.mode = FLEET_TO;
+			else if (!strcmp(optarg, "all"))
+				cfg.mode = FLEET_ALL;
+			else
+				return false;
+			break;
+		case 'd':
+			cfg.templateDir = optarg;
+			break;
+		case 'w':
+			cfg.workDir = optarg;
+			break;
+		case 'i':
+			cfg.interval = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			cfg.pipeline = true;
+			break;
+		case 's':
+			cfg.stageThreads = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		default:
+			return false;
+		}
+	}
+
+	if (!cfg.devices || !cfg.threads || cfg.threads > FLEET_MAX_THREADS ||
+	    cfg.rate < 0)
+		return false;
+	if (cfg.pipeline) {
+		if (cfg.mode == FLEET_TO) {
+			printf("-p pipelines DI, not TO1 and TO2\n");
+			return false;
+		}
+		cfg.mode = FLEET_DI;
+		if (!cfg.stageThreads ||
+		    cfg.threads + 2 * cfg.stageThreads > FLEET_MAX_THREADS)
+			return false;
+	}
+#ifdef FLEET_SINGLE_INSTANCE
+	if (cfg.pipeline) {
+		printf("This device attestation allows no pipeline\n");
+		return false;
+	}
+	if (cfg.threads > 1) {
+		printf("This device attestation allows one worker thread\n");
+		cfg.threads = 1;
+	}
+#endif
+	return true;
+}
+
+/* Start up to n threads running worker, false if none could be */
+static bool fleetStart(pthread_t *threads, unsigned n, unsigned *started,
+		       void *(*worker)(void *))
+{
+	unsigned first = *started;
+
+	while (*started - first < n &&
+	       !pthread_create(&threads[*started], NULL, worker, NULL))
+		(*started)++;
+	return *started > first;
+}
+
+/* The stages of the DI pipeline, all of their threads or nothing */
+static bool fleetStartPipeline(pthread_t *threads, unsigned *started)
+{
+	unsigned want = cfg.threads + 2 * cfg.stageThreads;
+
+	/* Each stage runs at most as many devices ahead as DI has in flight */
+	if (!fleetPipeInit(&pipes[0], cfg.threads, cfg.stageThreads) ||
+	    !fleetPipeInit(&pipes[1], cfg.threads, cfg.threads))
+		return false;
+	fleetStart(threads, cfg.stageThreads, started, fleetPrepareWorker);
+	fleetStart(threads, cfg.threads, started, fleetExchangeWorker);
+	fleetStart(threads, cfg.stageThreads, started, fleetCommitWorker);
+	return *started == want;
+}
+
+int main(int argc, char **argv)
+{
+	pthread_t *workers;
+	uint64_t start;
+	unsigned i, started = 0;
+	unsigned nthreads;
+
+	if (!fleetOptions(argc, argv)) {
+		fleetUsage(argv[0]);
+		return -1;
+	}
+	if (mkdir(cfg.workDir, 0700) && errno != EEXIST) {
+		printf("Failed to create %s\n", cfg.workDir);
+		return -1;
+	}
+
+	queue.id = calloc(cfg.devices, sizeof(*queue.id));
+	queue.arrival = calloc(cfg.devices, sizeof(*queue.arrival));
+	nthreads = cfg.threads + (cfg.pipeline ? 2 * cfg.stageThreads : 0);
+	workers = calloc(nthreads, sizeof(*workers));
+	if (!queue.id || !queue.arrival || !workers) {
+		printf("Out of memory\n");
+		return -1;
+	}
+
+	sdoSdkSetMsgCallback(fleetMsgCB);
+	/* The commit stage writes the credentials while DI goes on */
+	if (cfg.pipeline)
+		sdoSdkSetCredWriteCallback(fleetCredWriteCB);
+	setbuf(stdout, NULL);
+
+	start = fleetNowMs();
+	if (cfg.pipeline ? !fleetStartPipeline(workers, &started)
+			 : !fleetStart(workers, cfg.threads, &started,
+				       fleetWorker)) {
+		printf("Failed to start the worker threads\n");
+		return -1;
+	}
+	printf("%u devices, %u workers%s, %.2f arrivals/s, templates %s, "
+	       "work directory %s\n",
+	       cfg.devices, started, cfg.pipeline ? " on a DI pipeline" : "",
+	       cfg.rate, cfg.templateDir, cfg.workDir);
+
+	fleetGenerate(start);
+	for (i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+
+	sdoSdkSetMsgCallback(NULL);
+	sdoSdkSetCredWriteCallback(NULL);
+	fleetReport(start);
+
+	free(workers);
+	free(queue.id);
+	free(queue.arrival);
+	return stats.failed ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Scaffolding shared by the benchmarks of the reference application
+ * (bench, cryptobench and storagebench).
+ *
+ */
+
+#ifndef __BENCHUTIL_H__
+#define __BENCHUTIL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+uint64_t benchNowNs(void);
+void benchFill(uint8_t *buf, int len);
+void benchUsage(const char *prog, unsigned ms, const char *options,
+		const char *notes);
+bool benchSelected(const char *name, int argc, char **argv);
+
+#endif // #ifndef __BENCHUTIL_H__
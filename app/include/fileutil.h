@@ -0,0 +1,19 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * File helpers shared by the tools of the reference application (fleet
+ * and replay).
+ *
+ */
+
+#ifndef __FILEUTIL_H__
+#define __FILEUTIL_H__
+
+#include <stdbool.h>
+
+bool appCopyFile(const char *from, const char *to);
+
+#endif // #ifndef __FILEUTIL_H__
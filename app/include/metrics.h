@@ -0,0 +1,29 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Metrics exporter of the reference application.
+ *
+ */
+
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+/*
+ * Sinks of the exporter, set in the environment of the application, as a
+ * fleet of devices runs the same binary:
+ * SDO_METRICS_PROM=path     Prometheus text, for the textfile collector
+ * SDO_METRICS_STATSD=ip:port statsd over UDP, with DogStatsD tags
+ * SDO_METRICS_JSONL=path    a JSON object appended per run
+ * SDO_METRICS_LABELS=fw=1.2,region=eu labels of all the metrics
+ */
+#define METRICS_ENV_PROM "SDO_METRICS_PROM"
+#define METRICS_ENV_STATSD "SDO_METRICS_STATSD"
+#define METRICS_ENV_JSONL "SDO_METRICS_JSONL"
+#define METRICS_ENV_LABELS "SDO_METRICS_LABELS"
+
+void metricsExport(void);
+
+#endif // #ifndef __METRICS_H__
@@ -21,6 +21,9 @@
 #include <unistd.h>
 #include "blob.h"
 #include "safe_lib.h"
+#ifdef TARGET_OS_LINUX
+#include "metrics.h"
+#endif
 #ifdef SECURE_ELEMENT
 #include "se_provisioning.h"
 #endif
@@ -96,12 +99,15 @@ static bool is_ownership_transfer(void)
  * @return
  *        pointer to array of SvInfo modules.
  */
+/* SvInfo modules of the device, at most SDO_MAX_MODULES */
+#define SVINFO_MODULES 1
+
 static sdoSdkServiceInfoModule *sdoSvInfoModulesInit(void)
 {
 	sdoSdkServiceInfoModule *moduleInfo = NULL;
 
 #ifdef MODULES_ENABLED
-	moduleInfo = malloc(SDO_MAX_MODULES * (sizeof(*moduleInfo)));
+	moduleInfo = malloc(SVINFO_MODULES * (sizeof(*moduleInfo)));
 
 	if (!moduleInfo) {
 		LOG(LOG_ERROR, "Malloc failed!\n");
@@ -213,6 +219,7 @@ int app_main()
 #endif
 {
 	sdoSdkServiceInfoModule *moduleInfo;
+	sdoSdkStatus ret;
 
 	LOG(LOG_DEBUG, "Starting Secure Device Onboard\n");
 
@@ -237,7 +244,7 @@ int app_main()
 	}
 
 	/* Init sdo sdk */
-	if (SDO_SUCCESS != sdoSdkInit(error_cb, SDO_MAX_MODULES, moduleInfo)) {
+	if (SDO_SUCCESS != sdoSdkInit(error_cb, SVINFO_MODULES, moduleInfo)) {
 		LOG(LOG_ERROR, "sdoSdkInit failed!!\n");
 		return -1;
 	}
@@ -278,7 +285,16 @@ int app_main()
 
 	print_device_status();
 
-	if (SDO_SUCCESS != sdoSdkRun()) {
+	ret = sdoSdkRun();
+#if defined(SDO_TRACE) && defined(TARGET_OS_LINUX)
+	/* Failed runs are the most interesting to look at */
+	if (sdoSdkTraceDump("trace.json") == SDO_SUCCESS)
+		LOG(LOG_INFO, "Timeline of the run written to trace.json\n");
+#endif
+#ifdef TARGET_OS_LINUX
+	metricsExport();
+#endif
+	if (SDO_SUCCESS != ret) {
 		LOG(LOG_ERROR, "Secure device onboarding failed\n");
 		return -1;
 	}
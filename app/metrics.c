@@ -0,0 +1,553 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Export of the statistics of the SDK to the sinks of metrics.h.
+ *
+ * The statistics of the protocol runs (sdoSdkGetStats) and, with
+ * CRYPTO_STATS=true, of the crypto operations (sdoSdkGetCryptoStats) are
+ * copied out once the run is over, so the export adds nothing to the
+ * protocol path. Its memory is a fixed buffer, written to the sink when
+ * the next line does not fit in it, or in a statsd datagram. The durations
+ * go out as the histograms of the SDK, bucket b holding [2^(b-1), 2^b) ms
+ * (us for crypto), or as statsd timers: the p50 and p99 of a fleet are
+ * those of the collector, over the runs of all its devices.
+ */
+
+#include "sdo.h"
+#include "util.h"
+#include "metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#define METRICS_BUF_SIZE 8192
+#define METRICS_LINE_MAX 1024
+#define METRICS_DATAGRAM 1400
+#define METRICS_LABELS_MAX 8
+#define METRICS_LABEL_LEN 64
+/* Labels as a sink writes them, one of them is a line at most */
+#define METRICS_LABEL_STR 512
+#define METRICS_PATH_MAX 1024
+
+static struct {
+	char buf[METRICS_BUF_SIZE];
+	size_t len;
+	size_t limit; /* written out beyond, a datagram for statsd */
+	int fd;
+	bool failed;
+} out;
+
+/* Labels of all the metrics: ,fw="1.2"  ,fw:1.2  "fw":"1.2" */
+static struct {
+	char prom[METRICS_LABEL_STR];
+	char statsd[METRICS_LABEL_STR];
+	char json[METRICS_LABEL_STR];
+} labels;
+
+/* Copies of the statistics, to be exported */
+static sdoSdkStats stats;
+static sdoSdkCryptoStats crypto;
+static bool haveCrypto;
+
+static const char *const phaseNames[] = {"di", "to1", "to2"};
+#define METRICS_PHASES (sizeof(phaseNames) / sizeof(phaseNames[0]))
+
+/* Counter or gauge of a field of a statistics struct */
+typedef struct {
+	const char *name; /* as prometheus names it */
+	const char *type;
+	size_t offset;
+	size_t size; /* 4 or 8 bytes */
+} metricsField_t;
+
+static const metricsField_t phaseFields[] = {
+    {"sdo_phase_runs_total", "counter", offsetof(sdoSdkPhaseStats, runs), 4},
+    {"sdo_phase_failures_total", "counter",
+     offsetof(sdoSdkPhaseStats, failures), 4},
+    {"sdo_phase_last_ms", "gauge", offsetof(sdoSdkPhaseStats, lastMs), 4},
+};
+
+static const metricsField_t msgFields[] = {
+    {"sdo_msg_total", "counter", offsetof(sdoSdkMsgStats, count), 4},
+    {"sdo_msg_errors_total", "counter", offsetof(sdoSdkMsgStats, errors), 4},
+    {"sdo_msg_retries_total", "counter", offsetof(sdoSdkMsgStats, retries),
+     4},
+    {"sdo_msg_tx_bytes_total", "counter", offsetof(sdoSdkMsgStats, txBytes),
+     8},
+    {"sdo_msg_rx_bytes_total", "counter", offsetof(sdoSdkMsgStats, rxBytes),
+     8},
+    {"sdo_msg_parse_us_total", "counter", offsetof(sdoSdkMsgStats, parseUs),
+     8},
+    {"sdo_msg_crypto_us_total", "counter",
+     offsetof(sdoSdkMsgStats, cryptoUs), 8},
+};
+
+static const metricsField_t cryptoFields[] = {
+    {"sdo_crypto_calls_total", "counter",
+     offsetof(sdoSdkCryptoOpStats, calls), 8},
+    {"sdo_crypto_bytes_total", "counter",
+     offsetof(sdoSdkCryptoOpStats, bytes), 8},
+    {"sdo_crypto_max_us", "gauge", offsetof(sdoSdkCryptoOpStats, maxUs), 4},
+};
+
+#define METRICS_FIELDS(f) (sizeof(f) / sizeof((f)[0]))
+
+static unsigned long long metricsValue(const void *s, const metricsField_t *f)
+{
+	const uint8_t *p = (const uint8_t *)s + f->offset;
+	uint32_t v32;
+	uint64_t v64;
+
+	if (f->size == 4) {
+		memcpy(&v32, p, sizeof(v32));
+		return v32;
+	}
+	memcpy(&v64, p, sizeof(v64));
+	return v64;
+}
+
+static void metricsFlush(void)
+{
+	size_t done = 0;
+	ssize_t n;
+
+	while (!out.failed && done < out.len) {
+		n = write(out.fd, out.buf + done, out.len - done);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			LOG(LOG_ERROR, "Metrics write failed, errno=%d\n",
+			    errno);
+			out.failed = true;
+			break;
+		}
+		done += n;
+	}
+	out.len = 0;
+}
+
+static void metricsPut(const char *fmt, ...)
+{
+	char line[METRICS_LINE_MAX];
+	va_list ap;
+	int n;
+
+	va_start(ap, fmt);
+	n = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t)n >= sizeof(line)) {
+		out.failed = true;
+		return;
+	}
+	if (out.len + n > out.limit)
+		metricsFlush();
+	memcpy(out.buf + out.len, line, n);
+	out.len += n;
+}
+
+/* Upper bound of the histogram bucket holding the pct percentile */
+static unsigned long long metricsPct(const uint32_t *hist, unsigned pct)
+{
+	uint64_t count = 0, seen = 0, want;
+	unsigned b;
+
+	for (b = 0; b < SDO_STATS_HIST_BUCKETS; b++)
+		count += hist[b];
+	want = (count * pct + 99) / 100;
+	for (b = 0; b < SDO_STATS_HIST_BUCKETS - 1; b++) {
+		seen += hist[b];
+		if (seen >= want && seen)
+			break;
+	}
+	/* the last bucket has no upper bound, its lower one then */
+	return b < SDO_STATS_HIST_BUCKETS - 1 ? 1ull << b : 1ull << (b - 1);
+}
+
+/* Label names of [A-Za-z_][A-Za-z0-9_]*, values of [A-Za-z0-9_.-]+ */
+static bool metricsLabelOk(const char *s, size_t len, bool value)
+{
+	size_t i;
+	char c;
+
+	if (!len || len >= METRICS_LABEL_LEN)
+		return false;
+	for (i = 0; i < len; i++) {
+		c = s[i];
+		if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+		    c == '_' || (c >= '0' && c <= '9' && (value || i)) ||
+		    (value && (c == '.' || c == '-')))
+			continue;
+		return false;
+	}
+	return true;
+}
+
+static void metricsLabels(void)
+{
+	const char *spec = getenv(METRICS_ENV_LABELS);
+	size_t lp = 0, ls = 0, lj = 0, nameLen, valueLen;
+	const char *name, *eq, *end;
+	unsigned count = 0;
+	int n[3];
+
+	while (spec && *spec && count < METRICS_LABELS_MAX) {
+		name = spec;
+		end = strchr(spec, ',');
+		if (!end)
+			end = spec + strlen(spec);
+		spec = *end ? end + 1 : end;
+		eq = memchr(name, '=', end - name);
+		if (!eq)
+			continue;
+		nameLen = eq - name;
+		valueLen = end - eq - 1;
+		if (!metricsLabelOk(name, nameLen, false) ||
+		    !metricsLabelOk(eq + 1, valueLen, true)) {
+			LOG(LOG_ERROR, "Metrics label %.*s ignored\n",
+			    (int)(end - name), name);
+			continue;
+		}
+		n[0] = snprintf(labels.prom + lp, sizeof(labels.prom) - lp,
+				",%.*s=\"%.*s\"", (int)nameLen, name,
+				(int)valueLen, eq + 1);
+		n[1] = snprintf(labels.statsd + ls, sizeof(labels.statsd) - ls,
+				",%.*s:%.*s", (int)nameLen, name,
+				(int)valueLen, eq + 1);
+		n[2] = snprintf(labels.json + lj, sizeof(labels.json) - lj,
+				"%s\"%.*s\":\"%.*s\"", count ? "," : "",
+				(int)nameLen, name, (int)valueLen, eq + 1);
+		if (n[0] < 0 || lp + n[0] >= sizeof(labels.prom) || n[1] < 0 ||
+		    ls + n[1] >= sizeof(labels.statsd) || n[2] < 0 ||
+		    lj + n[2] >= sizeof(labels.json)) {
+			labels.prom[lp] = labels.statsd[ls] = 0;
+			labels.json[lj] = 0;
+			break;
+		}
+		lp += n[0];
+		ls += n[1];
+		lj += n[2];
+		count++;
+	}
+}
+
+/* A histogram of a family, first of it to give its TYPE line */
+static void metricsPromHist(const char *name, bool first, const char *lbl,
+			    const uint32_t *hist, unsigned long long sum)
+{
+	unsigned long long total = 0;
+	unsigned b;
+
+	if (first)
+		metricsPut("# TYPE %s histogram\n", name);
+	for (b = 0; b < SDO_STATS_HIST_BUCKETS - 1; b++) {
+		total += hist[b];
+		metricsPut("%s_bucket{%s%s,le=\"%llu\"} %llu\n", name, lbl,
+			   labels.prom, 1ull << b, total);
+	}
+	total += hist[b];
+	metricsPut("%s_bucket{%s%s,le=\"+Inf\"} %llu\n", name, lbl,
+		   labels.prom, total);
+	metricsPut("%s_sum{%s%s} %llu\n%s_count{%s%s} %llu\n", name, lbl,
+		   labels.prom, sum, name, lbl, labels.prom, total);
+}
+
+/* The families in turn, as the text format wants their samples together */
+static void metricsProm(void)
+{
+	char lbl[64];
+	unsigned i, f;
+	const sdoSdkPhaseStats *p;
+	const sdoSdkMsgStats *m;
+	const sdoSdkCryptoOpStats *c;
+
+	for (f = 0; f < METRICS_FIELDS(phaseFields); f++) {
+		metricsPut("# TYPE %s %s\n", phaseFields[f].name,
+			   phaseFields[f].type);
+		for (i = 0, p = &stats.di; i < METRICS_PHASES; i++, p++)
+			metricsPut("%s{phase=\"%s\"%s} %llu\n",
+				   phaseFields[f].name, phaseNames[i],
+				   labels.prom,
+				   metricsValue(p, &phaseFields[f]));
+	}
+	for (i = 0, p = &stats.di; i < METRICS_PHASES; i++, p++) {
+		(void)snprintf(lbl, sizeof(lbl), "phase=\"%s\"", phaseNames[i]);
+		metricsPromHist("sdo_phase_duration_ms", !i, lbl, p->hist,
+				p->totalMs);
+	}
+
+	for (f = 0; f < METRICS_FIELDS(msgFields); f++) {
+		metricsPut("# TYPE %s %s\n", msgFields[f].name,
+			   msgFields[f].type);
+		for (i = 0; i < SDO_STATS_MSG_TYPES; i++) {
+			m = &stats.msg[i];
+			if (m->count)
+				metricsPut("%s{type=\"%u\"%s} %llu\n",
+					   msgFields[f].name,
+					   i + SDO_STATS_MSG_FIRST, labels.prom,
+					   metricsValue(m, &msgFields[f]));
+		}
+	}
+	for (i = 0, f = 0; i < SDO_STATS_MSG_TYPES; i++) {
+		m = &stats.msg[i];
+		if (!m->count)
+			continue;
+		(void)snprintf(lbl, sizeof(lbl), "type=\"%u\"",
+			       i + SDO_STATS_MSG_FIRST);
+		metricsPromHist("sdo_msg_wait_ms", !f++, lbl, m->waitHist,
+				m->waitUs / 1000);
+	}
+
+	if (!haveCrypto)
+		return;
+	for (f = 0; f < METRICS_FIELDS(cryptoFields); f++) {
+		metricsPut("# TYPE %s %s\n", cryptoFields[f].name,
+			   cryptoFields[f].type);
+		for (i = 0; i < SDO_CRYPTO_OPS; i++) {
+			c = &crypto.op[i];
+			if (c->calls)
+				metricsPut("%s{op=\"%s\",backend=\"%s\"%s} "
+					   "%llu\n",
+					   cryptoFields[f].name, c->name,
+					   c->backend, labels.prom,
+					   metricsValue(c, &cryptoFields[f]));
+		}
+	}
+	for (i = 0, f = 0; i < SDO_CRYPTO_OPS; i++) {
+		c = &crypto.op[i];
+		if (!c->calls)
+			continue;
+		(void)snprintf(lbl, sizeof(lbl), "op=\"%s\",backend=\"%s\"",
+			       c->name, c->backend);
+		metricsPromHist("sdo_crypto_us", !f++, lbl, c->hist,
+				c->totalUs);
+	}
+}
+
+/* Counters and timers of the run, the collector aggregating the fleet */
+static void metricsStatsd(void)
+{
+	const sdoSdkPhaseStats *p;
+	const sdoSdkMsgStats *m;
+	const sdoSdkCryptoOpStats *c;
+	unsigned i;
+
+	for (i = 0, p = &stats.di; i < METRICS_PHASES; i++, p++) {
+		if (!p->runs)
+			continue;
+		metricsPut("sdo.phase.runs:%u|c|#phase:%s%s\n", p->runs,
+			   phaseNames[i], labels.statsd);
+		metricsPut("sdo.phase.failures:%u|c|#phase:%s%s\n",
+			   p->failures, phaseNames[i], labels.statsd);
+		metricsPut("sdo.phase.duration:%u|ms|#phase:%s%s\n",
+			   p->lastMs, phaseNames[i], labels.statsd);
+	}
+
+	for (i = 0; i < SDO_STATS_MSG_TYPES; i++) {
+		m = &stats.msg[i];
+		if (!m->count)
+			continue;
+		metricsPut("sdo.msg.count:%u|c|#type:%u%s\n", m->count,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.errors:%u|c|#type:%u%s\n", m->errors,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.retries:%u|c|#type:%u%s\n", m->retries,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.tx_bytes:%llu|c|#type:%u%s\n",
+			   (unsigned long long)m->txBytes,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.rx_bytes:%llu|c|#type:%u%s\n",
+			   (unsigned long long)m->rxBytes,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		/* means over the exchanges of the type */
+		metricsPut("sdo.msg.wait:%.3f|ms|#type:%u%s\n",
+			   (double)m->waitUs / 1000 / m->count,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.parse:%.3f|ms|#type:%u%s\n",
+			   (double)m->parseUs / 1000 / m->count,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+		metricsPut("sdo.msg.crypto:%.3f|ms|#type:%u%s\n",
+			   (double)m->cryptoUs / 1000 / m->count,
+			   i + SDO_STATS_MSG_FIRST, labels.statsd);
+	}
+
+	for (i = 0; haveCrypto && i < SDO_CRYPTO_OPS; i++) {
+		c = &crypto.op[i];
+		if (!c->calls)
+			continue;
+		metricsPut("sdo.crypto.calls:%llu|c|#op:%s,backend:%s%s\n",
+			   (unsigned long long)c->calls, c->name, c->backend,
+			   labels.statsd);
+		metricsPut("sdo.crypto.bytes:%llu|c|#op:%s,backend:%s%s\n",
+			   (unsigned long long)c->bytes, c->name, c->backend,
+			   labels.statsd);
+		metricsPut("sdo.crypto.time:%.3f|ms|#op:%s,backend:%s%s\n",
+			   (double)c->totalUs / 1000 / c->calls, c->name,
+			   c->backend, labels.statsd);
+	}
+}
+
+/* The run as one JSON object, on a line of its own */
+static void metricsJson(void)
+{
+	const sdoSdkPhaseStats *p;
+	const sdoSdkMsgStats *m;
+	const sdoSdkCryptoOpStats *c;
+	const char *sep = "";
+	unsigned i;
+
+	metricsPut("{\"time\":%lld,\"labels\":{%s},\"phases\":{",
+		   (long long)time(NULL), labels.json);
+	for (i = 0, p = &stats.di; i < METRICS_PHASES; i++, p++) {
+		metricsPut("%s\"%s\":{\"runs\":%u,\"failures\":%u,"
+			   "\"lastMs\":%u,\"totalMs\":%llu,\"p50Ms\":%llu,"
+			   "\"p99Ms\":%llu}",
+			   i ? "," : "", phaseNames[i], p->runs, p->failures,
+			   p->lastMs, (unsigned long long)p->totalMs,
+			   p->runs ? metricsPct(p->hist, 50) : 0,
+			   p->runs ? metricsPct(p->hist, 99) : 0);
+	}
+
+	metricsPut("},\"msgs\":{");
+	for (i = 0; i < SDO_STATS_MSG_TYPES; i++) {
+		m = &stats.msg[i];
+		if (!m->count)
+			continue;
+		metricsPut("%s\"%u\":{\"count\":%u,\"errors\":%u,"
+			   "\"retries\":%u,\"txBytes\":%llu,"
+			   "\"rxBytes\":%llu,\"waitUs\":%llu,"
+			   "\"parseUs\":%llu,\"cryptoUs\":%llu,"
+			   "\"waitP50Ms\":%llu,\"waitP99Ms\":%llu}",
+			   sep, i + SDO_STATS_MSG_FIRST, m->count, m->errors,
+			   m->retries, (unsigned long long)m->txBytes,
+			   (unsigned long long)m->rxBytes,
+			   (unsigned long long)m->waitUs,
+			   (unsigned long long)m->parseUs,
+			   (unsigned long long)m->cryptoUs,
+			   metricsPct(m->waitHist, 50),
+			   metricsPct(m->waitHist, 99));
+		sep = ",";
+	}
+
+	metricsPut("},\"crypto\":{");
+	sep = "";
+	for (i = 0; haveCrypto && i < SDO_CRYPTO_OPS; i++) {
+		c = &crypto.op[i];
+		if (!c->calls)
+			continue;
+		metricsPut("%s\"%s\":{\"backend\":\"%s\",\"calls\":%llu,"
+			   "\"bytes\":%llu,\"totalUs\":%llu,\"maxUs\":%u}",
+			   sep, c->name, c->backend,
+			   (unsigned long long)c->calls,
+			   (unsigned long long)c->bytes,
+			   (unsigned long long)c->totalUs, c->maxUs);
+		sep = ",";
+	}
+	metricsPut("}}\n");
+}
+
+/* A statsd collector of ip:port, or [ipv6]:port */
+static int metricsStatsdOpen(const char *spec)
+{
+	char host[256];
+	const char *colon = strrchr(spec, ':');
+	struct addrinfo hints, *res = NULL;
+	size_t len;
+	int fd;
+
+	if (!colon || colon == spec)
+		return -1;
+	len = colon - spec;
+	if (spec[0] == '[' && spec[len - 1] == ']') {
+		spec++;
+		len -= 2;
+	}
+	if (len >= sizeof(host))
+		return -1;
+	memcpy(host, spec, len);
+	host[len] = 0;
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	if (getaddrinfo(host, colon + 1, &hints, &res) != 0 || !res)
+		return -1;
+	fd = socket(res->ai_family, SOCK_DGRAM, 0);
+	if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+static void metricsSink(const char *env, void (*format)(void))
+{
+	const char *spec = getenv(env);
+	char tmp[METRICS_PATH_MAX];
+	bool prom = format == metricsProm;
+
+	if (!spec || !*spec)
+		return;
+
+	out.len = 0;
+	out.failed = false;
+	out.limit = sizeof(out.buf);
+	if (format == metricsStatsd) {
+		out.limit = METRICS_DATAGRAM;
+		out.fd = metricsStatsdOpen(spec);
+	} else if (prom) {
+		/* renamed once written, not to be scraped half way */
+		if (snprintf(tmp, sizeof(tmp), "%s.tmp", spec) >=
+		    (int)sizeof(tmp))
+			return;
+		out.fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	} else {
+		out.fd = open(spec, O_WRONLY | O_CREAT | O_APPEND, 0644);
+	}
+	if (out.fd < 0) {
+		LOG(LOG_ERROR, "Metrics sink %s not opened, errno=%d\n", spec,
+		    errno);
+		return;
+	}
+
+	format();
+	metricsFlush();
+	if (close(out.fd) != 0)
+		out.failed = true;
+	if (prom && (out.failed || rename(tmp, spec) != 0)) {
+		(void)unlink(tmp);
+		out.failed = true;
+	}
+	if (out.failed)
+		LOG(LOG_ERROR, "Metrics not exported to %s\n", spec);
+}
+
+/**
+ * Export the statistics of the SDK to the sinks set in the environment,
+ * once a run is over.
+ */
+void metricsExport(void)
+{
+	if (!getenv(METRICS_ENV_PROM) && !getenv(METRICS_ENV_STATSD) &&
+	    !getenv(METRICS_ENV_JSONL))
+		return;
+	if (sdoSdkGetStats(&stats) != SDO_SUCCESS)
+		return;
+	haveCrypto = sdoSdkGetCryptoStats(&crypto) == SDO_SUCCESS;
+	metricsLabels();
+
+	metricsSink(METRICS_ENV_PROM, metricsProm);
+	metricsSink(METRICS_ENV_STATSD, metricsStatsd);
+	metricsSink(METRICS_ENV_JSONL, metricsJson);
+}
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Replay harness. Runs the protocols of a device over and over again
+ * against a transcript of the messages of a real onboarding, served by the
+ * replay network layer (NET_REPLAY=play) instead of the manufacturer,
+ * rendezvous and owner servers, so that the CPU cost of DI, TO1 and TO2
+ * (parsing, crypto and storage) is measured on its own and the same way on
+ * every run.
+ *
+ * The transcript is recorded by the device built with NET_REPLAY=record,
+ * from a copy of its data directory taken before DI: the random bytes of
+ * both builds being the same sequence, the device sends the messages the
+ * servers answered. Each iteration starts the work directory over from
+ * that copy and runs the device until it is onboarded.
+ */
+
+#include "sdo.h"
+#include "sdomodules.h"
+#include "network_al.h"
+#include "fileutil.h"
+#include "safe_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#define REPLAY_PATH_MAX 1024
+#define REPLAY_MAX_RUNS 4 /* DI, TO1 and TO2, retried once */
+
+#ifndef SDO_TRANSCRIPT
+#define SDO_TRANSCRIPT "data/transcript.dat"
+#endif
+
+enum replayPhase { REPLAY_DI, REPLAY_TO1, REPLAY_TO2, REPLAY_PHASES };
+
+static const char *const phaseNames[REPLAY_PHASES] = {"DI", "TO1", "TO2"};
+
+/* First and last message type sent by the device in each phase */
+static const int phaseMsgs[REPLAY_PHASES][2] = {
+    {10, 13}, {30, 33}, {40, 51}};
+
+/* Times of one phase, or of the whole onboarding, in us */
+typedef struct {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+} replayStat_t;
+
+static struct {
+	const char *templateDir;
+	const char *workDir;
+	const char *transcript;
+	unsigned iterations;
+} cfg = {"data.pristine", "replay", SDO_TRANSCRIPT, 100};
+
+static struct {
+	replayStat_t handle[REPLAY_PHASES]; /* handling the responses */
+	replayStat_t crypto[REPLAY_PHASES]; /* of which crypto */
+	replayStat_t wall;		    /* of an onboarding */
+	replayStat_t cpu;
+} stats;
+
+static int replayErrorCB(sdoSdkStatus type, sdoSdkError errorcode)
+{
+	(void)type;
+	(void)errorcode;
+
+	/* The transcript holds no retries, give up on the first error */
+	return SDO_ABORT;
+}
+
+static uint64_t replayClockUs(clockid_t clock)
+{
+	struct timespec ts;
+
+	if (clock_gettime(clock, &ts) != 0)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void replayStatAdd(replayStat_t *s, uint64_t us)
+{
+	if (!s->count || us < s->min)
+		s->min = us;
+	if (us > s->max)
+		s->max = us;
+	s->sum += us;
+	s->count++;
+}
+
+/* Remove the regular files of dir, or copy those of from into it */
+static bool replayDirFiles(const char *dir, const char *from)
+{
+	char path[REPLAY_PATH_MAX];
+	char src[REPLAY_PATH_MAX];
+	const char *base = strrchr(cfg.transcript, '/');
+	struct dirent *e;
+	struct stat st;
+	bool ok = true;
+	DIR *d = opendir(from ? from : dir);
+
+	base = base ? base + 1 : cfg.transcript;
+	if (!d)
+		return false;
+	while (ok && (e = readdir(d)) != NULL) {
+		/* the transcript may sit in the template directory */
+		if (from && !strcmp(e->d_name, base))
+			continue;
+		if (snprintf(path, sizeof(path), "%s/%s", dir, e->d_name) >=
+			(int)sizeof(path) ||
+		    (from && snprintf(src, sizeof(src), "%s/%s", from,
+				      e->d_name) >= (int)sizeof(src)))
+			ok = false;
+		else if (!from)
+			ok = stat(path, &st) || !S_ISREG(st.st_mode) ||
+			     !unlink(path);
+		else if (!stat(src, &st) && S_ISREG(st.st_mode))
+			ok = appCopyFile(src, path);
+	}
+	closedir(d);
+	return ok;
+}
+
+/* Add up the handling times of the messages of the runs so far */
+static void replayPhases(const sdoSdkStats *s, uint64_t handle[],
+			 uint64_t crypto[])
+{
+	int p, t;
+
+	for (p = 0; p < REPLAY_PHASES; p++) {
+		for (t = phaseMsgs[p][0]; t <= phaseMsgs[p][1]; t++) {
+			handle[p] += s->msg[t - SDO_STATS_MSG_FIRST].parseUs;
+			crypto[p] += s->msg[t - SDO_STATS_MSG_FIRST].cryptoUs;
+		}
+	}
+}
+
+/* One onboarding, from the template to the device being IDLE */
+static bool replayIteration(unsigned i)
+{
+	sdoSdkServiceInfoModule *moduleInfo = NULL;
+	uint64_t handle[REPLAY_PHASES] = {0};
+	uint64_t crypto[REPLAY_PHASES] = {0};
+	uint64_t wall, cpu;
+	sdoSdkStats s;
+	sdoSdkCtx_t *ctx;
+	sdoSdkDeviceState state = SDO_STATE_PRE_DI;
+	unsigned runs;
+	int p;
+
+#ifdef MODULES_ENABLED
+	sdoSdkServiceInfoModule module[1];
+
+	if (strncpy_s(module[0].moduleName, SDO_MODULE_NAME_LEN, "sdo_sys",
+		      SDO_MODULE_NAME_LEN) != 0)
+		return false;
+	module[0].serviceInfoCallback = sdo_sys;
+	moduleInfo = module;
+#endif
+
+	if (!replayDirFiles(cfg.workDir, NULL) ||
+	    !replayDirFiles(cfg.workDir, cfg.templateDir)) {
+		printf("Iteration %u: %s not set up from %s\n", i, cfg.workDir,
+		       cfg.templateDir);
+		return false;
+	}
+	if (sdoConTranscript(cfg.transcript)) {
+		printf("Transcript %s not set\n", cfg.transcript);
+		return false;
+	}
+
+	wall = replayClockUs(CLOCK_MONOTONIC);
+	cpu = replayClockUs(CLOCK_PROCESS_CPUTIME_ID);
+	/* a run per protocol, as the device would be started over */
+	for (runs = 0; state != SDO_STATE_IDLE && runs < REPLAY_MAX_RUNS;
+	     runs++) {
+		ctx = sdoSdkCreate(replayErrorCB, moduleInfo ? 1 : 0,
+				   moduleInfo, cfg.workDir);
+		if (!ctx) {
+			printf("Iteration %u: SDK instance not set up\n", i);
+			return false;
+		}
+		if (sdoSdkCtxRun(ctx) != SDO_SUCCESS ||
+		    sdoSdkCtxGetStats(ctx, &s) != SDO_SUCCESS) {
+			printf("Iteration %u: run %u failed, see the log for "
+			       "the diverging message\n",
+			       i, runs + 1);
+			sdoSdkDestroy(ctx);
+			return false;
+		}
+		replayPhases(&s, handle, crypto);
+		state = sdoSdkCtxGetStatus(ctx);
+		sdoSdkDestroy(ctx);
+	}
+	wall = replayClockUs(CLOCK_MONOTONIC) - wall;
+	cpu = replayClockUs(CLOCK_PROCESS_CPUTIME_ID) - cpu;
+	if (state != SDO_STATE_IDLE) {
+		printf("Iteration %u: not onboarded after %u runs\n", i, runs);
+		return false;
+	}
+
+	for (p = 0; p < REPLAY_PHASES; p++) {
+		replayStatAdd(&stats.handle[p], handle[p]);
+		replayStatAdd(&stats.crypto[p], crypto[p]);
+	}
+	replayStatAdd(&stats.wall, wall);
+	replayStatAdd(&stats.cpu, cpu);
+	return true;
+}
+
+static void replayPrintStat(const char *name, const replayStat_t *s)
+{
+	if (!s->count)
+		return;
+	printf("%-12s %10.1f %10.1f %10.1f\n", name,
+	       (double)s->sum / s->count / 1000, (double)s->min / 1000,
+	       (double)s->max / 1000);
+}
+
+static void replayReport(void)
+{
+	char name[32];
+	int p;
+
+	printf("\n%u onboardings\n", (unsigned)stats.wall.count);
+	printf("%-12s %10s %10s %10s\n", "ms", "mean", "min", "max");
+	for (p = 0; p < REPLAY_PHASES; p++) {
+		replayPrintStat(phaseNames[p], &stats.handle[p]);
+		snprintf(name, sizeof(name), " %s crypto", phaseNames[p]);
+		replayPrintStat(name, &stats.crypto[p]);
+	}
+	replayPrintStat("onboarding", &stats.wall);
+	replayPrintStat(" cpu", &stats.cpu);
+}
+
+static void replayUsage(const char *prog)
+{
+	printf("Usage: %s [options]\n"
+	       "  -n ITERATIONS  onboardings to run (default %u)\n"
+	       "  -d DIR         data directory of the device before the "
+	       "recording (default %s)\n"
+	       "  -w DIR         work directory of the device (default %s)\n"
+	       "  -t FILE        transcript of NET_REPLAY=record "
+	       "(default %s)\n",
+	       prog, cfg.iterations, cfg.templateDir, cfg.workDir,
+	       cfg.transcript);
+}
+
+int main(int argc, char **argv)
+{
+	unsigned i;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:d:w:t:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			cfg.iterations = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg.templateDir = optarg;
+			break;
+		case 'w':
+			cfg.workDir = optarg;
+			break;
+		case 't':
+			cfg.transcript = optarg;
+			break;
+		default:
+			replayUsage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+	if (!cfg.iterations) {
+		replayUsage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	/* the network layer of the build serves no transcript */
+	if (sdoConTranscript(cfg.transcript)) {
+		printf("No transcript replay, build with make replay\n");
+		return EXIT_FAILURE;
+	}
+	if (mkdir(cfg.workDir, 0700) && errno != EEXIST) {
+		printf("Failed to create %s\n", cfg.workDir);
+		return EXIT_FAILURE;
+	}
+
+	setbuf(stdout, NULL);
+	printf("%u onboardings from %s, templates %s, work directory %s\n",
+	       cfg.iterations, cfg.transcript, cfg.templateDir, cfg.workDir);
+	for (i = 0; i < cfg.iterations; i++) {
+		if (!replayIteration(i))
+			break;
+	}
+
+	replayReport();
+	return i == cfg.iterations ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Benchmark of the storage (storage_al.h): sdoBlobWrite, sdoBlobRead
+ * and sdoBlobSize of normal, secure and raw blobs at several sizes, and a
+ * blob transaction, in a directory of their own.
+ *
+ * Each case runs for at least the given time and reports ops/s. Built with
+ * STORAGE_STATS=true, it also reports per op what reached the medium: the
+ * bytes written and read, the files opened, the syncs, and the time the
+ * HMACs and GCM seals took, then the writes per file over the whole run.
+ * The bytes written and syncs per op, times the writes a device does over
+ * its lifetime, project the wear of its eMMC or SD card. The backend is the
+ * one of the build: with the journal (BLOB_JOURNAL), the identity store or
+ * the TPM HMAC (DA=tpm20) the same cases go through them.
+ */
+
+#include "sdo.h"
+#include "sdotypes.h"
+#include "sdoCryptoApi.h"
+#include "storage_al.h"
+#include "safe_lib.h"
+#include "benchutil.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_BUF_MAX 16384
+#define BENCH_TX_BLOBS 3
+
+typedef enum { BENCH_WRITE, BENCH_READ, BENCH_SIZE, BENCH_TX } benchOp_t;
+
+typedef struct {
+	const char *name;
+	benchOp_t op;
+	sdoSdkBlobFlags flags;
+	uint32_t len;
+} benchCase_t;
+
+static const benchCase_t benchCases[] = {
+    {"write-normal-64", BENCH_WRITE, SDO_SDK_NORMAL_DATA, 64},
+    {"write-normal-1k", BENCH_WRITE, SDO_SDK_NORMAL_DATA, 1024},
+    {"write-normal-16k", BENCH_WRITE, SDO_SDK_NORMAL_DATA, 16384},
+    {"write-secure-64", BENCH_WRITE, SDO_SDK_SECURE_DATA, 64},
+    {"write-secure-1k", BENCH_WRITE, SDO_SDK_SECURE_DATA, 1024},
+    {"write-secure-16k", BENCH_WRITE, SDO_SDK_SECURE_DATA, 16384},
+    {"write-raw-1k", BENCH_WRITE, SDO_SDK_RAW_DATA, 1024},
+    {"read-normal-64", BENCH_READ, SDO_SDK_NORMAL_DATA, 64},
+    {"read-normal-1k", BENCH_READ, SDO_SDK_NORMAL_DATA, 1024},
+    {"read-normal-16k", BENCH_READ, SDO_SDK_NORMAL_DATA, 16384},
+    {"read-secure-1k", BENCH_READ, SDO_SDK_SECURE_DATA, 1024},
+    {"read-raw-1k", BENCH_READ, SDO_SDK_RAW_DATA, 1024},
+    {"size-normal-1k", BENCH_SIZE, SDO_SDK_NORMAL_DATA, 1024},
+    {"tx-normal-3x1k", BENCH_TX, SDO_SDK_NORMAL_DATA, 1024},
+};
+
+#define BENCH_CASES (sizeof(benchCases) / sizeof(benchCases[0]))
+
+static struct {
+	unsigned ms;
+	const char *dir; /* NULL for a fresh one under /tmp */
+} cfg = {500, NULL};
+
+static uint8_t bin[BENCH_BUF_MAX];
+static uint8_t out[BENCH_BUF_MAX];
+
+/* Name of the blob of a case, one per flags and size */
+static void benchBlobName(const benchCase_t *c, int i, char *name,
+			  size_t len)
+{
+	const char *kind = c->flags == SDO_SDK_SECURE_DATA ? "secure"
+			   : c->flags == SDO_SDK_RAW_DATA  ? "raw"
+							   : "normal";
+
+	(void)snprintf(name, len, "bench-%s-%u-%d.blob", kind, c->len, i);
+}
+
+/* One op of a case, false on failure */
+static bool benchOp(const benchCase_t *c)
+{
+	char name[64];
+	int i;
+
+	benchBlobName(c, 0, name, sizeof(name));
+	switch (c->op) {
+	case BENCH_WRITE:
+		return sdoBlobWrite(name, c->flags, bin, c->len) ==
+		       (int32_t)c->len;
+	case BENCH_READ:
+		return sdoBlobRead(name, c->flags, out, c->len) ==
+		       (int32_t)c->len;
+	case BENCH_SIZE:
+		return sdoBlobSize(name, c->flags) == (int32_t)c->len;
+	case BENCH_TX:
+		if (sdoBlobTxBegin() != 0)
+			return false;
+		for (i = 0; i < BENCH_TX_BLOBS; i++) {
+			benchBlobName(c, i, name, sizeof(name));
+			if (sdoBlobWrite(name, c->flags, bin, c->len) !=
+			    (int32_t)c->len) {
+				sdoBlobTxAbort();
+				return false;
+			}
+		}
+		return sdoBlobTxCommit() == 0;
+	}
+	return false;
+}
+
+/* Per op difference of a counter, for the report */
+static double benchPerOp(uint64_t after, uint64_t before, uint64_t ops)
+{
+	return ops ? (double)(after - before) / ops : 0;
+}
+
+static bool benchRun(const benchCase_t *c)
+{
+	benchCase_t w = *c;
+	sdoSdkStorageStats s0, s1;
+	uint64_t n = 1, ops = 0, start, ns;
+	bool counted;
+	uint64_t i;
+
+	/* Once, to have the blob to read and to warm up the keys */
+	w.op = BENCH_WRITE;
+	if ((c->op == BENCH_READ || c->op == BENCH_SIZE) && !benchOp(&w)) {
+		printf("%-18s failed\n", c->name);
+		return false;
+	}
+	if (!benchOp(c)) {
+		printf("%-18s failed\n", c->name);
+		return false;
+	}
+
+	counted = sdoSdkGetStorageStats(&s0) == SDO_SUCCESS;
+	start = benchNowNs();
+	do {
+		for (i = 0; i < n; i++) {
+			if (!benchOp(c)) {
+				printf("%-18s failed\n", c->name);
+				return false;
+			}
+		}
+		ops += n;
+		ns = benchNowNs() - start;
+		if (n < (1u << 16))
+			n <<= 1;
+	} while (ns < (uint64_t)cfg.ms * 1000000);
+
+	printf("%-18s %8llu %10.1f", c->name, (unsigned long long)ops,
+	       (double)ops * 1000000000 / ns);
+	if (!counted || sdoSdkGetStorageStats(&s1) != SDO_SUCCESS) {
+		printf("\n");
+		return true;
+	}
+	printf(" %9.1f %9.1f %6.2f %6.2f %8.1f %8.1f\n",
+	       benchPerOp(s1.bytesWritten, s0.bytesWritten, ops),
+	       benchPerOp(s1.bytesRead, s0.bytesRead, ops),
+	       benchPerOp(s1.opens, s0.opens, ops),
+	       benchPerOp(s1.syncs, s0.syncs, ops),
+	       benchPerOp(s1.hmacUs, s0.hmacUs, ops),
+	       benchPerOp(s1.gcmUs, s0.gcmUs, ops));
+	return true;
+}
+
+/* Writes per file over the run */
+static void benchFiles(void)
+{
+	sdoSdkStorageStats s;
+	int i;
+
+	if (sdoSdkGetStorageStats(&s) != SDO_SUCCESS)
+		return;
+	printf("\n%-32s %10s %14s\n", "file", "writes", "bytes");
+	for (i = 0; i < SDO_STORAGE_STATS_FILES && s.file[i].name[0]; i++)
+		printf("%-32s %10llu %14llu\n", s.file[i].name,
+		       (unsigned long long)s.file[i].writes,
+		       (unsigned long long)s.file[i].bytes);
+	if (s.filesDropped)
+		printf("(%llu writes to other files)\n",
+		       (unsigned long long)s.filesDropped);
+	printf("total: %llu bytes written, %llu syncs\n",
+	       (unsigned long long)s.bytesWritten,
+	       (unsigned long long)s.syncs);
+}
+
+/* The platform keys and IV are made on first use, in files that exist */
+static bool benchSetup(sdoStorageCtx_t **ctx)
+{
+	static char tmpl[] = "/tmp/sdo-storagebench-XXXXXX";
+	const char *files[] = {PLATFORM_IV, PLATFORM_AES_KEY,
+			       PLATFORM_HMAC_KEY};
+	char path[FILENAME_MAX];
+	const char *file;
+	FILE *f;
+	size_t i;
+
+	if (sdoCryptoRequire(SDO_CRYPTO_ENGINE))
+		return false;
+	if (!cfg.dir)
+		cfg.dir = mkdtemp(tmpl);
+	if (!cfg.dir)
+		return false;
+	*ctx = sdoStorageCtxAlloc(cfg.dir);
+	if (!*ctx)
+		return false;
+	sdoStorageCtxBind(*ctx);
+
+	for (i = 0; i < sizeof(files) / sizeof(files[0]); i++) {
+		file = sdoStoragePath(files[i], path, sizeof(path));
+		if (!file)
+			return false;
+		if (access(file, F_OK) == 0)
+			continue;
+		f = fopen(file, "w");
+		if (!f || fclose(f) == EOF)
+			return false;
+	}
+
+	benchFill(bin, sizeof(bin));
+	(void)sdoSdkResetStorageStats();
+	return true;
+}
+
+int main(int argc, char **argv)
+{
+	sdoStorageCtx_t *ctx = NULL;
+	unsigned c;
+	int opt;
+	int ret = EXIT_SUCCESS;
+
+	while ((opt = getopt(argc, argv, "t:d:lh")) != -1) {
+		switch (opt) {
+		case 't':
+			cfg.ms = (unsigned)strtoul(optarg, NULL, 0);
+			break;
+		case 'd':
+			cfg.dir = optarg;
+			break;
+		case 'l':
+			for (c = 0; c < BENCH_CASES; c++)
+				printf("%s\n", benchCases[c].name);
+			return EXIT_SUCCESS;
+		default:
+			benchUsage(argv[0], cfg.ms,
+				   "  -d DIR      directory of the blobs "
+				   "(default a new one in /tmp)\n",
+				   "");
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!benchSetup(&ctx)) {
+		printf("Setting up the storage failed\n");
+		sdoStorageCtxFree(ctx);
+		return EXIT_FAILURE;
+	}
+
+	printf("blobs in %s\n", cfg.dir);
+	printf("%-18s %8s %10s %9s %9s %6s %6s %8s %8s\n", "case", "ops",
+	       "ops/s", "wr B/op", "rd B/op", "open", "sync", "hmac us",
+	       "gcm us");
+	for (c = 0; c < BENCH_CASES; c++) {
+		if (!benchSelected(benchCases[c].name, argc, argv))
+			continue;
+		if (!benchRun(&benchCases[c]))
+			ret = EXIT_FAILURE;
+	}
+	benchFiles();
+
+	sdoStorageCtxFree(ctx);
+	sdoCryptoClose();
+	return ret;
+}
@@ -30,17 +30,78 @@ PROXY_DISCOVERY ?= false
 RESALE ?= false
 REUSE ?= true
 MODULES ?= false
+MAX_MODULES ?= 1
 STORAGE ?= true
 RETRY ?= true
+KEEP_ALIVE ?= true
+TLS_SESSION_CACHE ?= true
+TLS_SESSION_PERSIST ?= false
+TLS_EARLY_DATA ?= false
+TCP_FASTOPEN ?= false
+DNS_CACHE_TTL ?= 300
+RV_PROBE ?= false
+RV_RANK ?= true
+RV_REDIRECT_CACHE ?= true
+RV_REDIRECT_TTL ?= 600
+TO2_RESUME ?= false
+TO2_RESUME_TTL ?= 60
+OV_PREFIX_CACHE ?= true
+OV_PIPELINE ?= 0
+PROT_STATS ?= true
+CRYPTO_STATS ?= false
+TRACE_EVENTS ?= 0
+ALLOC_STATS ?= false
+STORAGE_STATS ?= false
+LOG_ASYNC ?= false
+HTTP_DEFLATE ?= false
+PROXY_TUNNEL ?= false
+HTTP2 ?= false
+OWNER_PRECONNECT ?= true
+STATIC_MEM ?= false
+STATIC_MEM_BLOCK ?= 8192
+NET_REPLAY ?= false
+NET_TRANSPORT ?= http
+BASE64_SIMD ?= true
+JSON_SIMD ?= true
+SINGLE_SUITE ?= false
+ECC_RESTARTABLE ?= false
+ECC_SLICE_OPS ?= 1000
+CRYPTO_DISPATCH ?= true
+ARENA ?= true
+RX_STREAM ?= false
+WIRE ?= json
+RANDOM_POOL ?= 0
+EPID_PRECOMP_PERSIST ?= true
+EPID_SIGRL_PERSIST ?= true
+EPID_PRESIGS ?= 2
+CSR_CACHE ?= false
+BLOB_CACHE ?= true
+CONFIG_SNAPSHOT ?= true
+DSI_CACHE ?= true
+DSI_ASYNC ?= true
+OSI_ASYNC ?= true
+OSI_APPLIED_CACHE ?= true
+DSI_PACK ?= 0
+BLOB_JOURNAL ?= true
+BLOB_CONTAINER ?= true
+IDENTITY_STORE ?= false
+SD_CACHE ?= 16
+IV_RESERVE ?= 64
 CRYPTO_HW ?= false
+CRED_BINARY ?= true
+CRED_ASYNC ?= false
+LAZY_INIT ?= true
 
 ifeq ($(MODULES), true)
 DFLAGS += -DMODULES_ENABLED
 endif
+DFLAGS += -DSDO_MAX_MODULES=$(MAX_MODULES)
 
 ifeq ($(TARGET_OS), linux)
 EPID ?= epid_r6
 TLS ?= openssl
+OV_VERIFY_THREADS ?= 1
+TASK_WORKERS ?= 2
 # Enable following compiler flags, so, that sdo compilation
 # works for optee out of the box
 CFLAGS += -Wold-style-declaration -Wold-style-definition
@@ -62,6 +123,10 @@ EPID ?= epid_r6
 TLS ?= mbedtls
 BOARD ?= NUCLEO_F429ZI
 endif
+OV_VERIFY_THREADS ?= 0
+OV_VERIFY_QUEUE ?= 4
+TASK_WORKERS ?= 0
+TASK_QUEUE ?= 8
 
 ifeq ($(CRYPTO_HW), true)
 DFLAGS += -DSECURE_ELEMENT
@@ -211,6 +276,39 @@ ifneq ("$(HTTPPROXY)", "")
     DFLAGS += -DRV_PROXY=\"$(PRJ_DIR)/data/rv_proxy.dat\"
     DFLAGS += -DOWNER_PROXY=\"$(PRJ_DIR)/data/owner_proxy.dat\"
 endif
+ifeq ($(TLS_SESSION_PERSIST), true)
+    DFLAGS += -DTLS_SESSION_BLOB=\"$(PRJ_DIR)/data/tls_session.blob\"
+endif
+ifeq ($(EPID_PRECOMP_PERSIST), true)
+    DFLAGS += -DEPID_PRECOMP_BLOB=\"$(PRJ_DIR)/data/epid_precomp.blob\"
+endif
+ifeq ($(EPID_SIGRL_PERSIST), true)
+    DFLAGS += -DEPID_SIGRL_BLOB=\"$(PRJ_DIR)/data/epid_sigrl.blob\"
+endif
+ifeq ($(CSR_CACHE), true)
+    DFLAGS += -DDEVICE_CSR_BLOB=\"$(PRJ_DIR)/data/device_csr.blob\"
+endif
+ifeq ($(RV_RANK), true)
+    DFLAGS += -DENDPOINT_STATS_BLOB=\"$(PRJ_DIR)/data/endpoint_stats.blob\"
+endif
+ifeq ($(RV_REDIRECT_CACHE), true)
+    DFLAGS += -DRV_REDIRECT_BLOB=\"$(PRJ_DIR)/data/rv_redirect.blob\"
+endif
+ifeq ($(OSI_APPLIED_CACHE), true)
+    DFLAGS += -DOSI_APPLIED_BLOB=\"$(PRJ_DIR)/data/osi_applied.blob\"
+endif
+ifeq ($(OV_PREFIX_CACHE), true)
+    DFLAGS += -DOV_PREFIX_BLOB=\"$(PRJ_DIR)/data/ov_prefix.blob\"
+endif
+ifeq ($(BLOB_JOURNAL), true)
+    DFLAGS += -DSDO_BLOB_JOURNAL=\"$(PRJ_DIR)/data/blob_journal.blob\"
+endif
+ifeq ($(IDENTITY_STORE), true)
+    DFLAGS += -DSDO_IDENTITY_STORE=\"$(PRJ_DIR)/data/identities.bin\"
+endif
+ifneq ($(NET_REPLAY), false)
+    DFLAGS += -DSDO_TRANSCRIPT=\"$(PRJ_DIR)/data/transcript.dat\"
+endif
 endif
 
 ifeq ($(TARGET_OS), mbedos)
@@ -263,6 +361,22 @@ ifneq ("$(HTTPPROXY)", "")
     DFLAGS += -DRV_PROXY=\"data/rv_proxy.dat\"
     DFLAGS += -DOWNER_PROXY=\"data/owner_proxy.dat\"
 endif
+ifeq ($(EPID_PRECOMP_PERSIST), true)
+    DFLAGS += -DEPID_PRECOMP_BLOB=\"data/epid_precomp.blob\"
+endif
+ifeq ($(EPID_SIGRL_PERSIST), true)
+    DFLAGS += -DEPID_SIGRL_BLOB=\"data/epid_sigrl.blob\"
+endif
+ifeq ($(CSR_CACHE), true)
+    DFLAGS += -DDEVICE_CSR_BLOB=\"data/device_csr.blob\"
+endif
+ifeq ($(OSI_APPLIED_CACHE), true)
+    DFLAGS += -DOSI_APPLIED_BLOB=\"data/osi_applied.blob\"
+endif
+ifeq ($(BLOB_CONTAINER), true)
+    DFLAGS += -DSDO_BLOB_CONTAINER=\"data/blobs.bin\"
+endif
+    DFLAGS += -DSD_CACHE=$(SD_CACHE)
 endif
 
 ### We don't want any logs when running unit tests
@@ -294,6 +408,251 @@ ifeq ($(RETRY), false)
 DFLAGS += -DRETRY_FALSE
 endif
 
+ifeq ($(KEEP_ALIVE), false)
+DFLAGS += -DKEEP_ALIVE_FALSE
+endif
+
+ifeq ($(TLS_SESSION_CACHE), false)
+DFLAGS += -DTLS_SESSION_CACHE_FALSE
+endif
+
+ifeq ($(TLS_EARLY_DATA), true)
+ifneq ($(TLS), openssl)
+$(error TLS_EARLY_DATA needs TLS=openssl)
+endif
+ifeq ($(TLS_SESSION_CACHE), false)
+$(error TLS_EARLY_DATA needs TLS_SESSION_CACHE=true)
+endif
+ifeq ($(HTTP2), true)
+$(error TLS_EARLY_DATA needs HTTP2=false)
+endif
+DFLAGS += -DTLS_EARLY_DATA
+endif
+
+ifeq ($(TCP_FASTOPEN), true)
+ifneq ($(TARGET_OS), linux)
+$(error TCP_FASTOPEN needs TARGET_OS=linux)
+endif
+DFLAGS += -DSDO_TCP_FASTOPEN
+endif
+
+DFLAGS += -DDNS_CACHE_TTL=$(DNS_CACHE_TTL)
+
+ifeq ($(RV_PROBE), true)
+DFLAGS += -DRV_PROBE_ENABLED
+endif
+
+DFLAGS += -DRV_REDIRECT_TTL=$(RV_REDIRECT_TTL)
+
+ifeq ($(TO2_RESUME), true)
+DFLAGS += -DTO2_RESUME -DTO2_RESUME_TTL=$(TO2_RESUME_TTL)
+endif
+
+ifeq ($(PROT_STATS), false)
+DFLAGS += -DPROT_STATS_FALSE
+endif
+
+ifeq ($(CRYPTO_STATS), true)
+DFLAGS += -DCRYPTO_STATS
+endif
+
+ifneq ($(TRACE_EVENTS), 0)
+DFLAGS += -DSDO_TRACE=$(TRACE_EVENTS)
+endif
+
+ifeq ($(ALLOC_STATS), true)
+DFLAGS += -DALLOC_STATS
+endif
+
+ifeq ($(STORAGE_STATS), true)
+DFLAGS += -DSTORAGE_STATS
+endif
+
+ifeq ($(LOG_ASYNC), true)
+ifneq ($(TARGET_OS), linux)
+$(error LOG_ASYNC needs TARGET_OS=linux)
+endif
+DFLAGS += -DLOG_ASYNC
+endif
+
+ifeq ($(HTTP_DEFLATE), true)
+ifneq ($(TARGET_OS), linux)
+$(error HTTP_DEFLATE needs TARGET_OS=linux)
+endif
+DFLAGS += -DHTTP_DEFLATE
+endif
+
+ifeq ($(HTTP2), true)
+ifneq ($(TARGET_OS), linux)
+$(error HTTP2 needs TARGET_OS=linux)
+endif
+ifeq ($(HTTP_DEFLATE), true)
+$(error HTTP2 needs HTTP_DEFLATE=false)
+endif
+ifneq ($(NET_TRANSPORT), http)
+$(error HTTP2 needs NET_TRANSPORT=http)
+endif
+DFLAGS += -DHTTP2
+endif
+
+ifeq ($(OWNER_PRECONNECT), false)
+DFLAGS += -DOWNER_PRECONNECT_FALSE
+endif
+
+ifeq ($(PROXY_TUNNEL), true)
+ifneq ($(TARGET_OS), linux)
+$(error PROXY_TUNNEL needs TARGET_OS=linux)
+endif
+ifneq ($(HTTPPROXY), true)
+$(error PROXY_TUNNEL needs HTTPPROXY=true)
+endif
+DFLAGS += -DPROXY_TUNNEL
+endif
+
+ifeq ($(STATIC_MEM), true)
+ifeq ($(ALLOC_STATS), true)
+$(error STATIC_MEM=true needs ALLOC_STATS=false)
+endif
+DFLAGS += -DSTATIC_MEM -DSDO_MEM_BLOCK_SIZE=$(STATIC_MEM_BLOCK)
+endif
+
+ifneq ($(filter record play,$(NET_REPLAY)),)
+ifeq ($(BUILD), release)
+$(error NET_REPLAY requires BUILD=debug)
+endif
+endif
+ifeq ($(NET_REPLAY), record)
+DFLAGS += -DNET_RECORD -DCRYPTO_FIXED_RANDOM
+endif
+ifeq ($(NET_REPLAY), play)
+DFLAGS += -DNET_REPLAY -DCRYPTO_FIXED_RANDOM
+endif
+
+ifeq ($(NET_TRANSPORT), coap)
+ifneq ($(TARGET_OS), linux)
+$(error NET_TRANSPORT=coap needs TARGET_OS=linux)
+endif
+ifneq ($(HTTPPROXY), false)
+$(error NET_TRANSPORT=coap needs HTTPPROXY=false)
+endif
+ifneq ($(NET_REPLAY), false)
+$(error NET_TRANSPORT=coap needs NET_REPLAY=false)
+endif
+ifeq ($(HTTP_DEFLATE), true)
+$(error NET_TRANSPORT=coap needs HTTP_DEFLATE=false)
+endif
+else ifneq ($(NET_TRANSPORT), http)
+$(error Supported values for NET_TRANSPORT are: http coap)
+endif
+
+ifeq ($(BASE64_SIMD), false)
+DFLAGS += -DBASE64_SIMD_FALSE
+endif
+
+ifeq ($(JSON_SIMD), false)
+DFLAGS += -DJSON_SIMD_FALSE
+endif
+
+ifeq ($(SINGLE_SUITE), true)
+DFLAGS += -DSDO_SINGLE_SUITE
+endif
+
+ifeq ($(ECC_RESTARTABLE), true)
+ifneq ($(TLS), mbedtls)
+$(error ECC_RESTARTABLE needs TLS=mbedtls)
+endif
+# mbedTLS is built with the same flags on mbedOS
+DFLAGS += -DECC_RESTARTABLE -DECC_SLICE_OPS=$(ECC_SLICE_OPS)
+DFLAGS += -DMBEDTLS_ECP_RESTARTABLE
+endif
+
+ifeq ($(CRYPTO_DISPATCH), false)
+DFLAGS += -DCRYPTO_DISPATCH_FALSE
+endif
+
+ifeq ($(BLOB_CACHE), false)
+DFLAGS += -DBLOB_CACHE_FALSE
+endif
+
+ifeq ($(CONFIG_SNAPSHOT), false)
+DFLAGS += -DCONFIG_SNAPSHOT_FALSE
+endif
+
+ifeq ($(DSI_CACHE), false)
+DFLAGS += -DDSI_CACHE_FALSE
+endif
+
+ifeq ($(DSI_ASYNC), false)
+DFLAGS += -DDSI_ASYNC_FALSE
+endif
+
+ifeq ($(OSI_ASYNC), false)
+DFLAGS += -DOSI_ASYNC_FALSE
+endif
+
+ifneq ($(DSI_PACK), 0)
+DFLAGS += -DDSI_PACK=$(DSI_PACK)
+endif
+
+ifneq ($(OV_PIPELINE), 0)
+DFLAGS += -DOV_PIPELINE=$(OV_PIPELINE)
+endif
+
+ifeq ($(CRED_BINARY), false)
+DFLAGS += -DCRED_BINARY_FALSE
+endif
+
+ifeq ($(LAZY_INIT), false)
+DFLAGS += -DLAZY_INIT_FALSE
+endif
+
+ifeq ($(ARENA), false)
+DFLAGS += -DARENA_FALSE
+endif
+
+ifeq ($(RX_STREAM), true)
+ifeq ($(ARENA), false)
+$(error RX_STREAM=true needs ARENA=true)
+endif
+DFLAGS += -DRX_STREAM_ENABLED
+endif
+
+ifeq ($(WIRE), cbor)
+DFLAGS += -DWIRE_CBOR_ENABLED
+else ifneq ($(WIRE), json)
+$(error WIRE must be json or cbor)
+endif
+
+ifneq ($(OV_VERIFY_THREADS), 0)
+DFLAGS += -DOV_VERIFY_THREADS=$(OV_VERIFY_THREADS)
+DFLAGS += -DOV_VERIFY_QUEUE=$(OV_VERIFY_QUEUE)
+endif
+
+DFLAGS += -DSDO_TASK_WORKERS=$(TASK_WORKERS)
+DFLAGS += -DSDO_TASK_QUEUE=$(TASK_QUEUE)
+
+ifneq ($(RANDOM_POOL), 0)
+DFLAGS += -DRANDOM_POOL=$(RANDOM_POOL)
+endif
+
+ifneq ($(EPID_PRESIGS), 0)
+DFLAGS += -DEPID_PRESIGS=$(EPID_PRESIGS)
+endif
+
+ifneq ($(IV_RESERVE), 0)
+DFLAGS += -DPLATFORM_IV_RESERVE=$(IV_RESERVE)
+endif
+
+ifeq ($(CRED_ASYNC), true)
+ifneq ($(TARGET_OS), linux)
+$(error CRED_ASYNC=true needs TARGET_OS=linux)
+endif
+ifneq ($(BLOB_JOURNAL), true)
+$(error CRED_ASYNC=true needs BLOB_JOURNAL=true)
+endif
+DFLAGS += -DCRED_WRITE_ASYNC
+endif
+
 CFLAGS +=-I$(SAFESTRING_ROOT)/include
 
 ### CSTD validation
@@ -6,6 +6,10 @@ include crypto/conf.mk
 
 ### Common crypto
 common-srcs-y += sdoOvVerify.c sdoKeyExchange.c sdoAes.c sdoHmac.c sdoDevSign.c sdoCryptoCommon.c sdoDevAttest.c
+common-srcs-y += sdoBase64.c sdoCryptoStats.c
+ifeq ($(CRYPTO_HW), true)
+        common-srcs-y += sdoDER.c
+endif
 
 ifeq ($(KEX), asym)
         common-srcs-y += sdokeyexchange_asym.c
@@ -13,7 +17,7 @@ endif
 
 ### OpenSSL
 ifeq ($(TLS), openssl)
-    crypto-srcs-y += openssl_AESRoutines.c openssl_cryptoSupport.c openssl_SSLRoutines.c openssl_base64.c
+    crypto-srcs-y += openssl_AESRoutines.c openssl_cryptoSupport.c openssl_SSLRoutines.c
 
     ifeq ($(CRYPTO_HW), false)
         crypto-srcs-y += openssl_AESGCMRoutines.c
@@ -62,7 +66,8 @@ endif
 
 ### mbedTLS
 ifeq ($(TLS), mbedtls)
-    crypto-srcs-y += mbedtls_AESRoutines.c mbedtls_cryptoSupport.c mbedtls_SSLRoutines.c mbedtls_random.c mbedtls_base64.c
+    crypto-srcs-y += mbedtls_AESRoutines.c mbedtls_cryptoSupport.c mbedtls_SSLRoutines.c mbedtls_random.c
+    crypto-srcs-y += mbedtls_dispatch.c
 
     ifeq ($(CRYPTO_HW), false)
         crypto-srcs-y += mbedtls_AESGCMRoutines.c
@@ -9,6 +9,7 @@
 #include "sdoCryptoCtx.h"
 #include "sdoCryptoApi.h"
 #include "network_al.h"
+#include "sdoCryptoTimed.h"
 
 /**
  * This API helps compute the size of the buffer that holds the ciphertext
@@ -125,7 +126,7 @@ int32_t sdoMsgEncrypt(uint8_t *clearText, uint32_t clearTextLength,
 	uint8_t *sek;
 	uint8_t sekLen;
 
-	if (!keyset) {
+	if (!keyset || sdoKexComplete() != 0) {
 		goto error;
 	}
 
@@ -200,7 +201,7 @@ int32_t sdoMsgDecrypt(uint8_t *clearText, uint32_t *clearTextLength,
 	uint8_t *sek;
 	uint8_t sekLen;
 
-	if (!keyset) {
+	if (!keyset || sdoKexComplete() != 0) {
 		goto error;
 	}
 	sek = keyset->sek->bytes;
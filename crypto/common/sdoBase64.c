@@ -0,0 +1,578 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Base64 encoding/decoding utilities.
+ *
+ * Whole blocks are converted by vector kernels where the CPU has them
+ * (AVX2 or SSE4.1 on x86, NEON on AArch64), selected at run time. The rest
+ * of the data, and padding, is converted by the scalar code.
+ */
+
+#include "base64.h"
+
+#if !defined(BASE64_SIMD_FALSE) && defined(__GNUC__) &&                      \
+    (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#elif !defined(BASE64_SIMD_FALSE) && defined(__aarch64__) &&                  \
+    defined(__ARM_NEON)
+#define BASE64_NEON
+#include <arm_neon.h>
+#endif
+
+/* Kernels return the number of source bytes they converted */
+typedef size_t (*b64Kernel_t)(const uint8_t *src, size_t srcLen, uint8_t *dst,
+			      size_t dstLen);
+
+static const char b64EncTab[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Value of a base64 character, 0xff if the character is invalid */
+static const uint8_t b64DecTab[256] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0x3e, 0xff, 0xff, 0xff, 0x3f,
+	0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b,
+	0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+	0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+	0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16,
+	0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20,
+	0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30,
+	0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+};
+
+#ifdef BASE64_X86
+/*
+ * The x86 kernels follow W. Mula and D. Lemire, "Faster Base64 Encoding
+ * and Decoding Using AVX2 Instructions": bytes are spread into 6-bit
+ * indices with multiplies, and characters are validated and translated
+ * with nibble lookups.
+ */
+
+/**
+ * Internal API: 16 base64 characters of 12 bytes, in the low 12 bytes of
+ * in.
+ */
+__attribute__((target("ssse3,sse4.1"))) static inline __m128i
+b64EncodeSSE(__m128i in)
+{
+	__m128i t0, t1, t2, t3, idx, res, less;
+
+	in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4,
+					       5, 3, 4, 1, 2, 0, 1));
+	t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+	t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+	t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+	t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+	idx = _mm_or_si128(t1, t3);
+
+	/* offset of each index to its character */
+	res = _mm_subs_epu8(idx, _mm_set1_epi8(51));
+	less = _mm_cmpgt_epi8(_mm_set1_epi8(26), idx);
+	res = _mm_or_si128(res, _mm_and_si128(less, _mm_set1_epi8(13)));
+	res = _mm_shuffle_epi8(
+	    _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			  '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+			  '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0),
+	    res);
+	return _mm_add_epi8(res, idx);
+}
+
+/**
+ * Internal API: values of 16 base64 characters, false if one is invalid.
+ */
+__attribute__((target("ssse3,sse4.1"))) static inline bool
+b64DecodeSSE(__m128i in, __m128i *out)
+{
+	__m128i hi = _mm_and_si128(_mm_srli_epi32(in, 4), _mm_set1_epi8(0x0f));
+	__m128i lo = _mm_and_si128(in, _mm_set1_epi8(0x0f));
+	__m128i shift, mask, bit, res;
+
+	shift = _mm_shuffle_epi8(_mm_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71,
+					       0, 0, 0, 0, 0, 0, 0, 0),
+				 hi);
+	shift = _mm_blendv_epi8(shift, _mm_set1_epi8(16),
+				_mm_cmpeq_epi8(in, _mm_set1_epi8('/')));
+	mask = _mm_shuffle_epi8(
+	    _mm_setr_epi8((char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8,
+			  (char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+			  (char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50,
+			  0x50, 0x54),
+	    lo);
+	bit = _mm_shuffle_epi8(_mm_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20,
+					     0x40, (char)0x80, 0, 0, 0, 0, 0, 0,
+					     0, 0),
+			       hi);
+	if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(mask, bit),
+					     _mm_setzero_si128())))
+		return false;
+
+	/* pack 4 x 6 bits into 3 bytes, in the low 12 bytes */
+	res = _mm_add_epi8(in, shift);
+	res = _mm_maddubs_epi16(res, _mm_set1_epi32(0x01400140));
+	res = _mm_madd_epi16(res, _mm_set1_epi32(0x00011000));
+	*out = _mm_shuffle_epi8(res, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8,
+						   14, 13, 12, -1, -1, -1, -1));
+	return true;
+}
+
+/**
+ * Internal API: SSE4.1 encoding of 12 byte blocks.
+ */
+__attribute__((target("ssse3,sse4.1"))) static size_t
+b64EncodeBlocksSSE(const uint8_t *src, size_t srcLen, uint8_t *dst,
+		   size_t dstLen)
+{
+	size_t i = 0, o = 0;
+
+	/* 16 bytes are loaded for 12 bytes of input */
+	while (i + 16 <= srcLen && o + 16 <= dstLen) {
+		__m128i in = _mm_loadu_si128((const __m128i *)&src[i]);
+
+		_mm_storeu_si128((__m128i *)&dst[o], b64EncodeSSE(in));
+		i += 12;
+		o += 16;
+	}
+	return i;
+}
+
+/**
+ * Internal API: SSE4.1 decoding of 16 character blocks.
+ */
+__attribute__((target("ssse3,sse4.1"))) static size_t
+b64DecodeBlocksSSE(const uint8_t *src, size_t srcLen, uint8_t *dst,
+		   size_t dstLen)
+{
+	size_t i = 0, o = 0;
+	__m128i out;
+
+	/* 16 bytes are stored for 12 bytes of output */
+	while (i + 16 <= srcLen && o + 16 <= dstLen) {
+		if (!b64DecodeSSE(_mm_loadu_si128((const __m128i *)&src[i]),
+				  &out))
+			break;
+		_mm_storeu_si128((__m128i *)&dst[o], out);
+		i += 16;
+		o += 12;
+	}
+	return i;
+}
+
+/**
+ * Internal API: AVX2 encoding of 24 byte blocks.
+ */
+__attribute__((target("avx2"))) static size_t
+b64EncodeBlocksAVX2(const uint8_t *src, size_t srcLen, uint8_t *dst,
+		    size_t dstLen)
+{
+	size_t i = 0, o = 0;
+	__m256i in, t0, t1, t2, t3, idx, res, less;
+
+	/* each lane loads 16 bytes for 12 bytes of input */
+	while (i + 28 <= srcLen && o + 32 <= dstLen) {
+		in = _mm256_inserti128_si256(
+		    _mm256_castsi128_si256(
+			_mm_loadu_si128((const __m128i *)&src[i])),
+		    _mm_loadu_si128((const __m128i *)&src[i + 12]), 1);
+		in = _mm256_shuffle_epi8(
+		    in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4,
+					1, 2, 0, 1, 10, 11, 9, 10, 7, 8, 6, 7,
+					4, 5, 3, 4, 1, 2, 0, 1));
+		t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+		t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+		t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+		t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+		idx = _mm256_or_si256(t1, t3);
+
+		res = _mm256_subs_epu8(idx, _mm256_set1_epi8(51));
+		less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), idx);
+		res = _mm256_or_si256(
+		    res, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+		res = _mm256_shuffle_epi8(
+		    _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52,
+				     '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				     '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+				     '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52,
+				     '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				     '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+				     '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0),
+		    res);
+		_mm256_storeu_si256((__m256i *)&dst[o],
+				    _mm256_add_epi8(res, idx));
+		i += 24;
+		o += 32;
+	}
+	return i;
+}
+
+/**
+ * Internal API: AVX2 decoding of 32 character blocks.
+ */
+__attribute__((target("avx2"))) static size_t
+b64DecodeBlocksAVX2(const uint8_t *src, size_t srcLen, uint8_t *dst,
+		    size_t dstLen)
+{
+	size_t i = 0, o = 0;
+	__m256i in, hi, lo, shift, mask, bit, res;
+
+	/* 32 bytes are stored for 24 bytes of output */
+	while (i + 32 <= srcLen && o + 32 <= dstLen) {
+		in = _mm256_loadu_si256((const __m256i *)&src[i]);
+		hi = _mm256_and_si256(_mm256_srli_epi32(in, 4),
+				      _mm256_set1_epi8(0x0f));
+		lo = _mm256_and_si256(in, _mm256_set1_epi8(0x0f));
+
+		shift = _mm256_shuffle_epi8(
+		    _mm256_setr_epi8(0, 0, 19, 4, -65, -65, -71, -71, 0, 0, 0,
+				     0, 0, 0, 0, 0, 0, 0, 19, 4, -65, -65, -71,
+				     -71, 0, 0, 0, 0, 0, 0, 0, 0),
+		    hi);
+		shift = _mm256_blendv_epi8(
+		    shift, _mm256_set1_epi8(16),
+		    _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')));
+		mask = _mm256_shuffle_epi8(
+		    _mm256_setr_epi8(
+			(char)0xa8, (char)0xf8, (char)0xf8, (char)0xf8,
+			(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+			(char)0xf8, (char)0xf8, (char)0xf0, 0x54, 0x50, 0x50,
+			0x50, 0x54, (char)0xa8, (char)0xf8, (char)0xf8,
+			(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf8,
+			(char)0xf8, (char)0xf8, (char)0xf8, (char)0xf0, 0x54,
+			0x50, 0x50, 0x50, 0x54),
+		    lo);
+		bit = _mm256_shuffle_epi8(
+		    _mm256_setr_epi8(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+				     (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0x01,
+				     0x02, 0x04, 0x08, 0x10, 0x20, 0x40,
+				     (char)0x80, 0, 0, 0, 0, 0, 0, 0, 0),
+		    hi);
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_and_si256(mask, bit), _mm256_setzero_si256())))
+			break;
+
+		res = _mm256_add_epi8(in, shift);
+		res = _mm256_maddubs_epi16(res, _mm256_set1_epi32(0x01400140));
+		res = _mm256_madd_epi16(res, _mm256_set1_epi32(0x00011000));
+		res = _mm256_shuffle_epi8(
+		    res, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13,
+					  12, -1, -1, -1, -1, 2, 1, 0, 6, 5, 4,
+					  10, 9, 8, 14, 13, 12, -1, -1, -1,
+					  -1));
+		/* join the 12 bytes of both lanes */
+		res = _mm256_permutevar8x32_epi32(
+		    res, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+		_mm256_storeu_si256((__m256i *)&dst[o], res);
+		i += 32;
+		o += 24;
+	}
+	return i;
+}
+#endif /* BASE64_X86 */
+
+#ifdef BASE64_NEON
+/**
+ * Internal API: load a 64 byte lookup table.
+ */
+static inline uint8x16x4_t b64LoadTab(const uint8_t *tab)
+{
+	uint8x16x4_t t;
+
+	t.val[0] = vld1q_u8(&tab[0]);
+	t.val[1] = vld1q_u8(&tab[16]);
+	t.val[2] = vld1q_u8(&tab[32]);
+	t.val[3] = vld1q_u8(&tab[48]);
+	return t;
+}
+
+/**
+ * Internal API: NEON encoding of 48 byte blocks.
+ */
+static size_t b64EncodeBlocksNEON(const uint8_t *src, size_t srcLen,
+				  uint8_t *dst, size_t dstLen)
+{
+	const uint8x16x4_t tab = b64LoadTab((const uint8_t *)b64EncTab);
+	const uint8x16_t m6 = vdupq_n_u8(0x3f);
+	size_t i = 0, o = 0;
+	uint8x16x3_t in;
+	uint8x16x4_t out;
+
+	while (i + 48 <= srcLen && o + 64 <= dstLen) {
+		in = vld3q_u8(&src[i]);
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4),
+					       vshrq_n_u8(in.val[1], 4)),
+				      m6);
+		out.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2),
+					       vshrq_n_u8(in.val[2], 6)),
+				      m6);
+		out.val[3] = vandq_u8(in.val[2], m6);
+		out.val[0] = vqtbl4q_u8(tab, out.val[0]);
+		out.val[1] = vqtbl4q_u8(tab, out.val[1]);
+		out.val[2] = vqtbl4q_u8(tab, out.val[2]);
+		out.val[3] = vqtbl4q_u8(tab, out.val[3]);
+		vst4q_u8(&dst[o], out);
+		i += 48;
+		o += 64;
+	}
+	return i;
+}
+
+/**
+ * Internal API: NEON decoding of 64 character blocks.
+ */
+static size_t b64DecodeBlocksNEON(const uint8_t *src, size_t srcLen,
+				  uint8_t *dst, size_t dstLen)
+{
+	const uint8x16x4_t lo = b64LoadTab(&b64DecTab[0]);
+	const uint8x16x4_t hi = b64LoadTab(&b64DecTab[64]);
+	const uint8x16_t c64 = vdupq_n_u8(64);
+	const uint8x16_t c128 = vdupq_n_u8(128);
+	size_t i = 0, o = 0;
+	uint8x16x4_t in;
+	uint8x16x3_t out;
+	uint8x16_t bad;
+	int k;
+
+	while (i + 64 <= srcLen && o + 48 <= dstLen) {
+		in = vld4q_u8(&src[i]);
+		bad = vdupq_n_u8(0);
+		for (k = 0; k < 4; k++) {
+			/* characters >= 128 are invalid, but select 0 */
+			bad = vorrq_u8(bad, vcgeq_u8(in.val[k], c128));
+			/* out-of-range indices select 0, so OR both halves */
+			in.val[k] = vorrq_u8(
+			    vqtbl4q_u8(lo, in.val[k]),
+			    vqtbl4q_u8(hi, vsubq_u8(in.val[k], c64)));
+			/* invalid characters are 0xff */
+			bad = vorrq_u8(bad, in.val[k]);
+		}
+		if (vmaxvq_u8(bad) > 0x3f)
+			break;
+
+		out.val[0] = vorrq_u8(vshlq_n_u8(in.val[0], 2),
+				      vshrq_n_u8(in.val[1], 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(in.val[1], 4),
+				      vshrq_n_u8(in.val[2], 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(in.val[2], 6), in.val[3]);
+		vst3q_u8(&dst[o], out);
+		i += 64;
+		o += 48;
+	}
+	return i;
+}
+#endif /* BASE64_NEON */
+
+static b64Kernel_t b64EncodeBlocks;
+static b64Kernel_t b64DecodeBlocks;
+static bool b64KernelsSelected;
+
+/**
+ * Internal API: select the vector kernels supported by the CPU.
+ */
+static void b64SelectKernels(void)
+{
+#if defined(BASE64_X86)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		b64EncodeBlocks = b64EncodeBlocksAVX2;
+		b64DecodeBlocks = b64DecodeBlocksAVX2;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		b64EncodeBlocks = b64EncodeBlocksSSE;
+		b64DecodeBlocks = b64DecodeBlocksSSE;
+	}
+#elif defined(BASE64_NEON)
+	b64EncodeBlocks = b64EncodeBlocksNEON;
+	b64DecodeBlocks = b64DecodeBlocksNEON;
+#endif
+	b64KernelsSelected = true;
+}
+
+/**
+ * Computes length of base64 output given binary input.
+ * @param binLength length of binary data.
+ * @return number of bytes of binary data this will convert into
+ */
+int binToB64Length(int binLength)
+{
+	/* Base64 length is ceil(4*(n/3)). */
+	if (binLength)
+		return (((binLength + 2) / 3) * 4);
+	else
+		return 0;
+}
+
+/**
+ * Computes length of binary output given base64 input.
+ * Actual output depends on the number of '=' at the end of the input stream.
+ * This API would return the maximum probable buffer size.
+ * @param b64Len length of b64 data, will be rounded down to a mulitple of 4.
+ * @return number of bytes of binary data this will convert into
+ */
+int b64ToBinLength(int b64Len)
+{
+	if (b64Len)
+		return ((b64Len / 4) * 3 + 2);
+	else
+		return 0;
+}
+
+/**
+ * Converts binary to base64.
+ * This routine does NOT put a zero at the end, do not assume the result is a
+ * string
+ * @param binLength number of binary input bytes
+ * @param binBytes binary input
+ * @param binOffset offset of binBytes to first input byte
+ * @param b64Len number of free bytes in the buffer
+ * @param b64Bytes output bytes, should be at least
+ * b64Offset+binToB64Length(length) bytes
+ * @param b64Offset offset into output array
+ * @return number of bytes in b64 representation, -1 on failures
+ */
+int binToB64(size_t binLength, uint8_t *binBytes, size_t binOffset,
+	     size_t b64Len, uint8_t *b64Bytes, size_t b64Offset)
+{
+	const uint8_t *src;
+	uint8_t *dst;
+	size_t i = 0, o = 0;
+	uint32_t v;
+
+	if (!binLength || !binBytes || !b64Bytes ||
+	    binLength > (size_t)INT32_MAX / 4 * 3 ||
+	    b64Len < (size_t)binToB64Length((int)binLength))
+		return -1;
+
+	src = &binBytes[binOffset];
+	dst = &b64Bytes[b64Offset];
+
+	if (!b64KernelsSelected)
+		b64SelectKernels();
+	if (b64EncodeBlocks) {
+		i = b64EncodeBlocks(src, binLength, dst, b64Len);
+		o = i / 3 * 4;
+	}
+
+	for (; i + 3 <= binLength; i += 3) {
+		v = (uint32_t)src[i] << 16 | (uint32_t)src[i + 1] << 8 |
+		    src[i + 2];
+		dst[o++] = b64EncTab[v >> 18];
+		dst[o++] = b64EncTab[(v >> 12) & 0x3f];
+		dst[o++] = b64EncTab[(v >> 6) & 0x3f];
+		dst[o++] = b64EncTab[v & 0x3f];
+	}
+
+	if (i < binLength) {
+		v = (uint32_t)src[i] << 16;
+		if (i + 1 < binLength)
+			v |= (uint32_t)src[i + 1] << 8;
+		dst[o++] = b64EncTab[v >> 18];
+		dst[o++] = b64EncTab[(v >> 12) & 0x3f];
+		dst[o++] = (i + 1 < binLength) ? b64EncTab[(v >> 6) & 0x3f]
+					       : '=';
+		dst[o++] = '=';
+	}
+
+	return (int)o;
+}
+
+/**
+ * Convert base64 input into binary output.
+ * The output buffer may exactly overlap the input buffer, to achieve in-place
+ * conversion.
+ * Output buffer must be at least binOffset+binToB64(...) bytes long.
+ * The input is padded base64: a length under 4 decodes to nothing, and
+ * any other length that is not a multiple of 4 is invalid (the OpenSSL
+ * backend used to decode the whole quanta of such input, the mbedTLS one
+ * rejected it).
+ * @param b64Len number of base64 input bytes
+ * @param b64bytes base64 input
+ * @param b64Offset offset to first byte of base64 input
+ * @param binLen number of binary output buffer bytes
+ * @param binBytes output buffer.  Compute length with b64ToBinLength
+ * @param binOffset offset into output buffer
+ * @return length of binary output, -1 if the base64 string is invalid.
+ */
+int b64ToBin(size_t b64Len, uint8_t *b64bytes, size_t b64Offset, size_t binLen,
+	     uint8_t *binBytes, size_t binOffset)
+{
+	const uint8_t *src;
+	uint8_t *dst;
+	size_t i = 0, o = 0;
+	uint8_t a, b, c, d;
+
+	if (!binLen || !binBytes || !b64bytes)
+		return -1;
+
+	if ((b64Len & (size_t)(~3)) == 0)
+		return 0;
+	if (b64Len % 4 || b64Len > INT32_MAX)
+		return -1;
+
+	src = &b64bytes[b64Offset];
+	dst = &binBytes[binOffset];
+
+	/* the last quantum may hold padding, leave it to the scalar code */
+	if (!b64KernelsSelected)
+		b64SelectKernels();
+	if (b64DecodeBlocks) {
+		i = b64DecodeBlocks(src, b64Len - 4, dst, binLen);
+		o = i / 4 * 3;
+	}
+
+	for (; i < b64Len; i += 4) {
+		a = b64DecTab[src[i]];
+		b = b64DecTab[src[i + 1]];
+		c = b64DecTab[src[i + 2]];
+		d = b64DecTab[src[i + 3]];
+
+		if (i + 4 == b64Len && src[i + 3] == '=') {
+			if (src[i + 2] == '=')
+				c = 0;
+			d = 0;
+		}
+		if ((a | b | c | d) & 0xc0)
+			return -1;
+
+		if (o >= binLen)
+			return -1;
+		dst[o++] = (uint8_t)(a << 2 | b >> 4);
+		if (i + 4 == b64Len && src[i + 2] == '=')
+			break;
+		if (o >= binLen)
+			return -1;
+		dst[o++] = (uint8_t)(b << 4 | c >> 2);
+		if (i + 4 == b64Len && src[i + 3] == '=')
+			break;
+		if (o >= binLen)
+			return -1;
+		dst[o++] = (uint8_t)(c << 6 | d);
+	}
+
+	return o ? (int)o : -1;
+}
@@ -6,6 +6,7 @@
 #ifndef __CRYTPO_API_H__
 #define __CRYTPO_API_H__
 
+#include "sdo.h"
 #include "crypto_utils.h"
 #include "util.h"
 #include <stdlib.h>
@@ -78,23 +79,49 @@
 #define SDO_PK_ENC SDO_CRYPTO_PUB_KEY_ENCODING_EPID
 #endif
 
+/* Parts of the crypto layer, brought up by sdoCryptoRequire */
+#define SDO_CRYPTO_ENGINE 0x1 // crypto library, DRBG and secure element
+#define SDO_CRYPTO_ATTEST 0x2 // device attestation (EPID context)
+#define SDO_CRYPTO_ALL (SDO_CRYPTO_ENGINE | SDO_CRYPTO_ATTEST)
+
 /* Function declarations */
 int32_t sdoCryptoInit(void);
+int32_t sdoCryptoRequire(unsigned int parts);
 int32_t sdoCryptoClose(void);
 
 int32_t sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes);
+int32_t sdoCryptoRandomPrefetch(void);
+void sdoCryptoOpDone(int op, size_t bytes, uint64_t startUs);
+uint64_t sdoCryptoTimeUs(void);
+int32_t sdoCryptoStatsGet(sdoSdkCryptoStats *stats);
+int32_t sdoCryptoStatsReset(void);
 
 int32_t sdoKexInit(void);
+int32_t sdoKexPrepare(void);
+void sdoKexPoll(void);
+int32_t sdoKexComplete(void);
 int32_t sdoKexClose(void);
 
 SDOString_t *sdoGetDeviceKexMethod(void);
 SDOString_t *sdoGetDeviceCryptoSuite(void);
 SDOByteArray_t **getOVKey(void);
+bool *getOVKeyReady(void);
 SDOEPIDInfoeB_t **getDeviceSigCtx(void);
 int32_t setOVKey(SDOByteArray_t *OVkey, size_t OVKeyLen);
 int32_t sdoOVVerify(uint8_t *message, uint32_t messageLength,
 		    uint8_t *messageSignature, uint32_t signatureLength,
 		    SDOPublicKey_t *pubkey, bool *result);
+int32_t sdoOVVerifyInit(void **context);
+int32_t sdoOVVerifyUpdate(void *context, const uint8_t *message, size_t len);
+int32_t sdoOVVerifyFinal(void **context, uint8_t *messageSignature,
+			 uint32_t signatureLength, SDOPublicKey_t *pubkey,
+			 bool *result);
+int32_t sdoOVBatchInit(void **batch);
+int32_t sdoOVBatchAdd(void *batch, void **context, uint8_t *messageSignature,
+		      uint32_t signatureLength, SDOPublicKey_t *pubkey);
+bool sdoOVBatchFailed(void *batch);
+int32_t sdoOVBatchFinal(void **batch, bool *result);
+void *sdoSigKeyGet(SDOPublicKey_t *pubkey);
 
 int32_t sdoMsgEncryptGetCipherLen(uint32_t clearLength, uint32_t *cipherLength);
 int32_t sdoMsgEncrypt(uint8_t *clearText, uint32_t clearTextLength,
@@ -106,8 +133,16 @@ int32_t sdoTo2HMAC(uint8_t *to2Msg, size_t to2MsgLen, uint8_t *hmac,
 		   size_t hmacLen);
 int32_t sdoDeviceOVHMAC(uint8_t *OVHdr, size_t OVHdrLen, uint8_t *hmac,
 			size_t hmacLen);
+int32_t sdoDeviceOVHMACInit(void **context);
+int32_t sdoDeviceOVHMACUpdate(void *context, const uint8_t *OVHdr,
+			      size_t OVHdrLen);
+int32_t sdoDeviceOVHMACFinal(void **context, uint8_t *hmac, size_t hmacLen);
 int32_t sdoCryptoHash(uint8_t *message, size_t messageLength, uint8_t *hash,
 		      size_t hashLength);
+int32_t sdoOVHashInit(void **context);
+int32_t sdoOVHashUpdate(void *context, const uint8_t *message,
+			size_t messageLength);
+int32_t sdoOVHashFinal(void **context, uint8_t *hash, size_t hashLength);
 int32_t sdoTo2chainedHMAC(uint8_t *to2Msg, size_t to2MsgLen, uint8_t *hmac,
 			  size_t hmacLen, const uint8_t *previousHMAC,
 			  size_t previousHMACLength);
@@ -120,6 +155,7 @@ int32_t sdoSetDeviceSigInfoeB(SDOByteArray_t *sigRL, SDOByteArray_t *pubkey);
 
 int32_t sdoDeviceSign(const uint8_t *message, size_t messageLength,
 		      SDOByteArray_t **signature);
+int32_t sdoDevicePreSign(void);
 
 sdoDevKeyCtx_t *getsdoDevKeyCtx(void);
 sdoKexCtx_t *getsdoKeyCtx(void);
@@ -127,10 +163,12 @@ sdoTo2SymEncCtx_t *getsdoTO2Ctx(void);
 int32_t dev_attestation_init(void);
 void dev_attestation_close(void);
 int32_t sdoGenerateOVHMACKey(void);
+int32_t sdoOVHMACKeyPrepare(void);
 int32_t sdoComputeStorageHMAC(const uint8_t *data, uint32_t dataLength,
 			      uint8_t *computedHmac, int computedHmacSize);
 int32_t sdoGenerateStorageHMACKey(void);
 
 int32_t sdoGetDeviceCsr(SDOByteArray_t **csr);
+int32_t sdoDeviceCsrPrepare(void);
 
 #endif /*__CRYTPO_API_H__ */
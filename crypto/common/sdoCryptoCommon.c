@@ -10,8 +10,26 @@
 #include "stdlib.h"
 #include "sdoCryptoCtx.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
+#include "sdocred.h"
+#include "storage_al.h"
 
-static sdoCryptoContext_t crypto_ctx;
+/* Context of the instance bound to this thread, see sdoCryptoCtxBind */
+static sdoCryptoContext_t default_crypto_ctx;
+static SDO_THREAD_LOCAL sdoCryptoContext_t *crypto_ctx = &default_crypto_ctx;
+
+/* The crypto engine is process wide, closed when no instance uses it */
+static unsigned int engine_users;
+SDO_MUTEX(engine_lock);
+#ifdef EPID_DA
+/* The EPID context is process wide too, only one instance may hold it */
+static sdoCryptoContext_t *attest_owner;
+#endif
+#ifdef CRYPTO_FIXED_RANDOM
+/* State of the fixed random sequence, started over with the engine */
+static uint64_t fixed_random_state;
+SDO_MUTEX(fixed_random_lock);
+#endif
 static void cleanup_ctx(void);
 
 /***********************************************************************************/
@@ -21,7 +39,7 @@ static void cleanup_ctx(void);
  */
 SDOString_t *sdoGetDeviceKexMethod(void)
 {
-	return crypto_ctx.kex.kx;
+	return crypto_ctx->kex.kx;
 }
 
 /**
@@ -30,7 +48,7 @@ SDOString_t *sdoGetDeviceKexMethod(void)
  */
 SDOString_t *sdoGetDeviceCryptoSuite(void)
 {
-	return crypto_ctx.kex.cs;
+	return crypto_ctx->kex.cs;
 }
 
 /**
@@ -39,7 +57,7 @@ SDOString_t *sdoGetDeviceCryptoSuite(void)
  */
 SDOAESKeyset_t *getKeyset(void)
 {
-	return &crypto_ctx.to2SymEnc.keyset;
+	return &crypto_ctx->to2SymEnc.keyset;
 }
 
 /**
@@ -48,7 +66,16 @@ SDOAESKeyset_t *getKeyset(void)
  */
 SDOByteArray_t **getOVKey(void)
 {
-	return &crypto_ctx.OVKey;
+	return &crypto_ctx->OVKey;
+}
+
+/**
+ * This function returns the address of the flag telling that the OV hmac
+ * key was generated ahead by sdoOVHMACKeyPrepare.
+ */
+bool *getOVKeyReady(void)
+{
+	return &crypto_ctx->OVKeyReady;
 }
 
 /**
@@ -57,7 +84,7 @@ SDOByteArray_t **getOVKey(void)
  */
 sdoDevKeyCtx_t *getsdoDevKeyCtx(void)
 {
-	return &crypto_ctx.devKey;
+	return &crypto_ctx->devKey;
 }
 
 /**
@@ -66,7 +93,7 @@ sdoDevKeyCtx_t *getsdoDevKeyCtx(void)
  */
 sdoKexCtx_t *getsdoKeyCtx(void)
 {
-	return &crypto_ctx.kex;
+	return &crypto_ctx->kex;
 }
 
 /**
@@ -75,51 +102,258 @@ sdoKexCtx_t *getsdoKeyCtx(void)
  */
 sdoTo2SymEncCtx_t *getsdoTO2Ctx(void)
 {
-	return &crypto_ctx.to2SymEnc;
+	return &crypto_ctx->to2SymEnc;
 }
 
+/**
+ * Bring the whole crypto layer up.
+ * @return 0 on success, -1 on failure.
+ */
 int32_t sdoCryptoInit(void)
+{
+	return sdoCryptoRequire(SDO_CRYPTO_ALL);
+}
+
+/**
+ * Bring up the parts of the crypto layer that are not up yet, so that each
+ * is only paid for once a protocol actually needs it.
+ * @param parts - SDO_CRYPTO_* flags.
+ * @return 0 on success, -1 on failure.
+ */
+int32_t sdoCryptoRequire(unsigned int parts)
 {
 	int32_t ret = -1;
 
-	if (cryptoInit()) {
-		goto err;
+	/* Attestation runs on the crypto library */
+	if (parts & SDO_CRYPTO_ATTEST)
+		parts |= SDO_CRYPTO_ENGINE;
+
+	SDO_LOCK(engine_lock);
+	if ((parts & SDO_CRYPTO_ENGINE) &&
+	    !(crypto_ctx->up & SDO_CRYPTO_ENGINE)) {
+#ifdef CRYPTO_FIXED_RANDOM
+		if (engine_users == 0) {
+			SDO_LOCK(fixed_random_lock);
+			fixed_random_state = 0;
+			SDO_UNLOCK(fixed_random_lock);
+		}
+#endif
+		if (engine_users == 0 && cryptoInit())
+			goto end;
+		engine_users++;
+		crypto_ctx->up |= SDO_CRYPTO_ENGINE;
 	}
-	if (dev_attestation_init()) {
-		goto err;
+	if ((parts & SDO_CRYPTO_ATTEST) &&
+	    !(crypto_ctx->up & SDO_CRYPTO_ATTEST)) {
+#ifdef EPID_DA
+		if (attest_owner) {
+			LOG(LOG_ERROR, "EPID attestation held by another "
+				       "instance\n");
+			goto end;
+		}
+#endif
+		if (dev_attestation_init())
+			goto end;
+#ifdef EPID_DA
+		attest_owner = crypto_ctx;
+#endif
+		crypto_ctx->up |= SDO_CRYPTO_ATTEST;
 	}
 	ret = 0;
-err:
+end:
+	SDO_UNLOCK(engine_lock);
 	return ret;
 }
 
 int32_t sdoCryptoClose(void)
 {
 	int32_t ret = 0;
-	dev_attestation_close();
 
-	ret = cryptoClose();
+	SDO_LOCK(engine_lock);
+	if (crypto_ctx->up & SDO_CRYPTO_ATTEST) {
+		dev_attestation_close();
+#ifdef EPID_DA
+		attest_owner = NULL;
+#endif
+	}
+	if ((crypto_ctx->up & SDO_CRYPTO_ENGINE) && --engine_users == 0)
+		ret = cryptoClose();
+	crypto_ctx->up = 0;
+	SDO_UNLOCK(engine_lock);
+
 	/* CLeanup of context structs */
 	cleanup_ctx();
 	return ret;
 }
 
+/**
+ * Allocate the crypto context of an SDK instance.
+ * @return context, NULL on failure.
+ */
+sdoCryptoContext_t *sdoCryptoCtxAlloc(void)
+{
+	return sdoAlloc(sizeof(sdoCryptoContext_t));
+}
+
+/**
+ * Make ctx the crypto context of the calling thread, NULL for the context
+ * of the single instance API.
+ */
+void sdoCryptoCtxBind(sdoCryptoContext_t *ctx)
+{
+	crypto_ctx = ctx ? ctx : &default_crypto_ctx;
+}
+
+/**
+ * Close and release the crypto context of an SDK instance.
+ */
+void sdoCryptoCtxFree(sdoCryptoContext_t *ctx)
+{
+	sdoCryptoContext_t *bound = crypto_ctx;
+
+	if (!ctx)
+		return;
+	crypto_ctx = ctx;
+	(void)sdoCryptoClose();
+	crypto_ctx = (bound == ctx) ? &default_crypto_ctx : bound;
+	sdoFree(ctx);
+}
+
 static void cleanup_ctx(void)
 {
-	/* devKey cleanup*/
-	if (crypto_ctx.devKey.eA) {
-		sdoPublicKeyFree(crypto_ctx.devKey.eA->pubkey);
-		sdoFree(crypto_ctx.devKey.eA);
-		crypto_ctx.devKey.eA = NULL;
-	}
-	sdoEPIDInfoEBFree(crypto_ctx.devKey.eB);
-	crypto_ctx.devKey.eB = NULL;
+	/* devKey cleanup, eA is kept for the next run by sdoDevSign.c */
+	crypto_ctx->devKey.eA = NULL;
+	sdoEPIDInfoEBFree(crypto_ctx->devKey.eB);
+	crypto_ctx->devKey.eB = NULL;
+	if (crypto_ctx->devKey.signKey && crypto_ctx->devKey.signKeyFree)
+		crypto_ctx->devKey.signKeyFree(crypto_ctx->devKey.signKey);
+	crypto_ctx->devKey.signKey = NULL;
 
 	/* cleanup ovkey */
-	sdoByteArrayFree(crypto_ctx.OVKey);
-	crypto_ctx.OVKey = NULL;
+	sdoByteArrayFree(crypto_ctx->OVKey);
+	crypto_ctx->OVKey = NULL;
+	crypto_ctx->OVKeyReady = false;
+
+	/* cleanup the key exchange values generated ahead and not used */
+	if (crypto_ctx->kex.nextContext) {
+		sdoCryptoKEXClose(&crypto_ctx->kex.nextContext);
+		crypto_ctx->kex.nextContext = NULL;
+	}
+	if (crypto_ctx->kex.kdfHmac)
+		sdoCryptoHMACFinal(&crypto_ctx->kex.kdfHmac, NULL, 0);
+
+#if !defined(SECURE_ELEMENT)
+	/* cleanup decoded verification keys */
+	for (int i = 0; i < SDO_SIG_KEY_CACHE_SIZE; i++) {
+		sdoSigKeyEntry_t *e = &crypto_ctx->sigKeys.entries[i];
+
+		sdoCryptoSigKeyFree(&e->key);
+		sdoPublicKeyFree(e->pk);
+		e->pk = NULL;
+	}
+	crypto_ctx->sigKeys.next = 0;
+#endif
+
+#if defined(RANDOM_POOL)
+	/* random bytes not handed out yet must not outlive the session */
+	(void)memset_s(crypto_ctx->randomPool.bytes,
+		       sizeof(crypto_ctx->randomPool.bytes), 0);
+	crypto_ctx->randomPool.avail = 0;
+#endif
 }
 
+#if !defined(SECURE_ELEMENT)
+/**
+ * Get the handle of a public key for sdoCryptoSigVerifyDigestKey. Keys are
+ * found by reference, then by their hash, so that the keys verified again
+ * and again, such as the owner and manufacturer keys, are decoded once.
+ * @param pubkey - public key to verify with.
+ * @return key handle, owned by the cache, or NULL on failure.
+ */
+void *sdoSigKeyGet(SDOPublicKey_t *pubkey)
+{
+	sdoSigKeyCache_t *cache = &crypto_ctx->sigKeys;
+	sdoSigKeyEntry_t *e = NULL;
+	const SDOHash_t *pkh = NULL, *epkh;
+	void *key = NULL;
+	int diff = 1;
+
+	if (!pubkey || !pubkey->key1)
+		return NULL;
+
+	for (int i = 0; i < SDO_SIG_KEY_CACHE_SIZE; i++) {
+		if (cache->entries[i].pk == pubkey)
+			return cache->entries[i].key;
+	}
+
+	pkh = sdoPubKeyHashOf(pubkey);
+	if (!pkh)
+		return NULL;
+
+	for (int i = 0; i < SDO_SIG_KEY_CACHE_SIZE; i++) {
+		e = &cache->entries[i];
+		epkh = sdoPubKeyHashOf(e->pk);
+		if (!epkh || epkh->hash->byteSz != pkh->hash->byteSz)
+			continue;
+		if (!memcmp_s(epkh->hash->bytes, epkh->hash->byteSz,
+			      pkh->hash->bytes, pkh->hash->byteSz, &diff) &&
+		    !diff)
+			return e->key;
+	}
+
+	if (0 != sdoCryptoSigKeyLoad(
+		     pubkey->pkenc, pubkey->pkalg, pubkey->key1->bytes,
+		     pubkey->key1->byteSz,
+		     /* X.509 encoded pubkeys only have key1 parameter */
+		     (pubkey->key2 ? pubkey->key2->bytes : NULL),
+		     (pubkey->key2 ? pubkey->key2->byteSz : 0), &key)) {
+		return NULL;
+	}
+
+	/* Replace the oldest entry */
+	e = &cache->entries[cache->next];
+	sdoCryptoSigKeyFree(&e->key);
+	sdoPublicKeyFree(e->pk);
+	e->pk = sdoPublicKeyClone(pubkey);
+	e->key = key;
+	cache->next = (cache->next + 1) % SDO_SIG_KEY_CACHE_SIZE;
+	return key;
+}
+#endif
+
+#ifdef CRYPTO_FIXED_RANDOM
+/**
+ * Generate the same sequence of bytes each time the engine is brought up
+ * (splitmix64), so that the messages of a run recorded with NET_REPLAY can
+ * be played back. Nothing secret is to be made from them.
+ * @param buf - buffer to be filled.
+ * @param len - number of bytes to be filled.
+ * @return 0 if succeeds, else -1.
+ */
+int32_t sdoCryptoFixedRandom(uint8_t *buf, size_t len)
+{
+	uint64_t z = 0;
+	size_t i;
+
+	if (!buf)
+		return -1;
+
+	SDO_LOCK(fixed_random_lock);
+	for (i = 0; i < len; i++) {
+		if (i % 8 == 0) {
+			fixed_random_state += 0x9e3779b97f4a7c15ULL;
+			z = fixed_random_state;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			z ^= z >> 31;
+		}
+		buf[i] = (uint8_t)(z >> (8 * (i % 8)));
+	}
+	SDO_UNLOCK(fixed_random_lock);
+	return 0;
+}
+#endif
+
 /**
  * If crypto init is true, generate random bytes of data
  * of size numBytes passed as paramater, else return error.
@@ -129,19 +363,251 @@ static void cleanup_ctx(void)
  */
 int32_t sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes)
 {
+#if defined(RANDOM_POOL)
+	sdoRandomPool_t *pool = &crypto_ctx->randomPool;
+
+	if (NULL == randomBuffer)
+		return -1;
+
+	/* Requests larger than the pool go to the DRBG directly */
+	if (numBytes > sizeof(pool->bytes))
+		return (_sdoCryptoRandomBytes(randomBuffer, numBytes));
+
+	if (pool->avail < numBytes && 0 != sdoCryptoRandomPrefetch())
+		return -1;
+
+	/* Hand out the top of the pool and wipe it, so no byte is used
+	 * twice */
+	pool->avail -= numBytes;
+	if (memcpy_s(randomBuffer, numBytes, &pool->bytes[pool->avail],
+		     numBytes) != 0 ||
+	    memset_s(&pool->bytes[pool->avail], numBytes, 0) != 0)
+		return -1;
+	return 0;
+#else
 	return (_sdoCryptoRandomBytes(randomBuffer, numBytes));
+#endif
 }
 
+/**
+ * Fill up the pool that sdoCryptoRandomBytes draws from, so that the DRBG
+ * runs while the device waits, such as for a reply from the server, rather
+ * than while a message is built. The DRBG reseeds by its own policy.
+ * @return 0 if succeeds, else -1. Without RANDOM_POOL, nothing is done.
+ */
+int32_t sdoCryptoRandomPrefetch(void)
+{
+#if defined(RANDOM_POOL)
+	sdoRandomPool_t *pool = &crypto_ctx->randomPool;
+
+	if (pool->avail == sizeof(pool->bytes))
+		return 0;
+	if (0 != _sdoCryptoRandomBytes(&pool->bytes[pool->avail],
+				       sizeof(pool->bytes) - pool->avail))
+		return -1;
+	pool->avail = sizeof(pool->bytes);
+#endif
+	return 0;
+}
+
+#if !defined(SECURE_ELEMENT)
+/**
+ * Submit a crypto job. The software backends defer it to the first
+ * sdoCryptoJobPoll or to sdoCryptoJobComplete.
+ * @param job - the job, with type, run and arg filled in
+ * @return 0 if succeeds, else -1.
+ */
+int32_t sdoCryptoJobSubmit(sdoCryptoJob_t *job)
+{
+	if (!job || !job->run || job->pending)
+		return -1;
+	job->pending = true;
+	job->done = false;
+	job->result = -1;
+	return 0;
+}
+
+/**
+ * Make progress on a submitted crypto job.
+ * @param job - the job
+ * @return true once the job has run, false if it has not or if it was not
+ * submitted.
+ */
+bool sdoCryptoJobPoll(sdoCryptoJob_t *job)
+{
+	if (!job || !job->pending)
+		return false;
+	if (!job->done) {
+		job->result = job->run(job->arg);
+		job->done = true;
+	}
+	return true;
+}
+
+/**
+ * Wait for a submitted crypto job to finish and end it.
+ * @param job - the job
+ * @return the return value of the job operation, -1 if it was not submitted.
+ */
+int32_t sdoCryptoJobComplete(sdoCryptoJob_t *job)
+{
+	if (!sdoCryptoJobPoll(job))
+		return -1;
+	job->pending = false;
+	return job->result;
+}
+#endif
+
+#if defined(DEVICE_CSR_BLOB)
+#if defined(DEVICE_TPM20_ENABLED)
+#define CSR_DEVICE_KEY TPM_ECDSA_DEVICE_KEY
+#else
+#define CSR_DEVICE_KEY ECDSA_PRIVKEY
+#endif
+
+/*
+ * The cached CSR blob is the hash of the device key file the CSR was made
+ * from, followed by the PEM CSR itself.
+ */
+
+/**
+ * Internal API: hash the stored device key, to tie the cached CSR to it.
+ *
+ * @param keyHash - output, SDO_SHA_DIGEST_SIZE_USED bytes
+ * @return 0 on success, -1 on failure
+ */
+static int32_t csrKeyHash(uint8_t *keyHash)
+{
+	int32_t ret = -1;
+	int32_t keySize = sdoBlobSize((char *)CSR_DEVICE_KEY, SDO_SDK_RAW_DATA);
+	uint8_t *key = NULL;
+
+	if (keySize <= 0)
+		return -1;
+	key = sdoAlloc(keySize);
+	if (!key)
+		return -1;
+
+	if (sdoBlobRead((char *)CSR_DEVICE_KEY, SDO_SDK_RAW_DATA, key,
+			keySize) != keySize)
+		goto end;
+	if (_sdoCryptoHash(SDO_CRYPTO_HASH_TYPE_USED, key, keySize, keyHash,
+			   SDO_SHA_DIGEST_SIZE_USED) != 0)
+		goto end;
+	ret = 0;
+end:
+	if (memset_s(key, keySize, 0) != 0)
+		ret = -1;
+	sdoFree(key);
+	return ret;
+}
+
+/**
+ * Internal API: the cached CSR, if it was made from the current device key.
+ *
+ * @param keyHash - hash of the current device key
+ * @return the CSR, or NULL if there is no valid cached one
+ */
+static SDOByteArray_t *csrCacheLoad(const uint8_t *keyHash)
+{
+	int32_t blobSize =
+	    sdoBlobSize((char *)DEVICE_CSR_BLOB, SDO_SDK_SECURE_DATA);
+	uint8_t *blob = NULL;
+	SDOByteArray_t *csr = NULL;
+	int result = 1;
+
+	if (blobSize <= SDO_SHA_DIGEST_SIZE_USED)
+		return NULL;
+	blob = sdoAlloc(blobSize);
+	if (!blob)
+		return NULL;
+
+	if (sdoBlobRead((char *)DEVICE_CSR_BLOB, SDO_SDK_SECURE_DATA, blob,
+			blobSize) != blobSize)
+		goto end;
+	if (memcmp_s(blob, SDO_SHA_DIGEST_SIZE_USED, keyHash,
+		     SDO_SHA_DIGEST_SIZE_USED, &result) != 0 ||
+	    result != 0) {
+		LOG(LOG_DEBUG, "Device key changed, dropping the cached CSR\n");
+		goto end;
+	}
+	csr = sdoByteArrayAllocWithByteArray(blob + SDO_SHA_DIGEST_SIZE_USED,
+					     blobSize -
+						 SDO_SHA_DIGEST_SIZE_USED);
+end:
+	sdoFree(blob);
+	return csr;
+}
+
+/**
+ * Internal API: store the CSR made from the device key with that hash.
+ */
+static void csrCacheSave(const uint8_t *keyHash, const SDOByteArray_t *csr)
+{
+	uint32_t blobSize = SDO_SHA_DIGEST_SIZE_USED + csr->byteSz;
+	uint8_t *blob = sdoAlloc(blobSize);
+
+	if (!blob)
+		return;
+	if (memcpy_s(blob, blobSize, keyHash, SDO_SHA_DIGEST_SIZE_USED) == 0 &&
+	    memcpy_s(blob + SDO_SHA_DIGEST_SIZE_USED,
+		     blobSize - SDO_SHA_DIGEST_SIZE_USED, csr->bytes,
+		     csr->byteSz) == 0 &&
+	    sdoBlobWrite((char *)DEVICE_CSR_BLOB, SDO_SDK_SECURE_DATA, blob,
+			 blobSize) == (int32_t)blobSize) {
+		LOG(LOG_DEBUG, "Device CSR cached\n");
+	} else {
+		LOG(LOG_ERROR, "Caching the device CSR failed\n");
+	}
+	sdoFree(blob);
+}
+#endif /* DEVICE_CSR_BLOB */
+
 /**
  * Internal API
  * Interface to get device CSR (certificate generated shall be used during
- * Device Attestation to RV/OWN server).
+ * Device Attestation to RV/OWN server). With DEVICE_CSR_BLOB the CSR made
+ * by sdoDeviceCsrPrepare is served instead of signing a fresh one, unless
+ * the device key changed since.
  * @return pointer to a byteArray holding a valid device CSR.
  */
 int32_t sdoGetDeviceCsr(SDOByteArray_t **csr)
 {
 #if !defined(EPID_DA)
+#if defined(DEVICE_CSR_BLOB)
+	uint8_t keyHash[SDO_SHA_DIGEST_SIZE_USED];
+
+	if (!csr)
+		return -1;
+	if (csrKeyHash(keyHash) == 0) {
+		*csr = csrCacheLoad(keyHash);
+		if (*csr)
+			return 0;
+		if (_sdoGetDeviceCsr(csr) != 0)
+			return -1;
+		csrCacheSave(keyHash, *csr);
+		return 0;
+	}
+#endif
 	return (_sdoGetDeviceCsr(csr));
 #endif
 	return 0;
 }
+
+/**
+ * Make the device CSR ahead of DI and cache it, if it is not cached for
+ * the current device key yet. Without DEVICE_CSR_BLOB this does nothing.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t sdoDeviceCsrPrepare(void)
+{
+#if !defined(EPID_DA) && defined(DEVICE_CSR_BLOB)
+	SDOByteArray_t *csr = NULL;
+
+	if (sdoGetDeviceCsr(&csr) != 0)
+		return -1;
+	sdoByteArrayFree(csr);
+#endif
+	return 0;
+}
@@ -9,13 +9,33 @@
 typedef struct sdoDevKeyCtx {
 	SDOSigInfo_t *eA;
 	SDOEPIDInfoeB_t *eB;
+	void *signKey; // resident device ECDSA key of the crypto library
+	void (*signKeyFree)(void *signKey); // wipes and frees signKey
 } sdoDevKeyCtx_t;
 
 typedef struct {
 	SDOByteArray_t *sek; // Symmetric AES key
 	SDOByteArray_t *svk; // HMAC key
+	void *svkHmac;	     // HMAC context keyed with svk
 } SDOAESKeyset_t;
 
+/* Crypto job, see sdoCryptoJobSubmit */
+typedef enum {
+	SDO_CRYPTO_JOB_SIGN,
+	SDO_CRYPTO_JOB_VERIFY,
+	SDO_CRYPTO_JOB_KEX,
+	SDO_CRYPTO_JOB_HMAC
+} sdoCryptoJobType_t;
+
+typedef struct {
+	sdoCryptoJobType_t type;
+	int32_t (*run)(void *arg); // the operation, run synchronously
+	void *arg;
+	bool pending; // submitted and not completed yet
+	bool done;    // run, result holds its return value
+	int32_t result;
+} sdoCryptoJob_t;
+
 /* SDO crypto context */
 typedef struct sdoTo2SymEncCtx {
 	SDOAESKeyset_t keyset;
@@ -41,14 +61,47 @@ typedef struct sdoKexCtx {
 	const char *sekLabel;
 	const char *svkLabel;
 	void *context;
+	void *nextContext; // generated ahead by sdoKexPrepare, used once
+	SDOByteArray_t *peerRandom; // xA, until kexJob has taken it
+	sdoCryptoJob_t kexJob;	    // sets xA and derives the session keys
+	void *kdfHmac; // keyed with the KDF key, kept for the next sessions
 } sdoKexCtx_t;
 
+/* Public keys decoded for signature verification, found by their hash */
+#define SDO_SIG_KEY_CACHE_SIZE 4
+typedef struct {
+	SDOPublicKey_t *pk; // reference to the public key, its hash kept
+	void *key;	    // key handle from sdoCryptoSigKeyLoad
+} sdoSigKeyEntry_t;
+
+typedef struct {
+	sdoSigKeyEntry_t entries[SDO_SIG_KEY_CACHE_SIZE];
+	int next; // entry replaced by the next key
+} sdoSigKeyCache_t;
+
+#if defined(RANDOM_POOL)
+/* DRBG output generated ahead of its use, bytes[0..avail) are unused */
+typedef struct {
+	uint8_t bytes[RANDOM_POOL];
+	size_t avail;
+} sdoRandomPool_t;
+#endif
+
 typedef struct {
+	unsigned int up; // SDO_CRYPTO_* parts brought up
 	sdoDevKeyCtx_t devKey;
 	sdoTo2SymEncCtx_t to2SymEnc;
 	sdoKexCtx_t kex;
 	SDOByteArray_t *OVKey;
+	bool OVKeyReady; // OV HMAC key generated ahead for DI, not used yet
+	sdoSigKeyCache_t sigKeys;
+#if defined(RANDOM_POOL)
+	sdoRandomPool_t randomPool;
+#endif
 } sdoCryptoContext_t;
 
 SDOAESKeyset_t *getKeyset(void);
+sdoCryptoContext_t *sdoCryptoCtxAlloc(void);
+void sdoCryptoCtxBind(sdoCryptoContext_t *ctx);
+void sdoCryptoCtxFree(sdoCryptoContext_t *ctx);
 #endif /*__CRYTPO_CONTEXT_H__ */
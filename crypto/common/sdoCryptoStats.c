@@ -0,0 +1,177 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Accounting of the crypto operations wrapped by sdoCryptoTimed.h: the time
+ * each thread spent signing, verifying and in the key exchange, for the
+ * statistics of the protocol runs, with CRYPTO_STATS=true the process
+ * wide counters of sdoSdkGetCryptoStats and with TRACE_EVENTS the spans of
+ * the timeline.
+ */
+
+#include "sdo.h"
+#include "sdoCryptoApi.h"
+#include "network_al.h"
+#include "sdotrace.h"
+#include "util.h"
+#include "safe_lib.h"
+
+#if !defined(PROT_STATS_FALSE)
+/* Time this thread spent in the costly crypto operations */
+static SDO_THREAD_LOCAL uint64_t cryptoTimeUs;
+#endif
+
+#if defined(CRYPTO_STATS) || defined(SDO_TRACE)
+#if defined(USE_MBEDTLS)
+#define CRYPTO_LIB "mbedtls"
+#else
+#define CRYPTO_LIB "openssl"
+#endif
+
+/* With CRYPTO_HW=true the secure element signs, verifies and seals */
+#if defined(SECURE_ELEMENT)
+#define CRYPTO_SIGN "se"
+#define CRYPTO_VERIFY "se"
+#define CRYPTO_GCM "se"
+#elif defined(DEVICE_TPM20_ENABLED)
+#define CRYPTO_SIGN "tpm"
+#endif
+#ifndef CRYPTO_SIGN
+#define CRYPTO_SIGN CRYPTO_LIB
+#endif
+#ifndef CRYPTO_VERIFY
+#define CRYPTO_VERIFY CRYPTO_LIB
+#endif
+#ifndef CRYPTO_GCM
+#define CRYPTO_GCM CRYPTO_LIB
+#endif
+
+static const char *const op_names[SDO_CRYPTO_OPS][2] = {
+    [SDO_CRYPTO_OP_HASH] = {"hash", CRYPTO_LIB},
+    [SDO_CRYPTO_OP_HMAC] = {"hmac", CRYPTO_LIB},
+    [SDO_CRYPTO_OP_SIGN] = {"sign", CRYPTO_SIGN},
+    [SDO_CRYPTO_OP_VERIFY] = {"verify", CRYPTO_VERIFY},
+    [SDO_CRYPTO_OP_AES_ENCRYPT] = {"aes-encrypt", CRYPTO_LIB},
+    [SDO_CRYPTO_OP_AES_DECRYPT] = {"aes-decrypt", CRYPTO_LIB},
+    [SDO_CRYPTO_OP_AES_GCM] = {"aes-gcm", CRYPTO_GCM},
+    [SDO_CRYPTO_OP_KEX] = {"kex", CRYPTO_LIB},
+};
+#endif
+
+#if defined(CRYPTO_STATS)
+
+/* Shared by all instances and the threads they run crypto on */
+static sdoSdkCryptoStats crypto_stats;
+SDO_MUTEX(crypto_stats_lock);
+
+static unsigned int us_bucket(uint64_t us)
+{
+	unsigned int b = 0;
+
+	while (us && b < SDO_STATS_HIST_BUCKETS - 1) {
+		us >>= 1;
+		b++;
+	}
+	return b;
+}
+#endif
+
+/**
+ * Account a crypto operation that has just returned.
+ * @param op - the sdoSdkCryptoOp.
+ * @param bytes - size of the data it processed.
+ * @param startUs - sdoTimeUs() before the operation.
+ */
+void sdoCryptoOpDone(int op, size_t bytes, uint64_t startUs)
+{
+	uint64_t us = sdoTimeUs() - startUs;
+
+#if !defined(PROT_STATS_FALSE)
+	if (op == SDO_CRYPTO_OP_SIGN || op == SDO_CRYPTO_OP_VERIFY ||
+	    op == SDO_CRYPTO_OP_KEX)
+		cryptoTimeUs += us;
+#endif
+	if (op < 0 || op >= SDO_CRYPTO_OPS)
+		return;
+	SDO_TRACE_END("crypto", op_names[op][0], -1, startUs);
+#if defined(CRYPTO_STATS)
+	sdoSdkCryptoOpStats *s = &crypto_stats.op[op];
+
+	SDO_LOCK(crypto_stats_lock);
+	s->calls++;
+	s->bytes += bytes;
+	s->totalUs += us;
+	if (us > s->maxUs)
+		s->maxUs = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+	s->hist[us_bucket(us)]++;
+	SDO_UNLOCK(crypto_stats_lock);
+#else
+	(void)bytes;
+	(void)us;
+#endif
+}
+
+/**
+ * Time the calling thread spent signing, verifying signatures and in the
+ * key exchange, for the statistics of the protocol runs. Only differences
+ * of two readings are meaningful.
+ * @return time in microseconds, 0 with PROT_STATS=false.
+ */
+uint64_t sdoCryptoTimeUs(void)
+{
+#if !defined(PROT_STATS_FALSE)
+	return cryptoTimeUs;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Copy out the crypto operation counters, with their names and backends.
+ * @param stats - out, the counters.
+ * @return 0 on success, -1 if stats is NULL or with CRYPTO_STATS=false.
+ */
+int32_t sdoCryptoStatsGet(sdoSdkCryptoStats *stats)
+{
+#if defined(CRYPTO_STATS)
+	int op;
+	int ret;
+
+	if (!stats)
+		return -1;
+	SDO_LOCK(crypto_stats_lock);
+	ret = memcpy_s(stats, sizeof(*stats), &crypto_stats,
+		       sizeof(crypto_stats));
+	SDO_UNLOCK(crypto_stats_lock);
+	if (ret != 0)
+		return -1;
+	for (op = 0; op < SDO_CRYPTO_OPS; op++) {
+		stats->op[op].name = op_names[op][0];
+		stats->op[op].backend = op_names[op][1];
+	}
+	return 0;
+#else
+	(void)stats;
+	return -1;
+#endif
+}
+
+/**
+ * Clear the crypto operation counters.
+ * @return 0 on success, -1 with CRYPTO_STATS=false.
+ */
+int32_t sdoCryptoStatsReset(void)
+{
+#if defined(CRYPTO_STATS)
+	int ret;
+
+	SDO_LOCK(crypto_stats_lock);
+	ret = memset_s(&crypto_stats, sizeof(crypto_stats), 0);
+	SDO_UNLOCK(crypto_stats_lock);
+	return ret != 0 ? -1 : 0;
+#else
+	return -1;
+#endif
+}
@@ -0,0 +1,336 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * The crypto HAL operations, timed by sdoCryptoOpDone(). Included by the
+ * sources calling them, after sdoCryptoHal.h: their calls then go through
+ * the timed versions below, while the crypto library backends, which
+ * implement the operations, do not see the renames.
+ *
+ * Signing, verifying and the key exchange are timed unless PROT_STATS=false
+ * and neither CRYPTO_STATS=true nor TRACE_EVENTS is set, as they feed
+ * sdoCryptoTimeUs() too. The cheap, frequent operations are only wrapped
+ * with CRYPTO_STATS=true or TRACE_EVENTS, so that they cost nothing
+ * otherwise.
+ */
+
+#ifndef __SDO_CRYPTO_TIMED_H__
+#define __SDO_CRYPTO_TIMED_H__
+
+#include "sdo.h"
+#include "sdoCryptoHal.h"
+#include "sdoCryptoApi.h"
+#include "network_al.h"
+
+#if !defined(PROT_STATS_FALSE) || defined(CRYPTO_STATS) || defined(SDO_TRACE)
+static inline int32_t sdoECDSASignTimed(const uint8_t *message,
+					size_t messageLen,
+					unsigned char *signature,
+					size_t *signatureLen)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret =
+	    sdoECDSASign(message, messageLen, signature, signatureLen);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_SIGN, messageLen, start);
+	return ret;
+}
+#define sdoECDSASign sdoECDSASignTimed
+
+static inline int32_t sdoCryptoSigVerifyTimed(
+    uint8_t keyEncoding, uint8_t keyAlgorithm, const uint8_t *message,
+    uint32_t messageLength, const uint8_t *messageSignature,
+    uint32_t signatureLength, const uint8_t *keyParam1,
+    uint32_t keyParam1Length, const uint8_t *keyParam2,
+    uint32_t keyParam2Length)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoSigVerify(
+	    keyEncoding, keyAlgorithm, message, messageLength,
+	    messageSignature, signatureLength, keyParam1, keyParam1Length,
+	    keyParam2, keyParam2Length);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_VERIFY, messageLength, start);
+	return ret;
+}
+#define sdoCryptoSigVerify sdoCryptoSigVerifyTimed
+
+static inline int32_t sdoCryptoSigVerifyDigestTimed(
+    uint8_t keyEncoding, uint8_t keyAlgorithm, const uint8_t *hash,
+    uint32_t hashLength, const uint8_t *messageSignature,
+    uint32_t signatureLength, const uint8_t *keyParam1,
+    uint32_t keyParam1Length, const uint8_t *keyParam2,
+    uint32_t keyParam2Length)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoSigVerifyDigest(
+	    keyEncoding, keyAlgorithm, hash, hashLength, messageSignature,
+	    signatureLength, keyParam1, keyParam1Length, keyParam2,
+	    keyParam2Length);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_VERIFY, hashLength, start);
+	return ret;
+}
+#define sdoCryptoSigVerifyDigest sdoCryptoSigVerifyDigestTimed
+
+static inline int32_t
+sdoCryptoSigVerifyDigestKeyTimed(void *key, const uint8_t *hash,
+				 uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoSigVerifyDigestKey(
+	    key, hash, hashLength, messageSignature, signatureLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_VERIFY, hashLength, start);
+	return ret;
+}
+#define sdoCryptoSigVerifyDigestKey sdoCryptoSigVerifyDigestKeyTimed
+
+static inline int32_t sdoCryptoKEXInitTimed(void **context)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoKEXInit(context);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_KEX, 0, start);
+	return ret;
+}
+#define sdoCryptoKEXInit sdoCryptoKEXInitTimed
+
+static inline int32_t sdoCryptoSetPeerRandomTimed(void *context,
+						  const uint8_t *peerRandValue,
+						  uint32_t peerRandLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret =
+	    sdoCryptoSetPeerRandom(context, peerRandValue, peerRandLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_KEX, peerRandLength, start);
+	return ret;
+}
+#define sdoCryptoSetPeerRandom sdoCryptoSetPeerRandomTimed
+#endif
+
+#if defined(CRYPTO_STATS) || defined(SDO_TRACE)
+static inline int32_t _sdoCryptoHashTimed(uint8_t hashType,
+					  const uint8_t *buffer,
+					  size_t bufferLength, uint8_t *output,
+					  size_t outputLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = _sdoCryptoHash(hashType, buffer, bufferLength, output,
+				     outputLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HASH, bufferLength, start);
+	return ret;
+}
+#define _sdoCryptoHash _sdoCryptoHashTimed
+
+static inline int32_t sdoCryptoHashInitTimed(uint8_t hashType, void **context)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHashInit(hashType, context);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HASH, 0, start);
+	return ret;
+}
+#define sdoCryptoHashInit sdoCryptoHashInitTimed
+
+static inline int32_t sdoCryptoHashUpdateTimed(void *context,
+					       const uint8_t *buffer,
+					       size_t bufferLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHashUpdate(context, buffer, bufferLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HASH, bufferLength, start);
+	return ret;
+}
+#define sdoCryptoHashUpdate sdoCryptoHashUpdateTimed
+
+static inline int32_t sdoCryptoHashFinalTimed(void **context, uint8_t *output,
+					      size_t outputLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHashFinal(context, output, outputLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HASH, 0, start);
+	return ret;
+}
+#define sdoCryptoHashFinal sdoCryptoHashFinalTimed
+
+static inline int32_t sdoCryptoHMACTimed(uint8_t hmacType,
+					 const uint8_t *buffer,
+					 size_t bufferLength, uint8_t *output,
+					 size_t outputLength,
+					 const uint8_t *key, size_t keyLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMAC(hmacType, buffer, bufferLength, output,
+				    outputLength, key, keyLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, bufferLength, start);
+	return ret;
+}
+#define sdoCryptoHMAC sdoCryptoHMACTimed
+
+static inline int32_t sdoCryptoHMACInitTimed(uint8_t hmacType,
+					     const uint8_t *key,
+					     size_t keyLength, void **context)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMACInit(hmacType, key, keyLength, context);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, 0, start);
+	return ret;
+}
+#define sdoCryptoHMACInit sdoCryptoHMACInitTimed
+
+static inline int32_t sdoCryptoHMACUpdateTimed(void *context,
+					       const uint8_t *buffer,
+					       size_t bufferLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMACUpdate(context, buffer, bufferLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, bufferLength, start);
+	return ret;
+}
+#define sdoCryptoHMACUpdate sdoCryptoHMACUpdateTimed
+
+static inline int32_t sdoCryptoHMACFinalTimed(void **context, uint8_t *output,
+					      size_t outputLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMACFinal(context, output, outputLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, 0, start);
+	return ret;
+}
+#define sdoCryptoHMACFinal sdoCryptoHMACFinalTimed
+
+static inline int32_t sdoCryptoHMACKeyedTimed(void *context,
+					      const uint8_t *buffer,
+					      size_t bufferLength,
+					      uint8_t *output,
+					      size_t outputLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMACKeyed(context, buffer, bufferLength, output,
+					 outputLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, bufferLength, start);
+	return ret;
+}
+#define sdoCryptoHMACKeyed sdoCryptoHMACKeyedTimed
+
+static inline int32_t sdoCryptoHMACKeyedFinalTimed(void *context,
+						   uint8_t *output,
+						   size_t outputLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoHMACKeyedFinal(context, output, outputLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_HMAC, 0, start);
+	return ret;
+}
+#define sdoCryptoHMACKeyedFinal sdoCryptoHMACKeyedFinalTimed
+
+/* The size queries, with a NULL output, are not counted */
+static inline int32_t
+sdoCryptoAESEncryptTimed(const uint8_t *clearText, uint32_t clearTextLength,
+			 uint8_t *cypherText, uint32_t *cypherLength,
+			 size_t blockSize, const uint8_t *iv,
+			 const uint8_t *key, uint32_t keyLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret =
+	    sdoCryptoAESEncrypt(clearText, clearTextLength, cypherText,
+				cypherLength, blockSize, iv, key, keyLength);
+
+	if (cypherText)
+		sdoCryptoOpDone(SDO_CRYPTO_OP_AES_ENCRYPT, clearTextLength,
+				start);
+	return ret;
+}
+#define sdoCryptoAESEncrypt sdoCryptoAESEncryptTimed
+
+static inline int32_t
+sdoCryptoAESDecryptTimed(uint8_t *clearText, uint32_t *clearTextLength,
+			 const uint8_t *cypherText, uint32_t cypherLength,
+			 size_t blockSize, const uint8_t *iv,
+			 const uint8_t *key, uint32_t keyLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret =
+	    sdoCryptoAESDecrypt(clearText, clearTextLength, cypherText,
+				cypherLength, blockSize, iv, key, keyLength);
+
+	if (clearText)
+		sdoCryptoOpDone(SDO_CRYPTO_OP_AES_DECRYPT, cypherLength,
+				start);
+	return ret;
+}
+#define sdoCryptoAESDecrypt sdoCryptoAESDecryptTimed
+
+static inline int32_t sdoCryptoAESGcmEncryptTimed(
+    const uint8_t *plainText, uint32_t plainTextLength, uint8_t *cipherText,
+    uint32_t cipherTextLength, const uint8_t *iv, uint32_t ivLength,
+    const uint8_t *key, uint32_t keyLength, uint8_t *tag, uint32_t tagLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoAESGcmEncrypt(
+	    plainText, plainTextLength, cipherText, cipherTextLength, iv,
+	    ivLength, key, keyLength, tag, tagLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_AES_GCM, plainTextLength, start);
+	return ret;
+}
+#define sdoCryptoAESGcmEncrypt sdoCryptoAESGcmEncryptTimed
+
+static inline int32_t sdoCryptoAESGcmDecryptTimed(
+    uint8_t *clearText, uint32_t clearTextLength, const uint8_t *cipherText,
+    uint32_t cipherTextLength, const uint8_t *iv, uint32_t ivLength,
+    const uint8_t *key, uint32_t keyLength, uint8_t *tag, uint32_t tagLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoAESGcmDecrypt(
+	    clearText, clearTextLength, cipherText, cipherTextLength, iv,
+	    ivLength, key, keyLength, tag, tagLength);
+
+	sdoCryptoOpDone(SDO_CRYPTO_OP_AES_GCM, cipherTextLength, start);
+	return ret;
+}
+#define sdoCryptoAESGcmDecrypt sdoCryptoAESGcmDecryptTimed
+
+static inline int32_t sdoCryptoGetDeviceRandomTimed(void *context,
+						    uint8_t *devRandValue,
+						    uint32_t *devRandLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret =
+	    sdoCryptoGetDeviceRandom(context, devRandValue, devRandLength);
+
+	if (devRandValue)
+		sdoCryptoOpDone(SDO_CRYPTO_OP_KEX, 0, start);
+	return ret;
+}
+#define sdoCryptoGetDeviceRandom sdoCryptoGetDeviceRandomTimed
+
+static inline int32_t sdoCryptoGetSecretTimed(void *context, uint8_t *secret,
+					      uint32_t *secretLength)
+{
+	uint64_t start = sdoTimeUs();
+	int32_t ret = sdoCryptoGetSecret(context, secret, secretLength);
+
+	if (secret)
+		sdoCryptoOpDone(SDO_CRYPTO_OP_KEX, 0, start);
+	return ret;
+}
+#define sdoCryptoGetSecret sdoCryptoGetSecretTimed
+#endif
+
+#endif /* __SDO_CRYPTO_TIMED_H__ */
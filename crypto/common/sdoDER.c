@@ -0,0 +1,214 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Fixed shape DER codec for P-256/P-384 ECDSA signatures and public
+ * keys.
+ *
+ * Converts between raw r||s (and x||y) and the DER forms SDO carries without
+ * building ASN.1 objects. Only the shapes a well formed P-256 or P-384
+ * signature and SubjectPublicKeyInfo can take are handled, anything else is
+ * refused so that the callers fall back to the crypto library.
+ */
+
+#include "sdoCryptoHal.h"
+#include "util.h"
+#include "safe_lib.h"
+
+#define DER_SEQUENCE 0x30
+#define DER_INTEGER 0x02
+#define DER_UNCOMPRESSED 0x04
+
+/* SubjectPublicKeyInfo up to and including the uncompressed point tag */
+static const uint8_t derSpkiP256[] = {
+    0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d,
+    0x02, 0x01, 0x06, 0x08, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x03, 0x01,
+    0x07, 0x03, 0x42, 0x00, DER_UNCOMPRESSED};
+static const uint8_t derSpkiP384[] = {
+    0x30, 0x76, 0x30, 0x10, 0x06, 0x07, 0x2a, 0x86, 0x48, 0xce, 0x3d, 0x02,
+    0x01, 0x06, 0x05, 0x2b, 0x81, 0x04, 0x00, 0x22, 0x03, 0x62, 0x00,
+    DER_UNCOMPRESSED};
+
+/**
+ * Internal API: check that the raw size is a P-256 or P-384 pair.
+ */
+static bool derRawSizeOk(size_t rawLength)
+{
+	return rawLength == 2 * BUFF_SIZE_32_BYTES ||
+	       rawLength == 2 * BUFF_SIZE_48_BYTES;
+}
+
+/**
+ * Internal API: write one unsigned big endian coordinate as a DER INTEGER.
+ *
+ * @param out - output, room for coordLength + 3 bytes
+ * @param coord - coordinate bytes
+ * @param coordLength - coordinate size
+ * @return number of bytes written
+ */
+static size_t derWriteInteger(uint8_t *out, const uint8_t *coord,
+			      size_t coordLength)
+{
+	size_t skip = 0;
+	size_t len;
+	size_t i;
+	size_t n = 0;
+
+	/* Minimal encoding, but keep a zero byte for the value zero */
+	while (skip < coordLength - 1 && coord[skip] == 0)
+		skip++;
+	len = coordLength - skip;
+
+	out[n++] = DER_INTEGER;
+	/* A leading zero keeps the value positive */
+	if (coord[skip] & 0x80) {
+		out[n++] = (uint8_t)(len + 1);
+		out[n++] = 0;
+	} else {
+		out[n++] = (uint8_t)len;
+	}
+	for (i = 0; i < len; i++)
+		out[n++] = coord[skip + i];
+	return n;
+}
+
+/**
+ * Internal API: read one DER INTEGER into a left padded coordinate.
+ *
+ * @param pp - input, advanced past the INTEGER
+ * @param end - end of the input
+ * @param coord - output coordinate
+ * @param coordLength - coordinate size
+ * @return true if it is a minimal, positive INTEGER that fits
+ */
+static bool derReadInteger(const uint8_t **pp, const uint8_t *end,
+			   uint8_t *coord, size_t coordLength)
+{
+	const uint8_t *p = *pp;
+	size_t len;
+
+	if (end - p < 3 || p[0] != DER_INTEGER || p[1] > end - p - 2)
+		return false;
+	len = p[1];
+	p += 2;
+	if (len == 0 || (p[0] & 0x80))
+		return false;
+	/* A leading zero is only there for a high bit in the next byte */
+	if (p[0] == 0 && len > 1) {
+		if (!(p[1] & 0x80))
+			return false;
+		p++;
+		len--;
+	}
+	if (len > coordLength)
+		return false;
+
+	if (memset_s(coord, coordLength - len, 0) != 0 ||
+	    memcpy_s(coord + coordLength - len, len, p, len) != 0)
+		return false;
+	*pp = p + len;
+	return true;
+}
+
+/**
+ * Encode raw r||s as a DER ECDSA-Sig-Value.
+ *
+ * @param rawSig - r||s, 64 bytes for P-256 or 96 bytes for P-384
+ * @param rawSigLength - size of rawSig
+ * @param der - output buffer
+ * @param derSize - size of der
+ * @param derLength - output, size of the encoding
+ * @return 0 on success, -1 if the input is not one of the shapes handled
+ */
+int32_t sdoDERSigFromRaw(const uint8_t *rawSig, size_t rawSigLength,
+			 uint8_t *der, size_t derSize, size_t *derLength)
+{
+	/* Two INTEGERs of up to a 49 byte value keep the short length form */
+	uint8_t buf[2 + 2 * (3 + BUFF_SIZE_48_BYTES)];
+	size_t coordLength = rawSigLength / 2;
+	size_t n = 2;
+
+	if (!rawSig || !der || !derLength || !derRawSizeOk(rawSigLength))
+		return -1;
+
+	n += derWriteInteger(buf + n, rawSig, coordLength);
+	n += derWriteInteger(buf + n, rawSig + coordLength, coordLength);
+	buf[0] = DER_SEQUENCE;
+	buf[1] = (uint8_t)(n - 2);
+
+	if (memcpy_s(der, derSize, buf, n) != 0)
+		return -1;
+	*derLength = n;
+	return 0;
+}
+
+/**
+ * Decode a DER ECDSA-Sig-Value into raw r||s.
+ *
+ * @param der - DER signature
+ * @param derLength - size of der
+ * @param rawSig - output, r||s
+ * @param rawSigLength - 64 bytes for P-256 or 96 bytes for P-384
+ * @return 0 on success, -1 if the input is not one of the shapes handled
+ */
+int32_t sdoDERSigToRaw(const uint8_t *der, size_t derLength, uint8_t *rawSig,
+		       size_t rawSigLength)
+{
+	const uint8_t *p = der;
+	const uint8_t *end = der + derLength;
+	size_t coordLength = rawSigLength / 2;
+
+	if (!der || !rawSig || !derRawSizeOk(rawSigLength) || derLength < 2)
+		return -1;
+	/* Only the short length form, as the library would emit for these */
+	if (p[0] != DER_SEQUENCE || p[1] != derLength - 2)
+		return -1;
+	p += 2;
+
+	if (!derReadInteger(&p, end, rawSig, coordLength) ||
+	    !derReadInteger(&p, end, rawSig + coordLength, coordLength) ||
+	    p != end)
+		return -1;
+	return 0;
+}
+
+/**
+ * Extract the raw x||y point from a P-256 or P-384 SubjectPublicKeyInfo.
+ *
+ * @param der - DER public key
+ * @param derLength - size of der
+ * @param rawKey - output, x||y
+ * @param rawKeyLength - 64 bytes for P-256 or 96 bytes for P-384
+ * @return 0 on success, -1 if the input is not one of the shapes handled
+ */
+int32_t sdoDERPubKeyToRaw(const uint8_t *der, size_t derLength,
+			  uint8_t *rawKey, size_t rawKeyLength)
+{
+	const uint8_t *prefix;
+	size_t prefixLength;
+	int result = 1;
+
+	if (!der || !rawKey)
+		return -1;
+	if (rawKeyLength == 2 * BUFF_SIZE_32_BYTES) {
+		prefix = derSpkiP256;
+		prefixLength = sizeof(derSpkiP256);
+	} else if (rawKeyLength == 2 * BUFF_SIZE_48_BYTES) {
+		prefix = derSpkiP384;
+		prefixLength = sizeof(derSpkiP384);
+	} else {
+		return -1;
+	}
+
+	if (derLength != prefixLength + rawKeyLength ||
+	    memcmp_s(der, prefixLength, prefix, prefixLength, &result) != 0 ||
+	    result != 0)
+		return -1;
+	if (memcpy_s(rawKey, rawKeyLength, der + prefixLength,
+		     rawKeyLength) != 0)
+		return -1;
+	return 0;
+}
@@ -13,6 +13,7 @@
 #endif
 #include "sdoCryptoCtx.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
 
 #define ECDSA_SIGNATURE_MAX_LEN BUFF_SIZE_256_BYTES
 
@@ -76,6 +77,26 @@ int32_t sdoDeviceSign(const uint8_t *message, size_t messageLength,
 	return 0;
 }
 
+/* This function makes signing material ahead of the next sdoDeviceSign
+ * call, while the device waits on the server. With EPID it tops up the
+ * pre-signature pool for the group public key of the last eB received.
+ * @return 0 on success, or when there is nothing to do, -1 on failure.
+ */
+int32_t sdoDevicePreSign(void)
+{
+#if defined(EPID_DA)
+	sdoDevKeyCtx_t *deviceCtx = getsdoDevKeyCtx();
+
+	if (!deviceCtx || !deviceCtx->eB || !deviceCtx->eB->pubkey)
+		return -1;
+
+	if (EPID_PreSign(deviceCtx->eB->pubkey->bytes,
+			 deviceCtx->eB->pubkey->byteSz) != 0)
+		return -1;
+#endif
+	return 0;
+}
+
 /* This function sets the eB parameter that is sent from the
  * Owner to the Device in response to eA parameter
  * @param eB pointer to EPID eB param
@@ -105,66 +126,119 @@ int32_t sdoSetDeviceSigInfoeB(SDOByteArray_t *sigRL, SDOByteArray_t *pubkey)
 	return 0;
 }
 
-/* This function sets the eA parameter. In case of EPID it
- * will allocate the public key structs and loads it with
- * input value. For other cases public key algorithm is populated
- * and public key is not allocated.
- * @param In eA The pointer to eA.
- * @param In eALen the size of the eA.
- * @return 0 on success and -1 on failure.
+/*
+ * SigInfo of the device (eA), built once per boot and shared by the crypto
+ * contexts of the SDK instances, which do not free it. It is built again
+ * only when the attestation key it is made of (the EPID GID) changes; the
+ * fragment caches of the instances keep its encoding as long, as they
+ * encode it from the same bytes.
  */
-int32_t sdoSetDeviceSigInfoeA(uint8_t *eA, size_t *eALen)
+static SDOSigInfo_t *devSigInfo;
+
+/* Free a SigInfo built by sdoDevSigInfoBuild */
+static void sdoDevSigInfoFree(SDOSigInfo_t *eA)
 {
-	int32_t ret = 0;
-	sdoDevKeyCtx_t *deviceCtx = getsdoDevKeyCtx();
+	if (!eA)
+		return;
+	sdoPublicKeyFree(eA->pubkey);
+	sdoFree(eA);
+}
 
-	if (NULL == deviceCtx || !eA || !eALen) {
-		return -1;
-	}
+/* Tell if the cached SigInfo is made of the attestation key eA */
+static bool sdoDevSigInfoMatches(const uint8_t *eA, size_t eALen)
+{
+#ifdef EPID_DA
+	SDOByteArray_t *gid;
+	int diff = 1;
 
-	deviceCtx->eA = sdoAlloc(sizeof(SDOSigInfo_t));
+	if (!devSigInfo || !devSigInfo->pubkey || eALen < SDO_PK_EA_SIZE)
+		return false;
+	gid = devSigInfo->pubkey->key1;
+	return gid &&
+	       memcmp_s(gid->bytes, gid->byteSz, eA, SDO_PK_EA_SIZE, &diff) ==
+		   0 &&
+	       diff == 0;
+#else
+	(void)eA;
+	(void)eALen;
+	return devSigInfo != NULL;
+#endif
+}
+
+/* Build the SigInfo of the attestation key eA, NULL on failure */
+static SDOSigInfo_t *sdoDevSigInfoBuild(const uint8_t *eA, size_t eALen)
+{
+	SDOSigInfo_t *sigInfo = sdoAlloc(sizeof(SDOSigInfo_t));
 
-	if (!deviceCtx->eA) {
+	if (!sigInfo) {
 		LOG(LOG_ERROR, "Malloc failed \n");
-		return -1;
+		return NULL;
 	}
-
-	deviceCtx->eA->sigType = SDO_PK_ALGO;
+	sigInfo->sigType = SDO_PK_ALGO;
 
 #ifdef EPID_DA
-	deviceCtx->eA->pubkey = sdoAlloc(sizeof(SDOPublicKey_t));
-	if (!deviceCtx->eA->pubkey) {
+	/* First GID_SIZE bytes in a private key are gid. */
+	if (eALen < SDO_PK_EA_SIZE)
+		goto err;
+	sigInfo->pubkey = sdoAlloc(sizeof(SDOPublicKey_t));
+	if (!sigInfo->pubkey) {
 		LOG(LOG_ERROR, "Malloc failed \n");
-		ret = -1;
 		goto err;
 	}
-	deviceCtx->eA->pubkey->key1 = sdoByteArrayAlloc(SDO_PK_EA_SIZE);
-	if (!deviceCtx->eA->pubkey->key1) {
+	sigInfo->pubkey->key1 = sdoByteArrayAlloc(SDO_PK_EA_SIZE);
+	if (!sigInfo->pubkey->key1) {
 		LOG(LOG_ERROR, "Malloc failed \n");
-		ret = -1;
 		goto err;
 	}
-	deviceCtx->eA->pubkey->pkalg = SDO_PK_ALGO;
-	deviceCtx->eA->pubkey->pkenc = SDO_PK_ENC;
+	sigInfo->pubkey->pkalg = SDO_PK_ALGO;
+	sigInfo->pubkey->pkenc = SDO_PK_ENC;
 
-	/* First GID_SIZE bytes in a private key are gid. */
-	if (*eALen < SDO_PK_EA_SIZE) {
-		ret = -1;
-		goto err;
-	}
-	if (memcpy_s(deviceCtx->eA->pubkey->key1->bytes, SDO_PK_EA_SIZE, eA,
+	if (memcpy_s(sigInfo->pubkey->key1->bytes, SDO_PK_EA_SIZE, eA,
 		     SDO_PK_EA_SIZE) != 0) {
 		LOG(LOG_ERROR, "Memcpy of eA failed \n");
-		ret = -1;
 		goto err;
 	}
+#else
+	(void)eA;
+	(void)eALen;
+#endif
+	return sigInfo;
+
+#ifdef EPID_DA
 err:
-	if (ret && (deviceCtx->eA->pubkey || deviceCtx->eA->pubkey->key1)) {
-		sdoFree(deviceCtx->eA->pubkey);
-		sdoByteArrayFree(deviceCtx->eA->pubkey->key1);
-	}
+	sdoDevSigInfoFree(sigInfo);
+	return NULL;
 #endif
-	return ret;
+}
+
+/* This function sets the eA parameter. In case of EPID it
+ * will allocate the public key structs and loads it with
+ * input value. For other cases public key algorithm is populated
+ * and public key is not allocated. The SigInfo of the last eA set is
+ * kept, and given again for the same eA.
+ * @param In eA The pointer to eA.
+ * @param In eALen the size of the eA.
+ * @return 0 on success and -1 on failure.
+ */
+int32_t sdoSetDeviceSigInfoeA(uint8_t *eA, size_t *eALen)
+{
+	sdoDevKeyCtx_t *deviceCtx = getsdoDevKeyCtx();
+	SDOSigInfo_t *sigInfo;
+
+	if (NULL == deviceCtx || !eA || !eALen) {
+		return -1;
+	}
+
+	if (!sdoDevSigInfoMatches(eA, *eALen)) {
+		sigInfo = sdoDevSigInfoBuild(eA, *eALen);
+		if (!sigInfo)
+			return -1;
+		/* attestation is held by one instance at a time */
+		sdoDevSigInfoFree(devSigInfo);
+		devSigInfo = sigInfo;
+	}
+	deviceCtx->eA = devSigInfo;
+	return 0;
 }
 
 /* This function returns the eA parameter that is sent from the Device
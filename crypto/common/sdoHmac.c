@@ -8,8 +8,10 @@
 #include "safe_lib.h"
 #include "sdoCryptoCtx.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
 #include "sdoprot.h"
 #include "storage_al.h"
+#include "storage_stats.h"
 #include "platform_utils.h"
 
 #if defined(DEVICE_TPM20_ENABLED)
@@ -20,7 +22,8 @@
  * This function computes the HMAC of encrypted TO2 messages using SVK as its
  * key. sdoTo2CryptoContext specifies the hmacType to be used to generate
  * the HMAC of the data contained in to2Msg of size to2MsgLength and places
- * the output in hmac, the size of which is specified by hmacLength.
+ * the output in hmac, the size of which is specified by hmacLength. The key
+ * state set up with the SVK by the key exchange is reused when present.
  * The hmac buffer must be of size SDO_MSG_HMAC_LENGTH or greater.
  * @param to2Msg In Pointer to the message
  * @param to2MsgLen In Size of the message
@@ -36,6 +39,9 @@ int32_t sdoTo2HMAC(uint8_t *to2Msg, size_t to2MsgLen, uint8_t *hmac,
 	uint8_t *svk;
 	uint8_t svkLen;
 
+	if (sdoKexComplete() != 0)
+		return -1;
+
 	if (NULL == keyset || (NULL == keyset->svk) || (NULL == to2Msg)) {
 		return -1;
 	}
@@ -45,6 +51,15 @@ int32_t sdoTo2HMAC(uint8_t *to2Msg, size_t to2MsgLen, uint8_t *hmac,
 	if (!svk || !svkLen || !to2MsgLen || !hmacLen)
 		goto error;
 
+	if (keyset->svkHmac) {
+		if (0 != sdoCryptoHMACKeyed(keyset->svkHmac, to2Msg, to2MsgLen,
+					    hmac, hmacLen)) {
+			LOG(LOG_ERROR, "Failed to perform HMAC\n");
+			goto error;
+		}
+		return 0;
+	}
+
 	if (0 != sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_USED, to2Msg, to2MsgLen,
 			       hmac, hmacLen, svk, svkLen)) {
 		LOG(LOG_ERROR, "Failed to perform HMAC\n");
@@ -142,6 +157,76 @@ error:
 #endif
 }
 
+/**
+ * sdoDeviceOVHMACInit function sets up the HMAC of an Ownership Voucher header
+ * handed over in pieces, keyed like sdoDeviceOVHMAC().
+ * @param context Out Pointer to the HMAC context
+ * @return 0 on success and -1 on failure, always with a TPM held key, which
+ * only sdoDeviceOVHMAC() can use.
+ */
+int32_t sdoDeviceOVHMACInit(void **context)
+{
+#if defined(DEVICE_TPM20_ENABLED)
+	(void)context;
+	return -1;
+#else
+	SDOByteArray_t **keyset = getOVKey();
+
+	if (!keyset || !*keyset || !(*keyset)->bytes || !(*keyset)->byteSz ||
+	    !context)
+		return -1;
+
+	if (0 != sdoCryptoHMACInit(SDO_CRYPTO_HMAC_TYPE_USED, (*keyset)->bytes,
+				   (*keyset)->byteSz, context)) {
+		LOG(LOG_ERROR, "Failed to set up HMAC\n");
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+/**
+ * sdoDeviceOVHMACUpdate function adds the next piece of the header
+ * @param context In HMAC context from sdoDeviceOVHMACInit()
+ * @param OVHdr In Pointer to the piece of the header
+ * @param OVHdrLen In Size of the piece
+ * @return 0 on success and -1 on failure.
+ */
+int32_t sdoDeviceOVHMACUpdate(void *context, const uint8_t *OVHdr,
+			      size_t OVHdrLen)
+{
+#if defined(DEVICE_TPM20_ENABLED)
+	(void)context;
+	(void)OVHdr;
+	(void)OVHdrLen;
+	return -1;
+#else
+	return sdoCryptoHMACUpdate(context, OVHdr, OVHdrLen) ? -1 : 0;
+#endif
+}
+
+/**
+ * sdoDeviceOVHMACFinal function places the HMAC of the header in hmac and
+ * releases its context
+ * @param context In/Out HMAC context from sdoDeviceOVHMACInit(), NULL on
+ * return
+ * @param hmac Out Pointer to the buffer of the HMAC, NULL to only release the
+ * context
+ * @param hmacLen In Size of the buffer pointed to by hmac
+ * @return 0 on success and -1 on failure.
+ */
+int32_t sdoDeviceOVHMACFinal(void **context, uint8_t *hmac, size_t hmacLen)
+{
+#if defined(DEVICE_TPM20_ENABLED)
+	(void)context;
+	(void)hmac;
+	(void)hmacLen;
+	return -1;
+#else
+	return sdoCryptoHMACFinal(context, hmac, hmacLen) ? -1 : 0;
+#endif
+}
+
 /**
  * sdoCryptoHash function calculate hash on input data
  *
@@ -170,15 +255,55 @@ int32_t sdoCryptoHash(uint8_t *message, size_t messageLength, uint8_t *hash,
 }
 
 /**
- * sdoGenerateOVHMACKey function generates OV HMAC key
+ * sdoOVHashInit function sets up the hash of data handed over in pieces, of
+ * the type sdoCryptoHash() uses
+ *
+ * @param context - out pointer to the hash context.
  *
  * @return
- *        return 0 on success, -1 on failure.
+ *        return 0 on success. -ve value on failure.
  */
+int32_t sdoOVHashInit(void **context)
+{
+	if (!context)
+		return -1;
+	return sdoCryptoHashInit(SDO_CRYPTO_HASH_TYPE_USED, context) ? -1 : 0;
+}
 
-int32_t sdoGenerateOVHMACKey(void)
+/**
+ * sdoOVHashUpdate function hashes the next piece of data
+ *
+ * @param context - hash context from sdoOVHashInit().
+ * @param message - pointer to the piece of data.
+ * @param messageLength - size of the piece
+ *
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoOVHashUpdate(void *context, const uint8_t *message,
+			size_t messageLength)
 {
+	return sdoCryptoHashUpdate(context, message, messageLength) ? -1 : 0;
+}
 
+/**
+ * sdoOVHashFinal function places the hash in hash and releases its context
+ *
+ * @param context - in/out hash context from sdoOVHashInit(), NULL on return.
+ * @param hash - pointer to output data buffer, NULL to only release the
+ * context.
+ * @param hashLength - output data buffer size
+ *
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoOVHashFinal(void **context, uint8_t *hash, size_t hashLength)
+{
+	return sdoCryptoHashFinal(context, hash, hashLength) ? -1 : 0;
+}
+
+static int32_t sdoOVHMACKeyGenerate(void)
+{
 	int32_t ret = -1;
 #if defined(DEVICE_TPM20_ENABLED)
 	if (0 != sdoTPMGenerateHMACKey(TPM_HMAC_PUB_KEY, TPM_HMAC_PRIV_KEY)) {
@@ -208,6 +333,45 @@ err:
 	return ret;
 }
 
+/**
+ * sdoGenerateOVHMACKey function generates OV HMAC key
+ *
+ * @return
+ *        return 0 on success, -1 on failure.
+ */
+
+int32_t sdoGenerateOVHMACKey(void)
+{
+	bool *ready = getOVKeyReady();
+
+	/* Generated ahead by sdoOVHMACKeyPrepare, each key is used once */
+	if (*ready) {
+		*ready = false;
+		return 0;
+	}
+	return sdoOVHMACKeyGenerate();
+}
+
+/**
+ * sdoOVHMACKeyPrepare function generates the OV HMAC key of DI ahead, while
+ * no manufacturer waits on the device. sdoGenerateOVHMACKey then takes it
+ * instead of generating one.
+ *
+ * @return
+ *        return 0 on success, -1 on failure.
+ */
+int32_t sdoOVHMACKeyPrepare(void)
+{
+	bool *ready = getOVKeyReady();
+
+	if (*ready)
+		return 0;
+	if (0 != sdoOVHMACKeyGenerate())
+		return -1;
+	*ready = true;
+	return 0;
+}
+
 /**
  * sdoComputeStorageHMAC function generates OV HMAC key
  * @param data: pointer to the input data
@@ -224,6 +388,7 @@ int32_t sdoComputeStorageHMAC(const uint8_t *data, uint32_t dataLength,
 {
 
 	int32_t ret = -1;
+	STORAGE_STATS_START(sealStart);
 
 	if (!data || !dataLength || !computedHmac ||
 	    (computedHmacSize != PLATFORM_HMAC_SIZE)) {
@@ -266,6 +431,7 @@ error:
 		goto error;
 	}
 #endif
+	sdoStorageStatsSeal(0, sealStart);
 	return ret;
 }
 
@@ -308,6 +474,8 @@ int32_t sdoGenerateStorageHMACKey(void)
 			       " properly!\n");
 		return ret;
 	}
+	/* The cached key is the old one */
+	clearPlatformKeys();
 
 	ret = 0;
 
@@ -11,9 +11,13 @@
 #include "stdlib.h"
 #include "sdoCryptoCtx.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
 
-/* Static functions */
-static int32_t removeJavaCompatibleByteArray(SDOByteArray_t *BArray);
+/* Largest shared secret, that of DH over 3072 bits is 384 bytes and those of
+ * ASYM and ECDH are less */
+#define KEX_SECRET_MAX_SIZE 1024
+/* Largest (byte)i||kdfLabel||(byte)0||sekLabel or svkLabel */
+#define KDF_PREFIX_MAX_SIZE 64
 
 /***********************************************************************************/
 /**
@@ -71,7 +75,12 @@ int32_t sdoKexInit(void)
 	if (!to2sym_ctx->keyset.svk)
 		goto err;
 
-	if (sdoCryptoKEXInit(&(kex_ctx->context))) {
+	/* Take the key pair generated ahead if there is one, it is handed
+	 * out once so that no session shares it */
+	if (kex_ctx->nextContext) {
+		kex_ctx->context = kex_ctx->nextContext;
+		kex_ctx->nextContext = NULL;
+	} else if (sdoCryptoKEXInit(&(kex_ctx->context))) {
 		goto err;
 	}
 
@@ -89,6 +98,25 @@ err:
 	return ret;
 }
 
+/**
+ * sdoKexPrepare() - generate the device key exchange values of the next
+ * sdoKexInit ahead of time, such as while TO1 waits for the rendezvous
+ * server, so that TO2 does not wait for them.
+ * @return 0 on success, -1 on failure.
+ */
+int32_t sdoKexPrepare(void)
+{
+	sdoKexCtx_t *kex_ctx = getsdoKeyCtx();
+
+	if (kex_ctx->nextContext)
+		return 0;
+	if (sdoCryptoKEXInit(&kex_ctx->nextContext)) {
+		kex_ctx->nextContext = NULL;
+		return -1;
+	}
+	return 0;
+}
+
 /**
  * sdoKexClose() - release kex context
  */
@@ -108,6 +136,13 @@ int32_t sdoKexClose(void)
 		kex_ctx->cs = NULL;
 	}
 
+	/* A key derivation still pending is dropped with the keys */
+	kex_ctx->kexJob.pending = false;
+	if (kex_ctx->peerRandom) {
+		sdoByteArrayFree(kex_ctx->peerRandom);
+		kex_ctx->peerRandom = NULL;
+	}
+
 	/* Free "Key Exchange" information sent from device */
 	if (kex_ctx->xB) {
 		sdoByteArrayFree(kex_ctx->xB);
@@ -129,6 +164,8 @@ int32_t sdoKexClose(void)
 		sdoByteArrayFree(to2sym_ctx->keyset.svk);
 		to2sym_ctx->keyset.svk = NULL;
 	}
+	if (to2sym_ctx->keyset.svkHmac)
+		sdoCryptoHMACFinal(&to2sym_ctx->keyset.svkHmac, NULL, 0);
 
 	if (to2sym_ctx->initializationVector) {
 		sdoFree(to2sym_ctx->initializationVector);
@@ -209,132 +246,95 @@ err:
 	return ret;
 }
 
-static int32_t removeJavaCompatibleByteArray(SDOByteArray_t *BArray)
+/**
+ * Internal API: get the shared secret ShSe.
+ * @param secret - buffer of KEX_SECRET_MAX_SIZE bytes to hold it.
+ * @param shse - out, start of ShSe in secret, past the extra byte of a
+ * big-endian java number.
+ * @param shseSize - out, size of ShSe.
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t getSecret(uint8_t *secret, const uint8_t **shse,
+			 size_t *shseSize)
 {
-	if (BArray && BArray->bytes) {
-		if (BArray->bytes[0] == 0x00) {
-			if (!memmove_s(BArray->bytes, BArray->byteSz - 1,
-				       &BArray->bytes[1], BArray->byteSz - 1))
-				BArray->byteSz--;
-			else
-				return -1;
-		}
-		return 0;
-		// BArray->bytes[0] != 0x00 is also valid array
+	sdoKexCtx_t *keyExData = getsdoKeyCtx();
+	uint32_t secret_size = 0;
+
+	if (sdoCryptoGetSecret(keyExData->context, NULL, &secret_size) != 0 ||
+	    0 == secret_size || secret_size > KEX_SECRET_MAX_SIZE) {
+		LOG(LOG_ERROR, " sdoCryptoGetSecret failed");
+		return -1;
 	}
-	return -1;
+
+	if (sdoCryptoGetSecret(keyExData->context, secret, &secret_size) !=
+	    0) {
+		LOG(LOG_ERROR, " sdoCryptoGetSecret failed");
+		return -1;
+	}
+
+	/* remove extra byte from bigendian java */
+	*shse = secret;
+	*shseSize = secret_size;
+	if (secret[0] == 0x00) {
+		(*shse)++;
+		(*shseSize)--;
+	}
+	return 0;
 }
 
 /**
- * Internal API
+ * Internal API: fill prefix with (byte)1||kdfLabel||(byte)0||label, the key
+ * material ahead of ShSe. prefix[0] is the index of the output block.
+ * @param prefix - buffer of KDF_PREFIX_MAX_SIZE bytes.
+ * @param label - sekLabel or svkLabel.
+ * @return size of the prefix, 0 on failure.
  */
-
-static int32_t prep_keymat(uint8_t *keymat, size_t keymat_size,
-			   SDOByteArray_t *shse, bool svk, bool svk384)
+static size_t kdfPrefix(uint8_t *prefix, const char *label)
 {
-	int ret = -1;
 	struct sdoKexCtx *kex_ctx = getsdoKeyCtx();
-	const char *label = kex_ctx->sekLabel;
+	size_t kdfLabelLen = strnlen_s(kex_ctx->kdfLabel, SDO_MAX_STR_SIZE);
+	size_t labelLen = strnlen_s(label, SDO_MAX_STR_SIZE);
 	size_t ofs = 0;
-	uint8_t idx0_val = 0x1; /* for keymat1 */
-
-	/* Decide what to fill in idx = 0 of key material */
-	if (svk) {
-		if (svk384 == 0) {
-			idx0_val = 0x2;
-		} else {
-			idx0_val = 0x3;
-		}
-		label = kex_ctx->svkLabel;
-	}
-	keymat[ofs] = idx0_val;
+
+	if (2 + kdfLabelLen + labelLen > KDF_PREFIX_MAX_SIZE)
+		return 0;
+
+	prefix[ofs] = 0x1;
 	ofs += 1;
 
 	/* Fill in the kdflabel */
-	if (strncpy_s((char *)&keymat[ofs], keymat_size - ofs,
-		      kex_ctx->kdfLabel,
-		      strnlen_s(kex_ctx->kdfLabel, SDO_MAX_STR_SIZE))) {
-		LOG(LOG_ERROR, "Failed to fill kdf label in key Material 1\n");
-		goto err;
-	}
-	ofs += strnlen_s(kex_ctx->kdfLabel, SDO_MAX_STR_SIZE);
+	if (memcpy_s(&prefix[ofs], KDF_PREFIX_MAX_SIZE - ofs,
+		     kex_ctx->kdfLabel, kdfLabelLen))
+		return 0;
+	ofs += kdfLabelLen;
 
 	/* Follow the kdfLabel by 0 */
-	keymat[ofs] = 0x00;
+	prefix[ofs] = 0x00;
 	ofs += 1;
 
 	/* Fill in the sek/svk label */
-	if (strncpy_s((char *)&keymat[ofs], keymat_size - ofs, label,
-		      strnlen_s(label, SDO_MAX_STR_SIZE))) {
-		LOG(LOG_ERROR, "Failed to fill svk label\n");
-		goto err;
-	}
-	ofs += strnlen_s(label, SDO_MAX_STR_SIZE);
-
-	/* Fill in the shared secret */
-	if (memcpy_s(&keymat[ofs], keymat_size - ofs, shse->bytes,
-		     shse->byteSz)) {
-		LOG(LOG_ERROR, "Failed to copy shared secret\n");
-		goto err;
-	}
-
-	ret = 0;
-
-err:
-	return ret;
+	if (memcpy_s(&prefix[ofs], KDF_PREFIX_MAX_SIZE - ofs, label, labelLen))
+		return 0;
+	return ofs + labelLen;
 }
 
-/* Get Shared Secret SheShe */
-static SDOByteArray_t *getSecret(void)
+/**
+ * Internal API: an output block of the KDF, HMAC[0, prefix||ShSe], streamed
+ * through the keyed KDF HMAC.
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t kdfBlock(void *hmac, const uint8_t *prefix, size_t prefixSize,
+			const uint8_t *shse, size_t shseSize, uint8_t *out,
+			size_t outSize)
 {
-	SDOByteArray_t *b = NULL;
-	uint8_t *shared_secret_buffer = NULL;
-	uint32_t secret_size = 0;
-	struct sdoKexCtx *kex_ctx = getsdoKeyCtx();
-	sdoKexCtx_t *keyExData = (sdoKexCtx_t *)(getsdoKeyCtx());
-
-	if (sdoCryptoGetSecret(keyExData->context, NULL, &secret_size) != 0) {
-		LOG(LOG_ERROR, " sdoCryptoGetSecret failed");
-		return NULL;
-	}
-
-	shared_secret_buffer = sdoAlloc(secret_size);
-
-	if (!shared_secret_buffer) {
-		LOG(LOG_ERROR, " alloc of %d failed", secret_size);
-		return NULL;
-	}
-
-	if (sdoCryptoGetSecret(keyExData->context, shared_secret_buffer,
-			       &secret_size) != 0) {
-		LOG(LOG_ERROR, " sdoCryptoGetSecret failed");
-		goto err;
-	}
-
-	b = sdoByteArrayAllocWithByteArray(shared_secret_buffer, secret_size);
-
-	if (memset_s(shared_secret_buffer, secret_size, 0)) {
-		LOG(LOG_ERROR, "Failed to clear shared secret buffer\n");
-		goto err;
-	}
-
-	sdoFree(shared_secret_buffer);
-
-	/* remove extra byte from bigendian java */
-	if (removeJavaCompatibleByteArray(b)) {
-		goto err;
-	}
-
-	if (kex_ctx->initialSecret) {
-		sdoBitsFree(kex_ctx->initialSecret);
-		kex_ctx->initialSecret = b;
+	if (sdoCryptoHMACRestart(hmac) ||
+	    sdoCryptoHMACUpdate(hmac, prefix, prefixSize) ||
+	    sdoCryptoHMACUpdate(hmac, shse, shseSize) ||
+	    sdoCryptoHMACKeyedFinal(hmac, out, outSize)) {
+		LOG(LOG_ERROR, "Failed to derive key via HMAC\n");
+		return -1;
 	}
-	return b;
-
-err:
-	sdoFree(shared_secret_buffer);
-	sdoByteArrayFree(b);
-	return NULL;
+	return 0;
 }
 
 /**
@@ -346,17 +346,18 @@ err:
  */
 static int32_t kex_kdf(void)
 {
+	static const uint8_t hmac_key[SHA256_DIGEST_SIZE] = {0};
 	int ret = -1;
-	size_t keymat1_size = 0;
-	size_t keymat2_size = 0;
 	struct sdoKexCtx *kex_ctx = getsdoKeyCtx();
-	SDOByteArray_t *shse = getSecret();
 	SDOAESKeyset_t *keyset = getKeyset();
-	uint8_t *keymat1 = NULL;
-	uint8_t *keymat2a = NULL;
-	uint8_t *keymat2b = NULL;
-	uint8_t *hmac_buf = NULL;
-	uint8_t hmac_key[SHA256_DIGEST_SIZE] = {0};
+	uint8_t secret[KEX_SECRET_MAX_SIZE];
+	uint8_t sekPrefix[KDF_PREFIX_MAX_SIZE];
+	uint8_t svkPrefix[KDF_PREFIX_MAX_SIZE];
+	uint8_t block[SDO_SHA_DIGEST_SIZE_USED];
+	const uint8_t *shse = NULL;
+	size_t shseSize = 0;
+	size_t sekPrefixSize = 0;
+	size_t svkPrefixSize = 0;
 
 	/*
 	 * kdfLabel = "MarshalPointKDF"
@@ -383,92 +384,37 @@ static int32_t kex_kdf(void)
 	 * sek = KeyMaterial1[0..31]
 	 * svk = KeyMaterial2a[0..47] || KeyMaterial2b[0..15]
 	 *
+	 * The key materials are not assembled: the label prefixes are built
+	 * once and each block streams its prefix and ShSe through the KDF
+	 * HMAC, keyed once, so nothing is allocated.
 	 */
 
-	if (!shse) {
+	if (getSecret(secret, &shse, &shseSize)) {
 		LOG(LOG_ERROR, "Failed to get the shared secret\n");
 		goto err;
 	}
 
-	keymat1_size = 1 + strnlen_s(kex_ctx->kdfLabel, SDO_MAX_STR_SIZE) + 1 +
-		       strnlen_s(kex_ctx->sekLabel, SDO_MAX_STR_SIZE) +
-		       shse->byteSz;
-	keymat2_size = 1 + strnlen_s(kex_ctx->kdfLabel, SDO_MAX_STR_SIZE) + 1 +
-		       strnlen_s(kex_ctx->svkLabel, SDO_MAX_STR_SIZE) +
-		       shse->byteSz;
-
-	/* Allocate memory for key materials */
-	keymat1 = sdoAlloc(keymat1_size);
-	if (!keymat1) {
-		LOG(LOG_ERROR, "Out of memory for key material 1\n");
-		goto err;
-	}
-
-	keymat2a = sdoAlloc(keymat2_size);
-	if (!keymat2a) {
-		LOG(LOG_ERROR, "Out of memory for key material 2a\n");
-		goto err;
-	}
-
-#ifdef KEX_ECDH384_ENABLED
-	keymat2b = sdoAlloc(keymat2_size);
-	if (!keymat2b) {
-		LOG(LOG_ERROR, "Out of memory for key material 2b\n");
-		goto err;
-	}
-#endif
-
-	/*
-	 * Prepare keymaterial for key derivation
-	 *  -----------------------------------------------------
-	 * | param1 (svk)| param2 (svk384) | Comments            |
-	 * | false       | Don't care      | Derive sek          |
-	 * | true        | false           | Derive svk          |
-	 * | true        | true            | Derive svk (ecdh384)|
-	 *  -----------------------------------------------------
-	 */
-	ret = prep_keymat(keymat1, keymat1_size, shse, false, false);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to prepare keymat1\n");
+	sekPrefixSize = kdfPrefix(sekPrefix, kex_ctx->sekLabel);
+	svkPrefixSize = kdfPrefix(svkPrefix, kex_ctx->svkLabel);
+	if (!sekPrefixSize || !svkPrefixSize) {
+		LOG(LOG_ERROR, "Failed to prepare the key material\n");
 		goto err;
 	}
+	svkPrefix[0] = 0x2;
 
-	ret = prep_keymat(keymat2a, keymat2_size, shse, true, false);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to prepare keymat2a\n");
-		goto err;
-	}
-
-#ifdef KEX_ECDH384_ENABLED
-	ret = prep_keymat(keymat2b, keymat2_size, shse, true, true);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to prepare keymat2b\n");
-		goto err;
-	}
-#endif
-
-	/* Generate the final key materials. Keys will be subpart of it */
-
-	/*
-	 * Allocate a transient buffer to store hmac.
-	 * AES key is either 128 bit or 256 bit, so, in any case it
-	 * cannot be directly used to hold the HMAC output
-	 */
-	hmac_buf = sdoAlloc(SDO_SHA_DIGEST_SIZE_USED);
-	if (!hmac_buf) {
-		LOG(LOG_ERROR, "Failed to allocate hmac buffer\n");
-		goto err;
-	}
-
-	if (sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_USED, keymat1, keymat1_size,
-			  hmac_buf, SDO_SHA_DIGEST_SIZE_USED, hmac_key,
-			  sizeof(hmac_key))) {
-		LOG(LOG_ERROR, "Failed to derive key via HMAC\n");
+	/* The KDF key is fixed, its HMAC is keyed for all the sessions */
+	if (!kex_ctx->kdfHmac &&
+	    sdoCryptoHMACInit(SDO_CRYPTO_HMAC_TYPE_USED, hmac_key,
+			      sizeof(hmac_key), &kex_ctx->kdfHmac)) {
+		LOG(LOG_ERROR, "Failed to set up the KDF HMAC\n");
 		goto err;
 	}
 
 	/* Get the sek. (keyset->sek->byteSz <= SDO_SHA_DIGEST_SIZE_USED) */
-	if (memcpy_s(keyset->sek->bytes, keyset->sek->byteSz, hmac_buf,
+	if (kdfBlock(kex_ctx->kdfHmac, sekPrefix, sekPrefixSize, shse,
+		     shseSize, block, sizeof(block)))
+		goto err;
+	if (memcpy_s(keyset->sek->bytes, keyset->sek->byteSz, block,
 		     keyset->sek->byteSz)) {
 		LOG(LOG_ERROR, "Failed to copy sek key\n");
 		goto err;
@@ -478,61 +424,73 @@ static int32_t kex_kdf(void)
 	 * Get the svk key. It can directly hold the hmac output as it
 	 * is either 256 bits (32 bytes) or 512 bits (64 bytes)
 	 */
-	if (sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_USED, keymat2a, keymat2_size,
-			  keyset->svk->bytes, keyset->svk->byteSz, hmac_key,
-			  sizeof(hmac_key))) {
-		LOG(LOG_ERROR, "Failed to derive key via HMAC\n");
+	if (kdfBlock(kex_ctx->kdfHmac, svkPrefix, svkPrefixSize, shse,
+		     shseSize, keyset->svk->bytes, keyset->svk->byteSz))
 		goto err;
-	}
 
-/*
- * If the kex selected is ecdh384, then calculate hmac over
- * keymat2b. In this case, hmac buffer will not be able to
- * directly hold next 48 bytes more, so, using the above
- * allocated transient buffer
- */
 #ifdef KEX_ECDH384_ENABLED
-	if (sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_USED, keymat2b, keymat2_size,
-			  hmac_buf, SDO_SHA_DIGEST_SIZE_USED, hmac_key,
-			  sizeof(hmac_key))) {
-		LOG(LOG_ERROR, "Failed to derive key via HMAC\n");
+	/* Copy 16 bytes more of the third block to complete 64 bytes of svk */
+	svkPrefix[0] = 0x3;
+	if (kdfBlock(kex_ctx->kdfHmac, svkPrefix, svkPrefixSize, shse,
+		     shseSize, block, sizeof(block)))
 		goto err;
-	}
-
-	/* Copy 16 bytes more to complete 64 bytes of svk */
 	if (memcpy_s(keyset->svk->bytes + SDO_SHA_DIGEST_SIZE_USED,
-		     keyset->svk->byteSz - SDO_SHA_DIGEST_SIZE_USED, hmac_buf,
+		     keyset->svk->byteSz - SDO_SHA_DIGEST_SIZE_USED, block,
 		     16)) {
 		LOG(LOG_ERROR, "Failed to fill svk\n");
 		goto err;
 	}
 #endif
 
+	/* svk MACs every TO2 message, its key is set up once for all of them */
+	if (keyset->svkHmac)
+		sdoCryptoHMACFinal(&keyset->svkHmac, NULL, 0);
+	if (sdoCryptoHMACInit(SDO_CRYPTO_HMAC_TYPE_USED, keyset->svk->bytes,
+			      keyset->svk->byteSz, &keyset->svkHmac)) {
+		LOG(LOG_ERROR, "Failed to set up svk HMAC\n");
+		goto err;
+	}
+
 	ret = 0;
 
 err:
-	if (hmac_buf) {
-		sdoFree(hmac_buf);
-	}
-	if (keymat1) {
-		sdoFree(keymat1);
-	}
-	if (keymat2a) {
-		sdoFree(keymat2a);
-	}
-	if (keymat2b) {
-		sdoFree(keymat2b);
+	if (memset_s(secret, sizeof(secret), 0) ||
+	    memset_s(block, sizeof(block), 0)) {
+		LOG(LOG_ERROR, "Failed to clear the key material\n");
+		ret = -1;
 	}
+	return ret;
+}
 
-	sdoByteArrayFree(shse);
+/**
+ * Internal API
+ * Run by kexJob: set the peer random xA and derive the session keys.
+ */
+static int32_t kexFinish(void *arg)
+{
+	sdoKexCtx_t *keyExData = arg;
+	int32_t ret = -1;
 
+	if (0 != sdoCryptoSetPeerRandom(keyExData->context,
+					keyExData->peerRandom->bytes,
+					keyExData->peerRandom->byteSz)) {
+		LOG(LOG_ERROR, "Failed set peer random\n");
+		goto end;
+	}
+
+	ret = kex_kdf();
+end:
+	sdoByteArrayFree(keyExData->peerRandom);
+	keyExData->peerRandom = NULL;
 	return ret;
 }
 
 /**
  * This API shall set the parameter A that is received from peer and proceed
  * to generate key as per the SDO Protocol Spec. This generated key shall be
- * used for encryption/decryption in TO2 protocol.
+ * used for encryption/decryption in TO2 protocol. The key generation is
+ * submitted as a crypto job, which sdoKexComplete finishes before the key is
+ * used.
  * @param xA In Pointer to the key exchange parameter xA
  * @param encryptKey Encrypt key
  * @return 0 on success and -1 on failures
@@ -540,7 +498,6 @@ err:
 int32_t sdoSetKexParamA(SDOByteArray_t *xA, SDOPublicKey_t *encryptKey)
 
 {
-	int32_t ret = true;
 	sdoKexCtx_t *keyExData = (sdoKexCtx_t *)(getsdoKeyCtx());
 	if (!xA) {
 		return -1;
@@ -551,12 +508,46 @@ int32_t sdoSetKexParamA(SDOByteArray_t *xA, SDOPublicKey_t *encryptKey)
 		return -1;
 	}
 
-	if (0 !=
-	    sdoCryptoSetPeerRandom(keyExData->context, xA->bytes, xA->byteSz)) {
-		LOG(LOG_ERROR, "Failed set peer random\n");
+	/* The session keys are first used after msg44 is sent, the shared
+	 * secret and key derivation run as a job until then */
+	if (keyExData->peerRandom)
+		sdoByteArrayFree(keyExData->peerRandom);
+	keyExData->peerRandom =
+	    sdoByteArrayAllocWithByteArray(xA->bytes, xA->byteSz);
+	if (!keyExData->peerRandom) {
+		LOG(LOG_ERROR, "Failed to keep peer random\n");
 		return -1;
 	}
 
-	ret = kex_kdf();
-	return ret;
+	keyExData->kexJob.type = SDO_CRYPTO_JOB_KEX;
+	keyExData->kexJob.run = kexFinish;
+	keyExData->kexJob.arg = keyExData;
+	return sdoCryptoJobSubmit(&keyExData->kexJob);
+}
+
+/**
+ * sdoKexPoll() - let the pending key derivation of sdoSetKexParamA make
+ * progress, such as while the device waits on the owner.
+ */
+void sdoKexPoll(void)
+{
+	(void)sdoCryptoJobPoll(&getsdoKeyCtx()->kexJob);
+}
+
+/**
+ * sdoKexComplete() - finish the pending key derivation of sdoSetKexParamA,
+ * if any, before the session keys are used.
+ * @return 0 on success, -1 if the key derivation failed.
+ */
+int32_t sdoKexComplete(void)
+{
+	sdoKexCtx_t *kex_ctx = getsdoKeyCtx();
+
+	if (!kex_ctx->kexJob.pending)
+		return 0;
+	if (sdoCryptoJobComplete(&kex_ctx->kexJob) != 0) {
+		LOG(LOG_ERROR, "Key exchange failed\n");
+		return -1;
+	}
+	return 0;
 }
@@ -11,6 +11,11 @@
 #include "sdotypes.h"
 #include "sdoCryptoHal.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
+#include "safe_lib.h"
+#if defined(OV_VERIFY_THREADS)
+#include "task_al.h"
+#endif
 
 /**
  * This function verifies if the signature messageSignature of length
@@ -38,8 +43,34 @@ int32_t sdoOVVerify(uint8_t *message, uint32_t messageLength,
 		return -1;
 	}
 
+#if !defined(SECURE_ELEMENT)
+	void *key = sdoSigKeyGet(pubkey);
+
+	if (key) {
+		uint8_t hash[SHA384_DIGEST_SIZE] = {0};
+		uint8_t hashType = SDO_CRYPTO_HASH_TYPE_SHA_256;
+		size_t hashLength = SHA256_DIGEST_SIZE;
+
+		if (SDO_SUITE_ALG(pubkey->pkalg) ==
+		    SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384) {
+			hashType = SDO_CRYPTO_HASH_TYPE_SHA_384;
+			hashLength = SHA384_DIGEST_SIZE;
+		}
+		if (0 != _sdoCryptoHash(hashType, message, messageLength, hash,
+					hashLength))
+			return -1;
+
+		ret = sdoCryptoSigVerifyDigestKey(key, hash, hashLength,
+						  messageSignature,
+						  signatureLength);
+		*result = (0 == ret) ? true : false;
+		return ret;
+	}
+#endif
+
 	ret = sdoCryptoSigVerify(
-	    pubkey->pkenc, pubkey->pkalg, message, messageLength,
+	    SDO_SUITE_ENC(pubkey->pkenc), SDO_SUITE_ALG(pubkey->pkalg),
+	    message, messageLength,
 	    messageSignature, signatureLength, pubkey->key1->bytes,
 	    pubkey->key1->byteSz,
 	    /* X.509 encoded pubkeys only have key1 parameter */
@@ -49,3 +80,433 @@ int32_t sdoOVVerify(uint8_t *message, uint32_t messageLength,
 	*result = (0 == ret) ? true : false;
 	return ret;
 }
+
+/* Digests kept while an OV signature region is being received. The key
+ * algorithm is only known once pk (which follows bo) has been read, so both
+ * candidate hashes are run over the region, but for the one digest of the
+ * suite of a SDO_SINGLE_SUITE build. */
+typedef struct {
+	void *sha256;
+	void *sha384;
+} SDOOVVerifyCtx_t;
+
+#if defined(SDO_SINGLE_SUITE)
+#define OV_DIGEST_SHA384 (SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)
+#define OV_DIGEST_SHA256 (!OV_DIGEST_SHA384)
+#else
+#define OV_DIGEST_SHA384 1
+#define OV_DIGEST_SHA256 1
+#endif
+
+/**
+ * Start an incremental verification of an OV signature region. The region
+ * is fed with sdoOVVerifyUpdate and checked by sdoOVVerifyFinal.
+ * @param context Out Verification context
+ * @return 0 on success; -1 on failure.
+ */
+int32_t sdoOVVerifyInit(void **context)
+{
+#if defined(SECURE_ELEMENT)
+	(void)context;
+	return -1;
+#else
+	SDOOVVerifyCtx_t *ctx = NULL;
+
+	if (!context)
+		return -1;
+
+	ctx = sdoAlloc(sizeof(SDOOVVerifyCtx_t));
+	if (!ctx)
+		return -1;
+
+	if ((OV_DIGEST_SHA256 &&
+	     0 != sdoCryptoHashInit(SDO_CRYPTO_HASH_TYPE_SHA_256,
+				    &ctx->sha256)) ||
+	    (OV_DIGEST_SHA384 &&
+	     0 != sdoCryptoHashInit(SDO_CRYPTO_HASH_TYPE_SHA_384,
+				    &ctx->sha384))) {
+		sdoCryptoHashFinal(&ctx->sha256, NULL, 0);
+		sdoCryptoHashFinal(&ctx->sha384, NULL, 0);
+		sdoFree(ctx);
+		return -1;
+	}
+
+	*context = ctx;
+	return 0;
+#endif
+}
+
+/**
+ * Feed the next part of the signed region.
+ * @param context In Verification context from sdoOVVerifyInit
+ * @param message In Pointer to the next part of the message
+ * @param len In Size of that part
+ * @return 0 on success; -1 on failure.
+ */
+int32_t sdoOVVerifyUpdate(void *context, const uint8_t *message, size_t len)
+{
+#if defined(SECURE_ELEMENT)
+	(void)context;
+	(void)message;
+	(void)len;
+	return -1;
+#else
+	SDOOVVerifyCtx_t *ctx = context;
+
+	if (!ctx || !message)
+		return -1;
+
+	if ((OV_DIGEST_SHA256 &&
+	     0 != sdoCryptoHashUpdate(ctx->sha256, message, len)) ||
+	    (OV_DIGEST_SHA384 &&
+	     0 != sdoCryptoHashUpdate(ctx->sha384, message, len)))
+		return -1;
+	return 0;
+#endif
+}
+
+#if !defined(SECURE_ELEMENT)
+/**
+ * Complete the digest of a signed region that pubkey verifies and release
+ * the verification context.
+ * @param context In/Out Verification context, set to NULL on return
+ * @param pubkey In Public key, NULL to only release the context
+ * @param hash Out Digest, SHA384_DIGEST_SIZE bytes
+ * @param hashLength Out Size of the digest
+ * @return 0 on success; -1 on failure.
+ */
+static int32_t sdoOVVerifyDigest(void **context, SDOPublicKey_t *pubkey,
+				 uint8_t *hash, size_t *hashLength)
+{
+	SDOOVVerifyCtx_t *ctx = *context;
+	int32_t ret = -1;
+
+	if (!pubkey)
+		goto end;
+
+	if (SDO_SUITE_ALG(pubkey->pkalg) == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384) {
+		*hashLength = SHA384_DIGEST_SIZE;
+		ret = sdoCryptoHashFinal(&ctx->sha384, hash, *hashLength);
+	} else {
+		*hashLength = SHA256_DIGEST_SIZE;
+		ret = sdoCryptoHashFinal(&ctx->sha256, hash, *hashLength);
+	}
+
+end:
+	sdoCryptoHashFinal(&ctx->sha256, NULL, 0);
+	sdoCryptoHashFinal(&ctx->sha384, NULL, 0);
+	sdoFree(ctx);
+	*context = NULL;
+	return ret ? -1 : 0;
+}
+#endif
+
+/**
+ * Finish an incremental verification and release its context. Passing a
+ * NULL messageSignature only releases the context.
+ * @param context In/Out Verification context, set to NULL on return
+ * @param messageSignature In Pointer to the signature of the message
+ * @param signatureLength In Size of the message signature
+ * @param pubkey In Pointer to the public key used to verify the signature
+ * @param result Out TRUE if the signature is successfully verified, FALSE
+ * if the signature does not match
+ * @return 0 on success; -1 on failure. The result parameter must be checked
+ * only when return value is 0.
+ */
+int32_t sdoOVVerifyFinal(void **context, uint8_t *messageSignature,
+			 uint32_t signatureLength, SDOPublicKey_t *pubkey,
+			 bool *result)
+{
+#if defined(SECURE_ELEMENT)
+	(void)context;
+	(void)messageSignature;
+	(void)signatureLength;
+	(void)pubkey;
+	(void)result;
+	return -1;
+#else
+	int32_t ret = -1;
+	uint8_t hash[SHA384_DIGEST_SIZE] = {0};
+	size_t hashLength = 0;
+	void *key = NULL;
+
+	if (!context || !*context)
+		return -1;
+
+	if (!messageSignature || !pubkey || !pubkey->key1 || !result) {
+		sdoOVVerifyDigest(context, NULL, NULL, NULL);
+		return -1;
+	}
+
+	if (0 != sdoOVVerifyDigest(context, pubkey, hash, &hashLength))
+		return -1;
+
+	key = sdoSigKeyGet(pubkey);
+	if (key)
+		ret = sdoCryptoSigVerifyDigestKey(key, hash, hashLength,
+						  messageSignature,
+						  signatureLength);
+	else
+		ret = sdoCryptoSigVerifyDigest(
+		    SDO_SUITE_ENC(pubkey->pkenc), SDO_SUITE_ALG(pubkey->pkalg),
+		    hash, hashLength,
+		    messageSignature, signatureLength, pubkey->key1->bytes,
+		    pubkey->key1->byteSz,
+		    /* X.509 encoded pubkeys only have key1 parameter */
+		    (pubkey->key2 ? pubkey->key2->bytes : NULL),
+		    (pubkey->key2 ? pubkey->key2->byteSz : 0));
+
+	*result = (0 == ret) ? true : false;
+	return ret;
+#endif
+}
+
+#if defined(OV_VERIFY_THREADS) && !defined(SECURE_ELEMENT)
+/* Signatures queued and not verified yet, sdoOVBatchAdd waits beyond it */
+#ifndef OV_VERIFY_QUEUE
+#define OV_VERIFY_QUEUE 4
+#endif
+
+/* A signature verified by a task of the shared pool. It holds a copy of the
+ * signature and a reference to the (unchanging) key, so that the task
+ * neither allocates nor frees, nor looks at protocol state. */
+typedef struct SDOOVJob_s {
+	struct SDOOVJob_s *next;
+	sdoTask_t *task;
+	uint8_t hash[SHA384_DIGEST_SIZE];
+	size_t hashLength;
+	uint8_t *sg;
+	uint32_t sgLen;
+	SDOPublicKey_t *pk;
+} SDOOVJob_t;
+
+typedef struct {
+	SDOOVJob_t *queue; // jobs submitted and not joined yet, oldest first
+	SDOOVJob_t **tail;
+	int pending; // jobs in the queue
+	bool failed; // a signature did not verify, the rest are skipped
+} SDOOVBatch_t;
+
+/**
+ * Internal API: verify the signature of a job, as a task of the pool
+ */
+static int32_t sdoOVBatchVerify(void *arg)
+{
+	SDOOVJob_t *job = arg;
+
+	/* X.509 encoded pubkeys only have key1 parameter */
+	return sdoCryptoSigVerifyDigest(
+	    SDO_SUITE_ENC(job->pk->pkenc), SDO_SUITE_ALG(job->pk->pkalg),
+	    job->hash, job->hashLength, job->sg, job->sgLen,
+	    job->pk->key1->bytes, job->pk->key1->byteSz,
+	    job->pk->key2 ? job->pk->key2->bytes : NULL,
+	    job->pk->key2 ? job->pk->key2->byteSz : 0);
+}
+
+/**
+ * Internal API: free a list of jobs
+ */
+static void sdoOVJobsFree(SDOOVJob_t *job)
+{
+	SDOOVJob_t *next;
+
+	for (; job; job = next) {
+		next = job->next;
+		if (job->sg)
+			sdoFree(job->sg);
+		sdoPublicKeyFree(job->pk);
+		sdoFree(job);
+	}
+}
+
+/**
+ * Internal API: copy len bytes of src to a new buffer in *dst
+ */
+static bool sdoOVJobCopy(uint8_t **dst, const uint8_t *src, uint32_t len)
+{
+	*dst = sdoAlloc(len);
+	return *dst && 0 == memcpy_s(*dst, len, src, len);
+}
+
+/**
+ * Internal API: wait for the oldest job of a batch and free it, cancelling
+ * it if a signature failed already
+ */
+static void sdoOVBatchJoin(SDOOVBatch_t *b)
+{
+	SDOOVJob_t *job = b->queue;
+	int32_t ret = -1;
+
+	b->queue = job->next;
+	if (!b->queue)
+		b->tail = &b->queue;
+	b->pending--;
+	job->next = NULL;
+
+	if (b->failed)
+		(void)sdoTaskCancel(job->task);
+	if (0 != sdoTaskJoin(job->task, &ret) || 0 != ret)
+		b->failed = true;
+	sdoOVJobsFree(job);
+}
+#endif
+
+/**
+ * Start a batch of OV signatures verified by the tasks of the shared pool
+ * while the protocol goes on. Signatures are queued with sdoOVBatchAdd and
+ * the outcome is collected by sdoOVBatchFinal.
+ * @param batch Out Batch context
+ * @return 0 on success; -1 on failure, always when the build does not batch
+ * them (OV_VERIFY_THREADS) or has no task workers, signatures are then
+ * verified in line.
+ */
+int32_t sdoOVBatchInit(void **batch)
+{
+#if defined(OV_VERIFY_THREADS) && !defined(SECURE_ELEMENT)
+	SDOOVBatch_t *b;
+
+	if (!batch)
+		return -1;
+	if (!sdoTaskPoolShared()) {
+		LOG(LOG_DEBUG, "No task worker to verify the OV entries on\n");
+		return -1;
+	}
+
+	b = sdoAlloc(sizeof(SDOOVBatch_t));
+	if (!b)
+		return -1;
+	b->tail = &b->queue;
+	*batch = b;
+	return 0;
+#else
+	(void)batch;
+	return -1;
+#endif
+}
+
+/**
+ * Queue the verification of a signed region of an incremental verification.
+ * The digest of the region is completed here, the signature is checked by
+ * a task. Once OV_VERIFY_QUEUE signatures are pending, waits for the oldest
+ * to be verified, so that a voucher of any length is verified in bounded
+ * memory.
+ * @param batch In Batch context from sdoOVBatchInit
+ * @param context In/Out Verification context from sdoOVVerifyInit holding
+ * the whole region, set to NULL on return
+ * @param messageSignature In Pointer to the signature of the message
+ * @param signatureLength In Size of the message signature
+ * @param pubkey In Pointer to the public key used to verify the signature
+ * @return 0 on success; -1 on failure.
+ */
+int32_t sdoOVBatchAdd(void *batch, void **context, uint8_t *messageSignature,
+		      uint32_t signatureLength, SDOPublicKey_t *pubkey)
+{
+#if defined(OV_VERIFY_THREADS) && !defined(SECURE_ELEMENT)
+	SDOOVBatch_t *b = batch;
+	SDOOVJob_t *job = NULL;
+
+	if (!context || !*context)
+		return -1;
+
+	if (!b || !messageSignature || !signatureLength || !pubkey ||
+	    !pubkey->key1)
+		goto err;
+
+	job = sdoAlloc(sizeof(SDOOVJob_t));
+	if (!job)
+		goto err;
+	if (0 != sdoOVVerifyDigest(context, pubkey, job->hash,
+				   &job->hashLength))
+		goto err;
+
+	job->sgLen = signatureLength;
+	job->pk = sdoPublicKeyClone(pubkey);
+	if (!job->pk ||
+	    !sdoOVJobCopy(&job->sg, messageSignature, signatureLength))
+		goto err;
+
+	while (b->pending >= OV_VERIFY_QUEUE)
+		sdoOVBatchJoin(b);
+	if (b->failed) {
+		/* the batch failed already, no need to check this one */
+		sdoOVJobsFree(job);
+		return 0;
+	}
+	job->task = sdoTaskSubmit(sdoTaskPoolShared(), sdoOVBatchVerify, job);
+	if (!job->task)
+		goto err;
+	*b->tail = job;
+	b->tail = &job->next;
+	b->pending++;
+	return 0;
+
+err:
+	if (*context)
+		sdoOVVerifyDigest(context, NULL, NULL, NULL);
+	sdoOVJobsFree(job);
+	return -1;
+#else
+	(void)batch;
+	(void)context;
+	(void)messageSignature;
+	(void)signatureLength;
+	(void)pubkey;
+	return -1;
+#endif
+}
+
+/**
+ * Check, without waiting, whether a signature of a batch failed to verify
+ * already.
+ * @param batch In Batch context from sdoOVBatchInit
+ * @return true if one did, false if none did so far.
+ */
+bool sdoOVBatchFailed(void *batch)
+{
+#if defined(OV_VERIFY_THREADS) && !defined(SECURE_ELEMENT)
+	SDOOVBatch_t *b = batch;
+
+	if (!b)
+		return false;
+	while (b->queue && sdoTaskDone(b->queue->task))
+		sdoOVBatchJoin(b);
+	return b->failed;
+#else
+	(void)batch;
+	return false;
+#endif
+}
+
+/**
+ * Wait for all the signatures of a batch and release it. Passing a NULL
+ * result skips the signatures not checked yet.
+ * @param batch In/Out Batch context, set to NULL on return
+ * @param result Out TRUE if every queued signature verified, FALSE
+ * otherwise
+ * @return 0 on success; -1 on failure. The result parameter must be checked
+ * only when return value is 0.
+ */
+int32_t sdoOVBatchFinal(void **batch, bool *result)
+{
+#if defined(OV_VERIFY_THREADS) && !defined(SECURE_ELEMENT)
+	SDOOVBatch_t *b;
+
+	if (!batch || !*batch)
+		return -1;
+	b = *batch;
+
+	if (!result)
+		b->failed = true;
+	while (b->queue)
+		sdoOVBatchJoin(b);
+	if (result)
+		*result = !b->failed;
+	sdoFree(b);
+	*batch = NULL;
+	return 0;
+#else
+	(void)batch;
+	(void)result;
+	return -1;
+#endif
+}
@@ -117,35 +117,68 @@ error:
 	return -1;
 }
 
+/**
+ * Internal API: encrypt the device random with the owner key, with the key
+ * object the signatures of the owner are verified with, if there is one.
+ * @return as for sdoCryptoRSAEncrypt.
+ */
+static int32_t rsaEncryptB(rsa_context_t *keyExData, void *key,
+			   uint8_t *cipher, uint32_t cipherLength)
+{
+	if (key)
+		return sdoCryptoRSAEncryptKey(
+		    SDO_PK_HASH_SHA256, key, keyExData->_DeviceRandom,
+		    keyExData->_DevRandSize, cipher, cipherLength);
+
+	return sdoCryptoRSAEncrypt(
+	    /* TODO : use hashtype, pkey encoding types/pubkey algos
+	     * too from keyExdata */
+	    SDO_PK_HASH_SHA256, SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
+	    SDO_CRYPTO_PUB_KEY_ALGO_RSA, keyExData->_DeviceRandom,
+	    keyExData->_DevRandSize, cipher, cipherLength,
+	    keyExData->_encryptKey->key1->bytes,
+	    keyExData->_encryptKey->key1->byteSz,
+	    keyExData->_encryptKey->key2->bytes,
+	    keyExData->_encryptKey->key2->byteSz);
+}
+
 /**
  * Internal API
  */
 static bool computePublicBAsym(rsa_context_t *keyExData)
 {
+	void *key = NULL;
+
 	LOG(LOG_DEBUG, "computePublicBAsym started\n");
 
 	// compute public B, encrypted version of secret
 	if (keyExData->_encryptKey != NULL) {
+#if !defined(SECURE_ELEMENT)
+		/*
+		 * The owner key decoded for msg41 is in the signature key
+		 * cache, its RSA object is used rather than a new one.
+		 */
+		if (keyExData->_encryptKey->pkalg ==
+			SDO_CRYPTO_PUB_KEY_ALGO_RSA &&
+		    keyExData->_encryptKey->pkenc ==
+			SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP)
+			key = sdoSigKeyGet(keyExData->_encryptKey);
+#endif
 		// We have a key, encrypt xb using it, producing xB
 		keyExData->_publicB_length = 0;
 #if LOG_LEVEL == LOG_MAX_LEVEL
-		char debug_buffer[2048] = {0};
+		char *debug_buffer = sdoScratchLease(SDO_SCRATCH_SIZE);
 		/* Have a look at the kpublic key provided. */
-		sdoPublicKeyToString(keyExData->_encryptKey, debug_buffer,
-				     2048);
-		LOG(LOG_DEBUG, "Owner Public Key 2: %s\n", debug_buffer);
+		if (debug_buffer &&
+		    sdoPublicKeyToString(keyExData->_encryptKey, debug_buffer,
+					 SDO_SCRATCH_SIZE))
+			LOG(LOG_DEBUG, "Owner Public Key 2: %s\n",
+			    debug_buffer);
+		sdoScratchRelease(debug_buffer);
 #endif
 		/* Get the cipherLength required */
-		keyExData->_publicB_length = sdoCryptoRSAEncrypt(
-		    /* TODO : use hashtype, pkey encoding types/pubkey algos
-		     * too from keyExdata */
-		    SDO_PK_HASH_SHA256, SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
-		    SDO_CRYPTO_PUB_KEY_ALGO_RSA, keyExData->_DeviceRandom,
-		    keyExData->_DevRandSize, NULL, 0,
-		    keyExData->_encryptKey->key1->bytes,
-		    keyExData->_encryptKey->key1->byteSz,
-		    keyExData->_encryptKey->key2->bytes,
-		    keyExData->_encryptKey->key2->byteSz);
+		keyExData->_publicB_length =
+		    rsaEncryptB(keyExData, key, NULL, 0);
 
 		if (keyExData->_publicB_length <= 0)
 			goto err;
@@ -157,16 +190,8 @@ static bool computePublicBAsym(rsa_context_t *keyExData)
 			goto err;
 		}
 
-		if (0 != sdoCryptoRSAEncrypt(
-			     SDO_PK_HASH_SHA256,
-			     SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP,
-			     SDO_CRYPTO_PUB_KEY_ALGO_RSA,
-			     keyExData->_DeviceRandom, keyExData->_DevRandSize,
-			     keyExData->_publicB, keyExData->_publicB_length,
-			     keyExData->_encryptKey->key1->bytes,
-			     keyExData->_encryptKey->key1->byteSz,
-			     keyExData->_encryptKey->key2->bytes,
-			     keyExData->_encryptKey->key2->byteSz)) {
+		if (0 != rsaEncryptB(keyExData, key, keyExData->_publicB,
+				     keyExData->_publicB_length)) {
 
 			LOG(LOG_ERROR, "rsa_encrypt() finished with "
 				       "some error !!\n");
@@ -178,10 +203,14 @@ static bool computePublicBAsym(rsa_context_t *keyExData)
 		if (keyExData->_DeviceRandom) {
 			SDOByteArray_t *pB = sdoByteArrayAllocWithByteArray(
 			    keyExData->_DeviceRandom, keyExData->_DevRandSize);
-			sdoByteArrayToString(pB, debug_buffer, 2048);
-			if (debug_buffer[0] != 0)
+			debug_buffer = sdoScratchLease(SDO_SCRATCH_SIZE);
+			if (debug_buffer &&
+			    sdoByteArrayToString(pB, debug_buffer,
+						 SDO_SCRATCH_SIZE) &&
+			    debug_buffer[0] != 0)
 				LOG(LOG_DEBUG, "rsa_encrypt result : %s.\n",
 				    debug_buffer);
+			sdoScratchRelease(debug_buffer);
 			sdoByteArrayFree(pB);
 		}
 #endif
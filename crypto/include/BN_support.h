@@ -57,6 +57,11 @@ static inline int bn_num_bytes(const bignum_t *a)
 
 #else
 
+/* BN_CTX pooled by the engine, so that operations do not allocate theirs */
+BN_CTX *bn_ctx_get(void);
+void bn_ctx_put(BN_CTX *ctx);
+void bn_ctx_pool_free(void);
+
 static inline int bn_bin2bn(const unsigned char *s, int len, bignum_t *bn)
 {
 	BIGNUM *ret = BN_bin2bn(s, len, bn);
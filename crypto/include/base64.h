@@ -49,7 +49,8 @@ int binToB64(size_t length, uint8_t *binBytes, size_t offset, size_t b64Len,
  * @param binBytes veriable length output buffer.  Compute length with
  * b64ToBinLength
  * @param binOffset offset into output buffer
- * @return length of binary output
+ * @return length of binary output, 0 if length is under 4, -1 if the input
+ * is invalid, length not being a multiple of 4 included
  */
 int b64ToBin(size_t length, uint8_t *b64bytes, size_t offset, size_t binLen,
 	     uint8_t *binBytes, size_t binOffset);
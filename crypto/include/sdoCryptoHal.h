@@ -29,6 +29,12 @@ extern "C" {
 #include <openssl/conf.h>
 #endif
 
+/*
+ * On TARGET_OS_OPTEE the whole SDK, this HAL included, is built into the TA,
+ * so the calls below are plain calls within the secure world and need no
+ * batching; only network and storage leave it.
+ */
+
 #define PLAIN_TEXT_SIZE BUFF_SIZE_1K_BYTES
 
 #define SHA256_DIGEST_SIZE BUFF_SIZE_32_BYTES
@@ -77,6 +83,11 @@ int random_close(void);
  * should point to a buffer large enough to store this data. */
 int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes);
 
+#ifdef CRYPTO_FIXED_RANDOM
+/* Same bytes each time the engine is brought up, for NET_REPLAY only. */
+int32_t sdoCryptoFixedRandom(uint8_t *buf, size_t len);
+#endif
+
 int32_t cryptoInit(void);
 int32_t cryptoClose(void);
 
@@ -92,6 +103,33 @@ int32_t sdoCryptoHMAC(uint8_t hmacType, const uint8_t *buffer,
 		      size_t bufferLength, uint8_t *output, size_t outputLength,
 		      const uint8_t *key, size_t keyLength);
 
+/* Incremental hash of data handed over in pieces. "context" is set up by the
+ * Init function, fed by Update and released by Final, which places the result
+ * in "output" unless "output" is NULL. */
+int32_t sdoCryptoHashInit(uint8_t hashType, void **context);
+int32_t sdoCryptoHashUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength);
+int32_t sdoCryptoHashFinal(void **context, uint8_t *output,
+			   size_t outputLength);
+
+/* Incremental hmac, the counterpart of the incremental hash keyed by "key" */
+int32_t sdoCryptoHMACInit(uint8_t hmacType, const uint8_t *key,
+			  size_t keyLength, void **context);
+int32_t sdoCryptoHMACUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength);
+int32_t sdoCryptoHMACFinal(void **context, uint8_t *output,
+			   size_t outputLength);
+/* Calculate the hmac of a whole "buffer" with the key of "context", which
+ * stays keyed for the next one, so a key is set up once for all its uses. */
+int32_t sdoCryptoHMACKeyed(void *context, const uint8_t *buffer,
+			   size_t bufferLength, uint8_t *output,
+			   size_t outputLength);
+/* Start a new hmac with the key of "context", fed by Update and completed by
+ * KeyedFinal, which keeps "context" keyed for the next one. */
+int32_t sdoCryptoHMACRestart(void *context);
+int32_t sdoCryptoHMACKeyedFinal(void *context, uint8_t *output,
+				size_t outputLength);
+
 /* sdoCryptoSigVerify
  * Verify an RSA PKCS v1.5 Signature using provided public key
  * or verify ecdsa signature verify
@@ -116,6 +154,43 @@ int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
 			   uint32_t keyParam1Length, const uint8_t *keyParam2,
 			   uint32_t keyParam2Length);
 
+/* sdoCryptoSigVerifyDigest
+ * Same as sdoCryptoSigVerify, for a message already hashed with the hash of
+ * the key algorithm (SHA-384 for ECDSA P-384, SHA-256 otherwise).
+ *
+ * @param hash[in] - digest of the message.
+ * @param hashLength[in] - size of the digest.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigest(uint8_t keyEncoding, uint8_t keyAlgorithm,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength,
+				 const uint8_t *keyParam1,
+				 uint32_t keyParam1Length,
+				 const uint8_t *keyParam2,
+				 uint32_t keyParam2Length);
+
+/* sdoCryptoSigKeyLoad
+ * Decode a public key, with the parameters of sdoCryptoSigVerify, into a
+ * handle of the crypto library to verify digests with, so that a key used
+ * for many signatures is decoded and checked once.
+ *
+ * @param key[out] - key handle, released with sdoCryptoSigKeyFree.
+ * @return 0 on success, else -1.
+ */
+int32_t sdoCryptoSigKeyLoad(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			    const uint8_t *keyParam1, uint32_t keyParam1Length,
+			    const uint8_t *keyParam2, uint32_t keyParam2Length,
+			    void **key);
+/* Same as sdoCryptoSigVerifyDigest, with a key from sdoCryptoSigKeyLoad */
+int32_t sdoCryptoSigVerifyDigestKey(void *key, const uint8_t *hash,
+				    uint32_t hashLength,
+				    const uint8_t *messageSignature,
+				    uint32_t signatureLength);
+/* Release a key handle, *key is set to NULL */
+void sdoCryptoSigKeyFree(void **key);
+
 /* ECDSA P-256/384 curve signature length, can be to used while allocating
  * buffer */
 
@@ -130,6 +205,11 @@ int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
 			    uint32_t cipherTextLength, const uint8_t *keyParam1,
 			    uint32_t keyParam1Length, const uint8_t *keyParam2,
 			    uint32_t keyParam2Length);
+/* Same as sdoCryptoRSAEncrypt, with an RSA key from sdoCryptoSigKeyLoad */
+int32_t sdoCryptoRSAEncryptKey(uint8_t hashType, void *key,
+			       const uint8_t *clearText,
+			       uint32_t clearTextLength, uint8_t *cipherText,
+			       uint32_t cipherTextLength);
 
 #define RSA_SHA256_KEY1_SIZE 256
 
@@ -194,26 +274,49 @@ int32_t DERDecode(uint8_t *rawKey, uint8_t *rawSig, const unsigned char *pubKey,
 		  size_t signatureLength, size_t rawKeyLength,
 		  size_t rawSigLength);
 
+/* Allocation free DER codec for the P-256/P-384 shapes, -1 for others */
+int32_t sdoDERSigFromRaw(const uint8_t *rawSig, size_t rawSigLength,
+			 uint8_t *der, size_t derSize, size_t *derLength);
+int32_t sdoDERSigToRaw(const uint8_t *der, size_t derLength, uint8_t *rawSig,
+		       size_t rawSigLength);
+int32_t sdoDERPubKeyToRaw(const uint8_t *der, size_t derLength,
+			  uint8_t *rawKey, size_t rawKeyLength);
+
 int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr);
 
 /* SSL API's*/
 
 int sdo_ssl_read(void *ssl, void *buf, int num);
 int sdo_ssl_write(void *ssl, const void *buf, int num);
+void sdo_ssl_context_free(void);
+void sdo_ssl_session_cache_clear(void);
+#ifdef HTTP2
+/* true if the connection speaks HTTP/2, as ALPN agreed */
+bool sdo_ssl_alpn_h2(void *ssl);
+#endif
 
 #ifdef USE_OPENSSL
-void *sdo_ssl_setup(int sock);
+struct sockaddr;
+void *sdo_ssl_setup(int sock, const struct sockaddr *peer);
 int sdo_ssl_connect(void *ssl);
 int sdo_ssl_close(void *ssl);
+#ifdef TLS_EARLY_DATA
+/* First write of a connection, as 0-RTT data if the session allows it */
+int sdo_ssl_write_early(void *ssl, const void *buf, int num);
+#endif
+
+/* Non-blocking read/write, return one of these if the call would block */
+#define SDO_SSL_WANT_READ -2
+#define SDO_SSL_WANT_WRITE -3
+int sdo_ssl_read_nb(void *ssl, void *buf, int num);
+int sdo_ssl_write_nb(void *ssl, const void *buf, int num);
 #endif
 
 #ifdef USE_MBEDTLS
+/* A connection, the TLS configuration is shared by all of them */
 typedef struct sslInfo {
 	mbedtls_net_context server_fd;
 	mbedtls_ssl_context ssl;
-	mbedtls_ssl_config conf;
-	mbedtls_entropy_context entropy;
-	mbedtls_ctr_drbg_context ctr_drbg;
 } sslInfo;
 
 void *sdo_ssl_setup_connect(char *server_name, char *port);
@@ -256,6 +359,27 @@ int32_t sdoCryptoKEXClose(void **context);
 
 int32_t setEncryptKeyAsym(void *context, SDOPublicKey_t *encryptKey);
 
+/*
+ * Crypto jobs, for operations whose input is known before their result is
+ * needed. A job is submitted, polled while the caller waits, such as on the
+ * network, and completed before its result is used. The software backends
+ * run it on the first poll or at completion; a secure element backend can
+ * start it on submission and have the poll check on the element. The job
+ * types are in sdoCryptoCtx.h.
+ */
+int32_t sdoCryptoJobSubmit(sdoCryptoJob_t *job);
+bool sdoCryptoJobPoll(sdoCryptoJob_t *job);
+int32_t sdoCryptoJobComplete(sdoCryptoJob_t *job);
+
+#ifdef ECC_RESTARTABLE
+/*
+ * ECDSA signing and ECDH run in slices of ECC_SLICE_OPS operations
+ * (mbedTLS restartable ECP), the yield callback running between two.
+ */
+typedef void (*sdoCryptoYieldCB)(void);
+void sdoCryptoSetYield(sdoCryptoYieldCB yield);
+#endif
+
 #ifdef __cplusplus
 } // endof externc (CPP code)
 #endif
@@ -98,5 +98,6 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 		      char *tpmHMACPrivKey);
 int32_t sdoTPMGenerateHMACKey(char *tpmHMACPubKey, char *tpmHMACPrivKey);
 int32_t isValidTPMDataProtectionKeyPresent(void);
+void sdoTPMClose(void);
 
 #endif /* #ifndef __TPM20_UTILS_H__ */
@@ -33,6 +33,11 @@ int32_t DEREncode(uint8_t *rawSig, size_t rawSigLength,
 	unsigned char *p = buf + sizeof(buf);
 	size_t len = 0;
 
+	/* P-256/P-384 signatures need no ASN.1 objects */
+	if (0 == sdoDERSigFromRaw(rawSig, rawSigLength, messageSignature,
+				  BUFF_SIZE_256_BYTES, signatureLength))
+		return 0;
+
 	mbedtls_mpi_init(&r);
 	mbedtls_mpi_init(&s);
 
@@ -127,6 +132,12 @@ int32_t DERDecode(uint8_t *rawKey, uint8_t *rawSig, const unsigned char *pubKey,
 	uint8_t *local_raw_key = NULL;
 	uint8_t *end_buf;
 
+	/* The usual key and signature shapes need no ASN.1 objects */
+	if (0 == sdoDERPubKeyToRaw(pubKey, keyLength, rawKey, rawKeyLength) &&
+	    0 == sdoDERSigToRaw(messageSignature, signatureLength, rawSig,
+				rawSigLength))
+		return 0;
+
 	if ((NULL == rawKey) || (NULL == rawSig) || (NULL == pubKey) ||
 	    (NULL == messageSignature) ||
 	    (BUFF_SIZE_64_BYTES != rawSigLength) ||
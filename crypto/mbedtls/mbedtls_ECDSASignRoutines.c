@@ -13,6 +13,7 @@
 #include "mbedtls/sha256.h"
 #include "mbedtls/platform.h"
 #include "mbedtls/ecdsa.h"
+#include "mbedtls/pk.h"
 
 #include "safe_lib.h"
 #include "sdoCryptoHal.h"
@@ -21,63 +22,75 @@
 #include "storage_al.h"
 #include "mbedtls_random.h"
 #include "ecdsa_privkey.h"
+#include "mbedtls_ec_key.h"
+#include "sdoCryptoApi.h"
+
+/*
+ * Resident device key: read from the storage of the instance and decoded
+ * once, with its group loaded and its public point computed. Computing the
+ * point by G leaves the fixed-base comb table of G in the group, so
+ * signatures only cost the multiplication by the nonce from the table. It
+ * is kept in the crypto context of the instance, each instance having a
+ * key of its own, and freed, and so wiped, when its crypto is closed.
+ */
+/* The comb table is built in the group on use, by one thread at a time */
+SDO_MUTEX(devKeyLock);
+
+/* Free the resident device key, see sdoDevKeyCtx_t */
+static void devKeyFree(void *key)
+{
+	mbedtls_ecdsa_context *devKey = key;
+
+	mbedtls_ecdsa_free(devKey);
+	sdoFree(devKey);
+}
 
 /**
- * Sign a message using provided ECDSA Private Keys.
- * @param data - pointer of type uint8_t, holds the plaintext message.
- * @param dataLen - size of message, type size_t.
- * @param messageSignature - pointer of type unsigned char, which will be
- * by filled with signature.
- * @param signatureLength - size of signature, type unsigned int.
- * @return 0 if true, else -1.
+ * Internal API: load the resident device key of the instance, unless it is
+ * loaded. To be called with devKeyLock held.
+ * @return the key, NULL on failure.
  */
-int32_t sdoECDSASign(const uint8_t *data, size_t dataLen,
-		     unsigned char *messageSignature, size_t *signatureLength)
+static mbedtls_ecdsa_context *devKeyLoad(void)
 {
-	int ret = -1;
-	int retval = -1;
-	mbedtls_ecdsa_context ctx_sign = {0};
+	sdoDevKeyCtx_t *keyCtx = getsdoDevKeyCtx();
+	mbedtls_ecdsa_context *devKey = NULL;
+	bool loaded = false;
+	int retval;
 	mbedtls_ctr_drbg_context *drbg_ctx = get_mbedtls_random_ctx();
-	unsigned char hash[SHA512_DIGEST_SIZE] = {0};
 	unsigned char *privkey = NULL;
 	size_t privkeysize = 0;
-#if !defined(ECDSA_PEM)
-	mbedtls_mpi d = {0};
-#else
-	mbedtls_pk_context pk_ctx = {0};
+	mbedtls_ecp_group_id curvetype = MBEDTLS_ECP_DP_NONE;
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecp_restart_ctx rs;
+#endif
+#if defined(ECDSA_PEM)
+	mbedtls_pk_context pk_ctx;
 	mbedtls_ecp_keypair *ecp = NULL;
+
+	mbedtls_pk_init(&pk_ctx);
 #endif
-	mbedtls_md_type_t hashType = MBEDTLS_MD_NONE;
-	size_t hashLength = 0;
-	uint32_t curvetype = 0;
 
-	if (!data || !dataLen || !messageSignature || !signatureLength ||
-	    !drbg_ctx) {
-		LOG(LOG_ERROR, "sdoCryptoDSASign params not valid\n");
-		ret = -1;
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecp_restart_init(&rs);
+#endif
+	if (!keyCtx)
+		return NULL;
+	if (keyCtx->signKey)
+		return keyCtx->signKey;
+	if (!drbg_ctx)
 		goto end;
-	}
-
-	mbedtls_ecdsa_init(&ctx_sign);
+	devKey = sdoAlloc(sizeof(mbedtls_ecdsa_context));
+	if (!devKey)
+		goto end;
+	mbedtls_ecdsa_init(devKey);
 
 #if defined(ECDSA256_DA)
-	hashType = MBEDTLS_MD_SHA256;
-	hashLength = SHA256_DIGEST_SIZE;
 	curvetype = MBEDTLS_ECP_DP_SECP256R1;
 #elif defined(ECDSA384_DA)
-	hashType = MBEDTLS_MD_SHA384;
-	hashLength = SHA384_DIGEST_SIZE;
 	curvetype = MBEDTLS_ECP_DP_SECP384R1;
 #endif
 
-	/* Calculate the hash over message and sign that hash */
-	if ((retval = mbedtls_md(mbedtls_md_info_from_type(hashType), data,
-				 dataLen, hash)) != 0) {
-		LOG(LOG_ERROR, " mbedtls_md FAILED:%d\n", retval);
-		goto end;
-	}
-
-	if ((retval = mbedtls_ecp_group_load(&ctx_sign.grp, curvetype)) != 0) {
+	if ((retval = mbedtls_ecp_group_load(&devKey->grp, curvetype)) != 0) {
 		LOG(LOG_ERROR, "signatur_ecp_group_load FAILED:%d\n", retval);
 		goto end;
 	}
@@ -90,19 +103,15 @@ int32_t sdoECDSASign(const uint8_t *data, size_t dataLen,
 	}
 
 #if !defined(ECDSA_PEM)
-
 	// Load private key from buffer to mbedtls mpi
-	if ((retval = mbedtls_mpi_read_binary(&d, privkey, (int)privkeysize)) !=
-	    0) {
+	if ((retval = mbedtls_mpi_read_binary(&devKey->d, privkey,
+					      privkeysize)) != 0) {
 		LOG(LOG_ERROR,
 		    "Reading private key from buf to mbedtls structure:%d\n",
 		    retval);
 		goto end;
 	}
-	ctx_sign.d = d;
 #else // use ecdsa pem file
-	mbedtls_pk_init(&pk_ctx);
-
 	// parse key api expect NULL char at the end
 	retval = mbedtls_pk_parse_key(&pk_ctx, privkey, privkeysize, NULL, 0);
 	if (retval != 0) {
@@ -113,24 +122,41 @@ int32_t sdoECDSASign(const uint8_t *data, size_t dataLen,
 	/* From the EC keypair, get the private key */
 	ecp = mbedtls_pk_ec(pk_ctx);
 	if (ecp == NULL ||
-	    (retval = mbedtls_mpi_copy(&(ctx_sign.d),
-				       (const mbedtls_mpi *)&(ecp->d))) != 0)
+	    (retval = mbedtls_mpi_copy(&devKey->d,
+				       (const mbedtls_mpi *)&ecp->d)) != 0)
 		goto end;
 #endif
 
-	// Generate Signature
-	if ((retval = mbedtls_ecdsa_write_signature(
-		 &ctx_sign, hashType, hash, hashLength, messageSignature,
-		 (size_t *)signatureLength, mbedtls_ctr_drbg_random,
-		 drbg_ctx)) != 0) {
-		LOG(LOG_ERROR, "signature creation failed ret:%d\n", retval);
+	/* Public point, building the comb table of G on the way */
+#ifdef ECC_RESTARTABLE
+	do {
+		retval = mbedtls_ecp_mul_restartable(
+		    &devKey->grp, &devKey->Q, &devKey->d, &devKey->grp.G,
+		    mbedtls_ctr_drbg_random, drbg_ctx, &rs);
+	} while (ECP_YIELD(retval));
+#else
+	retval = mbedtls_ecp_mul(&devKey->grp, &devKey->Q, &devKey->d,
+				 &devKey->grp.G, mbedtls_ctr_drbg_random,
+				 drbg_ctx);
+#endif
+	if (retval != 0) {
+		LOG(LOG_ERROR, "EC public key computation failed:%d\n",
+		    retval);
 		goto end;
 	}
 
-	ret = 0;
+	keyCtx->signKey = devKey;
+	keyCtx->signKeyFree = devKeyFree;
+	loaded = true;
 
 end:
-	mbedtls_ecdsa_free(&ctx_sign);
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecp_restart_free(&rs);
+#endif
+	if (devKey && !loaded) {
+		devKeyFree(devKey);
+		devKey = NULL;
+	}
 #if defined(ECDSA_PEM)
 	mbedtls_pk_free(&pk_ctx);
 #endif
@@ -139,5 +165,105 @@ end:
 			LOG(LOG_ERROR, "Memset Failed\n");
 		sdoFree(privkey);
 	}
+	return devKey;
+}
+
+/**
+ * Copy the device key, private and public, into a key pair of its own
+ * (for ex: for the CSR), loading the resident key if needed.
+ * @param keypair - initialized key pair to fill.
+ * @return 0 on success, else -1.
+ */
+int copy_ec_keypair(mbedtls_ecp_keypair *keypair)
+{
+	mbedtls_ecdsa_context *devKey;
+	int ret = -1;
+
+	if (!keypair)
+		return -1;
+
+	SDO_LOCK(devKeyLock);
+	devKey = devKeyLoad();
+	if (devKey &&
+	    mbedtls_ecp_group_copy(&keypair->grp, &devKey->grp) == 0 &&
+	    mbedtls_mpi_copy(&keypair->d, &devKey->d) == 0 &&
+	    mbedtls_ecp_copy(&keypair->Q, &devKey->Q) == 0)
+		ret = 0;
+	SDO_UNLOCK(devKeyLock);
+	return ret;
+}
+
+/**
+ * Sign a message using provided ECDSA Private Keys.
+ * @param data - pointer of type uint8_t, holds the plaintext message.
+ * @param dataLen - size of message, type size_t.
+ * @param messageSignature - pointer of type unsigned char, which will be
+ * by filled with signature.
+ * @param signatureLength - size of signature, type unsigned int.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoECDSASign(const uint8_t *data, size_t dataLen,
+		     unsigned char *messageSignature, size_t *signatureLength)
+{
+	int ret = -1;
+	int retval = -1;
+	mbedtls_ctr_drbg_context *drbg_ctx = get_mbedtls_random_ctx();
+	unsigned char hash[SHA512_DIGEST_SIZE] = {0};
+	mbedtls_md_type_t hashType = MBEDTLS_MD_NONE;
+	size_t hashLength = 0;
+	mbedtls_ecdsa_context *devKey;
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecdsa_restart_ctx rs;
+#endif
+
+	if (!data || !dataLen || !messageSignature || !signatureLength ||
+	    !drbg_ctx) {
+		LOG(LOG_ERROR, "sdoCryptoDSASign params not valid\n");
+		return -1;
+	}
+
+#if defined(ECDSA256_DA)
+	hashType = MBEDTLS_MD_SHA256;
+	hashLength = SHA256_DIGEST_SIZE;
+#elif defined(ECDSA384_DA)
+	hashType = MBEDTLS_MD_SHA384;
+	hashLength = SHA384_DIGEST_SIZE;
+#endif
+
+	/* Calculate the hash over message and sign that hash */
+	if ((retval = mbedtls_md(mbedtls_md_info_from_type(hashType), data,
+				 dataLen, hash)) != 0) {
+		LOG(LOG_ERROR, " mbedtls_md FAILED:%d\n", retval);
+		return -1;
+	}
+
+	SDO_LOCK(devKeyLock);
+	devKey = devKeyLoad();
+	if (!devKey)
+		goto end;
+
+	// Generate Signature
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecdsa_restart_init(&rs);
+	do {
+		retval = mbedtls_ecdsa_write_signature_restartable(
+		    devKey, hashType, hash, hashLength, messageSignature,
+		    signatureLength, mbedtls_ctr_drbg_random, drbg_ctx, &rs);
+	} while (ECP_YIELD(retval));
+	mbedtls_ecdsa_restart_free(&rs);
+#else
+	retval = mbedtls_ecdsa_write_signature(
+	    devKey, hashType, hash, hashLength, messageSignature,
+	    signatureLength, mbedtls_ctr_drbg_random, drbg_ctx);
+#endif
+	if (retval != 0) {
+		LOG(LOG_ERROR, "signature creation failed ret:%d\n", retval);
+		goto end;
+	}
+
+	ret = 0;
+
+end:
+	SDO_UNLOCK(devKeyLock);
 	return ret;
 }
@@ -21,6 +21,215 @@
 #include "stdlib.h"
 #include "storage_al.h"
 
+/**
+ * Parse an ECC P-256/P-384 public key into pk_ctx, which checks that the
+ * point is on the curve.
+ * @param pk_ctx - initialized context to parse the key into.
+ * @param keyEncoding - encoding typee.
+ * @param keyAlgorithm - public key algorithm.
+ * @param keyParam1 - pointer of type uint8_t, holds the EC public key.
+ * @param keyParam1Length - size of EC public key, type size_t.
+ * @return 0 on success, else -1.
+ */
+static int32_t ecdsaKeyParse(mbedtls_pk_context *pk_ctx, uint8_t keyEncoding,
+			     uint8_t keyAlgorithm, const uint8_t *keyParam1,
+			     uint32_t keyParam1Length)
+{
+	if (!SDO_SUITE_KEY(keyEncoding, keyAlgorithm) ||
+	    keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_X509 ||
+	    (keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256 &&
+	     keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)) {
+		LOG(LOG_ERROR, "Incorrect key type!\n");
+		return -1;
+	}
+
+	if (NULL == keyParam1 || 0 == keyParam1Length) {
+		LOG(LOG_ERROR, "Invalid arguments!\n");
+		return -1;
+	}
+
+	if (mbedtls_pk_parse_public_key(pk_ctx,
+					(const unsigned char *)keyParam1,
+					(size_t)keyParam1Length) != 0 ||
+	    !mbedtls_pk_can_do(pk_ctx, MBEDTLS_PK_ECKEY)) {
+		LOG(LOG_ERROR, "Parsing EC public-key failed!\n");
+		return -1;
+	}
+#if defined(SDO_SINGLE_SUITE)
+	/* checked once here, verifications take the curve of the suite */
+	if (mbedtls_pk_ec(*pk_ctx)->grp.id !=
+	    (SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384
+		 ? MBEDTLS_ECP_DP_SECP384R1
+		 : MBEDTLS_ECP_DP_SECP256R1)) {
+		LOG(LOG_ERROR, "EC public key not on the curve of the suite\n");
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * Verify an ECC P-256/P-384 signature of a message digest with a parsed key.
+ * @param pk_ctx - the EC public key.
+ * @param hash - digest of the message, SHA-256 for P-256 and SHA-384 for
+ *		P-384.
+ * @param hashLength - size of hash.
+ * @param messageSignature - ecdsa signature in big-endian format.
+ * @param signatureLength - size of signature.
+ * @return 0 if true, else -1.
+ */
+static int32_t ecdsaVerifyParsed(mbedtls_pk_context *pk_ctx,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength)
+{
+	uint32_t digestLength = SHA256_DIGEST_SIZE;
+
+	if (NULL == messageSignature || 0 == signatureLength ||
+	    NULL == hash) {
+		LOG(LOG_ERROR, "Invalid arguments!\n");
+		return -1;
+	}
+
+#if defined(SDO_SINGLE_SUITE)
+	/* the keys were parsed for the curve of the suite */
+	if (SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)
+#else
+	if (mbedtls_pk_ec(*pk_ctx)->grp.id == MBEDTLS_ECP_DP_SECP384R1)
+#endif
+		digestLength = SHA384_DIGEST_SIZE;
+	if (hashLength != digestLength)
+		return -1;
+
+	if (mbedtls_ecdsa_read_signature(mbedtls_pk_ec(*pk_ctx), hash,
+					 hashLength, messageSignature,
+					 signatureLength) != 0) {
+		LOG(LOG_ERROR, "ECDSA Signature-verification failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Decode an ECC P-256/P-384 public key into a key handle.
+ * @param keyEncoding - encoding typee.
+ * @param keyAlgorithm - public key algorithm.
+ * @param keyParam1 - pointer of type uint8_t, holds the EC public key.
+ * @param keyParam1Length - size of EC public key, type size_t.
+ * @param keyParam2 - not used.
+ * @param keyParam2Length - not used
+ * @param key - out, the key handle, released with sdoCryptoSigKeyFree.
+ * @return 0 on success, else -1.
+ */
+int32_t sdoCryptoSigKeyLoad(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			    const uint8_t *keyParam1, uint32_t keyParam1Length,
+			    const uint8_t *keyParam2, uint32_t keyParam2Length,
+			    void **key)
+{
+	mbedtls_pk_context *pk_ctx = NULL;
+
+	(void)keyParam2;
+	(void)keyParam2Length;
+
+	if (NULL == key)
+		return -1;
+
+	pk_ctx = sdoAlloc(sizeof(mbedtls_pk_context));
+	if (NULL == pk_ctx)
+		return -1;
+	mbedtls_pk_init(pk_ctx);
+
+	if (0 != ecdsaKeyParse(pk_ctx, keyEncoding, keyAlgorithm, keyParam1,
+			       keyParam1Length)) {
+		mbedtls_pk_free(pk_ctx);
+		sdoFree(pk_ctx);
+		return -1;
+	}
+
+	*key = pk_ctx;
+	return 0;
+}
+
+/**
+ * Verify an ECC P-256/P-384 signature of a message digest with a key from
+ * sdoCryptoSigKeyLoad.
+ * @param key - key handle to verify with.
+ * @param hash - pointer of type uint8_t, holds the digest of the message,
+ *		SHA-256 for P-256 and SHA-384 for P-384.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			ecdsa signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigestKey(void *key, const uint8_t *hash,
+				    uint32_t hashLength,
+				    const uint8_t *messageSignature,
+				    uint32_t signatureLength)
+{
+	if (NULL == key)
+		return -1;
+	return ecdsaVerifyParsed(key, hash, hashLength, messageSignature,
+				 signatureLength);
+}
+
+/**
+ * Release a key from sdoCryptoSigKeyLoad.
+ * @param key - in/out, the key handle, set to NULL.
+ */
+void sdoCryptoSigKeyFree(void **key)
+{
+	if (!key || !*key)
+		return;
+	mbedtls_pk_free(*key);
+	sdoFree(*key);
+}
+
+/**
+ * Verify an ECC P-256/P-384 signature of a message digest using provided
+ * ECDSA Public Keys. The key is parsed on the stack, so this may be called
+ * from any thread.
+ * @param keyEncoding - encoding typee.
+ * @param keyAlgorithm - public key algorithm.
+ * @param hash - pointer of type uint8_t, holds the digest of the message,
+ *		SHA-256 for P-256 and SHA-384 for P-384.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			ecdsa signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the EC public key.
+ * @param keyParam1Length - size of EC public key, type size_t.
+ * @param keyParam2 - not used.
+ * @param keyParam2Length - not used
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigest(uint8_t keyEncoding, uint8_t keyAlgorithm,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength,
+				 const uint8_t *keyParam1,
+				 uint32_t keyParam1Length,
+				 const uint8_t *keyParam2,
+				 uint32_t keyParam2Length)
+{
+	int32_t ret = -1;
+	mbedtls_pk_context pk_ctx = {0};
+
+	(void)keyParam2;
+	(void)keyParam2Length;
+
+	/* Initialize mbedtls_pk_context with incoming EC public-key */
+	mbedtls_pk_init(&pk_ctx);
+
+	if (0 == ecdsaKeyParse(&pk_ctx, keyEncoding, keyAlgorithm, keyParam1,
+			       keyParam1Length))
+		ret = ecdsaVerifyParsed(&pk_ctx, hash, hashLength,
+					messageSignature, signatureLength);
+
+	mbedtls_pk_free(&pk_ctx);
+	return ret;
+}
+
 /**
  * Verify an ECC P-256/P-384 signature using provided ECDSA Public Keys.
  * @param keyEncoding - encoding typee.
@@ -44,83 +253,29 @@ int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
 			   uint32_t keyParam1Length, const uint8_t *keyParam2,
 			   uint32_t keyParam2Length)
 {
-	int32_t ret = -1;
-	int result = 0;
 	unsigned char hash[SHA512_DIGEST_SIZE] = {0};
-	size_t hashLength = 0;
-	mbedtls_ecdsa_context ec_ctx = {0};
-	mbedtls_pk_context pk_ctx = {0};
-	mbedtls_md_type_t mbedhashType = MBEDTLS_MD_NONE;
+	size_t hashLength = SHA256_DIGEST_SIZE;
+	mbedtls_md_type_t mbedhashType = MBEDTLS_MD_SHA256;
 
-	(void)keyParam2;
-	(void)keyParam2Length;
-
-	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_X509 ||
-	    (keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256 &&
-	     keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)) {
-		LOG(LOG_ERROR, "Incorrect key type!\n");
-		goto end;
-	}
-
-	if (NULL == keyParam1 || 0 == keyParam1Length ||
-	    NULL == messageSignature || 0 == signatureLength ||
-	    NULL == message || 0 == messageLength) {
+	if (NULL == message || 0 == messageLength) {
 		LOG(LOG_ERROR, "Invalid arguments!\n");
-		goto end;
+		return -1;
 	}
 
-	/* Initialize mbedtls_ecdsa_context with EC group */
-	mbedtls_ecdsa_init(&ec_ctx);
-
-	if (keyAlgorithm == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256) { // P-256 NIST
-		LOG(LOG_DEBUG, "ECDSA256 verify\n");
-		result = mbedtls_ecp_group_load(&(ec_ctx.grp),
-						MBEDTLS_ECP_DP_SECP256R1);
-		mbedhashType = MBEDTLS_MD_SHA256;
-		hashLength = SHA256_DIGEST_SIZE;
-	} else { // P-384 NIST curve
-		LOG(LOG_DEBUG, "ECDSA384 verify\n");
-		result = mbedtls_ecp_group_load(&(ec_ctx.grp),
-						MBEDTLS_ECP_DP_SECP384R1);
-
+	if (SDO_SUITE_ALG(keyAlgorithm) == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384) {
 		mbedhashType = MBEDTLS_MD_SHA384;
 		hashLength = SHA384_DIGEST_SIZE;
 	}
-	if (result) {
-		LOG(LOG_ERROR, "Initializing with required EC group failed!\n");
-		goto end;
-	}
-
-	/* Initialize mbedtls_pk_context with incoming EC public-key */
-	mbedtls_pk_init(&pk_ctx);
-
-	if ((result = mbedtls_pk_parse_public_key(
-		 &pk_ctx, (const unsigned char *)keyParam1,
-		 (size_t)keyParam1Length)) != 0) {
-
-		LOG(LOG_ERROR, "Parsing EC public-key failed!\n");
-		goto end;
-	}
 
-	/* Calculate the hash over message and sign that hash */
+	/* Calculate the hash over message and verify that hash */
 	if (mbedtls_md(mbedtls_md_info_from_type(mbedhashType),
 		       (const uint8_t *)message, messageLength, hash) != 0) {
 		LOG(LOG_ERROR, " mbedtls_md FAILED:\n");
-		goto end;
-	}
-	/* Verify ECDSA signature with 'updated mbedtls_ecdsa_context with
-	 * pubkey info' */
-	if ((ret = mbedtls_ecdsa_read_signature(mbedtls_pk_ec(pk_ctx), hash,
-						hashLength, messageSignature,
-						signatureLength)) != 0) {
-		LOG(LOG_ERROR, "ECDSA Signature-verification failed!\n");
-		goto end;
+		return -1;
 	}
 
-	ret = 0;
-
-end:
-	mbedtls_ecdsa_free(&ec_ctx);
-	mbedtls_pk_free(&pk_ctx);
-	return ret;
+	return sdoCryptoSigVerifyDigest(
+	    keyEncoding, keyAlgorithm, hash, hashLength, messageSignature,
+	    signatureLength, keyParam1, keyParam1Length, keyParam2,
+	    keyParam2Length);
 }
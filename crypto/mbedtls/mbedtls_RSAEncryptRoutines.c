@@ -25,6 +25,71 @@
 
 #define mbedtls_calloc calloc
 
+/**
+ * Internal API: encrypt with a read RSA public key. The padding of the key
+ * is put back, as the key may be shared with the verification.
+ * Parameters and return as for sdoCryptoRSAEncrypt.
+ */
+static int32_t rsaEncryptRead(mbedtls_rsa_context *rsa, uint8_t hashType,
+			      const uint8_t *clearText,
+			      uint32_t clearTextLength, uint8_t *cipherText,
+			      uint32_t cipherTextLength)
+{
+	mbedtls_ctr_drbg_context ctr_drbg;
+	mbedtls_entropy_context entropy;
+	const char pers[] = "test_string";
+	int padding = rsa->padding;
+	int hash_id = rsa->hash_id;
+	int ret = -1;
+
+	LOG(LOG_DEBUG, "rsa len : %zu.\n", rsa->len);
+
+	/* send back required cipher budffer size */
+	if (cipherText == NULL)
+		return rsa->len;
+
+	/*When caller sends cipher buffer */
+	if (rsa->len > cipherTextLength)
+		return -1;
+
+	mbedtls_ctr_drbg_init(&ctr_drbg);
+	mbedtls_entropy_init(&entropy);
+	mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
+			      (const unsigned char *)pers, sizeof(pers) - 1);
+
+	switch (hashType) {
+	case SDO_PK_HASH_SHA1:
+		mbedtls_rsa_set_padding(rsa, MBEDTLS_RSA_PKCS_V21,
+					MBEDTLS_MD_SHA1);
+		break;
+	case SDO_PK_HASH_SHA256:
+		mbedtls_rsa_set_padding(rsa, MBEDTLS_RSA_PKCS_V21,
+					MBEDTLS_MD_SHA256);
+		break;
+	case SDO_PK_HASH_SHA384:
+		mbedtls_rsa_set_padding(rsa, MBEDTLS_RSA_PKCS_V21,
+					MBEDTLS_MD_SHA384);
+		break;
+	default:
+		LOG(LOG_ERROR, "Hash algorithm not supported.");
+		goto error;
+	}
+
+	if ((ret = mbedtls_rsa_pkcs1_encrypt(
+		 rsa, mbedtls_ctr_drbg_random, &ctr_drbg, MBEDTLS_RSA_PUBLIC,
+		 clearTextLength, (unsigned char *)clearText, cipherText)) !=
+	    0) {
+		LOG(LOG_ERROR, "rsa encrypt failed ret: %x\n", ret);
+		ret = -1;
+	}
+
+error:
+	mbedtls_rsa_set_padding(rsa, padding, hash_id);
+	mbedtls_ctr_drbg_free(&ctr_drbg);
+	mbedtls_entropy_free(&entropy);
+	return ret;
+}
+
 /**
  * sdoCryptoRSAEncrypt -  Encrypt the block passed using the public key
  * passed, the key must be RSA
@@ -56,10 +121,6 @@ int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
 	int ret = -1;
 	uint8_t *tmpkey1 = NULL;
 	size_t tmpkey1Sz = 0;
-	mbedtls_ctr_drbg_context ctr_drbg;
-	mbedtls_entropy_context entropy;
-	const char pers[] = "test_string";
-	uint32_t cipherCalLength = 0;
 
 	LOG(LOG_DEBUG, "rsa_encrypt starting.\n");
 
@@ -107,31 +168,8 @@ int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
 	hexdump("Public N", tmpkey1, tmpkey1Sz);
 	hexdump("Public E", keyParam2, keyParam2Length);
 #endif
-	mbedtls_ctr_drbg_init(&ctr_drbg);
-	mbedtls_entropy_init(&entropy);
-	mbedtls_ctr_drbg_seed(&ctr_drbg, mbedtls_entropy_func, &entropy,
-			      (const unsigned char *)pers, sizeof(pers) - 1);
-
 	// by default OEAP is selcted for PKCS_V15
 	mbedtls_rsa_init(&rsa, MBEDTLS_RSA_PKCS_V15, 0);
-	switch (hashType) {
-	case SDO_PK_HASH_SHA1:
-		mbedtls_rsa_set_padding(&rsa, MBEDTLS_RSA_PKCS_V21,
-					MBEDTLS_MD_SHA1);
-		break;
-	case SDO_PK_HASH_SHA256:
-		mbedtls_rsa_set_padding(&rsa, MBEDTLS_RSA_PKCS_V21,
-					MBEDTLS_MD_SHA256);
-		break;
-	case SDO_PK_HASH_SHA384:
-		mbedtls_rsa_set_padding(&rsa, MBEDTLS_RSA_PKCS_V21,
-					MBEDTLS_MD_SHA384);
-		break;
-	default:
-		LOG(LOG_ERROR, "Hash algorithm not supported.");
-		ret = -1;
-		goto error;
-	}
 
 	if ((mbedtls_mpi_read_binary(&rsa.N, tmpkey1, tmpkey1Sz)) != 0 ||
 	    (mbedtls_mpi_read_binary(&rsa.E, keyParam2, keyParam2Length)) !=
@@ -143,39 +181,45 @@ int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
 
 	if ((ret = mbedtls_rsa_check_pubkey(&rsa)) != 0) {
 		LOG(LOG_ERROR, "mbedtls_i rsa pubkey error: %d.\n", ret);
-		goto error;
-	}
-	cipherCalLength = rsa.len;
-	LOG(LOG_DEBUG, "rsa len : %zu.\n", rsa.len);
-
-	/* send back required cipher budffer size */
-	if (cipherText == NULL) {
-		ret = cipherCalLength;
-		goto error;
-	}
-
-	/*When caller sends cipher buffer */
-	if (cipherCalLength > cipherTextLength) {
 		ret = -1;
 		goto error;
 	}
 
-	if ((ret = mbedtls_rsa_pkcs1_encrypt(
-		 &rsa, mbedtls_ctr_drbg_random, &ctr_drbg, MBEDTLS_RSA_PUBLIC,
-		 clearTextLength, (unsigned char *)clearText, cipherText)) !=
-	    0) {
-		LOG(LOG_ERROR, "rsa encrypt failed ret: %x\n", ret);
-		ret = -1;
-		goto error;
-	}
+	ret = rsaEncryptRead(&rsa, hashType, clearText, clearTextLength,
+			     cipherText, cipherTextLength);
 
 error:
 	mbedtls_rsa_free(&rsa);
-	mbedtls_ctr_drbg_free(&ctr_drbg);
-	mbedtls_entropy_free(&entropy);
 	return ret;
 }
 
+/**
+ * sdoCryptoRSAEncryptKey -  Encrypt the block passed with a key from
+ * sdoCryptoSigKeyLoad, so that a key already read for verification is
+ * used as it is.
+ * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256)
+ * @param key - RSA context from sdoCryptoSigKeyLoad.
+ * @param clearText - Input text to be encrypted.
+ * @param clearTextLength - Plain text size in bytes.
+ * @param cipherText - Encrypted text(output).
+ * @param cipherTextLength - Encrypted text size in bytes.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ *        return cypherLength in bytes while cypherText passed as NULL.
+ */
+int32_t sdoCryptoRSAEncryptKey(uint8_t hashType, void *key,
+			       const uint8_t *clearText,
+			       uint32_t clearTextLength, uint8_t *cipherText,
+			       uint32_t cipherTextLength)
+{
+	if (NULL == key || NULL == clearText || 0 == clearTextLength) {
+		LOG(LOG_ERROR, "Incorrect input text.\n");
+		return -1;
+	}
+	return rsaEncryptRead(key, hashType, clearText, clearTextLength,
+			      cipherText, cipherTextLength);
+}
+
 /**
  * sdoCryptoRSALen - Returns the cipher length
  * @param keyParam1 - pointer of type uint8_t, holds the public key1.
@@ -27,32 +27,22 @@
 #define mbedtls_calloc calloc
 
 /**
- * Verify an RSA-SHA-256 signature using provided RSA Public Keys.
+ * Read an RSA public key into rsa.
+ * @param rsa - initialized context to read the key into.
  * @param keyEncoding - RSA Key encoding typee.
  * @param keyAlgorithm - RSA public key algorithm.
- * @param message - pointer of type uint8_t, holds the encoded message.
- * @param messageLength - size of message, type size_t.
- * @param messageSignature - pointer of type uint8_t, holds a valid
- *			PKCS v1.5 signature in big-endian format
- * @param signatureLength - size of signature, type unsigned int.
  * @param keyParam1 - pointer of type uint8_t, holds the public key1.
  * @param keyParam1Length - size of public key1, type size_t.
  * @param keyParam2 - pointer of type uint8_t,holds the public key2.
  * @param keyParam2Length - size of public key2, type size_t
- * @return 0 if true, else -1.
-
+ * @return 0 on success, else -1.
  */
-int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
-			   const uint8_t *message, uint32_t messageLength,
-			   const uint8_t *messageSignature,
-			   uint32_t signatureLength, const uint8_t *keyParam1,
-			   uint32_t keyParam1Length, const uint8_t *keyParam2,
-			   uint32_t keyParam2Length)
+static int32_t rsaKeyRead(mbedtls_rsa_context *rsa, uint8_t keyEncoding,
+			  uint8_t keyAlgorithm, const uint8_t *keyParam1,
+			  uint32_t keyParam1Length, const uint8_t *keyParam2,
+			  uint32_t keyParam2Length)
 {
 	int ret;
-	unsigned char hash[32];
-	mbedtls_rsa_context rsa;
-	mbedtls_pk_context ctx;
 
 	/* Check validity of key type. */
 	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP ||
@@ -62,41 +52,206 @@ int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
 	}
 
 	if (NULL == keyParam1 || 0 == keyParam1Length || NULL == keyParam2 ||
-	    0 == keyParam2Length || NULL == messageSignature ||
-	    0 == signatureLength || NULL == message || 0 == messageLength) {
+	    0 == keyParam2Length) {
 		LOG(LOG_ERROR, "Incorrect key type\n");
 		return -1;
 	}
 
-	mbedtls_rsa_init(&rsa, MBEDTLS_RSA_PKCS_V15, 0);
-
-	if ((ret = mbedtls_mpi_read_binary(&rsa.N, keyParam1,
+	if ((ret = mbedtls_mpi_read_binary(&rsa->N, keyParam1,
 					   keyParam1Length)) != 0 ||
-	    (ret = mbedtls_mpi_read_binary(&rsa.E, keyParam2,
+	    (ret = mbedtls_mpi_read_binary(&rsa->E, keyParam2,
 					   keyParam2Length)) != 0) {
 		LOG(LOG_ERROR, "mbedtls_mpi_read_binary returned %d./n", ret);
-		ret = -1;
-		goto end;
+		return -1;
 	}
-	rsa.len = (mbedtls_mpi_bitlen(&rsa.N) + 7) >> 3;
-	if (signatureLength != rsa.len) {
-		LOG(LOG_ERROR, "Invalid RSA signature format.\n");
-		ret = -1;
-		goto end;
+	rsa->len = (mbedtls_mpi_bitlen(&rsa->N) + 7) >> 3;
+	return 0;
+}
+
+/**
+ * Verify an RSA-SHA-256 signature of a message digest with a read key.
+ * @param rsa - the RSA public key.
+ * @param hash - SHA-256 digest of the message.
+ * @param hashLength - size of hash.
+ * @param messageSignature - PKCS v1.5 signature in big-endian format.
+ * @param signatureLength - size of signature.
+ * @return 0 if true, else -1.
+ */
+static int32_t rsaVerifyRead(mbedtls_rsa_context *rsa, const uint8_t *hash,
+			     uint32_t hashLength,
+			     const uint8_t *messageSignature,
+			     uint32_t signatureLength)
+{
+	int ret;
+
+	if (NULL == messageSignature || 0 == signatureLength ||
+	    NULL == hash || 32 != hashLength) {
+		LOG(LOG_ERROR, "Incorrect key type\n");
+		return -1;
 	}
 
-	mbedtls_pk_init(&ctx);
-	ctx.pk_ctx = &rsa;
+	if (signatureLength != rsa->len) {
+		LOG(LOG_ERROR, "Invalid RSA signature format.\n");
+		return -1;
+	}
 
-	mbedtls_sha256_ret((const unsigned char *)message, messageLength, hash,
-			   0);
 	if ((ret = mbedtls_rsa_pkcs1_verify(
-		 &rsa, NULL, NULL, MBEDTLS_RSA_PUBLIC, MBEDTLS_MD_SHA256, 0,
+		 rsa, NULL, NULL, MBEDTLS_RSA_PUBLIC, MBEDTLS_MD_SHA256, 0,
 		 hash, messageSignature)) != 0) {
 		LOG(LOG_ERROR, " mbedtls_rsa_pkcs1_verify returned %d.\n", ret);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Decode an RSA public key into a key handle.
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @param key - out, the key handle, released with sdoCryptoSigKeyFree.
+ * @return 0 on success, else -1.
+ */
+int32_t sdoCryptoSigKeyLoad(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			    const uint8_t *keyParam1, uint32_t keyParam1Length,
+			    const uint8_t *keyParam2, uint32_t keyParam2Length,
+			    void **key)
+{
+	mbedtls_rsa_context *rsa = NULL;
+
+	if (NULL == key)
+		return -1;
+
+	rsa = sdoAlloc(sizeof(mbedtls_rsa_context));
+	if (NULL == rsa)
+		return -1;
+	mbedtls_rsa_init(rsa, MBEDTLS_RSA_PKCS_V15, 0);
+
+	if (0 != rsaKeyRead(rsa, keyEncoding, keyAlgorithm, keyParam1,
+			    keyParam1Length, keyParam2, keyParam2Length)) {
+		mbedtls_rsa_free(rsa);
+		sdoFree(rsa);
+		return -1;
 	}
 
-end:
+	*key = rsa;
+	return 0;
+}
+
+/**
+ * Verify an RSA-SHA-256 signature of a message digest with a key from
+ * sdoCryptoSigKeyLoad.
+ * @param key - key handle to verify with.
+ * @param hash - pointer of type uint8_t, holds the SHA-256 digest of the
+ *		message.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigestKey(void *key, const uint8_t *hash,
+				    uint32_t hashLength,
+				    const uint8_t *messageSignature,
+				    uint32_t signatureLength)
+{
+	if (NULL == key)
+		return -1;
+	return rsaVerifyRead(key, hash, hashLength, messageSignature,
+			     signatureLength);
+}
+
+/**
+ * Release a key from sdoCryptoSigKeyLoad.
+ * @param key - in/out, the key handle, set to NULL.
+ */
+void sdoCryptoSigKeyFree(void **key)
+{
+	if (!key || !*key)
+		return;
+	mbedtls_rsa_free(*key);
+	sdoFree(*key);
+}
+
+/**
+ * Verify an RSA-SHA-256 signature of a message digest using provided RSA
+ * Public Keys. The key is read on the stack, so this may be called from any
+ * thread.
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param hash - pointer of type uint8_t, holds the SHA-256 digest of the
+ *		message.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigest(uint8_t keyEncoding, uint8_t keyAlgorithm,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength,
+				 const uint8_t *keyParam1,
+				 uint32_t keyParam1Length,
+				 const uint8_t *keyParam2,
+				 uint32_t keyParam2Length)
+{
+	int32_t ret = -1;
+	mbedtls_rsa_context rsa;
+
+	mbedtls_rsa_init(&rsa, MBEDTLS_RSA_PKCS_V15, 0);
+
+	if (0 == rsaKeyRead(&rsa, keyEncoding, keyAlgorithm, keyParam1,
+			    keyParam1Length, keyParam2, keyParam2Length))
+		ret = rsaVerifyRead(&rsa, hash, hashLength, messageSignature,
+				    signatureLength);
+
 	mbedtls_rsa_free(&rsa);
 	return ret;
 }
+
+/**
+ * Verify an RSA-SHA-256 signature using provided RSA Public Keys.
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param message - pointer of type uint8_t, holds the encoded message.
+ * @param messageLength - size of message, type size_t.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @return 0 if true, else -1.
+
+ */
+int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			   const uint8_t *message, uint32_t messageLength,
+			   const uint8_t *messageSignature,
+			   uint32_t signatureLength, const uint8_t *keyParam1,
+			   uint32_t keyParam1Length, const uint8_t *keyParam2,
+			   uint32_t keyParam2Length)
+{
+	unsigned char hash[32];
+
+	if (NULL == message || 0 == messageLength) {
+		LOG(LOG_ERROR, "Incorrect key type\n");
+		return -1;
+	}
+
+	mbedtls_sha256_ret((const unsigned char *)message, messageLength, hash,
+			   0);
+	return sdoCryptoSigVerifyDigest(keyEncoding, keyAlgorithm, hash,
+					sizeof(hash), messageSignature,
+					signatureLength, keyParam1,
+					keyParam1Length, keyParam2,
+					keyParam2Length);
+}
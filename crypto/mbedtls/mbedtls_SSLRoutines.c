@@ -14,9 +14,31 @@
 #include "stdlib.h"
 #include "safe_lib.h"
 #include "network_al.h"
+#include "mbedtls_random.h"
 
 #define MIN_BIT_LENGTH_DHM 2048
 
+/*
+ * Records the server may send, as a maximum fragment length request
+ * (RFC 6066). mbedTLS allocates its record buffers per connection at
+ * MBEDTLS_SSL_IN/OUT_CONTENT_LEN, so a configuration that shrinks them
+ * asks the server for records that fit.
+ */
+#if defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH) &&                              \
+    defined(MBEDTLS_SSL_IN_CONTENT_LEN)
+#if MBEDTLS_SSL_IN_CONTENT_LEN >= 16384
+#define TLS_MAX_FRAG_CODE MBEDTLS_SSL_MAX_FRAG_LEN_NONE
+#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 4096
+#define TLS_MAX_FRAG_CODE MBEDTLS_SSL_MAX_FRAG_LEN_4096
+#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 2048
+#define TLS_MAX_FRAG_CODE MBEDTLS_SSL_MAX_FRAG_LEN_2048
+#elif MBEDTLS_SSL_IN_CONTENT_LEN >= 1024
+#define TLS_MAX_FRAG_CODE MBEDTLS_SSL_MAX_FRAG_LEN_1024
+#else
+#define TLS_MAX_FRAG_CODE MBEDTLS_SSL_MAX_FRAG_LEN_512
+#endif
+#endif
+
 /* The list of recommended cipher suites to be used in TLS setup with server */
 static const int ciphersuites[] = {
     MBEDTLS_TLS_ECDHE_ECDSA_WITH_AES_128_GCM_SHA256,
@@ -38,21 +60,217 @@ static const int ciphersuites[] = {
     MBEDTLS_TLS_DHE_RSA_WITH_AES_256_CBC_SHA256,
 };
 
-#if !defined(TARGET_OS_MBEDOS) // non mbedos platform
-static sslInfo sslInfoVar = {0};
-static sslInfo *p_sslInfo = &sslInfoVar;
+#ifndef TLS_SESSION_CACHE_FALSE
+/* Number of servers (RV, owner ...) whose TLS session is remembered */
+#define TLS_SESSION_CACHE_SIZE 4
+/* "ip:port" of the server */
+#define TLS_SESSION_KEY_LEN 32
+
+/*
+ * TLS session cache. Sessions of previous connections are kept per server,
+ * so that a reconnect (within a protocol, or when TO1/TO2 is retried) does
+ * an abbreviated handshake instead of a full one.
+ */
+typedef struct {
+	char key[TLS_SESSION_KEY_LEN];
+	bool valid;
+	mbedtls_ssl_session session;
+} tlsSessionEntry_t;
+
+static SDO_THREAD_LOCAL tlsSessionEntry_t sessionCache[TLS_SESSION_CACHE_SIZE];
+static SDO_THREAD_LOCAL unsigned int sessionCacheNext;
+
+/**
+ * Internal API: find the cache entry of a server.
+ *
+ * @param key - session cache key of the server.
+ * @return entry on success, NULL if the server is not cached.
+ */
+static tlsSessionEntry_t *tlsSessionFind(const char *key)
+{
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+		if (!sessionCache[i].valid)
+			continue;
+		if (strcmp_s(sessionCache[i].key, TLS_SESSION_KEY_LEN, key,
+			     &res) == 0 &&
+		    res == 0)
+			return &sessionCache[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: drop the cached session of a server.
+ *
+ * @param entry - cache entry, may be NULL.
+ */
+static void tlsSessionDrop(tlsSessionEntry_t *entry)
+{
+	if (!entry)
+		return;
+	mbedtls_ssl_session_free(&entry->session);
+	entry->valid = false;
+}
+
+/**
+ * Internal API: remember the session of an established connection.
+ *
+ * @param key - session cache key of the server.
+ * @param ssl - ssl context after a successful handshake.
+ */
+static void tlsSessionStore(const char *key, const mbedtls_ssl_context *ssl)
+{
+	tlsSessionEntry_t *entry = tlsSessionFind(key);
+
+	if (!entry) {
+		entry = &sessionCache[sessionCacheNext];
+		sessionCacheNext =
+		    (sessionCacheNext + 1) % TLS_SESSION_CACHE_SIZE;
+		tlsSessionDrop(entry);
+		if (strcpy_s(entry->key, TLS_SESSION_KEY_LEN, key) != 0)
+			return;
+	} else {
+		tlsSessionDrop(entry);
+	}
+
+	mbedtls_ssl_session_init(&entry->session);
+	if (mbedtls_ssl_get_session(ssl, &entry->session) != 0) {
+		tlsSessionDrop(entry);
+		return;
+	}
+	entry->valid = true;
+}
+#endif
+
+/*
+ * TLS configuration shared by all connections: the settings, ciphersuites
+ * and the random generator are bound once, a connection only holds its
+ * socket and session.
+ */
+static struct {
+	bool ready;
+	mbedtls_ssl_config conf;
+} tlsContext;
+#if defined(HTTP2) && defined(MBEDTLS_SSL_ALPN)
+static const char *alpnProtocols[] = {"h2", "http/1.1", NULL};
+#endif
+SDO_MUTEX(tlsContextLock);
+
+/**
+ * Internal API: the shared TLS configuration, set up on first use.
+ *
+ * @return configuration on success, NULL on failure.
+ */
+static const mbedtls_ssl_config *tlsContextGet(void)
+{
+	int ret;
+	void *drbg_ctx = get_mbedtls_random_ctx();
+
+	if (tlsContext.ready)
+		return &tlsContext.conf;
+
+	if (!is_mbedtls_random_init() || !drbg_ctx) {
+		LOG(LOG_ERROR, "DRBG not initialized for TLS\n");
+		return NULL;
+	}
+
+	mbedtls_ssl_config_init(&tlsContext.conf);
+	if ((ret = mbedtls_ssl_config_defaults(
+		 &tlsContext.conf, MBEDTLS_SSL_IS_CLIENT,
+		 MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) !=
+	    0) {
+		LOG(LOG_ERROR,
+		    "failed\n  ! mbedtls_ssl_config_defaults returned %d\n\n",
+		    ret);
+		mbedtls_ssl_config_free(&tlsContext.conf);
+		return NULL;
+	}
+
+	/* The minimum size of DHM set to 2048 from default of 1024. */
+	mbedtls_ssl_conf_dhm_min_bitlen(&tlsContext.conf, MIN_BIT_LENGTH_DHM);
+
+	/* Override default ciphersuites with the recommended ones*/
+	mbedtls_ssl_conf_ciphersuites(&tlsContext.conf, ciphersuites);
+
+	/* Explicitly set the max TLS version = v1.2 and min TLS = v1.1 */
+	mbedtls_ssl_conf_max_version(&tlsContext.conf,
+				     MBEDTLS_SSL_MAJOR_VERSION_3,
+				     MBEDTLS_SSL_MINOR_VERSION_3);
+	mbedtls_ssl_conf_min_version(&tlsContext.conf,
+				     MBEDTLS_SSL_MAJOR_VERSION_3,
+				     MBEDTLS_SSL_MINOR_VERSION_2);
+
+	mbedtls_ssl_conf_authmode(&tlsContext.conf, MBEDTLS_SSL_VERIFY_NONE);
+#if defined(TLS_MAX_FRAG_CODE)
+	if ((ret = mbedtls_ssl_conf_max_frag_len(&tlsContext.conf,
+						 TLS_MAX_FRAG_CODE)) != 0) {
+		LOG(LOG_ERROR, "mbedtls_ssl_conf_max_frag_len returned %d\n",
+		    ret);
+		mbedtls_ssl_config_free(&tlsContext.conf);
+		return NULL;
+	}
+#endif
+#if defined(HTTP2) && defined(MBEDTLS_SSL_ALPN)
+	/* HTTP/2 if the server speaks it, HTTP/1.1 otherwise */
+	if ((ret = mbedtls_ssl_conf_alpn_protocols(&tlsContext.conf,
+						   alpnProtocols)) != 0) {
+		LOG(LOG_ERROR, "mbedtls_ssl_conf_alpn_protocols returned %d\n",
+		    ret);
+		mbedtls_ssl_config_free(&tlsContext.conf);
+		return NULL;
+	}
+#endif
+	/* The DRBG of the crypto layer, seeded once at cryptoInit */
+	mbedtls_ssl_conf_rng(&tlsContext.conf, mbedtls_ctr_drbg_random,
+			     drbg_ctx);
+#ifdef CONFIG_MBEDTLS_DEBUG
+	mbedtls_esp_enable_debug_log(&tlsContext.conf, 4);
+#endif
+
+	tlsContext.ready = true;
+	return &tlsContext.conf;
+}
+
+/**
+ * Free the shared TLS configuration. Connections must be closed before.
+ */
+void sdo_ssl_context_free(void)
+{
+	SDO_LOCK(tlsContextLock);
+	if (tlsContext.ready) {
+		mbedtls_ssl_config_free(&tlsContext.conf);
+		tlsContext.ready = false;
+	}
+	SDO_UNLOCK(tlsContextLock);
+}
+
+/**
+ * Free the TLS sessions cached by the calling thread, wiping their entries,
+ * as an instance is destroyed or a run shuts down.
+ */
+void sdo_ssl_session_cache_clear(void)
+{
+#ifndef TLS_SESSION_CACHE_FALSE
+	unsigned int i;
+
+	/* mbedtls_ssl_session_free zeroizes the master secret */
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; i++)
+		tlsSessionDrop(&sessionCache[i]);
+	(void)memset_s(sessionCache, sizeof(sessionCache), 0);
+	sessionCacheNext = 0;
 #endif
+}
 
 #if defined(TARGET_OS_MBEDOS)
 #include "mbed_net_al.h"
 typedef struct {
-	void *socket;
 	sslInfo mbed_sslInfo;
+	void *socket;
 } sinfoextra;
 
-static sinfoextra sslInfoVar = {0};
-static sslInfo *p_sslInfo = &sslInfoVar.mbed_sslInfo;
-
 /**
  * Internal API
  */
@@ -94,9 +312,15 @@ int mbed_ssl_rawwrite(void *sock, const unsigned char *buf, size_t num)
 	}
 	return ret;
 }
-sdoConHandle get_ssl_socket(void)
+
+/**
+ * Socket of a connection made by sdo_ssl_setup_connect.
+ *
+ * @param ssl - ssl handle returned by sdo_ssl_setup_connect.
+ */
+sdoConHandle get_ssl_socket(void *ssl)
 {
-	return sslInfoVar.socket;
+	return ssl ? ((sinfoextra *)ssl)->socket : NULL;
 }
 #endif
 /**
@@ -112,23 +336,47 @@ sdoConHandle get_ssl_socket(void)
 void *sdo_ssl_setup_connect(char *SERVER_NAME, char *SERVER_PORT)
 {
 	int ret = 0;
-	const char *DRBG_PERSONALIZED_STR = "Mbed TLS client";
+	const mbedtls_ssl_config *conf;
+	sslInfo *p_sslInfo = NULL;
+#if defined(TARGET_OS_MBEDOS)
+	sinfoextra *sinfo = NULL;
+	sdoConHandle *socket = NULL;
+#endif
+#ifndef TLS_SESSION_CACHE_FALSE
+	char key[TLS_SESSION_KEY_LEN] = {0};
+	tlsSessionEntry_t *entry = NULL;
+
+	if (strcpy_s(key, sizeof(key), SERVER_NAME) != 0 ||
+	    strcat_s(key, sizeof(key), ":") != 0 ||
+	    strcat_s(key, sizeof(key), SERVER_PORT) != 0) {
+		LOG(LOG_ERROR, "TLS session key too long\n");
+		return NULL;
+	}
+#endif
 
-// Initialization of SSL
-#if !defined(TARGET_OS_MBEDOS)
+	SDO_LOCK(tlsContextLock);
+	conf = tlsContextGet();
+	SDO_UNLOCK(tlsContextLock);
+	if (!conf)
+		return NULL;
+
+	/* Per connection state only, the configuration is shared */
+#if defined(TARGET_OS_MBEDOS)
+	sinfo = sdoAlloc(sizeof(sinfoextra));
+	if (!sinfo) {
+		LOG(LOG_ERROR, "Malloc failed for the TLS connection\n");
+		return NULL;
+	}
+	p_sslInfo = &sinfo->mbed_sslInfo;
+#else
+	p_sslInfo = sdoAlloc(sizeof(sslInfo));
+	if (!p_sslInfo) {
+		LOG(LOG_ERROR, "Malloc failed for the TLS connection\n");
+		return NULL;
+	}
 	mbedtls_net_init(&(p_sslInfo->server_fd));
 #endif
-	mbedtls_entropy_init(&(p_sslInfo->entropy));
-	mbedtls_ctr_drbg_init(&(p_sslInfo->ctr_drbg));
 	mbedtls_ssl_init(&(p_sslInfo->ssl));
-	mbedtls_ssl_config_init(&(p_sslInfo->conf));
-	if ((ret = mbedtls_ctr_drbg_seed(
-		 &(p_sslInfo->ctr_drbg), mbedtls_entropy_func,
-		 &(p_sslInfo->entropy), (unsigned char *)DRBG_PERSONALIZED_STR,
-		 strlen((char *)DRBG_PERSONALIZED_STR) + 1)) != 0) {
-		LOG(LOG_ERROR, "mbedtls_ctr_drbg_seed returned %d", ret);
-		goto exit;
-	}
 
 #if !defined(TARGET_OS_MBEDOS)
 	if ((ret = mbedtls_net_connect(
@@ -139,47 +387,15 @@ void *sdo_ssl_setup_connect(char *SERVER_NAME, char *SERVER_PORT)
 		goto exit;
 	}
 #else
-	sdoConHandle *socket = mos_socketOpen();
+	socket = mos_socketOpen();
 	if (!socket) {
 		LOG(LOG_ERROR, "mos_socketOpen() failed!\n");
 		goto exit;
 	}
-	sslInfoVar.socket = socket;
+	sinfo->socket = socket;
 #endif
 
-	if ((ret = mbedtls_ssl_config_defaults(
-		 &(p_sslInfo->conf), MBEDTLS_SSL_IS_CLIENT,
-		 MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT)) !=
-	    0) {
-		LOG(LOG_ERROR,
-		    "failed\n  ! mbedtls_ssl_config_defaults returned %d\n\n",
-		    ret);
-		goto exit;
-	}
-
-	/* The minimum size of DHM set to 2048 from default of 1024. */
-	mbedtls_ssl_conf_dhm_min_bitlen(&(p_sslInfo->conf), MIN_BIT_LENGTH_DHM);
-
-	/* Override default ciphersuites with the recommended ones*/
-	mbedtls_ssl_conf_ciphersuites(&p_sslInfo->conf, ciphersuites);
-
-	/* Explicitly set the max TLS version = v1.2 and min TLS = v1.1 */
-	mbedtls_ssl_conf_max_version(&p_sslInfo->conf,
-				     MBEDTLS_SSL_MAJOR_VERSION_3,
-				     MBEDTLS_SSL_MINOR_VERSION_3);
-	mbedtls_ssl_conf_min_version(&p_sslInfo->conf,
-				     MBEDTLS_SSL_MAJOR_VERSION_3,
-				     MBEDTLS_SSL_MINOR_VERSION_2);
-
-	mbedtls_ssl_conf_authmode(&(p_sslInfo->conf), MBEDTLS_SSL_VERIFY_NONE);
-	mbedtls_ssl_conf_rng(&(p_sslInfo->conf), mbedtls_ctr_drbg_random,
-			     &(p_sslInfo->ctr_drbg));
-#ifdef CONFIG_MBEDTLS_DEBUG
-	mbedtls_esp_enable_debug_log(&(p_sslInfo->conf), 4);
-#endif
-
-	if ((ret = mbedtls_ssl_setup(&(p_sslInfo->ssl), &(p_sslInfo->conf))) !=
-	    0) {
+	if ((ret = mbedtls_ssl_setup(&(p_sslInfo->ssl), conf)) != 0) {
 		LOG(LOG_ERROR, "failed\n  ! mbedtls_ssl_setup returned %d\n\n",
 		    ret);
 		goto exit;
@@ -193,11 +409,19 @@ void *sdo_ssl_setup_connect(char *SERVER_NAME, char *SERVER_PORT)
 		goto exit;
 	}
 
+#ifndef TLS_SESSION_CACHE_FALSE
+	/* offer the previous session of this server for resumption */
+	entry = tlsSessionFind(key);
+	if (entry && mbedtls_ssl_set_session(&(p_sslInfo->ssl),
+					     &entry->session) != 0)
+		LOG(LOG_DEBUG, "TLS session not set\n");
+#endif
+
 #if !defined(TARGET_OS_MBEDOS)
 	mbedtls_ssl_set_bio(&(p_sslInfo->ssl), &(p_sslInfo->server_fd),
 			    mbedtls_net_send, mbedtls_net_recv, NULL);
 #else
-	mbedtls_ssl_set_bio(&(p_sslInfo->ssl), (void *)sslInfoVar.socket,
+	mbedtls_ssl_set_bio(&(p_sslInfo->ssl), (void *)socket,
 			    mbed_ssl_rawwrite, mbed_ssl_rawread, NULL);
 #endif
 
@@ -219,6 +443,10 @@ void *sdo_ssl_setup_connect(char *SERVER_NAME, char *SERVER_PORT)
 		    ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 			LOG(LOG_ERROR,
 			    "mbedtls_ssl_handshake returned -0x%x\n\n", ret);
+#ifndef TLS_SESSION_CACHE_FALSE
+			/* do not offer the same session again */
+			tlsSessionDrop(entry);
+#endif
 			goto exit;
 		}
 	}
@@ -228,19 +456,47 @@ void *sdo_ssl_setup_connect(char *SERVER_NAME, char *SERVER_PORT)
 		goto exit;
 	}
 
+#ifndef TLS_SESSION_CACHE_FALSE
+	tlsSessionStore(key, &(p_sslInfo->ssl));
+#endif
+
 	return (void *)p_sslInfo;
 
 exit:
 #if !defined(TARGET_OS_MBEDOS)
 	mbedtls_net_free(&(p_sslInfo->server_fd));
+#else
+	if (socket)
+		mos_socketClose(socket);
 #endif
 	mbedtls_ssl_free(&(p_sslInfo->ssl));
-	mbedtls_ssl_config_free(&(p_sslInfo->conf));
-	mbedtls_ctr_drbg_free(&(p_sslInfo->ctr_drbg));
-	mbedtls_entropy_free(&(p_sslInfo->entropy));
+	sdoFree(p_sslInfo);
 	return NULL;
 }
 
+#ifdef HTTP2
+/**
+ * Tell whether the TLS handshake has agreed on HTTP/2 (ALPN "h2").
+ *
+ * @param ssl
+ *        ssl handle containing the TLS/SSL connection context.
+ * @return
+ *        return true for HTTP/2, false for HTTP/1.1.
+ */
+bool sdo_ssl_alpn_h2(void *ssl)
+{
+#ifdef MBEDTLS_SSL_ALPN
+	const char *proto =
+	    mbedtls_ssl_get_alpn_protocol(&((sslInfo *)ssl)->ssl);
+
+	return proto && proto[0] == 'h' && proto[1] == '2' && !proto[2];
+#else
+	(void)ssl;
+	return false;
+#endif
+}
+#endif
+
 /**
  * Shuts down an active TLS/SSL connection. It sends the "close notify"
  * shutdown alert to the peer. Also free the TLS/SSL connection context.
@@ -261,13 +517,10 @@ int sdo_ssl_close(void *ssl)
 	sslInfo *sslC = (sslInfo *)ssl;
 
 #if !defined(TARGET_OS_MBEDOS)
-	mbedtls_net_free(&(p_sslInfo->server_fd));
+	mbedtls_net_free(&(sslC->server_fd));
 #endif
-	mbedtls_entropy_free(&(sslC->entropy));
-	mbedtls_ctr_drbg_free(&(sslC->ctr_drbg));
 	mbedtls_ssl_free(&(sslC->ssl));
-	mbedtls_ssl_config_free(&(sslC->conf));
-	sslC = NULL;
+	sdoFree(sslC);
 	return 0;
 }
 
@@ -319,6 +572,7 @@ int sdo_ssl_read(void *ssl, void *buf, int num)
 int sdo_ssl_write(void *ssl, const void *buf, int num)
 {
 	int ret = -1;
+	int sent = 0;
 
 	if (!ssl || !buf) {
 		LOG(LOG_ERROR, "Invalid arguments in sdo_ssl_write()!\n");
@@ -327,16 +581,20 @@ int sdo_ssl_write(void *ssl, const void *buf, int num)
 
 	sslInfo *sslW = (sslInfo *)ssl;
 
-	/* At a time maximum length can be written is 16384(Maximum fragmented
-	 * length defined by mbedtls api) bytes of num.*/
-	while ((ret = mbedtls_ssl_write(
-		    &(sslW->ssl), (const unsigned char *)buf, num)) <= 0) {
-		if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
-		    ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+	/* A call writes at most one record, of the output buffer size or the
+	 * negotiated maximum fragment length, so loop until all is sent. */
+	while (sent < num) {
+		ret = mbedtls_ssl_write(&(sslW->ssl),
+					(const unsigned char *)buf + sent,
+					num - sent);
+		if (ret > 0) {
+			sent += ret;
+		} else if (ret != MBEDTLS_ERR_SSL_WANT_READ &&
+			   ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
 			LOG(LOG_ERROR, "mbedtls_ssl_write() returned -0x%x\n",
 			    -ret);
 			return -1;
 		}
 	}
-	return ret;
+	return sent;
 }
@@ -19,6 +19,13 @@
 #include "util.h"
 #include "safe_lib.h"
 #include "mbedtls_random.h"
+#include "mbedtls_dispatch.h"
+#if defined(ECDSA256_DA) || defined(ECDSA384_DA) || defined(ECC_RESTARTABLE)
+#include "mbedtls_ec_key.h"
+#endif
+#ifdef ECC_RESTARTABLE
+#include "task_al.h"
+#endif
 
 #ifdef SECURE_ELEMENT
 int32_t sdoSECryptoInit(void);
@@ -109,6 +116,35 @@ err:
 	return ret;
 }
 
+#ifdef ECC_RESTARTABLE
+static sdoCryptoYieldCB eccYield;
+
+/**
+ * Set what runs between the slices of an ECC operation.
+ * @param yield - callback, NULL to yield the thread to the others.
+ */
+void sdoCryptoSetYield(sdoCryptoYieldCB yield)
+{
+	eccYield = yield;
+}
+
+/**
+ * Yield if an ECP operation stopped at the end of its slice.
+ * @param ret - what the operation returned.
+ * @return true if it is to be called again, else false.
+ */
+bool mbedtls_ecp_yield(int ret)
+{
+	if (ret != MBEDTLS_ERR_ECP_IN_PROGRESS)
+		return false;
+	if (eccYield)
+		eccYield();
+	else
+		sdoTaskYield();
+	return true;
+}
+#endif
+
 #ifndef SECURE_ELEMENT
 /**
  * If crypto init is true, generate random bytes of data
@@ -124,9 +160,12 @@ int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes)
 	if (!is_mbedtls_random_init() || !dbrg_ctx)
 		return -1;
 
-	if (NULL == randomBuffer) {
+	if (NULL == randomBuffer)
 		return -1;
-	} else if (0 != mbedtls_ctr_drbg_random(
+#ifdef CRYPTO_FIXED_RANDOM
+	return sdoCryptoFixedRandom(randomBuffer, numBytes);
+#endif
+	if (0 != mbedtls_ctr_drbg_random(
 			    dbrg_ctx, (uint8_t *)randomBuffer, numBytes)) {
 		return -1;
 	}
@@ -142,9 +181,18 @@ int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes)
  */
 int32_t cryptoInit(void)
 {
+#ifdef CRYPTO_FIXED_RANDOM
+	LOG(LOG_ERROR, "*** CRYPTO_FIXED_RANDOM: the random bytes, keys and "
+		       "nonces are predictable, NET_REPLAY builds only, never "
+		       "for a device ***\n");
+#endif
 	if (0 != random_init()) {
 		return -1;
 	}
+	mbedtls_dispatch_init();
+#ifdef ECC_RESTARTABLE
+	mbedtls_ecp_set_max_ops(ECC_SLICE_OPS);
+#endif
 
 #ifdef SECURE_ELEMENT
 	if (0 != sdoSECryptoInit()) {
@@ -164,6 +212,8 @@ int32_t cryptoInit(void)
  */
 int32_t cryptoClose(void)
 {
+	/* the TLS configuration uses the DRBG */
+	sdo_ssl_context_free();
 	if (0 != random_close()) {
 		return -1;
 	}
@@ -211,6 +261,11 @@ int32_t _sdoCryptoHash(uint8_t _hashType, const uint8_t *buffer,
 	default:
 		return -1;
 	}
+	/* SHA-256 on the CPU extensions when there are some */
+	if (mbedhashType == MBEDTLS_MD_SHA256 &&
+	    mbedtls_dispatch_sha256(buffer, bufferLength, output) == 0)
+		return 0;
+
 	/* Calculate the hash over message and sign that hash */
 	if (mbedtls_md(mbedtls_md_info_from_type(mbedhashType),
 		       (const uint8_t *)buffer, bufferLength, output) != 0) {
@@ -344,4 +399,279 @@ end:
 	mbedtls_md_free(&ctx);
 	return ret;
 }
+
+/**
+ * sdoCryptoHashInit function sets up the hash of data handed over in pieces
+ *
+ * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256/
+ *				SDO_CRYPTO_HASH_TYPE_SHA_384)
+ * @param context - out pointer to the hash context.
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashInit(uint8_t hashType, void **context)
+{
+	mbedtls_md_context_t *ctx;
+	mbedtls_md_type_t mdType;
+
+	switch (hashType) {
+	case SDO_CRYPTO_HASH_TYPE_SHA_256:
+		mdType = MBEDTLS_MD_SHA256;
+		break;
+	case SDO_CRYPTO_HASH_TYPE_SHA_384:
+		mdType = MBEDTLS_MD_SHA384;
+		break;
+	default:
+		return -1;
+	}
+
+	if (!context)
+		return -1;
+
+	ctx = sdoAlloc(sizeof(mbedtls_md_context_t));
+	if (!ctx)
+		return -1;
+
+	mbedtls_md_init(ctx);
+	if (0 != mbedtls_md_setup(ctx, mbedtls_md_info_from_type(mdType), 0) ||
+	    0 != mbedtls_md_starts(ctx)) {
+		mbedtls_md_free(ctx);
+		sdoFree(ctx);
+		return -1;
+	}
+
+	*context = ctx;
+	return 0;
+}
+
+/**
+ * sdoCryptoHashUpdate function hashes the next piece of data
+ *
+ * @param context - hash context set up by sdoCryptoHashInit().
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength)
+{
+	if (!context || (!buffer && bufferLength))
+		return -1;
+	if (0 != mbedtls_md_update(context, buffer, bufferLength))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHashFinal function completes the hash and releases its context
+ *
+ * @param context - in/out hash context, NULL on return.
+ * @param output - pointer to output data buffer, NULL to only release the
+ * context.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashFinal(void **context, uint8_t *output,
+			   size_t outputLength)
+{
+	int32_t ret = -1;
+	mbedtls_md_context_t *ctx;
+
+	if (!context || !*context)
+		return -1;
+	ctx = *context;
+
+	if (!output) {
+		ret = 0;
+		goto end;
+	}
+	if (outputLength < mbedtls_md_get_size(ctx->md_info))
+		goto end;
+	if (0 != mbedtls_md_finish(ctx, output))
+		goto end;
+	ret = 0;
+
+end:
+	mbedtls_md_free(ctx);
+	sdoFree(ctx);
+	*context = NULL;
+	return ret;
+}
+
+/**
+ * sdoCryptoHMACInit function sets up the hmac of data handed over in pieces
+ *
+ * @param hmacType - Hmac type (SDO_CRYPTO_HMAC_TYPE_SHA_256/
+ *				SDO_CRYPTO_HMAC_TYPE_SHA_384)
+ * @param key - pointer to hmac key buffer of uint8_t type.
+ * @param keyLength - hmac key size
+ * @param context - out pointer to the hmac context.
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACInit(uint8_t hmacType, const uint8_t *key,
+			  size_t keyLength, void **context)
+{
+	mbedtls_md_context_t *ctx;
+	mbedtls_md_type_t mdType;
+
+	switch (hmacType) {
+	case SDO_CRYPTO_HMAC_TYPE_SHA_256:
+		mdType = MBEDTLS_MD_SHA256;
+		break;
+	case SDO_CRYPTO_HMAC_TYPE_SHA_384:
+		mdType = MBEDTLS_MD_SHA384;
+		break;
+	default:
+		return -1;
+	}
+
+	if (!context || NULL == key || 0 == keyLength)
+		return -1;
+
+	ctx = sdoAlloc(sizeof(mbedtls_md_context_t));
+	if (!ctx)
+		return -1;
+
+	mbedtls_md_init(ctx);
+	if (0 != mbedtls_md_setup(ctx, mbedtls_md_info_from_type(mdType), 1) ||
+	    0 != mbedtls_md_hmac_starts(ctx, key, keyLength)) {
+		mbedtls_md_free(ctx);
+		sdoFree(ctx);
+		return -1;
+	}
+
+	*context = ctx;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACUpdate function adds the next piece of data to the hmac
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength)
+{
+	if (!context || (!buffer && bufferLength))
+		return -1;
+	if (0 != mbedtls_md_hmac_update(context, buffer, bufferLength))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACFinal function completes the hmac and releases its context
+ *
+ * @param context - in/out hmac context, NULL on return.
+ * @param output - pointer to output data buffer, NULL to only release the
+ * context.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACFinal(void **context, uint8_t *output,
+			   size_t outputLength)
+{
+	int32_t ret = -1;
+	mbedtls_md_context_t *ctx;
+
+	if (!context || !*context)
+		return -1;
+	ctx = *context;
+
+	if (!output) {
+		ret = 0;
+		goto end;
+	}
+	if (outputLength < mbedtls_md_get_size(ctx->md_info))
+		goto end;
+	if (0 != mbedtls_md_hmac_finish(ctx, output))
+		goto end;
+	ret = 0;
+
+end:
+	mbedtls_md_free(ctx);
+	sdoFree(ctx);
+	*context = NULL;
+	return ret;
+}
+
+/**
+ * sdoCryptoHMACKeyed function calculates the hmac of a whole buffer with the
+ * key of a context, whose key state is kept for the next buffer
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit(), released by
+ * sdoCryptoHMACFinal() with a NULL output.
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @param output - pointer to output data buffer of uint8_t type.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACKeyed(void *context, const uint8_t *buffer,
+			   size_t bufferLength, uint8_t *output,
+			   size_t outputLength)
+{
+	mbedtls_md_context_t *ctx = context;
+
+	if (!ctx || NULL == buffer || 0 == bufferLength || NULL == output ||
+	    outputLength < mbedtls_md_get_size(ctx->md_info))
+		return -1;
+
+	/* Restarts from the inner pad kept by Init */
+	if (0 != mbedtls_md_hmac_reset(ctx) ||
+	    0 != mbedtls_md_hmac_update(ctx, buffer, bufferLength) ||
+	    0 != mbedtls_md_hmac_finish(ctx, output))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACRestart function starts a new hmac with the key of a context,
+ * the data of which is then handed over with sdoCryptoHMACUpdate()
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACRestart(void *context)
+{
+	if (!context)
+		return -1;
+	/* Restarts from the inner pad kept by Init */
+	if (0 != mbedtls_md_hmac_reset(context))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACKeyedFinal function completes the hmac started by
+ * sdoCryptoHMACRestart(), the context staying keyed for the next one
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @param output - pointer to output data buffer of uint8_t type.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACKeyedFinal(void *context, uint8_t *output,
+				size_t outputLength)
+{
+	mbedtls_md_context_t *ctx = context;
+
+	if (!ctx || NULL == output ||
+	    outputLength < mbedtls_md_get_size(ctx->md_info))
+		return -1;
+	if (0 != mbedtls_md_hmac_finish(ctx, output))
+		return -1;
+	return 0;
+}
 #endif /* SECURE_ELEMENT */
@@ -0,0 +1,292 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Run time selection of the mbedTLS primitive implementations.
+ *
+ * The CPU is probed once at cryptoInit and SHA-256 is bound to the SHA
+ * extensions (x86) or the ARMv8 Crypto Extensions where they are present.
+ * When mbedTLS is configured with MBEDTLS_SHA256_PROCESS_ALT every SHA-256
+ * it computes, for TLS and ECDSA too, goes through the same binding. AES and
+ * GHASH are dispatched by mbedTLS itself, MBEDTLS_AESNI_C probes AES-NI and
+ * PCLMULQDQ at run time.
+ */
+
+#include <stdbool.h>
+#include "mbedtls/sha256.h"
+
+#include "sdoCryptoHal.h"
+#include "safe_lib.h"
+#include "util.h"
+#include "mbedtls_dispatch.h"
+
+#if !defined(CRYPTO_DISPATCH_FALSE) && defined(__GNUC__) &&                  \
+    (defined(__x86_64__) || defined(__i386__))
+#define DISPATCH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+#elif !defined(CRYPTO_DISPATCH_FALSE) && defined(__GNUC__) &&                \
+    defined(__aarch64__) && defined(__ARM_NEON)
+#define DISPATCH_ARM
+#include <arm_neon.h>
+#if defined(__linux__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+#endif
+
+#define SHA256_BLOCK_SIZE 64
+
+/* Compress whole 64 byte blocks into the state */
+typedef void (*sha256Blocks_t)(uint32_t state[8], const uint8_t *data,
+			       size_t blocks);
+
+static const uint32_t sha256K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static const uint32_t sha256H0[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372,
+				     0xa54ff53a, 0x510e527f, 0x9b05688c,
+				     0x1f83d9ab, 0x5be0cd19};
+
+#ifdef DISPATCH_X86
+/**
+ * Internal API: compress blocks with the x86 SHA extensions.
+ */
+__attribute__((target("sha,sse4.1"))) static void
+sha256BlocksSHANI(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+	const __m128i bswap =
+	    _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i abef, cdgh, abefSave, cdghSave, msg, tmp, w[4];
+	int i;
+
+	/* The instructions want the state as ABEF and CDGH */
+	tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]),
+				0xb1);
+	cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]),
+				 0x1b);
+	abef = _mm_alignr_epi8(tmp, cdgh, 8);
+	cdgh = _mm_blend_epi16(cdgh, tmp, 0xf0);
+
+	while (blocks--) {
+		abefSave = abef;
+		cdghSave = cdgh;
+		for (i = 0; i < 4; i++)
+			w[i] = _mm_shuffle_epi8(
+			    _mm_loadu_si128((const __m128i *)(data + 16 * i)),
+			    bswap);
+
+		/* Four rounds per iteration, each on four schedule words */
+		for (i = 0; i < 16; i++) {
+			if (i >= 4)
+				w[i & 3] = _mm_sha256msg2_epu32(
+				    _mm_add_epi32(
+					_mm_sha256msg1_epu32(w[i & 3],
+							     w[(i + 1) & 3]),
+					_mm_alignr_epi8(w[(i + 3) & 3],
+							w[(i + 2) & 3], 4)),
+				    w[(i + 3) & 3]);
+			msg = _mm_add_epi32(
+			    w[i & 3],
+			    _mm_loadu_si128((const __m128i *)&sha256K[4 * i]));
+			cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0e);
+			abef = _mm_sha256rnds2_epu32(abef, cdgh, msg);
+		}
+
+		abef = _mm_add_epi32(abef, abefSave);
+		cdgh = _mm_add_epi32(cdgh, cdghSave);
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	tmp = _mm_shuffle_epi32(abef, 0x1b);
+	cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i *)&state[0],
+			 _mm_blend_epi16(tmp, cdgh, 0xf0));
+	_mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(cdgh, tmp, 8));
+}
+#endif /* DISPATCH_X86 */
+
+#ifdef DISPATCH_ARM
+/**
+ * Internal API: compress blocks with the ARMv8 Crypto Extensions.
+ */
+__attribute__((target("+crypto"))) static void
+sha256BlocksCE(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+	uint32x4_t abcd = vld1q_u32(&state[0]);
+	uint32x4_t efgh = vld1q_u32(&state[4]);
+	uint32x4_t abcdSave, efghSave, msg, tmp, w[4];
+	int i;
+
+	while (blocks--) {
+		abcdSave = abcd;
+		efghSave = efgh;
+		for (i = 0; i < 4; i++)
+			w[i] = vreinterpretq_u32_u8(
+			    vrev32q_u8(vld1q_u8(data + 16 * i)));
+
+		for (i = 0; i < 16; i++) {
+			if (i >= 4)
+				w[i & 3] = vsha256su1q_u32(
+				    vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]),
+				    w[(i + 2) & 3], w[(i + 3) & 3]);
+			msg = vaddq_u32(w[i & 3], vld1q_u32(&sha256K[4 * i]));
+			tmp = abcd;
+			abcd = vsha256hq_u32(abcd, efgh, msg);
+			efgh = vsha256h2q_u32(efgh, tmp, msg);
+		}
+
+		abcd = vaddq_u32(abcd, abcdSave);
+		efgh = vaddq_u32(efgh, efghSave);
+		data += SHA256_BLOCK_SIZE;
+	}
+
+	vst1q_u32(&state[0], abcd);
+	vst1q_u32(&state[4], efgh);
+}
+#endif /* DISPATCH_ARM */
+
+static sha256Blocks_t sha256Blocks;
+
+/**
+ * Probe the CPU and bind the fastest primitive implementations. Called from
+ * cryptoInit, before any of them is used.
+ */
+void mbedtls_dispatch_init(void)
+{
+#if defined(DISPATCH_X86)
+	unsigned int eax, ebx, ecx, edx;
+
+	/* SHA in CPUID.7.0:EBX, SSSE3 and SSE4.1 in CPUID.1:ECX */
+	if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) &&
+	    (ecx & (1u << 9)) && (ecx & (1u << 19)) &&
+	    __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+	    (ebx & (1u << 29)))
+		sha256Blocks = sha256BlocksSHANI;
+#elif defined(DISPATCH_ARM)
+#if defined(__linux__)
+	if (getauxval(AT_HWCAP) & HWCAP_SHA2)
+		sha256Blocks = sha256BlocksCE;
+#elif defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO)
+	sha256Blocks = sha256BlocksCE;
+#endif
+#endif
+	LOG(LOG_DEBUG, "SHA-256: %s\n",
+	    sha256Blocks ? "CPU extensions" : "mbedTLS software");
+}
+
+/**
+ * SHA-256 of a buffer with the kernel bound at init.
+ *
+ * @param buffer - input data
+ * @param bufferLength - input data size
+ * @param output - SHA256_DIGEST_SIZE bytes of digest
+ * @return 0 on success, -1 when there is no kernel for this CPU so the caller
+ *         uses mbedTLS instead
+ */
+int mbedtls_dispatch_sha256(const uint8_t *buffer, size_t bufferLength,
+			    uint8_t *output)
+{
+	uint8_t last[2 * SHA256_BLOCK_SIZE] = {0};
+	uint32_t state[8];
+	size_t whole = bufferLength / SHA256_BLOCK_SIZE;
+	size_t rest = bufferLength % SHA256_BLOCK_SIZE;
+	size_t lastLen = rest < 56 ? SHA256_BLOCK_SIZE : 2 * SHA256_BLOCK_SIZE;
+	uint64_t bits = (uint64_t)bufferLength * 8;
+	int i;
+
+	if (!sha256Blocks || !buffer || !output)
+		return -1;
+
+	if (memcpy_s(state, sizeof(state), sha256H0, sizeof(sha256H0)) != 0)
+		return -1;
+	sha256Blocks(state, buffer, whole);
+
+	if (rest &&
+	    memcpy_s(last, sizeof(last), buffer + whole * SHA256_BLOCK_SIZE,
+		     rest) != 0)
+		return -1;
+	last[rest] = 0x80;
+	for (i = 0; i < 8; i++)
+		last[lastLen - 1 - i] = (uint8_t)(bits >> (8 * i));
+	sha256Blocks(state, last, lastLen / SHA256_BLOCK_SIZE);
+
+	for (i = 0; i < 8; i++) {
+		output[4 * i] = (uint8_t)(state[i] >> 24);
+		output[4 * i + 1] = (uint8_t)(state[i] >> 16);
+		output[4 * i + 2] = (uint8_t)(state[i] >> 8);
+		output[4 * i + 3] = (uint8_t)state[i];
+	}
+	return 0;
+}
+
+#if defined(MBEDTLS_SHA256_PROCESS_ALT)
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+/**
+ * Internal API: compress one block in C, for CPUs without the extensions.
+ */
+static void sha256BlockC(uint32_t state[8], const uint8_t *data)
+{
+	uint32_t w[64], s[8], t1, t2;
+	int i;
+
+	for (i = 0; i < 16; i++)
+		w[i] = (uint32_t)data[4 * i] << 24 |
+		       (uint32_t)data[4 * i + 1] << 16 |
+		       (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+	for (; i < 64; i++)
+		w[i] = w[i - 16] + w[i - 7] +
+		       (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^
+			(w[i - 15] >> 3)) +
+		       (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^
+			(w[i - 2] >> 10));
+
+	for (i = 0; i < 8; i++)
+		s[i] = state[i];
+	for (i = 0; i < 64; i++) {
+		t1 = s[7] + (ROR(s[4], 6) ^ ROR(s[4], 11) ^ ROR(s[4], 25)) +
+		     ((s[4] & s[5]) ^ (~s[4] & s[6])) + sha256K[i] + w[i];
+		t2 = (ROR(s[0], 2) ^ ROR(s[0], 13) ^ ROR(s[0], 22)) +
+		     ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+		s[7] = s[6];
+		s[6] = s[5];
+		s[5] = s[4];
+		s[4] = s[3] + t1;
+		s[3] = s[2];
+		s[2] = s[1];
+		s[1] = s[0];
+		s[0] = t1 + t2;
+	}
+	for (i = 0; i < 8; i++)
+		state[i] += s[i];
+}
+
+/*
+ * mbedTLS SHA-256 block function, replaced by MBEDTLS_SHA256_PROCESS_ALT so
+ * that hashing inside mbedTLS picks up the binding as well.
+ */
+int mbedtls_internal_sha256_process(mbedtls_sha256_context *ctx,
+				    const unsigned char data[64])
+{
+	if (sha256Blocks)
+		sha256Blocks(ctx->state, data, 1);
+	else
+		sha256BlockC(ctx->state, data);
+	return 0;
+}
+#endif /* MBEDTLS_SHA256_PROCESS_ALT */
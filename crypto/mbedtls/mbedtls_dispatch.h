@@ -0,0 +1,16 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+#ifndef __MBEDTLS_DISPATCH_H__
+#define __MBEDTLS_DISPATCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Bind the primitives to the fastest implementation the CPU supports */
+void mbedtls_dispatch_init(void);
+/* SHA-256 through the bound kernel, -1 when there is none */
+int mbedtls_dispatch_sha256(const uint8_t *buffer, size_t bufferLength,
+			    uint8_t *output);
+#endif
@@ -16,7 +16,7 @@
 #include "mbedtls_random.h"
 #include "sdoCryptoHal.h"
 #include "safe_lib.h"
-#include "ecdsa_privkey.h"
+#include "mbedtls_ec_key.h"
 
 #define CSR_BUFFER_SIZE (4 * 1024)
 
@@ -35,8 +35,6 @@ static int f_rng(void *ctx, unsigned char *buf, size_t size)
 int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 {
 	int ret = -1;
-	uint8_t *privkey = NULL;
-	size_t privkey_size = 0;
 	uint8_t *csr_buf = NULL;
 	SDOByteArray_t *pem_byte_arr = NULL;
 	size_t pem_buf_size = 0;
@@ -45,7 +43,6 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 	mbedtls_ecp_keypair *keypair = NULL;
 	void *dbrg_ctx = get_mbedtls_random_ctx();
 	mbedtls_md_type_t md_algo = MBEDTLS_MD_SHA256;
-	mbedtls_ecp_group_id grp_id = MBEDTLS_ECP_DP_SECP256R1;
 	/*
 	 * FIXME: CN is generally URL which will be present in certificate.
 	 * The below data should be unique for each CSR.
@@ -56,13 +53,6 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 	/* Initialize the key context for CSR */
 	mbedtls_pk_init(&pk_ctx);
 
-	/* Load the EC private key from storage */
-	ret = load_ecdsa_privkey(&privkey, &privkey_size);
-	if (!privkey) {
-		LOG(LOG_ERROR, "Failed to load the EC private key\n");
-		goto key_err;
-	}
-
 	/* Set the key type to ec key */
 	ret = mbedtls_pk_setup(&pk_ctx,
 			       mbedtls_pk_info_from_type(MBEDTLS_PK_ECKEY));
@@ -79,37 +69,13 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 	}
 
 #ifdef ECDSA384_DA
-	grp_id = MBEDTLS_ECP_DP_SECP384R1;
 	md_algo = MBEDTLS_MD_SHA384;
 #endif
 
-	/* Load the EC group before reading data into the private point */
-	ret = mbedtls_ecp_group_load(&keypair->grp, grp_id);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to load EC pair with the group id\n");
-		goto key_err;
-	}
-
-#ifdef ECDSA_PEM
-	ret = mbedtls_pk_parse_key(&pk_ctx, privkey, privkey_size, NULL, 0);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to parse EC (PEM) private key\n");
-		goto key_err;
-	}
-#else
-	/* Copy binary data into EC private member and ready to roll */
-	ret = mbedtls_mpi_read_binary(&keypair->d, privkey, privkey_size);
-	if (ret) {
-		LOG(LOG_ERROR, "Failed to load binary data into EC priv ctx\n");
-		goto key_err;
-	}
-#endif
-
-	/* Fill the public key in the context */
-	ret = mbedtls_ecp_mul(&keypair->grp, &keypair->Q, &keypair->d,
-			      &keypair->grp.G, f_rng, dbrg_ctx);
+	/* The resident device key, with its public key */
+	ret = copy_ec_keypair(keypair);
 	if (ret) {
-		LOG(LOG_ERROR, "Failed to fill in public key\n");
+		LOG(LOG_ERROR, "Failed to load the EC private key\n");
 		goto key_err;
 	}
 
@@ -160,13 +126,6 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 	ret = 0;
 
 csr_err:
-	if (privkey) {
-		if (memset_s(privkey, privkey_size, 0)) {
-			LOG(LOG_ERROR, "Failed to clear ecdsa privkey\n");
-			ret = -1;
-		}
-		sdoFree(privkey);
-	}
 	if (pem_byte_arr && ret) {
 		sdoByteArrayFree(pem_byte_arr);
 		pem_byte_arr = NULL;
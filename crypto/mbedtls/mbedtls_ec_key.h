@@ -0,0 +1,25 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+#ifndef __MBEDTLS_EC_KEY_H__
+#define __MBEDTLS_EC_KEY_H__
+
+#include <stdbool.h>
+#include "mbedtls/ecp.h"
+
+int copy_ec_keypair(mbedtls_ecp_keypair *keypair);
+
+/*
+ * Restartable ECP (ECC_RESTARTABLE): a multiplication stops after
+ * ECC_SLICE_OPS basic operations with MBEDTLS_ERR_ECP_IN_PROGRESS, and is
+ * called again, with the same arguments, after a yield. ECP_YIELD(ret)
+ * is true once it yielded and the operation is to be resumed.
+ */
+#ifdef ECC_RESTARTABLE
+bool mbedtls_ecp_yield(int ret);
+#define ECP_YIELD(ret) mbedtls_ecp_yield(ret)
+#else
+#define ECP_YIELD(ret) false
+#endif
+#endif
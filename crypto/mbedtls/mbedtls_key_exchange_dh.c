@@ -136,6 +136,127 @@ static int myrand(void *rng_state, unsigned char *output, size_t len)
 	return _sdoCryptoRandomBytes(output, len);
 }
 
+/*
+ * Fixed-base comb for G^X. The group is fixed, so the 2^DH_COMB_TEETH
+ * products of G^(2^(spacing * i)) are computed once and GX then costs
+ * spacing squarings and multiplications instead of a full exponentiation.
+ * The table lives until the process exits.
+ */
+#define DH_COMB_TEETH 6
+#define DH_COMB_SIZE (1 << DH_COMB_TEETH)
+
+static struct {
+	mbedtls_mpi entry[DH_COMB_SIZE];
+	size_t spacing;
+	bool built;
+} dhComb;
+/* Built by the first key exchange, of any instance */
+SDO_MUTEX(dhCombLock);
+
+/* r = a * b mod p, with t as scratch */
+static int dhCombMulMod(mbedtls_mpi *r, const mbedtls_mpi *a,
+			const mbedtls_mpi *b, const mbedtls_mpi *p,
+			mbedtls_mpi *t)
+{
+	int ret = mbedtls_mpi_mul_mpi(t, a, b);
+
+	if (ret == 0)
+		ret = mbedtls_mpi_mod_mpi(r, t, p);
+	return ret;
+}
+
+/**
+ * Build the comb table for exponents below P, unless it is already built.
+ * @param dhm - the dhm context holding the group
+ * @return true on success, false on error
+ */
+static bool dhCombBuild(const mbedtls_dhm_context *dhm)
+{
+	mbedtls_mpi t;
+	size_t i, j, k;
+	int ret = 0;
+
+	if (dhComb.built)
+		return true;
+
+	mbedtls_mpi_init(&t);
+	for (j = 0; j < DH_COMB_SIZE; j++)
+		mbedtls_mpi_init(&dhComb.entry[j]);
+	dhComb.spacing =
+	    (mbedtls_mpi_bitlen(&dhm->P) + DH_COMB_TEETH - 1) / DH_COMB_TEETH;
+
+	/* entry[0] is one and entry[1 << i] is G^(2^(spacing * i)) */
+	ret = mbedtls_mpi_lset(&dhComb.entry[0], 1);
+	if (ret == 0)
+		ret = mbedtls_mpi_copy(&dhComb.entry[1], &dhm->G);
+	for (i = 1; ret == 0 && i < DH_COMB_TEETH; i++) {
+		mbedtls_mpi *e = &dhComb.entry[1 << i];
+
+		ret = mbedtls_mpi_copy(e, &dhComb.entry[1 << (i - 1)]);
+		for (k = 0; ret == 0 && k < dhComb.spacing; k++)
+			ret = dhCombMulMod(e, e, e, &dhm->P, &t);
+	}
+	/* Every other entry is the product of its lowest bit and the rest */
+	for (j = 3; ret == 0 && j < DH_COMB_SIZE; j++) {
+		if (!(j & (j - 1)))
+			continue;
+		ret = dhCombMulMod(&dhComb.entry[j], &dhComb.entry[j & (j - 1)],
+				   &dhComb.entry[j & -j], &dhm->P, &t);
+	}
+	mbedtls_mpi_free(&t);
+
+	if (ret != 0) {
+		for (j = 0; j < DH_COMB_SIZE; j++)
+			mbedtls_mpi_free(&dhComb.entry[j]);
+		return false;
+	}
+	dhComb.built = true;
+	return true;
+}
+
+/**
+ * Compute r = G^e mod P with the comb table.
+ * @param r - the result
+ * @param e - the exponent, of at most spacing * DH_COMB_TEETH bits
+ * @param p - the prime
+ * @return 0 on success, an mbedtls error code otherwise
+ */
+static int dhCombExp(mbedtls_mpi *r, const mbedtls_mpi *e,
+		     const mbedtls_mpi *p)
+{
+	mbedtls_mpi t;
+	size_t i, k, idx;
+	int ret;
+
+	mbedtls_mpi_init(&t);
+	ret = mbedtls_mpi_lset(r, 1);
+	for (k = dhComb.spacing; ret == 0 && k-- > 0;) {
+		ret = dhCombMulMod(r, r, r, p, &t);
+		idx = 0;
+		for (i = 0; i < DH_COMB_TEETH; i++) {
+			if (mbedtls_mpi_get_bit(e, dhComb.spacing * i + k))
+				idx |= 1 << i;
+		}
+		if (ret == 0)
+			ret = dhCombMulMod(r, r, &dhComb.entry[idx], p, &t);
+	}
+	mbedtls_mpi_free(&t);
+	return ret;
+}
+
+/* Same bounds as mbedtls dhm_check_range(): 2 <= x <= P - 2 */
+static bool dhInRange(const mbedtls_mpi *x, const mbedtls_mpi *p)
+{
+	mbedtls_mpi u;
+	bool ret;
+
+	mbedtls_mpi_init(&u);
+	ret = mbedtls_mpi_sub_int(&u, p, 2) == 0 &&
+	      mbedtls_mpi_cmp_int(x, 2) >= 0 && mbedtls_mpi_cmp_mpi(x, &u) <= 0;
+	mbedtls_mpi_free(&u);
+	return ret;
+}
+
 /**
  * Compute B from initial secret a passed to us in the clear
  * @param keyExData - pointer to the keyexchange data structure
@@ -146,6 +267,8 @@ static bool computePublicBDH(dh_context_t *keyExData)
 {
 	bool ret = false;
 	int retval = -1;
+	int count;
+	bool comb;
 
 	LOG(LOG_DEBUG, "computePublicB started\n");
 	retval = mbedtls_mpi_size(&keyExData->dhm.P);
@@ -159,13 +282,49 @@ static bool computePublicBDH(dh_context_t *keyExData)
 	}
 	keyExData->_publicB_length = keyExData->dhm.len;
 
-	retval = mbedtls_dhm_make_public(
-	    &keyExData->dhm, (int)keyExData->dhm.len, keyExData->_publicB,
-	    keyExData->dhm.len, myrand, NULL);
+	/* A table that fails to build only costs the fast path */
+	SDO_LOCK(dhCombLock);
+	comb = dhCombBuild(&keyExData->dhm);
+	SDO_UNLOCK(dhCombLock);
+	if (!comb) {
+		retval = mbedtls_dhm_make_public(
+		    &keyExData->dhm, (int)keyExData->dhm.len,
+		    keyExData->_publicB, keyExData->dhm.len, myrand, NULL);
+		if (retval != 0) {
+			LOG(LOG_ERROR, "Failled to make public:%x\n", retval);
+			goto err;
+		}
+		goto done;
+	}
+
+	/* The secret X is drawn as mbedtls_dhm_make_public() draws it */
+	count = 0;
+	do {
+		retval = mbedtls_mpi_fill_random(
+		    &keyExData->dhm.X, keyExData->dhm.len, myrand, NULL);
+		while (retval == 0 &&
+		       mbedtls_mpi_cmp_mpi(&keyExData->dhm.X,
+					   &keyExData->dhm.P) >= 0)
+			retval = mbedtls_mpi_shift_r(&keyExData->dhm.X, 1);
+		if (retval != 0 || count++ > 10) {
+			LOG(LOG_ERROR, "Failled to make secret:%x\n", retval);
+			goto err;
+		}
+	} while (!dhInRange(&keyExData->dhm.X, &keyExData->dhm.P));
+
+	retval = dhCombExp(&keyExData->dhm.GX, &keyExData->dhm.X,
+			   &keyExData->dhm.P);
+	if (retval == 0 && !dhInRange(&keyExData->dhm.GX, &keyExData->dhm.P))
+		retval = MBEDTLS_ERR_DHM_BAD_INPUT_DATA;
+	if (retval == 0)
+		retval = mbedtls_mpi_write_binary(&keyExData->dhm.GX,
+						  keyExData->_publicB,
+						  keyExData->dhm.len);
 	if (retval != 0) {
 		LOG(LOG_ERROR, "Failled to make public:%x\n", retval);
 		goto err;
 	}
+done:
 
 #if LOG_LEVEL == LOG_MAX_LEVEL
 	LOG(LOG_DEBUG, "Device Public Key (_publicB) : size %lu :\n",
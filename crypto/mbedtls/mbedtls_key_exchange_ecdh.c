@@ -9,6 +9,7 @@
 #include "crypto_utils.h"
 #include "BN_support.h"
 #include "safe_lib.h"
+#include "mbedtls_ec_key.h"
 #include <mbedtls/config.h>
 #include <mbedtls/ecdh.h>
 #include <mbedtls/ecp.h>
@@ -147,10 +148,16 @@ static bool computePublicBECDH(ecdh_context_t *keyExData)
 		LOG(LOG_ERROR, "ec group load failed, ret:%d\n", ret);
 		goto error;
 	}
+#ifdef ECC_RESTARTABLE
+	/* Key generation and shared secret in slices */
+	mbedtls_ecdh_enable_restart(&keyExData->ecdh);
+#endif
 
 	/* Generate private and public key */
-	ret = mbedtls_ecdh_make_public(&keyExData->ecdh, &olen, buf,
-				       sizeof(buf), myrand, NULL);
+	do {
+		ret = mbedtls_ecdh_make_public(&keyExData->ecdh, &olen, buf,
+					       sizeof(buf), myrand, NULL);
+	} while (ECP_YIELD(ret));
 	if (ret != 0) {
 		LOG(LOG_ERROR, "mbedtls_ecdh_make_public returned %d\n", ret);
 		goto error;
@@ -410,9 +417,12 @@ int32_t sdoCryptoSetPeerRandom(void *context, const uint8_t *peerRandValue,
 	}
 
 	/* Compute the ECDH shared secret */
-	if ((ret =
-		 mbedtls_ecdh_calc_secret(&keyExData->ecdh, &size_shse, secret,
-					  secret_buf_MAX, NULL, NULL)) != 0) {
+	do {
+		ret = mbedtls_ecdh_calc_secret(&keyExData->ecdh, &size_shse,
+					       secret, secret_buf_MAX, NULL,
+					       NULL);
+	} while (ECP_YIELD(ret));
+	if (ret != 0) {
 		LOG(LOG_DEBUG, "ecdh secret generation failed");
 		LOG(LOG_DEBUG, "ret:%d\n", ret);
 		goto exit;
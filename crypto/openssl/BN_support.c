@@ -12,6 +12,16 @@
 #include "sdoCryptoHal.h"
 #include <stdlib.h>
 #include "safe_lib.h"
+
+/* Idle BN_CTX kept for the next operations, with the BIGNUMs they hold */
+#define BN_CTX_POOL_SIZE 4
+
+static struct {
+	BN_CTX *ctx[BN_CTX_POOL_SIZE];
+	int count;
+} bnCtxPool;
+/* Shared by the instances and the crypto job workers of the engine */
+SDO_MUTEX(bnCtxLock);
 #include "util.h"
 
 /**
@@ -84,6 +94,74 @@ int bn_rand(bignum_t *rnd, int size)
 	if (NULL == rnd) {
 		return -1;
 	}
+#ifdef CRYPTO_FIXED_RANDOM
+	/* from the fixed sequence, with the top bit set as BN_rand does */
+	int ret = -1;
+	uint8_t *buf = size > 0 ? sdoAlloc(size) : NULL;
+
+	if (!buf)
+		return -1;
+	if (!_sdoCryptoRandomBytes(buf, size)) {
+		buf[0] |= 0x80;
+		if (BN_bin2bn(buf, size, rnd))
+			ret = 0;
+	}
+	sdoFree(buf);
+	return ret;
+#else
 	int ret = BN_rand(rnd, size * 8, false, -1);
 	return (ret == 1) ? 0 : -1;
+#endif
+}
+
+/**
+ * Take a BN_CTX from the pool of the engine, a new one if the pool is empty,
+ * with a frame started for its BN_CTX_get()s.
+ * @return the BN_CTX, handed back with bn_ctx_put(), NULL on failure.
+ */
+BN_CTX *bn_ctx_get(void)
+{
+	BN_CTX *ctx = NULL;
+
+	SDO_LOCK(bnCtxLock);
+	if (bnCtxPool.count)
+		ctx = bnCtxPool.ctx[--bnCtxPool.count];
+	SDO_UNLOCK(bnCtxLock);
+
+	if (!ctx)
+		ctx = BN_CTX_new();
+	if (ctx)
+		BN_CTX_start(ctx);
+	return ctx;
+}
+
+/**
+ * Hand a BN_CTX from bn_ctx_get() back to the pool, its frame ended. The
+ * BIGNUMs got from it that held secrets are to be cleared first.
+ * @param ctx - the BN_CTX, may be NULL.
+ */
+void bn_ctx_put(BN_CTX *ctx)
+{
+	if (!ctx)
+		return;
+	BN_CTX_end(ctx);
+
+	SDO_LOCK(bnCtxLock);
+	if (bnCtxPool.count < BN_CTX_POOL_SIZE) {
+		bnCtxPool.ctx[bnCtxPool.count++] = ctx;
+		ctx = NULL;
+	}
+	SDO_UNLOCK(bnCtxLock);
+	BN_CTX_free(ctx);
+}
+
+/**
+ * Release the pooled BN_CTX, as the engine is closed.
+ */
+void bn_ctx_pool_free(void)
+{
+	SDO_LOCK(bnCtxLock);
+	while (bnCtxPool.count)
+		BN_CTX_free(bnCtxPool.ctx[--bnCtxPool.count]);
+	SDO_UNLOCK(bnCtxLock);
 }
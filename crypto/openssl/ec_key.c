@@ -15,11 +15,22 @@
 #include "storage_al.h"
 #include "util.h"
 #include "ec_key.h"
+#include "sdoCryptoApi.h"
 #include "ecdsa_privkey.h"
 #include "safe_lib.h"
 
+/*
+ * Resident device key: read from the storage of the instance and decoded
+ * once, with its public key and the multiples of the generator
+ * precomputed, so signatures only cost the multiplication by the nonce. It
+ * is kept in the crypto context of the instance, each instance having a
+ * key of its own, and freed, and so wiped, when its crypto is closed.
+ * Callers get a reference of their own.
+ */
+SDO_MUTEX(devKeyLock);
+
 #ifdef ECDSA_PEM
-EC_KEY *get_EC_KEY(void)
+static EC_KEY *load_EC_KEY(void)
 {
 	int ret = -1;
 	uint8_t *privkey = NULL;
@@ -83,10 +94,10 @@ err:
 	return ec_key;
 }
 #else
-EC_KEY *get_EC_KEY(void)
+static EC_KEY *load_EC_KEY(void)
 {
 	int ret = 0;
-	uint8_t *privkey;
+	uint8_t *privkey = NULL;
 	size_t privkey_size;
 	EC_KEY *ec_key = NULL;
 	BIGNUM *ec_key_bn = NULL;
@@ -140,4 +151,75 @@ err:
 
 	return ec_key;
 }
-#endif
+#endif /* ECDSA_PEM */
+
+/**
+ * Compute the public key of the private key, if it came without one.
+ * @param ec_key - key holding the private key.
+ * @return 0 on success, else -1.
+ */
+static int set_EC_public_key(EC_KEY *ec_key)
+{
+	int ret = -1;
+	const EC_GROUP *grp = EC_KEY_get0_group(ec_key);
+	EC_POINT *pub_key = NULL;
+
+	if (EC_KEY_get0_public_key(ec_key))
+		return 0;
+
+	pub_key = EC_POINT_new(grp);
+	if (!pub_key ||
+	    !EC_POINT_mul(grp, pub_key, EC_KEY_get0_private_key(ec_key), NULL,
+			  NULL, NULL) ||
+	    !EC_KEY_set_public_key(ec_key, pub_key)) {
+		LOG(LOG_ERROR, "Failed to compute the ec public key\n");
+		goto err;
+	}
+	ret = 0;
+
+err:
+	if (pub_key)
+		EC_POINT_free(pub_key);
+	return ret;
+}
+
+/* Free the resident device key, see sdoDevKeyCtx_t */
+static void devKeyFree(void *key)
+{
+	EC_KEY_free(key);
+}
+
+/**
+ * Get the resident device key of the instance, loading it on the first
+ * call.
+ * @return a reference to the key, to be released with EC_KEY_free(), or
+ * NULL on failure.
+ */
+EC_KEY *get_EC_KEY(void)
+{
+	sdoDevKeyCtx_t *devKey = getsdoDevKeyCtx();
+	EC_KEY *ec_key = NULL;
+	EC_KEY *key;
+
+	if (!devKey)
+		return NULL;
+
+	SDO_LOCK(devKeyLock);
+	key = devKey->signKey;
+	if (!key) {
+		key = load_EC_KEY();
+		if (key && set_EC_public_key(key)) {
+			EC_KEY_free(key);
+			key = NULL;
+		}
+		/* Signing works without the table, only slower */
+		if (key && !EC_KEY_precompute_mult(key, NULL))
+			LOG(LOG_DEBUG, "No precomputed ec generator table\n");
+		devKey->signKey = key;
+		devKey->signKeyFree = devKeyFree;
+	}
+	if (key && EC_KEY_up_ref(key))
+		ec_key = key;
+	SDO_UNLOCK(devKeyLock);
+	return ec_key;
+}
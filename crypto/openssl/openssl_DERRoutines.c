@@ -9,6 +9,7 @@
  */
 
 #include "sdoCryptoHal.h"
+#include "BN_support.h"
 #include "util.h"
 #include "storage_al.h"
 #include "safe_lib.h"
@@ -26,11 +27,20 @@ int32_t DEREncode(uint8_t *rawSig, size_t rawSigLength,
 {
 	/* Encode */
 	int ret = 0;
-	BIGNUM *r = BN_new();
-	BIGNUM *s = BN_new();
-	ECDSA_SIG *sig = ECDSA_SIG_new();
+	BIGNUM *r = NULL;
+	BIGNUM *s = NULL;
+	ECDSA_SIG *sig = NULL;
 	uint8_t *msg = (uint8_t *)messageSignature;
 
+	/* P-256/P-384 signatures need no ASN.1 objects */
+	if (0 == sdoDERSigFromRaw(rawSig, rawSigLength, messageSignature,
+				  BUFF_SIZE_256_BYTES, signatureLength))
+		return 0;
+
+	r = BN_new();
+	s = BN_new();
+	sig = ECDSA_SIG_new();
+
 	if ((NULL == rawSig) || (BUFF_SIZE_64_BYTES != rawSigLength) ||
 	    (NULL == messageSignature) || (NULL == signatureLength)) {
 		ret = -1;
@@ -97,15 +107,26 @@ int32_t DERDecode(uint8_t *rawKey, uint8_t *rawSig, const unsigned char *pubKey,
 	int ret = 0;
 	/* bn_ctx is a temp var needed for only some openssl internal operations
 	 */
-	BN_CTX *bn_ctx = BN_CTX_new();
-	uint8_t *local_raw_key;
-	EC_KEY *eckey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-	const BIGNUM *r = BN_new();
-	const BIGNUM *s = BN_new();
-	ECDSA_SIG *sig = ECDSA_SIG_new();
+	BN_CTX *bn_ctx = NULL;
+	uint8_t *local_raw_key = NULL;
+	EC_KEY *eckey = NULL;
+	const BIGNUM *r = NULL;
+	const BIGNUM *s = NULL;
+	ECDSA_SIG *sig = NULL;
 	const EC_GROUP *ecgroup;
 	const EC_POINT *ecpoint;
 
+	/* The usual key and signature shapes need no ASN.1 objects */
+	if (0 == sdoDERPubKeyToRaw(pubKey, keyLength, rawKey, rawKeyLength) &&
+	    0 == sdoDERSigToRaw(messageSignature, signatureLength, rawSig,
+				rawSigLength))
+		return 0;
+
+	bn_ctx = bn_ctx_get();
+	eckey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
+	/* r and s are those of sig, set by ECDSA_SIG_get0() */
+	sig = ECDSA_SIG_new();
+
 	if ((NULL == rawKey) || (NULL == rawSig) || (NULL == pubKey) ||
 	    (NULL == messageSignature) ||
 	    (BUFF_SIZE_64_BYTES != rawSigLength) ||
@@ -114,8 +135,7 @@ int32_t DERDecode(uint8_t *rawKey, uint8_t *rawSig, const unsigned char *pubKey,
 		goto err;
 	}
 
-	if ((NULL == bn_ctx) || (NULL == eckey) || (NULL == r) || (NULL == s) ||
-	    (NULL == sig)) {
+	if ((NULL == bn_ctx) || (NULL == eckey) || (NULL == sig)) {
 		ret = -1;
 		goto err;
 	}
@@ -180,7 +200,7 @@ err:
 		ECDSA_SIG_free(sig);
 	}
 	EC_KEY_free(eckey);
-	BN_CTX_free(bn_ctx);
+	bn_ctx_put(bn_ctx);
 	OPENSSL_free(local_raw_key);
 	return ret;
 }
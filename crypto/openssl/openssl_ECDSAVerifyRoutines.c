@@ -18,93 +18,225 @@
 #include "safe_lib.h"
 
 /**
- * Verify an ECC P-256/P-384 signature using provided ECDSA Public Keys.
+ * Decode an ECC P-256/P-384 public key into an EC_KEY.
  * @param keyEncoding - encoding typee.
  * @param keyAlgorithm - public key algorithm.
- * @param message - pointer of type uint8_t, holds the encoded message.
- * @param messageLength - size of message, type size_t.
- * @param messageSignature - pointer of type uint8_t, holds a valid
- *			ecdsa signature in big-endian format
- * @param signatureLength - size of signature, type unsigned int.
  * @param keyParam1 - pointer of type uint8_t, holds the public key.
  * @param keyParam1Length - size of public key, type size_t.
  * @param keyParam2 - not used.
  * @param keyParam2Length - not used
- * @return 0 if true, else -1.
-
+ * @param key - out, the EC_KEY, released with sdoCryptoSigKeyFree.
+ * @return 0 on success, else -1.
  */
-int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
-			   const uint8_t *message, uint32_t messageLength,
-			   const uint8_t *messageSignature,
-			   uint32_t signatureLength, const uint8_t *keyParam1,
-			   uint32_t keyParam1Length, const uint8_t *keyParam2,
-			   uint32_t keyParam2Length)
+int32_t sdoCryptoSigKeyLoad(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			    const uint8_t *keyParam1, uint32_t keyParam1Length,
+			    const uint8_t *keyParam2, uint32_t keyParam2Length,
+			    void **key)
 {
-	int32_t ret = -1;
 	EC_KEY *eckey = NULL;
-	uint8_t hash[SHA512_DIGEST_LENGTH] = {0};
-	size_t hashLength = 0;
 	const unsigned char *pubKey = (const unsigned char *)keyParam1;
 
+	(void)keyParam2;
+	(void)keyParam2Length;
+
 	/* Check validity of key type. */
-	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_X509 ||
+	if (!SDO_SUITE_KEY(keyEncoding, keyAlgorithm) ||
+	    keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_X509 ||
 	    (keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256 &&
 	     keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)) {
 		LOG(LOG_ERROR, "Incorrect key type\n");
-		goto end;
+		return -1;
 	}
 
-	if (NULL == pubKey || 0 == keyParam1Length ||
-	    NULL == messageSignature || 0 == signatureLength ||
-	    NULL == message || 0 == messageLength) {
+	if (NULL == pubKey || 0 == keyParam1Length || NULL == key) {
 		LOG(LOG_ERROR, "Invalid arguments!\n");
-		goto end;
+		return -1;
 	}
 
 	/* generate required EC_KEY based on type */
-	if (keyAlgorithm == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256) { // P-256 NIST
+	if (SDO_SUITE_ALG(keyAlgorithm) ==
+	    SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256) // P-256 NIST
 		eckey = EC_KEY_new_by_curve_name(NID_X9_62_prime256v1);
-		/* Perform SHA-256 digest of the message */
-		if (SHA256((const unsigned char *)message, messageLength,
-			   hash) == NULL) {
-			LOG(LOG_ERROR, "SHA-256 calculation failed!\n");
-			goto end;
-		}
-		hashLength = SHA256_DIGEST_LENGTH;
-
-	} else { // P-384
+	else // P-384
 		eckey = EC_KEY_new_by_curve_name(NID_secp384r1);
-		/* Perform SHA-384 digest of the message */
-		if (SHA384((const unsigned char *)message, messageLength,
-			   hash) == NULL) {
-			LOG(LOG_ERROR, "SHA-384 calculation failed!\n");
-			goto end;
-		}
-		hashLength = SHA384_DIGEST_LENGTH;
-	}
 
 	if (NULL == eckey) {
 		LOG(LOG_ERROR, "EC_KEY allocation failed!\n");
-		goto end;
+		return -1;
 	}
 
-	/* decode EC_KEY struct from DER encoded EC public key */
+	/* decode EC_KEY struct from DER encoded EC public key, which checks
+	 * that the point is on the curve */
 	if (d2i_EC_PUBKEY(&eckey, &pubKey, (long)keyParam1Length) == NULL) {
 		LOG(LOG_ERROR, "DER to EC_KEY struct decoding failed!\n");
-		goto end;
+		EC_KEY_free(eckey);
+		return -1;
 	}
+#if defined(SDO_SINGLE_SUITE)
+	/* checked once here, verifications take the curve of the suite */
+	if (EC_GROUP_get_curve_name(EC_KEY_get0_group(eckey)) !=
+	    (SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384
+		 ? NID_secp384r1
+		 : NID_X9_62_prime256v1)) {
+		LOG(LOG_ERROR, "EC public key not on the curve of the suite\n");
+		EC_KEY_free(eckey);
+		return -1;
+	}
+#endif
+
+	*key = eckey;
+	return 0;
+}
+
+/**
+ * Verify an ECC P-256/P-384 signature of a message digest with a key from
+ * sdoCryptoSigKeyLoad.
+ * @param key - EC_KEY to verify with.
+ * @param hash - pointer of type uint8_t, holds the digest of the message,
+ *		SHA-256 for P-256 and SHA-384 for P-384.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			ecdsa signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigestKey(void *key, const uint8_t *hash,
+				    uint32_t hashLength,
+				    const uint8_t *messageSignature,
+				    uint32_t signatureLength)
+{
+	EC_KEY *eckey = key;
+	uint32_t digestLength = SHA256_DIGEST_LENGTH;
+
+	if (NULL == eckey || NULL == messageSignature ||
+	    0 == signatureLength || NULL == hash) {
+		LOG(LOG_ERROR, "Invalid arguments!\n");
+		return -1;
+	}
+
+#if defined(SDO_SINGLE_SUITE)
+	/* the keys were loaded for the curve of the suite */
+	if (SDO_SUITE_PKALG == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384)
+#else
+	if (EC_GROUP_get_curve_name(EC_KEY_get0_group(eckey)) ==
+	    NID_secp384r1)
+#endif
+		digestLength = SHA384_DIGEST_LENGTH;
+	if (hashLength != digestLength)
+		return -1;
 
 	if (1 != ECDSA_verify(0, hash, hashLength, messageSignature,
 			      signatureLength, eckey)) {
 		LOG(LOG_ERROR, "ECDSA Sig verification failed\n");
-		goto end;
+		return -1;
 	}
 
-	ret = 0;
+	return 0;
+}
 
-end:
-	if (eckey)
-		EC_KEY_free(eckey);
+/**
+ * Release a key from sdoCryptoSigKeyLoad.
+ * @param key - in/out, the EC_KEY, set to NULL.
+ */
+void sdoCryptoSigKeyFree(void **key)
+{
+	if (!key || !*key)
+		return;
+	EC_KEY_free(*key);
+	*key = NULL;
+}
+
+/**
+ * Verify an ECC P-256/P-384 signature of a message digest using provided
+ * ECDSA Public Keys.
+ * @param keyEncoding - encoding typee.
+ * @param keyAlgorithm - public key algorithm.
+ * @param hash - pointer of type uint8_t, holds the digest of the message,
+ *		SHA-256 for P-256 and SHA-384 for P-384.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			ecdsa signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key.
+ * @param keyParam1Length - size of public key, type size_t.
+ * @param keyParam2 - not used.
+ * @param keyParam2Length - not used
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigest(uint8_t keyEncoding, uint8_t keyAlgorithm,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength,
+				 const uint8_t *keyParam1,
+				 uint32_t keyParam1Length,
+				 const uint8_t *keyParam2,
+				 uint32_t keyParam2Length)
+{
+	int32_t ret = -1;
+	void *key = NULL;
 
+	if (0 != sdoCryptoSigKeyLoad(keyEncoding, keyAlgorithm, keyParam1,
+				     keyParam1Length, keyParam2,
+				     keyParam2Length, &key))
+		return -1;
+
+	ret = sdoCryptoSigVerifyDigestKey(key, hash, hashLength,
+					  messageSignature, signatureLength);
+	sdoCryptoSigKeyFree(&key);
 	return ret;
 }
+
+/**
+ * Verify an ECC P-256/P-384 signature using provided ECDSA Public Keys.
+ * @param keyEncoding - encoding typee.
+ * @param keyAlgorithm - public key algorithm.
+ * @param message - pointer of type uint8_t, holds the encoded message.
+ * @param messageLength - size of message, type size_t.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			ecdsa signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key.
+ * @param keyParam1Length - size of public key, type size_t.
+ * @param keyParam2 - not used.
+ * @param keyParam2Length - not used
+ * @return 0 if true, else -1.
+
+ */
+int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			   const uint8_t *message, uint32_t messageLength,
+			   const uint8_t *messageSignature,
+			   uint32_t signatureLength, const uint8_t *keyParam1,
+			   uint32_t keyParam1Length, const uint8_t *keyParam2,
+			   uint32_t keyParam2Length)
+{
+	uint8_t hash[SHA512_DIGEST_LENGTH] = {0};
+	size_t hashLength = 0;
+
+	if (NULL == message || 0 == messageLength) {
+		LOG(LOG_ERROR, "Invalid arguments!\n");
+		return -1;
+	}
+
+	if (SDO_SUITE_ALG(keyAlgorithm) == SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384) {
+		/* Perform SHA-384 digest of the message */
+		if (SHA384((const unsigned char *)message, messageLength,
+			   hash) == NULL) {
+			LOG(LOG_ERROR, "SHA-384 calculation failed!\n");
+			return -1;
+		}
+		hashLength = SHA384_DIGEST_LENGTH;
+	} else {
+		/* Perform SHA-256 digest of the message */
+		if (SHA256((const unsigned char *)message, messageLength,
+			   hash) == NULL) {
+			LOG(LOG_ERROR, "SHA-256 calculation failed!\n");
+			return -1;
+		}
+		hashLength = SHA256_DIGEST_LENGTH;
+	}
+
+	return sdoCryptoSigVerifyDigest(
+	    keyEncoding, keyAlgorithm, hash, hashLength, messageSignature,
+	    signatureLength, keyParam1, keyParam1Length, keyParam2,
+	    keyParam2Length);
+}
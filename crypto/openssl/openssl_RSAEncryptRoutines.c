@@ -91,32 +91,15 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 		return -1;
 	}
 	BIGNUM *n = NULL;
-	BIGNUM *d = NULL;
 	BIGNUM *e = NULL;
-	BIGNUM *p = NULL;
-	BIGNUM *q = NULL;
-	BIGNUM *dmp1 = NULL;
-	BIGNUM *dmq1 = NULL;
-	BIGNUM *iqmp = NULL;
 
-	/* We need the RSA components non-NULL. */
+	/* We need the RSA components non-NULL, a public key has no others */
 	if (rsa == NULL) {
 		return -1;
 	} else if ((n = BN_new()) == NULL) {
 		return -1;
-	} else if ((d = BN_new()) == NULL) {
-		return -1;
 	} else if ((e = BN_new()) == NULL) {
-		return -1;
-	} else if ((p = BN_new()) == NULL) {
-		return -1;
-	} else if ((q = BN_new()) == NULL) {
-		return -1;
-	} else if ((dmp1 = BN_new()) == NULL) {
-		return -1;
-	} else if ((dmq1 = BN_new()) == NULL) {
-		return -1;
-	} else if ((iqmp = BN_new()) == NULL) {
+		BN_free(n);
 		return -1;
 	}
 
@@ -132,10 +115,11 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 		goto err;
 	}
 
-	if (0 == RSA_set0_key(rsa, n, e, d) ||
-	    0 == RSA_set0_factors(rsa, p, q) ||
-	    0 == RSA_set0_crt_params(rsa, dmp1, dmq1, iqmp))
+	if (0 == RSA_set0_key(rsa, n, e, NULL))
 		goto err;
+	/* rsa owns n and e from here */
+	n = NULL;
+	e = NULL;
 
 	if (!EVP_PKEY_set1_RSA(*out, rsa))
 		goto err;
@@ -143,91 +127,31 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 err:
 	// no null check here as lib has it
 	BN_clear_free(n);
-	BN_clear_free(d);
 	BN_clear_free(e);
-	BN_clear_free(p);
-	BN_clear_free(q);
-	BN_clear_free(dmp1);
-	BN_clear_free(dmq1);
-	BN_clear_free(iqmp);
 	return -1;
 }
 /**
- * sdoCryptoRSAEncrypt -  Encrypt the block passed using the public key
- * passed, the key must be RSA
- * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256)
- * @param keyEncoding - RSA Key encoding typee.
- * @param keyAlgorithm - RSA public key algorithm.
- * @param clearText - Input text to be encrypted.
- * @param clearTextLength - Plain text size in bytes.
- * @param cipherText - Encrypted text(output).
- * @param cipherTextLength - Encrypted text size in bytes.
- * @param keyParam1 - pointer of type uint8_t, holds the public key1.
- * @param keyParam1Length - size of public key1, type size_t.
- * @param keyParam2 - pointer of type uint8_t,holds the public key2.
- * @param keyParam2Length - size of public key2, type size_t
- * @return ret
- *        return 0 on success. -1 on failure.
- *        return cypherLength in bytes while cipherText passed as NULL, & all
- *        other parameters are passed as it is.
+ * Internal API: encrypt with an RSA key and the EVP_PKEY holding it.
+ * Parameters and return as for sdoCryptoRSAEncrypt.
  */
-int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
-			    uint8_t keyAlgorithm, const uint8_t *clearText,
-			    uint32_t clearTextLength, uint8_t *cipherText,
-			    uint32_t cipherTextLength, const uint8_t *keyParam1,
-			    uint32_t keyParam1Length, const uint8_t *keyParam2,
-			    uint32_t keyParam2Length)
+static int32_t rsaEncryptPkey(uint8_t hashType, RSA *rkey, EVP_PKEY *pkey,
+			      const uint8_t *clearText,
+			      uint32_t clearTextLength, uint8_t *cipherText,
+			      uint32_t cipherTextLength)
 {
 	EVP_PKEY_CTX *ctx = NULL;
-	EVP_PKEY *pkey = NULL;
 	static const EVP_MD *evp_md;
-	RSA *rkey = NULL; /* The pubkey is converted to this RSA public key. */
-
 	unsigned char *out = NULL;
 	size_t outlen = 0;
 	uint32_t cipherCalLength = 0;
 	int ret = 0;
 
-	LOG(LOG_DEBUG, "rsa_encrypt starting.\n");
-
-	/* Make sure we have a correct type of key. */
-	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP ||
-	    keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_RSA) {
-		LOG(LOG_ERROR, "Incorrect key type.\n");
-		return -1;
-	}
-
-	if (NULL == clearText || 0 == clearTextLength) {
-		LOG(LOG_ERROR, "Incorrect input text.\n");
-		return -1;
-	}
-	if (keyParam1 == NULL || keyParam1Length == 0) {
-		LOG(LOG_ERROR, "Missing Key1.\n");
-		return -1;
-	}
-	if (keyParam2 == NULL || keyParam2Length == 0) {
-		LOG(LOG_ERROR, "Missing Key2.\n");
-		return -1;
-	}
-
-	/* Convert the representation to an RSA key. */
-	if (convert2pkey(&pkey, &rkey, keyParam1, keyParam1Length, keyParam2,
-			 keyParam2Length) != 0) {
-		LOG(LOG_ERROR,
-		    "Cannot convert public key to OpenSSL EVP_PKEY.\n ");
-		return -1;
-	}
-
-	LOG(LOG_DEBUG, "Public key converted to rkey & pkey.\n");
 	if (rkey)
 		cipherCalLength = RSA_size(rkey);
 
 	/* send back required cipher budffer size */
-	if (cipherText == NULL) {
-		RSA_free(rkey);
-		EVP_PKEY_free(pkey);
+	if (cipherText == NULL)
 		return cipherCalLength;
-	}
 
 	/*When caller sends cipher buffer */
 	if (cipherCalLength > cipherTextLength)
@@ -312,16 +236,120 @@ int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
 error:
 	if (ctx)
 		EVP_PKEY_CTX_free(ctx);
-	if (pkey)
-		EVP_PKEY_free(pkey);
 	if (out)
 		OPENSSL_free(out);
-	if (rkey)
-		RSA_free(rkey);
 
 	return ret;
 }
 
+/**
+ * sdoCryptoRSAEncrypt -  Encrypt the block passed using the public key
+ * passed, the key must be RSA
+ * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256)
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param clearText - Input text to be encrypted.
+ * @param clearTextLength - Plain text size in bytes.
+ * @param cipherText - Encrypted text(output).
+ * @param cipherTextLength - Encrypted text size in bytes.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ *        return cypherLength in bytes while cipherText passed as NULL, & all
+ *        other parameters are passed as it is.
+ */
+int32_t sdoCryptoRSAEncrypt(uint8_t hashType, uint8_t keyEncoding,
+			    uint8_t keyAlgorithm, const uint8_t *clearText,
+			    uint32_t clearTextLength, uint8_t *cipherText,
+			    uint32_t cipherTextLength, const uint8_t *keyParam1,
+			    uint32_t keyParam1Length, const uint8_t *keyParam2,
+			    uint32_t keyParam2Length)
+{
+	EVP_PKEY *pkey = NULL;
+	RSA *rkey = NULL; /* The pubkey is converted to this RSA public key. */
+	int32_t ret;
+
+	LOG(LOG_DEBUG, "rsa_encrypt starting.\n");
+
+	/* Make sure we have a correct type of key. */
+	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP ||
+	    keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_RSA) {
+		LOG(LOG_ERROR, "Incorrect key type.\n");
+		return -1;
+	}
+
+	if (NULL == clearText || 0 == clearTextLength) {
+		LOG(LOG_ERROR, "Incorrect input text.\n");
+		return -1;
+	}
+	if (keyParam1 == NULL || keyParam1Length == 0) {
+		LOG(LOG_ERROR, "Missing Key1.\n");
+		return -1;
+	}
+	if (keyParam2 == NULL || keyParam2Length == 0) {
+		LOG(LOG_ERROR, "Missing Key2.\n");
+		return -1;
+	}
+
+	/* Convert the representation to an RSA key. */
+	if (convert2pkey(&pkey, &rkey, keyParam1, keyParam1Length, keyParam2,
+			 keyParam2Length) != 0) {
+		LOG(LOG_ERROR,
+		    "Cannot convert public key to OpenSSL EVP_PKEY.\n ");
+		return -1;
+	}
+
+	LOG(LOG_DEBUG, "Public key converted to rkey & pkey.\n");
+	ret = rsaEncryptPkey(hashType, rkey, pkey, clearText, clearTextLength,
+			     cipherText, cipherTextLength);
+	EVP_PKEY_free(pkey);
+	RSA_free(rkey);
+	return ret;
+}
+
+/**
+ * sdoCryptoRSAEncryptKey -  Encrypt the block passed with a key from
+ * sdoCryptoSigKeyLoad, so that the RSA object of a key already read for
+ * verification, with its Montgomery context, is used as it is.
+ * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256)
+ * @param key - RSA object from sdoCryptoSigKeyLoad.
+ * @param clearText - Input text to be encrypted.
+ * @param clearTextLength - Plain text size in bytes.
+ * @param cipherText - Encrypted text(output).
+ * @param cipherTextLength - Encrypted text size in bytes.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ *        return cypherLength in bytes while cipherText passed as NULL.
+ */
+int32_t sdoCryptoRSAEncryptKey(uint8_t hashType, void *key,
+			       const uint8_t *clearText,
+			       uint32_t clearTextLength, uint8_t *cipherText,
+			       uint32_t cipherTextLength)
+{
+	EVP_PKEY *pkey = NULL;
+	int32_t ret = -1;
+
+	if (NULL == key || NULL == clearText || 0 == clearTextLength) {
+		LOG(LOG_ERROR, "Incorrect input text.\n");
+		return -1;
+	}
+
+	pkey = EVP_PKEY_new();
+	if (!pkey || !EVP_PKEY_set1_RSA(pkey, key)) {
+		LOG(LOG_ERROR, "Cannot wrap the RSA key in an EVP_PKEY.\n");
+		goto end;
+	}
+	ret = rsaEncryptPkey(hashType, key, pkey, clearText, clearTextLength,
+			     cipherText, cipherTextLength);
+end:
+	if (pkey)
+		EVP_PKEY_free(pkey);
+	return ret;
+}
+
 /**
  * sdoCryptoRSALen - Returns the cipher length
  * @param keyParam1 - pointer of type uint8_t, holds the public key1.
@@ -90,32 +90,15 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 	}
 
 	BIGNUM *n = NULL;
-	BIGNUM *d = NULL;
 	BIGNUM *e = NULL;
-	BIGNUM *p = NULL;
-	BIGNUM *q = NULL;
-	BIGNUM *dmp1 = NULL;
-	BIGNUM *dmq1 = NULL;
-	BIGNUM *iqmp = NULL;
 
-	/* We need the RSA components non-NULL. */
+	/* We need the RSA components non-NULL, a public key has no others */
 	if (rsa == NULL) {
 		return -1;
 	} else if ((n = BN_new()) == NULL) {
 		return -1;
-	} else if ((d = BN_new()) == NULL) {
-		return -1;
 	} else if ((e = BN_new()) == NULL) {
-		return -1;
-	} else if ((p = BN_new()) == NULL) {
-		return -1;
-	} else if ((q = BN_new()) == NULL) {
-		return -1;
-	} else if ((dmp1 = BN_new()) == NULL) {
-		return -1;
-	} else if ((dmq1 = BN_new()) == NULL) {
-		return -1;
-	} else if ((iqmp = BN_new()) == NULL) {
+		BN_free(n);
 		return -1;
 	}
 
@@ -131,10 +114,11 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 		goto err;
 	}
 
-	if (0 == RSA_set0_key(rsa, n, e, d) ||
-	    0 == RSA_set0_factors(rsa, p, q) ||
-	    0 == RSA_set0_crt_params(rsa, dmp1, dmq1, iqmp))
+	if (0 == RSA_set0_key(rsa, n, e, NULL))
 		goto err;
+	/* rsa owns n and e from here */
+	n = NULL;
+	e = NULL;
 
 	if (!EVP_PKEY_set1_RSA(*out, rsa))
 		goto err;
@@ -143,55 +127,40 @@ static int convert2pkey(EVP_PKEY **out, RSA **rsa_in, const uint8_t *key1,
 err:
 	// no null check here as lib has it
 	BN_clear_free(n);
-	BN_clear_free(d);
 	BN_clear_free(e);
-	BN_clear_free(p);
-	BN_clear_free(q);
-	BN_clear_free(dmp1);
-	BN_clear_free(dmq1);
-	BN_clear_free(iqmp);
 	return -1;
 }
 
 /**
- * sdoCryptoRSAVerify
- * Verify an RSA PKCS v1.5 Signature using provided public key
+ * Decode an RSA public key into an RSA object, which keeps the Montgomery
+ * context of its modulus once it has been used.
  * @param keyEncoding - RSA Key encoding typee.
  * @param keyAlgorithm - RSA public key algorithm.
- * @param message - pointer of type uint8_t, holds the encoded message.
- * @param messageLength - size of message, type size_t.
- * @param messageSignature - pointer of type uint8_t, holds a valid
- *			PKCS v1.5 signature in big-endian format
- * @param signatureLength - size of signature, type unsigned int.
  * @param keyParam1 - pointer of type uint8_t, holds the public key1.
  * @param keyParam1Length - size of public key1, type size_t.
  * @param keyParam2 - pointer of type uint8_t,holds the public key2.
  * @param keyParam2Length - size of public key2, type size_t
- * @return 0 if true, else -1.
+ * @param key - out, the RSA object, released with sdoCryptoSigKeyFree.
+ * @return 0 on success, else -1.
  */
-int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
-			   const uint8_t *message, uint32_t messageLength,
-			   const uint8_t *messageSignature,
-			   uint32_t signatureLength, const uint8_t *keyParam1,
-			   uint32_t keyParam1Length, const uint8_t *keyParam2,
-			   uint32_t keyParam2Length)
+int32_t sdoCryptoSigKeyLoad(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			    const uint8_t *keyParam1, uint32_t keyParam1Length,
+			    const uint8_t *keyParam2, uint32_t keyParam2Length,
+			    void **key)
 {
-	int ret = 0;
+	int32_t ret = -1;
 	RSA *rsa = NULL;
 	EVP_PKEY *pkey = NULL;
-	uint8_t *hash = NULL;
 
 	/* Make sure we have a valid key type. */
 	if (keyEncoding != SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP ||
 	    keyAlgorithm != SDO_CRYPTO_PUB_KEY_ALGO_RSA) {
 		LOG(LOG_ERROR, "Incorrect key type.\n");
-		ret = -1;
-		goto end;
+		return -1;
 	}
 
 	if (NULL == keyParam1 || 0 == keyParam1Length || NULL == keyParam2 ||
-	    0 == keyParam2Length || NULL == messageSignature ||
-	    0 == signatureLength || NULL == message || 0 == messageLength) {
+	    0 == keyParam2Length || NULL == key) {
 		LOG(LOG_ERROR, "Incorrect key type\n");
 		return -1;
 	}
@@ -200,47 +169,152 @@ int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
 			 keyParam2Length) != 0) {
 		LOG(LOG_ERROR, "Cannot convert public key to OpenSSL "
 			       "EVP_PKEY.\n ");
-		ret = -1;
 		goto end;
 	}
 
+	*key = rsa;
+	rsa = NULL;
+	ret = 0;
+end:
+	if (rsa)
+		RSA_free(rsa);
+	if (pkey)
+		EVP_PKEY_free(pkey);
+	return ret;
+}
+
+/**
+ * Verify an RSA PKCS v1.5 Signature of a SHA-256 message digest with a key
+ * from sdoCryptoSigKeyLoad.
+ * @param key - RSA object to verify with.
+ * @param hash - pointer of type uint8_t, holds the SHA-256 digest of the
+ *		message.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigestKey(void *key, const uint8_t *hash,
+				    uint32_t hashLength,
+				    const uint8_t *messageSignature,
+				    uint32_t signatureLength)
+{
+	RSA *rsa = key;
+
+	if (NULL == rsa || NULL == messageSignature || 0 == signatureLength ||
+	    NULL == hash || SHA256_DIGEST_LENGTH != hashLength) {
+		LOG(LOG_ERROR, "Incorrect key type\n");
+		return -1;
+	}
+
 	/* Verify that the signature is appropriate length for the
 	 * modulus of RSA key */
 	if (signatureLength != (unsigned int)RSA_size(rsa)) {
 		LOG(LOG_ERROR, "Wrong size signature\n");
 		RSAerr(RSA_F_RSA_VERIFY_ASN1_OCTET_STRING,
 		       RSA_R_WRONG_SIGNATURE_LENGTH);
-		ret = -1;
-		goto end;
-	}
-
-	/* Perform SHA-256 digest of the message */
-	hash =
-	    (unsigned char *)OPENSSL_malloc((unsigned int)SHA256_DIGEST_LENGTH);
-	if (NULL == hash) {
-		ret = -1;
-		goto end;
-	}
-	if (SHA256((const unsigned char *)message, messageLength, hash) ==
-	    NULL) {
-		ret = -1;
-		goto end;
+		return -1;
 	}
 
 	if (1 != RSA_verify(NID_sha256, hash, SHA256_DIGEST_LENGTH,
-			    messageSignature, signatureLength, rsa)) {
-		ret = -1;
-	}
-end:
+			    messageSignature, signatureLength, rsa))
+		return -1;
+	return 0;
+}
 
-	if (hash != NULL) {
-		OPENSSL_cleanse(hash, (unsigned int)SHA256_DIGEST_LENGTH);
-		OPENSSL_free(hash);
+/**
+ * Release a key from sdoCryptoSigKeyLoad.
+ * @param key - in/out, the RSA object, set to NULL.
+ */
+void sdoCryptoSigKeyFree(void **key)
+{
+	if (!key || !*key)
+		return;
+	RSA_free(*key);
+	*key = NULL;
+}
+
+/**
+ * Verify an RSA PKCS v1.5 Signature of a SHA-256 message digest using
+ * provided public key.
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param hash - pointer of type uint8_t, holds the SHA-256 digest of the
+ *		message.
+ * @param hashLength - size of hash.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerifyDigest(uint8_t keyEncoding, uint8_t keyAlgorithm,
+				 const uint8_t *hash, uint32_t hashLength,
+				 const uint8_t *messageSignature,
+				 uint32_t signatureLength,
+				 const uint8_t *keyParam1,
+				 uint32_t keyParam1Length,
+				 const uint8_t *keyParam2,
+				 uint32_t keyParam2Length)
+{
+	int32_t ret = -1;
+	void *key = NULL;
+
+	if (0 != sdoCryptoSigKeyLoad(keyEncoding, keyAlgorithm, keyParam1,
+				     keyParam1Length, keyParam2,
+				     keyParam2Length, &key))
+		return -1;
+
+	ret = sdoCryptoSigVerifyDigestKey(key, hash, hashLength,
+					  messageSignature, signatureLength);
+	sdoCryptoSigKeyFree(&key);
+	return ret;
+}
+
+/**
+ * Verify an RSA PKCS v1.5 Signature using provided public key.
+ * @param keyEncoding - RSA Key encoding typee.
+ * @param keyAlgorithm - RSA public key algorithm.
+ * @param message - pointer of type uint8_t, holds the encoded message.
+ * @param messageLength - size of message, type size_t.
+ * @param messageSignature - pointer of type uint8_t, holds a valid
+ *			PKCS v1.5 signature in big-endian format
+ * @param signatureLength - size of signature, type unsigned int.
+ * @param keyParam1 - pointer of type uint8_t, holds the public key1.
+ * @param keyParam1Length - size of public key1, type size_t.
+ * @param keyParam2 - pointer of type uint8_t,holds the public key2.
+ * @param keyParam2Length - size of public key2, type size_t
+ * @return 0 if true, else -1.
+ */
+int32_t sdoCryptoSigVerify(uint8_t keyEncoding, uint8_t keyAlgorithm,
+			   const uint8_t *message, uint32_t messageLength,
+			   const uint8_t *messageSignature,
+			   uint32_t signatureLength, const uint8_t *keyParam1,
+			   uint32_t keyParam1Length, const uint8_t *keyParam2,
+			   uint32_t keyParam2Length)
+{
+	int ret;
+	uint8_t hash[SHA256_DIGEST_LENGTH];
+
+	if (NULL == message || 0 == messageLength) {
+		LOG(LOG_ERROR, "Incorrect key type\n");
+		return -1;
 	}
-	if (rsa)
-		RSA_free(rsa);
-	if (pkey)
-		EVP_PKEY_free(pkey);
 
+	/* Perform SHA-256 digest of the message */
+	if (SHA256((const unsigned char *)message, messageLength, hash) ==
+	    NULL)
+		return -1;
+
+	ret = sdoCryptoSigVerifyDigest(keyEncoding, keyAlgorithm, hash,
+				       sizeof(hash), messageSignature,
+				       signatureLength, keyParam1,
+				       keyParam1Length, keyParam2,
+				       keyParam2Length);
+	OPENSSL_cleanse(hash, sizeof(hash));
 	return ret;
 }
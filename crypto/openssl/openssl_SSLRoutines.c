@@ -14,41 +14,379 @@
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/conf.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "safe_lib.h"
+#include "snprintf_s.h"
+#ifdef TLS_SESSION_BLOB
+#include "storage_al.h"
+#endif
 
+#ifndef TLS_SESSION_CACHE_FALSE
+/* Number of servers (RV, owner ...) whose TLS session is remembered */
+#define TLS_SESSION_CACHE_SIZE 4
+/* "ip:port" of the server, for ex: 255.255.255.255:65535 */
+#define TLS_SESSION_KEY_LEN (INET6_ADDRSTRLEN + 8)
+/* Upper bound on a DER encoded session (incl. session ticket) */
+#define TLS_SESSION_MAX_DER 4096
+
+/*
+ * TLS session cache. Sessions of previous connections are kept per server,
+ * so that a reconnect (within a protocol, or when TO1/TO2 is retried) does
+ * an abbreviated handshake instead of a full one.
+ */
+typedef struct {
+	char key[TLS_SESSION_KEY_LEN];
+	SSL_SESSION *session;
+} tlsSessionEntry_t;
+
+static SDO_THREAD_LOCAL tlsSessionEntry_t sessionCache[TLS_SESSION_CACHE_SIZE];
+static SDO_THREAD_LOCAL unsigned int sessionCacheNext;
+#ifdef TLS_SESSION_BLOB
+static SDO_THREAD_LOCAL bool sessionCacheLoaded;
+#endif
+#endif
+
+/* SSL context is shared by all connections, of all instances */
+static SSL_CTX *ssl_ctx;
+SDO_MUTEX(ssl_ctx_lock);
+
+#ifndef TLS_SESSION_CACHE_FALSE
 /**
- * Set up a SSL/TLS connection bound to socket fd passed to the API.
+ * Internal API: build the session cache key of the peer of the socket.
  *
- * @param sock
- *        Socket fd to bind the TLS/SSL connection to.
- * @return ssl
- *        return pointer to ssl structure on success. NULL on failure.
+ * @param sock - connected socket.
+ * @param peerAddr - address of the peer, NULL to ask the socket. A socket
+ * of TCP Fast Open has no peer until the server answers its SYN.
+ * @param key - out buffer of TLS_SESSION_KEY_LEN bytes.
+ * @return true on success, false otherwise.
+ */
+static bool tlsSessionKey(int sock, const struct sockaddr *peerAddr,
+			  char *key)
+{
+	struct sockaddr_storage peer;
+	socklen_t len = sizeof(peer);
+	char ip[INET6_ADDRSTRLEN] = {0};
+	const void *addr;
+	int port;
+
+	if (peerAddr) {
+		len = peerAddr->sa_family == AF_INET6
+			  ? sizeof(struct sockaddr_in6)
+			  : sizeof(struct sockaddr_in);
+		if (memcpy_s(&peer, sizeof(peer), peerAddr, len) != 0)
+			return false;
+	} else if (getpeername(sock, (struct sockaddr *)&peer, &len) != 0) {
+		return false;
+	}
+
+	if (peer.ss_family == AF_INET) {
+		addr = &((struct sockaddr_in *)&peer)->sin_addr;
+		port = ntohs(((struct sockaddr_in *)&peer)->sin_port);
+	} else if (peer.ss_family == AF_INET6) {
+		addr = &((struct sockaddr_in6 *)&peer)->sin6_addr;
+		port = ntohs(((struct sockaddr_in6 *)&peer)->sin6_port);
+	} else {
+		return false;
+	}
+
+	if (!inet_ntop(peer.ss_family, addr, ip, sizeof(ip)))
+		return false;
+
+	if (snprintf_s_si(key, TLS_SESSION_KEY_LEN, "%s:%d", ip, port) < 0)
+		return false;
+
+	return true;
+}
+
+/**
+ * Internal API: find the cache entry of a server.
+ *
+ * @param key - session cache key of the server.
+ * @return entry on success, NULL if the server is not cached.
+ */
+static tlsSessionEntry_t *tlsSessionFind(const char *key)
+{
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+		if (!sessionCache[i].session)
+			continue;
+		if (strcmp_s(sessionCache[i].key, TLS_SESSION_KEY_LEN, key,
+			     &res) == 0 &&
+		    res == 0)
+			return &sessionCache[i];
+	}
+	return NULL;
+}
+
+#ifdef TLS_SESSION_BLOB
+/**
+ * Internal API: save the session cache to secure storage. Every entry is
+ * stored as key, 2 bytes of DER length and the DER encoded session.
+ */
+static void tlsSessionSave(void)
+{
+	uint8_t *buf = NULL, *p;
+	size_t len = 0, keylen;
+	unsigned int i;
+	int derlen;
+
+	buf = sdoAlloc(TLS_SESSION_CACHE_SIZE *
+		       (TLS_SESSION_KEY_LEN + 2 + TLS_SESSION_MAX_DER));
+	if (!buf) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return;
+	}
+
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+		if (!sessionCache[i].session)
+			continue;
+		derlen = i2d_SSL_SESSION(sessionCache[i].session, NULL);
+		if (derlen <= 0 || derlen > TLS_SESSION_MAX_DER)
+			continue;
+
+		keylen = strnlen_s(sessionCache[i].key, TLS_SESSION_KEY_LEN);
+		if (memcpy_s(&buf[len], TLS_SESSION_KEY_LEN,
+			     sessionCache[i].key, keylen) != 0)
+			goto end;
+		len += TLS_SESSION_KEY_LEN;
+
+		buf[len++] = (derlen >> 8) & 0xff;
+		buf[len++] = derlen & 0xff;
+		p = &buf[len];
+		len += i2d_SSL_SESSION(sessionCache[i].session, &p);
+	}
+
+	if (sdoBlobWrite((char *)TLS_SESSION_BLOB, SDO_SDK_SECURE_DATA, buf,
+			 len) == -1)
+		LOG(LOG_DEBUG, "TLS session blob not written\n");
+end:
+	sdoFree(buf);
+}
+
+/**
+ * Internal API: load the session cache from secure storage, if present.
+ */
+static void tlsSessionLoad(void)
+{
+	uint8_t *buf = NULL;
+	const uint8_t *p;
+	int32_t size;
+	size_t len = 0, derlen;
+	unsigned int i = 0;
+
+	if (sessionCacheLoaded)
+		return;
+	sessionCacheLoaded = true;
+
+	size = sdoBlobSize((char *)TLS_SESSION_BLOB, SDO_SDK_SECURE_DATA);
+	if (size <= 0)
+		return;
+
+	buf = sdoAlloc(size);
+	if (!buf) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return;
+	}
+
+	if (sdoBlobRead((char *)TLS_SESSION_BLOB, SDO_SDK_SECURE_DATA, buf,
+			size) == -1)
+		goto end;
+
+	while (i < TLS_SESSION_CACHE_SIZE &&
+	       len + TLS_SESSION_KEY_LEN + 2 <= (size_t)size) {
+		if (memcpy_s(sessionCache[i].key, TLS_SESSION_KEY_LEN,
+			     &buf[len], TLS_SESSION_KEY_LEN) != 0)
+			goto end;
+		sessionCache[i].key[TLS_SESSION_KEY_LEN - 1] = 0;
+		len += TLS_SESSION_KEY_LEN;
+
+		derlen = (buf[len] << 8) | buf[len + 1];
+		len += 2;
+		if (len + derlen > (size_t)size)
+			break;
+
+		p = &buf[len];
+		sessionCache[i].session = d2i_SSL_SESSION(NULL, &p, derlen);
+		len += derlen;
+		if (sessionCache[i].session)
+			i++;
+	}
+	sessionCacheNext = i % TLS_SESSION_CACHE_SIZE;
+	LOG(LOG_DEBUG, "Loaded %u TLS session(s)\n", i);
+end:
+	sdoFree(buf);
+}
+#endif
+
+/**
+ * Internal API: remember the session of a connection for later resumption.
+ *
+ * @param ssl - TLS/SSL connection about to be closed.
  */
-void *sdo_ssl_setup(int sock)
+static void tlsSessionStore(SSL *ssl)
+{
+	char key[TLS_SESSION_KEY_LEN] = {0};
+	tlsSessionEntry_t *entry;
+	SSL_SESSION *session;
+
+	if (!tlsSessionKey(SSL_get_fd(ssl), NULL, key))
+		return;
+
+	entry = tlsSessionFind(key);
+	session = SSL_get1_session(ssl);
+
+	if (!session || !SSL_SESSION_is_resumable(session)) {
+		/* server does not allow resumption, forget about it */
+		if (session)
+			SSL_SESSION_free(session);
+		if (entry) {
+			SSL_SESSION_free(entry->session);
+			entry->session = NULL;
+		}
+		return;
+	}
+
+	if (entry && entry->session == session) {
+		/* the cached session was resumed, nothing has changed */
+		SSL_SESSION_free(session);
+		return;
+	}
+
+	if (!entry) {
+		entry = &sessionCache[sessionCacheNext];
+		sessionCacheNext =
+		    (sessionCacheNext + 1) % TLS_SESSION_CACHE_SIZE;
+		if (strcpy_s(entry->key, TLS_SESSION_KEY_LEN, key) != 0) {
+			SSL_SESSION_free(session);
+			return;
+		}
+	}
+	if (entry->session)
+		SSL_SESSION_free(entry->session);
+	entry->session = session;
+
+#ifdef TLS_SESSION_BLOB
+	tlsSessionSave();
+#endif
+}
+#endif
+
+/**
+ * Internal API: the SSL context shared by all connections, created on first
+ * use.
+ *
+ * @return context on success, NULL on failure.
+ */
+static SSL_CTX *tlsContextGet(void)
 {
 	SSL_CTX *ctx = NULL;
-	SSL *ssl = NULL;
 	const SSL_METHOD *method;
 	const long flags =
 	    SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_NO_COMPRESSION;
 	const char *const PREFERRED_CIPHERS =
 	    "HIGH:!aNULL:!NULL:!EXT:!DSS:!kRSA:!PSK:!SRP:!MD5:!RC4";
+
+	SDO_LOCK(ssl_ctx_lock);
+	if (ssl_ctx)
+		goto end;
+
 	SSL_library_init();
 	OpenSSL_add_all_algorithms();
 
 	SSL_load_error_strings();
 	method = SSLv23_method();
 	if (!(NULL != method))
-		goto err;
+		goto end;
 
 	ctx = SSL_CTX_new(method);
 	if (!(ctx != NULL))
-		goto err;
+		goto end;
 
 	SSL_CTX_set_options(ctx, flags);
 	if (0 == SSL_CTX_set_cipher_list(ctx, PREFERRED_CIPHERS)) {
 		LOG(LOG_ERROR, "SSL cipher suite set failed");
-		goto err;
+		SSL_CTX_free(ctx);
+		goto end;
+	}
+#ifdef HTTP2
+	/* HTTP/2 if the server speaks it, HTTP/1.1 otherwise */
+	if (0 != SSL_CTX_set_alpn_protos(
+		     ctx, (const unsigned char *)"\x02h2\x08http/1.1", 12)) {
+		LOG(LOG_ERROR, "SSL ALPN set failed\n");
+		SSL_CTX_free(ctx);
+		goto end;
+	}
+#endif
+	ssl_ctx = ctx;
+end:
+	ctx = ssl_ctx;
+	SDO_UNLOCK(ssl_ctx_lock);
+	return ctx;
+}
+
+/**
+ * Free the shared SSL context. Connections must be closed before.
+ */
+void sdo_ssl_context_free(void)
+{
+	SDO_LOCK(ssl_ctx_lock);
+	if (ssl_ctx) {
+		SSL_CTX_free(ssl_ctx);
+		ssl_ctx = NULL;
+	}
+	SDO_UNLOCK(ssl_ctx_lock);
+}
+
+/**
+ * Free the TLS sessions cached by the calling thread, wiping their entries,
+ * as an instance is destroyed or a run shuts down. With TLS_SESSION_BLOB,
+ * the next connection loads them again from storage.
+ */
+void sdo_ssl_session_cache_clear(void)
+{
+#ifndef TLS_SESSION_CACHE_FALSE
+	unsigned int i;
+
+	/* SSL_SESSION_free cleanses the master key of the last reference */
+	for (i = 0; i < TLS_SESSION_CACHE_SIZE; i++) {
+		if (sessionCache[i].session)
+			SSL_SESSION_free(sessionCache[i].session);
 	}
+	(void)memset_s(sessionCache, sizeof(sessionCache), 0);
+	sessionCacheNext = 0;
+#ifdef TLS_SESSION_BLOB
+	sessionCacheLoaded = false;
+#endif
+#endif
+}
+
+/**
+ * Set up a SSL/TLS connection bound to socket fd passed to the API.
+ *
+ * @param sock
+ *        Socket fd to bind the TLS/SSL connection to.
+ * @param peer
+ *        Address of the server, to find its session, NULL to ask sock.
+ * @return ssl
+ *        return pointer to ssl structure on success. NULL on failure.
+ */
+void *sdo_ssl_setup(int sock, const struct sockaddr *peer)
+{
+	SSL_CTX *ctx = tlsContextGet();
+	SSL *ssl = NULL;
+#ifndef TLS_SESSION_CACHE_FALSE
+	char key[TLS_SESSION_KEY_LEN] = {0};
+	tlsSessionEntry_t *entry;
+#else
+	(void)peer;
+#endif
+
+	if (!ctx)
+		return NULL;
 
 	ssl = SSL_new(ctx);
 	if (ssl == NULL)
@@ -56,6 +394,18 @@ void *sdo_ssl_setup(int sock)
 	if (0 == SSL_set_fd(ssl, sock))
 		goto err;
 
+#ifndef TLS_SESSION_CACHE_FALSE
+#ifdef TLS_SESSION_BLOB
+	tlsSessionLoad();
+#endif
+	/* offer the previous session of this server for resumption */
+	if (tlsSessionKey(sock, peer, key)) {
+		entry = tlsSessionFind(key);
+		if (entry && 0 == SSL_set_session(ssl, entry->session))
+			LOG(LOG_DEBUG, "TLS session not set\n");
+	}
+#endif
+
 	return (void *)ssl;
 err:
 	if (ssl)
@@ -73,7 +423,22 @@ err:
  */
 int sdo_ssl_connect(void *ssl)
 {
-	int ret = SSL_connect((SSL *)ssl);
+	int ret;
+
+#ifdef TLS_EARLY_DATA
+	SSL_SESSION *session = SSL_get0_session((SSL *)ssl);
+
+	/*
+	 * The server takes early data in the resumed session: the handshake
+	 * is left to the first write, to carry it (sdo_ssl_write_early) or
+	 * to run before it.
+	 */
+	if (session && SSL_SESSION_get_max_early_data(session) > 0) {
+		SSL_set_connect_state((SSL *)ssl);
+		return 0;
+	}
+#endif
+	ret = SSL_connect((SSL *)ssl);
 
 	if (ret <= 0) {
 		LOG(LOG_ERROR, "SSL Connection error: %d, errno: %lu\n",
@@ -81,11 +446,86 @@ int sdo_ssl_connect(void *ssl)
 		return -1;
 	}
 
-	LOG(LOG_DEBUG, "ssl connection successful\n");
+	LOG(LOG_DEBUG, "ssl connection successful%s\n",
+	    SSL_session_reused((SSL *)ssl) ? " (session resumed)" : "");
 
 	return 0;
 }
 
+#ifdef HTTP2
+/**
+ * Tell whether the TLS handshake has agreed on HTTP/2 (ALPN "h2").
+ *
+ * @param ssl
+ *        ssl handle containing the TLS/SSL connection context.
+ * @return
+ *        return true for HTTP/2, false for HTTP/1.1.
+ */
+bool sdo_ssl_alpn_h2(void *ssl)
+{
+	const unsigned char *proto = NULL;
+	unsigned int len = 0;
+
+	SSL_get0_alpn_selected((SSL *)ssl, &proto, &len);
+	return len == 2 && proto[0] == 'h' && proto[1] == '2';
+}
+#endif
+
+#ifdef TLS_EARLY_DATA
+/**
+ * Send the first bytes of a connection as TLS 1.3 early data (0-RTT), with
+ * the ClientHello of its resumed session, then complete the handshake. If
+ * the server rejects them, they are sent again after the handshake. As the
+ * early data can be replayed, buf must be a request that the server can
+ * take twice.
+ *
+ * @param ssl
+ *        ssl handle containing the TLS/SSL connection context.
+ * @param buf
+ *        Buffer containing data to be transmitted over TLS/SSL context.
+ * @param num
+ *        Length of data to be transmitted.
+ * @return ret
+ *        return no of byte on success. <=0 on failure.
+ */
+int sdo_ssl_write_early(void *ssl, const void *buf, int num)
+{
+	SSL_SESSION *session = SSL_get0_session((SSL *)ssl);
+	size_t written = 0, n;
+	int ret;
+
+	if (num <= 0 || SSL_is_init_finished((SSL *)ssl) || !session ||
+	    SSL_SESSION_get_max_early_data(session) < (uint32_t)num)
+		return sdo_ssl_write(ssl, buf, num);
+
+	while (written < (size_t)num) {
+		if (!SSL_write_early_data((SSL *)ssl,
+					  (const uint8_t *)buf + written,
+					  num - written, &n)) {
+			LOG(LOG_ERROR, "SSL early data write error: %lu\n",
+			    ERR_get_error());
+			return -1;
+		}
+		written += n;
+	}
+
+	ret = SSL_connect((SSL *)ssl);
+	if (ret <= 0) {
+		LOG(LOG_ERROR, "SSL Connection error: %d, errno: %lu\n",
+		    SSL_get_error((SSL *)ssl, ret), ERR_get_error());
+		return -1;
+	}
+
+	if (SSL_get_early_data_status((SSL *)ssl) != SSL_EARLY_DATA_ACCEPTED) {
+		LOG(LOG_DEBUG, "TLS early data rejected, sent again\n");
+		return sdo_ssl_write(ssl, buf, num);
+	}
+
+	LOG(LOG_DEBUG, "ssl connection successful (early data)\n");
+	return num;
+}
+#endif
+
 /**
  * Shuts down an active TLS/SSL connection. It sends the "close notify"
  * shutdown alert to the peer. Also free the TLS/SSL connection context.
@@ -97,7 +537,21 @@ int sdo_ssl_connect(void *ssl)
  */
 int sdo_ssl_close(void *ssl)
 {
-	int ret = SSL_shutdown((SSL *)ssl);
+	int ret;
+
+#ifndef TLS_SESSION_CACHE_FALSE
+	tlsSessionStore((SSL *)ssl);
+#endif
+
+#ifdef TLS_EARLY_DATA
+	/* The deferred handshake never ran, there is nothing to shut down */
+	if (!SSL_is_init_finished((SSL *)ssl)) {
+		SSL_free((SSL *)ssl);
+		return 0;
+	}
+#endif
+
+	ret = SSL_shutdown((SSL *)ssl);
 
 	if (ret <= 0) {
 		if (ret == 0) {
@@ -171,3 +625,64 @@ int sdo_ssl_write(void *ssl, const void *buf, int num)
 
 	return ret;
 }
+
+/**
+ * Internal API: map the result of a non-blocking SSL call.
+ */
+static int sdo_ssl_nb_result(SSL *ssl, int ret, const char *op)
+{
+	if (ret > 0)
+		return ret;
+
+	switch (SSL_get_error(ssl, ret)) {
+	case SSL_ERROR_WANT_READ:
+		return SDO_SSL_WANT_READ;
+	case SSL_ERROR_WANT_WRITE:
+		return SDO_SSL_WANT_WRITE;
+	default:
+		LOG(LOG_ERROR, "SSL Connection %s error: %d\n", op,
+		    SSL_get_error(ssl, ret));
+		return -1;
+	}
+}
+
+/**
+ * Reads up to "num" bytes over a TLS/SSL connection on a non-blocking
+ * socket.
+ *
+ * @param ssl
+ *        ssl handle containing the TLS/SSL connection context.
+ * @param buf
+ *        Buffer to read into.
+ * @param num
+ *        Size of buf.
+ * @return ret
+ *        return no of bytes read, SDO_SSL_WANT_READ/SDO_SSL_WANT_WRITE if
+ *        the read would block, -1 on failure.
+ */
+int sdo_ssl_read_nb(void *ssl, void *buf, int num)
+{
+	return sdo_ssl_nb_result((SSL *)ssl, SSL_read((SSL *)ssl, buf, num),
+				 "read");
+}
+
+/**
+ * Sends up to "num" bytes over a TLS/SSL connection on a non-blocking
+ * socket. If SDO_SSL_WANT_READ/SDO_SSL_WANT_WRITE is returned, the call is
+ * to be repeated with the same arguments.
+ *
+ * @param ssl
+ *        ssl handle containing the TLS/SSL connection context.
+ * @param buf
+ *        Buffer containing data to be transmitted over TLS/SSL context.
+ * @param num
+ *        Length of data to be transmitted.
+ * @return ret
+ *        return no of bytes written, SDO_SSL_WANT_READ/SDO_SSL_WANT_WRITE
+ *        if the write would block, -1 on failure.
+ */
+int sdo_ssl_write_nb(void *ssl, const void *buf, int num)
+{
+	return sdo_ssl_nb_result((SSL *)ssl, SSL_write((SSL *)ssl, buf, num),
+				 "write");
+}
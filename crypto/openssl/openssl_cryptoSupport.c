@@ -21,6 +21,13 @@
 #include <openssl/rand.h>
 #include <assert.h>
 #include "sdoCryptoHal.h"
+#include "BN_support.h"
+#if (defined(ECDSA256_DA) || defined(ECDSA384_DA)) && !defined(SECURE_ELEMENT)
+#include "ec_key.h"
+#endif
+#if defined(DEVICE_TPM20_ENABLED)
+#include "tpm20_Utils.h"
+#endif
 #ifdef SECURE_ELEMENT
 int32_t sdoSECryptoInit(void);
 #endif /* SECURE_ELEMENT */
@@ -162,8 +169,11 @@ int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes)
 		return -1;
 	} else if (NULL == randomBuffer) {
 		return -1;
-	} else if (1 !=
-		   RAND_priv_bytes((unsigned char *)randomBuffer, numBytes)) {
+	}
+#ifdef CRYPTO_FIXED_RANDOM
+	return sdoCryptoFixedRandom(randomBuffer, numBytes);
+#endif
+	if (1 != RAND_priv_bytes((unsigned char *)randomBuffer, numBytes)) {
 		return -1;
 	}
 
@@ -179,6 +189,11 @@ int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes)
  */
 int32_t cryptoInit(void)
 {
+#ifdef CRYPTO_FIXED_RANDOM
+	LOG(LOG_ERROR, "*** CRYPTO_FIXED_RANDOM: the random bytes, keys and "
+		       "nonces are predictable, NET_REPLAY builds only, never "
+		       "for a device ***\n");
+#endif
 	if (0 != random_init()) {
 		return -1;
 	}
@@ -205,6 +220,11 @@ int32_t cryptoInit(void)
  */
 int32_t cryptoClose(void)
 {
+#if defined(DEVICE_TPM20_ENABLED)
+	sdoTPMClose();
+#endif
+	sdo_ssl_context_free();
+	bn_ctx_pool_free();
 	if (0 != random_close()) {
 		return -1;
 	}
@@ -402,4 +422,264 @@ end:
 	HMAC_CTX_free(ctx);
 	return ret;
 }
+
+/**
+ * sdoCryptoHashInit function sets up the hash of data handed over in pieces
+ *
+ * @param hashType - Hash type (SDO_CRYPTO_HASH_TYPE_SHA_256/
+ *				SDO_CRYPTO_HASH_TYPE_SHA_384)
+ * @param context - out pointer to the hash context.
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashInit(uint8_t hashType, void **context)
+{
+	const EVP_MD *md;
+	EVP_MD_CTX *ctx;
+
+	if (!context)
+		return -1;
+
+	switch (hashType) {
+	case SDO_CRYPTO_HASH_TYPE_SHA_256:
+		md = EVP_sha256();
+		break;
+	case SDO_CRYPTO_HASH_TYPE_SHA_384:
+		md = EVP_sha384();
+		break;
+	default:
+		return -1;
+	}
+
+	ctx = EVP_MD_CTX_new();
+	if (!ctx)
+		return -1;
+	if (1 != EVP_DigestInit_ex(ctx, md, NULL)) {
+		EVP_MD_CTX_free(ctx);
+		return -1;
+	}
+	*context = ctx;
+	return 0;
+}
+
+/**
+ * sdoCryptoHashUpdate function hashes the next piece of data
+ *
+ * @param context - hash context set up by sdoCryptoHashInit().
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength)
+{
+	if (!context || (!buffer && bufferLength))
+		return -1;
+	if (1 != EVP_DigestUpdate(context, buffer, bufferLength))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHashFinal function completes the hash and releases its context
+ *
+ * @param context - in/out hash context, NULL on return.
+ * @param output - pointer to output data buffer, NULL to only release the
+ * context.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHashFinal(void **context, uint8_t *output,
+			   size_t outputLength)
+{
+	int32_t ret = -1;
+	EVP_MD_CTX *ctx;
+
+	if (!context || !*context)
+		return -1;
+	ctx = *context;
+
+	if (!output) {
+		ret = 0;
+		goto end;
+	}
+	if (outputLength < (size_t)EVP_MD_CTX_size(ctx))
+		goto end;
+	if (1 != EVP_DigestFinal_ex(ctx, output, NULL))
+		goto end;
+	ret = 0;
+
+end:
+	EVP_MD_CTX_free(ctx);
+	*context = NULL;
+	return ret;
+}
+
+/**
+ * sdoCryptoHMACInit function sets up the hmac of data handed over in pieces
+ *
+ * @param hmacType - Hmac type (SDO_CRYPTO_HMAC_TYPE_SHA_256/
+ *				SDO_CRYPTO_HMAC_TYPE_SHA_384)
+ * @param key - pointer to hmac key buffer of uint8_t type.
+ * @param keyLength - hmac key size
+ * @param context - out pointer to the hmac context.
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACInit(uint8_t hmacType, const uint8_t *key,
+			  size_t keyLength, void **context)
+{
+	const EVP_MD *md;
+	HMAC_CTX *ctx;
+
+	if (!context || NULL == key || 0 == keyLength)
+		return -1;
+
+	switch (hmacType) {
+	case SDO_CRYPTO_HMAC_TYPE_SHA_256:
+		md = EVP_sha256();
+		break;
+	case SDO_CRYPTO_HMAC_TYPE_SHA_384:
+		md = EVP_sha384();
+		break;
+	default:
+		return -1;
+	}
+
+	ctx = HMAC_CTX_new();
+	if (!ctx)
+		return -1;
+	if (1 != HMAC_Init_ex(ctx, key, keyLength, md, NULL)) {
+		HMAC_CTX_free(ctx);
+		return -1;
+	}
+	*context = ctx;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACUpdate function adds the next piece of data to the hmac
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACUpdate(void *context, const uint8_t *buffer,
+			    size_t bufferLength)
+{
+	if (!context || (!buffer && bufferLength))
+		return -1;
+	if (1 != HMAC_Update(context, buffer, bufferLength))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACFinal function completes the hmac and releases its context
+ *
+ * @param context - in/out hmac context, NULL on return.
+ * @param output - pointer to output data buffer, NULL to only release the
+ * context.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACFinal(void **context, uint8_t *output,
+			   size_t outputLength)
+{
+	int32_t ret = -1;
+	HMAC_CTX *ctx;
+
+	if (!context || !*context)
+		return -1;
+	ctx = *context;
+
+	if (!output) {
+		ret = 0;
+		goto end;
+	}
+	if (outputLength < HMAC_size(ctx))
+		goto end;
+	if (1 != HMAC_Final(ctx, output, NULL))
+		goto end;
+	ret = 0;
+
+end:
+	HMAC_CTX_free(ctx);
+	*context = NULL;
+	return ret;
+}
+
+/**
+ * sdoCryptoHMACKeyed function calculates the hmac of a whole buffer with the
+ * key of a context, whose key state is kept for the next buffer
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit(), released by
+ * sdoCryptoHMACFinal() with a NULL output.
+ * @param buffer - pointer to input data buffer of uint8_t type.
+ * @param bufferLength - input data buffer size
+ * @param output - pointer to output data buffer of uint8_t type.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACKeyed(void *context, const uint8_t *buffer,
+			   size_t bufferLength, uint8_t *output,
+			   size_t outputLength)
+{
+	if (!context || NULL == buffer || 0 == bufferLength ||
+	    NULL == output || outputLength < HMAC_size(context))
+		return -1;
+
+	/* No key restarts from the inner and outer pads computed by Init */
+	if (1 != HMAC_Init_ex(context, NULL, 0, NULL, NULL))
+		return -1;
+	if (1 != HMAC_Update(context, buffer, bufferLength))
+		return -1;
+	if (1 != HMAC_Final(context, output, NULL))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACRestart function starts a new hmac with the key of a context,
+ * the data of which is then handed over with sdoCryptoHMACUpdate()
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACRestart(void *context)
+{
+	if (!context)
+		return -1;
+	/* No key restarts from the inner and outer pads computed by Init */
+	if (1 != HMAC_Init_ex(context, NULL, 0, NULL, NULL))
+		return -1;
+	return 0;
+}
+
+/**
+ * sdoCryptoHMACKeyedFinal function completes the hmac started by
+ * sdoCryptoHMACRestart(), the context staying keyed for the next one
+ *
+ * @param context - hmac context set up by sdoCryptoHMACInit().
+ * @param output - pointer to output data buffer of uint8_t type.
+ * @param outputLength - output data buffer size
+ * @return
+ *        return 0 on success. -ve value on failure.
+ */
+int32_t sdoCryptoHMACKeyedFinal(void *context, uint8_t *output,
+				size_t outputLength)
+{
+	if (!context || NULL == output || outputLength < HMAC_size(context))
+		return -1;
+	if (1 != HMAC_Final(context, output, NULL))
+		return -1;
+	return 0;
+}
 #endif /* SECURE_ELEMENT */
@@ -26,10 +26,7 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 	char *csr_data = NULL;
 	size_t csr_size = 0;
 	EC_KEY *ec_key = NULL;
-	const EC_GROUP *ec_grp = NULL;
 	BIO *csr_mem_bio = NULL;
-	EC_POINT *pub_key = NULL;
-	const BIGNUM *privkey_bn = NULL;
 	X509_NAME *x509_name = NULL;
 	EVP_PKEY *ec_pkey = EVP_PKEY_new();
 	X509_REQ *x509_req = X509_REQ_new();
@@ -48,44 +45,9 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 		goto err;
 	}
 
-	/*
-	 * Generate the EC public key
-	 * a. Get the EC group
-	 * b. Generate a new point
-	 * c. Create the public key
-	 */
-	ec_grp = EC_KEY_get0_group(ec_key);
-	if (!ec_grp) {
-		LOG(LOG_ERROR, "Failed to create a group on ec curve\n");
-		ret = -1;
-		goto err;
-	}
-
-	pub_key = EC_POINT_new(ec_grp);
-	if (!pub_key) {
-		LOG(LOG_ERROR, "Failed to generate a point on curve\n");
-		ret = -1;
-		goto err;
-	}
-
-	privkey_bn = EC_KEY_get0_private_key(ec_key);
-	if (!privkey_bn) {
-		LOG(LOG_ERROR, "Failed to get private key bn\n");
-		ret = -1;
-		goto err;
-	}
-
-	ret = EC_POINT_mul(ec_grp, pub_key, privkey_bn, NULL, NULL, NULL);
-	if (!ret) {
-		LOG(LOG_ERROR, "Failed to generate public key\n");
-		ret = -1;
-		goto err;
-	}
-
-	/* Set the ec_key instance with both public/private key */
-	ret = EC_KEY_set_public_key(ec_key, pub_key);
-	if (!ret) {
-		LOG(LOG_ERROR, "Failed to set the public key\n");
+	/* The resident key comes with its public key */
+	if (!EC_KEY_get0_public_key(ec_key)) {
+		LOG(LOG_ERROR, "No public key for the CSR\n");
 		ret = -1;
 		goto err;
 	}
@@ -114,7 +76,8 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 		goto err;
 	}
 
-	ret = EVP_PKEY_assign_EC_KEY(ec_pkey, ec_key);
+	/* A reference of its own, the key is shared */
+	ret = EVP_PKEY_set1_EC_KEY(ec_pkey, ec_key);
 	if (!ret) {
 		LOG(LOG_ERROR, "Failed to get ec_key reference\n");
 		ret = -1;
@@ -182,18 +145,14 @@ int32_t _sdoGetDeviceCsr(SDOByteArray_t **csr)
 
 	ret = 0;
 err:
-#if 0 /* Freeing this leads to mem corruption */
 	if (ec_pkey)
 		EVP_PKEY_free(ec_pkey);
-#endif
 	if (csr_byte_arr && ret) {
 		sdoByteArrayFree(csr_byte_arr);
 		csr_byte_arr = NULL;
 	}
 	if (csr_mem_bio)
 		BIO_free(csr_mem_bio);
-	if (pub_key)
-		EC_POINT_free(pub_key);
 	if (ec_key)
 		EC_KEY_free(ec_key);
 	if (x509_req)
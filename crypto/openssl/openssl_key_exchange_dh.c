@@ -52,6 +52,120 @@ typedef union {
 
 static bool computePublicBDH(dh_context_t *keyExData);
 
+/*
+ * Fixed-base comb for g^b. The group is fixed, so the 2^DH_COMB_TEETH
+ * products of g^(2^(spacing * i)) are computed once, in Montgomery form,
+ * and B then costs spacing squarings and multiplications instead of a full
+ * exponentiation. The table lives until the process exits.
+ */
+#define DH_COMB_TEETH 6
+#define DH_COMB_SIZE (1 << DH_COMB_TEETH)
+
+static struct {
+	BN_MONT_CTX *mont;
+	BIGNUM *entry[DH_COMB_SIZE];
+	int spacing;
+} dhComb;
+/* Built by the first key exchange, of any instance */
+SDO_MUTEX(dhCombLock);
+
+static void dhCombFree(void)
+{
+	int j;
+
+	for (j = 0; j < DH_COMB_SIZE; j++) {
+		BN_free(dhComb.entry[j]);
+		dhComb.entry[j] = NULL;
+	}
+	BN_MONT_CTX_free(dhComb.mont);
+	dhComb.mont = NULL;
+}
+
+/**
+ * Build the comb table for exponents of up to DEFAULT_DH_SECRET_BITS bits,
+ * unless it is already built.
+ * @param g - the generator
+ * @param p - the prime
+ * @param ctx - the BN_CTX used for the calculation
+ * @return true on success, false on error
+ */
+static bool dhCombBuild(const BIGNUM *g, const BIGNUM *p, BN_CTX *ctx)
+{
+	int i, j, k;
+
+	if (dhComb.mont)
+		return true;
+
+	dhComb.spacing =
+	    (DEFAULT_DH_SECRET_BITS + DH_COMB_TEETH - 1) / DH_COMB_TEETH;
+	for (j = 0; j < DH_COMB_SIZE; j++) {
+		dhComb.entry[j] = BN_new();
+		if (!dhComb.entry[j])
+			goto err;
+	}
+	dhComb.mont = BN_MONT_CTX_new();
+	if (!dhComb.mont || !BN_MONT_CTX_set(dhComb.mont, p, ctx))
+		goto err;
+
+	/* entry[0] is one and entry[1 << i] is g^(2^(spacing * i)) */
+	if (!BN_to_montgomery(dhComb.entry[0], BN_value_one(), dhComb.mont,
+			      ctx) ||
+	    !BN_to_montgomery(dhComb.entry[1], g, dhComb.mont, ctx))
+		goto err;
+	for (i = 1; i < DH_COMB_TEETH; i++) {
+		BIGNUM *t = dhComb.entry[1 << i];
+
+		if (!BN_copy(t, dhComb.entry[1 << (i - 1)]))
+			goto err;
+		for (k = 0; k < dhComb.spacing; k++) {
+			if (!BN_mod_mul_montgomery(t, t, t, dhComb.mont, ctx))
+				goto err;
+		}
+	}
+	/* Every other entry is the product of its lowest bit and the rest */
+	for (j = 3; j < DH_COMB_SIZE; j++) {
+		if (!(j & (j - 1)))
+			continue;
+		if (!BN_mod_mul_montgomery(dhComb.entry[j],
+					   dhComb.entry[j & (j - 1)],
+					   dhComb.entry[j & -j], dhComb.mont,
+					   ctx))
+			goto err;
+	}
+	return true;
+err:
+	dhCombFree();
+	return false;
+}
+
+/**
+ * Compute r = g^e mod p with the comb table.
+ * @param r - the result
+ * @param e - the exponent, of at most spacing * DH_COMB_TEETH bits
+ * @param ctx - the BN_CTX used for the calculation
+ * @return true on success, false on error
+ */
+static bool dhCombExp(BIGNUM *r, const BIGNUM *e, BN_CTX *ctx)
+{
+	int i, k, idx;
+
+	if (!BN_copy(r, dhComb.entry[0]))
+		return false;
+	for (k = dhComb.spacing - 1; k >= 0; k--) {
+		if (!BN_mod_mul_montgomery(r, r, r, dhComb.mont, ctx))
+			return false;
+		idx = 0;
+		for (i = 0; i < DH_COMB_TEETH; i++) {
+			if (BN_is_bit_set(e, dhComb.spacing * i + k))
+				idx |= 1 << i;
+		}
+		if (!BN_mod_mul_montgomery(r, r, dhComb.entry[idx],
+					   dhComb.mont, ctx))
+			return false;
+	}
+	return BN_from_montgomery(r, r, dhComb.mont, ctx) == 1;
+}
+
 /**
  * Initialize the key exchange of type DH
  * @param context - points to the initialised pointer to the key exchange data
@@ -135,6 +249,7 @@ static bool computePublicBDH(dh_context_t *keyExData)
 {
 	BN_CTX *ctx = NULL;
 	bool ret = false;
+	bool comb;
 
 	LOG(LOG_DEBUG, "computePublicB started\n");
 
@@ -155,7 +270,7 @@ static bool computePublicBDH(dh_context_t *keyExData)
 	 * Compute public B = g^a mod p
 	 * _publicB = _g15 ^ _secretb mod _id15
 	 */
-	ctx = BN_CTX_new();
+	ctx = bn_ctx_get();
 
 	/*
 	 * This parameters are - destination, g, p, a, then a ctx used for the
@@ -163,8 +278,25 @@ static bool computePublicBDH(dh_context_t *keyExData)
 	 */
 	LOG(LOG_DEBUG, "Calculate _publicB\n");
 
-	if (bn_mod_exp(keyExData->_publicB, keyExData->_g15,
-		       keyExData->_secretb, keyExData->_p15, ctx)) {
+	if (!ctx) {
+		LOG(LOG_ERROR, "computePublicB : bn_ctx_get failed\n");
+		goto err;
+	}
+
+	/* A table that fails to build only costs the fast path */
+	SDO_LOCK(dhCombLock);
+	comb = dhCombBuild(keyExData->_g15, keyExData->_p15, ctx);
+	SDO_UNLOCK(dhCombLock);
+	if (comb && BN_num_bits(keyExData->_secretb) <=
+			dhComb.spacing * DH_COMB_TEETH) {
+		if (!dhCombExp(keyExData->_publicB, keyExData->_secretb,
+			       ctx)) {
+			LOG(LOG_ERROR,
+			    "computePublicB : Trouble doing the comb\n");
+			goto err;
+		}
+	} else if (bn_mod_exp(keyExData->_publicB, keyExData->_g15,
+			      keyExData->_secretb, keyExData->_p15, ctx)) {
 		LOG(LOG_ERROR,
 		    "computePublicB : Trouble doing the bn_mod_exp\n");
 		goto err;
@@ -180,8 +312,7 @@ static bool computePublicBDH(dh_context_t *keyExData)
 	ret = true;
 	LOG(LOG_DEBUG, "computePublicB complete\n");
 err:
-	/* Consider using the bn cache in ctx. */
-	BN_CTX_free(ctx);
+	bn_ctx_put(ctx);
 	return ret;
 }
 
@@ -259,7 +390,9 @@ int32_t sdoCryptoSetPeerRandom(void *context, const uint8_t *peerRandValue,
 		return ret;
 	}
 
-	ctx = BN_CTX_new();
+	ctx = bn_ctx_get();
+	if (!ctx)
+		return -1;
 
 	/*
 	 * Create our shared secret
@@ -275,7 +408,7 @@ int32_t sdoCryptoSetPeerRandom(void *context, const uint8_t *peerRandValue,
 #if LOG_LEVEL == LOG_MAX_LEVEL
 	hexdump("Public A (xA)", peerRandValue, peerRandLength);
 #endif
-	BN_CTX_free(ctx);
+	bn_ctx_put(ctx);
 
 	LOG(LOG_DEBUG, "KDF Successful\n");
 	return 0;
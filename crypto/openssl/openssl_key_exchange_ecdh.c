@@ -141,6 +141,40 @@ int32_t sdoCryptoKEXClose(void **context)
  * @return
  *        returns true on success, false on error
  */
+#ifdef CRYPTO_FIXED_RANDOM
+/**
+ * Generate the key pair from the fixed random sequence, EC_KEY_generate_key
+ * drawing from the openssl DRBG.
+ * @param key - EC key of the curve, out with the key pair.
+ * @param ctx - started BN context.
+ * @return true on success, false otherwise.
+ */
+static bool ecdhFixedKey(EC_KEY *key, BN_CTX *ctx)
+{
+	const EC_GROUP *group = EC_KEY_get0_group(key);
+	BIGNUM *priv = BN_CTX_get(ctx);
+	BIGNUM *order = BN_CTX_get(ctx);
+	EC_POINT *pub = NULL;
+	bool ret = false;
+
+	if (!group || !priv || !order || !EC_GROUP_get_order(group, order, ctx))
+		return false;
+
+	/* private key in [1, order), the sequence being nearly uniform */
+	if (bn_rand(priv, BN_num_bytes(order) + 8) ||
+	    !BN_mod(priv, priv, order, ctx) || BN_is_zero(priv))
+		return false;
+
+	pub = EC_POINT_new(group);
+	if (pub && EC_POINT_mul(group, pub, priv, NULL, NULL, ctx) &&
+	    EC_KEY_set_private_key(key, priv) &&
+	    EC_KEY_set_public_key(key, pub))
+		ret = true;
+	EC_POINT_free(pub);
+	return ret;
+}
+#endif
+
 static bool computePublicBECDH(ecdh_context_t *keyExData)
 {
 	BN_CTX *ctx = NULL;
@@ -160,12 +194,11 @@ static bool computePublicBECDH(ecdh_context_t *keyExData)
 		return ret;
 	}
 
-	ctx = BN_CTX_new();
+	ctx = bn_ctx_get();
 	if (!ctx) {
 		LOG(LOG_ERROR, "BN context new fail\n");
 		return ret;
 	}
-	BN_CTX_start(ctx);
 	x = BN_CTX_get(ctx);
 	y = BN_CTX_get(ctx);
 	if (!x || !y) {
@@ -185,7 +218,11 @@ static bool computePublicBECDH(ecdh_context_t *keyExData)
 	}
 
 	/* generate the public key and private key */
+#ifdef CRYPTO_FIXED_RANDOM
+	if (!ecdhFixedKey(key, ctx)) {
+#else
 	if (EC_KEY_generate_key(key) == 0) {
+#endif
 		LOG(LOG_ERROR, "EC key generation failed\n");
 		goto exit;
 	}
@@ -296,9 +333,7 @@ exit:
 		BN_clear(x);
 	if (y)
 		BN_clear(y);
-	/* Consider using the bn cache in ctx. */
-	if (ctx)
-		BN_CTX_free(ctx);
+	bn_ctx_put(ctx);
 	return ret;
 }
 
@@ -369,11 +404,16 @@ int32_t sdoCryptoSetPeerRandom(void *context, const uint8_t *peerRandValue,
 	EC_KEY *key = NULL;
 	int ret = -1;
 
-	Ax_bn = BN_new();
-	Ay_bn = BN_new();
-	Shx_bn = BN_new();
-	Shy_bn = BN_new();
-	ownerRandom_bn = BN_new();
+	ctx = bn_ctx_get();
+	if (!ctx) {
+		LOG(LOG_ERROR, "BN context new fail\n");
+		goto error;
+	}
+	Ax_bn = BN_CTX_get(ctx);
+	Ay_bn = BN_CTX_get(ctx);
+	Shx_bn = BN_CTX_get(ctx);
+	Shy_bn = BN_CTX_get(ctx);
+	ownerRandom_bn = BN_CTX_get(ctx);
 
 	if (!Ax_bn || !Ay_bn || !Shx_bn || !Shy_bn || !ownerRandom_bn) {
 		LOG(LOG_ERROR, "BN alloc failed\n");
@@ -435,12 +475,6 @@ int32_t sdoCryptoSetPeerRandom(void *context, const uint8_t *peerRandValue,
 	    bn_num_bytes(ownerRandom_bn), hexbuf4);
 	OPENSSL_free(hexbuf4);
 #endif
-	ctx = BN_CTX_new();
-	if (!ctx) {
-		LOG(LOG_ERROR, "BN context new fail\n");
-		goto error;
-	}
-
 	key = keyExData->_key;
 	group = EC_KEY_get0_group(key);
 	point = EC_POINT_new(group);
@@ -522,18 +556,18 @@ error:
 		EC_POINT_free(point);
 	if (shse)
 		sdoFree(shse);
+	/* The pooled BIGNUMs outlive the call, the secret ones are cleared */
 	if (Ax_bn)
-		BN_clear_free(Ax_bn);
+		BN_clear(Ax_bn);
 	if (Ay_bn)
-		BN_clear_free(Ay_bn);
+		BN_clear(Ay_bn);
 	if (ownerRandom_bn)
-		BN_clear_free(ownerRandom_bn);
+		BN_clear(ownerRandom_bn);
 	if (Shx_bn)
-		BN_clear_free(Shx_bn);
+		BN_clear(Shx_bn);
 	if (Shy_bn)
-		BN_clear_free(Shy_bn);
-	if (ctx)
-		BN_CTX_free(ctx);
+		BN_clear(Shy_bn);
+	bn_ctx_put(ctx);
 	if (shx)
 		sdoFree(shx);
 
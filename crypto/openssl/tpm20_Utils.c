@@ -24,66 +24,143 @@ static int32_t sdoTPMGeneratePrimaryKeyContext(ESYS_CONTEXT **esysContext,
 					       ESYS_TR *primaryHandle,
 					       ESYS_TR *authSessionHandle);
 
+/*
+ * The ESYS context, the primary key and its auth session are made once and
+ * kept for the process, and so are the HMAC keys loaded under the primary,
+ * so that a storage HMAC is a single command once they are there.
+ */
+#define TPM_HMAC_KEY_CACHE_SIZE 2
+#define TPM_KEY_FILE_NAME_MAX 256
+
+typedef struct {
+	char privKeyFile[TPM_KEY_FILE_NAME_MAX]; /* empty when unused */
+	ESYS_TR handle;
+} sdoTPMHMACKey_t;
+
+static struct {
+	ESYS_CONTEXT *esysContext;
+	ESYS_TR primaryKeyHandle;
+	ESYS_TR authSessionHandle;
+	sdoTPMHMACKey_t keys[TPM_HMAC_KEY_CACHE_SIZE];
+	int nextKey;
+} tpmCtx = {
+    .esysContext = NULL,
+    .primaryKeyHandle = ESYS_TR_NONE,
+    .authSessionHandle = ESYS_TR_NONE,
+};
+
 /**
- * Generates HMAC using TPM
+ * Make the process wide TPM context, unless it is already there.
+ *
+ * @return
+ *	0, on success
+ *	-1, on failure
+ */
+static int32_t sdoTPMContextGet(void)
+{
+	if (tpmCtx.esysContext)
+		return 0;
+
+	if (0 != sdoTPMGeneratePrimaryKeyContext(&tpmCtx.esysContext,
+						 &tpmCtx.primaryKeyHandle,
+						 &tpmCtx.authSessionHandle)) {
+		LOG(LOG_ERROR,
+		    "Failed to create primary key context from TPM.\n");
+		return -1;
+	}
+
+	LOG(LOG_DEBUG, "TPM Primary Key Context created successfully.\n");
+	return 0;
+}
+
+/**
+ * Flush a cached HMAC key.
+ *
+ * @param key: the cache entry
+ */
+static void sdoTPMHMACKeyFlush(sdoTPMHMACKey_t *key)
+{
+	if (!key->privKeyFile[0])
+		return;
+	if (tpmCtx.esysContext &&
+	    Esys_FlushContext(tpmCtx.esysContext, key->handle) !=
+		TSS2_RC_SUCCESS)
+		LOG(LOG_ERROR, "Failed to flush HMAC key handle.\n");
+	key->privKeyFile[0] = '\0';
+	key->handle = ESYS_TR_NONE;
+}
+
+/**
+ * Drop the cached HMAC key loaded from a private key file, if any.
+ *
+ * @param tpmHMACPrivKey: File name of the TPM HMAC private key
+ */
+static void sdoTPMHMACKeyDrop(const char *tpmHMACPrivKey)
+{
+	int i, diff = 1;
+
+	for (i = 0; i < TPM_HMAC_KEY_CACHE_SIZE; i++) {
+		if (strcmp_s(tpmCtx.keys[i].privKeyFile, TPM_KEY_FILE_NAME_MAX,
+			     tpmHMACPrivKey, &diff) == 0 &&
+		    diff == 0)
+			sdoTPMHMACKeyFlush(&tpmCtx.keys[i]);
+	}
+}
+
+/**
+ * Release the process wide TPM context and everything loaded under it.
+ */
+void sdoTPMClose(void)
+{
+	int i;
+
+	if (!tpmCtx.esysContext)
+		return;
+
+	for (i = 0; i < TPM_HMAC_KEY_CACHE_SIZE; i++)
+		sdoTPMHMACKeyFlush(&tpmCtx.keys[i]);
+	if (0 != sdoTPMTSSContextCleanUp(&tpmCtx.esysContext,
+					 &tpmCtx.authSessionHandle,
+					 &tpmCtx.primaryKeyHandle))
+		LOG(LOG_ERROR, "Failed to tear down all the TSS context.\n");
+	tpmCtx.esysContext = NULL;
+	tpmCtx.primaryKeyHandle = ESYS_TR_NONE;
+	tpmCtx.authSessionHandle = ESYS_TR_NONE;
+}
+
+/**
+ * Get the handle of an HMAC key, loading it under the primary key from its
+ * key files unless it is cached.
  *
- * @param data: pointer to the input data
- * @param dataLength: length of the input data
- * @param hmac: output buffer to save the HMAC
- * @param hmacLength: length of the output HMAC buffer, equal to the SHA256 hash
- *length
  * @param tpmHMACPubKey: File name of the TPM HMAC public key
  * @param tpmHMACPrivKey: File name of the TPM HMAC private key
+ * @param hmacKeyHandle: output HMAC key handle
  * @return
  *	0, on success
  *	-1, on failure
  */
-int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
-		      size_t hmacLength, char *tpmHMACPubKey,
-		      char *tpmHMACPrivKey)
+static int32_t sdoTPMHMACKeyGet(const char *tpmHMACPubKey,
+				const char *tpmHMACPrivKey,
+				ESYS_TR *hmacKeyHandle)
 {
 	int32_t ret = -1, retVal = -1, fileSize = 0;
-	size_t hashedLength = 0;
+	int i, diff = 1;
 	size_t offset = 0;
 	uint8_t bufferTPMHMACPrivKey[TPM_HMAC_PRIV_KEY_CONTEXT_SIZE] = {0};
 	uint8_t bufferTPMHMACPubKey[TPM_HMAC_PUB_KEY_CONTEXT_SIZE] = {0};
-	ESYS_CONTEXT *esysContext = NULL;
-	ESYS_TR primaryKeyHandle = ESYS_TR_NONE;
-	ESYS_TR authSessionHandle = ESYS_TR_NONE;
-	ESYS_TR hmacKeyHandle = ESYS_TR_NONE;
-	ESYS_TR sequenceHandle = ESYS_TR_NONE;
-	TPMT_TK_HASHCHECK *validation = NULL;
 	TPM2B_PUBLIC unmarshalHMACPubKey = {0};
 	TPM2B_PRIVATE unmarshalHMACPrivKey = {0};
-	TPM2B_DIGEST *outHMAC = NULL;
-	TPM2B_MAX_BUFFER block = {0};
-	TPM2B_AUTH nullAuth = {0};
-
-	LOG(LOG_DEBUG, "HMAC generation from TPM function called.\n");
-
-	/* Validating all input parameters are passed in the function call*/
-
-	if (!data || !dataLength || !tpmHMACPubKey || !tpmHMACPrivKey ||
-	    !hmac || (hmacLength != SHA256_DIGEST_SIZE)) {
-		LOG(LOG_ERROR,
-		    "Failed to generate HMAC from TPM, invalid parameter"
-		    " received.\n");
-		goto err;
-	}
-
-	LOG(LOG_DEBUG, "All required function parameters available.\n");
-
-	/*Creating TPM Primary Key Context*/
-
-	if (0 != sdoTPMGeneratePrimaryKeyContext(
-		     &esysContext, &primaryKeyHandle, &authSessionHandle)) {
-		LOG(LOG_ERROR,
-		    "Failed to create primary key context from TPM.\n");
-		goto err;
+	sdoTPMHMACKey_t *key;
+
+	for (i = 0; i < TPM_HMAC_KEY_CACHE_SIZE; i++) {
+		if (strcmp_s(tpmCtx.keys[i].privKeyFile, TPM_KEY_FILE_NAME_MAX,
+			     tpmHMACPrivKey, &diff) == 0 &&
+		    diff == 0) {
+			*hmacKeyHandle = tpmCtx.keys[i].handle;
+			return 0;
+		}
 	}
 
-	LOG(LOG_DEBUG, "TPM Primary Key Context created successfully.\n");
-
 	/* Unmarshalling the HMAC Private key from the HMAC Private key file*/
 
 	fileSize = get_file_size(tpmHMACPrivKey);
@@ -156,21 +233,66 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 	LOG(LOG_DEBUG,
 	    "TPM HMAC Public Key Unmarshal complete successfully.\n");
 
+	/* Make room, the key loaded longest ago goes */
+	key = &tpmCtx.keys[tpmCtx.nextKey];
+	tpmCtx.nextKey = (tpmCtx.nextKey + 1) % TPM_HMAC_KEY_CACHE_SIZE;
+	sdoTPMHMACKeyFlush(key);
+
 	/* Loading the TPM Primary key, HMAC public key and HMAC Private Key to
 	 * generate the HMAC Key Context */
 
-	retVal = Esys_Load(esysContext, primaryKeyHandle, authSessionHandle,
-			   ESYS_TR_NONE, ESYS_TR_NONE, &unmarshalHMACPrivKey,
-			   &unmarshalHMACPubKey, &hmacKeyHandle);
+	retVal = Esys_Load(tpmCtx.esysContext, tpmCtx.primaryKeyHandle,
+			   tpmCtx.authSessionHandle, ESYS_TR_NONE, ESYS_TR_NONE,
+			   &unmarshalHMACPrivKey, &unmarshalHMACPubKey,
+			   &key->handle);
 
 	if (retVal != TSS2_RC_SUCCESS) {
 		LOG(LOG_ERROR, "Failed to load HMAC Key Context.\n");
+		key->handle = ESYS_TR_NONE;
+		goto err;
+	}
+
+	if (strcpy_s(key->privKeyFile, TPM_KEY_FILE_NAME_MAX,
+		     tpmHMACPrivKey) != 0) {
+		LOG(LOG_ERROR, "Failed to cache HMAC Key Context.\n");
+		(void)Esys_FlushContext(tpmCtx.esysContext, key->handle);
+		key->privKeyFile[0] = '\0';
+		key->handle = ESYS_TR_NONE;
 		goto err;
 	}
 
 	LOG(LOG_DEBUG, "TPM HMAC Key Context generated successfully.\n");
+	*hmacKeyHandle = key->handle;
+	ret = 0;
 
-	/* Generating HMAC for input data, blockwise*/
+err:
+	if (memset_s(bufferTPMHMACPrivKey, sizeof(bufferTPMHMACPrivKey), 0))
+		LOG(LOG_ERROR, "Failed to clear HMAC Private Key buffer.\n");
+	return ret;
+}
+
+/**
+ * Run the HMAC of the input data with a loaded HMAC key, blockwise.
+ *
+ * @param data: pointer to the input data
+ * @param dataLength: length of the input data
+ * @param hmacKeyHandle: the HMAC key handle
+ * @param outHMAC: output HMAC, to be freed by the caller
+ * @return
+ *	0, on success
+ *	-1, on failure
+ */
+static int32_t sdoTPMHMACRun(const uint8_t *data, size_t dataLength,
+			     ESYS_TR hmacKeyHandle, TPM2B_DIGEST **outHMAC)
+{
+	int32_t ret = -1, retVal = -1;
+	size_t hashedLength = 0;
+	ESYS_CONTEXT *esysContext = tpmCtx.esysContext;
+	ESYS_TR authSessionHandle = tpmCtx.authSessionHandle;
+	ESYS_TR sequenceHandle = ESYS_TR_NONE;
+	TPMT_TK_HASHCHECK *validation = NULL;
+	TPM2B_MAX_BUFFER block = {0};
+	TPM2B_AUTH nullAuth = {0};
 
 	if (dataLength <= TPM2_MAX_DIGEST_BUFFER) {
 
@@ -186,9 +308,10 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 		LOG(LOG_DEBUG, "Data copied from input buffer to TPM data"
 			       " structure.\n");
 
-		retVal = Esys_HMAC(
-		    esysContext, hmacKeyHandle, authSessionHandle, ESYS_TR_NONE,
-		    ESYS_TR_NONE, &block, TPM2_ALG_SHA256, &outHMAC);
+		retVal = Esys_HMAC(esysContext, hmacKeyHandle,
+				   authSessionHandle, ESYS_TR_NONE,
+				   ESYS_TR_NONE, &block, TPM2_ALG_SHA256,
+				   outHMAC);
 
 		if (retVal != TSS2_RC_SUCCESS) {
 			LOG(LOG_ERROR, "Failed to create HMAC.\n");
@@ -235,8 +358,8 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 				retVal = Esys_SequenceComplete(
 				    esysContext, sequenceHandle,
 				    authSessionHandle, ESYS_TR_NONE,
-				    ESYS_TR_NONE, &block, TPM2_RH_NULL,
-				    &outHMAC, &validation);
+				    ESYS_TR_NONE, &block, TPM2_RH_NULL, outHMAC,
+				    &validation);
 
 				if (retVal != TSS2_RC_SUCCESS) {
 					LOG(LOG_ERROR,
@@ -287,6 +410,70 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 		}
 	}
 
+	ret = 0;
+
+err:
+	TPM2_ZEROISE_FREE(validation);
+	return ret;
+}
+
+/**
+ * Generates HMAC using TPM
+ *
+ * @param data: pointer to the input data
+ * @param dataLength: length of the input data
+ * @param hmac: output buffer to save the HMAC
+ * @param hmacLength: length of the output HMAC buffer, equal to the SHA256 hash
+ *length
+ * @param tpmHMACPubKey: File name of the TPM HMAC public key
+ * @param tpmHMACPrivKey: File name of the TPM HMAC private key
+ * @return
+ *	0, on success
+ *	-1, on failure
+ */
+int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
+		      size_t hmacLength, char *tpmHMACPubKey,
+		      char *tpmHMACPrivKey)
+{
+	int32_t ret = -1, retVal = -1;
+	bool cached;
+	ESYS_TR hmacKeyHandle = ESYS_TR_NONE;
+	TPM2B_DIGEST *outHMAC = NULL;
+
+	LOG(LOG_DEBUG, "HMAC generation from TPM function called.\n");
+
+	/* Validating all input parameters are passed in the function call*/
+
+	if (!data || !dataLength || !tpmHMACPubKey || !tpmHMACPrivKey ||
+	    !hmac || (hmacLength != SHA256_DIGEST_SIZE)) {
+		LOG(LOG_ERROR,
+		    "Failed to generate HMAC from TPM, invalid parameter"
+		    " received.\n");
+		goto err;
+	}
+
+	LOG(LOG_DEBUG, "All required function parameters available.\n");
+
+	for (;;) {
+		cached = (tpmCtx.esysContext != NULL);
+		if (0 != sdoTPMContextGet())
+			goto err;
+
+		if (0 == sdoTPMHMACKeyGet(tpmHMACPubKey, tpmHMACPrivKey,
+					  &hmacKeyHandle) &&
+		    0 == sdoTPMHMACRun(data, dataLength, hmacKeyHandle,
+				       &outHMAC))
+			break;
+
+		/* A context kept from before may have gone stale, e.g. with
+		 * the resource manager restarted, so it gets one fresh try */
+		TPM2_ZEROISE_FREE(outHMAC);
+		sdoTPMClose();
+		if (!cached)
+			goto err;
+		LOG(LOG_DEBUG, "Retrying HMAC with a new TPM context.\n");
+	}
+
 	if (!outHMAC || (hmacLength != outHMAC->size)) {
 		LOG(LOG_ERROR, "Incorrect HMAC Generated\n");
 		goto err;
@@ -306,30 +493,6 @@ int32_t sdoTPMGetHMAC(const uint8_t *data, size_t dataLength, uint8_t *hmac,
 	ret = 0;
 
 err:
-	if (esysContext) {
-		if (hmacKeyHandle != ESYS_TR_NONE) {
-			if (Esys_FlushContext(esysContext, hmacKeyHandle) !=
-			    TSS2_RC_SUCCESS) {
-				LOG(LOG_ERROR,
-				    "Failed to flush HMAC key handle.\n");
-				ret = -1;
-			} else {
-				LOG(LOG_DEBUG,
-				    "HMAC key handle flushed successfully.\n");
-				hmacKeyHandle = ESYS_TR_NONE;
-			}
-		}
-		if (0 != sdoTPMTSSContextCleanUp(&esysContext,
-						 &authSessionHandle,
-						 &primaryKeyHandle)) {
-			LOG(LOG_ERROR,
-			    "Failed to tear down all the TSS context.\n");
-			ret = -1;
-		} else {
-			LOG(LOG_DEBUG, "TSS context flushed successfully.\n");
-		}
-	}
-	TPM2_ZEROISE_FREE(validation);
 	TPM2_ZEROISE_FREE(outHMAC);
 
 	return ret;
@@ -348,9 +511,6 @@ int32_t sdoTPMGenerateHMACKey(char *tpmHMACPubKey, char *tpmHMACPrivKey)
 {
 	int32_t ret = -1;
 	TSS2_RC retVal = TPM2_RC_FAILURE;
-	ESYS_CONTEXT *esysContext = NULL;
-	ESYS_TR primaryKeyHandle = ESYS_TR_NONE;
-	ESYS_TR authSessionHandle = ESYS_TR_NONE;
 	TPM2B_PUBLIC *outPublic = NULL;
 	TPM2B_PRIVATE *outPrivate = NULL;
 	TPM2B_CREATION_DATA *creationData = NULL;
@@ -380,16 +540,16 @@ int32_t sdoTPMGenerateHMACKey(char *tpmHMACPubKey, char *tpmHMACPrivKey)
 		goto err;
 	}
 
-	if (0 != sdoTPMGeneratePrimaryKeyContext(
-		     &esysContext, &primaryKeyHandle, &authSessionHandle)) {
-		LOG(LOG_ERROR,
-		    "Failed to create primary key context from TPM.\n");
+	/* The key loaded from the old files is stale now */
+	sdoTPMHMACKeyDrop(tpmHMACPrivKey);
+
+	if (0 != sdoTPMContextGet())
 		goto err;
-	}
 
-	retVal = Esys_Create(esysContext, primaryKeyHandle, authSessionHandle,
-			     ESYS_TR_NONE, ESYS_TR_NONE, &inSensitivePrimary,
-			     &inPublic, &outsideInfo, &creationPCR, &outPrivate,
+	retVal = Esys_Create(tpmCtx.esysContext, tpmCtx.primaryKeyHandle,
+			     tpmCtx.authSessionHandle, ESYS_TR_NONE,
+			     ESYS_TR_NONE, &inSensitivePrimary, &inPublic,
+			     &outsideInfo, &creationPCR, &outPrivate,
 			     &outPublic, &creationData, &creationHash,
 			     &creationTicket);
 
@@ -440,11 +600,9 @@ err:
 	TPM2_ZEROISE_FREE(creationHash);
 	TPM2_ZEROISE_FREE(creationTicket);
 
-	if (esysContext &&
-	    (0 != sdoTPMTSSContextCleanUp(&esysContext, &authSessionHandle,
-					  &primaryKeyHandle))) {
-		LOG(LOG_ERROR, "Failed to tear down all the TSS context.\n");
-	}
+	/* On failure the context may be the cause, the next user remakes it */
+	if (ret)
+		sdoTPMClose();
 
 	return ret;
 }
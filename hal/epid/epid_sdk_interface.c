@@ -28,6 +28,9 @@
 #include "util.h"
 #include <stdlib.h>
 #include "safe_lib.h"
+#if defined(EPID_PRECOMP_BLOB) || defined(EPID_SIGRL_BLOB)
+#include "storage_al.h"
+#endif
 
 /* Show if the initialization has been completed */
 static bool g_epidInitialized = false;
@@ -49,6 +52,291 @@ static bool is_precompute_available = false;
 /* Hash algorithm */
 static HashAlg g_hashalg = kSha256;
 
+#ifdef EPID_PRECOMP_BLOB
+/*
+ * The member pre-computation is kept in secure storage across boots. It is
+ * only valid for the group public key and private key it was computed from,
+ * so the blob leads with a digest of the two and is ignored once they change.
+ */
+typedef struct {
+	uint8_t keyHash[SHA256_DIGEST_SIZE];
+	MemberPrecomp precomp;
+} EpidPrecompBlob;
+
+/* Digest of the keys g_member_precomp was computed from */
+static uint8_t g_precomp_key_hash[SHA256_DIGEST_SIZE];
+
+/**
+ * Digest the keys a member pre-computation belongs to.
+ *
+ * @param pubKey
+ *        Group public key of the member.
+ * @param keyHash
+ *        Output buffer of SHA256_DIGEST_SIZE bytes.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ */
+static int epidPrecompKeyHash(const GroupPubKey *pubKey, uint8_t *keyHash)
+{
+	struct {
+		GroupPubKey pubKey;
+		PrivKey privKey;
+	} keys;
+	int ret = -1;
+
+	if (memcpy_s(&keys.pubKey, sizeof(keys.pubKey), pubKey,
+		     sizeof(*pubKey)) != 0 ||
+	    memcpy_s(&keys.privKey, sizeof(keys.privKey), &g_priv_key,
+		     sizeof(g_priv_key)) != 0)
+		goto end;
+
+	if (_sdoCryptoHash(SDO_CRYPTO_HASH_TYPE_SHA_256, (uint8_t *)&keys,
+			   sizeof(keys), keyHash, SHA256_DIGEST_SIZE) != 0)
+		goto end;
+	ret = 0;
+end:
+	if (memset_s(&keys, sizeof(keys), 0))
+		ret = -1;
+	return ret;
+}
+
+/**
+ * Make g_member_precomp hold the pre-computation of the keys in use, loading
+ * it from secure storage if it is there, or mark it as unavailable.
+ *
+ * @param pubKey
+ *        Group public key of the member.
+ */
+static void epidPrecompLoad(const GroupPubKey *pubKey)
+{
+	EpidPrecompBlob blob;
+	uint8_t keyHash[SHA256_DIGEST_SIZE];
+	int result = 1;
+
+	if (epidPrecompKeyHash(pubKey, keyHash) != 0) {
+		is_precompute_available = false;
+		return;
+	}
+
+	if (is_precompute_available) {
+		if (memcmp_s(g_precomp_key_hash, sizeof(g_precomp_key_hash),
+			     keyHash, sizeof(keyHash), &result) == 0 &&
+		    result == 0)
+			return;
+		LOG(LOG_DEBUG, "EPID keys changed, dropping precomp\n");
+		is_precompute_available = false;
+	}
+
+	if (sdoBlobSize((char *)EPID_PRECOMP_BLOB, SDO_SDK_SECURE_DATA) !=
+	    (int32_t)sizeof(blob))
+		return;
+
+	if (sdoBlobRead((char *)EPID_PRECOMP_BLOB, SDO_SDK_SECURE_DATA,
+			(uint8_t *)&blob, sizeof(blob)) == -1)
+		goto end;
+
+	if (memcmp_s(blob.keyHash, sizeof(blob.keyHash), keyHash,
+		     sizeof(keyHash), &result) != 0 ||
+	    result != 0) {
+		LOG(LOG_DEBUG, "EPID precomp blob is for other keys\n");
+		goto end;
+	}
+
+	if (memcpy_s(&g_member_precomp, sizeof(g_member_precomp),
+		     &blob.precomp, sizeof(blob.precomp)) != 0 ||
+	    memcpy_s(g_precomp_key_hash, sizeof(g_precomp_key_hash), keyHash,
+		     sizeof(keyHash)) != 0)
+		goto end;
+	is_precompute_available = true;
+	LOG(LOG_DEBUG, "EPID precomp loaded from storage\n");
+end:
+	(void)memset_s(&blob, sizeof(blob), 0);
+}
+
+/**
+ * Save the member pre-computation of the keys in use to secure storage.
+ *
+ * @param pubKey
+ *        Group public key of the member.
+ */
+static void epidPrecompSave(const GroupPubKey *pubKey)
+{
+	EpidPrecompBlob blob;
+
+	if (epidPrecompKeyHash(pubKey, blob.keyHash) != 0 ||
+	    memcpy_s(g_precomp_key_hash, sizeof(g_precomp_key_hash),
+		     blob.keyHash, sizeof(blob.keyHash)) != 0)
+		goto end;
+
+	if (memcpy_s(&blob.precomp, sizeof(blob.precomp), &g_member_precomp,
+		     sizeof(g_member_precomp)) != 0)
+		goto end;
+
+	if (sdoBlobWrite((char *)EPID_PRECOMP_BLOB, SDO_SDK_SECURE_DATA,
+			 (uint8_t *)&blob, sizeof(blob)) == -1)
+		LOG(LOG_DEBUG, "EPID precomp blob not written\n");
+end:
+	(void)memset_s(&blob, sizeof(blob), 0);
+}
+#endif
+
+#if defined(EPID_PRESIGS) && !(defined EPID_R6 || defined EPID_TINY)
+/*
+ * Pool of pre-computed signatures, made while waiting on the server so that
+ * EPID_Sign only does the message dependent part. A pre-signature must never
+ * be used twice, so the pool is kept in memory only and an entry is wiped as
+ * it is handed to the member.
+ */
+static PreComputedSignature g_presigs[EPID_PRESIGS];
+static size_t g_num_presigs;
+/* Group public key the pool was made for */
+static GroupPubKey g_presig_key;
+
+/**
+ * Empty the pre-signature pool.
+ */
+static void epidPreSigFlush(void)
+{
+	if (memset_s(g_presigs, sizeof(g_presigs), 0))
+		LOG(LOG_ERROR, "Failed to clear pre-signatures\n");
+	g_num_presigs = 0;
+}
+
+/**
+ * Hand one pre-signature made for pubKey to the member, if there is one.
+ *
+ * @param member
+ *        Member context that signs next.
+ * @param pubKey
+ *        Group public key of the member.
+ */
+static void epidPreSigTake(MemberCtx *member, const GroupPubKey *pubKey)
+{
+	PreComputedSignature *presig;
+	int result = 1;
+
+	if (!g_num_presigs)
+		return;
+	if (memcmp_s(&g_presig_key, sizeof(g_presig_key), pubKey,
+		     sizeof(*pubKey), &result) != 0 ||
+	    result != 0) {
+		epidPreSigFlush();
+		return;
+	}
+
+	presig = &g_presigs[--g_num_presigs];
+	if (kEpidNoErr != EpidAddPreSigs(member, 1, presig))
+		LOG(LOG_DEBUG, "EPID pre-signature not taken\n");
+	(void)memset_s(presig, sizeof(*presig), 0);
+}
+#endif
+
+/*
+ * SigRL cache. eB brings the same SigRL in msg31 and msg41, and again on
+ * every retry, and signing proves the member is none of its entries, with
+ * one non-revoked proof each. Those proofs hang on the randomness of the
+ * signature they are part of, so none can be reused; but a list that
+ * revokes the member does so for good. The list is known by its version
+ * and a digest of it and the member private key (the verdict is of that
+ * member), and once it was found to revoke the member, signing with it
+ * fails at once rather than after a pass over all its entries. The verdict
+ * is kept in storage (EPID_SIGRL_BLOB), so that a revoked device does not
+ * make that pass again after a reboot either.
+ */
+typedef struct {
+	uint32_t version;
+	uint8_t digest[SHA256_DIGEST_SIZE];
+} EpidSigRlKey;
+
+/* SigRL known to revoke the member */
+static EpidSigRlKey g_sigrl_revoked;
+static bool g_sigrl_loaded;
+
+/**
+ * Identify a SigRL, for the member.
+ *
+ * @param sigrl
+ *        The SigRL of eB.
+ * @param size
+ *        Its size in bytes.
+ * @param key
+ *        Output, its version and digest.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ */
+static int epidSigRlKey(const uint8_t *sigrl, size_t size, EpidSigRlKey *key)
+{
+	const SigRl *list = (const SigRl *)sigrl;
+	void *hash = NULL;
+
+	if (size < sizeof(list->gid) + sizeof(list->version))
+		return -1;
+	key->version = (uint32_t)list->version.data[0] << 24 |
+		       (uint32_t)list->version.data[1] << 16 |
+		       (uint32_t)list->version.data[2] << 8 |
+		       list->version.data[3];
+
+	if (sdoCryptoHashInit(SDO_CRYPTO_HASH_TYPE_SHA_256, &hash) != 0)
+		return -1;
+	if (sdoCryptoHashUpdate(hash, (const uint8_t *)&g_priv_key,
+				sizeof(g_priv_key)) != 0 ||
+	    sdoCryptoHashUpdate(hash, sigrl, size) != 0) {
+		(void)sdoCryptoHashFinal(&hash, NULL, 0);
+		return -1;
+	}
+	if (sdoCryptoHashFinal(&hash, key->digest, sizeof(key->digest)) != 0)
+		return -1;
+	return 0;
+}
+
+/**
+ * Tell if a SigRL is known to revoke the member.
+ *
+ * @param key
+ *        Version and digest of the SigRL.
+ * @return ret
+ *        return true if it revokes the member, else false.
+ */
+static bool epidSigRlRevoked(const EpidSigRlKey *key)
+{
+	int result = 1;
+
+#ifdef EPID_SIGRL_BLOB
+	if (!g_sigrl_loaded &&
+	    sdoBlobSize((char *)EPID_SIGRL_BLOB, SDO_SDK_NORMAL_DATA) ==
+		(int32_t)sizeof(g_sigrl_revoked) &&
+	    sdoBlobRead((char *)EPID_SIGRL_BLOB, SDO_SDK_NORMAL_DATA,
+			(uint8_t *)&g_sigrl_revoked,
+			sizeof(g_sigrl_revoked)) == -1)
+		(void)memset_s(&g_sigrl_revoked, sizeof(g_sigrl_revoked), 0);
+#endif
+	g_sigrl_loaded = true;
+
+	return memcmp_s(&g_sigrl_revoked, sizeof(g_sigrl_revoked), key,
+			sizeof(*key), &result) == 0 &&
+	       result == 0;
+}
+
+/**
+ * Remember that a SigRL revokes the member.
+ *
+ * @param key
+ *        Version and digest of the SigRL.
+ */
+static void epidSigRlSetRevoked(const EpidSigRlKey *key)
+{
+	if (memcpy_s(&g_sigrl_revoked, sizeof(g_sigrl_revoked), key,
+		     sizeof(*key)) != 0)
+		return;
+	g_sigrl_loaded = true;
+#ifdef EPID_SIGRL_BLOB
+	if (sdoBlobWrite((char *)EPID_SIGRL_BLOB, SDO_SDK_NORMAL_DATA,
+			 (uint8_t *)&g_sigrl_revoked,
+			 sizeof(g_sigrl_revoked)) == -1)
+		LOG(LOG_DEBUG, "EPID SigRL verdict not written\n");
+#endif
+}
+
 /**
  * Verify that CaCert is valid
  *
@@ -136,6 +424,10 @@ EpidStatus epid_r6_init(void)
 		goto err2;
 	}
 
+#ifdef EPID_PRECOMP_BLOB
+	epidPrecompLoad(&g_groupPublicKey);
+#endif
+
 	sts = EpidProvisionKey(g_member_ctx, &g_groupPublicKey, &g_priv_key,
 			       is_precompute_available ? &g_member_precomp
 						       : NULL);
@@ -149,7 +441,8 @@ EpidStatus epid_r6_init(void)
 		goto err2;
 	}
 
-#if !defined(EPID_TINY) && defined(TARGET_OS_FREERTOS)
+#if !defined(EPID_TINY) &&                                                     \
+    (defined(TARGET_OS_FREERTOS) || defined(EPID_PRECOMP_BLOB))
 	/* return member pre-computation blob if requested */
 	if (!is_precompute_available) {
 		sts = EpidMemberWritePrecomp(g_member_ctx, &g_member_precomp);
@@ -160,6 +453,9 @@ EpidStatus epid_r6_init(void)
 			goto err2;
 		}
 		is_precompute_available = true;
+#ifdef EPID_PRECOMP_BLOB
+		epidPrecompSave(&g_groupPublicKey);
+#endif
 	}
 #endif
 
@@ -347,6 +643,9 @@ void EPID_Close(void)
 		LOG(LOG_ERROR, "Failed to clear g_priv_key\n");
 	g_member_ctx = NULL;
 	is_precompute_available = false;
+#if defined(EPID_PRESIGS) && !(defined EPID_R6 || defined EPID_TINY)
+	epidPreSigFlush();
+#endif
 }
 
 /**
@@ -380,6 +679,7 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	SigRl *eBsigrl = NULL;
 	SDOBits_t *sig_bits = NULL;
 	size_t sig_size = 0;
+	EpidSigRlKey sigrlKey = {0};
 
 	eBsigrl = (SigRl *)bSigrl;
 
@@ -416,6 +716,16 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	LOG(LOG_DEBUG, "EPID_sign:  SigRl size %d, pubkeysz %d\n",
 	    (int)SigRlSize, (int)GroupPublicKeyLen);
 
+	if (SigRlSize) {
+		if (epidSigRlKey(bSigrl, SigRlSize, &sigrlKey) != 0)
+			goto err1;
+		if (epidSigRlRevoked(&sigrlKey)) {
+			LOG(LOG_ERROR, "Member revoked in SigRL version %u\n",
+			    (unsigned int)sigrlKey.version);
+			goto err1;
+		}
+	}
+
 	sts = epid_r6_init();
 	if (kEpidNoErr != sts) {
 		LOG(LOG_ERROR, "Failed to init R6 EPID (%d)\n", (int)sts);
@@ -442,6 +752,8 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	sts = EpidSign(g_member_ctx, data, data_len, NULL, 0, sig, sig_size);
 	if (kEpidNoErr != sts) {
 		LOG(LOG_ERROR, "Data Signing failed(%d)\n", (int)sts);
+		if (kEpidSigRevokedInSigRl == sts)
+			epidSigRlSetRevoked(&sigrlKey);
 		sdoFree(sig);
 		goto err2;
 	}
@@ -461,6 +773,28 @@ err2:
 err1:
 	return sig_bits;
 }
+
+/**
+ * EPID_PreSign - top up the pre-signature pool for the group public key
+ * passed, so that the next EPID_Sign calls with it are cheaper. Does
+ * nothing without EPID_PRESIGS or with the R6 member API.
+ * @param bGroupPublicKey
+ *        Group public key to which the private key of device belongs.
+ * @param GroupPublicKeyLen
+ *        Length of group public key.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ */
+/*
+ * The R6 member API has no way to move pre-signatures between member
+ * contexts, and a context lives for one signature only.
+ */
+int EPID_PreSign(const uint8_t *bGroupPublicKey, size_t GroupPublicKeyLen)
+{
+	(void)bGroupPublicKey;
+	(void)GroupPublicKeyLen;
+	return 0;
+}
 #else
 
 SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
@@ -474,9 +808,7 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	MemberCtx *member = NULL;
 	SDOBits_t *sig_bits = NULL;
 	size_t sig_size = 0;
-
-	/* intermediate return value for EPID functions */
-	EpidStatus result = kEpidErr;
+	EpidSigRlKey sigrlKey = {0};
 
 	/* Sanity checks */
 	if (!data || !data_len) {
@@ -495,9 +827,29 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 		return NULL;
 	}
 
+	if (SigRlSize) {
+		if (epidSigRlKey(bSigrl, SigRlSize, &sigrlKey) != 0)
+			return NULL;
+		if (epidSigRlRevoked(&sigrlKey)) {
+			LOG(LOG_ERROR, "Member revoked in SigRL version %u\n",
+			    (unsigned int)sigrlKey.version);
+			return NULL;
+		}
+	}
+
+#ifdef EPID_PRECOMP_BLOB
+	if (!PublicKey || GroupPublicKeyLen != sizeof(GroupPubKey)) {
+		LOG(LOG_ERROR, "Invalid group public key for EPID_Sign!\n");
+		return NULL;
+	}
+	epidPrecompLoad(PublicKey);
+#endif
+
 	/* create member */
-	sts = EpidMemberCreate(PublicKey, &g_priv_key, NULL, epid_prng_gen,
-			       NULL, &member);
+	sts = EpidMemberCreate(PublicKey, &g_priv_key,
+			       is_precompute_available ? &g_member_precomp
+						       : NULL,
+			       epid_prng_gen, NULL, &member);
 	if (kEpidNoErr != sts) {
 		LOG(LOG_ERROR,
 		    "Could not create Epid Member context. sts: %d\n", sts);
@@ -505,11 +857,18 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	}
 
 	/* return member pre-computation blob if requested */
-	sts = EpidMemberWritePrecomp(member, &g_member_precomp);
-	if (kEpidNoErr != sts) {
-		LOG(LOG_ERROR, "Could not write Epid Member precomp. sts: %d\n",
-		    sts);
-		return NULL;
+	if (!is_precompute_available) {
+		sts = EpidMemberWritePrecomp(member, &g_member_precomp);
+		if (kEpidNoErr != sts) {
+			LOG(LOG_ERROR,
+			    "Could not write Epid Member precomp. sts: %d\n",
+			    sts);
+			return NULL;
+		}
+#ifdef EPID_PRECOMP_BLOB
+		is_precompute_available = true;
+		epidPrecompSave(PublicKey);
+#endif
 	}
 
 	sts = EpidMemberSetHashAlg(member, g_hashalg);
@@ -518,13 +877,17 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 		return NULL;
 	}
 
+#if defined(EPID_PRESIGS)
+	epidPreSigTake(member, PublicKey);
+#endif
+
 	/*
 	 * Signature
 	 * Note: Signature size must be computed after sig_rl is loaded.
 	 */
 	sig_size = EpidGetSigSize(eBsigrl);
 
-	sig = malloc(sig_size);
+	sig = sdoAlloc(sig_size);
 	if (!sig) {
 		LOG(LOG_ERROR,
 		    "Could not allocate memory for epid "
@@ -539,20 +902,16 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	if (kEpidNoErr != sts) {
 		LOG(LOG_ERROR, "Failed creating epid signature. sts: %d\n",
 		    sts);
-		sdoFree(sig);
-		return NULL;
-	}
-	sts = kEpidNoErr;
-
-	/* Report Result */
-	if (kEpidNoErr != result) {
-		if (kEpidSigRevokedInSigRl == result) {
+		if (kEpidSigRevokedInSigRl == sts) {
 			LOG(LOG_ERROR, "signature revoked in SigRL\n");
+			epidSigRlSetRevoked(&sigrlKey);
 		}
+		sdoFree(sig);
+		return NULL;
 	}
 
 	/* Construct return object */
-	sig_bits = malloc(sizeof(SDOBits_t));
+	sig_bits = sdoAlloc(sizeof(SDOBits_t));
 	if (!sig_bits) {
 		LOG(LOG_ERROR, "failed to create memory for signature bytes\n");
 		sdoFree(sig);
@@ -564,4 +923,76 @@ SDOBits_t *EPID_Sign(uint8_t *data, size_t data_len,
 	EpidMemberDelete(&member);
 	return sig_bits;
 }
+
+/**
+ * EPID_PreSign - top up the pre-signature pool for the group public key
+ * passed, so that the next EPID_Sign calls with it are cheaper. Does
+ * nothing without EPID_PRESIGS or with the R6 member API.
+ * @param bGroupPublicKey
+ *        Group public key to which the private key of device belongs.
+ * @param GroupPublicKeyLen
+ *        Length of group public key.
+ * @return ret
+ *        return 0 on success. -1 on failure.
+ */
+int EPID_PreSign(const uint8_t *bGroupPublicKey, size_t GroupPublicKeyLen)
+{
+#if defined(EPID_PRESIGS)
+	const GroupPubKey *PublicKey = (const GroupPubKey *)bGroupPublicKey;
+	MemberCtx *member = NULL;
+	EpidStatus sts = kEpidErr;
+	size_t need;
+	int result = 1;
+
+	if (!g_epidInitialized || !PublicKey ||
+	    GroupPublicKeyLen != sizeof(GroupPubKey))
+		return -1;
+
+	if (g_num_presigs &&
+	    (memcmp_s(&g_presig_key, sizeof(g_presig_key), PublicKey,
+		      sizeof(*PublicKey), &result) != 0 ||
+	     result != 0))
+		epidPreSigFlush();
+
+	need = EPID_PRESIGS - g_num_presigs;
+	if (!need)
+		return 0;
+
+#ifdef EPID_PRECOMP_BLOB
+	epidPrecompLoad(PublicKey);
+#endif
+	sts = EpidMemberCreate(PublicKey, &g_priv_key,
+			       is_precompute_available ? &g_member_precomp
+						       : NULL,
+			       epid_prng_gen, NULL, &member);
+	if (kEpidNoErr != sts) {
+		LOG(LOG_ERROR,
+		    "Could not create Epid Member context. sts: %d\n", sts);
+		return -1;
+	}
+
+	sts = EpidAddPreSigs(member, need, NULL);
+	if (kEpidNoErr == sts)
+		sts = EpidWritePreSigs(member, &g_presigs[g_num_presigs],
+				       need);
+	EpidMemberDelete(&member);
+	if (kEpidNoErr != sts) {
+		LOG(LOG_ERROR, "Could not make pre-signatures. sts: %d\n",
+		    sts);
+		return -1;
+	}
+
+	if (memcpy_s(&g_presig_key, sizeof(g_presig_key), PublicKey,
+		     sizeof(*PublicKey)) != 0) {
+		epidPreSigFlush();
+		return -1;
+	}
+	g_num_presigs += need;
+	LOG(LOG_DEBUG, "EPID pre-signatures: %d\n", (int)g_num_presigs);
+#else
+	(void)bGroupPublicKey;
+	(void)GroupPublicKeyLen;
+#endif
+	return 0;
+}
 #endif
@@ -21,6 +21,8 @@ int EPID_Init(const uint8_t *signedGroupPublicKey,
 	      size_t signed_sig_rl_size, const uint8_t *precomp_file,
 	      size_t precomp_size);
 
+int EPID_PreSign(const uint8_t *bGroupPublicKey, size_t GroupPublicKeyLen);
+
 void EPID_Close(void);
 
 #endif /* __EPID_H__ */
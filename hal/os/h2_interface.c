@@ -0,0 +1,815 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * HTTP/2 Layer
+ *
+ * The file implements the framing (RFC 7540) and the header compression
+ * (HPACK, RFC 7541) of the REST messages carried over HTTP/2. A request
+ * header is encoded from the REST context, the fields that repeat from
+ * message to message (authority, content type, authorization) indexed in
+ * the dynamic table, so that they cost a byte each after the first
+ * message. A response header is decoded into HTTP/1.1 text, which
+ * getRESTContentLength() processes as it does that of HTTP/1.1.
+ */
+
+#include "util.h"
+#include "network_al.h"
+#include "safe_lib.h"
+#include "snprintf_s.h"
+#include "h2_interface.h"
+#include <arpa/inet.h>
+
+#if H2_TABLE_SIZE > H2_DEFAULT_TABLE_SIZE
+#error "H2_TABLE_SIZE is larger than the default size"
+#endif
+
+/* Longest name and value of a header field decoded */
+#define HPACK_NAME_MAX 128
+#define HPACK_VALUE_MAX H2_TABLE_SIZE
+/* Overhead of an entry of the dynamic table, as RFC 7541 counts it */
+#define HPACK_ENTRY_OVERHEAD 32
+/* Bytes the lengths of the name and value of a stored entry take */
+#define HPACK_ENTRY_LENS 4
+
+/* Static table, RFC 7541 Appendix A */
+static const struct {
+	const char *name;
+	const char *value;
+} hpackStatic[] = {
+	{":authority", ""}, // 1
+	{":method", "GET"}, // 2
+	{":method", "POST"}, // 3
+	{":path", "/"}, // 4
+	{":path", "/index.html"}, // 5
+	{":scheme", "http"}, // 6
+	{":scheme", "https"}, // 7
+	{":status", "200"}, // 8
+	{":status", "204"}, // 9
+	{":status", "206"}, // 10
+	{":status", "304"}, // 11
+	{":status", "400"}, // 12
+	{":status", "404"}, // 13
+	{":status", "500"}, // 14
+	{"accept-charset", ""}, // 15
+	{"accept-encoding", "gzip, deflate"}, // 16
+	{"accept-language", ""}, // 17
+	{"accept-ranges", ""}, // 18
+	{"accept", ""}, // 19
+	{"access-control-allow-origin", ""}, // 20
+	{"age", ""}, // 21
+	{"allow", ""}, // 22
+	{"authorization", ""}, // 23
+	{"cache-control", ""}, // 24
+	{"content-disposition", ""}, // 25
+	{"content-encoding", ""}, // 26
+	{"content-language", ""}, // 27
+	{"content-length", ""}, // 28
+	{"content-location", ""}, // 29
+	{"content-range", ""}, // 30
+	{"content-type", ""}, // 31
+	{"cookie", ""}, // 32
+	{"date", ""}, // 33
+	{"etag", ""}, // 34
+	{"expect", ""}, // 35
+	{"expires", ""}, // 36
+	{"from", ""}, // 37
+	{"host", ""}, // 38
+	{"if-match", ""}, // 39
+	{"if-modified-since", ""}, // 40
+	{"if-none-match", ""}, // 41
+	{"if-range", ""}, // 42
+	{"if-unmodified-since", ""}, // 43
+	{"last-modified", ""}, // 44
+	{"link", ""}, // 45
+	{"location", ""}, // 46
+	{"max-forwards", ""}, // 47
+	{"proxy-authenticate", ""}, // 48
+	{"proxy-authorization", ""}, // 49
+	{"range", ""}, // 50
+	{"referer", ""}, // 51
+	{"refresh", ""}, // 52
+	{"retry-after", ""}, // 53
+	{"server", ""}, // 54
+	{"set-cookie", ""}, // 55
+	{"strict-transport-security", ""}, // 56
+	{"transfer-encoding", ""}, // 57
+	{"user-agent", ""}, // 58
+	{"vary", ""}, // 59
+	{"via", ""}, // 60
+	{"www-authenticate", ""}, // 61
+};
+#define HPACK_STATIC_COUNT (sizeof(hpackStatic) / sizeof(hpackStatic[0]))
+
+/*
+ * Huffman code, RFC 7541 Appendix B. The code is canonical: it is given by
+ * the number of codes of each length and by the symbols in code order.
+ */
+#define HPACK_HUFF_MAX_LEN 30
+static const uint8_t hpackHuffCount[HPACK_HUFF_MAX_LEN + 1] = {
+	0, 0, 0, 0, 0, 10, 26, 32, 6,  0,  5,  3,  2,  6, 2, 3,
+	0, 0, 0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4};
+#define HPACK_EOS 256
+static const uint16_t hpackHuffSym[HPACK_EOS + 1] = {
+	48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51, 52,
+	53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109, 110,
+	112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76, 77, 78,
+	79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118, 119, 120,
+	121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39, 43, 124, 35,
+	62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92, 195, 208, 128,
+	130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177, 179,
+	209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156,
+	160, 163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196,
+	198, 228, 232, 233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150,
+	151, 152, 155, 157, 158, 165, 166, 168, 174, 175, 180, 182, 183, 188,
+	191, 197, 231, 239, 9, 142, 144, 145, 148, 159, 171, 206, 215, 225, 236,
+	237, 199, 207, 234, 235, 192, 193, 200, 201, 202, 205, 210, 213, 218,
+	219, 238, 240, 242, 243, 255, 203, 204, 211, 212, 214, 221, 222, 223,
+	241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254, 2, 3, 4, 5, 6, 7,
+	8, 11, 12, 14, 15, 16, 17, 18, 19, 20, 21, 23, 24, 25, 26, 27, 28, 29,
+	30, 31, 127, 220, 249, 10, 13, 22, 256};
+
+/**
+ * Write the header of a frame.
+ *
+ * @param buf - out, H2_FRAME_HDR_LEN bytes.
+ * @param len - length of the payload.
+ * @param type - frame type.
+ * @param flags - frame flags.
+ * @param stream - stream identifier, 0 for the connection.
+ * @return H2_FRAME_HDR_LEN.
+ */
+size_t h2PutFrameHeader(uint8_t *buf, uint32_t len, uint8_t type,
+			uint8_t flags, uint32_t stream)
+{
+	buf[0] = (len >> 16) & 0xff;
+	buf[1] = (len >> 8) & 0xff;
+	buf[2] = len & 0xff;
+	buf[3] = type;
+	buf[4] = flags;
+	buf[5] = (stream >> 24) & 0x7f;
+	buf[6] = (stream >> 16) & 0xff;
+	buf[7] = (stream >> 8) & 0xff;
+	buf[8] = stream & 0xff;
+	return H2_FRAME_HDR_LEN;
+}
+
+/**
+ * Read the header of a frame.
+ *
+ * @param buf - H2_FRAME_HDR_LEN bytes received.
+ * @param frame - out frame header.
+ */
+void h2GetFrameHeader(const uint8_t *buf, h2Frame_t *frame)
+{
+	frame->len = ((uint32_t)buf[0] << 16) | ((uint32_t)buf[1] << 8) |
+		     buf[2];
+	frame->type = buf[3];
+	frame->flags = buf[4];
+	frame->stream = ((uint32_t)(buf[5] & 0x7f) << 24) |
+			((uint32_t)buf[6] << 16) | ((uint32_t)buf[7] << 8) |
+			buf[8];
+}
+
+/**
+ * Initialize a dynamic table, empty and of H2_TABLE_SIZE. For the encoder,
+ * a size below the default is announced in the first header block.
+ *
+ * @param t - table.
+ */
+void h2TableInit(h2Table_t *t)
+{
+	t->used = 0;
+	t->count = 0;
+	t->size = 0;
+	t->maxSize = H2_TABLE_SIZE;
+	t->announce = H2_TABLE_SIZE != H2_DEFAULT_TABLE_SIZE;
+}
+
+/**
+ * Internal API: offset of an entry of a dynamic table.
+ *
+ * @param t - table.
+ * @param idx - entry, 0 for the newest.
+ * @param nameLen - out length of its name.
+ * @param valLen - out length of its value.
+ * @return offset of the entry in the data of the table.
+ */
+static size_t hpackEntry(const h2Table_t *t, uint32_t idx, size_t *nameLen,
+			 size_t *valLen)
+{
+	size_t off = 0;
+	const uint8_t *p;
+
+	for (;;) {
+		p = &t->data[off];
+		*nameLen = ((size_t)p[0] << 8) | p[1];
+		*valLen = ((size_t)p[2] << 8) | p[3];
+		if (!idx--)
+			return off;
+		off += HPACK_ENTRY_LENS + *nameLen + *valLen;
+	}
+}
+
+/**
+ * Internal API: evict the oldest entries of a dynamic table, until an
+ * entry of the given size fits.
+ *
+ * @param t - table.
+ * @param room - size of the entry to fit.
+ */
+static void hpackEvict(h2Table_t *t, uint32_t room)
+{
+	size_t nameLen, valLen;
+
+	while (t->count && t->size + room > t->maxSize) {
+		(void)hpackEntry(t, t->count - 1, &nameLen, &valLen);
+		t->used -= HPACK_ENTRY_LENS + nameLen + valLen;
+		t->size -= HPACK_ENTRY_OVERHEAD + nameLen + valLen;
+		t->count--;
+	}
+}
+
+/**
+ * Change the size of a dynamic table, evicting the entries that no longer
+ * fit. For the encoder, the peer has set the size the decoder has; the
+ * change is announced in the next header block.
+ *
+ * @param t - table.
+ * @param maxSize - size, at most H2_TABLE_SIZE is used.
+ */
+void h2TableResize(h2Table_t *t, uint32_t maxSize)
+{
+	if (maxSize > H2_TABLE_SIZE)
+		maxSize = H2_TABLE_SIZE;
+	if (maxSize == t->maxSize)
+		return;
+	t->maxSize = maxSize;
+	t->announce = true;
+	hpackEvict(t, 0);
+}
+
+/**
+ * Internal API: add an entry to a dynamic table, as the newest one. An
+ * entry larger than the table empties it.
+ *
+ * @param t - table.
+ * @param name - name of the entry.
+ * @param nameLen - length of name.
+ * @param val - value of the entry.
+ * @param valLen - length of val.
+ * @retval true on success, false otherwise.
+ */
+static bool hpackInsert(h2Table_t *t, const uint8_t *name, size_t nameLen,
+			const uint8_t *val, size_t valLen)
+{
+	size_t stored = HPACK_ENTRY_LENS + nameLen + valLen;
+	uint8_t *p = t->data;
+
+	if (HPACK_ENTRY_OVERHEAD + nameLen + valLen > t->maxSize) {
+		hpackEvict(t, t->maxSize + 1);
+		return true;
+	}
+	hpackEvict(t, HPACK_ENTRY_OVERHEAD + nameLen + valLen);
+
+	if ((t->used &&
+	     memmove_s(p + stored, sizeof(t->data) - stored, p, t->used) !=
+		 0) ||
+	    (nameLen && memcpy_s(p + HPACK_ENTRY_LENS,
+				 sizeof(t->data) - HPACK_ENTRY_LENS, name,
+				 nameLen) != 0) ||
+	    (valLen &&
+	     memcpy_s(p + HPACK_ENTRY_LENS + nameLen,
+		      sizeof(t->data) - HPACK_ENTRY_LENS - nameLen, val,
+		      valLen) != 0)) {
+		LOG(LOG_ERROR, "HPACK: table update failed\n");
+		return false;
+	}
+	p[0] = (nameLen >> 8) & 0xff;
+	p[1] = nameLen & 0xff;
+	p[2] = (valLen >> 8) & 0xff;
+	p[3] = valLen & 0xff;
+	t->used += stored;
+	t->size += HPACK_ENTRY_OVERHEAD + nameLen + valLen;
+	t->count++;
+	return true;
+}
+
+/**
+ * Internal API: write an integer with an N-bit prefix.
+ *
+ * @param out - output buffer.
+ * @param outSize - size of out.
+ * @param pos - in/out position in out.
+ * @param first - bits of the first byte above the prefix.
+ * @param prefix - bits of the prefix.
+ * @param val - integer.
+ * @retval true on success, false if out is full.
+ */
+static bool hpackPutInt(uint8_t *out, size_t outSize, size_t *pos,
+			uint8_t first, uint8_t prefix, uint32_t val)
+{
+	uint32_t max = (1u << prefix) - 1;
+
+	if (*pos >= outSize)
+		return false;
+	if (val < max) {
+		out[(*pos)++] = first | val;
+		return true;
+	}
+	out[(*pos)++] = first | max;
+	for (val -= max; val >= 0x80; val >>= 7) {
+		if (*pos >= outSize)
+			return false;
+		out[(*pos)++] = (val & 0x7f) | 0x80;
+	}
+	if (*pos >= outSize)
+		return false;
+	out[(*pos)++] = val;
+	return true;
+}
+
+/**
+ * Internal API: read an integer with an N-bit prefix.
+ *
+ * @param in - header block.
+ * @param len - length of in.
+ * @param pos - in/out position in in.
+ * @param prefix - bits of the prefix.
+ * @param val - out integer.
+ * @retval true on success, false if it is truncated or too large.
+ */
+static bool hpackGetInt(const uint8_t *in, size_t len, size_t *pos,
+			uint8_t prefix, uint32_t *val)
+{
+	uint32_t max = (1u << prefix) - 1;
+	unsigned int shift = 0;
+	uint8_t b;
+
+	if (*pos >= len)
+		return false;
+	*val = in[(*pos)++] & max;
+	if (*val < max)
+		return true;
+	do {
+		/* 28 bits are plenty for any size or index */
+		if (*pos >= len || shift > 21)
+			return false;
+		b = in[(*pos)++];
+		*val += (uint32_t)(b & 0x7f) << shift;
+		shift += 7;
+	} while (b & 0x80);
+	return true;
+}
+
+/**
+ * Internal API: write a string literal, not Huffman coded.
+ *
+ * @retval true on success, false if out is full.
+ */
+static bool hpackPutString(uint8_t *out, size_t outSize, size_t *pos,
+			   const char *str, size_t len)
+{
+	if (!hpackPutInt(out, outSize, pos, 0, 7, (uint32_t)len) ||
+	    len > outSize - *pos)
+		return false;
+	if (len && memcpy_s(out + *pos, outSize - *pos, str, len) != 0)
+		return false;
+	*pos += len;
+	return true;
+}
+
+/**
+ * Internal API: decode a Huffman coded string.
+ *
+ * @param in - coded string.
+ * @param len - length of in.
+ * @param out - decoded string.
+ * @param outSize - size of out.
+ * @param outLen - out length of the decoded string.
+ * @retval true on success, false if the string is malformed or too long.
+ */
+static bool hpackHuffDecode(const uint8_t *in, size_t len, uint8_t *out,
+			    size_t outSize, size_t *outLen)
+{
+	uint32_t code = 0, first = 0, offset = 0;
+	unsigned int bits = 0;
+	uint16_t sym;
+	size_t i, n = 0;
+	int b;
+
+	for (i = 0; i < len; i++) {
+		for (b = 7; b >= 0; b--) {
+			code = (code << 1) | ((in[i] >> b) & 1);
+			bits++;
+			/* codes of this length run from first on */
+			if (code - first < hpackHuffCount[bits]) {
+				sym = hpackHuffSym[offset + code - first];
+				if (sym == HPACK_EOS || n == outSize)
+					return false;
+				out[n++] = (uint8_t)sym;
+				code = first = offset = 0;
+				bits = 0;
+				continue;
+			}
+			if (bits == HPACK_HUFF_MAX_LEN)
+				return false;
+			first = (first + hpackHuffCount[bits]) << 1;
+			offset += hpackHuffCount[bits];
+		}
+	}
+	/* padded with at most 7 bits of EOS, all ones */
+	if (bits > 7 || code != (1u << bits) - 1)
+		return false;
+	*outLen = n;
+	return true;
+}
+
+/**
+ * Internal API: read a string literal.
+ *
+ * @param in - header block.
+ * @param len - length of in.
+ * @param pos - in/out position in in.
+ * @param out - string read.
+ * @param outSize - size of out.
+ * @param outLen - out length of the string.
+ * @retval true on success, false if it is malformed or too long.
+ */
+static bool hpackGetString(const uint8_t *in, size_t len, size_t *pos,
+			   uint8_t *out, size_t outSize, size_t *outLen)
+{
+	bool huffman;
+	uint32_t n;
+
+	if (*pos >= len)
+		return false;
+	huffman = in[*pos] & 0x80;
+	if (!hpackGetInt(in, len, pos, 7, &n) || n > len - *pos)
+		return false;
+
+	if (huffman) {
+		if (!hpackHuffDecode(in + *pos, n, out, outSize, outLen))
+			return false;
+	} else {
+		if (n > outSize ||
+		    (n && memcpy_s(out, outSize, in + *pos, n) != 0))
+			return false;
+		*outLen = n;
+	}
+	*pos += n;
+	return true;
+}
+
+/**
+ * Internal API: tell if len bytes of a and b are the same.
+ */
+static bool hpackSame(const void *a, const void *b, size_t len)
+{
+	int diff = 1;
+
+	return !len || (memcmp_s(a, len, b, len, &diff) == 0 && diff == 0);
+}
+
+/**
+ * Internal API: write a header field, as an index of a table entry if one
+ * has its name and value, as a literal otherwise. A literal added to the
+ * dynamic table is sent as an index next time.
+ *
+ * @param enc - dynamic table of the encoder.
+ * @param out - header block.
+ * @param outSize - size of out.
+ * @param pos - in/out position in out.
+ * @param name - lowercase name.
+ * @param val - value.
+ * @param valLen - length of val.
+ * @param index - true to add the field to the dynamic table.
+ * @retval true on success, false if out is full.
+ */
+static bool hpackPutField(h2Table_t *enc, uint8_t *out, size_t outSize,
+			  size_t *pos, const char *name, const char *val,
+			  size_t valLen, bool index)
+{
+	size_t nameLen = strnlen_s(name, HPACK_NAME_MAX);
+	size_t off, eName, eVal;
+	uint32_t i, nameIdx = 0;
+
+	for (i = 0; i < HPACK_STATIC_COUNT; i++) {
+		if (strcmp(hpackStatic[i].name, name) != 0)
+			continue;
+		if (strnlen_s(hpackStatic[i].value, HPACK_NAME_MAX) ==
+			valLen &&
+		    hpackSame(hpackStatic[i].value, val, valLen))
+			return hpackPutInt(out, outSize, pos, 0x80, 7, i + 1);
+		if (!nameIdx)
+			nameIdx = i + 1;
+	}
+	for (i = 0; i < enc->count; i++) {
+		off = hpackEntry(enc, i, &eName, &eVal);
+		if (eName == nameLen && eVal == valLen &&
+		    hpackSame(&enc->data[off + HPACK_ENTRY_LENS], name,
+			      nameLen) &&
+		    hpackSame(&enc->data[off + HPACK_ENTRY_LENS + nameLen], val,
+			      valLen))
+			return hpackPutInt(out, outSize, pos, 0x80, 7,
+					   HPACK_STATIC_COUNT + 1 + i);
+	}
+
+	/* literal with incremental indexing, or without indexing */
+	if (!hpackPutInt(out, outSize, pos, index ? 0x40 : 0x00,
+			 index ? 6 : 4, nameIdx) ||
+	    (!nameIdx && !hpackPutString(out, outSize, pos, name, nameLen)) ||
+	    !hpackPutString(out, outSize, pos, val, valLen))
+		return false;
+	if (index)
+		return hpackInsert(enc, (const uint8_t *)name, nameLen,
+				   (const uint8_t *)val, valLen);
+	return true;
+}
+
+/**
+ * Internal API: authority of the server of the REST context, "host:port".
+ *
+ * @param rest - REST context.
+ * @param authority - out authority.
+ * @param size - size of authority.
+ * @retval true on success, false otherwise.
+ */
+static bool h2Authority(RestCtx_t *rest, char *authority, size_t size)
+{
+	char ip[INET6_ADDRSTRLEN + 2] = {0};
+	const char *name = rest->hostDNS;
+
+	if (!name && rest->hostIP) {
+		if (rest->hostIP->length == IPV6_ADDR_LEN) {
+			ip[0] = '[';
+			if (!inet_ntop(AF_INET6, rest->hostIP->addr, ip + 1,
+				       INET6_ADDRSTRLEN) ||
+			    strcat_s(ip, sizeof(ip), "]") != 0)
+				return false;
+		} else if (!inet_ntop(AF_INET, rest->hostIP->addr, ip,
+				      sizeof(ip))) {
+			return false;
+		}
+		name = ip;
+	}
+	if (!name) {
+		LOG(LOG_ERROR, "Host IP and DNS both are NULL!\n");
+		return false;
+	}
+	return snprintf_s_si(authority, size, "%s:%d", (char *)name,
+			     rest->portno) > 0;
+}
+
+/**
+ * Encode the header block of a request, the POST of the message of the
+ * REST context: its protocol version, message type and content length.
+ *
+ * @param enc - dynamic table of the encoder.
+ * @param rest - REST context.
+ * @param out - out header block.
+ * @param outSize - size of out.
+ * @param outLen - out length of the header block.
+ * @retval true on success, false otherwise.
+ */
+bool h2EncodeRequest(h2Table_t *enc, RestCtx_t *rest, uint8_t *out,
+		     size_t outSize, size_t *outLen)
+{
+	char authority[HTTP_MAX_URL_SIZE];
+	char path[HTTP_MAX_URL_SIZE];
+	char length[12];
+	const char *type =
+	    rest->cbor ? "application/cbor" : "application/json";
+	size_t pos = 0;
+	bool ok;
+
+	if (!h2Authority(rest, authority, sizeof(authority)) ||
+	    snprintf_s_ii(path, sizeof(path), "/mp/%d/msg/%d", rest->protVer,
+			  rest->msgType) < 0 ||
+	    snprintf_s_i(length, sizeof(length), "%u",
+			 (uint32_t)rest->contentLength) < 0) {
+		LOG(LOG_ERROR, "Snprintf() failed!\n");
+		return false;
+	}
+
+	/* the decoder of the peer is smaller than the default */
+	if (enc->announce) {
+		if (!hpackPutInt(out, outSize, &pos, 0x20, 5, enc->maxSize))
+			return false;
+		enc->announce = false;
+	}
+
+	ok = hpackPutField(enc, out, outSize, &pos, ":method", "POST", 4,
+			   false) &&
+	     hpackPutField(enc, out, outSize, &pos, ":scheme",
+			   rest->tls ? "https" : "http", rest->tls ? 5 : 4,
+			   false) &&
+	     hpackPutField(enc, out, outSize, &pos, ":authority", authority,
+			   strnlen_s(authority, sizeof(authority)), true) &&
+	     hpackPutField(enc, out, outSize, &pos, ":path", path,
+			   strnlen_s(path, sizeof(path)), true) &&
+	     hpackPutField(enc, out, outSize, &pos, "content-type", type,
+			   strnlen_s(type, HTTP_MAX_URL_SIZE), true) &&
+	     hpackPutField(enc, out, outSize, &pos, "content-length", length,
+			   strnlen_s(length, sizeof(length)), false);
+	if (ok && rest->authorization[0])
+		ok = hpackPutField(
+		    enc, out, outSize, &pos, "authorization",
+		    rest->authorization,
+		    strnlen_s(rest->authorization, REST_MAX_TOKEN_SIZE), true);
+	if (!ok) {
+		LOG(LOG_ERROR, "HTTP/2 request header too long\n");
+		return false;
+	}
+	*outLen = pos;
+	return true;
+}
+
+/**
+ * Internal API: append len bytes to the header text.
+ *
+ * @retval true on success, false if they do not fit.
+ */
+static bool h2Append(char *hdr, size_t hdrSize, size_t *hdrLen,
+		     const void *src, size_t len)
+{
+	if (*hdrLen + len > hdrSize)
+		return false;
+	if (len && memcpy_s(hdr + *hdrLen, hdrSize - *hdrLen, src, len) != 0)
+		return false;
+	*hdrLen += len;
+	return true;
+}
+
+/**
+ * Internal API: tell if a field name is the given one.
+ */
+static bool h2IsName(const uint8_t *name, size_t nameLen, const char *is,
+		     size_t isLen)
+{
+	return nameLen == isLen && hpackSame(name, is, isLen);
+}
+
+/**
+ * Internal API: append a header field to the HTTP/1.1 text of a response.
+ * The pseudo-header fields but the status are left out, and so is the
+ * content length: that of the body received is appended after the body.
+ *
+ * @retval true on success, false if the field is misplaced or does not
+ * fit.
+ */
+static bool h2RenderField(const uint8_t *name, size_t nameLen,
+			  const uint8_t *val, size_t valLen, char *hdr,
+			  size_t hdrSize, size_t *hdrLen)
+{
+	static const char status[] = "HTTP/2.0 ";
+
+	if (!hdr)
+		return true;
+	if (h2IsName(name, nameLen, ":status", 7)) {
+		/* the status line goes first */
+		if (*hdrLen || valLen != 3 ||
+		    !h2Append(hdr, hdrSize, hdrLen, status,
+			      sizeof(status) - 1) ||
+		    !h2Append(hdr, hdrSize, hdrLen, val, valLen) ||
+		    !h2Append(hdr, hdrSize, hdrLen, "\r\n", 2)) {
+			*hdrLen = 0;
+			return false;
+		}
+		return true;
+	}
+	if (nameLen && name[0] == ':')
+		return true;
+	if (h2IsName(name, nameLen, "content-length", 14))
+		return true;
+
+	if (!*hdrLen || *hdrLen + nameLen + valLen + 4 > hdrSize ||
+	    !h2Append(hdr, hdrSize, hdrLen, name, nameLen) ||
+	    !h2Append(hdr, hdrSize, hdrLen, ": ", 2) ||
+	    !h2Append(hdr, hdrSize, hdrLen, val, valLen) ||
+	    !h2Append(hdr, hdrSize, hdrLen, "\r\n", 2)) {
+		LOG(LOG_ERROR, "HTTP/2 response header too long\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Decode the header block of a response into the HTTP/1.1 text of its
+ * header, "HTTP/2.0 <status>" and a line per field, without the empty
+ * line ending it. A block to be discarded, for ex: trailers, still has to
+ * be decoded, for the dynamic table to stay in step with the server.
+ *
+ * @param dec - dynamic table of the decoder.
+ * @param blk - header block.
+ * @param len - length of blk.
+ * @param hdr - out header text, NULL to discard the block.
+ * @param hdrSize - size of hdr.
+ * @param hdrLen - out length of the header text.
+ * @retval true on success, false if the block is malformed (which breaks
+ * the connection) or the header does not fit.
+ */
+bool h2DecodeResponse(h2Table_t *dec, const uint8_t *blk, size_t len,
+		      char *hdr, size_t hdrSize, size_t *hdrLen)
+{
+	uint8_t *name = NULL, *val = NULL;
+	size_t pos = 0, nameLen = 0, valLen = 0, off, eName, eVal;
+	uint32_t idx;
+	bool ret = false, index;
+	uint8_t b;
+
+	*hdrLen = 0;
+	name = sdoAlloc(HPACK_NAME_MAX + HPACK_VALUE_MAX);
+	if (!name) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return false;
+	}
+	val = name + HPACK_NAME_MAX;
+
+	while (pos < len) {
+		b = blk[pos];
+		if (b & 0x80) {
+			/* indexed field */
+			if (!hpackGetInt(blk, len, &pos, 7, &idx) || !idx)
+				goto err;
+			index = false;
+		} else if ((b & 0xe0) == 0x20) {
+			/* dynamic table size update */
+			if (!hpackGetInt(blk, len, &pos, 5, &idx) ||
+			    idx > H2_TABLE_SIZE)
+				goto err;
+			dec->maxSize = idx;
+			hpackEvict(dec, 0);
+			continue;
+		} else {
+			/* literal, with incremental indexing or without */
+			index = b & 0x40;
+			if (!hpackGetInt(blk, len, &pos, index ? 6 : 4, &idx))
+				goto err;
+		}
+
+		/* name, and value of an indexed field, of the tables */
+		if (idx && idx <= HPACK_STATIC_COUNT) {
+			nameLen = strnlen_s(hpackStatic[idx - 1].name,
+					    HPACK_NAME_MAX);
+			valLen = strnlen_s(hpackStatic[idx - 1].value,
+					   HPACK_VALUE_MAX);
+			if ((nameLen &&
+			     memcpy_s(name, HPACK_NAME_MAX,
+				      hpackStatic[idx - 1].name, nameLen)) ||
+			    (valLen &&
+			     memcpy_s(val, HPACK_VALUE_MAX,
+				      hpackStatic[idx - 1].value, valLen)))
+				goto err;
+		} else if (idx) {
+			if (idx - HPACK_STATIC_COUNT > dec->count)
+				goto err;
+			off = hpackEntry(dec, idx - HPACK_STATIC_COUNT - 1,
+					 &eName, &eVal);
+			if (eName > HPACK_NAME_MAX || eVal > HPACK_VALUE_MAX)
+				goto err;
+			nameLen = eName;
+			valLen = eVal;
+			if ((nameLen &&
+			     memcpy_s(name, HPACK_NAME_MAX,
+				      &dec->data[off + HPACK_ENTRY_LENS],
+				      nameLen)) ||
+			    (valLen &&
+			     memcpy_s(val, HPACK_VALUE_MAX,
+				      &dec->data[off + HPACK_ENTRY_LENS +
+						 eName],
+				      valLen)))
+				goto err;
+		}
+
+		if (!(b & 0x80)) {
+			if ((!idx && !hpackGetString(blk, len, &pos, name,
+						     HPACK_NAME_MAX,
+						     &nameLen)) ||
+			    !hpackGetString(blk, len, &pos, val,
+					    HPACK_VALUE_MAX, &valLen))
+				goto err;
+			if (index &&
+			    !hpackInsert(dec, name, nameLen, val, valLen))
+				goto err;
+		}
+
+		if (!h2RenderField(name, nameLen, val, valLen, hdr, hdrSize,
+				   hdrLen))
+			goto done;
+	}
+	if (hdr && !*hdrLen) {
+		LOG(LOG_ERROR, "HTTP/2 response without a status\n");
+		goto done;
+	}
+	ret = true;
+	goto done;
+
+err:
+	LOG(LOG_ERROR, "HPACK: malformed header block\n");
+done:
+	sdoFree(name);
+	return ret;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * HTTP/2 Layer
+ *
+ * This file is a header implementation of the HTTP/2 framing and header
+ * compression (HPACK), which the network HAL uses in place of the HTTP/1.1
+ * text of the REST layer.
+ *
+ */
+
+#ifndef __H2_INTERFACE_H__
+#define __H2_INTERFACE_H__
+
+#include "rest_interface.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define H2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define H2_PREFACE_LEN 24
+#define H2_FRAME_HDR_LEN 9
+/* Largest frame taken, the default SETTINGS_MAX_FRAME_SIZE */
+#define H2_MAX_FRAME_SIZE 16384
+#define H2_DEFAULT_WINDOW 65535
+#define H2_MAX_WINDOW 0x7fffffff
+
+/* Frame types */
+#define H2_DATA 0x0
+#define H2_HEADERS 0x1
+#define H2_PRIORITY 0x2
+#define H2_RST_STREAM 0x3
+#define H2_SETTINGS 0x4
+#define H2_PUSH_PROMISE 0x5
+#define H2_PING 0x6
+#define H2_GOAWAY 0x7
+#define H2_WINDOW_UPDATE 0x8
+#define H2_CONTINUATION 0x9
+
+/* Frame flags */
+#define H2_FLAG_END_STREAM 0x1
+#define H2_FLAG_ACK 0x1
+#define H2_FLAG_END_HEADERS 0x4
+#define H2_FLAG_PADDED 0x8
+#define H2_FLAG_PRIORITY 0x20
+
+/* Settings */
+#define H2_SETTINGS_HEADER_TABLE_SIZE 0x1
+#define H2_SETTINGS_ENABLE_PUSH 0x2
+#define H2_SETTINGS_MAX_CONCURRENT_STREAMS 0x3
+#define H2_SETTINGS_INITIAL_WINDOW_SIZE 0x4
+#define H2_SETTINGS_MAX_FRAME_SIZE 0x5
+
+/* Error codes of RST_STREAM and GOAWAY */
+#define H2_NO_ERROR 0x0
+#define H2_PROTOCOL_ERROR 0x1
+#define H2_COMPRESSION_ERROR 0x9
+
+/* Size of the dynamic tables of HPACK, at most the default size */
+#define H2_DEFAULT_TABLE_SIZE 4096
+#ifndef H2_TABLE_SIZE
+#define H2_TABLE_SIZE H2_DEFAULT_TABLE_SIZE
+#endif
+
+typedef struct {
+	uint32_t len;
+	uint8_t type;
+	uint8_t flags;
+	uint32_t stream;
+} h2Frame_t;
+
+/*
+ * Dynamic table of HPACK, of the encoder or of the decoder. The entries are
+ * kept newest first, each as the lengths of its name and its value, then
+ * the name and the value.
+ */
+typedef struct {
+	uint8_t data[H2_TABLE_SIZE];
+	size_t used;	  // bytes of data in use
+	uint32_t count;	  // entries
+	uint32_t size;	  // size of the entries, as RFC 7541 counts it
+	uint32_t maxSize; // at most H2_TABLE_SIZE
+	bool announce;	  // encoder: maxSize to go in the next block
+} h2Table_t;
+
+void h2TableInit(h2Table_t *t);
+void h2TableResize(h2Table_t *t, uint32_t maxSize);
+size_t h2PutFrameHeader(uint8_t *buf, uint32_t len, uint8_t type,
+			uint8_t flags, uint32_t stream);
+void h2GetFrameHeader(const uint8_t *buf, h2Frame_t *frame);
+bool h2EncodeRequest(h2Table_t *enc, RestCtx_t *rest, uint8_t *out,
+		     size_t outSize, size_t *outLen);
+bool h2DecodeResponse(h2Table_t *dec, const uint8_t *blk, size_t len,
+		      char *hdr, size_t hdrSize, size_t *hdrLen);
+
+#endif // __H2_INTERFACE_H__
@@ -18,7 +18,9 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #define IPV4_ADDR_LEN 4
+#define IPV6_ADDR_LEN 16
 
 #if defined(TARGET_OS_OPTEE)
 typedef void *sdoConHandle;
@@ -63,6 +65,36 @@ int32_t sdoConDnsLookup(const char *url, SDOIPAddress_t **ipList,
  */
 sdoConHandle sdoConConnect(SDOIPAddress_t *addr, uint16_t port, void **ssl);
 
+/*
+ * Open a connection to the first reachable address of a list.
+ *
+ * @param[in] ipList: IP addresses to connect to, in order of preference.
+ * @param[in] numOfIPs: number of IP addresses in ipList.
+ * @param[in] port: port number to connect to.
+ * @param[in] ports: port number per address, NULL to use port for all.
+ * @param[in] ssl: SSL handler in case of tls connection.
+ * @param[out] index: index of the connected address in ipList.
+ * @retval -1 on failure, connection handle on success.
+ */
+sdoConHandle sdoConConnectRace(SDOIPAddress_t *ipList, uint32_t numOfIPs,
+			       uint16_t port, const uint16_t *ports,
+			       void **ssl, uint32_t *index);
+
+#ifdef PROXY_TUNNEL
+/*
+ * Open an HTTP CONNECT tunnel to a server, through the proxy the connection
+ * is made to. The messages sent on the connection afterwards reach the
+ * server.
+ *
+ * @param[in] handle: connection to the proxy.
+ * @param[in] host: host name or IP address of the server.
+ * @param[in] port: port number of the server.
+ * @retval -1 on failure, 0 once the proxy connected to the server.
+ */
+int32_t sdoConProxyTunnel(sdoConHandle handle, const char *host,
+			  uint16_t port);
+#endif
+
 /*
  * Disconnect the connection.
  *
@@ -112,6 +144,103 @@ int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
 			  uint32_t messageType, const uint8_t *buf,
 			  size_t length, void *ssl);
 
+/*
+ * Non-blocking (asynchronous) variant of the connection I/O, for driving
+ * a protocol from an event loop. The connection is switched to
+ * non-blocking mode with sdoConSetNonBlocking() and its readiness is
+ * waited for on sdoConGetFd(). sdoConSendMessageAsync(),
+ * sdoConRecvMsgHeaderAsync() and sdoConRecvMsgBodyAsync() return one of
+ * the following and are to be called again, with the same arguments,
+ * while they return SDO_CON_WANT_READ or SDO_CON_WANT_WRITE.
+ */
+#define SDO_CON_DONE 0
+#define SDO_CON_ERROR -1
+#define SDO_CON_WANT_READ 1  // wait for the connection to become readable
+#define SDO_CON_WANT_WRITE 2 // wait for the connection to become writable
+
+/*
+ * Switch connection between blocking and non-blocking mode.
+ *
+ * @param[in] handle: connection handler (for ex: socket-id)
+ * @param[in] enable: true for non-blocking mode.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConSetNonBlocking(sdoConHandle handle, bool enable);
+
+/*
+ * Get file descriptor to wait on for readiness of the connection.
+ *
+ * @param[in] handle: connection handler (for ex: socket-id)
+ * @retval -1 on failure (not supported), file descriptor on success.
+ */
+int32_t sdoConGetFd(sdoConHandle handle);
+
+/*
+ * Send(write) data without blocking.
+ *
+ * @param[in] handle: connection handler (for ex: socket-id)
+ * @param[in] protocolVersion: SDO protocol version
+ * @param[in] messageType: message type of outgoing SDO message.
+ * @param[in] buf: data buffer to write from.
+ * @param[in] length: Number of bytes to send.
+ * @param[in] ssl handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
+ */
+int32_t sdoConSendMessageAsync(sdoConHandle handle, uint32_t protocolVersion,
+			       uint32_t messageType, const uint8_t *buf,
+			       size_t length, void *ssl);
+
+/*
+ * Receive(read) protocol version, message type and length of incoming sdo
+ * packet without blocking.
+ *
+ * @param[in] handle: connection handler (for ex: socket-id)
+ * @param[out] protocolVersion: SDO protocol version
+ * @param[out] messageType: message type of incoming SDO message.
+ * @param[out] msglen: length of incoming message.
+ * @param[in] ssl handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgHeaderAsync(sdoConHandle handle,
+				 uint32_t *protocolVersion,
+				 uint32_t *messageType, uint32_t *msglen,
+				 void *ssl);
+
+/*
+ * Receive(read) incoming sdo packet without blocking.
+ *
+ * @param[in] handle: connection handler (for ex: socket-id)
+ * @param[out] buf: data buffer to read into.
+ * @param[in] length: Number of bytes to be read.
+ * @param[in,out] nread: Number of bytes read so far, 0 initially.
+ * @param[in] ssl handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgBodyAsync(sdoConHandle handle, uint8_t *buf,
+			       size_t length, size_t *nread, void *ssl);
+
+/*
+ * Set timeouts of connection operations. 0 means no timeout. Can also be
+ * set through sdoConSetup() params "connect_timeout_ms=<ms>",
+ * "read_timeout_ms=<ms>" and "write_timeout_ms=<ms>".
+ *
+ * @param[in] connectMs: connect timeout (incl. trying all addresses).
+ * @param[in] readMs: timeout of a read that makes no progress.
+ * @param[in] writeMs: timeout of a write that makes no progress.
+ */
+void sdoConSetTimeouts(uint32_t connectMs, uint32_t readMs, uint32_t writeMs);
+
+/*
+ * Set deadline of the running protocol, bounding all connection
+ * operations.
+ *
+ * @param[in] deadline: deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoConSetDeadline(uint64_t deadline);
+
 /*
  * Network Connection tear down.
  * This API is counter to sdoConSetup().
@@ -119,9 +248,19 @@ int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
  */
 int32_t sdoConTeardown(void);
 
+/*
+ * Set the transcript of the messages, appended to with NET_REPLAY=record
+ * and played back from its start with NET_REPLAY=play (Linux).
+ *
+ * @param[in] path: transcript file, NULL for the default of the build.
+ * @retval -1 on failure or without NET_REPLAY, 0 on success.
+ */
+int32_t sdoConTranscript(const char *path);
+
 /* put SDO device in Low power mode */
 // FIXME: we might have to find a suitable place for this API
 void sdoSleep(int sec);
+void sdoSleepMs(uint32_t ms);
 
 /* Convert from Network to Host byte order */
 uint32_t sdoNetToHostLong(uint32_t value);
@@ -141,4 +280,9 @@ const char *get_device_serial_number(void);
 /* generate random number */
 int sdoRandom(void);
 
+/* monotonic time in milliseconds, for timeouts and cache expiry */
+uint64_t sdoTimeMs(void);
+/* same clock in microseconds, for measuring short operations */
+uint64_t sdoTimeUs(void);
+
 #endif /* __NETWORK_AL_H__ */
@@ -17,3 +17,11 @@
 bool getPlatformHMACKey(uint8_t *key, size_t len);
 bool getPlatformIV(uint8_t *iv, size_t len, size_t datalen);
 bool getPlatformAESKey(uint8_t *key, size_t len);
+void clearPlatformKeys(void);
+
+/* IV counter and key cache of one SDK instance (Linux) */
+typedef struct platformState_s platformState_t;
+platformState_t *platformStateAlloc(void);
+void platformStateBind(platformState_t *state);
+void platformStateFree(platformState_t *state);
+bool platformStateDerive(platformState_t *state, const char *identity);
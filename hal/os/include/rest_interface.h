@@ -26,31 +26,48 @@
 #define DEFAULT_DELAYSEC 120
 #define IP_TAG_LEN 16   // e.g. 192.168.111.111
 #define MAX_PORT_SIZE 6 // max port size is 65536 + 1null char
+/* Smallest request body sent deflated, smaller ones gain too little */
+#define REST_DEFLATE_MIN 256
+/* Longest Authorization or X-Token value kept */
+#define REST_MAX_TOKEN_SIZE 256
 
 // REST context
 typedef struct Rest_ctx_s {
 	uint32_t protVer;
 	uint32_t msgType;
 	bool tls;
+	bool cbor; // Content-type of the messages is application/cbor
 	size_t contentLength;
+	bool deflate;	  // body is deflate (or gzip) encoded
+	bool peerDeflate; // server sent an encoded body, takes encoded ones
 	bool keepAlive;
-	char *authorization;
-	char *xTokenAuthorization;
+	bool chunked; // body is sent in chunks, Transfer-Encoding: chunked
+	uint8_t pipeline; // requests the server takes pipelined, X-Pipeline
+	char authorization[REST_MAX_TOKEN_SIZE];
+	char xTokenAuthorization[REST_MAX_TOKEN_SIZE];
 	SDOIPAddress_t *hostIP;
 	uint16_t portno;
 	char *hostDNS;
 	bool isDNS;
+	// Request header with the message type, length and encoding left out
+	char hdrTmpl[REST_MAX_MSGHDR_SIZE];
+	size_t hdrTmplLen; // 0 when it is to be built (again)
+	uint32_t hdrTmplVer;
+	size_t hdrMsgOff; // where the message type goes
+	size_t hdrLenOff; // where the content length goes
+	size_t hdrEncOff; // where the content encoding goes
 } RestCtx_t;
 
 bool cacheHostDns(const char *dns);
 bool cacheHostIP(SDOIPAddress_t *ip);
 bool cacheHostPort(uint16_t port);
 bool cacheTLSConnection(void);
+bool cacheCBOREncoding(void);
 bool initRESTContext(void);
 RestCtx_t *getRESTContext(void);
 bool constructRESTHeader(RestCtx_t *rest, char *header, size_t headerLen);
 char getRESTHdrBodySeparator(void);
-bool getRESTContentLength(char *hdr, size_t hdrlen, uint32_t *contLen);
+bool getRESTContentLength(const char *hdr, size_t hdrlen, uint32_t *contLen);
 void exitRESTContext(void);
 
 #endif // __REST_INTERFACE_H__
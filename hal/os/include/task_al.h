@@ -0,0 +1,50 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Task Abstraction Layer
+ *
+ * A fixed pool of worker threads taking tasks from a bounded queue, for the
+ * work the protocol runs off its critical path. Submitting a task gives its
+ * future, which is joined once for its result and can be cancelled while it
+ * has not started. The workers are pthreads on linux, CMSIS-RTOS2 threads on
+ * mbedOS and tasks on FreeRTOS. With no workers (TASK_WORKERS=0, the default
+ * but on linux) or a full queue, the task runs inline, in the submitter, and
+ * the API stays the same.
+ */
+
+#ifndef __TASK_AL_H__
+#define __TASK_AL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Workers of the shared pool, 0 to run all tasks inline */
+#ifndef SDO_TASK_WORKERS
+#define SDO_TASK_WORKERS 0
+#endif
+
+/* Tasks queued ahead of the workers at most */
+#ifndef SDO_TASK_QUEUE
+#define SDO_TASK_QUEUE 8
+#endif
+
+typedef int32_t (*sdoTaskFn_t)(void *arg);
+
+typedef struct sdoTaskPool_s sdoTaskPool_t;
+typedef struct sdoTask_s sdoTask_t;
+
+sdoTaskPool_t *sdoTaskPoolCreate(unsigned workers, unsigned queue);
+void sdoTaskPoolDestroy(sdoTaskPool_t *pool);
+sdoTaskPool_t *sdoTaskPoolShared(void);
+
+sdoTask_t *sdoTaskSubmit(sdoTaskPool_t *pool, sdoTaskFn_t fn, void *arg);
+bool sdoTaskCancel(sdoTask_t *task);
+bool sdoTaskDone(sdoTask_t *task);
+int32_t sdoTaskJoin(sdoTask_t *task, int32_t *result);
+
+void sdoTaskYield(void);
+
+#endif /* __TASK_AL_H__ */
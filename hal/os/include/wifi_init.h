@@ -6,7 +6,48 @@
 #ifndef __WIFI_INIT_H__
 #define __WIFI_INIT_H__
 
+#include <stdint.h>
+#include <stdbool.h>
+
 int sdoWifiInit(void);
 int sdoWifiExit();
 
+/*
+ * Connection state of the last network joined, kept in a secure blob so
+ * that sdoWifiInit can reconnect without a scan: it joins the cached BSSID
+ * on its channel, with the cached PMK (no PBKDF2 of the passphrase) or
+ * PMKSA, and asks for the cached address (DHCP INIT-REBOOT, RFC 2131
+ * 4.3.2), which the server acknowledges or refuses at once. If any of it
+ * fails, sdoWifiInit drops the cache and does the full scan, association
+ * and DHCP exchange, then saves the new state.
+ */
+#ifndef WIFI_CACHE_BLOB
+#define WIFI_CACHE_BLOB "wifi_cache.blob"
+#endif
+
+#define WIFI_SSID_MAX 32
+#define WIFI_BSSID_LEN 6
+#define WIFI_PMK_LEN 32
+#define WIFI_PMKID_LEN 16
+
+typedef struct {
+	char ssid[WIFI_SSID_MAX + 1]; // network the state is of
+	uint8_t bssid[WIFI_BSSID_LEN];
+	uint8_t channel;
+	bool pmkValid;
+	uint8_t pmk[WIFI_PMK_LEN];
+	bool pmkidValid; // PMKSA of the access point, to skip 802.1X or SAE
+	uint8_t pmkid[WIFI_PMKID_LEN];
+	bool leaseValid;
+	uint8_t ip[4];
+	uint8_t netmask[4];
+	uint8_t gateway[4];
+	uint8_t dns[4];
+	uint8_t dhcpServer[4];
+} sdoWifiCache_t;
+
+int32_t sdoWifiCacheLoad(const char *ssid, sdoWifiCache_t *cache);
+int32_t sdoWifiCacheSave(const sdoWifiCache_t *cache);
+void sdoWifiCacheDrop(void);
+
 #endif
@@ -16,8 +16,20 @@ extern "C" {
 #endif
 
 #ifdef __cplusplus
+/* Bytes received ahead of the reads of the REST layer */
+#define MOS_RX_BUF_SIZE 512
+
+/*
+ * A connection: its socket and what was received from it and is not read
+ * yet, so that the header is not received byte by byte.
+ */
 class sdoConHandle : public TCPSocket
 {
+      public:
+	bool used;	// taken from the pool
+	size_t rxStart; // first unread byte of rxData
+	size_t rxEnd;	// one past the last received byte
+	uint8_t rxData[MOS_RX_BUF_SIZE];
 };
 #else
 #include "mbedtls/ssl.h"
@@ -33,7 +45,8 @@ int mos_socketConOnly(sdoConHandle *socket, SDOIPAddress_t *ip, uint16_t port);
 void mos_socketClose(sdoConHandle *socket);
 int mos_socketSend(sdoConHandle *socket, void *buf, size_t len, int flags);
 int mos_socketRecv(sdoConHandle *socket, void *buf, size_t len, int flags);
-sdoConHandle get_ssl_socket(void);
+void mos_socketSetTimeout(sdoConHandle *socket, int ms);
+sdoConHandle get_ssl_socket(void *ssl);
 
 #define MBED_SOCKET_TIMEOUT 10000
 #ifdef __cplusplus
@@ -0,0 +1,1365 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Abstraction Layer Library
+ *
+ * The file implements the network abstraction layer over CoAP (RFC 7252)
+ * on UDP, for devices on constrained links (NET_TRANSPORT=coap). A message
+ * is a POST to the resource /mp/<version>/msg/<type>, as with HTTP, sent
+ * confirmable and retransmitted until acknowledged. Bodies larger than a
+ * block are sent and received block-wise (RFC 7959). The session token
+ * of the owner travels in an experimental option.
+ */
+
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <errno.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <poll.h>
+
+#include "util.h"
+#include "network_al.h"
+#include "sdoprotctx.h"
+#include "sdonet.h"
+#include "safe_lib.h"
+#include "rest_interface.h"
+#include "sdotrace.h"
+
+/* Timeouts of connect (reaching a server) and of a response */
+#ifndef CON_CONNECT_TIMEOUT_MS
+#define CON_CONNECT_TIMEOUT_MS 10000
+#endif
+#ifndef CON_READ_TIMEOUT_MS
+#define CON_READ_TIMEOUT_MS 60000
+#endif
+#ifndef CON_WRITE_TIMEOUT_MS
+#define CON_WRITE_TIMEOUT_MS 60000
+#endif
+
+/* Transmission parameters of RFC 7252 section 4.8 */
+#ifndef COAP_ACK_TIMEOUT_MS
+#define COAP_ACK_TIMEOUT_MS 2000
+#endif
+#define COAP_MAX_RETRANSMIT 4
+
+/* Block size exponent: blocks of 2^(SZX+4) bytes, 512 by default */
+#ifndef COAP_BLOCK_SZX
+#define COAP_BLOCK_SZX 5
+#endif
+#define COAP_BLOCK_SIZE(szx) (1u << ((szx) + 4))
+
+/* Message types */
+#define COAP_CON 0
+#define COAP_NON 1
+#define COAP_ACK 2
+#define COAP_RST 3
+
+/* Codes, class << 5 | detail */
+#define COAP_EMPTY 0x00
+#define COAP_POST 0x02
+#define COAP_CONTINUE 0x5f // 2.31
+#define COAP_CLASS(code) ((code) >> 5)
+
+/* Options */
+#define COAP_OPT_URI_HOST 3
+#define COAP_OPT_URI_PATH 11
+#define COAP_OPT_CONTENT_FORMAT 12
+#define COAP_OPT_BLOCK2 23
+#define COAP_OPT_BLOCK1 27
+#define COAP_OPT_SIZE1 60
+/* Session token of the owner, as the HTTP Authorization header (critical) */
+#define COAP_OPT_AUTHORIZATION 65001
+
+#define COAP_FORMAT_JSON 50
+#define COAP_FORMAT_CBOR 60
+
+#define COAP_TOKEN_LEN 4
+/* Header, token and options: host name, path and session token at most */
+#define COAP_OPTS_MAX (4 + 8 + 2 * 256 + REST_MAX_TOKEN_SIZE + 64)
+#define COAP_DGRAM_MAX (COAP_BLOCK_SIZE(6) + COAP_OPTS_MAX)
+
+/* Block option value not present */
+#define COAP_NO_BLOCK UINT32_MAX
+
+/*
+ * Timeouts of connection operations, and the deadline of the protocol this
+ * thread runs (0 if none) that bounds all of them.
+ */
+static struct {
+	uint32_t connectMs;
+	uint32_t readMs;
+	uint32_t writeMs;
+} conTimeouts = {CON_CONNECT_TIMEOUT_MS, CON_READ_TIMEOUT_MS,
+		 CON_WRITE_TIMEOUT_MS};
+static SDO_THREAD_LOCAL uint64_t conDeadline;
+
+/* A message received, parsed in place */
+typedef struct {
+	uint8_t type;
+	uint8_t code;
+	uint16_t mid;
+	uint8_t tkl;
+	const uint8_t *token;
+	uint32_t block1; // option value, COAP_NO_BLOCK if absent
+	uint32_t block2;
+	const uint8_t *auth;
+	size_t authLen;
+	const uint8_t *payload;
+	size_t payloadLen;
+} coapMsg_t;
+
+/*
+ * Exchange of the connection: the request being sent (kept for
+ * retransmission), the datagram received last and the response body
+ * gathered from its blocks, handed out by sdoConRecvMsgBody().
+ */
+static SDO_THREAD_LOCAL struct {
+	uint16_t mid;
+	uint8_t token[COAP_TOKEN_LEN];
+	uint8_t req[COAP_DGRAM_MAX];
+	size_t reqLen;
+	uint16_t reqMid;
+	bool acked;
+	uint32_t timeoutMs; // of the next retransmission
+	uint32_t sent;	    // retransmissions so far
+	uint64_t due;	    // sdoTimeMs() of the next retransmission
+	uint8_t rsp[COAP_DGRAM_MAX];
+	coapMsg_t msg;
+	uint8_t *body;
+	size_t len;
+	size_t off;
+} coap;
+
+/**
+ * Get the time allowed for an operation, bounded by the deadline.
+ *
+ * @param ms - timeout of the operation, 0 for none.
+ * @param out - out time allowed in ms, 0 for no limit.
+ * @retval false if the deadline has passed, true otherwise.
+ */
+static bool conTimeout(uint32_t ms, uint32_t *out)
+{
+	uint64_t now;
+
+	*out = ms;
+	if (!conDeadline)
+		return true;
+
+	now = sdoTimeMs();
+	if (now >= conDeadline) {
+		LOG(LOG_ERROR, "Protocol deadline expired\n");
+		return false;
+	}
+	if (!ms || conDeadline - now < ms)
+		*out = conDeadline - now;
+	return true;
+}
+
+/**
+ * Drop the response body still held.
+ */
+static void coapBodyReset(void)
+{
+	if (coap.body)
+		sdoFree(coap.body);
+	coap.len = 0;
+	coap.off = 0;
+}
+
+/**
+ * Internal API: append an option to a message being built. Options are to
+ * be appended in the order of their numbers.
+ *
+ * @param buf - message, with room for COAP_DGRAM_MAX bytes.
+ * @param pos - in/out length of the message.
+ * @param last - in/out number of the option appended last.
+ * @param num - option number.
+ * @param val - option value.
+ * @param len - length of val.
+ * @retval true on success, false if the message is full.
+ */
+static bool coapPutOption(uint8_t *buf, size_t *pos, uint16_t *last,
+			  uint16_t num, const void *val, size_t len)
+{
+	uint32_t delta = num - *last;
+	uint8_t *p = buf + *pos;
+	uint8_t *head = p++;
+
+	if (*pos + 5 + len > COAP_DGRAM_MAX || len > 65535 + 269)
+		return false;
+
+	if (delta < 13) {
+		*head = delta << 4;
+	} else if (delta < 269) {
+		*head = 13 << 4;
+		*p++ = delta - 13;
+	} else {
+		*head = 14 << 4;
+		*p++ = (delta - 269) >> 8;
+		*p++ = (delta - 269) & 0xff;
+	}
+	if (len < 13) {
+		*head |= len;
+	} else if (len < 269) {
+		*head |= 13;
+		*p++ = len - 13;
+	} else {
+		*head |= 14;
+		*p++ = (len - 269) >> 8;
+		*p++ = (len - 269) & 0xff;
+	}
+	if (len && memcpy_s(p, COAP_DGRAM_MAX - (p - buf), val, len) != 0)
+		return false;
+	*pos = (p - buf) + len;
+	*last = num;
+	return true;
+}
+
+/**
+ * Internal API: append an unsigned integer option, in as few bytes as it
+ * takes.
+ */
+static bool coapPutUintOption(uint8_t *buf, size_t *pos, uint16_t *last,
+			      uint16_t num, uint32_t val)
+{
+	uint8_t b[4];
+	size_t n = 0;
+	int shift;
+
+	for (shift = 24; shift >= 0; shift -= 8) {
+		if (n || (val >> shift) & 0xff)
+			b[n++] = (val >> shift) & 0xff;
+	}
+	return coapPutOption(buf, pos, last, num, b, n);
+}
+
+/**
+ * Internal API: build the request of the REST context into coap.req, a
+ * confirmable POST of a new message ID.
+ *
+ * @param rest - REST context, with the protocol version and message type.
+ * @param payload - request body of this block, NULL if none.
+ * @param len - length of payload.
+ * @param block1 - Block1 option value, COAP_NO_BLOCK if none.
+ * @param block2 - Block2 option value, COAP_NO_BLOCK if none.
+ * @param size1 - Size1 option value (size of the body), 0 if none.
+ * @retval true on success, false otherwise.
+ */
+static bool coapBuildRequest(RestCtx_t *rest, const uint8_t *payload,
+			     size_t len, uint32_t block1, uint32_t block2,
+			     uint32_t size1)
+{
+	char seg[12];
+	uint8_t *buf = coap.req;
+	size_t pos = 4 + COAP_TOKEN_LEN;
+	uint16_t last = 0;
+	size_t authLen = strnlen_s(rest->authorization, REST_MAX_TOKEN_SIZE);
+	bool ok = true;
+
+	coap.reqMid = coap.mid++;
+	buf[0] = 0x40 | (COAP_CON << 4) | COAP_TOKEN_LEN;
+	buf[1] = COAP_POST;
+	buf[2] = coap.reqMid >> 8;
+	buf[3] = coap.reqMid & 0xff;
+	if (memcpy_s(&buf[4], COAP_TOKEN_LEN, coap.token, COAP_TOKEN_LEN) != 0)
+		return false;
+
+	if (rest->isDNS && rest->hostDNS)
+		ok = coapPutOption(buf, &pos, &last, COAP_OPT_URI_HOST,
+				   rest->hostDNS,
+				   strnlen_s(rest->hostDNS, 255));
+	/* /mp/<version>/msg/<type> */
+	ok = ok &&
+	     coapPutOption(buf, &pos, &last, COAP_OPT_URI_PATH, "mp", 2) &&
+	     snprintf_s_i(seg, sizeof(seg), "%d", rest->protVer) > 0 &&
+	     coapPutOption(buf, &pos, &last, COAP_OPT_URI_PATH, seg,
+			   strnlen_s(seg, sizeof(seg))) &&
+	     coapPutOption(buf, &pos, &last, COAP_OPT_URI_PATH, "msg", 3) &&
+	     snprintf_s_i(seg, sizeof(seg), "%d", rest->msgType) > 0 &&
+	     coapPutOption(buf, &pos, &last, COAP_OPT_URI_PATH, seg,
+			   strnlen_s(seg, sizeof(seg)));
+	if (ok && payload)
+		ok = coapPutUintOption(buf, &pos, &last,
+				       COAP_OPT_CONTENT_FORMAT,
+				       rest->cbor ? COAP_FORMAT_CBOR
+						  : COAP_FORMAT_JSON);
+	if (ok && block2 != COAP_NO_BLOCK)
+		ok = coapPutUintOption(buf, &pos, &last, COAP_OPT_BLOCK2,
+				       block2);
+	if (ok && block1 != COAP_NO_BLOCK)
+		ok = coapPutUintOption(buf, &pos, &last, COAP_OPT_BLOCK1,
+				       block1);
+	if (ok && size1)
+		ok = coapPutUintOption(buf, &pos, &last, COAP_OPT_SIZE1,
+				       size1);
+	if (ok && authLen)
+		ok = coapPutOption(buf, &pos, &last, COAP_OPT_AUTHORIZATION,
+				   rest->authorization, authLen);
+	if (ok && payload && len) {
+		ok = pos + 1 + len <= COAP_DGRAM_MAX;
+		if (ok) {
+			buf[pos++] = 0xff;
+			ok = memcpy_s(&buf[pos], COAP_DGRAM_MAX - pos, payload,
+				      len) == 0;
+			pos += len;
+		}
+	}
+	if (!ok) {
+		LOG(LOG_ERROR, "CoAP request too large\n");
+		return false;
+	}
+	coap.reqLen = pos;
+	return true;
+}
+
+/**
+ * Internal API: read an unsigned integer option value.
+ */
+static uint32_t coapUint(const uint8_t *val, size_t len)
+{
+	uint32_t v = 0;
+	size_t i;
+
+	for (i = 0; i < len && i < 4; i++)
+		v = (v << 8) | val[i];
+	return v;
+}
+
+/**
+ * Internal API: parse a message received, in place.
+ *
+ * @param buf - message.
+ * @param len - length of buf.
+ * @param msg - out parsed message.
+ * @retval true if the message is well formed, false otherwise.
+ */
+static bool coapParse(const uint8_t *buf, size_t len, coapMsg_t *msg)
+{
+	size_t pos;
+	uint32_t num = 0, delta, olen;
+
+	if (len < 4 || (buf[0] >> 6) != 1 || (buf[0] & 0x0f) > 8)
+		return false;
+	msg->type = (buf[0] >> 4) & 0x03;
+	msg->tkl = buf[0] & 0x0f;
+	msg->code = buf[1];
+	msg->mid = (buf[2] << 8) | buf[3];
+	msg->token = &buf[4];
+	msg->block1 = COAP_NO_BLOCK;
+	msg->block2 = COAP_NO_BLOCK;
+	msg->auth = NULL;
+	msg->authLen = 0;
+	msg->payload = NULL;
+	msg->payloadLen = 0;
+	pos = 4 + msg->tkl;
+	if (pos > len)
+		return false;
+
+	while (pos < len && buf[pos] != 0xff) {
+		delta = buf[pos] >> 4;
+		olen = buf[pos] & 0x0f;
+		pos++;
+		if (delta == 15 || olen == 15)
+			return false;
+		if (delta == 13 && pos < len) {
+			delta = buf[pos++] + 13;
+		} else if (delta == 14 && pos + 1 < len) {
+			delta = ((buf[pos] << 8) | buf[pos + 1]) + 269;
+			pos += 2;
+		} else if (delta >= 13) {
+			return false;
+		}
+		if (olen == 13 && pos < len) {
+			olen = buf[pos++] + 13;
+		} else if (olen == 14 && pos + 1 < len) {
+			olen = ((buf[pos] << 8) | buf[pos + 1]) + 269;
+			pos += 2;
+		} else if (olen >= 13) {
+			return false;
+		}
+		if (pos + olen > len)
+			return false;
+		num += delta;
+
+		if (num == COAP_OPT_BLOCK1)
+			msg->block1 = coapUint(&buf[pos], olen);
+		else if (num == COAP_OPT_BLOCK2)
+			msg->block2 = coapUint(&buf[pos], olen);
+		else if (num == COAP_OPT_AUTHORIZATION) {
+			msg->auth = &buf[pos];
+			msg->authLen = olen;
+		}
+		pos += olen;
+	}
+	if (pos < len) {
+		/* a payload marker is followed by a payload */
+		if (++pos == len)
+			return false;
+		msg->payload = &buf[pos];
+		msg->payloadLen = len - pos;
+	}
+	return true;
+}
+
+/**
+ * Internal API: send an empty ACK or RST of a message of the server.
+ */
+static void coapSendEmpty(int sock, uint8_t type, uint16_t mid)
+{
+	uint8_t buf[4] = {0x40 | (type << 4), COAP_EMPTY, mid >> 8,
+			  mid & 0xff};
+
+	(void)send(sock, buf, sizeof(buf), 0);
+}
+
+/**
+ * Internal API: send the request in coap.req, its first transmission.
+ *
+ * @retval false on failure, true otherwise.
+ */
+static bool coapTransmit(int sock)
+{
+	coap.acked = false;
+	coap.sent = 0;
+	/* initial timeout is random, between ACK_TIMEOUT and 1.5 times it */
+	coap.timeoutMs =
+	    COAP_ACK_TIMEOUT_MS +
+	    (uint32_t)(sdoRandom() % (COAP_ACK_TIMEOUT_MS / 2 + 1));
+	coap.due = sdoTimeMs() + coap.timeoutMs;
+	if (send(sock, coap.req, coap.reqLen, 0) != (ssize_t)coap.reqLen) {
+		LOG(LOG_ERROR, "CoAP send failed, errno=%d\n", errno);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Internal API: wait for the response of the request sent, retransmitting
+ * the request until it is acknowledged. The response is piggybacked on the
+ * acknowledgement, or comes separately once the server has it. A separate
+ * confirmable response is acknowledged.
+ *
+ * @param sock - socket of the connection.
+ * @retval false on failure or timeout, true once coap.msg is the response.
+ */
+static bool coapAwait(int sock)
+{
+	struct pollfd pfd = {.fd = sock, .events = POLLIN};
+	coapMsg_t *msg = &coap.msg;
+	uint64_t now, readEnd = 0;
+	uint32_t limit;
+	int wait, res = 1;
+	ssize_t n;
+
+	for (;;) {
+		if (!conTimeout(0, &limit))
+			return false;
+		now = sdoTimeMs();
+
+		if (!coap.acked && now >= coap.due) {
+			if (coap.sent++ == COAP_MAX_RETRANSMIT) {
+				LOG(LOG_ERROR, "CoAP request not "
+					       "acknowledged\n");
+				return false;
+			}
+			LOG(LOG_DEBUG, "CoAP retransmission %u\n", coap.sent);
+			(void)send(sock, coap.req, coap.reqLen, 0);
+			coap.timeoutMs *= 2;
+			coap.due = now + coap.timeoutMs;
+		}
+		if (coap.acked && conTimeouts.readMs && now >= readEnd) {
+			LOG(LOG_ERROR, "CoAP response timed out\n");
+			return false;
+		}
+		wait = (int)((coap.acked ? readEnd : coap.due) - now);
+		if (coap.acked && !conTimeouts.readMs)
+			wait = -1;
+		if (limit && (wait < 0 || (uint32_t)wait > limit))
+			wait = (int)limit;
+
+		if (poll(&pfd, 1, wait) < 0 && errno != EINTR) {
+			LOG(LOG_ERROR, "poll() failed, errno=%d\n", errno);
+			return false;
+		}
+		if (!(pfd.revents & POLLIN))
+			continue;
+		n = recv(sock, coap.rsp, sizeof(coap.rsp), 0);
+		if (n < 0) {
+			/* for ex: ICMP port unreachable */
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			LOG(LOG_ERROR, "CoAP receive failed, errno=%d\n",
+			    errno);
+			return false;
+		}
+		if (!coapParse(coap.rsp, (size_t)n, msg))
+			continue;
+
+		if ((msg->type == COAP_ACK || msg->type == COAP_RST) &&
+		    msg->mid == coap.reqMid) {
+			if (msg->type == COAP_RST) {
+				LOG(LOG_ERROR, "CoAP request rejected\n");
+				return false;
+			}
+			if (!coap.acked && msg->code == COAP_EMPTY)
+				readEnd = sdoTimeMs() + conTimeouts.readMs;
+			coap.acked = true;
+			if (msg->code == COAP_EMPTY)
+				continue;
+		} else if (msg->type == COAP_CON || msg->type == COAP_NON) {
+			if (COAP_CLASS(msg->code) < 2) {
+				/* requests of the server are not served */
+				coapSendEmpty(sock, COAP_RST, msg->mid);
+				continue;
+			}
+			/* a separate response, or the repeat of an old one */
+			if (msg->type == COAP_CON)
+				coapSendEmpty(sock, COAP_ACK, msg->mid);
+			coap.acked = true;
+		} else {
+			continue;
+		}
+
+		if (msg->tkl == COAP_TOKEN_LEN &&
+		    memcmp_s(msg->token, COAP_TOKEN_LEN, coap.token,
+			     COAP_TOKEN_LEN, &res) == 0 &&
+		    res == 0)
+			return true;
+	}
+}
+
+/**
+ * Internal API: send the request and wait for its response.
+ */
+static bool coapExchange(int sock)
+{
+	return coapTransmit(sock) && coapAwait(sock);
+}
+
+/**
+ * Internal API: check that a server answers on the socket, with a CoAP
+ * ping (an empty confirmable message, to which the server replies with a
+ * reset).
+ *
+ * @param sock - connected socket.
+ * @param ms - time allowed, 0 for no limit.
+ * @retval true if the server answered, false otherwise.
+ */
+static bool coapPing(int sock, uint32_t ms)
+{
+	struct pollfd pfd = {.fd = sock, .events = POLLIN};
+	uint64_t end = sdoTimeMs() + (ms ? ms : CON_CONNECT_TIMEOUT_MS);
+	uint16_t mid = coap.mid++;
+	uint8_t ping[4] = {0x40 | (COAP_CON << 4), COAP_EMPTY, mid >> 8,
+			   mid & 0xff};
+	uint32_t timeout = COAP_ACK_TIMEOUT_MS, sent;
+	uint64_t now, due;
+	coapMsg_t msg;
+	ssize_t n;
+
+	for (sent = 0; sent <= COAP_MAX_RETRANSMIT; sent++) {
+		if (send(sock, ping, sizeof(ping), 0) != sizeof(ping))
+			return false;
+		now = sdoTimeMs();
+		due = now + timeout < end ? now + timeout : end;
+		while (now < due) {
+			if (poll(&pfd, 1, (int)(due - now)) > 0 &&
+			    (pfd.revents & POLLIN)) {
+				n = recv(sock, coap.rsp, sizeof(coap.rsp), 0);
+				if (n < 0 && errno != EINTR && errno != EAGAIN)
+					return false;
+				if (n > 0 &&
+				    coapParse(coap.rsp, (size_t)n, &msg) &&
+				    msg.mid == mid &&
+				    (msg.type == COAP_RST ||
+				     msg.type == COAP_ACK))
+					return true;
+			}
+			now = sdoTimeMs();
+		}
+		if (now >= end)
+			break;
+		timeout *= 2;
+	}
+	return false;
+}
+
+/**
+ * Set the transcript the messages are recorded to, which CoAP does not.
+ *
+ * @retval -1
+ */
+int32_t sdoConTranscript(const char *path)
+{
+	(void)path;
+	return -1;
+}
+
+/**
+ * sdoConSetup Connection Setup.
+ *
+ * @param medium - specified network medium to connect to
+ * @param params - parameters(if any) supported for 'medium'
+ * @param count - number of valid string in params
+ * @return 0 on success. -1 on failure
+ */
+int32_t sdoConSetup(char *medium, char **params, uint32_t count)
+{
+	uint32_t i;
+	char key[32];
+	char *val;
+	int res1 = 1, res2 = 1, res3 = 1;
+
+	(void)medium;
+
+	/* timeouts as "connect_timeout_ms=<ms>", "read_timeout_ms=<ms>", ... */
+	for (i = 0; params && i < count; i++) {
+		if (!params[i])
+			continue;
+		val = strchr(params[i], '=');
+		if (!val || val - params[i] >= (int)sizeof(key))
+			continue;
+		if (strncpy_s(key, sizeof(key), params[i], val - params[i]) !=
+		    0)
+			continue;
+		val++;
+
+		strcmp_s(key, sizeof(key), "connect_timeout_ms", &res1);
+		strcmp_s(key, sizeof(key), "read_timeout_ms", &res2);
+		strcmp_s(key, sizeof(key), "write_timeout_ms", &res3);
+		if (!res1)
+			conTimeouts.connectMs = atoi(val);
+		else if (!res2)
+			conTimeouts.readMs = atoi(val);
+		else if (!res3)
+			conTimeouts.writeMs = atoi(val);
+		else
+			LOG(LOG_ERROR, "Unknown connection parameter: %s\n",
+			    params[i]);
+	}
+
+	if (!coap.mid)
+		coap.mid = (uint16_t)sdoRandom();
+
+	// Initiate REST context
+	if (!initRESTContext()) {
+		LOG(LOG_ERROR, "initRESTContext() failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Perform a DNS look for a specified host.
+ * Note : return ip address in network format.
+ * @param url - host's URL.
+ * @param ipList - output IP address list for specified host URL.
+ * @param ipListSize - output number of IP address in ipList
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConDnsLookup(const char *url, SDOIPAddress_t **ipList,
+			uint32_t *ipListSize)
+{
+	struct addrinfo *result = NULL, *it = NULL;
+	struct addrinfo hints;
+	SDOIPAddress_t *ip_list = NULL;
+	const void *addr;
+	uint32_t len = 0, idx = 0;
+	int32_t ret = -1;
+
+	if (!url || !ipList || !ipListSize)
+		return ret;
+
+	LOG(LOG_DEBUG, "Resolving DNS-URL: <%s>\n", url);
+
+	if (memset_s(&hints, sizeof hints, 0) != 0) {
+		LOG(LOG_ERROR, "Memset failed\n");
+		goto end;
+	}
+	hints.ai_family = AF_UNSPEC; // IPv4 and IPv6
+	hints.ai_socktype = SOCK_DGRAM;
+
+	if (getaddrinfo(url, NULL, &hints, &result) != 0) {
+		LOG(LOG_ERROR, "getaddrinfo() failed!\n");
+		goto end;
+	}
+	for (it = result; it != NULL; it = it->ai_next)
+		++len;
+
+	ip_list = sdoAlloc(sizeof(SDOIPAddress_t) * len);
+	if (!ip_list) {
+		LOG(LOG_ERROR, "Malloc failed!\n");
+		goto end;
+	}
+
+	for (it = result; it != NULL; it = it->ai_next) {
+		if (it->ai_family == AF_INET) {
+			addr = &((struct sockaddr_in *)it->ai_addr)->sin_addr;
+			ip_list[idx].length = IPV4_ADDR_LEN;
+		} else if (it->ai_family == AF_INET6) {
+			addr = &((struct sockaddr_in6 *)it->ai_addr)->sin6_addr;
+			ip_list[idx].length = IPV6_ADDR_LEN;
+		} else {
+			continue;
+		}
+		if (memcpy_s(ip_list[idx].addr, sizeof(ip_list->addr), addr,
+			     ip_list[idx].length) != 0) {
+			LOG(LOG_ERROR, "Memcpy failed\n");
+			goto end;
+		}
+		++idx;
+	}
+	if (!idx) {
+		LOG(LOG_ERROR, "No IPv4/IPv6 address for %s\n", url);
+		goto end;
+	}
+
+	*ipList = ip_list;
+	*ipListSize = idx;
+	ret = 0;
+end:
+	if (ret != 0) {
+		*ipListSize = 0;
+		if (ip_list)
+			sdoFree(ip_list);
+	}
+	if (result)
+		freeaddrinfo(result);
+	return ret;
+}
+
+/**
+ * Internal API: open a UDP socket bound to the server.
+ *
+ * @param ip_addr - IP address of the server.
+ * @param port - port of the server.
+ * @return socket on success, -1 on failure.
+ */
+static int coapSocket(const SDOIPAddress_t *ip_addr, uint16_t port)
+{
+	struct sockaddr_storage sa;
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)&sa;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)&sa;
+	socklen_t salen;
+	int sock;
+
+	if (memset_s(&sa, sizeof(sa), 0) != 0)
+		return -1;
+	if (ip_addr->length == IPV4_ADDR_LEN) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_port = htons(port);
+		if (memcpy_s(&sa4->sin_addr, sizeof(sa4->sin_addr),
+			     ip_addr->addr, IPV4_ADDR_LEN) != 0)
+			return -1;
+		salen = sizeof(*sa4);
+	} else if (ip_addr->length == IPV6_ADDR_LEN) {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_port = htons(port);
+		if (memcpy_s(&sa6->sin6_addr, sizeof(sa6->sin6_addr),
+			     ip_addr->addr, IPV6_ADDR_LEN) != 0)
+			return -1;
+		salen = sizeof(*sa6);
+	} else {
+		LOG(LOG_ERROR, "Invalid IP address length %d\n",
+		    ip_addr->length);
+		return -1;
+	}
+
+	sock = socket(sa.ss_family, SOCK_DGRAM, 0);
+	if (sock < 0)
+		return -1;
+	/* datagrams of other peers are filtered out */
+	if (connect(sock, (struct sockaddr *)&sa, salen) != 0) {
+		close(sock);
+		return -1;
+	}
+	return sock;
+}
+
+/**
+ * Open a connection to a server, without a round trip: the first request
+ * tells whether it is there.
+ *
+ * @param ip_addr - pointer to IP address info
+ * @param port - port number to connect
+ * @param ssl - DTLS is not supported, must be NULL.
+ * @return connection handle on success. -ve value on failure
+ */
+sdoConHandle sdoConConnect(SDOIPAddress_t *ip_addr, uint16_t port, void **ssl)
+{
+	sdoConHandle sock = SDO_CON_INVALID_HANDLE;
+	SDO_TRACE_START(traceStart);
+
+	coapBodyReset();
+	if (!ip_addr)
+		goto end;
+	if (ssl) {
+		LOG(LOG_ERROR, "CoAP: DTLS is not supported\n");
+		goto end;
+	}
+	sock = coapSocket(ip_addr, port);
+	if (sock < 0) {
+		LOG(LOG_ERROR, "CoAP socket failed\n");
+		sock = SDO_CON_INVALID_HANDLE;
+	}
+end:
+	SDO_TRACE_END("net", "connect", port, traceStart);
+	return sock;
+}
+
+/**
+ * Connect to the first address of a list at which a server answers a CoAP
+ * ping, trying them in order.
+ *
+ * @param ipList - list of IP addresses, in order of preference.
+ * @param numOfIPs - number of IP addresses in ipList.
+ * @param port - port number to connect
+ * @param ports - port number per address, NULL to use port for all.
+ * @param ssl - DTLS is not supported, must be NULL.
+ * @param index - out index of the connected address in ipList.
+ * @return connection handle on success. -ve value on failure
+ */
+sdoConHandle sdoConConnectRace(SDOIPAddress_t *ipList, uint32_t numOfIPs,
+			       uint16_t port, const uint16_t *ports, void **ssl,
+			       uint32_t *index)
+{
+	uint64_t end;
+	uint32_t limit, i;
+	int sock;
+
+	coapBodyReset();
+	if (!ipList || !numOfIPs || !index)
+		return SDO_CON_INVALID_HANDLE;
+	if (ssl) {
+		LOG(LOG_ERROR, "CoAP: DTLS is not supported\n");
+		return SDO_CON_INVALID_HANDLE;
+	}
+	if (!conTimeout(conTimeouts.connectMs, &limit))
+		return SDO_CON_INVALID_HANDLE;
+	end = sdoTimeMs() + (limit ? limit : CON_CONNECT_TIMEOUT_MS);
+
+	for (i = 0; i < numOfIPs && sdoTimeMs() < end; i++) {
+		sock = coapSocket(&ipList[i], ports ? ports[i] : port);
+		if (sock < 0)
+			continue;
+		if (coapPing(sock, (uint32_t)(end - sdoTimeMs()))) {
+			*index = i;
+			return sock;
+		}
+		LOG(LOG_DEBUG, "No CoAP server at IP %u\n", i);
+		close(sock);
+	}
+	LOG(LOG_ERROR, "Failed to reach any of %u IPs\n", numOfIPs);
+	return SDO_CON_INVALID_HANDLE;
+}
+
+/**
+ * Disconnect the connection for a given connection handle.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param ssl - DTLS handler, none.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConDisconnect(sdoConHandle handle, void *ssl)
+{
+	(void)ssl;
+
+	coapBodyReset();
+	return close(handle) ? -1 : 0;
+}
+
+/**
+ * Internal API: take the session token of the owner from the response, as
+ * the HTTP Authorization header.
+ */
+static void coapKeepAuth(RestCtx_t *rest, const coapMsg_t *msg)
+{
+	if (!msg->auth)
+		return;
+	if (msg->authLen >= REST_MAX_TOKEN_SIZE ||
+	    memcpy_s(rest->authorization, REST_MAX_TOKEN_SIZE, msg->auth,
+		     msg->authLen) != 0) {
+		LOG(LOG_ERROR, "CoAP: session token too long\n");
+		return;
+	}
+	rest->authorization[msg->authLen] = '\0';
+}
+
+/**
+ * Internal API: append the payload of a response block to the body.
+ *
+ * @retval false if the body is too large, true otherwise.
+ */
+static bool coapBodyAppend(const coapMsg_t *msg)
+{
+	uint8_t *body;
+
+	if (!msg->payloadLen)
+		return true;
+	if (coap.len + msg->payloadLen > REST_MAX_MSGBODY_SIZE) {
+		LOG(LOG_ERROR, "CoAP response body too large\n");
+		return false;
+	}
+	body = sdoRealloc(coap.body, (int)(coap.len + msg->payloadLen));
+	if (!body)
+		return false;
+	coap.body = body;
+	if (memcpy_s(coap.body + coap.len, msg->payloadLen, msg->payload,
+		     msg->payloadLen) != 0)
+		return false;
+	coap.len += msg->payloadLen;
+	return true;
+}
+
+/**
+ * Receive(read) protocol version, message type and length of the response
+ * of the message sent. The whole body is received, its further blocks
+ * fetched with Block2, and held for sdoConRecvMsgBody().
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - out SDO protocol version
+ * @param messageType - out message type of incoming SDO message.
+ * @param msglen - out Number of received bytes.
+ * @param ssl - DTLS handler, none.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
+			    uint32_t *messageType, uint32_t *msglen, void *ssl)
+{
+	RestCtx_t *rest = getRESTContext();
+	coapMsg_t *msg = &coap.msg;
+	uint32_t num = 0, szx;
+	int32_t ret = -1;
+	SDO_TRACE_START(traceStart);
+
+	(void)ssl;
+
+	if (!protocolVersion || !messageType || !msglen || !rest)
+		goto end;
+
+	coapBodyReset();
+	if (!coapAwait(handle))
+		goto end;
+
+	for (;;) {
+		coapKeepAuth(rest, msg);
+		if (COAP_CLASS(msg->code) != 2) {
+			LOG(LOG_ERROR, "CoAP response %u.%02u\n",
+			    COAP_CLASS(msg->code), msg->code & 0x1f);
+			/* an error message, if it has a body */
+			rest->msgType = SDO_TYPE_ERROR;
+			if (!coapBodyAppend(msg))
+				goto end;
+			break;
+		}
+		rest->msgType = 0;
+		if (msg->block2 == COAP_NO_BLOCK) {
+			if (!coapBodyAppend(msg))
+				goto end;
+			break;
+		}
+
+		/* block num of 2^(szx+4) bytes, more if bit 3 is set */
+		szx = msg->block2 & 0x07;
+		if (szx == 7 || (msg->block2 >> 4) != num ||
+		    coap.len != (size_t)num * COAP_BLOCK_SIZE(szx) ||
+		    !coapBodyAppend(msg)) {
+			LOG(LOG_ERROR, "CoAP: unexpected block %u\n",
+			    msg->block2 >> 4);
+			goto end;
+		}
+		if (!(msg->block2 & 0x08))
+			break;
+
+		num = (uint32_t)(coap.len / COAP_BLOCK_SIZE(szx));
+		if (!coapBuildRequest(rest, NULL, 0, COAP_NO_BLOCK,
+				      num << 4 | szx, 0) ||
+		    !coapExchange(handle))
+			goto end;
+	}
+
+	rest->contentLength = coap.len;
+	/* the connection stays, there being none to close */
+	rest->keepAlive = true;
+	*protocolVersion = rest->protVer;
+	*messageType = rest->msgType;
+	*msglen = (uint32_t)coap.len;
+	ret = 0;
+end:
+	if (ret)
+		coapBodyReset();
+	SDO_TRACE_END("net", "recv-header", ret ? -1 : (int32_t)*messageType,
+		      traceStart);
+	return ret;
+}
+
+/**
+ * Receive(read) protocol version, message type and length of the response,
+ * which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgHeaderAsync(sdoConHandle handle,
+				 uint32_t *protocolVersion,
+				 uint32_t *messageType, uint32_t *msglen,
+				 void *ssl)
+{
+	if (sdoConRecvMsgHeader(handle, protocolVersion, messageType, msglen,
+				ssl))
+		return SDO_CON_ERROR;
+	return SDO_CON_DONE;
+}
+
+/**
+ * Receive(read) MsgBody of the response of sdoConRecvMsgHeader().
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param buf - data buffer to read into.
+ * @param length - Number of received bytes.
+ * @param ssl - DTLS handler, none.
+ * @retval -1 on failure, number of bytes read on success.
+ */
+int32_t sdoConRecvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
+			  void *ssl)
+{
+	(void)handle;
+	(void)ssl;
+
+	if (!buf || !length)
+		return -1;
+	if (!coap.body || length > coap.len - coap.off) {
+		LOG(LOG_ERROR, "Read beyond the response body\n");
+		return -1;
+	}
+	if (memcpy_s(buf, length, coap.body + coap.off, length) != 0) {
+		LOG(LOG_ERROR, "Memcpy failed\n");
+		return -1;
+	}
+	coap.off += length;
+	if (coap.off == coap.len)
+		coapBodyReset();
+	return (int32_t)length;
+}
+
+/**
+ * Receive(read) MsgBody, which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgBodyAsync(sdoConHandle handle, uint8_t *buf,
+			       size_t length, size_t *nread, void *ssl)
+{
+	if (!nread || *nread > length)
+		return SDO_CON_ERROR;
+	if (*nread < length) {
+		if (sdoConRecvMsgBody(handle, buf + *nread, length - *nread,
+				      ssl) < 0)
+			return SDO_CON_ERROR;
+		*nread = length;
+	}
+	return SDO_CON_DONE;
+}
+
+/**
+ * Send(write) a message. A body larger than a block is sent block-wise,
+ * each block but the last acknowledged with 2.31 Continue; the server may
+ * ask for smaller blocks then. The last block is only sent, its response
+ * is waited for by sdoConRecvMsgHeader(), so that the device works while
+ * the server handles the message.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - SDO protocol version
+ * @param messageType - message type of outgoing SDO message.
+ * @param buf - data buffer to write from.
+ * @param length - Number of sent bytes.
+ * @param ssl - DTLS handler, none.
+ * @retval -1 on failure, number of bytes written.
+ */
+int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
+			  uint32_t messageType, const uint8_t *buf,
+			  size_t length, void *ssl)
+{
+	RestCtx_t *rest = getRESTContext();
+	uint32_t szx = COAP_BLOCK_SZX, ack, i;
+	size_t off = 0, size;
+	int32_t ret = -1;
+	SDO_TRACE_START(traceStart);
+
+	(void)ssl;
+
+	if (!buf || !length || !rest)
+		goto end;
+
+	rest->protVer = protocolVersion;
+	rest->msgType = messageType;
+	rest->contentLength = length;
+	coapBodyReset();
+	for (i = 0; i < COAP_TOKEN_LEN; i++)
+		coap.token[i] = (uint8_t)sdoRandom();
+
+	size = COAP_BLOCK_SIZE(szx);
+	while (length - off > size) {
+		if (!coapBuildRequest(rest, buf + off, size,
+				      (uint32_t)(off / size) << 4 | 0x08 | szx,
+				      COAP_NO_BLOCK, off ? 0 : length) ||
+		    !coapExchange(handle))
+			goto end;
+		ack = coap.msg.block1;
+		if (coap.msg.code != COAP_CONTINUE || ack == COAP_NO_BLOCK ||
+		    (ack & 0x07) == 7) {
+			LOG(LOG_ERROR, "CoAP: block %zu not taken\n",
+			    off / size);
+			goto end;
+		}
+		/* the server may take smaller blocks than offered */
+		if ((ack & 0x07) < szx)
+			szx = ack & 0x07;
+		off = (size_t)((ack >> 4) + 1) * COAP_BLOCK_SIZE(ack & 0x07);
+		size = COAP_BLOCK_SIZE(szx);
+		if (off >= length)
+			goto end;
+	}
+
+	if (!coapBuildRequest(rest, buf + off, length - off,
+			      off ? (uint32_t)(off / size) << 4 | szx
+				  : COAP_NO_BLOCK,
+			      COAP_NO_BLOCK, 0) ||
+	    !coapTransmit(handle))
+		goto end;
+	ret = (int32_t)length;
+end:
+	SDO_TRACE_END("net", "send", ret < 0 ? -1 : (int32_t)messageType,
+		      traceStart);
+	return ret;
+}
+
+/**
+ * Send(write) a message, which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConSendMessageAsync(sdoConHandle handle, uint32_t protocolVersion,
+			       uint32_t messageType, const uint8_t *buf,
+			       size_t length, void *ssl)
+{
+	if (sdoConSendMessage(handle, protocolVersion, messageType, buf,
+			      length, ssl) < 0)
+		return SDO_CON_ERROR;
+	return SDO_CON_DONE;
+}
+
+/**
+ * Non-blocking mode is not supported, the protocols run blocking I/O.
+ *
+ * @retval -1
+ */
+int32_t sdoConSetNonBlocking(sdoConHandle handle, bool enable)
+{
+	(void)handle;
+	(void)enable;
+	return -1;
+}
+
+/**
+ * There is no file descriptor to wait on, as there is no non-blocking mode.
+ *
+ * @retval -1
+ */
+int32_t sdoConGetFd(sdoConHandle handle)
+{
+	(void)handle;
+	return -1;
+}
+
+/**
+ * Set timeouts of connection operations. 0 means no timeout.
+ *
+ * @param connectMs - time to find a server that answers.
+ * @param readMs - time the server has for a response, once it has
+ * acknowledged the request.
+ * @param writeMs - unused, requests are retransmitted as RFC 7252 says.
+ */
+void sdoConSetTimeouts(uint32_t connectMs, uint32_t readMs, uint32_t writeMs)
+{
+	conTimeouts.connectMs = connectMs;
+	conTimeouts.readMs = readMs;
+	conTimeouts.writeMs = writeMs;
+}
+
+/**
+ * Set deadline of the running protocol. Connection operations fail once it
+ * has passed.
+ *
+ * @param deadline - deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoConSetDeadline(uint64_t deadline)
+{
+	conDeadline = deadline;
+}
+
+/**
+ * sdoConTearDown connection tear-down.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t sdoConTeardown(void)
+{
+	coapBodyReset();
+
+	/* REST context over */
+	exitRESTContext();
+	return 0;
+}
+
+/**
+ * Put the SDO device to low power state
+ *
+ * @param sec
+ *        number of seconds to put the device to low power state
+ *
+ * @return none
+ */
+void sdoSleep(int sec)
+{
+	sleep(sec);
+}
+
+/**
+ * Put the SDO device to low power state, with millisecond granularity
+ *
+ * @param ms
+ *        number of milliseconds to put the device to low power state
+ *
+ * @return none
+ */
+void sdoSleepMs(uint32_t ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+/**
+ * Convert from Network to Host byte order
+ *
+ * @param value
+ *        Number in network byte order.
+ *
+ * @return
+ *         Value in Host byte order.
+ */
+uint32_t sdoNetToHostLong(uint32_t value)
+{
+	return ntohl(value);
+}
+
+/**
+ * Convert from Host to Network byte order
+ *
+ * @param value
+ *         Value in Host byte order.
+ *
+ * @return
+ *        Number in network byte order.
+ */
+uint32_t sdoHostToNetLong(uint32_t value)
+{
+	return htonl(value);
+}
+
+/**
+ * Convert from ASCII to Network format
+ *
+ * @param src
+ *         Source address in ASCII format.
+ * @param addr
+ *         Source address in network format.
+ *
+ * @return
+ *        1 on success. -1 on error. 0 if input format is invalie
+ */
+int32_t sdoPrintableToNet(const char *src, void *addr)
+{
+	return inet_pton(AF_INET, src, addr);
+}
+
+/**
+ * get device model
+ *
+ * @return
+ *        returns model as string
+ */
+const char *get_device_model(void)
+{
+	return "Intel-SDO-Linux";
+}
+
+/**
+ *  get device serial number
+ *
+ * @return
+ *        returns device serial number as string.
+ */
+const char *get_device_serial_number(void)
+{
+	return "sdo-linux-1234";
+}
+
+/**
+ * sdo_random generates random number and returns
+ *
+ * Note: this is only to be used for calculating random
+ * network delay for retransmissions and NOT for crypto
+ *
+ * @return
+ *        returns random number
+ */
+int sdoRandom(void)
+{
+	return rand();
+}
+
+/**
+ * Monotonic time, not affected by changes of the wall clock.
+ *
+ * @return
+ *        returns milliseconds elapsed since an unspecified starting point
+ */
+uint64_t sdoTimeMs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Monotonic time in microseconds, for measuring short operations.
+ *
+ * @return
+ *        returns microseconds elapsed since the starting point of sdoTimeMs
+ */
+uint64_t sdoTimeUs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
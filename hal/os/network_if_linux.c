@@ -16,8 +16,20 @@
 #include <stdlib.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <errno.h>
 #include <netdb.h> //hostent
 #include <arpa/inet.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <poll.h>
+#ifdef SDO_TCP_FASTOPEN
+#include <netinet/tcp.h>
+#endif
+#ifdef HTTP_DEFLATE
+#include <zlib.h>
+#endif
 
 #include "util.h"
 #include "network_al.h"
@@ -27,404 +39,2189 @@
 #include "safe_lib.h"
 #include "snprintf_s.h"
 #include "rest_interface.h"
+#ifdef HTTP2
+#include "h2_interface.h"
+#endif
+#include "sdotrace.h"
 
-/**
- * Read from socket until new-line is encountered.
- *
- * @param sock - socket-id.
- * @param out -  out pointer for REST header line.
- * @param size - out REST header line length.
- * @param ssl -  SSL pointer if TLS is active
- * @retval true if line read was successful, false otherwise.
+/*
+ * Connection race: attempts in flight, stagger between starts, and limit
+ * when no connect timeout is set
  */
-static bool readUntilNewLine(uint32_t sock, char *out, size_t size, void *ssl)
-{
-	int sz, n;
-	char c;
+#define CONNECT_RACE_MAX 8
+#define CONNECT_RACE_STAGGER_MS 250
+#define CONNECT_RACE_TIMEOUT_MS 30000
 
-	if (!out || !size)
-		return false;
+#if defined(SDO_TCP_FASTOPEN) && !defined(TCP_FASTOPEN_CONNECT)
+#define TCP_FASTOPEN_CONNECT 30 /* linux 4.11 */
+#endif
 
-	--size; // leave room for NULL
-	sz = 0;
-	for (;;) {
+/* Default timeouts of connection operations, 0 means no timeout */
+#ifndef CON_CONNECT_TIMEOUT_MS
+#define CON_CONNECT_TIMEOUT_MS 10000
+#endif
+#ifndef CON_READ_TIMEOUT_MS
+#define CON_READ_TIMEOUT_MS 60000
+#endif
+#ifndef CON_WRITE_TIMEOUT_MS
+#define CON_WRITE_TIMEOUT_MS 60000
+#endif
 
-		if (ssl)
-			n = sdo_ssl_read(ssl, (uint8_t *)&c, 1);
-		else
-			n = recv(sock, (uint8_t *)&c, 1, MSG_WAITALL);
+/*
+ * Timeouts of connect, read and write operations, and the deadline of the
+ * protocol this thread runs (0 if none) that bounds all of them.
+ */
+static struct {
+	uint32_t connectMs;
+	uint32_t readMs;
+	uint32_t writeMs;
+} conTimeouts = {CON_CONNECT_TIMEOUT_MS, CON_READ_TIMEOUT_MS,
+		 CON_WRITE_TIMEOUT_MS};
+static SDO_THREAD_LOCAL uint64_t conDeadline;
 
-		if (n <= 0) {
-			LOG(LOG_ERROR,
-			    "Socket Read Failed, ret=%d, "
-			    "errno=%d, %d\n",
-			    n, errno, __LINE__);
-			return false;
-		}
-		if (sz < size)
-			out[sz++] = c;
+/**
+ * Get the time allowed for an operation, bounded by the deadline.
+ *
+ * @param ms - timeout of the operation, 0 for none.
+ * @param out - out time allowed in ms, 0 for no limit.
+ * @retval false if the deadline has passed, true otherwise.
+ */
+static bool conTimeout(uint32_t ms, uint32_t *out)
+{
+	uint64_t now;
 
-		if (c == '\n')
-			break;
-	}
-	out[sz] = 0;
-	/* remove \n and \r and don't process invalid string */
-	if ((sz < size) && (sz >= 1)) {
-		out[--sz] = 0; // remove NL
-		if ((sz >= 1) && (out[sz - 1] == '\r'))
-			out[--sz] = 0; // ... remove CRNL
-	}
+	*out = ms;
+	if (!conDeadline)
+		return true;
 
+	now = sdoTimeMs();
+	if (now >= conDeadline) {
+		LOG(LOG_ERROR, "Protocol deadline expired\n");
+		return false;
+	}
+	if (!ms || conDeadline - now < ms)
+		*out = conDeadline - now;
 	return true;
 }
 
 /**
- * sdoConSetup Connection Setup.
+ * Apply read and write timeouts to a blocking connection, so that a stalled
+ * peer fails the operation instead of hanging it.
  *
- * @param medium - specified network medium to connect to
- * @param params - parameters(if any) supported for 'medium'
- * @param count - number of valid string in params
- * @return 0 on success. -1 on failure
+ * @param sock - socket-id.
+ * @retval -1 on failure or if the deadline has passed, 0 on success.
  */
-int32_t sdoConSetup(char *medium, char **params, uint32_t count)
+static int conApplyTimeouts(int sock)
 {
-	/*TODO: make use of input params (if required ?)*/
-	(void)medium;
-	(void)params;
-	(void)count;
+	struct timeval tv;
+	uint32_t ms;
 
-	// Initiate REST context
-	if (!initRESTContext()) {
-		LOG(LOG_ERROR, "initRESTContext() failed!\n");
+	if (sock < 0)
+		return 0;
+
+	if (!conTimeout(conTimeouts.readMs, &ms))
 		return -1;
-	}
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	if (setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0)
+		return -1;
+
+	if (!conTimeout(conTimeouts.writeMs, &ms))
+		return -1;
+	tv.tv_sec = ms / 1000;
+	tv.tv_usec = (ms % 1000) * 1000;
+	if (setsockopt(sock, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0)
+		return -1;
+
 	return 0;
 }
 
+/* Size of the buffer holding data received ahead of the REST parser */
+#define REST_RX_BUF_SIZE (2 * REST_MAX_MSGHDR_SIZE)
+
+/*
+ * Receive buffer of the connection. REST header is read in chunks into it
+ * and parsed in place; any body bytes that came along with the header are
+ * handed over to sdoConRecvMsgBody().
+ */
+typedef struct {
+	size_t start; // first unconsumed byte
+	size_t end;   // one past the last received byte
+	uint8_t data[REST_RX_BUF_SIZE];
+} sdoRxBuf_t;
+
+static SDO_THREAD_LOCAL sdoRxBuf_t rxbuf;
+
+#ifdef HTTP_DEFLATE
+/*
+ * Encoded body of a response. Its decoded length is only known once it is
+ * inflated, so it is received along with the header and handed out by
+ * sdoConRecvMsgBody() from the decoded copy.
+ */
+static SDO_THREAD_LOCAL struct {
+	uint8_t *in; // encoded body being received
+	size_t inLen;
+	size_t inRead;
+	uint8_t *out; // decoded body
+	size_t outLen;
+	size_t outOff; // first byte not handed out yet
+} zbody;
+
 /**
- * Perform a DNS look for a specified host.
- * Note : return ip address in network format.
- * @param url - host's URL.
- * @param ipList - output IP address list for specified host URL.
- * @param ipListSize - output number of IP address in ipList
- * @retval -1 on failure, 0 on success.
+ * Drop the encoded body and its decoded copy.
  */
-int32_t sdoConDnsLookup(const char *url, SDOIPAddress_t **ipList,
-			uint32_t *ipListSize)
+static void zbodyReset(void)
 {
-	int idx;
-	struct addrinfo *result = NULL, *it = NULL;
-	struct addrinfo hints;
-	struct sockaddr_in *sa_in = NULL;
-	SDOIPAddress_t *ip_list = NULL;
-	int32_t ret = -1;
+	if (zbody.in)
+		sdoFree(zbody.in);
+	if (zbody.out)
+		sdoFree(zbody.out);
+	zbody.inLen = zbody.inRead = 0;
+	zbody.outLen = zbody.outOff = 0;
+}
+#endif
 
-	if (!url || !ipList || !ipListSize)
-		return ret;
+#ifdef HTTP2
+/* Requests in flight on an HTTP/2 connection */
+#ifndef H2_STREAMS_MAX
+#define H2_STREAMS_MAX 4
+#endif
+/* Header block of a response, with its CONTINUATION frames */
+#define H2_BLOCK_SIZE 4096
 
-	LOG(LOG_DEBUG, "Resolving DNS-URL: <%s>\n", url);
+/*
+ * Request sent over HTTP/2 and its response, collected as its frames come:
+ * the header, decoded into HTTP/1.1 text, and the body.
+ */
+typedef struct {
+	uint32_t id;
+	int64_t window; // send window of the stream
+	bool headers;	// response header received
+	bool ended;	// response complete
+	bool reset;	// stream reset by the server
+	char hdr[REST_RX_BUF_SIZE];
+	size_t hdrLen;
+	uint8_t *body;
+	size_t bodyLen;
+} h2Stream_t;
 
-	if (memset_s(&hints, sizeof hints, 0) != 0) {
-		LOG(LOG_ERROR, "Memset failed\n");
-		goto end;
-	}
+/*
+ * HTTP/2 connection, once TLS has agreed on it (ALPN). A request is a
+ * stream of it, several may be in flight; their responses, which may come
+ * interleaved, are handed out in the order of the requests.
+ */
+static SDO_THREAD_LOCAL struct {
+	bool on;
+	bool goaway;	     // the server takes no more streams
+	uint32_t lastId;     // streams above it are not processed, GOAWAY
+	uint32_t nextId;     // of the next request
+	uint32_t maxStreams; // SETTINGS_MAX_CONCURRENT_STREAMS of the server
+	uint32_t maxFrame;   // SETTINGS_MAX_FRAME_SIZE of the server
+	uint32_t initWindow; // SETTINGS_INITIAL_WINDOW_SIZE of the server
+	int64_t window;	     // send window of the connection
+	h2Table_t enc;
+	h2Table_t dec;
+	h2Stream_t streams[H2_STREAMS_MAX]; // in order of the requests
+	uint32_t count;
+	uint8_t *frame; // payload of the frame read last
+	uint8_t block[H2_BLOCK_SIZE];
+	size_t blockLen;
+	uint32_t blockStream; // stream of the header block, 0 if none
+	bool blockEnd;	      // the block ends its stream
+	uint8_t *out;	      // body handed out by sdoConRecvMsgBody()
+	size_t outLen;
+	size_t outOff;
+} h2;
 
-	hints.ai_family = AF_INET; // IPv4
-	hints.ai_socktype = SOCK_STREAM;
+/**
+ * Drop the HTTP/2 state of the connection, and the responses with it.
+ */
+static void h2Reset(void)
+{
+	uint32_t i;
 
-	// get the list-of IP addresses
-	if (getaddrinfo(url, NULL, &hints, &result) != 0) {
-		LOG(LOG_ERROR, "getaddrinfo() failed!\n");
-		goto end;
+	for (i = 0; i < h2.count; i++) {
+		if (h2.streams[i].body)
+			sdoFree(h2.streams[i].body);
 	}
+	if (h2.frame)
+		sdoFree(h2.frame);
+	if (h2.out)
+		sdoFree(h2.out);
+	h2.on = false;
+	h2.count = 0;
+	h2.blockLen = 0;
+	h2.blockStream = 0;
+	h2.outLen = 0;
+	h2.outOff = 0;
+}
+#endif
 
-	int len = 0;
+/**
+ * Drop all buffered data. To be called whenever the connection changes.
+ */
+static void rxbufReset(void)
+{
+	rxbuf.start = 0;
+	rxbuf.end = 0;
+#ifdef HTTP_DEFLATE
+	zbodyReset();
+#endif
+#ifdef HTTP2
+	h2Reset();
+#endif
+}
 
-	// get length of the ip-address LL
-	for (it = result; it != NULL; it = it->ai_next) {
-		++len;
+/*
+ * Message being sent by sdoConSendMessageAsync(): REST header and body,
+ * and how much of it has been written.
+ */
+static SDO_THREAD_LOCAL struct {
+	uint8_t *buf;
+	size_t len;
+	size_t off;
+} txbuf;
+
+/**
+ * Drop the message being sent. To be called whenever the connection
+ * changes.
+ */
+static void txbufReset(void)
+{
+	if (txbuf.buf)
+		sdoFree(txbuf.buf);
+	txbuf.len = 0;
+	txbuf.off = 0;
+}
+
+#if defined(NET_RECORD)
+/*
+ * Transcript of the messages sent and received, played back by
+ * network_if_replay.c: per message a line "> <version> <type> <length>"
+ * (sent) or "< <version> <type> <length>" (received), then its body and a
+ * new line. Runs append to it, the first run starts it.
+ */
+static struct {
+	char path[FILENAME_MAX];
+	FILE *fp;
+	size_t rxLeft; // bytes of the received body still to come
+} rec;
+SDO_MUTEX(rec_lock);
+
+static FILE *recFile(void)
+{
+	const char *path = rec.path[0] ? rec.path : SDO_TRANSCRIPT;
+
+	if (!rec.fp) {
+		rec.fp = fopen(path, "ab");
+		if (!rec.fp)
+			LOG(LOG_ERROR, "Transcript %s not opened\n", path);
 	}
+	return rec.fp;
+}
 
-	ip_list = sdoAlloc(sizeof(SDOIPAddress_t) * len);
+static void recMsg(char dir, uint32_t protocolVersion, uint32_t messageType,
+		   const uint8_t *body, size_t length)
+{
+	FILE *fp;
+
+	SDO_LOCK(rec_lock);
+	fp = recFile();
+	if (fp) {
+		fprintf(fp, "%c %u %u %zu\n", dir, protocolVersion,
+			messageType, length);
+		rec.rxLeft = body ? 0 : length;
+		if (body)
+			fwrite(body, 1, length, fp);
+		if (!rec.rxLeft)
+			fputc('\n', fp);
+		fflush(fp);
+	}
+	SDO_UNLOCK(rec_lock);
+}
 
-	if (!ip_list) {
-		LOG(LOG_ERROR, "Malloc failed!\n");
-		goto end;
+static void recBody(const uint8_t *buf, size_t len)
+{
+	SDO_LOCK(rec_lock);
+	if (rec.fp && len && len <= rec.rxLeft) {
+		fwrite(buf, 1, len, rec.fp);
+		rec.rxLeft -= len;
+		if (!rec.rxLeft)
+			fputc('\n', rec.fp);
+		fflush(rec.fp);
 	}
+	SDO_UNLOCK(rec_lock);
+}
 
-	// iterate and store IP-addresses
-	for (idx = 0, it = result; it != NULL; ++idx, it = it->ai_next) {
-		sa_in = (struct sockaddr_in *)it->ai_addr;
+#define recSend(v, t, buf, len) recMsg('>', v, t, buf, len)
+#define recHeader(v, t, len) recMsg('<', v, t, NULL, len)
+#else
+#define recSend(v, t, buf, len)
+#define recHeader(v, t, len)
+#define recBody(buf, len)
+#endif
 
-#if LOG_LEVEL == LOG_MAX_LEVEL
-		// for trace purpose
-		char host[16];
-		inet_ntop(AF_INET, &(sa_in->sin_addr), host, 16);
-		LOG(LOG_DEBUG, "Resolved into IP-Address: <%s>\n", host);
+/**
+ * Set the transcript the messages are recorded to, with NET_REPLAY=record.
+ *
+ * @param path - transcript file, NULL for SDO_TRANSCRIPT.
+ * @retval -1 if the messages are not recorded, 0 otherwise.
+ */
+int32_t sdoConTranscript(const char *path)
+{
+#if defined(NET_RECORD)
+	int32_t ret = 0;
+
+	SDO_LOCK(rec_lock);
+	if (rec.fp)
+		fclose(rec.fp);
+	rec.fp = NULL;
+	rec.rxLeft = 0;
+	rec.path[0] = 0;
+	if (path && strcpy_s(rec.path, sizeof(rec.path), path) != 0)
+		ret = -1;
+	SDO_UNLOCK(rec_lock);
+	return ret;
+#else
+	(void)path;
+	return -1;
 #endif
-		(ip_list + idx)->length = IPV4_ADDR_LEN;
+}
 
-		if (memcpy_s((ip_list + idx)->addr, ip_list->length,
-			     &(sa_in->sin_addr.s_addr), ip_list->length) != 0) {
-			LOG(LOG_ERROR, "Memcpy failed\n");
-			goto end;
-		}
-	}
+/**
+ * Read from the connection, without blocking if the connection has been
+ * put in non-blocking mode.
+ *
+ * @param sock - socket-id.
+ * @param ssl -  SSL pointer if TLS is active
+ * @param buf - buffer to read into.
+ * @param len - size of buf.
+ * @param n - out number of bytes read.
+ * @retval SDO_CON_DONE if data was read, SDO_CON_WANT_READ/WRITE if the
+ * read would block, SDO_CON_ERROR otherwise.
+ */
+static int32_t conRead(sdoConHandle sock, void *ssl, void *buf, size_t len,
+		       int *n)
+{
+	if (ssl) {
+#ifdef USE_OPENSSL
+		*n = sdo_ssl_read_nb(ssl, buf, len);
+		if (*n == SDO_SSL_WANT_READ)
+			return SDO_CON_WANT_READ;
+		if (*n == SDO_SSL_WANT_WRITE)
+			return SDO_CON_WANT_WRITE;
+#else
+		*n = sdo_ssl_read(ssl, buf, len);
+#endif
+	} else {
+		do {
+			*n = recv(sock, buf, len, 0);
+		} while (*n < 0 && errno == EINTR);
 
-	*ipList = ip_list;
-	*ipListSize = len;
-	ret = 0;
+		if (*n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return SDO_CON_WANT_READ;
+	}
 
-end:
-	// avoid leak in case DNS look-up operation was not successful.
-	if (ret != 0) {
-		*ipListSize = 0;
-		if (ip_list) {
-			sdoFree(ip_list);
-		}
+	if (*n <= 0) {
+		LOG(LOG_ERROR,
+		    "Socket Read Failed, ret=%d, "
+		    "errno=%d, %d\n",
+		    *n, errno, __LINE__);
+		return SDO_CON_ERROR;
 	}
-	if (result)
-		freeaddrinfo(result); // free the addr list always
-	return ret;
+	return SDO_CON_DONE;
 }
 
 /**
- * sdoConConnect connects to the network socket
+ * Write to the connection, without blocking if the connection has been
+ * put in non-blocking mode.
  *
- * @param ip_addr - pointer to IP address info
- * @param port - port number to connect
- * @param ssl - ssl handler in case of tls connection.
- * @return connection handle on success. -ve value on failure
+ * @param sock - socket-id.
+ * @param ssl -  SSL pointer if TLS is active
+ * @param buf - data to write.
+ * @param len - length of data.
+ * @param n - out number of bytes written.
+ * @retval SDO_CON_DONE if data was written, SDO_CON_WANT_READ/WRITE if the
+ * write would block, SDO_CON_ERROR otherwise.
  */
-
-sdoConHandle sdoConConnect(SDOIPAddress_t *ip_addr, uint16_t port, void **ssl)
+static int32_t conWrite(sdoConHandle sock, void *ssl, const void *buf,
+			size_t len, int *n)
 {
-	int sock = SDO_CON_INVALID_HANDLE;
-	struct sockaddr_in haddr;
-
-	if (!ip_addr)
-		goto end;
+	if (ssl) {
+#ifdef USE_OPENSSL
+		*n = sdo_ssl_write_nb(ssl, buf, len);
+		if (*n == SDO_SSL_WANT_READ)
+			return SDO_CON_WANT_READ;
+		if (*n == SDO_SSL_WANT_WRITE)
+			return SDO_CON_WANT_WRITE;
+#else
+		*n = sdo_ssl_write(ssl, buf, len);
+#endif
+	} else {
+		do {
+			*n = send(sock, buf, len, MSG_NOSIGNAL);
+		} while (*n < 0 && errno == EINTR);
 
-	if (memset_s(&haddr, sizeof haddr, 0) != 0) {
-		LOG(LOG_ERROR, "Memset failed\n");
-		goto end;
+		if (*n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return SDO_CON_WANT_WRITE;
 	}
 
-	if (memcpy_s(&haddr.sin_addr.s_addr, ip_addr->length, &ip_addr->addr[0],
-		     ip_addr->length) != 0) {
-		LOG(LOG_ERROR, "Memcpy failed\n");
-		goto end;
+	if (*n <= 0) {
+		LOG(LOG_ERROR,
+		    "Socket write Failed, ret=%d, "
+		    "errno=%d, %d\n",
+		    *n, errno, __LINE__);
+		return SDO_CON_ERROR;
 	}
+	return SDO_CON_DONE;
+}
 
-	haddr.sin_family = AF_INET; // IPV4
-	haddr.sin_port = htons(port);
+/**
+ * Read whatever is available on the connection into the receive buffer.
+ *
+ * @param sock - socket-id.
+ * @param ssl -  SSL pointer if TLS is active
+ * @retval SDO_CON_DONE if some data was read, SDO_CON_WANT_READ/WRITE if the
+ * read would block, SDO_CON_ERROR otherwise.
+ */
+static int32_t rxbufFill(sdoConHandle sock, void *ssl)
+{
+	int32_t ret;
+	int n;
 
-#ifdef USE_MBEDTLS
+	/* move unconsumed data to the front to make room */
+	if (rxbuf.start) {
+		if (rxbuf.end > rxbuf.start &&
+		    memmove_s(rxbuf.data, sizeof(rxbuf.data),
+			      &rxbuf.data[rxbuf.start],
+			      rxbuf.end - rxbuf.start) != 0) {
+			LOG(LOG_ERROR, "Memmove failed\n");
+			return SDO_CON_ERROR;
+		}
+		rxbuf.end -= rxbuf.start;
+		rxbuf.start = 0;
+	}
 
-	if (ssl) {
-		char ipv4[IP_TAG_LEN] = {0};
-		char port_s[MAX_PORT_SIZE] = {0};
-		uint8_t octlet_size =
-		    4; // e.g 192.168.0.100, max 3char + 1null/oct.
+	if (rxbuf.end == sizeof(rxbuf.data)) {
+		LOG(LOG_ERROR, "REST header too large\n");
+		return SDO_CON_ERROR;
+	}
 
-		if (!ip_addr)
-			goto end;
+	ret = conRead(sock, ssl, &rxbuf.data[rxbuf.end],
+		      sizeof(rxbuf.data) - rxbuf.end, &n);
+	if (ret == SDO_CON_DONE)
+		rxbuf.end += n;
+	return ret;
+}
 
-		/*
-		 * Convert ip binary to string format as required by
-		 * mbed connect
-		 */
-		if ((snprintf_s_i(ipv4, octlet_size, "%d", ip_addr->addr[0]) <
-		     0) ||
-		    (snprintf_s_i((ipv4 + strnlen_s(ipv4, IP_TAG_LEN)),
-				  octlet_size + 1, ".%d",
-				  ip_addr->addr[1]) < 0) ||
-		    (snprintf_s_i((ipv4 + strnlen_s(ipv4, IP_TAG_LEN)),
-				  octlet_size + 1, ".%d",
-				  ip_addr->addr[2]) < 0) ||
-		    (snprintf_s_i((ipv4 + strnlen_s(ipv4, IP_TAG_LEN)),
-				  octlet_size + 1, ".%d",
-				  ip_addr->addr[3]) < 0)) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto end;
+/**
+ * Find the end of REST header (the empty line) in the receive buffer.
+ *
+ * @param hdrlen - out length of header without the empty line.
+ * @param sepLen - out length of the empty line (incl. preceding new-line).
+ * @retval true if the complete header is buffered, false otherwise.
+ */
+static bool rxbufFindHeaderEnd(size_t *hdrlen, size_t *sepLen)
+{
+	size_t i;
+	uint8_t *p = &rxbuf.data[rxbuf.start];
+	size_t len = rxbuf.end - rxbuf.start;
+
+	for (i = 0; i + 1 < len; i++) {
+		if (p[i] != '\n')
+			continue;
+		if (p[i + 1] == '\n') {
+			*hdrlen = i + 1;
+			*sepLen = 1;
+			return true;
 		}
-		if (snprintf_s_i(port_s, sizeof port_s, "%d", port) < 0) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto end;
+		if (p[i + 1] == '\r' && i + 2 < len && p[i + 2] == '\n') {
+			*hdrlen = i + 1;
+			*sepLen = 2;
+			return true;
 		}
+	}
+	return false;
+}
 
-		*ssl = sdo_ssl_setup_connect(ipv4, port_s);
+#ifdef HTTP2
+/**
+ * Internal API: write all of a buffer to the HTTP/2 connection.
+ *
+ * @retval true on success, false otherwise.
+ */
+static bool h2Write(sdoConHandle handle, void *ssl, const uint8_t *buf,
+		    size_t len)
+{
+	size_t off;
+	int n;
 
-		if (NULL == *ssl) {
-			LOG(LOG_ERROR, "TLS connection "
-				       "setup "
-				       "failed\n");
-			goto end;
-		}
-		return MBEDTLS_NET_DUMMY_SOCKET;
+	for (off = 0; off < len; off += n) {
+		if (conWrite(handle, ssl, buf + off, len - off, &n) !=
+		    SDO_CON_DONE)
+			return false;
 	}
-#endif
-	sock = socket(AF_INET, SOCK_STREAM, 0);
+	return true;
+}
 
-	if (sock < 0)
-		goto end;
+/**
+ * Internal API: read the given number of bytes from the HTTP/2 connection,
+ * those already buffered first.
+ *
+ * @retval true on success, false otherwise.
+ */
+static bool h2Read(sdoConHandle handle, void *ssl, uint8_t *buf, size_t len)
+{
+	size_t off = 0, avail;
+	int n;
 
-	if (connect(sock, (struct sockaddr *)&haddr, sizeof haddr) < 0) {
-		LOG(LOG_ERROR, "Socket Connect failed, trying next IP\n");
-		close(sock);
-		sock = -1;
-		goto end;
+	avail = rxbuf.end - rxbuf.start;
+	if (avail) {
+		if (avail > len)
+			avail = len;
+		if (memcpy_s(buf, len, &rxbuf.data[rxbuf.start], avail) != 0)
+			return false;
+		rxbuf.start += avail;
+		off = avail;
 	}
-#if defined(USE_OPENSSL)
-	if (ssl) {
-		*ssl = sdo_ssl_setup(sock);
+	for (; off < len; off += n) {
+		if (conRead(handle, ssl, buf + off, len - off, &n) !=
+		    SDO_CON_DONE)
+			return false;
+	}
+	return true;
+}
 
-		if (NULL == *ssl) {
-			LOG(LOG_ERROR, "TLS connection setup failed\n");
-			close(sock);
-			sock = SDO_CON_INVALID_HANDLE;
-		}
+/**
+ * Internal API: send a frame of the connection with a 4 byte payload,
+ * WINDOW_UPDATE, RST_STREAM or the like.
+ *
+ * @retval true on success, false otherwise.
+ */
+static bool h2Send32(sdoConHandle handle, void *ssl, uint8_t type,
+		     uint32_t stream, uint32_t val)
+{
+	uint8_t buf[H2_FRAME_HDR_LEN + 4];
+
+	(void)h2PutFrameHeader(buf, 4, type, 0, stream);
+	buf[H2_FRAME_HDR_LEN] = (val >> 24) & 0xff;
+	buf[H2_FRAME_HDR_LEN + 1] = (val >> 16) & 0xff;
+	buf[H2_FRAME_HDR_LEN + 2] = (val >> 8) & 0xff;
+	buf[H2_FRAME_HDR_LEN + 3] = val & 0xff;
+	return h2Write(handle, ssl, buf, sizeof(buf));
+}
 
-		if (sdo_ssl_connect(*ssl)) {
-			LOG(LOG_ERROR, "TLS connect failed\n");
-			close(sock);
-			sock = SDO_CON_INVALID_HANDLE;
-		}
-	}
-#endif
-end:
-	return sock;
+/**
+ * Internal API: tell the server the connection is over, GOAWAY.
+ *
+ * @param error - error code, H2_NO_ERROR when closing.
+ */
+static void h2GoAway(sdoConHandle handle, void *ssl, uint32_t error)
+{
+	uint8_t buf[H2_FRAME_HDR_LEN + 8] = {0};
+
+	(void)h2PutFrameHeader(buf, 8, H2_GOAWAY, 0, 0);
+	buf[H2_FRAME_HDR_LEN + 7] = error & 0xff;
+	(void)h2Write(handle, ssl, buf, sizeof(buf));
+}
+
+static uint32_t h2Get32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | p[3];
+}
+
+/**
+ * Internal API: start HTTP/2 on a connection TLS has agreed on it for:
+ * the preface and the settings of the client, server push off.
+ *
+ * @retval true on success, false otherwise.
+ */
+static bool h2Start(sdoConHandle handle, void *ssl)
+{
+	uint8_t buf[H2_PREFACE_LEN + H2_FRAME_HDR_LEN + 2 * 6];
+	uint8_t *p = buf + H2_PREFACE_LEN + H2_FRAME_HDR_LEN;
+
+	h2Reset();
+	h2.frame = sdoAlloc(H2_MAX_FRAME_SIZE);
+	if (!h2.frame) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return false;
+	}
+
+	if (memcpy_s(buf, sizeof(buf), H2_PREFACE, H2_PREFACE_LEN) != 0)
+		return false;
+	(void)h2PutFrameHeader(buf + H2_PREFACE_LEN, 2 * 6, H2_SETTINGS, 0,
+			       0);
+	p[0] = 0;
+	p[1] = H2_SETTINGS_ENABLE_PUSH;
+	p[2] = p[3] = p[4] = p[5] = 0;
+	p[6] = 0;
+	p[7] = H2_SETTINGS_HEADER_TABLE_SIZE;
+	p[8] = (H2_TABLE_SIZE >> 24) & 0xff;
+	p[9] = (H2_TABLE_SIZE >> 16) & 0xff;
+	p[10] = (H2_TABLE_SIZE >> 8) & 0xff;
+	p[11] = H2_TABLE_SIZE & 0xff;
+	if (!h2Write(handle, ssl, buf, sizeof(buf))) {
+		LOG(LOG_ERROR, "HTTP/2 preface write failed\n");
+		return false;
+	}
+
+	h2.on = true;
+	h2.goaway = false;
+	h2.lastId = H2_MAX_WINDOW;
+	h2.nextId = 1;
+	h2.maxStreams = H2_STREAMS_MAX;
+	h2.maxFrame = H2_MAX_FRAME_SIZE;
+	h2.initWindow = H2_DEFAULT_WINDOW;
+	h2.window = H2_DEFAULT_WINDOW;
+	h2TableInit(&h2.enc);
+	h2TableInit(&h2.dec);
+	LOG(LOG_DEBUG, "HTTP/2 connection\n");
+	return true;
+}
+
+static h2Stream_t *h2Find(uint32_t id)
+{
+	uint32_t i;
+
+	for (i = 0; id && i < h2.count; i++) {
+		if (h2.streams[i].id == id)
+			return &h2.streams[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: the header block is complete, decode it. The first one of
+ * a stream is the response header; informational ones (1xx) and trailers
+ * are decoded for the dynamic table only.
+ *
+ * @retval true on success, false if the block is malformed.
+ */
+static bool h2BlockDone(void)
+{
+	h2Stream_t *s = h2Find(h2.blockStream);
+	bool first = s && !s->headers && !s->reset;
+	size_t len;
+
+	if (!h2DecodeResponse(&h2.dec, h2.block, h2.blockLen,
+			      first ? s->hdr : NULL, REST_RX_BUF_SIZE,
+			      first ? &s->hdrLen : &len))
+		return false;
+	if (first)
+		s->headers = s->hdr[sizeof("HTTP/2.0 ") - 1] != '1';
+	if (s && h2.blockEnd)
+		s->ended = true;
+	h2.blockStream = 0;
+	h2.blockLen = 0;
+	return true;
+}
+
+/**
+ * Internal API: append a fragment of a header block.
+ *
+ * @retval true on success, false if the block is too large.
+ */
+static bool h2BlockAppend(const uint8_t *p, size_t len)
+{
+	if (len > sizeof(h2.block) - h2.blockLen) {
+		LOG(LOG_ERROR, "HTTP/2 header block too large\n");
+		return false;
+	}
+	if (len &&
+	    memcpy_s(h2.block + h2.blockLen, sizeof(h2.block) - h2.blockLen,
+		     p, len) != 0)
+		return false;
+	h2.blockLen += len;
+	return true;
+}
+
+/**
+ * Internal API: apply the settings of the server, and acknowledge them.
+ *
+ * @retval true on success, false if a setting is invalid.
+ */
+static bool h2Settings(sdoConHandle handle, void *ssl, const uint8_t *p,
+		       size_t len)
+{
+	uint8_t ack[H2_FRAME_HDR_LEN];
+	uint32_t id, val, i;
+	size_t off;
+
+	for (off = 0; off + 6 <= len; off += 6) {
+		id = ((uint32_t)p[off] << 8) | p[off + 1];
+		val = h2Get32(p + off + 2);
+		switch (id) {
+		case H2_SETTINGS_HEADER_TABLE_SIZE:
+			h2TableResize(&h2.enc, val);
+			break;
+		case H2_SETTINGS_MAX_CONCURRENT_STREAMS:
+			h2.maxStreams = val;
+			break;
+		case H2_SETTINGS_INITIAL_WINDOW_SIZE:
+			if (val > H2_MAX_WINDOW)
+				return false;
+			/* the open streams get the difference */
+			for (i = 0; i < h2.count; i++)
+				h2.streams[i].window +=
+				    (int64_t)val - h2.initWindow;
+			h2.initWindow = val;
+			break;
+		case H2_SETTINGS_MAX_FRAME_SIZE:
+			if (val < H2_MAX_FRAME_SIZE || val > 0xffffff)
+				return false;
+			h2.maxFrame = val;
+			break;
+		default:
+			break;
+		}
+	}
+	(void)h2PutFrameHeader(ack, 0, H2_SETTINGS, H2_FLAG_ACK, 0);
+	return h2Write(handle, ssl, ack, sizeof(ack));
+}
+
+/**
+ * Internal API: read a frame of the HTTP/2 connection and process it.
+ *
+ * @retval true on success, false if the connection failed or broke the
+ * protocol.
+ */
+static bool h2ReadFrame(sdoConHandle handle, void *ssl)
+{
+	uint8_t hdr[H2_FRAME_HDR_LEN + 8];
+	const uint8_t *p = h2.frame;
+	h2Stream_t *s;
+	h2Frame_t f;
+	uint32_t len, i;
+	uint8_t *body;
+
+	if (!h2Read(handle, ssl, hdr, H2_FRAME_HDR_LEN))
+		return false;
+	h2GetFrameHeader(hdr, &f);
+	if (f.len > H2_MAX_FRAME_SIZE ||
+	    (f.len && !h2Read(handle, ssl, h2.frame, f.len)))
+		goto err;
+	len = f.len;
+
+	/* a header block goes on in CONTINUATION frames only */
+	if (h2.blockStream &&
+	    (f.type != H2_CONTINUATION || f.stream != h2.blockStream))
+		goto err;
+	if ((f.type == H2_DATA || f.type == H2_HEADERS) &&
+	    (f.flags & H2_FLAG_PADDED)) {
+		if (!len || p[0] >= len)
+			goto err;
+		len -= 1 + p[0];
+		p++;
+	}
+	s = h2Find(f.stream);
+
+	switch (f.type) {
+	case H2_DATA:
+		if (!f.stream)
+			goto err;
+		/* the connection window is given back as the data comes */
+		if (f.len &&
+		    !h2Send32(handle, ssl, H2_WINDOW_UPDATE, 0, f.len))
+			return false;
+		if (!s || s->reset || s->ended)
+			break;
+		if (len) {
+			if (s->bodyLen + len > REST_MAX_MSGBODY_SIZE) {
+				LOG(LOG_ERROR, "HTTP/2 response too long\n");
+				return false;
+			}
+			body = sdoRealloc(s->body, (int)(s->bodyLen + len));
+			if (!body)
+				return false;
+			s->body = body;
+			if (memcpy_s(s->body + s->bodyLen, len, p, len) != 0)
+				return false;
+			s->bodyLen += len;
+		}
+		if (f.flags & H2_FLAG_END_STREAM)
+			s->ended = true;
+		break;
+	case H2_HEADERS:
+		if (!f.stream)
+			goto err;
+		if (f.flags & H2_FLAG_PRIORITY) {
+			if (len < 5)
+				goto err;
+			p += 5;
+			len -= 5;
+		}
+		h2.blockStream = f.stream;
+		h2.blockEnd = f.flags & H2_FLAG_END_STREAM;
+		h2.blockLen = 0;
+		/* FALLTHROUGH */
+	case H2_CONTINUATION:
+		if (!h2.blockStream || !h2BlockAppend(p, len))
+			goto err;
+		if ((f.flags & H2_FLAG_END_HEADERS) && !h2BlockDone())
+			goto err;
+		break;
+	case H2_SETTINGS:
+		if (f.stream || len % 6)
+			goto err;
+		if (!(f.flags & H2_FLAG_ACK) &&
+		    !h2Settings(handle, ssl, p, len))
+			goto err;
+		break;
+	case H2_PING:
+		if (f.stream || len != 8)
+			goto err;
+		if (f.flags & H2_FLAG_ACK)
+			break;
+		(void)h2PutFrameHeader(hdr, 8, H2_PING, H2_FLAG_ACK, 0);
+		if (memcpy_s(hdr + H2_FRAME_HDR_LEN, 8, p, 8) != 0 ||
+		    !h2Write(handle, ssl, hdr, sizeof(hdr)))
+			return false;
+		break;
+	case H2_GOAWAY:
+		if (f.stream || len < 8)
+			goto err;
+		h2.goaway = true;
+		h2.lastId = h2Get32(p) & H2_MAX_WINDOW;
+		LOG(LOG_DEBUG, "HTTP/2 GOAWAY, last stream %u, error %u\n",
+		    h2.lastId, h2Get32(p + 4));
+		for (i = 0; i < h2.count; i++) {
+			if (h2.streams[i].id > h2.lastId)
+				h2.streams[i].reset = true;
+		}
+		break;
+	case H2_RST_STREAM:
+		if (!f.stream || len != 4)
+			goto err;
+		if (s) {
+			LOG(LOG_ERROR, "HTTP/2 stream %u reset, error %u\n",
+			    f.stream, h2Get32(p));
+			s->reset = true;
+		}
+		break;
+	case H2_WINDOW_UPDATE:
+		if (len != 4 || !(h2Get32(p) & H2_MAX_WINDOW))
+			goto err;
+		if (!f.stream)
+			h2.window += h2Get32(p) & H2_MAX_WINDOW;
+		else if (s)
+			s->window += h2Get32(p) & H2_MAX_WINDOW;
+		break;
+	case H2_PUSH_PROMISE:
+		/* push is off */
+		goto err;
+	default:
+		/* PRIORITY, and frame types of extensions */
+		break;
+	}
+	return true;
+
+err:
+	LOG(LOG_ERROR, "HTTP/2 protocol error, frame type %u\n", f.type);
+	h2GoAway(handle, ssl, H2_PROTOCOL_ERROR);
+	return false;
+}
+
+/**
+ * Internal API: send a request over HTTP/2, on a new stream: its header,
+ * then its body in DATA frames as the flow control windows allow. The
+ * frames go out together when the windows allow the whole body.
+ *
+ * @retval true on success, false otherwise.
+ */
+static bool h2Send(sdoConHandle handle, void *ssl, uint32_t protocolVersion,
+		   uint32_t messageType, const uint8_t *buf, size_t length)
+{
+	RestCtx_t *rest = getRESTContext();
+	uint8_t *msg = NULL;
+	size_t size, pos, blockLen, off = 0, n;
+	h2Stream_t *s;
+	bool ret = false;
+
+	if (!rest) {
+		LOG(LOG_ERROR, "REST context is NULL!\n");
+		return false;
+	}
+	if (h2.goaway || h2.count == H2_STREAMS_MAX ||
+	    h2.count >= h2.maxStreams || h2.nextId > H2_MAX_WINDOW) {
+		LOG(LOG_ERROR, "HTTP/2: no stream left for the request\n");
+		return false;
+	}
+
+	/* the body in frames of H2_MAX_FRAME_SIZE at least, and a short one */
+	size = H2_FRAME_HDR_LEN + REST_MAX_MSGHDR_SIZE + length +
+	       H2_FRAME_HDR_LEN * (length / H2_MAX_FRAME_SIZE + 2);
+	msg = sdoAlloc((int)size);
+	if (!msg) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return false;
+	}
+
+	rest->protVer = protocolVersion;
+	rest->msgType = messageType;
+	rest->contentLength = length;
+	if (!h2EncodeRequest(&h2.enc, rest, msg + H2_FRAME_HDR_LEN,
+			     REST_MAX_MSGHDR_SIZE, &blockLen))
+		goto end;
+
+	s = &h2.streams[h2.count++];
+	if (memset_s(s, sizeof(*s), 0) != 0)
+		goto end;
+	s->id = h2.nextId;
+	s->window = h2.initWindow;
+	h2.nextId += 2;
+	pos = h2PutFrameHeader(msg, (uint32_t)blockLen, H2_HEADERS,
+			       H2_FLAG_END_HEADERS, s->id) +
+	      blockLen;
+
+	while (off < length) {
+		n = length - off;
+		if (n > h2.maxFrame)
+			n = h2.maxFrame;
+		if ((int64_t)n > h2.window)
+			n = h2.window > 0 ? (size_t)h2.window : 0;
+		if ((int64_t)n > s->window)
+			n = s->window > 0 ? (size_t)s->window : 0;
+		if (!n) {
+			/* out of window: send what is queued, await more */
+			if (pos && !h2Write(handle, ssl, msg, pos))
+				goto end;
+			pos = 0;
+			if (!h2ReadFrame(handle, ssl) || s->reset)
+				goto end;
+			continue;
+		}
+		pos += h2PutFrameHeader(msg + pos, (uint32_t)n, H2_DATA,
+					off + n == length ? H2_FLAG_END_STREAM
+							  : 0,
+					s->id);
+		if (memcpy_s(msg + pos, size - pos, buf + off, n) != 0)
+			goto end;
+		pos += n;
+		off += n;
+		h2.window -= n;
+		s->window -= n;
+	}
+	ret = h2Write(handle, ssl, msg, pos);
+end:
+	if (!ret)
+		LOG(LOG_ERROR, "HTTP/2 request not sent\n");
+	sdoFree(msg);
+	return ret;
+}
+
+/**
+ * Internal API: receive the response of the oldest request in flight, and
+ * process its header as that of HTTP/1.1. Its body is held for
+ * sdoConRecvMsgBody().
+ *
+ * @retval SDO_CON_DONE on success, SDO_CON_ERROR otherwise.
+ */
+static int32_t h2RecvHeader(sdoConHandle handle, void *ssl,
+			    uint32_t *protocolVersion, uint32_t *messageType,
+			    uint32_t *msglen)
+{
+	h2Stream_t *s = &h2.streams[0];
+	RestCtx_t *rest = getRESTContext();
+	uint32_t cap;
+	int n;
+
+	if (!h2.count || !rest) {
+		LOG(LOG_ERROR, "HTTP/2: no request in flight\n");
+		return SDO_CON_ERROR;
+	}
+	while (!s->ended && !s->reset) {
+		if (!h2ReadFrame(handle, ssl))
+			return SDO_CON_ERROR;
+	}
+	if (s->reset || !s->headers) {
+		LOG(LOG_ERROR, "HTTP/2 stream %u failed\n", s->id);
+		return SDO_CON_ERROR;
+	}
+
+	/* the length is that of the body received */
+	n = snprintf_s_i(s->hdr + s->hdrLen, sizeof(s->hdr) - s->hdrLen,
+			 "content-length: %d\r\n", (int)s->bodyLen);
+	if (n <= 0 ||
+	    !getRESTContentLength(s->hdr, s->hdrLen + n, msglen)) {
+		LOG(LOG_ERROR, "REST Header processing failed!!\n");
+		return SDO_CON_ERROR;
+	}
+
+	/* the connection stays, and takes as many requests as streams */
+	rest->keepAlive = !h2.goaway;
+	cap = h2.maxStreams < H2_STREAMS_MAX ? h2.maxStreams : H2_STREAMS_MAX;
+	if (cap > 1 && cap - 1 > rest->pipeline)
+		rest->pipeline = (uint8_t)(cap - 1);
+
+	if (h2.out)
+		sdoFree(h2.out);
+	h2.out = s->body;
+	h2.outLen = s->bodyLen;
+	h2.outOff = 0;
+	s->body = NULL;
+	if (--h2.count &&
+	    memmove_s(&h2.streams[0], sizeof(h2.streams), &h2.streams[1],
+		      h2.count * sizeof(h2.streams[0])) != 0)
+		return SDO_CON_ERROR;
+
+	*protocolVersion = rest->protVer;
+	*messageType = rest->msgType;
+	recHeader(*protocolVersion, *messageType, *msglen);
+	return SDO_CON_DONE;
+}
+
+/**
+ * Internal API: hand out the body of the response received last.
+ *
+ * @retval SDO_CON_DONE on success, SDO_CON_ERROR otherwise.
+ */
+static int32_t h2RecvBody(uint8_t *buf, size_t length, size_t *nread)
+{
+	size_t n = length - *nread;
+
+	if (n > h2.outLen - h2.outOff) {
+		LOG(LOG_ERROR, "Read beyond the response body\n");
+		return SDO_CON_ERROR;
+	}
+	if (n && memcpy_s(buf + *nread, n, h2.out + h2.outOff, n) != 0)
+		return SDO_CON_ERROR;
+	h2.outOff += n;
+	*nread = length;
+	return SDO_CON_DONE;
+}
+#endif
+
+/**
+ * sdoConSetup Connection Setup.
+ *
+ * @param medium - specified network medium to connect to
+ * @param params - parameters(if any) supported for 'medium'
+ * @param count - number of valid string in params
+ * @return 0 on success. -1 on failure
+ */
+int32_t sdoConSetup(char *medium, char **params, uint32_t count)
+{
+	uint32_t i;
+	char key[32];
+	char *val;
+	int res1 = 1, res2 = 1, res3 = 1;
+
+	(void)medium;
+
+	/* timeouts as "connect_timeout_ms=<ms>", "read_timeout_ms=<ms>", ... */
+	for (i = 0; params && i < count; i++) {
+		if (!params[i])
+			continue;
+		val = strchr(params[i], '=');
+		if (!val || val - params[i] >= (int)sizeof(key))
+			continue;
+		if (strncpy_s(key, sizeof(key), params[i], val - params[i]) !=
+		    0)
+			continue;
+		val++;
+
+		strcmp_s(key, sizeof(key), "connect_timeout_ms", &res1);
+		strcmp_s(key, sizeof(key), "read_timeout_ms", &res2);
+		strcmp_s(key, sizeof(key), "write_timeout_ms", &res3);
+		if (!res1)
+			conTimeouts.connectMs = atoi(val);
+		else if (!res2)
+			conTimeouts.readMs = atoi(val);
+		else if (!res3)
+			conTimeouts.writeMs = atoi(val);
+		else
+			LOG(LOG_ERROR, "Unknown connection parameter: %s\n",
+			    params[i]);
+	}
+
+	// Initiate REST context
+	if (!initRESTContext()) {
+		LOG(LOG_ERROR, "initRESTContext() failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Perform a DNS look for a specified host.
+ * Note : return ip address in network format.
+ * @param url - host's URL.
+ * @param ipList - output IP address list for specified host URL.
+ * @param ipListSize - output number of IP address in ipList
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConDnsLookup(const char *url, SDOIPAddress_t **ipList,
+			uint32_t *ipListSize)
+{
+	int idx;
+	struct addrinfo *result = NULL, *it = NULL;
+	struct addrinfo hints;
+	struct sockaddr_in *sa_in = NULL;
+	SDOIPAddress_t *ip_list = NULL;
+	int32_t ret = -1;
+
+	if (!url || !ipList || !ipListSize)
+		return ret;
+
+	LOG(LOG_DEBUG, "Resolving DNS-URL: <%s>\n", url);
+
+	if (memset_s(&hints, sizeof hints, 0) != 0) {
+		LOG(LOG_ERROR, "Memset failed\n");
+		goto end;
+	}
+
+	hints.ai_family = AF_UNSPEC; // IPv4 and IPv6
+	hints.ai_socktype = SOCK_STREAM;
+
+	// get the list-of IP addresses
+	if (getaddrinfo(url, NULL, &hints, &result) != 0) {
+		LOG(LOG_ERROR, "getaddrinfo() failed!\n");
+		goto end;
+	}
+
+	int len = 0;
+
+	// get length of the ip-address LL
+	for (it = result; it != NULL; it = it->ai_next) {
+		++len;
+	}
+
+	ip_list = sdoAlloc(sizeof(SDOIPAddress_t) * len);
+
+	if (!ip_list) {
+		LOG(LOG_ERROR, "Malloc failed!\n");
+		goto end;
+	}
+
+	// iterate and store IP-addresses
+	for (idx = 0, it = result; it != NULL; it = it->ai_next) {
+		const void *addr;
+
+		if (it->ai_family == AF_INET) {
+			sa_in = (struct sockaddr_in *)it->ai_addr;
+			addr = &(sa_in->sin_addr.s_addr);
+			(ip_list + idx)->length = IPV4_ADDR_LEN;
+		} else if (it->ai_family == AF_INET6) {
+			addr = &((struct sockaddr_in6 *)it->ai_addr)->sin6_addr;
+			(ip_list + idx)->length = IPV6_ADDR_LEN;
+		} else {
+			continue;
+		}
+
+#if LOG_LEVEL == LOG_MAX_LEVEL
+		// for trace purpose
+		char host[INET6_ADDRSTRLEN];
+		inet_ntop(it->ai_family, addr, host, sizeof(host));
+		LOG(LOG_DEBUG, "Resolved into IP-Address: <%s>\n", host);
+#endif
+
+		if (memcpy_s((ip_list + idx)->addr, sizeof(ip_list->addr),
+			     addr, (ip_list + idx)->length) != 0) {
+			LOG(LOG_ERROR, "Memcpy failed\n");
+			goto end;
+		}
+		++idx;
+	}
+
+	if (!idx) {
+		LOG(LOG_ERROR, "No IPv4/IPv6 address for %s\n", url);
+		goto end;
+	}
+	len = idx;
+
+	*ipList = ip_list;
+	*ipListSize = len;
+	ret = 0;
+
+end:
+	// avoid leak in case DNS look-up operation was not successful.
+	if (ret != 0) {
+		*ipListSize = 0;
+		if (ip_list) {
+			sdoFree(ip_list);
+		}
+	}
+	if (result)
+		freeaddrinfo(result); // free the addr list always
+	return ret;
+}
+
+/**
+ * Fill socket address of given IP address (IPv4 or IPv6) and port.
+ *
+ * @param ip_addr - pointer to IP address info
+ * @param port - port number
+ * @param sa - out socket address
+ * @return length of socket address on success, 0 on failure
+ */
+static socklen_t sdoSockAddr(const SDOIPAddress_t *ip_addr, uint16_t port,
+			     struct sockaddr_storage *sa)
+{
+	struct sockaddr_in *sa4 = (struct sockaddr_in *)sa;
+	struct sockaddr_in6 *sa6 = (struct sockaddr_in6 *)sa;
+
+	if (memset_s(sa, sizeof(*sa), 0) != 0) {
+		LOG(LOG_ERROR, "Memset failed\n");
+		return 0;
+	}
+
+	if (ip_addr->length == IPV4_ADDR_LEN) {
+		sa4->sin_family = AF_INET;
+		sa4->sin_port = htons(port);
+		if (memcpy_s(&sa4->sin_addr.s_addr, sizeof(sa4->sin_addr),
+			     ip_addr->addr, IPV4_ADDR_LEN) != 0)
+			return 0;
+		return sizeof(*sa4);
+	} else if (ip_addr->length == IPV6_ADDR_LEN) {
+		sa6->sin6_family = AF_INET6;
+		sa6->sin6_port = htons(port);
+		if (memcpy_s(&sa6->sin6_addr, sizeof(sa6->sin6_addr),
+			     ip_addr->addr, IPV6_ADDR_LEN) != 0)
+			return 0;
+		return sizeof(*sa6);
+	}
+
+	LOG(LOG_ERROR, "Invalid IP address length %d\n", ip_addr->length);
+	return 0;
+}
+
+/**
+ * Bring up TLS on top of a connected socket, if required.
+ *
+ * @param sock - connected socket, closed on failure. With mbedtls, that
+ * opens its own connection, it may be SDO_CON_INVALID_HANDLE.
+ * @param ip_addr - pointer to IP address info
+ * @param port - port number
+ * @param ssl - ssl handler in case of tls connection.
+ * @return connection handle on success. -ve value on failure
+ */
+static sdoConHandle sdoConStartTls(int sock, const SDOIPAddress_t *ip_addr,
+				   uint16_t port, void **ssl)
+{
+	if (!ssl)
+		return sock;
+
+#ifdef USE_MBEDTLS
+	char ip_s[INET6_ADDRSTRLEN] = {0};
+	char port_s[MAX_PORT_SIZE] = {0};
+
+	/* mbedtls opens a connection on its own */
+	if (sock >= 0)
+		close(sock);
+
+	/*
+	 * Convert ip binary to string format as required by
+	 * mbedtls ssl connect
+	 */
+	if (!inet_ntop(ip_addr->length == IPV4_ADDR_LEN ? AF_INET : AF_INET6,
+		       ip_addr->addr, ip_s, sizeof(ip_s))) {
+		LOG(LOG_ERROR, "net to ascii ip failed!\n");
+		return SDO_CON_INVALID_HANDLE;
+	}
+	if (snprintf_s_i(port_s, sizeof port_s, "%d", port) < 0) {
+		LOG(LOG_ERROR, "Snprintf() failed!\n");
+		return SDO_CON_INVALID_HANDLE;
+	}
+
+	*ssl = sdo_ssl_setup_connect(ip_s, port_s);
+
+	if (NULL == *ssl) {
+		LOG(LOG_ERROR, "TLS connection "
+			       "setup "
+			       "failed\n");
+		return SDO_CON_INVALID_HANDLE;
+	}
+#ifdef HTTP2
+	if (sdo_ssl_alpn_h2(*ssl) &&
+	    !h2Start(MBEDTLS_NET_DUMMY_SOCKET, *ssl)) {
+		sdo_ssl_close(*ssl);
+		*ssl = NULL;
+		return SDO_CON_INVALID_HANDLE;
+	}
+#endif
+	return MBEDTLS_NET_DUMMY_SOCKET;
+#elif defined(USE_OPENSSL)
+	struct sockaddr_storage sa;
+
+	/* The session of the server is found by the address connected to */
+	*ssl = sdoSockAddr(ip_addr, port, &sa)
+		   ? sdo_ssl_setup(sock, (struct sockaddr *)&sa)
+		   : NULL;
+
+	if (NULL == *ssl) {
+		LOG(LOG_ERROR, "TLS connection setup failed\n");
+		close(sock);
+		return SDO_CON_INVALID_HANDLE;
+	}
+
+	if (sdo_ssl_connect(*ssl)) {
+		LOG(LOG_ERROR, "TLS connect failed\n");
+		goto err;
+	}
+#ifdef HTTP2
+	if (sdo_ssl_alpn_h2(*ssl) && !h2Start(sock, *ssl))
+		goto err;
+#endif
+	return sock;
+err:
+	sdo_ssl_close(*ssl);
+	*ssl = NULL;
+	close(sock);
+	return SDO_CON_INVALID_HANDLE;
+#else
+	return sock;
+#endif
+}
+
+/**
+ * sdoConConnect connects to the network socket
+ *
+ * @param ip_addr - pointer to IP address info
+ * @param port - port number to connect
+ * @param ssl - ssl handler in case of tls connection.
+ * @return connection handle on success. -ve value on failure
+ */
+
+sdoConHandle sdoConConnect(SDOIPAddress_t *ip_addr, uint16_t port, void **ssl)
+{
+	int sock = SDO_CON_INVALID_HANDLE;
+	uint32_t idx = 0;
+	SDO_TRACE_START(traceStart);
+
+	rxbufReset();
+	txbufReset();
+
+	if (!ip_addr)
+		goto end;
+
+#ifdef USE_MBEDTLS
+	if (ssl) {
+		sock = sdoConStartTls(SDO_CON_INVALID_HANDLE, ip_addr, port,
+				      ssl);
+		goto end;
+	}
+#endif
+
+	/* a race of one, for the connect timeout */
+	sock = sdoConConnectRace(ip_addr, 1, port, NULL, ssl, &idx);
+	if (sock == SDO_CON_INVALID_HANDLE)
+		LOG(LOG_ERROR, "Socket Connect failed, trying next IP\n");
+end:
+	SDO_TRACE_END("net", "connect", port, traceStart);
+	return sock;
+}
+
+/**
+ * Start a non-blocking connect to an address of the race.
+ *
+ * @param ip_addr - pointer to IP address info
+ * @param port - port number to connect
+ * @param fastOpen - use TCP Fast Open: with a cookie of the server cached
+ * by the kernel, the connect completes at once and the SYN leaves with the
+ * first write, carrying its data.
+ * @return socket on success (connect may still be in progress),
+ * -1 on failure
+ */
+static int sdoConRaceStart(const SDOIPAddress_t *ip_addr, uint16_t port,
+			   bool fastOpen)
+{
+	struct sockaddr_storage haddr;
+	socklen_t haddrlen;
+	int sock;
+	int flags;
+
+	haddrlen = sdoSockAddr(ip_addr, port, &haddr);
+	if (!haddrlen)
+		return -1;
+
+	sock = socket(haddr.ss_family, SOCK_STREAM, 0);
+	if (sock < 0)
+		return -1;
+
+	flags = fcntl(sock, F_GETFL, 0);
+	if (flags < 0 || fcntl(sock, F_SETFL, flags | O_NONBLOCK) < 0)
+		goto err;
+
+#ifdef SDO_TCP_FASTOPEN
+	flags = 1;
+	if (fastOpen && setsockopt(sock, IPPROTO_TCP, TCP_FASTOPEN_CONNECT,
+				   &flags, sizeof(flags)) != 0)
+		LOG(LOG_DEBUG, "TCP Fast Open not available, errno=%d\n",
+		    errno);
+#else
+	(void)fastOpen;
+#endif
+
+	if (connect(sock, (struct sockaddr *)&haddr, haddrlen) == 0 ||
+	    errno == EINPROGRESS)
+		return sock;
+err:
+	close(sock);
+	return -1;
+}
+
+/**
+ * Connect to the first reachable address of a list. Connects are raced
+ * (happy eyeballs, RFC 8305): a new non-blocking connect is started every
+ * CONNECT_RACE_STAGGER_MS, or as soon as the previous one failed, and the
+ * first one to complete wins. The others are abandoned. The race as a whole
+ * is bounded by the connect timeout.
+ *
+ * @param ipList - list of IP addresses, in order of preference.
+ * @param numOfIPs - number of IP addresses in ipList.
+ * @param port - port number to connect
+ * @param ports - port number per address, NULL to use port for all.
+ * @param ssl - ssl handler in case of tls connection.
+ * @param index - out index of the connected address in ipList.
+ * @return connection handle on success. -ve value on failure
+ */
+sdoConHandle sdoConConnectRace(SDOIPAddress_t *ipList, uint32_t numOfIPs,
+			       uint16_t port, const uint16_t *ports, void **ssl,
+			       uint32_t *index)
+{
+	struct pollfd pfd[CONNECT_RACE_MAX];
+	uint32_t owner[CONNECT_RACE_MAX];
+	uint32_t next = 0, active = 0, i;
+	uint64_t now, nextStart, deadline;
+	int sock = SDO_CON_INVALID_HANDLE;
+	int timeout, err, flags;
+	socklen_t errlen;
+	uint32_t limit;
+
+	rxbufReset();
+	txbufReset();
+
+	if (!ipList || !numOfIPs || !index)
+		goto end;
+
+	if (!conTimeout(conTimeouts.connectMs, &limit))
+		goto end;
+
+	now = sdoTimeMs();
+	nextStart = now;
+	deadline = now + (limit ? limit : CONNECT_RACE_TIMEOUT_MS);
+
+	while (sock == SDO_CON_INVALID_HANDLE && now < deadline &&
+	       (active || next < numOfIPs)) {
+
+		/* start the next attempt if it is due */
+		if (next < numOfIPs && active < CONNECT_RACE_MAX &&
+		    (now >= nextStart || !active)) {
+			/*
+			 * Fast Open only without a race to run: its connect
+			 * completes before the server is known to answer
+			 */
+			pfd[active].fd = sdoConRaceStart(
+			    &ipList[next], ports ? ports[next] : port,
+			    numOfIPs == 1);
+			if (pfd[active].fd >= 0) {
+				pfd[active].events = POLLOUT;
+				pfd[active].revents = 0;
+				owner[active++] = next;
+			}
+			next++;
+			nextStart = now + CONNECT_RACE_STAGGER_MS;
+			continue;
+		}
+
+		timeout = deadline - now;
+		if (next < numOfIPs && active < CONNECT_RACE_MAX &&
+		    nextStart - now < (uint64_t)timeout)
+			timeout = nextStart - now;
+
+		if (poll(pfd, active, timeout) < 0 && errno != EINTR) {
+			LOG(LOG_ERROR, "poll() failed, errno=%d\n", errno);
+			break;
+		}
+
+		for (i = 0; i < active;) {
+			if (!pfd[i].revents) {
+				i++;
+				continue;
+			}
+
+			errlen = sizeof(err);
+			if (getsockopt(pfd[i].fd, SOL_SOCKET, SO_ERROR, &err,
+				       &errlen) == 0 &&
+			    err == 0 && sock == SDO_CON_INVALID_HANDLE) {
+				sock = pfd[i].fd;
+				*index = owner[i];
+			} else {
+				LOG(LOG_DEBUG, "Connect to IP %u failed\n",
+				    owner[i]);
+				close(pfd[i].fd);
+				/* a failure starts the next attempt at once */
+				nextStart = now;
+			}
+
+			/* remove from the race */
+			active--;
+			pfd[i] = pfd[active];
+			owner[i] = owner[active];
+		}
+		now = sdoTimeMs();
+	}
+
+	/* abandon the losers */
+	for (i = 0; i < active; i++)
+		close(pfd[i].fd);
+
+	if (sock == SDO_CON_INVALID_HANDLE) {
+		LOG(LOG_ERROR, "Failed to connect to any of %u IPs\n",
+		    numOfIPs);
+		goto end;
+	}
+
+	/* rest of the I/O is blocking, with timeouts */
+	flags = fcntl(sock, F_GETFL, 0);
+	if (flags < 0 || fcntl(sock, F_SETFL, flags & ~O_NONBLOCK) < 0 ||
+	    conApplyTimeouts(sock)) {
+		close(sock);
+		sock = SDO_CON_INVALID_HANDLE;
+		goto end;
+	}
+
+	sock = sdoConStartTls(sock, &ipList[*index],
+			      ports ? ports[*index] : port, ssl);
+end:
+	return sock;
+}
+
+#ifdef PROXY_TUNNEL
+/**
+ * Open an HTTP CONNECT tunnel to a server, through the proxy the connection
+ * is made to.
+ *
+ * @param handle - connection to the proxy.
+ * @param host - host name or IP address of the server.
+ * @param port - port number of the server.
+ * @retval -1 on failure, 0 once the proxy connected to the server.
+ */
+int32_t sdoConProxyTunnel(sdoConHandle handle, const char *host,
+			  uint16_t port)
+{
+	char authority[HTTP_MAX_URL_SIZE];
+	char req[2 * HTTP_MAX_URL_SIZE + 32] = {0};
+	const char *status = (const char *)&rxbuf.data[rxbuf.start];
+	size_t len, off, hdrlen = 0, sepLen = 0;
+	int32_t ret;
+	int n;
+
+	if (!host || conApplyTimeouts(handle))
+		return -1;
+
+	if (snprintf_s_si(authority, sizeof(authority), "%s:%d", (char *)host,
+			  port) < 0 ||
+	    strcat_s(req, sizeof(req), "CONNECT ") != 0 ||
+	    strcat_s(req, sizeof(req), authority) != 0 ||
+	    strcat_s(req, sizeof(req), " HTTP/1.1\r\nHost: ") != 0 ||
+	    strcat_s(req, sizeof(req), authority) != 0 ||
+	    strcat_s(req, sizeof(req), "\r\n\r\n") != 0) {
+		LOG(LOG_ERROR, "CONNECT request too long\n");
+		return -1;
+	}
+
+	len = strnlen_s(req, sizeof(req));
+	for (off = 0; off < len; off += n) {
+		if (conWrite(handle, NULL, req + off, len - off, &n) !=
+		    SDO_CON_DONE)
+			return -1;
+	}
+
+	/* the proxy answers before any byte of the server comes */
+	while (!rxbufFindHeaderEnd(&hdrlen, &sepLen)) {
+		ret = rxbufFill(handle, NULL);
+		if (ret != SDO_CON_DONE) {
+			LOG(LOG_ERROR, "CONNECT response read failed\n");
+			return -1;
+		}
+		status = (const char *)&rxbuf.data[rxbuf.start];
+	}
+
+	/* "HTTP/1.x 200 ..." */
+	if (hdrlen < 12 || strncmp(status, "HTTP/1.", 7) != 0 ||
+	    strncmp(status + 8, " 200", 4) != 0) {
+		LOG(LOG_ERROR, "HTTP proxy refused to connect to %s\n",
+		    authority);
+		return -1;
+	}
+	rxbuf.start += hdrlen + sepLen;
+	LOG(LOG_DEBUG, "HTTP proxy tunnel to %s open\n", authority);
+	return 0;
+}
+#endif
+
+/**
+ * Disconnect the connection for a given connection handle.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param ssl - SSL handler in case of tls connection.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConDisconnect(sdoConHandle handle, void *ssl)
+{
+#ifdef HTTP2
+	if (h2.on)
+		h2GoAway(handle, ssl, H2_NO_ERROR);
+#endif
+	rxbufReset();
+	txbufReset();
+
+	if (ssl) {
+		sdo_ssl_close(ssl);
+
+#ifdef USE_MBEDTLS
+		return 0;
+#endif
+	}
+	// close() returns 0 on success
+	if (!close(handle))
+		return 0;
+	else
+		return -1;
+}
+
+static int32_t recvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
+			   size_t *nread, void *ssl);
+
+#ifdef HTTP_DEFLATE
+/**
+ * Inflate the encoded body of the response. The decoded body is no larger
+ * than a plain one may be, which also bounds what a crafted one costs.
+ *
+ * @retval true on success, false if the body is invalid or too large.
+ */
+static bool zbodyInflate(void)
+{
+	z_stream z;
+	int ret;
+
+	if (memset_s(&z, sizeof(z), 0) != 0)
+		return false;
+	zbody.out = sdoAlloc(REST_MAX_MSGBODY_SIZE);
+	if (!zbody.out) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		return false;
+	}
+	/* zlib (deflate) or gzip wrapper, told apart by its header */
+	if (inflateInit2(&z, MAX_WBITS + 32) != Z_OK)
+		return false;
+	z.next_in = zbody.in;
+	z.avail_in = (uInt)zbody.inLen;
+	z.next_out = zbody.out;
+	z.avail_out = REST_MAX_MSGBODY_SIZE;
+	ret = inflate(&z, Z_FINISH);
+	zbody.outLen = z.total_out;
+	(void)inflateEnd(&z);
+	if (ret != Z_STREAM_END) {
+		LOG(LOG_ERROR, "Encoded body invalid or over %d bytes\n",
+		    REST_MAX_MSGBODY_SIZE);
+		return false;
+	}
+	LOG(LOG_DEBUG, "REST: body inflated from %zu to %zu bytes\n",
+	    zbody.inLen, zbody.outLen);
+	sdoFree(zbody.in);
+	return true;
+}
+
+/**
+ * Receive the encoded body of the response and inflate it, resuming after
+ * the bytes already read.
+ *
+ * @retval SDO_CON_DONE with the decoded length in msglen,
+ * SDO_CON_WANT_READ/WRITE if the body is still incomplete, SDO_CON_ERROR
+ * otherwise.
+ */
+static int32_t recvEncodedBody(sdoConHandle handle, uint32_t *protocolVersion,
+			       uint32_t *messageType, uint32_t *msglen,
+			       void *ssl)
+{
+	RestCtx_t *rest = getRESTContext();
+	int32_t ret;
+
+	ret = recvMsgBody(handle, zbody.in, zbody.inLen, &zbody.inRead, ssl);
+	if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE)
+		return ret;
+	if (ret != SDO_CON_DONE || !rest || !zbodyInflate()) {
+		LOG(LOG_ERROR, "REST encoded body read failed!\n");
+		zbodyReset();
+		return SDO_CON_ERROR;
+	}
+
+	*protocolVersion = rest->protVer;
+	*messageType = rest->msgType;
+	*msglen = (uint32_t)zbody.outLen;
+	recHeader(*protocolVersion, *messageType, *msglen);
+	return SDO_CON_DONE;
+}
+
+/**
+ * Hand out the decoded body of the response.
+ *
+ * @retval SDO_CON_DONE when length bytes were handed out, SDO_CON_ERROR if
+ * the body is shorter.
+ */
+static int32_t zbodyRead(uint8_t *buf, size_t length, size_t *nread)
+{
+	size_t n = length - *nread;
+
+	if (n > zbody.outLen - zbody.outOff ||
+	    memcpy_s(buf + *nread, n, zbody.out + zbody.outOff, n) != 0) {
+		LOG(LOG_ERROR, "REST body read beyond decoded body\n");
+		return SDO_CON_ERROR;
+	}
+	zbody.outOff += n;
+	*nread = length;
+	if (zbody.outOff == zbody.outLen)
+		zbodyReset();
+	return SDO_CON_DONE;
+}
+
+/**
+ * Deflate the body of a message, if the server takes encoded bodies and it
+ * shrinks enough to be worth it.
+ *
+ * @param buf - body of the message.
+ * @param length - length of the body.
+ * @param zlen - out length of the encoded body.
+ * @retval encoded body, to be freed, or NULL to send the body as it is.
+ */
+static uint8_t *deflateBody(const uint8_t *buf, size_t length, size_t *zlen)
+{
+	RestCtx_t *rest = getRESTContext();
+	uLongf n;
+	uint8_t *z;
+
+	if (!rest)
+		return NULL;
+	rest->deflate = false;
+	if (!rest->peerDeflate || length < REST_DEFLATE_MIN)
+		return NULL;
+
+	n = compressBound(length);
+	z = sdoAlloc(n);
+	if (!z)
+		return NULL;
+	if (compress2(z, &n, buf, length, Z_DEFAULT_COMPRESSION) != Z_OK ||
+	    n >= length) {
+		sdoFree(z);
+		return NULL;
+	}
+	LOG(LOG_DEBUG, "REST: body deflated from %zu to %lu bytes\n", length,
+	    (unsigned long)n);
+	rest->deflate = true;
+	*zlen = n;
+	return z;
+}
+#endif
+
+/**
+ * Receive REST header, resuming from what has already been buffered.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - out SDO protocol version
+ * @param messageType - out message type of incoming SDO message.
+ * @param msglen - out length of incoming message.
+ * @param ssl - handler in case of tls connection.
+ * @retval SDO_CON_DONE when the header has been received and processed,
+ * SDO_CON_WANT_READ/WRITE if it is still incomplete, SDO_CON_ERROR
+ * otherwise.
+ */
+static int32_t recvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
+			     uint32_t *messageType, uint32_t *msglen,
+			     void *ssl)
+{
+	int32_t ret = SDO_CON_ERROR;
+	const char *hdr = NULL;
+	size_t hdrlen = 0, sepLen = 0;
+	RestCtx_t *rest = NULL;
+
+	if (!protocolVersion || !messageType || !msglen)
+		goto err;
+
+#ifdef HTTP2
+	if (h2.on)
+		return h2RecvHeader(handle, ssl, protocolVersion, messageType,
+				    msglen);
+#endif
+#ifdef HTTP_DEFLATE
+	// header done, the encoded body is still coming
+	if (zbody.in)
+		return recvEncodedBody(handle, protocolVersion, messageType,
+				       msglen, ssl);
+#endif
+
+	// read REST header, until the empty line is in the buffer
+	while (!rxbufFindHeaderEnd(&hdrlen, &sepLen)) {
+		ret = rxbufFill(handle, ssl);
+		if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE)
+			return ret;
+		if (ret != SDO_CON_DONE) {
+			LOG(LOG_ERROR, "REST header read failed!\n");
+			goto err;
+		}
+	}
+	ret = SDO_CON_ERROR;
+	hdr = (const char *)&rxbuf.data[rxbuf.start];
+
+	// consume header and the empty line, leaving body in the buffer
+	rxbuf.start += hdrlen + sepLen;
+
+	/* Process REST header, in place, and get content-length of body */
+	if (!getRESTContentLength(hdr, hdrlen, msglen)) {
+		LOG(LOG_ERROR, "REST Header processing failed!!\n");
+		goto err;
+	}
+
+	rest = getRESTContext();
+	if (!rest) {
+		LOG(LOG_ERROR, "REST context is NULL!\n");
+		goto err;
+	}
+
+#ifdef HTTP_DEFLATE
+	if (rest->deflate && *msglen) {
+		zbodyReset();
+		zbody.in = sdoAlloc(*msglen);
+		if (!zbody.in) {
+			LOG(LOG_ERROR, "Malloc failed\n");
+			goto err;
+		}
+		zbody.inLen = *msglen;
+		return recvEncodedBody(handle, protocolVersion, messageType,
+				       msglen, ssl);
+	}
+#endif
+
+	// copy protver from REST context
+	*protocolVersion = rest->protVer;
+	*messageType = rest->msgType;
+	recHeader(*protocolVersion, *messageType, *msglen);
+
+	ret = SDO_CON_DONE;
+
+err:
+	return ret;
+}
+
+/**
+ * Receive(read) protocol version, message type and length of rest body
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - out SDO protocol version
+ * @param messageType - out message type of incoming SDO message.
+ * @param msglen - out Number of received bytes.
+ * @param ssl - handler in case of tls connection.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
+			    uint32_t *messageType, uint32_t *msglen, void *ssl)
+{
+	int32_t ret;
+	SDO_TRACE_START(traceStart);
+
+	if (conApplyTimeouts(handle))
+		return -1;
+
+	ret = recvMsgHeader(handle, protocolVersion, messageType, msglen, ssl);
+	if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE)
+		LOG(LOG_ERROR, "REST header read timed out\n");
+	SDO_TRACE_END("net", "recv-header",
+		      ret == SDO_CON_DONE ? (int32_t)*messageType : -1,
+		      traceStart);
+	return ret == SDO_CON_DONE ? 0 : -1;
+}
+
+/**
+ * Receive(read) REST header without blocking. To be called again, with the
+ * same arguments, when the connection becomes ready.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - out SDO protocol version
+ * @param messageType - out message type of incoming SDO message.
+ * @param msglen - out length of incoming message.
+ * @param ssl - handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgHeaderAsync(sdoConHandle handle,
+				 uint32_t *protocolVersion,
+				 uint32_t *messageType, uint32_t *msglen,
+				 void *ssl)
+{
+	return recvMsgHeader(handle, protocolVersion, messageType, msglen,
+			     ssl);
+}
+
+/**
+ * Receive REST body, resuming after the bytes already read.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param buf - data buffer to read into.
+ * @param length - Number of bytes to be received.
+ * @param nread - in/out number of bytes received so far.
+ * @param ssl - handler in case of tls connection.
+ * @retval SDO_CON_DONE when all bytes have been received,
+ * SDO_CON_WANT_READ/WRITE if the body is still incomplete, SDO_CON_ERROR
+ * otherwise.
+ */
+static int32_t recvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
+			   size_t *nread, void *ssl)
+{
+	int32_t ret;
+	size_t avail;
+	int n;
+
+	if (!buf || !length || *nread > length)
+		return SDO_CON_ERROR;
+
+#ifdef HTTP2
+	if (h2.on)
+		return h2RecvBody(buf, length, nread);
+#endif
+#ifdef HTTP_DEFLATE
+	if (zbody.out)
+		return zbodyRead(buf, length, nread);
+#endif
+
+	// body bytes received along with the header
+	if (rxbuf.end > rxbuf.start && *nread < length) {
+		avail = rxbuf.end - rxbuf.start;
+		if (avail > length - *nread)
+			avail = length - *nread;
+		if (memcpy_s(buf + *nread, length - *nread,
+			     &rxbuf.data[rxbuf.start], avail) != 0) {
+			LOG(LOG_ERROR, "Memcpy failed\n");
+			return SDO_CON_ERROR;
+		}
+		rxbuf.start += avail;
+		*nread += avail;
+	}
+
+	while (*nread < length) {
+		ret = conRead(handle, ssl, buf + *nread, length - *nread, &n);
+		if (ret != SDO_CON_DONE)
+			return ret;
+		*nread += n;
+	}
+	return SDO_CON_DONE;
+}
+
+/**
+ * Receive(read) MsgBody
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param buf - data buffer to read into.
+ * @param length - Number of received bytes.
+ * @param ssl - handler in case of tls connection.
+ * @retval -1 on failure, number of bytes read on success.
+ */
+int32_t sdoConRecvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
+			  void *ssl)
+{
+	size_t nread = 0;
+	int32_t ret;
+	SDO_TRACE_START(traceStart);
+
+	if (conApplyTimeouts(handle))
+		return -1;
+
+	ret = recvMsgBody(handle, buf, length, &nread, ssl);
+	recBody(buf, nread);
+	if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE)
+		LOG(LOG_ERROR, "REST body read timed out\n");
+	SDO_TRACE_END("net", "recv-body", (int32_t)nread, traceStart);
+	return ret == SDO_CON_DONE ? (int32_t)nread : -1;
 }
 
 /**
- * Disconnect the connection for a given connection handle.
+ * Receive(read) MsgBody without blocking. To be called again, with the
+ * same arguments, when the connection becomes ready.
  *
  * @param handle - connection handler (for ex: socket-id)
- * @param ssl - SSL handler in case of tls connection.
- * @retval -1 on failure, 0 on success.
+ * @param buf - data buffer to read into.
+ * @param length - Number of bytes to be received.
+ * @param nread - in/out number of bytes received so far, 0 initially.
+ * @param ssl - handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
  */
-int32_t sdoConDisconnect(sdoConHandle handle, void *ssl)
+int32_t sdoConRecvMsgBodyAsync(sdoConHandle handle, uint8_t *buf,
+			       size_t length, size_t *nread, void *ssl)
 {
-	if (ssl) {
-		sdo_ssl_close(ssl);
-
-#ifdef USE_MBEDTLS
-		return 0;
-#endif
-	}
-	// close() returns 0 on success
-	if (!close(handle))
-		return 0;
-	else
-		return -1;
+	size_t from;
+	int32_t ret;
+
+	if (!nread)
+		return SDO_CON_ERROR;
+	from = *nread;
+	ret = recvMsgBody(handle, buf, length, nread, ssl);
+	if (*nread > from)
+		recBody(buf + from, *nread - from);
+	return ret;
 }
 
 /**
- * Receive(read) protocol version, message type and length of rest body
+ * Send REST header and body over a plain socket with a single vectored
+ * write, so that both go out in the same segment(s). Partial writes are
+ * continued until everything is sent.
  *
  * @param handle - connection handler (for ex: socket-id)
- * @param protocolVersion - out SDO protocol version
- * @param messageType - out message type of incoming SDO message.
- * @param msglen - out Number of received bytes.
- * @param ssl - handler in case of tls connection.
- * @retval -1 on failure, 0 on success.
+ * @param hdr - REST header
+ * @param hdrlen - length of REST header
+ * @param body - REST body
+ * @param bodylen - length of REST body
+ * @retval 0 on success, -1 on failure.
  */
-int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
-			    uint32_t *messageType, uint32_t *msglen, void *ssl)
+static int sockSendHdrBody(sdoConHandle handle, const char *hdr,
+			   size_t hdrlen, const uint8_t *body, size_t bodylen)
 {
-	int32_t ret = -1;
-	char hdr[REST_MAX_MSGHDR_SIZE] = {0};
-	char tmp[REST_MAX_MSGHDR_SIZE];
-	size_t hdrlen;
-	RestCtx_t *rest = NULL;
-
-	if (!protocolVersion || !messageType || !msglen)
-		goto err;
-
-	// read REST header
-	for (;;) {
-		if (memset_s(tmp, sizeof(tmp), 0) != 0) {
-			LOG(LOG_ERROR, "Memset() failed!\n");
-			goto err;
+	struct iovec iov[2];
+	struct msghdr msg;
+	struct iovec *cur = iov;
+	size_t iovcnt = 2;
+	ssize_t n;
+
+	iov[0].iov_base = (void *)hdr;
+	iov[0].iov_len = hdrlen;
+	iov[1].iov_base = (void *)body;
+	iov[1].iov_len = bodylen;
+
+	while (iovcnt) {
+		if (memset_s(&msg, sizeof(msg), 0) != 0) {
+			LOG(LOG_ERROR, "Memset failed\n");
+			return -1;
 		}
+		msg.msg_iov = cur;
+		msg.msg_iovlen = iovcnt;
 
-		if (!readUntilNewLine(handle, tmp, REST_MAX_MSGHDR_SIZE, ssl)) {
-			LOG(LOG_ERROR, "readUntilNewLine() failed!\n");
-			goto err;
+		n = sendmsg(handle, &msg, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			LOG(LOG_ERROR,
+			    "Socket write Failed, ret=%zd, "
+			    "errno=%d, %d\n",
+			    n, errno, __LINE__);
+			return -1;
 		}
 
-		// end of header
-		if (tmp[0] == getRESTHdrBodySeparator())
-			break;
-
-		// accumulate header content
-		if (strncat_s(hdr, REST_MAX_MSGHDR_SIZE, tmp,
-			      strnlen_s(tmp, REST_MAX_MSGHDR_SIZE)) != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
+		/* skip what has been sent */
+		while (iovcnt && (size_t)n >= cur->iov_len) {
+			n -= cur->iov_len;
+			cur++;
+			iovcnt--;
 		}
-
-		// append new line for convenient parsing in REST
-		if (strcat_s(hdr, REST_MAX_MSGHDR_SIZE, "\n") != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
+		if (iovcnt) {
+			cur->iov_base = (uint8_t *)cur->iov_base + n;
+			cur->iov_len -= n;
 		}
 	}
+	return 0;
+}
 
-	hdrlen = strnlen_s(hdr, REST_MAX_MSGHDR_SIZE);
+/**
+ * Send REST header and body over TLS. Both are coalesced into one buffer so
+ * that they are carried in a single TLS record.
+ *
+ * @param ssl - handler of tls connection.
+ * @param hdr - REST header
+ * @param hdrlen - length of REST header
+ * @param body - REST body
+ * @param bodylen - length of REST body
+ * @param early - the message may go as TLS early data, the server can take
+ * it twice.
+ * @retval 0 on success, -1 on failure.
+ */
+static int sslSendHdrBody(void *ssl, const char *hdr, size_t hdrlen,
+			  const uint8_t *body, size_t bodylen, bool early)
+{
+	int ret = -1;
+	int n;
+	size_t total = hdrlen + bodylen;
+	size_t sent = 0;
+	uint8_t *msg = sdoAlloc(total);
 
-	/* Process REST header and get content-length of body */
-	if (!getRESTContentLength(hdr, hdrlen, msglen)) {
-		LOG(LOG_ERROR, "REST Header processing failed!!\n");
-		goto err;
+	if (!msg) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		goto end;
 	}
 
-	rest = getRESTContext();
-	if (!rest) {
-		LOG(LOG_ERROR, "REST context is NULL!\n");
-		goto err;
+	if (memcpy_s(msg, total, hdr, hdrlen) != 0 ||
+	    memcpy_s(msg + hdrlen, total - hdrlen, body, bodylen) != 0) {
+		LOG(LOG_ERROR, "Memcpy failed\n");
+		goto end;
 	}
 
-	// copy protver from REST context
-	*protocolVersion = rest->protVer;
-	*messageType = rest->msgType;
-
+#ifdef TLS_EARLY_DATA
+	if (early) {
+		n = sdo_ssl_write_early(ssl, msg, total);
+		if (n <= 0) {
+			LOG(LOG_ERROR, "SSL write Failed!\n");
+			goto end;
+		}
+		sent += n;
+	}
+#else
+	(void)early;
+#endif
+	while (sent < total) {
+		n = sdo_ssl_write(ssl, msg + sent, total - sent);
+		if (n <= 0) {
+			LOG(LOG_ERROR, "SSL write Failed!\n");
+			goto end;
+		}
+		sent += n;
+	}
 	ret = 0;
 
-err:
+end:
+	if (msg)
+		sdoFree(msg);
 	return ret;
 }
 
 /**
- * Receive(read) MsgBody
+ * Construct REST header of an outgoing message.
  *
- * @param handle - connection handler (for ex: socket-id)
- * @param buf - data buffer to read into.
- * @param length - Number of received bytes.
- * @param ssl - handler in case of tls connection.
- * @retval -1 on failure, number of bytes read on success.
+ * @param protocolVersion - SDO protocol version
+ * @param messageType - message type of outgoing SDO message.
+ * @param length - length of message body.
+ * @param restHdr - out buffer of REST_MAX_MSGHDR_SIZE bytes.
+ * @retval length of REST header on success, 0 on failure.
  */
-int32_t sdoConRecvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
-			  void *ssl)
+static size_t buildRESTHeader(uint32_t protocolVersion, uint32_t messageType,
+			      size_t length, char *restHdr)
 {
-	int n;
-	int32_t ret = -1;
+	RestCtx_t *rest = getRESTContext();
+	size_t headerLen = 0;
 
-	if (!buf || !length)
-		goto err;
+	if (!rest) {
+		LOG(LOG_ERROR, "REST context is NULL!\n");
+		return 0;
+	}
 
-	if (ssl)
-		n = sdo_ssl_read(ssl, buf, length);
-	else
-		n = recv(handle, buf, length, MSG_WAITALL);
+	// supply info to REST for POST-URL construction
+	rest->protVer = protocolVersion;
+	rest->msgType = messageType;
+	rest->contentLength = length;
 
-	if (n <= 0) {
-		ret = -1;
-		goto err;
+	if (!constructRESTHeader(rest, restHdr, REST_MAX_MSGHDR_SIZE)) {
+		LOG(LOG_ERROR, "Error during constrcution of REST hdr!\n");
+		return 0;
 	}
-	ret = n;
-err:
-	return ret;
+
+	headerLen = strnlen_s(restHdr, REST_MAX_MSGHDR_SIZE);
+
+	if (!headerLen || headerLen == REST_MAX_MSGHDR_SIZE) {
+		LOG(LOG_ERROR, "Strlen() failed!\n");
+		return 0;
+	}
+
+	LOG(LOG_DEBUG, "REST:header(%zu):%s\n", headerLen, restHdr);
+	return headerLen;
 }
 
 /**
@@ -443,118 +2240,242 @@ int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
 			  size_t length, void *ssl)
 {
 	int ret = -1;
-	int n;
-	RestCtx_t *rest = NULL;
-	char restHdr[REST_MAX_MSGHDR_SIZE] = {0};
+	char *restHdr = NULL;
 	size_t headerLen = 0;
+	const uint8_t *body = buf;
+	size_t bodyLen = length;
+	uint8_t *zbuf = NULL;
+	SDO_TRACE_START(traceStart);
 
 	if (!buf || !length)
 		goto err;
 
-	rest = getRESTContext();
-
-	if (!rest) {
-		LOG(LOG_ERROR, "REST context is NULL!\n");
-		goto err;
+#ifdef HTTP2
+	if (h2.on) {
+		if (conApplyTimeouts(handle) ||
+		    !h2Send(handle, ssl, protocolVersion, messageType, buf,
+			    length))
+			goto senderr;
+		recSend(protocolVersion, messageType, buf, length);
+		SDO_TRACE_END("net", "send", (int32_t)messageType,
+			      traceStart);
+		return length;
 	}
+#endif
 
-	// supply info to REST for POST-URL construction
-	rest->protVer = protocolVersion;
-	rest->msgType = messageType;
-	rest->contentLength = length;
-
-	if (!constructRESTHeader(rest, restHdr, REST_MAX_MSGHDR_SIZE)) {
-		LOG(LOG_ERROR, "Error during constrcution of REST hdr!\n");
+	restHdr = sdoScratchLease(REST_MAX_MSGHDR_SIZE);
+	if (!restHdr)
 		goto err;
-	}
 
-	headerLen = strnlen_s(restHdr, REST_MAX_MSGHDR_SIZE);
+#ifdef HTTP_DEFLATE
+	zbuf = deflateBody(buf, length, &bodyLen);
+	if (zbuf)
+		body = zbuf;
+#endif
+	headerLen =
+	    buildRESTHeader(protocolVersion, messageType, bodyLen, restHdr);
+	if (!headerLen)
+		goto err;
 
-	if (!headerLen || headerLen == REST_MAX_MSGHDR_SIZE) {
-		LOG(LOG_ERROR, "Strlen() failed!\n");
+	if (conApplyTimeouts(handle))
 		goto err;
-	}
 
-	/* Send REST header */
+	/* Send REST header and body together */
 	if (ssl) {
-		n = sdo_ssl_write(ssl, restHdr, headerLen);
-
-		if (n <= 0) {
-			LOG(LOG_ERROR, "SSL Header write Failed!\n");
-			goto hdrerr;
-		}
+		/* The first message of TO1 and TO2 only asks for a nonce */
+		if (sslSendHdrBody(ssl, restHdr, headerLen, body, bodyLen,
+				   messageType == SDO_TO1_TYPE_HELLO_SDO ||
+				       messageType == SDO_TO2_HELLO_DEVICE))
+			goto senderr;
 	} else {
+		if (sockSendHdrBody(handle, restHdr, headerLen, body, bodyLen))
+			goto senderr;
+	}
 
-		n = send(handle, restHdr, headerLen, 0);
+	LOG(LOG_DEBUG, "REST write returns %zu/%zu bytes\n\n",
+	    headerLen + bodyLen, headerLen + bodyLen);
+	recSend(protocolVersion, messageType, buf, length);
+	sdoScratchRelease(restHdr);
+	if (zbuf)
+		sdoFree(zbuf);
 
-		if (n <= 0) {
-			LOG(LOG_ERROR,
-			    "Socket write Failed, ret=%d, "
-			    "errno=%d, %d\n",
-			    n, errno, __LINE__);
+	SDO_TRACE_END("net", "send", (int32_t)messageType, traceStart);
+	return length;
 
-			if (sdoConDisconnect(handle, ssl)) {
-				LOG(LOG_ERROR, "Error during socket close()\n");
-				goto hdrerr;
-			}
-			goto hdrerr;
+senderr:
+	LOG(LOG_ERROR, "REST write not successful!\n");
+err:
+	sdoScratchRelease(restHdr);
+	if (zbuf)
+		sdoFree(zbuf);
+	return ret;
+}
 
-		} else if (n < headerLen) {
-			LOG(LOG_ERROR,
-			    "Rest Header write returns %d/%zu bytes\n", n,
-			    headerLen);
-			goto hdrerr;
+/**
+ * Send(write) data without blocking. The first call queues the message,
+ * later calls (with the same arguments) continue writing it when the
+ * connection becomes ready.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param protocolVersion - SDO protocol version
+ * @param messageType - message type of outgoing SDO message.
+ * @param buf - data buffer to write from.
+ * @param length - Number of bytes to send.
+ * @param ssl - handler in case of tls connection.
+ * @retval SDO_CON_DONE, SDO_CON_WANT_READ, SDO_CON_WANT_WRITE or
+ * SDO_CON_ERROR.
+ */
+int32_t sdoConSendMessageAsync(sdoConHandle handle, uint32_t protocolVersion,
+			       uint32_t messageType, const uint8_t *buf,
+			       size_t length, void *ssl)
+{
+	int32_t ret = SDO_CON_ERROR;
+	char *restHdr = NULL;
+	size_t headerLen;
+	const uint8_t *body = buf;
+	size_t bodyLen = length;
+	uint8_t *zbuf = NULL;
+	int n;
+
+	if (!buf || !length)
+		goto err;
 
-		} else
-			LOG(LOG_DEBUG,
-			    "Rest Header write returns %d/%zu bytes\n\n", n,
-			    headerLen);
+#ifdef HTTP2
+	/* HTTP/2 connections stay blocking */
+	if (h2.on) {
+		if (sdoConSendMessage(handle, protocolVersion, messageType,
+				      buf, length, ssl) < 0)
+			return SDO_CON_ERROR;
+		return SDO_CON_DONE;
 	}
+#endif
 
-	LOG(LOG_DEBUG, "REST:header(%zu):%s\n", headerLen, restHdr);
+	if (!txbuf.buf) {
+		restHdr = sdoScratchLease(REST_MAX_MSGHDR_SIZE);
+		if (!restHdr)
+			goto err;
+#ifdef HTTP_DEFLATE
+		zbuf = deflateBody(buf, length, &bodyLen);
+		if (zbuf)
+			body = zbuf;
+#endif
+		headerLen = buildRESTHeader(protocolVersion, messageType,
+					    bodyLen, restHdr);
+		if (!headerLen)
+			goto err;
 
-	/* Send REST body */
-	if (ssl) {
-		n = sdo_ssl_write(ssl, buf, length);
-		if (n <= 0) {
-			LOG(LOG_ERROR, "SSL Body write Failed!\n");
-			goto bodyerr;
+		/* header and body together, as one write (TLS record) */
+		txbuf.len = headerLen + bodyLen;
+		txbuf.off = 0;
+		txbuf.buf = sdoAlloc(txbuf.len);
+		if (!txbuf.buf) {
+			LOG(LOG_ERROR, "Malloc failed\n");
+			goto err;
 		}
-	} else {
-		n = send(handle, buf, length, 0);
+		if (memcpy_s(txbuf.buf, txbuf.len, restHdr, headerLen) != 0 ||
+		    memcpy_s(txbuf.buf + headerLen, bodyLen, body, bodyLen) !=
+			0) {
+			LOG(LOG_ERROR, "Memcpy failed\n");
+			goto err;
+		}
+		sdoScratchRelease(restHdr);
+		restHdr = NULL;
+		if (zbuf)
+			sdoFree(zbuf);
+	}
 
-		if (n <= 0) {
-			LOG(LOG_ERROR,
-			    "Socket write Failed, ret=%d, "
-			    "errno=%d, %d\n",
-			    n, errno, __LINE__);
+	while (txbuf.off < txbuf.len) {
+		ret = conWrite(handle, ssl, txbuf.buf + txbuf.off,
+			       txbuf.len - txbuf.off, &n);
+		if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE)
+			return ret;
+		if (ret != SDO_CON_DONE) {
+			LOG(LOG_ERROR, "REST write not successful!\n");
+			goto err;
+		}
+		txbuf.off += n;
+	}
+	recSend(protocolVersion, messageType, buf, length);
+	ret = SDO_CON_DONE;
+err:
+	sdoScratchRelease(restHdr);
+	if (zbuf)
+		sdoFree(zbuf);
+	txbufReset();
+	return ret;
+}
 
-			if (sdoConDisconnect(handle, ssl)) {
-				LOG(LOG_ERROR, "Error during socket close()\n");
-				goto bodyerr;
-			}
-			goto bodyerr;
+/**
+ * Switch the connection between blocking and non-blocking mode.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @param enable - true for non-blocking mode.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConSetNonBlocking(sdoConHandle handle, bool enable)
+{
+	int flags;
 
-		} else if (n < length) {
-			LOG(LOG_ERROR, "Rest Body write returns %d/%zu bytes\n",
-			    n, length);
-			goto bodyerr;
+#ifdef USE_MBEDTLS
+	/* TLS connection is owned by mbedtls */
+	if (handle == MBEDTLS_NET_DUMMY_SOCKET)
+		return -1;
+#endif
+#ifdef HTTP2
+	/* frames are read and written whole */
+	if (h2.on && enable)
+		return -1;
+#endif
+	flags = fcntl(handle, F_GETFL, 0);
+	if (flags < 0)
+		return -1;
 
-		} else
-			LOG(LOG_DEBUG,
-			    "Rest Body write returns %d/%zu bytes\n\n", n,
-			    length);
-	}
+	flags = enable ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	if (fcntl(handle, F_SETFL, flags) < 0)
+		return -1;
 
-	return n;
+	return 0;
+}
 
-hdrerr:
-	LOG(LOG_ERROR, "REST Header write not successful!\n");
-	goto err;
-bodyerr:
-	LOG(LOG_ERROR, "REST Body write not successful!\n");
-err:
-	return ret;
+/**
+ * Get the file descriptor to wait on for readiness of the connection, for
+ * ex: with poll()/epoll.
+ *
+ * @param handle - connection handler (for ex: socket-id)
+ * @retval -1 on failure, file descriptor on success.
+ */
+int32_t sdoConGetFd(sdoConHandle handle)
+{
+#ifdef USE_MBEDTLS
+	if (handle == MBEDTLS_NET_DUMMY_SOCKET)
+		return -1;
+#endif
+	return handle;
+}
+
+/**
+ * Set timeouts of connection operations. 0 means no timeout.
+ *
+ * @param connectMs - connect timeout (incl. trying all addresses)
+ * @param readMs - timeout of a read that makes no progress.
+ * @param writeMs - timeout of a write that makes no progress.
+ */
+void sdoConSetTimeouts(uint32_t connectMs, uint32_t readMs, uint32_t writeMs)
+{
+	conTimeouts.connectMs = connectMs;
+	conTimeouts.readMs = readMs;
+	conTimeouts.writeMs = writeMs;
+}
+
+/**
+ * Set deadline of the running protocol. Connection operations fail once it
+ * has passed.
+ *
+ * @param deadline - deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoConSetDeadline(uint64_t deadline)
+{
+	conDeadline = deadline;
 }
 
 /**
@@ -582,6 +2503,24 @@ void sdoSleep(int sec)
 	sleep(sec);
 }
 
+/**
+ * Put the SDO device to low power state, with millisecond granularity
+ *
+ * @param ms
+ *        number of milliseconds to put the device to low power state
+ *
+ * @return none
+ */
+void sdoSleepMs(uint32_t ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (long)(ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
 /**
  * Convert from Network to Host byte order
  *
@@ -661,3 +2600,35 @@ int sdoRandom(void)
 {
 	return rand();
 }
+
+/**
+ * Monotonic time, not affected by changes of the wall clock.
+ *
+ * @return
+ *        returns milliseconds elapsed since an unspecified starting point
+ */
+uint64_t sdoTimeMs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Monotonic time in microseconds, for measuring short operations.
+ *
+ * @return
+ *        returns microseconds elapsed since the starting point of sdoTimeMs
+ */
+uint64_t sdoTimeUs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -20,9 +20,63 @@
 #include "def.h"
 #include "mbed_wait_api.h"
 #include "platform/mbed_thread.h"
+#include "hal/us_ticker_api.h"
+#include <stdlib.h>
+#include <string.h>
 #include <lwip/ip4_addr.h>
 #include <lwip/sockets.h>
 
+/* Default timeouts of connection operations, 0 means no timeout */
+#ifndef CON_CONNECT_TIMEOUT_MS
+#define CON_CONNECT_TIMEOUT_MS 10000
+#endif
+#ifndef CON_READ_TIMEOUT_MS
+#define CON_READ_TIMEOUT_MS 60000
+#endif
+#ifndef CON_WRITE_TIMEOUT_MS
+#define CON_WRITE_TIMEOUT_MS 60000
+#endif
+
+/*
+ * Timeouts of read and write operations, and the deadline of the running
+ * protocol (0 if none) that bounds them. Connect is bounded by the network
+ * stack.
+ */
+static struct {
+	uint32_t connectMs;
+	uint32_t readMs;
+	uint32_t writeMs;
+	uint64_t deadline;
+} conTimeouts = {CON_CONNECT_TIMEOUT_MS, CON_READ_TIMEOUT_MS,
+		 CON_WRITE_TIMEOUT_MS, 0};
+
+/**
+ * Apply the timeout of the next operation to the socket, bounded by the
+ * deadline.
+ *
+ * @param handle - socket-handle.
+ * @param ms - timeout of the operation, 0 for none.
+ * @retval -1 if the deadline has passed, 0 otherwise.
+ */
+static int conApplyTimeout(sdoConHandle handle, uint32_t ms)
+{
+	uint64_t now;
+
+	if (conTimeouts.deadline) {
+		now = sdoTimeMs();
+		if (now >= conTimeouts.deadline) {
+			LOG(LOG_ERROR, "Protocol deadline expired\n");
+			return -1;
+		}
+		if (!ms || conTimeouts.deadline - now < ms)
+			ms = conTimeouts.deadline - now;
+	}
+
+	/* -1 makes the socket block without timeout */
+	mos_socketSetTimeout(handle, ms ? (int)ms : -1);
+	return 0;
+}
+
 /**
  * Read from socket until new-line is encountered.
  *
@@ -84,10 +138,38 @@ static bool readUntilNewLine(sdoConHandle handle, char *out, size_t size,
  */
 int32_t sdoConSetup(char *medium, char **params, uint32_t count)
 {
-	/*TODO: make use of input params (if required ?)*/
+	uint32_t i;
+	char key[32];
+	char *val;
+	int res1 = 1, res2 = 1, res3 = 1;
+
 	(void)medium;
-	(void)params;
-	(void)count;
+
+	/* timeouts as "connect_timeout_ms=<ms>", "read_timeout_ms=<ms>", ... */
+	for (i = 0; params && i < count; i++) {
+		if (!params[i])
+			continue;
+		val = strchr(params[i], '=');
+		if (!val || val - params[i] >= (int)sizeof(key))
+			continue;
+		if (strncpy_s(key, sizeof(key), params[i], val - params[i]) !=
+		    0)
+			continue;
+		val++;
+
+		strcmp_s(key, sizeof(key), "connect_timeout_ms", &res1);
+		strcmp_s(key, sizeof(key), "read_timeout_ms", &res2);
+		strcmp_s(key, sizeof(key), "write_timeout_ms", &res3);
+		if (!res1)
+			conTimeouts.connectMs = atoi(val);
+		else if (!res2)
+			conTimeouts.readMs = atoi(val);
+		else if (!res3)
+			conTimeouts.writeMs = atoi(val);
+		else
+			LOG(LOG_ERROR, "Unknown connection parameter: %s\n",
+			    params[i]);
+	}
 
 	// Initiate REST context
 	if (!initRESTContext()) {
@@ -183,7 +265,7 @@ sdoConHandle sdoConConnect(SDOIPAddress_t *ip_addr, uint16_t port, void **ssl)
 				       "failed\n");
 			goto end;
 		}
-		sock = (sdoConHandle *)get_ssl_socket();
+		sock = (sdoConHandle *)get_ssl_socket(*ssl);
 		return sock;
 	}
 	sock = mos_socketConnect(ip_addr, port);
@@ -192,6 +274,35 @@ end:
 	return sock;
 }
 
+/**
+ * Connect to the first reachable address of a list. The network stack
+ * has a single blocking connect, so the addresses are tried in order.
+ *
+ * @param ipList - list of IP addresses, in order of preference.
+ * @param numOfIPs - number of IP addresses in ipList.
+ * @param port - port number to connect
+ * @param ports - port number per address, NULL to use port for all.
+ * @param ssl - ssl handler in case of tls connection.
+ * @param index - out index of the connected address in ipList.
+ * @return connection handle on success. -ve value on failure
+ */
+sdoConHandle sdoConConnectRace(SDOIPAddress_t *ipList, uint32_t numOfIPs,
+			       uint16_t port, const uint16_t *ports, void **ssl,
+			       uint32_t *index)
+{
+	sdoConHandle sock = SDO_CON_INVALID_HANDLE;
+	uint32_t i;
+
+	if (!ipList || !index)
+		return sock;
+
+	for (i = 0; i < numOfIPs && sock == SDO_CON_INVALID_HANDLE; i++) {
+		sock = sdoConConnect(&ipList[i], ports ? ports[i] : port, ssl);
+		*index = i;
+	}
+	return sock;
+}
+
 /**
  * Disconnect the connection for a given connection handle.
  *
@@ -222,17 +333,25 @@ int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
 			    uint32_t *messageType, uint32_t *msglen, void *ssl)
 {
 	int32_t ret = -1;
-	char hdr[REST_MAX_MSGHDR_SIZE] = {0};
-	char tmp[REST_MAX_MSGHDR_SIZE];
+	char *hdr = NULL;
+	char *tmp = NULL;
 	size_t hdrlen;
 	RestCtx_t *rest = NULL;
 
 	if (!protocolVersion || !messageType || !msglen)
 		goto err;
 
+	hdr = sdoScratchLease(REST_MAX_MSGHDR_SIZE);
+	tmp = sdoScratchLease(REST_MAX_MSGHDR_SIZE);
+	if (!hdr || !tmp)
+		goto err;
+
+	if (conApplyTimeout(handle, conTimeouts.readMs))
+		goto err;
+
 	// read REST header
 	for (;;) {
-		if (memset_s(tmp, sizeof(tmp), 0) != 0) {
+		if (memset_s(tmp, REST_MAX_MSGHDR_SIZE, 0) != 0) {
 			LOG(LOG_ERROR, "Memset() failed!\n");
 			goto err;
 		}
@@ -281,6 +400,8 @@ int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
 	ret = 0;
 
 err:
+	sdoScratchRelease(tmp);
+	sdoScratchRelease(hdr);
 	return ret;
 }
 
@@ -303,6 +424,10 @@ int32_t sdoConRecvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
 
 	if (!buf || !length)
 		goto err;
+
+	if (conApplyTimeout(handle, conTimeouts.readMs))
+		goto err;
+
 	do {
 		bufp = bufp + n;
 		if (ssl)
@@ -340,12 +465,19 @@ int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
 	int ret = -1;
 	int n;
 	RestCtx_t *rest = NULL;
-	char restHdr[REST_MAX_MSGHDR_SIZE] = {0};
+	char *restHdr = NULL;
 	size_t headerLen = 0;
 
 	if (!buf || !length)
 		goto err;
 
+	restHdr = sdoScratchLease(REST_MAX_MSGHDR_SIZE);
+	if (!restHdr)
+		goto err;
+
+	if (conApplyTimeout(handle, conTimeouts.writeMs))
+		goto err;
+
 	rest = getRESTContext();
 
 	if (!rest) {
@@ -440,6 +572,7 @@ int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
 			    length);
 	}
 
+	sdoScratchRelease(restHdr);
 	return n;
 
 hdrerr:
@@ -448,9 +581,100 @@ hdrerr:
 bodyerr:
 	LOG(LOG_ERROR, "REST Body write not successful!\n");
 err:
+	sdoScratchRelease(restHdr);
 	return ret;
 }
 
+/**
+ * Non-blocking I/O is not supported by this network stack.
+ */
+int32_t sdoConSetNonBlocking(sdoConHandle handle, bool enable)
+{
+	(void)handle;
+	(void)enable;
+	return -1;
+}
+
+/**
+ * Non-blocking I/O is not supported by this network stack.
+ */
+int32_t sdoConGetFd(sdoConHandle handle)
+{
+	(void)handle;
+	return -1;
+}
+
+/**
+ * Non-blocking I/O is not supported by this network stack.
+ */
+int32_t sdoConSendMessageAsync(sdoConHandle handle, uint32_t protocolVersion,
+			       uint32_t messageType, const uint8_t *buf,
+			       size_t length, void *ssl)
+{
+	(void)handle;
+	(void)protocolVersion;
+	(void)messageType;
+	(void)buf;
+	(void)length;
+	(void)ssl;
+	return SDO_CON_ERROR;
+}
+
+/**
+ * Non-blocking I/O is not supported by this network stack.
+ */
+int32_t sdoConRecvMsgHeaderAsync(sdoConHandle handle,
+				 uint32_t *protocolVersion,
+				 uint32_t *messageType, uint32_t *msglen,
+				 void *ssl)
+{
+	(void)handle;
+	(void)protocolVersion;
+	(void)messageType;
+	(void)msglen;
+	(void)ssl;
+	return SDO_CON_ERROR;
+}
+
+/**
+ * Non-blocking I/O is not supported by this network stack.
+ */
+int32_t sdoConRecvMsgBodyAsync(sdoConHandle handle, uint8_t *buf,
+			       size_t length, size_t *nread, void *ssl)
+{
+	(void)handle;
+	(void)buf;
+	(void)length;
+	(void)nread;
+	(void)ssl;
+	return SDO_CON_ERROR;
+}
+
+/**
+ * Set timeouts of connection operations. 0 means no timeout.
+ *
+ * @param connectMs - connect timeout, unused: bounded by the network stack.
+ * @param readMs - timeout of a read that makes no progress.
+ * @param writeMs - timeout of a write that makes no progress.
+ */
+void sdoConSetTimeouts(uint32_t connectMs, uint32_t readMs, uint32_t writeMs)
+{
+	conTimeouts.connectMs = connectMs;
+	conTimeouts.readMs = readMs;
+	conTimeouts.writeMs = writeMs;
+}
+
+/**
+ * Set deadline of the running protocol. Connection operations fail once it
+ * has passed.
+ *
+ * @param deadline - deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoConSetDeadline(uint64_t deadline)
+{
+	conTimeouts.deadline = deadline;
+}
+
 /**
  * sdoConTearDown connection tear-down.
  *
@@ -476,6 +700,19 @@ void sdoSleep(int sec)
 	thread_sleep_for(sec * 1000);
 }
 
+/**
+ * Put the SDO device to low power state, with millisecond granularity
+ *
+ * @param ms
+ *        number of milliseconds to put the device to low power state
+ *
+ * @return none
+ */
+void sdoSleepMs(uint32_t ms)
+{
+	thread_sleep_for(ms);
+}
+
 /**
  * Convert from Network to Host byte order
  *
@@ -555,3 +792,25 @@ int sdoRandom(void)
 {
 	return rand();
 }
+
+/**
+ * Monotonic time, not affected by changes of the wall clock.
+ *
+ * @return
+ *        returns milliseconds elapsed since an unspecified starting point
+ */
+uint64_t sdoTimeMs(void)
+{
+	return ticker_read_us(get_us_ticker_data()) / 1000;
+}
+
+/**
+ * Monotonic time in microseconds, for measuring short operations.
+ *
+ * @return
+ *        returns microseconds elapsed since the starting point of sdoTimeMs
+ */
+uint64_t sdoTimeUs(void)
+{
+	return ticker_read_us(get_us_ticker_data());
+}
@@ -15,9 +15,27 @@
 extern "C" {
 extern int strncpy_s(char *dest, size_t dmax, const char *src, size_t slen);
 size_t strnlen_s(const char *dest, size_t dmax);
+int memcpy_s(void *dest, size_t dmax, const void *src, size_t slen);
 }
 extern NetworkInterface *getNetinterface(void);
 
+/*
+ * Sockets of the connections, reused from one connection to the next
+ * rather than allocated for each; one more is allocated if they are all
+ * in use.
+ */
+#ifndef MOS_SOCKET_POOL
+#define MOS_SOCKET_POOL 2
+#endif
+
+static sdoConHandle socketPool[MOS_SOCKET_POOL];
+
+static bool mos_socketPooled(sdoConHandle *socket)
+{
+	return socket >= &socketPool[0] &&
+	       socket < &socketPool[MOS_SOCKET_POOL];
+}
+
 int mos_resolvedns(char *dn, char *ip)
 {
 	NetworkInterface *net = getNetinterface();
@@ -52,14 +70,21 @@ int mos_resolvedns(char *dn, char *ip)
 sdoConHandle *mos_socketOpen(void)
 {
 	NetworkInterface *net = getNetinterface();
-	sdoConHandle *socket = new sdoConHandle;
+	sdoConHandle *socket = NULL;
 	int r = -1;
+	int i;
 
 	if (!net) {
 		LOG(LOG_ERROR, "net interface not initialized\n");
 		return NULL;
 	}
 
+	for (i = 0; i < MOS_SOCKET_POOL && !socket; i++) {
+		if (!socketPool[i].used)
+			socket = &socketPool[i];
+	}
+	if (!socket)
+		socket = new sdoConHandle;
 	if (!socket) {
 		LOG(LOG_ERROR, "create socket instance failed\n");
 		return NULL;
@@ -67,9 +92,13 @@ sdoConHandle *mos_socketOpen(void)
 	r = socket->open(net);
 	if (r != 0) {
 		LOG(LOG_ERROR, "socket.open() returned: %d\n", r);
-		delete socket;
+		if (!mos_socketPooled(socket))
+			delete socket;
 		return NULL;
 	}
+	socket->used = true;
+	socket->rxStart = 0;
+	socket->rxEnd = 0;
 
 	return socket;
 }
@@ -122,10 +151,12 @@ err:
 
 void mos_socketClose(sdoConHandle *socket)
 {
-	if (socket) {
-		socket->close();
+	if (!socket)
+		return;
+	socket->close();
+	socket->used = false;
+	if (!mos_socketPooled(socket))
 		delete socket;
-	}
 }
 
 int mos_socketSend(sdoConHandle *socket, void *buf, size_t len, int flags)
@@ -136,10 +167,41 @@ int mos_socketSend(sdoConHandle *socket, void *buf, size_t len, int flags)
 	return -1;
 }
 
+/*
+ * Reads smaller than the receive buffer are served from it, refilled by a
+ * single recv() of as much as the stack has; larger ones, of the body, go
+ * to the socket once the buffer is drained.
+ */
 int mos_socketRecv(sdoConHandle *socket, void *buf, size_t len, int flags)
 {
-	if (socket) {
-		return (socket->recv((char *)buf, len));
+	nsapi_size_or_error_t n;
+	size_t avail;
+
+	(void)flags;
+	if (!socket || !buf)
+		return -1;
+
+	if (socket->rxStart == socket->rxEnd) {
+		if (len >= sizeof(socket->rxData))
+			return socket->recv((char *)buf, len);
+		n = socket->recv(socket->rxData, sizeof(socket->rxData));
+		if (n <= 0)
+			return n;
+		socket->rxStart = 0;
+		socket->rxEnd = (size_t)n;
 	}
-	return -1;
+
+	avail = socket->rxEnd - socket->rxStart;
+	if (len > avail)
+		len = avail;
+	if (memcpy_s(buf, len, &socket->rxData[socket->rxStart], len) != 0)
+		return -1;
+	socket->rxStart += len;
+	return (int)len;
+}
+
+void mos_socketSetTimeout(sdoConHandle *socket, int ms)
+{
+	if (socket)
+		socket->set_timeout(ms);
 }
@@ -0,0 +1,637 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Abstraction Layer Library
+ *
+ * The file implements the network abstraction layer over a transcript of
+ * messages recorded with NET_REPLAY=record, for running the protocols
+ * without servers (NET_REPLAY=play). Messages sent are checked against the
+ * transcript, responses are served from it.
+ */
+
+#include <netinet/in.h>
+#include <unistd.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <time.h>
+
+#include "util.h"
+#include "network_al.h"
+#include "sdoprotctx.h"
+#include "sdonet.h"
+#include "safe_lib.h"
+#include "rest_interface.h"
+#include "sdotrace.h"
+
+/* Handle of the connections, there being no socket */
+#define REPLAY_HANDLE 1
+
+/*
+ * Transcript being played back: the file, the number of the next record
+ * (for reporting divergence) and the body of the response received last,
+ * handed out by sdoConRecvMsgBody().
+ */
+static struct {
+	char path[FILENAME_MAX];
+	FILE *fp;
+	uint32_t record;
+	uint8_t *body;
+	size_t len;
+	size_t off;
+} play;
+SDO_MUTEX(play_lock);
+
+/**
+ * Read the header line of the next record of the transcript.
+ *
+ * @param dir - out '>' for a message sent, '<' for one received.
+ * @param protocolVersion - out SDO protocol version.
+ * @param messageType - out message type.
+ * @param length - out length of the body that follows.
+ * @retval false at the end of the transcript or on error, true otherwise.
+ */
+static bool playNext(char *dir, uint32_t *protocolVersion,
+		     uint32_t *messageType, size_t *length)
+{
+	const char *path = play.path[0] ? play.path : SDO_TRANSCRIPT;
+
+	if (!play.fp) {
+		play.fp = fopen(path, "rb");
+		if (!play.fp) {
+			LOG(LOG_ERROR, "Transcript %s not opened\n", path);
+			return false;
+		}
+	}
+	if (fscanf(play.fp, " %c %u %u %zu", dir, protocolVersion,
+		   messageType, length) != 4 ||
+	    fgetc(play.fp) != '\n') {
+		LOG(LOG_ERROR, "Transcript over at record %u\n", play.record);
+		return false;
+	}
+	play.record++;
+	return true;
+}
+
+/**
+ * Skip or read the body of the current record, and its new line.
+ *
+ * @param buf - buffer to read into, NULL to skip the body.
+ * @param length - length of the body.
+ * @retval false on a short transcript, true otherwise.
+ */
+static bool playBody(uint8_t *buf, size_t length)
+{
+	if (buf) {
+		if (fread(buf, 1, length, play.fp) != length)
+			goto err;
+	} else if (fseek(play.fp, (long)length, SEEK_CUR) != 0) {
+		goto err;
+	}
+	if (fgetc(play.fp) != '\n')
+		goto err;
+	return true;
+err:
+	LOG(LOG_ERROR, "Transcript record %u truncated\n", play.record);
+	return false;
+}
+
+/**
+ * Drop the response body still held.
+ */
+static void playBodyReset(void)
+{
+	if (play.body)
+		sdoFree(play.body);
+	play.body = NULL;
+	play.len = 0;
+	play.off = 0;
+}
+
+/**
+ * Set the transcript to play back, from its start.
+ *
+ * @param path - transcript file, NULL for SDO_TRANSCRIPT.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConTranscript(const char *path)
+{
+	int32_t ret = 0;
+
+	SDO_LOCK(play_lock);
+	if (play.fp)
+		fclose(play.fp);
+	play.fp = NULL;
+	play.record = 0;
+	playBodyReset();
+	play.path[0] = 0;
+	if (path && strcpy_s(play.path, sizeof(play.path), path) != 0)
+		ret = -1;
+	SDO_UNLOCK(play_lock);
+	return ret;
+}
+
+/**
+ * sdoConSetup Connection Setup.
+ *
+ * @param medium - specified network medium to connect to
+ * @param params - parameters(if any) supported for 'medium'
+ * @param count - number of valid string in params
+ * @return 0 on success. -1 on failure
+ */
+int32_t sdoConSetup(char *medium, char **params, uint32_t count)
+{
+	(void)medium;
+	(void)params;
+	(void)count;
+
+	// Initiate REST context
+	if (!initRESTContext()) {
+		LOG(LOG_ERROR, "initRESTContext() failed!\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Perform a DNS look for a specified host, every host being the loopback
+ * address.
+ *
+ * @param url - host's URL.
+ * @param ipList - output IP address list for specified host URL.
+ * @param ipListSize - output number of IP address in ipList
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConDnsLookup(const char *url, SDOIPAddress_t **ipList,
+			uint32_t *ipListSize)
+{
+	SDOIPAddress_t *ip_list;
+
+	if (!url || !ipList || !ipListSize)
+		return -1;
+
+	ip_list = sdoAlloc(sizeof(SDOIPAddress_t));
+	if (!ip_list) {
+		LOG(LOG_ERROR, "Malloc failed!\n");
+		return -1;
+	}
+	ip_list->length = IPV4_ADDR_LEN;
+	ip_list->addr[0] = 127;
+	ip_list->addr[3] = 1;
+
+	*ipList = ip_list;
+	*ipListSize = 1;
+	return 0;
+}
+
+/**
+ * Open a connection, which always succeeds.
+ *
+ * @param ip_addr - IP address to connect to.
+ * @param port - port number to connect to.
+ * @param ssl - out SSL handler, none.
+ * @retval connection handle.
+ */
+sdoConHandle sdoConConnect(SDOIPAddress_t *ip_addr, uint16_t port, void **ssl)
+{
+	(void)ip_addr;
+	(void)port;
+
+	if (ssl)
+		*ssl = NULL;
+	SDO_LOCK(play_lock);
+	playBodyReset();
+	SDO_UNLOCK(play_lock);
+	return REPLAY_HANDLE;
+}
+
+/**
+ * Open a connection to the first address of a list.
+ *
+ * @param ipList - IP addresses to connect to.
+ * @param numOfIPs - number of IP addresses in ipList.
+ * @param port - port number to connect to.
+ * @param ports - port number per address, NULL to use port for all.
+ * @param ssl - out SSL handler, none.
+ * @param index - out index of the connected address, 0.
+ * @retval -1 on failure, connection handle on success.
+ */
+sdoConHandle sdoConConnectRace(SDOIPAddress_t *ipList, uint32_t numOfIPs,
+			       uint16_t port, const uint16_t *ports,
+			       void **ssl, uint32_t *index)
+{
+	if (!ipList || !numOfIPs)
+		return SDO_CON_INVALID_HANDLE;
+
+	if (index)
+		*index = 0;
+	return sdoConConnect(ipList, ports ? ports[0] : port, ssl);
+}
+
+/**
+ * Disconnect the connection for a given connection handle.
+ *
+ * @param handle - connection handler
+ * @param ssl - SSL handler, none.
+ * @retval 0 on success.
+ */
+int32_t sdoConDisconnect(sdoConHandle handle, void *ssl)
+{
+	(void)handle;
+	(void)ssl;
+
+	SDO_LOCK(play_lock);
+	playBodyReset();
+	SDO_UNLOCK(play_lock);
+	return 0;
+}
+
+/**
+ * Receive(read) protocol version, message type and length of the next
+ * response of the transcript, holding its body for sdoConRecvMsgBody().
+ *
+ * @param handle - connection handler
+ * @param protocolVersion - out SDO protocol version
+ * @param messageType - out message type of incoming SDO message.
+ * @param msglen - out Number of received bytes.
+ * @param ssl - handler in case of tls connection.
+ * @retval -1 on failure, 0 on success.
+ */
+int32_t sdoConRecvMsgHeader(sdoConHandle handle, uint32_t *protocolVersion,
+			    uint32_t *messageType, uint32_t *msglen, void *ssl)
+{
+	int32_t ret = -1;
+	char dir;
+	size_t length;
+	RestCtx_t *rest;
+	SDO_TRACE_START(traceStart);
+
+	(void)handle;
+	(void)ssl;
+
+	if (!protocolVersion || !messageType || !msglen)
+		return -1;
+
+	SDO_LOCK(play_lock);
+	playBodyReset();
+	if (!playNext(&dir, protocolVersion, messageType, &length))
+		goto end;
+	if (dir != '<' || !length) {
+		LOG(LOG_ERROR, "Transcript record %u is not a response\n",
+		    play.record);
+		goto end;
+	}
+
+	play.body = sdoAlloc(length);
+	if (!play.body) {
+		LOG(LOG_ERROR, "Malloc failed\n");
+		goto end;
+	}
+	if (!playBody(play.body, length))
+		goto end;
+	play.len = length;
+	*msglen = length;
+
+	/* as the REST header would have */
+	rest = getRESTContext();
+	if (rest) {
+		rest->protVer = *protocolVersion;
+		rest->msgType = *messageType;
+		rest->contentLength = length;
+		rest->keepAlive = true;
+	}
+	ret = 0;
+end:
+	if (ret)
+		playBodyReset();
+	SDO_UNLOCK(play_lock);
+	SDO_TRACE_END("net", "recv-header", ret ? -1 : (int32_t)*messageType,
+		      traceStart);
+	return ret;
+}
+
+/**
+ * Receive(read) protocol version, message type and length of the next
+ * response, which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgHeaderAsync(sdoConHandle handle,
+				 uint32_t *protocolVersion,
+				 uint32_t *messageType, uint32_t *msglen,
+				 void *ssl)
+{
+	if (sdoConRecvMsgHeader(handle, protocolVersion, messageType, msglen,
+				ssl))
+		return SDO_CON_ERROR;
+	return SDO_CON_DONE;
+}
+
+/**
+ * Receive(read) MsgBody of the response of sdoConRecvMsgHeader().
+ *
+ * @param handle - connection handler
+ * @param buf - data buffer to read into.
+ * @param length - Number of received bytes.
+ * @param ssl - handler in case of tls connection.
+ * @retval -1 on failure, number of bytes read on success.
+ */
+int32_t sdoConRecvMsgBody(sdoConHandle handle, uint8_t *buf, size_t length,
+			  void *ssl)
+{
+	int32_t ret = -1;
+	SDO_TRACE_START(traceStart);
+
+	(void)handle;
+	(void)ssl;
+
+	if (!buf || !length)
+		return -1;
+
+	SDO_LOCK(play_lock);
+	if (!play.body || length > play.len - play.off) {
+		LOG(LOG_ERROR, "Read beyond the response body\n");
+		goto end;
+	}
+	if (memcpy_s(buf, length, play.body + play.off, length) != 0) {
+		LOG(LOG_ERROR, "Memcpy failed\n");
+		goto end;
+	}
+	play.off += length;
+	if (play.off == play.len)
+		playBodyReset();
+	ret = (int32_t)length;
+end:
+	SDO_UNLOCK(play_lock);
+	SDO_TRACE_END("net", "recv-body", ret, traceStart);
+	return ret;
+}
+
+/**
+ * Receive(read) MsgBody, which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConRecvMsgBodyAsync(sdoConHandle handle, uint8_t *buf,
+			       size_t length, size_t *nread, void *ssl)
+{
+	if (!nread || *nread > length)
+		return SDO_CON_ERROR;
+	if (*nread < length) {
+		if (sdoConRecvMsgBody(handle, buf + *nread, length - *nread,
+				      ssl) < 0)
+			return SDO_CON_ERROR;
+		*nread = length;
+	}
+	return SDO_CON_DONE;
+}
+
+/**
+ * Send(write) a message, which is to be the next one of the transcript.
+ * Only the message type is checked, the bodies differing with time stamps
+ * and the like.
+ *
+ * @param handle - connection handler
+ * @param protocolVersion - SDO protocol version
+ * @param messageType - message type of outgoing SDO message.
+ * @param buf - data buffer to write from.
+ * @param length - Number of sent bytes.
+ * @param ssl - handler in case of tls connection.
+ * @retval -1 on failure, number of bytes written.
+ */
+int32_t sdoConSendMessage(sdoConHandle handle, uint32_t protocolVersion,
+			  uint32_t messageType, const uint8_t *buf,
+			  size_t length, void *ssl)
+{
+	int32_t ret = -1;
+	char dir;
+	uint32_t ver, type;
+	size_t len;
+	SDO_TRACE_START(traceStart);
+
+	(void)handle;
+	(void)ssl;
+
+	if (!buf || !length)
+		return -1;
+
+	SDO_LOCK(play_lock);
+	if (!playNext(&dir, &ver, &type, &len))
+		goto end;
+	if (dir != '>' || type != messageType || ver != protocolVersion) {
+		LOG(LOG_ERROR,
+		    "Message %u diverges from transcript record %u\n",
+		    messageType, play.record);
+		goto end;
+	}
+	if (len != length)
+		LOG(LOG_DEBUG, "Message %u of %zu bytes, %zu recorded\n",
+		    messageType, length, len);
+	if (!playBody(NULL, len))
+		goto end;
+	ret = (int32_t)length;
+end:
+	SDO_UNLOCK(play_lock);
+	SDO_TRACE_END("net", "send", ret < 0 ? -1 : (int32_t)messageType,
+		      traceStart);
+	return ret;
+}
+
+/**
+ * Send(write) a message, which is never pending.
+ *
+ * @retval SDO_CON_DONE or SDO_CON_ERROR.
+ */
+int32_t sdoConSendMessageAsync(sdoConHandle handle, uint32_t protocolVersion,
+			       uint32_t messageType, const uint8_t *buf,
+			       size_t length, void *ssl)
+{
+	if (sdoConSendMessage(handle, protocolVersion, messageType, buf,
+			      length, ssl) < 0)
+		return SDO_CON_ERROR;
+	return SDO_CON_DONE;
+}
+
+/**
+ * Non-blocking mode is not supported, the protocols run blocking I/O.
+ *
+ * @retval -1
+ */
+int32_t sdoConSetNonBlocking(sdoConHandle handle, bool enable)
+{
+	(void)handle;
+	(void)enable;
+	return -1;
+}
+
+/**
+ * There is no file descriptor to wait on.
+ *
+ * @retval -1
+ */
+int32_t sdoConGetFd(sdoConHandle handle)
+{
+	(void)handle;
+	return -1;
+}
+
+/**
+ * Timeouts do not apply, nothing is waited for.
+ */
+void sdoConSetTimeouts(uint32_t connectMs, uint32_t readMs, uint32_t writeMs)
+{
+	(void)connectMs;
+	(void)readMs;
+	(void)writeMs;
+}
+
+void sdoConSetDeadline(uint64_t deadline)
+{
+	(void)deadline;
+}
+
+/**
+ * sdoConTearDown connection tear-down.
+ *
+ * @return 0 on success, -1 on failure
+ */
+int32_t sdoConTeardown(void)
+{
+	SDO_LOCK(play_lock);
+	playBodyReset();
+	SDO_UNLOCK(play_lock);
+
+	/* REST context over */
+	exitRESTContext();
+	return 0;
+}
+
+/**
+ * Delays between retries are skipped, so that they are not measured.
+ */
+void sdoSleep(int sec)
+{
+	(void)sec;
+}
+
+void sdoSleepMs(uint32_t ms)
+{
+	(void)ms;
+}
+
+/**
+ * Convert from Network to Host byte order
+ *
+ * @param value
+ *        Number in network byte order.
+ *
+ * @return
+ *         Value in Host byte order.
+ */
+uint32_t sdoNetToHostLong(uint32_t value)
+{
+	return ntohl(value);
+}
+
+/**
+ * Convert from Host to Network byte order
+ *
+ * @param value
+ *         Value in Host byte order.
+ *
+ * @return
+ *        Number in network byte order.
+ */
+uint32_t sdoHostToNetLong(uint32_t value)
+{
+	return htonl(value);
+}
+
+/**
+ * Convert from ASCII to Network format
+ *
+ * @param src
+ *         Source address in ASCII format.
+ * @param addr
+ *         Source address in network format.
+ *
+ * @return
+ *        1 on success. -1 on error. 0 if input format is invalie
+ */
+int32_t sdoPrintableToNet(const char *src, void *addr)
+{
+	return inet_pton(AF_INET, src, addr);
+}
+
+/**
+ * get device model
+ *
+ * @return
+ *        returns model as string
+ */
+const char *get_device_model(void)
+{
+	return "Intel-SDO-Linux";
+}
+
+/**
+ *  get device serial number
+ *
+ * @return
+ *        returns device serial number as string.
+ */
+const char *get_device_serial_number(void)
+{
+	return "sdo-linux-1234";
+}
+
+/**
+ * sdo_random generates random number and returns
+ *
+ * Note: this is only to be used for calculating random
+ * network delay for retransmissions and NOT for crypto
+ *
+ * @return
+ *        returns random number
+ */
+int sdoRandom(void)
+{
+	return rand();
+}
+
+/**
+ * Monotonic time, not affected by changes of the wall clock.
+ *
+ * @return
+ *        returns milliseconds elapsed since an unspecified starting point
+ */
+uint64_t sdoTimeMs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/**
+ * Monotonic time in microseconds, for measuring short operations.
+ *
+ * @return
+ *        returns microseconds elapsed since the starting point of sdoTimeMs
+ */
+uint64_t sdoTimeUs(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
@@ -11,7 +11,17 @@ include $(BASE_DIR)/base.mk
 ### LINUX
 ifeq ($(TARGET_OS), linux)
 PATH_PREFIX = $(BASE_DIR)
+ifeq ($(NET_REPLAY), play)
+SRC = network_if_replay.c rest_interface.c util.c
+else ifeq ($(NET_TRANSPORT), coap)
+SRC = network_if_coap.c rest_interface.c util.c
+else
 SRC = network_if_linux.c rest_interface.c util.c
+ifeq ($(HTTP2), true)
+SRC += h2_interface.c
+endif
+endif
+SRC += task_if.c
 endif
 
 CFLAGS += -I$(BASE_DIR)/crypto/include
@@ -17,6 +17,7 @@
 extern "C" {
 extern int32_t _sdoCryptoRandomBytes(uint8_t *randomBuffer, size_t numBytes);
 extern int memcpy_s(void *dest, size_t dmax, const void *src, size_t slen);
+extern int memset_s(void *dest, size_t dmax, uint8_t value);
 }
 
 /**
@@ -110,6 +111,30 @@ end:
 	return retval;
 }
 
+/*
+ * Platform key cache. The AES and HMAC keys are read (or generated) once
+ * and then served from memory, wiped by clearPlatformKeys. There is no
+ * swap to lock them out of on this platform.
+ */
+static struct {
+	bool aesValid;
+	bool hmacValid;
+	uint8_t aes[PLATFORM_AES_KEY_DEFAULT_LEN];
+	uint8_t hmac[PLATFORM_HMAC_KEY_DEFAULT_LEN];
+} platformKeys;
+
+/**
+ * Wipe the cached platform keys, when a key file is replaced and at
+ * shutdown.
+ */
+void clearPlatformKeys(void)
+{
+	if (memset_s(&platformKeys, sizeof(platformKeys), 0))
+		LOG(LOG_ERROR, "Failed to clear platform keys\n");
+	platformKeys.aesValid = false;
+	platformKeys.hmacValid = false;
+}
+
 /**
  * Generate platform AES Key (if not already generated) else provide already
  * generated Key.
@@ -128,6 +153,13 @@ bool getPlatformAESKey(uint8_t *key, size_t len)
 		goto end;
 	}
 
+	if (platformKeys.aesValid) {
+		if (memcpy_s(key, len, platformKeys.aes,
+			     PLATFORM_AES_KEY_DEFAULT_LEN) != 0)
+			goto end;
+		return true;
+	}
+
 	fsize = sdoBlobSize((const char *)PLATFORM_AES_KEY, SDO_SDK_RAW_DATA);
 
 	if (fsize != PLATFORM_AES_KEY_DEFAULT_LEN) {
@@ -158,6 +190,9 @@ bool getPlatformAESKey(uint8_t *key, size_t len)
 			goto end;
 		}
 	}
+	if (memcpy_s(platformKeys.aes, sizeof(platformKeys.aes), key,
+		     PLATFORM_AES_KEY_DEFAULT_LEN) == 0)
+		platformKeys.aesValid = true;
 	retval = true;
 
 end:
@@ -182,6 +217,13 @@ bool getPlatformHMACKey(uint8_t *key, size_t len)
 		goto end;
 	}
 
+	if (platformKeys.hmacValid && len == PLATFORM_HMAC_KEY_DEFAULT_LEN) {
+		if (memcpy_s(key, len, platformKeys.hmac,
+			     PLATFORM_HMAC_KEY_DEFAULT_LEN) != 0)
+			goto end;
+		return true;
+	}
+
 	fsize = sdoBlobSize((const char *)PLATFORM_HMAC_KEY, SDO_SDK_RAW_DATA);
 
 	if (fsize != PLATFORM_HMAC_KEY_DEFAULT_LEN) {
@@ -212,6 +254,10 @@ bool getPlatformHMACKey(uint8_t *key, size_t len)
 			goto end;
 		}
 	}
+	if (len == PLATFORM_HMAC_KEY_DEFAULT_LEN &&
+	    memcpy_s(platformKeys.hmac, sizeof(platformKeys.hmac), key,
+		     PLATFORM_HMAC_KEY_DEFAULT_LEN) == 0)
+		platformKeys.hmacValid = true;
 	retval = true;
 
 end:
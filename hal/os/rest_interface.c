@@ -18,12 +18,13 @@
 #include "safe_lib.h"
 #include "snprintf_s.h"
 #include "rest_interface.h"
+#include <ctype.h>
 
 // Global REST context is allocated ?
 #define isRESTContextActive() ((rest) ? true : false)
 
-// Global REST context
-static RestCtx_t *rest;
+// REST context of the connection set up by this thread
+static SDO_THREAD_LOCAL RestCtx_t *rest;
 
 /**
  * Initialize REST context.
@@ -88,6 +89,7 @@ bool cacheHostDns(const char *dns)
 	}
 	if (strcpy_s(rest->hostDNS, len + 1, dns) != 0)
 		goto err;
+	rest->hdrTmplLen = 0;
 
 	ret = true;
 
@@ -128,6 +130,7 @@ bool cacheHostIP(SDOIPAddress_t *ip)
 		sdoFree(rest->hostIP);
 		goto err;
 	}
+	rest->hdrTmplLen = 0;
 	ret = true;
 err:
 	return ret;
@@ -149,6 +152,7 @@ bool cacheHostPort(uint16_t port)
 	}
 
 	rest->portno = port;
+	rest->hdrTmplLen = 0;
 	ret = true;
 
 err:
@@ -170,6 +174,29 @@ bool cacheTLSConnection(void)
 	}
 
 	rest->tls = true;
+	rest->hdrTmplLen = 0;
+	ret = true;
+
+err:
+	return ret;
+}
+
+/**
+ * Cache if the messages are CBOR encoded, for their Content-type
+ *
+ *
+ */
+bool cacheCBOREncoding(void)
+{
+	bool ret = false;
+
+	if (!isRESTContextActive()) {
+		LOG(LOG_ERROR, "Rest Context is not active!\n");
+		goto err;
+	}
+
+	rest->cbor = true;
+	rest->hdrTmplLen = 0;
 	ret = true;
 
 err:
@@ -214,347 +241,425 @@ err:
 }
 
 /**
- * REST header (POST URL) construction based on current REST context.
+ * Internal API: append str to the header template of the REST context.
  *
  * @param rest - current REST context.
- * @param g_URL - post URL output.
- * @param POST_URL_LEN - post URL max length.
- * @retval true if header onstruction was successful, false otherwise.
+ * @param str - text to append.
+ * @retval true if appending was successful, false otherwise.
  */
-bool constructRESTHeader(RestCtx_t *rest, char *g_URL, size_t POST_URL_LEN)
+static bool restHdrAppend(RestCtx_t *rest, const char *str)
 {
-	char *ip_ascii = NULL;
-	char temp[HTTP_MAX_URL_SIZE] = {0};
-	char temp1[256] = {0};
-	char msgequals[] = ""; //!!! todo: "msg=";
-	bool ret = false;
-
-	if (!rest || !g_URL || !POST_URL_LEN) {
-		LOG(LOG_ERROR, "Invalid input!\n");
-		goto err;
+	if (strcat_s(rest->hdrTmpl, sizeof(rest->hdrTmpl), str) != 0) {
+		LOG(LOG_ERROR, "Strcat() failed!\n");
+		return false;
 	}
+	return true;
+}
 
-	if (rest->hostIP) {
-		ip_ascii = sdoAlloc(IP_TAG_LEN);
+/**
+ * Internal API: build the header template of the REST context, the request
+ * header with the message type, the content length and the content
+ * encoding left out. Built again once the host, port, protocol version or
+ * authorization change.
+ *
+ * @param rest - current REST context.
+ * @retval true if the template was built, false otherwise.
+ */
+static bool buildRESTHeaderTemplate(RestCtx_t *rest)
+{
+	char ip_ascii[IP_TAG_LEN] = {0};
+	char host[HTTP_MAX_URL_SIZE] = {0};
+	char temp[HTTP_MAX_URL_SIZE] = {0};
+	const char *name = rest->hostDNS;
 
-		if (!ip_ascii)
-			goto err;
+	rest->hdrTmplLen = 0;
+	rest->hdrTmpl[0] = '\0';
 
+	if (!name && rest->hostIP) {
 		if (!ipBinToAscii(rest->hostIP, ip_ascii))
-			goto err;
+			return false;
+		name = ip_ascii;
 	}
-
-	// TLS needed ?
-	if (rest->tls) {
-		if (strcpy_s(g_URL, POST_URL_LEN, "POST https://") != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
-		}
-	} else {
-		if (strcpy_s(g_URL, POST_URL_LEN, "POST http://") != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
-		}
-	}
-
-	if (/* rest->isDNS  && */ rest->hostDNS) {
-		/* DNS */
-		if (snprintf_s_si(temp, sizeof(temp), "%s:%d", rest->hostDNS,
-				  rest->portno) < 0) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto err;
-		}
-	} else if (rest->hostIP && ip_ascii) {
-		/* IP */
-		if (snprintf_s_si(temp, sizeof(temp), "%s:%d", ip_ascii,
-				  rest->portno) < 0) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto err;
-		}
-	} else {
+	if (!name) {
 		LOG(LOG_ERROR, "Host IP and DNS both are NULL!\n");
-		goto err;
+		return false;
 	}
 
-	if (strcat_s(g_URL, POST_URL_LEN, temp) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
+	if (snprintf_s_si(host, sizeof(host), "%s:%d", (char *)name,
+			  rest->portno) < 0 ||
+	    snprintf_s_i(temp, sizeof(temp), "/mp/%d/msg/", rest->protVer) <
+		0) {
+		LOG(LOG_ERROR, "Snprintf() failed!\n");
+		return false;
 	}
 
-	if (snprintf_s_i(temp, sizeof(temp), "/mp/%d", rest->protVer) < 0) {
-		LOG(LOG_ERROR, "Snprintf failed!\n");
-		goto err;
-	}
+	// TLS needed ?
+	if (!restHdrAppend(rest,
+			   rest->tls ? "POST https://" : "POST http://") ||
+	    !restHdrAppend(rest, host) || !restHdrAppend(rest, temp))
+		return false;
+	rest->hdrMsgOff = strnlen_s(rest->hdrTmpl, sizeof(rest->hdrTmpl));
+
+	if (!restHdrAppend(rest, " HTTP/1.1\r\nHOST:") ||
+	    !restHdrAppend(rest, host) ||
+	    !restHdrAppend(rest, rest->cbor
+				     ? "\r\nContent-type:application/cbor"
+				     : "\r\nContent-type:application/json") ||
+	    !restHdrAppend(rest, "\r\nContent-length:"))
+		return false;
+	rest->hdrLenOff = strnlen_s(rest->hdrTmpl, sizeof(rest->hdrTmpl));
 
-	if (strcat_s(g_URL, POST_URL_LEN, temp) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
-	}
+	if (!restHdrAppend(rest, "\r\nConnection: keep-alive\r\n"))
+		return false;
+#ifdef HTTP_DEFLATE
+	if (!restHdrAppend(rest, "Accept-Encoding: deflate, gzip\r\n"))
+		return false;
+#endif
+	rest->hdrEncOff = strnlen_s(rest->hdrTmpl, sizeof(rest->hdrTmpl));
 
-	if (snprintf_s_i(temp, sizeof(temp), "/msg/%d", rest->msgType) < 0) {
-		LOG(LOG_ERROR, "Snprintf failed!\n");
-		goto err;
-	}
+	if (rest->authorization[0] &&
+	    (!restHdrAppend(rest, "Authorization:") ||
+	     !restHdrAppend(rest, rest->authorization) ||
+	     !restHdrAppend(rest, "\r\n")))
+		return false;
+	if (!restHdrAppend(rest, "\r\n"))
+		return false;
 
-	if (strcat_s(g_URL, POST_URL_LEN, temp) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
-	}
+	rest->hdrTmplVer = rest->protVer;
+	rest->hdrTmplLen = strnlen_s(rest->hdrTmpl, sizeof(rest->hdrTmpl));
+	return true;
+}
 
-	if (strcat_s(g_URL, POST_URL_LEN, " HTTP/1.1\r\n") != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
-	}
+/**
+ * Internal API: write the decimal digits of a number, unterminated.
+ *
+ * @param buf - output, room for 10 digits.
+ * @param val - number to write.
+ * @return number of digits written.
+ */
+static size_t restPutUint(char *buf, uint32_t val)
+{
+	char digits[10];
+	size_t n = 0, i;
+
+	do {
+		digits[n++] = '0' + val % 10;
+		val /= 10;
+	} while (val);
+	for (i = 0; i < n; i++)
+		buf[i] = digits[n - 1 - i];
+	return n;
+}
 
-	if (memset_s(temp, sizeof(temp), 0) != 0) {
-		ret = false;
-		goto err;
-	}
+/**
+ * REST header (POST URL) construction based on current REST context: the
+ * header template of the context, built when missing, with the message
+ * type, the content length and the content encoding filled in.
+ *
+ * @param rest - current REST context.
+ * @param g_URL - post URL output.
+ * @param POST_URL_LEN - post URL max length.
+ * @retval true if header onstruction was successful, false otherwise.
+ */
+bool constructRESTHeader(RestCtx_t *rest, char *g_URL, size_t POST_URL_LEN)
+{
+	static const char encoding[] = "Content-Encoding: deflate\r\n";
+	const char *tmpl;
+	size_t len = 0;
 
-	if (rest->hostDNS) {
-		/* DNS */
-		if (snprintf_s_si(temp, sizeof(temp), "HOST:%s:%d\r\n",
-				  rest->hostDNS, rest->portno) < 0) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto err;
-		}
-	} else if (rest->hostIP && ip_ascii) {
-		/* IP */
-		if (snprintf_s_si(temp, sizeof(temp), "HOST:%s:%d\r\n",
-				  ip_ascii, rest->portno) < 0) {
-			LOG(LOG_ERROR, "Snprintf() failed!\n");
-			goto err;
-		}
+	if (!rest || !g_URL || !POST_URL_LEN) {
+		LOG(LOG_ERROR, "Invalid input!\n");
+		return false;
 	}
 
-	if (strcat_s(g_URL, POST_URL_LEN, temp) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
+	if ((!rest->hdrTmplLen || rest->hdrTmplVer != rest->protVer) &&
+	    !buildRESTHeaderTemplate(rest))
+		return false;
+	tmpl = rest->hdrTmpl;
+
+	/* Two numbers of at most 10 digits, the encoding and a NUL at most */
+	if (rest->hdrTmplLen + 2 * 10 + sizeof(encoding) > POST_URL_LEN) {
+		LOG(LOG_ERROR, "REST header too long!\n");
+		return false;
 	}
 
-	if (snprintf_s_i(temp1, sizeof(temp1),
-			 "Content-type:application/json\r\n"
-			 "Content-length:%u\r\nConnection: keep-alive\r\n",
-			 rest->contentLength) < 0) {
-		LOG(LOG_ERROR, "Snprintf() failed!\n");
-		goto err;
+	memcpy(g_URL, tmpl, rest->hdrMsgOff);
+	len = rest->hdrMsgOff;
+	len += restPutUint(g_URL + len, rest->msgType);
+	memcpy(g_URL + len, tmpl + rest->hdrMsgOff,
+	       rest->hdrLenOff - rest->hdrMsgOff);
+	len += rest->hdrLenOff - rest->hdrMsgOff;
+	len += restPutUint(g_URL + len, (uint32_t)rest->contentLength);
+	memcpy(g_URL + len, tmpl + rest->hdrLenOff,
+	       rest->hdrEncOff - rest->hdrLenOff);
+	len += rest->hdrEncOff - rest->hdrLenOff;
+#ifdef HTTP_DEFLATE
+	if (rest->deflate) {
+		memcpy(g_URL + len, encoding, sizeof(encoding) - 1);
+		len += sizeof(encoding) - 1;
+	}
+#endif
+	memcpy(g_URL + len, tmpl + rest->hdrEncOff,
+	       rest->hdrTmplLen - rest->hdrEncOff);
+	len += rest->hdrTmplLen - rest->hdrEncOff;
+	g_URL[len] = '\0';
+	return true;
+}
+
+/**
+ * Internal API: compare a header token with a lowercase name, ignoring the
+ * case of the token.
+ *
+ * @param tok - token, not NUL terminated.
+ * @param len - length of tok.
+ * @param name - lowercase name.
+ * @retval true if the token is the name, false otherwise.
+ */
+static bool restTokenIs(const char *tok, size_t len, const char *name)
+{
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		if (!name[i] || tolower((unsigned char)tok[i]) != name[i])
+			return false;
 	}
+	return !name[len];
+}
 
-	if (strcat_s(g_URL, POST_URL_LEN, temp1) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
+/**
+ * Internal API: keep a header value in a buffer of the REST context.
+ *
+ * @param dst - buffer of the REST context.
+ * @param dstSize - size of dst.
+ * @param val - value, not NUL terminated.
+ * @param len - length of val.
+ * @retval true if the value fits in the buffer, false otherwise.
+ */
+static bool restKeepValue(char *dst, size_t dstSize, const char *val,
+			  size_t len)
+{
+	if (len >= dstSize) {
+		LOG(LOG_ERROR, "REST: header value too long\n");
+		return false;
 	}
+	if (memcpy_s(dst, dstSize, val, len) != 0)
+		return false;
+	dst[len] = '\0';
+	return true;
+}
 
-	if (rest->authorization) {
-		if (strcat_s(g_URL, POST_URL_LEN, "Authorization:") != 0) {
-			LOG(LOG_ERROR, "Strcpy() failed!\n");
-			goto err;
-		}
+/**
+ * Process the Content-Encoding of a response. Encoded bodies are inflated
+ * by the network layer, they tell that the server takes encoded requests.
+ *
+ * @param encoding - value of the header.
+ * @param len - length of encoding.
+ * @retval true if the body can be decoded, false otherwise.
+ */
+static bool getRESTContentEncoding(const char *encoding, size_t len)
+{
+	if (restTokenIs(encoding, len, "identity"))
+		return true;
+#ifdef HTTP_DEFLATE
+	if (restTokenIs(encoding, len, "deflate") ||
+	    restTokenIs(encoding, len, "gzip")) {
+		rest->deflate = true;
+		rest->peerDeflate = true;
+		return true;
+	}
+#endif
+	LOG(LOG_ERROR, "Content-encoding %.*s not supported\n", (int)len,
+	    encoding);
+	return false;
+}
 
-		if (strcat_s(g_URL, POST_URL_LEN, rest->authorization) != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
-		}
+/**
+ * Internal API: process the status line of a response,
+ * "HTTP/<major>.<minor> <code> <reason>".
+ *
+ * @param line - status line, without its end.
+ * @param len - length of line.
+ * @retval true if the line is valid, false otherwise.
+ */
+static bool getRESTStatus(const char *line, size_t len)
+{
+	int rcode = 0;
+	size_t i = sizeof("HTTP/1.1 ") - 1;
 
-		if (strcat_s(g_URL, POST_URL_LEN, "\r\n") != 0) {
-			LOG(LOG_ERROR, "Strcat() failed!\n");
-			goto err;
-		}
+	if (len < i + 3 || !restTokenIs(line, 5, "http/") || line[8] != ' ') {
+		LOG(LOG_ERROR, "sdoRestRun: Response line parse error\n");
+		return false;
 	}
+	/* HTTP/1.0 connections are closed unless the server says otherwise */
+	if (line[5] == '1' && line[7] == '0')
+		rest->keepAlive = false;
 
-	if (strcat_s(g_URL, POST_URL_LEN, "\r\n") != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
-	}
+	for (; i < len && line[i] >= '0' && line[i] <= '9'; i++)
+		rcode = rcode * 10 + line[i] - '0';
+	LOG(LOG_DEBUG, "Response code %03d received (%.*s)\n", rcode,
+	    (int)(i < len ? len - i - 1 : 0), line + (i < len ? i + 1 : i));
 
-	if (strcat_s(g_URL, POST_URL_LEN, msgequals) != 0) {
-		LOG(LOG_ERROR, "Strcat() failed!\n");
-		goto err;
+	if (rcode != HTTP_SUCCESS_OK) {
+		LOG(LOG_ERROR, "HTTP reponse is not 200(OK)!\n");
+		rest->msgType = SDO_TYPE_ERROR;
 	}
+	return true;
+}
 
-	ret = true;
-
-err:
-	if (ip_ascii)
-		sdoFree(ip_ascii);
-	return ret;
+/**
+ * Internal API: process a header line of a response.
+ *
+ * @param name - header name.
+ * @param nameLen - length of name.
+ * @param val - header value, without surrounding blanks.
+ * @param valLen - length of val.
+ * @retval true if the header is valid, false otherwise.
+ */
+static bool getRESTField(const char *name, size_t nameLen, const char *val,
+			 size_t valLen)
+{
+	size_t i;
+#ifdef OV_PIPELINE
+	uint32_t depth;
+#endif
+
+	if (restTokenIs(name, nameLen, "content-length")) {
+		if (!valLen)
+			return false;
+		rest->contentLength = 0;
+		for (i = 0; i < valLen; i++) {
+			if (val[i] < '0' || val[i] > '9' ||
+			    rest->contentLength > REST_MAX_MSGBODY_SIZE) {
+				LOG(LOG_ERROR, "Invalid content-length!\n");
+				return false;
+			}
+			rest->contentLength =
+			    rest->contentLength * 10 + val[i] - '0';
+		}
+		LOG(LOG_DEBUG, "Content-length: %zu\n", rest->contentLength);
+	} else if (restTokenIs(name, nameLen, "content-type")) {
+		LOG(LOG_DEBUG, "Content type: %.*s\n", (int)valLen, val);
+	} else if (restTokenIs(name, nameLen, "content-encoding")) {
+		return getRESTContentEncoding(val, valLen);
+	} else if (restTokenIs(name, nameLen, "transfer-encoding")) {
+		/* the last coding is applied last, chunked if any */
+		rest->chunked = valLen >= 7 &&
+				restTokenIs(val + valLen - 7, 7, "chunked");
+	} else if (restTokenIs(name, nameLen, "connection")) {
+		rest->keepAlive = restTokenIs(val, valLen, "keep-alive");
+		LOG(LOG_DEBUG, "Keep alive: %u\n", rest->keepAlive);
+	} else if (restTokenIs(name, nameLen, "authorization")) {
+		/* the same token keeps the header template */
+		if (strnlen_s(rest->authorization, REST_MAX_TOKEN_SIZE) !=
+			valLen ||
+		    memcmp(rest->authorization, val, valLen) != 0) {
+			if (!restKeepValue(rest->authorization,
+					   REST_MAX_TOKEN_SIZE, val, valLen))
+				return false;
+			rest->hdrTmplLen = 0;
+		}
+		LOG(LOG_DEBUG, "Authorization: %s\n", rest->authorization);
+#ifdef OV_PIPELINE
+	} else if (restTokenIs(name, nameLen, "x-pipeline")) {
+		/* the owner takes as many requests before it answers */
+		depth = 0;
+		for (i = 0; i < valLen && val[i] >= '0' && val[i] <= '9'; i++) {
+			depth = depth * 10 + val[i] - '0';
+			if (depth > UINT8_MAX)
+				depth = UINT8_MAX;
+		}
+		rest->pipeline = (uint8_t)depth;
+		LOG(LOG_DEBUG, "Pipeline: %u\n", rest->pipeline);
+#endif
+	} else if (restTokenIs(name, nameLen, "x-token")) {
+		if (rest->xTokenAuthorization[0])
+			return true;
+		if (!restKeepValue(rest->xTokenAuthorization,
+				   REST_MAX_TOKEN_SIZE, val, valLen))
+			return false;
+		LOG(LOG_DEBUG, "X-Token: %s\n", rest->xTokenAuthorization);
+	}
+	return true;
 }
 
 /**
  * Parse/Process REST header elements (including HTTP Response) and return
- * content-length of REST body.
+ * content-length of REST body. The header is processed in a single pass,
+ * in place: the status line, then the header lines, each ended by LF or
+ * CRLF.
  *
- * @param hdr - pointer to REST header.
+ * @param hdr - pointer to REST header, up to the empty line ending it.
  * @param hdrlen - REST header length.
  * @param contLen - output pointer to content-length of REST body.
  * @retval true if HTTP 200 response is seen and parsing/processing was
  * successful, false otherwise.
  */
-bool getRESTContentLength(char *hdr, size_t hdrlen, uint32_t *contLen)
+bool getRESTContentLength(const char *hdr, size_t hdrlen, uint32_t *contLen)
 {
-	bool ret = false;
-	char *rem, *p1, *p2;
-	size_t remlen;
-	char tmp[512];
-	size_t tmplen;
-	int rcode, result_strcmpcase;
+	size_t pos, eol, len, colon, val, vend;
+	const char *line;
 
 	/* REST context must be active */
 	if (!isRESTContextActive()) {
 		LOG(LOG_ERROR, "Rest Context is not active!\n");
-		goto err;
+		return false;
 	}
+	if (!hdr || !hdrlen || !contLen)
+		return false;
 
 	rest->msgType = 0;
-
-	// GET HTTP reponse from header
-	rem = strchr(hdr, '\n');
-
-	if (rem) {
-		remlen = strnlen_s(rem, SDO_MAX_STR_SIZE);
-
-		if (!remlen || remlen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_ERROR, "Strlen() failed!\n");
-			goto err;
-		}
-
-		tmplen = hdrlen - remlen;
-
-		if (strncpy_s(tmp, tmplen + 1, hdr, tmplen) != 0) {
-			LOG(LOG_ERROR, "Strcpy() failed!\n");
-			goto err;
-		}
-
-		hdr += tmplen;
-		hdrlen -= tmplen;
-		LOG(LOG_DEBUG, "REST: HTTP response line: %s\n", tmp);
-
-		// validate HTTP response
-		p1 = strchr(tmp, ' ');
-		if (p1 == NULL) {
-			LOG(LOG_ERROR,
-			    "sdoRestRun: Response line parse error\n");
-			goto err;
-		}
-		*p1++ = 0;
-		rcode = atoi(p1);
-		p2 = strchr(p1, ' ');
-		if (p2 == NULL) {
-			LOG(LOG_DEBUG, "Response code %03d \n", rcode);
-		} else {
-			*p2++ = 0;
-			LOG(LOG_DEBUG, "Response code %03d received (%s)\n",
-			    rcode, p2);
+	rest->contentLength = 0;
+	rest->deflate = false;
+	rest->chunked = false;
+	/* HTTP/1.1 connections are persistent unless the server says otherwise */
+	rest->keepAlive = true;
+
+	for (pos = 0; pos < hdrlen; pos = eol + 1) {
+		line = hdr + pos;
+		for (eol = pos; eol < hdrlen && hdr[eol] != '\n'; eol++)
+			;
+		len = eol - pos;
+		if (len && line[len - 1] == '\r')
+			len--;
+
+		if (!pos) {
+			if (!getRESTStatus(line, len))
+				return false;
+			continue;
 		}
+		if (!len)
+			continue;
 
-		if (rcode != HTTP_SUCCESS_OK) {
-			LOG(LOG_ERROR, "HTTP reponse is not 200(OK)!\n");
-			rest->msgType = SDO_TYPE_ERROR;
-		}
-		// consume \n
-		++hdr;
-		--hdrlen;
-	}
-
-	// parse and process other header elements
-	while ((rem = strchr(hdr, '\n')) != NULL) {
-		remlen = strnlen_s(rem, SDO_MAX_STR_SIZE);
-
-		if (!remlen || remlen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_ERROR, "Strlen() failed!\n");
-			goto err;
-		}
-		tmplen = hdrlen - remlen;
-
-		if (strncpy_s(tmp, tmplen + 1, hdr, tmplen) != 0) {
-			LOG(LOG_ERROR, "Strcpy() failed!\n");
-			goto err;
-		}
-
-		hdr += tmplen;
-		hdrlen -= tmplen;
-
-		p1 = strchr(tmp, ':');
-		if (p1 == NULL) {
+		for (colon = 0; colon < len && line[colon] != ':'; colon++)
+			;
+		if (colon == len) {
 			LOG(LOG_ERROR, "REST: HEADER parse error\n");
-			goto err;
-		}
-
-		*p1++ = 0;
-		while (*p1 == ' ')
-			++p1;
-
-		if ((strcasecmp_s(tmp, tmplen, "content-length",
-				  &result_strcmpcase) == 0) &&
-		    result_strcmpcase == 0) {
-			rest->contentLength = atoi(p1);
-			LOG(LOG_DEBUG, "Content-length: %zu\n",
-			    rest->contentLength);
-		} else if ((strcasecmp_s(tmp, tmplen, "content-type",
-					 &result_strcmpcase) == 0) &&
-			   result_strcmpcase == 0) {
-			LOG(LOG_DEBUG, "Content type: %s\n", p1);
-		} else if ((strcasecmp_s(tmp, tmplen, "connection",
-					 &result_strcmpcase) == 0) &&
-			   result_strcmpcase == 0) {
-			if ((strcasecmp_s(p1, strnlen_s(p1, SDO_MAX_STR_SIZE),
-					  "keep-alive",
-					  &result_strcmpcase) == 0) &&
-			    result_strcmpcase == 0) {
-				rest->keepAlive = true;
-			} else {
-				rest->keepAlive = false;
-			}
-			LOG(LOG_DEBUG, "Keep alive: %u\n", rest->keepAlive);
-		} else if (strcasecmp_s(tmp, tmplen, "authorization",
-					&result_strcmpcase) == 0 &&
-			   result_strcmpcase == 0) {
-			if (rest->authorization)
-				sdoFree(rest->authorization);
-			rest->authorization = strdup(p1);
-			if (rest->authorization) {
-				LOG(LOG_DEBUG, "Authorization: %s\n",
-				    rest->authorization);
-			}
-		} else if (rest->xTokenAuthorization == NULL &&
-			   strcasecmp_s(tmp, tmplen, "X-Token",
-					&result_strcmpcase) == 0 &&
-			   result_strcmpcase == 0) {
-			rest->xTokenAuthorization = strdup(p1);
-			if (rest->xTokenAuthorization) {
-				LOG(LOG_DEBUG, "X-Token: %s\n",
-				    rest->xTokenAuthorization);
-			}
-		} else {
-			/* TODO: This looks like dead code, remove this
-			 */
-			/*
-			 * If in protocol error sdoRestFree is not
-			 * called
-			 * this can lead to memory leak, hence sdoFree
-			 * if
-			 * allocated
-			 */
-			if (rest->xTokenAuthorization)
-				sdoFree(rest->xTokenAuthorization);
-			rest->xTokenAuthorization = strdup(p1);
-			LOG(LOG_DEBUG, "Body: %s\n", tmp);
+			return false;
 		}
-		// consume \n
-		++hdr;
-		--hdrlen;
+		for (val = colon + 1; val < len && (line[val] == ' ' ||
+						    line[val] == '\t');
+		     val++)
+			;
+		for (vend = len; vend > val && (line[vend - 1] == ' ' ||
+						line[vend - 1] == '\t');
+		     vend--)
+			;
+		if (!getRESTField(line, colon, line + val, vend - val))
+			return false;
+	}
+
+	/* the body is read by its length, which chunks do not tell */
+	if (rest->chunked) {
+		LOG(LOG_ERROR, "REST: chunked body not supported!\n");
+		return false;
 	}
-
 	if (rest->contentLength > REST_MAX_MSGBODY_SIZE) {
 		LOG(LOG_ERROR, "Invalid content-length!\n");
-		goto err;
+		return false;
 	}
 
 	*contLen = rest->contentLength;
-	ret = true;
-
-err:
-	return ret;
+	return true;
 }
 
 /**
@@ -574,10 +679,6 @@ char getRESTHdrBodySeparator(void)
 void exitRESTContext(void)
 {
 	if (rest) {
-		if (rest->authorization)
-			sdoFree(rest->authorization);
-		if (rest->xTokenAuthorization)
-			sdoFree(rest->xTokenAuthorization);
 		if (rest->hostIP)
 			sdoFree(rest->hostIP);
 		if (rest->hostDNS)
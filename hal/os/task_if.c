@@ -0,0 +1,601 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Worker pool and task futures of the Task Abstraction Layer.
+ *
+ * The queue is a ring of SDO_TASK_QUEUE entries under the lock of the pool,
+ * and a semaphore counts the entries for the workers to wait on. A future
+ * is held by its submitter and by the queue: the last of the two to let go
+ * of it frees it, so that a task cancelled in the queue can be joined at
+ * once and dropped by the worker that takes it later. Each backend gives a
+ * lock, a counting semaphore and a joinable thread; without one, all tasks
+ * run inline.
+ */
+
+#include "util.h"
+#include "task_al.h"
+#include <stddef.h>
+
+/* Stack of the workers on the RTOS */
+#ifndef SDO_TASK_STACK
+#define SDO_TASK_STACK 8192
+#endif
+
+#if defined(TARGET_OS_LINUX)
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#define SDO_TASK_THREADS
+
+typedef pthread_mutex_t taskLock_t;
+typedef sem_t taskSem_t;
+typedef pthread_t taskThread_t;
+#elif defined(TARGET_OS_MBEDOS)
+#include "cmsis_os2.h"
+#define SDO_TASK_THREADS
+
+typedef osMutexId_t taskLock_t;
+typedef osSemaphoreId_t taskSem_t;
+typedef osThreadId_t taskThread_t;
+#elif defined(TARGET_OS_FREERTOS)
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#define SDO_TASK_THREADS
+
+typedef SemaphoreHandle_t taskLock_t;
+typedef SemaphoreHandle_t taskSem_t;
+/* A FreeRTOS task cannot be joined, it gives exit before deleting itself */
+typedef struct {
+	TaskHandle_t handle;
+	SemaphoreHandle_t exit;
+} taskThread_t;
+#endif
+
+typedef enum {
+	SDO_TASK_QUEUED,
+	SDO_TASK_RUNNING,
+	SDO_TASK_FINISHED,
+	SDO_TASK_CANCELLED
+} sdoTaskState_t;
+
+struct sdoTask_s {
+	sdoTaskFn_t fn;
+	void *arg;
+	int32_t result;
+	sdoTaskState_t state;
+#if defined(SDO_TASK_THREADS)
+	sdoTaskPool_t *pool; /* NULL when the task ran inline */
+	unsigned refs;	     /* submitter and queue, under the pool lock */
+	taskSem_t done;
+#endif
+};
+
+#if defined(SDO_TASK_THREADS)
+typedef struct {
+	sdoTaskPool_t *pool;
+	taskThread_t thread;
+} taskWorker_t;
+
+struct sdoTaskPool_s {
+	taskLock_t lock;
+	taskSem_t pending; /* entries of the ring, and one per worker to stop */
+	sdoTask_t **ring;
+	unsigned size;
+	unsigned head;
+	unsigned count;
+	bool stop;
+	unsigned workers;
+	taskWorker_t *worker;
+};
+
+#if defined(TARGET_OS_LINUX)
+static bool taskLockInit(taskLock_t *l)
+{
+	return pthread_mutex_init(l, NULL) == 0;
+}
+
+static void taskLockFree(taskLock_t *l)
+{
+	(void)pthread_mutex_destroy(l);
+}
+
+static void taskLock(taskLock_t *l)
+{
+	(void)pthread_mutex_lock(l);
+}
+
+static void taskUnlock(taskLock_t *l)
+{
+	(void)pthread_mutex_unlock(l);
+}
+
+static bool taskSemInit(taskSem_t *s)
+{
+	return sem_init(s, 0, 0) == 0;
+}
+
+static void taskSemFree(taskSem_t *s)
+{
+	(void)sem_destroy(s);
+}
+
+static void taskSemWait(taskSem_t *s)
+{
+	while (sem_wait(s) != 0)
+		; /* EINTR */
+}
+
+static void taskSemPost(taskSem_t *s)
+{
+	(void)sem_post(s);
+}
+
+static void taskWorkerRun(taskWorker_t *w);
+
+static void *taskThreadMain(void *arg)
+{
+	taskWorkerRun(arg);
+	return NULL;
+}
+
+static bool taskThreadStart(taskWorker_t *w)
+{
+	return pthread_create(&w->thread, NULL, taskThreadMain, w) == 0;
+}
+
+static void taskThreadJoin(taskWorker_t *w)
+{
+	(void)pthread_join(w->thread, NULL);
+}
+#elif defined(TARGET_OS_MBEDOS)
+static bool taskLockInit(taskLock_t *l)
+{
+	*l = osMutexNew(NULL);
+	return *l != NULL;
+}
+
+static void taskLockFree(taskLock_t *l)
+{
+	(void)osMutexDelete(*l);
+}
+
+static void taskLock(taskLock_t *l)
+{
+	(void)osMutexAcquire(*l, osWaitForever);
+}
+
+static void taskUnlock(taskLock_t *l)
+{
+	(void)osMutexRelease(*l);
+}
+
+static bool taskSemInit(taskSem_t *s)
+{
+	*s = osSemaphoreNew(0xffff, 0, NULL);
+	return *s != NULL;
+}
+
+static void taskSemFree(taskSem_t *s)
+{
+	(void)osSemaphoreDelete(*s);
+}
+
+static void taskSemWait(taskSem_t *s)
+{
+	(void)osSemaphoreAcquire(*s, osWaitForever);
+}
+
+static void taskSemPost(taskSem_t *s)
+{
+	(void)osSemaphoreRelease(*s);
+}
+
+static void taskWorkerRun(taskWorker_t *w);
+
+static void taskThreadMain(void *arg)
+{
+	taskWorkerRun(arg);
+}
+
+static bool taskThreadStart(taskWorker_t *w)
+{
+	osThreadAttr_t attr = {0};
+
+	attr.name = "sdoTask";
+	attr.attr_bits = osThreadJoinable;
+	attr.stack_size = SDO_TASK_STACK;
+	w->thread = osThreadNew(taskThreadMain, w, &attr);
+	return w->thread != NULL;
+}
+
+static void taskThreadJoin(taskWorker_t *w)
+{
+	(void)osThreadJoin(w->thread);
+}
+#elif defined(TARGET_OS_FREERTOS)
+static bool taskLockInit(taskLock_t *l)
+{
+	*l = xSemaphoreCreateMutex();
+	return *l != NULL;
+}
+
+static void taskLockFree(taskLock_t *l)
+{
+	vSemaphoreDelete(*l);
+}
+
+static void taskLock(taskLock_t *l)
+{
+	(void)xSemaphoreTake(*l, portMAX_DELAY);
+}
+
+static void taskUnlock(taskLock_t *l)
+{
+	(void)xSemaphoreGive(*l);
+}
+
+static bool taskSemInit(taskSem_t *s)
+{
+	*s = xSemaphoreCreateCounting(0xffff, 0);
+	return *s != NULL;
+}
+
+static void taskSemFree(taskSem_t *s)
+{
+	vSemaphoreDelete(*s);
+}
+
+static void taskSemWait(taskSem_t *s)
+{
+	(void)xSemaphoreTake(*s, portMAX_DELAY);
+}
+
+static void taskSemPost(taskSem_t *s)
+{
+	(void)xSemaphoreGive(*s);
+}
+
+static void taskWorkerRun(taskWorker_t *w);
+
+static void taskThreadMain(void *arg)
+{
+	taskWorker_t *w = arg;
+
+	taskWorkerRun(w);
+	(void)xSemaphoreGive(w->thread.exit);
+	vTaskDelete(NULL);
+}
+
+static bool taskThreadStart(taskWorker_t *w)
+{
+	w->thread.exit = xSemaphoreCreateBinary();
+	if (!w->thread.exit)
+		return false;
+	if (xTaskCreate(taskThreadMain, "sdoTask", SDO_TASK_STACK, w,
+			tskIDLE_PRIORITY + 1, &w->thread.handle) != pdPASS) {
+		vSemaphoreDelete(w->thread.exit);
+		return false;
+	}
+	return true;
+}
+
+static void taskThreadJoin(taskWorker_t *w)
+{
+	(void)xSemaphoreTake(w->thread.exit, portMAX_DELAY);
+	vSemaphoreDelete(w->thread.exit);
+}
+#endif
+
+/* Let go of a future, freeing it if the other holder has, under the lock */
+static void taskRelease(sdoTask_t *task)
+{
+	if (--task->refs)
+		return;
+	taskSemFree(&task->done);
+	sdoFree(task);
+}
+
+static void taskWorkerRun(taskWorker_t *w)
+{
+	sdoTaskPool_t *pool = w->pool;
+	sdoTask_t *task;
+
+	for (;;) {
+		taskSemWait(&pool->pending);
+		taskLock(&pool->lock);
+		if (!pool->count) {
+			/* Woken to stop, the ring drained */
+			taskUnlock(&pool->lock);
+			return;
+		}
+		task = pool->ring[pool->head];
+		pool->head = (pool->head + 1) % pool->size;
+		pool->count--;
+		if (task->state == SDO_TASK_CANCELLED) {
+			taskRelease(task);
+			taskUnlock(&pool->lock);
+			continue;
+		}
+		task->state = SDO_TASK_RUNNING;
+		taskUnlock(&pool->lock);
+
+		task->result = task->fn(task->arg);
+
+		taskLock(&pool->lock);
+		task->state = SDO_TASK_FINISHED;
+		taskSemPost(&task->done);
+		taskRelease(task);
+		taskUnlock(&pool->lock);
+	}
+}
+#endif
+
+/**
+ * Create a pool of worker threads.
+ * @param workers - threads of the pool, 0 for a pool running all its tasks
+ * inline.
+ * @param queue - tasks queued ahead of the workers at most, those submitted
+ * beyond run inline.
+ * @return the pool, or NULL on failure and without a thread backend, to
+ * run the tasks inline.
+ */
+sdoTaskPool_t *sdoTaskPoolCreate(unsigned workers, unsigned queue)
+{
+#if defined(SDO_TASK_THREADS)
+	sdoTaskPool_t *pool = sdoAlloc(sizeof(sdoTaskPool_t));
+	unsigned i;
+
+	if (!pool)
+		return NULL;
+	if (!workers || !queue)
+		return pool;
+
+	pool->ring = sdoAlloc(queue * sizeof(sdoTask_t *));
+	pool->worker = sdoAlloc(workers * sizeof(taskWorker_t));
+	if (!pool->ring || !pool->worker) {
+		sdoFree(pool->ring);
+		sdoFree(pool->worker);
+		sdoFree(pool);
+		return NULL;
+	}
+	pool->size = queue;
+	if (!taskLockInit(&pool->lock)) {
+		sdoFree(pool->ring);
+		sdoFree(pool->worker);
+		sdoFree(pool);
+		return NULL;
+	}
+	if (!taskSemInit(&pool->pending)) {
+		taskLockFree(&pool->lock);
+		sdoFree(pool->ring);
+		sdoFree(pool->worker);
+		sdoFree(pool);
+		return NULL;
+	}
+	for (i = 0; i < workers; i++) {
+		pool->worker[i].pool = pool;
+		if (!taskThreadStart(&pool->worker[i])) {
+			LOG(LOG_ERROR, "Starting the task worker %u failed\n",
+			    i);
+			break;
+		}
+		pool->workers++;
+	}
+	if (!pool->workers) {
+		sdoTaskPoolDestroy(pool);
+		return NULL;
+	}
+	return pool;
+#else
+	(void)workers;
+	(void)queue;
+	return NULL;
+#endif
+}
+
+/**
+ * Stop the workers of a pool, once they have run the tasks in its queue,
+ * and free it. The futures of its tasks are to be joined before.
+ * @param pool - the pool, may be NULL.
+ */
+void sdoTaskPoolDestroy(sdoTaskPool_t *pool)
+{
+#if defined(SDO_TASK_THREADS)
+	unsigned i;
+
+	if (!pool)
+		return;
+	if (pool->ring) {
+		taskLock(&pool->lock);
+		pool->stop = true;
+		taskUnlock(&pool->lock);
+		for (i = 0; i < pool->workers; i++)
+			taskSemPost(&pool->pending);
+		for (i = 0; i < pool->workers; i++)
+			taskThreadJoin(&pool->worker[i]);
+		taskSemFree(&pool->pending);
+		taskLockFree(&pool->lock);
+	}
+	sdoFree(pool->ring);
+	sdoFree(pool->worker);
+	sdoFree(pool);
+#else
+	(void)pool;
+#endif
+}
+
+/**
+ * The pool shared by the SDK, of SDO_TASK_WORKERS workers and a queue of
+ * SDO_TASK_QUEUE tasks, created on first use and kept for the process.
+ * @return the pool, or NULL to run the tasks inline.
+ */
+sdoTaskPool_t *sdoTaskPoolShared(void)
+{
+#if defined(SDO_TASK_THREADS) && SDO_TASK_WORKERS > 0
+	static sdoTaskPool_t *shared;
+	static bool tried;
+	SDO_MUTEX(shared_lock);
+	sdoTaskPool_t *pool;
+
+	SDO_LOCK(shared_lock);
+	if (!tried) {
+		shared = sdoTaskPoolCreate(SDO_TASK_WORKERS, SDO_TASK_QUEUE);
+		tried = true;
+	}
+	pool = shared;
+	SDO_UNLOCK(shared_lock);
+	return pool;
+#else
+	return NULL;
+#endif
+}
+
+/**
+ * Run a task on a pool. The task runs inline, before this returns, when
+ * the pool is NULL or has no workers, when its queue is full or when it is
+ * being destroyed.
+ * @param pool - the pool, NULL to run the task inline.
+ * @param fn - the task.
+ * @param arg - its argument.
+ * @return the future of the task to join, or NULL if it could not be
+ * allocated, in which case the task has not run.
+ */
+sdoTask_t *sdoTaskSubmit(sdoTaskPool_t *pool, sdoTaskFn_t fn, void *arg)
+{
+	sdoTask_t *task;
+
+	if (!fn)
+		return NULL;
+	task = sdoAlloc(sizeof(sdoTask_t));
+	if (!task)
+		return NULL;
+	task->fn = fn;
+	task->arg = arg;
+
+#if defined(SDO_TASK_THREADS)
+	if (pool && pool->workers && taskSemInit(&task->done)) {
+		taskLock(&pool->lock);
+		if (!pool->stop && pool->count < pool->size) {
+			task->pool = pool;
+			task->refs = 2;
+			task->state = SDO_TASK_QUEUED;
+			pool->ring[(pool->head + pool->count) % pool->size] =
+			    task;
+			pool->count++;
+			taskUnlock(&pool->lock);
+			taskSemPost(&pool->pending);
+			return task;
+		}
+		taskUnlock(&pool->lock);
+		taskSemFree(&task->done);
+	}
+#else
+	(void)pool;
+#endif
+
+	task->state = SDO_TASK_RUNNING;
+	task->result = fn(arg);
+	task->state = SDO_TASK_FINISHED;
+	return task;
+}
+
+/**
+ * Cancel a task which has not started. Its future is still to be joined.
+ * @param task - the future of the task.
+ * @return true if the task will not run, false if it has run or is running.
+ */
+bool sdoTaskCancel(sdoTask_t *task)
+{
+	bool cancelled = false;
+
+	if (!task)
+		return false;
+#if defined(SDO_TASK_THREADS)
+	if (task->pool) {
+		taskLock(&task->pool->lock);
+		if (task->state == SDO_TASK_QUEUED) {
+			task->state = SDO_TASK_CANCELLED;
+			taskSemPost(&task->done);
+			cancelled = true;
+		}
+		taskUnlock(&task->pool->lock);
+	}
+#endif
+	return cancelled;
+}
+
+/**
+ * Check whether a task is over, without waiting.
+ * @param task - the future of the task.
+ * @return true if the task has run or was cancelled.
+ */
+bool sdoTaskDone(sdoTask_t *task)
+{
+	if (!task)
+		return true;
+#if defined(SDO_TASK_THREADS)
+	if (task->pool) {
+		bool done;
+
+		taskLock(&task->pool->lock);
+		done = task->state == SDO_TASK_FINISHED ||
+		       task->state == SDO_TASK_CANCELLED;
+		taskUnlock(&task->pool->lock);
+		return done;
+	}
+#endif
+	return task->state == SDO_TASK_FINISHED;
+}
+
+/**
+ * Wait for a task to be over and free its future.
+ * @param task - the future of the task, may be NULL.
+ * @param result - out, what the task returned, may be NULL.
+ * @return 0 if the task has run, -1 if it was cancelled or task is NULL.
+ */
+int32_t sdoTaskJoin(sdoTask_t *task, int32_t *result)
+{
+	bool ran;
+
+	if (!task)
+		return -1;
+#if defined(SDO_TASK_THREADS)
+	if (task->pool) {
+		sdoTaskPool_t *pool = task->pool;
+
+		taskSemWait(&task->done);
+		taskLock(&pool->lock);
+		ran = task->state == SDO_TASK_FINISHED;
+		if (ran && result)
+			*result = task->result;
+		taskRelease(task);
+		taskUnlock(&pool->lock);
+		return ran ? 0 : -1;
+	}
+#endif
+	ran = task->state == SDO_TASK_FINISHED;
+	if (ran && result)
+		*result = task->result;
+	sdoFree(task);
+	return ran ? 0 : -1;
+}
+
+/**
+ * Let the other ready threads run, for ex: between the slices of a long
+ * computation.
+ */
+void sdoTaskYield(void)
+{
+#if defined(TARGET_OS_LINUX)
+	(void)sched_yield();
+#elif defined(TARGET_OS_MBEDOS)
+	(void)osThreadYield();
+#elif defined(TARGET_OS_FREERTOS)
+	taskYIELD();
+#endif
+}
@@ -10,10 +10,19 @@
 
 #include "util.h"
 #include "network_al.h"
+#include "sdostats.h"
 #include <stdlib.h>
 #include <ctype.h>
 #include "safe_lib.h"
 #include "snprintf_s.h"
+#ifdef STATIC_MEM
+#include "rest_interface.h"
+#include "sdoblockio.h"
+#endif
+
+/* The allocators below, not their tagging macros */
+#undef sdoAlloc
+#undef sdoRealloc
 
 #ifdef TARGET_OS_FREERTOS
 #include "freertos/FreeRTOS.h"
@@ -241,12 +250,496 @@ void hexdump(const char *message, const void *buffer, size_t size)
 	LOG(LOG_DEBUGNTS, "\n");
 }
 
+#if defined(ALLOC_STATS) || defined(LOG_ASYNC)
+/* Source files of each subsystem, by a part of their name, first match */
+static const struct {
+	const char *part;
+	unsigned tag;
+} allocTagFiles[] = {
+    {"sdoblockio", SDO_ALLOC_TAG_BLOCKIO},
+    {"sdotypes", SDO_ALLOC_TAG_TYPES},
+    {"module", SDO_ALLOC_TAG_MODULES},
+    {"sdo_sys", SDO_ALLOC_TAG_MODULES},
+    {"network", SDO_ALLOC_TAG_NETWORK},
+    {"rest_interface", SDO_ALLOC_TAG_NETWORK},
+    {"sdonet", SDO_ALLOC_TAG_NETWORK},
+    {"storage", SDO_ALLOC_TAG_STORAGE},
+    {"platform_utils", SDO_ALLOC_TAG_STORAGE},
+    {"crypto", SDO_ALLOC_TAG_CRYPTO},
+    {"Crypto", SDO_ALLOC_TAG_CRYPTO},
+    {"openssl", SDO_ALLOC_TAG_CRYPTO},
+    {"mbedtls", SDO_ALLOC_TAG_CRYPTO},
+    {"ecdsa", SDO_ALLOC_TAG_CRYPTO},
+    {"tpm20", SDO_ALLOC_TAG_CRYPTO},
+    {"epid", SDO_ALLOC_TAG_CRYPTO},
+    {"sdoKeyExchange", SDO_ALLOC_TAG_CRYPTO},
+    {"sdokeyexchange", SDO_ALLOC_TAG_CRYPTO},
+    {"sdoOvVerify", SDO_ALLOC_TAG_CRYPTO},
+    {"sdoDev", SDO_ALLOC_TAG_CRYPTO},
+    {"sdoHmac", SDO_ALLOC_TAG_CRYPTO},
+    {"sdoAes", SDO_ALLOC_TAG_CRYPTO},
+    {"prot", SDO_ALLOC_TAG_PROT},
+    {"sdocred", SDO_ALLOC_TAG_PROT},
+};
+
+/*
+ * The file of the last allocation or message of the thread, __FILE__ is a
+ * constant
+ */
+static SDO_THREAD_LOCAL const char *allocLastFile;
+static SDO_THREAD_LOCAL unsigned allocLastTag;
+
+static unsigned allocTagOf(const char *file)
+{
+	size_t i;
+
+	if (!file)
+		return SDO_ALLOC_TAG_OTHER;
+	if (file == allocLastFile)
+		return allocLastTag;
+	allocLastFile = file;
+	allocLastTag = SDO_ALLOC_TAG_OTHER;
+	for (i = 0; i < sizeof(allocTagFiles) / sizeof(allocTagFiles[0]); i++) {
+		if (strstr(file, allocTagFiles[i].part)) {
+			allocLastTag = allocTagFiles[i].tag;
+			break;
+		}
+	}
+	return allocLastTag;
+}
+#endif
+
+#ifdef ALLOC_STATS
+/*
+ * Allocation statistics. The live allocations are kept in a hash table,
+ * from their address to their size and tag, so that sdoFree() of memory
+ * not allocated here (by the TLS library, ...) is simply not counted. The
+ * memory of the table itself is not counted either.
+ */
+struct sdoAllocEntry {
+	void *ptr; // NULL for a free slot
+	size_t size;
+	unsigned tag;
+};
+
+static struct sdoAllocEntry *allocTable;
+static size_t allocTableSize; // power of two
+static size_t allocLive;
+static uint64_t allocPhasePeak; // since sdoAllocPhaseBegin()
+static sdoSdkAllocStats allocStats;
+SDO_MUTEX(alloc_lock);
+
+static const char *const allocTagNames[SDO_ALLOC_TAGS] = {
+    [SDO_ALLOC_TAG_OTHER] = "other",     [SDO_ALLOC_TAG_BLOCKIO] = "blockio",
+    [SDO_ALLOC_TAG_TYPES] = "types",     [SDO_ALLOC_TAG_PROT] = "prot",
+    [SDO_ALLOC_TAG_CRYPTO] = "crypto",   [SDO_ALLOC_TAG_NETWORK] = "network",
+    [SDO_ALLOC_TAG_STORAGE] = "storage", [SDO_ALLOC_TAG_MODULES] = "modules",
+    [SDO_ALLOC_TAG_ARENA] = "arena",
+};
+
+static size_t allocSlot(const void *ptr)
+{
+	uint64_t h = ((uint64_t)(uintptr_t)ptr >> 3) * 0x9E3779B97F4A7C15ULL;
+
+	return (size_t)(h >> 32) & (allocTableSize - 1);
+}
+
+/* Keep the table at most half full, false if it cannot grow */
+static bool allocTableGrow(void)
+{
+	struct sdoAllocEntry *old = allocTable;
+	size_t oldSize = allocTableSize, i, j;
+	size_t size = oldSize ? oldSize * 2 : 256;
+
+	if ((allocLive + 1) * 2 <= oldSize)
+		return true;
+	allocTable = calloc(size, sizeof(*allocTable));
+	if (!allocTable) {
+		allocTable = old;
+		return false;
+	}
+	allocTableSize = size;
+	for (i = 0; i < oldSize; i++) {
+		if (!old[i].ptr)
+			continue;
+		for (j = allocSlot(old[i].ptr); allocTable[j].ptr;
+		     j = (j + 1) & (size - 1))
+			;
+		allocTable[j] = old[i];
+	}
+	free(old);
+	return true;
+}
+
+/* Bucket of a size: 0 for 0, then one per power of two */
+static unsigned allocBucket(size_t size)
+{
+	unsigned b = 0;
+
+	while (size && b < SDO_STATS_HIST_BUCKETS - 1) {
+		size >>= 1;
+		b++;
+	}
+	return b;
+}
+
 /**
- * Internal API
+ * Internal API: count a new allocation.
  */
-void *sdoAlloc(int size)
+static void allocTrack(void *ptr, size_t size, unsigned tag)
+{
+	sdoSdkAllocTagStats *t = &allocStats.tag[tag];
+	size_t i;
+
+	if (!ptr)
+		return;
+	SDO_LOCK(alloc_lock);
+	if (!allocTableGrow()) {
+		SDO_UNLOCK(alloc_lock);
+		return;
+	}
+	for (i = allocSlot(ptr); allocTable[i].ptr;
+	     i = (i + 1) & (allocTableSize - 1))
+		;
+	allocTable[i].ptr = ptr;
+	allocTable[i].size = size;
+	allocTable[i].tag = tag;
+	allocLive++;
+
+	t->allocs++;
+	t->bytes += size;
+	t->hist[allocBucket(size)]++;
+	t->curBytes += size;
+	if (t->curBytes > t->peakBytes)
+		t->peakBytes = t->curBytes;
+	allocStats.curBytes += size;
+	if (allocStats.curBytes > allocStats.peakBytes)
+		allocStats.peakBytes = allocStats.curBytes;
+	if (allocStats.curBytes > allocPhasePeak)
+		allocPhasePeak = allocStats.curBytes;
+	SDO_UNLOCK(alloc_lock);
+}
+
+/**
+ * Internal API: count the release of an allocation, if it was counted.
+ */
+static void allocUntrack(void *ptr)
+{
+	sdoSdkAllocTagStats *t;
+	size_t i, j, k;
+
+	if (!ptr)
+		return;
+	SDO_LOCK(alloc_lock);
+	if (!allocTableSize)
+		goto end;
+	for (i = allocSlot(ptr); allocTable[i].ptr != ptr;
+	     i = (i + 1) & (allocTableSize - 1)) {
+		if (!allocTable[i].ptr)
+			goto end;
+	}
+	t = &allocStats.tag[allocTable[i].tag];
+	t->frees++;
+	t->curBytes -= allocTable[i].size;
+	allocStats.curBytes -= allocTable[i].size;
+	allocLive--;
+
+	/* Shift back the entries that probed past the freed slot */
+	for (j = (i + 1) & (allocTableSize - 1); allocTable[j].ptr;
+	     j = (j + 1) & (allocTableSize - 1)) {
+		k = allocSlot(allocTable[j].ptr);
+		if (((j - k) & (allocTableSize - 1)) >=
+		    ((j - i) & (allocTableSize - 1))) {
+			allocTable[i] = allocTable[j];
+			i = j;
+		}
+	}
+	allocTable[i].ptr = NULL;
+end:
+	SDO_UNLOCK(alloc_lock);
+}
+
+/**
+ * Copy out the allocation statistics.
+ * @param stats - out, the statistics.
+ * @return 0 on success, -1 if stats is NULL or with ALLOC_STATS=false.
+ */
+int sdoAllocStatsGet(sdoSdkAllocStats *stats)
+{
+	unsigned tag;
+	int ret;
+
+	if (!stats)
+		return -1;
+	SDO_LOCK(alloc_lock);
+	ret = memcpy_s(stats, sizeof(*stats), &allocStats, sizeof(allocStats));
+	SDO_UNLOCK(alloc_lock);
+	if (ret != 0)
+		return -1;
+	for (tag = 0; tag < SDO_ALLOC_TAGS; tag++)
+		stats->tag[tag].name = allocTagNames[tag];
+	return 0;
+}
+
+/**
+ * Clear the allocation counters. The bytes in use stay, the peaks start
+ * over from them.
+ * @return 0 on success, -1 with ALLOC_STATS=false.
+ */
+int sdoAllocStatsReset(void)
+{
+	sdoSdkAllocTagStats *t;
+	unsigned tag, phase;
+
+	SDO_LOCK(alloc_lock);
+	for (tag = 0; tag < SDO_ALLOC_TAGS; tag++) {
+		t = &allocStats.tag[tag];
+		t->allocs = 0;
+		t->frees = 0;
+		t->bytes = 0;
+		t->peakBytes = t->curBytes;
+		if (memset_s(t->hist, sizeof(t->hist), 0) != 0)
+			LOG(LOG_ERROR, "Memset Failed\n");
+	}
+	allocStats.peakBytes = allocStats.curBytes;
+	for (phase = 0; phase < SDO_ALLOC_PHASES; phase++)
+		allocStats.phasePeak[phase] = 0;
+	allocPhasePeak = allocStats.curBytes;
+	SDO_UNLOCK(alloc_lock);
+	return 0;
+}
+
+/**
+ * Start watching the heap peak of a protocol run. With several runs at
+ * once the peak is that of the whole process.
+ */
+void sdoAllocPhaseBegin(void)
+{
+	SDO_LOCK(alloc_lock);
+	allocPhasePeak = allocStats.curBytes;
+	SDO_UNLOCK(alloc_lock);
+}
+
+/**
+ * Record the heap peak of a protocol run that has ended.
+ * @param phase - the protocol of the run.
+ */
+void sdoAllocPhaseEnd(sdoSdkAllocPhase phase)
+{
+	if (phase >= SDO_ALLOC_PHASES)
+		return;
+	SDO_LOCK(alloc_lock);
+	if (allocPhasePeak > allocStats.phasePeak[phase])
+		allocStats.phasePeak[phase] = allocPhasePeak;
+	SDO_UNLOCK(alloc_lock);
+}
+#else
+#define allocTrack(ptr, size, tag) ((void)0)
+#define allocUntrack(ptr) ((void)0)
+#ifndef LOG_ASYNC
+#define allocTagOf(file) ((void)(file), 0)
+#endif
+
+int sdoAllocStatsGet(sdoSdkAllocStats *stats)
+{
+	(void)stats;
+	return -1;
+}
+
+int sdoAllocStatsReset(void)
+{
+	return -1;
+}
+
+void sdoAllocPhaseBegin(void)
+{
+}
+
+void sdoAllocPhaseEnd(sdoSdkAllocPhase phase)
+{
+	(void)phase;
+}
+#endif
+
+#ifdef STATIC_MEM
+/*
+ * Memory plan of the STATIC_MEM profile: a static pool of blocks per size,
+ * each sized for a TO2 run with the default modules. A request is served
+ * by the smallest free block that fits, so that allocating and freeing
+ * take constant time, the pools cannot fragment and the heap is not used.
+ * The number of blocks of each size can be set at build time.
+ */
+#ifndef SDO_MEM_16
+#define SDO_MEM_16 256 // byte arrays, hashes, list nodes
+#endif
+#ifndef SDO_MEM_32
+#define SDO_MEM_32 192 // nonces, GUIDs, key value pairs
+#endif
+#ifndef SDO_MEM_64
+#define SDO_MEM_64 96 // digests, public key objects, short strings
+#endif
+#ifndef SDO_MEM_128
+#define SDO_MEM_128 48 // service info values, host names
+#endif
+#ifndef SDO_MEM_256
+#define SDO_MEM_256 24 // EC keys and signatures
+#endif
+#ifndef SDO_MEM_512
+#define SDO_MEM_512 16 // RSA keys and signatures
+#endif
+#ifndef SDO_MEM_1024
+#define SDO_MEM_1024 8 // certificates, encoded service info
+#endif
+#ifndef SDO_MEM_2048
+#define SDO_MEM_2048 6 // EPID signatures, credentials
+#endif
+#ifndef SDO_MEM_BLOCKS
+#define SDO_MEM_BLOCKS 6 // message blocks, arena chunks
+#endif
+
+#define SDO_MEM_POOL_BYTES                                                     \
+	(16 * SDO_MEM_16 + 32 * SDO_MEM_32 + 64 * SDO_MEM_64 +                 \
+	 128 * SDO_MEM_128 + 256 * SDO_MEM_256 + 512 * SDO_MEM_512 +           \
+	 1024 * SDO_MEM_1024 + 2048 * SDO_MEM_2048 +                           \
+	 (size_t)SDO_MEM_BLOCK_SIZE * SDO_MEM_BLOCKS)
+
+_Static_assert(SDO_MEM_BLOCK_SIZE > 2048 && SDO_MEM_BLOCK_SIZE % 8 == 0,
+	       "SDO_MEM_BLOCK_SIZE must be a multiple of 8 above 2048");
+_Static_assert(SDO_MEM_BLOCK_SIZE >= REST_MAX_MSGBODY_SIZE + SDO_BLOCKINC,
+	       "SDO_MEM_BLOCK_SIZE cannot hold a message body");
+_Static_assert(SDO_MEM_BLOCKS >= 3,
+	       "SDO_MEM_BLOCKS must hold the SDOR, SDOW and arena blocks");
+
+struct sdoMemPool {
+	size_t size;  // of a block
+	size_t count; // of blocks
+	uint8_t *base;
+	size_t fresh; // blocks handed out at least once
+	void *free;   // blocks given back, linked by their first bytes
+};
+
+static uint64_t memArea[SDO_MEM_POOL_BYTES / sizeof(uint64_t)];
+static struct sdoMemPool memPools[] = {
+    {16, SDO_MEM_16, NULL, 0, NULL},
+    {32, SDO_MEM_32, NULL, 0, NULL},
+    {64, SDO_MEM_64, NULL, 0, NULL},
+    {128, SDO_MEM_128, NULL, 0, NULL},
+    {256, SDO_MEM_256, NULL, 0, NULL},
+    {512, SDO_MEM_512, NULL, 0, NULL},
+    {1024, SDO_MEM_1024, NULL, 0, NULL},
+    {2048, SDO_MEM_2048, NULL, 0, NULL},
+    {SDO_MEM_BLOCK_SIZE, SDO_MEM_BLOCKS, NULL, 0, NULL},
+};
+#define SDO_MEM_POOLS (sizeof(memPools) / sizeof(memPools[0]))
+SDO_MUTEX(mem_lock);
+
+/**
+ * Internal API: the pool ptr was taken from, NULL if it is not of the
+ * pools (memory of a library freed through sdoFree()).
+ */
+static struct sdoMemPool *memPoolOf(const void *ptr)
+{
+	uintptr_t p = (uintptr_t)ptr;
+	size_t i;
+
+	for (i = 0; i < SDO_MEM_POOLS; i++) {
+		if (p >= (uintptr_t)memPools[i].base &&
+		    p < (uintptr_t)memPools[i].base +
+			    memPools[i].size * memPools[i].count)
+			return &memPools[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: take a block of at least size bytes, from the smallest
+ * pool that has one left.
+ */
+static void *memGet(size_t size)
+{
+	struct sdoMemPool *pool;
+	uint8_t *base = (uint8_t *)memArea;
+	void *block = NULL;
+	size_t i;
+
+	SDO_LOCK(mem_lock);
+	if (!memPools[0].base) {
+		for (i = 0; i < SDO_MEM_POOLS; i++) {
+			memPools[i].base = base;
+			base += memPools[i].size * memPools[i].count;
+		}
+	}
+	for (i = 0; i < SDO_MEM_POOLS && !block; i++) {
+		pool = &memPools[i];
+		if (pool->size < size)
+			continue;
+		if (pool->free) {
+			block = pool->free;
+			pool->free = *(void **)block;
+		} else if (pool->fresh < pool->count) {
+			block = pool->base + pool->size * pool->fresh++;
+		}
+	}
+	SDO_UNLOCK(mem_lock);
+	if (!block)
+		LOG(LOG_ERROR, "No pool block of %u bytes left\n",
+		    (unsigned)size);
+	return block;
+}
+
+/**
+ * Internal API: give a block back to its pool.
+ */
+static void memPut(void *ptr)
+{
+	struct sdoMemPool *pool = memPoolOf(ptr);
+
+	if (!pool) {
+		free(ptr);
+		return;
+	}
+	SDO_LOCK(mem_lock);
+	*(void **)ptr = pool->free;
+	pool->free = ptr;
+	SDO_UNLOCK(mem_lock);
+}
+
+/**
+ * Internal API: like realloc(), a block that is large enough is kept.
+ */
+static void *memResize(void *ptr, size_t size)
+{
+	struct sdoMemPool *pool = memPoolOf(ptr);
+	void *block;
+
+	if (!ptr)
+		return memGet(size);
+	if (!pool)
+		return NULL;
+	if (size <= pool->size)
+		return ptr;
+	block = memGet(size);
+	if (!block)
+		return NULL;
+	if (memcpy_s(block, size, ptr, pool->size) != 0) {
+		memPut(block);
+		return NULL;
+	}
+	memPut(ptr);
+	return block;
+}
+#else
+#define memGet(size) malloc(size)
+#define memPut(ptr) free(ptr)
+#define memResize(ptr, size) realloc(ptr, size)
+#endif
+
+/**
+ * Internal API: allocate a zeroed buffer for the subsystem of file.
+ */
+void *sdoAllocAt(int size, const char *file)
 {
-	void *buf = malloc(size);
+	void *buf = memGet(size);
 	if (!buf) {
 		LOG(LOG_ERROR, "sdoAlloc failed to allocate\n");
 		goto end;
@@ -254,13 +747,310 @@ void *sdoAlloc(int size)
 
 	if (memset_s(buf, size, 0) != 0) {
 		LOG(LOG_ERROR, "Memset Failed\n");
-		sdoFree(buf);
+		memPut(buf);
+		buf = NULL;
 		goto end;
 	}
+	allocTrack(buf, (size_t)size, allocTagOf(file));
 
 end:
 	return buf;
 }
+
+/**
+ * Internal API
+ */
+void *sdoAlloc(int size)
+{
+	return sdoAllocAt(size, NULL);
+}
+
+/**
+ * Internal API: resize a buffer for the subsystem of file.
+ */
+void *sdoReallocAt(void *ptr, int size, const char *file)
+{
+	void *buf;
+
+	if (size <= 0)
+		return NULL;
+	/* Before the address can be reused, it is counted again if kept */
+	allocUntrack(ptr);
+	buf = memResize(ptr, size);
+	if (!buf) {
+		LOG(LOG_ERROR, "sdoRealloc failed to allocate\n");
+		buf = ptr;
+		size = 0;
+	}
+	allocTrack(buf, (size_t)size, allocTagOf(file));
+	return size ? buf : NULL;
+}
+
+/**
+ * Internal API
+ */
+void *sdoRealloc(void *ptr, int size)
+{
+	return sdoReallocAt(ptr, size, NULL);
+}
+
+/*
+ * Arena of transient objects, those that do not outlive the protocol
+ * message being processed. They are carved out of a few large chunks and
+ * all released at once by sdoArenaReset(), sdoFree() on them is a no-op.
+ * Each thread has its own arena.
+ */
+#ifndef SDO_ARENA_CHUNK
+#define SDO_ARENA_CHUNK 4096
+#endif
+#define SDO_ARENA_ALIGN 8
+
+struct sdoArenaChunk {
+	struct sdoArenaChunk *next;
+	size_t size; // bytes of data
+	size_t used;
+};
+
+/* Data of a chunk follows its header, aligned */
+#define SDO_ARENA_HDR                                                          \
+	((sizeof(struct sdoArenaChunk) + SDO_ARENA_ALIGN - 1) &                \
+	 ~(size_t)(SDO_ARENA_ALIGN - 1))
+#define SDO_ARENA_DATA(c) ((uint8_t *)(c) + SDO_ARENA_HDR)
+
+#ifdef STATIC_MEM
+_Static_assert(SDO_MEM_BLOCK_SIZE >= SDO_ARENA_HDR + SDO_ARENA_CHUNK,
+	       "SDO_MEM_BLOCK_SIZE cannot hold an arena chunk");
+#endif
+
+/* Chunk being carved first, then dedicated chunks of large objects */
+static SDO_THREAD_LOCAL struct sdoArenaChunk *arenaHead;
+
+/**
+ * Internal API: check if ptr was carved out of the arena.
+ */
+static bool sdoArenaOwns(const void *ptr)
+{
+	const struct sdoArenaChunk *c;
+	uintptr_t p = (uintptr_t)ptr, d;
+
+	for (c = arenaHead; c; c = c->next) {
+		d = (uintptr_t)SDO_ARENA_DATA(c);
+		if (p >= d && p < d + c->size)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * Release memory allocated by sdoAlloc() or sdoAllocTransient(), use
+ * sdoFree() instead.
+ */
+void sdoFreeMem(void *ptr)
+{
+	if (ptr && !sdoArenaOwns(ptr)) {
+		allocUntrack(ptr);
+		memPut(ptr);
+	}
+}
+
+/**
+ * Allocate a zeroed object that is not used past the protocol message
+ * being processed. It is released by the next sdoArenaReset(), while
+ * sdoFree() on it does nothing, so it can go through the usual free
+ * functions.
+ *
+ * @param size - size of the object.
+ * @return pointer to the object, NULL on failure.
+ */
+void *sdoAllocTransient(int size)
+{
+#ifdef ARENA_FALSE
+	return sdoAlloc(size);
+#else
+	struct sdoArenaChunk *c = arenaHead;
+	size_t need, chunkSize;
+	uint8_t *p;
+
+	if (size < 0)
+		return NULL;
+	need = ((size_t)size + SDO_ARENA_ALIGN - 1) &
+	       ~(size_t)(SDO_ARENA_ALIGN - 1);
+	if (!need)
+		need = SDO_ARENA_ALIGN;
+
+	if (!c || c->size - c->used < need) {
+		chunkSize = need > SDO_ARENA_CHUNK ? need : SDO_ARENA_CHUNK;
+		c = memGet(SDO_ARENA_HDR + chunkSize);
+		if (!c)
+			return sdoAlloc(size);
+		allocTrack(c, SDO_ARENA_HDR + chunkSize, SDO_ALLOC_TAG_ARENA);
+		c->size = chunkSize;
+		c->used = 0;
+		if (arenaHead && chunkSize > SDO_ARENA_CHUNK) {
+			/* keep carving the current chunk */
+			c->next = arenaHead->next;
+			arenaHead->next = c;
+		} else {
+			c->next = arenaHead;
+			arenaHead = c;
+		}
+	}
+
+	p = SDO_ARENA_DATA(c) + c->used;
+	c->used += need;
+	if (memset_s(p, need, 0) != 0) {
+		LOG(LOG_ERROR, "Memset Failed\n");
+		return NULL;
+	}
+	return p;
+#endif
+}
+
+/**
+ * Release all transient objects. One chunk is kept for the next message.
+ */
+void sdoArenaReset(void)
+{
+	struct sdoArenaChunk *c = arenaHead, *next, *keep = NULL;
+
+	for (; c; c = next) {
+		next = c->next;
+		if (!keep && c->size == SDO_ARENA_CHUNK) {
+			keep = c;
+			continue;
+		}
+		allocUntrack(c);
+		memPut(c);
+	}
+	if (keep) {
+		keep->next = NULL;
+		keep->used = 0;
+	}
+	arenaHead = keep;
+}
+
+/**
+ * Release all transient objects and the memory of the arena.
+ */
+void sdoArenaRelease(void)
+{
+	sdoArenaReset();
+	if (arenaHead) {
+		allocUntrack(arenaHead);
+		memPut(arenaHead);
+		arenaHead = NULL;
+	}
+}
+
+/*
+ * Scratch slots. The bytes past the leased size, and a guard after each
+ * slot, are filled with SDO_SCRATCH_FILL so that an overrun is found when
+ * the lease is given back.
+ */
+#define SDO_SCRATCH_GUARD 8
+#define SDO_SCRATCH_FILL 0xa5
+
+static SDO_THREAD_LOCAL struct {
+	uint8_t buf[SDO_SCRATCH_SIZE];
+	uint8_t guard[SDO_SCRATCH_GUARD];
+	size_t size; // leased bytes
+	bool leased;
+} scratch[SDO_SCRATCH_SLOTS];
+
+/**
+ * Lease a zeroed scratch buffer, to be given back with sdoScratchRelease().
+ *
+ * @param size - bytes needed, at most SDO_SCRATCH_SIZE.
+ * @return pointer to the buffer, NULL if too large or no slot is free.
+ */
+void *sdoScratchLease(size_t size)
+{
+	int i;
+
+	if (size > SDO_SCRATCH_SIZE) {
+		LOG(LOG_ERROR, "Scratch lease of %u bytes too large\n",
+		    (unsigned)size);
+		return NULL;
+	}
+	for (i = 0; i < SDO_SCRATCH_SLOTS; i++) {
+		if (scratch[i].leased)
+			continue;
+		if (memset_s(scratch[i].buf, sizeof(scratch[i].buf),
+			     SDO_SCRATCH_FILL) != 0 ||
+		    memset_s(scratch[i].guard, sizeof(scratch[i].guard),
+			     SDO_SCRATCH_FILL) != 0 ||
+		    (size && memset_s(scratch[i].buf, size, 0) != 0)) {
+			LOG(LOG_ERROR, "Memset Failed\n");
+			return NULL;
+		}
+		scratch[i].size = size;
+		scratch[i].leased = true;
+		return scratch[i].buf;
+	}
+	LOG(LOG_ERROR, "No scratch buffer free\n");
+	return NULL;
+}
+
+/**
+ * Give back a buffer of sdoScratchLease(). NULL is ignored.
+ *
+ * @param buf - buffer leased.
+ */
+void sdoScratchRelease(void *buf)
+{
+	size_t j;
+	int i;
+
+	if (!buf)
+		return;
+	for (i = 0; i < SDO_SCRATCH_SLOTS; i++) {
+		if (buf == scratch[i].buf)
+			break;
+	}
+	if (i == SDO_SCRATCH_SLOTS || !scratch[i].leased) {
+		LOG(LOG_ERROR, "Release of a scratch buffer not leased\n");
+		return;
+	}
+	for (j = scratch[i].size; j < SDO_SCRATCH_SIZE + SDO_SCRATCH_GUARD;
+	     j++) {
+		if ((j < SDO_SCRATCH_SIZE
+			 ? scratch[i].buf[j]
+			 : scratch[i].guard[j - SDO_SCRATCH_SIZE]) !=
+		    SDO_SCRATCH_FILL) {
+			LOG(LOG_ERROR, "Scratch buffer overrun past %u bytes\n",
+			    (unsigned)scratch[i].size);
+			break;
+		}
+	}
+	scratch[i].leased = false;
+}
+
+#if defined(TARGET_OS_LINUX)
+/*
+ * The time of day of a second, as HH:MM:SS. The string is made once per
+ * second and thread, all the messages of that second share it.
+ */
+static const char *timeOfDay(time_t sec)
+{
+	static SDO_THREAD_LOCAL time_t lastSec = -1;
+	static SDO_THREAD_LOCAL char hms[TIMESTAMP_LEN];
+	struct tm t;
+
+	if (sec == lastSec)
+		return hms;
+	if (localtime_r(&sec, &t) == NULL) {
+		LOG(LOG_ERROR, "localtime_r Failed");
+		return NULL;
+	}
+	if (strftime(hms, sizeof(hms), "%T", &t) == 0) {
+		LOG(LOG_ERROR, "strftime Failed");
+		return NULL;
+	}
+	lastSec = sec;
+	return hms;
+}
+#endif
+
 /**
  * Internal API
  */
@@ -282,28 +1072,539 @@ int print_timestamp(void)
 #endif
 
 #if defined(TARGET_OS_LINUX)
-	struct tm t;
-	int ret;
 	struct timespec ts;
-	char buf[TIMESTAMP_LEN];
+	const char *hms;
 
 	clock_gettime(CLOCK_REALTIME, &ts);
-
-	if (localtime_r(&(ts.tv_sec), &t) == NULL) {
-		LOG(LOG_ERROR, "localtime_r Failed");
+	hms = timeOfDay(ts.tv_sec);
+	if (!hms)
 		return 1;
+
+	printf("%s:%3lu ", hms, ts.tv_nsec / 1000000);
+
+	return 0;
+#endif
+	return 0;
+}
+
+#ifdef LOG_ASYNC
+#include <stdarg.h>
+
+#if LOG_ASYNC_SLOTS & (LOG_ASYNC_SLOTS - 1)
+#error LOG_ASYNC_SLOTS must be a power of two
+#endif
+#define LOG_ASYNC_ARGS 448 // bytes of the arguments of a record
+#define LOG_ASYNC_LINE 2048
+#define LOG_ASYNC_IDLE_MS 10
+
+/*
+ * A message in the ring buffer. The arguments are those of the conversions
+ * of fmt, in order: an integer, a pointer or a double on 8 bytes, a string
+ * copied with its NUL (cut to what is left of the record). seq is that of
+ * the ring below.
+ */
+struct sdoLogRecord {
+	uint64_t seq;
+	const char *file;
+	const char *fmt;
+	int32_t level;
+	int32_t line;
+	int64_t sec; // of the LOG_DEBUG messages, that have a time stamp
+	uint32_t ms;
+	uint16_t len; // bytes of args
+	bool cut;     // the last arguments did not fit
+	uint8_t args[LOG_ASYNC_ARGS];
+};
+
+/*
+ * Bounded ring of records, taken by any thread without a lock and drained
+ * by one at a time. A record is free for the producer of position pos when
+ * its seq is pos, and ready for the drainer when it is pos + 1; once
+ * printed it is given to the producer of the next lap, pos + slots.
+ * Messages are dropped, and counted, while the ring is full.
+ */
+static struct sdoLogRecord logRing[LOG_ASYNC_SLOTS];
+static uint64_t logTail; // next position to take, of the producers
+static uint64_t logHead; // next position to print, under log_lock
+static uint64_t logDropped;
+static pthread_once_t logOnce = PTHREAD_ONCE_INIT;
+SDO_MUTEX(log_lock);
+
+/* Level of the messages of each subsystem, up to the LOG_LEVEL of the build */
+static int logLevels[SDO_ALLOC_TAGS] = {[0 ... SDO_ALLOC_TAGS - 1] =
+					    LOG_LEVEL};
+
+/* A conversion of a format, from its '%' */
+struct sdoLogSpec {
+	const char *flags;
+	size_t nflags;
+	const char *width; // digits, "*" or NULL
+	size_t nwidth;
+	const char *prec; // after the '.', digits, "*" or NULL
+	size_t nprec;
+	char length; // 'H' for hh, 'h', 'l', 'L' for ll, 'j', 'z', 't', 'D'
+		     // for the L of long double or 0
+	char conv;   // 0 at the end of the format
+};
+
+static const char *logSpecParse(const char *p, struct sdoLogSpec *sp)
+{
+	memset(sp, 0, sizeof(*sp));
+	sp->flags = ++p;
+	while (*p && strchr("-+ #0'", *p))
+		p++;
+	sp->nflags = p - sp->flags;
+	if (*p == '*' || isdigit((unsigned char)*p)) {
+		sp->width = p;
+		if (*p == '*')
+			p++;
+		else
+			while (isdigit((unsigned char)*p))
+				p++;
+		sp->nwidth = p - sp->width;
+	}
+	if (*p == '.') {
+		sp->prec = ++p;
+		if (*p == '*')
+			p++;
+		else
+			while (isdigit((unsigned char)*p))
+				p++;
+		sp->nprec = p - sp->prec;
 	}
+	switch (*p) {
+	case 'h':
+		sp->length = p[1] == 'h' ? 'H' : 'h';
+		p += p[1] == 'h' ? 2 : 1;
+		break;
+	case 'l':
+		sp->length = p[1] == 'l' ? 'L' : 'l';
+		p += p[1] == 'l' ? 2 : 1;
+		break;
+	case 'L':
+		sp->length = 'D';
+		p++;
+		break;
+	case 'j':
+	case 'z':
+	case 't':
+		sp->length = *p++;
+		break;
+	}
+	sp->conv = *p;
+	return *p ? p + 1 : p;
+}
 
-	ret = strftime(buf, sizeof(buf), "%T", &t);
+static bool logArgPut(struct sdoLogRecord *r, const void *v, size_t n)
+{
+	if (r->cut || n > sizeof(r->args) - r->len) {
+		r->cut = true;
+		return false;
+	}
+	memcpy(r->args + r->len, v, n);
+	r->len += n;
+	return true;
+}
 
-	if (ret == 0) {
-		LOG(LOG_ERROR, "strftime Failed");
-		return 1;
+static void logArgStr(struct sdoLogRecord *r, const char *s)
+{
+	size_t n = strnlen(s ? s : "(null)", sizeof(r->args));
+
+	if (r->cut || r->len == sizeof(r->args)) {
+		r->cut = true;
+		return;
+	}
+	if (n >= sizeof(r->args) - r->len) {
+		n = sizeof(r->args) - r->len - 1;
+		r->cut = true;
 	}
+	memcpy(r->args + r->len, s ? s : "(null)", n);
+	r->args[r->len + n] = '\0';
+	r->len += n + 1;
+}
 
-	printf("%s:%3lu ", buf, ts.tv_nsec / 1000000);
+/* Take an integer argument of spec as its printf would see it */
+static int64_t logArgInt(const struct sdoLogSpec *sp, va_list *ap)
+{
+	bool u = sp->conv != 'd' && sp->conv != 'i';
 
+	switch (sp->length) {
+	case 'H':
+		return u ? (unsigned char)va_arg(*ap, int)
+			 : (signed char)va_arg(*ap, int);
+	case 'h':
+		return u ? (unsigned short)va_arg(*ap, int)
+			 : (short)va_arg(*ap, int);
+	case 'l':
+		return u ? (int64_t)va_arg(*ap, unsigned long)
+			 : va_arg(*ap, long);
+	case 'L':
+		return u ? (int64_t)va_arg(*ap, unsigned long long)
+			 : va_arg(*ap, long long);
+	case 'j':
+		return va_arg(*ap, intmax_t);
+	case 'z':
+		return (int64_t)va_arg(*ap, size_t);
+	case 't':
+		return va_arg(*ap, ptrdiff_t);
+	default:
+		return u ? (int64_t)va_arg(*ap, unsigned int)
+			 : va_arg(*ap, int);
+	}
+}
+
+static void *logDrainer(void *arg)
+{
+	(void)arg;
+	for (;;) {
+		sdoLogFlush();
+		sdoSleepMs(LOG_ASYNC_IDLE_MS);
+	}
+	return NULL;
+}
+
+static void logStart(void)
+{
+	pthread_t t;
+	uint64_t i;
+
+	for (i = 0; i < LOG_ASYNC_SLOTS; i++)
+		logRing[i].seq = i;
+	if (pthread_create(&t, NULL, logDrainer, NULL) == 0)
+		pthread_detach(t);
+	/* without the thread the messages are printed at exit */
+	atexit(sdoLogFlush);
+}
+
+/**
+ * Tell whether a message is to be logged, by the level of the subsystem of
+ * its file.
+ * @param level - of the message.
+ * @param file - __FILE__ of the message.
+ * @return true if so.
+ */
+bool sdoLogOn(int level, const char *file)
+{
+	return level <= __atomic_load_n(&logLevels[allocTagOf(file)],
+					__ATOMIC_RELAXED);
+}
+
+/**
+ * Put a message in the ring buffer, as its format and arguments. It is
+ * dropped if the ring is full.
+ * @param level - of the message.
+ * @param file - __FILE__ of the message.
+ * @param line - __LINE__ of the message.
+ * @param fmt - printf format, a literal.
+ */
+void sdoLogPut(int level, const char *file, int line, const char *fmt, ...)
+{
+	struct sdoLogRecord *r;
+	struct sdoLogSpec sp;
+	struct timespec ts;
+	const char *p = fmt;
+	uint64_t pos, seq;
+	int64_t i;
+	double d;
+	va_list ap;
+
+	pthread_once(&logOnce, logStart);
+	pos = __atomic_load_n(&logTail, __ATOMIC_RELAXED);
+	for (;;) {
+		r = &logRing[pos & (LOG_ASYNC_SLOTS - 1)];
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&logTail, &pos, pos + 1,
+							true, __ATOMIC_RELAXED,
+							__ATOMIC_RELAXED))
+				break;
+		} else if ((int64_t)(seq - pos) < 0) {
+			__atomic_fetch_add(&logDropped, 1, __ATOMIC_RELAXED);
+			return;
+		} else {
+			pos = __atomic_load_n(&logTail, __ATOMIC_RELAXED);
+		}
+	}
+
+	r->file = file;
+	r->fmt = fmt;
+	r->level = level;
+	r->line = line;
+	r->len = 0;
+	r->cut = false;
+	if (level == LOG_DEBUG) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+		r->sec = ts.tv_sec;
+		r->ms = ts.tv_nsec / 1000000;
+	}
+
+	va_start(ap, fmt);
+	while (!r->cut && (p = strchr(p, '%')) != NULL) {
+		p = logSpecParse(p, &sp);
+		if (sp.width && *sp.width == '*') {
+			i = va_arg(ap, int);
+			logArgPut(r, &i, sizeof(i));
+		}
+		if (sp.prec && *sp.prec == '*') {
+			i = va_arg(ap, int);
+			logArgPut(r, &i, sizeof(i));
+		}
+		switch (sp.conv) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+		case 'c':
+			i = logArgInt(&sp, &ap);
+			logArgPut(r, &i, sizeof(i));
+			break;
+		case 's':
+			logArgStr(r, va_arg(ap, const char *));
+			break;
+		case 'p':
+			i = (int64_t)(uintptr_t)va_arg(ap, void *);
+			logArgPut(r, &i, sizeof(i));
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			d = sp.length == 'D' ? (double)va_arg(ap, long double)
+					     : va_arg(ap, double);
+			logArgPut(r, &d, sizeof(d));
+			break;
+		case 'n':
+			(void)va_arg(ap, void *);
+			break;
+		case '\0':
+			p = NULL;
+			break;
+		}
+		if (!p)
+			break;
+	}
+	va_end(ap);
+
+	__atomic_store_n(&r->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+/* Append to the line being printed, cut at its end */
+static void logOut(char *out, size_t *n, const char *fmt, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void logOut(char *out, size_t *n, const char *fmt, ...)
+{
+	va_list ap;
+	int ret;
+
+	if (*n >= LOG_ASYNC_LINE - 1)
+		return;
+	va_start(ap, fmt);
+	ret = vsnprintf(out + *n, LOG_ASYNC_LINE - *n, fmt, ap);
+	va_end(ap);
+	if (ret > 0)
+		*n += (size_t)ret < LOG_ASYNC_LINE - *n ? (size_t)ret
+						      : LOG_ASYNC_LINE - 1 - *n;
+}
+
+/* Take an 8 byte argument of r, false if it was not put */
+static bool logArgGet(const struct sdoLogRecord *r, size_t *at, void *v)
+{
+	if (*at + 8 > r->len)
+		return false;
+	memcpy(v, r->args + *at, 8);
+	*at += 8;
+	return true;
+}
+
+/*
+ * Print a record. Each conversion is printed on its own by a format of
+ * its flags, width and precision, the length taken to that of the stored
+ * argument. The message ends in "..." where its arguments were cut.
+ */
+static void logPrint(const struct sdoLogRecord *r, char *out)
+{
+	struct sdoLogSpec sp;
+	const char *p = r->fmt, *q, *hms;
+	const char *str;
+	char spec[64];
+	size_t n = 0, at = 0, k;
+	int64_t i = 0, w = 0, pr = 0;
+	double d = 0;
+	bool ok = true;
+
+	if (r->level == LOG_ERROR)
+		logOut(out, &n, "ERROR:[%s:%d] ", r->file, r->line);
+	if (r->level == LOG_DEBUG) {
+		hms = timeOfDay((time_t)r->sec);
+		if (hms)
+			logOut(out, &n, "%s:%3u ", hms, r->ms);
+		else
+			logOut(out, &n, "TimeStamp ERROR\n");
+	}
+
+	while (ok && (q = strchr(p, '%')) != NULL) {
+		logOut(out, &n, "%.*s", (int)(q - p), p);
+		p = logSpecParse(q, &sp);
+		if (sp.conv == '%')
+			logOut(out, &n, "%%");
+		if (sp.conv == '%' || sp.conv == '\0' || sp.conv == 'n')
+			continue;
+		if ((sp.width && *sp.width == '*' && !logArgGet(r, &at, &w)) ||
+		    (sp.prec && *sp.prec == '*' && !logArgGet(r, &at, &pr))) {
+			ok = false;
+			break;
+		}
+
+		/* %, flags, width and precision, then length and conversion */
+		k = (size_t)snprintf(spec, sizeof(spec), "%%%.*s",
+				     (int)sp.nflags, sp.flags);
+		if (sp.width && *sp.width == '*')
+			k += (size_t)snprintf(spec + k, sizeof(spec) - k, "%d",
+					      (int)w);
+		else if (sp.width)
+			k += (size_t)snprintf(spec + k, sizeof(spec) - k,
+					      "%.*s", (int)sp.nwidth, sp.width);
+		if (sp.prec && *sp.prec == '*')
+			k += (size_t)snprintf(spec + k, sizeof(spec) - k,
+					      ".%d", (int)pr);
+		else if (sp.prec)
+			k += (size_t)snprintf(spec + k, sizeof(spec) - k,
+					      ".%.*s", (int)sp.nprec, sp.prec);
+		if (k + 4 > sizeof(spec)) {
+			ok = false;
+			break;
+		}
+
+		switch (sp.conv) {
+		case 's':
+			ok = at < r->len;
+			if (!ok)
+				break;
+			str = (const char *)r->args + at;
+			at += strlen(str) + 1;
+			spec[k++] = 's';
+			spec[k] = '\0';
+			logOut(out, &n, spec, str);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			ok = logArgGet(r, &at, &d);
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			if (ok)
+				logOut(out, &n, spec, d);
+			break;
+		case 'c':
+		case 'p':
+			ok = logArgGet(r, &at, &i);
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			if (ok && sp.conv == 'c')
+				logOut(out, &n, spec, (int)i);
+			else if (ok)
+				logOut(out, &n, spec, (void *)(uintptr_t)i);
+			break;
+		default:
+			ok = logArgGet(r, &at, &i);
+			spec[k++] = 'l';
+			spec[k++] = 'l';
+			spec[k++] = sp.conv;
+			spec[k] = '\0';
+			if (ok)
+				logOut(out, &n, spec, (long long)i);
+			break;
+		}
+	}
+	if (ok)
+		logOut(out, &n, "%s", p);
+	else
+		logOut(out, &n, "...\n");
+	fwrite(out, 1, n, stdout);
+}
+
+/* Print the records that are ready, under log_lock */
+static size_t logDrain(char *out)
+{
+	struct sdoLogRecord *r;
+	size_t printed = 0;
+
+	for (;;) {
+		r = &logRing[logHead & (LOG_ASYNC_SLOTS - 1)];
+		if (__atomic_load_n(&r->seq, __ATOMIC_ACQUIRE) != logHead + 1)
+			break;
+		logPrint(r, out);
+		__atomic_store_n(&r->seq, logHead + LOG_ASYNC_SLOTS,
+				 __ATOMIC_RELEASE);
+		logHead++;
+		printed++;
+	}
+	return printed;
+}
+
+/**
+ * Print the messages in the ring buffer, in the order they were taken. A
+ * message still being put, and those after it, are left for the next time.
+ */
+void sdoLogFlush(void)
+{
+	static char out[LOG_ASYNC_LINE];
+	uint64_t dropped;
+	size_t printed;
+
+	SDO_LOCK(log_lock);
+	printed = logDrain(out);
+	dropped = __atomic_exchange_n(&logDropped, 0, __ATOMIC_RELAXED);
+	if (dropped)
+		printf("ERROR: %llu log messages dropped, the ring was full\n",
+		       (unsigned long long)dropped);
+	if (printed || dropped)
+		fflush(stdout);
+	SDO_UNLOCK(log_lock);
+}
+
+/**
+ * Set the level of the messages of a subsystem, those above it are
+ * dropped when they are logged. It cannot go past the LOG_LEVEL of the
+ * build.
+ * @param tag - the subsystem, a sdoSdkAllocTag, or SDO_ALLOC_TAGS for all.
+ * @param level - LOG_ERROR to LOG_DEBUGNTS, -1 for none.
+ * @return 0 on success, -1 for an unknown subsystem.
+ */
+int sdoLogSetLevel(int tag, int level)
+{
+	int i;
+
+	if (tag < 0 || tag > SDO_ALLOC_TAGS)
+		return -1;
+	for (i = 0; i < SDO_ALLOC_TAGS; i++) {
+		if (tag == SDO_ALLOC_TAGS || tag == i)
+			__atomic_store_n(&logLevels[i], level,
+					 __ATOMIC_RELAXED);
+	}
 	return 0;
-#endif
-	return 0;
 }
+#else
+int sdoLogSetLevel(int tag, int level)
+{
+	(void)tag;
+	(void)level;
+	return -1;
+}
+
+void sdoLogFlush(void)
+{
+}
+#endif
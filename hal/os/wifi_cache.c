@@ -0,0 +1,186 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Cache of the Wi-Fi connection state, for the fast reconnect of
+ * sdoWifiInit (see wifi_init.h).
+ *
+ * The state is a record of fixed layout in a secure blob, the PMK it holds
+ * being a secret of the network. It is only written when it changed, as a
+ * device reconnecting to the same access point would otherwise wear its
+ * flash at every start.
+ */
+
+#include "util.h"
+#include "storage_al.h"
+#include "wifi_init.h"
+#include "safe_lib.h"
+
+#define WIFI_CACHE_VERSION 1
+#define WIFI_CACHE_PMK 0x1
+#define WIFI_CACHE_PMKID 0x2
+#define WIFI_CACHE_LEASE 0x4
+/* version, flags, SSID length and the fields of sdoWifiCache_t */
+#define WIFI_CACHE_LEN                                                         \
+	(3 + WIFI_SSID_MAX + WIFI_BSSID_LEN + 1 + WIFI_PMK_LEN +               \
+	 WIFI_PMKID_LEN + 5 * 4)
+
+static bool wifiCachePut(uint8_t *rec, size_t *off, const void *src,
+			 size_t len)
+{
+	if (memcpy_s(rec + *off, WIFI_CACHE_LEN - *off, src, len) != 0)
+		return false;
+	*off += len;
+	return true;
+}
+
+static bool wifiCacheGet(const uint8_t *rec, size_t *off, void *dst,
+			 size_t len)
+{
+	if (memcpy_s(dst, len, rec + *off, len) != 0)
+		return false;
+	*off += len;
+	return true;
+}
+
+static bool wifiCacheEncode(const sdoWifiCache_t *cache, uint8_t *rec)
+{
+	size_t ssidLen = strnlen_s(cache->ssid, sizeof(cache->ssid));
+	size_t off = 3;
+
+	if (!ssidLen || ssidLen > WIFI_SSID_MAX)
+		return false;
+	if (memset_s(rec, WIFI_CACHE_LEN, 0) != 0)
+		return false;
+	rec[0] = WIFI_CACHE_VERSION;
+	rec[1] = (cache->pmkValid ? WIFI_CACHE_PMK : 0) |
+		 (cache->pmkidValid ? WIFI_CACHE_PMKID : 0) |
+		 (cache->leaseValid ? WIFI_CACHE_LEASE : 0);
+	rec[2] = (uint8_t)ssidLen;
+
+	if (!wifiCachePut(rec, &off, cache->ssid, ssidLen))
+		return false;
+	/* the SSID field is padded to its maximum */
+	off = 3 + WIFI_SSID_MAX;
+	return wifiCachePut(rec, &off, cache->bssid, WIFI_BSSID_LEN) &&
+	       wifiCachePut(rec, &off, &cache->channel, 1) &&
+	       wifiCachePut(rec, &off, cache->pmk, WIFI_PMK_LEN) &&
+	       wifiCachePut(rec, &off, cache->pmkid, WIFI_PMKID_LEN) &&
+	       wifiCachePut(rec, &off, cache->ip, 4) &&
+	       wifiCachePut(rec, &off, cache->netmask, 4) &&
+	       wifiCachePut(rec, &off, cache->gateway, 4) &&
+	       wifiCachePut(rec, &off, cache->dns, 4) &&
+	       wifiCachePut(rec, &off, cache->dhcpServer, 4);
+}
+
+static bool wifiCacheDecode(const uint8_t *rec, sdoWifiCache_t *cache)
+{
+	size_t off = 3;
+
+	if (rec[0] != WIFI_CACHE_VERSION || !rec[2] || rec[2] > WIFI_SSID_MAX)
+		return false;
+	if (memset_s(cache, sizeof(*cache), 0) != 0)
+		return false;
+	cache->pmkValid = rec[1] & WIFI_CACHE_PMK;
+	cache->pmkidValid = rec[1] & WIFI_CACHE_PMKID;
+	cache->leaseValid = rec[1] & WIFI_CACHE_LEASE;
+
+	if (!wifiCacheGet(rec, &off, cache->ssid, rec[2]))
+		return false;
+	/* the SSID field is padded to its maximum */
+	off = 3 + WIFI_SSID_MAX;
+	return wifiCacheGet(rec, &off, cache->bssid, WIFI_BSSID_LEN) &&
+	       wifiCacheGet(rec, &off, &cache->channel, 1) &&
+	       wifiCacheGet(rec, &off, cache->pmk, WIFI_PMK_LEN) &&
+	       wifiCacheGet(rec, &off, cache->pmkid, WIFI_PMKID_LEN) &&
+	       wifiCacheGet(rec, &off, cache->ip, 4) &&
+	       wifiCacheGet(rec, &off, cache->netmask, 4) &&
+	       wifiCacheGet(rec, &off, cache->gateway, 4) &&
+	       wifiCacheGet(rec, &off, cache->dns, 4) &&
+	       wifiCacheGet(rec, &off, cache->dhcpServer, 4);
+}
+
+static bool wifiCacheRead(uint8_t *rec)
+{
+	if (sdoBlobSize(WIFI_CACHE_BLOB, SDO_SDK_SECURE_DATA) !=
+	    WIFI_CACHE_LEN)
+		return false;
+	return sdoBlobRead(WIFI_CACHE_BLOB, SDO_SDK_SECURE_DATA, rec,
+			   WIFI_CACHE_LEN) == WIFI_CACHE_LEN;
+}
+
+/**
+ * Load the connection state of a network.
+ * @param ssid - the network to join, NULL for the last one joined.
+ * @param cache - out, its state.
+ * @return 0 on success, -1 if there is no state of that network.
+ */
+int32_t sdoWifiCacheLoad(const char *ssid, sdoWifiCache_t *cache)
+{
+	uint8_t rec[WIFI_CACHE_LEN];
+	int32_t ret = -1;
+	int res = 1;
+
+	if (!cache || !wifiCacheRead(rec) || !wifiCacheDecode(rec, cache))
+		goto end;
+	if (ssid && (strcmp_s(cache->ssid, sizeof(cache->ssid), ssid,
+			      &res) != 0 ||
+		     res != 0)) {
+		LOG(LOG_DEBUG, "Wi-Fi state cached of another network\n");
+		goto end;
+	}
+	ret = 0;
+end:
+	(void)memset_s(rec, sizeof(rec), 0);
+	return ret;
+}
+
+/**
+ * Save the connection state of the network joined, if it changed.
+ * @param cache - its state.
+ * @return 0 on success, -1 on failure.
+ */
+int32_t sdoWifiCacheSave(const sdoWifiCache_t *cache)
+{
+	uint8_t rec[WIFI_CACHE_LEN];
+	uint8_t old[WIFI_CACHE_LEN];
+	int32_t ret = -1;
+	int diff = 1;
+
+	if (!cache || !wifiCacheEncode(cache, rec))
+		goto end;
+	if (wifiCacheRead(old) &&
+	    memcmp_s(old, sizeof(old), rec, sizeof(rec), &diff) == 0 &&
+	    diff == 0) {
+		ret = 0;
+		goto end;
+	}
+	if (sdoBlobWrite(WIFI_CACHE_BLOB, SDO_SDK_SECURE_DATA, rec,
+			 sizeof(rec)) == -1) {
+		LOG(LOG_ERROR, "Wi-Fi state not saved\n");
+		goto end;
+	}
+	ret = 0;
+end:
+	(void)memset_s(rec, sizeof(rec), 0);
+	(void)memset_s(old, sizeof(old), 0);
+	return ret;
+}
+
+/**
+ * Forget the connection state, after a fast reconnect failed.
+ */
+void sdoWifiCacheDrop(void)
+{
+	uint8_t rec[WIFI_CACHE_LEN] = {0};
+
+	/* A record of no version is no state */
+	if (wifiCacheRead(rec) && rec[0] &&
+	    (memset_s(rec, sizeof(rec), 0) != 0 ||
+	     sdoBlobWrite(WIFI_CACHE_BLOB, SDO_SDK_SECURE_DATA, rec,
+			  sizeof(rec)) == -1))
+		LOG(LOG_ERROR, "Wi-Fi state not dropped\n");
+}
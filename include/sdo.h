@@ -30,7 +30,8 @@ typedef enum {
 	SDO_RESALE_NOT_READY,
 	SDO_WARNING,
 	SDO_ERROR,
-	SDO_ABORT
+	SDO_ABORT,
+	SDO_RESUME // time budget used up, see sdoSdkRunWithBudget
 } sdoSdkStatus;
 
 typedef enum {
@@ -43,6 +44,24 @@ typedef enum {
 
 sdoSdkStatus sdoSdkRun(void);
 
+// sdoSdkRun within a time budget, SDO_RESUME if it stopped for it
+sdoSdkStatus sdoSdkRunWithBudget(uint32_t budgetMs);
+
+// progress of a run driven by sdoSdkStep
+typedef enum {
+	SDO_STEP_DONE,       // run is over
+	SDO_STEP_WAIT_READ,  // step when sdoSdkStepFd() is readable
+	SDO_STEP_WAIT_WRITE, // step when sdoSdkStepFd() is writable
+	SDO_STEP_WAIT_TIME,  // step after sdoSdkStepTimeout() ms
+	SDO_STEP_AGAIN       // step again, after the application's turn
+} sdoSdkStepState;
+
+sdoSdkStepState sdoSdkStep(sdoSdkStatus *status);
+
+int sdoSdkStepFd(void);
+
+uint32_t sdoSdkStepTimeout(void);
+
 sdoSdkStatus sdoSdkResale(void);
 
 sdoSdkDeviceState sdoSdkGetStatus(void);
@@ -54,6 +73,239 @@ sdoSdkStatus sdoSdkInit(sdoSdkErrorCB errorHandlingCallback,
 			uint32_t numModules,
 			sdoSdkServiceInfoModule *moduleInformation);
 
+// timeouts of the process: they apply to all SDK instances (sdoSdkCreate)
+sdoSdkStatus sdoSdkSetTimeouts(uint32_t connectMs, uint32_t ioMs,
+			       uint32_t phaseSec);
+
+sdoSdkStatus sdoSdkSetRetryPolicy(uint32_t baseMs, uint32_t capMs,
+				  uint32_t maxRetries,
+				  uint32_t breakerThreshold,
+				  uint32_t breakerCooldownSec);
+
+// why the SDK waits, see sdoSdkSetSleepCallback
+typedef enum {
+	SDO_SLEEP_BACKOFF, // before retrying a connection or message
+	SDO_SLEEP_DELAY	   // before the next protocol, or retrying one
+} sdoSdkSleepReason;
+
+// callback sleeping ms with no connection open, for ex: in deep sleep with
+// the radio off; returns the ms left to sleep if it woke early, else 0
+typedef uint32_t (*sdoSdkSleepCB)(uint32_t ms, sdoSdkSleepReason reason);
+
+sdoSdkStatus sdoSdkSetSleepCallback(sdoSdkSleepCB sleepCallback,
+				    uint32_t wakeWindowMs);
+
+// callback for credentials written in the background
+typedef void (*sdoSdkCredWriteCB)(sdoSdkStatus status);
+
+sdoSdkStatus sdoSdkSetCredWriteCallback(sdoSdkCredWriteCB credWriteCallback);
+
+sdoSdkStatus sdoSdkCredSync(void);
+
+// callback between the slices of a long ECC operation (ECC_RESTARTABLE),
+// for ex: to feed a watchdog
+typedef void (*sdoSdkYieldCB)(void);
+
+sdoSdkStatus sdoSdkSetYieldCallback(sdoSdkYieldCB yieldCallback);
+
+// callback for each message exchanged with a server: type of the message
+// sent and of the response, time from sending to the response in ms, sizes;
+// one for the process, called for the messages of all SDK instances
+typedef void (*sdoSdkMsgCB)(int msgType, int respType, uint32_t elapsedMs,
+			    uint32_t txBytes, uint32_t rxBytes);
+
+sdoSdkStatus sdoSdkSetMsgCallback(sdoSdkMsgCB msgCallback);
+
+// Statistics of the protocol runs, see sdoSdkGetStats
+#define SDO_STATS_MSG_FIRST 10 // DI.AppStart
+#define SDO_STATS_MSG_LAST 51  // TO2.Done2
+#define SDO_STATS_MSG_TYPES (SDO_STATS_MSG_LAST - SDO_STATS_MSG_FIRST + 1)
+#define SDO_STATS_HIST_BUCKETS 20 // bucket b counts [2^(b-1), 2^b) ms
+#define SDO_STATS_RV_ENTRIES 8
+
+// Statistics of the messages of one type sent by the device
+typedef struct {
+	uint32_t count;	   // exchanges, answered or not
+	uint32_t errors;   // answered by an error message, or not at all
+	uint32_t retries;  // sent again over a new connection
+	uint64_t txBytes;  // message bodies sent
+	uint64_t rxBytes;  // response bodies received
+	uint64_t waitUs;   // from sending to having the whole response
+	uint64_t parseUs;  // handling the response, up to the next message
+	uint64_t cryptoUs; // of parseUs, signing, verifying and key exchange
+	uint32_t waitHist[SDO_STATS_HIST_BUCKETS]; // of waitUs
+} sdoSdkMsgStats;
+
+// Statistics of the runs of one protocol
+typedef struct {
+	uint32_t runs;
+	uint32_t failures;
+	uint32_t lastMs; // duration of the last run
+	uint64_t totalMs;
+	uint32_t hist[SDO_STATS_HIST_BUCKETS];
+} sdoSdkPhaseStats;
+
+typedef struct {
+	sdoSdkMsgStats msg[SDO_STATS_MSG_TYPES]; // [type - SDO_STATS_MSG_FIRST]
+	sdoSdkPhaseStats di;
+	sdoSdkPhaseStats to1;
+	sdoSdkPhaseStats to2;
+	uint32_t rvIndex; // rendezvous entry of the last TO1, from 1, 0 none
+	uint32_t rvRuns[SDO_STATS_RV_ENTRIES];	   // TO1 runs per entry
+	uint32_t rvFailures[SDO_STATS_RV_ENTRIES]; // of which failed
+} sdoSdkStats;
+
+sdoSdkStatus sdoSdkGetStats(sdoSdkStats *stats);
+
+sdoSdkStatus sdoSdkResetStats(void);
+
+// Crypto operations counted with CRYPTO_STATS=true, see sdoSdkGetCryptoStats
+typedef enum {
+	SDO_CRYPTO_OP_HASH = 0,
+	SDO_CRYPTO_OP_HMAC,
+	SDO_CRYPTO_OP_SIGN,
+	SDO_CRYPTO_OP_VERIFY,
+	SDO_CRYPTO_OP_AES_ENCRYPT,
+	SDO_CRYPTO_OP_AES_DECRYPT,
+	SDO_CRYPTO_OP_AES_GCM, // sealing of the stored blobs
+	SDO_CRYPTO_OP_KEX,
+	SDO_CRYPTO_OPS
+} sdoSdkCryptoOp;
+
+typedef struct {
+	const char *name;    // "hash", "sign", ...
+	const char *backend; // "openssl", "mbedtls", "tpm" or "se"
+	uint64_t calls;	     // into the backend, incremental steps each
+	uint64_t bytes;	     // data hashed, signed, encrypted, ...
+	uint64_t totalUs;
+	uint32_t maxUs;
+	uint32_t hist[SDO_STATS_HIST_BUCKETS]; // bucket b: [2^(b-1), 2^b) us
+} sdoSdkCryptoOpStats;
+
+typedef struct {
+	sdoSdkCryptoOpStats op[SDO_CRYPTO_OPS]; // [sdoSdkCryptoOp]
+} sdoSdkCryptoStats;
+
+sdoSdkStatus sdoSdkGetCryptoStats(sdoSdkCryptoStats *stats);
+
+sdoSdkStatus sdoSdkResetCryptoStats(void);
+
+// Storage counted with STORAGE_STATS=true, see sdoSdkGetStorageStats
+#define SDO_STORAGE_STATS_FILES 16
+#define SDO_STORAGE_STATS_NAME 64
+
+// Writes to one file of the medium
+typedef struct {
+	char name[SDO_STORAGE_STATS_NAME]; // without the directory
+	uint64_t writes;
+	uint64_t bytes;
+} sdoSdkStorageFileStats;
+
+typedef struct {
+	uint64_t reads;	       // sdoBlobRead calls
+	uint64_t writes;       // sdoBlobWrite calls
+	uint64_t sizes;	       // sdoBlobSize calls
+	uint64_t opens;	       // files opened on the medium
+	uint64_t bytesRead;    // from the medium
+	uint64_t bytesWritten; // to the medium, HMAC, tag and IV included
+	uint64_t syncs;	       // waits for the medium: fsync, syncfs, ...
+	uint64_t hmacs;	       // HMACs of the normal blobs, journal, ...
+	uint64_t hmacUs;
+	uint64_t gcms;	       // sealing or opening a secure blob
+	uint64_t gcmUs;
+	uint64_t filesDropped; // writes to files beyond the table
+	// per file, in the order they were first written
+	sdoSdkStorageFileStats file[SDO_STORAGE_STATS_FILES];
+} sdoSdkStorageStats;
+
+sdoSdkStatus sdoSdkGetStorageStats(sdoSdkStorageStats *stats);
+
+sdoSdkStatus sdoSdkResetStorageStats(void);
+
+// Heap use per subsystem with ALLOC_STATS=true, see sdoSdkGetAllocStats
+typedef enum {
+	SDO_ALLOC_TAG_OTHER = 0,
+	SDO_ALLOC_TAG_BLOCKIO, // message buffers
+	SDO_ALLOC_TAG_TYPES,   // protocol objects
+	SDO_ALLOC_TAG_PROT,    // message handlers and protocol state
+	SDO_ALLOC_TAG_CRYPTO,
+	SDO_ALLOC_TAG_NETWORK,
+	SDO_ALLOC_TAG_STORAGE,
+	SDO_ALLOC_TAG_MODULES, // service info modules
+	SDO_ALLOC_TAG_ARENA,   // chunks holding the transient objects
+	SDO_ALLOC_TAGS
+} sdoSdkAllocTag;
+
+typedef enum {
+	SDO_ALLOC_PHASE_DI = 0,
+	SDO_ALLOC_PHASE_TO1,
+	SDO_ALLOC_PHASE_TO2,
+	SDO_ALLOC_PHASES
+} sdoSdkAllocPhase;
+
+typedef struct {
+	const char *name;
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t bytes;	   // allocated in all
+	uint64_t curBytes; // in use
+	uint64_t peakBytes;
+	uint32_t hist[SDO_STATS_HIST_BUCKETS]; // by size, [2^(b-1), 2^b)
+} sdoSdkAllocTagStats;
+
+typedef struct {
+	sdoSdkAllocTagStats tag[SDO_ALLOC_TAGS]; // [sdoSdkAllocTag]
+	uint64_t curBytes;			 // of all tags
+	uint64_t peakBytes;
+	uint64_t phasePeak[SDO_ALLOC_PHASES]; // highest peak of a run
+} sdoSdkAllocStats;
+
+sdoSdkStatus sdoSdkGetAllocStats(sdoSdkAllocStats *stats);
+
+sdoSdkStatus sdoSdkResetAllocStats(void);
+
+// Log level per subsystem with LOG_ASYNC=true, SDO_ALLOC_TAGS for all
+sdoSdkStatus sdoSdkSetLogLevel(sdoSdkAllocTag subsystem, int level);
+
+// Timeline of the runs with TRACE_EVENTS=<n>, as Chrome trace JSON
+sdoSdkStatus sdoSdkTraceDump(const char *path);
+
+sdoSdkStatus sdoSdkTraceClear(void);
+
+// SDK instance of sdoSdkCreate, one device identity among several
+typedef struct sdoSdkCtx_s sdoSdkCtx_t;
+
+sdoSdkCtx_t *sdoSdkCreate(sdoSdkErrorCB errorHandlingCallback,
+			  uint32_t numModules,
+			  sdoSdkServiceInfoModule *moduleInformation,
+			  const char *dataDir);
+
+// Many identities in one store with IDENTITY_STORE=true, for gateways
+sdoSdkStatus sdoSdkIdentityStoreOpen(const char *path);
+
+sdoSdkCtx_t *sdoSdkCreateIdentity(sdoSdkErrorCB errorHandlingCallback,
+				  uint32_t numModules,
+				  sdoSdkServiceInfoModule *moduleInformation,
+				  const char *identity);
+
+sdoSdkStatus sdoSdkIdentityStoreCommit(void);
+
+void sdoSdkIdentityStoreClose(void);
+
+sdoSdkStatus sdoSdkCtxRun(sdoSdkCtx_t *ctx);
+
+sdoSdkStatus sdoSdkCtxRunWithBudget(sdoSdkCtx_t *ctx, uint32_t budgetMs);
+
+sdoSdkStatus sdoSdkCtxResale(sdoSdkCtx_t *ctx);
+
+sdoSdkDeviceState sdoSdkCtxGetStatus(sdoSdkCtx_t *ctx);
+
+sdoSdkStatus sdoSdkCtxCredSync(sdoSdkCtx_t *ctx);
+
+sdoSdkStatus sdoSdkCtxGetStats(sdoSdkCtx_t *ctx, sdoSdkStats *stats);
+
+void sdoSdkDestroy(sdoSdkCtx_t *ctx);
+
 int sdoDeInit(void);
 
 #endif /* __MP_H__ */
@@ -6,16 +6,16 @@
 #ifndef __SDOMODULES_H__
 #define __SDOMODULES_H__
 
+#include <stddef.h>
+
 /*
  * SDO module specific #defs (SvInfo)
  */
 #define SDO_MODULE_NAME_LEN 32
 #define SDO_MODULE_MSG_LEN 32
 #define SDO_MODULE_VALUE_LEN 100
-#ifdef TARGET_OS_OPTEE
-#define SDO_MAX_MODULES 1
-#else
-#define SDO_MAX_MODULES 1
+#ifndef SDO_MAX_MODULES
+#define SDO_MAX_MODULES 1 // MAX_MODULES=<n> of the build
 #endif
 
 /*==================================================================*/
@@ -29,7 +29,8 @@ typedef enum {
 	SDO_SI_GET_DSI,
 	SDO_SI_SET_OSI,
 	SDO_SI_END,
-	SDO_SI_FAILURE
+	SDO_SI_FAILURE,
+	SDO_SI_SET_OSI_CHUNK // OSI value in place, to modules accepting it
 } sdoSdkSiType;
 
 // enum for SvInfo module CB return value
@@ -38,9 +39,35 @@ enum { SDO_SI_CONTENT_ERROR, SDO_SI_INTERNAL_ERROR, SDO_SI_SUCCESS };
 typedef struct sdoSdkSiKeyValue {
 	char *key;
 	char *value;
+	/*
+	 * SDO_SI_SET_OSI_CHUNK: value points at length bytes in the decrypted
+	 * message, valid during the callback and not NUL terminated; offset
+	 * is where they go in the value of key, the chunks of consecutive
+	 * OSI pairs of the same key (over messages too) adding up to it.
+	 */
+	size_t offset;
+	size_t length;
 } sdoSdkSiKeyValue;
 
-// callback to module
+/*
+ * Flags a module may set in *count on SDO_SI_START. With SDO_SI_OSI_CHUNKS
+ * it is handed OSI values by SDO_SI_SET_OSI_CHUNK instead of copies by
+ * SDO_SI_SET_OSI. With SDO_SI_DSI_ASYNC its SDO_SI_GET_DSI callbacks run on
+ * a task worker of the SDK from msg44 on (linux), while its other callbacks
+ * may run. With SDO_SI_OSI_ASYNC its OSI callbacks run in order, one at a
+ * time, on the task workers (linux) while the next OSIs are fetched; a
+ * failure of them fails TO2 before msg50, after which its SDO_SI_END
+ * callback runs. With SDO_SI_OSI_ONCE it is not handed again the OSIs it
+ * applied (its callback succeeded) in an earlier run of TO2 that failed,
+ * when the owner sends the same message and value in the retry; their
+ * indexes are counted still. It has no effect along with SDO_SI_OSI_CHUNKS.
+ */
+#define SDO_SI_OSI_CHUNKS 0x1
+#define SDO_SI_DSI_ASYNC 0x2
+#define SDO_SI_OSI_ASYNC 0x4
+#define SDO_SI_OSI_ONCE 0x8
+
+/* callback to module */
 typedef int (*sdoSdkServiceInfoCB)(sdoSdkSiType type, int *count,
 				   sdoSdkSiKeyValue *si);
 
@@ -50,6 +77,9 @@ typedef struct {
 	sdoSdkServiceInfoCB serviceInfoCallback;
 } sdoSdkServiceInfoModule;
 
+/* A module's DSIs changed since it gave them (to SDO_SI_GET_DSI) */
+void sdoSdkServiceInfoDsiChanged(void);
+
 // Modules CB
 extern int devconfig(sdoSdkSiType type, int *count, sdoSdkSiKeyValue *si);
 extern int keypair(sdoSdkSiType type, int *count, sdoSdkSiKeyValue *si);
@@ -6,7 +6,7 @@
 /*!
  * \file
  * \brief Reading & Writing Device credentials in JSON format as described by
- * spec.
+ * spec, and the Normal ones in a compact binary layout.
  */
 
 #include "util.h"
@@ -20,6 +20,473 @@
 #include "sdoCryptoApi.h"
 #define verboseDumpPackets 0
 
+/*
+ * Binary layout of the Normal device credentials, all values big endian:
+ * [magic "SDCR"(4)||version(1)||ST(1)]
+ * and, from SDO_DEVICE_STATE_READY1 on, the owner block:
+ * [pv(4)||pe(4)||guidLen(2)||guid||pkh||rvCount(2)||rv entries]
+ * A hash is [hashType(1)||len(1)||bytes], a string [len(2)||bytes] and an
+ * IP address [length(1)||addr(16)]. Each rv entry is [fieldMask(2)] and the
+ * fields that are present, in CRED_RV_* order. The blob is decoded straight
+ * into the structures, the JSON form is still read for older blobs.
+ */
+#define CRED_BIN_MAGIC "SDCR"
+#define CRED_BIN_MAGIC_LEN 4
+#define CRED_BIN_VERSION 1
+
+#define CRED_RV_ONLY (1 << 0)
+#define CRED_RV_IP (1 << 1)
+#define CRED_RV_PO (1 << 2)
+#define CRED_RV_POW (1 << 3)
+#define CRED_RV_DN (1 << 4)
+#define CRED_RV_SCH (1 << 5)
+#define CRED_RV_CCH (1 << 6)
+#define CRED_RV_UI (1 << 7)
+#define CRED_RV_SS (1 << 8)
+#define CRED_RV_PW (1 << 9)
+#define CRED_RV_WSP (1 << 10)
+#define CRED_RV_ME (1 << 11)
+#define CRED_RV_PR (1 << 12)
+#define CRED_RV_DELAYSEC (1 << 13)
+#define CRED_RV_ALL ((1 << 14) - 1)
+
+#if !defined(CRED_BINARY_FALSE) && !defined(NO_PERSISTENT_STORAGE)
+#define CRED_BIN_WRITE
+
+/* Output cursor, only counts the bytes while buf is NULL */
+typedef struct {
+	uint8_t *buf;
+	size_t size;
+	size_t n;
+	bool ok;
+} credWriter_t;
+
+/**
+ * Internal API: append bytes to the binary credentials.
+ */
+static void credPut(credWriter_t *w, const void *data, size_t len)
+{
+	if (w->buf && w->ok) {
+		if (w->n + len > w->size ||
+		    (len && memcpy_s(w->buf + w->n, w->size - w->n, data,
+				     len) != 0))
+			w->ok = false;
+	}
+	w->n += len;
+}
+
+/**
+ * Internal API: append a big endian value of len bytes.
+ */
+static void credPutUInt(credWriter_t *w, uint32_t value, size_t len)
+{
+	uint8_t be[4];
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		be[i] = (uint8_t)(value >> (8 * (len - 1 - i)));
+	credPut(w, be, len);
+}
+
+/**
+ * Internal API: append a string, nothing if it is absent.
+ */
+static void credPutString(credWriter_t *w, SDOString_t *s)
+{
+	size_t len;
+
+	if (!s)
+		return;
+	len = s->bytes ? strnlen_s(s->bytes, s->byteSz) : 0;
+	if (len > UINT16_MAX)
+		w->ok = false;
+	credPutUInt(w, (uint32_t)len, 2);
+	credPut(w, s->bytes, len);
+}
+
+/**
+ * Internal API: append a hash, nothing if it is absent.
+ */
+static void credPutHash(credWriter_t *w, SDOHash_t *h)
+{
+	size_t len;
+
+	if (!h)
+		return;
+	len = h->hash ? h->hash->byteSz : 0;
+	if (len > UINT8_MAX || h->hashType < 0 || h->hashType > UINT8_MAX)
+		w->ok = false;
+	credPutUInt(w, (uint32_t)h->hashType, 1);
+	credPutUInt(w, (uint32_t)len, 1);
+	if (len)
+		credPut(w, h->hash->bytes, len);
+}
+
+/**
+ * Internal API: append a 32 bit value, nothing if it is absent.
+ */
+static void credPutU32(credWriter_t *w, uint32_t *value)
+{
+	if (value)
+		credPutUInt(w, *value, 4);
+}
+
+/**
+ * Internal API: append one rendezvous entry.
+ */
+static void credPutRendezvous(credWriter_t *w, SDORendezvous_t *rv)
+{
+	uint32_t mask = 0;
+
+	mask |= rv->only ? CRED_RV_ONLY : 0;
+	mask |= rv->ip ? CRED_RV_IP : 0;
+	mask |= rv->po ? CRED_RV_PO : 0;
+	mask |= rv->pow ? CRED_RV_POW : 0;
+	mask |= rv->dn ? CRED_RV_DN : 0;
+	mask |= rv->sch ? CRED_RV_SCH : 0;
+	mask |= rv->cch ? CRED_RV_CCH : 0;
+	mask |= rv->ui ? CRED_RV_UI : 0;
+	mask |= rv->ss ? CRED_RV_SS : 0;
+	mask |= rv->pw ? CRED_RV_PW : 0;
+	mask |= rv->wsp ? CRED_RV_WSP : 0;
+	mask |= rv->me ? CRED_RV_ME : 0;
+	mask |= rv->pr ? CRED_RV_PR : 0;
+	mask |= rv->delaysec ? CRED_RV_DELAYSEC : 0;
+	credPutUInt(w, mask, 2);
+
+	credPutString(w, rv->only);
+	if (rv->ip) {
+		credPutUInt(w, rv->ip->length, 1);
+		credPut(w, rv->ip->addr, sizeof(rv->ip->addr));
+	}
+	credPutU32(w, rv->po);
+	credPutU32(w, rv->pow);
+	credPutString(w, rv->dn);
+	credPutHash(w, rv->sch);
+	credPutHash(w, rv->cch);
+	credPutU32(w, rv->ui);
+	credPutString(w, rv->ss);
+	credPutString(w, rv->pw);
+	credPutString(w, rv->wsp);
+	credPutString(w, rv->me);
+	credPutString(w, rv->pr);
+	credPutU32(w, rv->delaysec);
+}
+
+/**
+ * Internal API: serialize the Normal device credentials.
+ * @param w - output cursor, a NULL buffer only sizes the credentials
+ * @param ocred - the credentials
+ */
+static void credBinEncode(credWriter_t *w, SDODevCred_t *ocred)
+{
+	SDOCredOwner_t *owner = ocred->ownerBlk;
+	SDORendezvous_t *rv;
+	uint16_t count = 0;
+
+	credPut(w, CRED_BIN_MAGIC, CRED_BIN_MAGIC_LEN);
+	credPutUInt(w, CRED_BIN_VERSION, 1);
+	credPutUInt(w, ocred->ST, 1);
+	if (ocred->ST < SDO_DEVICE_STATE_READY1)
+		return;
+
+	if (!owner || !owner->guid || !owner->pkh || !owner->rvlst) {
+		w->ok = false;
+		return;
+	}
+	credPutUInt(w, (uint32_t)owner->pv, 4);
+	credPutUInt(w, (uint32_t)owner->pe, 4);
+	if (owner->guid->byteSz > UINT16_MAX)
+		w->ok = false;
+	credPutUInt(w, (uint32_t)owner->guid->byteSz, 2);
+	credPut(w, owner->guid->bytes, owner->guid->byteSz);
+	credPutHash(w, owner->pkh);
+
+	count = owner->rvlst->numEntries;
+	credPutUInt(w, count, 2);
+	for (rv = owner->rvlst->rvEntries; count--; rv++)
+		credPutRendezvous(w, rv);
+}
+
+/**
+ * Internal API: write the Normal device credentials in the binary layout.
+ * @return true if written, otherwise false
+ */
+static bool credBinWrite(const char *devCredFile, sdoSdkBlobFlags flags,
+			 SDODevCred_t *ocred)
+{
+	credWriter_t writer = {NULL, 0, 0, true}, *w = &writer;
+	bool ret = false;
+
+	credBinEncode(w, ocred);
+	if (!w->ok || w->n > R_MAX_SIZE) {
+		LOG(LOG_ERROR, "Device credentials can not be encoded\n");
+		return false;
+	}
+
+	w->size = w->n;
+	w->n = 0;
+	w->buf = sdoAlloc(w->size);
+	if (!w->buf) {
+		LOG(LOG_ERROR, "Malloc Failed for device credentials\n");
+		return false;
+	}
+	credBinEncode(w, ocred);
+
+	if (!w->ok || sdoBlobWrite(devCredFile, flags, w->buf, w->size) ==
+			  -1) {
+		LOG(LOG_ERROR, "Issue while writing Devcred blob\n");
+		goto end;
+	}
+	ret = true;
+
+end:
+	sdoFree(w->buf);
+	return ret;
+}
+#endif
+
+/* Input cursor, ok turns false on the first short or bad field */
+typedef struct {
+	const uint8_t *p;
+	size_t left;
+	bool ok;
+} credReader_t;
+
+/**
+ * Internal API: take len bytes from the binary credentials.
+ * @return pointer to the bytes, NULL if the blob is too short
+ */
+static const uint8_t *credGet(credReader_t *r, size_t len)
+{
+	const uint8_t *p = r->p;
+
+	if (!r->ok || r->left < len) {
+		r->ok = false;
+		return NULL;
+	}
+	r->p += len;
+	r->left -= len;
+	return p;
+}
+
+/**
+ * Internal API: take a big endian value of len bytes.
+ */
+static uint32_t credGetUInt(credReader_t *r, size_t len)
+{
+	const uint8_t *p = credGet(r, len);
+	uint32_t value = 0;
+	size_t i;
+
+	for (i = 0; p && i < len; i++)
+		value = (value << 8) | p[i];
+	return value;
+}
+
+/**
+ * Internal API: take a string.
+ */
+static SDOString_t *credGetString(credReader_t *r)
+{
+	size_t len = credGetUInt(r, 2);
+	const uint8_t *p = credGet(r, len);
+	SDOString_t *s;
+
+	if (!p)
+		return NULL;
+	s = sdoStringAllocWith((char *)p, (int)len);
+	if (!s)
+		r->ok = false;
+	return s;
+}
+
+/**
+ * Internal API: take a hash.
+ */
+static SDOHash_t *credGetHash(credReader_t *r)
+{
+	int hashType = (int)credGetUInt(r, 1);
+	size_t len = credGetUInt(r, 1);
+	const uint8_t *p = credGet(r, len);
+	SDOHash_t *h;
+
+	if (!p)
+		return NULL;
+	h = len ? sdoHashAlloc(hashType, (int)len) : sdoHashAllocEmpty();
+	if (!h) {
+		r->ok = false;
+		return NULL;
+	}
+	h->hashType = hashType;
+	if (len && memcpy_s(h->hash->bytes, h->hash->byteSz, p, len) != 0)
+		r->ok = false;
+	return h;
+}
+
+/**
+ * Internal API: take a 32 bit value.
+ */
+static uint32_t *credGetU32(credReader_t *r)
+{
+	uint32_t value = credGetUInt(r, 4);
+	uint32_t *v;
+
+	if (!r->ok)
+		return NULL;
+	v = sdoAlloc(sizeof(uint32_t));
+	if (!v) {
+		r->ok = false;
+		return NULL;
+	}
+	*v = value;
+	return v;
+}
+
+/**
+ * Internal API: take an IP address.
+ */
+static SDOIPAddress_t *credGetIPAddress(credReader_t *r)
+{
+	uint8_t length = (uint8_t)credGetUInt(r, 1);
+	const uint8_t *p = credGet(r, sizeof(((SDOIPAddress_t *)0)->addr));
+	SDOIPAddress_t *ip;
+
+	if (!p || length > sizeof(ip->addr))
+		goto err;
+	ip = sdoIPAddressAlloc();
+	if (!ip)
+		goto err;
+	ip->length = length;
+	if (memcpy_s(ip->addr, sizeof(ip->addr), p, sizeof(ip->addr)) != 0) {
+		sdoFree(ip);
+		goto err;
+	}
+	return ip;
+
+err:
+	r->ok = false;
+	return NULL;
+}
+
+/**
+ * Internal API: take one rendezvous entry.
+ * @return the entry, NULL on error
+ */
+static SDORendezvous_t *credGetRendezvous(credReader_t *r)
+{
+	uint32_t mask = credGetUInt(r, 2);
+	SDORendezvous_t *rv;
+
+	if (!r->ok || (mask & ~CRED_RV_ALL))
+		return NULL;
+	rv = sdoRendezvousAlloc();
+	if (!rv)
+		return NULL;
+
+	if (mask & CRED_RV_ONLY)
+		rv->only = credGetString(r);
+	if (mask & CRED_RV_IP)
+		rv->ip = credGetIPAddress(r);
+	if (mask & CRED_RV_PO)
+		rv->po = credGetU32(r);
+	if (mask & CRED_RV_POW)
+		rv->pow = credGetU32(r);
+	if (mask & CRED_RV_DN)
+		rv->dn = credGetString(r);
+	if (mask & CRED_RV_SCH)
+		rv->sch = credGetHash(r);
+	if (mask & CRED_RV_CCH)
+		rv->cch = credGetHash(r);
+	if (mask & CRED_RV_UI)
+		rv->ui = credGetU32(r);
+	if (mask & CRED_RV_SS)
+		rv->ss = credGetString(r);
+	if (mask & CRED_RV_PW)
+		rv->pw = credGetString(r);
+	if (mask & CRED_RV_WSP)
+		rv->wsp = credGetString(r);
+	if (mask & CRED_RV_ME)
+		rv->me = credGetString(r);
+	if (mask & CRED_RV_PR)
+		rv->pr = credGetString(r);
+	if (mask & CRED_RV_DELAYSEC)
+		rv->delaysec = credGetU32(r);
+
+	if (!r->ok) {
+		sdoRendezvousFree(rv);
+		return NULL;
+	}
+	for (rv->numParams = 0; mask; mask &= mask - 1)
+		rv->numParams++;
+	return rv;
+}
+
+/**
+ * Internal API: decode the binary Normal device credentials.
+ * @param blob - the credentials, starting with CRED_BIN_MAGIC
+ * @param len - size of blob
+ * @param ourDevCred - the device credentials to fill
+ * @return true if decoded correctly, otherwise false
+ */
+static bool credBinDecode(const uint8_t *blob, size_t len,
+			  SDODevCred_t *ourDevCred)
+{
+	credReader_t reader = {blob, len, true}, *r = &reader;
+	SDOCredOwner_t *owner;
+	SDORendezvous_t *rv;
+	const uint8_t *p;
+	uint32_t count;
+	size_t guidLen;
+
+	credGet(r, CRED_BIN_MAGIC_LEN);
+	if (credGetUInt(r, 1) != CRED_BIN_VERSION || !r->ok) {
+		LOG(LOG_ERROR, "Unsupported device credentials version\n");
+		return false;
+	}
+	ourDevCred->ST = (uint8_t)credGetUInt(r, 1);
+	if (!r->ok)
+		return false;
+	if (ourDevCred->ST < SDO_DEVICE_STATE_READY1)
+		return r->left == 0;
+
+	if (ourDevCred->ownerBlk != NULL) {
+		sdoCredOwnerFree(ourDevCred->ownerBlk);
+		ourDevCred->ownerBlk = NULL;
+	}
+	owner = ourDevCred->ownerBlk = SDOCredOwnerAlloc();
+	if (!owner) {
+		LOG(LOG_ERROR, "devCred's ownerBlk allocation failed\n");
+		return false;
+	}
+
+	owner->pv = (int)credGetUInt(r, 4);
+	owner->pe = (int)credGetUInt(r, 4);
+	guidLen = credGetUInt(r, 2);
+	p = credGet(r, guidLen);
+	if (!p || !owner->pv || !owner->pe || guidLen == 0)
+		return false;
+	owner->guid = sdoByteArrayAllocWithByteArray((uint8_t *)p,
+						     (int)guidLen);
+	owner->pkh = credGetHash(r);
+	owner->rvlst = sdoRendezvousListAlloc();
+	if (!owner->guid || !owner->pkh || !owner->rvlst)
+		return false;
+
+	count = credGetUInt(r, 2);
+	while (r->ok && count--) {
+		rv = credGetRendezvous(r);
+		if (!rv || !sdoRendezvousListAdd(owner->rvlst, rv))
+			return false;
+	}
+
+	if (!r->ok || r->left != 0) {
+		LOG(LOG_ERROR, "Malformed device credentials blob\n");
+		return false;
+	}
+	return true;
+}
+
 /**
  * Write the Device Credentials blob, contains our state
  * @param devCredFile - pointer of type const char to which credentails are
@@ -36,7 +503,9 @@ bool WriteNormalDeviceCredentials(const char *devCredFile,
 				  sdoSdkBlobFlags flags, SDODevCred_t *ocred)
 {
 	bool ret = true;
-#ifndef NO_PERSISTENT_STORAGE
+#ifdef CRED_BIN_WRITE
+	ret = credBinWrite(devCredFile, flags, ocred);
+#elif !defined(NO_PERSISTENT_STORAGE)
 	SDOW_t sdowriter, *sdow = &sdowriter;
 	if (!sdoWInit(sdow)) {
 		LOG(LOG_ERROR, "sdoWInit() failed!\n");
@@ -204,6 +673,7 @@ bool ReadNormalDeviceCredentials(const char *devCredFile, sdoSdkBlobFlags flags,
 
 	bool ret = false;
 	int32_t devCredLen = 0;
+	int result = 1;
 
 	sdor = &sdoreader;
 	sdob = &(sdor->b);
@@ -233,6 +703,14 @@ bool ReadNormalDeviceCredentials(const char *devCredFile, sdoSdkBlobFlags flags,
 
 	LOG(LOG_DEBUG, "Reading Ownership Credential from blob: Normal.blob\n");
 
+	if (devCredLen >= CRED_BIN_MAGIC_LEN &&
+	    memcmp_s(sdob->block, CRED_BIN_MAGIC_LEN, CRED_BIN_MAGIC,
+		     CRED_BIN_MAGIC_LEN, &result) == 0 &&
+	    result == 0) {
+		ret = credBinDecode(sdob->block, devCredLen, ourDevCred);
+		goto end;
+	}
+
 	sdor->b.blockSize = devCredLen;
 	sdor->haveBlock = true;
 
@@ -352,6 +830,12 @@ bool ReadNormalDeviceCredentials(const char *devCredFile, sdoSdkBlobFlags flags,
 
 	ret = true;
 
+#ifdef CRED_BIN_WRITE
+	/* Move the JSON credentials over to the binary layout */
+	if (!credBinWrite(devCredFile, flags, ourDevCred))
+		LOG(LOG_ERROR, "Could not convert the Device Credentials\n");
+#endif
+
 end:
 	if (sdob->block) {
 		sdoFree(sdob->block);
@@ -583,13 +1067,14 @@ static int sdoRFileRecv(SDOR_t *sdor, int nbytes)
 	return nread;
 }
 #endif
+/* Told about credential writes left to the background, NULL if none */
+static sdoSdkCredWriteCB credWriteCB;
+
 /**
- * Write and save the device credentials passed as an parameter ocred of type
- * SDODevCred_t.
- * @param ocred - Pointer of type SDODevCred_t, credentials to be copied
+ * Internal API: write all the credential blobs in the open blob transaction.
  * @return 0 if success, else -1 on failure.
  */
-int store_credential(SDODevCred_t *ocred)
+static int write_credential_blobs(SDODevCred_t *ocred)
 {
 	/* Write in the file and save the Normal device credentials */
 	LOG(LOG_DEBUG, "Writing to %s blob\n", "Normal.blob");
@@ -616,10 +1101,93 @@ int store_credential(SDODevCred_t *ocred)
 		return -1;
 	}
 #endif
+	return 0;
+}
+
+/**
+ * Write and save the device credentials passed as an parameter ocred of type
+ * SDODevCred_t.
+ * @param ocred - Pointer of type SDODevCred_t, credentials to be copied
+ * @return 0 if success, else -1 on failure.
+ */
+int store_credential(SDODevCred_t *ocred)
+{
+	/* All the blobs are updated, or none of them */
+	if (sdoBlobTxBegin() != 0)
+		return -1;
+
+	if (write_credential_blobs(ocred) != 0)
+		goto err;
+
+	if (sdoBlobTxCommit() != 0) {
+		LOG(LOG_ERROR, "Could not commit the Credentials blobs\n");
+		return -1;
+	}
+	return 0;
+
+err:
+	sdoBlobTxAbort();
+	return -1;
+}
 
+/**
+ * Internal API: pass the result of a background credential write on.
+ */
+static void credential_written(int32_t result)
+{
+	if (result != 0)
+		LOG(LOG_ERROR, "Could not commit the Credentials blobs\n");
+	if (credWriteCB)
+		credWriteCB(result == 0 ? SDO_SUCCESS : SDO_ERROR);
+}
+
+/**
+ * Like store_credential, but once a write callback is set the blobs are
+ * only sealed here and written out in the background. ocred may be freed
+ * as soon as this returns.
+ * @param ocred - Pointer of type SDODevCred_t, credentials to be copied
+ * @return 0 if success, else -1 on failure.
+ */
+int store_credential_deferred(SDODevCred_t *ocred)
+{
+	if (!credWriteCB)
+		return store_credential(ocred);
+
+	if (sdoBlobTxBegin() != 0)
+		return -1;
+
+	if (write_credential_blobs(ocred) != 0) {
+		sdoBlobTxAbort();
+		return -1;
+	}
+
+	if (sdoBlobTxCommitAsync(credential_written) != 0) {
+		LOG(LOG_ERROR, "Could not commit the Credentials blobs\n");
+		return -1;
+	}
 	return 0;
 }
 
+/**
+ * Set the callback told about the credential writes store_credential_deferred
+ * leaves to the background, NULL to write them in line. A pending write is
+ * waited for first.
+ */
+void set_credential_write_cb(sdoSdkCredWriteCB cb)
+{
+	(void)sdoBlobTxSync();
+	credWriteCB = cb;
+}
+
+/**
+ * Wait until the credentials written in the background are durable.
+ * @return 0 if success, else -1 if the write failed.
+ */
+int sync_credential(void)
+{
+	return sdoBlobTxSync();
+}
+
 /**
  * load_credentials function loads the State & OwnerBlk credentials from storage
  *
@@ -644,6 +1212,60 @@ int load_credential(void)
 	return 0;
 }
 
+/**
+ * load_credential_state function loads only the State of the State &
+ * OwnerBlk credentials, from the header of their binary blob, which the
+ * storage protects by its HMAC as the rest. Telling the status or finding
+ * the device onboarded needs no more; load_credential loads the OwnerBlk
+ * once a protocol is to run. Older (JSON) blobs are loaded in full.
+ *
+ * @return
+ *        return 0 if all of them were loaded, 1 if the OwnerBlk was left
+ *        out, -1 on failure.
+ */
+int load_credential_state(void)
+{
+	SDODevCred_t *ocred;
+	uint8_t *blob;
+	int32_t len;
+	int result = 1;
+	int ret = 0;
+
+	len = sdoBlobSize((char *)SDO_CRED_NORMAL, SDO_SDK_NORMAL_DATA);
+	if (len < CRED_BIN_MAGIC_LEN + 2)
+		return load_credential();
+
+	blob = sdoAlloc(len);
+	if (!blob)
+		return -1;
+	if (sdoBlobRead((char *)SDO_CRED_NORMAL, SDO_SDK_NORMAL_DATA, blob,
+			len) != len) {
+		LOG(LOG_ERROR, "Could not read the device credentials blob\n");
+		sdoFree(blob);
+		return -1;
+	}
+
+	if (memcmp_s(blob, CRED_BIN_MAGIC_LEN, CRED_BIN_MAGIC,
+		     CRED_BIN_MAGIC_LEN, &result) != 0 ||
+	    result != 0 || blob[CRED_BIN_MAGIC_LEN] != CRED_BIN_VERSION) {
+		sdoFree(blob);
+		return load_credential();
+	}
+
+	ocred = app_alloc_credentials();
+	if (!ocred) {
+		sdoFree(blob);
+		return -1;
+	}
+	sdoDevCredInit(ocred);
+	ocred->ST = blob[CRED_BIN_MAGIC_LEN + 1];
+	/* the blob of a device before READY1 is only its state */
+	if (ocred->ST >= SDO_DEVICE_STATE_READY1)
+		ret = 1;
+	sdoFree(blob);
+	return ret;
+}
+
 /**
  * load_mfg_secret function loads the Secure & MFG credentials from storage
  *
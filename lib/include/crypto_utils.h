@@ -10,10 +10,7 @@
 #include <stdint.h>
 #include <stddef.h>
 
-int aes_encrypt_packet(SDOEncryptedPacket_t *cipher_txt, uint8_t *clear_txt,
-		       size_t clear_txt_size);
-
-int aes_decrypt_packet(SDOEncryptedPacket_t *cipher_txt,
-		       SDOString_t *clear_txt);
+int aes_decrypt_packet(SDOEncryptedPacket_t *cipher_txt, uint8_t *clear_txt,
+		       uint32_t *clear_txt_size);
 
 #endif /* __CRYPTO_UTILS_H__ */
@@ -30,8 +30,12 @@ bool WriteSecureDeviceCredentials(const char *devCredFile,
 				  sdoSdkBlobFlags flags,
 				  SDODevCred_t *ourDevCred);
 int load_credential(void);
+int load_credential_state(void);
 int load_mfg_secret(void);
 int store_credential(SDODevCred_t *ocred);
+int store_credential_deferred(SDODevCred_t *ocred);
+void set_credential_write_cb(sdoSdkCredWriteCB cb);
+int sync_credential(void);
 void load_default_data(void);
 SDODevCred_t *app_get_credentials(void);
 SDODevCred_t *app_alloc_credentials(void);
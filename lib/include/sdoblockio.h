@@ -18,6 +18,52 @@ typedef struct {
 	uint8_t *block;
 } SDOBlock_t;
 
+/*
+ * Consumer of a region of a streamed message. The bytes of the region are
+ * fed to it as they are released from the block, so that the region needs
+ * not be kept whole.
+ */
+typedef struct {
+	bool (*feed)(void **ctx, const uint8_t *buf, int len);
+	void (*drop)(void **ctx);
+} SDOReadTapOps_t;
+
+typedef struct {
+	const SDOReadTapOps_t *ops; // NULL for a free tap
+	void *ctx;
+	int from;    // offset of the first byte of the region not fed yet
+	bool fed;    // part of the region was released, ctx holds it
+	bool pinned; // region could not be fed, it is kept in the block
+	bool failed;
+	bool ended;
+} SDOReadTap_t;
+
+#define SDO_READ_TAPS_MAX 4
+
+/*
+ * Structural index of a message received whole: its brackets and braces
+ * outside of strings, in order, each with the entry it pairs with. It is
+ * built the first time a value is skipped, so that a skip jumps over the
+ * nested sequences and objects instead of reading them.
+ */
+typedef struct {
+	int pos;   // offset of the bracket or brace
+	int match; // entry pairing with it, -1 if there is none
+} SDOStructEntry_t;
+
+typedef struct {
+	SDOStructEntry_t *entries;
+	int count;
+	int max;
+	bool valid;
+	const uint8_t *block; // block it was built on
+	int blockSize;
+} SDOStructIndex_t;
+
+/* Wire encodings of a message, see sdocbor.h for CBOR */
+#define SDO_ENCODING_JSON 0
+#define SDO_ENCODING_CBOR 1
+
 typedef struct _SDOR_s {
 	SDOBlock_t b;
 	uint8_t needComma;
@@ -26,10 +72,56 @@ typedef struct _SDOR_s {
 	int contentLength;
 	int (*receive)(struct _SDOR_s *, int);
 	void *receiveData;
+	int pending; // bytes of a streamed message not received yet
+	SDOReadTap_t taps[SDO_READ_TAPS_MAX];
+	uint8_t encoding;
+	uint8_t cborDepth; // open CBOR containers
+	uint32_t cborMaps; // bit set for each of them that is a map
+	SDOStructIndex_t index;
 } SDOR_t;
 
 typedef int (*SDOReceiveFcnPtr_t)(SDOR_t *, int);
 
+/* Tokens of the JSON reader, structural ones are their own character */
+typedef enum {
+	SDO_TOKEN_NONE = 0, // end of the block
+	SDO_TOKEN_INVALID,
+	SDO_TOKEN_STRING,
+	SDO_TOKEN_NUMBER,
+	SDO_TOKEN_BEGIN_SEQ = '[',
+	SDO_TOKEN_END_SEQ = ']',
+	SDO_TOKEN_BEGIN_OBJ = '{',
+	SDO_TOKEN_END_OBJ = '}',
+	SDO_TOKEN_COLON = ':',
+	SDO_TOKEN_COMMA = ','
+} SDOTokenType_t;
+
+typedef struct {
+	SDOTokenType_t type;
+	int start; // offset of the value, string contents without the quotes
+	int len;   // length of the value
+	int end;   // offset after the token
+} SDOToken_t;
+
+/*
+ * Key of a set of tags dispatched on at once, for ex: the keys of a
+ * rendezvous entry. A set is an array sorted by length, then by bytes, so
+ * that a tag is found by a binary search that mostly compares lengths.
+ */
+typedef struct {
+	const char *tag;
+	uint8_t tagLen;
+	int val;
+} SDOTagKey_t;
+
+#define SDO_TAG_KEY(tag, val)                                                  \
+	{                                                                      \
+		(tag), sizeof(tag) - 1, (val)                                  \
+	}
+/* Results of sdoReadTagKey() other than the value of a key */
+#define SDO_TAG_UNKNOWN -1 // a tag that is not in the set
+#define SDO_TAG_INVALID -2 // no tag at the cursor
+
 typedef struct _SDOW_s {
 	SDOBlock_t b;
 	uint8_t needComma;
@@ -37,6 +129,7 @@ typedef struct _SDOW_s {
 	int msgType;
 	int (*send)(struct _SDOW_s *);
 	void *sendData;
+	uint8_t encoding;
 } SDOW_t;
 
 #define SDO_FIX_UP_STR "\"0000\""
@@ -44,20 +137,42 @@ typedef struct _SDOW_s {
 #define SDO_FIX_UP_LEN 6
 #define SDO_BLOCK_READ_SZ 7 // ["XXXX"
 #define SDO_BLOCKINC 256
+/* Smallest read of a streamed message */
+#ifndef SDO_BLOCK_READ_CHUNK
+#define SDO_BLOCK_READ_CHUNK 1024
+#endif
 #define SDO_BLOCK_MASK ~255
+/* Largest block kept between messages */
+#ifndef SDO_BLOCK_RETAIN_MAX
+#define SDO_BLOCK_RETAIN_MAX (64 * 1024)
+#endif
 #define SDO_OK 0
 #define SDO_BLOCKLEN_SZ 8
+#define SDO_TAG_MAX_LEN 32
 void sdoBlockInit(SDOBlock_t *sdob);
 void sdoBlockReset(SDOBlock_t *sdob);
 int SDOBPeekc(SDOBlock_t *sdob);
 void sdoResizeBlock(SDOBlock_t *sdob, int need);
+bool sdoRReserve(SDOR_t *sdor, int len);
 bool sdoRInit(SDOR_t *sdor, SDOReceiveFcnPtr_t rcv, void *rcvData);
 void sdoRFlush(SDOR_t *sdor);
 int sdoRPeek(SDOR_t *sdor);
 bool sdoRHaveBlock(SDOR_t *sdor);
 void sdoRSetHaveBlock(SDOR_t *sdor);
 bool sdoRNextBlock(SDOR_t *sdor, uint32_t *typep);
+bool sdoRPeekToken(SDOR_t *sdor, SDOToken_t *tok);
+void sdoRConsumeToken(SDOR_t *sdor, const SDOToken_t *tok);
 uint8_t *sdoRGetBlockPtr(SDOR_t *sdor, int fromCursor);
+bool sdoRFill(SDOR_t *sdor, int need);
+void sdoRStream(SDOR_t *sdor, int len);
+bool sdoRStreaming(SDOR_t *sdor);
+void sdoRRelease(SDOR_t *sdor);
+int sdoRTapBegin(SDOR_t *sdor, const SDOReadTapOps_t *ops);
+bool sdoRTapEnd(SDOR_t *sdor, int tap, int *start);
+bool sdoRTapPause(SDOR_t *sdor, int tap, int *start);
+bool sdoRTapResume(SDOR_t *sdor, int tap);
+void **sdoRTapContext(SDOR_t *sdor, int tap);
+void sdoRTapFree(SDOR_t *sdor, int tap);
 uint8_t *sdoWGetBlockPtr(SDOW_t *sdow, int fromCursor);
 bool sdoRBeginSequence(SDOR_t *sdor);
 bool sdoREndSequence(SDOR_t *sdor);
@@ -68,13 +183,20 @@ int sdoReadStringSz(SDOR_t *sdor);
 int sdoReadArraySz(SDOR_t *sdor);
 int sdoReadArrayNoStateChange(SDOR_t *sdor, uint8_t *buf);
 int sdoReadString(SDOR_t *sdor, char *bufp, int bufSz);
+int sdoReadStringRef(SDOR_t *sdor, const char **strp);
 int sdoReadTag(SDOR_t *sdor, char *bufp, int bufSz);
 bool sdoReadTagFinisher(SDOR_t *sdor);
 int sdoReadExpectedTag(SDOR_t *sdor, char *tag);
+int sdoReadExpectedTagLen(SDOR_t *sdor, const char *tag, int tagLen);
+int sdoTagLookup(const SDOTagKey_t *keys, int numKeys, const uint8_t *tag,
+		 int tagLen);
+int sdoReadTagKey(SDOR_t *sdor, const SDOTagKey_t *keys, int numKeys);
 int sdoReadByteArrayField(SDOR_t *sdor, int b64Sz, uint8_t *bufp, int bufSz);
+bool sdoReadByteArrayText(SDOR_t *sdor, int b64Sz, const uint8_t **textp);
 
 bool sdoWInit(SDOW_t *sdow);
 void sdoWBlockReset(SDOW_t *sdow);
+bool sdoWReserve(SDOW_t *sdow, int len);
 int sdoWNextBlock(SDOW_t *sdow, int type);
 int sdoWCreateFixup(SDOW_t *sdow);
 void sdoWFixFixup(SDOW_t *sdow, int cursorPosn, int fixup);
@@ -87,6 +209,7 @@ void sdoWriteTagLen(SDOW_t *sdow, char *tag, int len);
 void sdoWriteUInt(SDOW_t *sdow, uint32_t i);
 void sdoWriteString(SDOW_t *sdow, const char *s);
 void sdoWriteStringLen(SDOW_t *sdow, char *s, int len);
+void sdoWriteEncoded(SDOW_t *sdow, const uint8_t *buf, int len);
 void sdoWriteBigNumField(SDOW_t *sdow, uint8_t *bufp, int bufSz);
 void sdoWriteBigNum(SDOW_t *sdow, uint8_t *bufp, int bufSz);
 void sdoWriteByteArrayField(SDOW_t *sdow, uint8_t *bufp, int bufSz);
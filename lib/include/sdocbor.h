@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOCBOR_H__
+#define __SDOCBOR_H__
+
+#include "sdoblockio.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * CBOR (RFC 7049) wire encoding of the SDOR/SDOW primitives. Sequences and
+ * objects are indefinite length arrays and maps, so that they are written
+ * without knowing their size like the JSON ones, tags are text strings and
+ * byte arrays are byte strings, carried without base64.
+ */
+#define SDO_CBOR_UINT 0
+#define SDO_CBOR_NINT 1
+#define SDO_CBOR_BSTR 2
+#define SDO_CBOR_TSTR 3
+#define SDO_CBOR_ARRAY 4
+#define SDO_CBOR_MAP 5
+#define SDO_CBOR_TAG 6
+#define SDO_CBOR_SIMPLE 7
+
+#define SDO_CBOR_INDEFINITE 31
+#define SDO_CBOR_BREAK 0xff
+#define SDO_CBOR_HEAD_MAX 9 // longest head, a 64 bit argument
+/* Deepest nesting of sequences and objects */
+#define SDO_CBOR_DEPTH_MAX 32
+
+bool sdoCborRBegin(SDOR_t *sdor, uint8_t major);
+bool sdoCborREnd(SDOR_t *sdor, uint8_t major);
+int sdoCborRPeek(SDOR_t *sdor);
+void sdoCborRSkipToEnd(SDOR_t *sdor);
+uint32_t sdoCborReadUInt(SDOR_t *sdor);
+int sdoCborReadStringSz(SDOR_t *sdor);
+int sdoCborReadString(SDOR_t *sdor, char *bufp, int bufSz);
+int sdoCborReadStringRef(SDOR_t *sdor, const char **strp);
+int sdoCborReadTag(SDOR_t *sdor, char *bufp, int bufSz);
+int sdoCborReadExpectedTagLen(SDOR_t *sdor, const char *tag, int tagLen);
+int sdoCborReadTagKey(SDOR_t *sdor, const SDOTagKey_t *keys, int numKeys);
+int sdoCborArrayEnd(SDOR_t *sdor);
+int sdoCborReadByteArrayField(SDOR_t *sdor, int b64Sz, uint8_t *bufp,
+			      int bufSz);
+bool sdoCborReadBytes(SDOR_t *sdor, int b64Sz, const uint8_t **bytesp,
+		      int *lenp);
+
+void sdoCborWriteHead(SDOW_t *sdow, uint8_t major, uint32_t val);
+void sdoCborWBegin(SDOW_t *sdow, uint8_t major);
+void sdoCborWEnd(SDOW_t *sdow);
+void sdoCborWriteString(SDOW_t *sdow, const char *s, int len);
+void sdoCborWriteBytes(SDOW_t *sdow, const uint8_t *bufp, int bufSz);
+
+#endif /* __SDOCBOR_H__ */
@@ -9,6 +9,7 @@
 #include "sdotypes.h"
 
 SDOHash_t *sdoPubKeyHash(SDOPublicKey_t *pubKey);
+const SDOHash_t *sdoPubKeyHashOf(SDOPublicKey_t *pubKey);
 
 typedef struct _sdo_credowner_t {
 	int pv; // The protocol version
@@ -49,7 +50,6 @@ void sdoCredMfgFree(SDOCredMfg_t *ocredMfg);
 void sdoCredMfgPrint(SDOCredMfg_t *ocredMfg);
 
 typedef struct _sdo_oventry_t {
-	struct _sdo_oventry_t *next;
 	uint16_t enn;
 	SDOHash_t *hpHash;
 	SDOHash_t *hcHash;
@@ -57,8 +57,7 @@ typedef struct _sdo_oventry_t {
 } SDOOvEntry_t;
 
 SDOOvEntry_t *sdoOvEntryAllocEmpty(void);
-SDOOvEntry_t *sdoOvEntryFree(SDOOvEntry_t *e);
-bool sdoOvEntryAdd(SDOOvEntry_t *rootEntry, SDOOvEntry_t *e);
+void sdoOvEntryFree(SDOOvEntry_t *e);
 
 #define SDO_DEV_INFO_SZ 512 // max size of dev info we handle
 
@@ -71,7 +70,7 @@ typedef struct _sdo_ownershipvoucher_t {
 	SDOPublicKey_t *mfgPubKey;
 	SDOHash_t *ovoucherHdrHash;
 	int numOVEntries;
-	SDOOvEntry_t *OVEntries;
+	SDOOvEntry_t *OVEntries; // the last entry verified, not a chain
 	SDOHash_t *hdc;
 } SDOOwnershipVoucher_t;
 
@@ -80,7 +79,8 @@ void sdoOvFree(SDOOwnershipVoucher_t *ov);
 void sdoOvPrint(SDOOwnershipVoucher_t *ov);
 SDOOwnershipVoucher_t *sdoOvHdrRead(SDOR_t *sdor, SDOHash_t **hmac,
 				    bool calHpHc);
-SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey);
+SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey,
+			   SDOHash_t **newPkh);
 
 typedef struct SDOOwnerSuppliedCredentials_s {
 	SDORendezvousList_t *rvlst;
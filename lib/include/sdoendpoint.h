@@ -0,0 +1,18 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOENDPOINT_H__
+#define __SDOENDPOINT_H__
+
+#include "sdotypes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+void sdoEndpointRecord(const char *dn, const SDOIPAddress_t *ip,
+		       uint16_t port, bool success, uint32_t connectMs,
+		       uint32_t responseMs);
+int sdoEndpointPickRendezvous(SDORendezvousList_t *rvlst);
+
+#endif /* __SDOENDPOINT_H__ */
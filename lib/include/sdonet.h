@@ -8,11 +8,6 @@
 
 #include "sdoprotctx.h"
 
-#define MANUFACTURER_CONNECT_RETRIES 2
-#define RENDEZVOUS_CONNECT_RETRIES 2
-#define OWNER_CONNECT_RETRIES 2
-#define RETRY_DELAY 1
-
 void sdoNetInit(void);
 bool is_rv_proxy_defined(void);
 bool is_mfg_proxy_defined(void);
@@ -20,6 +15,9 @@ bool is_owner_proxy_defined(void);
 bool setup_http_proxy(const char *filename, SDOIPAddress_t *sdoip,
 		      uint16_t *port_num);
 
+void sdoDnsCacheInvalidate(const char *dn);
+int sdoRendezvousProbe(SDORendezvousList_t *rvlst, int rvIndex);
+
 bool ResolveDn(const char *dn, SDOIPAddress_t **ip, uint16_t port, void **ssl,
 	       bool proxy);
 
@@ -31,6 +29,12 @@ bool ConnectToRendezvous(SDOIPAddress_t *ip, uint16_t port, int *sock,
 
 bool ConnectToOwner(SDOIPAddress_t *ip, uint16_t port, int *sock, void **ssl);
 
+/* Connect to the owner while TO1 finishes, for TO2 to take over */
+void sdoOwnerPreconnect(const char *dn, const SDOIPAddress_t *ip,
+			uint16_t port);
+bool sdoOwnerPreconnectTake(SDOProtCtx_t *prot_ctx);
+void sdoOwnerPreconnectDrop(void);
+
 /* Try reconnecting to server if connection lost */
 int sdoConnectionRestablish(SDOProtCtx_t *prot_ctx);
 
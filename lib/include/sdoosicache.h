@@ -0,0 +1,26 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOOSICACHE_H__
+#define __SDOOSICACHE_H__
+
+#include "sdotypes.h"
+#include "sdomodules.h"
+#include <stdbool.h>
+
+/*
+ * OSI pairs applied by the modules of an instance taking SDO_SI_OSI_ONCE,
+ * kept from the start of TO2 for a GUID until it completes, so that a
+ * retried TO2 does not apply them again.
+ */
+void sdoOsiCacheOpen(sdoOsiCache_t *cache, const SDOByteArray_t *guid);
+bool sdoOsiCacheApplied(sdoOsiCache_t *cache, const char *modName,
+			const sdoSdkSiKeyValue *kv);
+void sdoOsiCacheAdd(sdoOsiCache_t *cache, const char *modName,
+		    const sdoSdkSiKeyValue *kv);
+void sdoOsiCacheFlush(sdoOsiCache_t *cache);
+void sdoOsiCacheClose(sdoOsiCache_t *cache, bool done);
+
+#endif /* __SDOOSICACHE_H__ */
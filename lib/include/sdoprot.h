@@ -173,6 +173,7 @@ sdourl_t sdoStateToURL(int state);
 
 typedef struct SDOProt_s {
 	int state;
+	int prevState; // state of the last connect, resumed after an error
 	int ecode;
 	bool success;
 	SDOR_t sdor;
@@ -195,6 +196,9 @@ typedef struct SDOProt_s {
 	SDOPublicKey_t *localKeyPair;
 	uint16_t ovEntryNum;
 	SDOOwnershipVoucher_t *ovoucher;
+	void *ovBatch; // OV entry signatures being verified by workers
+	SDOByteArray_t *ovPrefix; // "bo" hashes of a chain verified before
+	SDOByteArray_t *ovHashes; // "bo" hashes of the entries read so far
 	SDOHash_t *newOVHdrHMAC;
 	SDORendezvous_t *rv;
 	uint16_t servReqInfoNum;
@@ -205,18 +209,26 @@ typedef struct SDOProt_s {
 	SDOByteArray_t *n4;
 	SDOByteArray_t *n5;
 	SDOByteArray_t *n7;
-	SDOByteArray_t *n5r;
 	SDOByteArray_t *n6;
-	SDOByteArray_t *n7r;
 	SDORedirect_t SDORedirect;
+	bool redirectOk; // msg41 verified SDORedirect, the owner took it
 	uint32_t RoundTripCount;
 	//	void *keyExData;
 	sdoSdkServiceInfoModuleList_t
 	    *SvInfoModListHead; // Global SvInfomodule list head
 	sdoSvInfoDsiInfo_t *dsiInfo;
+	sdoSvInfoDsiSnap_t *dsiSnap; // DSI snapshot of the device, may be NULL
+	bool dsiSnapped;	     // msg46 writes the rounds of dsiSnap
+	sdoFragCache_t *frags;	     // fragments of the device, may be NULL
+	sdoOsiCache_t *osiCache;     // OSIs applied, may be NULL
+	SDOW_t *msg44;		     // written ahead by msg44Prepare, or NULL
 	int totalDsiRounds; // device service infos + module DSI counts
 	uint8_t rvIndex;    // keep track of current rv index
 	bool reuse_enabled; // REUSE protocol flag
+	/* TO2 session kept after a lost connection, see sdoTO2Suspend() */
+	uint64_t resumeEnd; // sdoTimeMs() until it can be resumed, 0 if not
+	bool resume;	    // sdow is the message to send again
+	char *resumeAuth;   // Authorization of the owner, or NULL
 } SDOProt_t;
 
 /* DI function declarations */
@@ -235,8 +247,11 @@ int32_t msg33(SDOProt_t *ps);
 int32_t msg40(SDOProt_t *ps);
 int32_t msg41(SDOProt_t *ps);
 int32_t msg42(SDOProt_t *ps);
+bool msg42Ahead(SDOProt_t *ps, SDOW_t *sdow, uint16_t enn);
 int32_t msg43(SDOProt_t *ps);
 int32_t msg44(SDOProt_t *ps);
+int32_t msg44Prepare(SDOProt_t *ps);
+void msg44Drop(SDOProt_t *ps);
 int32_t msg45(SDOProt_t *ps);
 int32_t msg46(SDOProt_t *ps);
 int32_t msg47(SDOProt_t *ps);
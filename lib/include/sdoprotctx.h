@@ -6,6 +6,7 @@
 #ifndef __SDOPROTCTX_H__
 #define __SDOPROTCTX_H__
 
+#include "sdo.h"
 #include "sdoblockio.h"
 #include "sdoprot.h"
 #include <stdio.h>
@@ -24,6 +25,7 @@ typedef struct SDOProt_Ctx_s {
 	int sock;
 	void *ssl;
 	bool tls;
+	uint8_t encoding; // SDO_ENCODING_JSON or SDO_ENCODING_CBOR
 	int msgType;
 	SDOProt_t *protdata;
 	bool (*protrun)();
@@ -31,13 +33,52 @@ typedef struct SDOProt_Ctx_s {
 	uint16_t host_port;
 	char *host_dns;
 	SDOIPAddress_t *resolved_ip;
+	/* progress of a step-wise run, see sdoProtCtxStep() */
+	int stepState;
+	bool reused;
+	bool resent;
+	uint32_t rxLen;
+	size_t rxDone;
+	uint64_t txStart; // sdoTimeUs() when the message went out
+	uint64_t phaseEnd;   // sdoTimeMs() deadline of the protocol, 0 if none
+	uint64_t ioDeadline; // sdoTimeMs() deadline of the pending I/O
+	bool blocking;       // the network has no non-blocking I/O
+	/* statistics of the run, see sdostats.h */
+	uint64_t runStart; // sdoTimeMs() when the run began
+	int firstMsg;	   // type of its first message, tells the protocol
+	int parseMsg;	   // message whose response is handled next, or 0
+	uint32_t retries;  // of the message being exchanged
+	bool inFlight;	   // a message is out, its response not in
+	uint8_t ahead;	   // msg42 sent ahead of the current one
+	/* latency of the server, see sdoendpoint.h */
+	uint32_t connects;    // successful connections of the run
+	uint64_t connectUs;   // time they took altogether
+	uint32_t responses;   // responses received in the run
+	uint64_t responseUs;  // time they took altogether
 } SDOProtCtx_t;
 
+/* Results of sdoProtCtxStep() */
+#define SDO_PROT_CTX_DONE 0
+#define SDO_PROT_CTX_ERROR -1
+#define SDO_PROT_CTX_WANT_READ 1  // call again when sdoProtCtxGetFd() reads
+#define SDO_PROT_CTX_WANT_WRITE 2 // call again when sdoProtCtxGetFd() writes
+#define SDO_PROT_CTX_AGAIN 3      // call again, nothing to wait on
+
 SDOProtCtx_t *sdoProtCtxAlloc(bool (*protrun)(), SDOProt_t *protdata,
 			      SDOIPAddress_t *host_ip, char *host_dns,
 			      uint16_t host_port, bool tls);
 
+void sdoProtCtxSetPhaseTimeout(uint32_t sec);
+void sdoProtCtxSetIoTimeout(uint32_t ms);
+void sdoProtCtxSetRunDeadline(uint64_t deadline);
+void sdoProtCtxSetMsgCallback(sdoSdkMsgCB cb);
+void sdoProtCtxSetEncoding(SDOProtCtx_t *prot_ctx, uint8_t encoding);
 int sdoProtCtxRun(SDOProtCtx_t *prot_ctx);
+int sdoProtCtxStart(SDOProtCtx_t *prot_ctx);
+int sdoProtCtxStep(SDOProtCtx_t *prot_ctx);
+int sdoProtCtxGetFd(SDOProtCtx_t *prot_ctx);
+uint64_t sdoProtCtxGetDeadline(SDOProtCtx_t *prot_ctx);
 void sdoProtCtxFree(SDOProtCtx_t *prot_ctx);
+void sdoProtCtxReleaseBuffers(void);
 
 #endif /* __SDOPROTCTX_H__ */
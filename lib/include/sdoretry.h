@@ -0,0 +1,33 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDORETRY_H__
+#define __SDORETRY_H__
+
+#include "sdotypes.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Failure tracking of a server (manufacturer, rendezvous or owner) */
+typedef struct sdoRetryEndpoint_s sdoRetryEndpoint_t;
+
+void sdoRetrySetPolicy(uint32_t baseMs, uint32_t capMs, uint32_t maxRetries,
+		       uint32_t breakerThreshold, uint32_t breakerCooldownSec);
+uint32_t sdoRetryMaxRetries(void);
+
+sdoRetryEndpoint_t *sdoRetryEndpoint(const char *dn, const SDOIPAddress_t *ip,
+				     uint16_t port);
+bool sdoRetryAllowed(sdoRetryEndpoint_t *ep);
+void sdoRetrySuccess(sdoRetryEndpoint_t *ep);
+void sdoRetryFailure(sdoRetryEndpoint_t *ep);
+
+void sdoRetrySetSleep(sdoSdkSleepCB sleep, uint32_t wakeWindowMs);
+void sdoRetryWait(uint32_t ms, sdoSdkSleepReason reason);
+
+void sdoRetrySetDeadline(uint64_t deadline);
+bool sdoRetryBackoff(uint32_t attempt);
+uint32_t sdoRetryDelay(uint32_t minMs);
+
+#endif /* __SDORETRY_H__ */
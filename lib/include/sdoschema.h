@@ -0,0 +1,87 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOSCHEMA_H__
+#define __SDOSCHEMA_H__
+
+#include "sdotypes.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Message schemas: a JSON object of a protocol message described as a table
+ * of its tags, in order, and where their values live in a C struct. One
+ * engine parses or emits any such object.
+ */
+typedef enum {
+	SDO_FIELD_TYPE_UINT,   // unsigned integer of 1, 2 or 4 bytes
+	SDO_FIELD_TYPE_BYTES,  // SDOByteArray_t *, "byte array in base64"
+	SDO_FIELD_TYPE_SLICE,  // SDOByteSlice_t, read only
+	SDO_FIELD_TYPE_CUSTOM, // read/write callbacks on the whole struct
+} SDOFieldType_t;
+
+typedef struct {
+	const char *tag;
+	uint8_t tagLen;
+	uint8_t type;
+	uint8_t size; // size of an integer member
+	size_t offset;
+	bool (*read)(SDOR_t *sdor, void *obj);
+	bool (*write)(SDOW_t *sdow, const void *obj);
+} SDOField_t;
+
+typedef struct {
+	const SDOField_t *fields;
+	int numFields;
+} SDOSchema_t;
+
+/* Zero valued, fails to compile if cond is false */
+#define SDO_SCHEMA_CHECK(cond) (0 * sizeof(char[(cond) ? 1 : -1]))
+
+#define SDO_FIELD_TAG(tag)                                                     \
+	tag, sizeof(tag) - 1 + SDO_SCHEMA_CHECK(sizeof(tag) <= SDO_TAG_MAX_LEN)
+
+#define SDO_FIELD_MEMBER(type, member, cond)                                   \
+	offsetof(type, member) +                                               \
+	    SDO_SCHEMA_CHECK(cond(sizeof(((type *)0)->member)))
+
+#define SDO_SCHEMA_IS_UINT(sz) ((sz) == 1 || (sz) == 2 || (sz) == 4)
+#define SDO_SCHEMA_IS_BYTES(sz) ((sz) == sizeof(SDOByteArray_t *))
+#define SDO_SCHEMA_IS_SLICE(sz) ((sz) == sizeof(SDOByteSlice_t))
+
+#define SDO_FIELD_UINT(tag, type, member)                                      \
+	{                                                                      \
+		SDO_FIELD_TAG(tag), SDO_FIELD_TYPE_UINT,                       \
+		    sizeof(((type *)0)->member),                               \
+		    SDO_FIELD_MEMBER(type, member, SDO_SCHEMA_IS_UINT), NULL,  \
+		    NULL                                                       \
+	}
+#define SDO_FIELD_BYTES(tag, type, member)                                     \
+	{                                                                      \
+		SDO_FIELD_TAG(tag), SDO_FIELD_TYPE_BYTES, 0,                   \
+		    SDO_FIELD_MEMBER(type, member, SDO_SCHEMA_IS_BYTES), NULL, \
+		    NULL                                                       \
+	}
+#define SDO_FIELD_SLICE(tag, type, member)                                     \
+	{                                                                      \
+		SDO_FIELD_TAG(tag), SDO_FIELD_TYPE_SLICE, 0,                   \
+		    SDO_FIELD_MEMBER(type, member, SDO_SCHEMA_IS_SLICE), NULL, \
+		    NULL                                                       \
+	}
+#define SDO_FIELD_CUSTOM(tag, read, write)                                     \
+	{                                                                      \
+		SDO_FIELD_TAG(tag), SDO_FIELD_TYPE_CUSTOM, 0, 0, read, write   \
+	}
+
+#define SDO_SCHEMA(fields)                                                     \
+	{                                                                      \
+		fields, sizeof(fields) / sizeof((fields)[0])                   \
+	}
+
+bool sdoSchemaRead(SDOR_t *sdor, const SDOSchema_t *schema, void *obj);
+bool sdoSchemaWrite(SDOW_t *sdow, const SDOSchema_t *schema, const void *obj);
+
+#endif /* __SDOSCHEMA_H__ */
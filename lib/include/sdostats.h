@@ -0,0 +1,27 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOSTATS_H__
+#define __SDOSTATS_H__
+
+#include "sdo.h"
+#include <stdint.h>
+#include <stdbool.h>
+
+void sdoStatsBind(sdoSdkStats *stats);
+sdoSdkStats *sdoStatsGet(void);
+
+void sdoStatsMsg(int msgType, uint32_t txBytes, uint32_t rxBytes,
+		 uint64_t waitUs, uint32_t retries, bool error);
+void sdoStatsMsgParsed(int msgType, uint64_t parseUs, uint64_t cryptoUs);
+void sdoStatsPhase(int firstMsgType, uint32_t ms, bool success);
+void sdoStatsRendezvous(uint32_t rvIndex);
+
+int sdoAllocStatsGet(sdoSdkAllocStats *stats);
+int sdoAllocStatsReset(void);
+void sdoAllocPhaseBegin(void);
+void sdoAllocPhaseEnd(sdoSdkAllocPhase phase);
+
+#endif /* __SDOSTATS_H__ */
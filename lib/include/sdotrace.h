@@ -0,0 +1,30 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+#ifndef __SDOTRACE_H__
+#define __SDOTRACE_H__
+
+#include <stdint.h>
+
+/*
+ * Timeline of the onboarding runs, with TRACE_EVENTS=<n>: a span from
+ * SDO_TRACE_START(v) to SDO_TRACE_END(cat, name, arg, v) is one event of
+ * the ring buffer dumped by sdoSdkTraceDump(). Without it, both compile to
+ * nothing and the arguments of SDO_TRACE_END are not evaluated.
+ */
+#if defined(SDO_TRACE)
+#include "network_al.h"
+
+void sdoTraceEvent(const char *cat, const char *name, int32_t arg,
+		   uint64_t startUs);
+
+#define SDO_TRACE_START(v) uint64_t v = sdoTimeUs()
+#define SDO_TRACE_END(cat, name, arg, v) sdoTraceEvent(cat, name, arg, v)
+#else
+#define SDO_TRACE_START(v) (void)0
+#define SDO_TRACE_END(cat, name, arg, v) (void)0
+#endif
+
+#endif /* __SDOTRACE_H__ */
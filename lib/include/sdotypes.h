@@ -17,12 +17,29 @@
  */
 typedef char *sdourl_t;
 
+/*
+ * Flat containers: the rendezvous list and the ServiceInfo KVs hold their
+ * elements in one array, indexed directly and appended to in place,
+ * instead of in a chain of separately allocated nodes.
+ */
+#define SDO_ARRAY_MIN 4 // capacity of an array when first grown
+void *sdoArrayGrow(void *items, uint32_t *cap, uint32_t count, size_t size);
+
 // Generic bit holder
 typedef struct {
 	size_t byteSz;
 	uint8_t *bytes;
 } SDOBits_t;
 
+/*
+ * Largest bytes allocated along with their SDOBits_t (or SDOHash_t) in one
+ * allocation: nonces, GUIDs, IVs, hashes and HMACs. The bytes of others,
+ * and bytes resized later, have an allocation of their own. 0 for none.
+ */
+#ifndef SDO_BITS_INLINE
+#define SDO_BITS_INLINE 64
+#endif
+
 SDOBits_t *sdoBitsInit(SDOBits_t *b, int byteSz);
 SDOBits_t *sdoBitsAlloc(int byteSz);
 SDOBits_t *sdoBitsAllocWith(int byteSz, uint8_t *data);
@@ -50,6 +67,7 @@ typedef SDOBits_t SDOByteArray_t;
 SDOByteArray_t *SDOByteArrayInit(SDOByteArray_t *bn, int byteSz);
 #endif
 SDOByteArray_t *sdoByteArrayAlloc(int byteSz);
+SDOByteArray_t *sdoByteArrayAllocTransient(int byteSz);
 SDOByteArray_t *sdoByteArrayAllocWithInt(int val);
 SDOByteArray_t *sdoByteArrayAllocWithByteArray(uint8_t *ba, int baLen);
 void sdoByteArrayFree(SDOByteArray_t *ba);
@@ -71,6 +89,25 @@ int sdoByteArrayReadWithType(SDOR_t *sdor, SDOByteArray_t *ba,
 void SDOByteArrayWrite(SDOW_t *sdow, SDOByteArray_t *ba);
 void sdoByteArrayWriteChars(SDOW_t *sdow, SDOByteArray_t *ba);
 
+/*
+ * Byte array slice: a non-owning view of a base64 byte array in the SDOR
+ * block. It is valid until the block is flushed or the next block is
+ * received, and is decoded only when copied or compared. A slice of a CBOR
+ * message is raw, its text is the bytes themselves.
+ */
+typedef struct {
+	const uint8_t *b64; // base64 text in the SDOR block
+	size_t b64Sz;
+	size_t byteSz; // length of the decoded bytes
+	bool raw;
+} SDOByteSlice_t;
+
+int sdoByteSliceRead(SDOR_t *sdor, SDOByteSlice_t *bs);
+int sdoByteSliceReadChars(SDOR_t *sdor, SDOByteSlice_t *bs);
+int sdoByteSliceCopy(const SDOByteSlice_t *bs, uint8_t *buf, size_t bufSz);
+bool sdoByteSliceEqual(const SDOByteSlice_t *bs, const uint8_t *bytes,
+		       size_t len);
+
 // Bignum
 
 typedef struct {
@@ -125,6 +162,7 @@ char *sdoGuidToString(SDOByteArray_t *g, char *buf, int bufSz);
 /* Nonce  */
 void sdoNonceInitRand(SDOByteArray_t *n);
 char *sdoNonceToString(uint8_t *n, char *buf, int bufSz);
+char *sdoNonceSliceToString(const SDOByteSlice_t *n, char *buf, int bufSz);
 bool sdoNonceEqual(SDOByteArray_t *n1, SDOByteArray_t *n2);
 
 typedef struct _sdo_hash_t {
@@ -156,13 +194,16 @@ SDOHash_t *sdoHashAllocEmpty(void);
 SDOHash_t *sdoHashAlloc(int hashType, int size);
 void sdoHashFree(SDOHash_t *hp);
 int sdoHashRead(SDOR_t *sdor, SDOHash_t *hp);
+int sdoHashSliceRead(SDOR_t *sdor, int *hashType, SDOByteSlice_t *bs);
 void sdoHashWrite(SDOW_t *sdow, SDOHash_t *hp);
 void sdoHashNullWrite(SDOW_t *sdow);
 char *sdoHashTypeToString(int hashType);
 char *sdoHashToString(SDOHash_t *hp, char *buf, int bufSz);
 
-bool sdoBeginReadHMAC(SDOR_t *sdor, int *sigBlockStart);
-bool sdoEndReadHMAC(SDOR_t *sdor, SDOHash_t **hmac, int sigBlockStart);
+bool sdoBeginReadHMAC(SDOR_t *sdor, int *hmacTap);
+bool sdoEndReadHMAC(SDOR_t *sdor, SDOHash_t **hmac, int hmacTap);
+int sdoHashTapBegin(SDOR_t *sdor);
+bool sdoHashTapEnd(SDOR_t *sdor, int tap, SDOHash_t *hash);
 
 typedef SDOByteArray_t SDOKeyExchange_t;
 
@@ -230,6 +271,42 @@ void sdoAppIDWrite(SDOW_t *sdow);
 
 //#define SDO_PK_ENC_DEFAULT SDO_CRYPTO_PUB_KEY_ENCODING_X509
 #define SDO_PK_ENC_DEFAULT SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP
+
+/*
+ * SDO_SINGLE_SUITE builds take owner keys of one algorithm and encoding:
+ * RSA with PK_ENC=rsa, else ECDSA on the curve of DA (P-256 but for
+ * ECDSA384_DA). Keys of other suites are refused when they are read, so
+ * that the code using them takes the suite as a constant and the branches
+ * on the other suites compile out. Device keys are not owner keys, but
+ * never RSA.
+ */
+#if defined(SDO_SINGLE_SUITE)
+#if defined(PK_ENC_RSA)
+#define SDO_SUITE_PKALG SDO_CRYPTO_PUB_KEY_ALGO_RSA
+#define SDO_SUITE_PKENC SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP
+#elif defined(ECDSA384_DA)
+#define SDO_SUITE_PKALG SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp384
+#define SDO_SUITE_PKENC SDO_CRYPTO_PUB_KEY_ENCODING_X509
+#else
+#define SDO_SUITE_PKALG SDO_CRYPTO_PUB_KEY_ALGO_ECDSAp256
+#define SDO_SUITE_PKENC SDO_CRYPTO_PUB_KEY_ENCODING_X509
+#endif
+#define SDO_SUITE_ALG(alg) SDO_SUITE_PKALG
+#define SDO_SUITE_ENC(enc) SDO_SUITE_PKENC
+#define SDO_SUITE_KEY(enc, alg)                                                \
+	((enc) == SDO_SUITE_PKENC && (alg) == SDO_SUITE_PKALG)
+#if defined(PK_ENC_RSA)
+#define SDO_PK_IS_RSA(pk) ((pk)->pkenc == SDO_SUITE_PKENC)
+#else
+#define SDO_PK_IS_RSA(pk) false
+#endif
+#else
+#define SDO_SUITE_ALG(alg) (alg)
+#define SDO_SUITE_ENC(enc) (enc)
+#define SDO_SUITE_KEY(enc, alg) true
+#define SDO_PK_IS_RSA(pk)                                                      \
+	((pk)->pkenc == SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP)
+#endif
 // Define the encryption values
 //#define SDOEAlgAES_ECB_NoPadding 1
 
@@ -241,11 +318,19 @@ typedef struct {
 } SDOCertChain_t;
 SDOCertChain_t *sdoCertChainRead(SDOR_t *sdor);
 
+/*
+ * Public keys are not changed once built, so they are shared rather than
+ * copied: sdoPublicKeyClone() takes a reference and sdoPublicKeyFree()
+ * drops one, the key is freed with its last reference. References are
+ * taken and dropped by the thread of the SDK instance only.
+ */
 typedef struct {
 	int pkalg;
 	int pkenc;
 	SDOByteArray_t *key1; // in RSA, the Modulus/ binary for DSA
 	SDOByteArray_t *key2; // In RSA, the Exponent
+	uint32_t refs;	      // references besides the first
+	SDOHash_t *pkh;	      // hash of the key, see sdoPubKeyHashOf()
 } SDOPublicKey_t;
 
 typedef struct {
@@ -312,8 +397,47 @@ bool sdoWriteIV(SDOEncryptedPacket_t *pkt, SDOIV_t *ps_iv, int len);
 
 #define SDO_AES_128_BLOCK_SIZE 16
 
+/*
+ * Fragment cache: the values of the messages of a device that do not change
+ * over its lifetime, encoded once with the encoding of a message and copied
+ * into the next ones as is. A fragment is encoded again if the bytes it is
+ * made of differ from the ones it was encoded from.
+ */
+typedef enum {
+	SDO_FRAG_AI, // application id, "ai"
+	SDO_FRAG_EA, // device SigInfo, "eA"
+	SDO_FRAG_PK, // device public key, "pk" after a signed body
+	SDO_FRAG_KX, // key exchange suite name, "kx"
+	SDO_FRAG_CS, // cipher suite name, "cs"
+	SDO_FRAG_G2, // device GUID, "g2"
+	SDO_FRAG_COUNT
+} sdoFragId_t;
+
+typedef struct {
+	SDOByteArray_t *src; // bytes it was encoded from, NULL if constant
+	SDOByteArray_t *enc; // the value, NULL if not encoded yet
+	uint8_t encoding;    // SDO_ENCODING_* of enc
+} sdoFrag_t;
+
+typedef struct {
+	sdoFrag_t frag[SDO_FRAG_COUNT];
+} sdoFragCache_t;
+
+bool sdoFragWrite(SDOW_t *sdow, sdoFragCache_t *cache, sdoFragId_t id,
+		  const uint8_t *src, size_t srcLen,
+		  bool (*write)(SDOW_t *sdow, const void *obj),
+		  const void *obj);
+void sdoFragAppIDWrite(SDOW_t *sdow, sdoFragCache_t *cache);
+void sdoFragGidWrite(SDOW_t *sdow, sdoFragCache_t *cache);
+void sdoFragGuidWrite(SDOW_t *sdow, sdoFragCache_t *cache,
+		      SDOByteArray_t *guid);
+void sdoFragStringWrite(SDOW_t *sdow, sdoFragCache_t *cache, sdoFragId_t id,
+			SDOString_t *str);
+void sdoFragCacheFree(sdoFragCache_t *cache);
+
 typedef struct {
 	int sigBlockStart;
+	int tap; // tap on the signed region of a streamed message
 	SDOPublicKey_t *pk;
 	SDOByteArray_t *sg;
 } SDOSig_t;
@@ -327,14 +451,14 @@ typedef struct {
 bool sdoBeginReadSignature(SDOR_t *sdor, SDOSig_t *sig);
 bool sdoEndReadSignature(SDOR_t *sdor, SDOSig_t *sig);
 bool sdoEndReadSignatureFull(SDOR_t *sdor, SDOSig_t *sig,
-			     SDOPublicKey_t **getpk);
-bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig);
+			     SDOPublicKey_t **getpk, void *batch);
+bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig,
+			  sdoFragCache_t *frags);
 bool sdoBeginWriteSignature(SDOW_t *sdow, SDOSig_t *sig, SDOPublicKey_t *pk);
 bool sdoOVSignatureVerification(SDOR_t *sdor, SDOSig_t *sig,
-				SDOPublicKey_t *pk);
+				SDOPublicKey_t *pk, void *batch);
 
 typedef struct SDOKeyValue_s {
-	struct SDOKeyValue_s *next;
 	SDOString_t *key;
 	SDOString_t *val;
 } SDOKeyValue_t;
@@ -347,7 +471,6 @@ void sdoKVWrite(SDOW_t *sdow, SDOKeyValue_t *kv);
 
 typedef struct SDORendezvous_s {
 	int numParams;
-	struct SDORendezvous_s *next;
 	SDOString_t *only;
 	SDOIPAddress_t *ip;
 	uint32_t *po;
@@ -375,7 +498,8 @@ char *sdoRendezvousToString(SDORendezvous_t *rv, char *buf, int bufsz);
 
 typedef struct SDORendezvousList_s {
 	uint16_t numEntries;
-	SDORendezvous_t *rvEntries;
+	uint32_t capEntries;
+	SDORendezvous_t *rvEntries; // array of numEntries
 } SDORendezvousList_t;
 
 SDORendezvousList_t *sdoRendezvousListAlloc(void);
@@ -388,14 +512,15 @@ bool sdoRendezvousListWrite(SDOW_t *sdow, SDORendezvousList_t *list);
 
 typedef struct SDOServiceInfo_s {
 	int numKV;
-	SDOKeyValue_t *kv;
+	uint32_t capKV;
+	SDOKeyValue_t *kv; // array of numKV
 } SDOServiceInfo_t;
 
 SDOServiceInfo_t *sdoServiceInfoAlloc(void);
 SDOServiceInfo_t *sdoServiceInfoAllocWith(char *key, char *val);
 void sdoServiceInfoFree(SDOServiceInfo_t *si);
-SDOKeyValue_t **sdoServiceInfoFetch(SDOServiceInfo_t *si, char *key);
-SDOKeyValue_t **sdoServiceInfoGet(SDOServiceInfo_t *si, int keyNum);
+SDOKeyValue_t *sdoServiceInfoFetch(SDOServiceInfo_t *si, char *key);
+SDOKeyValue_t *sdoServiceInfoGet(SDOServiceInfo_t *si, int keyNum);
 bool sdoServiceInfoAddKVStr(SDOServiceInfo_t *si, char *key, char *val);
 bool sdoServiceInfoAddKV(SDOServiceInfo_t *si, SDOKeyValue_t *kv);
 bool sdoSignatureVerification(SDOByteArray_t *plainText, SDOByteArray_t *sg,
@@ -415,14 +540,76 @@ typedef struct sdoSdkServiceInfoModuleList_s {
 	int modulePsiIndex;
 	int moduleDsiCount;
 	int moduleOsiIndex;
+	bool osiChunks; // takes the OSI values in place, SDO_SI_SET_OSI_CHUNK
+	bool dsiAsync;	// gives its DSIs on a worker, SDO_SI_DSI_ASYNC
+	bool osiAsync;	// takes its OSIs on a worker, SDO_SI_OSI_ASYNC
+	bool osiOnce;	// skips the OSIs it applied, SDO_SI_OSI_ONCE
+	void *osiWorker; // applying its OSIs of this TO2 run, or NULL
+	int dsiRound;	// of its first DSI in the DSI snapshot
+	char osiChunkMsg[SDO_MODULE_MSG_LEN + 1]; // message of the last chunk
+	size_t osiChunkOffset;			   // of the next chunk
+	struct sdoSdkServiceInfoModuleReg_s *reg;   // registry, NULL if none
+	uint32_t round; // of reg the PSI and OSI indexes are of
 	struct sdoSdkServiceInfoModuleList_s *next; // ptr to next module node
 } sdoSdkServiceInfoModuleList_t;
 
+/* Slots of the index of the modules by name, half of them free at most */
+#define SDO_MODULE_SLOTS (2 * SDO_MAX_MODULES)
+
+/*
+ * Module registry: the list in the order of registration, for the DSIs,
+ * and an index of it by name (open addressing), for the PSIs and OSIs.
+ * The nodes of the list are held in the registry itself, in order.
+ * Bumping round starts the PSI and OSI indexes of all modules over.
+ */
+typedef struct sdoSdkServiceInfoModuleReg_s {
+	sdoSdkServiceInfoModuleList_t node[SDO_MAX_MODULES];
+	sdoSdkServiceInfoModuleList_t *head;
+	sdoSdkServiceInfoModuleList_t *tail;
+	uint32_t count;
+	uint32_t round;
+	sdoSdkServiceInfoModuleList_t *slot[SDO_MODULE_SLOTS];
+} sdoSdkServiceInfoModuleReg_t;
+
 typedef struct sdoSvInfoDsiInfo_s {
 	sdoSdkServiceInfoModuleList_t *list_dsi;
 	int moduleDsiIndex;
 } sdoSvInfoDsiInfo_t;
 
+/*
+ * DSI snapshot: the DSIs of the platform and modules encoded once, as the
+ * members of the "dsi" of each msg46, for all TO2 runs of the device until
+ * gen moves on (sdoSdkServiceInfoDsiChanged).
+ */
+typedef struct sdoSvInfoDsiSnap_s {
+	uint32_t gen;	   // bumped when a module's DSIs change
+	uint32_t builtGen; // gen the rounds were built at
+	uint8_t encoding;  // SDO_ENCODING_* of the rounds
+	int rounds;	   // msg46 messages, 0 if none built
+	SDOByteArray_t **round;
+	void *worker;	   // building the rounds of SDO_SI_DSI_ASYNC ones
+} sdoSvInfoDsiSnap_t;
+
+/* Pairs kept at most, those applied past them are applied again */
+#ifndef OSI_CACHE_MAX
+#define OSI_CACHE_MAX 64
+#endif
+#define OSI_CACHE_GUID_LEN 16
+#define OSI_CACHE_DIGEST_LEN 16
+
+/*
+ * OSI pairs applied by the modules of an instance taking SDO_SI_OSI_ONCE,
+ * see sdoosicache.h. The first prior digests are of earlier TO2 runs, and
+ * the only ones skipped; those after them are of the run going on.
+ */
+typedef struct sdoOsiCache_s {
+	uint8_t guid[OSI_CACHE_GUID_LEN];
+	uint8_t digest[OSI_CACHE_MAX][OSI_CACHE_DIGEST_LEN];
+	size_t prior; // digests of earlier runs
+	size_t count;
+	size_t saved; // count in storage
+} sdoOsiCache_t;
+
 /* exposed API for modules to registr */
 void sdoSdkServiceInfoRegisterModule(sdoSdkServiceInfoModule *module);
 void printServiceInfoModuleList(void);
@@ -438,6 +625,11 @@ bool sdoGetDSICount(sdoSdkServiceInfoModuleList_t *moduleList, int *modmescount,
 bool sdoModDataKV(char *modName, sdoSdkSiKeyValue *sv_kv);
 bool sdoConstructModuleDSI(sdoSvInfoDsiInfo_t *dsiInfo, sdoSdkSiKeyValue *sv_kv,
 			   int *cbReturnVal);
+bool sdoDsiSnapGet(sdoSvInfoDsiSnap_t *snap, SDOServiceInfo_t *si,
+		   sdoSdkServiceInfoModuleList_t *moduleList, uint8_t encoding);
+const SDOByteArray_t *sdoDsiSnapRound(sdoSvInfoDsiSnap_t *snap, int r);
+void sdoDsiSnapJoin(sdoSvInfoDsiSnap_t *snap);
+void sdoDsiSnapFree(sdoSvInfoDsiSnap_t *snap);
 bool sdoModKVWrite(SDOW_t *sdow, sdoSdkSiKeyValue *kv);
 void sdoSVKeyValueFree(sdoSdkSiKeyValue *sv_kv);
 
@@ -445,13 +637,21 @@ bool sdoSupplyModulePSI(sdoSdkServiceInfoModuleList_t *moduleList,
 			char *mod_name, sdoSdkSiKeyValue *sv_kv,
 			int *cbReturnVal);
 bool sdoSupplyModuleOSI(sdoSdkServiceInfoModuleList_t *moduleList,
-			char *mod_name, sdoSdkSiKeyValue *sv_kv,
-			int *cbReturnVal);
+			sdoOsiCache_t *osiCache, char *mod_name,
+			sdoSdkSiKeyValue *sv_kv, int *cbReturnVal);
 bool sdoOsiParsing(SDOR_t *sdor, sdoSdkServiceInfoModuleList_t *moduleList,
-		   sdoSdkSiKeyValue *kv, int *cbReturnVal);
+		   sdoOsiCache_t *osiCache, sdoSdkSiKeyValue *kv,
+		   int *cbReturnVal);
 bool sdoOsiHandling(sdoSdkServiceInfoModuleList_t *moduleList,
-		    sdoSdkSiKeyValue *sv, int *cbReturnVal);
+		    sdoOsiCache_t *osiCache, sdoSdkSiKeyValue *sv,
+		    int *cbReturnVal);
+bool sdoOsiJoin(sdoSdkServiceInfoModuleList_t *moduleList);
 void sdoSvInfoClearModulePsiOsiIndex(sdoSdkServiceInfoModuleList_t *moduleList);
+bool sdoModuleRegAdd(sdoSdkServiceInfoModuleReg_t *reg,
+		     const sdoSdkServiceInfoModule *module);
+void sdoModuleRegFree(sdoSdkServiceInfoModuleReg_t *reg);
+sdoSdkServiceInfoModuleList_t *
+sdoModuleLookup(sdoSdkServiceInfoModuleList_t *moduleList, const char *name);
 bool sdoConstructModuleList(sdoSdkServiceInfoModuleList_t *moduleList,
 			    char **mod_name);
 
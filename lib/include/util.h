@@ -29,12 +29,54 @@ extern "C" {
 
 int atoi(char *ptr);
 int isalnum(int c);
+
+#define sdoAllocTransient(size) sdoAlloc(size)
+#define sdoArenaReset()
+#define sdoArenaRelease()
+#define sdoScratchLease(size) sdoAlloc(size)
+#define sdoScratchRelease(buf) TEE_Free(buf)
 #else
 #define sdoFree(x)                                                             \
 	{                                                                      \
-		free(x);                                                       \
+		sdoFreeMem(x);                                                 \
 		x = NULL;                                                      \
 	}
+
+void sdoFreeMem(void *ptr);
+void *sdoAllocTransient(int size);
+void sdoArenaReset(void);
+void sdoArenaRelease(void);
+
+/*
+ * Scratch buffers, for the large temporary buffers of the message handlers
+ * and the network layer (headers, debug strings) that would otherwise sit
+ * on the stack. A lease is zeroed, of at most SDO_SCRATCH_SIZE bytes, and
+ * is given back with sdoScratchRelease() before the function returns; up
+ * to SDO_SCRATCH_SLOTS are out at once per thread. Writing past the leased
+ * size is reported on release.
+ */
+#define SDO_SCRATCH_SIZE 1024
+#define SDO_SCRATCH_SLOTS 3
+void *sdoScratchLease(size_t size);
+void sdoScratchRelease(void *buf);
+#endif
+
+/*
+ * Several SDK instances (sdoSdkCreate) only run at once on linux. State that
+ * does not outlive a call is kept per thread, the few process wide
+ * resources are guarded by a mutex.
+ */
+#ifdef TARGET_OS_LINUX
+#include <pthread.h>
+#define SDO_THREAD_LOCAL __thread
+#define SDO_MUTEX(name) static pthread_mutex_t name = PTHREAD_MUTEX_INITIALIZER
+#define SDO_LOCK(name) pthread_mutex_lock(&(name))
+#define SDO_UNLOCK(name) pthread_mutex_unlock(&(name))
+#else
+#define SDO_THREAD_LOCAL
+#define SDO_MUTEX(name) static int name
+#define SDO_LOCK(name) ((void)(name))
+#define SDO_UNLOCK(name) ((void)(name))
 #endif
 
 #define b64charCheck(y)                                                        \
@@ -58,6 +100,21 @@ typedef enum log_level {
 #include <time.h>
 #include <string.h>
 #define TIMESTAMP_LEN 9
+#ifdef LOG_ASYNC
+/*
+ * With LOG_ASYNC=true (linux) a message is put in a ring buffer as its
+ * format and arguments, and printed by a background thread. It is dropped
+ * before anything is done when its level is above that of the subsystem
+ * of the file, see sdoLogSetLevel(). The format must be a literal, it is
+ * kept by reference until the message is printed.
+ */
+#define LOG(level, fmt, ...)                                                   \
+	{                                                                      \
+		if ((level) <= LOG_LEVEL && sdoLogOn((level), __FILE__))      \
+			sdoLogPut((level), __FILE__, __LINE__, "" fmt,         \
+				  ##__VA_ARGS__);                              \
+	}
+#else
 #define LOG(level, ...)                                                        \
 	{                                                                      \
 		if (level <= LOG_LEVEL) {                                      \
@@ -72,6 +129,7 @@ typedef enum log_level {
 		}                                                              \
 	}
 #endif
+#endif
 
 #define BUFF_SIZE_0_BYTES 0
 #define BUFF_SIZE_4_BYTES 4
@@ -165,9 +223,48 @@ int read_buffer_from_file(const char *filename, void *buffer, size_t size);
  */
 void *sdoAlloc(int size);
 
+/*
+ * Resize a buffer of sdoAlloc() or sdoRealloc(), like realloc(). The bytes
+ * beyond the old size are not set.
+ */
+void *sdoRealloc(void *ptr, int size);
+
+/*
+ * With ALLOC_STATS=true the allocations are counted per subsystem, told by
+ * the source file allocating.
+ */
+void *sdoAllocAt(int size, const char *file);
+void *sdoReallocAt(void *ptr, int size, const char *file);
+#if defined(ALLOC_STATS) && !defined(TARGET_OS_OPTEE)
+#define sdoAlloc(size) sdoAllocAt(size, __FILE__)
+#define sdoRealloc(ptr, size) sdoReallocAt(ptr, size, __FILE__)
+#endif
+
+/*
+ * With STATIC_MEM=true all of the above is served from static pools of
+ * fixed-size blocks (see the memory plan in util.c), the heap is not used.
+ * The largest blocks hold a whole message block (SDOR/SDOW), which is
+ * taken at that size at once so that it never moves.
+ */
+#ifndef SDO_MEM_BLOCK_SIZE
+#define SDO_MEM_BLOCK_SIZE 8192
+#endif
+
 /* Print timestamp */
 int print_timestamp(void);
 
+#ifdef LOG_ASYNC
+/* Records in the ring buffer of the messages, a power of two */
+#ifndef LOG_ASYNC_SLOTS
+#define LOG_ASYNC_SLOTS 512
+#endif
+bool sdoLogOn(int level, const char *file);
+void sdoLogPut(int level, const char *file, int line, const char *fmt, ...)
+    __attribute__((format(printf, 4, 5)));
+#endif
+int sdoLogSetLevel(int tag, int level);
+void sdoLogFlush(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -65,7 +65,7 @@
 /* TODO: Device serial number source need to be fixed */
 static const char *device_serial = "abcdef";
 static const char *model_number = "0";
-static char key_id[MAX_KEY_ID_SIZE];
+static SDO_THREAD_LOCAL char key_id[MAX_KEY_ID_SIZE];
 
 /**
  * Internal API
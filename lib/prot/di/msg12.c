@@ -11,6 +11,7 @@
 
 #include "util.h"
 #include "sdoprot.h"
+#include "sdoschema.h"
 
 /**
  * msg12() - DI.SetHMAC
@@ -24,24 +25,36 @@
  *    "hmac": Hash
  * }
  */
+static bool setHMACWriteHMAC(SDOW_t *sdow, const void *obj)
+{
+	const SDOProt_t *ps = obj;
+
+	sdoHashWrite(sdow, ps->newOVHdrHMAC);
+	return true;
+}
+
+static const SDOField_t setHMACFields[] = {
+    SDO_FIELD_CUSTOM("hmac", NULL, setHMACWriteHMAC),
+};
+static const SDOSchema_t setHMAC = SDO_SCHEMA(setHMACFields);
+
 int32_t msg12(SDOProt_t *ps)
 {
 	int ret = -1;
 
-	/* Prepare the block for msg12 */
-	sdoWNextBlock(&ps->sdow, SDO_DI_SET_HMAC);
-	sdoWBeginObject(&ps->sdow);
-
-	sdoWriteTag(&ps->sdow, "hmac");
 	if (!ps->newOVHdrHMAC) {
 		LOG(LOG_ERROR, "OVHdrHMAC is NULL MSG#12\n");
 		goto err;
 	}
 
+	/* Prepare the block for msg12 */
+	sdoWNextBlock(&ps->sdow, SDO_DI_SET_HMAC);
+
 	/* Write the HMAC and send it to manufacturer */
-	sdoHashWrite(&ps->sdow, ps->newOVHdrHMAC);
+	if (!sdoSchemaWrite(&ps->sdow, &setHMAC, ps)) {
+		goto err;
+	}
 	sdoHashFree(ps->newOVHdrHMAC);
-	sdoWEndObject(&ps->sdow);
 
 	/* Mark as success and goto msg13 */
 	ps->state = SDO_STATE_DI_DONE;
@@ -47,7 +47,7 @@ int32_t msg13(SDOProt_t *ps)
 
 	/* Update the state of device to be ready for TO1 */
 	ps->devCred->ST = SDO_DEVICE_STATE_READY1;
-	if (store_credential(ps->devCred) != 0) {
+	if (store_credential_deferred(ps->devCred) != 0) {
 		LOG(LOG_ERROR, "Failed to store updated device state\n");
 		goto err;
 	}
@@ -9,6 +9,7 @@
  */
 
 #include "sdoprot.h"
+#include "sdoschema.h"
 
 /**
  * msg30() - TO1.HelloSDO
@@ -31,20 +32,35 @@
  * Value = 13 (ECDSA256): 128bit number
  * Value = 14 (ECDSA384): 128bit number
  */
-int32_t msg30(SDOProt_t *ps)
+struct helloSdo {
+	SDOByteArray_t *g2;
+	sdoFragCache_t *frags;
+};
+
+static bool helloSdoWriteEA(SDOW_t *sdow, const void *obj)
 {
-	sdoWNextBlock(&ps->sdow, SDO_TO1_TYPE_HELLO_SDO);
-	sdoWBeginObject(&ps->sdow);
+	const struct helloSdo *msg = obj;
+
+	sdoFragGidWrite(sdow, msg->frags);
+	return true;
+}
 
-	/* Write GUID received during DI */
-	sdoWriteTag(&ps->sdow, "g2");
-	sdoByteArrayWriteChars(&ps->sdow, ps->devCred->ownerBlk->guid);
+static const SDOField_t helloSdoFields[] = {
+    /* GUID received during DI */
+    SDO_FIELD_BYTES("g2", struct helloSdo, g2),
+    /* The siginfo for RV to use and prepare next msg */
+    SDO_FIELD_CUSTOM("eA", NULL, helloSdoWriteEA),
+};
+static const SDOSchema_t helloSdo = SDO_SCHEMA(helloSdoFields);
 
-	/* Write the siginfo for RV to use and prepare next msg */
-	sdoWriteTag(&ps->sdow, "eA");
-	sdoGidWrite(&ps->sdow);
+int32_t msg30(SDOProt_t *ps)
+{
+	struct helloSdo msg = {ps->devCred->ownerBlk->guid, ps->frags};
 
-	sdoWEndObject(&ps->sdow);
+	sdoWNextBlock(&ps->sdow, SDO_TO1_TYPE_HELLO_SDO);
+	if (!sdoSchemaWrite(&ps->sdow, &helloSdo, &msg)) {
+		return -1;
+	}
 
 	/* Move to next state (msg31) */
 	ps->state = SDO_STATE_TO1_RCV_HELLO_SDOACK;
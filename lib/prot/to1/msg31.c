@@ -10,6 +10,7 @@
 
 #include "util.h"
 #include "sdoprot.h"
+#include "sdoschema.h"
 
 /**
  * msg31() - TO1.HelloSDOAck
@@ -38,11 +39,28 @@
  * }
  *
  */
+static bool helloSdoAckReadEB(SDOR_t *sdor, void *obj)
+{
+	(void)obj;
+	/* Handle both EPID and ECDSA cases */
+	if (0 != sdoEBRead(sdor)) {
+		LOG(LOG_ERROR, "EB read in message 31 failed\n");
+		return false;
+	}
+	return true;
+}
+
+static const SDOField_t helloSdoAckFields[] = {
+    SDO_FIELD_BYTES("n4", SDOProt_t, n4),
+    SDO_FIELD_CUSTOM("eB", helloSdoAckReadEB, NULL),
+};
+static const SDOSchema_t helloSdoAck = SDO_SCHEMA(helloSdoAckFields);
+
 int32_t msg31(SDOProt_t *ps)
 {
 	int ret = -1;
 	char prot[] = "SDOProtTO1";
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 
 	/* Read network data from internal buffer */
 	if (!sdoProtRcvMsg(&ps->sdor, &ps->sdow, prot, &ps->state)) {
@@ -50,37 +68,17 @@ int32_t msg31(SDOProt_t *ps)
 		goto err;
 	}
 
-	if (!sdoRBeginObject(&ps->sdor)) {
-		goto err;
-	}
-
-	/* Read "n4" tag, and it's data */
-	if (!sdoReadExpectedTag(&ps->sdor, "n4")) {
-		goto err;
-	}
-
-	ps->n4 = sdoByteArrayAlloc(SDO_NONCE_BYTES);
-	if (!ps->n4 || !sdoByteArrayReadChars(&ps->sdor, ps->n4)) {
+	/* Read "n4" and the eB data: EPID or ECDSA */
+	if (!sdoSchemaRead(&ps->sdor, &helloSdoAck, ps)) {
 		goto err;
 	}
 
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Received n4: %s\n",
-	    sdoNonceToString(ps->n4->bytes, buf, sizeof buf) ? buf : "");
-
-	/* Read eB data: EPID or ECDSA */
-	if (!sdoReadExpectedTag(&ps->sdor, "eB")) {
-		goto err;
-	}
-
-	/* Handle both EPID and ECDSA cases */
-	if (0 != sdoEBRead(&ps->sdor)) {
-		LOG(LOG_ERROR, "EB read in message 31 failed\n");
-		goto err;
-	}
-
-	if (!sdoREndObject(&ps->sdor)) {
-		goto err;
-	}
+	    buf && sdoNonceToString(ps->n4->bytes, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	sdoRFlush(&ps->sdor);
 
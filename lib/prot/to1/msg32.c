@@ -10,6 +10,7 @@
 
 #include "util.h"
 #include "sdoprot.h"
+#include "sdoschema.h"
 #include "sdoCryptoApi.h"
 
 /**
@@ -30,6 +31,32 @@
  * --- Message Format Ends---
  *
  */
+static bool proveToSdoWriteAI(SDOW_t *sdow, const void *obj)
+{
+	const SDOProt_t *ps = obj;
+
+	sdoFragAppIDWrite(sdow, ps->frags);
+	return true;
+}
+
+static bool proveToSdoWriteG2(SDOW_t *sdow, const void *obj)
+{
+	const SDOProt_t *ps = obj;
+
+	/* The GUID received during DI */
+	sdoFragGuidWrite(sdow, ps->frags, ps->devCred->ownerBlk->guid);
+	return true;
+}
+
+/* TODO: Add support for epk defined in spec 0.8 */
+static const SDOField_t proveToSdoFields[] = {
+    SDO_FIELD_CUSTOM("ai", NULL, proveToSdoWriteAI),
+    /* The same nonce which was received in msg31 */
+    SDO_FIELD_BYTES("n4", SDOProt_t, n4),
+    SDO_FIELD_CUSTOM("g2", NULL, proveToSdoWriteG2),
+};
+static const SDOSchema_t proveToSdo = SDO_SCHEMA(proveToSdoFields);
+
 int32_t msg32(SDOProt_t *ps)
 {
 	int ret = -1;
@@ -51,33 +78,22 @@ int32_t msg32(SDOProt_t *ps)
 		goto err;
 	}
 
-	sdoWBeginObject(&ps->sdow);
-
-	/* Write the "ai" tag */
-	sdoWriteTag(&ps->sdow, "ai");
-	sdoAppIDWrite(&ps->sdow);
-
-	/* Write back the same nonce which was received in msg31 */
-	sdoWriteTag(&ps->sdow, "n4");
 	if (!ps->n4) {
 		LOG(LOG_ERROR, "ps->n4 is empty MSG#32\n");
 		goto err;
 	}
 
+	if (!sdoSchemaWrite(&ps->sdow, &proveToSdo, ps)) {
+		goto err;
+	}
+
 	/* FIXME: Move to error handling. If TO1 restarts, we will leak memory
 	 */
-	sdoByteArrayWriteChars(&ps->sdow, ps->n4);
 	sdoByteArrayFree(ps->n4);
 	ps->n4 = NULL;
 
-	/* Write the GUID received during DI */
-	sdoWriteTag(&ps->sdow, "g2");
-	sdoByteArrayWriteChars(&ps->sdow, ps->devCred->ownerBlk->guid);
-	/* TODO: Add support for epk defined in spec 0.8 */
-	sdoWEndObject(&ps->sdow);
-
 	/* Fill in the pk and sg based on Device Attestation selected */
-	if (sdoEndWriteSignature(&ps->sdow, &sig) != true) {
+	if (sdoEndWriteSignature(&ps->sdow, &sig, ps->frags) != true) {
 		LOG(LOG_ERROR, "Failed in writing the signature\n");
 		goto err;
 	}
@@ -11,6 +11,7 @@
 #include "safe_lib.h"
 #include "util.h"
 #include "sdoprot.h"
+#include "sdonet.h"
 
 /**
  * msg33() - TO1.SDORedirect
@@ -38,7 +39,7 @@ int32_t msg33(SDOProt_t *ps)
 	int sigBlockSz = -1;
 	int sigBlockEnd = -1;
 	SDOHash_t *obHash = NULL;
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	uint8_t *plainText = NULL;
 	SDOPublicKey_t *tempPk = NULL;
 	char prot[] = "SDOProtTO1";
@@ -89,6 +90,9 @@ int32_t msg33(SDOProt_t *ps)
 	}
 	ps->port1 = sdoReadUInt(&ps->sdor);
 
+	/* Connect to the owner while the rest of TO1 and TO2 setup run */
+	sdoOwnerPreconnect(ps->dns1, &ps->i1, (uint16_t)ps->port1);
+
 	/* Read "to0dh" tag/value: Owner hash sent to RV */
 	if (!sdoReadExpectedTag(&ps->sdor, "to0dh")) {
 		goto err;
@@ -181,8 +185,12 @@ int32_t msg33(SDOProt_t *ps)
 
 	sdoRFlush(&ps->sdor);
 
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Received redirect: %s\n",
-	    sdoIPAddressToString(&ps->i1, buf, sizeof buf) ? buf : "");
+	    buf && sdoIPAddressToString(&ps->i1, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Mark as success and ready for TO2 */
 	ps->state = SDO_STATE_DONE;
@@ -32,7 +32,7 @@
 int32_t msg40(SDOProt_t *ps)
 {
 	int ret = -1;
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	SDOString_t *kx = sdoGetDeviceKexMethod();
 	SDOString_t *cs = sdoGetDeviceCryptoSuite();
 
@@ -45,7 +45,7 @@ int32_t msg40(SDOProt_t *ps)
 
 	/* Fill in the GUID */
 	sdoWriteTag(&ps->sdow, "g2");
-	sdoByteArrayWriteChars(&ps->sdow, ps->g2);
+	sdoFragGuidWrite(&ps->sdow, ps->frags, ps->g2);
 
 	/* Fill in the Nonce */
 	sdoWriteTag(&ps->sdow, "n5");
@@ -55,8 +55,12 @@ int32_t msg40(SDOProt_t *ps)
 		goto err;
 	}
 	sdoNonceInitRand(ps->n5);
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Sending n5: %s\n",
-	    sdoNonceToString(ps->n5->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceToString(ps->n5->bytes, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 	sdoByteArrayWriteChars(&ps->sdow, ps->n5);
 
 	/* Fill in the public key encoding */
@@ -65,15 +69,15 @@ int32_t msg40(SDOProt_t *ps)
 
 	/* Fill in the key exchange */
 	sdoWriteTag(&ps->sdow, "kx");
-	sdoWriteStringLen(&ps->sdow, kx->bytes, kx->byteSz);
+	sdoFragStringWrite(&ps->sdow, ps->frags, SDO_FRAG_KX, kx);
 
 	/* Fill in the ciphersuite info */
 	sdoWriteTag(&ps->sdow, "cs");
-	sdoWriteStringLen(&ps->sdow, cs->bytes, cs->byteSz);
+	sdoFragStringWrite(&ps->sdow, ps->frags, SDO_FRAG_CS, cs);
 
 	/* Write the eA info */
 	sdoWriteTag(&ps->sdow, "eA");
-	sdoGidWrite(&ps->sdow);
+	sdoFragGidWrite(&ps->sdow, ps->frags);
 
 	/* Close the JSON object */
 	sdoWEndObject(&ps->sdow);
@@ -11,6 +11,7 @@
 #include "sdoprot.h"
 #include "safe_lib.h"
 #include "sdokeyexchange.h"
+#include "sdoCryptoApi.h"
 #include "util.h"
 
 /**
@@ -47,12 +48,15 @@
 int32_t msg41(SDOProt_t *ps)
 {
 	char prot[] = "SDOProtTO2";
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	int ret = -1;
 	uint16_t OVEntries = 0;
 	int result_memcmp = 0;
 	SDOSig_t sig = {0};
 	SDOByteArray_t *xA = NULL;
+	SDOByteSlice_t n5r = {0};
+	void *batch = NULL;
+	bool verified = false;
 
 	LOG(LOG_DEBUG, "SDO_STATE_TO2_RCV_PROVE_OVHDR: Starting\n");
 
@@ -102,6 +106,9 @@ int32_t msg41(SDOProt_t *ps)
 	}
 	ps->ovoucher->numOVEntries = OVEntries;
 
+	/* The header is parsed, a streamed message need not keep it */
+	sdoRRelease(&ps->sdor);
+
 	LOG(LOG_DEBUG, "Total number of Ownership Vouchers: %d\n", OVEntries);
 
 	/*
@@ -127,12 +134,15 @@ int32_t msg41(SDOProt_t *ps)
 	if (!sdoReadExpectedTag(&ps->sdor, "n5")) {
 		goto err;
 	}
-	ps->n5r = sdoByteArrayAlloc(SDO_NONCE_BYTES);
-	if (!ps->n5r || !sdoByteArrayReadChars(&ps->sdor, ps->n5r)) {
+	if (!sdoByteSliceReadChars(&ps->sdor, &n5r)) {
 		goto err;
 	}
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Received n5r: %s\n",
-	    sdoNonceToString(ps->n5r->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceSliceToString(&n5r, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Read "n6" value. It will be used in msg44 (TO2.ProveDevice) */
 	if (!sdoReadExpectedTag(&ps->sdor, "n6")) {
@@ -143,8 +153,12 @@ int32_t msg41(SDOProt_t *ps)
 		goto err;
 	}
 
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Received n6: %s\n",
-	    sdoNonceToString(ps->n6->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceToString(ps->n6->bytes, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Read Device Attestation key Info */
 	if (!sdoReadExpectedTag(&ps->sdor, "eB")) {
@@ -188,8 +202,19 @@ int32_t msg41(SDOProt_t *ps)
 		goto err;
 	}
 
+	/*
+	 * The signature over bo and the one of the redirect (msg33) are both
+	 * made by the owner key, and are independent. When the build has
+	 * workers, the one over bo is verified by a worker while the redirect
+	 * is verified here, and both are joined before accepting the owner.
+	 */
+	if (0 == sdoOVBatchInit(&batch))
+		LOG(LOG_DEBUG, "TO2.ProveOPHdr signature is verified by a "
+			       "worker\n");
+
 	/* Here we will save a copy of the owner pk (TO2.ProveOVHdr bo.pk) */
-	if (!sdoEndReadSignatureFull(&ps->sdor, &sig, &ps->ownerPublicKey)) {
+	if (!sdoEndReadSignatureFull(&ps->sdor, &sig, &ps->ownerPublicKey,
+				     batch)) {
 		goto err;
 	}
 
@@ -220,7 +245,8 @@ int32_t msg41(SDOProt_t *ps)
 #endif
 
 	/* The nonces "n5" (msg40) and "n6" here must match */
-	if (!sdoNonceEqual(ps->n5r, ps->n5)) {
+	if (!ps->n5 ||
+	    !sdoByteSliceEqual(&n5r, ps->n5->bytes, SDO_NONCE_BYTES)) {
 		LOG(LOG_ERROR, "Invalid Nonce send by owner\n");
 		goto err;
 	}
@@ -234,6 +260,16 @@ int32_t msg41(SDOProt_t *ps)
 	}
 	LOG(LOG_DEBUG, "SDORedirect verification Successful \n");
 
+	/* Join the verification of the signature over bo */
+	if (batch) {
+		if (0 != sdoOVBatchFinal(&batch, &verified) || !verified) {
+			LOG(LOG_ERROR, "TO2.ProveOPHdr signature verification "
+				       "Failed.\n");
+			goto err;
+		}
+	}
+	ps->redirectOk = true;
+
 	sdoRFlush(&ps->sdor);
 
 	/* Save TO2.ProveOPHdr.pk for Asymmetric Key Exchange algorithm */
@@ -262,6 +298,8 @@ int32_t msg41(SDOProt_t *ps)
 
 err:
 	/* sdoPublicKeyFree(ps->ownerPublicKey); */
+	if (batch)
+		sdoOVBatchFinal(&batch, NULL);
 	if (xA) {
 		sdoByteArrayFree(xA);
 	}
@@ -9,6 +9,7 @@
  */
 
 #include "sdoprot.h"
+#include "sdoschema.h"
 #include "util.h"
 
 /**
@@ -20,17 +21,40 @@
  * }
  * --- Message Format Ends ---
  */
+static const SDOField_t getOPNextEntryFields[] = {
+    SDO_FIELD_UINT("enn", SDOProt_t, ovEntryNum),
+};
+static const SDOSchema_t getOPNextEntry = SDO_SCHEMA(getOPNextEntryFields);
+
+#ifdef OV_PIPELINE
+/**
+ * msg42Ahead() - TO2.GetOPNextEntry of entry enn, written ahead of its turn
+ * for an owner that takes pipelined requests. msg43 reads the responses in
+ * turn.
+ * @return true on success, false otherwise.
+ */
+bool msg42Ahead(SDOProt_t *ps, SDOW_t *sdow, uint16_t enn)
+{
+	uint16_t cur = ps->ovEntryNum;
+	bool ret;
+
+	sdoWNextBlock(sdow, SDO_TO2_GET_OP_NEXT_ENTRY);
+	ps->ovEntryNum = enn;
+	ret = sdoSchemaWrite(sdow, &getOPNextEntry, ps);
+	ps->ovEntryNum = cur;
+	return ret;
+}
+#endif
+
 int32_t msg42(SDOProt_t *ps)
 {
 	LOG(LOG_DEBUG, "SDO_STATE_TO2_SND_GET_OP_NEXT_ENTRY: Starting\n");
 	sdoWNextBlock(&ps->sdow, SDO_TO2_GET_OP_NEXT_ENTRY);
-	sdoWBeginObject(&ps->sdow);
 
 	/* Write "enn" value in the block */
-	sdoWriteTag(&ps->sdow, "enn");
-	sdoWriteUInt(&ps->sdow, ps->ovEntryNum);
-
-	sdoWEndObject(&ps->sdow);
+	if (!sdoSchemaWrite(&ps->sdow, &getOPNextEntry, ps)) {
+		return -1;
+	}
 
 	/* Move to msg43 */
 	ps->state = SDO_STATE_T02_RCV_OP_NEXT_ENTRY;
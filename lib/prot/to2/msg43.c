@@ -13,6 +13,92 @@
 #include "safe_lib.h"
 #include "util.h"
 #include "sdoCryptoApi.h"
+#ifdef OV_PREFIX_BLOB
+#include "storage_al.h"
+#endif
+
+#ifdef OV_PREFIX_BLOB
+/*
+ * The verified-prefix cache is the hashes of the "bo" of the entries of the
+ * last Ownership Voucher chain verified in full, in order. The "bo" of an
+ * entry holds the hash of the previous one ("hp"), up to the voucher header,
+ * so an entry whose "bo" hashes as the cached one at its index was signed
+ * by the same key as then, and its signature needs no verification again.
+ */
+
+/**
+ * Internal API: load the cache and set up the hashes of this chain, at its
+ * first entry. Without them every entry is verified.
+ */
+static void ovPrefixInit(SDOProt_t *ps)
+{
+	int32_t size = sdoBlobSize((char *)OV_PREFIX_BLOB, SDO_SDK_SECURE_DATA);
+
+	sdoByteArrayFree(ps->ovPrefix);
+	ps->ovPrefix = NULL;
+	sdoByteArrayFree(ps->ovHashes);
+	ps->ovHashes =
+	    sdoByteArrayAlloc(ps->ovoucher->numOVEntries *
+			      SDO_SHA_DIGEST_SIZE_USED);
+
+	if (size <= 0 || size % SDO_SHA_DIGEST_SIZE_USED || !ps->ovHashes)
+		return;
+	ps->ovPrefix = sdoByteArrayAlloc(size);
+	if (ps->ovPrefix &&
+	    sdoBlobRead((char *)OV_PREFIX_BLOB, SDO_SDK_SECURE_DATA,
+			ps->ovPrefix->bytes, size) != size) {
+		sdoByteArrayFree(ps->ovPrefix);
+		ps->ovPrefix = NULL;
+	}
+}
+
+/**
+ * Internal API: note the "bo" hash of the current entry.
+ *
+ * @return true if the cached chain has the same entry at this index.
+ */
+static bool ovPrefixKnown(SDOProt_t *ps, const SDOHash_t *boHash)
+{
+	size_t off = (size_t)ps->ovEntryNum * SDO_SHA_DIGEST_SIZE_USED;
+	int result = 1;
+
+	if (!ps->ovHashes || boHash->hash->byteSz != SDO_SHA_DIGEST_SIZE_USED ||
+	    memcpy_s(&ps->ovHashes->bytes[off], SDO_SHA_DIGEST_SIZE_USED,
+		     boHash->hash->bytes, SDO_SHA_DIGEST_SIZE_USED) != 0) {
+		sdoByteArrayFree(ps->ovHashes);
+		ps->ovHashes = NULL;
+		return false;
+	}
+	return ps->ovPrefix &&
+	       off + SDO_SHA_DIGEST_SIZE_USED <= ps->ovPrefix->byteSz &&
+	       memcmp_s(&ps->ovPrefix->bytes[off], SDO_SHA_DIGEST_SIZE_USED,
+			boHash->hash->bytes, SDO_SHA_DIGEST_SIZE_USED,
+			&result) == 0 &&
+	       result == 0;
+}
+
+/**
+ * Internal API: cache the chain once all its entries are verified.
+ */
+static void ovPrefixSave(SDOProt_t *ps)
+{
+	int result = 1;
+
+	if (!ps->ovHashes)
+		return;
+	/* nothing new since the last save */
+	if (ps->ovPrefix && ps->ovPrefix->byteSz == ps->ovHashes->byteSz &&
+	    memcmp_s(ps->ovPrefix->bytes, ps->ovPrefix->byteSz,
+		     ps->ovHashes->bytes, ps->ovHashes->byteSz,
+		     &result) == 0 &&
+	    result == 0)
+		return;
+	if (sdoBlobWrite((char *)OV_PREFIX_BLOB, SDO_SDK_SECURE_DATA,
+			 ps->ovHashes->bytes,
+			 ps->ovHashes->byteSz) != (int32_t)ps->ovHashes->byteSz)
+		LOG(LOG_ERROR, "Caching the verified OV entries failed\n");
+}
+#endif /* OV_PREFIX_BLOB */
 
 /**
  * msg43() - TO2.OPNextEntry
@@ -36,17 +122,16 @@ int32_t msg43(SDOProt_t *ps)
 {
 	char prot[] = "SDOProtTO2";
 	int ret = -1;
-	int hpStart = 0;
-	int hpEnd = 0;
-	int result_memcmp = 0;
-	uint8_t *hpText = NULL;
+	int hpTap = -1;
+	int hashType = 0;
 	SDOOvEntry_t *tempEntry = NULL;
 	SDOHash_t *currentHpHash = NULL;
-	SDOHash_t *tempHashHp;
-	SDOHash_t *tempHashHc;
+	SDOHash_t *hpHash, *hcHash;
+	SDOByteSlice_t hp = {0}, hc = {0};
 	SDOPublicKey_t *tempPk;
 	SDOSig_t sig = {0};
 	uint16_t entryNum;
+	bool known = false;
 
 	LOG(LOG_DEBUG, "SDO_STATE_T02_RCV_OP_NEXT_ENTRY: Starting\n");
 
@@ -94,13 +179,17 @@ int32_t msg43(SDOProt_t *ps)
 
 	/* TODO: better to increment the pointer by reading "bo" tag */
 	ps->sdor.needComma = false;
-	hpStart = ps->sdor.b.cursor;
+	/* The hash of the body ("bo") is fed as it is read */
+	hpTap = sdoHashTapBegin(&ps->sdor);
+	if (hpTap < 0) {
+		goto err;
+	}
 	if (!sdoRBeginObject(&ps->sdor)) {
 		goto err;
 	}
 
 	/* Add a new entry to the Owner Proxy */
-	tempEntry = sdoOvEntryAllocEmpty();
+	tempEntry = sdoAllocTransient(sizeof(SDOOvEntry_t));
 	if (!tempEntry) {
 		LOG(LOG_ERROR, "Ownership Voucher "
 			       "allocation failed!\n");
@@ -119,10 +208,8 @@ int32_t msg43(SDOProt_t *ps)
 		goto err;
 	}
 
-	tempHashHp =
-	    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED, SDO_CRYPTO_HASH_TYPE_NONE);
-	if (tempHashHp && sdoHashRead(&ps->sdor, tempHashHp) > 0) {
-		tempEntry->hpHash = tempHashHp;
+	if (!sdoHashSliceRead(&ps->sdor, &hashType, &hp)) {
+		goto err;
 	}
 
 	/*
@@ -133,10 +220,8 @@ int32_t msg43(SDOProt_t *ps)
 	if (!sdoReadExpectedTag(&ps->sdor, "hc")) {
 		goto err;
 	}
-	tempHashHc =
-	    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED, SDO_CRYPTO_HASH_TYPE_NONE);
-	if (tempHashHc && sdoHashRead(&ps->sdor, tempHashHc) > 0) {
-		tempEntry->hcHash = tempHashHc;
+	if (!sdoHashSliceRead(&ps->sdor, &hashType, &hc)) {
+		goto err;
 	}
 
 	/* Read "pk". It must be equal to: TO2.ProveOPHdr.pk */
@@ -152,64 +237,80 @@ int32_t msg43(SDOProt_t *ps)
 		goto err;
 	}
 
-	/* Get the buffer start/end over TO2.OPNextEntry.enn.eni.bo */
-	hpEnd = ps->sdor.b.cursor;
-	hpText = sdoRGetBlockPtr(&ps->sdor, hpStart);
-	if (hpText == NULL) {
-		goto err;
-	}
-
-	/* Calculate hash over received body ("bo") */
+	/* Complete the hash over TO2.OPNextEntry.enn.eni.bo */
 	currentHpHash =
 	    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED, SDO_SHA_DIGEST_SIZE_USED);
 	if (!currentHpHash) {
 		goto err;
 	}
 
-	if (0 != sdoCryptoHash(hpText, (hpEnd - hpStart),
-			       currentHpHash->hash->bytes,
-			       currentHpHash->hash->byteSz)) {
+	if (!sdoHashTapEnd(&ps->sdor, hpTap, currentHpHash)) {
+		hpTap = -1;
 		goto err;
 	}
+	hpTap = -1;
 
-	/* Verify the signature over body */
+	/*
+	 * Signatures are checked by workers when the build has them, while
+	 * the next entries are fetched. The hash chain is still checked here,
+	 * in order.
+	 */
+	if (ps->ovEntryNum == 0) {
+		if (ps->ovBatch)
+			sdoOVBatchFinal(&ps->ovBatch, NULL);
+		if (0 == sdoOVBatchInit(&ps->ovBatch))
+			LOG(LOG_DEBUG, "OVEntry Signatures are verified by "
+				       "workers\n");
+#ifdef OV_PREFIX_BLOB
+		ovPrefixInit(ps);
+#endif
+	}
+#ifdef OV_PREFIX_BLOB
+	known = ovPrefixKnown(ps, currentHpHash);
+#endif
+
+	/* Verify the signature over body, unless verified in an earlier run */
 	if (!sdoOVSignatureVerification(&ps->sdor, &sig,
-					ps->ovoucher->OVEntries->pk)) {
+					known ? NULL
+					      : ps->ovoucher->OVEntries->pk,
+					ps->ovBatch)) {
+		LOG(LOG_ERROR, "OVEntry Signature "
+			       "verification fails\n");
+		goto err;
+	}
+	LOG(LOG_DEBUG, "OVEntry Signature %s\n",
+	    known ? "verified before"
+		  : (ps->ovBatch ? "queued" : "verification successful"));
+	/* Stop fetching entries once a queued one failed */
+	if (sdoOVBatchFailed(ps->ovBatch)) {
 		LOG(LOG_ERROR, "OVEntry Signature "
 			       "verification fails\n");
 		goto err;
 	}
-	LOG(LOG_DEBUG, "OVEntry Signature "
-		       "verification "
-		       "successful\n");
-	sdoRFlush(&ps->sdor);
 
 	/* Free the signature */
 	sdoByteArrayFree(sig.sg);
 
-	/* Compare hp hash (msg41 data) with the hp hash in this message */
-	if (memcmp_s(ps->ovoucher->OVEntries->hpHash->hash->bytes,
-		     ps->ovoucher->OVEntries->hpHash->hash->byteSz,
-		     tempEntry->hpHash->hash->bytes,
-		     ps->ovoucher->OVEntries->hpHash->hash->byteSz,
-		     &result_memcmp) ||
-	    result_memcmp) {
+	/*
+	 * Compare hp and hc hashes (msg41 data) with the ones in this
+	 * message, while they are still in the receive block
+	 */
+	hpHash = ps->ovoucher->OVEntries->hpHash;
+	if (!sdoByteSliceEqual(&hp, hpHash->hash->bytes,
+			       hpHash->hash->byteSz)) {
 		LOG(LOG_ERROR, "Failed to match HP Hash at entry %d\n",
 		    ps->ovEntryNum);
 		goto err;
 	}
 
-	/* Compare hc hash (msg41 data) with the hc hash in this message */
-	if (memcmp_s(ps->ovoucher->OVEntries->hcHash->hash->bytes,
-		     ps->ovoucher->OVEntries->hcHash->hash->byteSz,
-		     tempEntry->hcHash->hash->bytes,
-		     ps->ovoucher->OVEntries->hcHash->hash->byteSz,
-		     &result_memcmp) ||
-	    result_memcmp) {
+	hcHash = ps->ovoucher->OVEntries->hcHash;
+	if (!sdoByteSliceEqual(&hc, hcHash->hash->bytes,
+			       hcHash->hash->byteSz)) {
 		LOG(LOG_ERROR, "Failed to match HC Hash at entry %d\n",
 		    ps->ovEntryNum);
 		goto err;
 	}
+	sdoRFlush(&ps->sdor);
 
 	/* hp hash needs to be updated with current message ("bo") hash */
 	sdoHashFree(ps->ovoucher->OVEntries->hpHash);
@@ -232,6 +333,17 @@ int32_t msg43(SDOProt_t *ps)
 		sdoHashFree(currentHpHash);
 		ps->state = SDO_STATE_TO2_SND_GET_OP_NEXT_ENTRY;
 	} else {
+		/* Join the workers before TO2.ProveDevice (msg44) */
+		if (ps->ovBatch) {
+			bool verified = false;
+
+			if (0 != sdoOVBatchFinal(&ps->ovBatch, &verified) ||
+			    !verified) {
+				LOG(LOG_ERROR, "OVEntry Signature "
+					       "verification fails\n");
+				goto err;
+			}
+		}
 		LOG(LOG_DEBUG,
 		    "All %d OP entries have been "
 		    "verified successfully!\n",
@@ -246,18 +358,16 @@ int32_t msg43(SDOProt_t *ps)
 				       "pk!\n");
 			goto err;
 		}
+#ifdef OV_PREFIX_BLOB
+		ovPrefixSave(ps);
+#endif
 		ps->state = SDO_STATE_TO2_SND_PROVE_DEVICE;
 	}
 
 	ret = 0; /* Mark as success */
 err:
+	sdoRTapFree(&ps->sdor, hpTap);
 	if (tempEntry) {
-		if (tempEntry->hpHash) {
-			sdoHashFree(tempEntry->hpHash);
-		}
-		if (tempEntry->hcHash) {
-			sdoHashFree(tempEntry->hcHash);
-		}
 		sdoFree(tempEntry);
 	}
 
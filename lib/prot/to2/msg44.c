@@ -12,109 +12,197 @@
 #include "sdokeyexchange.h"
 #include "util.h"
 #include "sdoCryptoApi.h"
+#include "base64.h"
+
+/* Size of msg44 without "xB": nonces, GUID, public key and signature */
+#define MSG44_FIXED_SIZE 2048
 
 /**
- * msg44() - TO2.ProveDevice
- * The device sends out data proving that it is authentic device.
- * --- Message Format Begins ---
- * { # Signature
- *     "bo": {
- *         "ai": AppId,        # proves App provenance within TEE
- *         "n6: Nonce,         # proves signature freshness
- *         "n7: Nonce,         # used in TO2.SetupDevice
- *         "g2": GUID,         # proves the GUID matches with g2 in
- *                             # TO2.HelloDevice
- *         "nn": UInt8,        # number of device service info messages to come
- *         "xB": DHKeyExchange # Key Exchange, 2nd Step
- *     },
- *     "pk": PublicKey,        # EPID key for EPID device attestation;
- *                             # PKNull if ECDSA
- *     "sg": Signature         # Signature from device
- * }
- * --- Message Format Ends ---
+ * Internal API: write msg44 into sdow. It depends on msg41 only, so that
+ * it can be written while the OV entries are fetched.
+ * @return true on success, false otherwise.
  */
-int32_t msg44(SDOProt_t *ps)
+static bool msg44Write(SDOProt_t *ps, SDOW_t *sdow)
 {
 	int modMesCount = 0;
 	int modRetVal = 0;
-	int ret = -1;
 	SDOSig_t sig = {0};
 	SDOByteArray_t *xB = NULL;
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	SDOSigInfo_t *eA;
 	SDOPublicKey_t *publickey;
 
-	LOG(LOG_DEBUG, "SDO_STATE_TO2_SND_PROVE_DEVICE: Starting\n");
-
-	sdoWNextBlock(&ps->sdow, SDO_TO2_PROVE_DEVICE);
+	sdoWNextBlock(sdow, SDO_TO2_PROVE_DEVICE);
 
 	eA = sdoGetDeviceSigInfoeA();
 	publickey = eA ? eA->pubkey : NULL;
 
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "EPID key is: %s\n",
-	    sdoPublicKeyToString(publickey, buf, sizeof(buf)) ? buf : "");
+	    buf && sdoPublicKeyToString(publickey, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Store the pointer to opening "{" for signing */
-	if (sdoBeginWriteSignature(&ps->sdow, &sig, publickey) != true) {
+	if (sdoBeginWriteSignature(sdow, &sig, publickey) != true) {
 		LOG(LOG_ERROR, "Failed in writing the signature\n");
-		goto err;
+		return false;
 	}
 
 	/* Get the second part of Key Exchange */
-	ret = sdoGetKexParamB(&xB);
-	if (0 != ret && !xB) {
+	if (0 != sdoGetKexParamB(&xB) && !xB) {
 		LOG(LOG_ERROR, "Device has no publicB\n");
-		goto err;
+		return false;
 	}
 
+	/* Build the message in one buffer, without growing it */
+	(void)sdoWReserve(sdow, (xB ? binToB64Length(xB->byteSz) : 0) +
+				    MSG44_FIXED_SIZE);
+
 	/* Write "ai" (application id) in the body */
-	sdoWBeginObject(&ps->sdow);
-	sdoWriteTag(&ps->sdow, "ai");
-	sdoAppIDWrite(&ps->sdow);
+	sdoWBeginObject(sdow);
+	sdoWriteTag(sdow, "ai");
+	sdoFragAppIDWrite(sdow, ps->frags);
 
 	/* Write "n6" (nonce) received in msg41 */
-	sdoWriteTag(&ps->sdow, "n6");
-	sdoByteArrayWriteChars(&ps->sdow, ps->n6);
+	sdoWriteTag(sdow, "n6");
+	sdoByteArrayWriteChars(sdow, ps->n6);
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Sending n6: %s\n",
-	    sdoNonceToString(ps->n6->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceToString(ps->n6->bytes, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Write "n7" (nonce) to be used in msg47 */
-	sdoWriteTag(&ps->sdow, "n7");
+	sdoWriteTag(sdow, "n7");
+	sdoByteArrayFree(ps->n7);
 	ps->n7 = sdoByteArrayAlloc(SDO_NONCE_BYTES);
 	if (!ps->n7) {
 		LOG(LOG_ERROR, "Alloc failed \n");
-		goto err;
+		return false;
 	}
 	sdoNonceInitRand(ps->n7);
-	sdoByteArrayWriteChars(&ps->sdow, ps->n7);
+	sdoByteArrayWriteChars(sdow, ps->n7);
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Sending n7: %s\n",
-	    sdoNonceToString(ps->n7->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceToString(ps->n7->bytes, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* Write the guid sent in msg40 (same as received in msg 11) */
-	sdoWriteTag(&ps->sdow, "g2");
-	sdoByteArrayWriteChars(&ps->sdow, ps->g2);
-
-	/* Get Device Service Info (DSI) count from modules (GET_DSI_COUNT) */
-	if (!sdoGetDSICount(ps->SvInfoModListHead, &modMesCount, &modRetVal)) {
-		if (modRetVal == SDO_SI_INTERNAL_ERROR)
-			goto err;
+	sdoWriteTag(sdow, "g2");
+	sdoFragGuidWrite(sdow, ps->frags, ps->g2);
+
+	/* Reuse the DSIs encoded by an earlier run, or encode them now */
+	ps->dsiSnapped = sdoDsiSnapGet(ps->dsiSnap, ps->serviceInfo,
+				       ps->SvInfoModListHead, sdow->encoding);
+	if (ps->dsiSnapped) {
+		modMesCount = ps->dsiSnap->rounds - 1;
+	} else {
+		/* Get DSI count from modules (GET_DSI_COUNT) */
+		if (!sdoGetDSICount(ps->SvInfoModListHead, &modMesCount,
+				    &modRetVal) &&
+		    modRetVal == SDO_SI_INTERNAL_ERROR)
+			return false;
 	}
 
 	/* +1 for all platform DSI's */
 	ps->totalDsiRounds = 1 + modMesCount;
-	sdoWriteTag(&ps->sdow, "nn");
+	sdoWriteTag(sdow, "nn");
 	/* If we have any device service info, then not 0 */
 	if (ps->serviceInfo) /* FIXME: Where is 0 written?? */
-		sdoWriteUInt(&ps->sdow, ps->totalDsiRounds);
+		sdoWriteUInt(sdow, ps->totalDsiRounds);
 
 	/* Write down the "xB" (key exchange) info */
-	sdoWriteTag(&ps->sdow, "xB");
-	SDOByteArrayWrite(&ps->sdow, xB);
-	sdoWEndObject(&ps->sdow);
+	sdoWriteTag(sdow, "xB");
+	SDOByteArrayWrite(sdow, xB);
+	sdoWEndObject(sdow);
 
 	/* Sign the body */
-	if (sdoEndWriteSignature(&ps->sdow, &sig) != true) {
+	if (sdoEndWriteSignature(sdow, &sig, ps->frags) != true) {
 		LOG(LOG_ERROR, "Failed in writing the signature\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Release msg44 written ahead by msg44Prepare, if any.
+ */
+void msg44Drop(SDOProt_t *ps)
+{
+	if (!ps->msg44)
+		return;
+	sdoFree(ps->msg44->b.block);
+	sdoFree(ps->msg44);
+	ps->msg44 = NULL;
+}
+
+/**
+ * Write msg44 ahead, once msg41 was received, while the OV entries are
+ * fetched (msg42/msg43). msg44 then sends it once the last entry is
+ * verified, instead of signing it then.
+ * @return 0 on success, or if written already, -1 on failure.
+ */
+int32_t msg44Prepare(SDOProt_t *ps)
+{
+	if (ps->msg44)
+		return 0;
+
+	ps->msg44 = sdoAlloc(sizeof(SDOW_t));
+	if (!ps->msg44 || !sdoWInit(ps->msg44)) {
+		sdoFree(ps->msg44);
+		ps->msg44 = NULL;
+		return -1;
+	}
+	ps->msg44->encoding = ps->sdow.encoding;
+	if (!msg44Write(ps, ps->msg44)) {
+		LOG(LOG_DEBUG, "msg44 not written ahead\n");
+		msg44Drop(ps);
+		return -1;
+	}
+	LOG(LOG_DEBUG, "msg44 written ahead\n");
+	return 0;
+}
+
+/**
+ * msg44() - TO2.ProveDevice
+ * The device sends out data proving that it is authentic device.
+ * --- Message Format Begins ---
+ * { # Signature
+ *     "bo": {
+ *         "ai": AppId,        # proves App provenance within TEE
+ *         "n6: Nonce,         # proves signature freshness
+ *         "n7: Nonce,         # used in TO2.SetupDevice
+ *         "g2": GUID,         # proves the GUID matches with g2 in
+ *                             # TO2.HelloDevice
+ *         "nn": UInt8,        # number of device service info messages to come
+ *         "xB": DHKeyExchange # Key Exchange, 2nd Step
+ *     },
+ *     "pk": PublicKey,        # EPID key for EPID device attestation;
+ *                             # PKNull if ECDSA
+ *     "sg": Signature         # Signature from device
+ * }
+ * --- Message Format Ends ---
+ */
+int32_t msg44(SDOProt_t *ps)
+{
+	SDOBlock_t b;
+	int ret = -1;
+
+	LOG(LOG_DEBUG, "SDO_STATE_TO2_SND_PROVE_DEVICE: Starting\n");
+
+	if (ps->msg44) {
+		/* Written ahead, take its block */
+		sdoWNextBlock(&ps->sdow, SDO_TO2_PROVE_DEVICE);
+		b = ps->sdow.b;
+		ps->sdow.b = ps->msg44->b;
+		ps->msg44->b = b;
+		msg44Drop(ps);
+	} else if (!msg44Write(ps, &ps->sdow)) {
 		goto err;
 	}
 
@@ -24,6 +24,7 @@
  */
 int32_t msg46(SDOProt_t *ps)
 {
+	const SDOByteArray_t *dsi;
 	int ret = -1;
 
 	/* Send all the key value sets in the Service Info list */
@@ -47,7 +48,16 @@ int32_t msg46(SDOProt_t *ps)
 	 * 2. SvInfo external module(s) DSI's (remaining iterations)
 	 */
 
-	if (ps->servReqInfoNum == 0) {
+	if (ps->dsiSnapped) {
+		/* Encoded already, or being encoded by the DSI worker */
+		dsi = sdoDsiSnapRound(ps->dsiSnap, ps->servReqInfoNum);
+		if (!dsi) {
+			LOG(LOG_ERROR, "SvInfo: DSI %d not built\n",
+			    ps->servReqInfoNum);
+			goto err;
+		}
+		sdoWriteEncoded(&ps->sdow, dsi->bytes, dsi->byteSz);
+	} else if (ps->servReqInfoNum == 0) {
 		/* Construct and write platform DSI's into a single json msg */
 		if (!sdoCombinePlatformDSIs(&ps->sdow, ps->serviceInfo)) {
 			LOG(LOG_ERROR, "Error in combining platform DSI's!\n");
@@ -34,10 +34,11 @@ int32_t msg47(SDOProt_t *ps)
 {
 	int ret = -1;
 	char prot[] = "SDOProtTO2";
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	SDOSig_t sig = {0};
 	uint32_t mtype = 0;
 	SDOEncryptedPacket_t *pkt = NULL;
+	SDOByteSlice_t n7r = {0};
 
 	LOG(LOG_DEBUG, "SDO_STATE_TO2_RCV_SETUP_DEVICE: Starting\n");
 
@@ -125,19 +126,26 @@ int32_t msg47(SDOProt_t *ps)
 	}
 
 #if LOG_LEVEL == LOG_MAX_LEVEL
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "New guid is \"%s\"\n",
-	    sdoGuidToString(ps->osc->guid, buf, sizeof buf) ? buf : "");
+	    buf && sdoGuidToString(ps->osc->guid, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 #endif
 	/* "n7" (nonce) was sent to owner in msg44 */
 	if (!sdoReadExpectedTag(&ps->sdor, "n7")) {
 		goto err;
 	}
-	ps->n7r = sdoByteArrayAlloc(SDO_NONCE_BYTES);
-	if (!ps->n7r || !sdoByteArrayReadChars(&ps->sdor, ps->n7r)) {
+	if (!sdoByteSliceReadChars(&ps->sdor, &n7r)) {
 		goto err;
 	}
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Receiving n7: %s\n",
-	    sdoNonceToString(ps->n7r->bytes, buf, sizeof buf) ? buf : "");
+	    buf && sdoNonceSliceToString(&n7r, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	if (!sdoREndObject(&ps->sdor)) {
 		goto err;
@@ -145,7 +153,7 @@ int32_t msg47(SDOProt_t *ps)
 
 	/*
 	 * "bo" ends. Let's verify signature */
-	if (!sdoEndReadSignatureFull(&ps->sdor, &sig, &ps->new_pk)) {
+	if (!sdoEndReadSignatureFull(&ps->sdor, &sig, &ps->new_pk, NULL)) {
 		goto err;
 	}
 
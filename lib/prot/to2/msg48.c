@@ -9,6 +9,7 @@
  */
 
 #include "sdoprot.h"
+#include "sdoschema.h"
 #include "sdokeyexchange.h"
 #include "util.h"
 
@@ -20,18 +21,22 @@
  * }
  * --- Message Format Ends ---
  */
+static const SDOField_t getNextOwnerServiceInfoFields[] = {
+    /* "nn" - next Owner Service Info Index */
+    SDO_FIELD_UINT("nn", SDOProt_t, ownerSuppliedServiceInfoNum),
+};
+static const SDOSchema_t getNextOwnerServiceInfo =
+    SDO_SCHEMA(getNextOwnerServiceInfoFields);
+
 int32_t msg48(SDOProt_t *ps)
 {
 	int ret = -1;
 
 	/* send entry number to load */
 	sdoWNextBlock(&ps->sdow, SDO_TO2_GET_NEXT_OWNER_SERVICE_INFO);
-	sdoWBeginObject(&ps->sdow);
-
-	/* Write the "nn" - next Owner Service Info Index */
-	sdoWriteTag(&ps->sdow, "nn");
-	sdoWriteUInt(&ps->sdow, ps->ownerSuppliedServiceInfoNum);
-	sdoWEndObject(&ps->sdow);
+	if (!sdoSchemaWrite(&ps->sdow, &getNextOwnerServiceInfo, ps)) {
+		goto err;
+	}
 
 	if (!sdoEncryptedPacketWindup(
 		&ps->sdow, SDO_TO2_GET_NEXT_OWNER_SERVICE_INFO, ps->iv)) {
@@ -11,6 +11,7 @@
 #include "sdoprot.h"
 #include "sdokeyexchange.h"
 #include "util.h"
+#include "sdoosicache.h"
 
 /**
  * msg49() - TO2.OwnerServiceInfo
@@ -91,13 +92,15 @@ int32_t msg49(SDOProt_t *ps)
 		 */
 		sdoSdkSiKeyValue osiKV;
 
-		if (!sdoOsiParsing(&ps->sdor, ps->SvInfoModListHead, &osiKV,
-				   &modRetVal)) {
+		if (!sdoOsiParsing(&ps->sdor, ps->SvInfoModListHead,
+				   ps->osiCache, &osiKV, &modRetVal)) {
 			LOG(LOG_ERROR, "SvInfo: OSI did not "
 				       "finished "
 				       "gracefully!\n");
 			goto err;
 		}
+		/* what was applied must survive a restart before the retry */
+		sdoOsiCacheFlush(ps->osiCache);
 		/*===============OSI=================*/
 
 		if (!sdoREndObject(&ps->sdor)) {
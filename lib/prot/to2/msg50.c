@@ -31,9 +31,16 @@ int32_t msg50(SDOProt_t *ps)
 	SDOByteArray_t *new_guid = ps->osc->guid;
 	SDORendezvousList_t *new_rvlist = ps->osc->rvlst;
 	SDOHash_t *hmac = NULL;
+	SDOHash_t *pkh = NULL;
 
 	LOG(LOG_DEBUG, "SDO_STATE_TO2_SND_DONE: Starting\n");
 
+	/* the OSIs still being applied by the modules are to be in effect */
+	if (!sdoOsiJoin(ps->SvInfoModListHead)) {
+		LOG(LOG_ERROR, "SvInfo: a module failed to apply its OSIs\n");
+		goto err;
+	}
+
 	/* Check if REUSE is ON */
 	if (sdoComparePublicKeys(ps->ownerPublicKey, ps->new_pk) &&
 	    sdoCompareByteArrays(ps->devCred->ownerBlk->guid, new_guid) &&
@@ -95,13 +102,14 @@ int32_t msg50(SDOProt_t *ps)
 
 		if (resale_supported) {
 			LOG(LOG_DEBUG, "*****Resale triggered.*****\n");
-			hmac = sdoNewOVHdrSign(ps->devCred, ps->new_pk);
-
 			/* Update the pkh to the new
 			 * values
 			 * Store hash of the new owner public key */
-			sdoHashFree(ps->devCred->ownerBlk->pkh);
-			ps->devCred->ownerBlk->pkh = sdoPubKeyHash(ps->new_pk);
+			hmac = sdoNewOVHdrSign(ps->devCred, ps->new_pk, &pkh);
+			if (hmac) {
+				sdoHashFree(ps->devCred->ownerBlk->pkh);
+				ps->devCred->ownerBlk->pkh = pkh;
+			}
 
 		} else {
 			LOG(LOG_DEBUG,
@@ -144,8 +152,12 @@ int32_t msg50(SDOProt_t *ps)
 	}
 	LOG(LOG_DEBUG, "Data protection key rotated successfully!!\n");
 
-	/* Write new device credentials */
-	if (store_credential(ps->devCred) != 0) {
+	/*
+	 * Write new device credentials, in the background if the application
+	 * asked for it: the owner's application then starts without waiting
+	 * for the storage
+	 */
+	if (store_credential_deferred(ps->devCred) != 0) {
 		LOG(LOG_ERROR, "Failed to store new device creds\n");
 		goto err;
 	}
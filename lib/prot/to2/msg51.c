@@ -9,6 +9,7 @@
  */
 
 #include "sdoprot.h"
+#include "sdoschema.h"
 #include "util.h"
 #include "sdokeyexchange.h"
 
@@ -23,12 +24,22 @@
  * }
  * --- Message Format Ends ---
  */
+struct done2 {
+	SDOByteSlice_t n7;
+};
+
+static const SDOField_t done2Fields[] = {
+    SDO_FIELD_SLICE("n7", struct done2, n7),
+};
+static const SDOSchema_t done2 = SDO_SCHEMA(done2Fields);
+
 int32_t msg51(SDOProt_t *ps)
 {
 	int ret = -1;
 	char prot[] = "SDOProtTO2";
-	char buf[DEBUGBUFSZ] = {0};
+	char *buf;
 	SDOEncryptedPacket_t *pkt = NULL;
+	struct done2 msg = {{0}};
 
 	LOG(LOG_DEBUG, "SDO_STATE_TO2_RCV_DONE_2: Starting\n");
 
@@ -52,27 +63,19 @@ int32_t msg51(SDOProt_t *ps)
 		goto err;
 	}
 
-	if (!sdoRBeginObject(&ps->sdor)) {
-		goto err;
-	}
-
-	if (!sdoReadExpectedTag(&ps->sdor, "n7")) {
-		goto err;
-	}
-
-	/* already allocated  n7r*/
-	if (!ps->n7r || !sdoByteArrayReadChars(&ps->sdor, ps->n7r)) {
+	if (!sdoSchemaRead(&ps->sdor, &done2, &msg)) {
 		goto err;
 	}
+	buf = sdoScratchLease(DEBUGBUFSZ);
 	LOG(LOG_DEBUG, "Receiving n7: %s\n",
-	    sdoNonceToString(ps->n7r->bytes, buf, sizeof buf) ? buf : "");
-
-	if (!sdoREndObject(&ps->sdor)) {
-		goto err;
-	}
+	    buf && sdoNonceSliceToString(&msg.n7, buf, DEBUGBUFSZ)
+		? buf
+		: "");
+	sdoScratchRelease(buf);
 
 	/* verify the nonce received is correct. */
-	if (!sdoNonceEqual(ps->n7r, ps->n7)) {
+	if (!ps->n7 ||
+	    !sdoByteSliceEqual(&msg.n7, ps->n7->bytes, SDO_NONCE_BYTES)) {
 		LOG(LOG_ERROR, "Invalid Nonce send by owner\n");
 		goto err;
 	}
@@ -14,6 +14,11 @@
 #include "sdokeyexchange.h"
 #include "sdoprotctx.h"
 #include "sdonet.h"
+#include "sdoretry.h"
+#include "sdostats.h"
+#include "sdoosicache.h"
+#include "storage_stats.h"
+#include "sdoendpoint.h"
 #include "sdoprot.h"
 #include "load_credentials.h"
 #include "network_al.h"
@@ -21,17 +26,26 @@
 #include "util.h"
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include "safe_lib.h"
 #include "sdodeviceinfo.h"
+#include "platform_utils.h"
+#include "sdoCryptoHal.h"
 
 #define HTTPS_TAG "https"
 
+/* Share of the time budget left that TO1 may use, TO2 gets the rest */
+#ifndef SDO_BUDGET_TO1_PERCENT
+#define SDO_BUDGET_TO1_PERCENT 30
+#endif
+
 int TO2_done = 0;
 typedef struct app_data_s {
 	bool error_recovery;
 	bool recovery_enabled;
 	bool (*state_fn)(void);
 	SDODevCred_t *devcred;
+	bool credStateOnly; // devcred has the state, not the OwnerBlk yet
 	void *ssl;
 	SDOProt_t prot;
 	int err;
@@ -42,21 +56,64 @@ typedef struct app_data_s {
 	uint32_t delaysec;
 	/* Error handling callback */
 	sdoSdkErrorCB error_callback;
-	/* Global SvInfo ModuleList head pointer */
-	sdoSdkServiceInfoModuleList_t *moduleList;
+	/* Global SvInfo modules, in the order of registration */
+	sdoSdkServiceInfoModuleReg_t modules;
+	/* DSIs of the TO2 runs, encoded once */
+	sdoSvInfoDsiSnap_t dsiSnap;
+	/* Unchanging values of the TO1 and TO2 messages, encoded once */
+	sdoFragCache_t frags;
+	/* OSIs applied in the TO2 runs, skipped when TO2 is retried */
+	sdoOsiCache_t osiCache;
+	/* Step-wise run of sdoSdkStep */
+	bool stepping;
+	SDOProtCtx_t *stepProt; // protocol of the state, being stepped
+	bool (*stepDone)(SDOProtCtx_t *prot_ctx, int result);
+	int stepWait;    // SDO_PROT_CTX_WANT_* of stepProt, 0 for none
+	uint64_t wakeAt; // sdoTimeMs() of the next step, 0 for now
+	sdoSdkStatus stepRet;
+	/* Time budget of sdoSdkRunWithBudget */
+	uint64_t budgetEnd; // sdoTimeMs() by which it returns, 0 for none
+	uint64_t shareEnd;  // end of the share of the protocol running
+	bool budgetOut;	    // stopped for the budget, to be resumed
+	/* Manufacturer address, while DI runs */
+	SDOIPAddress_t *mfgIPAddr;
+	char *mfgDNS;
 } app_data_t;
 
+/*
+ * SDK instance of sdoSdkCreate: the state sdoSdkInit sets up, along with
+ * its own crypto context and storage.
+ */
+struct sdoSdkCtx_s {
+	app_data_t *app;
+	sdoCryptoContext_t *crypto;
+	sdoStorageCtx_t *storage;
+	sdoSdkStats *stats;
+};
+
 /* Globals */
-static app_data_t *g_sdo_data;
+static app_data_t *g_sdo_default;
+/* State of the instance the calling thread works on, see sdoSdkCtxBind */
+static SDO_THREAD_LOCAL app_data_t **g_sdo_slot = &g_sdo_default;
+#define g_sdo_data (*g_sdo_slot)
 extern int g_argc;
 extern char **g_argv;
 
 static bool _STATE_DI(void);
+static bool _STATE_DI_Done(SDOProtCtx_t *prot_ctx, int result);
 static bool _STATE_TO1(void);
+static bool _STATE_TO1_Done(SDOProtCtx_t *prot_ctx, int result);
 static bool _STATE_TO2(void);
+static bool _STATE_TO2_Done(SDOProtCtx_t *prot_ctx, int result);
+#ifdef TO2_RESUME
+static bool _STATE_TO2_Resume(void);
+#endif
 static bool _STATE_Error(void);
 static bool _STATE_Shutdown(void);
 static bool _STATE_Shutdown_Error(void);
+static bool _STATE_Budget(void);
+
+static bool sdoTO2End(SDOProtCtx_t *prot_ctx, bool ret);
 
 static sdoSdkStatus app_initialize(void);
 static void app_close(void);
@@ -68,20 +125,10 @@ static void app_close(void);
 	}
 
 /**
- * sdoSdkRun is user API call to start device ownership
- * transfer
- * sdoSdkInit should be called before calling this function
- * If device supports Device Initialization (DI) protocol,
- * then the first time invoking of this call completes DI
- * and for the next invoke completes transfer ownership protocols
- * (TO1 and TO2). If device does not support DI, then device is expected
- * to have credentials programmed in the factory and first time
- * invoking of this function will complete transfer ownership protocols.
- *
- * @return
- *        return SDO_SUCCESS on success. non-zero value from sdoSdkStatus enum.
+ * Internal API: run the state machine until its last state, within the
+ * time budget of the run if there is one.
  */
-sdoSdkStatus sdoSdkRun(void)
+static sdoSdkStatus sdoSdkRunFor(uint32_t budgetMs)
 {
 	sdoSdkStatus ret = SDO_ERROR;
 
@@ -91,6 +138,8 @@ sdoSdkStatus sdoSdkRun(void)
 		goto end;
 	}
 
+	g_sdo_data->budgetEnd = budgetMs ? sdoTimeMs() + budgetMs : 0;
+	g_sdo_data->budgetOut = false;
 	if (SDO_SUCCESS != app_initialize()) {
 		goto end;
 	}
@@ -110,13 +159,193 @@ sdoSdkStatus sdoSdkRun(void)
 		}
 	}
 
+	if (g_sdo_data->budgetOut)
+		ret = SDO_RESUME;
 end:
+	sdoProtCtxSetRunDeadline(0);
 	app_close();
 	/* This should be moved to sdoSdkExit when its available */
 	sdoFree(g_sdo_data);
+	g_sdo_data = NULL;
 	return ret;
 }
 
+/**
+ * sdoSdkRun is user API call to start device ownership
+ * transfer
+ * sdoSdkInit should be called before calling this function
+ * If device supports Device Initialization (DI) protocol,
+ * then the first time invoking of this call completes DI
+ * and for the next invoke completes transfer ownership protocols
+ * (TO1 and TO2). If device does not support DI, then device is expected
+ * to have credentials programmed in the factory and first time
+ * invoking of this function will complete transfer ownership protocols.
+ *
+ * @return
+ *        return SDO_SUCCESS on success. non-zero value from sdoSdkStatus enum.
+ */
+sdoSdkStatus sdoSdkRun(void)
+{
+	return sdoSdkRunFor(0);
+}
+
+/**
+ * sdoSdkRunWithBudget is sdoSdkRun bounded in time, for devices that are
+ * only connected for short windows. The budget is shared out among the
+ * protocols run: TO1 may use SDO_BUDGET_TO1_PERCENT of what is left when
+ * it starts, DI and TO2 all of it. It bounds their connections, messages
+ * and the waits before their retries, those that would not end within it
+ * are given up.
+ * A run that the budget stops returns SDO_RESUME. The protocols that
+ * completed are kept in the device credentials, sdoSdkInit and
+ * sdoSdkRunWithBudget go on from there in the next window.
+ *
+ * @param budgetMs - time budget in milliseconds, 0 for none (sdoSdkRun).
+ * @return SDO_SUCCESS on success, SDO_RESUME if the budget was used up,
+ * else as sdoSdkRun.
+ */
+sdoSdkStatus sdoSdkRunWithBudget(uint32_t budgetMs)
+{
+	return sdoSdkRunFor(budgetMs);
+}
+
+/**
+ * sdoSdkStep is sdoSdkRun for applications that cannot block, for ex: a
+ * main loop, an RTOS task sharing the CPU or an event loop. Each call moves
+ * onboarding on as far as it can without waiting, and tells what to wait
+ * for before the next call. The first call starts the run, as sdoSdkRun
+ * does; the run is over when SDO_STEP_DONE is returned.
+ * Name resolution, connect and the TLS handshake still block. Networks
+ * without non-blocking I/O exchange one message per call, in blocking mode.
+ * A thread has one step-wise run at a time.
+ *
+ * @param status - out status of the run once it is over, as returned by
+ * sdoSdkRun.
+ * @return SDO_STEP_WAIT_READ or SDO_STEP_WAIT_WRITE: call again when
+ * sdoSdkStepFd() is readable or writable, or after sdoSdkStepTimeout() ms.
+ * SDO_STEP_WAIT_TIME: call again after sdoSdkStepTimeout() ms.
+ * SDO_STEP_AGAIN: call again, once the application has had its turn.
+ * SDO_STEP_DONE: the run is over.
+ */
+sdoSdkStepState sdoSdkStep(sdoSdkStatus *status)
+{
+	SDOProtCtx_t *prot_ctx;
+	int ret;
+
+	if (!g_sdo_data) {
+		LOG(LOG_ERROR,
+		    "sdoSdk not initialized. Call sdoSdkInit first\n");
+		if (status)
+			*status = SDO_ERROR;
+		return SDO_STEP_DONE;
+	}
+
+	if (!g_sdo_data->stepping) {
+		g_sdo_data->stepping = true;
+		g_sdo_data->stepRet = SDO_ERROR;
+		if (SDO_SUCCESS != app_initialize())
+			goto end;
+	}
+
+	for (;;) {
+		/* Protocol of the current state */
+		prot_ctx = g_sdo_data->stepProt;
+		if (prot_ctx) {
+			ret = sdoProtCtxStep(prot_ctx);
+			g_sdo_data->stepWait = 0;
+			if (ret == SDO_PROT_CTX_WANT_READ ||
+			    ret == SDO_PROT_CTX_WANT_WRITE) {
+				g_sdo_data->stepWait = ret;
+				return ret == SDO_PROT_CTX_WANT_READ
+					   ? SDO_STEP_WAIT_READ
+					   : SDO_STEP_WAIT_WRITE;
+			}
+			if (ret == SDO_PROT_CTX_AGAIN)
+				return SDO_STEP_AGAIN;
+
+			g_sdo_data->stepProt = NULL;
+			ret = (ret == SDO_PROT_CTX_DONE) ? 0 : -1;
+			if (true == g_sdo_data->stepDone(prot_ctx, ret))
+				g_sdo_data->stepRet = SDO_SUCCESS;
+			else
+				g_sdo_data->stepRet = SDO_ERROR;
+			continue;
+		}
+
+		/* Delay before a retry */
+		if (g_sdo_data->wakeAt) {
+			if (sdoTimeMs() < g_sdo_data->wakeAt)
+				return SDO_STEP_WAIT_TIME;
+			g_sdo_data->wakeAt = 0;
+		}
+
+		/* Nothing left to perform in state machine */
+		if (!g_sdo_data->state_fn)
+			break;
+
+		if (true == g_sdo_data->state_fn())
+			g_sdo_data->stepRet = SDO_SUCCESS;
+		else
+			g_sdo_data->stepRet = SDO_ERROR;
+	}
+
+end:
+	if (status)
+		*status = g_sdo_data->stepRet;
+	app_close();
+	/* This should be moved to sdoSdkExit when its available */
+	sdoFree(g_sdo_data);
+	g_sdo_data = NULL;
+	return SDO_STEP_DONE;
+}
+
+/**
+ * sdoSdkStepFd gives the file descriptor that a step-wise run waits on.
+ *
+ * @return file descriptor, -1 if the run does not wait on one.
+ */
+int sdoSdkStepFd(void)
+{
+	if (!g_sdo_data || !g_sdo_data->stepProt || !g_sdo_data->stepWait)
+		return -1;
+
+	return sdoProtCtxGetFd(g_sdo_data->stepProt);
+}
+
+/**
+ * sdoSdkStepTimeout gives the time after which sdoSdkStep is to be called
+ * again, at the latest: the end of a retry delay, or the timeout of the
+ * connection or the protocol waited for.
+ *
+ * @return time in milliseconds, 0 to call it right away, UINT32_MAX if
+ * there is no timeout.
+ */
+uint32_t sdoSdkStepTimeout(void)
+{
+	uint64_t deadline = 0;
+	uint64_t now;
+
+	if (!g_sdo_data || !g_sdo_data->stepping)
+		return 0;
+
+	if (g_sdo_data->stepProt) {
+		if (!g_sdo_data->stepWait)
+			return 0;
+		deadline = sdoProtCtxGetDeadline(g_sdo_data->stepProt);
+		if (!deadline)
+			return UINT32_MAX;
+	} else {
+		deadline = g_sdo_data->wakeAt;
+	}
+
+	now = sdoTimeMs();
+	if (deadline <= now)
+		return 0;
+	if (deadline - now > UINT32_MAX)
+		return UINT32_MAX;
+	return (uint32_t)(deadline - now);
+}
+
 /**
  * Deallocate allocated  memories in DI protocol and exit from DI.
  *
@@ -175,6 +404,16 @@ static void sdoProtTO2Exit(app_data_t *appData)
 		sdoOvFree(ps->ovoucher);
 		ps->ovoucher = NULL;
 	}
+	if (ps->ovBatch != NULL)
+		sdoOVBatchFinal(&ps->ovBatch, NULL);
+	if (ps->ovPrefix != NULL) {
+		sdoByteArrayFree(ps->ovPrefix);
+		ps->ovPrefix = NULL;
+	}
+	if (ps->ovHashes != NULL) {
+		sdoByteArrayFree(ps->ovHashes);
+		ps->ovHashes = NULL;
+	}
 	if (ps->rv != NULL) {
 		sdoRendezvousFree(ps->rv);
 		ps->rv = NULL;
@@ -203,10 +442,7 @@ static void sdoProtTO2Exit(app_data_t *appData)
 		sdoByteArrayFree(ps->n7);
 		ps->n7 = NULL;
 	}
-	if (ps->n7r != NULL) {
-		sdoByteArrayFree(ps->n7r);
-		ps->n7r = NULL;
-	}
+	msg44Drop(ps);
 
 	/* clear SvInfo PSI/DSI/OSI related data */
 	if (ps->dsiInfo) {
@@ -216,6 +452,14 @@ static void sdoProtTO2Exit(app_data_t *appData)
 	sdoSvInfoClearModulePsiOsiIndex(ps->SvInfoModListHead);
 	ps->totalDsiRounds = 0;
 	sdoRFlush(&ps->sdor);
+
+	/* the session is over, TO2 is not resumed */
+	if (ps->resumeAuth != NULL) {
+		sdoFree(ps->resumeAuth);
+		ps->resumeAuth = NULL;
+	}
+	ps->resumeEnd = 0;
+	ps->resume = false;
 }
 /**
  * Allocate memory to hold device credentials which includes owner credentials
@@ -248,6 +492,26 @@ SDODevCred_t *app_get_credentials(void)
 	return g_sdo_data->devcred;
 }
 
+/**
+ * Internal API: load the OwnerBlk of the credentials, which sdoSdkInit
+ * left out.
+ * @return 0 on success, -1 on failure.
+ */
+static int sdoCredLoad(void)
+{
+	if (!g_sdo_data->credStateOnly)
+		return 0;
+
+	sdoDevCredFree(g_sdo_data->devcred);
+	sdoFree(g_sdo_data->devcred);
+	if (load_credential() != 0) {
+		LOG(LOG_ERROR, "Could not load the device credentials\n");
+		return -1;
+	}
+	g_sdo_data->credStateOnly = false;
+	return 0;
+}
+
 /**
  * Internal API
  */
@@ -293,6 +557,16 @@ static sdoSdkStatus app_initialize(void)
 		return SDO_ERROR;
 	}
 
+	/* An onboarded device has nothing to load or bring up */
+	if (g_sdo_data->devcred->ST != SDO_DEVICE_STATE_IDLE &&
+	    0 != sdoCredLoad())
+		return SDO_ERROR;
+	if (g_sdo_data->devcred->ST != SDO_DEVICE_STATE_IDLE &&
+	    0 != sdoCryptoRequire(SDO_CRYPTO_ALL)) {
+		LOG(LOG_ERROR, "sdoCryptoInit failed!!\n");
+		return SDO_ERROR;
+	}
+
 	if (g_sdo_data->devcred->ST == SDO_DEVICE_STATE_READY1) {
 		ret = load_mfg_secret();
 		if (ret)
@@ -353,7 +627,7 @@ static sdoSdkStatus app_initialize(void)
 		sdoServiceInfoAddKVStr(g_sdo_data->service_info, "sdodev:ch",
 				       "");
 
-	if (sdoConstructModuleList(g_sdo_data->moduleList, &get_modules)) {
+	if (sdoConstructModuleList(g_sdo_data->modules.head, &get_modules)) {
 		sdoServiceInfoAddKVStr(g_sdo_data->service_info,
 				       "sdodev:modules", get_modules);
 		sdoFree(get_modules);
@@ -419,32 +693,18 @@ void sdoSdkServiceInfoRegisterModule(sdoSdkServiceInfoModule *module)
 	if (module == NULL)
 		return;
 
-	sdoSdkServiceInfoModuleList_t *new =
-	    sdoAlloc(sizeof(sdoSdkServiceInfoModuleList_t));
-
-	if (new == NULL) {
-		LOG(LOG_ERROR, "malloc failed\n");
-		return;
-	}
-
-	if (memcpy_s(&new->module, sizeof(sdoSdkServiceInfoModule), module,
-		     sizeof(sdoSdkServiceInfoModule)) != 0) {
-		LOG(LOG_ERROR, "Memcpy Failed\n");
-		sdoFree(new);
-		return;
-	}
-
-	if (g_sdo_data->moduleList == NULL) {
-		// 1st module to register
-		g_sdo_data->moduleList = new;
-	} else {
-		sdoSdkServiceInfoModuleList_t *list = g_sdo_data->moduleList;
-
-		while (list->next != NULL)
-			list = list->next;
+	sdoModuleRegAdd(&g_sdo_data->modules, module);
+}
 
-		list->next = new;
-	}
+/**
+ * API for modules to signal that their DSIs changed since they last gave
+ * them, so that the next TO2 run asks them again instead of sending the
+ * DSI snapshot.
+ */
+void sdoSdkServiceInfoDsiChanged(void)
+{
+	if (g_sdo_data)
+		g_sdo_data->dsiSnap.gen++;
 }
 
 /**
@@ -479,11 +739,22 @@ sdoSdkStatus sdoSdkInit(sdoSdkErrorCB errorHandlingCallback,
 
 	g_sdo_data->err = 0;
 
-	/* Initialize Crypto services */
+	/*
+	 * Crypto services come up once a protocol needs them, reading the
+	 * credentials needs no more than hashing. Storage backed by a TPM or
+	 * secure element needs them right away.
+	 */
+#if defined(LAZY_INIT_FALSE) || defined(DEVICE_TPM20_ENABLED) ||              \
+    defined(SECURE_ELEMENT)
 	if (0 != sdoCryptoInit()) {
 		LOG(LOG_ERROR, "sdoCryptoInit failed!!\n");
 		return SDO_ERROR;
 	}
+#endif
+
+	/* Static configuration in one pass, then looked up by all */
+	if (sdoConfigSnapshotLoad() != 0)
+		LOG(LOG_INFO, "Configuration read from storage when needed\n");
 
 	sdoNetInit();
 
@@ -496,13 +767,40 @@ sdoSdkStatus sdoSdkInit(sdoSdkErrorCB errorHandlingCallback,
 		return SDO_ERROR;
 	}
 
-	/* Load credentials */
+	/* Credentials still written in the background land first */
+	if (sync_credential() != 0)
+		LOG(LOG_ERROR, "Credentials of the last run not stored!\n");
+
+	/* Finish a credential update a power loss cut short */
+	if (sdoBlobJournalReplay() != 0) {
+		LOG(LOG_ERROR, "Blob journal replay failed!\n");
+		return SDO_ERROR;
+	}
+
+	/* Load credentials, the OwnerBlk once a protocol is to run */
+#ifdef LAZY_INIT_FALSE
 	ret = load_credential();
+#else
+	ret = load_credential_state();
+	g_sdo_data->credStateOnly = ret == 1;
+	if (ret == 1)
+		ret = 0;
+#endif
 	if (ret) {
 		printf("load fail -----------------\n");
 		return SDO_ERROR;
 	}
 
+	/*
+	 * Sign the DI CSR and generate the OV HMAC key now rather than while
+	 * the manufacturer waits
+	 */
+	if (g_sdo_data->devcred->ST == SDO_DEVICE_STATE_PC &&
+	    0 == sdoCryptoRequire(SDO_CRYPTO_ENGINE)) {
+		(void)sdoDeviceCsrPrepare();
+		(void)sdoOVHMACKeyPrepare();
+	}
+
 #ifdef MODULES_ENABLED
 	if ((numModules == 0) || (numModules > SDO_MAX_MODULES) ||
 	    (moduleInformation == NULL) ||
@@ -528,7 +826,7 @@ sdoSdkStatus sdoSdkInit(sdoSdkErrorCB errorHandlingCallback,
  */
 void printServiceInfoModuleList(void)
 {
-	sdoSdkServiceInfoModuleList_t *list = g_sdo_data->moduleList;
+	sdoSdkServiceInfoModuleList_t *list = g_sdo_data->modules.head;
 	if (list) {
 		while (list != NULL) {
 			LOG(LOG_DEBUG, "ServiceInfo module-name: %s\n",
@@ -538,6 +836,285 @@ void printServiceInfoModuleList(void)
 	}
 }
 #endif
+/**
+ * Sets timeouts of the network operations of DI, TO1 and TO2, so that a
+ * stalled server fails the protocol instead of blocking the device. May be
+ * called before or after sdoSdkInit. 0 disables the respective timeout.
+ * The timeouts are process-wide: they apply to the runs of all SDK
+ * instances, sdoSdkCreate ones included, as of their next connection.
+ *
+ * @param connectMs - timeout of connecting to a server, in milliseconds.
+ * @param ioMs - timeout of a read or write that makes no progress, in
+ * milliseconds.
+ * @param phaseSec - time budget of one protocol run, in seconds.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetTimeouts(uint32_t connectMs, uint32_t ioMs,
+			       uint32_t phaseSec)
+{
+	sdoConSetTimeouts(connectMs, ioMs, ioMs);
+	sdoProtCtxSetIoTimeout(ioMs);
+	sdoProtCtxSetPhaseTimeout(phaseSec);
+	return SDO_SUCCESS;
+}
+
+/**
+ * Sets the retry policy of DI, TO1 and TO2. Retries of connections,
+ * messages and protocols wait a random delay (full jitter) between 0 and
+ * min(capMs, baseMs * 2^retry), so that devices do not retry in lockstep.
+ * After breakerThreshold consecutive failed protocol runs, a server is not
+ * contacted for breakerCooldownSec seconds. May be called before or after
+ * sdoSdkInit.
+ *
+ * @param baseMs - delay ceiling of the first retry, in milliseconds.
+ * @param capMs - maximum delay ceiling, in milliseconds.
+ * @param maxRetries - retries of a failed connection or message.
+ * @param breakerThreshold - consecutive failures that pause a server, 0 to
+ * never pause.
+ * @param breakerCooldownSec - seconds a server is paused.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetRetryPolicy(uint32_t baseMs, uint32_t capMs,
+				  uint32_t maxRetries,
+				  uint32_t breakerThreshold,
+				  uint32_t breakerCooldownSec)
+{
+	sdoRetrySetPolicy(baseMs, capMs, maxRetries, breakerThreshold,
+			  breakerCooldownSec);
+	return SDO_SUCCESS;
+}
+
+/**
+ * Lets a battery device sleep through the waits of the SDK with the radio
+ * off. No connection is open while sleepCallback runs; it is called with
+ * the time to sleep, and returns the time left if it woke early, for ex: on
+ * a button press, and is then called again with the rest. The waits end on
+ * a multiple of wakeWindowMs of the monotonic clock, so that the retries of
+ * the SDK instances of the device, and the application's own periodic work
+ * if it uses the same window, are served in one wake-up rather than each
+ * waking the device. The wait still to go is sdoSdkStepTimeout() in a
+ * step-wise run, which calls neither. May be called before or after
+ * sdoSdkInit.
+ *
+ * @param sleepCallback - sleep of the platform, NULL to sleep in the SDK.
+ * @param wakeWindowMs - wake window in milliseconds, 0 to not align the
+ * waits.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetSleepCallback(sdoSdkSleepCB sleepCallback,
+				    uint32_t wakeWindowMs)
+{
+	sdoRetrySetSleep(sleepCallback, wakeWindowMs);
+	return SDO_SUCCESS;
+}
+
+/**
+ * Lets the credentials updated at the end of DI and TO2 be written to
+ * storage in the background (CRED_ASYNC), so that neither the manufacturing
+ * line nor the owner's application is held up by the storage.
+ * credWriteCallback is called, from the writer thread, with SDO_SUCCESS
+ * once they are durable or SDO_ERROR if the write failed. sdoSdkInit and
+ * resale wait for the write; call sdoSdkCredSync before powering off.
+ * Without CRED_ASYNC, the callback is called in line. May be called before
+ * or after sdoSdkInit.
+ *
+ * @param credWriteCallback - callback, NULL to write the credentials in
+ * line again.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetCredWriteCallback(sdoSdkCredWriteCB credWriteCallback)
+{
+	set_credential_write_cb(credWriteCallback);
+	return SDO_SUCCESS;
+}
+
+/**
+ * Waits until the credentials written in the background are durable.
+ *
+ * @return SDO_SUCCESS, or SDO_ERROR if the write failed.
+ */
+sdoSdkStatus sdoSdkCredSync(void)
+{
+	if (sync_credential() != 0) {
+		LOG(LOG_ERROR, "Credentials not stored\n");
+		return SDO_ERROR;
+	}
+	return SDO_SUCCESS;
+}
+
+/**
+ * Lets the application run during the ECDSA signatures and the ECDH of the
+ * device, which take hundreds of milliseconds on a microcontroller. With
+ * ECC_RESTARTABLE (mbedTLS) they run in slices of ECC_SLICE_OPS
+ * operations, and yieldCallback is called between two, from the thread
+ * running the operation, for ex: to feed a watchdog or run an iteration of
+ * the application's control loop. In a step-wise run it is the turn of the
+ * application within a step, as SDO_STEP_AGAIN is between steps. With no
+ * callback the thread yields to the other ready threads. Without
+ * ECC_RESTARTABLE the callback is never called. May be called before or
+ * after sdoSdkInit.
+ *
+ * @param yieldCallback - callback, NULL to only yield the thread.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetYieldCallback(sdoSdkYieldCB yieldCallback)
+{
+#ifdef ECC_RESTARTABLE
+	sdoCryptoSetYield(yieldCallback);
+#else
+	(void)yieldCallback;
+#endif
+	return SDO_SUCCESS;
+}
+
+/**
+ * Copies out the statistics of the protocol runs since start-up or the
+ * last sdoSdkResetStats: per message type sent, the bytes exchanged, the
+ * time the server took to respond, the time the device took to handle the
+ * response (and of that, in crypto) and the retries; per protocol, the
+ * runs and their durations; the rendezvous entries TO1 used. Call it
+ * between runs, not while a protocol runs on another thread.
+ *
+ * @param stats - out, the statistics.
+ * @return SDO_SUCCESS, SDO_ERROR if stats is NULL or the SDK is built with
+ * PROT_STATS=false.
+ */
+sdoSdkStatus sdoSdkGetStats(sdoSdkStats *stats)
+{
+	sdoSdkStats *s = sdoStatsGet();
+
+	if (!stats || !s)
+		return SDO_ERROR;
+	if (memcpy_s(stats, sizeof(*stats), s, sizeof(*s)) != 0)
+		return SDO_ERROR;
+	return SDO_SUCCESS;
+}
+
+/**
+ * Clears the statistics of the protocol runs.
+ *
+ * @return SDO_SUCCESS, SDO_ERROR if the SDK is built with PROT_STATS=false.
+ */
+sdoSdkStatus sdoSdkResetStats(void)
+{
+	sdoSdkStats *s = sdoStatsGet();
+
+	if (!s)
+		return SDO_ERROR;
+	if (memset_s(s, sizeof(*s), 0) != 0)
+		return SDO_ERROR;
+	return SDO_SUCCESS;
+}
+
+/**
+ * Copies out the counters of the crypto operations since start-up or the
+ * last sdoSdkResetCryptoStats: per operation, the backend doing it, the
+ * calls, the bytes processed and the latency. They are process wide,
+ * covering all SDK instances and threads.
+ *
+ * @param stats - out, the counters.
+ * @return SDO_SUCCESS, SDO_ERROR if stats is NULL or the SDK is built
+ * without CRYPTO_STATS=true.
+ */
+sdoSdkStatus sdoSdkGetCryptoStats(sdoSdkCryptoStats *stats)
+{
+	return sdoCryptoStatsGet(stats) ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Clears the counters of the crypto operations.
+ *
+ * @return SDO_SUCCESS, SDO_ERROR if the SDK is built without
+ * CRYPTO_STATS=true.
+ */
+sdoSdkStatus sdoSdkResetCryptoStats(void)
+{
+	return sdoCryptoStatsReset() ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Copies out the counters of the storage since start-up or the last
+ * sdoSdkResetStorageStats: the blob reads, writes and size queries, the
+ * files opened, the bytes read from and written to the medium, the syncs,
+ * the time spent in the HMACs and GCM seals, and the writes per file. They
+ * are process wide, covering all SDK instances.
+ *
+ * @param stats - out, the counters.
+ * @return SDO_SUCCESS, SDO_ERROR if stats is NULL or the SDK is built
+ * without STORAGE_STATS=true.
+ */
+sdoSdkStatus sdoSdkGetStorageStats(sdoSdkStorageStats *stats)
+{
+	return sdoStorageStatsGet(stats) ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Clears the counters of the storage.
+ *
+ * @return SDO_SUCCESS, SDO_ERROR if the SDK is built without
+ * STORAGE_STATS=true.
+ */
+sdoSdkStatus sdoSdkResetStorageStats(void)
+{
+	return sdoStorageStatsReset() ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Copies out the heap statistics: per subsystem, the allocations, their
+ * sizes and the bytes in use and at the peak; the peak of the DI, TO1 and
+ * TO2 runs. They are process wide, covering all SDK instances.
+ *
+ * @param stats - out, the statistics.
+ * @return SDO_SUCCESS, SDO_ERROR if stats is NULL or the SDK is built
+ * without ALLOC_STATS=true.
+ */
+sdoSdkStatus sdoSdkGetAllocStats(sdoSdkAllocStats *stats)
+{
+	return sdoAllocStatsGet(stats) ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Clears the heap statistics, the peaks start over from the bytes in use.
+ *
+ * @return SDO_SUCCESS, SDO_ERROR if the SDK is built without
+ * ALLOC_STATS=true.
+ */
+sdoSdkStatus sdoSdkResetAllocStats(void)
+{
+	return sdoAllocStatsReset() ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Sets the level of the log messages of a subsystem (its files are those
+ * of the heap statistics), the messages above it are dropped before they
+ * are formatted. It cannot raise the LOG_LEVEL of the build. It is process
+ * wide, covering all SDK instances.
+ *
+ * @param subsystem - the subsystem, SDO_ALLOC_TAGS for all of them.
+ * @param level - LOG_ERROR (0) to LOG_DEBUGNTS (3), -1 for none.
+ * @return SDO_SUCCESS, SDO_ERROR for an unknown subsystem or if the SDK is
+ * built without LOG_ASYNC=true.
+ */
+sdoSdkStatus sdoSdkSetLogLevel(sdoSdkAllocTag subsystem, int level)
+{
+	return sdoLogSetLevel(subsystem, level) ? SDO_ERROR : SDO_SUCCESS;
+}
+
+/**
+ * Registers a callback told about each message exchanged with the
+ * manufacturer, rendezvous and owner servers, once its response is in. It
+ * is shared by all SDK instances and called from the thread running the
+ * protocol. May be called before or after sdoSdkInit.
+ *
+ * @param msgCallback - callback, NULL for none.
+ * @return SDO_SUCCESS
+ */
+sdoSdkStatus sdoSdkSetMsgCallback(sdoSdkMsgCB msgCallback)
+{
+	sdoProtCtxSetMsgCallback(msgCallback);
+	return SDO_SUCCESS;
+}
+
 /**
  * Sets device state to Resale if all conditions are met.
  * sdoSdkInit should be called before calling this function
@@ -558,43 +1135,375 @@ sdoSdkStatus sdoSdkResale(void)
 	return SDO_RESALE_NOT_SUPPORTED;
 #endif
 
-	if (!g_sdo_data)
+	if (!g_sdo_data)
+		return SDO_ERROR;
+
+	if (!g_sdo_data->devcred)
+		return SDO_ERROR;
+
+	if (g_sdo_data->devcred->ST == SDO_DEVICE_STATE_IDLE) {
+		if (0 != sdoCryptoRequire(SDO_CRYPTO_ENGINE)) {
+			LOG(LOG_ERROR, "sdoCryptoInit failed!!\n");
+			return SDO_ERROR;
+		}
+		if (sdoCredLoad() != 0)
+			return SDO_ERROR;
+		g_sdo_data->devcred->ST = SDO_DEVICE_STATE_READYN;
+
+		if (load_mfg_secret()) {
+			LOG(LOG_ERROR, "Reading {Mfg|Secret} blob failied!\n");
+			return SDO_ERROR;
+		}
+
+		ret = store_credential(g_sdo_data->devcred);
+		if (!ret) {
+			LOG(LOG_INFO, "Set Resale complete\n");
+			r = SDO_SUCCESS;
+		}
+	} else {
+		r = SDO_RESALE_NOT_READY;
+	}
+
+	if (r == SDO_ERROR) {
+		LOG(LOG_ERROR, "Failed to set Resale\n");
+	} else if (r == SDO_RESALE_NOT_READY) {
+		LOG(LOG_DEBUG, "Device is not ready for Resale\n");
+	}
+	if (g_sdo_data->devcred) {
+		sdoDevCredFree(g_sdo_data->devcred);
+		sdoFree(g_sdo_data->devcred);
+		g_sdo_data->devcred = NULL;
+	}
+
+	sdoFree(g_sdo_data);
+	g_sdo_data = NULL;
+	return r;
+}
+
+/**
+ * Internal API: let the calling thread work on ctx, NULL for the instance
+ * of sdoSdkInit.
+ */
+static void sdoSdkCtxBind(sdoSdkCtx_t *ctx)
+{
+	g_sdo_slot = ctx ? &ctx->app : &g_sdo_default;
+	sdoCryptoCtxBind(ctx ? ctx->crypto : NULL);
+	sdoStatsBind(ctx ? ctx->stats : NULL);
+#ifdef TARGET_OS_LINUX
+	sdoStorageCtxBind(ctx ? ctx->storage : NULL);
+#endif
+}
+
+#ifdef TARGET_OS_LINUX
+/**
+ * Internal API: set up an SDK instance on its storage, which it takes
+ * over.
+ */
+static sdoSdkCtx_t *sdoSdkCreateOn(sdoSdkErrorCB errorHandlingCallback,
+				   uint32_t numModules,
+				   sdoSdkServiceInfoModule *moduleInformation,
+				   sdoStorageCtx_t *storage, const char *name)
+{
+	sdoSdkCtx_t *ctx = sdoAlloc(sizeof(sdoSdkCtx_t));
+	sdoSdkStatus ret;
+
+	if (!ctx) {
+		LOG(LOG_ERROR, "malloc failed to alloc sdoSdkCtx_t\n");
+		if (storage)
+			sdoStorageCtxFree(storage);
+		return NULL;
+	}
+
+	ctx->crypto = sdoCryptoCtxAlloc();
+	ctx->storage = storage;
+	if (!ctx->crypto || !ctx->storage)
+		goto err;
+#if !defined(PROT_STATS_FALSE)
+	ctx->stats = sdoAlloc(sizeof(sdoSdkStats));
+	if (!ctx->stats)
+		goto err;
+#endif
+
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkInit(errorHandlingCallback, numModules, moduleInformation);
+	sdoSdkCtxBind(NULL);
+	if (ret == SDO_SUCCESS)
+		return ctx;
+
+err:
+	LOG(LOG_ERROR, "Failed to set up the SDK instance of %s\n",
+	    name ? name : "(null)");
+	sdoSdkDestroy(ctx);
+	return NULL;
+}
+#endif
+
+/**
+ * sdoSdkCreate sets up an SDK instance, which is sdoSdkInit for one device
+ * identity among several in the same process. Each instance has its own
+ * credentials and protocol state, crypto context and storage, so that
+ * instances may run on different threads at the same time. An instance is
+ * used by one thread at a time, and is good for one sdoSdkCtxRun or
+ * sdoSdkCtxResale, as after sdoSdkInit. Linux only.
+ *
+ * @param errorHandlingCallback - see sdoSdkInit.
+ * @param numModules - see sdoSdkInit.
+ * @param moduleInformation - see sdoSdkInit.
+ * @param dataDir - directory of the credentials and platform files of the
+ * instance, laid out as the data directory. Instances must not share it.
+ * @return the instance, NULL on error
+ */
+sdoSdkCtx_t *sdoSdkCreate(sdoSdkErrorCB errorHandlingCallback,
+			  uint32_t numModules,
+			  sdoSdkServiceInfoModule *moduleInformation,
+			  const char *dataDir)
+{
+#ifdef TARGET_OS_LINUX
+	return sdoSdkCreateOn(errorHandlingCallback, numModules,
+			      moduleInformation, sdoStorageCtxAlloc(dataDir),
+			      dataDir);
+#else
+	(void)errorHandlingCallback;
+	(void)numModules;
+	(void)moduleInformation;
+	(void)dataDir;
+	LOG(LOG_ERROR, "SDK instances are not supported on this platform\n");
+	return NULL;
+#endif
+}
+
+/**
+ * sdoSdkCreateIdentity is sdoSdkCreate for an identity of the identity
+ * store (IDENTITY_STORE), opened with sdoSdkIdentityStoreOpen: the blobs
+ * of the instance are records of the store, sealed with keys derived from
+ * the platform keys for the identity, rather than files of a directory.
+ * Its writes are durable with the next sdoSdkIdentityStoreCommit.
+ *
+ * @param errorHandlingCallback - see sdoSdkInit.
+ * @param numModules - see sdoSdkInit.
+ * @param moduleInformation - see sdoSdkInit.
+ * @param identity - name of the identity in the store, without '/'.
+ * Instances must not share it.
+ * @return the instance, NULL on error
+ */
+sdoSdkCtx_t *sdoSdkCreateIdentity(sdoSdkErrorCB errorHandlingCallback,
+				  uint32_t numModules,
+				  sdoSdkServiceInfoModule *moduleInformation,
+				  const char *identity)
+{
+#ifdef TARGET_OS_LINUX
+	return sdoSdkCreateOn(errorHandlingCallback, numModules,
+			      moduleInformation,
+			      sdoStorageCtxAllocIdentity(identity), identity);
+#else
+	(void)errorHandlingCallback;
+	(void)numModules;
+	(void)moduleInformation;
+	(void)identity;
+	LOG(LOG_ERROR, "SDK instances are not supported on this platform\n");
+	return NULL;
+#endif
+}
+
+/**
+ * sdoSdkIdentityStoreOpen reads the identity store at once, before the
+ * instances of sdoSdkCreateIdentity are set up. Linux only.
+ *
+ * @param path - file of the store, NULL for data/identities.bin.
+ * @return SDO_SUCCESS on success (an absent store is empty), SDO_ERROR
+ * otherwise, for ex: if the store is damaged.
+ */
+sdoSdkStatus sdoSdkIdentityStoreOpen(const char *path)
+{
+#ifdef TARGET_OS_LINUX
+	return sdoIdentityStoreOpen(path) == 0 ? SDO_SUCCESS : SDO_ERROR;
+#else
+	(void)path;
+	return SDO_ERROR;
+#endif
+}
+
+/**
+ * sdoSdkIdentityStoreCommit makes the credentials all the instances of
+ * sdoSdkCreateIdentity wrote since the last commit durable, with one write
+ * of the store. Instances may keep on running meanwhile.
+ *
+ * @return SDO_SUCCESS on success, SDO_ERROR otherwise, in which case the
+ * credentials are written with the next commit.
+ */
+sdoSdkStatus sdoSdkIdentityStoreCommit(void)
+{
+#ifdef TARGET_OS_LINUX
+	return sdoIdentityStoreCommit() == 0 ? SDO_SUCCESS : SDO_ERROR;
+#else
+	return SDO_ERROR;
+#endif
+}
+
+/**
+ * sdoSdkIdentityStoreClose releases the identity store once the instances
+ * of sdoSdkCreateIdentity are destroyed. What was not committed is lost.
+ */
+void sdoSdkIdentityStoreClose(void)
+{
+#ifdef TARGET_OS_LINUX
+	sdoIdentityStoreClose();
+#endif
+}
+
+/**
+ * sdoSdkCtxRun is sdoSdkRun for an instance of sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @return SDO_SUCCESS on success. non-zero value from sdoSdkStatus enum.
+ */
+sdoSdkStatus sdoSdkCtxRun(sdoSdkCtx_t *ctx)
+{
+	sdoSdkStatus ret;
+
+	if (!ctx)
+		return SDO_ERROR;
+
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkRun();
+	sdoSdkCtxBind(NULL);
+	return ret;
+}
+
+/**
+ * sdoSdkCtxRunWithBudget is sdoSdkRunWithBudget for an instance of
+ * sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @param budgetMs - time budget in milliseconds, 0 for none.
+ * @return see sdoSdkRunWithBudget.
+ */
+sdoSdkStatus sdoSdkCtxRunWithBudget(sdoSdkCtx_t *ctx, uint32_t budgetMs)
+{
+	sdoSdkStatus ret;
+
+	if (!ctx)
+		return SDO_ERROR;
+
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkRunWithBudget(budgetMs);
+	sdoSdkCtxBind(NULL);
+	return ret;
+}
+
+/**
+ * sdoSdkCtxResale is sdoSdkResale for an instance of sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @return see sdoSdkResale.
+ */
+sdoSdkStatus sdoSdkCtxResale(sdoSdkCtx_t *ctx)
+{
+	sdoSdkStatus ret;
+
+	if (!ctx)
+		return SDO_ERROR;
+
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkResale();
+	sdoSdkCtxBind(NULL);
+	return ret;
+}
+
+/**
+ * sdoSdkCtxGetStatus is sdoSdkGetStatus for an instance of sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @return see sdoSdkGetStatus.
+ */
+sdoSdkDeviceState sdoSdkCtxGetStatus(sdoSdkCtx_t *ctx)
+{
+	sdoSdkDeviceState status;
+
+	if (!ctx)
+		return SDO_STATE_ERROR;
+
+	sdoSdkCtxBind(ctx);
+	status = sdoSdkGetStatus();
+	sdoSdkCtxBind(NULL);
+	return status;
+}
+
+/**
+ * sdoSdkCtxCredSync is sdoSdkCredSync for an instance of sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @return see sdoSdkCredSync.
+ */
+sdoSdkStatus sdoSdkCtxCredSync(sdoSdkCtx_t *ctx)
+{
+	sdoSdkStatus ret;
+
+	if (!ctx)
 		return SDO_ERROR;
 
-	if (!g_sdo_data->devcred)
-		return SDO_ERROR;
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkCredSync();
+	sdoSdkCtxBind(NULL);
+	return ret;
+}
 
-	if (g_sdo_data->devcred->ST == SDO_DEVICE_STATE_IDLE) {
-		g_sdo_data->devcred->ST = SDO_DEVICE_STATE_READYN;
+/**
+ * sdoSdkCtxGetStats is sdoSdkGetStats for an instance of sdoSdkCreate.
+ *
+ * @param ctx - the instance.
+ * @param stats - see sdoSdkGetStats.
+ * @return see sdoSdkGetStats.
+ */
+sdoSdkStatus sdoSdkCtxGetStats(sdoSdkCtx_t *ctx, sdoSdkStats *stats)
+{
+	sdoSdkStatus ret;
 
-		if (load_mfg_secret()) {
-			LOG(LOG_ERROR, "Reading {Mfg|Secret} blob failied!\n");
-			return SDO_ERROR;
-		}
+	if (!ctx)
+		return SDO_ERROR;
 
-		ret = store_credential(g_sdo_data->devcred);
-		if (!ret) {
-			LOG(LOG_INFO, "Set Resale complete\n");
-			r = SDO_SUCCESS;
-		}
-	} else {
-		r = SDO_RESALE_NOT_READY;
-	}
+	sdoSdkCtxBind(ctx);
+	ret = sdoSdkGetStats(stats);
+	sdoSdkCtxBind(NULL);
+	return ret;
+}
 
-	if (r == SDO_ERROR) {
-		LOG(LOG_ERROR, "Failed to set Resale\n");
-	} else if (r == SDO_RESALE_NOT_READY) {
-		LOG(LOG_DEBUG, "Device is not ready for Resale\n");
-	}
-	if (g_sdo_data->devcred) {
-		sdoDevCredFree(g_sdo_data->devcred);
-		sdoFree(g_sdo_data->devcred);
-		g_sdo_data->devcred = NULL;
-	}
+/**
+ * sdoSdkDestroy waits for the credentials of an instance to be written,
+ * and releases it along with all its state.
+ *
+ * @param ctx - instance of sdoSdkCreate, may be NULL.
+ */
+void sdoSdkDestroy(sdoSdkCtx_t *ctx)
+{
+	if (!ctx)
+		return;
 
-	sdoFree(g_sdo_data);
-	g_sdo_data = NULL;
-	return r;
+	sdoSdkCtxBind(ctx);
+	if (ctx->app) {
+		if (ctx->app->devcred) {
+			sdoDevCredFree(ctx->app->devcred);
+			sdoFree(ctx->app->devcred);
+		}
+		sdoModuleRegFree(&ctx->app->modules);
+		sdoDsiSnapFree(&ctx->app->dsiSnap);
+		sdoFragCacheFree(&ctx->app->frags);
+		sdoFree(ctx->app);
+		ctx->app = NULL;
+	}
+	/* The TLS sessions of the thread hold master secrets */
+	sdo_ssl_session_cache_clear();
+	sdoSdkCtxBind(NULL);
+
+	/* Each waits for and wipes what the instance left behind */
+	if (ctx->crypto)
+		sdoCryptoCtxFree(ctx->crypto);
+#ifdef TARGET_OS_LINUX
+	if (ctx->storage)
+		sdoStorageCtxFree(ctx->storage);
+#endif
+	sdoFree(ctx->stats);
+	sdoFree(ctx);
 }
 
 /**
@@ -625,6 +1534,99 @@ static void app_close(void)
 		sdoFree(sdob->block);
 		sdob->block = NULL;
 	}
+
+	sdoProtCtxReleaseBuffers();
+	sdoArenaRelease();
+}
+
+/**
+ * Internal API: run the protocol of a state and finish the state with done.
+ * A step-wise run only starts the protocol here, sdoSdkStep advances it and
+ * calls done once it is over.
+ */
+static bool sdoSdkProtRun(SDOProtCtx_t *prot_ctx,
+			  bool (*done)(SDOProtCtx_t *prot_ctx, int result))
+{
+	if (!g_sdo_data->stepping)
+		return done(prot_ctx, sdoProtCtxRun(prot_ctx));
+
+	if (sdoProtCtxStart(prot_ctx) != 0)
+		return done(prot_ctx, -1);
+
+	g_sdo_data->stepProt = prot_ctx;
+	g_sdo_data->stepDone = done;
+	return true;
+}
+
+/**
+ * Internal API: share out the time budget of the run to the protocol of
+ * the state about to start, percent of what is left. With none left the
+ * run is stopped, to be resumed.
+ *
+ * @return true if the protocol is to run.
+ */
+static bool sdoSdkBudgetShare(unsigned percent)
+{
+	uint64_t now;
+
+	if (!g_sdo_data->budgetEnd) {
+		sdoProtCtxSetRunDeadline(0);
+		return true;
+	}
+
+	now = sdoTimeMs();
+	if (now >= g_sdo_data->budgetEnd) {
+		LOG(LOG_INFO, "Time budget used up, to be resumed\n");
+		g_sdo_data->state_fn = &_STATE_Budget;
+		return false;
+	}
+	g_sdo_data->shareEnd =
+	    now + (g_sdo_data->budgetEnd - now) * percent / 100;
+	sdoProtCtxSetRunDeadline(g_sdo_data->shareEnd);
+	return true;
+}
+
+/**
+ * Internal API: tell whether a wait of ms before the next state fits the
+ * time budget of the run. If not, the retry or the next state is left to
+ * the resumed run, as is a protocol that failed for running out of its
+ * share; any other failure stays an error.
+ */
+static bool sdoSdkBudgetFits(uint32_t ms)
+{
+	uint64_t now = sdoTimeMs();
+
+	if (now + ms < g_sdo_data->budgetEnd)
+		return true;
+	if (g_sdo_data->state_fn != &_STATE_Error ||
+	    now >= g_sdo_data->shareEnd) {
+		LOG(LOG_INFO, "Time budget used up, to be resumed\n");
+		g_sdo_data->state_fn = &_STATE_Budget;
+	}
+	return false;
+}
+
+/**
+ * Internal API: wait before the next state. A step-wise run is stepped
+ * again after the delay instead.
+ */
+static void sdoSdkDelay(uint32_t ms)
+{
+	if (g_sdo_data->budgetEnd && !sdoSdkBudgetFits(ms))
+		return;
+
+	if (g_sdo_data->stepping)
+		g_sdo_data->wakeAt = sdoTimeMs() + ms;
+	else
+		sdoRetryWait(ms, SDO_SLEEP_DELAY);
+}
+
+/**
+ * Internal API: wait before retrying the protocol that failed.
+ */
+static void sdoSdkRetryWait(uint32_t minMs)
+{
+	sdoSdkDelay(sdoRetryDelay(minMs));
 }
 
 static const uint16_t g_DI_PORT = 8039;
@@ -640,9 +1642,11 @@ static bool _STATE_DI(void)
 {
 	bool ret = false;
 	SDOProtCtx_t *prot_ctx = NULL;
-	sdoSdkStatus status = SDO_SUCCESS;
 	uint16_t diPort = g_DI_PORT;
 
+	if (!sdoSdkBudgetShare(100))
+		return false;
+
 	LOG(LOG_DEBUG, "\n-------------------------------------------"
 		       "-------------------------------------------"
 		       "-------------------------------------------"
@@ -750,11 +1754,10 @@ static bool _STATE_DI(void)
 
 	/* If MANUFACTURER_PORT file does not exists or is a blank file then,
 	   use existing global DI port(8039) else use configured value as DI
-	   port */
-	if (file_exists(MANUFACTURER_PORT)) {
-		fsize =
-		    sdoBlobSize((char *)MANUFACTURER_PORT, SDO_SDK_RAW_DATA);
-
+	   port. The storage looks it up in the data directory of the
+	   instance. */
+	fsize = sdoBlobSize((char *)MANUFACTURER_PORT, SDO_SDK_RAW_DATA);
+	if (fsize > 0) {
 		if ((fsize > 0) && (fsize <= SDO_PORT_MAX_LEN)) {
 			char portBuffer[SDO_PORT_MAX_LEN + 1] = {0};
 			char *extraString = NULL;
@@ -807,7 +1810,34 @@ static bool _STATE_DI(void)
 		goto end;
 	}
 
-	if (sdoProtCtxRun(prot_ctx) != 0) {
+	/* The protocol context refers to them until DI is done */
+	g_sdo_data->mfgIPAddr = manIPAddr;
+	g_sdo_data->mfgDNS = mfg_dns;
+	return sdoSdkProtRun(prot_ctx, &_STATE_DI_Done);
+
+end:
+	sdoProtDIExit(g_sdo_data);
+	sdoFree(manIPAddr);
+#ifndef TARGET_OS_OPTEE
+	sdoFree(mfg_dns);
+#endif
+	return ret;
+}
+
+/**
+ * Finishes the DI state once the DI protocol has run.
+ *
+ * @param prot_ctx - protocol context of DI.
+ * @param result - 0 if the protocol completed, -1 otherwise.
+ * @return ret
+ *         true if DI completes successfully. false in case of error.
+ */
+static bool _STATE_DI_Done(SDOProtCtx_t *prot_ctx, int result)
+{
+	bool ret = false;
+	sdoSdkStatus status = SDO_SUCCESS;
+
+	if (result != 0) {
 		LOG(LOG_ERROR, "DI failed.\n");
 		if (g_sdo_data->error_recovery) {
 			LOG(LOG_INFO, "Retrying,.....\n");
@@ -824,11 +1854,11 @@ static bool _STATE_DI(void)
 					goto end;
 				}
 			}
-			sdoSleep(3); /* Sleep and retry */
+			sdoSdkRetryWait(0); /* Sleep and retry */
 			goto end;
 		} else {
 			ERROR()
-			sdoSleep(g_sdo_data->delaysec + sdoRandom() % 25);
+			sdoSdkRetryWait(g_sdo_data->delaysec * 1000);
 			if (g_sdo_data->error_callback)
 				status = g_sdo_data->error_callback(
 				    SDO_ERROR, SDO_DI_ERROR);
@@ -841,7 +1871,7 @@ static bool _STATE_DI(void)
 
 #ifdef NO_PERSISTENT_STORAGE
 	g_sdo_data->state_fn = &_STATE_TO1;
-	sdoSleep(5);
+	sdoSdkDelay(5000);
 #else
 	g_sdo_data->state_fn = &_STATE_Shutdown;
 #endif
@@ -849,12 +1879,219 @@ static bool _STATE_DI(void)
 end:
 	sdoProtDIExit(g_sdo_data);
 	sdoProtCtxFree(prot_ctx);
-	sdoFree(manIPAddr);
+	sdoFree(g_sdo_data->mfgIPAddr);
+	g_sdo_data->mfgIPAddr = NULL;
 #ifndef TARGET_OS_OPTEE
-	sdoFree(mfg_dns);
+	sdoFree(g_sdo_data->mfgDNS);
 #endif
+	g_sdo_data->mfgDNS = NULL;
+	return ret;
+}
+
+#ifdef RV_REDIRECT_BLOB
+/*
+ * The cached owner redirect is the expiry (8 bytes, seconds since the
+ * epoch) followed by the GUID it is for, the owner address (i1, port1 and
+ * dns1), the owner-signed "bo" of TO1.SDORedirect and its signature, each
+ * preceded by 2 bytes of length, all big-endian. Blobs cannot be removed,
+ * an expiry of 0 marks the cache as empty.
+ */
+#define REDIRECT_EXPIRY_SZ 8
+#define REDIRECT_FIELDS 6
+/* Longest domain name as per RFC 1035, incl. terminator */
+#define REDIRECT_MAX_DN 256
+
+typedef struct {
+	uint8_t *buf;
+	size_t len;
+	size_t pos;
+} sdoRedirectBuf_t;
+
+/**
+ * Internal API: append a field of len bytes to the redirect blob.
+ */
+static bool sdoRedirectPut(sdoRedirectBuf_t *b, const void *bytes,
+			   size_t len)
+{
+	if (len > 0xffff || b->pos + 2 + len > b->len)
+		return false;
+	b->buf[b->pos++] = (len >> 8) & 0xff;
+	b->buf[b->pos++] = len & 0xff;
+	if (len && memcpy_s(&b->buf[b->pos], len, bytes, len) != 0)
+		return false;
+	b->pos += len;
+	return true;
+}
+
+/**
+ * Internal API: the next field of the redirect blob, NULL if truncated.
+ */
+static uint8_t *sdoRedirectGet(sdoRedirectBuf_t *b, size_t *len)
+{
+	uint8_t *bytes;
+
+	if (b->pos + 2 > b->len)
+		return NULL;
+	*len = (b->buf[b->pos] << 8) | b->buf[b->pos + 1];
+	b->pos += 2;
+	if (b->pos + *len > b->len)
+		return NULL;
+	bytes = &b->buf[b->pos];
+	b->pos += *len;
+	return bytes;
+}
+
+/**
+ * Internal API: keep the redirect of the TO1 just done, so that TO2 can be
+ * retried against the owner for RV_REDIRECT_TTL seconds without TO1.
+ */
+static void sdoRedirectSave(SDOProt_t *ps)
+{
+	const SDORedirect_t *r = &ps->SDORedirect;
+	uint8_t port[2] = {(ps->port1 >> 8) & 0xff, ps->port1 & 0xff};
+	uint64_t expiry = (uint64_t)time(NULL) + RV_REDIRECT_TTL;
+	sdoRedirectBuf_t b = {0};
+	size_t dnsLen;
+	int i;
+
+	if (!ps->g2 || !r->plainText || !r->Obsig)
+		return;
+	dnsLen = ps->dns1 ? strnlen_s(ps->dns1, REDIRECT_MAX_DN) : 0;
+	b.len = REDIRECT_EXPIRY_SZ + REDIRECT_FIELDS * 2 + ps->g2->byteSz +
+		ps->i1.length + sizeof(port) + dnsLen + r->plainText->byteSz +
+		r->Obsig->byteSz;
+	b.buf = sdoAlloc(b.len);
+	if (!b.buf)
+		return;
+	for (i = REDIRECT_EXPIRY_SZ - 1; i >= 0; i--, expiry >>= 8)
+		b.buf[i] = expiry & 0xff;
+	b.pos = REDIRECT_EXPIRY_SZ;
+
+	if (sdoRedirectPut(&b, ps->g2->bytes, ps->g2->byteSz) &&
+	    sdoRedirectPut(&b, ps->i1.addr, ps->i1.length) &&
+	    sdoRedirectPut(&b, port, sizeof(port)) &&
+	    sdoRedirectPut(&b, ps->dns1, dnsLen) &&
+	    sdoRedirectPut(&b, r->plainText->bytes, r->plainText->byteSz) &&
+	    sdoRedirectPut(&b, r->Obsig->bytes, r->Obsig->byteSz) &&
+	    sdoBlobWrite((char *)RV_REDIRECT_BLOB, SDO_SDK_SECURE_DATA, b.buf,
+			 b.pos) == (int32_t)b.pos) {
+		LOG(LOG_DEBUG, "Owner redirect cached\n");
+	} else {
+		LOG(LOG_ERROR, "Caching the owner redirect failed\n");
+	}
+	sdoFree(b.buf);
+}
+
+/**
+ * Internal API: forget the cached redirect, the owner rejected it or the
+ * device is onboarded.
+ */
+static void sdoRedirectDrop(void)
+{
+	static const uint8_t none[REDIRECT_EXPIRY_SZ] = {0};
+
+	if (sdoBlobSize((char *)RV_REDIRECT_BLOB, SDO_SDK_SECURE_DATA) <=
+	    REDIRECT_EXPIRY_SZ)
+		return;
+	if (sdoBlobWrite((char *)RV_REDIRECT_BLOB, SDO_SDK_SECURE_DATA, none,
+			 sizeof(none)) != (int32_t)sizeof(none))
+		LOG(LOG_ERROR, "Dropping the cached owner redirect failed\n");
+}
+
+/**
+ * Internal API: set the owner address and SDORedirect of ps from the
+ * cached redirect, in place of running TO1.
+ *
+ * @param ps - protocol state, initialized for TO1.
+ * @return true if a redirect for the GUID of ps was cached and is valid.
+ */
+static bool sdoRedirectLoad(SDOProt_t *ps)
+{
+	int32_t size =
+	    sdoBlobSize((char *)RV_REDIRECT_BLOB, SDO_SDK_SECURE_DATA);
+	uint64_t now = (uint64_t)time(NULL);
+	uint64_t expiry = 0;
+	sdoRedirectBuf_t b = {0};
+	uint8_t *guid, *ip, *port, *dns, *bo, *sig;
+	size_t guidLen, ipLen, portLen, dnsLen, boLen, sigLen;
+	SDOByteArray_t *plainText = NULL, *obsig = NULL;
+	char *dns1 = NULL;
+	int result = 1;
+	bool ret = false;
+	int i;
+
+	if (size <= REDIRECT_EXPIRY_SZ || !ps->g2)
+		return false;
+	b.buf = sdoAlloc(size);
+	if (!b.buf)
+		return false;
+	b.len = size;
+	if (sdoBlobRead((char *)RV_REDIRECT_BLOB, SDO_SDK_SECURE_DATA, b.buf,
+			size) != size)
+		goto end;
+
+	for (i = 0; i < REDIRECT_EXPIRY_SZ; i++)
+		expiry = (expiry << 8) | b.buf[i];
+	b.pos = REDIRECT_EXPIRY_SZ;
+	/* an expiry too far ahead means the clock was set back */
+	if (now >= expiry || expiry - now > RV_REDIRECT_TTL) {
+		LOG(LOG_DEBUG, "Cached owner redirect expired\n");
+		goto end;
+	}
+
+	guid = sdoRedirectGet(&b, &guidLen);
+	ip = guid ? sdoRedirectGet(&b, &ipLen) : NULL;
+	port = ip ? sdoRedirectGet(&b, &portLen) : NULL;
+	dns = port ? sdoRedirectGet(&b, &dnsLen) : NULL;
+	bo = dns ? sdoRedirectGet(&b, &boLen) : NULL;
+	sig = bo ? sdoRedirectGet(&b, &sigLen) : NULL;
+	if (!sig || ipLen > sizeof(ps->i1.addr) || portLen != 2 || !boLen ||
+	    !sigLen || dnsLen >= REDIRECT_MAX_DN)
+		goto end;
+	if (guidLen != ps->g2->byteSz ||
+	    memcmp_s(guid, guidLen, ps->g2->bytes, guidLen, &result) != 0 ||
+	    result != 0) {
+		LOG(LOG_DEBUG, "Cached owner redirect is for another GUID\n");
+		goto end;
+	}
+
+	if (dnsLen) {
+		dns1 = sdoAlloc(dnsLen + 1);
+		if (!dns1 || memcpy_s(dns1, dnsLen + 1, dns, dnsLen) != 0)
+			goto end;
+		dns1[dnsLen] = '\0';
+	}
+	plainText = sdoByteArrayAllocWithByteArray(bo, boLen);
+	obsig = sdoByteArrayAllocWithByteArray(sig, sigLen);
+	if (!plainText || !obsig)
+		goto end;
+	if (ipLen && memcpy_s(ps->i1.addr, sizeof(ps->i1.addr), ip, ipLen) != 0)
+		goto end;
+	ps->i1.length = (uint8_t)ipLen;
+	ps->port1 = (port[0] << 8) | port[1];
+
+	sdoFree(ps->dns1);
+	ps->dns1 = dns1;
+	dns1 = NULL;
+	if (ps->SDORedirect.plainText)
+		sdoByteArrayFree(ps->SDORedirect.plainText);
+	ps->SDORedirect.plainText = plainText;
+	plainText = NULL;
+	if (ps->SDORedirect.Obsig)
+		sdoByteArrayFree(ps->SDORedirect.Obsig);
+	ps->SDORedirect.Obsig = obsig;
+	obsig = NULL;
+	ret = true;
+end:
+	if (plainText)
+		sdoByteArrayFree(plainText);
+	if (obsig)
+		sdoByteArrayFree(obsig);
+	sdoFree(dns1);
+	sdoFree(b.buf);
 	return ret;
 }
+#endif /* RV_REDIRECT_BLOB */
 
 /**
  * Handles TO1 state of device. Initializes protocol context engine,
@@ -868,7 +2105,9 @@ static bool _STATE_TO1(void)
 	bool ret = false;
 	bool tls = false;
 	SDOProtCtx_t *prot_ctx = NULL;
-	sdoSdkStatus status = SDO_SUCCESS;
+
+	if (!sdoSdkBudgetShare(SDO_BUDGET_TO1_PERCENT))
+		return false;
 
 	LOG(LOG_DEBUG, "\n-------------------------------------------"
 		       "-------------------------------------------"
@@ -884,9 +2123,20 @@ static bool _STATE_TO1(void)
 	if (sdoProtTO1Init(&g_sdo_data->prot, g_sdo_data->devcred)) {
 		goto end;
 	}
+	g_sdo_data->prot.frags = &g_sdo_data->frags;
 
 	SDOProt_t *ps = &g_sdo_data->prot;
 
+#ifdef RV_REDIRECT_BLOB
+	/* the owner of the last TO1 is still there, retry TO2 with it */
+	if (sdoRedirectLoad(ps)) {
+		LOG(LOG_INFO, "Owner redirect cached, skipping TO1\n");
+		g_sdo_data->state_fn = &_STATE_TO2;
+		ret = true;
+		goto end;
+	}
+#endif
+
 	// check for rendezvous list
 	if (!g_sdo_data->devcred->ownerBlk->rvlst ||
 	    g_sdo_data->devcred->ownerBlk->rvlst->numEntries == 0) {
@@ -895,13 +2145,24 @@ static bool _STATE_TO1(void)
 		goto end;
 	}
 
-	ps->rvIndex = ps->rvIndex + 1;
+	/* the fastest healthy entry of the past runs first */
+	int picked =
+	    sdoEndpointPickRendezvous(g_sdo_data->devcred->ownerBlk->rvlst);
+#ifdef RV_PROBE_ENABLED
+	/* probe all rendezvous entries at once, use the first reachable */
+	if (!picked)
+		picked = sdoRendezvousProbe(
+		    g_sdo_data->devcred->ownerBlk->rvlst, ps->rvIndex);
+#endif
+	if (picked > 0)
+		ps->rvIndex = picked;
+	else
+		ps->rvIndex = ps->rvIndex + 1;
 	if (ps->rvIndex > g_sdo_data->devcred->ownerBlk->rvlst->numEntries)
 		ps->rvIndex = ps->rvIndex %
 			      g_sdo_data->devcred->ownerBlk->rvlst->numEntries;
-	SDORendezvous_t *rv = g_sdo_data->devcred->ownerBlk->rvlst->rvEntries;
-	for (int i = 1; i < ps->rvIndex; i++)
-		rv = rv->next;
+	SDORendezvous_t *rv = sdoRendezvousListGet(
+	    g_sdo_data->devcred->ownerBlk->rvlst, ps->rvIndex - 1);
 
 	if (rv == NULL) {
 		ERROR();
@@ -931,9 +2192,32 @@ static bool _STATE_TO1(void)
 		ERROR();
 		goto end;
 	}
+	sdoStatsRendezvous((uint32_t)ps->rvIndex);
+
+	return sdoSdkProtRun(prot_ctx, &_STATE_TO1_Done);
+
+end:
+	sdoProtTO1Exit(g_sdo_data);
+	return ret;
+}
+
+/**
+ * Finishes the TO1 state once the TO1 protocol has run.
+ *
+ * @param prot_ctx - protocol context of TO1.
+ * @param result - 0 if the protocol completed, -1 otherwise.
+ * @return ret
+ *         true if TO1 completes successfully. false in case of error.
+ */
+static bool _STATE_TO1_Done(SDOProtCtx_t *prot_ctx, int result)
+{
+	bool ret = false;
+	sdoSdkStatus status = SDO_SUCCESS;
 
-	if (sdoProtCtxRun(prot_ctx) != 0) {
+	if (result != 0) {
 		LOG(LOG_ERROR, "TO1 failed.\n");
+		/* the redirect, if any, is not to be followed */
+		sdoOwnerPreconnectDrop();
 		if (g_sdo_data->error_recovery) {
 			LOG(LOG_INFO, "Retrying,.....\n");
 			g_sdo_data->state_fn = &_STATE_TO1;
@@ -948,13 +2232,13 @@ static bool _STATE_TO1(void)
 					goto end;
 				}
 			}
-			sdoSleep(3);
+			sdoSdkRetryWait(0);
 			/* Error recovery is enabled, so, it's not the final
 			 * status */
 			goto end;
 		} else {
 			ERROR()
-			sdoSleep(g_sdo_data->delaysec + sdoRandom() % 25);
+			sdoSdkRetryWait(g_sdo_data->delaysec * 1000);
 			if (g_sdo_data->error_callback)
 				status = g_sdo_data->error_callback(
 				    SDO_ERROR, SDO_TO1_ERROR);
@@ -965,6 +2249,10 @@ static bool _STATE_TO1(void)
 	LOG(LOG_DEBUG, "\n------------------------------------ TO1 Successful "
 		       "--------------------------------------\n");
 
+#ifdef RV_REDIRECT_BLOB
+	sdoRedirectSave(&g_sdo_data->prot);
+#endif
+
 	g_sdo_data->state_fn = &_STATE_TO2;
 	ret = true;
 end:
@@ -983,9 +2271,10 @@ end:
 static bool _STATE_TO2(void)
 {
 	SDOProtCtx_t *prot_ctx = NULL;
-	SDOBlock_t *sdob;
 	bool ret = false;
-	sdoSdkStatus status = SDO_SUCCESS;
+
+	if (!sdoSdkBudgetShare(100))
+		return false;
 
 	LOG(LOG_DEBUG, "\n-------------------------------------------"
 		       "-------------------------------------------"
@@ -1006,20 +2295,50 @@ static bool _STATE_TO2(void)
 
 	if (!sdoProtTO2Init(&g_sdo_data->prot, g_sdo_data->service_info,
 
-			    g_sdo_data->devcred, g_sdo_data->moduleList)) {
+			    g_sdo_data->devcred, g_sdo_data->modules.head)) {
 		LOG(LOG_ERROR, "TO2_Init() failed!\n");
-		goto err;
+		return sdoTO2End(NULL, false);
 	}
+	g_sdo_data->prot.osiCache = &g_sdo_data->osiCache;
+	sdoOsiCacheOpen(&g_sdo_data->osiCache, g_sdo_data->prot.g2);
+#ifdef DSI_CACHE_FALSE
+	/* encoded for this run only */
+	g_sdo_data->dsiSnap.gen++;
+#endif
+	g_sdo_data->prot.dsiSnap = &g_sdo_data->dsiSnap;
+	g_sdo_data->prot.frags = &g_sdo_data->frags;
 
 	prot_ctx = sdoProtCtxAlloc(sdo_process_states, &g_sdo_data->prot,
 				   &g_sdo_data->prot.i1, g_sdo_data->prot.dns1,
 				   (uint16_t)g_sdo_data->prot.port1, false);
 	if (prot_ctx == NULL) {
 		ERROR();
-		goto err;
+		return sdoTO2End(NULL, false);
 	}
 
-	if (sdoProtCtxRun(prot_ctx) != 0) {
+	return sdoSdkProtRun(prot_ctx, &_STATE_TO2_Done);
+}
+
+/**
+ * Finishes the TO2 state once the TO2 protocol has run.
+ *
+ * @param prot_ctx - protocol context of TO2.
+ * @param result - 0 if the protocol completed, -1 otherwise.
+ * @return ret
+ *         true if TO2 completes successfully. false in case of error.
+ */
+static bool _STATE_TO2_Done(SDOProtCtx_t *prot_ctx, int result)
+{
+	SDOBlock_t *sdob;
+	bool ret = false;
+
+	/* no module callback on the DSI and OSI workers from here on */
+	sdoDsiSnapJoin(&g_sdo_data->dsiSnap);
+	sdoOsiJoin(g_sdo_data->prot.SvInfoModListHead);
+	sdoOsiCacheClose(&g_sdo_data->osiCache,
+			 result == 0 && g_sdo_data->prot.success);
+
+	if (result != 0) {
 		ERROR();
 		goto err;
 	}
@@ -1041,6 +2360,9 @@ static bool _STATE_TO2(void)
 	g_sdo_data->state_fn = &_STATE_Shutdown;
 
 	sdoProtTO2Exit(g_sdo_data);
+#ifdef RV_REDIRECT_BLOB
+	sdoRedirectDrop();
+#endif
 
 	LOG(LOG_DEBUG, "\n------------------------------------ TO2 Successful "
 		       "--------------------------------------\n\n");
@@ -1066,6 +2388,104 @@ static bool _STATE_TO2(void)
 
 	ret = true;
 err:
+	return sdoTO2End(prot_ctx, ret);
+}
+
+#ifdef TO2_RESUME
+/**
+ * Internal API: keep the session of a TO2 run that lost its connection,
+ * for _STATE_TO2_Resume to send its unanswered message again on a new one
+ * instead of restarting from TO1. The keys, the IV counter and the
+ * ServiceInfo rounds of the session are left as they are, and the
+ * Authorization of the owner was kept by the protocol context.
+ * Only done once the owner has a session (msg41 answered), while it did
+ * not answer with an error, and for TO2_RESUME_TTL seconds from the loss.
+ *
+ * @return true if TO2 is to be resumed.
+ */
+static bool sdoTO2Suspend(void)
+{
+	SDOProt_t *ps = &g_sdo_data->prot;
+	uint64_t now = sdoTimeMs();
+
+	if (!g_sdo_data->error_recovery || !ps->resumeAuth ||
+	    !ps->sdow.b.block || ps->state == SDO_STATE_ERROR ||
+	    ps->state == SDO_STATE_DONE ||
+	    ps->sdow.msgType <= SDO_TO2_HELLO_DEVICE ||
+	    ps->sdow.msgType > SDO_TO2_DONE ||
+	    ps->sdor.msgType == SDO_TYPE_ERROR)
+		return false;
+
+	if (!ps->resumeEnd)
+		ps->resumeEnd = now + (uint64_t)TO2_RESUME_TTL * 1000;
+	if (now >= ps->resumeEnd) {
+		LOG(LOG_INFO, "TO2 session expired, not resumed\n");
+		return false;
+	}
+
+	LOG(LOG_INFO, "Connection lost, resuming TO2 at msg%d\n",
+	    ps->sdow.msgType);
+	g_sdo_data->recovery_enabled = true;
+	g_sdo_data->state_fn = &_STATE_TO2_Resume;
+	sdoSdkRetryWait(0);
+	/* the retry is left to the next time budget */
+	if (g_sdo_data->state_fn != &_STATE_TO2_Resume)
+		sdoProtTO2Exit(g_sdo_data);
+	return true;
+}
+
+/**
+ * Resumes a TO2 session that sdoTO2Suspend kept, over a new connection to
+ * the owner.
+ *
+ * @return ret
+ *         true if TO2 completes successfully. false in case of error.
+ */
+static bool _STATE_TO2_Resume(void)
+{
+	SDOProtCtx_t *prot_ctx = NULL;
+
+	if (!sdoSdkBudgetShare(100)) {
+		sdoProtTO2Exit(g_sdo_data);
+		return false;
+	}
+
+	g_sdo_data->prot.resume = true;
+	prot_ctx = sdoProtCtxAlloc(sdo_process_states, &g_sdo_data->prot,
+				   &g_sdo_data->prot.i1, g_sdo_data->prot.dns1,
+				   (uint16_t)g_sdo_data->prot.port1, false);
+	if (prot_ctx == NULL) {
+		ERROR();
+		return sdoTO2End(NULL, false);
+	}
+
+	return sdoSdkProtRun(prot_ctx, &_STATE_TO2_Done);
+}
+#endif
+
+/**
+ * Internal API: release the TO2 protocol context and, if TO2 failed, go
+ * for a retry as the error recovery settings say.
+ */
+static bool sdoTO2End(SDOProtCtx_t *prot_ctx, bool ret)
+{
+	sdoSdkStatus status = SDO_SUCCESS;
+
+#ifdef RV_REDIRECT_BLOB
+	/* unreachable owner, or it did not take the redirect: back to TO1 */
+	if (prot_ctx && !g_sdo_data->prot.success &&
+	    !g_sdo_data->prot.redirectOk)
+		sdoRedirectDrop();
+#endif
+	/* TO2 ended before it connected */
+	sdoOwnerPreconnectDrop();
+#ifdef TO2_RESUME
+	/* a lost connection, not a failed protocol */
+	if (prot_ctx && !ret && sdoTO2Suspend()) {
+		sdoProtCtxFree(prot_ctx);
+		return false;
+	}
+#endif
 	sdoProtCtxFree(prot_ctx);
 	if (g_sdo_data->prot.success == false) {
 		if (g_sdo_data->error_recovery) {
@@ -1077,7 +2497,7 @@ err:
 				status = g_sdo_data->error_callback(
 				    SDO_WARNING, SDO_TO2_ERROR);
 
-			sdoSleep(3);
+			sdoSdkRetryWait(0);
 		} else {
 			if (g_sdo_data->error_callback)
 				status = g_sdo_data->error_callback(
@@ -1120,6 +2540,7 @@ static bool _STATE_Shutdown(void)
 		sdoServiceInfoFree(g_sdo_data->service_info);
 		g_sdo_data->service_info = NULL;
 	}
+	sdoDsiSnapFree(&g_sdo_data->dsiSnap);
 	if (g_sdo_data->devcred) {
 		sdoDevCredFree(g_sdo_data->devcred);
 		sdoFree(g_sdo_data->devcred);
@@ -1131,6 +2552,11 @@ static bool _STATE_Shutdown(void)
 	/* Closing all crypto related functions.*/
 	(void)sdoCryptoClose();
 
+	/* No credential plaintext or key stays in memory after the run */
+	sdo_ssl_session_cache_clear();
+	sdoBlobCacheFlush();
+	clearPlatformKeys();
+
 	return true;
 }
 
@@ -1150,3 +2576,17 @@ static bool _STATE_Shutdown_Error(void)
 	/* Return false becuase there has been a failure. */
 	return false;
 }
+
+/**
+ * Sets device state to shutdown and sdoFrees all resources, as the time
+ * budget of the run is used up. The run is to be resumed.
+ *
+ * @return ret
+ *         Returns false always.
+ */
+static bool _STATE_Budget(void)
+{
+	(void)_STATE_Shutdown();
+	g_sdo_data->budgetOut = true;
+	return false;
+}
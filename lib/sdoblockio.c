@@ -9,15 +9,25 @@
  */
 
 #include "sdoblockio.h"
+#include "sdocbor.h"
 #include "base64.h"
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <inttypes.h>
+#include <limits.h>
 #include "safe_lib.h"
 #include "snprintf_s.h"
 
-#define SDO_TAG_MAX_LEN 32
+#if !defined(JSON_SIMD_FALSE) && defined(__SSE2__)
+#define JSON_SCAN_SSE2
+#include <emmintrin.h>
+#elif !defined(JSON_SIMD_FALSE) && defined(__aarch64__) &&                    \
+    defined(__ARM_NEON)
+#define JSON_SCAN_NEON
+#include <arm_neon.h>
+#endif
 
 /*
  * Internal function prototypes
@@ -67,8 +77,11 @@ void sdoSkipC(SDOBlock_t *sdob)
  */
 void sdoBPutC(SDOBlock_t *sdob, char c)
 {
-	if (sdob->cursor >= sdob->blockMax)
-		sdoResizeBlock(sdob, sdob->blockMax + 1);
+	if (sdob->cursor >= sdob->blockMax) {
+		sdoResizeBlock(sdob, sdob->cursor + 1);
+		if (sdob->cursor >= sdob->blockMax)
+			return;
+	}
 	sdob->block[sdob->cursor++] = c;
 }
 
@@ -124,20 +137,89 @@ int intToHexit(int v)
 #endif
 
 /**
- * Internal API
+ * Grow the block to hold at least need bytes. A block that already holds
+ * data grows at least by half, so that writing a message byte by byte
+ * reallocates only a logarithmic number of times. The block is left as is
+ * if it cannot be grown.
+ *
+ * @param sdob - block to grow.
+ * @param need - number of bytes the block must hold.
  */
 void sdoResizeBlock(SDOBlock_t *sdob, int need)
 {
-	if (need > sdob->blockMax) {
-		int newSize = (need + SDO_BLOCKINC - 1) & SDO_BLOCK_MASK;
-		sdob->block = realloc(sdob->block, newSize);
-		sdob->blockMax = newSize;
+	uint8_t *block;
+	int newSize;
 
-		if (!sdob->block) {
-			LOG(LOG_ERROR, "realloc failure at %s:%d\r\n", __FILE__,
-			    __LINE__);
-		}
+	if (need <= sdob->blockMax)
+		return;
+
+	newSize = need;
+	if (sdob->blockMax && sdob->blockMax < INT_MAX / 2 &&
+	    newSize < sdob->blockMax + sdob->blockMax / 2)
+		newSize = sdob->blockMax + sdob->blockMax / 2;
+	if (newSize <= INT_MAX - SDO_BLOCKINC)
+		newSize = (newSize + SDO_BLOCKINC - 1) & SDO_BLOCK_MASK;
+#ifdef STATIC_MEM
+	/* taken as a whole pool block at once, so that it never moves */
+	if (need <= SDO_MEM_BLOCK_SIZE)
+		newSize = SDO_MEM_BLOCK_SIZE;
+#endif
+
+	block = sdoRealloc(sdob->block, newSize);
+	if (!block) {
+		LOG(LOG_ERROR, "realloc failure at %s:%d\r\n", __FILE__,
+		    __LINE__);
+		return;
 	}
+	sdob->block = block;
+	sdob->blockMax = newSize;
+}
+
+/**
+ * Internal API: release the block if it grew beyond SDO_BLOCK_RETAIN_MAX,
+ * buffers up to that size are kept for the next message.
+ */
+static void sdoBlockTrim(SDOBlock_t *sdob)
+{
+	if (sdob->block && sdob->blockMax > SDO_BLOCK_RETAIN_MAX) {
+		sdoFree(sdob->block);
+		sdob->blockMax = 0;
+	}
+}
+
+/**
+ * Reserve room for a message of an estimated size about to be written,
+ * so that it is built without growing the block repeatedly.
+ *
+ * @param sdow - writer of the message.
+ * @param len - number of bytes about to be written.
+ * @return true if the room is available, false otherwise.
+ */
+bool sdoWReserve(SDOW_t *sdow, int len)
+{
+	SDOBlock_t *sdob = &sdow->b;
+
+	if (len < 0 || sdob->cursor > INT_MAX - len)
+		return false;
+	sdoResizeBlock(sdob, sdob->cursor + len);
+	return sdob->blockMax >= sdob->cursor + len;
+}
+
+/**
+ * Reserve room for a message of len bytes about to be received.
+ *
+ * @param sdor - reader of the message.
+ * @param len - number of bytes about to be received.
+ * @return true if the room is available, false otherwise.
+ */
+bool sdoRReserve(SDOR_t *sdor, int len)
+{
+	SDOBlock_t *sdob = &sdor->b;
+
+	if (len < 0)
+		return false;
+	sdoResizeBlock(sdob, len);
+	return sdob->blockMax >= len;
 }
 
 /**
@@ -169,24 +251,316 @@ bool sdoRInit(SDOR_t *sdor, SDOReceiveFcnPtr_t rcv, void *rcvData)
 	return true;
 }
 
+/**
+ * Internal API: receive more of a streamed message, until need bytes are
+ * available from the cursor or the message is complete. The block grows at
+ * least by SDO_BLOCK_READ_CHUNK and by what it already holds past the
+ * cursor, so that a long value is received in few reads. The received bytes
+ * are NUL terminated like a block received whole.
+ * @return true if need bytes are available, false otherwise.
+ */
+bool sdoRFill(SDOR_t *sdor, int need)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	int avail, want, n;
+
+	while ((avail = sdob->blockSize - sdob->cursor) < need) {
+		if (!sdor->receive || sdor->pending <= 0)
+			return false;
+
+		want = need - avail;
+		if (want < SDO_BLOCK_READ_CHUNK)
+			want = SDO_BLOCK_READ_CHUNK;
+		if (want < avail)
+			want = avail;
+		if (want > sdor->pending)
+			want = sdor->pending;
+		if (sdob->blockSize > INT_MAX - want - 1)
+			return false;
+
+		sdoResizeBlock(sdob, sdob->blockSize + want + 1);
+		if (sdob->blockMax < sdob->blockSize + want + 1)
+			return false;
+
+		n = sdor->receive(sdor, want);
+		if (n <= 0 || n > want) {
+			LOG(LOG_ERROR, "Streamed message receive failed\n");
+			sdor->receive = NULL;
+			return false;
+		}
+		sdob->blockSize += n;
+		sdor->pending -= n;
+		sdob->block[sdob->blockSize] = 0;
+	}
+	return true;
+}
+
+/**
+ * Start reading a message of len bytes that is received while it is
+ * parsed. The receive function set with sdoRInit() is called to append the
+ * next bytes at the end of the block and returns how many it appended.
+ *
+ * @param sdor - reader of the message, flushed.
+ * @param len - length of the message.
+ */
+void sdoRStream(SDOR_t *sdor, int len)
+{
+	sdoBlockReset(&sdor->b);
+	sdor->pending = len > 0 ? len : 0;
+	sdor->haveBlock = true;
+	sdor->index.valid = false;
+}
+
+/**
+ * Tell whether the message is still being received.
+ *
+ * @param sdor - reader of the message.
+ * @return true if part of the message is still to be received.
+ */
+bool sdoRStreaming(SDOR_t *sdor)
+{
+	return sdor->receive && sdor->pending > 0;
+}
+
+/**
+ * Release the bytes of a streamed message before the cursor, so that the
+ * block holds only what is still to be parsed. The regions of the open taps
+ * are fed to them first; a region whose tap cannot be fed is kept. Offsets
+ * of the block taken before the release are no longer valid, those of the
+ * taps are adjusted.
+ *
+ * @param sdor - reader of the message.
+ */
+void sdoRRelease(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	SDOReadTap_t *t;
+	int drop, i;
+
+	if (!sdor->receive || !sdob->block)
+		return;
+
+	drop = sdob->cursor;
+	for (i = 0; i < SDO_READ_TAPS_MAX; i++) {
+		t = &sdor->taps[i];
+		if (!t->ops)
+			continue;
+		if (!t->ended && !t->pinned && t->from < sdob->cursor) {
+			if (t->ops->feed(&t->ctx, &sdob->block[t->from],
+					 sdob->cursor - t->from)) {
+				t->fed = true;
+			} else if (t->fed) {
+				t->failed = true;
+			} else {
+				t->pinned = true;
+			}
+			if (t->fed)
+				t->from = sdob->cursor;
+		}
+		if (!t->fed && t->from < drop)
+			drop = t->from;
+	}
+
+	if (drop <= 0)
+		return;
+	if (sdob->blockSize > drop &&
+	    memmove_s(sdob->block, sdob->blockMax, &sdob->block[drop],
+		      sdob->blockSize - drop) != 0)
+		return;
+
+	sdob->blockSize -= drop;
+	sdob->cursor -= drop;
+	sdob->block[sdob->blockSize] = 0;
+	for (i = 0; i < SDO_READ_TAPS_MAX; i++) {
+		t = &sdor->taps[i];
+		if (t->ops)
+			t->from = t->from > drop ? t->from - drop : 0;
+	}
+}
+
+/**
+ * Open a tap on the region of the message starting at the cursor.
+ *
+ * @param sdor - reader of the message.
+ * @param ops - consumer of the region.
+ * @return the tap, -1 if all taps are open.
+ */
+int sdoRTapBegin(SDOR_t *sdor, const SDOReadTapOps_t *ops)
+{
+	SDOReadTap_t *t;
+	int i;
+
+	if (!ops || !ops->feed)
+		return -1;
+
+	for (i = 0; i < SDO_READ_TAPS_MAX; i++) {
+		t = &sdor->taps[i];
+		if (t->ops)
+			continue;
+		if (memset_s(t, sizeof(*t), 0) != 0)
+			return -1;
+		t->ops = ops;
+		t->from = sdor->b.cursor;
+		return i;
+	}
+	LOG(LOG_ERROR, "No tap left on the message\n");
+	return -1;
+}
+
+/**
+ * End the region of a tap at the cursor. If part of the region was fed,
+ * the rest is fed now and its context holds the whole region. Otherwise
+ * the region is still in the block, from start to the cursor.
+ *
+ * @param sdor - reader of the message.
+ * @param tap - tap from sdoRTapBegin().
+ * @param start - set to the offset of the region in the block.
+ * @return true on success, false if the region could not be fed.
+ */
+bool sdoRTapEnd(SDOR_t *sdor, int tap, int *start)
+{
+	SDOReadTap_t *t;
+
+	if (tap < 0 || tap >= SDO_READ_TAPS_MAX || !sdor->taps[tap].ops)
+		return false;
+	t = &sdor->taps[tap];
+
+	if (!t->ended && t->fed && !t->failed && t->from < sdor->b.cursor &&
+	    !t->ops->feed(&t->ctx, &sdor->b.block[t->from],
+			  sdor->b.cursor - t->from))
+		t->failed = true;
+	t->ended = true;
+	if (t->fed)
+		t->from = sdor->b.cursor;
+	if (start)
+		*start = t->from;
+	return !t->failed;
+}
+
+/**
+ * Suspend the region of a tap at the cursor, feeding it whatever is left so
+ * that its context holds the region so far. If the tap cannot take any of
+ * the region, the region is kept in the block as with sdoRTapEnd().
+ *
+ * @param sdor - reader of the message.
+ * @param tap - tap from sdoRTapBegin().
+ * @param start - set to the offset of the region in the block.
+ * @return true on success, false if the region could not be fed.
+ */
+bool sdoRTapPause(SDOR_t *sdor, int tap, int *start)
+{
+	SDOReadTap_t *t;
+
+	if (tap < 0 || tap >= SDO_READ_TAPS_MAX || !sdor->taps[tap].ops)
+		return false;
+	t = &sdor->taps[tap];
+
+	if (!t->ended && !t->failed && t->from < sdor->b.cursor) {
+		if (t->ops->feed(&t->ctx, &sdor->b.block[t->from],
+				 sdor->b.cursor - t->from))
+			t->fed = true;
+		else if (t->fed)
+			t->failed = true;
+	}
+	t->ended = true;
+	if (t->fed)
+		t->from = sdor->b.cursor;
+	if (start)
+		*start = t->from;
+	return !t->failed;
+}
+
+/**
+ * Extend the region of a paused tap with the bytes read from the cursor on,
+ * the ones skipped since the pause are left out of it.
+ *
+ * @param sdor - reader of the message.
+ * @param tap - tap paused by sdoRTapPause().
+ * @return true on success, false if the region so far is not in the context.
+ */
+bool sdoRTapResume(SDOR_t *sdor, int tap)
+{
+	SDOReadTap_t *t;
+
+	if (tap < 0 || tap >= SDO_READ_TAPS_MAX || !sdor->taps[tap].ops)
+		return false;
+	t = &sdor->taps[tap];
+
+	if (!t->ended || !t->fed || t->failed)
+		return false;
+	t->ended = false;
+	t->from = sdor->b.cursor;
+	return true;
+}
+
+/**
+ * Get the context of an ended tap.
+ *
+ * @param sdor - reader of the message.
+ * @param tap - tap from sdoRTapBegin().
+ * @return the context holding the region, NULL if the region is in the
+ * block instead.
+ */
+void **sdoRTapContext(SDOR_t *sdor, int tap)
+{
+	if (tap < 0 || tap >= SDO_READ_TAPS_MAX || !sdor->taps[tap].ops ||
+	    !sdor->taps[tap].fed)
+		return NULL;
+	return &sdor->taps[tap].ctx;
+}
+
+/**
+ * Close a tap, dropping its context.
+ *
+ * @param sdor - reader of the message.
+ * @param tap - tap from sdoRTapBegin().
+ */
+void sdoRTapFree(SDOR_t *sdor, int tap)
+{
+	SDOReadTap_t *t;
+
+	if (tap < 0 || tap >= SDO_READ_TAPS_MAX)
+		return;
+	t = &sdor->taps[tap];
+
+	if (t->ops && t->ctx && t->ops->drop)
+		t->ops->drop(&t->ctx);
+	t->ops = NULL;
+	t->ctx = NULL;
+}
+
 /**
  * Internal API
  */
 int sdoRPeek(SDOR_t *sdor)
 {
 	SDOBlock_t *sdob = &sdor->b;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborRPeek(sdor);
+	sdoRFill(sdor, 1);
 	return SDOBPeekc(sdob);
 }
 
 /**
- * Internal API
+ * Internal API: the rest of a streamed message is drained by the caller.
  */
 void sdoRFlush(SDOR_t *sdor)
 {
 	SDOBlock_t *sdob = &sdor->b;
+	int i;
+
 	sdoBlockReset(sdob);
 	sdor->needComma = false;
 	sdor->haveBlock = false;
+	sdor->receive = NULL;
+	sdor->cborDepth = 0;
+	for (i = 0; i < SDO_READ_TAPS_MAX; i++)
+		sdoRTapFree(sdor, i);
+	if (sdor->index.entries)
+		sdoFree(sdor->index.entries);
+	sdor->index.count = sdor->index.max = 0;
+	sdor->index.valid = false;
 }
 
 /**
@@ -203,6 +577,7 @@ bool sdoRHaveBlock(SDOR_t *sdor)
 void sdoRSetHaveBlock(SDOR_t *sdor)
 {
 	sdor->haveBlock = true;
+	sdor->index.valid = false;
 }
 
 /**
@@ -246,12 +621,140 @@ uint8_t *sdoWGetBlockPtr(SDOW_t *sdow, int fromCursor)
 	return &sdow->b.block[fromCursor];
 }
 
+/*
+ * Character classes of the JSON reader. The messages carry no white space,
+ * so every token starts right at the cursor.
+ */
+#define SDO_CC_DIGIT 0x01
+#define SDO_CC_STRUCT 0x02
+
+static const uint8_t sdoCharClass[256] = {
+    ['0'] = SDO_CC_DIGIT, ['1'] = SDO_CC_DIGIT,  ['2'] = SDO_CC_DIGIT,
+    ['3'] = SDO_CC_DIGIT, ['4'] = SDO_CC_DIGIT,  ['5'] = SDO_CC_DIGIT,
+    ['6'] = SDO_CC_DIGIT, ['7'] = SDO_CC_DIGIT,  ['8'] = SDO_CC_DIGIT,
+    ['9'] = SDO_CC_DIGIT, ['['] = SDO_CC_STRUCT, [']'] = SDO_CC_STRUCT,
+    ['{'] = SDO_CC_STRUCT, ['}'] = SDO_CC_STRUCT, [':'] = SDO_CC_STRUCT,
+    [','] = SDO_CC_STRUCT,
+};
+
+/**
+ * Internal API: lex the token at pos of the block.
+ */
+static void sdoLex(const SDOBlock_t *sdob, int pos, SDOToken_t *tok)
+{
+	const uint8_t *p, *q;
+	int c;
+
+	tok->start = pos;
+	tok->len = 0;
+	tok->end = pos;
+	if (!sdob->block || pos < 0 || pos >= sdob->blockSize) {
+		tok->type = SDO_TOKEN_NONE;
+		return;
+	}
+
+	p = &sdob->block[pos];
+	c = *p;
+	if (c == '"') {
+		/* A string runs to the next quote, there are no escapes */
+		q = memchr(p + 1, '"', sdob->blockSize - pos - 1);
+		if (!q) {
+			tok->type = SDO_TOKEN_INVALID;
+			return;
+		}
+		tok->type = SDO_TOKEN_STRING;
+		tok->start = pos + 1;
+		tok->len = (int)(q - p - 1);
+		tok->end = tok->start + tok->len + 1;
+	} else if (sdoCharClass[c] & SDO_CC_DIGIT) {
+		q = p + 1;
+		p = &sdob->block[sdob->blockSize];
+		while (q < p && (sdoCharClass[*q] & SDO_CC_DIGIT))
+			q++;
+		tok->type = SDO_TOKEN_NUMBER;
+		tok->len = (int)(q - &sdob->block[pos]);
+		tok->end = pos + tok->len;
+	} else if (sdoCharClass[c] & SDO_CC_STRUCT) {
+		tok->type = (SDOTokenType_t)c;
+		tok->len = 1;
+		tok->end = pos + 1;
+	} else {
+		tok->type = SDO_TOKEN_INVALID;
+	}
+}
+
+/**
+ * Look at the next value of the reader without consuming it, skipping the
+ * comma that separates it from the previous value.
+ *
+ * @param sdor - reader of the message.
+ * @param tok - set to the next token. If the comma is missing, it is set to
+ * the token at the cursor.
+ * @return true on success, false if the separating comma is missing.
+ */
+bool sdoRPeekToken(SDOR_t *sdor, SDOToken_t *tok)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	int pos = sdob->cursor;
+	bool ret = true;
+
+	sdoRFill(sdor, sdor->needComma ? 2 : 1);
+	if (sdor->needComma) {
+		if (sdob->block && pos < sdob->blockSize &&
+		    sdob->block[pos] == ',')
+			pos++;
+		else
+			ret = false;
+	}
+
+	/* A token cut by the end of a streamed block is lexed again once
+	 * more of the message is in */
+	for (;;) {
+		sdoLex(sdob, pos, tok);
+		if (tok->type != SDO_TOKEN_NONE &&
+		    !(tok->type == SDO_TOKEN_NUMBER &&
+		      tok->end == sdob->blockSize) &&
+		    !(tok->type == SDO_TOKEN_INVALID &&
+		      sdob->block[pos] == '"'))
+			break;
+		if (!sdoRFill(sdor, sdob->blockSize - sdob->cursor + 1))
+			break;
+	}
+	return ret;
+}
+
+/**
+ * Consume a token returned by sdoRPeekToken(), a comma is expected after
+ * a value.
+ *
+ * @param sdor - reader of the message.
+ * @param tok - token to consume.
+ */
+void sdoRConsumeToken(SDOR_t *sdor, const SDOToken_t *tok)
+{
+	sdor->b.cursor = tok->end;
+	switch (tok->type) {
+	case SDO_TOKEN_STRING:
+	case SDO_TOKEN_NUMBER:
+	case SDO_TOKEN_END_SEQ:
+	case SDO_TOKEN_END_OBJ:
+		sdor->needComma = true;
+		break;
+	default:
+		sdor->needComma = false;
+		break;
+	}
+}
+
 /**
  * Internal API
  */
 bool _readExpectedChar(SDOR_t *sdor, char expected)
 {
-	char c = sdoBGetC(&sdor->b);
+	char c;
+
+	sdoRFill(sdor, 1);
+	c = sdoBGetC(&sdor->b);
 	if (c != expected) {
 		LOG(LOG_ERROR, "expected '%c' at cursor %u, got '%c'.\n",
 		    expected, sdor->b.cursor - 1, c);
@@ -303,6 +806,8 @@ bool _readExpectedCharCommaAfter(SDOR_t *sdor, char expected)
  */
 bool sdoRBeginSequence(SDOR_t *sdor)
 {
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborRBegin(sdor, SDO_CBOR_ARRAY);
 	return _readExpectedCharCommaBefore(sdor, '[');
 }
 
@@ -311,6 +816,8 @@ bool sdoRBeginSequence(SDOR_t *sdor)
  */
 bool sdoREndSequence(SDOR_t *sdor)
 {
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborREnd(sdor, SDO_CBOR_ARRAY);
 	return _readExpectedCharCommaAfter(sdor, ']');
 }
 
@@ -319,6 +826,8 @@ bool sdoREndSequence(SDOR_t *sdor)
  */
 bool sdoRBeginObject(SDOR_t *sdor)
 {
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborRBegin(sdor, SDO_CBOR_MAP);
 	return _readExpectedCharCommaBefore(sdor, '{');
 }
 
@@ -327,20 +836,174 @@ bool sdoRBeginObject(SDOR_t *sdor)
  */
 bool sdoREndObject(SDOR_t *sdor)
 {
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborREnd(sdor, SDO_CBOR_MAP);
 	return _readExpectedCharCommaAfter(sdor, '}');
 }
 
 /**
- * Internal API
+ * Internal API: grow the structural index by half, SDO_BLOCKINC entries at
+ * least.
  */
-void sdoRReadAndIgnoreUntil(SDOR_t *sdor, char expected)
+static bool sdoRIndexGrow(SDOStructIndex_t *x)
 {
-	char c;
-	while (1) {
-		c = sdoBGetC(&sdor->b);
-		if (expected != c && c != '\0')
+	SDOStructEntry_t *entries;
+	int max = x->max + (x->max / 2 > SDO_BLOCKINC ? x->max / 2
+						       : SDO_BLOCKINC);
+
+	if (max > INT_MAX / (int)sizeof(*entries))
+		return false;
+	entries = sdoRealloc(x->entries, max * (int)sizeof(*entries));
+	if (!entries) {
+		LOG(LOG_ERROR, "Structural index alloc failed\n");
+		return false;
+	}
+	x->entries = entries;
+	x->max = max;
+	return true;
+}
+
+/**
+ * Internal API: build the structural index of the message, unless it is
+ * up to date, in a single pass. Strings are stepped over with memchr(),
+ * so that the pass reads one by one only the bytes outside of them. The
+ * openers still waiting for their closer are chained by their match.
+ * @return true if the index is available, false if the message is still
+ * being received or the index could not be built.
+ */
+static bool sdoRIndex(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	SDOStructIndex_t *x = &sdor->index;
+	SDOStructEntry_t *e;
+	const uint8_t *p, *end;
+	int open = -1, parent;
+
+	if (x->valid && x->block == sdob->block &&
+	    x->blockSize == sdob->blockSize)
+		return true;
+	if (!sdob->block || sdoRStreaming(sdor))
+		return false;
+
+	x->valid = false;
+	x->count = 0;
+	end = &sdob->block[sdob->blockSize];
+	for (p = sdob->block; p < end && *p; p++) {
+		if (*p == '"') {
+			p = memchr(p + 1, '"', end - p - 1);
+			if (!p)
+				break;
 			continue;
-		break;
+		}
+		if (*p != '[' && *p != '{' && *p != ']' && *p != '}')
+			continue;
+
+		if (x->count == x->max && !sdoRIndexGrow(x))
+			return false;
+		e = &x->entries[x->count];
+		e->pos = (int)(p - sdob->block);
+		e->match = -1;
+		if (*p == '[' || *p == '{') {
+			e->match = open;
+			open = x->count;
+		} else if (open >= 0 &&
+			   sdob->block[x->entries[open].pos] ==
+			       (*p == ']' ? '[' : '{')) {
+			parent = x->entries[open].match;
+			x->entries[open].match = x->count;
+			e->match = open;
+			open = parent;
+		}
+		x->count++;
+	}
+	for (; open >= 0; open = parent) {
+		parent = x->entries[open].match;
+		x->entries[open].match = -1;
+	}
+
+	x->block = sdob->block;
+	x->blockSize = sdob->blockSize;
+	x->valid = true;
+	return true;
+}
+
+/**
+ * Internal API: first entry of the structural index at or after pos.
+ */
+static int sdoRIndexFind(const SDOStructIndex_t *x, int pos)
+{
+	int lo = 0, hi = x->count, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (x->entries[mid].pos < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * Internal API: skip past the next expected character that is not nested
+ * in a sequence or object, nor in a string. The sequences and objects on
+ * the way are skipped whole, with the structural index when the message
+ * is received whole. A CBOR message is skipped to the end of the innermost
+ * sequence or object instead.
+ */
+void sdoRReadAndIgnoreUntil(SDOR_t *sdor, char expected)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	SDOStructIndex_t *x = &sdor->index;
+	const uint8_t *q;
+	int depth = 0, i, c;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR) {
+		sdoCborRSkipToEnd(sdor);
+		return;
+	}
+
+	sdoRFill(sdor, 1);
+	if (!sdob->block || sdob->cursor >= sdob->blockSize)
+		return;
+
+	if ((expected == ']' || expected == '}') && sdoRIndex(sdor)) {
+		for (i = sdoRIndexFind(x, sdob->cursor); i < x->count; i++) {
+			c = sdob->block[x->entries[i].pos];
+			if (c == expected) {
+				sdob->cursor = x->entries[i].pos + 1;
+				return;
+			}
+			if (c == '[' || c == '{') {
+				if (x->entries[i].match < 0)
+					break;
+				i = x->entries[i].match;
+			}
+		}
+		sdob->cursor = sdob->blockSize;
+		return;
+	}
+
+	/* Message being received, walk it */
+	for (;;) {
+		if (sdob->cursor >= sdob->blockSize && !sdoRFill(sdor, 1))
+			return;
+		c = sdob->block[sdob->cursor++];
+		if (!c || (c == expected && !depth))
+			return;
+		if (c == '"') {
+			while (!(q = memchr(&sdob->block[sdob->cursor], '"',
+					    sdob->blockSize - sdob->cursor))) {
+				sdob->cursor = sdob->blockSize;
+				if (!sdoRFill(sdor, 1))
+					return;
+			}
+			sdob->cursor = (int)(q - sdob->block) + 1;
+		} else if (c == '[' || c == '{') {
+			depth++;
+		} else if ((c == ']' || c == '}') && depth) {
+			depth--;
+		}
 	}
 }
 
@@ -353,21 +1016,40 @@ void sdoRReadAndIgnoreUntilEndSequence(SDOR_t *sdor)
 	sdor->needComma = true;
 }
 
+/**
+ * Internal API
+ */
+static uint32_t sdoParseUInt(const uint8_t *p, int len)
+{
+	uint32_t r = 0;
+
+	/* Two digits per step, wrapping like the digit by digit loop */
+	for (; len >= 2; p += 2, len -= 2)
+		r = r * 100 + (uint32_t)(p[0] - '0') * 10 + (p[1] - '0');
+	if (len)
+		r = r * 10 + (*p - '0');
+	return r;
+}
+
 /**
  * Internal API
  */
 uint32_t sdoReadUInt(SDOR_t *sdor)
 {
 	uint32_t r = 0;
-	int c;
-	SDOBlock_t *sdob = &sdor->b;
+	SDOToken_t tok;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadUInt(sdor);
 
-	if (!_readComma(sdor))
+	if (!sdoRPeekToken(sdor, &tok))
 		LOG(LOG_ERROR, "we were expecting , here!\n");
 
-	while ((c = SDOBPeekc(sdob)) != -1 && c >= '0' && c <= '9') {
-		sdoSkipC(sdob);
-		r = (r * 10) + (c - '0');
+	if (tok.type == SDO_TOKEN_NUMBER) {
+		r = sdoParseUInt(&sdor->b.block[tok.start], tok.len);
+		sdor->b.cursor = tok.end;
+	} else {
+		sdor->b.cursor = tok.start;
 	}
 	sdor->needComma = true;
 	return r;
@@ -378,16 +1060,49 @@ uint32_t sdoReadUInt(SDOR_t *sdor)
  */
 int sdoReadStringSz(SDOR_t *sdor)
 {
-	int n, saveCursor;
-	bool saveNeedComma;
-	char c;
+	SDOToken_t tok;
 
-	saveNeedComma = sdor->needComma;
-	saveCursor = sdor->b.cursor;
-	n = sdoReadString(sdor, &c, 1);
-	sdor->b.cursor = saveCursor;
-	sdor->needComma = saveNeedComma;
-	return n;
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadStringSz(sdor);
+
+	if (!sdoRPeekToken(sdor, &tok)) {
+		LOG(LOG_ERROR, "we were expecting , here!\n");
+		return 0;
+	}
+	if (tok.type != SDO_TOKEN_STRING) {
+		LOG(LOG_ERROR, "Expected char read is not \"\n");
+		return 0;
+	}
+	return tok.len;
+}
+
+/**
+ * Internal API: find the second ']' from the character before the cursor,
+ * the end of an [[iv], size, "cipher text"] array.
+ */
+static int sdoArrayEnd(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	const uint8_t *p, *q;
+	size_t n;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborArrayEnd(sdor);
+
+	if (!sdob->block || sdob->cursor < 1 || sdob->cursor > sdob->blockSize)
+		return -1;
+
+	for (;;) {
+		p = &sdob->block[sdob->cursor - 1];
+		n = sdob->blockSize - sdob->cursor + 1;
+		q = memchr(p, ']', n);
+		if (q)
+			q = memchr(q + 1, ']', n - (q + 1 - p));
+		if (q)
+			return (int)(q - p) + 1;
+		if (!sdoRFill(sdor, (int)n))
+			return -1;
+	}
 }
 
 /**
@@ -397,38 +1112,7 @@ int sdoReadStringSz(SDOR_t *sdor)
  */
 int sdoReadArraySz(SDOR_t *sdor)
 {
-	int saveCursor;
-	bool saveNeedComma;
-	char c;
-	uint32_t size_of_buffer = 0;
-	bool ct_end_wait = false;
-
-	saveNeedComma = sdor->needComma;
-	saveCursor = sdor->b.cursor;
-	sdor->b.cursor--;
-	while (1) {
-		c = sdoBGetC(&sdor->b);
-		if (-1 == c) {
-			return -1;
-		}
-		size_of_buffer++;
-
-		if (']' != c && c != '\0' && ct_end_wait == false) {
-			continue;
-		} else {
-			if (']' == c && ct_end_wait == false) {
-				ct_end_wait = true;
-			} else {
-				if (']' == c && c != '\0' &&
-				    ct_end_wait == true)
-					break;
-			}
-		}
-	}
-
-	sdor->b.cursor = saveCursor;
-	sdor->needComma = saveNeedComma;
-	return size_of_buffer;
+	return sdoArrayEnd(sdor);
 }
 
 /**
@@ -438,38 +1122,13 @@ int sdoReadArraySz(SDOR_t *sdor)
  */
 int sdoReadArrayNoStateChange(SDOR_t *sdor, uint8_t *buf)
 {
-	int saveCursor;
-	bool saveNeedComma;
-	char c;
-	uint32_t size_of_buffer = 0;
-	bool ct_end_wait = false;
-
-	saveNeedComma = sdor->needComma;
-	saveCursor = sdor->b.cursor;
-	sdor->b.cursor--;
-	while (1) {
-		c = sdoBGetC(&sdor->b);
-		if (-1 == c) {
-			return -1;
-		}
-		buf[size_of_buffer++] = c;
-
-		if (']' != c && c != '\0' && ct_end_wait == false) {
-			continue;
-		} else {
-			if (']' == c && ct_end_wait == false) {
-				ct_end_wait = true;
-			} else {
-				if (']' == c && c != '\0' &&
-				    ct_end_wait == true)
-					break;
-			}
-		}
-	}
+	int n = sdoArrayEnd(sdor);
 
-	sdor->b.cursor = saveCursor;
-	sdor->needComma = saveNeedComma;
-	return size_of_buffer;
+	if (n <= 0 || !buf)
+		return -1;
+	if (memcpy_s(buf, n, &sdor->b.block[sdor->b.cursor - 1], n) != 0)
+		return -1;
+	return n;
 }
 
 /**
@@ -477,29 +1136,64 @@ int sdoReadArrayNoStateChange(SDOR_t *sdor, uint8_t *buf)
  */
 int sdoReadString(SDOR_t *sdor, char *bufp, int bufSz)
 {
-	int n, c;
-	char *limit = bufp + (bufSz - 1);
-	SDOBlock_t *sdob = &sdor->b;
+	SDOToken_t tok;
+	int n;
 
-	if (!_readComma(sdor)) {
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadString(sdor, bufp, bufSz);
+
+	if (!sdoRPeekToken(sdor, &tok)) {
 		LOG(LOG_ERROR, "we were expecting , here!\n");
 		return 0;
 	}
 
-	if (!_readExpectedChar(sdor, '"')) {
+	if (tok.type != SDO_TOKEN_STRING) {
 		LOG(LOG_ERROR, "Expected char read is not \"\n");
 		return 0;
 	}
 
-	n = 0;
-	while ((c = sdoBGetC(sdob)) != '"' && c != -1) {
-		++n;
-		if (bufp < limit)
-			*bufp++ = c;
+	if (bufp && bufSz > 0) {
+		n = tok.len < bufSz - 1 ? tok.len : bufSz - 1;
+		if (n && memcpy_s(bufp, bufSz, &sdor->b.block[tok.start], n))
+			return 0;
+		bufp[n] = 0;
 	}
-	*bufp = 0;
-	sdor->needComma = true;
-	return n;
+	sdoRConsumeToken(sdor, &tok);
+	return tok.len;
+}
+
+/**
+ * Read a string, returning a pointer to it in the SDOR block instead of
+ * copying it.
+ *
+ * @param sdor - data to be read
+ * @param strp - set to the string, not NUL terminated, valid until the
+ * block is flushed or the next block is received
+ * @return the length of the string, -1 if there is none
+ */
+int sdoReadStringRef(SDOR_t *sdor, const char **strp)
+{
+	SDOToken_t tok;
+
+	if (!strp)
+		return -1;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadStringRef(sdor, strp);
+
+	if (!sdoRPeekToken(sdor, &tok)) {
+		LOG(LOG_ERROR, "we were expecting , here!\n");
+		return -1;
+	}
+
+	if (tok.type != SDO_TOKEN_STRING) {
+		LOG(LOG_ERROR, "Expected char read is not \"\n");
+		return -1;
+	}
+
+	*strp = (const char *)&sdor->b.block[tok.start];
+	sdoRConsumeToken(sdor, &tok);
+	return tok.len;
 }
 
 /**
@@ -507,7 +1201,12 @@ int sdoReadString(SDOR_t *sdor, char *bufp, int bufSz)
  */
 int sdoReadTag(SDOR_t *sdor, char *bufp, int bufSz)
 {
-	int n = sdoReadString(sdor, bufp, bufSz);
+	int n;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadTag(sdor, bufp, bufSz);
+
+	n = sdoReadString(sdor, bufp, bufSz);
 
 	if (!_readExpectedChar(sdor, ':')) {
 		LOG(LOG_ERROR, "Expected char read is not :\n");
@@ -523,6 +1222,9 @@ int sdoReadTag(SDOR_t *sdor, char *bufp, int bufSz)
  */
 bool sdoReadTagFinisher(SDOR_t *sdor)
 {
+	/* A CBOR map key is not followed by a separator */
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return true;
 	sdor->needComma = false;
 	return _readExpectedChar(sdor, ':');
 }
@@ -532,15 +1234,107 @@ bool sdoReadTagFinisher(SDOR_t *sdor)
  */
 int sdoReadExpectedTag(SDOR_t *sdor, char *tag)
 {
-	char buf[SDO_TAG_MAX_LEN] = {0};
-	int strcmp_result = 0;
+	return sdoReadExpectedTagLen(sdor, tag, strnlen_s(tag, SDO_TAG_MAX_LEN));
+}
 
-	sdoReadTag(sdor, &buf[0], sizeof buf);
-	strcmp_s(buf, SDO_TAG_MAX_LEN, tag, &strcmp_result);
-	if (strcmp_result == 0)
-		return 1;
-	else
+/**
+ * Read a tag and its ':', checking that it is the expected one.
+ *
+ * @param sdor - reader of the message.
+ * @param tag - expected tag.
+ * @param tagLen - length of the expected tag.
+ * @return 1 if the tag was read and matches, 0 otherwise.
+ */
+int sdoReadExpectedTagLen(SDOR_t *sdor, const char *tag, int tagLen)
+{
+	SDOToken_t tok;
+	int memcmp_result = 1;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadExpectedTagLen(sdor, tag, tagLen);
+
+	if (!sdoRPeekToken(sdor, &tok) || tok.type != SDO_TOKEN_STRING) {
+		LOG(LOG_ERROR, "Expected tag \"%s\" not found\n", tag);
 		return 0;
+	}
+
+	/* Compare in place, by length first */
+	if (tok.len == tagLen &&
+	    memcmp_s(&sdor->b.block[tok.start], tok.len, tag, tagLen,
+		     &memcmp_result) != 0)
+		memcmp_result = 1;
+	sdoRConsumeToken(sdor, &tok);
+
+	if (!sdoReadTagFinisher(sdor)) {
+		LOG(LOG_ERROR, "Expected char read is not :\n");
+		return 0;
+	}
+	return memcmp_result == 0;
+}
+
+/**
+ * Find a tag in a set of keys.
+ *
+ * @param keys - keys of the set, sorted by length then by bytes.
+ * @param numKeys - number of keys.
+ * @param tag - tag to be found, not NUL terminated.
+ * @param tagLen - length of the tag.
+ * @return value of the key of the tag, SDO_TAG_UNKNOWN if it is not a key.
+ */
+int sdoTagLookup(const SDOTagKey_t *keys, int numKeys, const uint8_t *tag,
+		 int tagLen)
+{
+	int lo = 0, hi = numKeys - 1, mid, d;
+
+	if (!keys || !tag || tagLen <= 0)
+		return SDO_TAG_UNKNOWN;
+
+	while (lo <= hi) {
+		mid = lo + (hi - lo) / 2;
+		d = keys[mid].tagLen - tagLen;
+		if (d == 0 && memcmp_s(keys[mid].tag, keys[mid].tagLen, tag,
+				       tagLen, &d) != 0)
+			return SDO_TAG_UNKNOWN;
+		if (d == 0)
+			return keys[mid].val;
+		if (d < 0)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	return SDO_TAG_UNKNOWN;
+}
+
+/**
+ * Read a tag and its ':', comparing it in place with a set of keys.
+ *
+ * @param sdor - reader of the message.
+ * @param keys - keys of the set, sorted by length then by bytes.
+ * @param numKeys - number of keys.
+ * @return value of the key of the tag, SDO_TAG_UNKNOWN if it is not a key
+ * or SDO_TAG_INVALID if no tag was read.
+ */
+int sdoReadTagKey(SDOR_t *sdor, const SDOTagKey_t *keys, int numKeys)
+{
+	SDOToken_t tok;
+	int val;
+
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadTagKey(sdor, keys, numKeys);
+
+	if (!sdoRPeekToken(sdor, &tok) || tok.type != SDO_TOKEN_STRING) {
+		LOG(LOG_ERROR, "Expected tag not found\n");
+		return SDO_TAG_INVALID;
+	}
+
+	val = sdoTagLookup(keys, numKeys, &sdor->b.block[tok.start], tok.len);
+	sdoRConsumeToken(sdor, &tok);
+
+	if (!sdoReadTagFinisher(sdor)) {
+		LOG(LOG_ERROR, "Expected char read is not :\n");
+		return SDO_TAG_INVALID;
+	}
+	return val;
 }
 
 #if 0 // Deprecated
@@ -600,6 +1394,9 @@ int sdoReadByteArrayField(SDOR_t *sdor, int b64Sz, uint8_t *bufp, int bufSz)
 {
 	int converted = 0;
 
+	if (sdor->encoding == SDO_ENCODING_CBOR)
+		return sdoCborReadByteArrayField(sdor, b64Sz, bufp, bufSz);
+
 	if (!_readComma(sdor)) {
 		LOG(LOG_ERROR, "we were expecting , here!\n");
 		goto err;
@@ -609,6 +1406,7 @@ int sdoReadByteArrayField(SDOR_t *sdor, int b64Sz, uint8_t *bufp, int bufSz)
 	if (!_readExpectedChar(sdor, '"'))
 		goto err;
 
+	sdoRFill(sdor, b64Sz + 1);
 	converted = b64ToBin((size_t)b64Sz, sdor->b.block, sdor->b.cursor,
 			     (size_t)bufSz, bufp, 0);
 
@@ -629,6 +1427,45 @@ err:
 	return 0; /* Any failure means no bytes read */
 }
 
+/**
+ * Skip a byte array base64 field, returning a pointer to its text in the
+ * SDOR block instead of decoding it.
+ *
+ * @param sdor - data to be read in the form of JSON
+ * @param b64Sz - length of the base64 text
+ * @param textp - set to the base64 text on success, it is valid until the
+ * block is flushed or the next block is received
+ * @return true on success, false otherwise, always for a CBOR message whose
+ * byte arrays carry no base64 text, see sdoCborReadBytes()
+ */
+bool sdoReadByteArrayText(SDOR_t *sdor, int b64Sz, const uint8_t **textp)
+{
+	if (!textp || b64Sz < 0 || sdor->encoding == SDO_ENCODING_CBOR)
+		return false;
+
+	if (!_readComma(sdor)) {
+		LOG(LOG_ERROR, "we were expecting , here!\n");
+		return false;
+	}
+
+	if (!_readExpectedChar(sdor, '"'))
+		return false;
+
+	sdoRFill(sdor, b64Sz + 1);
+	if (b64Sz > sdor->b.blockSize - sdor->b.cursor) {
+		LOG(LOG_ERROR, "Base64 string exceeds the block!\n");
+		return false;
+	}
+	*textp = &sdor->b.block[sdor->b.cursor];
+	sdor->b.cursor += b64Sz;
+
+	if (!_readExpectedChar(sdor, '"'))
+		return false;
+
+	sdor->needComma = true;
+	return true;
+}
+
 //==============================================================================
 // Write values
 //
@@ -664,17 +1501,58 @@ void sdoWBlockReset(SDOW_t *sdow)
 int sdoWNextBlock(SDOW_t *sdow, int type)
 {
 	sdoWBlockReset(sdow);
+	sdoBlockTrim(&sdow->b);
 	sdow->msgType = type;
 	return true;
 }
 
+static const char sdoHexUpper[] = "0123456789ABCDEF";
+static const char sdoHexLower[] = "0123456789abcdef";
+static const char sdoDigitPairs[] = "00010203040506070809"
+				    "10111213141516171819"
+				    "20212223242526272829"
+				    "30313233343536373839"
+				    "40414243444546474849"
+				    "50515253545556575859"
+				    "60616263646566676869"
+				    "70717273747576777879"
+				    "80818283848586878889"
+				    "90919293949596979899";
+
+/* Decimal digits of the largest uint32_t */
+#define SDO_UINT_DIGITS 10
+
+/**
+ * Internal API: format v in decimal, right aligned at the end of buf.
+ * @return pointer to the first digit
+ */
+static char *sdoFormatUInt(char buf[SDO_UINT_DIGITS], uint32_t v)
+{
+	char *p = &buf[SDO_UINT_DIGITS];
+	uint32_t d;
+
+	while (v >= 100) {
+		d = (v % 100) * 2;
+		v /= 100;
+		*--p = sdoDigitPairs[d + 1];
+		*--p = sdoDigitPairs[d];
+	}
+	if (v >= 10) {
+		*--p = sdoDigitPairs[v * 2 + 1];
+		*--p = sdoDigitPairs[v * 2];
+	} else {
+		*--p = (char)('0' + v);
+	}
+	return p;
+}
+
 /**
  * Internal API
  */
 void _writeComma(SDOW_t *sdow)
 {
 	SDOBlock_t *sdob = &sdow->b;
-	if (sdow->needComma) {
+	if (sdow->needComma && sdow->encoding != SDO_ENCODING_CBOR) {
 		sdow->needComma = false;
 		sdoBPutC(sdob, ',');
 		if (sdob->blockSize < sdob->cursor)
@@ -682,37 +1560,201 @@ void _writeComma(SDOW_t *sdow)
 	}
 }
 
+/**
+ * Internal API: tell whether a character of a string is written escaped.
+ */
+static bool sdoJsonEscaped(uint8_t c)
+{
+	return c < 0x20 || c > 0x7d || c == '[' || c == ']' || c == '"' ||
+	       c == '\\' || c == '{' || c == '}' || c == '&';
+}
+
+#define JSON_ONES 0x0101010101010101ULL
+#define JSON_HIGHS 0x8080808080808080ULL
+/* high bit of the bytes of w that are 0, or of all bytes after one */
+#define JSON_ZERO(w) ((((w) - JSON_ONES) & ~(w)) & JSON_HIGHS)
+
+/**
+ * Internal API: number of characters at the start of s, of n, that are
+ * written as they are. Whole blocks are checked at once, 16 bytes with
+ * SSE2 or NEON, else 8 bytes in a word; a block with a character to
+ * escape is then looked at byte by byte.
+ */
+static size_t sdoJsonCleanLen(const uint8_t *s, size_t n)
+{
+	size_t i = 0;
+	uint64_t w, m;
+
+#if defined(JSON_SCAN_SSE2)
+	/* signed compares: below 0x20 takes in 0x80-0xff */
+	const __m128i ctl = _mm_set1_epi8(0x20);
+	const __m128i del = _mm_set1_epi8(0x7d);
+	__m128i v, e;
+
+	for (; i + 16 <= n; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(s + i));
+		e = _mm_or_si128(_mm_cmplt_epi8(v, ctl),
+				 _mm_cmpgt_epi8(v, del));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('"')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('\\')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('{')));
+		e = _mm_or_si128(e, _mm_cmpeq_epi8(v, _mm_set1_epi8('}')));
+		m = (uint64_t)_mm_movemask_epi8(e);
+		if (m)
+			return i + (size_t)__builtin_ctz((unsigned)m);
+	}
+#elif defined(JSON_SCAN_NEON)
+	uint8x16_t v, e;
+
+	for (; i + 16 <= n; i += 16) {
+		v = vld1q_u8(s + i);
+		e = vorrq_u8(vcltq_u8(v, vdupq_n_u8(0x20)),
+			     vcgtq_u8(v, vdupq_n_u8(0x7d)));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('"')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('&')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('[')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('\\')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8(']')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('{')));
+		e = vorrq_u8(e, vceqq_u8(v, vdupq_n_u8('}')));
+		if (vmaxvq_u8(e))
+			break;
+	}
+#endif
+	for (; i + 8 <= n; i += 8) {
+		memcpy(&w, s + i, sizeof(w));
+		/* below 0x20, above 0x7d, or one of the characters */
+		m = (w - 0x20 * JSON_ONES) & ~w & JSON_HIGHS;
+		m |= ((w + 2 * JSON_ONES) | w) & JSON_HIGHS;
+		m |= JSON_ZERO(w ^ ('"' * JSON_ONES));
+		m |= JSON_ZERO(w ^ ('&' * JSON_ONES));
+		m |= JSON_ZERO(w ^ ('[' * JSON_ONES));
+		m |= JSON_ZERO(w ^ ('\\' * JSON_ONES));
+		m |= JSON_ZERO(w ^ (']' * JSON_ONES));
+		m |= JSON_ZERO(w ^ ('{' * JSON_ONES));
+		m |= JSON_ZERO(w ^ ('}' * JSON_ONES));
+		if (m)
+			break;
+	}
+	while (i < n && !sdoJsonEscaped(s[i]))
+		i++;
+	return i;
+}
+
 /**
  * Write a string to the block, extending block and converting
  * special characters.  Does NOT handle commas.
+ * The runs of characters written as they are are copied at once, only the
+ * characters in between are escaped.
  */
 void _padstring(SDOW_t *sdow, const char *s, int len, bool escape)
 {
 	SDOBlock_t *sdob = &sdow->b;
-	char ucode[10], *ucs;
-	unsigned char c;
-	while (len-- != 0 && (c = (unsigned char)*s++) != 0) {
-		if (escape &&
-		    (c < 0x20 || c > 0x7d || c == '[' || c == ']' || c == '"' ||
-		     c == '\\' || c == '{' || c == '}' || c == '&')) {
-
-			if (snprintf_s_i(ucode, sizeof ucode, "\\u%04x", c) <
-			    0) {
-				LOG(LOG_ERROR, "snprintf() failed!\n");
-				return;
-			}
+	const uint8_t *p = (const uint8_t *)s;
+	const char *nul;
+	uint8_t *out;
+	size_t n, run;
+
+	/* up to the terminator, if any */
+	if (len < 0)
+		n = strlen(s);
+	else if ((nul = memchr(s, 0, (size_t)len)) != NULL)
+		n = (size_t)(nul - s);
+	else
+		n = (size_t)len;
+	if (n > INT_MAX)
+		return;
 
-			for (ucs = &ucode[0]; *ucs; ucs++) {
-				sdoBPutC(sdob, *ucs);
-			}
-		} else {
-			sdoBPutC(sdob, c);
+	while (n) {
+		run = escape ? sdoJsonCleanLen(p, n) : n;
+		if (run) {
+			if (!sdoWReserve(sdow, (int)run) ||
+			    memcpy_s(&sdob->block[sdob->cursor],
+				     sdob->blockMax - sdob->cursor, p,
+				     run) != 0)
+				break;
+			sdob->cursor += (int)run;
+			p += run;
+			n -= run;
+			continue;
 		}
+		/* \u00XX */
+		if (!sdoWReserve(sdow, 6))
+			break;
+		out = &sdob->block[sdob->cursor];
+		out[0] = '\\';
+		out[1] = 'u';
+		out[2] = '0';
+		out[3] = '0';
+		out[4] = sdoHexLower[*p >> 4];
+		out[5] = sdoHexLower[*p & 0xf];
+		sdob->cursor += 6;
+		p++;
+		n--;
 	}
 	if (sdob->blockSize < sdob->cursor)
 		sdob->blockSize = sdob->cursor;
 }
 
+/**
+ * Write a placeholder for a value known only after the data that follows
+ * it is written, for ex: its length.
+ *
+ * @param sdow - writer of the message.
+ * @return cursor of the placeholder, to be passed to sdoWFixFixup().
+ */
+int sdoWCreateFixup(SDOW_t *sdow)
+{
+	SDOBlock_t *sdob = &sdow->b;
+	int cursorPosn;
+
+	_writeComma(sdow);
+	cursorPosn = sdob->cursor;
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		/* A text string of the digits, its head in place of a quote */
+		sdoCborWriteString(sdow, SDO_FIX_UP_STR + 1, SDO_FIX_UP_LEN - 2);
+		return cursorPosn;
+	}
+	_padstring(sdow, SDO_FIX_UP_STR, SDO_FIX_UP_LEN, false);
+	sdow->needComma = true;
+	return cursorPosn;
+}
+
+/**
+ * Fill a placeholder written by sdoWCreateFixup() with its value, as
+ * SDO_FIX_UP_TEMPL.
+ *
+ * @param sdow - writer of the message.
+ * @param cursorPosn - cursor of the placeholder.
+ * @param fixup - value of the placeholder, up to 0xffff.
+ */
+void sdoWFixFixup(SDOW_t *sdow, int cursorPosn, int fixup)
+{
+	SDOBlock_t *sdob = &sdow->b;
+	bool cbor = sdow->encoding == SDO_ENCODING_CBOR;
+	int len = cbor ? SDO_FIX_UP_LEN - 1 : SDO_FIX_UP_LEN;
+	uint8_t *p;
+
+	if (cursorPosn < 0 || cursorPosn > sdob->blockSize - len ||
+	    fixup < 0 || fixup > 0xffff) {
+		LOG(LOG_ERROR, "Invalid fixup %d at %d\n", fixup, cursorPosn);
+		return;
+	}
+
+	p = &sdob->block[cursorPosn];
+	p[1] = sdoHexLower[(fixup >> 12) & 0xf];
+	p[2] = sdoHexLower[(fixup >> 8) & 0xf];
+	p[3] = sdoHexLower[(fixup >> 4) & 0xf];
+	p[4] = sdoHexLower[fixup & 0xf];
+	if (!cbor) {
+		p[0] = '"';
+		p[5] = '"';
+	}
+}
+
 /**
  * Internal API
  */
@@ -732,6 +1774,10 @@ void _writespecialchar(SDOW_t *sdow, char c)
  */
 void sdoWBeginSequence(SDOW_t *sdow)
 {
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWBegin(sdow, SDO_CBOR_ARRAY);
+		return;
+	}
 	_writespecialchar(sdow, '[');
 }
 
@@ -740,6 +1786,10 @@ void sdoWBeginSequence(SDOW_t *sdow)
  */
 void sdoWEndSequence(SDOW_t *sdow)
 {
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWEnd(sdow);
+		return;
+	}
 	sdow->needComma = false;
 	_writespecialchar(sdow, ']');
 	sdow->needComma = true;
@@ -750,6 +1800,10 @@ void sdoWEndSequence(SDOW_t *sdow)
  */
 void sdoWBeginObject(SDOW_t *sdow)
 {
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWBegin(sdow, SDO_CBOR_MAP);
+		return;
+	}
 	_writespecialchar(sdow, '{');
 }
 
@@ -758,6 +1812,10 @@ void sdoWBeginObject(SDOW_t *sdow)
  */
 void sdoWEndObject(SDOW_t *sdow)
 {
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWEnd(sdow);
+		return;
+	}
 	sdow->needComma = false;
 	_writespecialchar(sdow, '}');
 	sdow->needComma = true;
@@ -769,6 +1827,8 @@ void sdoWEndObject(SDOW_t *sdow)
 void sdoWriteTag(SDOW_t *sdow, char *tag)
 {
 	sdoWriteString(sdow, tag);
+	if (sdow->encoding == SDO_ENCODING_CBOR)
+		return;
 	sdow->needComma = false;
 	_writespecialchar(sdow, ':');
 }
@@ -779,6 +1839,8 @@ void sdoWriteTag(SDOW_t *sdow, char *tag)
 void sdoWriteTagLen(SDOW_t *sdow, char *tag, int len)
 {
 	sdoWriteStringLen(sdow, tag, len);
+	if (sdow->encoding == SDO_ENCODING_CBOR)
+		return;
 	sdow->needComma = false;
 	_writespecialchar(sdow, ':');
 }
@@ -789,14 +1851,25 @@ void sdoWriteTagLen(SDOW_t *sdow, char *tag, int len)
 void sdoWriteUInt(SDOW_t *sdow, uint32_t i)
 {
 	SDOBlock_t *sdob = &sdow->b;
-	char num[20] = {0};
+	char num[SDO_UINT_DIGITS];
+	char *p;
+	int n;
+
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWriteHead(sdow, SDO_CBOR_UINT, i);
+		return;
+	}
 
 	_writeComma(sdow);
-	if (snprintf_s_i(num, sizeof(num), "%u", i) < 0) {
-		LOG(LOG_ERROR, "snprintf() failed!\n");
+	p = sdoFormatUInt(num, i);
+	n = (int)(&num[SDO_UINT_DIGITS] - p);
+	if (!sdoWReserve(sdow, n) ||
+	    memcpy_s(&sdob->block[sdob->cursor], sdob->blockMax - sdob->cursor,
+		     p, n) != 0) {
+		LOG(LOG_ERROR, "Failed to write %u\n", i);
 		return;
 	}
-	_padstring(sdow, num, -1, false);
+	sdob->cursor += n;
 	sdow->needComma = true;
 	if (sdob->blockSize < sdob->cursor)
 		sdob->blockSize = sdob->cursor;
@@ -809,6 +1882,11 @@ void sdoWriteString(SDOW_t *sdow, const char *s)
 {
 	SDOBlock_t *sdob = &sdow->b;
 
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWriteString(sdow, s, -1);
+		return;
+	}
+
 	_writeComma(sdow);
 	sdoBPutC(sdob, '"');
 	_padstring(sdow, s, -1, true);
@@ -825,6 +1903,11 @@ void sdoWriteStringLen(SDOW_t *sdow, char *s, int len)
 {
 	SDOBlock_t *sdob = &sdow->b;
 
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWriteString(sdow, s, len);
+		return;
+	}
+
 	_writeComma(sdow);
 	sdoBPutC(sdob, '"');
 	_padstring(sdow, s, len, true);
@@ -833,6 +1916,31 @@ void sdoWriteStringLen(SDOW_t *sdow, char *s, int len)
 	if (sdob->blockSize < sdob->cursor)
 		sdob->blockSize = sdob->cursor;
 }
+
+/**
+ * Write values encoded before, with the encoding of sdow, by another writer
+ * starting out the same way (e.g. a snapshot of the members of an object).
+ */
+void sdoWriteEncoded(SDOW_t *sdow, const uint8_t *buf, int len)
+{
+	SDOBlock_t *sdob = &sdow->b;
+
+	if (len <= 0)
+		return;
+	if (sdow->encoding != SDO_ENCODING_CBOR)
+		_writeComma(sdow);
+	if (!sdoWReserve(sdow, len) ||
+	    memcpy_s(&sdob->block[sdob->cursor], sdob->blockMax - sdob->cursor,
+		     buf, len) != 0) {
+		LOG(LOG_ERROR, "Failed to write %d encoded bytes\n", len);
+		return;
+	}
+	sdob->cursor += len;
+	if (sdow->encoding != SDO_ENCODING_CBOR)
+		sdow->needComma = true;
+	if (sdob->blockSize < sdob->cursor)
+		sdob->blockSize = sdob->cursor;
+}
 #if 0
 /**
  * Internal API
@@ -866,21 +1974,22 @@ void sdoWriteBigNumField(SDOW_t *sdow, uint8_t *bufp, int bufSz)
 void sdoWriteBigNum(SDOW_t *sdow, uint8_t *bufp, int bufSz)
 {
 	SDOBlock_t *sdob = &sdow->b;
-	char hex[3];
 
 	sdoWBeginSequence(sdow); // Write out the '['
 	sdoWriteUInt(sdow, bufSz);
 	_writeComma(sdow);
-	sdoBPutC(sdob, '"');
+	if (bufSz > 0)
+		(void)sdoWReserve(sdow, bufSz * 2 + SDO_CBOR_HEAD_MAX);
+	if (sdow->encoding == SDO_ENCODING_CBOR)
+		sdoCborWriteHead(sdow, SDO_CBOR_TSTR, bufSz * 2);
+	else
+		sdoBPutC(sdob, '"');
 	while (bufSz-- > 0) {
-		if (snprintf_s_i(hex, sizeof hex, "%02X", *bufp++) < 0) {
-			LOG(LOG_ERROR, "snprintf() failed!\n");
-			return;
-		}
-		sdoBPutC(sdob, hex[0]);
-		sdoBPutC(sdob, hex[1]);
+		sdoBPutC(sdob, sdoHexUpper[*bufp >> 4]);
+		sdoBPutC(sdob, sdoHexUpper[*bufp++ & 0xf]);
 	}
-	sdoBPutC(sdob, '"');
+	if (sdow->encoding != SDO_ENCODING_CBOR)
+		sdoBPutC(sdob, '"');
 	sdoWEndSequence(sdow); // Write out the ']'
 	sdow->needComma = true;
 	if (sdob->blockSize < sdob->cursor)
@@ -894,38 +2003,32 @@ void sdoWriteBigNum(SDOW_t *sdow, uint8_t *bufp, int bufSz)
 void sdoWriteByteArrayField(SDOW_t *sdow, uint8_t *bufp, int bufSz)
 {
 	SDOBlock_t *sdob = &sdow->b;
-	int index;
+	int strLen;
+
+	if (sdow->encoding == SDO_ENCODING_CBOR) {
+		sdoCborWriteBytes(sdow, bufp, bufSz);
+		return;
+	}
 
 	int bufNeeded = binToB64Length(bufSz);
 
 	// mbedtls expect larger size buffer
 	bufNeeded += 1;
-	// LOG(LOG_ERROR, "bufSz: %d, bufNeeded: %d\n", bufSz, bufNeeded);
-
-	if (bufNeeded) {
-		uint8_t *wrBuf = sdoAlloc(bufNeeded * sizeof(uint8_t));
-		if (wrBuf) {
-			// LOG(LOG_ERROR, "bufp: %p, bufSz: %d, wrBuf: %p\n",
-			// bufp,
-			// bufSz,
-			// wrBuf);
-
-			// Convert the binary to a string
-			int strLen =
-			    binToB64(bufSz, bufp, 0, bufNeeded, wrBuf, 0);
-			// LOG(LOG_ERROR, "strLen: %d\n", strLen);
-
-			_writeComma(sdow);
-			sdoBPutC(sdob, '"');
-			for (index = 0; index < strLen; index++)
-				sdoBPutC(sdob, wrBuf[index]);
-			sdoBPutC(sdob, '"');
-			sdow->needComma = true;
-			if (sdob->blockSize < sdob->cursor)
-				sdob->blockSize = sdob->cursor;
-			sdoFree(wrBuf);
-		}
-	}
+
+	/* comma, quotes and base64 encoded straight into the block */
+	if (!sdoWReserve(sdow, bufNeeded + 3))
+		return;
+
+	_writeComma(sdow);
+	sdoBPutC(sdob, '"');
+	strLen = binToB64(bufSz, bufp, 0, sdob->blockMax - sdob->cursor,
+			  sdob->block, sdob->cursor);
+	if (strLen > 0)
+		sdob->cursor += strLen;
+	sdoBPutC(sdob, '"');
+	sdow->needComma = true;
+	if (sdob->blockSize < sdob->cursor)
+		sdob->blockSize = sdob->cursor;
 }
 
 /**
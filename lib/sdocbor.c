@@ -0,0 +1,574 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Implementation of the CBOR encoding of the SDOR/SDOW primitives.
+ */
+
+#include "sdocbor.h"
+#include "base64.h"
+#include "util.h"
+#include <limits.h>
+#include <string.h>
+#include "safe_lib.h"
+
+typedef struct {
+	uint8_t major;
+	bool indefinite;
+	uint64_t val; // argument of the head, length of a string
+	int len;      // bytes of the head
+} SDOCborHead_t;
+
+/**
+ * Internal API: make n bytes from pos available, receiving them first when
+ * the message is streamed.
+ */
+static bool cborAvail(SDOR_t *sdor, int pos, int n)
+{
+	SDOBlock_t *sdob = &sdor->b;
+
+	if (pos < 0 || n < 0 || n > INT_MAX - pos)
+		return false;
+	if (pos + n > sdob->blockSize)
+		sdoRFill(sdor, pos + n - sdob->cursor);
+	return sdob->block && pos + n <= sdob->blockSize;
+}
+
+/**
+ * Internal API: decode the head of the item at pos.
+ * @return true if the head is complete and well formed, false otherwise.
+ */
+static bool cborHead(SDOR_t *sdor, int pos, SDOCborHead_t *h)
+{
+	const uint8_t *p;
+	uint8_t ai;
+	int i, n;
+
+	if (!cborAvail(sdor, pos, 1))
+		return false;
+
+	p = &sdor->b.block[pos];
+	h->major = p[0] >> 5;
+	h->indefinite = false;
+	h->val = 0;
+	h->len = 1;
+	ai = p[0] & 0x1f;
+
+	if (ai < 24) {
+		h->val = ai;
+		return true;
+	}
+	if (ai == SDO_CBOR_INDEFINITE) {
+		h->indefinite = true;
+		return h->major >= SDO_CBOR_BSTR && h->major != SDO_CBOR_TAG;
+	}
+	if (ai > 27)
+		return false;
+
+	n = 1 << (ai - 24);
+	if (!cborAvail(sdor, pos, 1 + n))
+		return false;
+	p = &sdor->b.block[pos];
+	for (i = 1; i <= n; i++)
+		h->val = h->val << 8 | p[i];
+	h->len = 1 + n;
+	return true;
+}
+
+/**
+ * Internal API: find the definite length string item at the cursor, either
+ * a text string or, if bytes is set, a byte string, and receive all of it.
+ * @return true with the offset and length of its contents, false otherwise.
+ */
+static bool cborString(SDOR_t *sdor, bool bytes, int *start, int *len)
+{
+	SDOCborHead_t h;
+	int pos = sdor->b.cursor;
+
+	if (!cborHead(sdor, pos, &h) || h.indefinite ||
+	    (h.major != SDO_CBOR_TSTR && (!bytes || h.major != SDO_CBOR_BSTR)))
+		return false;
+
+	pos += h.len;
+	if (h.val > (uint64_t)(INT_MAX - pos) ||
+	    !cborAvail(sdor, pos, (int)h.val))
+		return false;
+	*start = pos;
+	*len = (int)h.val;
+	return true;
+}
+
+/**
+ * Internal API: offset after the item at pos, containers included.
+ * @return the offset, -1 if the item is invalid or incomplete.
+ */
+static int cborItemEnd(SDOR_t *sdor, int pos)
+{
+	SDOCborHead_t h;
+	int depth = 0;
+
+	do {
+		if (!cborHead(sdor, pos, &h))
+			return -1;
+		pos += h.len;
+
+		switch (h.major) {
+		case SDO_CBOR_BSTR:
+		case SDO_CBOR_TSTR:
+			if (h.indefinite || h.val > (uint64_t)(INT_MAX - pos))
+				return -1;
+			pos += (int)h.val;
+			break;
+		case SDO_CBOR_ARRAY:
+		case SDO_CBOR_MAP:
+			/* Only the indefinite length ones are written */
+			if (!h.indefinite || depth == SDO_CBOR_DEPTH_MAX)
+				return -1;
+			depth++;
+			break;
+		case SDO_CBOR_SIMPLE:
+			if (h.indefinite && depth-- == 0)
+				return -1;
+			break;
+		case SDO_CBOR_TAG:
+			return -1;
+		default:
+			break;
+		}
+	} while (depth > 0);
+
+	return cborAvail(sdor, pos, 0) ? pos : -1;
+}
+
+/**
+ * Internal API: true if the innermost open container is a map.
+ */
+static bool cborInMap(const SDOR_t *sdor)
+{
+	return sdor->cborDepth &&
+	       (sdor->cborMaps >> (sdor->cborDepth - 1) & 1) != 0;
+}
+
+/**
+ * Enter the indefinite length array or map at the cursor.
+ *
+ * @param sdor - reader of the message.
+ * @param major - SDO_CBOR_ARRAY or SDO_CBOR_MAP.
+ * @return true if the container was entered, false otherwise.
+ */
+bool sdoCborRBegin(SDOR_t *sdor, uint8_t major)
+{
+	SDOCborHead_t h;
+
+	if (sdor->cborDepth >= SDO_CBOR_DEPTH_MAX ||
+	    !cborHead(sdor, sdor->b.cursor, &h) || h.major != major ||
+	    !h.indefinite) {
+		LOG(LOG_ERROR, "expected CBOR %s at cursor %d\n",
+		    major == SDO_CBOR_MAP ? "map" : "array", sdor->b.cursor);
+		return false;
+	}
+
+	sdor->b.cursor += h.len;
+	if (major == SDO_CBOR_MAP)
+		sdor->cborMaps |= 1u << sdor->cborDepth;
+	else
+		sdor->cborMaps &= ~(1u << sdor->cborDepth);
+	sdor->cborDepth++;
+	return true;
+}
+
+/**
+ * Leave the innermost container at its break.
+ *
+ * @param sdor - reader of the message.
+ * @param major - SDO_CBOR_ARRAY or SDO_CBOR_MAP, the kind of the container.
+ * @return true if the container ended here, false otherwise.
+ */
+bool sdoCborREnd(SDOR_t *sdor, uint8_t major)
+{
+	if (!sdor->cborDepth || cborInMap(sdor) != (major == SDO_CBOR_MAP) ||
+	    !cborAvail(sdor, sdor->b.cursor, 1) ||
+	    sdor->b.block[sdor->b.cursor] != SDO_CBOR_BREAK) {
+		LOG(LOG_ERROR, "expected end of CBOR %s at cursor %d\n",
+		    major == SDO_CBOR_MAP ? "map" : "array", sdor->b.cursor);
+		return false;
+	}
+
+	sdor->b.cursor++;
+	sdor->cborDepth--;
+	return true;
+}
+
+/**
+ * Peek at the cursor, as the JSON reader does for the end of a container.
+ * @return ']' or '}' at the break of an array or a map, 0 otherwise.
+ */
+int sdoCborRPeek(SDOR_t *sdor)
+{
+	if (!cborAvail(sdor, sdor->b.cursor, 1) ||
+	    sdor->b.block[sdor->b.cursor] != SDO_CBOR_BREAK)
+		return 0;
+	return cborInMap(sdor) ? '}' : ']';
+}
+
+/**
+ * Skip the rest of the innermost container, its break included.
+ */
+void sdoCborRSkipToEnd(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	int end;
+
+	if (!sdor->cborDepth)
+		return;
+
+	while (cborAvail(sdor, sdob->cursor, 1)) {
+		if (sdob->block[sdob->cursor] == SDO_CBOR_BREAK) {
+			sdob->cursor++;
+			sdor->cborDepth--;
+			return;
+		}
+		end = cborItemEnd(sdor, sdob->cursor);
+		if (end < 0)
+			break;
+		sdob->cursor = end;
+	}
+	sdob->cursor = sdob->blockSize;
+}
+
+/**
+ * Read an unsigned integer. Any other item is left at the cursor.
+ * @return the integer, 0 if there is none.
+ */
+uint32_t sdoCborReadUInt(SDOR_t *sdor)
+{
+	SDOCborHead_t h;
+
+	if (!cborHead(sdor, sdor->b.cursor, &h) || h.major != SDO_CBOR_UINT ||
+	    h.val > UINT32_MAX) {
+		LOG(LOG_ERROR, "expected CBOR uint at cursor %d\n",
+		    sdor->b.cursor);
+		return 0;
+	}
+	sdor->b.cursor += h.len;
+	return (uint32_t)h.val;
+}
+
+/**
+ * Length of the string at the cursor. A byte string counts as the base64
+ * text the JSON reader would see, so that the callers size it alike.
+ * @return the length, 0 if there is no string.
+ */
+int sdoCborReadStringSz(SDOR_t *sdor)
+{
+	SDOCborHead_t h;
+
+	if (!cborHead(sdor, sdor->b.cursor, &h) || h.indefinite ||
+	    h.val > INT_MAX / 2 ||
+	    (h.major != SDO_CBOR_TSTR && h.major != SDO_CBOR_BSTR)) {
+		LOG(LOG_ERROR, "expected CBOR string at cursor %d\n",
+		    sdor->b.cursor);
+		return 0;
+	}
+	if (h.major == SDO_CBOR_BSTR)
+		return binToB64Length((int)h.val);
+	return (int)h.val;
+}
+
+/**
+ * Read a text or byte string into bufp, NUL terminated and truncated to
+ * bufSz.
+ * @return the length of the string, 0 if there is none.
+ */
+int sdoCborReadString(SDOR_t *sdor, char *bufp, int bufSz)
+{
+	int start, len, n;
+
+	if (!cborString(sdor, true, &start, &len)) {
+		LOG(LOG_ERROR, "expected CBOR string at cursor %d\n",
+		    sdor->b.cursor);
+		return 0;
+	}
+
+	if (bufp && bufSz > 0) {
+		n = len < bufSz - 1 ? len : bufSz - 1;
+		if (n && memcpy_s(bufp, bufSz, &sdor->b.block[start], n))
+			return 0;
+		bufp[n] = 0;
+	}
+	sdor->b.cursor = start + len;
+	return len;
+}
+
+/**
+ * Read a text string in place, see sdoReadStringRef().
+ * @return the length of the string, -1 if there is none.
+ */
+int sdoCborReadStringRef(SDOR_t *sdor, const char **strp)
+{
+	int start, len;
+
+	if (!cborString(sdor, false, &start, &len)) {
+		LOG(LOG_ERROR, "expected CBOR string at cursor %d\n",
+		    sdor->b.cursor);
+		return -1;
+	}
+	*strp = (const char *)&sdor->b.block[start];
+	sdor->b.cursor = start + len;
+	return len;
+}
+
+/**
+ * Read a tag, a text string, into bufp like sdoCborReadString().
+ * @return the length of the tag, 0 if there is none.
+ */
+int sdoCborReadTag(SDOR_t *sdor, char *bufp, int bufSz)
+{
+	int start, len;
+
+	if (!cborString(sdor, false, &start, &len)) {
+		LOG(LOG_ERROR, "expected CBOR tag at cursor %d\n",
+		    sdor->b.cursor);
+		return 0;
+	}
+	return sdoCborReadString(sdor, bufp, bufSz);
+}
+
+/**
+ * Read a tag, checking that it is the expected one.
+ * @return 1 if the tag was read and matches, 0 otherwise.
+ */
+int sdoCborReadExpectedTagLen(SDOR_t *sdor, const char *tag, int tagLen)
+{
+	int start, len, memcmp_result = 1;
+
+	if (!cborString(sdor, false, &start, &len)) {
+		LOG(LOG_ERROR, "Expected tag \"%s\" not found\n", tag);
+		return 0;
+	}
+
+	if (len == tagLen &&
+	    memcmp_s(&sdor->b.block[start], len, tag, tagLen,
+		     &memcmp_result) != 0)
+		memcmp_result = 1;
+	sdor->b.cursor = start + len;
+	return memcmp_result == 0;
+}
+
+/**
+ * Read a tag, comparing it in place with a set of keys.
+ * @return value of the key of the tag, SDO_TAG_UNKNOWN if it is not a key
+ * or SDO_TAG_INVALID if no tag was read.
+ */
+int sdoCborReadTagKey(SDOR_t *sdor, const SDOTagKey_t *keys, int numKeys)
+{
+	int start, len;
+
+	if (!cborString(sdor, false, &start, &len)) {
+		LOG(LOG_ERROR, "expected CBOR tag at cursor %d\n",
+		    sdor->b.cursor);
+		return SDO_TAG_INVALID;
+	}
+
+	sdor->b.cursor = start + len;
+	return sdoTagLookup(keys, numKeys, &sdor->b.block[start], len);
+}
+
+/**
+ * Length of the array whose head is just before the cursor, the whole
+ * [[iv], size, cipher text] array of an encrypted message.
+ * @return the length from its head to its break, -1 if it is invalid.
+ */
+int sdoCborArrayEnd(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+	int start = sdob->cursor - 1, end;
+
+	if (!sdob->block || start < 0 || sdob->cursor > sdob->blockSize ||
+	    sdob->block[start] != (SDO_CBOR_ARRAY << 5 | SDO_CBOR_INDEFINITE))
+		return -1;
+
+	end = cborItemEnd(sdor, start);
+	return end < 0 ? -1 : end - start;
+}
+
+/**
+ * Internal API: find the byte array at the cursor, a byte string or the
+ * empty text string written for an empty one, and check it against the
+ * base64 length the caller expects.
+ */
+static bool cborByteArray(SDOR_t *sdor, int b64Sz, int *start, int *len)
+{
+	if (!cborString(sdor, true, start, len) ||
+	    (sdor->b.block[sdor->b.cursor] >> 5 == SDO_CBOR_TSTR && *len) ||
+	    binToB64Length(*len) != b64Sz) {
+		LOG(LOG_ERROR, "expected CBOR byte string at cursor %d\n",
+		    sdor->b.cursor);
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Read a byte array into bufp.
+ *
+ * @param sdor - reader of the message.
+ * @param b64Sz - length of the array in base64, as reported in the message.
+ * @param bufp - buffer for the bytes.
+ * @param bufSz - size of bufp.
+ * @return the number of bytes read, 0 on failure.
+ */
+int sdoCborReadByteArrayField(SDOR_t *sdor, int b64Sz, uint8_t *bufp,
+			      int bufSz)
+{
+	int start, len;
+
+	if (!cborByteArray(sdor, b64Sz, &start, &len))
+		return 0;
+	if (len > bufSz ||
+	    (len && memcpy_s(bufp, bufSz, &sdor->b.block[start], len) != 0)) {
+		LOG(LOG_ERROR, "CBOR byte string does not fit\n");
+		return 0;
+	}
+	sdor->b.cursor = start + len;
+	return len;
+}
+
+/**
+ * Skip a byte array, returning a pointer to its bytes in the SDOR block.
+ *
+ * @param sdor - reader of the message.
+ * @param b64Sz - length of the array in base64, as reported in the message.
+ * @param bytesp - set to the bytes, valid until the block is flushed, the
+ * next block is received or more of a streamed one is.
+ * @param lenp - set to the number of bytes.
+ * @return true on success, false otherwise.
+ */
+bool sdoCborReadBytes(SDOR_t *sdor, int b64Sz, const uint8_t **bytesp,
+		      int *lenp)
+{
+	int start, len;
+
+	if (!bytesp || !lenp || !cborByteArray(sdor, b64Sz, &start, &len))
+		return false;
+	*bytesp = &sdor->b.block[start];
+	*lenp = len;
+	sdor->b.cursor = start + len;
+	return true;
+}
+
+//==============================================================================
+// Write values
+//
+
+/**
+ * Internal API: append len bytes to the block.
+ */
+static void cborPut(SDOW_t *sdow, const uint8_t *buf, int len)
+{
+	SDOBlock_t *sdob = &sdow->b;
+
+	if (len <= 0)
+		return;
+	if (!sdoWReserve(sdow, len) ||
+	    memcpy_s(&sdob->block[sdob->cursor], sdob->blockMax - sdob->cursor,
+		     buf, len) != 0) {
+		LOG(LOG_ERROR, "Failed to write %d CBOR bytes\n", len);
+		return;
+	}
+	sdob->cursor += len;
+	if (sdob->blockSize < sdob->cursor)
+		sdob->blockSize = sdob->cursor;
+}
+
+/**
+ * Write the head of an item in its shortest form.
+ *
+ * @param sdow - writer of the message.
+ * @param major - major type of the item.
+ * @param val - argument of the head, the value or the length of the item.
+ */
+void sdoCborWriteHead(SDOW_t *sdow, uint8_t major, uint32_t val)
+{
+	uint8_t head[5];
+	int n;
+
+	if (val < 24) {
+		head[0] = (uint8_t)(major << 5 | val);
+		n = 1;
+	} else if (val <= 0xff) {
+		head[0] = major << 5 | 24;
+		head[1] = (uint8_t)val;
+		n = 2;
+	} else if (val <= 0xffff) {
+		head[0] = major << 5 | 25;
+		head[1] = (uint8_t)(val >> 8);
+		head[2] = (uint8_t)val;
+		n = 3;
+	} else {
+		head[0] = major << 5 | 26;
+		head[1] = (uint8_t)(val >> 24);
+		head[2] = (uint8_t)(val >> 16);
+		head[3] = (uint8_t)(val >> 8);
+		head[4] = (uint8_t)val;
+		n = 5;
+	}
+	cborPut(sdow, head, n);
+}
+
+/**
+ * Open an indefinite length array or map.
+ *
+ * @param sdow - writer of the message.
+ * @param major - SDO_CBOR_ARRAY or SDO_CBOR_MAP.
+ */
+void sdoCborWBegin(SDOW_t *sdow, uint8_t major)
+{
+	uint8_t head = major << 5 | SDO_CBOR_INDEFINITE;
+
+	cborPut(sdow, &head, 1);
+}
+
+/**
+ * Close the innermost array or map.
+ */
+void sdoCborWEnd(SDOW_t *sdow)
+{
+	uint8_t brk = SDO_CBOR_BREAK;
+
+	cborPut(sdow, &brk, 1);
+}
+
+/**
+ * Write a text string of up to len characters, stopping at a NUL like the
+ * JSON writer, or of all of s if len is negative.
+ */
+void sdoCborWriteString(SDOW_t *sdow, const char *s, int len)
+{
+	const char *z;
+
+	if (len < 0)
+		len = (int)strlen(s);
+	else if (len && (z = memchr(s, 0, len)) != NULL)
+		len = (int)(z - s);
+
+	(void)sdoWReserve(sdow, SDO_CBOR_HEAD_MAX + len);
+	sdoCborWriteHead(sdow, SDO_CBOR_TSTR, len);
+	cborPut(sdow, (const uint8_t *)s, len);
+}
+
+/**
+ * Write a byte string.
+ */
+void sdoCborWriteBytes(SDOW_t *sdow, const uint8_t *bufp, int bufSz)
+{
+	if (bufSz < 0 || (bufSz && !bufp))
+		bufSz = 0;
+
+	(void)sdoWReserve(sdow, SDO_CBOR_HEAD_MAX + bufSz);
+	sdoCborWriteHead(sdow, SDO_CBOR_BSTR, bufSz);
+	cborPut(sdow, bufp, bufSz);
+}
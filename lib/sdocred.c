@@ -63,21 +63,24 @@ void sdoCredOwnerFree(SDOCredOwner_t *ocred)
  */
 void sdoCredOwnerPrint(SDOCredOwner_t *ocred)
 {
-	char pbuf[1024] = {0};
+	char *pbuf = sdoScratchLease(SDO_SCRATCH_SIZE);
 	char *p_pbuf = NULL;
 
+	if (!pbuf)
+		return;
 	LOG(LOG_DEBUG, "========================================\n");
 	LOG(LOG_DEBUG, "PM.CredOwner\n");
 	LOG(LOG_DEBUG, " pv : %d\n", ocred->pv);
 	p_pbuf = sdoPKEncToString(ocred->pe);
 	LOG(LOG_DEBUG, " pe : %s\n", p_pbuf ? p_pbuf : "");
-	p_pbuf = sdoGuidToString(ocred->guid, pbuf, sizeof pbuf);
+	p_pbuf = sdoGuidToString(ocred->guid, pbuf, SDO_SCRATCH_SIZE);
 	LOG(LOG_DEBUG, " g  : %s\n", p_pbuf ? p_pbuf : "");
-	p_pbuf =
-	    sdoRendezvousToString(ocred->rvlst->rvEntries, pbuf, sizeof pbuf);
+	p_pbuf = sdoRendezvousToString(ocred->rvlst->rvEntries, pbuf,
+				       SDO_SCRATCH_SIZE);
 	LOG(LOG_DEBUG, " r  : %s\n", p_pbuf ? p_pbuf : "");
-	p_pbuf = sdoHashToString(ocred->pkh, pbuf, sizeof pbuf);
+	p_pbuf = sdoHashToString(ocred->pkh, pbuf, SDO_SCRATCH_SIZE);
 	LOG(LOG_DEBUG, " pkh: %s\n", p_pbuf ? p_pbuf : "");
+	sdoScratchRelease(pbuf);
 }
 #endif
 
@@ -189,6 +192,34 @@ void sdoDevCredFree(SDODevCred_t *devCred)
 	}
 }
 
+/**
+ * Internal API: hash of a public key from its serialization by
+ * sdoPublicKeyWrite(), as sdoPubKeyHash() makes it.
+ * @param pk - the serialized key
+ * @param len - size of pk
+ * @return the hash, NULL on failure
+ */
+static SDOHash_t *sdoPubKeyHashBytes(uint8_t *pk, size_t len)
+{
+	SDOHash_t *hash;
+
+	if (len < PUBLIC_KEY_OFFSET)
+		return NULL;
+
+	hash =
+	    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED, SDO_SHA_DIGEST_SIZE_USED);
+	if (!hash)
+		return NULL;
+
+	// the hash is of the key from offset 12
+	if (0 != sdoCryptoHash(pk + PUBLIC_KEY_OFFSET, len - PUBLIC_KEY_OFFSET,
+			       hash->hash->bytes, hash->hash->byteSz)) {
+		sdoHashFree(hash);
+		return NULL;
+	}
+	return hash;
+}
+
 /**
  * Make a hash of the passed public key
  * @param pubKey - pointer to the public key object
@@ -198,37 +229,17 @@ SDOHash_t *sdoPubKeyHash(SDOPublicKey_t *pubKey)
 {
 	// Calculate the hash of the mfgPubKey
 	SDOHash_t *hash = NULL;
-	hash =
-	    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED, SDO_SHA_DIGEST_SIZE_USED);
-	if (!hash)
-		return NULL;
-
 	SDOW_t sdowriter, *sdow = &sdowriter;
 
 	// Prepare the data structure
 	if (!sdoWInit(sdow)) {
-		sdoHashFree(hash);
 		LOG(LOG_ERROR, "sdoWInit() failed!\n");
 		return NULL;
 	}
 	sdoWNextBlock(sdow, SDO_TYPE_HMAC);
 	sdoPublicKeyWrite(sdow, pubKey);
 
-	if (hash && (sdow->b.blockSize < PUBLIC_KEY_OFFSET)) {
-		sdoHashFree(hash);
-		return NULL;
-	}
-
-	// buffer sdow now contains the key to sign offset 12
-
-	if (hash &&
-	    (0 != sdoCryptoHash(&sdow->b.block[PUBLIC_KEY_OFFSET],
-				sdow->b.blockSize - PUBLIC_KEY_OFFSET,
-				hash->hash->bytes, hash->hash->byteSz))) {
-
-		sdoHashFree(hash);
-		return NULL;
-	}
+	hash = sdoPubKeyHashBytes(sdow->b.block, sdow->b.blockSize);
 
 	if (sdow->b.block) {
 		sdoFree(sdow->b.block);
@@ -237,6 +248,21 @@ SDOHash_t *sdoPubKeyHash(SDOPublicKey_t *pubKey)
 	return hash;
 }
 
+/**
+ * Get the hash of the passed public key, as made by sdoPubKeyHash(). It is
+ * made once and kept with the key.
+ * @param pubKey - pointer to the public key object
+ * @return the hash, owned by the key, or NULL on failure
+ */
+const SDOHash_t *sdoPubKeyHashOf(SDOPublicKey_t *pubKey)
+{
+	if (!pubKey)
+		return NULL;
+	if (!pubKey->pkh)
+		pubKey->pkh = sdoPubKeyHash(pubKey);
+	return pubKey->pkh;
+}
+
 /*------------------------------------------------------------------------------
  * Owner Proxy Entry Routines
  */
@@ -255,9 +281,8 @@ SDOOvEntry_t *sdoOvEntryAllocEmpty(void)
 /**
  * Release and sdoFree an Ownership Voucher entry
  * @param e - the entry to sdoFree
- * @return - the entry pointed to by the next value
  */
-SDOOvEntry_t *sdoOvEntryFree(SDOOvEntry_t *e)
+void sdoOvEntryFree(SDOOvEntry_t *e)
 {
 	if (e->pk)
 		sdoPublicKeyFree(e->pk);
@@ -265,9 +290,7 @@ SDOOvEntry_t *sdoOvEntryFree(SDOOvEntry_t *e)
 		sdoHashFree(e->hpHash);
 	if (e->hcHash)
 		sdoHashFree(e->hcHash);
-	SDOOvEntry_t *next = e->next;
 	sdoFree(e);
-	return next;
 }
 /*------------------------------------------------------------------------------
  * Ownership Voucher Routines
@@ -293,8 +316,6 @@ SDOOwnershipVoucher_t *sdoOvAlloc(void)
  */
 void sdoOvFree(SDOOwnershipVoucher_t *ov)
 {
-	SDOOvEntry_t *e;
-
 	if (ov->rvlst2 != NULL)
 		sdoRendezvousListFree(ov->rvlst2);
 	if (ov->devInfo != NULL)
@@ -308,11 +329,9 @@ void sdoOvFree(SDOOwnershipVoucher_t *ov)
 	if (ov->hdc)
 		sdoHashFree(ov->hdc);
 
-	// Free all listed Owner Proxy Entries
-	while ((e = ov->OVEntries) != NULL) {
-		ov->OVEntries = e->next;
-		sdoOvEntryFree(e);
-	}
+	// The entries are verified one at a time, only the last one is held
+	if (ov->OVEntries)
+		sdoOvEntryFree(ov->OVEntries);
 	sdoFree(ov);
 }
 
@@ -331,23 +350,31 @@ SDOOwnershipVoucher_t *sdoOvHdrRead(SDOR_t *sdor, SDOHash_t **hmac,
 		return NULL;
 
 	SDOOwnershipVoucher_t *ov = sdoOvAlloc();
-	int gstart = -1;
-	int gend = -1;
-	int dstart = -1;
-	int dend = -1;
-	int sigBlockStart = -1;
+	int hmacTap = -1;
+	int hpTap = -1;
+	int hcTap = -1;
+	bool done;
 	int ret = -1;
-	uint8_t *hpText = NULL;
-	uint8_t *hcText = NULL;
 
 	if (ov == NULL) {
 		LOG(LOG_ERROR, "Ownership Voucher allocation failed!");
 		return NULL;
 	}
 
-	if (!sdoBeginReadHMAC(sdor, &sigBlockStart))
+	if (!sdoBeginReadHMAC(sdor, &hmacTap))
 		goto exit;
 
+	/*
+	 * hp = SHA256[TO2.ProveOVHdr.bo.oh||TO2.ProveOvHdr.bo.hmac]
+	 * hc = SHA256[TO2.ProveOVHdr.bo.oh.g||TO2.ProveOVHdr.bo.oh.d]
+	 * are fed as their parts are read
+	 */
+	if (calHpHc) {
+		hpTap = sdoHashTapBegin(sdor);
+		if (hpTap < 0)
+			goto exit;
+	}
+
 	if (!sdoRBeginObject(sdor))
 		goto exit;
 
@@ -377,22 +404,24 @@ SDOOwnershipVoucher_t *sdoOvHdrRead(SDOR_t *sdor, SDOHash_t **hmac,
 
 	if (!sdoReadExpectedTag(sdor, "g"))
 		goto exit;
-	gstart = sdor->b.cursor;
+	if (calHpHc) {
+		hcTap = sdoHashTapBegin(sdor);
+		if (hcTap < 0)
+			goto exit;
+	}
 	ov->g2 = sdoByteArrayAlloc(0);
 	if (!ov->g2 || !sdoByteArrayReadChars(sdor, ov->g2)) {
 		LOG(LOG_ERROR, "sdoOvHdrRead GUID Error\n");
 		goto exit;
 	}
-	gend = sdor->b.cursor;
-	uint8_t *gText = sdoRGetBlockPtr(sdor, gstart);
-
-	if (gText == NULL)
+	if (calHpHc && !sdoRTapPause(sdor, hcTap, NULL))
 		goto exit;
 
 	if (!sdoReadExpectedTag(sdor, "d")) // DeviceInfo String
 		goto exit;
 
-	dstart = sdor->b.cursor;
+	if (calHpHc && !sdoRTapResume(sdor, hcTap))
+		goto exit;
 	ov->devInfo = sdoStringAlloc();
 
 	if (!ov->devInfo || !sdoStringRead(sdor, ov->devInfo)) {
@@ -400,10 +429,7 @@ SDOOwnershipVoucher_t *sdoOvHdrRead(SDOR_t *sdor, SDOHash_t **hmac,
 		goto exit;
 	}
 
-	dend = sdor->b.cursor;
-
-	uint8_t *dText = sdoRGetBlockPtr(sdor, dstart);
-	if (dText == NULL)
+	if (calHpHc && !sdoRTapPause(sdor, hcTap, NULL))
 		goto exit;
 
 	if (!sdoReadExpectedTag(sdor, "pk")) // Mfg Public key
@@ -431,117 +457,63 @@ SDOOwnershipVoucher_t *sdoOvHdrRead(SDOR_t *sdor, SDOHash_t **hmac,
 		goto exit;
 	}
 #endif
-	if (!sdoEndReadHMAC(sdor, hmac, sigBlockStart)) {
+	/* The HMAC closes its tap either way */
+	done = sdoEndReadHMAC(sdor, hmac, hmacTap);
+	hmacTap = -1;
+	if (!done) {
 		LOG(LOG_ERROR, "Error making OVHdr HMAC!\n");
 		goto exit;
 	}
 
 	if (calHpHc) {
-		int ohEnd = sdor->b.cursor;
-		int ohSz = ohEnd - sigBlockStart;
-		uint8_t *ohText = sdoRGetBlockPtr(sdor, sigBlockStart);
-		int hmacStart = 0;
-		int hmacEnd = 0;
-		uint8_t *hmacText = NULL;
-
-		if (ohText == NULL)
+		if (!sdoRTapPause(sdor, hpTap, NULL))
 			goto exit;
 
 		// Now get the HMAC of the OV Header from the DI
 		// phase
 		if (!sdoReadExpectedTag(sdor, "hmac"))
 			goto exit;
-		hmacStart = sdor->b.cursor;
+		if (!sdoRTapResume(sdor, hpTap))
+			goto exit;
 		ov->ovoucherHdrHash = sdoHashAllocEmpty();
 		if (!ov->ovoucherHdrHash ||
 		    !sdoHashRead(sdor, ov->ovoucherHdrHash))
 			goto exit;
-		hmacEnd = sdor->b.cursor;
-		hmacText = sdoRGetBlockPtr(sdor, hmacStart);
-
-		if (hmacText == NULL)
-			goto exit;
-
-		// hp = SHA256[TO2.ProveOVHdr.bo.oh||TO2.ProveOvHdr.bo.hmac] )
-
-		hpText = sdoAlloc(ohSz + (hmacEnd - hmacStart));
-		if (hpText == NULL) {
-			LOG(LOG_ERROR, "Memset Failed\n");
-			goto exit;
-		}
-
-		if (memcpy_s(hpText, ohSz + (hmacEnd - hmacStart), ohText,
-			     ohSz) != 0) {
-			LOG(LOG_ERROR, "Memcpy Failed\n");
-			goto exit;
-		}
-
-		if (memcpy_s(hpText + ohSz, hmacEnd - hmacStart, hmacText,
-			     hmacEnd - hmacStart) != 0) {
-			LOG(LOG_ERROR, "Memcpy Failed\n");
-			goto exit;
-		}
 
 		ov->OVEntries = sdoOvEntryAllocEmpty();
 
-		if (ov->OVEntries)
+		if (ov->OVEntries) {
 			ov->OVEntries->hpHash =
 			    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED,
 					 SDO_SHA_DIGEST_SIZE_USED);
-		if (!ov->OVEntries || !ov->OVEntries->hpHash) {
+			ov->OVEntries->hcHash =
+			    sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED,
+					 SDO_SHA_DIGEST_SIZE_USED);
+		}
+		if (!ov->OVEntries || !ov->OVEntries->hpHash ||
+		    !ov->OVEntries->hcHash) {
 			LOG(LOG_ERROR,
 			    "Ownership Voucher allocation failed!\n");
 			goto exit;
 		}
 
-		if (0 != sdoCryptoHash(hpText, ohSz + (hmacEnd - hmacStart),
-				       ov->OVEntries->hpHash->hash->bytes,
-				       ov->OVEntries->hpHash->hash->byteSz)) {
+		done = sdoHashTapEnd(sdor, hpTap, ov->OVEntries->hpHash);
+		hpTap = -1;
+		if (!done)
 			goto exit;
-		}
-
-		// hc = SHA256[TO2.ProveOVHdr.bo.oh.g||TO2.ProveOVHdr.bo.oh.d]
-		// g size + d size
-		hcText = sdoAlloc((gend - gstart) + (dend - dstart));
-		if (hcText == NULL) {
-			LOG(LOG_ERROR, "Memset Failed\n");
+		done = sdoHashTapEnd(sdor, hcTap, ov->OVEntries->hcHash);
+		hcTap = -1;
+		if (!done)
 			goto exit;
-		}
-
-		if (memcpy_s(hcText, ((gend - gstart) + (dend - dstart)), gText,
-			     (gend - gstart)) != 0) {
-			LOG(LOG_ERROR, "Memcpy Failed\n");
-			goto exit;
-		}
-
-		if (memcpy_s(hcText + (gend - gstart), (dend - dstart), dText,
-			     (dend - dstart)) != 0) {
-			LOG(LOG_ERROR, "Memcpy Failed\n");
-			goto exit;
-		}
-
-		ov->OVEntries->hcHash = sdoHashAlloc(SDO_CRYPTO_HASH_TYPE_USED,
-						     SDO_SHA_DIGEST_SIZE_USED);
-		if (!ov->OVEntries->hcHash)
-			goto exit;
-
-		if (0 != sdoCryptoHash(hcText,
-				       (gend - gstart) + (dend - dstart),
-				       ov->OVEntries->hcHash->hash->bytes,
-				       ov->OVEntries->hcHash->hash->byteSz)) {
-			LOG(LOG_ERROR, "Hash generation failed\n");
-			goto exit;
-		}
 
 		// To verify the next entry in the ownership voucher
 		ov->OVEntries->pk = sdoPublicKeyClone(ov->mfgPubKey);
 	}
 	ret = 0;
 exit:
-	if (hpText)
-		sdoFree(hpText);
-	if (hcText)
-		sdoFree(hcText);
+	sdoRTapFree(sdor, hmacTap);
+	sdoRTapFree(sdor, hpTap);
+	sdoRTapFree(sdor, hcTap);
 	if (ret) {
 		LOG(LOG_ERROR, "OvHdr Error\n");
 		sdoOvFree(ov);
@@ -554,11 +526,15 @@ exit:
  * Take the the values in the "oh" and create a new HMAC
  * @param devCred - pointer to the DeviceCredential to source
  * @param newPubKey - the public key to use in the signature
+ * @param newPkh - if not NULL, out hash of newPubKey as made by
+ * sdoPubKeyHash(), from its serialization in the header
  * @return pointer to a new SDOHash_t object containing the HMAC
  */
-SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey)
+SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey,
+			   SDOHash_t **newPkh)
 {
 	SDOW_t sdowriter, *sdow = &sdowriter;
+	int pkStart, pkEnd;
 
 	// Prepare the data structure
 	if (!sdoWInit(sdow)) {
@@ -591,7 +567,9 @@ SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey)
 			  devCred->mfgBlk->d->byteSz);
 
 	sdoWriteTag(sdow, "pk");
+	pkStart = sdow->b.cursor;
 	sdoPublicKeyWrite(sdow, newPubKey);
+	pkEnd = sdow->b.cursor;
 
 	sdoWEndObject(sdow);
 
@@ -615,6 +593,16 @@ SDOHash_t *sdoNewOVHdrSign(SDODevCred_t *devCred, SDOPublicKey_t *newPubKey)
 		return NULL;
 	}
 
+	/* no serialization of the key again for its hash */
+	if (hmac && newPkh) {
+		*newPkh = sdoPubKeyHashBytes(sdoWGetBlockPtr(sdow, pkStart),
+					     pkEnd - pkStart);
+		if (!*newPkh) {
+			sdoHashFree(hmac);
+			hmac = NULL;
+		}
+	}
+
 	if (sdow->b.block) {
 		sdoFree(sdow->b.block);
 		sdow->b.block = NULL;
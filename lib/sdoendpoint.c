@@ -0,0 +1,300 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Statistics of the rendezvous and owner servers, kept across runs.
+ *
+ * Each server (domain name or IP address, and port) TO1 or TO2 ran against
+ * has its success rate, its consecutive failures and the time it took to
+ * connect to and to answer, averaged over the recent runs. They are kept in
+ * a blob, so that TO1 can start with the historically fastest healthy
+ * rendezvous entry, for ex: the regional one, rather than with the first
+ * entry the owner listed. Entries without a history are tried in the order
+ * of the owner. RV_RANK=false leaves them out.
+ */
+
+#include "util.h"
+#include "sdoendpoint.h"
+#include "storage_al.h"
+#include "safe_lib.h"
+
+#ifdef ENDPOINT_STATS_BLOB
+/* Servers remembered, the least recently used one is replaced */
+#define ENDPOINT_MAX 8
+/* Runs a success rate is over, older runs count half each time */
+#define ENDPOINT_RUNS_MAX 32
+/* Longest domain name as per RFC 1035, incl. terminator */
+#define ENDPOINT_MAX_DN 256
+
+/*
+ * The blob is a version byte and a count byte, followed by the servers,
+ * each a record of ENDPOINT_REC_SZ bytes, all big-endian: key (4), runs
+ * (1), successes (1), consecutive failures (1), connect ms (4), response
+ * ms (4) and last use (4).
+ */
+#define ENDPOINT_VERSION 1
+#define ENDPOINT_HDR_SZ 2
+#define ENDPOINT_REC_SZ 19
+
+typedef struct {
+	uint32_t key; // hash of the name or address, and port
+	uint8_t runs;
+	uint8_t successes;
+	uint8_t failStreak;
+	uint32_t connectMs;  // average time to connect
+	uint32_t responseMs; // average time to the response of a message
+	uint32_t lastUse;    // sequence of the run, for the replacement
+} sdoEndpoint_t;
+
+typedef struct {
+	uint8_t count;
+	sdoEndpoint_t ep[ENDPOINT_MAX];
+} sdoEndpointTable_t;
+
+/**
+ * Internal API: key of a server, FNV-1a over its name (or address) and port.
+ */
+static uint32_t sdoEndpointKey(const char *dn, const SDOIPAddress_t *ip,
+			       uint16_t port)
+{
+	const uint8_t *p = dn ? (const uint8_t *)dn : ip->addr;
+	size_t len = dn ? strnlen_s(dn, ENDPOINT_MAX_DN) : ip->length;
+	uint32_t h = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len && i < ENDPOINT_MAX_DN; i++)
+		h = (h ^ p[i]) * 16777619u;
+	h = (h ^ (port >> 8)) * 16777619u;
+	return (h ^ (port & 0xff)) * 16777619u;
+}
+
+static uint32_t sdoEndpointGet32(const uint8_t *b)
+{
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+	       ((uint32_t)b[2] << 8) | b[3];
+}
+
+static void sdoEndpointPut32(uint8_t *b, uint32_t v)
+{
+	b[0] = (v >> 24) & 0xff;
+	b[1] = (v >> 16) & 0xff;
+	b[2] = (v >> 8) & 0xff;
+	b[3] = v & 0xff;
+}
+
+/**
+ * Internal API: read the statistics, an empty table if there are none.
+ */
+static void sdoEndpointLoad(sdoEndpointTable_t *t)
+{
+	uint8_t buf[ENDPOINT_HDR_SZ + ENDPOINT_MAX * ENDPOINT_REC_SZ];
+	int32_t size =
+	    sdoBlobSize((char *)ENDPOINT_STATS_BLOB, SDO_SDK_NORMAL_DATA);
+	const uint8_t *r;
+	int i;
+
+	t->count = 0;
+	if (size < ENDPOINT_HDR_SZ || size > (int32_t)sizeof(buf) ||
+	    sdoBlobRead((char *)ENDPOINT_STATS_BLOB, SDO_SDK_NORMAL_DATA, buf,
+			size) != size)
+		return;
+	if (buf[0] != ENDPOINT_VERSION || buf[1] > ENDPOINT_MAX ||
+	    size != ENDPOINT_HDR_SZ + buf[1] * ENDPOINT_REC_SZ)
+		return;
+
+	for (i = 0; i < buf[1]; i++) {
+		r = &buf[ENDPOINT_HDR_SZ + i * ENDPOINT_REC_SZ];
+		t->ep[i].key = sdoEndpointGet32(r);
+		t->ep[i].runs = r[4];
+		t->ep[i].successes = r[5];
+		t->ep[i].failStreak = r[6];
+		t->ep[i].connectMs = sdoEndpointGet32(r + 7);
+		t->ep[i].responseMs = sdoEndpointGet32(r + 11);
+		t->ep[i].lastUse = sdoEndpointGet32(r + 15);
+	}
+	t->count = buf[1];
+}
+
+/**
+ * Internal API: write the statistics.
+ */
+static void sdoEndpointSave(const sdoEndpointTable_t *t)
+{
+	uint8_t buf[ENDPOINT_HDR_SZ + ENDPOINT_MAX * ENDPOINT_REC_SZ];
+	uint8_t *r;
+	int32_t size = ENDPOINT_HDR_SZ + t->count * ENDPOINT_REC_SZ;
+	int i;
+
+	buf[0] = ENDPOINT_VERSION;
+	buf[1] = t->count;
+	for (i = 0; i < t->count; i++) {
+		r = &buf[ENDPOINT_HDR_SZ + i * ENDPOINT_REC_SZ];
+		sdoEndpointPut32(r, t->ep[i].key);
+		r[4] = t->ep[i].runs;
+		r[5] = t->ep[i].successes;
+		r[6] = t->ep[i].failStreak;
+		sdoEndpointPut32(r + 7, t->ep[i].connectMs);
+		sdoEndpointPut32(r + 11, t->ep[i].responseMs);
+		sdoEndpointPut32(r + 15, t->ep[i].lastUse);
+	}
+	if (sdoBlobWrite((char *)ENDPOINT_STATS_BLOB, SDO_SDK_NORMAL_DATA, buf,
+			 size) != size)
+		LOG(LOG_ERROR, "Saving the server statistics failed\n");
+}
+
+static sdoEndpoint_t *sdoEndpointFind(sdoEndpointTable_t *t, uint32_t key)
+{
+	int i;
+
+	for (i = 0; i < t->count; i++) {
+		if (t->ep[i].key == key)
+			return &t->ep[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: average of the recent samples, the new one weighing a
+ * quarter.
+ */
+static uint32_t sdoEndpointAverage(uint32_t avg, uint32_t sample)
+{
+	if (!avg)
+		return sample ? sample : 1;
+	return (uint32_t)(((uint64_t)avg * 3 + sample) / 4);
+}
+
+/**
+ * Record a TO1 or TO2 run with a server.
+ *
+ * @param dn - domain name of the server, NULL if it is known by IP.
+ * @param ip - IP address of the server, used if dn is NULL.
+ * @param port - port of the server.
+ * @param success - true if the protocol completed.
+ * @param connectMs - average time to connect in the run, 0 if it did not.
+ * @param responseMs - average time to a response in the run, 0 if none.
+ */
+void sdoEndpointRecord(const char *dn, const SDOIPAddress_t *ip,
+		       uint16_t port, bool success, uint32_t connectMs,
+		       uint32_t responseMs)
+{
+	sdoEndpointTable_t t;
+	sdoEndpoint_t *ep;
+	uint32_t key, seq = 0;
+	int i;
+
+	if (!dn && !ip)
+		return;
+	key = sdoEndpointKey(dn, ip, port);
+
+	sdoEndpointLoad(&t);
+	for (i = 0; i < t.count; i++) {
+		if (t.ep[i].lastUse > seq)
+			seq = t.ep[i].lastUse;
+	}
+	ep = sdoEndpointFind(&t, key);
+	if (!ep && t.count < ENDPOINT_MAX) {
+		ep = &t.ep[t.count++];
+	} else if (!ep) {
+		ep = &t.ep[0];
+		for (i = 1; i < t.count; i++) {
+			if (t.ep[i].lastUse < ep->lastUse)
+				ep = &t.ep[i];
+		}
+	}
+	if (ep->key != key) {
+		if (memset_s(ep, sizeof(*ep), 0) != 0)
+			return;
+		ep->key = key;
+	}
+
+	if (ep->runs >= ENDPOINT_RUNS_MAX) {
+		ep->runs /= 2;
+		ep->successes /= 2;
+	}
+	ep->runs++;
+	if (success) {
+		ep->successes++;
+		ep->failStreak = 0;
+	} else if (ep->failStreak < UINT8_MAX) {
+		ep->failStreak++;
+	}
+	if (connectMs)
+		ep->connectMs = sdoEndpointAverage(ep->connectMs, connectMs);
+	if (responseMs)
+		ep->responseMs =
+		    sdoEndpointAverage(ep->responseMs, responseMs);
+	ep->lastUse = seq + 1;
+
+	sdoEndpointSave(&t);
+}
+
+/**
+ * Pick the rendezvous entry to start TO1 with: the fastest one to connect
+ * to and answer, among those whose last run succeeded and which succeed at
+ * least half of the time.
+ *
+ * @param rvlst - rendezvous list.
+ * @return 1-based index of the entry, 0 if no entry has such a history
+ * (the entries are then to be tried in order).
+ */
+int sdoEndpointPickRendezvous(SDORendezvousList_t *rvlst)
+{
+	sdoEndpointTable_t t;
+	sdoEndpoint_t *ep;
+	SDORendezvous_t *rv;
+	uint64_t score, best = UINT64_MAX;
+	int n, picked = 0;
+
+	if (!rvlst || rvlst->numEntries < 2)
+		return 0;
+
+	sdoEndpointLoad(&t);
+	if (!t.count)
+		return 0;
+
+	for (n = 0; n < rvlst->numEntries; n++) {
+		rv = sdoRendezvousListGet(rvlst, n);
+		if (!rv || !rv->po || (!rv->dn && !rv->ip))
+			continue;
+		ep = sdoEndpointFind(
+		    &t, sdoEndpointKey(rv->dn ? rv->dn->bytes : NULL,
+				       rv->dn ? NULL : rv->ip, *rv->po));
+		if (!ep || ep->failStreak || !ep->connectMs ||
+		    ep->successes * 2 < ep->runs)
+			continue;
+		/* ties go to the earlier entry of the owner */
+		score = (uint64_t)ep->connectMs + ep->responseMs;
+		if (score < best) {
+			best = score;
+			picked = n + 1;
+		}
+	}
+	if (picked)
+		LOG(LOG_DEBUG, "Rendezvous entry %d is the fastest (%u ms)\n",
+		    picked, (uint32_t)best);
+	return picked;
+}
+
+#else
+void sdoEndpointRecord(const char *dn, const SDOIPAddress_t *ip,
+		       uint16_t port, bool success, uint32_t connectMs,
+		       uint32_t responseMs)
+{
+	(void)dn;
+	(void)ip;
+	(void)port;
+	(void)success;
+	(void)connectMs;
+	(void)responseMs;
+}
+
+int sdoEndpointPickRendezvous(SDORendezvousList_t *rvlst)
+{
+	(void)rvlst;
+	return 0;
+}
+#endif /* ENDPOINT_STATS_BLOB */
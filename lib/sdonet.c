@@ -6,6 +6,7 @@
 #include "util.h"
 #include "network_al.h"
 #include "sdonet.h"
+#include "sdoretry.h"
 #include "sdotypes.h"
 #include "safe_lib.h"
 #include <stdlib.h>
@@ -24,23 +25,221 @@
 #include <proxy.h>
 #endif
 #endif
+#ifdef TARGET_OS_LINUX
+#include <stdio.h>
+#include <sys/stat.h>
+#endif
+
+/* A transcript has the connects in order, so it plays no early connect */
+#if defined(TARGET_OS_LINUX) && !defined(OWNER_PRECONNECT_FALSE) &&          \
+    !defined(NET_REPLAY) && !defined(NET_RECORD)
+#define OWNER_PRECONNECT_WORKER
+#include <pthread.h>
+#endif
 
-/* HTTP Proxy parameters */
-static SDOIPAddress_t rvproxy_ip;
-static uint16_t rvproxy_port;
-static SDOIPAddress_t mfgproxy_ip;
-static uint16_t mfgproxy_port;
-static SDOIPAddress_t ownerproxy_ip;
-static uint16_t ownerproxy_port;
+enum { PROXY_MFG, PROXY_RV, PROXY_OWNER, PROXY_COUNT };
+
+/*
+ * HTTP proxy of each server. The proxy file is parsed (or the proxy
+ * discovered) once, by the first instance, and again only when an SDK run
+ * finds the file changed: its size, and on linux its modification time,
+ * are all that is checked otherwise.
+ */
+typedef struct {
+	const char *file;
+	const char *name;
+	SDOIPAddress_t ip;
+	uint16_t port; // 0 if there is no proxy
+	bool parsed;
+	int32_t size; // of the file parsed, 0 if absent
+	int64_t mtime;
+} proxyConf_t;
+
+static proxyConf_t proxyConf[PROXY_COUNT] = {{MFG_PROXY, "Manufacturer"},
+					      {RV_PROXY, "Rendezvous"},
+					      {OWNER_PROXY, "Owner"}};
+SDO_MUTEX(proxiesLock);
 #endif // defined HTTPPROXY
 
+#ifndef DNS_CACHE_TTL
+/* Seconds a successful DNS resolution is reused, 0 disables the cache */
+#define DNS_CACHE_TTL 300
+#endif
+#ifndef DNS_NEG_CACHE_TTL
+/* Seconds a failed DNS resolution is remembered */
+#define DNS_NEG_CACHE_TTL 10
+#endif
+/* Manufacturer, rendezvous, owner and a proxy */
+#define DNS_CACHE_SIZE 4
+/* Longest domain name as per RFC 1035, incl. terminator */
+#define DNS_CACHE_MAX_DN 256
+
+/*
+ * DNS resolution cache, shared by DI, TO1 and TO2. It keeps the complete
+ * address list of a host, so that retries and the next protocol do not
+ * resolve the same name again. Failed look-ups are cached too (numOfIPs is
+ * 0), for a shorter time.
+ */
+typedef struct {
+	char *dn;
+	SDOIPAddress_t *ipList;
+	uint32_t numOfIPs;
+	uint64_t expiry; // in sdoTimeMs() units
+} dnsCacheEntry_t;
+
+static SDO_THREAD_LOCAL dnsCacheEntry_t dnsCache[DNS_CACHE_SIZE];
+
+/**
+ * Internal API: find the cache entry of a domain name.
+ */
+static dnsCacheEntry_t *dnsCacheFind(const char *dn)
+{
+	int i, res;
+
+	for (i = 0; i < DNS_CACHE_SIZE; i++) {
+		if (!dnsCache[i].dn)
+			continue;
+		if (strcmp_s(dnsCache[i].dn,
+			     strnlen_s(dnsCache[i].dn, DNS_CACHE_MAX_DN), dn,
+			     &res) == 0 &&
+		    res == 0)
+			return &dnsCache[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: release a cache entry.
+ */
+static void dnsCacheClear(dnsCacheEntry_t *entry)
+{
+	if (entry->dn)
+		sdoFree(entry->dn);
+	if (entry->ipList)
+		sdoFree(entry->ipList);
+	entry->numOfIPs = 0;
+	entry->expiry = 0;
+}
+
+/**
+ * Internal API: store the result of a DNS look-up in the cache. The oldest
+ * (or an expired) entry is replaced when the cache is full.
+ */
+static void dnsCacheStore(const char *dn, const SDOIPAddress_t *ipList,
+			  uint32_t numOfIPs, uint64_t now)
+{
+	dnsCacheEntry_t *entry = dnsCacheFind(dn);
+	size_t dnlen = strnlen_s(dn, DNS_CACHE_MAX_DN);
+	uint32_t ttl = numOfIPs ? DNS_CACHE_TTL : DNS_NEG_CACHE_TTL;
+	int i;
+
+	if (!entry) {
+		entry = &dnsCache[0];
+		for (i = 0; i < DNS_CACHE_SIZE; i++) {
+			if (dnsCache[i].expiry < entry->expiry)
+				entry = &dnsCache[i];
+		}
+	}
+	dnsCacheClear(entry);
+
+	entry->dn = sdoAlloc(dnlen + 1);
+	if (!entry->dn || strcpy_s(entry->dn, dnlen + 1, dn) != 0)
+		goto err;
+
+	if (numOfIPs) {
+		entry->ipList = sdoAlloc(numOfIPs * sizeof(SDOIPAddress_t));
+		if (!entry->ipList ||
+		    memcpy_s(entry->ipList, numOfIPs * sizeof(SDOIPAddress_t),
+			     ipList, numOfIPs * sizeof(SDOIPAddress_t)) != 0)
+			goto err;
+	}
+	entry->numOfIPs = numOfIPs;
+	entry->expiry = now + (uint64_t)ttl * 1000;
+	return;
+err:
+	LOG(LOG_ERROR, "DNS cache update failed\n");
+	dnsCacheClear(entry);
+}
+
+/**
+ * Resolve a domain name, using the DNS cache if possible. Has the same
+ * interface as sdoConDnsLookup(); a copy of the address list is returned
+ * which is to be freed by the caller.
+ *
+ * @param dn - domain name to resolve.
+ * @param ipList - out list of IP addresses.
+ * @param numOfIPs - out number of IP addresses in ipList.
+ * @return 0 on success, -1 on failure.
+ */
+static int32_t dnsLookupCached(const char *dn, SDOIPAddress_t **ipList,
+			       uint32_t *numOfIPs)
+{
+	dnsCacheEntry_t *entry;
+	uint64_t now;
+
+	if (!dn || !ipList || !numOfIPs)
+		return -1;
+
+	if (DNS_CACHE_TTL == 0)
+		return sdoConDnsLookup(dn, ipList, numOfIPs);
+
+	now = sdoTimeMs();
+	entry = dnsCacheFind(dn);
+
+	if (!entry || entry->expiry <= now) {
+		if (sdoConDnsLookup(dn, ipList, numOfIPs) == -1) {
+			dnsCacheStore(dn, NULL, 0, now);
+			return -1;
+		}
+		dnsCacheStore(dn, *ipList, *numOfIPs, now);
+		return 0;
+	}
+
+	if (!entry->numOfIPs) {
+		LOG(LOG_DEBUG, "DNS look-up of %s failed recently\n", dn);
+		return -1;
+	}
+
+	LOG(LOG_DEBUG, "Using cached DNS result for %s\n", dn);
+	*ipList = sdoAlloc(entry->numOfIPs * sizeof(SDOIPAddress_t));
+	if (!*ipList ||
+	    memcpy_s(*ipList, entry->numOfIPs * sizeof(SDOIPAddress_t),
+		     entry->ipList,
+		     entry->numOfIPs * sizeof(SDOIPAddress_t)) != 0) {
+		LOG(LOG_ERROR, "Memcpy failed\n");
+		if (*ipList)
+			sdoFree(*ipList);
+		return -1;
+	}
+	*numOfIPs = entry->numOfIPs;
+	return 0;
+}
+
+/**
+ * Drop the cached resolution of a domain name, for ex: when none of its
+ * addresses is reachable any more.
+ *
+ * @param dn - domain name.
+ */
+void sdoDnsCacheInvalidate(const char *dn)
+{
+	dnsCacheEntry_t *entry;
+
+	if (!dn)
+		return;
+
+	entry = dnsCacheFind(dn);
+	if (entry)
+		dnsCacheClear(entry);
+}
+
 /**
  * Internal API
  */
 bool is_rv_proxy_defined(void)
 {
 #if defined HTTPPROXY
-	if (rvproxy_port != 0)
+	if (proxyConf[PROXY_RV].port != 0)
 		return true;
 	LOG(LOG_DEBUG, "Proxy enabled but Not set\n");
 #endif // defined HTTPPROXY
@@ -53,7 +252,7 @@ bool is_rv_proxy_defined(void)
 bool is_mfg_proxy_defined(void)
 {
 #if defined HTTPPROXY
-	if (mfgproxy_port != 0)
+	if (proxyConf[PROXY_MFG].port != 0)
 		return true;
 	LOG(LOG_DEBUG, "Proxy enabled but Not set\n");
 #endif // defined HTTPPROXY
@@ -66,7 +265,7 @@ bool is_mfg_proxy_defined(void)
 bool is_owner_proxy_defined(void)
 {
 #if defined HTTPPROXY
-	if (ownerproxy_port != 0)
+	if (proxyConf[PROXY_OWNER].port != 0)
 		return true;
 	LOG(LOG_DEBUG, "Proxy enabled but Not set\n");
 #endif // defined HTTPPROXY
@@ -109,7 +308,7 @@ static bool get_netip_port(const char *proxydata, uint8_t proxydatsize,
 	}
 #if !defined(OPTEE_ADAPTATION)
 	// resolve dn proxy-chain.intel.com
-	if (sdoConDnsLookup(proxy_url, &ipList, &numOfIPs) == -1) {
+	if (dnsLookupCached(proxy_url, &ipList, &numOfIPs) == -1) {
 		LOG(LOG_ERROR, "DNS look-up failed!\n");
 		goto err;
 	}
@@ -277,46 +476,68 @@ err:
 	return true;
 }
 #endif
+#if defined HTTPPROXY
 /**
- * Initialize network related states and members.
+ * Internal API: modification time of a proxy file, 0 if it is not known.
  */
-void sdoNetInit(void)
+static int64_t proxyFileTime(const char *file)
 {
-#if defined HTTPPROXY
-	if (setup_http_proxy(MFG_PROXY, &mfgproxy_ip, &mfgproxy_port)) {
-		LOG(LOG_INFO, "Manufacturer HTTP proxy has been configured\n");
-	}
-#if defined(PROXY_DISCOVERY)
+#ifdef TARGET_OS_LINUX
+	char path[FILENAME_MAX];
+	const char *name = sdoStoragePath(file, path, sizeof(path));
+	struct stat st;
 
-	else {
-		if (discover_proxy(&mfgproxy_ip, &mfgproxy_port))
-			LOG(LOG_INFO, "Manufacturer HTTP proxy has been "
-				      "discovered & configured\n");
-	}
+	if (name && stat(name, &st) == 0)
+		return (int64_t)st.st_mtime;
+#else
+	(void)file;
 #endif
+	return 0;
+}
 
-	if (setup_http_proxy(RV_PROXY, &rvproxy_ip, &rvproxy_port)) {
-		LOG(LOG_INFO, "Rendezvous HTTP proxy has been configured\n");
+/**
+ * Internal API: set up a proxy from its file, or discover it, unless the
+ * file is the one it was set up from.
+ */
+static void proxyRefresh(proxyConf_t *conf)
+{
+	int32_t size = sdoBlobSize(conf->file, SDO_SDK_RAW_DATA);
+	int64_t mtime = proxyFileTime(conf->file);
+
+	if (conf->parsed && size == conf->size && mtime == conf->mtime)
+		return;
+
+	conf->size = size;
+	conf->mtime = mtime;
+	conf->port = 0;
+	if (setup_http_proxy(conf->file, &conf->ip, &conf->port)) {
+		LOG(LOG_INFO, "%s HTTP proxy has been configured\n",
+		    conf->name);
 	}
 #if defined(PROXY_DISCOVERY)
-	else {
-		if (discover_proxy(&rvproxy_ip, &rvproxy_port))
-			LOG(LOG_INFO, "Rendezvous HTTP proxy has been "
-				      "discovered & configured\n");
+	else if (discover_proxy(&conf->ip, &conf->port)) {
+		LOG(LOG_INFO,
+		    "%s HTTP proxy has been discovered & configured\n",
+		    conf->name);
 	}
 #endif
-
-	if (setup_http_proxy(OWNER_PROXY, &ownerproxy_ip, &ownerproxy_port)) {
-		LOG(LOG_INFO, "Owner HTTP proxy has been configured\n");
-	}
-#if defined(PROXY_DISCOVERY)
-	else {
-		if (discover_proxy(&ownerproxy_ip, &ownerproxy_port))
-			LOG(LOG_INFO, "Owner HTTP proxy has been discovered & "
-				      "configured\n");
-	}
+	/* a proxy file that did not resolve is tried again next run */
+	conf->parsed = conf->port != 0 || size <= 0;
+}
 #endif
 
+/**
+ * Initialize network related states and members.
+ */
+void sdoNetInit(void)
+{
+#if defined HTTPPROXY
+	int i;
+
+	SDO_LOCK(proxiesLock);
+	for (i = 0; i < PROXY_COUNT; i++)
+		proxyRefresh(&proxyConf[i]);
+	SDO_UNLOCK(proxiesLock);
 #endif
 }
 
@@ -365,23 +586,19 @@ bool ResolveDn(const char *dn, SDOIPAddress_t **ip, uint16_t port, void **ssl,
 		goto end;
 	}
 	// get list of IPs resolved to given DNS
-	if (sdoConDnsLookup(dn, &ipList, &numOfIPs) == -1) {
+	if (dnsLookupCached(dn, &ipList, &numOfIPs) == -1) {
 		LOG(LOG_ERROR, "DNS look-up failed!\n");
 		goto end;
 	}
 
 	if (ipList && numOfIPs > 0) {
-		// Iterate over IP-list to connect
+		// Race connects over IP-list, first reachable IP wins
 		uint32_t iter = 0;
-		while (iter != numOfIPs && sock == SDO_CON_INVALID_HANDLE) {
-			if (((sock =
-				  sdoConConnect((ipList + iter), port, ssl)) ==
-			     SDO_CON_INVALID_HANDLE)) {
-				LOG(LOG_ERROR, "Failed to connect to "
-					       "server: retrying...\n");
-			}
-			iter++;
-		}
+
+		sock = sdoConConnectRace(ipList, numOfIPs, port, NULL, ssl,
+					 &iter);
+		if (sock == SDO_CON_INVALID_HANDLE)
+			LOG(LOG_ERROR, "Failed to connect to server\n");
 
 		if (SDO_CON_INVALID_HANDLE != sock) {
 			sdoConDisconnect(sock, (ssl ? *ssl : NULL));
@@ -391,7 +608,7 @@ bool ResolveDn(const char *dn, SDOIPAddress_t **ip, uint16_t port, void **ssl,
 			}
 			*ip = sdoAlloc(sizeof(SDOIPAddress_t));
 			if (0 != memcpy_s(*ip, sizeof(SDOIPAddress_t),
-					  ipList + (iter - 1),
+					  ipList + iter,
 					  sizeof(SDOIPAddress_t))) {
 				LOG(LOG_ERROR, "Memcpy failed\n");
 				goto end;
@@ -399,6 +616,8 @@ bool ResolveDn(const char *dn, SDOIPAddress_t **ip, uint16_t port, void **ssl,
 			ret = true;
 			goto end;
 		} else {
+			/* resolve again next time, addresses may have moved */
+			sdoDnsCacheInvalidate(dn);
 			*ip = NULL;
 			goto end;
 		}
@@ -409,6 +628,108 @@ end:
 	return ret;
 }
 
+#ifndef RV_PROBE_MAX_IPS
+/* Addresses raced across all rendezvous entries */
+#define RV_PROBE_MAX_IPS 16
+#endif
+
+/**
+ * Probe all entries of the rendezvous list at once and find the first one
+ * that accepts a connection. Connects are raced over the addresses of all
+ * entries, in list order starting after the last used entry, so that
+ * unreachable entries do not cost a TO1 attempt each.
+ *
+ * @param rvlst - rendezvous list.
+ * @param rvIndex - 1-based index of the entry used last (0 if none).
+ * @return 1-based index of the reachable entry, 0 if none was reached or
+ * probing is not possible (for ex: behind a proxy).
+ */
+int sdoRendezvousProbe(SDORendezvousList_t *rvlst, int rvIndex)
+{
+	SDOIPAddress_t ips[RV_PROBE_MAX_IPS];
+	uint16_t ports[RV_PROBE_MAX_IPS];
+	int owner[RV_PROBE_MAX_IPS];
+	SDOIPAddress_t *ipList = NULL;
+	uint32_t numOfIPs = 0, num = 0, i, winner = 0;
+	SDORendezvous_t *rv;
+	sdoConHandle sock;
+	int n, idx, ret = 0;
+
+	if (!rvlst || rvlst->numEntries < 2 || is_rv_proxy_defined())
+		return 0;
+
+	for (n = 0; n < rvlst->numEntries && num < RV_PROBE_MAX_IPS; n++) {
+		idx = (rvIndex + n) % rvlst->numEntries; // 0-based
+		rv = sdoRendezvousListGet(rvlst, idx);
+		if (!rv || !rv->po)
+			continue;
+
+		if (rv->ip) {
+			ips[num] = *rv->ip;
+			ports[num] = *rv->po;
+			owner[num++] = idx + 1;
+			continue;
+		}
+		if (!rv->dn ||
+		    dnsLookupCached(rv->dn->bytes, &ipList, &numOfIPs) != 0)
+			continue;
+
+		for (i = 0; i < numOfIPs && num < RV_PROBE_MAX_IPS; i++) {
+			ips[num] = ipList[i];
+			ports[num] = *rv->po;
+			owner[num++] = idx + 1;
+		}
+		sdoFree(ipList);
+	}
+
+	if (!num)
+		return 0;
+
+	sock = sdoConConnectRace(ips, num, 0, ports, NULL, &winner);
+	if (sock != SDO_CON_INVALID_HANDLE) {
+		sdoConDisconnect(sock, NULL);
+		ret = owner[winner];
+		LOG(LOG_DEBUG, "Rendezvous entry %d is reachable\n", ret);
+	}
+	return ret;
+}
+
+#ifdef PROXY_TUNNEL
+/**
+ * Internal API: open an HTTP CONNECT tunnel through the proxy connected to,
+ * to the server the REST context is set up for. The tunnel lasts as long as
+ * the connection, which is kept open for the following messages of the
+ * protocol: the proxy is then asked once per connection instead of once per
+ * message. TLS servers are left to the proxy, as without a tunnel.
+ *
+ * @param sock: connection to the proxy, closed if no tunnel is opened.
+ * @return true if the connection is ready for the messages, else false.
+ */
+static bool proxyTunnelOpen(int *sock)
+{
+	RestCtx_t *rest = getRESTContext();
+	char ip_ascii[INET_ADDRSTRLEN];
+	const char *host;
+
+	if (!rest || rest->tls)
+		return true;
+
+	host = rest->hostDNS;
+	if (!host && rest->hostIP &&
+	    inet_ntop(AF_INET, rest->hostIP->addr, ip_ascii,
+		      sizeof(ip_ascii)))
+		host = ip_ascii;
+
+	if (host && sdoConProxyTunnel(*sock, host, rest->portno) == 0)
+		return true;
+
+	LOG(LOG_ERROR, "HTTP proxy tunnel not opened\n");
+	sdoConDisconnect(*sock, NULL);
+	*sock = SDO_CON_INVALID_HANDLE;
+	return false;
+}
+#endif
+
 /**
  * Connects device to manufacturer or cred tool. Connection info should be
  * programmed into device by the manufacturer.
@@ -425,7 +746,7 @@ bool ConnectToManufacturer(SDOIPAddress_t *ip, uint16_t port, int *sock,
 			   void **ssl)
 {
 	bool ret = false;
-	int retries = MANUFACTURER_CONNECT_RETRIES;
+	uint32_t attempt = 0;
 
 	LOG(LOG_DEBUG, "Connecting to manufacturer Server\n");
 
@@ -450,23 +771,23 @@ bool ConnectToManufacturer(SDOIPAddress_t *ip, uint16_t port, int *sock,
 
 	if (is_mfg_proxy_defined()) {
 #if defined HTTPPROXY
-		ip = &mfgproxy_ip;
-		port = mfgproxy_port;
+		ip = &proxyConf[PROXY_MFG].ip;
+		port = proxyConf[PROXY_MFG].port;
 
-		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n",
-		    mfgproxy_ip.addr[0], mfgproxy_ip.addr[1],
-		    mfgproxy_ip.addr[2], mfgproxy_ip.addr[3], mfgproxy_port);
+		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n", ip->addr[0],
+		    ip->addr[1], ip->addr[2], ip->addr[3], port);
 #endif
 	}
 
 	if (ip && ip->length > 0) {
 		LOG(LOG_DEBUG, "using IP\n");
-		if (((*sock = (int)sdoConConnect(ip, port, ssl)) ==
-		     SDO_CON_INVALID_HANDLE) &&
-		    retries--) {
+		while (((*sock = (int)sdoConConnect(ip, port, ssl)) ==
+			SDO_CON_INVALID_HANDLE) &&
+		       attempt < sdoRetryMaxRetries()) {
 			LOG(LOG_INFO, "Failed to connect to Manufacturer "
 				      "server: retrying...\n");
-			sdoSleep(RETRY_DELAY);
+			if (!sdoRetryBackoff(attempt++))
+				break;
 		}
 	} else {
 		LOG(LOG_ERROR,
@@ -479,6 +800,10 @@ bool ConnectToManufacturer(SDOIPAddress_t *ip, uint16_t port, int *sock,
 		    "Failed to connect to Manufacturer server: Giving up...\n");
 		goto end;
 	}
+#ifdef PROXY_TUNNEL
+	if (is_mfg_proxy_defined() && !proxyTunnelOpen(sock))
+		goto end;
+#endif
 	ret = true;
 
 end:
@@ -500,7 +825,7 @@ bool ConnectToRendezvous(SDOIPAddress_t *ip, uint16_t port, int *sock,
 			 void **ssl)
 {
 	bool ret = false;
-	int retries = RENDEZVOUS_CONNECT_RETRIES;
+	uint32_t attempt = 0;
 
 	LOG(LOG_DEBUG, "Connecting to Rendezvous server\n");
 
@@ -531,27 +856,27 @@ bool ConnectToRendezvous(SDOIPAddress_t *ip, uint16_t port, int *sock,
 
 	if (is_rv_proxy_defined()) {
 #if defined HTTPPROXY
-		ip = &rvproxy_ip;
-		port = rvproxy_port;
+		ip = &proxyConf[PROXY_RV].ip;
+		port = proxyConf[PROXY_RV].port;
 		// When connecting through proxy, the proxy server will
 		// establish tls connection. Device opens a normal connection to
 		// Proxy server
 		ssl = NULL;
 
-		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n",
-		    rvproxy_ip.addr[0], rvproxy_ip.addr[1], rvproxy_ip.addr[2],
-		    rvproxy_ip.addr[3], rvproxy_port);
+		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n", ip->addr[0],
+		    ip->addr[1], ip->addr[2], ip->addr[3], port);
 #endif
 	}
 
 	if (ip && ip->length > 0) {
 		LOG(LOG_DEBUG, "using IP\n");
-		if (((*sock = sdoConConnect(ip, port, ssl)) ==
-		     SDO_CON_INVALID_HANDLE) &&
-		    retries--) {
+		while (((*sock = sdoConConnect(ip, port, ssl)) ==
+			SDO_CON_INVALID_HANDLE) &&
+		       attempt < sdoRetryMaxRetries()) {
 			LOG(LOG_INFO, "Failed to connect to Rendezvous server: "
 				      "retrying...\n");
-			sdoSleep(RETRY_DELAY);
+			if (!sdoRetryBackoff(attempt++))
+				break;
 		}
 	} else {
 		LOG(LOG_ERROR,
@@ -564,6 +889,10 @@ bool ConnectToRendezvous(SDOIPAddress_t *ip, uint16_t port, int *sock,
 		    "Failed to connect to rendezvous: Giving up...\n");
 		goto end;
 	}
+#ifdef PROXY_TUNNEL
+	if (is_rv_proxy_defined() && !proxyTunnelOpen(sock))
+		goto end;
+#endif
 	ret = true;
 
 end:
@@ -585,7 +914,7 @@ end:
 bool ConnectToOwner(SDOIPAddress_t *ip, uint16_t port, int *sock, void **ssl)
 {
 	bool ret = false;
-	int retries = OWNER_CONNECT_RETRIES;
+	uint32_t attempt = 0;
 
 	LOG(LOG_DEBUG, "Connecting to owner server\n");
 
@@ -610,24 +939,23 @@ bool ConnectToOwner(SDOIPAddress_t *ip, uint16_t port, int *sock, void **ssl)
 
 	if (is_owner_proxy_defined()) {
 #if defined HTTPPROXY
-		ip = &ownerproxy_ip;
-		port = ownerproxy_port;
+		ip = &proxyConf[PROXY_OWNER].ip;
+		port = proxyConf[PROXY_OWNER].port;
 
-		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n",
-		    ownerproxy_ip.addr[0], ownerproxy_ip.addr[1],
-		    ownerproxy_ip.addr[2], ownerproxy_ip.addr[3],
-		    ownerproxy_port);
+		LOG(LOG_DEBUG, "via HTTP proxy <%u.%u.%u.%u:%u>\n", ip->addr[0],
+		    ip->addr[1], ip->addr[2], ip->addr[3], port);
 #endif
 	}
 
 	if (ip && ip->length > 0) {
 		LOG(LOG_DEBUG, "using IP\n");
-		if (((*sock = sdoConConnect(ip, port, ssl)) ==
-		     SDO_CON_INVALID_HANDLE) &&
-		    retries--) {
+		while (((*sock = sdoConConnect(ip, port, ssl)) ==
+			SDO_CON_INVALID_HANDLE) &&
+		       attempt < sdoRetryMaxRetries()) {
 			LOG(LOG_INFO,
 			    "Failed to connect to Owner server: retrying...\n");
-			sdoSleep(RETRY_DELAY);
+			if (!sdoRetryBackoff(attempt++))
+				break;
 		}
 	} else {
 		LOG(LOG_ERROR, "Invalid Connection info for Owner server!\n");
@@ -638,12 +966,203 @@ bool ConnectToOwner(SDOIPAddress_t *ip, uint16_t port, int *sock, void **ssl)
 		LOG(LOG_ERROR, "Failed to connect to Owner: Giving up...\n");
 		goto end;
 	}
+#ifdef PROXY_TUNNEL
+	if (is_owner_proxy_defined() && !proxyTunnelOpen(sock))
+		goto end;
+#endif
 	ret = true;
 
 end:
 	return ret;
 }
 
+#ifdef OWNER_PRECONNECT_WORKER
+/*
+ * Connection to the owner, made while TO1 finishes and TO2 gets ready: the
+ * owner is resolved and connected to on a thread of its own from the time
+ * msg33 read the redirect address, and TO2 takes the connection over
+ * rather than making one. A connection not taken is closed.
+ */
+typedef struct {
+	pthread_t thread;
+	bool started;
+	char *dn;	  // owner domain name, NULL if known by IP
+	SDOIPAddress_t ip; // owner IP address, if dn is NULL
+	uint16_t port;
+	/* results of the thread, valid once it is joined */
+	SDOIPAddress_t *ipList;
+	uint32_t numOfIPs;
+	uint32_t index;
+	sdoConHandle sock;
+} ownerPreconnect_t;
+
+static SDO_THREAD_LOCAL ownerPreconnect_t preconnect;
+
+static void *ownerPreconnectRun(void *arg)
+{
+	ownerPreconnect_t *p = arg;
+
+	if (p->dn &&
+	    sdoConDnsLookup(p->dn, &p->ipList, &p->numOfIPs) == -1)
+		return NULL;
+	p->sock = sdoConConnectRace(p->dn ? p->ipList : &p->ip,
+				    p->dn ? p->numOfIPs : 1, p->port, NULL,
+				    NULL, &p->index);
+	return NULL;
+}
+
+/**
+ * Internal API: release what the thread left, once it is joined.
+ */
+static void ownerPreconnectRelease(ownerPreconnect_t *p)
+{
+	if (p->sock != SDO_CON_INVALID_HANDLE)
+		sdoConDisconnect(p->sock, NULL);
+	p->sock = SDO_CON_INVALID_HANDLE;
+	if (p->ipList)
+		sdoFree(p->ipList);
+	if (p->dn)
+		sdoFree(p->dn);
+	p->numOfIPs = 0;
+}
+
+/**
+ * Close the early connection to the owner, if it was not taken over.
+ */
+void sdoOwnerPreconnectDrop(void)
+{
+	ownerPreconnect_t *p = &preconnect;
+
+	if (!p->started)
+		return;
+	pthread_join(p->thread, NULL);
+	p->started = false;
+	ownerPreconnectRelease(p);
+}
+
+/**
+ * Start connecting to the owner the device is redirected to, for TO2 to
+ * take over with sdoOwnerPreconnectTake(). Nothing is done if the owner is
+ * reached through a proxy.
+ *
+ * @param dn - domain name of the owner, NULL if it is known by IP.
+ * @param ip - IP address of the owner, used if dn is NULL.
+ * @param port - port of the owner.
+ */
+void sdoOwnerPreconnect(const char *dn, const SDOIPAddress_t *ip,
+			uint16_t port)
+{
+	ownerPreconnect_t *p = &preconnect;
+	size_t dnlen;
+
+	sdoOwnerPreconnectDrop();
+	if (!port || (!dn && (!ip || !ip->length)) ||
+	    is_owner_proxy_defined())
+		return;
+
+	p->sock = SDO_CON_INVALID_HANDLE;
+	p->port = port;
+	if (dn) {
+		dnlen = strnlen_s(dn, DNS_CACHE_MAX_DN);
+		p->dn = sdoAlloc(dnlen + 1);
+		if (!p->dn || strcpy_s(p->dn, dnlen + 1, dn) != 0)
+			goto err;
+	} else if (memcpy_s(&p->ip, sizeof(p->ip), ip, sizeof(*ip)) != 0) {
+		goto err;
+	}
+
+	if (pthread_create(&p->thread, NULL, ownerPreconnectRun, p) != 0)
+		goto err;
+	p->started = true;
+	LOG(LOG_DEBUG, "Connecting to the owner early\n");
+	return;
+err:
+	ownerPreconnectRelease(p);
+}
+
+/**
+ * Take over the early connection to the owner, if it is to the server of
+ * the protocol context and succeeded. The connection is cached to REST as
+ * ResolveDn() and ConnectToOwner() would.
+ *
+ * @param prot_ctx - protocol context of TO2.
+ * @return true if prot_ctx->sock is the connection, false if TO2 is to
+ * connect on its own.
+ */
+bool sdoOwnerPreconnectTake(SDOProtCtx_t *prot_ctx)
+{
+	ownerPreconnect_t *p = &preconnect;
+	SDOIPAddress_t *ip;
+	bool same, taken = false;
+	int res = 1;
+
+	if (!p->started)
+		return false;
+	pthread_join(p->thread, NULL);
+	p->started = false;
+
+	if (p->dn && prot_ctx->host_dns)
+		same = strcmp_s(p->dn, DNS_CACHE_MAX_DN, prot_ctx->host_dns,
+				&res) == 0 &&
+		       res == 0;
+	else
+		same = !p->dn && !prot_ctx->host_dns && prot_ctx->host_ip &&
+		       p->ip.length == prot_ctx->host_ip->length &&
+		       memcmp(p->ip.addr, prot_ctx->host_ip->addr,
+			      p->ip.length) == 0;
+	same = same && p->port == prot_ctx->host_port;
+	if (!same || p->sock == SDO_CON_INVALID_HANDLE)
+		goto drop;
+
+	ip = p->dn ? &p->ipList[p->index] : &p->ip;
+	if (p->dn) {
+		/* the next look-ups of the owner need not wait either */
+		if (DNS_CACHE_TTL)
+			dnsCacheStore(p->dn, p->ipList, p->numOfIPs,
+				      sdoTimeMs());
+		if (!cacheHostDns(p->dn))
+			goto drop;
+		if (prot_ctx->resolved_ip)
+			sdoFree(prot_ctx->resolved_ip);
+		prot_ctx->resolved_ip = sdoAlloc(sizeof(SDOIPAddress_t));
+		if (!prot_ctx->resolved_ip ||
+		    memcpy_s(prot_ctx->resolved_ip, sizeof(SDOIPAddress_t), ip,
+			     sizeof(*ip)) != 0)
+			goto drop;
+		prot_ctx->host_ip = prot_ctx->resolved_ip;
+	}
+	if (!cacheHostIP(ip) || !cacheHostPort(p->port))
+		goto drop;
+
+	LOG(LOG_DEBUG, "Using the early connection to the owner\n");
+	prot_ctx->sock = p->sock;
+	p->sock = SDO_CON_INVALID_HANDLE;
+	taken = true;
+drop:
+	ownerPreconnectRelease(p);
+	return taken;
+}
+
+#else
+void sdoOwnerPreconnect(const char *dn, const SDOIPAddress_t *ip,
+			uint16_t port)
+{
+	(void)dn;
+	(void)ip;
+	(void)port;
+}
+
+bool sdoOwnerPreconnectTake(SDOProtCtx_t *prot_ctx)
+{
+	(void)prot_ctx;
+	return false;
+}
+
+void sdoOwnerPreconnectDrop(void)
+{
+}
+#endif /* OWNER_PRECONNECT_WORKER */
+
 /**
  * Try reconnecting to server when connection is lost.
  *
@@ -655,15 +1174,21 @@ end:
  */
 int sdoConnectionRestablish(SDOProtCtx_t *prot_ctx)
 {
-	int retries = OWNER_CONNECT_RETRIES;
+	uint32_t attempt = 0;
 
 	/* re-connect using server-IP */
-	while (((prot_ctx->sock =
-		     sdoConConnect(prot_ctx->host_ip, prot_ctx->host_port,
-				   prot_ctx->ssl)) == SDO_CON_INVALID_HANDLE) &&
-	       retries--) {
+	for (;;) {
+		if (!sdoRetryBackoff(attempt)) {
+			prot_ctx->sock = SDO_CON_INVALID_HANDLE;
+			break;
+		}
+		prot_ctx->sock =
+		    sdoConConnect(prot_ctx->host_ip, prot_ctx->host_port,
+				  (prot_ctx->tls ? &prot_ctx->ssl : NULL));
+		if (prot_ctx->sock != SDO_CON_INVALID_HANDLE ||
+		    attempt++ >= sdoRetryMaxRetries())
+			break;
 		LOG(LOG_INFO, "Failed reconnecting to server: retrying...");
-		sdoSleep(RETRY_DELAY);
 	}
 
 	if (prot_ctx->sock == SDO_CON_INVALID_HANDLE) {
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Cache of the owner service infos applied, across TO2 retries.
+ *
+ * A TO2 run failing after msg49 is retried from its start, and the owner
+ * sends all its OSIs again. A module taking SDO_SI_OSI_ONCE is not handed
+ * those it already applied, that is the same module, message and value its
+ * callback succeeded for, in an earlier run for the same GUID. Those it
+ * applied in the run going on are handed again, as the owner may send a
+ * pair twice. The pairs are kept as digests, truncated SHA-256 of the
+ * module name, message and value, in the instance, written to its storage
+ * as msg49s are read so that a restart of the device between runs does not
+ * lose them, and forgotten once TO2 completes. The modules give their OSI
+ * indexes as before, skipped pairs included.
+ */
+
+#include "util.h"
+#include "sdoosicache.h"
+#include "sdoCryptoHal.h"
+#include "storage_al.h"
+#include "safe_lib.h"
+
+#if defined(TARGET_OS_LINUX) && !defined(OSI_ASYNC_FALSE)
+/* pairs are added by the OSI workers of the modules, see sdoOsiQueue */
+#include <pthread.h>
+static pthread_mutex_t osiCacheLock = PTHREAD_MUTEX_INITIALIZER;
+#define OSI_CACHE_LOCK() pthread_mutex_lock(&osiCacheLock)
+#define OSI_CACHE_UNLOCK() pthread_mutex_unlock(&osiCacheLock)
+#else
+#define OSI_CACHE_LOCK()
+#define OSI_CACHE_UNLOCK()
+#endif
+
+#define OSI_CACHE_VERSION 1
+/* version and GUID, followed by the digests */
+#define OSI_CACHE_HDR_LEN (1 + OSI_CACHE_GUID_LEN)
+
+/**
+ * Internal API: the digest of an OSI pair of a module.
+ * @return true on success.
+ */
+static bool osiCacheDigest(const char *modName, const sdoSdkSiKeyValue *kv,
+			   uint8_t *digest)
+{
+	uint8_t hash[SHA256_DIGEST_SIZE];
+	void *ctx = NULL;
+	bool ret = false;
+
+	if (!modName || !kv || !kv->key || !kv->value)
+		return false;
+	if (sdoCryptoHashInit(SDO_CRYPTO_HASH_TYPE_SHA_256, &ctx) != 0)
+		return false;
+	/* the terminators keep the fields apart */
+	if (sdoCryptoHashUpdate(ctx, (const uint8_t *)modName,
+				strnlen_s(modName, SDO_MODULE_NAME_LEN) + 1) !=
+		0 ||
+	    sdoCryptoHashUpdate(ctx, (const uint8_t *)kv->key,
+				strnlen_s(kv->key, SDO_MODULE_MSG_LEN) + 1) !=
+		0 ||
+	    sdoCryptoHashUpdate(ctx, (const uint8_t *)kv->value,
+				kv->length) != 0) {
+		(void)sdoCryptoHashFinal(&ctx, NULL, 0);
+		return false;
+	}
+	if (sdoCryptoHashFinal(&ctx, hash, sizeof(hash)) == 0 &&
+	    memcpy_s(digest, OSI_CACHE_DIGEST_LEN, hash,
+		     OSI_CACHE_DIGEST_LEN) == 0)
+		ret = true;
+	return ret;
+}
+
+/**
+ * Internal API: the index of a digest among the first n of the cache, -1
+ * if not in them.
+ */
+static int osiCacheFind(const sdoOsiCache_t *cache, size_t n,
+			const uint8_t *digest)
+{
+	size_t i;
+	int diff;
+
+	for (i = 0; i < n; i++) {
+		if (memcmp_s(cache->digest[i], OSI_CACHE_DIGEST_LEN, digest,
+			     OSI_CACHE_DIGEST_LEN, &diff) == 0 &&
+		    diff == 0)
+			return (int)i;
+	}
+	return -1;
+}
+
+/**
+ * Start a TO2 run: keep the pairs applied in earlier runs for the same
+ * GUID, in memory or in storage, and drop those of another GUID.
+ * @param cache - cache of the instance.
+ * @param guid - GUID of the device the run is for.
+ */
+void sdoOsiCacheOpen(sdoOsiCache_t *cache, const SDOByteArray_t *guid)
+{
+	int diff = 1;
+#ifdef OSI_APPLIED_BLOB
+	uint8_t *rec = NULL;
+	int32_t size;
+#endif
+
+	if (!cache || !guid || guid->byteSz != OSI_CACHE_GUID_LEN)
+		return;
+
+	OSI_CACHE_LOCK();
+	if (cache->count &&
+	    memcmp_s(cache->guid, sizeof(cache->guid), guid->bytes,
+		     guid->byteSz, &diff) == 0 &&
+	    diff == 0)
+		goto end;
+
+	cache->count = 0;
+	cache->saved = 0;
+	if (memcpy_s(cache->guid, sizeof(cache->guid), guid->bytes,
+		     guid->byteSz) != 0)
+		goto end;
+#ifdef OSI_APPLIED_BLOB
+	size = sdoBlobSize((char *)OSI_APPLIED_BLOB, SDO_SDK_NORMAL_DATA);
+	if (size <= OSI_CACHE_HDR_LEN ||
+	    (size - OSI_CACHE_HDR_LEN) % OSI_CACHE_DIGEST_LEN ||
+	    (size - OSI_CACHE_HDR_LEN) / OSI_CACHE_DIGEST_LEN > OSI_CACHE_MAX)
+		goto end;
+	rec = sdoAlloc(size);
+	if (!rec)
+		goto end;
+	if (sdoBlobRead((char *)OSI_APPLIED_BLOB, SDO_SDK_NORMAL_DATA, rec,
+			size) != size ||
+	    rec[0] != OSI_CACHE_VERSION ||
+	    memcmp_s(&rec[1], OSI_CACHE_GUID_LEN, guid->bytes, guid->byteSz,
+		     &diff) != 0 ||
+	    diff != 0)
+		goto end;
+	if (memcpy_s(cache->digest, sizeof(cache->digest),
+		     &rec[OSI_CACHE_HDR_LEN], size - OSI_CACHE_HDR_LEN) != 0)
+		goto end;
+	cache->count = (size - OSI_CACHE_HDR_LEN) / OSI_CACHE_DIGEST_LEN;
+	cache->saved = cache->count;
+	LOG(LOG_DEBUG, "%u OSIs applied in earlier TO2 runs\n",
+	    (unsigned)cache->count);
+#endif
+end:
+	/* all the pairs so far are of earlier runs */
+	cache->prior = cache->count;
+	OSI_CACHE_UNLOCK();
+#ifdef OSI_APPLIED_BLOB
+	if (rec)
+		sdoFree(rec);
+#endif
+}
+
+/**
+ * Tell if a module applied an OSI pair in an earlier run.
+ * @param cache - cache of the instance, NULL for none.
+ * @param modName - name of the module.
+ * @param kv - module message, and value in the input buffer.
+ * @return true if it did, and the pair is to be skipped.
+ */
+bool sdoOsiCacheApplied(sdoOsiCache_t *cache, const char *modName,
+			const sdoSdkSiKeyValue *kv)
+{
+	uint8_t digest[OSI_CACHE_DIGEST_LEN];
+	bool ret;
+
+	if (!cache || !osiCacheDigest(modName, kv, digest))
+		return false;
+	OSI_CACHE_LOCK();
+	ret = osiCacheFind(cache, cache->prior, digest) >= 0;
+	OSI_CACHE_UNLOCK();
+	return ret;
+}
+
+/**
+ * Record that a module applied an OSI pair, its callback succeeded.
+ * @param cache - cache of the instance, NULL for none.
+ * @param modName - name of the module.
+ * @param kv - module message, and value.
+ */
+void sdoOsiCacheAdd(sdoOsiCache_t *cache, const char *modName,
+		    const sdoSdkSiKeyValue *kv)
+{
+	uint8_t digest[OSI_CACHE_DIGEST_LEN];
+
+	if (!cache || !osiCacheDigest(modName, kv, digest))
+		return;
+	OSI_CACHE_LOCK();
+	if (cache->count < OSI_CACHE_MAX &&
+	    osiCacheFind(cache, cache->count, digest) < 0 &&
+	    memcpy_s(cache->digest[cache->count], OSI_CACHE_DIGEST_LEN,
+		     digest, sizeof(digest)) == 0)
+		cache->count++;
+	OSI_CACHE_UNLOCK();
+}
+
+/**
+ * Write the pairs recorded since the last flush to the storage of the
+ * instance, after a msg49 is read.
+ * @param cache - cache of the instance, NULL for none.
+ */
+void sdoOsiCacheFlush(sdoOsiCache_t *cache)
+{
+#ifdef OSI_APPLIED_BLOB
+	uint8_t *rec;
+	size_t len;
+
+	if (!cache)
+		return;
+	OSI_CACHE_LOCK();
+	if (cache->count == cache->saved)
+		goto end;
+	len = OSI_CACHE_HDR_LEN + cache->count * OSI_CACHE_DIGEST_LEN;
+	rec = sdoAlloc(len);
+	if (!rec)
+		goto end;
+	rec[0] = OSI_CACHE_VERSION;
+	if (memcpy_s(&rec[1], OSI_CACHE_GUID_LEN, cache->guid,
+		     sizeof(cache->guid)) == 0 &&
+	    memcpy_s(&rec[OSI_CACHE_HDR_LEN], len - OSI_CACHE_HDR_LEN,
+		     cache->digest, len - OSI_CACHE_HDR_LEN) == 0 &&
+	    sdoBlobWrite((char *)OSI_APPLIED_BLOB, SDO_SDK_NORMAL_DATA, rec,
+			 len) == (int32_t)len)
+		cache->saved = cache->count;
+	else
+		LOG(LOG_ERROR, "Saving the OSIs applied failed\n");
+	sdoFree(rec);
+end:
+	OSI_CACHE_UNLOCK();
+#else
+	(void)cache;
+#endif
+}
+
+/**
+ * End a TO2 run, once no OSI is being applied anymore.
+ * @param cache - cache of the instance.
+ * @param done - true if TO2 completed, and the pairs are to be forgotten.
+ */
+void sdoOsiCacheClose(sdoOsiCache_t *cache, bool done)
+{
+	if (!cache)
+		return;
+	if (!done) {
+		sdoOsiCacheFlush(cache);
+		return;
+	}
+
+	OSI_CACHE_LOCK();
+	cache->count = 0;
+	cache->prior = 0;
+#ifdef OSI_APPLIED_BLOB
+	/* A record of no version is no pair */
+	if (cache->saved) {
+		static const uint8_t none[OSI_CACHE_HDR_LEN] = {0};
+
+		if (sdoBlobWrite((char *)OSI_APPLIED_BLOB, SDO_SDK_NORMAL_DATA,
+				 none, sizeof(none)) != (int32_t)sizeof(none))
+			LOG(LOG_ERROR, "Dropping the OSIs applied failed\n");
+	}
+#endif
+	cache->saved = 0;
+	OSI_CACHE_UNLOCK();
+}
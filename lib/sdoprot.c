@@ -13,6 +13,7 @@
 #include "util.h"
 #include "sdoprot.h"
 #include "load_credentials.h"
+#include "sdotrace.h"
 #include <stdio.h>
 #include <inttypes.h>
 #include <stdlib.h>
@@ -92,10 +93,6 @@ static void ps_free(SDOProt_t *ps)
 		sdoByteArrayFree(ps->n5);
 		ps->n5 = NULL;
 	}
-	if (ps->n5r) {
-		sdoByteArrayFree(ps->n5r);
-		ps->n5r = NULL;
-	}
 	if (ps->newOVHdrHMAC) {
 		sdoHashFree(ps->newOVHdrHMAC);
 		ps->newOVHdrHMAC = NULL;
@@ -104,10 +101,6 @@ static void ps_free(SDOProt_t *ps)
 		sdoByteArrayFree(ps->n6);
 		ps->n6 = NULL;
 	}
-	if (ps->n7r) {
-		sdoByteArrayFree(ps->n7r);
-		ps->n7r = NULL;
-	}
 }
 
 /**
@@ -140,6 +133,7 @@ bool sdo_process_states(SDOProt_t *ps)
 {
 	bool status = false;
 	int prevState = 0;
+	int fnRet;
 	state_func state_fn = NULL;
 
 	for (;;) {
@@ -199,7 +193,13 @@ bool sdo_process_states(SDOProt_t *ps)
 		if (!state_fn)
 			break;
 
-		if (state_fn && state_fn(ps)) {
+		SDO_TRACE_START(traceStart);
+		fnRet = state_fn(ps);
+		SDO_TRACE_END("state", "msg", prevState, traceStart);
+		/* Transient objects do not outlive the message */
+		sdoArenaReset();
+
+		if (fnRet) {
 			char err_msg[64];
 
 			(void)snprintf_s_i(err_msg, sizeof(err_msg),
@@ -274,6 +274,7 @@ bool sdoProtTO2Init(SDOProt_t *ps, SDOServiceInfo_t *si, SDODevCred_t *devCred,
 	ps->keyEncoding = SDO_OWNER_ATTEST_PK_ENC;
 
 	ps->success = false;
+	ps->redirectOk = false;
 	ps->serviceInfo = si;
 	ps->devCred = devCred;
 	ps->g2 = devCred->ownerBlk->guid;
@@ -17,13 +17,71 @@
 #include "sdoprot.h"
 #include "sdoprotctx.h"
 #include "sdonet.h"
+#include "sdoretry.h"
+#include "sdostats.h"
+#include "sdoendpoint.h"
 #include "network_al.h"
+#include "rest_interface.h"
 #include <stdlib.h>
+#include <limits.h>
 #include "load_credentials.h"
 #include "safe_lib.h"
 #include "snprintf_s.h"
+#include "sdoCryptoApi.h"
 
-#define CONNECTION_RETRY 2
+/* Time budget of a protocol run in seconds, 0 means no budget */
+#ifndef PROT_PHASE_TIMEOUT_SEC
+#define PROT_PHASE_TIMEOUT_SEC 0
+#endif
+
+/* Of the process, for the runs of all instances, see sdoSdkSetTimeouts */
+static uint32_t phaseTimeoutSec = PROT_PHASE_TIMEOUT_SEC;
+
+/* End of the time left to the run of the thread, 0 for none */
+static SDO_THREAD_LOCAL uint64_t runDeadline;
+
+/* Time a step-wise run waits for the connection to become ready */
+#ifndef PROT_IO_TIMEOUT_MS
+#define PROT_IO_TIMEOUT_MS 60000
+#endif
+
+/* Of the process, as phaseTimeoutSec */
+static uint32_t ioTimeoutMs = PROT_IO_TIMEOUT_MS;
+
+/* Wire encoding of the messages of a new protocol context */
+#ifdef WIRE_CBOR_ENABLED
+#define PROT_WIRE_ENCODING SDO_ENCODING_CBOR
+#else
+#define PROT_WIRE_ENCODING SDO_ENCODING_JSON
+#endif
+
+/* Largest receive buffer kept between protocol runs */
+#ifndef PROT_RX_RETAIN_MAX
+#define PROT_RX_RETAIN_MAX SDO_BLOCK_RETAIN_MAX
+#endif
+
+/*
+ * Receive buffer of the last protocol run. The next run takes it over, so
+ * that responses are received into an already grown buffer.
+ */
+static SDO_THREAD_LOCAL struct {
+	uint8_t *block;
+	int blockMax;
+} rxRetained;
+
+/* Observer of the message exchanges, of the process: one for all the
+ * instances, see sdoSdkSetMsgCallback */
+static sdoSdkMsgCB msgCallback;
+
+/* States of a step-wise protocol run */
+enum {
+	SDO_PROT_STEP_IDLE = 0,
+	SDO_PROT_STEP_RUN,      // run protocol, to produce the next message
+	SDO_PROT_STEP_CONNECT,  // connect, unless the connection is kept open
+	SDO_PROT_STEP_SEND,     // send the message
+	SDO_PROT_STEP_RECV_HDR, // receive REST header of the response
+	SDO_PROT_STEP_RECV_BODY // receive body of the response
+};
 
 /**
  * sdoProtCtxAlloc responsible for allocation of required protocol context.
@@ -61,9 +119,333 @@ SDOProtCtx_t *sdoProtCtxAlloc(bool (*protrun)(), SDOProt_t *protdata,
 
 	prot_ctx->host_port = host_port;
 	prot_ctx->tls = tls;
+	prot_ctx->encoding = PROT_WIRE_ENCODING;
+	prot_ctx->sock = SDO_CON_INVALID_HANDLE;
 	return prot_ctx;
 }
 
+/**
+ * Set the wire encoding of the messages of a protocol context, before it
+ * is run. Contexts are allocated with the encoding of the build.
+ *
+ * @param prot_ctx - protocol context.
+ * @param encoding - SDO_ENCODING_JSON or SDO_ENCODING_CBOR.
+ */
+void sdoProtCtxSetEncoding(SDOProtCtx_t *prot_ctx, uint8_t encoding)
+{
+	if (prot_ctx)
+		prot_ctx->encoding = encoding;
+}
+
+#ifdef TO2_RESUME
+/**
+ * Internal API: keep the Authorization of the owner past the REST context
+ * of a TO2 run that failed, the session being resumed on a new one.
+ */
+static void sdoProtCtxKeepAuth(SDOProtCtx_t *prot_ctx, bool success)
+{
+	SDOProt_t *ps = prot_ctx->protdata;
+	RestCtx_t *rest = getRESTContext();
+	size_t len;
+
+	if (ps->resumeAuth) {
+		sdoFree(ps->resumeAuth);
+		ps->resumeAuth = NULL;
+	}
+	if (success || !rest || prot_ctx->firstMsg < SDO_TO2_HELLO_DEVICE)
+		return;
+
+	len = strnlen_s(rest->authorization, REST_MAX_TOKEN_SIZE);
+	if (!len || len >= REST_MAX_TOKEN_SIZE)
+		return;
+	ps->resumeAuth = sdoAlloc(len + 1);
+	if (ps->resumeAuth &&
+	    strcpy_s(ps->resumeAuth, len + 1, rest->authorization) != 0) {
+		sdoFree(ps->resumeAuth);
+		ps->resumeAuth = NULL;
+	}
+}
+
+/**
+ * Internal API: give the REST context of a resumed TO2 run the
+ * Authorization of the session, its message going out as it was encoded.
+ * @return 0 on success, -1 on error.
+ */
+static int sdoProtCtxResumeAuth(SDOProtCtx_t *prot_ctx)
+{
+	SDOProt_t *ps = prot_ctx->protdata;
+	RestCtx_t *rest = getRESTContext();
+
+	if (!ps->resume)
+		return 0;
+	if (!rest || !ps->resumeAuth ||
+	    strcpy_s(rest->authorization, sizeof(rest->authorization),
+		     ps->resumeAuth) != 0) {
+		LOG(LOG_ERROR, "TO2 session not resumed\n");
+		return -1;
+	}
+	prot_ctx->encoding = ps->sdow.encoding;
+	return 0;
+}
+#endif
+
+/**
+ * Internal API: set up the connection layer for a run, the messages in
+ * the encoding of the context.
+ * @return 0 on success, -1 on error.
+ */
+static int sdoProtCtxSetup(SDOProtCtx_t *prot_ctx)
+{
+	if (sdoConSetup(NULL, NULL, 0)) {
+		LOG(LOG_ERROR, "Connection setup failed!\n");
+		return -1;
+	}
+#ifdef TO2_RESUME
+	if (sdoProtCtxResumeAuth(prot_ctx))
+		return -1;
+#endif
+	if (prot_ctx->encoding == SDO_ENCODING_CBOR && !cacheCBOREncoding())
+		return -1;
+
+	prot_ctx->protdata->sdor.encoding = prot_ctx->encoding;
+	prot_ctx->protdata->sdow.encoding = prot_ctx->encoding;
+	prot_ctx->runStart = sdoTimeMs();
+	sdoAllocPhaseBegin();
+	prot_ctx->firstMsg = 0;
+	prot_ctx->parseMsg = 0;
+	prot_ctx->inFlight = false;
+	prot_ctx->connects = 0;
+	prot_ctx->connectUs = 0;
+	prot_ctx->responses = 0;
+	prot_ctx->responseUs = 0;
+	return 0;
+}
+
+/**
+ * Set the time budget of a protocol (DI, TO1 or TO2) run. Connection
+ * operations fail once the budget of the running protocol is used up.
+ *
+ * @param sec - budget in seconds, 0 for none.
+ */
+void sdoProtCtxSetPhaseTimeout(uint32_t sec)
+{
+	phaseTimeoutSec = sec;
+}
+
+/**
+ * Set the end of the time the calling thread has left for its protocol
+ * runs, for ex: the share of a time budget of the protocol to run next.
+ * It bounds the protocol along with its own budget.
+ *
+ * @param deadline - deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoProtCtxSetRunDeadline(uint64_t deadline)
+{
+	runDeadline = deadline;
+}
+
+/**
+ * Set the time a step-wise run waits for the connection to become ready
+ * (sending, receiving the header, or receiving more of the body), as the
+ * blocking read and write timeouts do for sdoProtCtxRun().
+ *
+ * @param ms - timeout in milliseconds, 0 for none.
+ */
+void sdoProtCtxSetIoTimeout(uint32_t ms)
+{
+	ioTimeoutMs = ms;
+}
+
+/**
+ * Set the callback told about each message exchanged with a server.
+ * @param cb - callback, NULL for none
+ */
+void sdoProtCtxSetMsgCallback(sdoSdkMsgCB cb)
+{
+	msgCallback = cb;
+}
+
+/**
+ * Internal API: run the protocol over the response received, up to its
+ * next message, timing the handling of the response.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t
+ */
+static void sdoProtCtxProtRun(SDOProtCtx_t *prot_ctx)
+{
+	uint64_t start = sdoTimeUs();
+	uint64_t crypto = sdoCryptoTimeUs();
+
+#ifdef TO2_RESUME
+	/* the message of the lost connection goes again as it is */
+	if (prot_ctx->protdata->resume) {
+		prot_ctx->protdata->resume = false;
+		prot_ctx->firstMsg = prot_ctx->protdata->sdow.msgType;
+		return;
+	}
+#endif
+	(*prot_ctx->protrun)(prot_ctx->protdata);
+
+	if (prot_ctx->parseMsg)
+		sdoStatsMsgParsed(prot_ctx->parseMsg, sdoTimeUs() - start,
+				  sdoCryptoTimeUs() - crypto);
+	prot_ctx->parseMsg = 0;
+	if (!prot_ctx->firstMsg)
+		prot_ctx->firstMsg = prot_ctx->protdata->sdow.msgType;
+}
+
+/**
+ * Internal API: a new message is about to go out.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t
+ */
+static void sdoProtCtxMsgStart(SDOProtCtx_t *prot_ctx)
+{
+	prot_ctx->txStart = sdoTimeUs();
+	prot_ctx->retries = 0;
+	prot_ctx->inFlight = true;
+}
+
+/**
+ * Internal API: record the exchange of the message sent, and tell the
+ * observer, once its response has been received.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t
+ * @param rxLen - size of the response body
+ */
+static void sdoProtCtxMsgDone(SDOProtCtx_t *prot_ctx, uint32_t rxLen)
+{
+	SDOProt_t *ps = prot_ctx->protdata;
+	uint64_t waitUs = sdoTimeUs() - prot_ctx->txStart;
+	bool error = ps->sdor.msgType == SDO_TYPE_ERROR;
+
+	sdoStatsMsg(ps->sdow.msgType, (uint32_t)ps->sdow.b.blockSize, rxLen,
+		    waitUs, prot_ctx->retries, error);
+	prot_ctx->inFlight = false;
+	prot_ctx->responses++;
+	prot_ctx->responseUs += waitUs;
+	if (!error)
+		prot_ctx->parseMsg = ps->sdow.msgType;
+#ifdef TO2_RESUME
+	/* the session is alive, a later loss gets the whole time again */
+	if (!error)
+		ps->resumeEnd = 0;
+#endif
+
+	if (msgCallback)
+		msgCallback(ps->sdow.msgType, ps->sdor.msgType,
+			    (uint32_t)(waitUs / 1000),
+			    (uint32_t)ps->sdow.b.blockSize, rxLen);
+}
+
+/**
+ * Internal API: work done while the server is busy with the message just
+ * sent.
+ */
+static void sdoProtCtxSent(SDOProtCtx_t *prot_ctx, SDOW_t *sdow)
+{
+	/* Top up the random bytes that the next messages will draw */
+	(void)sdoCryptoRandomPrefetch();
+	/* The rendezvous server verifies the device before it redirects it,
+	 * make the key exchange values of TO2 now */
+	if (sdow->msgType == SDO_TO1_TYPE_PROVE_TO_SDO)
+		(void)sdoKexPrepare();
+	/* Also make the signing material of the next device signature */
+	(void)sdoDevicePreSign();
+	/* and run the key derivation that msg41 submitted */
+	sdoKexPoll();
+	/* msg44 depends on msg41 only, sign it while the OV is fetched */
+	if (sdow->msgType == SDO_TO2_GET_OP_NEXT_ENTRY)
+		(void)msg44Prepare(prot_ctx->protdata);
+}
+
+/**
+ * Internal API: prepare the receive block for a response body of msglen
+ * bytes, taking over the retained buffer of the last run if the block has
+ * none. The body is received in place, so only the terminating pad is
+ * cleared.
+ * @return true on success, false otherwise.
+ */
+static bool sdoProtCtxRxPrepare(SDOR_t *sdor, uint32_t msglen)
+{
+	SDOBlock_t *sdob = &sdor->b;
+
+	if (!sdob->block && rxRetained.block) {
+		sdob->block = rxRetained.block;
+		sdob->blockMax = rxRetained.blockMax;
+		rxRetained.block = NULL;
+		rxRetained.blockMax = 0;
+	}
+
+	if (msglen > INT_MAX - 4 || !sdoRReserve(sdor, msglen + 4) ||
+	    memset_s(&sdob->block[msglen], 4, 0) != 0) {
+		LOG(LOG_ERROR, "No receive buffer for %u bytes\n", msglen);
+		return false;
+	}
+	sdob->blockSize = msglen;
+	return true;
+}
+
+/**
+ * Internal API: keep the receive block of a finished run for the next run,
+ * unless it grew too large.
+ */
+static void sdoProtCtxRxRetain(SDOR_t *sdor)
+{
+	SDOBlock_t *sdob = &sdor->b;
+
+	sdoRFlush(sdor);
+	sdor->pending = 0;
+	sdor->receiveData = NULL;
+	if (sdob->block) {
+		if (!rxRetained.block &&
+		    sdob->blockMax <= PROT_RX_RETAIN_MAX) {
+			rxRetained.block = sdob->block;
+			rxRetained.blockMax = sdob->blockMax;
+		} else {
+			sdoFree(sdob->block);
+		}
+	}
+	sdob->block = NULL;
+	sdob->blockMax = 0;
+	sdob->blockSize = 0;
+	sdob->cursor = 0;
+}
+
+/**
+ * Release the receive buffer kept between protocol runs.
+ */
+void sdoProtCtxReleaseBuffers(void)
+{
+	if (rxRetained.block)
+		sdoFree(rxRetained.block);
+	rxRetained.blockMax = 0;
+}
+
+/**
+ * Internal API: bound the connection operations and the waits before their
+ * retries.
+ */
+static void sdoProtCtxSetDeadline(uint64_t deadline)
+{
+	sdoConSetDeadline(deadline);
+	sdoRetrySetDeadline(deadline);
+}
+
+/**
+ * Internal API: start the deadline of a protocol run, the earlier of its
+ * budget and the time left to the run of the thread.
+ * @return deadline in sdoTimeMs() units, 0 if there is none.
+ */
+static uint64_t sdoProtCtxStartDeadline(void)
+{
+	uint64_t deadline = 0;
+
+	if (phaseTimeoutSec)
+		deadline = sdoTimeMs() + (uint64_t)phaseTimeoutSec * 1000;
+	if (runDeadline && (!deadline || runDeadline < deadline))
+		deadline = runDeadline;
+	sdoProtCtxSetDeadline(deadline);
+	return deadline;
+}
+
 /**
  * Internal API
  */
@@ -76,16 +458,213 @@ void sdoProtCtxFree(SDOProtCtx_t *prot_ctx)
 	}
 }
 
+/**
+ * Close the connection held by the protocol context (if any) and mark it
+ * as closed, so that the next message opens a fresh one.
+ *
+ * @param prot_ctx - Pointer of type SDOProtCtx_t holding the connection.
+ * @return 0 on success, -1 if closing the connection failed.
+ */
+static int sdoProtCtxDisconnect(SDOProtCtx_t *prot_ctx)
+{
+	int ret = 0;
+
+	/* the requests sent ahead go with the connection */
+	prot_ctx->ahead = 0;
+	if (prot_ctx->sock == SDO_CON_INVALID_HANDLE)
+		return 0;
+
+	/* TLS shutdown of a step-wise run must not see EAGAIN */
+	(void)sdoConSetNonBlocking(prot_ctx->sock, false);
+
+	if (sdoConDisconnect(prot_ctx->sock, prot_ctx->ssl)) {
+		LOG(LOG_ERROR, "Error during socket close()\n");
+		ret = -1;
+	}
+	prot_ctx->sock = SDO_CON_INVALID_HANDLE;
+	prot_ctx->ssl = NULL;
+	return ret;
+}
+
+/**
+ * Check if the connection can be kept open for the next message of the
+ * protocol. The server must not have asked to close it.
+ *
+ * @return true if the connection is to be reused, false otherwise.
+ */
+static bool sdoProtCtxKeepAlive(void)
+{
+#ifdef KEEP_ALIVE_FALSE
+	return false;
+#else
+	RestCtx_t *rest = getRESTContext();
+
+	return rest ? rest->keepAlive : false;
+#endif
+}
+
+#ifdef OV_PIPELINE
+/**
+ * Internal API: send the msg42 of the next OV entries ahead of their turn,
+ * so that the owner works on them while the responses come back. Only done
+ * if the owner said how many requests it takes pipelined (X-Pipeline), on a
+ * kept-alive connection. The responses come in order, msg43 reads them in
+ * turn.
+ */
+static void sdoProtCtxPipeline(SDOProtCtx_t *prot_ctx)
+{
+	SDOProt_t *ps = prot_ctx->protdata;
+	RestCtx_t *rest = getRESTContext();
+	uint32_t depth, enn;
+	SDOW_t w;
+	bool sent;
+
+	if (!rest || !sdoProtCtxKeepAlive())
+		return;
+	depth = rest->pipeline < OV_PIPELINE ? rest->pipeline : OV_PIPELINE;
+
+	while (prot_ctx->ahead + 1u < depth) {
+		enn = ps->ovEntryNum + 1u + prot_ctx->ahead;
+		if (enn >= (uint32_t)ps->ovoucher->numOVEntries ||
+		    !sdoWInit(&w))
+			return;
+		w.encoding = ps->sdow.encoding;
+		sent = msg42Ahead(ps, &w, (uint16_t)enn) &&
+		       sdoConSendMessage(prot_ctx->sock, SDO_PROT_SPEC_VERSION,
+					 w.msgType, w.b.block, w.b.blockSize,
+					 prot_ctx->ssl) > 0;
+		sdoFree(w.b.block);
+		/* the rest are sent in turn */
+		if (!sent)
+			return;
+		prot_ctx->ahead++;
+		LOG(LOG_DEBUG, "OV entry %u requested ahead\n", enn);
+	}
+}
+#endif
+
+#ifdef RX_STREAM_ENABLED
+/**
+ * Internal API: receive function of a streamed response, appending the
+ * next nbytes of the body to the receive block.
+ * @return number of bytes received, -1 on failure.
+ */
+static int sdoProtCtxRecv(SDOR_t *sdor, int nbytes)
+{
+	SDOProtCtx_t *prot_ctx = sdor->receiveData;
+
+	if (!prot_ctx || nbytes <= 0)
+		return -1;
+	return sdoConRecvMsgBody(prot_ctx->sock,
+				 &sdor->b.block[sdor->b.blockSize], nbytes,
+				 prot_ctx->ssl);
+}
+
+/**
+ * Internal API: finish a streamed response once the protocol handled it.
+ * What the protocol did not read is skipped, so that the connection can
+ * carry the next message.
+ * @return 0 on success, -1 on failure.
+ */
+static int sdoProtCtxRxFinish(SDOProtCtx_t *prot_ctx)
+{
+	SDOR_t *sdor = &prot_ctx->protdata->sdor;
+	uint8_t skip[256];
+	int n;
+
+	if (sdor->receiveData != prot_ctx)
+		return 0;
+	sdor->receive = NULL;
+	sdor->receiveData = NULL;
+
+	while (sdor->pending > 0) {
+		n = sdor->pending < (int)sizeof(skip) ? sdor->pending
+						      : (int)sizeof(skip);
+		if (sdoConRecvMsgBody(prot_ctx->sock, skip, n, prot_ctx->ssl) !=
+		    n) {
+			LOG(LOG_ERROR, "Socket read not successful!\n");
+			sdor->pending = 0;
+			return sdoProtCtxDisconnect(prot_ctx);
+		}
+		sdor->pending -= n;
+	}
+
+	if (!sdoProtCtxKeepAlive())
+		return sdoProtCtxDisconnect(prot_ctx);
+	return 0;
+}
+#endif
+
+/**
+ * Internal API: failure tracking of the server of the protocol.
+ */
+static sdoRetryEndpoint_t *sdoProtCtxEndpoint(SDOProtCtx_t *prot_ctx)
+{
+	return sdoRetryEndpoint(prot_ctx->host_dns,
+				prot_ctx->host_dns ? NULL : prot_ctx->host_ip,
+				prot_ctx->host_port);
+}
+
+/**
+ * Internal API: record the result of a protocol run with its server.
+ */
+static void sdoProtCtxRecordResult(SDOProtCtx_t *prot_ctx, bool success)
+{
+	SDOW_t *sdow = &prot_ctx->protdata->sdow;
+	uint64_t connectMs = 0, responseMs = 0;
+
+	/* The message in flight got no response */
+	if (prot_ctx->inFlight)
+		sdoStatsMsg(sdow->msgType, (uint32_t)sdow->b.blockSize, 0,
+			    sdoTimeUs() - prot_ctx->txStart,
+			    prot_ctx->retries, true);
+	prot_ctx->inFlight = false;
+	sdoStatsPhase(prot_ctx->firstMsg,
+		      (uint32_t)(sdoTimeMs() - prot_ctx->runStart), success);
+	if (prot_ctx->firstMsg >= SDO_TO2_HELLO_DEVICE)
+		sdoAllocPhaseEnd(SDO_ALLOC_PHASE_TO2);
+	else if (prot_ctx->firstMsg >= SDO_TO1_TYPE_HELLO_SDO)
+		sdoAllocPhaseEnd(SDO_ALLOC_PHASE_TO1);
+	else if (prot_ctx->firstMsg >= SDO_DI_APP_START)
+		sdoAllocPhaseEnd(SDO_ALLOC_PHASE_DI);
+
+	if (success)
+		sdoRetrySuccess(sdoProtCtxEndpoint(prot_ctx));
+	else
+		sdoRetryFailure(sdoProtCtxEndpoint(prot_ctx));
+
+	/* Rendezvous and owner servers are ranked by their latency */
+	if (prot_ctx->firstMsg < SDO_TO1_TYPE_HELLO_SDO)
+		return;
+	/* averages rounded up, 0 tells there was no sample */
+	if (prot_ctx->connects)
+		connectMs =
+		    (prot_ctx->connectUs / prot_ctx->connects + 999) / 1000;
+	if (prot_ctx->responses)
+		responseMs =
+		    (prot_ctx->responseUs / prot_ctx->responses + 999) / 1000;
+	sdoEndpointRecord(prot_ctx->host_dns,
+			  prot_ctx->host_dns ? NULL : prot_ctx->host_ip,
+			  prot_ctx->host_port, success, (uint32_t)connectMs,
+			  (uint32_t)responseMs);
+}
+
 /**
  * Internal API
  */
 bool sdoProtCtxConnect(SDOProtCtx_t *prot_ctx)
 {
 	bool ret = false;
-	static int prevstate = 0;
+	uint64_t start = sdoTimeUs();
+
+	if (!sdoRetryAllowed(sdoProtCtxEndpoint(prot_ctx))) {
+		LOG(LOG_ERROR, "Server failed repeatedly, paused until its "
+			       "cool-down ends\n");
+		return false;
+	}
 
 	if (prot_ctx->protdata->state == SDO_STATE_ERROR)
-		prot_ctx->protdata->state = prevstate;
+		prot_ctx->protdata->state = prot_ctx->protdata->prevState;
 
 	switch (prot_ctx->protdata->state) {
 	case SDO_STATE_DI_APP_START:       /* type 10 */
@@ -127,6 +706,11 @@ bool sdoProtCtxConnect(SDOProtCtx_t *prot_ctx)
 		break;
 	case SDO_STATE_T02_SND_HELLO_DEVICE: /* type 40 */
 	case SDO_STATE_TO2_RCV_PROVE_OVHDR:  /* type 41 */
+		/* connected already, while TO1 finished */
+		if (sdoOwnerPreconnectTake(prot_ctx)) {
+			ret = true;
+			break;
+		}
 		if (prot_ctx->host_dns) {
 			if (!ResolveDn(prot_ctx->host_dns,
 				       &prot_ctx->resolved_ip,
@@ -154,7 +738,12 @@ bool sdoProtCtxConnect(SDOProtCtx_t *prot_ctx)
 		LOG(LOG_ERROR, "sdoProtCtxConnect reached unknown state \n");
 		break;
 	}
-	prevstate = prot_ctx->protdata->state;
+	prot_ctx->protdata->prevState = prot_ctx->protdata->state;
+	if (ret) {
+		/* name resolution and TLS handshake included */
+		prot_ctx->connects++;
+		prot_ctx->connectUs += sdoTimeUs() - start;
+	}
 	return ret;
 }
 
@@ -173,7 +762,9 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 	int ret = 0;
 	int n, size;
 	int retries = 0;
-	SDOBlock_t *sdob = NULL;
+	bool reused = false;
+	bool resent = false;
+	bool pipelined = false;
 	SDOR_t *sdor = NULL;
 	SDOW_t *sdow = NULL;
 
@@ -183,20 +774,26 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 	sdow = &prot_ctx->protdata->sdow;
 
 	// init connection set-up for send/receive packets
-	if (sdoConSetup(NULL, NULL, 0)) {
-		LOG(LOG_ERROR, "Connection setup failed!\n");
+	if (sdoProtCtxSetup(prot_ctx))
 		return -1;
-	}
+	sdoProtCtxStartDeadline();
 
 	for (;;) {
 
 		if (prot_ctx->protrun)
-			(*prot_ctx->protrun)(prot_ctx->protdata);
+			sdoProtCtxProtRun(prot_ctx);
 		else {
 			ret = -1;
 			break;
 		}
 
+#ifdef RX_STREAM_ENABLED
+		if (sdoProtCtxRxFinish(prot_ctx)) {
+			ret = -1;
+			break;
+		}
+#endif
+
 		//=====================================================================
 		// Transmit outbound packet
 		//
@@ -217,28 +814,42 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 			break;
 		}
 
-		if (!sdoProtCtxConnect(prot_ctx)) {
+		size = sdow->b.blockSize;
+		sdow->b.block[size] = 0;
+		resent = false;
+		sdoProtCtxMsgStart(prot_ctx);
+		/* sent ahead already, its response is the next one */
+		pipelined = prot_ctx->ahead &&
+			    sdow->msgType == SDO_TO2_GET_OP_NEXT_ENTRY;
+		if (pipelined)
+			prot_ctx->ahead--;
+
+	resend:
+		/*
+		 * Connection is opened once and kept open for the whole
+		 * protocol (DI/TO1/TO2) unless the server closes it or an
+		 * error occurs.
+		 */
+		reused = (prot_ctx->sock != SDO_CON_INVALID_HANDLE);
+		if (!reused && !sdoProtCtxConnect(prot_ctx)) {
 			/* Giving up, we tried enough to
 			 * re-establish */
 			ret = -1;
 			break;
 		}
 
-		size = sdow->b.blockSize;
-
-		sdow->b.block[size] = 0;
-		retries = CONNECTION_RETRY;
+		retries = (int)sdoRetryMaxRetries();
 		do {
-			n = sdoConSendMessage(prot_ctx->sock,
-					      SDO_PROT_SPEC_VERSION,
-					      sdow->msgType, &sdow->b.block[0],
-					      size, prot_ctx->ssl);
+			if (pipelined)
+				n = size;
+			else
+				n = sdoConSendMessage(
+				    prot_ctx->sock, SDO_PROT_SPEC_VERSION,
+				    sdow->msgType, &sdow->b.block[0], size,
+				    prot_ctx->ssl);
 
 			if (n <= 0) {
-				if (sdoConDisconnect(prot_ctx->sock,
-						     prot_ctx->ssl)) {
-					LOG(LOG_ERROR,
-					    "Error during socket close()\n");
+				if (sdoProtCtxDisconnect(prot_ctx)) {
 					ret = -1;
 					break;
 				}
@@ -249,6 +860,7 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 					ret = -1;
 					break;
 				}
+				prot_ctx->retries++;
 			}
 		} while (n < 0 && retries--);
 
@@ -260,47 +872,66 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 		LOG(LOG_DEBUG, "Tx sdoProtCtxRun:body:%s\n\n",
 		    &sdow->b.block[0]);
 
+		sdoProtCtxSent(prot_ctx, sdow);
+#ifdef OV_PIPELINE
+		if (sdow->msgType == SDO_TO2_GET_OP_NEXT_ENTRY)
+			sdoProtCtxPipeline(prot_ctx);
+#endif
+
 		//=====================================================================
 		// Receive response
 		//
-		sdob = &sdor->b;
-
 		uint32_t msglen = 0;
 		uint32_t protver = 0;
 
 		if ((ret = sdoConRecvMsgHeader(prot_ctx->sock, &protver,
 					       (uint32_t *)&sdor->msgType,
 					       &msglen, prot_ctx->ssl)) == -1) {
+			/*
+			 * The server may have dropped an idle kept-alive
+			 * connection, after we sent the message. Send it once
+			 * more over a new connection.
+			 */
+			if (reused && !resent) {
+				LOG(LOG_DEBUG, "Kept-alive connection lost, "
+					       "reconnecting\n");
+				resent = true;
+				pipelined = false;
+				ret = 0;
+				prot_ctx->retries++;
+				if (sdoProtCtxDisconnect(prot_ctx) == 0)
+					goto resend;
+			}
 			LOG(LOG_ERROR, "sdoConRecvMsgHeader() Failed!\n");
 			ret = -1;
 			break;
 		}
 
 		sdoRFlush(sdor);
-		sdob = &sdor->b;
-		sdoResizeBlock(sdob, msglen + 4);
-
-		if (memset_s(sdob->block, msglen + 4, 0) != 0) {
-			LOG(LOG_ERROR, "Memset Failed\n");
+#ifdef RX_STREAM_ENABLED
+		/* The body is received while the protocol parses it */
+		if (!sdoProtCtxRxPrepare(sdor, 0)) {
+			ret = -1;
+			break;
+		}
+		sdor->receive = sdoProtCtxRecv;
+		sdor->receiveData = prot_ctx;
+		sdoRStream(sdor, msglen);
+#else
+		if (!sdoProtCtxRxPrepare(sdor, msglen)) {
 			ret = -1;
 			break;
 		}
-
-		sdob->blockSize = msglen;
 
 		if (msglen > 0) {
-			retries = CONNECTION_RETRY;
+			retries = (int)sdoRetryMaxRetries();
 			n = 0;
 			do {
 				n = sdoConRecvMsgBody(prot_ctx->sock,
-						      &sdob->block[0], msglen,
+						      &sdor->b.block[0], msglen,
 						      prot_ctx->ssl);
 				if (n < 0) {
-					if (sdoConDisconnect(prot_ctx->sock,
-							     prot_ctx->ssl)) {
-						LOG(LOG_ERROR, "Error during "
-							       "socket "
-							       "close()\n");
+					if (sdoProtCtxDisconnect(prot_ctx)) {
 						ret = -1;
 						break;
 					}
@@ -311,6 +942,7 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 						ret = -1;
 						break;
 					}
+					prot_ctx->retries++;
 				}
 			} while (n < 0 && retries--);
 
@@ -323,8 +955,7 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 			}
 		}
 
-		if (sdoConDisconnect(prot_ctx->sock, prot_ctx->ssl)) {
-			LOG(LOG_ERROR, "Error during socket close()\n");
+		if (!sdoProtCtxKeepAlive() && sdoProtCtxDisconnect(prot_ctx)) {
 			ret = -1;
 			break;
 		}
@@ -333,6 +964,8 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 		    &sdor->b.block[0]);
 
 		sdoRSetHaveBlock(sdor);
+#endif
+		sdoProtCtxMsgDone(prot_ctx, msglen);
 
 		/*
 		 * When a REST error message(type 255) is sent over network,
@@ -349,14 +982,335 @@ int sdoProtCtxRun(SDOProtCtx_t *prot_ctx)
 		}
 	}
 
+	if (sdoProtCtxDisconnect(prot_ctx))
+		ret = -1;
+
+#ifdef TO2_RESUME
+	sdoProtCtxKeepAuth(prot_ctx, ret == 0);
+#endif
+	sdoConTeardown();
+	sdoProtCtxSetDeadline(0);
+	sdoProtCtxRecordResult(prot_ctx, ret == 0);
+	sdoProtCtxRxRetain(sdor);
+	return ret;
+}
+
+/**
+ * Internal API: close down a step-wise run.
+ */
+static int sdoProtCtxStepEnd(SDOProtCtx_t *prot_ctx, int ret)
+{
+	prot_ctx->stepState = SDO_PROT_STEP_IDLE;
+
+	if (sdoProtCtxDisconnect(prot_ctx))
+		ret = SDO_PROT_CTX_ERROR;
+
+#ifdef TO2_RESUME
+	sdoProtCtxKeepAuth(prot_ctx, ret == SDO_PROT_CTX_DONE);
+#endif
 	sdoConTeardown();
+	sdoProtCtxSetDeadline(0);
+	sdoProtCtxRecordResult(prot_ctx, ret == SDO_PROT_CTX_DONE);
+	sdoProtCtxRxRetain(&prot_ctx->protdata->sdor);
+	return ret;
+}
+
+/**
+ * sdoProtCtxStart prepares a step-wise (non-blocking) run of the DI, TO1 or
+ * TO2 protocol, as alternative to sdoProtCtxRun(). The protocol is then
+ * advanced by calling sdoProtCtxStep() whenever the connection is ready.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t, holds the all the
+ * information,
+ * @return 0 on success, -1 on error.
+ */
+int sdoProtCtxStart(SDOProtCtx_t *prot_ctx)
+{
+	if (!prot_ctx || !prot_ctx->protdata || !prot_ctx->protrun)
+		return -1;
+
+	// init connection set-up for send/receive packets
+	if (sdoProtCtxSetup(prot_ctx))
+		return -1;
+	prot_ctx->phaseEnd = sdoProtCtxStartDeadline();
+	prot_ctx->ioDeadline = 0;
+	prot_ctx->blocking = false;
+	prot_ctx->stepState = SDO_PROT_STEP_RUN;
+	return 0;
+}
+
+/**
+ * Internal API: move a step-wise run on to the next state. The I/O of the
+ * new state gets a new timeout.
+ */
+static void sdoProtCtxStepTo(SDOProtCtx_t *prot_ctx, int stepState)
+{
+	prot_ctx->stepState = stepState;
+	prot_ctx->ioDeadline = 0;
+}
+
+/**
+ * Internal API: send the message, blocking if the network has no
+ * non-blocking I/O.
+ */
+static int32_t sdoProtCtxStepSend(SDOProtCtx_t *prot_ctx, SDOW_t *sdow)
+{
+	if (prot_ctx->blocking)
+		return sdoConSendMessage(prot_ctx->sock, SDO_PROT_SPEC_VERSION,
+					 sdow->msgType, &sdow->b.block[0],
+					 sdow->b.blockSize, prot_ctx->ssl) < 0
+			   ? SDO_CON_ERROR
+			   : SDO_CON_DONE;
 
-	if (sdob && sdob->block) {
-		sdob->blockMax = 0;
-		sdob->blockSize = 0;
-		sdob->cursor = 0;
-		sdoFree(sdob->block);
-		sdob->block = NULL;
+	return sdoConSendMessageAsync(prot_ctx->sock, SDO_PROT_SPEC_VERSION,
+				      sdow->msgType, &sdow->b.block[0],
+				      sdow->b.blockSize, prot_ctx->ssl);
+}
+
+/**
+ * Internal API: receive the REST header of the response, blocking if the
+ * network has no non-blocking I/O.
+ */
+static int32_t sdoProtCtxStepRecvHdr(SDOProtCtx_t *prot_ctx, SDOR_t *sdor)
+{
+	uint32_t protver = 0;
+
+	if (prot_ctx->blocking)
+		return sdoConRecvMsgHeader(prot_ctx->sock, &protver,
+					   (uint32_t *)&sdor->msgType,
+					   &prot_ctx->rxLen, prot_ctx->ssl) < 0
+			   ? SDO_CON_ERROR
+			   : SDO_CON_DONE;
+
+	return sdoConRecvMsgHeaderAsync(prot_ctx->sock, &protver,
+					(uint32_t *)&sdor->msgType,
+					&prot_ctx->rxLen, prot_ctx->ssl);
+}
+
+/**
+ * Internal API: receive the body of the response, blocking if the network
+ * has no non-blocking I/O.
+ */
+static int32_t sdoProtCtxStepRecvBody(SDOProtCtx_t *prot_ctx, SDOR_t *sdor)
+{
+	size_t before = prot_ctx->rxDone;
+	int32_t ret;
+	int n;
+
+	if (prot_ctx->blocking) {
+		n = sdoConRecvMsgBody(prot_ctx->sock, &sdor->b.block[0],
+				      prot_ctx->rxLen, prot_ctx->ssl);
+		if (n < 0 || (uint32_t)n != prot_ctx->rxLen)
+			return SDO_CON_ERROR;
+		prot_ctx->rxDone = prot_ctx->rxLen;
+		return SDO_CON_DONE;
 	}
+
+	ret = sdoConRecvMsgBodyAsync(prot_ctx->sock, &sdor->b.block[0],
+				     prot_ctx->rxLen, &prot_ctx->rxDone,
+				     prot_ctx->ssl);
+	/* A body that keeps coming is not stalled */
+	if (prot_ctx->rxDone != before)
+		prot_ctx->ioDeadline = 0;
 	return ret;
 }
+
+/**
+ * sdoProtCtxStep advances a protocol started with sdoProtCtxStart() as far
+ * as possible without waiting on the network. Connection set-up (DNS,
+ * connect, TLS handshake) is still done in place; message exchange does not
+ * block.
+ * On SDO_PROT_CTX_WANT_READ/SDO_PROT_CTX_WANT_WRITE, the caller waits until
+ * sdoProtCtxGetFd() is readable/writable (for ex: with epoll), or until
+ * sdoProtCtxGetDeadline() at the latest, and calls again. A wait which
+ * outlasts the I/O timeout fails the protocol.
+ * If the network has no non-blocking I/O, each call exchanges one message
+ * in blocking mode and returns SDO_PROT_CTX_AGAIN, so that the caller gets
+ * to run between messages.
+ * Errors are not retried here, the caller restarts the protocol as it does
+ * after a failed sdoProtCtxRun().
+ * @param prot_ctx - Pointer of type SDOProtCtx_t, holds the all the
+ * information,
+ * @return SDO_PROT_CTX_DONE when the protocol is complete,
+ * SDO_PROT_CTX_WANT_READ, SDO_PROT_CTX_WANT_WRITE, SDO_PROT_CTX_AGAIN or
+ * SDO_PROT_CTX_ERROR.
+ */
+int sdoProtCtxStep(SDOProtCtx_t *prot_ctx)
+{
+	int32_t ret;
+	uint64_t now;
+	SDOR_t *sdor = NULL;
+	SDOW_t *sdow = NULL;
+
+	if (!prot_ctx || !prot_ctx->protdata ||
+	    prot_ctx->stepState == SDO_PROT_STEP_IDLE)
+		return SDO_PROT_CTX_ERROR;
+	sdor = &prot_ctx->protdata->sdor;
+	sdow = &prot_ctx->protdata->sdow;
+
+	now = sdoTimeMs();
+	if (prot_ctx->ioDeadline && now >= prot_ctx->ioDeadline) {
+		LOG(LOG_ERROR, "Connection timed out\n");
+		goto err;
+	}
+	if (prot_ctx->phaseEnd && now >= prot_ctx->phaseEnd) {
+		LOG(LOG_ERROR, "Protocol deadline expired\n");
+		goto err;
+	}
+
+	for (;;) {
+		switch (prot_ctx->stepState) {
+		case SDO_PROT_STEP_RUN:
+			sdoProtCtxProtRun(prot_ctx);
+
+			if (prot_ctx->protdata->state == SDO_STATE_DONE)
+				return sdoProtCtxStepEnd(prot_ctx,
+							 SDO_PROT_CTX_DONE);
+
+			if ((sdow->msgType < SDO_DI_APP_START) ||
+			    (sdow->msgType > SDO_TYPE_ERROR))
+				goto err;
+
+			sdow->b.block[sdow->b.blockSize] = 0;
+			prot_ctx->resent = false;
+			sdoProtCtxMsgStart(prot_ctx);
+			sdoProtCtxStepTo(prot_ctx, SDO_PROT_STEP_CONNECT);
+			break;
+
+		case SDO_PROT_STEP_CONNECT:
+			prot_ctx->reused =
+			    (prot_ctx->sock != SDO_CON_INVALID_HANDLE);
+			if (!prot_ctx->reused) {
+				if (!sdoProtCtxConnect(prot_ctx))
+					goto err;
+				if (!prot_ctx->blocking &&
+				    sdoConSetNonBlocking(prot_ctx->sock,
+							 true)) {
+					LOG(LOG_DEBUG, "Non-blocking I/O not "
+						       "supported, one "
+						       "message per step\n");
+					prot_ctx->blocking = true;
+				}
+			}
+			sdoProtCtxStepTo(prot_ctx, SDO_PROT_STEP_SEND);
+			break;
+
+		case SDO_PROT_STEP_SEND:
+			ret = sdoProtCtxStepSend(prot_ctx, sdow);
+			if (ret != SDO_CON_DONE)
+				goto io;
+
+			LOG(LOG_DEBUG, "Tx sdoProtCtxStep:body:%s\n\n",
+			    &sdow->b.block[0]);
+			sdoProtCtxSent(prot_ctx, sdow);
+			sdoProtCtxStepTo(prot_ctx, SDO_PROT_STEP_RECV_HDR);
+			break;
+
+		case SDO_PROT_STEP_RECV_HDR:
+			ret = sdoProtCtxStepRecvHdr(prot_ctx, sdor);
+			if (ret == SDO_CON_ERROR && prot_ctx->reused &&
+			    !prot_ctx->resent) {
+				/* kept-alive connection lost, send again */
+				LOG(LOG_DEBUG, "Kept-alive connection lost, "
+					       "reconnecting\n");
+				prot_ctx->resent = true;
+				prot_ctx->retries++;
+				if (sdoProtCtxDisconnect(prot_ctx))
+					goto err;
+				sdoProtCtxStepTo(prot_ctx,
+						 SDO_PROT_STEP_CONNECT);
+				break;
+			}
+			if (ret != SDO_CON_DONE)
+				goto io;
+
+			sdoRFlush(sdor);
+			if (!sdoProtCtxRxPrepare(sdor, prot_ctx->rxLen))
+				goto err;
+			prot_ctx->rxDone = 0;
+			sdoProtCtxStepTo(prot_ctx, SDO_PROT_STEP_RECV_BODY);
+			break;
+
+		case SDO_PROT_STEP_RECV_BODY:
+			if (prot_ctx->rxLen > 0) {
+				ret = sdoProtCtxStepRecvBody(prot_ctx, sdor);
+				if (ret != SDO_CON_DONE)
+					goto io;
+			}
+
+			if (!sdoProtCtxKeepAlive() &&
+			    sdoProtCtxDisconnect(prot_ctx))
+				goto err;
+
+			LOG(LOG_DEBUG, "Rx sdoProtCtxStep:body:%s\n\n",
+			    &sdor->b.block[0]);
+
+			sdoRSetHaveBlock(sdor);
+			sdoProtCtxMsgDone(prot_ctx, prot_ctx->rxLen);
+
+			/*
+			 * When a REST error message(type 255) is sent over
+			 * network, the received response may have an empty
+			 * body.
+			 */
+			if (prot_ctx->rxLen == 0 &&
+			    sdow->msgType == SDO_TYPE_ERROR)
+				goto err;
+			if (sdor->msgType == SDO_TYPE_ERROR)
+				goto err;
+
+			sdoProtCtxStepTo(prot_ctx, SDO_PROT_STEP_RUN);
+			/* Blocking exchanges, let the caller run between */
+			if (prot_ctx->blocking)
+				return SDO_PROT_CTX_AGAIN;
+			break;
+
+		default:
+			goto err;
+		}
+	}
+
+io:
+	if (ret == SDO_CON_WANT_READ || ret == SDO_CON_WANT_WRITE) {
+		if (!prot_ctx->ioDeadline && ioTimeoutMs)
+			prot_ctx->ioDeadline = sdoTimeMs() + ioTimeoutMs;
+		return ret == SDO_CON_WANT_READ ? SDO_PROT_CTX_WANT_READ
+						: SDO_PROT_CTX_WANT_WRITE;
+	}
+err:
+	return sdoProtCtxStepEnd(prot_ctx, SDO_PROT_CTX_ERROR);
+}
+
+/**
+ * sdoProtCtxGetFd gives the file descriptor a step-wise run is waiting on.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t, holds the all the
+ * information,
+ * @return file descriptor on success, -1 if there is none.
+ */
+int sdoProtCtxGetFd(SDOProtCtx_t *prot_ctx)
+{
+	if (!prot_ctx || prot_ctx->sock == SDO_CON_INVALID_HANDLE ||
+	    prot_ctx->blocking)
+		return -1;
+
+	return sdoConGetFd(prot_ctx->sock);
+}
+
+/**
+ * sdoProtCtxGetDeadline gives the time at which a step-wise run is to be
+ * stepped again even if its connection is not ready, for it to time out.
+ * @param prot_ctx - Pointer of type SDOProtCtx_t, holds the all the
+ * information,
+ * @return deadline in sdoTimeMs() units, 0 if there is none.
+ */
+uint64_t sdoProtCtxGetDeadline(SDOProtCtx_t *prot_ctx)
+{
+	uint64_t deadline;
+
+	if (!prot_ctx || prot_ctx->stepState == SDO_PROT_STEP_IDLE)
+		return 0;
+
+	deadline = prot_ctx->ioDeadline;
+	if (prot_ctx->phaseEnd && (!deadline || prot_ctx->phaseEnd < deadline))
+		deadline = prot_ctx->phaseEnd;
+	return deadline;
+}
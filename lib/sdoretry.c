@@ -0,0 +1,360 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Retry scheduling of connections and protocols.
+ *
+ * All retries wait an exponentially growing delay with full jitter (a
+ * random delay between 0 and the exponential ceiling), so that a fleet of
+ * devices does not retry in synchronized waves after a server outage.
+ * Failures are tracked per server: after too many consecutive failures the
+ * circuit of the server opens and connections to it fail without network
+ * traffic, until a cool-down has passed and a single trial is allowed.
+ *
+ * The waits go to the sleep callback of the platform when there is one, so
+ * that a battery device can sleep through them with the radio off, and end
+ * on a wake window, so that the retries of its SDK instances, and the work
+ * of the application in the same window, take a single wake-up.
+ */
+
+#include "util.h"
+#include "sdoretry.h"
+#include "network_al.h"
+#include "sdoCryptoApi.h"
+#include "safe_lib.h"
+
+#ifndef RETRY_BASE_MS
+#define RETRY_BASE_MS 1000
+#endif
+#ifndef RETRY_CAP_MS
+#define RETRY_CAP_MS 60000
+#endif
+#ifndef RETRY_MAX_RETRIES
+#define RETRY_MAX_RETRIES 2
+#endif
+/* Consecutive failed runs that open the circuit, 0 disables it */
+#ifndef RETRY_BREAKER_THRESHOLD
+#define RETRY_BREAKER_THRESHOLD 5
+#endif
+#ifndef RETRY_BREAKER_COOLDOWN_SEC
+#define RETRY_BREAKER_COOLDOWN_SEC 300
+#endif
+
+/* Manufacturer, rendezvous, owner and a spare */
+#define RETRY_ENDPOINTS 4
+/* Longest domain name as per RFC 1035, incl. terminator */
+#define RETRY_MAX_DN 256
+
+struct sdoRetryEndpoint_s {
+	char dn[RETRY_MAX_DN]; // empty if the server is known by IP
+	SDOIPAddress_t ip;
+	uint16_t port;
+	bool used;
+	uint32_t failures;  // consecutive failures
+	uint64_t openUntil; // in sdoTimeMs() units, circuit open before it
+	uint64_t lastUse;
+};
+
+static struct {
+	uint32_t baseMs;
+	uint32_t capMs;
+	uint32_t maxRetries;
+	uint32_t breakerThreshold;
+	uint32_t breakerCooldownSec;
+} policy = {RETRY_BASE_MS, RETRY_CAP_MS, RETRY_MAX_RETRIES,
+	    RETRY_BREAKER_THRESHOLD, RETRY_BREAKER_COOLDOWN_SEC};
+
+/* sleep of the platform, sdoSleepMs if NULL, and its wake window */
+static sdoSdkSleepCB sleepHook;
+static uint32_t wakeWindow;
+
+static SDO_THREAD_LOCAL sdoRetryEndpoint_t endpoints[RETRY_ENDPOINTS];
+/* server of the last failure, whose protocol is retried next */
+static SDO_THREAD_LOCAL sdoRetryEndpoint_t *lastFailed;
+/* deadline of the running protocol, no retry waits past it */
+static SDO_THREAD_LOCAL uint64_t retryDeadline;
+
+/**
+ * Set the retry policy.
+ *
+ * @param baseMs - delay ceiling of the first retry.
+ * @param capMs - maximum delay ceiling.
+ * @param maxRetries - retries of a failed connection or message.
+ * @param breakerThreshold - consecutive failures that open the circuit of
+ * a server, 0 to never open it.
+ * @param breakerCooldownSec - seconds the circuit stays open.
+ */
+void sdoRetrySetPolicy(uint32_t baseMs, uint32_t capMs, uint32_t maxRetries,
+		       uint32_t breakerThreshold, uint32_t breakerCooldownSec)
+{
+	policy.baseMs = baseMs;
+	policy.capMs = capMs < baseMs ? baseMs : capMs;
+	policy.maxRetries = maxRetries;
+	policy.breakerThreshold = breakerThreshold;
+	policy.breakerCooldownSec = breakerCooldownSec;
+}
+
+/**
+ * @return number of retries of a failed connection or message.
+ */
+uint32_t sdoRetryMaxRetries(void)
+{
+	return policy.maxRetries;
+}
+
+/**
+ * Set the sleep of the waits.
+ *
+ * @param sleep - sleep callback of the platform, NULL for sdoSleepMs.
+ * @param wakeWindowMs - the waits end on a multiple of it in sdoTimeMs()
+ * units, 0 for no alignment.
+ */
+void sdoRetrySetSleep(sdoSdkSleepCB sleep, uint32_t wakeWindowMs)
+{
+	sleepHook = sleep;
+	wakeWindow = wakeWindowMs;
+}
+
+/**
+ * Internal API: stretch a wait to end on the next wake window.
+ */
+static uint32_t retryAlign(uint32_t ms)
+{
+	uint64_t now, end;
+
+	if (!wakeWindow)
+		return ms;
+	now = sdoTimeMs();
+	end = (now + ms + wakeWindow - 1) / wakeWindow * wakeWindow;
+	if (end - now > UINT32_MAX)
+		return UINT32_MAX;
+	return (uint32_t)(end - now);
+}
+
+/**
+ * Wait, in the sleep callback of the platform if there is one. If it wakes
+ * early, the rest of the wait is handed to it again.
+ *
+ * @param ms - wait in milliseconds.
+ * @param reason - what is waited for, passed on to the callback.
+ */
+void sdoRetryWait(uint32_t ms, sdoSdkSleepReason reason)
+{
+	uint32_t left;
+
+	if (!sleepHook) {
+		sdoSleepMs(ms);
+		return;
+	}
+	while (ms) {
+		left = sleepHook(ms, reason);
+		if (left >= ms) {
+			/* no progress, do not spin on the callback */
+			sdoSleepMs(ms);
+			break;
+		}
+		ms = left;
+	}
+}
+
+/**
+ * Set the deadline of the running protocol, the retries of its connections
+ * and messages are given up rather than waited for past it.
+ *
+ * @param deadline - deadline in sdoTimeMs() units, 0 for none.
+ */
+void sdoRetrySetDeadline(uint64_t deadline)
+{
+	retryDeadline = deadline;
+}
+
+/**
+ * Find the failure tracking of a server, starting it if the server is not
+ * tracked yet. The least recently used server is replaced when the table
+ * is full.
+ *
+ * @param dn - domain name of the server, NULL if it is known by IP.
+ * @param ip - IP address of the server, used if dn is NULL.
+ * @param port - port of the server.
+ * @return failure tracking of the server, NULL if dn and ip are NULL.
+ */
+sdoRetryEndpoint_t *sdoRetryEndpoint(const char *dn, const SDOIPAddress_t *ip,
+				     uint16_t port)
+{
+	sdoRetryEndpoint_t *ep = NULL;
+	int i, res = 1;
+
+	if (!dn && !ip)
+		return NULL;
+
+	for (i = 0; i < RETRY_ENDPOINTS; i++) {
+		sdoRetryEndpoint_t *e = &endpoints[i];
+
+		if (!e->used || e->port != port)
+			continue;
+		if (dn && e->dn[0])
+			strcmp_s(e->dn, sizeof(e->dn), dn, &res);
+		else if (!dn && !e->dn[0])
+			memcmp_s(&e->ip, sizeof(e->ip), ip, sizeof(*ip), &res);
+		if (res == 0) {
+			ep = e;
+			goto end;
+		}
+	}
+
+	ep = &endpoints[0];
+	for (i = 0; i < RETRY_ENDPOINTS; i++) {
+		if (!endpoints[i].used) {
+			ep = &endpoints[i];
+			break;
+		}
+		if (endpoints[i].lastUse < ep->lastUse)
+			ep = &endpoints[i];
+	}
+	if (ep == lastFailed)
+		lastFailed = NULL;
+
+	if (memset_s(ep, sizeof(*ep), 0) != 0)
+		return NULL;
+	if (dn) {
+		if (strncpy_s(ep->dn, sizeof(ep->dn), dn,
+			      sizeof(ep->dn) - 1) != 0)
+			return NULL;
+	} else {
+		ep->ip = *ip;
+	}
+	ep->port = port;
+	ep->used = true;
+end:
+	ep->lastUse = sdoTimeMs();
+	return ep;
+}
+
+/**
+ * Check if a connection to the server may be attempted, i.e. its circuit
+ * is closed, or the cool-down has passed (a trial is allowed then).
+ *
+ * @param ep - failure tracking of the server, NULL if unknown.
+ * @return true if the connection may be attempted, false otherwise.
+ */
+bool sdoRetryAllowed(sdoRetryEndpoint_t *ep)
+{
+	if (!ep || !policy.breakerThreshold ||
+	    ep->failures < policy.breakerThreshold)
+		return true;
+
+	return sdoTimeMs() >= ep->openUntil;
+}
+
+/**
+ * Record a successful protocol run with the server, closing its circuit.
+ *
+ * @param ep - failure tracking of the server, NULL if unknown.
+ */
+void sdoRetrySuccess(sdoRetryEndpoint_t *ep)
+{
+	if (!ep)
+		return;
+	ep->failures = 0;
+	ep->openUntil = 0;
+	if (ep == lastFailed)
+		lastFailed = NULL;
+}
+
+/**
+ * Record a failed protocol run with the server. The circuit opens (again)
+ * when the failures reach the threshold.
+ *
+ * @param ep - failure tracking of the server, NULL if unknown.
+ */
+void sdoRetryFailure(sdoRetryEndpoint_t *ep)
+{
+	if (!ep)
+		return;
+	lastFailed = ep;
+	/* the circuit is still open, the server was not even tried */
+	if (!sdoRetryAllowed(ep))
+		return;
+	if (ep->failures < UINT32_MAX)
+		ep->failures++;
+
+	if (policy.breakerThreshold &&
+	    ep->failures >= policy.breakerThreshold) {
+		ep->openUntil =
+		    sdoTimeMs() + (uint64_t)policy.breakerCooldownSec * 1000;
+		LOG(LOG_INFO,
+		    "Server failed %u times, pausing it for %u seconds\n",
+		    ep->failures, policy.breakerCooldownSec);
+	}
+}
+
+/**
+ * Internal API: full jitter delay of a retry, a random delay between 0 and
+ * min(cap, base * 2^attempt).
+ */
+static uint32_t retryJitterMs(uint32_t attempt)
+{
+	uint64_t ceiling;
+	uint32_t rnd;
+
+	if (attempt > 31)
+		attempt = 31;
+	ceiling = (uint64_t)policy.baseMs << attempt;
+	if (ceiling > policy.capMs)
+		ceiling = policy.capMs;
+
+	/* the device RNG differs per device, unlike an unseeded rand() */
+	if (sdoCryptoRandomBytes((uint8_t *)&rnd, sizeof(rnd)) != 0)
+		rnd = (uint32_t)sdoRandom();
+
+	return ceiling ? (uint32_t)(rnd % ceiling) : 0;
+}
+
+/**
+ * Wait before the given retry of a connection or message.
+ *
+ * @param attempt - 0 for the first retry, growing with each retry.
+ * @return false, without waiting, if the retry would start past the
+ * deadline of the protocol.
+ */
+bool sdoRetryBackoff(uint32_t attempt)
+{
+	uint32_t ms = retryAlign(retryJitterMs(attempt));
+
+	if (retryDeadline && sdoTimeMs() + ms >= retryDeadline) {
+		LOG(LOG_INFO, "No time left to retry\n");
+		return false;
+	}
+	LOG(LOG_DEBUG, "Retrying in %u ms\n", ms);
+	sdoRetryWait(ms, SDO_SLEEP_BACKOFF);
+	return true;
+}
+
+/**
+ * Delay before retrying the protocol that failed last. The delay grows
+ * with the consecutive failures of its server, and lasts at least until
+ * the circuit of the server closes again.
+ *
+ * @param minMs - delay added to the backoff, for ex: a delay requested by
+ * the rendezvous entry.
+ * @return delay in milliseconds.
+ */
+uint32_t sdoRetryDelay(uint32_t minMs)
+{
+	uint32_t failures = lastFailed ? lastFailed->failures : 1;
+	uint64_t ms = (uint64_t)minMs + retryJitterMs(failures - 1);
+	uint64_t now = sdoTimeMs();
+
+	if (lastFailed && !sdoRetryAllowed(lastFailed) &&
+	    lastFailed->openUntil - now > ms)
+		ms = lastFailed->openUntil - now;
+	if (ms > UINT32_MAX)
+		ms = UINT32_MAX;
+	ms = retryAlign((uint32_t)ms);
+
+	LOG(LOG_INFO, "Retrying in %u ms\n", (uint32_t)ms);
+	return (uint32_t)ms;
+}
@@ -0,0 +1,169 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Schema driven parsing and emitting of protocol message objects.
+ */
+
+#include "sdoschema.h"
+#include "util.h"
+#include "safe_lib.h"
+
+/**
+ * Internal API: set the value of an integer field.
+ */
+static void schemaSetUInt(void *p, uint8_t size, uint32_t v)
+{
+	switch (size) {
+	case 1:
+		*(uint8_t *)p = (uint8_t)v;
+		break;
+	case 2:
+		*(uint16_t *)p = (uint16_t)v;
+		break;
+	default:
+		*(uint32_t *)p = v;
+		break;
+	}
+}
+
+/**
+ * Internal API: the value of an integer field.
+ */
+static uint32_t schemaGetUInt(const void *p, uint8_t size)
+{
+	switch (size) {
+	case 1:
+		return *(const uint8_t *)p;
+	case 2:
+		return *(const uint16_t *)p;
+	default:
+		return *(const uint32_t *)p;
+	}
+}
+
+/**
+ * Internal API: read the value of a field into obj.
+ */
+static bool schemaReadField(SDOR_t *sdor, const SDOField_t *f, void *obj)
+{
+	void *p = (uint8_t *)obj + f->offset;
+	SDOByteArray_t **ba;
+
+	switch (f->type) {
+	case SDO_FIELD_TYPE_UINT:
+		schemaSetUInt(p, f->size, sdoReadUInt(sdor));
+		return true;
+	case SDO_FIELD_TYPE_BYTES:
+		ba = p;
+		if (!*ba) {
+			*ba = sdoByteArrayAlloc(0);
+			if (!*ba) {
+				LOG(LOG_ERROR, "Alloc failed\n");
+				return false;
+			}
+		}
+		return sdoByteArrayReadChars(sdor, *ba) > 0;
+	case SDO_FIELD_TYPE_SLICE:
+		return sdoByteSliceReadChars(sdor, p) > 0;
+	case SDO_FIELD_TYPE_CUSTOM:
+		return f->read && f->read(sdor, obj);
+	default:
+		return false;
+	}
+}
+
+/**
+ * Internal API: write the value of a field from obj.
+ */
+static bool schemaWriteField(SDOW_t *sdow, const SDOField_t *f,
+			     const void *obj)
+{
+	const void *p = (const uint8_t *)obj + f->offset;
+	SDOByteArray_t *ba;
+
+	switch (f->type) {
+	case SDO_FIELD_TYPE_UINT:
+		sdoWriteUInt(sdow, schemaGetUInt(p, f->size));
+		return true;
+	case SDO_FIELD_TYPE_BYTES:
+		ba = *(SDOByteArray_t *const *)p;
+		if (!ba)
+			return false;
+		sdoByteArrayWriteChars(sdow, ba);
+		return true;
+	case SDO_FIELD_TYPE_CUSTOM:
+		return f->write && f->write(sdow, obj);
+	default:
+		/* slices only refer to received data */
+		return false;
+	}
+}
+
+/**
+ * Parse a message object described by a schema, decoding every value into
+ * its member of obj.
+ *
+ * @param sdor - reader positioned at the '{' of the object.
+ * @param schema - tags of the object, in order.
+ * @param obj - struct the values are decoded into.
+ * @return true on success, false otherwise.
+ */
+bool sdoSchemaRead(SDOR_t *sdor, const SDOSchema_t *schema, void *obj)
+{
+	const SDOField_t *f;
+	int i;
+
+	if (!sdor || !schema || !obj)
+		return false;
+
+	if (!sdoRBeginObject(sdor))
+		return false;
+
+	for (i = 0; i < schema->numFields; i++) {
+		f = &schema->fields[i];
+		if (!sdoReadExpectedTagLen(sdor, f->tag, f->tagLen)) {
+			LOG(LOG_ERROR, "Expected \"%s\" tag\n", f->tag);
+			return false;
+		}
+		if (!schemaReadField(sdor, f, obj)) {
+			LOG(LOG_ERROR, "Invalid \"%s\" value\n", f->tag);
+			return false;
+		}
+	}
+
+	return sdoREndObject(sdor);
+}
+
+/**
+ * Emit a message object described by a schema, encoding every value from
+ * its member of obj.
+ *
+ * @param sdow - writer of the message.
+ * @param schema - tags of the object, in order.
+ * @param obj - struct the values are encoded from.
+ * @return true on success, false otherwise.
+ */
+bool sdoSchemaWrite(SDOW_t *sdow, const SDOSchema_t *schema, const void *obj)
+{
+	const SDOField_t *f;
+	int i;
+
+	if (!sdow || !schema || !obj)
+		return false;
+
+	sdoWBeginObject(sdow);
+	for (i = 0; i < schema->numFields; i++) {
+		f = &schema->fields[i];
+		sdoWriteTagLen(sdow, (char *)f->tag, f->tagLen);
+		if (!schemaWriteField(sdow, f, obj)) {
+			LOG(LOG_ERROR, "Failed to write \"%s\"\n", f->tag);
+			return false;
+		}
+	}
+	sdoWEndObject(sdow);
+	return true;
+}
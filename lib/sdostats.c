@@ -0,0 +1,193 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Statistics of the protocol runs.
+ *
+ * Each SDK instance has its own statistics, which the thread working on
+ * the instance binds along with its state. They count the messages
+ * exchanged per type (bytes, server wait, handling and crypto time,
+ * retries), the DI, TO1 and TO2 runs and the rendezvous entries TO1 used,
+ * so that the statistics of a fleet of devices can be aggregated to find
+ * its slow servers and slow devices. PROT_STATS=false leaves them out.
+ */
+
+#include "util.h"
+#include "sdoprot.h"
+#include "sdostats.h"
+#include "safe_lib.h"
+
+#if !defined(PROT_STATS_FALSE)
+/* Statistics of the instance of sdoSdkInit */
+static sdoSdkStats defaultStats;
+/* Statistics of the instance the calling thread works on */
+static SDO_THREAD_LOCAL sdoSdkStats *bound = &defaultStats;
+
+/* Histogram bucket of ms: 0 below 1ms, then one per power of two */
+static unsigned sdoStatsBucket(uint64_t ms)
+{
+	unsigned b = 0;
+
+	while (b < SDO_STATS_HIST_BUCKETS - 1 && ms >= ((uint64_t)1 << b))
+		b++;
+	return b;
+}
+
+static sdoSdkMsgStats *sdoStatsMsgOf(int msgType)
+{
+	if (msgType < SDO_STATS_MSG_FIRST || msgType > SDO_STATS_MSG_LAST)
+		return NULL;
+	return &bound->msg[msgType - SDO_STATS_MSG_FIRST];
+}
+
+/**
+ * Let the calling thread record into stats.
+ * @param stats - statistics of an SDK instance, NULL for those of the
+ * instance of sdoSdkInit.
+ */
+void sdoStatsBind(sdoSdkStats *stats)
+{
+	bound = stats ? stats : &defaultStats;
+}
+
+/**
+ * @return the statistics the calling thread records into.
+ */
+sdoSdkStats *sdoStatsGet(void)
+{
+	return bound;
+}
+
+/**
+ * Record the exchange of a message with its server.
+ * @param msgType - type of the message sent.
+ * @param txBytes - size of its body.
+ * @param rxBytes - size of the response body.
+ * @param waitUs - time from sending it to having the whole response.
+ * @param retries - times it was sent again over a new connection.
+ * @param error - true if it was answered by an error message, or not at
+ * all.
+ */
+void sdoStatsMsg(int msgType, uint32_t txBytes, uint32_t rxBytes,
+		 uint64_t waitUs, uint32_t retries, bool error)
+{
+	sdoSdkMsgStats *m = sdoStatsMsgOf(msgType);
+
+	if (!m)
+		return;
+	m->count++;
+	if (error)
+		m->errors++;
+	m->retries += retries;
+	m->txBytes += txBytes;
+	m->rxBytes += rxBytes;
+	m->waitUs += waitUs;
+	m->waitHist[sdoStatsBucket(waitUs / 1000)]++;
+}
+
+/**
+ * Record the handling of the response to a message.
+ * @param msgType - type of the message sent.
+ * @param parseUs - time the protocol took over the response, up to having
+ * the next message.
+ * @param cryptoUs - of that time, the time spent in crypto.
+ */
+void sdoStatsMsgParsed(int msgType, uint64_t parseUs, uint64_t cryptoUs)
+{
+	sdoSdkMsgStats *m = sdoStatsMsgOf(msgType);
+
+	if (!m)
+		return;
+	m->parseUs += parseUs;
+	m->cryptoUs += cryptoUs;
+}
+
+/**
+ * Record a run of the DI, TO1 or TO2 protocol.
+ * @param firstMsgType - type of the first message of the run, which tells
+ * the protocol.
+ * @param ms - duration of the run.
+ * @param success - true if the protocol completed.
+ */
+void sdoStatsPhase(int firstMsgType, uint32_t ms, bool success)
+{
+	sdoSdkPhaseStats *p;
+	uint32_t rv = bound->rvIndex;
+
+	if (firstMsgType >= SDO_DI_APP_START &&
+	    firstMsgType < SDO_TO1_TYPE_HELLO_SDO)
+		p = &bound->di;
+	else if (firstMsgType >= SDO_TO1_TYPE_HELLO_SDO &&
+		 firstMsgType < SDO_TO2_HELLO_DEVICE)
+		p = &bound->to1;
+	else if (firstMsgType >= SDO_TO2_HELLO_DEVICE &&
+		 firstMsgType <= SDO_TO2_DONE2)
+		p = &bound->to2;
+	else
+		return;
+
+	p->runs++;
+	p->lastMs = ms;
+	p->totalMs += ms;
+	p->hist[sdoStatsBucket(ms)]++;
+	if (success)
+		return;
+	p->failures++;
+	if (p == &bound->to1 && rv && rv <= SDO_STATS_RV_ENTRIES)
+		bound->rvFailures[rv - 1]++;
+}
+
+/**
+ * Record the rendezvous entry a TO1 run is about to use.
+ * @param rvIndex - entry of the rendezvous list, from 1.
+ */
+void sdoStatsRendezvous(uint32_t rvIndex)
+{
+	bound->rvIndex = rvIndex;
+	if (rvIndex && rvIndex <= SDO_STATS_RV_ENTRIES)
+		bound->rvRuns[rvIndex - 1]++;
+}
+#else
+void sdoStatsBind(sdoSdkStats *stats)
+{
+	(void)stats;
+}
+
+sdoSdkStats *sdoStatsGet(void)
+{
+	return NULL;
+}
+
+void sdoStatsMsg(int msgType, uint32_t txBytes, uint32_t rxBytes,
+		 uint64_t waitUs, uint32_t retries, bool error)
+{
+	(void)msgType;
+	(void)txBytes;
+	(void)rxBytes;
+	(void)waitUs;
+	(void)retries;
+	(void)error;
+}
+
+void sdoStatsMsgParsed(int msgType, uint64_t parseUs, uint64_t cryptoUs)
+{
+	(void)msgType;
+	(void)parseUs;
+	(void)cryptoUs;
+}
+
+void sdoStatsPhase(int firstMsgType, uint32_t ms, bool success)
+{
+	(void)firstMsgType;
+	(void)ms;
+	(void)success;
+}
+
+void sdoStatsRendezvous(uint32_t rvIndex)
+{
+	(void)rvIndex;
+}
+#endif
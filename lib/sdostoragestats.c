@@ -0,0 +1,168 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Accounting of the storage medium, with STORAGE_STATS=true.
+ *
+ * The storage backends report the blob API calls, the files they open,
+ * the bytes they read and write, the syncs they wait for and the time the
+ * HMACs and GCM seals of the blobs took. The writes are also counted per
+ * file, so that the wear of an eMMC or SD card over a device lifetime can
+ * be projected from a run. The counters are process wide, covering all SDK
+ * instances.
+ */
+
+#include "util.h"
+#include "network_al.h"
+#include "storage_stats.h"
+#include "safe_lib.h"
+#include <string.h>
+
+#if defined(STORAGE_STATS)
+static sdoSdkStorageStats storage_stats;
+SDO_MUTEX(storage_stats_lock);
+
+/**
+ * Account a call of sdoBlobRead, sdoBlobWrite or sdoBlobSize.
+ * @param api - the call.
+ */
+void sdoStorageStatsApi(sdoStorageApi api)
+{
+	SDO_LOCK(storage_stats_lock);
+	if (api == SDO_STORAGE_API_READ)
+		storage_stats.reads++;
+	else if (api == SDO_STORAGE_API_WRITE)
+		storage_stats.writes++;
+	else
+		storage_stats.sizes++;
+	SDO_UNLOCK(storage_stats_lock);
+}
+
+/**
+ * Account a file read from the medium.
+ * @param bytes - bytes read.
+ */
+void sdoStorageStatsRead(size_t bytes)
+{
+	SDO_LOCK(storage_stats_lock);
+	storage_stats.opens++;
+	storage_stats.bytesRead += bytes;
+	SDO_UNLOCK(storage_stats_lock);
+}
+
+/**
+ * Account a file written to the medium, in full.
+ * @param path - path of the file, counted by its name without the
+ * directory.
+ * @param bytes - bytes written.
+ */
+void sdoStorageStatsWrite(const char *path, size_t bytes)
+{
+	const char *name = path ? strrchr(path, '/') : NULL;
+	sdoSdkStorageFileStats *f = NULL;
+	int i;
+
+	name = name ? name + 1 : path;
+	SDO_LOCK(storage_stats_lock);
+	storage_stats.opens++;
+	storage_stats.bytesWritten += bytes;
+	for (i = 0; name && i < SDO_STORAGE_STATS_FILES; i++) {
+		f = &storage_stats.file[i];
+		if (!f->name[0]) {
+			if (strncpy_s(f->name, sizeof(f->name), name,
+				      sizeof(f->name) - 1) != 0)
+				f = NULL;
+			break;
+		}
+		if (!strncmp(f->name, name, sizeof(f->name)))
+			break;
+		f = NULL;
+	}
+	if (f) {
+		f->writes++;
+		f->bytes += bytes;
+	} else {
+		storage_stats.filesDropped++;
+	}
+	SDO_UNLOCK(storage_stats_lock);
+}
+
+/**
+ * Account a wait for the medium to persist the writes.
+ */
+void sdoStorageStatsSync(void)
+{
+	SDO_LOCK(storage_stats_lock);
+	storage_stats.syncs++;
+	SDO_UNLOCK(storage_stats_lock);
+}
+
+uint64_t sdoStorageStatsNow(void)
+{
+	return sdoTimeUs();
+}
+
+/**
+ * Account the HMAC or the GCM seal (or opening) of a blob.
+ * @param gcm - non-zero for GCM, zero for the HMAC.
+ * @param startUs - STORAGE_STATS_START before it.
+ */
+void sdoStorageStatsSeal(int gcm, uint64_t startUs)
+{
+	uint64_t us = sdoTimeUs() - startUs;
+
+	SDO_LOCK(storage_stats_lock);
+	if (gcm) {
+		storage_stats.gcms++;
+		storage_stats.gcmUs += us;
+	} else {
+		storage_stats.hmacs++;
+		storage_stats.hmacUs += us;
+	}
+	SDO_UNLOCK(storage_stats_lock);
+}
+#endif
+
+/**
+ * Copy out the storage counters.
+ * @param stats - out, the counters.
+ * @return 0 on success, -1 if stats is NULL or with STORAGE_STATS=false.
+ */
+int32_t sdoStorageStatsGet(sdoSdkStorageStats *stats)
+{
+#if defined(STORAGE_STATS)
+	int ret;
+
+	if (!stats)
+		return -1;
+	SDO_LOCK(storage_stats_lock);
+	ret = memcpy_s(stats, sizeof(*stats), &storage_stats,
+		       sizeof(storage_stats));
+	SDO_UNLOCK(storage_stats_lock);
+	return ret != 0 ? -1 : 0;
+#else
+	(void)stats;
+	return -1;
+#endif
+}
+
+/**
+ * Clear the storage counters.
+ * @return 0 on success, -1 with STORAGE_STATS=false.
+ */
+int32_t sdoStorageStatsReset(void)
+{
+#if defined(STORAGE_STATS)
+	int ret;
+
+	SDO_LOCK(storage_stats_lock);
+	ret = memset_s(&storage_stats, sizeof(storage_stats), 0);
+	SDO_UNLOCK(storage_stats_lock);
+	return ret != 0 ? -1 : 0;
+#else
+	return -1;
+#endif
+}
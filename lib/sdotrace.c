@@ -0,0 +1,131 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*!
+ * \file
+ * \brief Timeline of the onboarding runs.
+ *
+ * With TRACE_EVENTS=<n>, the protocol states, the network calls, the crypto
+ * operations and the storage I/O are recorded as spans into a ring buffer
+ * of the last n events, shared by all SDK instances and threads. The
+ * buffer is dumped in the Chrome trace event format, which chrome://tracing
+ * and Perfetto show as one timeline per thread.
+ */
+
+#include "sdo.h"
+#include "sdotrace.h"
+#include "util.h"
+#include <stdio.h>
+#include <inttypes.h>
+
+#if defined(SDO_TRACE)
+typedef struct {
+	const char *cat;
+	const char *name;
+	int32_t arg; // message type, size, ...; -1 for none
+	uint32_t tid;
+	uint64_t startUs;
+	uint64_t durUs;
+} sdoTraceEvent_t;
+
+static sdoTraceEvent_t ring[SDO_TRACE];
+static uint64_t recorded; // ring[recorded % SDO_TRACE] is the next
+static uint32_t threads;
+SDO_MUTEX(trace_lock);
+
+/* Timeline of the calling thread, numbered from 1 on its first event */
+static SDO_THREAD_LOCAL uint32_t tid;
+
+/**
+ * Record a span that has just ended.
+ * @param cat - category: "state", "net", "crypto" or "storage".
+ * @param name - name of the span, a string literal.
+ * @param arg - shown after the name, -1 for none.
+ * @param startUs - sdoTimeUs() at the start of the span.
+ */
+void sdoTraceEvent(const char *cat, const char *name, int32_t arg,
+		   uint64_t startUs)
+{
+	uint64_t now = sdoTimeUs();
+	sdoTraceEvent_t *e;
+
+	SDO_LOCK(trace_lock);
+	if (!tid)
+		tid = ++threads;
+	e = &ring[recorded++ % SDO_TRACE];
+	e->cat = cat;
+	e->name = name;
+	e->arg = arg;
+	e->tid = tid;
+	e->startUs = startUs;
+	e->durUs = now - startUs;
+	SDO_UNLOCK(trace_lock);
+}
+#endif
+
+/**
+ * Writes the recorded events, oldest first, as Chrome trace JSON: open the
+ * file in chrome://tracing or ui.perfetto.dev. The buffer keeps the last
+ * TRACE_EVENTS events.
+ *
+ * @param path - file to write.
+ * @return SDO_SUCCESS, SDO_ERROR if the file cannot be written or the SDK
+ * is built without TRACE_EVENTS.
+ */
+sdoSdkStatus sdoSdkTraceDump(const char *path)
+{
+#if defined(SDO_TRACE)
+	FILE *fp;
+	uint64_t i, first;
+	sdoTraceEvent_t *e;
+	int err = 0;
+
+	if (!path)
+		return SDO_ERROR;
+	fp = fopen(path, "w");
+	if (!fp)
+		return SDO_ERROR;
+
+	SDO_LOCK(trace_lock);
+	first = recorded > SDO_TRACE ? recorded - SDO_TRACE : 0;
+	err |= fprintf(fp, "{\"traceEvents\":[\n") < 0;
+	for (i = first; i < recorded && !err; i++) {
+		e = &ring[i % SDO_TRACE];
+		err |= fprintf(fp, "%s{\"name\":\"%s", i == first ? "" : ",\n",
+			       e->name) < 0;
+		if (e->arg >= 0)
+			err |= fprintf(fp, " %" PRId32, e->arg) < 0;
+		err |= fprintf(fp,
+			       "\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%" PRIu64
+			       ",\"dur\":%" PRIu64 ",\"pid\":1,\"tid\":%" PRIu32
+			       "}",
+			       e->cat, e->startUs, e->durUs, e->tid) < 0;
+	}
+	SDO_UNLOCK(trace_lock);
+	err |= fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n") < 0;
+	err |= fclose(fp) != 0;
+	return err ? SDO_ERROR : SDO_SUCCESS;
+#else
+	(void)path;
+	return SDO_ERROR;
+#endif
+}
+
+/**
+ * Drops the recorded events.
+ *
+ * @return SDO_SUCCESS, SDO_ERROR if the SDK is built without TRACE_EVENTS.
+ */
+sdoSdkStatus sdoSdkTraceClear(void)
+{
+#if defined(SDO_TRACE)
+	SDO_LOCK(trace_lock);
+	recorded = 0;
+	SDO_UNLOCK(trace_lock);
+	return SDO_SUCCESS;
+#else
+	return SDO_ERROR;
+#endif
+}
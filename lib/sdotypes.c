@@ -12,6 +12,7 @@
 #include "sdoprot.h"
 #include "base64.h"
 #include "sdotypes.h"
+#include "sdocbor.h"
 #include "network_al.h"
 #include "sdoCryptoApi.h"
 #include "util.h"
@@ -22,6 +23,35 @@
 #include "safe_lib.h"
 #include "snprintf_s.h"
 #include "sdodeviceinfo.h"
+#include "sdoosicache.h"
+
+#if defined(TARGET_OS_LINUX) && !defined(DSI_ASYNC_FALSE)
+#define DSI_ASYNC_WORKER
+#endif
+#if defined(TARGET_OS_LINUX) && !defined(OSI_ASYNC_FALSE)
+#define OSI_ASYNC_WORKER
+#endif
+#if defined(DSI_ASYNC_WORKER) || defined(OSI_ASYNC_WORKER)
+#include <pthread.h>
+#include "task_al.h"
+#endif
+
+/* A hash allocated along with its byte array, see sdoHashAlloc */
+typedef struct {
+	SDOHash_t h;
+	SDOBits_t bits;
+} SDOHashInline_t;
+
+/**
+ * Internal API: free the bytes of b, unless they were allocated along with
+ * b, right after it (see sdoBitsAlloc)
+ */
+static void sdoBitsFreeBytes(SDOBits_t *b)
+{
+	if (b->bytes && b->bytes != (uint8_t *)(b + 1))
+		sdoFree(b->bytes);
+	b->bytes = NULL;
+}
 
 /**
  * Allocate and Initialize the bits
@@ -41,10 +71,7 @@ SDOBits_t *sdoBitsInit(SDOBits_t *b, int byteSz)
 		b->byteSz = byteSz;
 		return b;
 	} else {
-		if (b->bytes) {
-			sdoFree(b->bytes);
-			b->bytes = NULL;
-		}
+		sdoBitsFreeBytes(b);
 		b->byteSz = 0;
 	}
 	return b;
@@ -57,7 +84,19 @@ SDOBits_t *sdoBitsInit(SDOBits_t *b, int byteSz)
  */
 SDOBits_t *sdoBitsAlloc(int byteSz)
 {
-	SDOBits_t *b = sdoAlloc(sizeof(SDOBits_t));
+	SDOBits_t *b;
+
+	/* Small ones in one allocation, the bytes right after the bits */
+	if (byteSz > 0 && byteSz <= SDO_BITS_INLINE) {
+		b = sdoAlloc(sizeof(SDOBits_t) + byteSz);
+		if (b == NULL)
+			return NULL;
+		b->bytes = (uint8_t *)(b + 1);
+		b->byteSz = byteSz;
+		return b;
+	}
+
+	b = sdoAlloc(sizeof(SDOBits_t));
 	if (b == NULL)
 		return NULL;
 
@@ -78,7 +117,7 @@ SDOBits_t *sdoBitsAllocWith(int byteSz, uint8_t *data)
 	SDOBits_t *b = sdoBitsAlloc(byteSz);
 	if (b == NULL)
 		return NULL;
-	if (!sdoBitsFill(&b)) {
+	if (!b->bytes && !sdoBitsFill(&b)) {
 		sdoBitsFree(b);
 		return NULL;
 	}
@@ -113,8 +152,7 @@ void sdoBitsEmpty(SDOBits_t *b)
 	if (b->bytes) {
 		if (b->byteSz && memset_s(b->bytes, b->byteSz, 0))
 			LOG(LOG_ERROR, "Failed to clear memory\n");
-		sdoFree(b->bytes);
-		b->bytes = NULL;
+		sdoBitsFreeBytes(b);
 	}
 	b->byteSz = 0;
 }
@@ -158,10 +196,7 @@ bool sdoBitsFill(SDOBits_t **bits)
 		return false;
 
 	b = *bits;
-	if (b->bytes != NULL) {
-		sdoFree(b->bytes);
-		b->bytes = NULL;
-	}
+	sdoBitsFreeBytes(b);
 	b->bytes = sdoAlloc(b->byteSz);
 	if (b->bytes == NULL)
 		return false;
@@ -515,6 +550,39 @@ SDOByteArray_t *sdoByteArrayAlloc(int byteSz)
 	return sdoBitsAlloc(byteSz);
 }
 
+/**
+ * Allocate a byte array used only while the current message is processed,
+ * see sdoAllocTransient()
+ * @param byteSz - number of bytes to be allocated
+ * @return pointer to the byte array if success else NULL
+ */
+SDOByteArray_t *sdoByteArrayAllocTransient(int byteSz)
+{
+	SDOByteArray_t *ba;
+
+	if (byteSz > 0 && byteSz <= SDO_BITS_INLINE) {
+		ba = sdoAllocTransient(sizeof(SDOByteArray_t) + byteSz);
+		if (!ba)
+			return NULL;
+		ba->bytes = (uint8_t *)(ba + 1);
+		ba->byteSz = byteSz;
+		return ba;
+	}
+
+	ba = sdoAllocTransient(sizeof(SDOByteArray_t));
+	if (!ba)
+		return NULL;
+	if (byteSz > 0) {
+		ba->bytes = sdoAllocTransient(byteSz);
+		if (!ba->bytes) {
+			sdoFree(ba);
+			return NULL;
+		}
+		ba->byteSz = byteSz;
+	}
+	return ba;
+}
+
 /**
  * Allocate and initialize the bytes
  * @param val - value to the initialized
@@ -691,10 +759,7 @@ int sdoByteArrayReadChars(SDOR_t *sdor, SDOByteArray_t *ba)
 	if (!sdor || !ba)
 		return 0;
 
-	if (ba->bytes) {
-		sdoFree(ba->bytes);
-		ba->bytes = NULL;
-	}
+	sdoBitsFreeBytes(ba);
 
 	int b64Len = sdoReadStringSz(sdor);
 	// LOG(LOG_ERROR, "b64LenReported %d\n", b64Len);
@@ -733,10 +798,7 @@ int sdoByteArrayRead(SDOR_t *sdor, SDOByteArray_t *ba)
 		return 0;
 
 	/*FIXME: if unnecessary remove it */
-	if (ba->bytes) {
-		sdoFree(ba->bytes);
-		ba->bytes = NULL;
-	}
+	sdoBitsFreeBytes(ba);
 
 	int binLenReported = sdoReadUInt(sdor);
 	// Determine the needed length
@@ -797,7 +859,7 @@ int sdoByteArrayReadWithType(SDOR_t *sdor, SDOByteArray_t *ba,
 		LOG(LOG_ERROR, "Incorrect arguments passed!\n");
 		goto err;
 	}
-	*ctString = sdoByteArrayAlloc(ct_size);
+	*ctString = sdoByteArrayAllocTransient(ct_size);
 
 	if (NULL == *ctString) {
 		LOG(LOG_ERROR, "Failed to alloc buffer!\n");
@@ -860,7 +922,7 @@ int sdoByteArrayReadWithType(SDOR_t *sdor, SDOByteArray_t *ba,
 	if (ba->bytes)
 		goto err;
 
-	ba->bytes = sdoAlloc(binLenReported * sizeof(uint8_t));
+	ba->bytes = sdoAllocTransient(binLenReported * sizeof(uint8_t));
 
 	if (!ba->bytes)
 		goto err;
@@ -873,6 +935,186 @@ err:
 	return ret;
 }
 
+/* A slice is decoded in chunks of this many base64 characters */
+#define SDO_SLICE_CHUNK_B64 64
+#define SDO_SLICE_CHUNK_BIN (SDO_SLICE_CHUNK_B64 / 4 * 3)
+
+/**
+ * Internal API: decode the chunk of a byte array slice starting at pos
+ * @return number of bytes decoded into buf, -1 if the chunk is invalid
+ */
+static int byteSliceChunk(const SDOByteSlice_t *bs, size_t pos, uint8_t *buf)
+{
+	size_t n = bs->b64Sz - pos;
+
+	if (n > SDO_SLICE_CHUNK_B64)
+		n = SDO_SLICE_CHUNK_B64;
+
+	/* Padding may only end the whole string, not a chunk of it */
+	if (pos + n < bs->b64Sz && bs->b64[pos + n - 1] == '=')
+		return -1;
+
+	return b64ToBin(n, (uint8_t *)bs->b64, pos, SDO_SLICE_CHUNK_BIN, buf,
+			0);
+}
+
+/**
+ * Internal API: point the slice to the base64 field at the cursor and
+ * validate it, without keeping the decoded bytes
+ */
+static bool byteSliceInit(SDOR_t *sdor, SDOByteSlice_t *bs, int b64Sz)
+{
+	uint8_t chunk[SDO_SLICE_CHUNK_BIN];
+	uint8_t *text;
+	size_t pos;
+	int n;
+
+	bs->b64 = NULL;
+	bs->b64Sz = 0;
+	bs->byteSz = 0;
+	bs->raw = sdor->encoding == SDO_ENCODING_CBOR;
+
+	if (b64Sz < 0 || b64Sz % 4 != 0) {
+		LOG(LOG_ERROR, "Invalid input B64 string!\n");
+		return false;
+	}
+	if (bs->raw) {
+		if (!sdoCborReadBytes(sdor, b64Sz, &bs->b64, &b64Sz))
+			return false;
+	} else if (!sdoReadByteArrayText(sdor, b64Sz, &bs->b64)) {
+		return false;
+	}
+	bs->b64Sz = b64Sz;
+
+	/* A streamed block moves as more of the message is received, the
+	 * text is copied out of it */
+	if (sdoRStreaming(sdor) && b64Sz) {
+		text = sdoAllocTransient(b64Sz);
+		if (!text || memcpy_s(text, b64Sz, bs->b64, b64Sz) != 0) {
+			bs->b64 = NULL;
+			bs->b64Sz = 0;
+			return false;
+		}
+		bs->b64 = text;
+	}
+
+	if (bs->raw) {
+		bs->byteSz = bs->b64Sz;
+		return true;
+	}
+
+	for (pos = 0; pos < bs->b64Sz; pos += SDO_SLICE_CHUNK_B64) {
+		n = byteSliceChunk(bs, pos, chunk);
+		if (n < 0) {
+			LOG(LOG_ERROR, "Base64 string is invalid!\n");
+			bs->b64 = NULL;
+			bs->b64Sz = 0;
+			bs->byteSz = 0;
+			return false;
+		}
+		bs->byteSz += n;
+	}
+	return true;
+}
+
+/**
+ * Read a base64 byte array, "byte array in base64", as a slice of the
+ * SDOR block
+ * @param sdor - data to be read in the form of JSON
+ * @param bs - slice set to the byte array
+ * @return the length of the byte array if success else zero
+ */
+int sdoByteSliceReadChars(SDOR_t *sdor, SDOByteSlice_t *bs)
+{
+	if (!sdor || !bs)
+		return 0;
+
+	if (!byteSliceInit(sdor, bs, sdoReadStringSz(sdor)))
+		return 0;
+
+	LOG(LOG_DEBUG, "Byte Array len %zu\n", bs->byteSz);
+	return bs->byteSz;
+}
+
+/**
+ * Read a base64 byte array, len,"byte array in base64", as a slice of the
+ * SDOR block
+ * @param sdor - data to be read in the form of JSON
+ * @param bs - slice set to the byte array
+ * @return the length of the byte array if success else zero
+ */
+int sdoByteSliceRead(SDOR_t *sdor, SDOByteSlice_t *bs)
+{
+	int binLenReported, b64Len;
+
+	if (!sdor || !bs)
+		return 0;
+
+	binLenReported = sdoReadUInt(sdor);
+	b64Len = binToB64Length(binLenReported);
+	if (!b64Len)
+		return 0;
+
+	if (!byteSliceInit(sdor, bs, b64Len))
+		return 0;
+	return bs->byteSz;
+}
+
+/**
+ * Decode a byte array slice into a buffer
+ * @param bs - slice to be decoded
+ * @param buf - buffer for the decoded bytes
+ * @param bufSz - size of buf, at least the length of the byte array
+ * @return the number of bytes decoded if success else zero
+ */
+int sdoByteSliceCopy(const SDOByteSlice_t *bs, uint8_t *buf, size_t bufSz)
+{
+	int n;
+
+	if (!bs || !buf || !bs->byteSz || bufSz < bs->byteSz)
+		return 0;
+
+	if (bs->raw)
+		return memcpy_s(buf, bufSz, bs->b64, bs->byteSz) ? 0 : bs->byteSz;
+
+	n = b64ToBin(bs->b64Sz, (uint8_t *)bs->b64, 0, bufSz, buf, 0);
+	return n < 0 ? 0 : n;
+}
+
+/**
+ * Compare a byte array slice with bytes, decoding it piece by piece
+ * @param bs - slice to be compared
+ * @param bytes - bytes to compare with
+ * @param len - length of bytes
+ * @return true if both hold the same bytes, false otherwise
+ */
+bool sdoByteSliceEqual(const SDOByteSlice_t *bs, const uint8_t *bytes,
+		       size_t len)
+{
+	uint8_t chunk[SDO_SLICE_CHUNK_BIN];
+	size_t pos, off = 0;
+	int n, result_memcmp = 0;
+
+	if (!bs || !bytes || bs->byteSz != len)
+		return false;
+
+	if (bs->raw)
+		return !len || (!memcmp_s(bs->b64, len, bytes, len,
+					  &result_memcmp) &&
+				!result_memcmp);
+
+	for (pos = 0; pos < bs->b64Sz; pos += SDO_SLICE_CHUNK_B64) {
+		n = byteSliceChunk(bs, pos, chunk);
+		if (n <= 0 || (size_t)n > len - off)
+			return false;
+		if (memcmp_s(chunk, n, &bytes[off], n, &result_memcmp) ||
+		    result_memcmp)
+			return false;
+		off += n;
+	}
+	return off == len;
+}
+
 /**
  * Byte array is represented as "byte array in base64"
  * @param sdow - pointer to the written data
@@ -1589,6 +1831,22 @@ char *sdoNonceToString(uint8_t *n, char *buf, int bufSz)
 	return buf;
 }
 
+/**
+ * convert a nonce slice to string
+ * @param n - pointer to the input nonce slice
+ * @param buf - pointer to the converted string
+ * @param bufSz - size of the converted string
+ * @return pointer to the converted string
+ */
+char *sdoNonceSliceToString(const SDOByteSlice_t *n, char *buf, int bufSz)
+{
+	uint8_t nonce[SDO_NONCE_BYTES];
+
+	if (sdoByteSliceCopy(n, nonce, sizeof(nonce)) != SDO_NONCE_BYTES)
+		return NULL;
+	return sdoNonceToString(nonce, buf, bufSz);
+}
+
 //------------------------------------------------------------------------------
 // Hash/HMAC Routines
 //
@@ -1613,7 +1871,22 @@ SDOHash_t *sdoHashAllocEmpty(void)
  */
 SDOHash_t *sdoHashAlloc(int hashType, int size)
 {
-	SDOHash_t *hp = sdoAlloc(sizeof(SDOHash_t));
+	SDOHashInline_t *hi;
+	SDOHash_t *hp;
+
+	/* Small ones in one allocation: hash, byte array, then bytes */
+	if (size > 0 && size <= SDO_BITS_INLINE) {
+		hi = sdoAlloc(sizeof(SDOHashInline_t) + size);
+		if (hi == NULL)
+			return NULL;
+		hi->h.hashType = hashType;
+		hi->bits.bytes = (uint8_t *)(hi + 1);
+		hi->bits.byteSz = size;
+		hi->h.hash = &hi->bits;
+		return &hi->h;
+	}
+
+	hp = sdoAlloc(sizeof(SDOHash_t));
 	if (hp == NULL)
 		return NULL;
 	hp->hashType = hashType;
@@ -1625,6 +1898,19 @@ SDOHash_t *sdoHashAlloc(int hashType, int size)
 	return hp;
 }
 
+/**
+ * Internal API: free the byte array of a hash, only emptying it if it was
+ * allocated along with the hash
+ */
+static void sdoHashBitsFree(SDOHash_t *hp)
+{
+	if (hp->hash == &((SDOHashInline_t *)hp)->bits)
+		sdoBitsEmpty(hp->hash);
+	else
+		sdoByteArrayFree(hp->hash);
+	hp->hash = NULL;
+}
+
 /**
  * Free the allocated struct of type hash type
  * @param hp - pointer to the struct of type hash that is to be sdoFree
@@ -1634,10 +1920,8 @@ void sdoHashFree(SDOHash_t *hp)
 	if (NULL == hp) {
 		return;
 	}
-	if (hp->hash != NULL) {
-		sdoByteArrayFree(hp->hash);
-		hp->hash = NULL;
-	}
+	if (hp->hash != NULL)
+		sdoHashBitsFree(hp);
 	sdoFree(hp);
 }
 
@@ -1649,7 +1933,7 @@ void sdoHashFree(SDOHash_t *hp)
  */
 char *sdoHashTypeToString(int hashType)
 {
-	static char buf[25];
+	static SDO_THREAD_LOCAL char buf[25];
 	switch (hashType) {
 	case SDO_CRYPTO_HASH_TYPE_NONE:
 		return "NONE";
@@ -1760,7 +2044,7 @@ int sdoHashRead(SDOR_t *sdor, SDOHash_t *hp)
 
 	if (mbinLenReported &&
 	    sdoBitsResize(hp->hash, mbinLenReported + 3) == false) {
-		sdoByteArrayFree(hp->hash);
+		sdoHashBitsFree(hp);
 		LOG(LOG_ERROR, "SDOBitsResize failed\n");
 		return 0;
 	}
@@ -1786,6 +2070,46 @@ int sdoHashRead(SDOR_t *sdor, SDOHash_t *hp)
 	return wasRead;
 }
 
+/**
+ * Read the hash from JSON format as a slice of the SDOR block
+ * @param sdor - input data in JSON format
+ * @param hashType - set to the type of the hash
+ * @param bs - slice set to the hash value
+ * @return length of the hash, 0 if read failed
+ */
+int sdoHashSliceRead(SDOR_t *sdor, int *hashType, SDOByteSlice_t *bs)
+{
+	int binLenReported, b64LenReported;
+
+	if (!sdor || !hashType || !bs)
+		return 0;
+
+	if (!sdoRBeginSequence(sdor)) {
+		LOG(LOG_ERROR, "Not at beginning of sequence\n");
+		return 0;
+	}
+
+	binLenReported = sdoReadUInt(sdor);
+	*hashType = sdoReadUInt(sdor);
+
+	b64LenReported = sdoReadStringSz(sdor);
+	if (b64LenReported <= 0 ||
+	    b64LenReported != binToB64Length(binLenReported)) {
+		LOG(LOG_ERROR, "Incoming B64 string length is not proportional "
+			       "to binary length reported!\n");
+		return 0;
+	}
+
+	if (!byteSliceInit(sdor, bs, b64LenReported))
+		return 0;
+
+	if (!sdoREndSequence(sdor)) {
+		LOG(LOG_ERROR, "End Sequence not found!\n");
+		return 0;
+	}
+	return bs->byteSz;
+}
+
 /**
  * Write the hash type
  * @param sdow - pointer to the output struct of type JSON message
@@ -2155,9 +2479,9 @@ SDOPublicKey_t *sdoPublicKeyAlloc(int pkalg, int pkenc, int pklen,
 }
 
 /**
- * Clone the public key
+ * Take a reference to the public key, released with sdoPublicKeyFree()
  * @param pk 0 pointer to the public key that is to be cloned
- * @return pointer to the cloned public key
+ * @return pk, or NULL if it is not a complete key
  */
 SDOPublicKey_t *sdoPublicKeyClone(SDOPublicKey_t *pk)
 {
@@ -2167,17 +2491,8 @@ SDOPublicKey_t *sdoPublicKeyClone(SDOPublicKey_t *pk)
 	if (!pk->key1 || !pk->pkenc || !pk->pkalg)
 		return NULL;
 
-	SDOPublicKey_t *npk = sdoPublicKeyAlloc(
-	    pk->pkalg, pk->pkenc, pk->key1->byteSz, pk->key1->bytes);
-	if (!npk) {
-		LOG(LOG_ERROR, "failed to alloc public key struct\n");
-		return NULL;
-	}
-	if (pk->key2 != NULL) {
-		npk->key2 = sdoByteArrayAllocWithByteArray(pk->key2->bytes,
-							   pk->key2->byteSz);
-	}
-	return npk;
+	pk->refs++;
+	return pk;
 }
 
 /**
@@ -2199,6 +2514,10 @@ bool sdoComparePublicKeys(SDOPublicKey_t *pk1, SDOPublicKey_t *pk2)
 	    !pk1->pkalg || !pk2->pkalg)
 		return false;
 
+	/* References to the same key */
+	if (pk1 == pk2)
+		return true;
+
 	if (pk1->pkalg != pk2->pkalg)
 		return false;
 
@@ -2222,17 +2541,23 @@ bool sdoComparePublicKeys(SDOPublicKey_t *pk1, SDOPublicKey_t *pk2)
 }
 
 /**
- * Free the allocated public key
+ * Drop a reference to the public key, freeing it with the last one
  * @param pk - pointer to the public key that is to be sdoFreed
  */
 void sdoPublicKeyFree(SDOPublicKey_t *pk)
 {
 	if (!pk)
 		return;
+	if (pk->refs) {
+		pk->refs--;
+		return;
+	}
 	sdoByteArrayFree(pk->key1);
 	if (pk->key2) {
 		sdoByteArrayFree(pk->key2);
 	}
+	if (pk->pkh)
+		sdoHashFree(pk->pkh);
 	sdoFree(pk);
 }
 
@@ -2243,7 +2568,7 @@ void sdoPublicKeyFree(SDOPublicKey_t *pk)
  */
 char *sdoPKAlgToString(int alg)
 {
-	static char buf[25];
+	static SDO_THREAD_LOCAL char buf[25];
 	switch (alg) {
 	case SDO_CRYPTO_PUB_KEY_ALGO_NONE:
 		return "AlgNONE";
@@ -2268,7 +2593,7 @@ char *sdoPKAlgToString(int alg)
  */
 char *sdoPKEncToString(int enc)
 {
-	static char buf[25];
+	static SDO_THREAD_LOCAL char buf[25];
 	switch (enc) {
 	case SDO_CRYPTO_PUB_KEY_ENCODING_X509:
 		return "EncX509";
@@ -2311,7 +2636,7 @@ void sdoPublicKeyWrite(SDOW_t *sdow, SDOPublicKey_t *pk)
 	sdoWriteUInt(sdow, pk->pkalg);
 	sdoWriteUInt(sdow, pk->pkenc);
 	sdoWriteByteArray(sdow, pk->key1->bytes, pk->key1->byteSz);
-	if (pk->pkenc == SDO_CRYPTO_PUB_KEY_ENCODING_RSA_MOD_EXP) {
+	if (SDO_PK_IS_RSA(pk)) {
 		sdoWriteByteArray(sdow, pk->key2->bytes, pk->key2->byteSz);
 	}
 	sdoWEndSequence(sdow);
@@ -2508,6 +2833,11 @@ SDOPublicKey_t *sdoPublicKeyRead(SDOR_t *sdor)
 
 	if (!pkalg || !pkenc)
 		goto err;
+	if (!SDO_SUITE_KEY(pkenc, pkalg)) {
+		LOG(LOG_ERROR, "Public key %d/%d not of the suite\n", pkalg,
+		    pkenc);
+		goto err;
+	}
 
 	if (!sdoRBeginSequence(sdor))
 		goto err;
@@ -2592,14 +2922,11 @@ SDORendezvous_t *sdoRendezvousAlloc(void)
 }
 
 /**
- * Free the allocated rendezvous struct
+ * Free the members of a rendezvous, leaving it empty
  * @param rv - pointer to the struct of type rendezvous
  */
-void sdoRendezvousFree(SDORendezvous_t *rv)
+static void sdoRendezvousClear(SDORendezvous_t *rv)
 {
-	if (!rv)
-		return;
-
 	if (rv->only != NULL)
 		sdoStringFree(rv->only);
 
@@ -2642,6 +2969,20 @@ void sdoRendezvousFree(SDORendezvous_t *rv)
 	if (rv->delaysec != NULL)
 		sdoFree(rv->delaysec);
 
+	if (memset_s(rv, sizeof(*rv), 0) != 0)
+		LOG(LOG_ERROR, "Memset Failed\n");
+}
+
+/**
+ * Free the allocated rendezvous struct
+ * @param rv - pointer to the struct of type rendezvous
+ */
+void sdoRendezvousFree(SDORendezvous_t *rv)
+{
+	if (!rv)
+		return;
+
+	sdoRendezvousClear(rv);
 	sdoFree(rv);
 }
 
@@ -2743,7 +3084,6 @@ bool sdoRendezvousWrite(SDOW_t *sdow, SDORendezvous_t *rv)
 /*
  * This is a lookup on all possible strings
  */
-#define BADKEY -1
 #define ONLY 1
 #define IP 2
 #define PO 3
@@ -2759,50 +3099,17 @@ bool sdoRendezvousWrite(SDOW_t *sdow, SDORendezvous_t *rv)
 #define PR 13
 #define DELAYSEC 14
 
-typedef struct {
-	char *key;
-	int val;
-} t_symstruct;
-
-static t_symstruct lookuptable[] = {{"only", ONLY}, {"ip", IP},
-				    {"po", PO},     {"pow", POW},
-				    {"dn", DN},     {"sch", SCH},
-				    {"cch", CCH},   {"ui", UI},
-				    {"ss", SS},     {"pw", PW},
-				    {"wsp", WSP},   {"me", ME},
-				    {"pr", PR},     {"delaysec", DELAYSEC}};
-
-#define NKEYS (sizeof(lookuptable) / sizeof(t_symstruct))
+/* Keys of a rendezvous entry, sorted by length then by bytes */
+static const SDOTagKey_t rvKeys[] = {
+    SDO_TAG_KEY("dn", DN),     SDO_TAG_KEY("ip", IP),
+    SDO_TAG_KEY("me", ME),     SDO_TAG_KEY("po", PO),
+    SDO_TAG_KEY("pr", PR),     SDO_TAG_KEY("pw", PW),
+    SDO_TAG_KEY("ss", SS),     SDO_TAG_KEY("ui", UI),
+    SDO_TAG_KEY("cch", CCH),   SDO_TAG_KEY("pow", POW),
+    SDO_TAG_KEY("sch", SCH),   SDO_TAG_KEY("wsp", WSP),
+    SDO_TAG_KEY("only", ONLY), SDO_TAG_KEY("delaysec", DELAYSEC)};
 
-/**
- * Search the lookuptable for the string passed
- * @param key - key to be searched for
- * @return key if success else error code
- */
-int keyfromstring(char *key)
-{
-	size_t i;
-	int res = 1;
-	if (!key)
-		return BADKEY;
-
-	for (i = 0; i < NKEYS; i++) {
-		// t_symstruct *sym = lookuptable + i*sizeof(t_symstruct);
-		t_symstruct *sym = &lookuptable[i];
-		int symkeylen = strnlen_s(sym->key, SDO_MAX_STR_SIZE);
-		if (!symkeylen || symkeylen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_DEBUG, "Strnlen Failed");
-			continue;
-		}
-		strcmp_s(sym->key, symkeylen, key, &res);
-		if (res == 0) {
-			return sym->val;
-		}
-	}
-	LOG(LOG_ERROR, "returns BADKEY\n");
-
-	return BADKEY;
-}
+#define NKEYS (sizeof(rvKeys) / sizeof(rvKeys[0]))
 
 /**
  * Read the rendezvous from the input buffer
@@ -2828,30 +3135,16 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 	LOG(LOG_DEBUG, "sdoRendezvousRead started\n");
 
 	int index, result;
-	size_t keyBufSz = 24;
-	char keyBuf[keyBufSz];
 	size_t strBufSz = 80;
 	char strBuf[strBufSz];
 
 	rv->numParams = 0;
 
 	for (index = 0; index < numRvEntries; index++) {
-		if (memset_s(keyBuf, keyBufSz, 0) != 0) {
-			LOG(LOG_ERROR, "Memset Failed\n");
-			return false;
-		}
-
-		int strLen = sdoReadString(sdor, keyBuf, keyBufSz);
-		if (strLen == 0 || strLen > (int)keyBufSz)
-			ret = false;
-
-		// Parse the values found
-		switch (keyfromstring(keyBuf)) {
+		// Parse the values found, the key is compared in place
+		switch (sdoReadTagKey(sdor, rvKeys, NKEYS)) {
 
 		case ONLY:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -2877,9 +3170,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case IP:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->ip = sdoIPAddressAlloc();
 			if (!rv->ip) {
 				LOG(LOG_ERROR, "Rendezvous ip alloc failed\n");
@@ -2893,9 +3183,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case PO:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->po =
 			    sdoAlloc(sizeof(uint32_t)); // Allocate an integer
 			if (!rv->po) {
@@ -2908,9 +3195,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 
 		/* valid only for OWNER */
 		case POW:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->pow = sdoAlloc(sizeof(uint32_t));
 			if (!rv->pow) {
 				LOG(LOG_ERROR, "Rendezvous pow alloc fail\n");
@@ -2921,9 +3205,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case DN:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -2941,9 +3222,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case SCH:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->sch = sdoHashAllocEmpty();
 			if (!rv->sch) {
 				LOG(LOG_ERROR, "Rendezvous ss alloc failed\n");
@@ -2954,9 +3232,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case CCH:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->cch = sdoHashAllocEmpty();
 			if (!rv->cch) {
 				LOG(LOG_ERROR, "Rendezvous cch alloc fail\n");
@@ -2967,9 +3242,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case UI:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->ui =
 			    sdoAlloc(sizeof(uint32_t)); // Allocate an integer
 			if (!rv->ui) {
@@ -2982,9 +3254,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case SS:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -3001,9 +3270,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case PW:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -3020,9 +3286,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case WSP:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -3039,9 +3302,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case ME:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -3058,9 +3318,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case PR:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			if (memset_s(strBuf, strBufSz, 0) != 0) {
 				LOG(LOG_ERROR, "Memset Failed\n");
 				return false;
@@ -3078,9 +3335,6 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 			break;
 
 		case DELAYSEC:
-			if (!sdoReadTagFinisher(sdor))
-				return false;
-
 			rv->delaysec = sdoAlloc(sizeof(uint32_t));
 			if (!rv->delaysec) {
 				LOG(LOG_ERROR, "Alloc failed \n");
@@ -3095,8 +3349,7 @@ bool sdoRendezvousRead(SDOR_t *sdor, SDORendezvous_t *rv)
 
 		default:
 			LOG(LOG_ERROR,
-			    "sdoRendezvousRead : Unknown Entry Type %s\n",
-			    keyBuf);
+			    "sdoRendezvousRead : Unknown Entry Type\n");
 			ret = false; // Abort due to unexpected value for key
 			break;
 		}
@@ -3154,16 +3407,56 @@ char *sdoRendezvousToString(SDORendezvous_t *rv, char *buf, int bufsz)
 #endif
 
 //------------------------------------------------------------------------------
-// RendezvousList Routines
+// Flat containers
 //
 
 /**
- * Allocate an empty SDORendezvousList object to the list.
- * @return an allocated SDORendezvousList object.
+ * Make room for one more element at the end of an array grown in place,
+ * doubling its capacity. The elements added are zeroed.
+ * @param items - the array, NULL if none yet.
+ * @param cap - in/out capacity of the array, in elements.
+ * @param count - elements in use.
+ * @param size - size of an element.
+ * @return the array, moved if grown, NULL on failure (items is kept).
  */
-SDORendezvousList_t *sdoRendezvousListAlloc(void)
+void *sdoArrayGrow(void *items, uint32_t *cap, uint32_t count, size_t size)
 {
-	return sdoAlloc(sizeof(SDORendezvousList_t));
+	uint32_t newCap;
+	uint8_t *p;
+
+	if (!cap || !size)
+		return NULL;
+	if (items && count < *cap)
+		return items;
+
+	newCap = *cap ? *cap * 2 : SDO_ARRAY_MIN;
+	if (newCap <= count || (size_t)newCap * size > INT32_MAX) {
+		LOG(LOG_ERROR, "Array of %u elements too large\n", count);
+		return NULL;
+	}
+	p = sdoRealloc(items, (int)(newCap * size));
+	if (!p)
+		return NULL;
+	if (memset_s(p + (size_t)count * size, (newCap - count) * size, 0) !=
+	    0) {
+		LOG(LOG_ERROR, "Memset Failed\n");
+		return NULL;
+	}
+	*cap = newCap;
+	return p;
+}
+
+//------------------------------------------------------------------------------
+// RendezvousList Routines
+//
+
+/**
+ * Allocate an empty SDORendezvousList object to the list.
+ * @return an allocated SDORendezvousList object.
+ */
+SDORendezvousList_t *sdoRendezvousListAlloc(void)
+{
+	return sdoAlloc(sizeof(SDORendezvousList_t));
 }
 
 /**
@@ -3173,57 +3466,64 @@ SDORendezvousList_t *sdoRendezvousListAlloc(void)
  */
 void sdoRendezvousListFree(SDORendezvousList_t *list)
 {
-	SDORendezvous_t *entry, *next;
+	int index;
 
 	if (list == NULL) {
 		return;
 	}
 
 	/* Delete all entries. */
-	next = entry = list->rvEntries;
-	while (entry) {
-		next = entry->next;
-		sdoRendezvousFree(entry);
-		entry = next;
-	};
+	for (index = 0; index < list->numEntries; index++)
+		sdoRendezvousClear(&list->rvEntries[index]);
+	sdoFree(list->rvEntries);
 
 	list->numEntries = 0;
 	sdoFree(list);
 }
 
 /**
- * Add the rendzvous to the rendzvous list
+ * Make room for one more rendezvous at the end of the list.
+ * @param list - pointer to the rendzvous list
+ * @return the zeroed entry, not counted in the list yet, NULL on failure
+ */
+static SDORendezvous_t *sdoRendezvousListSlot(SDORendezvousList_t *list)
+{
+	SDORendezvous_t *entries;
+
+	if (list->numEntries == UINT16_MAX)
+		return NULL;
+	entries = sdoArrayGrow(list->rvEntries, &list->capEntries,
+			       list->numEntries, sizeof(SDORendezvous_t));
+	if (!entries)
+		return NULL;
+	list->rvEntries = entries;
+	return &entries[list->numEntries];
+}
+
+/**
+ * Add the rendzvous to the end of the rendzvous list. Its contents are
+ * moved into the list and rv itself is freed, also on failure.
  * @param list - pointer to the rendzvous list
  * @param rv - pointer to the rendezvous to be added to the list
- * @return number of entries added if success else error code
+ * @return number of entries if success else 0
  */
 int sdoRendezvousListAdd(SDORendezvousList_t *list, SDORendezvous_t *rv)
 {
+	SDORendezvous_t *entry;
+
 	if (list == NULL || rv == NULL)
 		return 0;
 
 	LOG(LOG_DEBUG, "Adding to rvlst\n");
 
-	if (list->numEntries == 0) {
-		// List empty, add the first entry
-		list->rvEntries = rv;
-		list->numEntries++;
-	} else {
-		// already has entries, find the last entry
-		SDORendezvous_t *entryPtr, *prevPtr;
-
-		entryPtr = (SDORendezvous_t *)list->rvEntries->next;
-		prevPtr = list->rvEntries;
-		// Find the last entry
-		while (entryPtr != NULL) {
-			prevPtr = entryPtr;
-			entryPtr = (SDORendezvous_t *)entryPtr->next;
-		}
-		// Now the entyPtr is pointing to the last entry
-		// Add the r entry onto the end
-		prevPtr->next = rv;
-		list->numEntries++;
+	entry = sdoRendezvousListSlot(list);
+	if (!entry) {
+		sdoRendezvousFree(rv);
+		return 0;
 	}
+	*entry = *rv;
+	sdoFree(rv);
+	list->numEntries++;
 	LOG(LOG_DEBUG, "Added to rvlst, %d entries\n", list->numEntries);
 	return list->numEntries;
 }
@@ -3237,16 +3537,11 @@ int sdoRendezvousListAdd(SDORendezvousList_t *list, SDORendezvous_t *rv)
 
 SDORendezvous_t *sdoRendezvousListGet(SDORendezvousList_t *list, int num)
 {
-	int index;
-
-	if (list == NULL || list->numEntries == 0 || list->rvEntries == NULL)
+	if (list == NULL || num < 0 || num >= list->numEntries ||
+	    list->rvEntries == NULL)
 		return NULL;
 
-	SDORendezvous_t *entryPtr = list->rvEntries;
-	for (index = 0; index < num; index++) {
-		entryPtr = entryPtr->next;
-	}
-	return entryPtr;
+	return &list->rvEntries[num];
 }
 
 /**
@@ -3271,15 +3566,15 @@ int sdoRendezvousListRead(SDOR_t *sdor, SDORendezvousList_t *list)
 	for (index = 0; index < numRvs; index++) {
 		LOG(LOG_DEBUG, "rvIndex %d\n", index);
 
-		// Read each rv entry and add to the rv list
-		SDORendezvous_t *rvEntry = sdoRendezvousAlloc();
-		LOG(LOG_DEBUG, "New rv allocated %p\n", rvEntry);
+		// Read each rv entry in place at the end of the rv list
+		SDORendezvous_t *rvEntry = sdoRendezvousListSlot(list);
 
+		if (!rvEntry)
+			return false;
 		if (sdoRendezvousRead(sdor, rvEntry))
-			sdoRendezvousListAdd(list, rvEntry);
-		else {
-			sdoRendezvousFree(rvEntry);
-		}
+			list->numEntries++;
+		else
+			sdoRendezvousClear(rvEntry);
 	}
 	if (!sdoREndSequence(sdor)) {
 		LOG(LOG_ERROR,
@@ -3330,7 +3625,8 @@ bool sdoRendezvousListWrite(SDOW_t *sdow, SDORendezvousList_t *list)
  */
 SDOEncryptedPacket_t *sdoEncryptedPacketAlloc(void)
 {
-	return sdoAlloc(sizeof(SDOEncryptedPacket_t));
+	/* A packet lives only while its message is unwound or wound up */
+	return sdoAllocTransient(sizeof(SDOEncryptedPacket_t));
 }
 
 /**
@@ -3388,7 +3684,7 @@ SDOEncryptedPacket_t *sdoEncryptedPacketRead(SDOR_t *sdor)
 		goto error;
 	}
 
-	pkt->emBody = sdoByteArrayAlloc(0);
+	pkt->emBody = sdoByteArrayAllocTransient(0);
 	if (!pkt->emBody) {
 		LOG(LOG_ERROR, "Out of memory for emBody\n");
 		goto error;
@@ -3408,9 +3704,10 @@ SDOEncryptedPacket_t *sdoEncryptedPacketRead(SDOR_t *sdor)
 
 	sdor->needComma = true;
 
-	pkt->hmac = sdoHashAllocEmpty();
+	pkt->hmac = sdoAllocTransient(sizeof(SDOHash_t));
 	if (!pkt->hmac)
 		goto error;
+	pkt->hmac->hashType = SDO_CRYPTO_HASH_TYPE_NONE;
 
 	/* Read the HMAC */
 	/* Expect "hmac" tag */
@@ -3432,7 +3729,7 @@ SDOEncryptedPacket_t *sdoEncryptedPacketRead(SDOR_t *sdor)
 	int b64Len = binToB64Length(hmac_size);
 
 	if (pkt->hmac->hash == NULL) {
-		pkt->hmac->hash = sdoByteArrayAlloc(8);
+		pkt->hmac->hash = sdoByteArrayAllocTransient(8);
 		if (!pkt->hmac->hash) {
 			LOG(LOG_ERROR, "Alloc failed \n");
 			goto error;
@@ -3443,7 +3740,7 @@ SDOEncryptedPacket_t *sdoEncryptedPacketRead(SDOR_t *sdor)
 	// Resize the byte array buffer to required length
 	if (hmac_size &&
 	    sdoBitsResize(pkt->hmac->hash, hmac_size + 3) == false) {
-		sdoByteArrayFree(pkt->hmac->hash);
+		sdoHashBitsFree(pkt->hmac);
 		LOG(LOG_ERROR, "SDOBitsResize failed\n");
 		return 0;
 	}
@@ -3541,6 +3838,9 @@ bool sdoWriteIV(SDOEncryptedPacket_t *pkt, SDOIV_t *ps_iv, int len)
 	return true;
 }
 
+/* Tags, braces and lengths of an encrypted packet */
+#define SDO_ENC_PKT_OVERHEAD 64
+
 /**
  * Write out an Encrypted Message Body object to the sdow buffer
  * @param sdow - Output buffer to write the JASON packet representation
@@ -3549,9 +3849,18 @@ bool sdoWriteIV(SDOEncryptedPacket_t *pkt, SDOIV_t *ps_iv, int len)
  */
 void sdoEncryptedPacketWrite(SDOW_t *sdow, SDOEncryptedPacket_t *pkt)
 {
+	int len = SDO_ENC_PKT_OVERHEAD + binToB64Length(AES_IV);
+
 	if (!sdow || !pkt)
 		return;
 
+	/* base64 of ciphertext, IV and HMAC, plus tags and lengths */
+	if (pkt->emBody)
+		len += binToB64Length(pkt->emBody->byteSz);
+	if (pkt->hmac)
+		len += binToB64Length(pkt->hmac->hash->byteSz);
+	(void)sdoWReserve(sdow, len);
+
 	sdoWBeginObject(sdow);
 	/* Write the Encrypted Message Block data */
 	if (pkt->emBody && pkt->emBody->byteSz) {
@@ -3662,56 +3971,48 @@ char *SDOEncryptedPacketToString(SDOEncryptedPacket_t *pkt, char *buf, int bufsz
 bool sdoEncryptedPacketUnwind(SDOR_t *sdor, SDOEncryptedPacket_t *pkt,
 			      SDOIV_t *iv)
 {
-	bool ret = true;
-	SDOString_t *cleartext = NULL;
+	bool ret = false;
+	uint32_t clearTextLength = 0;
 
 	// Decrypt the Encrypted Body
-	if (!sdor || !pkt || !iv) {
+	if (!sdor || !pkt || !pkt->emBody || !iv) {
 		LOG(LOG_ERROR,
 		    "sdoEncryptedPacketUnwind : Invalid Input param\n");
-		ret = false;
-		goto err;
-	}
-	cleartext = sdoStringAlloc();
-
-	if (cleartext == NULL) {
-		ret = false;
 		goto err;
 	}
 
-	/* New iv is used for each new decryption which comes from pkt*/
-	if (0 != aes_decrypt_packet(pkt, cleartext)) {
-		ret = false;
+	if (0 != sdoMsgDecryptGetPTLen(pkt->emBody->byteSz, &clearTextLength))
 		goto err;
-	}
 
-	/* Reset the pointers */
+	/* Reset the pointers, the packet holds all that is left to read */
 	sdoRFlush(sdor);
 	SDOBlock_t *sdob = &sdor->b;
 
-	/* Adjust the buffer for the clear text */
-	sdoResizeBlock(sdob, cleartext->byteSz);
-	/* Copy the cleartext to the sdor buffer */
-	if (memcpy_s(sdob->block, cleartext->byteSz, cleartext->bytes,
-		     cleartext->byteSz) != 0) {
-		LOG(LOG_ERROR, "Memcpy Failed\n");
-		ret = false;
+	/* Decrypt straight into the buffer for the clear text.
+	 * New iv is used for each new decryption which comes from pkt */
+	sdoResizeBlock(sdob, clearTextLength);
+	if (sdob->blockMax < (int)clearTextLength) {
+		LOG(LOG_ERROR, "Cannot size the clear text buffer\n");
 		goto err;
 	}
+	if (0 != aes_decrypt_packet(pkt, sdob->block, &clearTextLength))
+		goto err;
 
-	sdob->blockSize = cleartext->byteSz;
+	sdob->blockSize = clearTextLength;
 	sdor->haveBlock = true;
+	ret = true;
 err:
 	if (pkt)
 		sdoEncryptedPacketFree(pkt);
-	if (cleartext)
-		sdoStringFree(cleartext);
 	return ret;
 }
 
 /**
  * Take the cleartext packet contained in the sdow buffer and convert it
- * to an Encrypted Message Body in the sdow buffer
+ * to an Encrypted Message Body in the sdow buffer. The cleartext is
+ * encrypted within its own block, then the ciphertext is base64 encoded
+ * straight into the new output block and the HMAC is made over the "ct"
+ * array as it was written out.
  * @param sdow - pointer to the message buffer
  * @param type - message type
  * @param iv - Pointer to the iv to fill Encrypted Packet pkt.
@@ -3719,34 +4020,282 @@ err:
  */
 bool sdoEncryptedPacketWindup(SDOW_t *sdow, int type, SDOIV_t *iv)
 {
+	bool ret = false;
+	uint8_t pktIv[AES_IV] = {0};
+	uint8_t hmac[SDO_SHA_DIGEST_SIZE_USED] = {0};
+	uint8_t *clearBlock = NULL;
+	uint32_t clearLength, cipherLength = 0, cipherOffset = 0;
+	int start;
+
 	if (!sdow || !iv)
 		return false;
 
 	SDOBlock_t *sdob = &sdow->b;
 
-	SDOEncryptedPacket_t *pkt = sdoEncryptedPacketAlloc();
+	clearLength = sdob->blockSize;
+	if (0 != sdoMsgEncryptGetCipherLen(clearLength, &cipherLength)) {
+		LOG(LOG_ERROR, "Failed to get ciphertext buffer size.\n");
+		return false;
+	}
 
-	if (!pkt) {
-		LOG(LOG_ERROR, "Not encrypted\n");
+#ifdef AES_MODE_CBC_ENABLED
+	/* Not all backends can pad in place, CBC encrypts past the cleartext */
+	cipherOffset = clearLength;
+#endif
+	sdoResizeBlock(sdob, cipherOffset + cipherLength);
+	if (sdob->blockMax < (int)(cipherOffset + cipherLength)) {
+		LOG(LOG_ERROR, "Cannot size the ciphertext buffer\n");
 		return false;
 	}
 
-	if (0 != aes_encrypt_packet(pkt, sdob->block, sdob->blockSize)) {
-		sdoEncryptedPacketFree(pkt);
+	if (0 != sdoMsgEncrypt(sdob->block, clearLength,
+			       &sdob->block[cipherOffset], &cipherLength,
+			       pktIv)) {
+		LOG(LOG_ERROR, "Failed to get encrypt.\n");
 		return false;
 	}
 
-	// At this point we have a valid Encrypted Message Body packet
-	// Remake the output buffer, abandoning the cleartext
+	// At this point the block holds the ciphertext. Keep it aside and
+	// remake the output buffer in a new block
+	clearBlock = sdob->block;
+	sdob->block = NULL;
+	sdob->blockMax = 0;
 	sdoWNextBlock(sdow, type);
-	sdoEncryptedPacketWrite(sdow, pkt);
 
-	if (pkt)
-		sdoEncryptedPacketFree(pkt);
+	if (!sdoWReserve(sdow, SDO_ENC_PKT_OVERHEAD + binToB64Length(AES_IV) +
+				   binToB64Length(cipherLength) +
+				   binToB64Length(sizeof(hmac))))
+		goto end;
+
+	sdoWBeginObject(sdow);
+	sdoWriteTag(sdow, "ct");
+	start = sdob->cursor;
+	sdoWriteByteArrayTwoInt(sdow, pktIv, AES_IV,
+				&clearBlock[cipherOffset], cipherLength);
+
+	/* HMAC of [[ivsize, iv], size, cipher_text] as it is on the wire */
+	if (0 != sdoTo2HMAC(&sdob->block[start], sdob->cursor - start, hmac,
+			    sizeof(hmac)))
+		goto end;
+
+	sdoWriteTag(sdow, "hmac");
+	sdoWriteByteArray(sdow, hmac, sizeof(hmac));
+	sdoWEndObject(sdow);
+	ret = true;
+end:
+	sdoFree(clearBlock);
+	return ret;
+}
+
+//------------------------------------------------------------------------------
+// Fragment Cache Routines
+//
+
+/**
+ * Internal API: drop the encoded value of a fragment
+ */
+static void sdoFragDrop(sdoFrag_t *f)
+{
+	sdoByteArrayFree(f->src);
+	sdoByteArrayFree(f->enc);
+	f->src = NULL;
+	f->enc = NULL;
+}
+
+/**
+ * Internal API: check that a fragment was encoded with encoding from the
+ * srcLen bytes at src, none for a constant one
+ */
+static bool sdoFragValid(const sdoFrag_t *f, uint8_t encoding,
+			 const uint8_t *src, size_t srcLen)
+{
+	int diff = 1;
+
+	if (!f->enc || f->encoding != encoding)
+		return false;
+	if (!src || !srcLen)
+		return !f->src;
+	if (!f->src || f->src->byteSz != srcLen)
+		return false;
+	return !memcmp_s(f->src->bytes, srcLen, src, srcLen, &diff) &&
+	       !diff;
+}
+
+/**
+ * Internal API: encode a fragment with write, on a writer of its own
+ */
+static bool sdoFragEncode(sdoFrag_t *f, uint8_t encoding, const uint8_t *src,
+			  size_t srcLen,
+			  bool (*write)(SDOW_t *sdow, const void *obj),
+			  const void *obj)
+{
+	SDOW_t sdow;
+	bool ok;
+
+	sdoFragDrop(f);
+	if (!sdoWInit(&sdow))
+		return false;
+	sdow.encoding = encoding;
+
+	ok = write(&sdow, obj) && sdow.b.blockSize > 0;
+	if (ok)
+		f->enc = sdoByteArrayAllocWithByteArray(sdow.b.block,
+							sdow.b.blockSize);
+	if (f->enc && src && srcLen)
+		f->src = sdoByteArrayAllocWithByteArray((uint8_t *)src, srcLen);
+	sdoFree(sdow.b.block);
+
+	if (!f->enc || (src && srcLen && !f->src)) {
+		sdoFragDrop(f);
+		return false;
+	}
+	f->encoding = encoding;
+	return true;
+}
+
+/**
+ * Write a value that does not change over the lifetime of the device,
+ * copying it from the cache, where it is encoded on first use.
+ * @param sdow - pointer to the output buffer
+ * @param cache - fragment cache, NULL to write the value with write
+ * @param id - fragment of the value
+ * @param src - bytes the value is made of, NULL for a constant
+ * @param srcLen - size of src
+ * @param write - writes the value
+ * @param obj - passed to write
+ * @return false if write failed
+ */
+bool sdoFragWrite(SDOW_t *sdow, sdoFragCache_t *cache, sdoFragId_t id,
+		  const uint8_t *src, size_t srcLen,
+		  bool (*write)(SDOW_t *sdow, const void *obj),
+		  const void *obj)
+{
+	sdoFrag_t *f;
+
+	if (!sdow || !write)
+		return false;
+	if (!cache || id >= SDO_FRAG_COUNT)
+		return write(sdow, obj);
+
+	f = &cache->frag[id];
+	if (!sdoFragValid(f, sdow->encoding, src, srcLen) &&
+	    !sdoFragEncode(f, sdow->encoding, src, srcLen, write, obj))
+		return write(sdow, obj);
+
+	sdoWriteEncoded(sdow, f->enc->bytes, f->enc->byteSz);
+	return true;
+}
+
+static bool sdoFragAppID(SDOW_t *sdow, const void *obj)
+{
+	(void)obj;
+	sdoAppIDWrite(sdow);
+	return true;
+}
+
+/**
+ * Write the APPID, from the fragment cache
+ * @param sdow - pointer to the output buffer
+ * @param cache - fragment cache, may be NULL
+ */
+void sdoFragAppIDWrite(SDOW_t *sdow, sdoFragCache_t *cache)
+{
+	(void)sdoFragWrite(sdow, cache, SDO_FRAG_AI, NULL, 0, sdoFragAppID,
+			   NULL);
+}
+
+static bool sdoFragGid(SDOW_t *sdow, const void *obj)
+{
+	(void)obj;
+	sdoGidWrite(sdow);
+	return true;
+}
+
+/**
+ * Write the GID (eA), from the fragment cache
+ * @param sdow - pointer to the output buffer
+ * @param cache - fragment cache, may be NULL
+ */
+void sdoFragGidWrite(SDOW_t *sdow, sdoFragCache_t *cache)
+{
+	SDOSigInfo_t *eA = sdoGetDeviceSigInfoeA();
+	SDOByteArray_t *key = NULL;
+
+	if (eA && eA->pubkey)
+		key = eA->pubkey->key1;
+	(void)sdoFragWrite(sdow, cache, SDO_FRAG_EA, key ? key->bytes : NULL,
+			   key ? key->byteSz : 0, sdoFragGid, NULL);
+}
+
+static bool sdoFragGuid(SDOW_t *sdow, const void *obj)
+{
+	sdoByteArrayWriteChars(sdow, (SDOByteArray_t *)obj);
+	return true;
+}
+
+/**
+ * Write the GUID of the device, from the fragment cache
+ * @param sdow - pointer to the output buffer
+ * @param cache - fragment cache, may be NULL
+ * @param guid - the GUID
+ */
+void sdoFragGuidWrite(SDOW_t *sdow, sdoFragCache_t *cache,
+		      SDOByteArray_t *guid)
+{
+	if (!guid || !guid->bytes || !guid->byteSz) {
+		sdoByteArrayWriteChars(sdow, guid);
+		return;
+	}
+	(void)sdoFragWrite(sdow, cache, SDO_FRAG_G2, guid->bytes, guid->byteSz,
+			   sdoFragGuid, guid);
+}
+
+static bool sdoFragString(SDOW_t *sdow, const void *obj)
+{
+	const SDOString_t *str = obj;
+
+	sdoWriteStringLen(sdow, str->bytes, str->byteSz);
+	return true;
+}
+
+/**
+ * Write a string of the device (kx or cs), from the fragment cache
+ * @param sdow - pointer to the output buffer
+ * @param cache - fragment cache, may be NULL
+ * @param id - fragment of the string
+ * @param str - the string
+ */
+void sdoFragStringWrite(SDOW_t *sdow, sdoFragCache_t *cache, sdoFragId_t id,
+			SDOString_t *str)
+{
+	if (!str || !str->bytes || str->byteSz <= 0) {
+		LOG(LOG_ERROR, "No string to write\n");
+		return;
+	}
+	(void)sdoFragWrite(sdow, cache, id, (uint8_t *)str->bytes,
+			   str->byteSz, sdoFragString, str);
+}
 
+static bool sdoFragPublicKey(SDOW_t *sdow, const void *obj)
+{
+	sdoPublicKeyWrite(sdow, (SDOPublicKey_t *)obj);
 	return true;
 }
 
+/**
+ * Release the fragments of a cache, to be encoded again.
+ * @param cache - fragment cache.
+ */
+void sdoFragCacheFree(sdoFragCache_t *cache)
+{
+	int i;
+
+	if (!cache)
+		return;
+	for (i = 0; i < SDO_FRAG_COUNT; i++)
+		sdoFragDrop(&cache->frag[i]);
+}
+
 //------------------------------------------------------------------------------
 // Write Signature Routines
 //
@@ -3777,8 +4326,10 @@ bool sdoBeginWriteSignature(SDOW_t *sdow, SDOSig_t *sig, SDOPublicKey_t *pk)
  * Write the signature to the buffer
  * @param sdow - pointer to the output buffer
  * @param sig - pointer to the struct of type signature
+ * @param frags - fragment cache the device public key is written from, may
+ * be NULL
  */
-bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig)
+bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig, sdoFragCache_t *frags)
 {
 	int sigBlockEnd;
 	int sigBlockSz;
@@ -3827,7 +4378,15 @@ bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig)
 	eA = sdoGetDeviceSigInfoeA();
 	publickey = eA ? eA->pubkey : NULL;
 
-	sdoPublicKeyWrite(sdow, publickey);
+	/* Bar an RSA key, key1 holds all of the key */
+	if (publickey && publickey->key1 && publickey->key1->byteSz &&
+	    !SDO_PK_IS_RSA(publickey))
+		(void)sdoFragWrite(sdow, frags, SDO_FRAG_PK,
+				   publickey->key1->bytes,
+				   publickey->key1->byteSz, sdoFragPublicKey,
+				   publickey);
+	else
+		sdoPublicKeyWrite(sdow, publickey);
 	sdoWriteTag(sdow, "sg");
 	sdoWriteByteArray(sdow, sigtext->bytes, sigtext->byteSz);
 	sdoWEndObject(sdow);
@@ -3835,59 +4394,77 @@ bool sdoEndWriteSignature(SDOW_t *sdow, SDOSig_t *sig)
 	return true;
 }
 
+/**
+ * Internal API: feed a part of the header to its HMAC
+ */
+static bool sdoHMACTapFeed(void **ctx, const uint8_t *buf, int len)
+{
+	if (!*ctx && 0 != sdoDeviceOVHMACInit(ctx))
+		return false;
+	return 0 == sdoDeviceOVHMACUpdate(*ctx, buf, len);
+}
+
+/**
+ * Internal API: drop the HMAC of a header
+ */
+static void sdoHMACTapDrop(void **ctx)
+{
+	sdoDeviceOVHMACFinal(ctx, NULL, 0);
+}
+
+static const SDOReadTapOps_t sdoHMACTapOps = {sdoHMACTapFeed, sdoHMACTapDrop};
+
 /**
  * HMAC processing start of a block to HMAC
  * @param sdor - pointer to the input buffer
- * @param sigBlockStart - pointer to the signature starting block
+ * @param hmacTap - set to the tap feeding the block to its HMAC
  * @return true if proper header present, otherwise false
  */
-bool sdoBeginReadHMAC(SDOR_t *sdor, int *sigBlockStart)
+bool sdoBeginReadHMAC(SDOR_t *sdor, int *hmacTap)
 {
-	if (!sdor)
+	if (!sdor || !hmacTap)
 		return false;
 
 	if (!sdoReadExpectedTag(sdor, "oh")) {
 		LOG(LOG_ERROR, "No oh\n");
 		return false;
 	}
-	*sigBlockStart = sdor->b.cursor;
+	*hmacTap = sdoRTapBegin(sdor, &sdoHMACTapOps);
 
-	return true;
+	return *hmacTap >= 0;
 }
 
 /**
  * Create the HMAC using our secret
  * @param sdor - input buffer
  * @param hmac - pointer to the hash object to use
- * @param sigBlockStart - pointer to the signature starting block
+ * @param hmacTap - tap from sdoBeginReadHMAC(), closed on return
  * @return true if proper header present, otherwise false
  */
-bool sdoEndReadHMAC(SDOR_t *sdor, SDOHash_t **hmac, int sigBlockStart)
+bool sdoEndReadHMAC(SDOR_t *sdor, SDOHash_t **hmac, int hmacTap)
 {
+	SDOHash_t *h = NULL;
+	int sigBlockStart = 0;
+	int sigBlockSz;
+	uint8_t *plainText;
+	uint8_t saveByte;
+	void **ctx;
+	bool ret = false;
+
 	// Make the ending calculation for the buffer to sign
 
 	if (!sdor || !hmac)
 		return false;
 
-	if (!sdoREndObject(sdor)) {
-		return false;
-	}
-	int sigBlockEnd = sdor->b.cursor;
-	int sigBlockSz = sigBlockEnd - sigBlockStart;
-	uint8_t *plainText = sdoRGetBlockPtr(sdor, sigBlockStart);
+	if (!sdoREndObject(sdor))
+		goto end;
 
-	if (plainText == NULL) {
-		LOG(LOG_ERROR, "sdoRGetBlockPtr() returned null, "
-			       "sdoEndReadHMAC() failed !!");
-		return false;
+	/* The block is fed to the HMAC as it is read, unless the key is held
+	 * where only the one shot HMAC can use it */
+	if (!sdoRTapPause(sdor, hmacTap, &sigBlockStart)) {
+		LOG(LOG_ERROR, "OVHdr could not be fed to its HMAC\n");
+		goto end;
 	}
-
-	// Display the block to be signed
-	uint8_t saveByte;
-	saveByte = plainText[sigBlockSz];
-	plainText[sigBlockSz] = 0;
-	LOG(LOG_DEBUG, "sdoEndReadHMAC.plainText: %s\n", plainText);
-	plainText[sigBlockSz] = saveByte;
 #if !defined(DEVICE_TPM20_ENABLED)
 	char buf[256];
 	LOG(LOG_DEBUG, "sdoEndReadHMAC.key: %s\n",
@@ -3895,57 +4472,228 @@ bool sdoEndReadHMAC(SDOR_t *sdor, SDOHash_t **hmac, int sigBlockStart)
 								      : "");
 #endif
 	// Create the HMAC
-	*hmac =
-	    sdoHashAlloc(SDO_CRYPTO_HMAC_TYPE_USED, SDO_SHA_DIGEST_SIZE_USED);
-	if (!*hmac) {
-		return false;
+	h = sdoHashAlloc(SDO_CRYPTO_HMAC_TYPE_USED, SDO_SHA_DIGEST_SIZE_USED);
+	if (!h)
+		goto end;
+
+	ctx = sdoRTapContext(sdor, hmacTap);
+	if (ctx) {
+		if (0 != sdoDeviceOVHMACFinal(ctx, h->hash->bytes,
+					      h->hash->byteSz))
+			goto end;
+		ret = true;
+		goto end;
 	}
 
-	if (0 != sdoDeviceOVHMAC(plainText, sigBlockSz, (*hmac)->hash->bytes,
-				 (*hmac)->hash->byteSz)) {
-		sdoHashFree(*hmac);
-		return false;
+	sigBlockSz = sdor->b.cursor - sigBlockStart;
+	plainText = sdoRGetBlockPtr(sdor, sigBlockStart);
+	if (plainText == NULL) {
+		LOG(LOG_ERROR, "sdoRGetBlockPtr() returned null, "
+			       "sdoEndReadHMAC() failed !!");
+		goto end;
 	}
 
-	return true;
+	// Display the block to be signed
+	saveByte = plainText[sigBlockSz];
+	plainText[sigBlockSz] = 0;
+	LOG(LOG_DEBUG, "sdoEndReadHMAC.plainText: %s\n", plainText);
+	plainText[sigBlockSz] = saveByte;
+
+	if (0 != sdoDeviceOVHMAC(plainText, sigBlockSz, h->hash->bytes,
+				 h->hash->byteSz))
+		goto end;
+	ret = true;
+end:
+	if (ret)
+		*hmac = h;
+	else if (h)
+		sdoHashFree(h);
+	sdoRTapFree(sdor, hmacTap);
+	return ret;
 }
 
 /**
- * Signature processing.  Call this to mark the place before reading
- * the signature body.  Then call sdoEndReadSignature* afterwards.
- * The same SDOSig_t object must be presented to both procedures.
- *
- * @param sdor - pointer to the input buffer
- * @param sig - pointer to the signature object to use
- * @return true if proper header present, otherwise false
+ * Internal API: feed a part of a region to its hash
  */
-bool sdoBeginReadSignature(SDOR_t *sdor, SDOSig_t *sig)
+static bool sdoHashTapFeed(void **ctx, const uint8_t *buf, int len)
 {
-	if (!sdor || !sig)
+	if (!*ctx && 0 != sdoOVHashInit(ctx))
 		return false;
+	return 0 == sdoOVHashUpdate(*ctx, buf, len);
+}
 
-	if (!sdoRBeginObject(sdor))
-		return false;
-	if (!sdoReadExpectedTag(sdor, "bo"))
-		return false;
-	sig->sigBlockStart = sdor->b.cursor;
-	return true;
+/**
+ * Internal API: drop the hash of a region
+ */
+static void sdoHashTapDrop(void **ctx)
+{
+	sdoOVHashFinal(ctx, NULL, 0);
 }
 
-#if 0
+static const SDOReadTapOps_t sdoHashTapOps = {sdoHashTapFeed, sdoHashTapDrop};
+
 /**
- * Simple Signature processing, yes or no, based on transmitted
- * public key.  The sig pointer must be the same one used for
- * the corresponding BEGIN call
+ * Start hashing the message from the cursor on. The region may be cut in
+ * parts with sdoRTapPause() and sdoRTapResume().
  * @param sdor - pointer to the input buffer
- * @param sig - pointer to the signature object to use
- * @returns true if parsing is correct and signature verifies.
+ * @return the tap feeding the hash, -1 on failure
  */
-bool sdoEndReadSignature(SDOR_t *sdor, SDOSig_t *sig)
+int sdoHashTapBegin(SDOR_t *sdor)
 {
-	return sdoEndReadSignatureFull(sdor, sig, NULL);
+	if (!sdor)
+		return -1;
+	return sdoRTapBegin(sdor, &sdoHashTapOps);
 }
-#endif
+
+/**
+ * End the hashed region at the cursor and place its hash in hash
+ * @param sdor - pointer to the input buffer
+ * @param tap - tap from sdoHashTapBegin(), closed on return
+ * @param hash - hash object of SDO_CRYPTO_HASH_TYPE_USED to fill in
+ * @return true on success, otherwise false
+ */
+bool sdoHashTapEnd(SDOR_t *sdor, int tap, SDOHash_t *hash)
+{
+	void **ctx;
+	bool ret = false;
+
+	if (!sdor || !hash || !hash->hash)
+		goto end;
+
+	if (!sdoRTapPause(sdor, tap, NULL))
+		goto end;
+	ctx = sdoRTapContext(sdor, tap);
+	if (!ctx || 0 != sdoOVHashFinal(ctx, hash->hash->bytes,
+					hash->hash->byteSz)) {
+		LOG(LOG_ERROR, "Hash generation failed\n");
+		goto end;
+	}
+	ret = true;
+end:
+	if (sdor)
+		sdoRTapFree(sdor, tap);
+	return ret;
+}
+
+/**
+ * Internal API: feed a released part of a signed region to its verification
+ */
+static bool sdoSigTapFeed(void **ctx, const uint8_t *buf, int len)
+{
+	if (!*ctx && 0 != sdoOVVerifyInit(ctx))
+		return false;
+	return 0 == sdoOVVerifyUpdate(*ctx, buf, len);
+}
+
+/**
+ * Internal API: drop the verification of a signed region
+ */
+static void sdoSigTapDrop(void **ctx)
+{
+	sdoOVVerifyFinal(ctx, NULL, 0, NULL, NULL);
+}
+
+static const SDOReadTapOps_t sdoSigTapOps = {sdoSigTapFeed, sdoSigTapDrop};
+
+/**
+ * Internal API: end the signed region of sig at the cursor, feeding the
+ * part still in the block to its verification if feed is set
+ */
+static bool sdoSigRegionEnd(SDOR_t *sdor, SDOSig_t *sig, bool feed)
+{
+	if (feed ? !sdoRTapPause(sdor, sig->tap, &sig->sigBlockStart)
+		 : !sdoRTapEnd(sdor, sig->tap, &sig->sigBlockStart)) {
+		LOG(LOG_ERROR, "Signed region could not be hashed\n");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * Internal API: verify the signature sg over the signed region of sig,
+ * which ends at sigBlockEnd, and close its tap. With a batch, a region held
+ * by its tap is only queued on the batch.
+ * @return 0 on success; -1 on failure. The result parameter must be checked
+ * only when return value is 0.
+ */
+static int sdoSigRegionVerify(SDOR_t *sdor, SDOSig_t *sig, int sigBlockEnd,
+			      SDOPublicKey_t *pk, void *batch, bool *result)
+{
+	void **ctx = sdoRTapContext(sdor, sig->tap);
+	int sigBlockSz = sigBlockEnd - sig->sigBlockStart;
+	uint8_t *plainText;
+	uint8_t saveByte;
+	int ret = -1;
+
+	if (ctx && batch) {
+		ret = sdoOVBatchAdd(batch, ctx, sig->sg->bytes, sig->sg->byteSz,
+				    pk);
+		*result = true;
+		goto end;
+	}
+
+	if (ctx) {
+		ret = sdoOVVerifyFinal(ctx, sig->sg->bytes, sig->sg->byteSz, pk,
+				       result);
+		goto end;
+	}
+
+	plainText = sdoRGetBlockPtr(sdor, sig->sigBlockStart);
+	if (plainText == NULL) {
+		LOG(LOG_ERROR, "sdoRGetBlockPtr() returned null, "
+			       "signature verification failed !!");
+		goto end;
+	}
+
+	saveByte = plainText[sigBlockSz];
+	plainText[sigBlockSz] = 0;
+	LOG(LOG_DEBUG, "sdoEndReadSignature.SigText: %s\n", plainText);
+	plainText[sigBlockSz] = saveByte;
+
+	ret = sdoOVVerify(plainText, sigBlockSz, sig->sg->bytes,
+			  sig->sg->byteSz, pk, result);
+end:
+	sdoRTapFree(sdor, sig->tap);
+	return ret;
+}
+
+/**
+ * Signature processing.  Call this to mark the place before reading
+ * the signature body.  Then call sdoEndReadSignature* afterwards.
+ * The same SDOSig_t object must be presented to both procedures.
+ *
+ * @param sdor - pointer to the input buffer
+ * @param sig - pointer to the signature object to use
+ * @return true if proper header present, otherwise false
+ */
+bool sdoBeginReadSignature(SDOR_t *sdor, SDOSig_t *sig)
+{
+	if (!sdor || !sig)
+		return false;
+
+	if (!sdoRBeginObject(sdor))
+		return false;
+	if (!sdoReadExpectedTag(sdor, "bo"))
+		return false;
+	sig->sigBlockStart = sdor->b.cursor;
+	sig->tap = sdoRTapBegin(sdor, &sdoSigTapOps);
+	return sig->tap >= 0;
+}
+
+#if 0
+/**
+ * Simple Signature processing, yes or no, based on transmitted
+ * public key.  The sig pointer must be the same one used for
+ * the corresponding BEGIN call
+ * @param sdor - pointer to the input buffer
+ * @param sig - pointer to the signature object to use
+ * @returns true if parsing is correct and signature verifies.
+ */
+bool sdoEndReadSignature(SDOR_t *sdor, SDOSig_t *sig)
+{
+	return sdoEndReadSignatureFull(sdor, sig, NULL, NULL);
+}
+#endif
 
 /**
  * Full Signature processing:
@@ -3953,15 +4701,15 @@ bool sdoEndReadSignature(SDOR_t *sdor, SDOSig_t *sig)
  * @param sdor - input buffer to check
  * @param sig - object holds offset of block start and holds returned signature
  * @param getpk - returns verify public key (caller must sdoFree)
- * @return true if verification successful, otherwise false
+ * @param batch - batch from sdoOVBatchInit() the signature is queued on,
+ * NULL to verify it now.
+ * @return true if verification successful (or queued), otherwise false
  */
 bool sdoEndReadSignatureFull(SDOR_t *sdor, SDOSig_t *sig,
-			     SDOPublicKey_t **getpk)
+			     SDOPublicKey_t **getpk, void *batch)
 {
 	// Save buffer at the end of the area to be checked
 	int sigBlockEnd;
-	int sigBlockSz;
-	uint8_t *plainText;
 	SDOPublicKey_t *pk;
 	bool r = false;
 	int ret;
@@ -3970,14 +4718,8 @@ bool sdoEndReadSignatureFull(SDOR_t *sdor, SDOSig_t *sig,
 		return false;
 
 	sigBlockEnd = sdor->b.cursor;
-	sigBlockSz = sigBlockEnd - sig->sigBlockStart;
-	plainText = sdoRGetBlockPtr(sdor, sig->sigBlockStart);
-
-	if (plainText == NULL) {
-		LOG(LOG_ERROR, "sdoRGetBlockPtr() returned null, "
-			       "sdoEndReadSignatureFull() failed !!");
+	if (!sdoSigRegionEnd(sdor, sig, batch != NULL))
 		return false;
-	}
 
 	if (!sdoReadExpectedTag(sdor, "pk"))
 		return false;
@@ -4029,24 +4771,21 @@ bool sdoEndReadSignatureFull(SDOR_t *sdor, SDOSig_t *sig,
 	// Buffer read, all objects consumed, start verify
 
 	// Check the signature
-	uint8_t saveByte;
-	char buf[1024];
+	char *buf = sdoScratchLease(SDO_SCRATCH_SIZE);
 	bool signature_verify = false;
 
-	saveByte = plainText[sigBlockSz];
-	plainText[sigBlockSz] = 0;
-	LOG(LOG_DEBUG, "sdoEndReadSignature.SigText: %s\n", plainText);
-	plainText[sigBlockSz] = saveByte;
 	LOG(LOG_DEBUG, "sdoEndReadSignature.PK: %s\n",
-	    sdoPublicKeyToString(pk, buf, sizeof buf) ? buf : "");
+	    buf && sdoPublicKeyToString(pk, buf, SDO_SCRATCH_SIZE) ? buf : "");
+	sdoScratchRelease(buf);
 
-	ret = sdoOVVerify(plainText, sigBlockSz, sig->sg->bytes,
-			  sig->sg->byteSz, pk, &signature_verify);
+	ret = sdoSigRegionVerify(sdor, sig, sigBlockEnd, pk, batch,
+				 &signature_verify);
 
 result:
 
 	if ((ret == 0) && (true == signature_verify)) {
-		LOG(LOG_DEBUG, "Signature verifies OK.\n");
+		LOG(LOG_DEBUG, "Signature %s.\n",
+		    batch ? "queued" : "verifies OK");
 		r = true;
 	} else {
 		LOG(LOG_ERROR, "Signature internal failure, or signature does "
@@ -4054,11 +4793,9 @@ result:
 		r = false;
 	}
 
-	// Return a copy of the data to use or clean up
-	if (getpk != NULL) {
-		*getpk = sdoPublicKeyClone(pk);
-		sdoPublicKeyFree(pk);
-	}
+	// Hand the key over to use or clean up
+	if (getpk != NULL)
+		*getpk = pk;
 
 	return r;
 }
@@ -4134,31 +4871,27 @@ bool sdoReadPKNull(SDOR_t *sdor)
  * for generating hash.
  * @param sig - Pointer of type SDOSig_t, as signature
  * @param pk - Pointer of type SDOPublicKey_t, holds the key used for
- * verification.
- * @return true if success, else false
+ * verification, NULL to only read the signature of a region verified in an
+ * earlier run.
+ * @param batch - batch from sdoOVBatchInit() the signature is queued on,
+ * NULL to verify it now.
+ * @return true if success (or queued), else false
  */
 
-bool sdoOVSignatureVerification(SDOR_t *sdor, SDOSig_t *sig, SDOPublicKey_t *pk)
+bool sdoOVSignatureVerification(SDOR_t *sdor, SDOSig_t *sig,
+				SDOPublicKey_t *pk, void *batch)
 {
 
 	int ret;
 	int sigBlockEnd;
-	int sigBlockSz;
-	uint8_t *plainText;
 	bool signature_verify = false;
 
-	if (!sdor || !sig || !pk)
+	if (!sdor || !sig)
 		return false;
 
 	sigBlockEnd = sdor->b.cursor;
-	sigBlockSz = sigBlockEnd - sig->sigBlockStart;
-	plainText = sdoRGetBlockPtr(sdor, sig->sigBlockStart);
-
-	if (plainText == NULL) {
-		LOG(LOG_ERROR, "sdoRGetBlockPtr() returned null, "
-			       "sdoOVSignatureVerification() failed !!");
+	if (!sdoSigRegionEnd(sdor, sig, pk && batch))
 		return false;
-	}
 
 	if (!sdoReadPKNull(sdor))
 		return false;
@@ -4190,8 +4923,12 @@ bool sdoOVSignatureVerification(SDOR_t *sdor, SDOSig_t *sig, SDOPublicKey_t *pk)
 	if (!sdoREndObject(sdor))
 		return false;
 
-	ret = sdoOVVerify(plainText, sigBlockSz, sig->sg->bytes,
-			  sig->sg->byteSz, pk, &signature_verify);
+	if (!pk) {
+		sdoRTapFree(sdor, sig->tap);
+		return true;
+	}
+	ret = sdoSigRegionVerify(sdor, sig, sigBlockEnd, pk, batch,
+				 &signature_verify);
 
 	if ((ret == 0) && (true == signature_verify)) {
 		LOG(LOG_DEBUG, "Signature verifies OK.\n");
@@ -4249,6 +4986,56 @@ SDOKeyValue_t *sdoKVAllocWithArray(char *key, SDOByteArray_t *val)
 	return kv;
 }
 
+/**
+ * Free the key and value of a key value, leaving it empty
+ * @param kv - pointer to the struct of type key value
+ */
+static void sdoKVClear(SDOKeyValue_t *kv)
+{
+	if (kv->key != NULL)
+		sdoStringFree(kv->key);
+	if (kv->val != NULL)
+		sdoStringFree(kv->val);
+	kv->key = NULL;
+	kv->val = NULL;
+}
+
+/**
+ * Initialize an empty key value with the strings provided
+ * @param kv - pointer to the key value, left empty on failure
+ * @param key - pointer to the key
+ * @param val - pointer to the input value
+ * @return true if success else false.
+ */
+static bool sdoKVSetStr(SDOKeyValue_t *kv, char *key, char *val)
+{
+	int keyLen = strnlen_s(key, SDO_MAX_STR_SIZE);
+
+	if (!keyLen || keyLen == SDO_MAX_STR_SIZE) {
+		LOG(LOG_ERROR, "sdoKVAllocWithStr(): key is either "
+			       "'NULL' or 'isn't "
+			       "NULL terminated'\n");
+		return false;
+	}
+
+	int valLen = strnlen_s(val, SDO_MAX_STR_SIZE);
+
+	if (valLen == SDO_MAX_STR_SIZE) {
+		LOG(LOG_ERROR, "sdoKVAllocWithStr(): value is either "
+			       "'NULL' or 'isn't NULL terminated'\n");
+		printf("vallen:%d\t, buf:%s\n", valLen, val);
+		return false;
+	}
+
+	kv->key = sdoStringAllocWith(key, keyLen);
+	kv->val = sdoStringAllocWith(val, valLen);
+	if (kv->key == NULL || kv->val == NULL) {
+		sdoKVClear(kv);
+		return false;
+	}
+	return true;
+}
+
 /**
  * Allocate the key vlaue and initialize with the value provided
  * @param key - pointer to the key
@@ -4261,34 +5048,9 @@ SDOKeyValue_t *sdoKVAllocWithStr(char *key, char *val)
 		return NULL;
 
 	SDOKeyValue_t *kv = sdoKVAlloc();
-	if (kv != NULL) {
-		int keyLen = strnlen_s(key, SDO_MAX_STR_SIZE);
-
-		if (!keyLen || keyLen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_ERROR, "sdoKVAllocWithStr(): key is either "
-				       "'NULL' or 'isn't "
-				       "NULL terminated'\n");
-			sdoKVFree(kv);
-			return NULL;
-		}
-
-		kv->key = sdoStringAllocWith(key, keyLen);
-
-		int valLen = strnlen_s(val, SDO_MAX_STR_SIZE);
-
-		if (valLen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_ERROR, "sdoKVAllocWithStr(): value is either "
-				       "'NULL' or 'isn't NULL terminated'\n");
-			printf("vallen:%d\t, buf:%s\n", valLen, val);
-			sdoKVFree(kv);
-			return NULL;
-		}
-
-		kv->val = sdoStringAllocWith(val, valLen);
-		if (kv->key == NULL || kv->val == NULL) {
-			sdoKVFree(kv);
-			kv = NULL;
-		}
+	if (kv != NULL && !sdoKVSetStr(kv, key, val)) {
+		sdoFree(kv);
+		kv = NULL;
 	}
 	return kv;
 }
@@ -4299,10 +5061,7 @@ SDOKeyValue_t *sdoKVAllocWithStr(char *key, char *val)
  */
 void sdoKVFree(SDOKeyValue_t *kv)
 {
-	if (kv->key != NULL)
-		sdoStringFree(kv->key);
-	if (kv->val != NULL)
-		sdoStringFree(kv->val);
+	sdoKVClear(kv);
 	sdoFree(kv);
 }
 
@@ -4320,18 +5079,23 @@ void sdoKVWrite(SDOW_t *sdow, SDOKeyValue_t *kv)
 
 /**
  * Read multiple SvInfo (OSI) Key/Value pairs from the input buffer
- * All Key-value pairs MUST be a null terminated strings.
+ * All Key-value pairs MUST be a null terminated strings. The values are
+ * left in the input buffer, kv->value and kv->length pointing at them,
+ * for sdoOsiHandling() to hand over in place or as copies.
  * @param sdor - pointer to the input buffer
  * @param moduleList - Global Module List Head Pointer.
+ * @param osiCache - OSIs applied by the modules, may be NULL.
  * @param kv - pointer to the SvInfo key/value pair
  * @param cbReturnVal - Pointer of type int which will be filled with CB return
  * value.
  * @return true of read succeeded, false otherwise
  */
 bool sdoOsiParsing(SDOR_t *sdor, sdoSdkServiceInfoModuleList_t *moduleList,
-		   sdoSdkSiKeyValue *kv, int *cbReturnVal)
+		   sdoOsiCache_t *osiCache, sdoSdkSiKeyValue *kv,
+		   int *cbReturnVal)
 {
 	int strLen;
+	const char *val;
 
 	if (!cbReturnVal)
 		return false;
@@ -4359,32 +5123,26 @@ bool sdoOsiParsing(SDOR_t *sdor, sdoSdkServiceInfoModuleList_t *moduleList,
 		// read tag "" from KV pair and copy to "kv->key"
 		sdoReadTag(sdor, kv->key, strLen + 1);
 
-		// get len of "value" in KV pair
-		strLen = sdoReadStringSz(sdor);
-
-		kv->value = sdoAlloc(strLen + 1); // +1 for null termination
-
-		if (!kv->value) {
-			LOG(LOG_ERROR, "Malloc failed!\n");
+		// value for above tag, where it is in the input buffer
+		strLen = sdoReadStringRef(sdor, &val);
+		if (strLen < 0) {
 			sdoFree(kv->key);
 			return false;
 		}
+		kv->value = (char *)val;
+		kv->offset = 0;
+		kv->length = strLen;
 
-		// read value for above tag and copy into "kv->value"
-		sdoReadString(sdor, kv->value, strLen + 1);
-
-		LOG(LOG_DEBUG, "OSI_KV pair:\nKey->%s,Value->%s\n", kv->key,
-		    kv->value);
+		LOG(LOG_DEBUG, "OSI_KV pair:\nKey->%s,Value->%.*s\n", kv->key,
+		    strLen, val);
 
 		// call module callback's with appropriate KV pairs
-		if (!sdoOsiHandling(moduleList, kv, cbReturnVal)) {
+		if (!sdoOsiHandling(moduleList, osiCache, kv, cbReturnVal)) {
 			sdoFree(kv->key);
-			sdoFree(kv->value);
 			return false;
 		}
 		// free present KV pair memory
 		sdoFree(kv->key);
-		sdoFree(kv->value);
 	}
 
 	return true;
@@ -4404,6 +5162,23 @@ SDOServiceInfo_t *sdoServiceInfoAlloc(void)
 	return sdoAlloc(sizeof(SDOServiceInfo_t));
 }
 
+/**
+ * Make room for one more key value at the end of si.
+ * @param si - Pointer to the SDOServiceInfo_t object si,
+ * @return the zeroed entry, not counted in si yet, NULL on failure.
+ */
+static SDOKeyValue_t *sdoServiceInfoSlot(SDOServiceInfo_t *si)
+{
+	SDOKeyValue_t *kv;
+
+	kv = sdoArrayGrow(si->kv, &si->capKV, (uint32_t)si->numKV,
+			  sizeof(SDOKeyValue_t));
+	if (!kv)
+		return NULL;
+	si->kv = kv;
+	return &kv[si->numKV];
+}
+
 /**
  * Create a SDOServiceInfo object, by filling the object with key & val
  * passed as parameter.
@@ -4419,12 +5194,11 @@ SDOServiceInfo_t *sdoServiceInfoAllocWith(char *key, char *val)
 	SDOServiceInfo_t *si = sdoServiceInfoAlloc();
 	if (si == NULL)
 		return NULL;
-	kv = sdoKVAllocWithStr(key, val);
-	if (!kv) {
+	kv = sdoServiceInfoSlot(si);
+	if (!kv || !key || !val || !sdoKVSetStr(kv, key, val)) {
 		sdoServiceInfoFree(si);
 		return NULL;
 	}
-	si->kv = kv;
 	si->numKV = 1;
 	return si;
 }
@@ -4437,64 +5211,56 @@ SDOServiceInfo_t *sdoServiceInfoAllocWith(char *key, char *val)
 
 void sdoServiceInfoFree(SDOServiceInfo_t *si)
 {
-	SDOKeyValue_t *kv = NULL;
+	int index;
+
 	if (!si)
 		return;
-	while ((kv = si->kv) != NULL) {
-		si->kv = kv->next;
-		sdoKVFree(kv);
-	}
+	for (index = 0; index < si->numKV; index++)
+		sdoKVClear(&si->kv[index]);
+	sdoFree(si->kv);
 	sdoFree(si);
 }
 
 /**
  * Compares the kv member of si with key parameter and
- * if there is match, return the matched pointer,
- * else last entry in the list.
+ * if there is match, return the matched pointer.
  * @param si  - Pointer to the SDOServiceInfo_t object si,
  * @param key - Pointer to the char buffer key,
- * @return pointer to SDOKeyValue_t.
+ * @return pointer to SDOKeyValue_t, NULL if there is no match.
  */
 
-SDOKeyValue_t **sdoServiceInfoFetch(SDOServiceInfo_t *si, char *key)
+SDOKeyValue_t *sdoServiceInfoFetch(SDOServiceInfo_t *si, char *key)
 {
-	SDOKeyValue_t **kvp, *kv;
-	int res = 1;
+	SDOKeyValue_t *kv;
+	int index, res = 1;
+	int keylen = strnlen_s(key, SDO_MAX_STR_SIZE);
 
-	for (kvp = &si->kv; (kv = *kvp) != NULL; kvp = &kv->next) {
-		int keylen = strnlen_s(key, SDO_MAX_STR_SIZE);
-		if (!keylen || keylen == SDO_MAX_STR_SIZE) {
-			LOG(LOG_DEBUG, "strlen() failed!\n");
-			continue;
-		}
+	if (!keylen || keylen == SDO_MAX_STR_SIZE) {
+		LOG(LOG_DEBUG, "strlen() failed!\n");
+		return NULL;
+	}
 
+	for (index = 0; index < si->numKV; index++) {
+		kv = &si->kv[index];
 		if ((strcasecmp_s(key, keylen, (char *)(kv->key->bytes),
 				  &res) == 0) &&
 		    res == 0)
-			break;
+			return kv;
 	}
-	return kvp;
+	return NULL;
 }
 /**
- * Compares the corresponding index associated with kv member of si
- * & keyNum parameter, if there is match, return the matched pointer,
- * else last entry in the list.
+ * Return the entry of si at index keyNum.
  * @param si  - Pointer to the SDOServiceInfo_t object si,
  * @param keyNum - Integer variable determines service request Info number,
- * @return pointer to SDOKeyValue_t.
+ * @return pointer to SDOKeyValue_t, NULL if keyNum is out of range.
  */
 
-SDOKeyValue_t **sdoServiceInfoGet(SDOServiceInfo_t *si, int keyNum)
+SDOKeyValue_t *sdoServiceInfoGet(SDOServiceInfo_t *si, int keyNum)
 {
-	SDOKeyValue_t **kvp, *kv;
-	int index;
-
-	for (kvp = &si->kv, index = 0; (kv = *kvp) != NULL;
-	     kvp = &kv->next, index++) {
-		if (index == keyNum)
-			break;
-	}
-	return kvp;
+	if (keyNum < 0 || keyNum >= si->numKV)
+		return NULL;
+	return &si->kv[keyNum];
 }
 /**
  * si & key are input to the function, it looks for the matching
@@ -4510,19 +5276,17 @@ SDOKeyValue_t **sdoServiceInfoGet(SDOServiceInfo_t *si, int keyNum)
 
 bool sdoServiceInfoAddKVStr(SDOServiceInfo_t *si, char *key, char *val)
 {
-	SDOKeyValue_t **kvp, *kv;
+	SDOKeyValue_t *kv;
 
 	if (!si || !key || !val)
 		return false;
 
-	kvp = sdoServiceInfoFetch(si, key);
-	kv = *kvp;
+	kv = sdoServiceInfoFetch(si, key);
 	if (kv == NULL) {
-		// Not found, at end of linked list, add a new entry
-		kv = sdoKVAllocWithStr(key, val);
-		if (kv == NULL)
+		// Not found, add a new entry in place at the end
+		kv = sdoServiceInfoSlot(si);
+		if (kv == NULL || !sdoKVSetStr(kv, key, val))
 			return false;
-		*kvp = kv; // Use this pointer to update the next value
 		si->numKV++;
 		return true;
 	} else {
@@ -4548,8 +5312,9 @@ bool sdoServiceInfoAddKVStr(SDOServiceInfo_t *si, char *key, char *val)
 	return true;
 }
 /**
- * Add kvs object of type SDOKeyValue_t to the end of the list(si) if
- * not empty else add it to the head.
+ * Add kvs object of type SDOKeyValue_t to the end of the list(si). Its
+ * contents are moved into the list and kvs itself is freed, also on
+ * failure.
  * @param si  - Pointer to the SDOServiceInfo_t list,
  * @param kvs - Pointer to the SDOKeyValue_t kvs, to be added,
  * @return true if updated correctly else false.
@@ -4559,22 +5324,18 @@ bool sdoServiceInfoAddKV(SDOServiceInfo_t *si, SDOKeyValue_t *kvs)
 {
 	SDOKeyValue_t *kv = NULL;
 
-	if (!si || !kvs)
+	if (!kvs)
 		return false;
 
-	// Is the list empty?  If it is, add this to the head of the list
-	if (si->kv == NULL) {
-		si->kv = kvs;
-		si->numKV = 1;
-		kvs->next = NULL;
-	} else {
-		// Find the last entry
-		for (kv = si->kv; kv->next != NULL; kv = kv->next)
-			;
-		kv->next = kvs;
-		si->numKV++;
-		kvs->next = NULL;
+	if (si)
+		kv = sdoServiceInfoSlot(si);
+	if (!kv) {
+		sdoKVFree(kvs);
+		return false;
 	}
+	*kv = *kvs;
+	sdoFree(kvs);
+	si->numKV++;
 	return true;
 }
 
@@ -4591,7 +5352,6 @@ bool sdoCombinePlatformDSIs(SDOW_t *sdow, SDOServiceInfo_t *si)
 {
 	int num = 0;
 	bool ret = false;
-	SDOKeyValue_t **kvp = NULL;
 	SDOKeyValue_t *kv = NULL;
 
 	if (!sdow || !si)
@@ -4599,9 +5359,7 @@ bool sdoCombinePlatformDSIs(SDOW_t *sdow, SDOServiceInfo_t *si)
 
 	// fetch all platfrom DSI's one-by-one
 	while (num != si->numKV) {
-		kvp = sdoServiceInfoGet(si, num);
-
-		kv = *kvp;
+		kv = sdoServiceInfoGet(si, num);
 		if (!kv || !kv->key || !kv->val) {
 			LOG(LOG_ERROR, "Plaform DSI: key-value not found!\n");
 			goto end;
@@ -4630,13 +5388,25 @@ end:
 bool sdoModExecSvInfotype(sdoSdkServiceInfoModuleList_t *moduleList,
 			  sdoSdkSiType type)
 {
+	int flags;
+
 	while (moduleList) {
-		if (moduleList->module.serviceInfoCallback(type, NULL, NULL) !=
+		/* on START, a module may set SDO_SI_OSI_CHUNKS and the like */
+		flags = 0;
+		if (moduleList->module.serviceInfoCallback(
+			type, type == SDO_SI_START ? &flags : NULL, NULL) !=
 		    SDO_SI_SUCCESS) {
 			LOG(LOG_DEBUG, "SvInfo: %s's CB Failed for type:%d\n",
 			    moduleList->module.moduleName, type);
 			return false;
 		}
+		if (type == SDO_SI_START) {
+			moduleList->osiChunks = flags & SDO_SI_OSI_CHUNKS;
+			moduleList->dsiAsync = flags & SDO_SI_DSI_ASYNC;
+			moduleList->osiAsync = flags & SDO_SI_OSI_ASYNC;
+			moduleList->osiOnce = (flags & SDO_SI_OSI_ONCE) &&
+					      !moduleList->osiChunks;
+		}
 		moduleList = moduleList->next;
 	}
 	return true;
@@ -4692,23 +5462,293 @@ bool sdoGetDSICount(sdoSdkServiceInfoModuleList_t *moduleList, int *modMesCount,
 	return true;
 }
 
+/**
+ * Internal API: hand an OSI value over in place, as the chunk following
+ * those of the same module message before it.
+ * @param module - module of the OSI pair.
+ * @param index - OSI index of the pair in the module.
+ * @param sv_kv - module message, and value in the input buffer.
+ * @return CB return value.
+ */
+static int sdoSupplyModuleOSIChunk(sdoSdkServiceInfoModuleList_t *module,
+				   int *index, sdoSdkSiKeyValue *sv_kv)
+{
+	int res = 1;
+	int ret;
+
+	strcmp_s(module->osiChunkMsg, sizeof(module->osiChunkMsg), sv_kv->key,
+		 &res);
+	if (res != 0) {
+		if (strcpy_s(module->osiChunkMsg, sizeof(module->osiChunkMsg),
+			     sv_kv->key) != 0)
+			return SDO_SI_INTERNAL_ERROR;
+		module->osiChunkOffset = 0;
+	}
+
+	sv_kv->offset = module->osiChunkOffset;
+	ret = module->module.serviceInfoCallback(SDO_SI_SET_OSI_CHUNK, index,
+						 sv_kv);
+	module->osiChunkOffset += sv_kv->length;
+	return ret;
+}
+
+/**
+ * Internal API: hand a copy of an OSI value over, NUL terminated.
+ * @param module - module of the OSI pair.
+ * @param sv_kv - module message, and value in the input buffer.
+ * @return CB return value.
+ */
+static int sdoSupplyModuleOSICopy(sdoSdkServiceInfoModuleList_t *module,
+				  sdoSdkSiKeyValue *sv_kv)
+{
+	char *in = sv_kv->value;
+	int ret;
+
+	sv_kv->value = sdoAlloc(sv_kv->length + 1);
+	if (!sv_kv->value) {
+		LOG(LOG_ERROR, "Malloc failed!\n");
+		sv_kv->value = in;
+		return SDO_SI_INTERNAL_ERROR;
+	}
+	if (sv_kv->length &&
+	    memcpy_s(sv_kv->value, sv_kv->length + 1, in, sv_kv->length)) {
+		sdoFree(sv_kv->value);
+		sv_kv->value = in;
+		return SDO_SI_INTERNAL_ERROR;
+	}
+
+	ret = module->module.serviceInfoCallback(
+	    SDO_SI_SET_OSI, &module->moduleOsiIndex, sv_kv);
+	sdoFree(sv_kv->value);
+	sv_kv->value = in;
+	return ret;
+}
+
+#ifdef OSI_ASYNC_WORKER
+/* A copy of an OSI pair, queued for the worker of its module */
+typedef struct sdoOsiItem_s {
+	struct sdoOsiItem_s *next;
+	int index; // OSI index of the pair in the module
+	char key[SDO_MODULE_MSG_LEN + 1];
+	char *value; // length bytes, NUL terminated
+	size_t length;
+} sdoOsiItem_t;
+
+/*
+ * Worker applying the OSIs of a module taking SDO_SI_OSI_ASYNC, in order:
+ * a task of the shared pool drains the queue, and is submitted again by
+ * the next OSI queued once it is over, so that one runs at a time.
+ */
+typedef struct {
+	sdoTask_t *task; // the last task draining the queue
+	pthread_mutex_t lock;
+	bool draining; // the task takes the OSIs queued
+	int result;    // CB return value of the first failure
+	sdoOsiItem_t *head;
+	sdoOsiItem_t *tail;
+	sdoSdkServiceInfoModuleList_t *module;
+	sdoOsiCache_t *osiCache; // of the instance of the module, may be NULL
+} sdoOsiWorker_t;
+
+/**
+ * Internal API: apply the OSIs queued for a module, skipping those after a
+ * failure, until the queue is empty.
+ */
+static int32_t sdoOsiWorkerRun(void *arg)
+{
+	sdoOsiWorker_t *w = arg;
+	sdoSdkServiceInfoModuleList_t *module = w->module;
+	sdoSdkSiKeyValue kv;
+	sdoOsiItem_t *item;
+	int ret;
+
+	pthread_mutex_lock(&w->lock);
+	for (;;) {
+		item = w->head;
+		if (!item)
+			break;
+		w->head = item->next;
+		if (!w->head)
+			w->tail = NULL;
+		ret = w->result;
+		pthread_mutex_unlock(&w->lock);
+
+		if (ret == SDO_SI_SUCCESS) {
+			kv.key = item->key;
+			kv.value = item->value;
+			kv.offset = 0;
+			kv.length = item->length;
+			if (module->osiChunks)
+				ret = sdoSupplyModuleOSIChunk(
+				    module, &item->index, &kv);
+			else
+				ret = module->module.serviceInfoCallback(
+				    SDO_SI_SET_OSI, &item->index, &kv);
+			if (ret != SDO_SI_SUCCESS) {
+				LOG(LOG_ERROR, "SvInfo: %s's OSI CB Failed\n",
+				    module->module.moduleName);
+			} else if (module->osiOnce) {
+				sdoOsiCacheAdd(w->osiCache,
+					       module->module.moduleName, &kv);
+			}
+		}
+		sdoFree(item->value);
+		sdoFree(item);
+
+		pthread_mutex_lock(&w->lock);
+		w->result = ret;
+	}
+	w->draining = false;
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+/**
+ * Internal API: set up the worker applying the OSIs of a module taking
+ * SDO_SI_OSI_ASYNC.
+ * @param module - the module.
+ * @param osiCache - OSIs applied by the modules, may be NULL.
+ * @return the worker, NULL if it could not be set up.
+ */
+static sdoOsiWorker_t *
+sdoOsiWorkerStart(sdoSdkServiceInfoModuleList_t *module,
+		  sdoOsiCache_t *osiCache)
+{
+	sdoOsiWorker_t *w = sdoAlloc(sizeof(sdoOsiWorker_t));
+
+	if (!w)
+		return NULL;
+	if (0 != pthread_mutex_init(&w->lock, NULL)) {
+		sdoFree(w);
+		return NULL;
+	}
+	w->result = SDO_SI_SUCCESS;
+	w->module = module;
+	w->osiCache = osiCache;
+	return w;
+}
+#endif
+
+/**
+ * Internal API: queue a copy of an OSI pair for the worker of its module,
+ * setting it up with the first one and submitting its task if none is
+ * draining the queue, for the pair to be applied while the next messages
+ * are exchanged.
+ * @param module - module of the OSI pair, taking SDO_SI_OSI_ASYNC.
+ * @param osiCache - OSIs applied by the modules, may be NULL.
+ * @param sv_kv - module message, and value in the input buffer.
+ * @param cbReturnVal - filled with SDO_SI_SUCCESS, or the CB return value
+ * of a failure of the worker so far.
+ * @return false if there is no worker, for the pair to be handed over now.
+ */
+static bool sdoOsiQueue(sdoSdkServiceInfoModuleList_t *module,
+			sdoOsiCache_t *osiCache, sdoSdkSiKeyValue *sv_kv,
+			int *cbReturnVal)
+{
+#ifdef OSI_ASYNC_WORKER
+	sdoOsiWorker_t *w = module->osiWorker;
+	sdoOsiItem_t *item;
+	bool submit;
+
+	if (!w) {
+		w = sdoOsiWorkerStart(module, osiCache);
+		if (!w)
+			return false;
+		module->osiWorker = w;
+	}
+
+	*cbReturnVal = SDO_SI_INTERNAL_ERROR;
+	item = sdoAlloc(sizeof(sdoOsiItem_t));
+	if (!item)
+		return true;
+	item->value = sdoAlloc(sv_kv->length + 1);
+	if (!item->value ||
+	    strcpy_s(item->key, sizeof(item->key), sv_kv->key) != 0 ||
+	    (sv_kv->length && memcpy_s(item->value, sv_kv->length + 1,
+				       sv_kv->value, sv_kv->length))) {
+		sdoFree(item->value);
+		sdoFree(item);
+		return true;
+	}
+	item->length = sv_kv->length;
+	item->index = module->moduleOsiIndex;
+
+	pthread_mutex_lock(&w->lock);
+	if (w->tail)
+		w->tail->next = item;
+	else
+		w->head = item;
+	w->tail = item;
+	*cbReturnVal = w->result;
+	submit = !w->draining;
+	w->draining = true;
+	pthread_mutex_unlock(&w->lock);
+
+	if (submit) {
+		/* the last task is over, or about to return */
+		(void)sdoTaskJoin(w->task, NULL);
+		w->task =
+		    sdoTaskSubmit(sdoTaskPoolShared(), sdoOsiWorkerRun, w);
+		if (!w->task)
+			(void)sdoOsiWorkerRun(w);
+	}
+	return true;
+#else
+	(void)module;
+	(void)osiCache;
+	(void)sv_kv;
+	(void)cbReturnVal;
+	return false;
+#endif
+}
+
+/**
+ * Wait for the OSIs queued for the modules taking SDO_SI_OSI_ASYNC to be
+ * applied, freeing their workers. Done before msg50, and as TO2 ends for
+ * no module callback to run on them afterwards.
+ * @param moduleList - Global Module List Head Pointer.
+ * @return true if all of them were applied, false if a CB failed.
+ */
+bool sdoOsiJoin(sdoSdkServiceInfoModuleList_t *moduleList)
+{
+	bool ok = true;
+#ifdef OSI_ASYNC_WORKER
+	sdoOsiWorker_t *w;
+
+	for (; moduleList; moduleList = moduleList->next) {
+		w = moduleList->osiWorker;
+		if (!w)
+			continue;
+		(void)sdoTaskJoin(w->task, NULL);
+		if (w->result != SDO_SI_SUCCESS)
+			ok = false;
+		pthread_mutex_destroy(&w->lock);
+		sdoFree(w);
+		moduleList->osiWorker = NULL;
+	}
+#else
+	(void)moduleList;
+#endif
+	return ok;
+}
+
 /**
  * Traverse the list for OSI, comparing list with name & calling the appropriate
  * CB.
  * @param moduleList - Global Module List Head Pointer.
+ * @param osiCache - OSIs applied by the modules, may be NULL.
  * @param mod_name - Pointer to the mod_name, to be compared with list's modname
  * @param sv_kv - Pointer of type sdoSdkSiKeyValue, holds Module message &
- * value.
+ * value, sv_kv->length bytes in the input buffer.
  * @param cbReturnVal - Pointer of type int which will be filled with CB return
  * value.
  * @return true if success (module found in list + CB succeed) else false.
  */
 
 bool sdoSupplyModuleOSI(sdoSdkServiceInfoModuleList_t *moduleList,
-			char *mod_name, sdoSdkSiKeyValue *sv_kv,
-			int *cbReturnVal)
+			sdoOsiCache_t *osiCache, char *mod_name,
+			sdoSdkSiKeyValue *sv_kv, int *cbReturnVal)
 {
-	int strcmp_result = 1;
 	bool retval = false;
 
 	if (!cbReturnVal)
@@ -4720,27 +5760,38 @@ bool sdoSupplyModuleOSI(sdoSdkServiceInfoModuleList_t *moduleList,
 	}
 
 	retval = true;
-	while (moduleList) {
-		strcmp_s(moduleList->module.moduleName, SDO_MODULE_NAME_LEN,
-			 mod_name, &strcmp_result);
-		if (strcmp_result == 0) {
-			// check if module CB is successful
-			*cbReturnVal = moduleList->module.serviceInfoCallback(
-			    SDO_SI_SET_OSI, &(moduleList->moduleOsiIndex),
-			    sv_kv);
-
-			if (*cbReturnVal != SDO_SI_SUCCESS) {
-				LOG(LOG_ERROR,
-				    "SvInfo: %s's CB Failed for type:%d\n",
-				    moduleList->module.moduleName,
-				    SDO_SI_SET_OSI);
-				retval = false;
-			}
-			// Inc OSI index per module
-			moduleList->moduleOsiIndex++;
-			break;
+	moduleList = sdoModuleLookup(moduleList, mod_name);
+	if (moduleList) {
+		// check if module CB is successful
+		if (moduleList->osiOnce &&
+		    sdoOsiCacheApplied(osiCache, mod_name, sv_kv)) {
+			LOG(LOG_DEBUG, "SvInfo: %s's %s applied already\n",
+			    mod_name, sv_kv->key);
+			*cbReturnVal = SDO_SI_SUCCESS;
+		} else if (moduleList->osiAsync &&
+			   sdoOsiQueue(moduleList, osiCache, sv_kv,
+				       cbReturnVal)) {
+			/* applied by its worker, failures so far reported */
+		} else if (moduleList->osiChunks) {
+			*cbReturnVal = sdoSupplyModuleOSIChunk(
+			    moduleList, &moduleList->moduleOsiIndex, sv_kv);
+		} else {
+			*cbReturnVal =
+			    sdoSupplyModuleOSICopy(moduleList, sv_kv);
+			if (*cbReturnVal == SDO_SI_SUCCESS &&
+			    moduleList->osiOnce)
+				sdoOsiCacheAdd(osiCache, mod_name, sv_kv);
 		}
-		moduleList = moduleList->next;
+
+		if (*cbReturnVal != SDO_SI_SUCCESS) {
+			LOG(LOG_ERROR, "SvInfo: %s's CB Failed for type:%d\n",
+			    moduleList->module.moduleName,
+			    moduleList->osiChunks ? SDO_SI_SET_OSI_CHUNK
+						  : SDO_SI_SET_OSI);
+			retval = false;
+		}
+		// Inc OSI index per module
+		moduleList->moduleOsiIndex++;
 	}
 
 	return retval;
@@ -4762,7 +5813,6 @@ bool sdoSupplyModulePSI(sdoSdkServiceInfoModuleList_t *moduleList,
 			char *mod_name, sdoSdkSiKeyValue *sv_kv,
 			int *cbReturnVal)
 {
-	int strcmp_result = 1;
 	bool retval = false;
 
 	if (!cbReturnVal)
@@ -4774,27 +5824,19 @@ bool sdoSupplyModulePSI(sdoSdkServiceInfoModuleList_t *moduleList,
 	}
 
 	retval = true;
-	while (moduleList) {
-		strcmp_s(moduleList->module.moduleName, SDO_MODULE_NAME_LEN,
-			 mod_name, &strcmp_result);
-		if (strcmp_result == 0) {
-			// check if module CB is successful
-			*cbReturnVal = moduleList->module.serviceInfoCallback(
-			    SDO_SI_SET_PSI, &(moduleList->modulePsiIndex),
-			    sv_kv);
-
-			if (*cbReturnVal != SDO_SI_SUCCESS) {
-				LOG(LOG_ERROR,
-				    "SvInfo: %s's CB Failed for type:%d\n",
-				    moduleList->module.moduleName,
-				    SDO_SI_SET_PSI);
-				retval = false;
-			}
-			// Inc PSI index per module
-			moduleList->modulePsiIndex++;
-			break;
+	moduleList = sdoModuleLookup(moduleList, mod_name);
+	if (moduleList) {
+		// check if module CB is successful
+		*cbReturnVal = moduleList->module.serviceInfoCallback(
+		    SDO_SI_SET_PSI, &(moduleList->modulePsiIndex), sv_kv);
+
+		if (*cbReturnVal != SDO_SI_SUCCESS) {
+			LOG(LOG_ERROR, "SvInfo: %s's CB Failed for type:%d\n",
+			    moduleList->module.moduleName, SDO_SI_SET_PSI);
+			retval = false;
 		}
-		moduleList = moduleList->next;
+		// Inc PSI index per module
+		moduleList->modulePsiIndex++;
 	}
 
 	return retval;
@@ -5003,6 +6045,370 @@ bool sdoConstructModuleDSI(sdoSvInfoDsiInfo_t *dsiInfo, sdoSdkSiKeyValue *sv_kv,
 	return true;
 }
 
+#ifdef DSI_ASYNC_WORKER
+/* Task of the shared pool building the rounds of the modules taking
+ * SDO_SI_DSI_ASYNC */
+typedef struct {
+	sdoTask_t *task;
+	pthread_mutex_t lock;
+	pthread_cond_t built; // a round was built, or done was set
+	bool done;	      // no more rounds coming, all built or not
+	sdoSvInfoDsiSnap_t *snap;
+	sdoSdkServiceInfoModuleList_t *moduleList;
+} sdoDsiWorker_t;
+#endif
+
+/**
+ * Wait for the rounds of the DSI snapshot still being built, keeping them
+ * only if all of them were.
+ * @param snap - DSI snapshot.
+ */
+void sdoDsiSnapJoin(sdoSvInfoDsiSnap_t *snap)
+{
+#ifdef DSI_ASYNC_WORKER
+	sdoDsiWorker_t *w;
+	int r;
+
+	if (!snap || !snap->worker)
+		return;
+	w = snap->worker;
+	(void)sdoTaskJoin(w->task, NULL);
+	pthread_cond_destroy(&w->built);
+	pthread_mutex_destroy(&w->lock);
+	sdoFree(w);
+	snap->worker = NULL;
+
+	for (r = 0; r < snap->rounds; r++) {
+		if (!snap->round[r]) {
+			sdoDsiSnapFree(snap);
+			break;
+		}
+	}
+#else
+	(void)snap;
+#endif
+}
+
+/**
+ * Free the rounds of a DSI snapshot, for them to be built again.
+ * @param snap - DSI snapshot.
+ */
+void sdoDsiSnapFree(sdoSvInfoDsiSnap_t *snap)
+{
+	int r;
+
+	if (!snap || !snap->round)
+		return;
+	sdoDsiSnapJoin(snap);
+	if (!snap->round)
+		return;
+	for (r = 0; r < snap->rounds; r++)
+		sdoByteArrayFree(snap->round[r]);
+	sdoFree(snap->round);
+	snap->round = NULL;
+	snap->rounds = 0;
+}
+
+/**
+ * Internal API: encode DSI index of a module, as the "dsi" of a msg46.
+ */
+static SDOByteArray_t *sdoDsiSnapModule(SDOW_t *sdow,
+					sdoSdkServiceInfoModuleList_t *module,
+					int index)
+{
+	sdoSdkSiKeyValue *sv_kv = sdoAlloc(sizeof(sdoSdkSiKeyValue));
+	SDOByteArray_t *ba = NULL;
+
+	if (!sv_kv)
+		return NULL;
+	sdoWBlockReset(sdow);
+	if (module->module.serviceInfoCallback(SDO_SI_GET_DSI, &index,
+					       sv_kv) != SDO_SI_SUCCESS) {
+		LOG(LOG_ERROR, "SvInfo: %s's DSI CB Failed!\n",
+		    module->module.moduleName);
+	} else if (sdoModDataKV(module->module.moduleName, sv_kv) &&
+		   sdoModKVWrite(sdow, sv_kv)) {
+		ba = sdoByteArrayAllocWithByteArray(sdow->b.block,
+						    sdow->b.blockSize);
+	}
+	sdoSVKeyValueFree(sv_kv);
+	return ba;
+}
+
+/**
+ * Internal API: encode the DSIs of the modules, those of the modules
+ * taking SDO_SI_DSI_ASYNC only if async, the others only if not.
+ * @return false if a DSI could not be encoded.
+ */
+static bool sdoDsiSnapModules(sdoSvInfoDsiSnap_t *snap,
+			      sdoSdkServiceInfoModuleList_t *moduleList,
+			      bool async, void *worker)
+{
+	SDOByteArray_t *ba;
+	SDOW_t sdow;
+	bool ok = true;
+	int r, i;
+
+	if (!sdoWInit(&sdow))
+		return false;
+	sdow.encoding = snap->encoding;
+
+	for (; ok && moduleList; moduleList = moduleList->next) {
+		if (moduleList->dsiAsync != async)
+			continue;
+		r = moduleList->dsiRound;
+		for (i = 0; ok && i < moduleList->moduleDsiCount; i++, r++) {
+			ba = sdoDsiSnapModule(&sdow, moduleList, i);
+			ok = ba != NULL;
+#ifdef DSI_ASYNC_WORKER
+			if (worker) {
+				sdoDsiWorker_t *w = worker;
+
+				pthread_mutex_lock(&w->lock);
+				snap->round[r] = ba;
+				pthread_cond_broadcast(&w->built);
+				pthread_mutex_unlock(&w->lock);
+				continue;
+			}
+#endif
+			snap->round[r] = ba;
+		}
+	}
+	(void)worker;
+	sdoFree(sdow.b.block);
+	return ok;
+}
+
+#ifdef DSI_PACK
+/**
+ * Internal API: move round r of the DSI snapshot to round *n, or append its
+ * DSIs to those of round *n - 1 if open and they fit in DSI_PACK bytes.
+ */
+static void sdoDsiSnapPut(sdoSvInfoDsiSnap_t *snap, int r, int *n, bool *open)
+{
+	/* the DSIs of JSON objects are separated by a comma */
+	int sep = snap->encoding == SDO_ENCODING_CBOR ? 0 : 1;
+	SDOByteArray_t *dsi = snap->round[r];
+	SDOByteArray_t *last = *n ? snap->round[*n - 1] : NULL;
+	SDOByteArray_t *ba;
+
+	snap->round[r] = NULL;
+	if (*open && last->byteSz + sep + dsi->byteSz <= DSI_PACK) {
+		ba = sdoByteArrayAlloc(last->byteSz + sep + dsi->byteSz);
+		if (ba &&
+		    !memcpy_s(ba->bytes, ba->byteSz, last->bytes,
+			      last->byteSz) &&
+		    !memcpy_s(ba->bytes + last->byteSz + sep,
+			      ba->byteSz - last->byteSz - sep, dsi->bytes,
+			      dsi->byteSz)) {
+			if (sep)
+				ba->bytes[last->byteSz] = ',';
+			sdoByteArrayFree(last);
+			sdoByteArrayFree(dsi);
+			snap->round[*n - 1] = ba;
+			return;
+		}
+		sdoByteArrayFree(ba);
+	}
+	snap->round[(*n)++] = dsi;
+	*open = true;
+}
+
+/**
+ * Internal API: pack the DSIs of the snapshot into as few rounds as fit in
+ * DSI_PACK bytes each, in order. The DSIs of the modules taking
+ * SDO_SI_DSI_ASYNC, not built yet if async, keep a round each.
+ */
+static void sdoDsiSnapPack(sdoSvInfoDsiSnap_t *snap,
+			   sdoSdkServiceInfoModuleList_t *moduleList,
+			   bool async)
+{
+	bool open = false;
+	int n = 0;
+	int first, i;
+
+	sdoDsiSnapPut(snap, 0, &n, &open);
+	for (; moduleList; moduleList = moduleList->next) {
+		first = moduleList->dsiRound;
+		moduleList->dsiRound = n;
+		if (async && moduleList->dsiAsync) {
+			n += moduleList->moduleDsiCount;
+			open = false;
+			continue;
+		}
+		for (i = 0; i < moduleList->moduleDsiCount; i++)
+			sdoDsiSnapPut(snap, first + i, &n, &open);
+	}
+	snap->rounds = n;
+}
+#endif
+
+#ifdef DSI_ASYNC_WORKER
+/**
+ * Internal API: build the rounds of the modules taking SDO_SI_DSI_ASYNC,
+ * while the messages before them are exchanged.
+ */
+static int32_t sdoDsiWorkerRun(void *arg)
+{
+	sdoDsiWorker_t *w = arg;
+
+	if (!sdoDsiSnapModules(w->snap, w->moduleList, true, w))
+		LOG(LOG_DEBUG, "SvInfo: asynchronous DSIs not built\n");
+
+	pthread_mutex_lock(&w->lock);
+	w->done = true;
+	pthread_cond_broadcast(&w->built);
+	pthread_mutex_unlock(&w->lock);
+	return 0;
+}
+
+/**
+ * Internal API: start the worker building the rounds of the modules taking
+ * SDO_SI_DSI_ASYNC.
+ * @return false if it could not be started.
+ */
+static bool sdoDsiWorkerStart(sdoSvInfoDsiSnap_t *snap,
+			      sdoSdkServiceInfoModuleList_t *moduleList)
+{
+	sdoDsiWorker_t *w = sdoAlloc(sizeof(sdoDsiWorker_t));
+
+	if (!w)
+		return false;
+	if (0 != pthread_mutex_init(&w->lock, NULL)) {
+		sdoFree(w);
+		return false;
+	}
+	if (0 != pthread_cond_init(&w->built, NULL)) {
+		pthread_mutex_destroy(&w->lock);
+		sdoFree(w);
+		return false;
+	}
+	w->snap = snap;
+	w->moduleList = moduleList;
+	w->task = sdoTaskSubmit(sdoTaskPoolShared(), sdoDsiWorkerRun, w);
+	if (!w->task) {
+		pthread_cond_destroy(&w->built);
+		pthread_mutex_destroy(&w->lock);
+		sdoFree(w);
+		return false;
+	}
+	snap->worker = w;
+	return true;
+}
+#endif
+
+/**
+ * Get the DSI snapshot of a TO2 run, building it if there is none for the
+ * encoding or the modules changed their DSIs since. Building it runs the
+ * GET_DSI_COUNT and GET_DSI callbacks of the modules, once; those of the
+ * modules taking SDO_SI_DSI_ASYNC on a task of the shared pool, their
+ * rounds being waited for by sdoDsiSnapRound.
+ * @param snap - DSI snapshot of the device.
+ * @param si - platform DSIs.
+ * @param moduleList - Global Module List Head Pointer.
+ * @param encoding - SDO_ENCODING_* of the messages.
+ * @return true if snap holds the rounds, false to build the DSIs of each
+ * message as it is sent.
+ */
+bool sdoDsiSnapGet(sdoSvInfoDsiSnap_t *snap, SDOServiceInfo_t *si,
+		   sdoSdkServiceInfoModuleList_t *moduleList, uint8_t encoding)
+{
+	sdoSdkServiceInfoModuleList_t *module;
+	int modMesCount = 0;
+	int cbReturnVal = 0;
+	bool async = false;
+	SDOW_t sdow;
+	int r;
+
+	if (!snap || !si)
+		return false;
+	sdoDsiSnapJoin(snap);
+	if (snap->round && snap->builtGen == snap->gen &&
+	    snap->encoding == encoding)
+		return true;
+
+	sdoDsiSnapFree(snap);
+	if (!sdoGetDSICount(moduleList, &modMesCount, &cbReturnVal))
+		return false;
+
+	snap->round = sdoAlloc((1 + modMesCount) * sizeof(*snap->round));
+	if (!snap->round)
+		return false;
+	snap->rounds = 1 + modMesCount;
+	/* the callbacks may bump gen, as of which the snapshot is */
+	snap->builtGen = snap->gen;
+	snap->encoding = encoding;
+
+	/* a round per DSI, the platform DSIs first */
+	for (r = 1, module = moduleList; module; module = module->next) {
+		module->dsiRound = r;
+		r += module->moduleDsiCount;
+		async |= module->dsiAsync && module->moduleDsiCount;
+	}
+
+	if (!sdoWInit(&sdow))
+		goto err;
+	sdow.encoding = encoding;
+	if (sdoCombinePlatformDSIs(&sdow, si))
+		snap->round[0] = sdoByteArrayAllocWithByteArray(
+		    sdow.b.block, sdow.b.blockSize);
+	sdoFree(sdow.b.block);
+	if (!snap->round[0] ||
+	    !sdoDsiSnapModules(snap, moduleList, false, NULL))
+		goto err;
+#ifndef DSI_ASYNC_WORKER
+	/* no worker, build them now */
+	if (async && !sdoDsiSnapModules(snap, moduleList, true, NULL))
+		goto err;
+	async = false;
+#endif
+
+#ifdef DSI_PACK
+	sdoDsiSnapPack(snap, moduleList, async);
+#endif
+#ifdef DSI_ASYNC_WORKER
+	/* if no worker can be started, build them now */
+	if (async && !sdoDsiWorkerStart(snap, moduleList) &&
+	    !sdoDsiSnapModules(snap, moduleList, true, NULL))
+		goto err;
+#endif
+	return true;
+
+err:
+	LOG(LOG_DEBUG, "SvInfo: DSIs not in snapshot\n");
+	sdoDsiSnapFree(snap);
+	return false;
+}
+
+/**
+ * Get a round of the DSI snapshot, waiting for it if it is being built.
+ * @param snap - DSI snapshot of sdoDsiSnapGet.
+ * @param r - round, the "nn" of the msg46.
+ * @return the encoded DSIs, NULL if they could not be built.
+ */
+const SDOByteArray_t *sdoDsiSnapRound(sdoSvInfoDsiSnap_t *snap, int r)
+{
+#ifdef DSI_ASYNC_WORKER
+	const SDOByteArray_t *ba;
+	sdoDsiWorker_t *w;
+#endif
+
+	if (!snap || !snap->round || r < 0 || r >= snap->rounds)
+		return NULL;
+#ifdef DSI_ASYNC_WORKER
+	w = snap->worker;
+	if (w) {
+		pthread_mutex_lock(&w->lock);
+		while (!snap->round[r] && !w->done)
+			pthread_cond_wait(&w->built, &w->lock);
+		ba = snap->round[r];
+		pthread_mutex_unlock(&w->lock);
+		return ba;
+	}
+#endif
+	return snap->round[r];
+}
+
 /**
  * Write the key value to the buffer
  * @param sdow - pointer to the output buffer
@@ -5045,15 +6451,18 @@ void sdoSVKeyValueFree(sdoSdkSiKeyValue *sv_kv)
 
 /**
  * Read a SvInfo (OSI) Key/Value pair from the input buffer
- * The Key and value both  MUST be a null terminated string.
+ * The Key MUST be a null terminated string, the value is sv->length bytes
+ * in the input buffer.
  * @param moduleList - Global Module List Head Pointer.
+ * @param osiCache - OSIs applied by the modules, may be NULL.
  * @param sv - pointer to the SvInfo key/value pair
  * @param cbReturnVal - Pointer of type int which will be filled with CB return
  * value.
  * @return true if read succeeded, false otherwise
  */
 bool sdoOsiHandling(sdoSdkServiceInfoModuleList_t *moduleList,
-		    sdoSdkSiKeyValue *sv, int *cbReturnVal)
+		    sdoOsiCache_t *osiCache, sdoSdkSiKeyValue *sv,
+		    int *cbReturnVal)
 {
 	char mod_name[SDO_MODULE_NAME_LEN + 1];
 	char mod_msg[SDO_MODULE_MSG_LEN + 1];
@@ -5108,7 +6517,8 @@ bool sdoOsiHandling(sdoSdkServiceInfoModuleList_t *moduleList,
 		return false;
 	}
 
-	if (!sdoSupplyModuleOSI(moduleList, mod_name, sv, cbReturnVal))
+	if (!sdoSupplyModuleOSI(moduleList, osiCache, mod_name, sv,
+				cbReturnVal))
 		return false;
 
 	*cbReturnVal = SDO_SI_SUCCESS;
@@ -5116,19 +6526,158 @@ bool sdoOsiHandling(sdoSdkServiceInfoModuleList_t *moduleList,
 }
 
 /**
- * SvInfo: Clear the Module PSI and OSI Index for next rounds.
+ * Internal API: start the PSI and OSI indexes of a module over.
+ */
+static void sdoModuleClearIndex(sdoSdkServiceInfoModuleList_t *module)
+{
+	module->modulePsiIndex = 0;
+	module->moduleOsiIndex = 0;
+	module->osiChunkMsg[0] = 0;
+	module->osiChunkOffset = 0;
+}
+
+/**
+ * SvInfo: Clear the Module PSI and OSI Index for next rounds. The modules of
+ * a registry are cleared as they are next looked up.
  * @param moduleList - Global Module List Head Pointer.
  * @return none
  */
 void sdoSvInfoClearModulePsiOsiIndex(sdoSdkServiceInfoModuleList_t *moduleList)
 {
-	if (moduleList) {
-		while (moduleList) {
-			moduleList->modulePsiIndex = 0;
-			moduleList->moduleOsiIndex = 0;
-			moduleList = moduleList->next;
+	if (moduleList && moduleList->reg) {
+		moduleList->reg->round++;
+		return;
+	}
+	while (moduleList) {
+		sdoModuleClearIndex(moduleList);
+		moduleList = moduleList->next;
+	}
+}
+
+/**
+ * Internal API: slot of the index where the name is, or is to go.
+ * @return the slot, SDO_MODULE_SLOTS if the index is full.
+ */
+static uint32_t sdoModuleSlot(const sdoSdkServiceInfoModuleReg_t *reg,
+			      const char *name)
+{
+	uint32_t h = 2166136261u; // FNV-1a
+	uint32_t i, n, slot;
+	int res;
+
+	for (i = 0; i < SDO_MODULE_NAME_LEN && name[i]; i++)
+		h = (h ^ (uint8_t)name[i]) * 16777619u;
+
+	for (n = 0; n < SDO_MODULE_SLOTS; n++) {
+		slot = (h + n) % SDO_MODULE_SLOTS;
+		if (!reg->slot[slot])
+			return slot;
+		res = 1;
+		strcmp_s(reg->slot[slot]->module.moduleName,
+			 SDO_MODULE_NAME_LEN, name, &res);
+		if (res == 0)
+			return slot;
+	}
+	return SDO_MODULE_SLOTS;
+}
+
+/**
+ * Add a module to the end of a registry, at most SDO_MAX_MODULES with
+ * different names.
+ * @param reg - registry.
+ * @param module - module, copied into the next node of the registry.
+ * @return true if success else false.
+ */
+bool sdoModuleRegAdd(sdoSdkServiceInfoModuleReg_t *reg,
+		     const sdoSdkServiceInfoModule *module)
+{
+	sdoSdkServiceInfoModuleList_t *node;
+	uint32_t slot;
+
+	if (!reg || !module)
+		return false;
+
+	if (reg->count >= SDO_MAX_MODULES) {
+		LOG(LOG_ERROR, "More than %d modules\n", SDO_MAX_MODULES);
+		return false;
+	}
+	slot = sdoModuleSlot(reg, module->moduleName);
+	if (slot == SDO_MODULE_SLOTS || reg->slot[slot]) {
+		LOG(LOG_ERROR, "Module %s registered already\n",
+		    module->moduleName);
+		return false;
+	}
+
+	node = &reg->node[reg->count];
+	if (memset_s(node, sizeof(*node), 0) != 0 ||
+	    memcpy_s(&node->module, sizeof(node->module), module,
+		     sizeof(*module)) != 0) {
+		LOG(LOG_ERROR, "Memcpy Failed\n");
+		return false;
+	}
+
+	reg->slot[slot] = node;
+	node->reg = reg;
+	node->round = reg->round;
+	if (reg->tail)
+		reg->tail->next = node;
+	else
+		reg->head = node;
+	reg->tail = node;
+	reg->count++;
+	return true;
+}
+
+/**
+ * Free the modules of a registry, leaving it empty.
+ * @param reg - registry.
+ */
+void sdoModuleRegFree(sdoSdkServiceInfoModuleReg_t *reg)
+{
+	if (!reg)
+		return;
+	if (memset_s(reg, sizeof(*reg), 0) != 0)
+		LOG(LOG_ERROR, "Memset failed\n");
+}
+
+/**
+ * Find a module by name, through the index of its registry if it has one,
+ * with its PSI and OSI indexes of the current round.
+ * @param moduleList - Global Module List Head Pointer.
+ * @param name - name of the module.
+ * @return the module, NULL if there is none of that name.
+ */
+sdoSdkServiceInfoModuleList_t *
+sdoModuleLookup(sdoSdkServiceInfoModuleList_t *moduleList, const char *name)
+{
+	sdoSdkServiceInfoModuleReg_t *reg;
+	uint32_t slot;
+	int res;
+
+	if (!moduleList || !name)
+		return NULL;
+
+	reg = moduleList->reg;
+	if (!reg) {
+		for (; moduleList; moduleList = moduleList->next) {
+			res = 1;
+			strcmp_s(moduleList->module.moduleName,
+				 SDO_MODULE_NAME_LEN, name, &res);
+			if (res == 0)
+				return moduleList;
 		}
+		return NULL;
+	}
+
+	slot = sdoModuleSlot(reg, name);
+	if (slot == SDO_MODULE_SLOTS || !reg->slot[slot])
+		return NULL;
+	moduleList = reg->slot[slot];
+	if (moduleList->round != reg->round) {
+		sdoModuleClearIndex(moduleList);
+		moduleList->round = reg->round;
 	}
+	return moduleList;
 }
 
 /**
@@ -5301,11 +6850,11 @@ end:
 	char vbuf[KVBUF_SIZE];
 
 	LOG(LOG_DEBUG, "{#SDOServiceInfo numKV: %u\n", si->numKV);
-	for (kv = si->kv; kv; kv = kv->next) {
+	for (kv = si->kv; kv < si->kv + si->numKV; kv++) {
 		LOG(LOG_DEBUG, "    \"%s\":\"%s\"%s\n",
 		    sdoStringToString(kv->key, kbuf, KVBUF_SIZE),
 		    sdoStringToString(kv->val, vbuf, KVBUF_SIZE),
-		    kv->next ? "," : "");
+		    kv + 1 < si->kv + si->numKV ? "," : "");
 	}
 	LOG(LOG_DEBUG, "}\n");
 }
@@ -54,6 +54,7 @@ DFLAGS += -DMBEDOS_SD_DATA
 MBEDOS_STORAGE_IGNORE_LIST +='storage_if_mbedFlash.cpp\n'
 else
 MBEDOS_STORAGE_IGNORE_LIST +='storage_if_mbedSD.cpp\n'
+MBEDOS_STORAGE_IGNORE_LIST +='SDCacheBlockDevice.cpp\n'
 endif
 
 ifeq ($(KEX), dh)
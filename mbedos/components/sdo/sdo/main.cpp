@@ -21,6 +21,9 @@
 #include "SDBlockDevice.h"
 #include "FATFileSystem.h"
 #endif
+#if defined(MBEDOS_SD_DATA)
+#include "SDCacheBlockDevice.h"
+#endif
 #include "EthernetInterface.h"
 
 extern "C" int TO2_done;
@@ -33,7 +36,13 @@ extern void cloud_main(SDBlockDevice *bd, FATFileSystem *fs);
 #if defined(MBEDOS_SD_DATA) || defined(CLOUD_CLIENT)
 #define SD_MOUNT_POINT "sd"
 SDBlockDevice bd(PE_6, PE_5, PE_2, PE_4);
+#if defined(MBEDOS_SD_DATA) && SD_CACHE
+// the blobs are read and written through the sector cache
+SDCacheBlockDevice sdCache(&bd);
+FATFileSystem fs(SD_MOUNT_POINT, &sdCache);
+#else
 FATFileSystem fs(SD_MOUNT_POINT, &bd);
+#endif
 #endif // defined(MBEDOS_SD_DATA)
 
 #if !defined(MBEDOS_SD_DATA)
@@ -47,8 +56,26 @@ void end_eth(void); // closes Ethernet socket
 EthernetInterface net;
 nsapi_error_t status;
 
+/*
+ * The network is brought up (DHCP) by a thread of its own while the SDK
+ * loads the credentials from storage and sets up crypto, it is waited for
+ * when first used: the DNS lookup or connection of the first message.
+ */
+static Thread netThread;
+static bool netStarted;
+static bool netJoined;
+
+static void netBringUp(void)
+{
+	(void)init_eth();
+}
+
 EthernetInterface *getNetinterface(void)
 {
+	if (netStarted && !netJoined) {
+		netThread.join();
+		netJoined = true;
+	}
 	return &net;
 }
 
@@ -78,8 +105,8 @@ int init_eth(void)
 
 void end_eth(void)
 {
-	// Bring down the ethernet interface
-	net.disconnect();
+	// Bring down the ethernet interface, once it is up
+	getNetinterface()->disconnect();
 	// delete &net;
 } // end end_eth
 
@@ -91,7 +118,9 @@ int main()
 	       MBED_MINOR_VERSION, MBED_PATCH_VERSION);
 #endif
 
-	init_eth();
+	netStarted = netThread.start(callback(netBringUp)) == osOK;
+	if (!netStarted)
+		init_eth();
 #if !defined(MBEDOS_SD_DATA)
 	initiate_files_firsttime();
 #endif
@@ -103,6 +132,10 @@ int main()
 	app_main();
 	if (TO2_done == 1) {
 #ifdef CLOUD_CLIENT
+#if defined(MBEDOS_SD_DATA) && SD_CACHE
+		// the client also goes to the card without the cache
+		sdCache.invalidate();
+#endif
 		cloud_main(&bd, &fs);
 #endif
 	}
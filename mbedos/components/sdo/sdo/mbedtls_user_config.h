@@ -28,3 +28,17 @@
 #define MBEDTLS_PLATFORM_NV_SEED_READ_MACRO mbed_default_seed_read
 #define MBEDTLS_PLATFORM_NV_SEED_WRITE_MACRO mbed_default_seed_write
 #endif
+
+/*
+ * TLS record buffers, allocated for each connection. Define SDO_TLS_RECORD_LEN
+ * (in the mbed_app.json macros) to shrink them from the 16384 byte default;
+ * the SDK then asks the server for a maximum fragment length (RFC 6066) that
+ * fits, which the server must support for records it sends.
+ */
+#if !defined(MBEDTLS_SSL_MAX_FRAGMENT_LENGTH)
+#define MBEDTLS_SSL_MAX_FRAGMENT_LENGTH
+#endif
+#if defined(SDO_TLS_RECORD_LEN)
+#define MBEDTLS_SSL_IN_CONTENT_LEN SDO_TLS_RECORD_LEN
+#define MBEDTLS_SSL_OUT_CONTENT_LEN SDO_TLS_RECORD_LEN
+#endif
@@ -30,6 +30,12 @@ typedef enum {
 	SDO_SDK_OTP_DATA = 4,
 	SDO_SDK_RAW_DATA = 8
 } sdoSdkBlobFlags;
+
+/* Result of a blob transaction commit, 0 once durable, -1 on failure */
+typedef void (*sdoBlobTxDoneCB)(int32_t result);
+
+/* Storage of one SDK instance (Linux) */
+typedef struct sdoStorageCtx_s sdoStorageCtx_t;
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -46,6 +52,38 @@ int32_t sdoReadEPIDKey(uint8_t *buffer, uint32_t *size);
 
 int32_t createHMACForNormalBlob(void);
 
+void sdoBlobCacheFlush(void);
+
+int32_t sdoConfigSnapshotLoad(void);
+
+int32_t sdoBlobTxBegin(void);
+
+int32_t sdoBlobTxCommit(void);
+
+int32_t sdoBlobTxCommitAsync(sdoBlobTxDoneCB done);
+
+int32_t sdoBlobTxSync(void);
+
+void sdoBlobTxAbort(void);
+
+int32_t sdoBlobJournalReplay(void);
+
+sdoStorageCtx_t *sdoStorageCtxAlloc(const char *dir);
+
+void sdoStorageCtxBind(sdoStorageCtx_t *ctx);
+
+void sdoStorageCtxFree(sdoStorageCtx_t *ctx);
+
+sdoStorageCtx_t *sdoStorageCtxAllocIdentity(const char *identity);
+
+int32_t sdoIdentityStoreOpen(const char *path);
+
+int32_t sdoIdentityStoreCommit(void);
+
+void sdoIdentityStoreClose(void);
+
+const char *sdoStoragePath(const char *name, char *path, size_t len);
+
 #ifdef __cplusplus
 } // endof externc (CPP code)
 #endif
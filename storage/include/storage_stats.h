@@ -0,0 +1,104 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Accounting of the storage medium, with STORAGE_STATS=true, for
+ * sdoSdkGetStorageStats. The storage backends report the blob API calls,
+ * each file they read or write and each sync they wait for, and seal the
+ * blobs through the counted versions of the HMAC and GCM operations below.
+ * Without it, the accounting compiles to nothing, its arguments are not
+ * evaluated, and the counted versions are the crypto HAL operations.
+ */
+
+#ifndef __STORAGE_STATS_H__
+#define __STORAGE_STATS_H__
+
+#include "sdo.h"
+#include "sdoCryptoHal.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	SDO_STORAGE_API_READ,
+	SDO_STORAGE_API_WRITE,
+	SDO_STORAGE_API_SIZE
+} sdoStorageApi;
+
+int32_t sdoStorageStatsGet(sdoSdkStorageStats *stats);
+int32_t sdoStorageStatsReset(void);
+
+#if defined(STORAGE_STATS)
+void sdoStorageStatsApi(sdoStorageApi api);
+void sdoStorageStatsRead(size_t bytes);
+void sdoStorageStatsWrite(const char *path, size_t bytes);
+void sdoStorageStatsSync(void);
+uint64_t sdoStorageStatsNow(void);
+void sdoStorageStatsSeal(int gcm, uint64_t startUs);
+
+#define STORAGE_STATS_START(v) uint64_t v = sdoStorageStatsNow()
+
+static inline int32_t sdoStorageHMAC(uint8_t hmacType, const uint8_t *buffer,
+				     size_t bufferLength, uint8_t *output,
+				     size_t outputLength, const uint8_t *key,
+				     size_t keyLength)
+{
+	uint64_t start = sdoStorageStatsNow();
+	int32_t ret = sdoCryptoHMAC(hmacType, buffer, bufferLength, output,
+				    outputLength, key, keyLength);
+
+	sdoStorageStatsSeal(0, start);
+	return ret;
+}
+
+static inline int32_t
+sdoStorageGcmEncrypt(const uint8_t *plainText, uint32_t plainTextLength,
+		     uint8_t *cipherText, uint32_t cipherTextLength,
+		     const uint8_t *iv, uint32_t ivLength, const uint8_t *key,
+		     uint32_t keyLength, uint8_t *tag, uint32_t tagLength)
+{
+	uint64_t start = sdoStorageStatsNow();
+	int32_t ret = sdoCryptoAESGcmEncrypt(
+	    plainText, plainTextLength, cipherText, cipherTextLength, iv,
+	    ivLength, key, keyLength, tag, tagLength);
+
+	sdoStorageStatsSeal(1, start);
+	return ret;
+}
+
+static inline int32_t
+sdoStorageGcmDecrypt(uint8_t *clearText, uint32_t clearTextLength,
+		     const uint8_t *cipherText, uint32_t cipherTextLength,
+		     const uint8_t *iv, uint32_t ivLength, const uint8_t *key,
+		     uint32_t keyLength, uint8_t *tag, uint32_t tagLength)
+{
+	uint64_t start = sdoStorageStatsNow();
+	int32_t ret = sdoCryptoAESGcmDecrypt(
+	    clearText, clearTextLength, cipherText, cipherTextLength, iv,
+	    ivLength, key, keyLength, tag, tagLength);
+
+	sdoStorageStatsSeal(1, start);
+	return ret;
+}
+#else
+#define sdoStorageStatsApi(api) (void)0
+#define sdoStorageStatsRead(bytes) (void)0
+#define sdoStorageStatsWrite(path, bytes) (void)0
+#define sdoStorageStatsSync() (void)0
+#define sdoStorageStatsSeal(gcm, v) (void)0
+#define STORAGE_STATS_START(v) (void)0
+
+#define sdoStorageHMAC sdoCryptoHMAC
+#define sdoStorageGcmEncrypt sdoCryptoAESGcmEncrypt
+#define sdoStorageGcmDecrypt sdoCryptoAESGcmDecrypt
+#endif
+
+#ifdef __cplusplus
+} // endof externc (CPP code)
+#endif
+#endif /* __STORAGE_STATS_H__ */
@@ -9,136 +9,396 @@
  * The file implements required platform utilities for SDO.
  */
 #include <stdlib.h>
+#include <sys/mman.h>
 #include "util.h"
 #include "safe_lib.h"
 #include "sdoCryptoHal.h"
 #include "platform_utils.h"
+#include "storage_al.h"
+#include "storage_stats.h"
+/* IV values reserved per write of the platform IV file */
+#ifndef PLATFORM_IV_RESERVE
+#define PLATFORM_IV_RESERVE 1
+#endif
+
+/*
+ * Platform IV counter. The file holds [First_iv||mark], where mark is the
+ * highest IV reserved so far. The counter lives here, and the file is only
+ * rewritten when a new block of PLATFORM_IV_RESERVE values is reserved.
+ * After a crash counting restarts past the mark, so a value is never handed
+ * out twice; the unused rest of a block is skipped.
+ */
+typedef struct {
+	bool loaded;
+	uint8_t first[PLATFORM_IV_DEFAULT_LEN];
+	uint8_t last[PLATFORM_IV_DEFAULT_LEN];
+	size_t reserved;
+} platformIV_t;
+
+/*
+ * Platform key cache. The AES and HMAC keys are read (or generated) once
+ * and then served from memory, which is locked so it is never swapped out
+ * and wiped by clearPlatformKeys.
+ */
+typedef struct {
+	bool aesValid;
+	bool hmacValid;
+	uint8_t aes[PLATFORM_AES_KEY_DEFAULT_LEN];
+	uint8_t hmac[PLATFORM_HMAC_KEY_DEFAULT_LEN];
+} platformKeys_t;
+
+/*
+ * IV counter and key cache of an SDK instance, which has its own platform
+ * files. The state bound to the calling thread is used. The keys of a
+ * derived state, the one of an identity of the identity store, are derived
+ * from the platform HMAC key once and never read from a file, and its IVs
+ * come from the platform IV counter, which all identities share.
+ */
+struct platformState_s {
+	platformIV_t iv;
+	platformKeys_t keys;
+	bool keysLocked;
+	bool derived;
+	char *identity; // of a derived state
+};
+
+/* Longest identity keys are derived for, incl. terminator */
+#define PLATFORM_IDENTITY_MAX 128
+
+static platformState_t defaultPlatform;
+static SDO_THREAD_LOCAL platformState_t *platform = &defaultPlatform;
+/* The default state is used by the derived ones, from any thread */
+SDO_MUTEX(defaultPlatformLock);
+
 /**
- * Generate platform IV (if not already generated) else provide already
- * generated IV.
- *
- * @param iv - buffer of size len to output IV.
- * @param len - length(in bytes) of the IV to be generated.
- * @param datalen - length(in bytes) of data to be encrypted.
- * @retval true if IV is copied successfully, false otherwise.
+ * platformStateAlloc allocates the platform state of an SDK instance.
+ * @return the state, NULL on error
  */
-bool getPlatformIV(uint8_t *iv, size_t len, size_t datalen)
+platformState_t *platformStateAlloc(void)
+{
+	return sdoAlloc(sizeof(platformState_t));
+}
+
+/**
+ * platformStateBind makes state the one of the calling thread.
+ * @param state - state of platformStateAlloc, NULL for the default one
+ */
+void platformStateBind(platformState_t *state)
+{
+	platform = state ? state : &defaultPlatform;
+}
+
+/**
+ * platformStateFree wipes and releases the platform state of an SDK
+ * instance.
+ * @param state - state of platformStateAlloc
+ */
+void platformStateFree(platformState_t *state)
+{
+	platformState_t *prev = platform;
+
+	if (!state)
+		return;
+	platform = state;
+	clearPlatformKeys();
+	platform = prev == state ? &defaultPlatform : prev;
+	if (state->identity)
+		sdoFree(state->identity);
+	sdoFree(state);
+}
+
+/**
+ * platformStateDerive makes state the one of an identity of the identity
+ * store: its keys are derived from the platform HMAC key for identity, and
+ * its IVs are those of the platform IV counter.
+ * @param state - state of platformStateAlloc, unused yet
+ * @param identity - name of the identity
+ * @return true on success
+ */
+bool platformStateDerive(platformState_t *state, const char *identity)
+{
+	size_t len = identity ? strnlen_s(identity, PLATFORM_IDENTITY_MAX) : 0;
+
+	if (!state || len == 0 || len >= PLATFORM_IDENTITY_MAX)
+		return false;
+	state->identity = sdoAlloc(len + 1);
+	if (!state->identity ||
+	    strcpy_s(state->identity, len + 1, identity) != 0)
+		return false;
+	state->derived = true;
+	return true;
+}
+
+/**
+ * Internal API: write [First_iv||mark] to the platform IV file.
+ * @return true on success
+ */
+static bool platformIVStore(const uint8_t *mark)
 {
+	uint8_t buf[PLATFORM_IV_DEFAULT_LEN * 2] = {0};
 	bool retval = false;
 	FILE *fp = NULL;
-	size_t fsize = 0;
-	uint8_t buf[PLATFORM_IV_DEFAULT_LEN * 2] = {0};
-	uint8_t *p_iv = NULL;
+	char path[FILENAME_MAX];
+	const char *file = NULL;
 
-	/*
-	 * Platform iv file storage format
-	 * [First_iv||latest_iv]
-	 */
-	if (!iv || len < PLATFORM_IV_DEFAULT_LEN) {
-		LOG(LOG_ERROR, "Invalid parameters!\n");
-		goto end;
+	if (memcpy_s(buf, sizeof(buf), platform->iv.first,
+		     PLATFORM_IV_DEFAULT_LEN) != 0 ||
+	    memcpy_s(buf + PLATFORM_IV_DEFAULT_LEN, PLATFORM_IV_DEFAULT_LEN,
+		     mark, PLATFORM_IV_DEFAULT_LEN) != 0) {
+		LOG(LOG_ERROR, "Copying platform IV failed!\n");
+		return false;
 	}
 
-	if (!file_exists((const char *)PLATFORM_IV)) {
-		LOG(LOG_ERROR, "Plaform-IV file does not exists!\n");
+	file = sdoStoragePath(PLATFORM_IV, path, sizeof(path));
+	if (!file)
+		return false;
+
+	if (!(fp = fopen(file, "w"))) {
+		LOG(LOG_ERROR, "Could not open platform IV file!\n");
+		return false;
+	}
+
+	if ((PLATFORM_IV_DEFAULT_LEN * 2) !=
+	    fwrite(buf, sizeof(char), sizeof(buf), fp)) {
+		LOG(LOG_ERROR, "Plaform IV file is not written properly!\n");
 		goto end;
 	}
+	sdoStorageStatsWrite(file, sizeof(buf));
+	retval = true;
 
-	fsize = get_file_size((const char *)PLATFORM_IV);
+end:
+	if (fclose(fp) == EOF) {
+		LOG(LOG_ERROR, "Plaform IV file is not written properly!\n");
+		retval = false;
+	}
+	return retval;
+}
 
-	if (fsize != PLATFORM_IV_DEFAULT_LEN * 2) {
-		/* generate new IV and store into file */
-		if ((p_iv = sdoAlloc(PLATFORM_IV_DEFAULT_LEN)) == NULL) {
-			LOG(LOG_ERROR, "Allocation failed for plaform IV!\n");
-			goto end;
-		}
+/**
+ * Internal API: load the IV counter from the platform IV file, generating
+ * the first IV if there is none yet.
+ * @param fresh - out, true if the first IV was just generated
+ * @return true on success
+ */
+static bool platformIVLoad(bool *fresh)
+{
+	uint8_t buf[PLATFORM_IV_DEFAULT_LEN * 2] = {0};
+	char path[FILENAME_MAX];
+	const char *file = NULL;
 
+	file = sdoStoragePath(PLATFORM_IV, path, sizeof(path));
+	if (!file)
+		return false;
+
+	if (!file_exists(file)) {
+		LOG(LOG_ERROR, "Plaform-IV file does not exists!\n");
+		return false;
+	}
+
+	if (get_file_size(file) != PLATFORM_IV_DEFAULT_LEN * 2) {
+		/* generate new IV and store into file */
 		LOG(LOG_DEBUG, "Generating platform IV of length: %zu\n",
 		    (size_t)PLATFORM_IV_DEFAULT_LEN);
 
-		if (_sdoCryptoRandomBytes(p_iv, PLATFORM_IV_DEFAULT_LEN)) {
+		if (_sdoCryptoRandomBytes(platform->iv.first,
+					  PLATFORM_IV_DEFAULT_LEN)) {
 			LOG(LOG_ERROR,
 			    "Generating random platform IV failed!\n");
-			goto end;
+			return false;
 		}
+		/* The first IV is handed out as is */
+		if (memcpy_s(platform->iv.last, PLATFORM_IV_DEFAULT_LEN,
+			     platform->iv.first,
+			     PLATFORM_IV_DEFAULT_LEN) != 0 ||
+		    !platformIVStore(platform->iv.first))
+			return false;
+		*fresh = true;
+		return true;
+	}
 
-		/* store the first iv */
-		if (memcpy_s(buf, len, p_iv, PLATFORM_IV_DEFAULT_LEN) != 0) {
-			LOG(LOG_ERROR, "Copying platform IV failed!\n");
-			goto end;
-		}
-		if (memcpy_s(buf + PLATFORM_IV_DEFAULT_LEN, len, p_iv,
-			     PLATFORM_IV_DEFAULT_LEN) != 0) {
-			LOG(LOG_ERROR, "Copying platform IV failed!\n");
-			goto end;
-		}
+	if (0 != read_buffer_from_file(file, buf, sizeof(buf))) {
+		LOG(LOG_ERROR, "Failed to read platform IV file!\n");
+		return false;
+	}
+	sdoStorageStatsRead(sizeof(buf));
+	if (memcpy_s(platform->iv.first, PLATFORM_IV_DEFAULT_LEN, buf,
+		     PLATFORM_IV_DEFAULT_LEN) != 0 ||
+	    memcpy_s(platform->iv.last, PLATFORM_IV_DEFAULT_LEN,
+		     buf + PLATFORM_IV_DEFAULT_LEN,
+		     PLATFORM_IV_DEFAULT_LEN) != 0) {
+		LOG(LOG_ERROR, "Copying platform IV failed!\n");
+		return false;
+	}
+	/* Carry on past the persisted mark */
+	*fresh = false;
+	return true;
+}
 
-	} else {
-		/* return the previously generated IV */
-		if (0 != read_buffer_from_file((const char *)PLATFORM_IV, buf,
-					       sizeof(buf))) {
-			LOG(LOG_ERROR, "Failed to read platform IV file!\n");
-			goto end;
-		}
+/**
+ * Internal API: reserve the next block of IV values, persisting its end as
+ * the new mark before any value of it is used.
+ * @return true on success
+ */
+static bool platformIVReserve(void)
+{
+	uint8_t mark[PLATFORM_IV_DEFAULT_LEN] = {0};
+	size_t i;
+
+	if (memcpy_s(mark, sizeof(mark), platform->iv.last,
+		     PLATFORM_IV_DEFAULT_LEN) != 0)
+		return false;
+
+	for (i = 0; i < PLATFORM_IV_RESERVE; i++) {
 		// check_the_rollover_and_increment
-		if (inc_rollover_ctr(buf, buf + PLATFORM_IV_DEFAULT_LEN,
-				     PLATFORM_IV_DEFAULT_LEN,
-				     datalen / PLATFORM_AES_BLOCK_LEN) == -1) {
+		if (inc_rollover_ctr(platform->iv.first, mark,
+				     PLATFORM_IV_DEFAULT_LEN, 0) == -1) {
 			LOG(LOG_ERROR, "Roll over condition reached!\n");
-			goto end;
+			return false;
 		}
 	}
-	if (!(fp = fopen((const char *)PLATFORM_IV, "w"))) {
-		LOG(LOG_ERROR, "Could not open platform IV file!\n");
-		goto end;
+
+	if (!platformIVStore(mark))
+		return false;
+	platform->iv.reserved = PLATFORM_IV_RESERVE;
+	return true;
+}
+
+/**
+ * Internal API: next IV of the counter of the bound state.
+ */
+static bool platformIVNext(uint8_t *iv, size_t len, size_t datalen)
+{
+	/* The IV advances by 2 for data of 2^32 AES blocks or more */
+	size_t step = (datalen / PLATFORM_AES_BLOCK_LEN <= 0xFFFFFFFF) ? 1 : 2;
+	bool fresh = false;
+
+	if (!iv || len < PLATFORM_IV_DEFAULT_LEN) {
+		LOG(LOG_ERROR, "Invalid parameters!\n");
+		return false;
 	}
 
-	if ((PLATFORM_IV_DEFAULT_LEN * 2) !=
-	    fwrite(buf, sizeof(char), sizeof(buf), fp)) {
-		LOG(LOG_ERROR, "Plaform IV file is not written properly!\n");
-		goto end;
+	if (!platform->iv.loaded) {
+		if (!platformIVLoad(&fresh))
+			return false;
+		platform->iv.loaded = true;
+		platform->iv.reserved = 0;
+		/* A freshly generated first IV is ready to use */
+		if (fresh)
+			goto copy;
 	}
 
-	if (memcpy_s(iv, len, buf + PLATFORM_IV_DEFAULT_LEN,
-		     PLATFORM_IV_DEFAULT_LEN) != 0) {
-		LOG(LOG_ERROR, "Copying platform IV failed!\n");
-		goto end;
+	if (platform->iv.reserved < step && !platformIVReserve())
+		return false;
+
+	// check_the_rollover_and_increment
+	if (inc_rollover_ctr(platform->iv.first, platform->iv.last,
+			     PLATFORM_IV_DEFAULT_LEN,
+			     datalen / PLATFORM_AES_BLOCK_LEN) == -1) {
+		LOG(LOG_ERROR, "Roll over condition reached!\n");
+		return false;
 	}
-	retval = true;
+	platform->iv.reserved -= step;
 
-end:
-	if (fp)
-		fclose(fp);
-	if (p_iv)
-		sdoFree(p_iv);
-	return retval;
+copy:
+	if (memcpy_s(iv, len, platform->iv.last, PLATFORM_IV_DEFAULT_LEN) !=
+	    0) {
+		LOG(LOG_ERROR, "Copying platform IV failed!\n");
+		return false;
+	}
+	return true;
 }
 
 /**
- * Generate platform AES Key (if not already generated) else provide already
- * generated Key.
+ * Generate platform IV (if not already generated) else provide already
+ * generated IV.
  *
- * @param key - buffer of size len to output KEY.
- * @param len - length(in bytes) of the KEY to be generated.
- * @retval true if Key is copied successfully, false otherwise.
+ * @param iv - buffer of size len to output IV.
+ * @param len - length(in bytes) of the IV to be generated.
+ * @param datalen - length(in bytes) of data to be encrypted.
+ * @retval true if IV is copied successfully, false otherwise.
  */
-bool getPlatformAESKey(uint8_t *key, size_t len)
+bool getPlatformIV(uint8_t *iv, size_t len, size_t datalen)
+{
+	platformState_t *own = platform;
+	bool ret;
+
+	if (own != &defaultPlatform && !own->derived)
+		return platformIVNext(iv, len, datalen);
+
+	SDO_LOCK(defaultPlatformLock);
+	platform = &defaultPlatform;
+	ret = platformIVNext(iv, len, datalen);
+	platform = own;
+	SDO_UNLOCK(defaultPlatformLock);
+	return ret;
+}
+
+/**
+ * Internal API: keep a platform key in the cache.
+ */
+static void platformKeyKeep(uint8_t *slot, bool *valid, const uint8_t *key,
+			    size_t len)
+{
+	if (!platform->keysLocked) {
+		if (mlock(&platform->keys, sizeof(platform->keys)) != 0) {
+			/* Not worth keeping on a swappable page */
+			LOG(LOG_DEBUG, "Platform keys not cached, no mlock\n");
+			return;
+		}
+		platform->keysLocked = true;
+	}
+	if (memcpy_s(slot, len, key, len) == 0)
+		*valid = true;
+}
+
+/**
+ * Wipe the cached platform keys, when a key file is replaced and at
+ * shutdown.
+ */
+void clearPlatformKeys(void)
+{
+	if (memset_s(&platform->keys, sizeof(platform->keys), 0))
+		LOG(LOG_ERROR, "Failed to clear platform keys\n");
+	platform->keys.aesValid = false;
+	platform->keys.hmacValid = false;
+	if (platform->keysLocked &&
+	    munlock(&platform->keys, sizeof(platform->keys)) == 0)
+		platform->keysLocked = false;
+}
+
+/**
+ * Internal API: the AES key of the bound state, from its file.
+ */
+static bool platformAESKeyLoad(uint8_t *key, size_t len)
 {
 	bool retval = false;
 	FILE *fp = NULL;
 	size_t fsize = 0;
+	char path[FILENAME_MAX];
+	const char *file = NULL;
 
 	if (!key || len < PLATFORM_AES_KEY_DEFAULT_LEN) {
 		LOG(LOG_ERROR, "Invalid parameters!\n");
 		goto end;
 	}
 
-	if (!file_exists((const char *)PLATFORM_AES_KEY)) {
+	if (platform->keys.aesValid) {
+		if (memcpy_s(key, len, platform->keys.aes,
+			     PLATFORM_AES_KEY_DEFAULT_LEN) != 0)
+			goto end;
+		return true;
+	}
+
+	file = sdoStoragePath(PLATFORM_AES_KEY, path, sizeof(path));
+	if (!file)
+		goto end;
+
+	if (!file_exists(file)) {
 		LOG(LOG_ERROR, "Plaform-AES-Key file does not exists!\n");
 		goto end;
 	}
 
-	fsize = get_file_size((const char *)PLATFORM_AES_KEY);
+	fsize = get_file_size(file);
 
 	if (fsize != PLATFORM_AES_KEY_DEFAULT_LEN) {
 		/* generate new AES Key and store into file */
@@ -152,7 +412,7 @@ bool getPlatformAESKey(uint8_t *key, size_t len)
 			goto end;
 		}
 
-		if (!(fp = fopen((const char *)PLATFORM_AES_KEY, "w"))) {
+		if (!(fp = fopen(file, "w"))) {
 			LOG(LOG_ERROR,
 			    "Could not open platform AES Key file!\n");
 			goto end;
@@ -164,16 +424,19 @@ bool getPlatformAESKey(uint8_t *key, size_t len)
 			    "Plaform AES Key file is not written properly!\n");
 			goto end;
 		}
+		sdoStorageStatsWrite(file, PLATFORM_AES_KEY_DEFAULT_LEN);
 	} else {
 		/* return the previously generated AES Key */
-		if (0 != read_buffer_from_file((const char *)PLATFORM_AES_KEY,
-					       key,
+		if (0 != read_buffer_from_file(file, key,
 					       PLATFORM_AES_KEY_DEFAULT_LEN)) {
 			LOG(LOG_ERROR,
 			    "Failed to read platform AES Key file!\n");
 			goto end;
 		}
+		sdoStorageStatsRead(PLATFORM_AES_KEY_DEFAULT_LEN);
 	}
+	platformKeyKeep(platform->keys.aes, &platform->keys.aesValid, key,
+			PLATFORM_AES_KEY_DEFAULT_LEN);
 	retval = true;
 
 end:
@@ -181,32 +444,40 @@ end:
 		fclose(fp);
 	return retval;
 }
+
 /**
- * Generate HMAC Key (if not already generated) else provide already
- * generated Key.
- *
- * @param key - buffer of size len to output key.
- * @param len - length(in bytes) of the key to be generated.
- * @retval true if key is copied successfully, false otherwise.
+ * Internal API: the HMAC key of the bound state, from its file.
  */
-
-bool getPlatformHMACKey(uint8_t *key, size_t len)
+static bool platformHMACKeyLoad(uint8_t *key, size_t len)
 {
 	bool retval = false;
 	FILE *fp = NULL;
 	size_t fsize = 0;
+	char path[FILENAME_MAX];
+	const char *file = NULL;
 
 	if (!key || len < PLATFORM_HMAC_KEY_DEFAULT_LEN) {
 		LOG(LOG_ERROR, "Invalid parameters!\n");
 		goto end;
 	}
 
-	if (!file_exists((const char *)PLATFORM_HMAC_KEY)) {
+	if (platform->keys.hmacValid && len == PLATFORM_HMAC_KEY_DEFAULT_LEN) {
+		if (memcpy_s(key, len, platform->keys.hmac,
+			     PLATFORM_HMAC_KEY_DEFAULT_LEN) != 0)
+			goto end;
+		return true;
+	}
+
+	file = sdoStoragePath(PLATFORM_HMAC_KEY, path, sizeof(path));
+	if (!file)
+		goto end;
+
+	if (!file_exists(file)) {
 		LOG(LOG_ERROR, "Plaform-HMAC-Key file does not exists!\n");
 		goto end;
 	}
 
-	fsize = get_file_size((const char *)PLATFORM_HMAC_KEY);
+	fsize = get_file_size(file);
 
 	if (fsize == 0 || fsize != len) {
 		/* generate new HMAC Key and store into file */
@@ -219,7 +490,7 @@ bool getPlatformHMACKey(uint8_t *key, size_t len)
 			goto end;
 		}
 
-		if (!(fp = fopen((const char *)PLATFORM_HMAC_KEY, "w"))) {
+		if (!(fp = fopen(file, "w"))) {
 			LOG(LOG_ERROR,
 			    "Could not open platform HMAC Key file!\n");
 			goto end;
@@ -231,16 +502,20 @@ bool getPlatformHMACKey(uint8_t *key, size_t len)
 			    "Plaform HMAC Key file is not written properly!\n");
 			goto end;
 		}
+		sdoStorageStatsWrite(file, PLATFORM_HMAC_KEY_DEFAULT_LEN);
 	} else {
 		/* return the previously generated HMAC Key */
-		if (0 != read_buffer_from_file((const char *)PLATFORM_HMAC_KEY,
-					       key,
+		if (0 != read_buffer_from_file(file, key,
 					       PLATFORM_HMAC_KEY_DEFAULT_LEN)) {
 			LOG(LOG_ERROR,
 			    "Failed to read platform HMAC Key file!\n");
 			goto end;
 		}
+		sdoStorageStatsRead(PLATFORM_HMAC_KEY_DEFAULT_LEN);
 	}
+	if (len == PLATFORM_HMAC_KEY_DEFAULT_LEN)
+		platformKeyKeep(platform->keys.hmac, &platform->keys.hmacValid,
+				key, PLATFORM_HMAC_KEY_DEFAULT_LEN);
 	retval = true;
 
 end:
@@ -248,3 +523,128 @@ end:
 		fclose(fp);
 	return retval;
 }
+
+/**
+ * Internal API: derive a key of the bound derived state, the HMAC-SHA256
+ * of "<purpose>:<identity>" with the platform HMAC key, or with the HMAC
+ * key a rotation wrote for the identity.
+ * @param purpose - "aes" or "hmac"
+ * @param key - buffer of size len to output the key
+ * @param len - length(in bytes) of the key, at most 32
+ * @return true on success
+ */
+static bool platformKeyDerive(const char *purpose, uint8_t *key, size_t len)
+{
+	uint8_t seed[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
+	uint8_t out[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
+	char label[PLATFORM_IDENTITY_MAX + 8];
+	platformState_t *own = platform;
+	bool retval = false;
+	bool seeded;
+
+	if (len > sizeof(out) ||
+	    strcpy_s(label, sizeof(label), purpose) != 0 ||
+	    strcat_s(label, sizeof(label), ":") != 0 ||
+	    strcat_s(label, sizeof(label), own->identity) != 0)
+		goto end;
+
+	seeded = purpose[0] == 'h' &&
+		 sdoBlobSize((char *)PLATFORM_HMAC_KEY, SDO_SDK_RAW_DATA) ==
+		     PLATFORM_HMAC_KEY_DEFAULT_LEN &&
+		 sdoBlobRead((char *)PLATFORM_HMAC_KEY, SDO_SDK_RAW_DATA, seed,
+			     sizeof(seed)) == PLATFORM_HMAC_KEY_DEFAULT_LEN;
+	if (!seeded) {
+		SDO_LOCK(defaultPlatformLock);
+		platform = &defaultPlatform;
+		seeded = platformHMACKeyLoad(seed, sizeof(seed));
+		platform = own;
+		SDO_UNLOCK(defaultPlatformLock);
+	}
+	if (!seeded) {
+		LOG(LOG_ERROR, "Could not get the platform HMAC key!\n");
+		goto end;
+	}
+
+	if (0 != sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, (uint8_t *)label,
+			       strnlen_s(label, sizeof(label)), out,
+			       sizeof(out), seed, sizeof(seed)) ||
+	    memcpy_s(key, len, out, len) != 0) {
+		LOG(LOG_ERROR, "Deriving the %s key of %s failed\n", purpose,
+		    own->identity);
+		goto end;
+	}
+	retval = true;
+
+end:
+	if (memset_s(seed, sizeof(seed), 0) || memset_s(out, sizeof(out), 0))
+		retval = false;
+	return retval;
+}
+
+/**
+ * Generate platform AES Key (if not already generated) else provide already
+ * generated Key.
+ *
+ * @param key - buffer of size len to output KEY.
+ * @param len - length(in bytes) of the KEY to be generated.
+ * @retval true if Key is copied successfully, false otherwise.
+ */
+bool getPlatformAESKey(uint8_t *key, size_t len)
+{
+	platformState_t *own = platform;
+	bool ret;
+
+	if (!own->derived && own != &defaultPlatform)
+		return platformAESKeyLoad(key, len);
+	if (!own->derived) {
+		SDO_LOCK(defaultPlatformLock);
+		ret = platformAESKeyLoad(key, len);
+		SDO_UNLOCK(defaultPlatformLock);
+		return ret;
+	}
+
+	if (!key || len < PLATFORM_AES_KEY_DEFAULT_LEN)
+		return false;
+	if (own->keys.aesValid)
+		return memcpy_s(key, len, own->keys.aes,
+				PLATFORM_AES_KEY_DEFAULT_LEN) == 0;
+	if (!platformKeyDerive("aes", key, PLATFORM_AES_KEY_DEFAULT_LEN))
+		return false;
+	platformKeyKeep(own->keys.aes, &own->keys.aesValid, key,
+			PLATFORM_AES_KEY_DEFAULT_LEN);
+	return true;
+}
+
+/**
+ * Generate HMAC Key (if not already generated) else provide already
+ * generated Key.
+ *
+ * @param key - buffer of size len to output key.
+ * @param len - length(in bytes) of the key to be generated.
+ * @retval true if key is copied successfully, false otherwise.
+ */
+bool getPlatformHMACKey(uint8_t *key, size_t len)
+{
+	platformState_t *own = platform;
+	bool ret;
+
+	if (!own->derived && own != &defaultPlatform)
+		return platformHMACKeyLoad(key, len);
+	if (!own->derived) {
+		SDO_LOCK(defaultPlatformLock);
+		ret = platformHMACKeyLoad(key, len);
+		SDO_UNLOCK(defaultPlatformLock);
+		return ret;
+	}
+
+	if (!key || len != PLATFORM_HMAC_KEY_DEFAULT_LEN)
+		return false;
+	if (own->keys.hmacValid)
+		return memcpy_s(key, len, own->keys.hmac,
+				PLATFORM_HMAC_KEY_DEFAULT_LEN) == 0;
+	if (!platformKeyDerive("hmac", key, PLATFORM_HMAC_KEY_DEFAULT_LEN))
+		return false;
+	platformKeyKeep(own->keys.hmac, &own->keys.hmacValid, key,
+			PLATFORM_HMAC_KEY_DEFAULT_LEN);
+	return true;
+}
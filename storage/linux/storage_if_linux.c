@@ -9,17 +9,33 @@
  * The file implements storage abstraction layer for Linux OS running on PC.
  */
 
+/* syncfs() */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
 #include "storage_al.h"
 #include <stdint.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "safe_lib.h"
 #include "util.h"
 #include "sdoCryptoHal.h"
 #include "sdoCryptoApi.h"
+#include "sdoCryptoTimed.h"
+#include "sdotrace.h"
+#include "storage_stats.h"
 #include "crypto_utils.h"
 #include "platform_utils.h"
+#if defined(SDO_BLOB_JOURNAL) && defined(CRED_WRITE_ASYNC)
+#include <pthread.h>
+#endif
 
 /****************************************************
  *
@@ -47,6 +63,1432 @@
  *
  **********************************************************/
 
+#ifndef BLOB_CACHE_FALSE
+/* Number of normal/secure blobs kept in memory once verified */
+#define BLOB_CACHE_SIZE 8
+
+/*
+ * Verified blob cache. The plaintext of normal and secure blobs is kept
+ * after the HMAC check or GCM decryption, so reading the same credentials
+ * again is a copy. A write replaces the entry, sdoBlobCacheFlush wipes all.
+ */
+typedef struct {
+	char *name;
+	sdoSdkBlobFlags flags;
+	uint8_t *data;
+	uint32_t length;
+} blobCacheEntry_t;
+#endif
+
+#ifndef CONFIG_SNAPSHOT_FALSE
+/*
+ * Static configuration: the raw files the SDK reads but never writes. They
+ * are all read in one pass by sdoConfigSnapshotLoad, into one buffer with
+ * an index, and sdoBlobSize/sdoBlobRead of them become look-ups. A file
+ * absent at load time is indexed as such, so it is not looked for again.
+ * The snapshot is immutable: a raw write to one of the files drops it and
+ * the files are read again until the next load.
+ */
+static const char *const configFiles[] = {
+#ifdef MANUFACTURER_IP
+    MANUFACTURER_IP,
+#endif
+#ifdef MANUFACTURER_DN
+    MANUFACTURER_DN,
+#endif
+    MANUFACTURER_PORT,
+#ifdef MFG_PROXY
+    MFG_PROXY,
+#endif
+#ifdef RV_PROXY
+    RV_PROXY,
+#endif
+#ifdef OWNER_PROXY
+    OWNER_PROXY,
+#endif
+};
+
+#define CONFIG_FILE_COUNT (sizeof(configFiles) / sizeof(configFiles[0]))
+
+typedef struct {
+	bool loaded;
+	uint8_t *data;
+	uint32_t offset[CONFIG_FILE_COUNT];
+	int32_t length[CONFIG_FILE_COUNT]; // 0 if the file is absent
+} configSnapshot_t;
+#endif
+
+#ifdef SDO_BLOB_JOURNAL
+/* Most blobs one transaction can stage */
+#define BLOB_TX_MAX 8
+#define BLOB_JOURNAL_MAGIC 0x53444f4a /* "SDOJ" */
+/* magic(4)||count(4) */
+#define BLOB_JOURNAL_HDR_LEN (2 * BLOB_CONTENT_SIZE)
+
+/*
+ * Blob transaction. Between sdoBlobTxBegin and sdoBlobTxCommit, sdoBlobWrite
+ * stages the sealed file content here instead of writing it. The commit
+ * puts all of it into one journal file:
+ * [magic(4)||count(4)||count * [nameLen(4)||name||length(4)||content]||
+ * HMAC(32 bytes)]
+ * Once the journal is synced the update has happened: the blob files are
+ * rewritten from it and the journal is removed after a second sync. A
+ * journal found at startup is replayed, a torn one (bad HMAC) is dropped,
+ * in which case none of the blob files were touched yet.
+ */
+typedef struct {
+	char *name;
+	uint8_t *data;
+	uint32_t length;
+} blobTxEntry_t;
+
+typedef struct {
+	bool active;
+	unsigned int count;
+	blobTxEntry_t entry[BLOB_TX_MAX];
+} blobTx_t;
+
+#ifdef CRED_WRITE_ASYNC
+/*
+ * Commit left to the writer thread. The thread only does file I/O on the
+ * sealed journal, it neither allocates nor frees. The journal is released
+ * once the thread is joined.
+ */
+typedef struct {
+	bool pending;
+	pthread_t writer;
+	uint8_t *journal;
+	size_t length;
+	const char *path;
+	int32_t result;
+	sdoBlobTxDoneCB done;
+} blobTxWriter_t;
+#endif
+#endif
+
+/*
+ * Storage of an SDK instance: the directory its blobs live in and all that
+ * is kept in memory about them. Blob names are mapped into dir, so
+ * instances with their own directories do not share a file. Calls use the
+ * context bound to the calling thread by sdoStorageCtxBind, the default one
+ * keeps the names as they are.
+ */
+struct sdoStorageCtx_s {
+	char *dir;
+	platformState_t *platform;
+#ifdef SDO_IDENTITY_STORE
+	char *identity; // blobs in the identity store, dir is NULL then
+#endif
+#ifndef BLOB_CACHE_FALSE
+	blobCacheEntry_t blobCache[BLOB_CACHE_SIZE];
+	unsigned int blobCacheNext;
+#endif
+#ifndef CONFIG_SNAPSHOT_FALSE
+	configSnapshot_t config;
+#endif
+#ifdef SDO_BLOB_JOURNAL
+	char journalPath[FILENAME_MAX];
+	blobTx_t blobTx;
+#ifdef CRED_WRITE_ASYNC
+	blobTxWriter_t blobTxWriter;
+#endif
+#endif
+};
+
+static sdoStorageCtx_t defaultStorage;
+static SDO_THREAD_LOCAL sdoStorageCtx_t *storage = &defaultStorage;
+
+/**
+ * sdoStoragePath maps a blob or data file name into the directory of the
+ * bound storage context.
+ * @param name - file name as built in
+ * @param path - buffer for the mapped name
+ * @param len - size of path
+ * @return the name to use, name itself if there is no mapping, NULL if
+ * the mapped name does not fit
+ */
+const char *sdoStoragePath(const char *name, char *path, size_t len)
+{
+	const char *base;
+
+	if (!storage->dir || !name)
+		return name;
+
+	base = strrchr(name, '/');
+	base = base ? base + 1 : name;
+	if (strcpy_s(path, len, storage->dir) != 0 ||
+	    strcat_s(path, len, "/") != 0 || strcat_s(path, len, base) != 0) {
+		LOG(LOG_ERROR, "Storage path too long for %s\n", base);
+		return NULL;
+	}
+	return path;
+}
+
+#ifdef SDO_BLOB_JOURNAL
+/**
+ * Internal API: the journal file of the bound storage context.
+ */
+static const char *blobJournalPath(void)
+{
+	return storage->dir ? storage->journalPath : SDO_BLOB_JOURNAL;
+}
+#endif
+
+#ifndef BLOB_CACHE_FALSE
+/**
+ * Internal API: wipe and release a cache entry.
+ */
+static void blobCacheDrop(blobCacheEntry_t *entry)
+{
+	if (entry->data) {
+		if (memset_s(entry->data, entry->length, 0))
+			LOG(LOG_ERROR, "Failed to clear cached blob\n");
+		sdoFree(entry->data);
+	}
+	if (entry->name)
+		sdoFree(entry->name);
+	entry->length = 0;
+}
+
+/**
+ * Internal API: find the cache entry of a blob.
+ *
+ * @param name - blob name
+ * @return entry, NULL if the blob is not cached
+ */
+static blobCacheEntry_t *blobCacheFind(const char *name)
+{
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < BLOB_CACHE_SIZE; i++) {
+		if (!storage->blobCache[i].name)
+			continue;
+		if (strcmp_s(storage->blobCache[i].name, FILENAME_MAX, name,
+			     &res) == 0 &&
+		    res == 0)
+			return &storage->blobCache[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: keep the verified plaintext of a blob, replacing what was
+ * cached for it. On failure the blob is simply not cached.
+ */
+static void blobCacheStore(const char *name, sdoSdkBlobFlags flags,
+			   const uint8_t *data, uint32_t length)
+{
+	blobCacheEntry_t *entry = blobCacheFind(name);
+	size_t nameLen = strnlen_s(name, FILENAME_MAX);
+
+	if (!entry) {
+		entry = &storage->blobCache[storage->blobCacheNext];
+		storage->blobCacheNext =
+		    (storage->blobCacheNext + 1) % BLOB_CACHE_SIZE;
+	}
+	blobCacheDrop(entry);
+
+	entry->name = sdoAlloc(nameLen + 1);
+	entry->data = sdoAlloc(length);
+	if (!entry->name || !entry->data ||
+	    strcpy_s(entry->name, nameLen + 1, name) != 0 ||
+	    memcpy_s(entry->data, length, data, length) != 0) {
+		blobCacheDrop(entry);
+		return;
+	}
+	entry->flags = flags;
+	entry->length = length;
+}
+#endif
+
+#ifndef CONFIG_SNAPSHOT_FALSE
+/**
+ * Internal API: release the configuration snapshot.
+ */
+static void configSnapshotDrop(void)
+{
+	configSnapshot_t *config = &storage->config;
+
+	if (config->data)
+		sdoFree(config->data);
+	if (memset_s(config, sizeof(*config), 0))
+		LOG(LOG_ERROR, "Failed to clear configuration snapshot\n");
+}
+
+/**
+ * Internal API: find a file in the configuration snapshot.
+ *
+ * @param name - file name as built in
+ * @return its index, -1 if the file is not in the snapshot
+ */
+static int configFind(const char *name)
+{
+	unsigned int i;
+	int res;
+
+	if (!storage->config.loaded)
+		return -1;
+	for (i = 0; i < CONFIG_FILE_COUNT; i++) {
+		if (strcmp_s(configFiles[i], FILENAME_MAX, name, &res) == 0 &&
+		    res == 0)
+			return (int)i;
+	}
+	return -1;
+}
+#endif
+
+/**
+ * sdoConfigSnapshotLoad reads the static configuration files of the bound
+ * storage in one pass, replacing what was loaded before. On failure the
+ * files are simply read when needed.
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoConfigSnapshotLoad(void)
+{
+#ifndef CONFIG_SNAPSHOT_FALSE
+	configSnapshot_t *config = &storage->config;
+	uint32_t total = 0;
+	unsigned int i;
+
+	configSnapshotDrop();
+	for (i = 0; i < CONFIG_FILE_COUNT; i++) {
+		config->length[i] =
+		    sdoBlobSize(configFiles[i], SDO_SDK_RAW_DATA);
+		if (config->length[i] < 0)
+			goto err;
+		config->offset[i] = total;
+		total += (uint32_t)config->length[i];
+	}
+
+	if (total) {
+		config->data = sdoAlloc(total);
+		if (!config->data)
+			goto err;
+	}
+	for (i = 0; i < CONFIG_FILE_COUNT; i++) {
+		if (config->length[i] &&
+		    sdoBlobRead(configFiles[i], SDO_SDK_RAW_DATA,
+				config->data + config->offset[i],
+				config->length[i]) != config->length[i])
+			goto err;
+	}
+	config->loaded = true;
+	return 0;
+
+err:
+	LOG(LOG_ERROR, "Configuration snapshot not loaded\n");
+	configSnapshotDrop();
+	return -1;
+#else
+	return 0;
+#endif
+}
+
+/**
+ * Wipe and release the verified blob cache, at shutdown.
+ */
+void sdoBlobCacheFlush(void)
+{
+#ifndef BLOB_CACHE_FALSE
+	unsigned int i;
+
+	for (i = 0; i < BLOB_CACHE_SIZE; i++)
+		blobCacheDrop(&storage->blobCache[i]);
+	storage->blobCacheNext = 0;
+#endif
+}
+
+/**
+ * Internal API: write a blob file in one go.
+ * @param name - pointer to the blob/file name
+ * @param data - file content
+ * @param length - size of data
+ * @return 0 on success, -1 on error
+ */
+static int blobFileWrite(const char *name, const uint8_t *data,
+			 size_t length)
+{
+	int ret = -1;
+	FILE *f = fopen(name, "w");
+
+	if (!f) {
+		LOG(LOG_ERROR, "Could not open file: %s\n", name);
+		return -1;
+	}
+
+	if (fwrite(data, sizeof(char), length, f) == length)
+		ret = 0;
+	else
+		LOG(LOG_ERROR, "file:%s not written properly\n", name);
+
+	if (fclose(f) == EOF) {
+		LOG(LOG_ERROR, "fclose() Failed in sdoBlobWrite\n");
+		ret = -1;
+	}
+	if (!ret)
+		sdoStorageStatsWrite(name, length);
+	return ret;
+}
+
+/**
+ * Internal API: read a file in full.
+ * @return 0 on success, -1 on error
+ */
+static int blobFileRead(const char *name, uint8_t *buf, size_t length)
+{
+	if (read_buffer_from_file(name, buf, length) != 0)
+		return -1;
+	sdoStorageStatsRead(length);
+	return 0;
+}
+
+#if defined(SDO_BLOB_JOURNAL) || defined(SDO_IDENTITY_STORE)
+/**
+ * Internal API: put a 32 bit value big endian.
+ */
+static void blobPutU32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value >> 0;
+}
+
+/**
+ * Internal API: get a 32 bit big endian value.
+ */
+static uint32_t blobGetU32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * Internal API: write a file and wait until it is on the medium.
+ * @return 0 on success, -1 on error
+ */
+static int blobFileWriteSync(const char *name, const uint8_t *data,
+			     size_t length)
+{
+	ssize_t n;
+	size_t done = 0;
+	int ret = -1;
+	int fd;
+
+	fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		LOG(LOG_ERROR, "Could not open file: %s\n", name);
+		return -1;
+	}
+
+	while (done < length) {
+		n = write(fd, data + done, length - done);
+		if (n <= 0) {
+			LOG(LOG_ERROR, "file:%s not written properly\n", name);
+			goto end;
+		}
+		done += (size_t)n;
+	}
+
+	if (fsync(fd) != 0) {
+		LOG(LOG_ERROR, "Failed to sync %s\n", name);
+		goto end;
+	}
+	sdoStorageStatsWrite(name, length);
+	sdoStorageStatsSync();
+	ret = 0;
+
+end:
+	(void)close(fd);
+	return ret;
+}
+
+#endif
+
+#ifdef SDO_IDENTITY_STORE
+#define IDSTORE_MAGIC 0x53444f49 /* "SDOI" */
+/* magic(4)||count(4)||indexLength(4) */
+#define IDSTORE_HDR_LEN (3 * BLOB_CONTENT_SIZE)
+/* keyLength(4)||key||offset(4)||length(4) */
+#define IDSTORE_ENTRY_LEN (3 * BLOB_CONTENT_SIZE)
+#define IDSTORE_NEW_SUFFIX ".new"
+/* Longest identity, incl. terminator */
+#define IDSTORE_ID_MAX 128
+/* Smallest growth of the index in memory */
+#define IDSTORE_GROW 64
+
+/*
+ * Identity store. The blobs of many device identities, the SDK instances of
+ * a gateway, live in one file, laid out as the blob container of mbedos:
+ * [magic(4)||count(4)||indexLength(4)||index||HMAC(32 bytes)||records]
+ * Each index entry gives the key of a record, "<identity>/<blob file name>",
+ * and where the record sits after the HMAC, which covers the header and the
+ * index. The entries are sorted by key. A record is the sealed blob as it
+ * would be stored in its own file, sealed with the keys of its identity,
+ * which are derived from the platform HMAC key (platformStateDerive).
+ * The store is read at once when it is opened, and the identities are then
+ * served from memory. Their writes only update the memory, until
+ * sdoIdentityStoreCommit writes all of them through a ".new" file that
+ * replaces the store: one write and one sync however many identities
+ * changed, and either the old or the new store after a power loss.
+ */
+typedef struct {
+	char *key;
+	uint32_t keyLength;
+	uint8_t *record;
+	uint32_t length;
+} idStoreRecord_t;
+
+static struct {
+	char *path; // NULL while the store is not open
+	idStoreRecord_t *rec;
+	unsigned int count;
+	unsigned int max;
+	bool dirty;
+} idStore;
+SDO_MUTEX(idStoreLock);
+/* Held over a commit, which writes outside of idStoreLock */
+SDO_MUTEX(idStoreCommitLock);
+
+/**
+ * Internal API: whether the blobs of the bound context are in the store.
+ */
+static bool blobInStore(void)
+{
+	return storage->identity != NULL;
+}
+
+/* Files of an identity that are never read from the data directory */
+static const char *const idStoreOwnFiles[] = {
+    PLATFORM_IV, PLATFORM_AES_KEY, PLATFORM_HMAC_KEY,
+#ifdef ECDSA_PRIVKEY
+    ECDSA_PRIVKEY,
+#endif
+};
+
+/**
+ * Internal API: order of two keys, as memcmp.
+ */
+static int idStoreCompare(const char *a, uint32_t aLength, const char *b,
+			  uint32_t bLength)
+{
+	int cmp = memcmp(a, b, aLength < bLength ? aLength : bLength);
+
+	if (cmp)
+		return cmp;
+	return aLength < bLength ? -1 : aLength > bLength;
+}
+
+/**
+ * Internal API: binary search of a key in the store.
+ * @param found - out, true if the store holds the key
+ * @return index of the key, or where it goes
+ */
+static unsigned int idStoreFind(const char *key, uint32_t keyLength,
+				bool *found)
+{
+	unsigned int lo = 0, hi = idStore.count, mid;
+	int cmp;
+
+	*found = false;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		cmp = idStoreCompare(idStore.rec[mid].key,
+				     idStore.rec[mid].keyLength, key,
+				     keyLength);
+		if (cmp == 0) {
+			*found = true;
+			return mid;
+		}
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/**
+ * Internal API: key of a blob of the bound identity.
+ * @return length of the key, -1 on error
+ */
+static int idStoreKey(const char *name, char *key, size_t len)
+{
+	const char *base = strrchr(name, '/');
+
+	base = base ? base + 1 : name;
+	if (strcpy_s(key, len, storage->identity) != 0 ||
+	    strcat_s(key, len, "/") != 0 || strcat_s(key, len, base) != 0) {
+		LOG(LOG_ERROR, "Identity store key too long for %s\n", base);
+		return -1;
+	}
+	return (int)strnlen_s(key, len);
+}
+
+/**
+ * Internal API: whether the bound identity reads a raw file it does not
+ * hold from the data directory, where the gateway keeps what all the
+ * identities share, for ex: the manufacturer address. Their keys are never
+ * shared.
+ */
+static bool idStoreShared(const char *name)
+{
+	unsigned int i;
+	int res;
+
+	for (i = 0; i < sizeof(idStoreOwnFiles) / sizeof(idStoreOwnFiles[0]);
+	     i++) {
+		if (strcmp_s(idStoreOwnFiles[i], FILENAME_MAX, name, &res) ==
+			0 &&
+		    res == 0)
+			return false;
+	}
+	return true;
+}
+
+/**
+ * Internal API: wipe and release a record.
+ */
+static void idStoreRecordDrop(idStoreRecord_t *rec)
+{
+	if (rec->record) {
+		if (memset_s(rec->record, rec->length, 0))
+			LOG(LOG_ERROR, "Failed to clear identity record\n");
+		sdoFree(rec->record);
+	}
+	if (rec->key)
+		sdoFree(rec->key);
+	rec->length = 0;
+}
+
+/**
+ * Internal API: wipe and release the store in memory.
+ */
+static void idStoreClear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < idStore.count; i++)
+		idStoreRecordDrop(&idStore.rec[i]);
+	if (idStore.rec)
+		sdoFree(idStore.rec);
+	if (idStore.path)
+		sdoFree(idStore.path);
+	idStore.count = idStore.max = 0;
+	idStore.dirty = false;
+}
+
+/**
+ * Internal API: insert or replace a record, with idStoreLock held.
+ * @param key - key of the record, copied
+ * @param record - in, content; taken over (and NULLed) once stored
+ * @param length - size of the content
+ * @return 0 on success, -1 on error
+ */
+static int idStorePutLocked(const char *key, uint32_t keyLength,
+			    uint8_t **record, uint32_t length)
+{
+	idStoreRecord_t *rec;
+	unsigned int i, max;
+	char *copy;
+	bool found;
+
+	i = idStoreFind(key, keyLength, &found);
+	if (found) {
+		rec = &idStore.rec[i];
+		if (memset_s(rec->record, rec->length, 0))
+			LOG(LOG_ERROR, "Failed to clear identity record\n");
+		sdoFree(rec->record);
+		goto take;
+	}
+
+	copy = sdoAlloc(keyLength + 1);
+	if (!copy || memcpy_s(copy, keyLength + 1, key, keyLength) != 0)
+		goto err;
+	if (idStore.count == idStore.max) {
+		max = idStore.max + (idStore.max / 2 > IDSTORE_GROW
+					 ? idStore.max / 2
+					 : IDSTORE_GROW);
+		rec = NULL;
+		if (max <= INT_MAX / sizeof(*rec))
+			rec = sdoRealloc(idStore.rec,
+					 (int)(max * sizeof(*rec)));
+		if (!rec)
+			goto err;
+		idStore.rec = rec;
+		idStore.max = max;
+	}
+	rec = &idStore.rec[i];
+	if (i < idStore.count &&
+	    memmove_s(rec + 1, (idStore.max - i - 1) * sizeof(*rec), rec,
+		      (idStore.count - i) * sizeof(*rec)) != 0)
+		goto err;
+	rec->key = copy;
+	rec->keyLength = keyLength;
+	idStore.count++;
+
+take:
+	rec->record = *record;
+	rec->length = length;
+	*record = NULL;
+	idStore.dirty = true;
+	return 0;
+
+err:
+	LOG(LOG_ERROR, "Identity store alloc failed\n");
+	if (copy)
+		sdoFree(copy);
+	return -1;
+}
+
+/**
+ * Internal API: store a blob of the bound identity.
+ * @param record - in, sealed content; taken over (and NULLed) once stored
+ * @return 0 on success, -1 on error
+ */
+static int idStorePut(const char *name, uint8_t **record, uint32_t length)
+{
+	char key[FILENAME_MAX];
+	int keyLength = idStoreKey(name, key, sizeof(key));
+	int ret = -1;
+
+	if (keyLength < 0)
+		return -1;
+	SDO_LOCK(idStoreLock);
+	if (idStore.path)
+		ret = idStorePutLocked(key, (uint32_t)keyLength, record,
+				       length);
+	SDO_UNLOCK(idStoreLock);
+	return ret;
+}
+
+/**
+ * Internal API: get a blob of the bound identity.
+ * @param record - out, a copy of the sealed content to be released by the
+ * caller, NULL to get the length only
+ * @param length - out, size of the content
+ * @return 1 if the identity holds the blob, 0 if not, -1 on error
+ */
+static int idStoreGet(const char *name, uint8_t **record, uint32_t *length)
+{
+	char key[FILENAME_MAX];
+	int keyLength = idStoreKey(name, key, sizeof(key));
+	idStoreRecord_t *rec;
+	unsigned int i;
+	bool found = false;
+	int ret = 0;
+
+	if (keyLength < 0)
+		return -1;
+	SDO_LOCK(idStoreLock);
+	i = idStoreFind(key, (uint32_t)keyLength, &found);
+	if (found) {
+		rec = &idStore.rec[i];
+		*length = rec->length;
+		ret = 1;
+		if (record) {
+			*record = sdoAlloc(rec->length);
+			if (!*record ||
+			    memcpy_s(*record, rec->length, rec->record,
+				     rec->length) != 0) {
+				if (*record)
+					sdoFree(*record);
+				ret = -1;
+			}
+		}
+	}
+	SDO_UNLOCK(idStoreLock);
+	return ret;
+}
+
+/**
+ * Internal API: parse and verify a store image into memory.
+ * @return 0 on success, -1 if the image is not a valid store
+ */
+static int idStoreParse(const uint8_t *image, size_t length)
+{
+	uint8_t mac[PLATFORM_HMAC_SIZE] = {0};
+	const uint8_t *p = image + IDSTORE_HDR_LEN;
+	const uint8_t *records, *indexEnd, *key;
+	uint8_t *record;
+	uint32_t indexLength, keyLength, offset, recLength, count;
+	bool found;
+	int result = -1;
+
+	if (length < IDSTORE_HDR_LEN + PLATFORM_HMAC_SIZE ||
+	    blobGetU32(image) != IDSTORE_MAGIC)
+		return -1;
+	count = blobGetU32(image + BLOB_CONTENT_SIZE);
+	indexLength = blobGetU32(image + 2 * BLOB_CONTENT_SIZE);
+	if (indexLength > length - IDSTORE_HDR_LEN - PLATFORM_HMAC_SIZE ||
+	    count > indexLength / IDSTORE_ENTRY_LEN)
+		return -1;
+	indexEnd = p + indexLength;
+	records = indexEnd + PLATFORM_HMAC_SIZE;
+
+	/* One MAC vouches for the whole index */
+	if (0 != sdoComputeStorageHMAC(image, IDSTORE_HDR_LEN + indexLength,
+				       mac, PLATFORM_HMAC_SIZE))
+		return -1;
+	memcmp_s(indexEnd, PLATFORM_HMAC_SIZE, mac, PLATFORM_HMAC_SIZE,
+		 &result);
+	if (result != 0) {
+		LOG(LOG_ERROR, "Identity store index HMAC does not match!\n");
+		return -1;
+	}
+
+	while (count--) {
+		if (indexEnd - p < IDSTORE_ENTRY_LEN)
+			return -1;
+		keyLength = blobGetU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if (keyLength == 0 || keyLength >= FILENAME_MAX ||
+		    (size_t)(indexEnd - p) <
+			keyLength + 2 * BLOB_CONTENT_SIZE)
+			return -1;
+		key = p;
+		p += keyLength;
+		offset = blobGetU32(p);
+		recLength = blobGetU32(p + BLOB_CONTENT_SIZE);
+		p += 2 * BLOB_CONTENT_SIZE;
+
+		if (recLength == 0 ||
+		    offset > (size_t)(image + length - records) ||
+		    recLength > (size_t)(image + length - records) - offset)
+			return -1;
+		/* Written in order, so each key goes at the end */
+		if (idStoreFind((const char *)key, keyLength, &found) !=
+			idStore.count ||
+		    found)
+			return -1;
+		record = sdoAlloc(recLength);
+		if (!record || memcpy_s(record, recLength, records + offset,
+					recLength) != 0 ||
+		    idStorePutLocked((const char *)key, keyLength, &record,
+				     recLength) != 0) {
+			if (record)
+				sdoFree(record);
+			return -1;
+		}
+	}
+	idStore.dirty = false;
+	return 0;
+}
+
+/**
+ * Internal API: put the store into one image, followed by the records.
+ * @param image - out, the image, to be released by the caller
+ * @param length - out, size of the image
+ * @return 0 on success, -1 on error
+ */
+static int idStoreSeal(uint8_t **image, size_t *length)
+{
+	size_t indexLength = 0, recLength = 0, n, len;
+	uint32_t offset = 0;
+	uint8_t *img;
+	unsigned int i;
+
+	for (i = 0; i < idStore.count; i++) {
+		indexLength += IDSTORE_ENTRY_LEN + idStore.rec[i].keyLength;
+		recLength += idStore.rec[i].length;
+	}
+	len = IDSTORE_HDR_LEN + indexLength + PLATFORM_HMAC_SIZE + recLength;
+	if (len > UINT32_MAX)
+		return -1;
+	img = sdoAlloc(len);
+	if (!img) {
+		LOG(LOG_ERROR, "Malloc Failed in sdoIdentityStoreCommit!\n");
+		return -1;
+	}
+
+	blobPutU32(img, IDSTORE_MAGIC);
+	blobPutU32(img + BLOB_CONTENT_SIZE, idStore.count);
+	blobPutU32(img + 2 * BLOB_CONTENT_SIZE, (uint32_t)indexLength);
+	n = IDSTORE_HDR_LEN;
+	for (i = 0; i < idStore.count; i++) {
+		blobPutU32(img + n, idStore.rec[i].keyLength);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(img + n, len - n, idStore.rec[i].key,
+			     idStore.rec[i].keyLength) != 0)
+			goto err;
+		n += idStore.rec[i].keyLength;
+		blobPutU32(img + n, offset);
+		blobPutU32(img + n + BLOB_CONTENT_SIZE, idStore.rec[i].length);
+		n += 2 * BLOB_CONTENT_SIZE;
+		offset += idStore.rec[i].length;
+	}
+
+	if (0 != sdoComputeStorageHMAC(img, (uint32_t)n, img + n,
+				       PLATFORM_HMAC_SIZE)) {
+		LOG(LOG_ERROR, "Computing HMAC failed for the identity "
+			       "store\n");
+		goto err;
+	}
+	n += PLATFORM_HMAC_SIZE;
+
+	for (i = 0; i < idStore.count; i++) {
+		if (memcpy_s(img + n, len - n, idStore.rec[i].record,
+			     idStore.rec[i].length) != 0)
+			goto err;
+		n += idStore.rec[i].length;
+	}
+
+	*image = img;
+	*length = len;
+	return 0;
+
+err:
+	sdoFree(img);
+	return -1;
+}
+#else
+static bool blobInStore(void)
+{
+	return false;
+}
+
+static int idStoreGet(const char *name, uint8_t **record, uint32_t *length)
+{
+	(void)name;
+	(void)record;
+	(void)length;
+	return -1;
+}
+
+static int idStorePut(const char *name, uint8_t **record, uint32_t length)
+{
+	(void)name;
+	(void)record;
+	(void)length;
+	return -1;
+}
+
+static bool idStoreShared(const char *name)
+{
+	(void)name;
+	return true;
+}
+#endif
+
+#ifdef SDO_BLOB_JOURNAL
+/**
+ * Internal API: release what the transaction staged.
+ */
+static void blobTxClear(void)
+{
+	blobTx_t *tx = &storage->blobTx;
+	unsigned int i;
+
+	for (i = 0; i < tx->count; i++) {
+		if (tx->entry[i].data) {
+			if (memset_s(tx->entry[i].data, tx->entry[i].length,
+				     0))
+				LOG(LOG_ERROR, "Failed to clear staged blob\n");
+			sdoFree(tx->entry[i].data);
+		}
+		if (tx->entry[i].name)
+			sdoFree(tx->entry[i].name);
+		tx->entry[i].length = 0;
+	}
+	tx->count = 0;
+	tx->active = false;
+}
+
+/**
+ * Internal API: stage the sealed content of a blob when a transaction is
+ * open.
+ * @param name - pointer to the blob/file name
+ * @param data - in, sealed content; taken over (and NULLed) once staged
+ * @param length - size of the content
+ * @return 1 if staged, 0 if there is no transaction, -1 on error
+ */
+static int blobTxStage(const char *name, uint8_t **data, uint32_t length)
+{
+	blobTx_t *tx = &storage->blobTx;
+	blobTxEntry_t *entry = NULL;
+	size_t nameLen;
+	unsigned int i;
+	int res;
+
+	if (!tx->active)
+		return 0;
+
+	/* A second write of the same blob replaces the first */
+	for (i = 0; i < tx->count; i++) {
+		if (strcmp_s(tx->entry[i].name, FILENAME_MAX, name, &res) ==
+			0 &&
+		    res == 0) {
+			entry = &tx->entry[i];
+			sdoFree(entry->data);
+			break;
+		}
+	}
+
+	if (!entry) {
+		if (tx->count == BLOB_TX_MAX) {
+			LOG(LOG_ERROR, "Too many blobs in one transaction\n");
+			return -1;
+		}
+		nameLen = strnlen_s(name, FILENAME_MAX);
+		entry = &tx->entry[tx->count];
+		entry->name = sdoAlloc(nameLen + 1);
+		if (!entry->name ||
+		    strcpy_s(entry->name, nameLen + 1, name) != 0) {
+			LOG(LOG_ERROR, "Failed to stage blob %s\n", name);
+			if (entry->name)
+				sdoFree(entry->name);
+			return -1;
+		}
+		tx->count++;
+	}
+
+	entry->data = *data;
+	entry->length = length;
+	*data = NULL;
+	return 1;
+}
+
+/**
+ * Internal API: rewrite the blob files from a journal, sync them all and
+ * remove the journal.
+ * @param path - the journal file
+ * @param journal - journal content, without the trailing HMAC
+ * @param length - size of journal
+ * @return 0 on success, -1 on error
+ */
+static int blobJournalApply(const char *path, const uint8_t *journal,
+			    size_t length)
+{
+	const uint8_t *p = journal + BLOB_JOURNAL_HDR_LEN;
+	const uint8_t *end = journal + length;
+	char name[FILENAME_MAX];
+	uint32_t nameLen;
+	uint32_t dataLen;
+	uint32_t count;
+	int ret = -1;
+	int fd;
+
+	if (length < BLOB_JOURNAL_HDR_LEN ||
+	    blobGetU32(journal) != BLOB_JOURNAL_MAGIC)
+		goto end;
+	count = blobGetU32(journal + BLOB_CONTENT_SIZE);
+
+	while (count--) {
+		if (end - p < BLOB_CONTENT_SIZE)
+			goto end;
+		nameLen = blobGetU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if (nameLen == 0 || nameLen >= FILENAME_MAX ||
+		    (size_t)(end - p) < nameLen + BLOB_CONTENT_SIZE)
+			goto end;
+
+		if (memcpy_s(name, sizeof(name), p, nameLen) != 0)
+			goto end;
+		name[nameLen] = '\0';
+		p += nameLen;
+
+		dataLen = blobGetU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if ((size_t)(end - p) < dataLen)
+			goto end;
+		if (blobFileWrite(name, p, dataLen) != 0)
+			goto end;
+		p += dataLen;
+	}
+
+	/* One barrier for all the blobs, they share the data directory */
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || syncfs(fd) != 0) {
+		LOG(LOG_ERROR, "Failed to sync the blob files\n");
+		if (fd >= 0)
+			(void)close(fd);
+		goto end;
+	}
+	(void)close(fd);
+	sdoStorageStatsSync();
+
+	if (remove(path) != 0) {
+		LOG(LOG_ERROR, "Failed to remove %s\n", path);
+		goto end;
+	}
+	ret = 0;
+
+end:
+	return ret;
+}
+
+/**
+ * Internal API: put what the transaction staged into one journal, followed
+ * by its HMAC.
+ * @param journal - out, the sealed journal, to be released by the caller
+ * @param length - out, size of the journal without the HMAC
+ * @return 0 on success, -1 on error
+ */
+static int blobTxSeal(uint8_t **journal, size_t *length)
+{
+	blobTx_t *tx = &storage->blobTx;
+	uint8_t *j = NULL;
+	size_t len = BLOB_JOURNAL_HDR_LEN;
+	size_t n = BLOB_JOURNAL_HDR_LEN;
+	size_t nameLen;
+	unsigned int i;
+
+	for (i = 0; i < tx->count; i++)
+		len += 2 * BLOB_CONTENT_SIZE +
+		       strnlen_s(tx->entry[i].name, FILENAME_MAX) +
+		       tx->entry[i].length;
+
+	j = sdoAlloc(len + PLATFORM_HMAC_SIZE);
+	if (!j) {
+		LOG(LOG_ERROR, "Malloc Failed in sdoBlobTxCommit!\n");
+		return -1;
+	}
+
+	blobPutU32(j, BLOB_JOURNAL_MAGIC);
+	blobPutU32(j + BLOB_CONTENT_SIZE, tx->count);
+	for (i = 0; i < tx->count; i++) {
+		nameLen = strnlen_s(tx->entry[i].name, FILENAME_MAX);
+		blobPutU32(j + n, (uint32_t)nameLen);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(j + n, len - n, tx->entry[i].name, nameLen) != 0)
+			goto err;
+		n += nameLen;
+		blobPutU32(j + n, tx->entry[i].length);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(j + n, len - n, tx->entry[i].data,
+			     tx->entry[i].length) != 0)
+			goto err;
+		n += tx->entry[i].length;
+	}
+
+	if (0 != sdoComputeStorageHMAC(j, (uint32_t)len, j + len,
+				       PLATFORM_HMAC_SIZE)) {
+		LOG(LOG_ERROR, "Computing HMAC failed for the blob journal\n");
+		goto err;
+	}
+
+	*journal = j;
+	*length = len;
+	return 0;
+
+err:
+	sdoFree(j);
+	return -1;
+}
+
+/**
+ * Internal API: write a sealed journal, which commits the update, then
+ * rewrite the blob files from it. Does file I/O only.
+ * @param path - the journal file
+ * @param journal - journal content followed by its HMAC
+ * @param length - size of the journal without the HMAC
+ * @return 0 on success, -1 on error
+ */
+static int blobJournalCommit(const char *path, const uint8_t *journal,
+			     size_t length)
+{
+	/* The update is committed once the journal is on the medium */
+	if (blobFileWriteSync(path, journal, length + PLATFORM_HMAC_SIZE) != 0)
+		return -1;
+
+	if (blobJournalApply(path, journal, length) != 0) {
+		LOG(LOG_ERROR, "Blob journal not applied, replayed at next "
+			       "start\n");
+		return -1;
+	}
+	return 0;
+}
+
+#ifdef CRED_WRITE_ASYNC
+
+/**
+ * Internal API: body of the writer thread.
+ */
+static void *blobTxWriterRun(void *arg)
+{
+	blobTxWriter_t *w = arg;
+
+	w->result = blobJournalCommit(w->path, w->journal, w->length);
+	if (w->done)
+		w->done(w->result);
+	return NULL;
+}
+
+/**
+ * Internal API: wait for the writer thread, if any. Its result is kept for
+ * sdoBlobTxSync.
+ */
+static void blobTxWriterJoin(void)
+{
+	blobTxWriter_t *w = &storage->blobTxWriter;
+
+	if (!w->pending)
+		return;
+
+	if (pthread_join(w->writer, NULL) != 0) {
+		LOG(LOG_ERROR, "Failed to join the blob writer\n");
+		w->result = -1;
+	}
+	sdoFree(w->journal);
+	w->journal = NULL;
+	w->pending = false;
+}
+#endif
+#endif
+
+#if !defined(SDO_BLOB_JOURNAL) || !defined(CRED_WRITE_ASYNC)
+/**
+ * Internal API: blobs are never written in the background.
+ */
+static void blobTxWriterJoin(void)
+{
+}
+#endif
+
+#ifndef SDO_BLOB_JOURNAL
+/**
+ * Internal API: there is no journal, every write goes straight to its file.
+ */
+static int blobTxStage(const char *name, uint8_t **data, uint32_t length)
+{
+	(void)name;
+	(void)data;
+	(void)length;
+	return 0;
+}
+#endif
+
+#if defined(SDO_BLOB_JOURNAL) && defined(SDO_IDENTITY_STORE)
+/**
+ * Internal API: put what the transaction staged into the identity store,
+ * under one hold of its lock, so that a commit of the store has all of it.
+ * @return 0 on success, -1 on error
+ */
+static int blobTxToStore(void)
+{
+	blobTx_t *tx = &storage->blobTx;
+	char key[FILENAME_MAX];
+	unsigned int i;
+	int keyLength;
+	int ret = 0;
+
+	SDO_LOCK(idStoreLock);
+	for (i = 0; i < tx->count && ret == 0; i++) {
+		keyLength = idStoreKey(tx->entry[i].name, key, sizeof(key));
+		if (keyLength < 0 || !idStore.path ||
+		    idStorePutLocked(key, (uint32_t)keyLength,
+				     &tx->entry[i].data,
+				     tx->entry[i].length) != 0)
+			ret = -1;
+	}
+	SDO_UNLOCK(idStoreLock);
+	if (ret != 0)
+		LOG(LOG_ERROR, "Blob transaction not stored for %s\n",
+		    storage->identity);
+	return ret;
+}
+#endif
+
+/**
+ * sdoBlobTxBegin opens a blob transaction. The following sdoBlobWrite calls
+ * are only staged, sdoBlobTxCommit then applies all of them or none.
+ * @return 0 on success, -1 if a transaction is already open
+ */
+int32_t sdoBlobTxBegin(void)
+{
+	/* A deferred commit lands before anything else is written */
+	if (sdoBlobTxSync() != 0)
+		LOG(LOG_ERROR, "Deferred blob commit failed\n");
+#ifdef SDO_BLOB_JOURNAL
+	if (storage->blobTx.active) {
+		LOG(LOG_ERROR, "Blob transaction already open\n");
+		return -1;
+	}
+	storage->blobTx.active = true;
+#endif
+	return 0;
+}
+
+/**
+ * sdoBlobTxAbort drops what the open blob transaction staged.
+ */
+void sdoBlobTxAbort(void)
+{
+#ifdef SDO_BLOB_JOURNAL
+	blobTxClear();
+	/* The cache may hold what was staged */
+	sdoBlobCacheFlush();
+#endif
+}
+
+/**
+ * sdoBlobTxCommit applies the blob writes staged since sdoBlobTxBegin
+ * atomically, through the journal.
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommit(void)
+{
+	int32_t ret = 0;
+#ifdef SDO_BLOB_JOURNAL
+	blobTx_t *tx = &storage->blobTx;
+	uint8_t *journal = NULL;
+	size_t length = 0;
+
+	if (!tx->active || tx->count == 0)
+		goto end;
+	ret = -1;
+
+#ifdef SDO_IDENTITY_STORE
+	/* Durable with the next commit of the store, which takes all */
+	if (blobInStore()) {
+		ret = blobTxToStore();
+		goto end;
+	}
+#endif
+	if (blobTxSeal(&journal, &length) != 0)
+		goto end;
+	ret = blobJournalCommit(blobJournalPath(), journal, length);
+
+end:
+	if (journal)
+		sdoFree(journal);
+	blobTxClear();
+#endif
+	return ret;
+}
+
+/**
+ * sdoBlobTxCommitAsync seals the blob writes staged since sdoBlobTxBegin
+ * into the journal and leaves writing it out to a background thread
+ * (CRED_WRITE_ASYNC), which calls done with the result. Blob accesses and
+ * the next transaction wait for the thread. Otherwise, this is
+ * sdoBlobTxCommit followed by done.
+ * @param done - called once the blobs are durable (0) or failed (-1), may
+ * be NULL. Not called when -1 is returned.
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommitAsync(sdoBlobTxDoneCB done)
+{
+#if defined(SDO_BLOB_JOURNAL) && defined(CRED_WRITE_ASYNC)
+	blobTx_t *tx = &storage->blobTx;
+	blobTxWriter_t *w = &storage->blobTxWriter;
+	uint8_t *journal = NULL;
+	size_t length = 0;
+	int32_t ret = 0;
+
+	/* Nothing to write out, the store is committed on its own */
+	if (blobInStore()) {
+		ret = sdoBlobTxCommit();
+		if (ret == 0 && done)
+			done(0);
+		return ret;
+	}
+	if (!tx->active || tx->count == 0) {
+		blobTxClear();
+		goto done;
+	}
+
+	ret = blobTxSeal(&journal, &length);
+	blobTxClear();
+	if (ret != 0)
+		return -1;
+
+	w->journal = journal;
+	w->length = length;
+	w->path = blobJournalPath();
+	w->done = done;
+	w->result = -1;
+	if (pthread_create(&w->writer, NULL, blobTxWriterRun, w) == 0) {
+		w->pending = true;
+		return 0;
+	}
+
+	LOG(LOG_ERROR, "Blob writer not started, writing in line\n");
+	ret = blobJournalCommit(w->path, journal, length);
+	sdoFree(journal);
+	w->journal = NULL;
+	if (ret != 0)
+		return -1;
+done:
+	if (done)
+		done(0);
+	return 0;
+#else
+	int32_t ret = sdoBlobTxCommit();
+
+	if (ret == 0 && done)
+		done(0);
+	return ret;
+#endif
+}
+
+/**
+ * sdoBlobTxSync waits until the commit handed over by sdoBlobTxCommitAsync
+ * is durable.
+ * @return 0 on success or if there was none, -1 if it failed
+ */
+int32_t sdoBlobTxSync(void)
+{
+	int32_t ret = 0;
+#if defined(SDO_BLOB_JOURNAL) && defined(CRED_WRITE_ASYNC)
+	blobTxWriterJoin();
+	ret = storage->blobTxWriter.result;
+	storage->blobTxWriter.result = 0;
+#endif
+	return ret;
+}
+
+/**
+ * sdoBlobJournalReplay completes a blob transaction cut short by a power
+ * loss or crash. It is run at startup, before any credential is read.
+ * @return 0 on success or if there is nothing to replay, -1 on error
+ */
+int32_t sdoBlobJournalReplay(void)
+{
+	int32_t ret = 0;
+#ifdef SDO_BLOB_JOURNAL
+	uint8_t computedHmac[PLATFORM_HMAC_SIZE] = {0};
+	const char *path = blobJournalPath();
+	uint8_t *journal = NULL;
+	size_t length;
+	int result = -1;
+
+	blobTxWriterJoin();
+	if (blobInStore() || !file_exists(path))
+		return 0;
+
+	length = get_file_size(path);
+	if (length > BLOB_JOURNAL_HDR_LEN + PLATFORM_HMAC_SIZE)
+		journal = sdoAlloc(length);
+	if (!journal || blobFileRead(path, journal, length) != 0)
+		goto drop;
+	length -= PLATFORM_HMAC_SIZE;
+
+	if (0 != sdoComputeStorageHMAC(journal, (uint32_t)length,
+				       computedHmac, PLATFORM_HMAC_SIZE))
+		goto drop;
+	memcmp_s(journal + length, PLATFORM_HMAC_SIZE, computedHmac,
+		 PLATFORM_HMAC_SIZE, &result);
+	if (result != 0)
+		goto drop;
+
+	LOG(LOG_INFO, "Replaying the blob journal\n");
+	ret = blobJournalApply(path, journal, length);
+	goto end;
+
+drop:
+	/* Torn before the commit point, the blob files are still intact */
+	LOG(LOG_ERROR, "Dropping incomplete blob journal\n");
+	if (remove(path) != 0)
+		ret = -1;
+end:
+	if (journal)
+		sdoFree(journal);
+#endif
+	return ret;
+}
+
 /**
  * sdoBlobSize Get specified SDO blob(file) size
  * Note: SDO_SDK_OTP_DATA flag is not supported for this platform.
@@ -57,29 +1499,61 @@
 
 int32_t sdoBlobSize(const char *name, sdoSdkBlobFlags flags)
 {
+	char path[FILENAME_MAX];
 	int32_t retval = -1;
-
+	uint32_t recLength = 0;
+	size_t size;
+	int found = 0;
+#ifndef CONFIG_SNAPSHOT_FALSE
+	int config;
+#endif
+
+	sdoStorageStatsApi(SDO_STORAGE_API_SIZE);
 	if (name == NULL) {
 		LOG(LOG_ERROR, "Invalid parameters!\n");
 		goto end;
 	}
+#ifndef CONFIG_SNAPSHOT_FALSE
+	config = flags == SDO_SDK_RAW_DATA ? configFind(name) : -1;
+	if (config >= 0) {
+		retval = storage->config.length[config];
+		goto end;
+	}
+#endif
+	name = sdoStoragePath(name, path, sizeof(path));
+	if (!name)
+		goto end;
 
-	if (file_exists(name) == false) {
+	/* The blob files may still be written in the background */
+	blobTxWriterJoin();
+
+	if (blobInStore()) {
+		found = idStoreGet(name, NULL, &recLength);
+		if (found < 0)
+			goto end;
+		if (!found &&
+		    (flags != SDO_SDK_RAW_DATA || !idStoreShared(name))) {
+			retval = 0;
+			goto end;
+		}
+	}
+	if (!found && file_exists(name) == false) {
 		LOG(LOG_DEBUG, "%s file does not exist!\n", name);
 		retval = 0;
 		goto end;
 	}
+	size = found ? recLength : get_file_size(name);
 
 	switch (flags) {
 	case SDO_SDK_RAW_DATA:
 		/* Raw Files are stored as plain files */
-		retval = (int32_t)(get_file_size(name));
+		retval = (int32_t)size;
 		break;
 	case SDO_SDK_NORMAL_DATA:
 		/* Normal blob is stored as:
 		 * [HMAC(32bytes)||data-content-size(4bytes)||data-content(?)]
 		 */
-		retval = (int32_t)(get_file_size(name) - PLATFORM_HMAC_SIZE -
+		retval = (int32_t)(size - PLATFORM_HMAC_SIZE -
 				   BLOB_CONTENT_SIZE);
 		break;
 	case SDO_SDK_SECURE_DATA:
@@ -87,7 +1561,7 @@ int32_t sdoBlobSize(const char *name, sdoSdkBlobFlags flags)
 		 * [IV_data(12byte)||TAG(16bytes)||
 		 * data-content-size(4bytes)||data-content(?)]
 		 */
-		retval = (int32_t)(get_file_size(name) - PLATFORM_GCM_TAG_SIZE -
+		retval = (int32_t)(size - PLATFORM_GCM_TAG_SIZE -
 				   PLATFORM_IV_DEFAULT_LEN - BLOB_CONTENT_SIZE);
 		break;
 	default:
@@ -103,6 +1577,101 @@ end:
 	return retval;
 }
 
+/**
+ * Internal API: map a blob file read-only, so it can be verified and
+ * decrypted in place.
+ * @param name - pointer to the blob/file name
+ * @param minLength - the file must hold at least that many bytes
+ * @param map - out, start of the mapping
+ * @param mapLength - out, size of the mapping
+ * @return 0 on success, -1 on error
+ */
+static int blobMap(const char *name, size_t minLength, uint8_t **map,
+		   size_t *mapLength)
+{
+	struct stat st;
+	void *addr;
+	int fd;
+
+	fd = open(name, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	if (fstat(fd, &st) != 0 || st.st_size <= 0 ||
+	    (size_t)st.st_size < minLength) {
+		(void)close(fd);
+		return -1;
+	}
+
+	addr = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	/* The mapping stays valid once the descriptor is closed */
+	(void)close(fd);
+	if (addr == MAP_FAILED)
+		return -1;
+
+	*map = addr;
+	*mapLength = (size_t)st.st_size;
+	sdoStorageStatsRead(*mapLength);
+	return 0;
+}
+
+/**
+ * Internal API: get the sealed content of a blob, a copy of the record of
+ * the bound identity or its file mapped.
+ * @return 0 on success, -1 on error
+ */
+static int blobLoad(const char *name, size_t minLength, uint8_t **map,
+		    size_t *mapLength)
+{
+	uint32_t length = 0;
+
+	if (!blobInStore())
+		return blobMap(name, minLength, map, mapLength);
+	if (idStoreGet(name, map, &length) != 1)
+		return -1;
+	*mapLength = length;
+	return length < minLength ? -1 : 0;
+}
+
+/**
+ * Internal API: release what blobLoad got.
+ */
+static void blobUnload(uint8_t *map, size_t mapLength)
+{
+	if (!blobInStore()) {
+		(void)munmap(map, mapLength);
+		return;
+	}
+	if (memset_s(map, mapLength, 0))
+		LOG(LOG_ERROR, "Failed to clear identity record\n");
+	sdoFree(map);
+}
+
+/**
+ * Internal API: read a raw blob, the record of the bound identity, else
+ * its file.
+ * @return 0 on success, -1 on error
+ */
+static int blobRawRead(const char *name, uint8_t *buf, uint32_t nBytes)
+{
+	uint8_t *record = NULL;
+	uint32_t length = 0;
+	int found;
+	int ret = -1;
+
+	if (!blobInStore())
+		return blobFileRead(name, buf, nBytes);
+	found = idStoreGet(name, &record, &length);
+	if (found == 0 && idStoreShared(name))
+		return blobFileRead(name, buf, nBytes);
+	if (found == 1 && length >= nBytes &&
+	    memcpy_s(buf, nBytes, record, nBytes) == 0)
+		ret = 0;
+	if (record)
+		blobUnload(record, length);
+	return ret;
+}
+
 /**
  * sdoBlobRead Read SDO blob(file) into specified buffer,
  * sdoBlobRead ensures authenticity &  integrity for non-secure
@@ -118,11 +1687,13 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 		    uint32_t nBytes)
 {
 	int retval = -1;
-	uint8_t *data = NULL;
+	const uint8_t *data = NULL;
 	uint32_t dataLength = 0;
-	uint8_t *sealedData = NULL;
+	uint8_t *map = NULL;
+	size_t mapLength = 0;
+	const uint8_t *sealedData = NULL;
 	uint32_t sealedDataLen = 0;
-	uint8_t *encryptedData = NULL;
+	const uint8_t *encryptedData = NULL;
 	uint32_t encryptedDataLen = 0;
 	uint8_t storedHmac[PLATFORM_HMAC_SIZE] = {0};
 	uint8_t computedHmac[PLATFORM_HMAC_SIZE] = {0};
@@ -131,7 +1702,16 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 	uint8_t iv[PLATFORM_IV_DEFAULT_LEN] = {0};
 	uint8_t aes_key[PLATFORM_AES_KEY_DEFAULT_LEN] = {0};
 	size_t datLen_offst = 0;
-
+	char path[FILENAME_MAX];
+#ifndef BLOB_CACHE_FALSE
+	blobCacheEntry_t *cached;
+#endif
+#ifndef CONFIG_SNAPSHOT_FALSE
+	int config;
+#endif
+	SDO_TRACE_START(traceStart);
+
+	sdoStorageStatsApi(SDO_STORAGE_API_READ);
 	if (!name || !buf || nBytes == 0) {
 		LOG(LOG_ERROR, "Invalid parameters in sdoBlobRead()!\n");
 		goto exit;
@@ -143,10 +1723,46 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 		goto exit;
 	}
 
+#ifndef CONFIG_SNAPSHOT_FALSE
+	config = flags == SDO_SDK_RAW_DATA ? configFind(name) : -1;
+	if (config >= 0) {
+		if (storage->config.length[config] < (int32_t)nBytes ||
+		    memcpy_s(buf, nBytes,
+			     storage->config.data +
+				 storage->config.offset[config],
+			     nBytes) != 0) {
+			LOG(LOG_ERROR, "Failed to read %s file!\n", name);
+			goto exit;
+		}
+		SDO_TRACE_END("storage", "blob-read", (int32_t)nBytes,
+			      traceStart);
+		return (int32_t)nBytes;
+	}
+#endif
+
+	/* Within the data directory of this SDK instance */
+	name = sdoStoragePath(name, path, sizeof(path));
+	if (!name)
+		goto exit;
+
+#ifndef BLOB_CACHE_FALSE
+	/* Already verified, as long as it was read with the same flags */
+	cached = blobCacheFind(name);
+	if (cached && cached->flags == flags && cached->length <= nBytes) {
+		if (memcpy_s(buf, nBytes, cached->data, cached->length) != 0)
+			goto exit;
+		SDO_TRACE_END("storage", "blob-read", (int32_t)nBytes,
+			      traceStart);
+		return (int32_t)nBytes;
+	}
+#endif
+
+	blobTxWriterJoin();
+
 	switch (flags) {
 	case SDO_SDK_RAW_DATA:
 		// Raw Files are stored as plain files
-		if (0 != read_buffer_from_file(name, buf, nBytes)) {
+		if (0 != blobRawRead(name, buf, nBytes)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", name);
 			goto exit;
 		}
@@ -161,16 +1777,11 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 
 		sealedDataLen = PLATFORM_HMAC_SIZE + BLOB_CONTENT_SIZE + nBytes;
 
-		if (NULL == (sealedData = sdoAlloc(sealedDataLen))) {
-			LOG(LOG_ERROR, "Malloc Failed in sdoBlobRead()!\n");
-			goto exit;
-		}
-
-		if (0 !=
-		    read_buffer_from_file(name, sealedData, sealedDataLen)) {
+		if (0 != blobLoad(name, sealedDataLen, &map, &mapLength)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", name);
 			goto exit;
 		}
+		sealedData = map;
 
 		// get actual data length
 		dataLength |= sealedData[PLATFORM_HMAC_SIZE] << 24;
@@ -218,6 +1829,9 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 				       "buffer failed!\n");
 			goto exit;
 		}
+#ifndef BLOB_CACHE_FALSE
+		blobCacheStore(name, flags, buf, dataLength);
+#endif
 		break;
 
 	case SDO_SDK_SECURE_DATA:
@@ -231,16 +1845,11 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 				   PLATFORM_GCM_TAG_SIZE + BLOB_CONTENT_SIZE +
 				   nBytes;
 
-		if (NULL == (encryptedData = sdoAlloc(encryptedDataLen))) {
-			LOG(LOG_ERROR, "Malloc Failed in sdoBlobRead()!\n");
-			goto exit;
-		}
-
-		if (0 != read_buffer_from_file(name, encryptedData,
-					       encryptedDataLen)) {
+		if (0 != blobLoad(name, encryptedDataLen, &map, &mapLength)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", name);
 			goto exit;
 		}
+		encryptedData = map;
 
 		datLen_offst = PLATFORM_GCM_TAG_SIZE + PLATFORM_IV_DEFAULT_LEN;
 		// get actual data length
@@ -283,14 +1892,17 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 
 		// decrypt and authenticate cipher-text content and fill the
 		// given buffer with clear-text
-		if (sdoCryptoAESGcmDecrypt(buf, nBytes, data, dataLength, iv,
-					   PLATFORM_IV_DEFAULT_LEN, aes_key,
-					   PLATFORM_AES_KEY_DEFAULT_LEN,
-					   storedTag, AES_GCM_TAG_LEN) < 0) {
+		if (sdoStorageGcmDecrypt(buf, nBytes, data, dataLength, iv,
+					 PLATFORM_IV_DEFAULT_LEN, aes_key,
+					 PLATFORM_AES_KEY_DEFAULT_LEN,
+					 storedTag, AES_GCM_TAG_LEN) < 0) {
 			LOG(LOG_ERROR, "Decryption failed during Secure "
 				       "Blob Read!\n");
 			goto exit;
 		}
+#ifndef BLOB_CACHE_FALSE
+		blobCacheStore(name, flags, buf, dataLength);
+#endif
 		break;
 
 	default:
@@ -301,14 +1913,13 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 	retval = (int32_t)nBytes;
 
 exit:
-	if (sealedData)
-		sdoFree(sealedData);
-	if (encryptedData)
-		sdoFree(encryptedData);
+	if (map)
+		blobUnload(map, mapLength);
 	if (memset_s(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN, 0)) {
 		LOG(LOG_ERROR, "Failed to clear AES key\n");
 		retval = -1;
 	}
+	SDO_TRACE_END("storage", "blob-read", retval, traceStart);
 	return retval;
 }
 
@@ -328,15 +1939,20 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		     const uint8_t *buf, uint32_t nBytes)
 {
 	int retval = -1;
-	FILE *f = NULL;
+	int staged;
 	uint32_t writeContextLen = 0;
 	uint8_t *writeContext = NULL;
-	size_t bytesWritten = 0;
 	uint8_t tag[PLATFORM_GCM_TAG_SIZE] = {0};
 	uint8_t iv[PLATFORM_IV_DEFAULT_LEN] = {0};
 	uint8_t aes_key[PLATFORM_AES_KEY_DEFAULT_LEN] = {0};
 	size_t datLen_offst = 0;
+	char path[FILENAME_MAX];
+#ifndef BLOB_CACHE_FALSE
+	blobCacheEntry_t *stale;
+#endif
+	SDO_TRACE_START(traceStart);
 
+	sdoStorageStatsApi(SDO_STORAGE_API_WRITE);
 	if (!buf || !name || nBytes == 0) {
 		LOG(LOG_ERROR, "Invalid parameters in sdoBlobWrite!\n");
 		goto exit;
@@ -348,6 +1964,25 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		goto exit;
 	}
 
+#ifndef CONFIG_SNAPSHOT_FALSE
+	if (flags == SDO_SDK_RAW_DATA && configFind(name) >= 0)
+		configSnapshotDrop();
+#endif
+
+	/* Within the data directory of this SDK instance */
+	name = sdoStoragePath(name, path, sizeof(path));
+	if (!name)
+		goto exit;
+
+#ifndef BLOB_CACHE_FALSE
+	/* The cached content is stale from here on, whatever the outcome */
+	stale = blobCacheFind(name);
+	if (stale)
+		blobCacheDrop(stale);
+#endif
+
+	blobTxWriterJoin();
+
 	switch (flags) {
 	case SDO_SDK_RAW_DATA:
 		// Raw Files are stored as plain files
@@ -431,7 +2066,7 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		}
 
 		// encrypt plain-text and copy cipher-text content
-		if (sdoCryptoAESGcmEncrypt(
+		if (sdoStorageGcmEncrypt(
 			buf, nBytes,
 			writeContext + PLATFORM_IV_DEFAULT_LEN +
 			    PLATFORM_GCM_TAG_SIZE + BLOB_CONTENT_SIZE,
@@ -473,31 +2108,31 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		goto exit;
 	}
 
-	f = fopen(name, "w");
-	if (f != NULL) {
-		bytesWritten =
-		    fwrite(writeContext, sizeof(char), writeContextLen, f);
-		if (bytesWritten != writeContextLen) {
-			LOG(LOG_ERROR, "file:%s not written properly\n", name);
-			goto exit;
-		}
-	} else {
-		LOG(LOG_ERROR, "Could not open file: %s\n", name);
+	/* Inside a transaction the content is only staged */
+	staged = blobTxStage(name, &writeContext, writeContextLen);
+	if (staged < 0)
+		goto exit;
+	if (!staged && blobInStore() &&
+	    idStorePut(name, &writeContext, writeContextLen) != 0)
+		goto exit;
+	if (!staged && !blobInStore() &&
+	    blobFileWrite(name, writeContext, writeContextLen) != 0)
 		goto exit;
-	}
 
 	retval = (int32_t)nBytes;
+#ifndef BLOB_CACHE_FALSE
+	if (flags != SDO_SDK_RAW_DATA)
+		blobCacheStore(name, flags, buf, nBytes);
+#endif
 
 exit:
 	if (writeContext)
 		sdoFree(writeContext);
-	if (f)
-		if (fclose(f) == EOF)
-			LOG(LOG_ERROR, "fclose() Failed in sdoBlobWrite\n");
 	if (memset_s(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN, 0)) {
 		LOG(LOG_ERROR, "Failed to clear AES key\n");
 		retval = -1;
 	}
+	SDO_TRACE_END("storage", "blob-write", retval, traceStart);
 	return retval;
 }
 
@@ -509,6 +2144,8 @@ exit:
  */
 int32_t sdoReadEPIDKey(uint8_t *buffer, uint32_t *size)
 {
+	char path[FILENAME_MAX];
+	const char *name;
 
 	if (!buffer || !size)
 		return -1;
@@ -518,10 +2155,317 @@ int32_t sdoReadEPIDKey(uint8_t *buffer, uint32_t *size)
 		return -1;
 	}
 
-	if (0 != read_buffer_from_file((char *)EPID_PRIVKEY, buffer, *size)) {
+	name = sdoStoragePath(EPID_PRIVKEY, path, sizeof(path));
+	if (!name || 0 != blobFileRead(name, buffer, *size)) {
 		LOG(LOG_ERROR, "Failed to read %s file!\n", EPID_PRIVKEY);
 		return -1;
 	}
 
 	return (int32_t)*size;
 }
+
+/**
+ * sdoStorageCtxAlloc sets up the storage of an SDK instance.
+ * @param dir - directory holding the blob and data files of the instance,
+ * laid out as the built in data directory
+ * @return the context, NULL on error
+ */
+sdoStorageCtx_t *sdoStorageCtxAlloc(const char *dir)
+{
+	sdoStorageCtx_t *ctx = NULL;
+	size_t len;
+
+	len = dir ? strnlen_s(dir, FILENAME_MAX) : 0;
+	if (len == 0 || len >= FILENAME_MAX) {
+		LOG(LOG_ERROR, "Invalid storage directory\n");
+		return NULL;
+	}
+
+	ctx = sdoAlloc(sizeof(sdoStorageCtx_t));
+	if (!ctx)
+		return NULL;
+	ctx->dir = sdoAlloc(len + 1);
+	ctx->platform = platformStateAlloc();
+	if (!ctx->dir || !ctx->platform ||
+	    strcpy_s(ctx->dir, len + 1, dir) != 0)
+		goto err;
+#ifdef SDO_BLOB_JOURNAL
+	{
+		sdoStorageCtx_t *prev = storage;
+		const char *path;
+
+		storage = ctx;
+		path = sdoStoragePath(SDO_BLOB_JOURNAL, ctx->journalPath,
+				      sizeof(ctx->journalPath));
+		storage = prev;
+		if (!path)
+			goto err;
+	}
+#endif
+	return ctx;
+
+err:
+	LOG(LOG_ERROR, "Failed to set up the storage of %s\n", dir);
+	platformStateFree(ctx->platform);
+	if (ctx->dir)
+		sdoFree(ctx->dir);
+	sdoFree(ctx);
+	return NULL;
+}
+
+/**
+ * sdoStorageCtxBind makes ctx the storage of the calling thread.
+ * @param ctx - context of sdoStorageCtxAlloc, NULL for the default one
+ */
+void sdoStorageCtxBind(sdoStorageCtx_t *ctx)
+{
+	storage = ctx ? ctx : &defaultStorage;
+	platformStateBind(ctx ? ctx->platform : NULL);
+}
+
+/**
+ * sdoStorageCtxFree waits for the background writes of ctx, wipes what it
+ * cached and releases it. The calling thread is left bound to the default
+ * storage.
+ * @param ctx - context of sdoStorageCtxAlloc
+ */
+void sdoStorageCtxFree(sdoStorageCtx_t *ctx)
+{
+	if (!ctx)
+		return;
+
+	sdoStorageCtxBind(ctx);
+	if (sdoBlobTxSync() != 0)
+		LOG(LOG_ERROR, "Deferred blob commit failed\n");
+	sdoBlobTxAbort();
+	sdoBlobCacheFlush();
+#ifndef CONFIG_SNAPSHOT_FALSE
+	configSnapshotDrop();
+#endif
+	clearPlatformKeys();
+	sdoStorageCtxBind(NULL);
+
+	platformStateFree(ctx->platform);
+	if (ctx->dir)
+		sdoFree(ctx->dir);
+#ifdef SDO_IDENTITY_STORE
+	if (ctx->identity)
+		sdoFree(ctx->identity);
+#endif
+	sdoFree(ctx);
+}
+
+/**
+ * sdoStorageCtxAllocIdentity sets up the storage of an SDK instance whose
+ * blobs live in the identity store (IDENTITY_STORE), opened beforehand.
+ * The keys of the identity are derived from the platform HMAC key, its
+ * raw files that are not keys are read from the data directory as long as
+ * it has none of its own.
+ * @param identity - name of the identity, without '/'
+ * @return the context, NULL on error
+ */
+sdoStorageCtx_t *sdoStorageCtxAllocIdentity(const char *identity)
+{
+#ifdef SDO_IDENTITY_STORE
+	sdoStorageCtx_t *ctx = NULL;
+	size_t len;
+	bool open;
+
+	len = identity ? strnlen_s(identity, IDSTORE_ID_MAX) : 0;
+	if (len == 0 || len >= IDSTORE_ID_MAX || strchr(identity, '/')) {
+		LOG(LOG_ERROR, "Invalid identity\n");
+		return NULL;
+	}
+	SDO_LOCK(idStoreLock);
+	open = idStore.path != NULL;
+	SDO_UNLOCK(idStoreLock);
+	if (!open) {
+		LOG(LOG_ERROR, "Identity store not open\n");
+		return NULL;
+	}
+
+	ctx = sdoAlloc(sizeof(sdoStorageCtx_t));
+	if (!ctx)
+		return NULL;
+	ctx->identity = sdoAlloc(len + 1);
+	ctx->platform = platformStateAlloc();
+	if (!ctx->identity || !ctx->platform ||
+	    strcpy_s(ctx->identity, len + 1, identity) != 0 ||
+	    !platformStateDerive(ctx->platform, identity)) {
+		LOG(LOG_ERROR, "Failed to set up the storage of %s\n",
+		    identity);
+		platformStateFree(ctx->platform);
+		if (ctx->identity)
+			sdoFree(ctx->identity);
+		sdoFree(ctx);
+		return NULL;
+	}
+	return ctx;
+#else
+	(void)identity;
+	LOG(LOG_ERROR, "Built without the identity store\n");
+	return NULL;
+#endif
+}
+
+/**
+ * sdoIdentityStoreOpen reads the identity store, which then serves the
+ * contexts of sdoStorageCtxAllocIdentity. It is called once, from a thread
+ * bound to the default storage, whose platform HMAC key vouches for the
+ * store.
+ * @param path - file of the store, NULL for the built in one
+ * @return 0 on success (an absent store is empty), -1 on error, for ex: a
+ * damaged store
+ */
+int32_t sdoIdentityStoreOpen(const char *path)
+{
+#ifdef SDO_IDENTITY_STORE
+	char newPath[FILENAME_MAX];
+	uint8_t *image = NULL;
+	size_t length = 0;
+	size_t len;
+	int32_t ret = -1;
+
+	if (!path)
+		path = SDO_IDENTITY_STORE;
+	len = strnlen_s(path, FILENAME_MAX);
+	if (len == 0 || len >= FILENAME_MAX - sizeof(IDSTORE_NEW_SUFFIX) ||
+	    strcpy_s(newPath, sizeof(newPath), path) != 0 ||
+	    strcat_s(newPath, sizeof(newPath), IDSTORE_NEW_SUFFIX) != 0) {
+		LOG(LOG_ERROR, "Invalid identity store path\n");
+		return -1;
+	}
+
+	SDO_LOCK(idStoreLock);
+	if (idStore.path) {
+		LOG(LOG_ERROR, "Identity store already open\n");
+		goto end;
+	}
+	idStore.path = sdoAlloc(len + 1);
+	if (!idStore.path || strcpy_s(idStore.path, len + 1, path) != 0)
+		goto err;
+
+	/* A commit cut short leaves the old store and a ".new" file */
+	if (file_exists(newPath) && remove(newPath) != 0)
+		LOG(LOG_ERROR, "Failed to remove %s\n", newPath);
+
+	/* One read for all the identities */
+	if (file_exists(path)) {
+		length = get_file_size(path);
+		if (length > 0)
+			image = sdoAlloc(length);
+		if (!image || blobFileRead(path, image, length) != 0 ||
+		    idStoreParse(image, length) != 0) {
+			LOG(LOG_ERROR, "Identity store %s is damaged\n", path);
+			goto err;
+		}
+		LOG(LOG_DEBUG, "Identity store holds %u blobs\n",
+		    idStore.count);
+	}
+	ret = 0;
+	goto end;
+
+err:
+	idStoreClear();
+end:
+	SDO_UNLOCK(idStoreLock);
+	if (image) {
+		if (memset_s(image, length, 0))
+			LOG(LOG_ERROR, "Failed to clear identity store\n");
+		sdoFree(image);
+	}
+	return ret;
+#else
+	(void)path;
+	LOG(LOG_ERROR, "Built without the identity store\n");
+	return -1;
+#endif
+}
+
+/**
+ * sdoIdentityStoreCommit makes what all the identities wrote since the
+ * last commit durable, at once. Identities may keep on reading and writing
+ * while the store is written out. It is called from a thread bound to the
+ * default storage, as sdoIdentityStoreOpen.
+ * @return 0 on success or if there was nothing to commit, -1 on error, in
+ * which case the writes are committed with the next commit
+ */
+int32_t sdoIdentityStoreCommit(void)
+{
+#ifdef SDO_IDENTITY_STORE
+	char newPath[FILENAME_MAX];
+	char path[FILENAME_MAX];
+	uint8_t *image = NULL;
+	size_t length = 0;
+	int32_t ret = -1;
+	int fd;
+
+	SDO_LOCK(idStoreCommitLock);
+	SDO_LOCK(idStoreLock);
+	if (!idStore.path) {
+		LOG(LOG_ERROR, "Identity store not open\n");
+	} else if (!idStore.dirty) {
+		ret = 0;
+	} else if (strcpy_s(path, sizeof(path), idStore.path) == 0 &&
+		   idStoreSeal(&image, &length) == 0) {
+		/* Writes from here on go with the next commit */
+		idStore.dirty = false;
+	}
+	SDO_UNLOCK(idStoreLock);
+	if (!image)
+		goto end;
+
+	if (strcpy_s(newPath, sizeof(newPath), path) != 0 ||
+	    strcat_s(newPath, sizeof(newPath), IDSTORE_NEW_SUFFIX) != 0 ||
+	    blobFileWriteSync(newPath, image, length) != 0 ||
+	    rename(newPath, path) != 0)
+		goto fail;
+
+	/* The rename is durable once the file system is synced */
+	fd = open(path, O_RDONLY);
+	if (fd < 0 || syncfs(fd) != 0) {
+		if (fd >= 0)
+			(void)close(fd);
+		goto fail;
+	}
+	(void)close(fd);
+	sdoStorageStatsSync();
+	ret = 0;
+	goto end;
+
+fail:
+	LOG(LOG_ERROR, "Identity store not committed\n");
+	SDO_LOCK(idStoreLock);
+	idStore.dirty = true;
+	SDO_UNLOCK(idStoreLock);
+end:
+	SDO_UNLOCK(idStoreCommitLock);
+	if (image) {
+		if (memset_s(image, length, 0))
+			LOG(LOG_ERROR, "Failed to clear identity store\n");
+		sdoFree(image);
+	}
+	return ret;
+#else
+	LOG(LOG_ERROR, "Built without the identity store\n");
+	return -1;
+#endif
+}
+
+/**
+ * sdoIdentityStoreClose wipes and releases the identity store, once the
+ * contexts of its identities are freed. What was not committed is lost.
+ */
+void sdoIdentityStoreClose(void)
+{
+#ifdef SDO_IDENTITY_STORE
+	SDO_LOCK(idStoreCommitLock);
+	SDO_LOCK(idStoreLock);
+	if (idStore.dirty)
+		LOG(LOG_ERROR, "Identity store closed with writes not "
+			       "committed\n");
+	idStoreClear();
+	SDO_UNLOCK(idStoreLock);
+	SDO_UNLOCK(idStoreCommitLock);
+#endif
+}
@@ -0,0 +1,323 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Storage Abstraction Layer Library
+ *
+ * The file implements the sector cache of the SD card for Mbedos. The FAT
+ * file system reads a blob a sector at a time (directory, FAT, then header,
+ * HMAC and data of the blob), each read being an SPI transaction of its
+ * own; with the cache the neighbouring sectors come along with the first.
+ * Writes stay in the cache until the file system syncs (a file is closed or
+ * renamed) or the storage abstraction layer commits, see sdoSdCacheSync.
+ */
+
+#include "SDCacheBlockDevice.h"
+#include <string.h>
+#include "util.h"
+
+#if SD_CACHE
+#define LINE_SIZE (SD_READ_AHEAD * SD_CACHE_SECTOR)
+#define LINE_ALL ((uint8_t)((1u << SD_READ_AHEAD) - 1))
+
+static SDCacheBlockDevice *active;
+
+/* Bits of the sectors of a line from offset off, n bytes long */
+static uint8_t sectorMask(bd_size_t off, bd_size_t n)
+{
+	uint32_t first = off / SD_CACHE_SECTOR;
+	uint32_t count = n / SD_CACHE_SECTOR;
+
+	return (uint8_t)(((1u << count) - 1) << first);
+}
+
+SDCacheBlockDevice::SDCacheBlockDevice(BlockDevice *bd)
+    : _bd(bd), _on(false), _clock(0)
+{
+	memset(_lines, 0, sizeof(_lines));
+	active = this;
+}
+
+SDCacheBlockDevice::~SDCacheBlockDevice()
+{
+	if (active == this)
+		active = NULL;
+}
+
+int SDCacheBlockDevice::init()
+{
+	int ret = _bd->init();
+
+	if (ret)
+		return ret;
+	_mutex.lock();
+	memset(_lines, 0, sizeof(_lines));
+	/* SD cards have 512 byte blocks, cache nothing otherwise */
+	_on = _bd->get_read_size() <= SD_CACHE_SECTOR &&
+	      _bd->get_program_size() <= SD_CACHE_SECTOR &&
+	      SD_CACHE_SECTOR % _bd->get_read_size() == 0 &&
+	      SD_CACHE_SECTOR % _bd->get_program_size() == 0;
+	_mutex.unlock();
+	return 0;
+}
+
+int SDCacheBlockDevice::deinit()
+{
+	int ret = invalidate();
+
+	if (_bd->deinit())
+		ret = BD_ERROR_DEVICE_ERROR;
+	return ret;
+}
+
+/* Line caching the sectors from addr, NULL if none */
+SDCacheBlockDevice::line *SDCacheBlockDevice::find(bd_addr_t addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < SD_CACHE_LINES; i++) {
+		if (_lines[i].used && _lines[i].addr == addr) {
+			_lines[i].used = ++_clock ? _clock : ++_clock;
+			return &_lines[i];
+		}
+	}
+	return NULL;
+}
+
+/* A line for the sectors from addr, the least recently used one evicted */
+SDCacheBlockDevice::line *SDCacheBlockDevice::take(bd_addr_t addr)
+{
+	line *l = &_lines[0];
+	unsigned int i;
+
+	for (i = 1; i < SD_CACHE_LINES && l->used; i++) {
+		if (_lines[i].used < l->used)
+			l = &_lines[i];
+	}
+	if (l->used && writeBack(l))
+		return NULL;
+	l->addr = addr;
+	l->valid = 0;
+	l->dirty = 0;
+	l->used = ++_clock ? _clock : ++_clock;
+	return l;
+}
+
+/* Read the sectors of mask missing from the line, a run at a time */
+int SDCacheBlockDevice::fill(line *l, uint8_t mask)
+{
+	bd_size_t end = _bd->size();
+	uint32_t i = 0;
+	uint32_t n;
+
+	mask &= ~l->valid;
+	while (mask) {
+		for (; !(mask & (1u << i)); i++)
+			;
+		for (n = 1; mask & (1u << (i + n)); n++)
+			;
+		/* the last line of the card may be short */
+		if (l->addr + (i + n) * SD_CACHE_SECTOR > end)
+			return BD_ERROR_DEVICE_ERROR;
+		if (_bd->read(l->data + i * SD_CACHE_SECTOR,
+			      l->addr + i * SD_CACHE_SECTOR,
+			      n * SD_CACHE_SECTOR))
+			return BD_ERROR_DEVICE_ERROR;
+		l->valid |=
+		    sectorMask(i * SD_CACHE_SECTOR, n * SD_CACHE_SECTOR);
+		mask &= ~l->valid;
+		i += n;
+	}
+	return 0;
+}
+
+/* Program the dirty sectors of the line, a run at a time */
+int SDCacheBlockDevice::writeBack(line *l)
+{
+	uint32_t i = 0;
+	uint32_t n;
+
+	while (l->dirty) {
+		for (; !(l->dirty & (1u << i)); i++)
+			;
+		for (n = 1; l->dirty & (1u << (i + n)); n++)
+			;
+		if (_bd->program(l->data + i * SD_CACHE_SECTOR,
+				 l->addr + i * SD_CACHE_SECTOR,
+				 n * SD_CACHE_SECTOR)) {
+			LOG(LOG_ERROR, "SD cache: write back failed\n");
+			return BD_ERROR_DEVICE_ERROR;
+		}
+		l->dirty &=
+		    ~sectorMask(i * SD_CACHE_SECTOR, n * SD_CACHE_SECTOR);
+		i += n;
+	}
+	return 0;
+}
+
+int SDCacheBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size)
+{
+	uint8_t *buf = (uint8_t *)buffer;
+	bd_size_t end = _bd->size();
+	bd_addr_t base;
+	bd_size_t off, n;
+	uint8_t ahead;
+	line *l;
+	int ret = 0;
+
+	if (!_on)
+		return _bd->read(buffer, addr, size);
+	if (!is_valid_read(addr, size))
+		return BD_ERROR_DEVICE_ERROR;
+
+	_mutex.lock();
+	while (size && !ret) {
+		base = addr - addr % LINE_SIZE;
+		off = addr - base;
+		n = LINE_SIZE - off < size ? LINE_SIZE - off : size;
+		l = find(base);
+		if (!l && n == LINE_SIZE) {
+			/* a whole line, not worth caching */
+			ret = _bd->read(buf, addr, n);
+		} else if (!l && !(l = take(base))) {
+			ret = BD_ERROR_DEVICE_ERROR;
+		} else {
+			/* the rest of the line along with the sectors read */
+			ahead = base + LINE_SIZE <= end
+				    ? LINE_ALL
+				    : sectorMask(0, end - base);
+			ret = fill(l, ahead | sectorMask(off, n));
+			if (!ret)
+				memcpy(buf, l->data + off, n);
+		}
+		buf += n;
+		addr += n;
+		size -= n;
+	}
+	_mutex.unlock();
+	return ret;
+}
+
+int SDCacheBlockDevice::program(const void *buffer, bd_addr_t addr,
+				bd_size_t size)
+{
+	const uint8_t *buf = (const uint8_t *)buffer;
+	bd_addr_t base;
+	bd_size_t off, n;
+	uint8_t mask;
+	line *l;
+	int ret = 0;
+
+	if (!_on)
+		return _bd->program(buffer, addr, size);
+	if (!is_valid_program(addr, size))
+		return BD_ERROR_DEVICE_ERROR;
+
+	_mutex.lock();
+	while (size && !ret) {
+		base = addr - addr % LINE_SIZE;
+		off = addr - base;
+		n = LINE_SIZE - off < size ? LINE_SIZE - off : size;
+		l = find(base);
+		if (!l && !(l = take(base))) {
+			ret = BD_ERROR_DEVICE_ERROR;
+		} else {
+			mask = sectorMask(off, n);
+			memcpy(l->data + off, buf, n);
+			l->valid |= mask;
+			l->dirty |= mask;
+		}
+		buf += n;
+		addr += n;
+		size -= n;
+	}
+	_mutex.unlock();
+	return ret;
+}
+
+int SDCacheBlockDevice::erase(bd_addr_t addr, bd_size_t size)
+{
+	unsigned int i;
+	int ret = 0;
+
+	if (!_on)
+		return _bd->erase(addr, size);
+
+	/* The lines overlapping the range are written back and dropped */
+	_mutex.lock();
+	for (i = 0; i < SD_CACHE_LINES && !ret; i++) {
+		if (!_lines[i].used || _lines[i].addr >= addr + size ||
+		    _lines[i].addr + LINE_SIZE <= addr)
+			continue;
+		ret = writeBack(&_lines[i]);
+		_lines[i].used = 0;
+	}
+	if (!ret)
+		ret = _bd->erase(addr, size);
+	_mutex.unlock();
+	return ret;
+}
+
+int SDCacheBlockDevice::sync()
+{
+	unsigned int i;
+	int ret = 0;
+
+	_mutex.lock();
+	for (i = 0; i < SD_CACHE_LINES; i++) {
+		if (_lines[i].used && writeBack(&_lines[i]))
+			ret = BD_ERROR_DEVICE_ERROR;
+	}
+	if (!ret)
+		ret = _bd->sync();
+	_mutex.unlock();
+	return ret;
+}
+
+int SDCacheBlockDevice::invalidate()
+{
+	unsigned int i;
+	int ret = sync();
+
+	_mutex.lock();
+	for (i = 0; i < SD_CACHE_LINES; i++)
+		_lines[i].used = 0;
+	_mutex.unlock();
+	return ret;
+}
+
+bd_size_t SDCacheBlockDevice::get_read_size() const
+{
+	return _on ? SD_CACHE_SECTOR : _bd->get_read_size();
+}
+
+bd_size_t SDCacheBlockDevice::get_program_size() const
+{
+	return _on ? SD_CACHE_SECTOR : _bd->get_program_size();
+}
+
+bd_size_t SDCacheBlockDevice::get_erase_size() const
+{
+	return _bd->get_erase_size();
+}
+
+bd_size_t SDCacheBlockDevice::size() const
+{
+	return _bd->size();
+}
+
+int sdoSdCacheSync(void)
+{
+	if (active && active->sync())
+		return -1;
+	return 0;
+}
+
+#else
+int sdoSdCacheSync(void)
+{
+	return 0;
+}
+#endif /* SD_CACHE */
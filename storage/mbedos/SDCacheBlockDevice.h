@@ -0,0 +1,94 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Storage Abstraction Layer Library
+ *
+ * Sector cache between the FAT file system and the SD card of Mbedos: reads
+ * are served from lines of SD_READ_AHEAD consecutive sectors, filled with
+ * one multiple block read, and writes are kept in the lines until sync(),
+ * which programs each run of dirty sectors at once.
+ */
+
+#ifndef __SD_CACHE_BLOCK_DEVICE_H__
+#define __SD_CACHE_BLOCK_DEVICE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Write the sectors kept by the cache to the SD card. Called by the storage
+ * abstraction layer when blobs are committed.
+ * @return 0 on success, -1 on error
+ */
+int sdoSdCacheSync(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+/* Sectors cached, 0 for none */
+#ifndef SD_CACHE
+#define SD_CACHE 16
+#endif
+
+#if SD_CACHE && defined(__cplusplus)
+#include "BlockDevice.h"
+#include "PlatformMutex.h"
+
+#define SD_CACHE_SECTOR 512
+/* Sectors read at once, on a miss */
+#define SD_READ_AHEAD 4
+#define SD_CACHE_LINES (SD_CACHE / SD_READ_AHEAD)
+
+#if SD_CACHE % SD_READ_AHEAD
+#error SD_CACHE must be a multiple of SD_READ_AHEAD
+#endif
+
+class SDCacheBlockDevice : public BlockDevice
+{
+      public:
+	SDCacheBlockDevice(BlockDevice *bd);
+	virtual ~SDCacheBlockDevice();
+
+	virtual int init();
+	virtual int deinit();
+	virtual int read(void *buffer, bd_addr_t addr, bd_size_t size);
+	virtual int program(const void *buffer, bd_addr_t addr,
+			    bd_size_t size);
+	virtual int erase(bd_addr_t addr, bd_size_t size);
+	virtual int sync();
+	virtual bd_size_t get_read_size() const;
+	virtual bd_size_t get_program_size() const;
+	virtual bd_size_t get_erase_size() const;
+	virtual bd_size_t size() const;
+
+	/* Write the dirty sectors back and forget all of them */
+	int invalidate();
+
+      private:
+	struct line {
+		bd_addr_t addr; // of its first sector
+		uint32_t used;	// LRU stamp, 0 when free
+		uint8_t valid;	// bit per sector read or written
+		uint8_t dirty;	// bit per sector not written back yet
+		uint8_t data[SD_READ_AHEAD * SD_CACHE_SECTOR];
+	};
+
+	line *find(bd_addr_t addr);
+	line *take(bd_addr_t addr);
+	int fill(line *l, uint8_t mask);
+	int writeBack(line *l);
+
+	BlockDevice *_bd;
+	PlatformMutex _mutex;
+	bool _on; // sectors of the device are the size of the lines'
+	uint32_t _clock;
+	line _lines[SD_CACHE_LINES];
+};
+#endif /* SD_CACHE */
+
+#endif /* __SD_CACHE_BLOCK_DEVICE_H__ */
@@ -0,0 +1,1005 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: Apache 2.0
+ */
+
+/*
+ * Storage Abstraction Layer Library
+ *
+ * The file implements storage abstraction layer for Mbedos running on CortexM
+ * without an SD card (DATASTORE other than sd). Blobs are records of the
+ * mbed KVStore, which the storage configuration puts on a TDBStore in
+ * internal flash: each record set is atomic and CRC protected, and the
+ * TDBStore spreads the writes over its two areas.
+ */
+
+#include "storage_al.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include "kvstore_global_api.h"
+#include "mbed_error.h"
+#include "util.h"
+#include "sdoCryptoHal.h"
+#include "crypto_utils.h"
+#include "platform_utils.h"
+#include "storage_stats.h"
+
+/* Provisioning data, turned into arrays by the creat_data make target */
+#include "Normal.blob.h"
+#include "Secure.blob.h"
+#include "Mfg.blob.h"
+#include "raw.blob.h"
+#include "ecdsaprivkey.h"
+#include "epidprivkey.dat.h"
+#ifdef MFG_PROXY
+#include "mfg_proxy.dat.h"
+#include "rv_proxy.dat.h"
+#include "owner_proxy.dat.h"
+#endif
+
+extern "C" {
+extern int memset_s(void *dest, size_t dmax, uint8_t value);
+extern int memcpy_s(void *dest, size_t dmax, const void *src, size_t slen);
+extern int memcmp_s(const void *dest, size_t dmax, const void *src, size_t slen,
+		    int *diff);
+extern size_t strnlen_s(const char *s, size_t smax);
+}
+
+#ifndef MBED_CONF_STORAGE_DEFAULT_KV
+#define MBED_CONF_STORAGE_DEFAULT_KV kv
+#endif
+#define KV_STR(x) #x
+#define KV_XSTR(x) KV_STR(x)
+#define KV_PREFIX "/" KV_XSTR(MBED_CONF_STORAGE_DEFAULT_KV) "/"
+
+#define MAX_KEY_PATH KV_MAX_KEY_LENGTH
+
+/* Record of the staged blob transaction, see sdoBlobTxCommit */
+#define KV_JOURNAL "sdo_journal"
+#define BLOB_TX_MAX 8
+
+/**
+ * Internal API: map a blob name to its KVStore key, "data/Normal.blob"
+ * becomes "/kv/data_Normal.blob" as keys cannot hold a '/'.
+ * @return 0 on success, -1 if the name does not fit
+ */
+static int getKVkey(char *key, const char *name)
+{
+	size_t prefixLen = sizeof(KV_PREFIX) - 1;
+	size_t nameLen = strnlen_s(name, MAX_KEY_PATH);
+	size_t i;
+
+	if (nameLen == 0 || prefixLen + nameLen >= MAX_KEY_PATH)
+		return -1;
+	if (memcpy_s(key, MAX_KEY_PATH, KV_PREFIX, prefixLen) != 0)
+		return -1;
+	for (i = 0; i < nameLen; i++)
+		key[prefixLen + i] = (name[i] == '/') ? '_' : name[i];
+	key[prefixLen + nameLen] = '\0';
+	return 0;
+}
+
+/**
+ * Internal API: size of a record.
+ * @return record size, 0 if there is none, -1 on error
+ */
+static int32_t kvRecordSize(const char *name)
+{
+	char key[MAX_KEY_PATH] = {0};
+	kv_info_t info;
+	int ret;
+
+	if (getKVkey(key, name) != 0)
+		return -1;
+
+	ret = kv_get_info(key, &info);
+	if (ret == MBED_ERROR_ITEM_NOT_FOUND)
+		return 0;
+	if (ret != MBED_SUCCESS) {
+		LOG(LOG_ERROR, "kv_get_info(%s) failed: %d\n", key, ret);
+		return -1;
+	}
+	return (int32_t)info.size;
+}
+
+/**
+ * Internal API: read the first length bytes of a record.
+ * @return 0 on success, -1 on error or if the record is shorter
+ */
+static int kvRecordRead(const char *name, uint8_t *buf, size_t length)
+{
+	char key[MAX_KEY_PATH] = {0};
+	size_t actual = 0;
+	int ret;
+
+	if (getKVkey(key, name) != 0)
+		return -1;
+
+	ret = kv_get(key, buf, length, &actual);
+	if (ret != MBED_SUCCESS || actual != length)
+		return -1;
+	sdoStorageStatsRead(length);
+	return 0;
+}
+
+/**
+ * Internal API: replace a record, atomically.
+ * @return 0 on success, -1 on error
+ */
+static int kvRecordWrite(const char *name, const uint8_t *buf, size_t length)
+{
+	char key[MAX_KEY_PATH] = {0};
+	int ret;
+
+	if (getKVkey(key, name) != 0)
+		return -1;
+
+	ret = kv_set(key, buf, length, 0);
+	if (ret != MBED_SUCCESS) {
+		LOG(LOG_ERROR, "kv_set(%s) failed: %d\n", key, ret);
+		return -1;
+	}
+	/* The record is on the flash once kv_set returns */
+	sdoStorageStatsWrite(key, length);
+	sdoStorageStatsSync();
+	return 0;
+}
+
+/*
+ * Blob transaction. Between sdoBlobTxBegin and sdoBlobTxCommit, sdoBlobWrite
+ * only stages the sealed records. The commit stores them all as one journal
+ * record, which is the commit point since a kv_set is atomic:
+ * [count(4)||count * [nameLen(4)||name||length(4)||record]]
+ * The records are then set one by one and the journal is removed. A journal
+ * left by a power loss is applied again by sdoBlobJournalReplay.
+ */
+typedef struct {
+	char *name;
+	uint8_t *record;
+	uint32_t length;
+} blobTxEntry_t;
+
+static struct {
+	bool active;
+	unsigned int count;
+	blobTxEntry_t entry[BLOB_TX_MAX];
+} blobTx;
+
+/**
+ * Internal API: put a 32 bit value big endian.
+ */
+static void putU32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value >> 0;
+}
+
+/**
+ * Internal API: get a 32 bit big endian value.
+ */
+static uint32_t getU32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * Internal API: release what the transaction staged.
+ */
+static void blobTxClear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < blobTx.count; i++) {
+		if (blobTx.entry[i].record) {
+			if (memset_s(blobTx.entry[i].record,
+				     blobTx.entry[i].length, 0))
+				LOG(LOG_ERROR, "Failed to clear staged blob\n");
+			sdoFree(blobTx.entry[i].record);
+		}
+		if (blobTx.entry[i].name)
+			sdoFree(blobTx.entry[i].name);
+		blobTx.entry[i].length = 0;
+	}
+	blobTx.count = 0;
+	blobTx.active = false;
+}
+
+/**
+ * Internal API: stage a sealed record while a transaction is open.
+ * @param record - in, sealed record; taken over (and NULLed) once staged
+ * @return 1 if staged, 0 if there is no transaction, -1 on error
+ */
+static int blobTxStage(const char *name, uint8_t **record, uint32_t length)
+{
+	blobTxEntry_t *entry = NULL;
+	size_t nameLen = strnlen_s(name, MAX_KEY_PATH);
+	unsigned int i;
+	int result;
+
+	if (!blobTx.active)
+		return 0;
+
+	/* A second write of the same blob replaces the first */
+	for (i = 0; i < blobTx.count; i++) {
+		result = -1;
+		if (strnlen_s(blobTx.entry[i].name, MAX_KEY_PATH) == nameLen)
+			memcmp_s(blobTx.entry[i].name, nameLen, name, nameLen,
+				 &result);
+		if (result == 0) {
+			entry = &blobTx.entry[i];
+			sdoFree(entry->record);
+			break;
+		}
+	}
+
+	if (!entry) {
+		if (blobTx.count == BLOB_TX_MAX) {
+			LOG(LOG_ERROR, "Too many blobs in one transaction\n");
+			return -1;
+		}
+		entry = &blobTx.entry[blobTx.count];
+		entry->name = (char *)sdoAlloc(nameLen + 1);
+		if (!entry->name ||
+		    memcpy_s(entry->name, nameLen + 1, name, nameLen) != 0) {
+			if (entry->name)
+				sdoFree(entry->name);
+			return -1;
+		}
+		blobTx.count++;
+	}
+
+	entry->record = *record;
+	entry->length = length;
+	*record = NULL;
+	return 1;
+}
+
+/**
+ * Internal API: set the records a journal holds, then remove it.
+ * @return 0 on success, -1 on error
+ */
+static int blobJournalApply(const uint8_t *journal, size_t length)
+{
+	const uint8_t *p = journal + BLOB_CONTENT_SIZE;
+	const uint8_t *end = journal + length;
+	char name[MAX_KEY_PATH] = {0};
+	uint32_t nameLen;
+	uint32_t recordLen;
+	uint32_t count;
+	char key[MAX_KEY_PATH] = {0};
+
+	if (length < BLOB_CONTENT_SIZE)
+		return -1;
+	count = getU32(journal);
+
+	while (count--) {
+		if (end - p < BLOB_CONTENT_SIZE)
+			return -1;
+		nameLen = getU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if (nameLen == 0 || nameLen >= MAX_KEY_PATH ||
+		    (size_t)(end - p) < nameLen + BLOB_CONTENT_SIZE)
+			return -1;
+		if (memcpy_s(name, sizeof(name), p, nameLen) != 0)
+			return -1;
+		name[nameLen] = '\0';
+		p += nameLen;
+
+		recordLen = getU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if ((size_t)(end - p) < recordLen ||
+		    kvRecordWrite(name, p, recordLen) != 0)
+			return -1;
+		p += recordLen;
+	}
+
+	if (getKVkey(key, KV_JOURNAL) != 0 || kv_remove(key) != MBED_SUCCESS) {
+		LOG(LOG_ERROR, "Failed to remove the blob journal\n");
+		return -1;
+	}
+	return 0;
+}
+
+/****************************************************
+ *
+ * Note on secure blob storage implementation
+ *   1. The current IV used is 12 bytes – this allows the IV to be
+ *      used directly to build the counter by OpenSSL and mbedTLS
+ *   2. When the IV is read from the file in order to perform encryption:
+ *   	a.Calculate the number of AES blocks the encryption will perform
+ *	(datalength/16)
+ *	b.If number of AES blocks < 2^32, increment the IV by one; otherwise
+ *	increment the IV by 2
+ *   3.	If the IV “rolls over” , further encryption is not allowed.
+ *
+ * How we handle roll over?
+ *   1.	Rollover occurs when the IV has been incremented back to the original
+ *	value set by the IV (2^(12*8) = 2^96)
+ *   2.	we handle roll-over by follwing way:
+ *	a. We save original IV value in first 12 byte of platform iv storage.
+ *	b. We keep updated iv (counter) in last 12 byte of platform iv storage.
+ *	c. During increment of iv we compare with original iv with the
+ *	incrementd value.
+ *	d. If rollover not detected, update the new iv in file and use the new
+ *	iv for encryption.
+ *	e. If rollover detected, further encryption is not allowed.
+ *
+ **********************************************************/
+
+/**
+ * initiate_files_firsttime stores the provisioning data built into the
+ * image as KVStore records, on the first boot after the flash was erased.
+ * Records that already exist are left alone, so device state survives
+ * reboots.
+ * @return 0 on success, -1 on error
+ */
+int initiate_files_firsttime(void)
+{
+	static const struct {
+		const char *name;
+		const unsigned char *data;
+		unsigned int length;
+	} seed[] = {
+	    {SDO_CRED_NORMAL, data_Normal_blob, data_Normal_blob_len},
+	    {SDO_CRED_SECURE, data_Secure_blob, data_Secure_blob_len},
+	    {SDO_CRED_MFG, data_Mfg_blob, data_Mfg_blob_len},
+	    {RAW_BLOB, data_raw_blob, data_raw_blob_len},
+	    {ECDSA_PRIVKEY, data_ecdsaprivkey, data_ecdsaprivkey_len},
+	    {EPID_PRIVKEY, data_epidprivkey_dat, data_epidprivkey_dat_len},
+#ifdef MFG_PROXY
+	    {MFG_PROXY, data_mfg_proxy_dat, data_mfg_proxy_dat_len},
+	    {RV_PROXY, data_rv_proxy_dat, data_rv_proxy_dat_len},
+	    {OWNER_PROXY, data_owner_proxy_dat, data_owner_proxy_dat_len},
+#endif
+	};
+	size_t i;
+	int ret = 0;
+
+	for (i = 0; i < sizeof(seed) / sizeof(seed[0]); i++) {
+		/* Empty files stand for "not provisioned yet" */
+		if (seed[i].length == 0 || kvRecordSize(seed[i].name) != 0)
+			continue;
+		if (kvRecordWrite(seed[i].name, seed[i].data,
+				  seed[i].length) != 0) {
+			LOG(LOG_ERROR, "Could not store %s\n", seed[i].name);
+			ret = -1;
+		}
+	}
+	return ret;
+}
+
+/**
+ * sdoBlobSize Get specified SDO blob(record) size
+ *
+ * @param name - pointer to the blob/file name
+ * @param flags - descriptor telling type of file
+ * @return blob size on success, 0 if it does not exist, -1 on failure
+ */
+int32_t sdoBlobSize(const char *name, sdoSdkBlobFlags flags)
+{
+	int32_t retval = -1;
+	int32_t recordSize;
+
+	sdoStorageStatsApi(SDO_STORAGE_API_SIZE);
+	if (name == NULL)
+		return -1;
+
+	recordSize = kvRecordSize(name);
+	if (recordSize <= 0) {
+		retval = recordSize;
+		goto end;
+	}
+
+	switch (flags) {
+	case SDO_SDK_RAW_DATA:
+		/* Raw blobs are stored as plain records */
+		retval = recordSize;
+		break;
+	case SDO_SDK_NORMAL_DATA:
+		/* Normal blob is stored as:
+		 * [HMAC(32bytes)||data-content-size(4bytes)||data-content(?)]
+		 */
+		retval = recordSize - PLATFORM_HMAC_SIZE - BLOB_CONTENT_SIZE;
+		break;
+	case SDO_SDK_SECURE_DATA:
+		/* Secure blob is stored as:
+		 * [IV_data(12byte)||TAG(16bytes)||
+		 * data-content-size(4bytes)||data-content(?)]
+		 */
+		retval = recordSize - PLATFORM_GCM_TAG_SIZE -
+			 PLATFORM_IV_DEFAULT_LEN - BLOB_CONTENT_SIZE;
+		break;
+	default:
+		LOG(LOG_ERROR, "Invalid storage flag:%d!\n", flags);
+		goto end;
+	}
+
+end:
+	if (retval > R_MAX_SIZE) {
+		LOG(LOG_ERROR, "Blob size is more than R_MAX_SIZE\n");
+		retval = -1;
+	}
+	return retval;
+}
+
+/**
+ * sdoBlobRead Read SDO blob(record) into specified buffer,
+ * sdoBlobRead ensures authenticity &  integrity for non-secure
+ * data & additionally confidentiality for secure data.
+ * Note: SDO_SDK_OTP_DATA flag is not supported for this platform.
+ * @param name - pointer to the blob/file name
+ * @param flags - descriptor telling type of file
+ * @param buf - pointer to buf where data is read into
+ * @param nBytes - length of data(in bytes) to be read
+ * @return num of bytes read if success, -1 on error
+ */
+int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
+		    uint32_t nBytes)
+{
+	int retval = -1;
+	uint8_t *data = NULL;
+	uint32_t dataLength = 0;
+	uint8_t *record = NULL;
+	uint32_t recordLen = 0;
+	uint8_t storedHmac[PLATFORM_HMAC_SIZE] = {0};
+	uint8_t computedHmac[PLATFORM_HMAC_SIZE] = {0};
+	uint8_t storedTag[PLATFORM_GCM_TAG_SIZE] = {0};
+	int strcmp_result = -1;
+	uint8_t iv[PLATFORM_IV_DEFAULT_LEN] = {0};
+	uint8_t aes_key[PLATFORM_AES_KEY_DEFAULT_LEN] = {0};
+	uint8_t hmac_key[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
+	size_t datLen_offst = 0;
+
+	sdoStorageStatsApi(SDO_STORAGE_API_READ);
+	if (!name || !buf || nBytes == 0) {
+		LOG(LOG_ERROR, "Invalid parameters in sdoBlobRead()!\n");
+		goto exit;
+	}
+
+	if (nBytes > R_MAX_SIZE) {
+		LOG(LOG_ERROR, "blob read buffer is more than R_MAX_SIZE in "
+			       "sdoBlobRead()!\n");
+		goto exit;
+	}
+
+	switch (flags) {
+	case SDO_SDK_RAW_DATA:
+		// Raw blobs are stored as plain records
+		if (0 != kvRecordRead(name, buf, nBytes)) {
+			LOG(LOG_ERROR, "Failed to read %s blob!\n", name);
+			goto exit;
+		}
+		break;
+
+	case SDO_SDK_NORMAL_DATA:
+		/* HMAC-256 is being used to store records under
+		 * SDO_SDK_NORMAL_DATA flag.
+		 * Record content stored as:
+		 * [HMAC(32 bytes)||SizeofPlaintext(4 bytes)||Plaintext(nBytes
+		 * bytes)] */
+		recordLen = PLATFORM_HMAC_SIZE + BLOB_CONTENT_SIZE + nBytes;
+
+		if (NULL == (record = (uint8_t *)sdoAlloc(recordLen))) {
+			LOG(LOG_ERROR, "Malloc Failed in sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		if (0 != kvRecordRead(name, record, recordLen)) {
+			LOG(LOG_ERROR, "Failed to read %s blob!\n", name);
+			goto exit;
+		}
+
+		// get actual data length
+		dataLength = getU32(record + PLATFORM_HMAC_SIZE);
+
+		// check if input buffer is sufficient ?
+		if (nBytes < dataLength) {
+			LOG(LOG_ERROR,
+			    "Failed to read data, Buffer is not enough, "
+			    "bufLen:%d,\t Lengthstoredinflash:%d\n",
+			    (int)nBytes, (int)dataLength);
+			goto exit;
+		}
+
+		if (memcpy_s(storedHmac, PLATFORM_HMAC_SIZE, record,
+			     PLATFORM_HMAC_SIZE) != 0) {
+			LOG(LOG_ERROR, "Copying stored HMAC failed during "
+				       "sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		data = record + PLATFORM_HMAC_SIZE + BLOB_CONTENT_SIZE;
+
+		if (!getPlatformHMACKey(hmac_key,
+					PLATFORM_HMAC_KEY_DEFAULT_LEN)) {
+			LOG(LOG_ERROR, "Could not get platform HMAC Key!\n");
+			goto exit;
+		}
+
+		// compute HMAC
+		if (0 != sdoStorageHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, data,
+					dataLength, computedHmac,
+					PLATFORM_HMAC_SIZE, hmac_key,
+					HMACSHA256_KEY_SIZE)) {
+			LOG(LOG_ERROR,
+			    "HMAC computation failed during sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		// compare HMAC
+		memcmp_s(storedHmac, PLATFORM_HMAC_SIZE, computedHmac,
+			 PLATFORM_HMAC_SIZE, &strcmp_result);
+		if (strcmp_result != 0) {
+			LOG(LOG_ERROR,
+			    "sdoBlobRead(): HMACs do not compare!\n");
+			goto exit;
+		}
+
+		// copy data into supplied buffer
+		if (memcpy_s(buf, nBytes, data, dataLength) != 0) {
+			LOG(LOG_ERROR, "sdoBlobRead(): Copying data into "
+				       "buffer failed!\n");
+			goto exit;
+		}
+		break;
+
+	case SDO_SDK_SECURE_DATA:
+		/* AES GCM authenticated encryption is being used to store
+		 * records under SDO_SDK_SECURE_DATA flag. Record content
+		 * stored as:
+		 * [IV_data(12byte)||[AuthenticatedTAG(16 bytes)||
+		 * SizeofCiphertext(8 * bytes)||Ciphertet(nBytes bytes)] */
+		recordLen = PLATFORM_IV_DEFAULT_LEN + PLATFORM_GCM_TAG_SIZE +
+			    BLOB_CONTENT_SIZE + nBytes;
+
+		if (NULL == (record = (uint8_t *)sdoAlloc(recordLen))) {
+			LOG(LOG_ERROR, "Malloc Failed in sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		if (0 != kvRecordRead(name, record, recordLen)) {
+			LOG(LOG_ERROR, "Failed to read %s blob!\n", name);
+			goto exit;
+		}
+
+		datLen_offst = PLATFORM_GCM_TAG_SIZE + PLATFORM_IV_DEFAULT_LEN;
+		// get actual data length
+		dataLength = getU32(record + datLen_offst);
+
+		// check if input buffer is sufficient ?
+		if (nBytes < dataLength) {
+			LOG(LOG_ERROR,
+			    "Failed to read data, Buffer is not enough, "
+			    "bufLen:%d,\t Lengthstoredinflash:%d\n",
+			    (int)nBytes, (int)dataLength);
+			goto exit;
+		}
+		/* read the iv from blob */
+		if (memcpy_s(iv, PLATFORM_IV_DEFAULT_LEN, record,
+			     PLATFORM_IV_DEFAULT_LEN) != 0) {
+			LOG(LOG_ERROR, "Copying stored IV failed during "
+				       "sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		if (memcpy_s(storedTag, PLATFORM_GCM_TAG_SIZE,
+			     record + PLATFORM_IV_DEFAULT_LEN,
+			     PLATFORM_GCM_TAG_SIZE) != 0) {
+			LOG(LOG_ERROR, "Copying stored TAG failed during "
+				       "sdoBlobRead()!\n");
+			goto exit;
+		}
+
+		data = record + PLATFORM_IV_DEFAULT_LEN +
+		       PLATFORM_GCM_TAG_SIZE + BLOB_CONTENT_SIZE;
+
+		if (!getPlatformAESKey(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN)) {
+			LOG(LOG_ERROR, "Could not get platform AES Key!\n");
+			goto exit;
+		}
+
+		// decrypt and authenticate cipher-text content and fill the
+		// given buffer with clear-text
+		if (sdoStorageGcmDecrypt(buf, nBytes, data, dataLength, iv,
+					 PLATFORM_IV_DEFAULT_LEN, aes_key,
+					 PLATFORM_AES_KEY_DEFAULT_LEN,
+					 storedTag, AES_GCM_TAG_LEN) < 0) {
+			LOG(LOG_ERROR, "Decryption failed during Secure "
+				       "Blob Read!\n");
+			goto exit;
+		}
+		break;
+
+	default:
+		LOG(LOG_ERROR, "Invalid SDO blob flag!!\n");
+		goto exit;
+	}
+
+	retval = (int32_t)nBytes;
+
+exit:
+	if (record)
+		sdoFree(record);
+	if (memset_s(hmac_key, PLATFORM_HMAC_KEY_DEFAULT_LEN, 0)) {
+		LOG(LOG_ERROR, "Failed to clear HMAC key\n");
+		retval = -1;
+	}
+	if (memset_s(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN, 0)) {
+		LOG(LOG_ERROR, "Failed to clear AES key\n");
+		retval = -1;
+	}
+	return retval;
+}
+
+/**
+ * sdoBlobWrite Write SDO blob(record) from specified buffer
+ * sdoBlobWrite ensures integrity & authenticity for non-secure
+ * data & additionally confidentiality for secure data.
+ * Note: SDO_SDK_OTP_DATA flag is not supported for this platform.
+ * @param name - pointer to the blob/file name
+ * @param flags - descriptor telling type of file
+ * @param buf - pointer to buf from where data is read and then written
+ * @param nBytes - length of data(in bytes) to be written
+ * @return num of bytes write if success, -1 on error
+ */
+int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
+		     const uint8_t *buf, uint32_t nBytes)
+{
+	int retval = -1;
+	int staged;
+	uint32_t recordLen = 0;
+	uint8_t *record = NULL;
+	uint8_t tag[PLATFORM_GCM_TAG_SIZE] = {0};
+	uint8_t iv[PLATFORM_IV_DEFAULT_LEN] = {0};
+	uint8_t aes_key[PLATFORM_AES_KEY_DEFAULT_LEN] = {0};
+	uint8_t hmac_key[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
+	size_t datLen_offst = 0;
+
+	sdoStorageStatsApi(SDO_STORAGE_API_WRITE);
+	if (!buf || !name || nBytes == 0) {
+		LOG(LOG_ERROR, "Invalid parameters in sdoBlobWrite!\n");
+		goto exit;
+	}
+
+	if (nBytes > R_MAX_SIZE) {
+		LOG(LOG_ERROR, "blob write buffer is more than R_MAX_SIZE in "
+			       "sdoBlobWrite()!\n");
+		goto exit;
+	}
+
+	switch (flags) {
+	case SDO_SDK_RAW_DATA:
+		// Raw blobs are stored as plain records
+		recordLen = nBytes;
+
+		if (NULL == (record = (uint8_t *)sdoAlloc(recordLen))) {
+			LOG(LOG_ERROR, "Malloc Failed in sdoBlobWrite!\n");
+			goto exit;
+		}
+
+		if (memcpy_s(record, recordLen, buf, nBytes) != 0) {
+			LOG(LOG_ERROR,
+			    "Copying data failed during RAW Blob write!\n");
+			goto exit;
+		}
+		break;
+
+	case SDO_SDK_NORMAL_DATA:
+		/* HMAC-256 is being used to store records under
+		 * SDO_SDK_NORMAL_DATA flag.
+		 * Record content stored as:
+		 * [HMAC(32 bytes)||SizeofPlaintext(4 bytes)||Plaintext(nBytes
+		 * bytes)] */
+		recordLen = PLATFORM_HMAC_SIZE + BLOB_CONTENT_SIZE + nBytes;
+
+		if (NULL == (record = (uint8_t *)sdoAlloc(recordLen))) {
+			LOG(LOG_ERROR, "Malloc Failed in sdoBlobWrite!\n");
+			goto exit;
+		}
+
+		if (!getPlatformHMACKey(hmac_key,
+					PLATFORM_HMAC_KEY_DEFAULT_LEN)) {
+			LOG(LOG_ERROR, "Could not get hmac_key!\n");
+			goto exit;
+		}
+
+		if (0 != sdoStorageHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, buf,
+					nBytes, record, PLATFORM_HMAC_SIZE,
+					hmac_key, HMACSHA256_KEY_SIZE)) {
+			LOG(LOG_ERROR, "Computing HMAC failed during Normal "
+				       "Blob write!\n");
+			goto exit;
+		}
+
+		// copy plain-text size
+		putU32(record + PLATFORM_HMAC_SIZE, nBytes);
+
+		// copy plain-text content
+		if (memcpy_s(record + PLATFORM_HMAC_SIZE + BLOB_CONTENT_SIZE,
+			     recordLen - PLATFORM_HMAC_SIZE - BLOB_CONTENT_SIZE,
+			     buf, nBytes) != 0) {
+			LOG(LOG_ERROR,
+			    "Copying data failed during Normal Blob write!\n");
+			goto exit;
+		}
+		break;
+
+	case SDO_SDK_SECURE_DATA:
+		/* AES GCM authenticated encryption is being used to store
+		 * records under SDO_SDK_SECURE_DATA flag. Record content
+		 * stored as:
+		 * [IV_data(12byte)||[AuthenticatedTAG(16 bytes)||
+		 * SizeofCiphertext(8 * bytes)||Ciphertet(nBytes bytes)] */
+		recordLen = PLATFORM_IV_DEFAULT_LEN + PLATFORM_GCM_TAG_SIZE +
+			    BLOB_CONTENT_SIZE + nBytes;
+
+		if (NULL == (record = (uint8_t *)sdoAlloc(recordLen))) {
+			LOG(LOG_ERROR, "Malloc Failed in sdoBlobWrite()!\n");
+			goto exit;
+		}
+
+		if (!getPlatformIV(iv, PLATFORM_IV_DEFAULT_LEN, nBytes)) {
+			LOG(LOG_ERROR, "Could not get platform IV!\n");
+			goto exit;
+		}
+
+		if (!getPlatformAESKey(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN)) {
+			LOG(LOG_ERROR, "Could not get platform AES Key!\n");
+			goto exit;
+		}
+
+		// encrypt plain-text and copy cipher-text content
+		if (sdoStorageGcmEncrypt(
+			buf, nBytes,
+			record + PLATFORM_IV_DEFAULT_LEN +
+			    PLATFORM_GCM_TAG_SIZE + BLOB_CONTENT_SIZE,
+			recordLen, iv, PLATFORM_IV_DEFAULT_LEN, aes_key,
+			PLATFORM_AES_KEY_DEFAULT_LEN, tag,
+			AES_GCM_TAG_LEN) < 0) {
+			LOG(LOG_ERROR, "Encypting data failed during Secure "
+				       "Blob write!\n");
+			goto exit;
+		}
+
+		// copy used IV for encryption
+		if (memcpy_s(record, PLATFORM_IV_DEFAULT_LEN, iv,
+			     PLATFORM_IV_DEFAULT_LEN) != 0) {
+			LOG(LOG_ERROR, "Copying IV value failed during Secure "
+				       "Blob write!\n");
+			goto exit;
+		}
+		// copy Authenticated TAG value
+		if (memcpy_s(record + PLATFORM_IV_DEFAULT_LEN,
+			     recordLen - PLATFORM_IV_DEFAULT_LEN, tag,
+			     PLATFORM_GCM_TAG_SIZE) != 0) {
+			LOG(LOG_ERROR, "Copying TAG value failed during Secure "
+				       "Blob write!\n");
+			goto exit;
+		}
+
+		datLen_offst = PLATFORM_GCM_TAG_SIZE + PLATFORM_IV_DEFAULT_LEN;
+		/* copy cipher-text size; CT size= PT size (AES GCM uses AES CTR
+		 * mode internally for encryption) */
+		putU32(record + datLen_offst, nBytes);
+		break;
+
+	default:
+		LOG(LOG_ERROR, "Invalid SDO blob flag!!\n");
+		goto exit;
+	}
+
+	/* Inside a transaction the record is only staged */
+	staged = blobTxStage(name, &record, recordLen);
+	if (staged < 0)
+		goto exit;
+	if (!staged && kvRecordWrite(name, record, recordLen) != 0)
+		goto exit;
+
+	retval = (int32_t)nBytes;
+
+exit:
+	if (record)
+		sdoFree(record);
+	if (memset_s(hmac_key, PLATFORM_HMAC_KEY_DEFAULT_LEN, 0)) {
+		LOG(LOG_ERROR, "Failed to clear HMAC key\n");
+		retval = -1;
+	}
+	if (memset_s(aes_key, PLATFORM_AES_KEY_DEFAULT_LEN, 0)) {
+		LOG(LOG_ERROR, "Failed to clear AES key\n");
+		retval = -1;
+	}
+	return retval;
+}
+
+/**
+ * sdoReadEPIDKey will read the key from its KVStore record
+ * @param buffer - pointer to the buffer
+ * @param size - length of buffer passed in buffer
+ * @return num of bytes write if success, -1 on error
+ */
+int32_t sdoReadEPIDKey(uint8_t *buffer, uint32_t *size)
+{
+	if (!buffer || !size)
+		return -1;
+
+	if (*size == 0) {
+		LOG(LOG_ERROR, "Can not read 0 bytes!\n");
+		return -1;
+	}
+
+	if (0 != kvRecordRead((const char *)EPID_PRIVKEY, buffer, *size)) {
+		LOG(LOG_ERROR, "Failed to read %s blob!\n", EPID_PRIVKEY);
+		return -1;
+	}
+
+	return (int32_t)*size;
+}
+
+/**
+ * sdoBlobCacheFlush is a no-op, blobs are not cached on this platform.
+ */
+void sdoBlobCacheFlush(void)
+{
+}
+
+/**
+ * sdoConfigSnapshotLoad is a no-op, the configuration is compiled in or
+ * read from the KVStore records when needed on this platform.
+ */
+int32_t sdoConfigSnapshotLoad(void)
+{
+	return 0;
+}
+
+/**
+ * sdoBlobTxBegin opens a blob transaction. The following sdoBlobWrite calls
+ * are only staged, sdoBlobTxCommit then applies all of them or none.
+ * @return 0 on success, -1 if a transaction is already open
+ */
+int32_t sdoBlobTxBegin(void)
+{
+	if (blobTx.active) {
+		LOG(LOG_ERROR, "Blob transaction already open\n");
+		return -1;
+	}
+	blobTx.active = true;
+	return 0;
+}
+
+/**
+ * sdoBlobTxAbort drops what the open blob transaction staged.
+ */
+void sdoBlobTxAbort(void)
+{
+	blobTxClear();
+}
+
+/**
+ * sdoBlobTxCommit applies the blob writes staged since sdoBlobTxBegin
+ * atomically, through the journal record.
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommit(void)
+{
+	int32_t ret = -1;
+	uint8_t *journal = NULL;
+	size_t length = BLOB_CONTENT_SIZE;
+	size_t n = BLOB_CONTENT_SIZE;
+	size_t nameLen;
+	unsigned int i;
+
+	if (!blobTx.active || blobTx.count == 0) {
+		ret = 0;
+		goto end;
+	}
+
+	for (i = 0; i < blobTx.count; i++)
+		length += 2 * BLOB_CONTENT_SIZE +
+			  strnlen_s(blobTx.entry[i].name, MAX_KEY_PATH) +
+			  blobTx.entry[i].length;
+
+	journal = (uint8_t *)sdoAlloc(length);
+	if (!journal) {
+		LOG(LOG_ERROR, "Malloc Failed in sdoBlobTxCommit!\n");
+		goto end;
+	}
+
+	putU32(journal, blobTx.count);
+	for (i = 0; i < blobTx.count; i++) {
+		nameLen = strnlen_s(blobTx.entry[i].name, MAX_KEY_PATH);
+		putU32(journal + n, (uint32_t)nameLen);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(journal + n, length - n, blobTx.entry[i].name,
+			     nameLen) != 0)
+			goto end;
+		n += nameLen;
+		putU32(journal + n, blobTx.entry[i].length);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(journal + n, length - n, blobTx.entry[i].record,
+			     blobTx.entry[i].length) != 0)
+			goto end;
+		n += blobTx.entry[i].length;
+	}
+
+	/* The update is committed once the journal record is set */
+	if (kvRecordWrite(KV_JOURNAL, journal, length) != 0)
+		goto end;
+
+	if (blobJournalApply(journal, length) != 0) {
+		LOG(LOG_ERROR, "Blob journal not applied, replayed at next "
+			       "start\n");
+		goto end;
+	}
+	ret = 0;
+
+end:
+	if (journal) {
+		if (memset_s(journal, length, 0))
+			LOG(LOG_ERROR, "Failed to clear the blob journal\n");
+		sdoFree(journal);
+	}
+	blobTxClear();
+	return ret;
+}
+
+/**
+ * sdoBlobTxCommitAsync is sdoBlobTxCommit followed by done, blobs are not
+ * written in the background on this platform.
+ * @param done - called once the blobs are durable, may be NULL
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommitAsync(sdoBlobTxDoneCB done)
+{
+	int32_t ret = sdoBlobTxCommit();
+
+	if (ret == 0 && done)
+		done(0);
+	return ret;
+}
+
+/**
+ * sdoBlobTxSync has nothing to wait for on this platform.
+ * @return 0
+ */
+int32_t sdoBlobTxSync(void)
+{
+	return 0;
+}
+
+/**
+ * sdoBlobJournalReplay completes a blob transaction cut short by a power
+ * loss. It is run at startup, before any credential is read.
+ * @return 0 on success or if there is nothing to replay, -1 on error
+ */
+int32_t sdoBlobJournalReplay(void)
+{
+	int32_t length = kvRecordSize(KV_JOURNAL);
+	uint8_t *journal = NULL;
+	int32_t ret = -1;
+
+	if (length == 0)
+		return 0;
+	if (length < 0)
+		return -1;
+
+	journal = (uint8_t *)sdoAlloc((size_t)length);
+	if (!journal ||
+	    kvRecordRead(KV_JOURNAL, journal, (size_t)length) != 0)
+		goto end;
+
+	LOG(LOG_INFO, "Replaying the blob journal\n");
+	ret = blobJournalApply(journal, (size_t)length);
+
+end:
+	if (journal) {
+		if (memset_s(journal, (size_t)length, 0))
+			LOG(LOG_ERROR, "Failed to clear the blob journal\n");
+		sdoFree(journal);
+	}
+	return ret;
+}
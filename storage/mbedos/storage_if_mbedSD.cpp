@@ -18,6 +18,8 @@
 #include "sdoCryptoHal.h"
 #include "crypto_utils.h"
 #include "platform_utils.h"
+#include "storage_stats.h"
+#include "SDCacheBlockDevice.h"
 
 extern "C" {
 extern int strncat_s(char *dest, size_t dmax, const char *src, size_t slen);
@@ -47,6 +49,444 @@ static int getSDfilepath(char *filepath, const char *name)
 	return 0;
 }
 
+#ifdef SDO_BLOB_CONTAINER
+/* Most normal/secure blobs the container holds */
+#define CONTAINER_MAX_BLOBS 16
+#define CONTAINER_MAGIC 0x53444f43 /* "SDOC" */
+/* magic(4)||count(4)||indexLength(4) */
+#define CONTAINER_HDR_LEN (3 * BLOB_CONTENT_SIZE)
+/* nameLength(4)||name||flags(4)||offset(4)||length(4) */
+#define CONTAINER_ENTRY_LEN (4 * BLOB_CONTENT_SIZE)
+#define CONTAINER_NEW_SUFFIX ".new"
+
+/*
+ * Blob container. All normal and secure blobs live in one file, so a boot
+ * costs one FAT lookup and one read instead of several per blob:
+ * [magic(4)||count(4)||indexLength(4)||index||HMAC(32 bytes)||records]
+ * Each index entry gives a blob name, its flags and where its record sits
+ * after the HMAC. The HMAC covers the header and the index. A record is the
+ * sealed blob exactly as it used to be stored in its own file, and keeps
+ * its own HMAC or GCM tag.
+ * The container is read once and kept in memory. It is rewritten through
+ * a ".new" file that replaces it, so an interrupted update leaves either
+ * the old or the new container. Blobs still in their own files from before
+ * are read from there, and move into the container when next written.
+ */
+typedef struct {
+	char *name;
+	uint32_t nameLength;
+	uint32_t flags;
+	uint8_t *record;
+	uint32_t length;
+} containerBlob_t;
+
+static struct {
+	bool loaded;
+	bool deferred;
+	bool dirty;
+	unsigned int count;
+	containerBlob_t blob[CONTAINER_MAX_BLOBS];
+} container;
+
+/**
+ * Internal API: put a 32 bit value big endian.
+ */
+static void containerPutU32(uint8_t *p, uint32_t value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value >> 0;
+}
+
+/**
+ * Internal API: get a 32 bit big endian value.
+ */
+static uint32_t containerGetU32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) |
+	       ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+/**
+ * Internal API: HMAC over the container header and index.
+ * @return 0 on success, -1 on error
+ */
+static int containerMac(const uint8_t *index, uint32_t length, uint8_t *mac)
+{
+	uint8_t hmac_key[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
+	int ret = -1;
+
+	if (!getPlatformHMACKey(hmac_key, PLATFORM_HMAC_KEY_DEFAULT_LEN)) {
+		LOG(LOG_ERROR, "Could not get hmac_key!\n");
+		goto end;
+	}
+	if (0 != sdoStorageHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, index, length,
+				mac, PLATFORM_HMAC_SIZE, hmac_key,
+				HMACSHA256_KEY_SIZE)) {
+		LOG(LOG_ERROR, "Computing HMAC failed for the container\n");
+		goto end;
+	}
+	ret = 0;
+
+end:
+	if (memset_s(hmac_key, PLATFORM_HMAC_KEY_DEFAULT_LEN, 0)) {
+		LOG(LOG_ERROR, "Failed to clear HMAC key\n");
+		ret = -1;
+	}
+	return ret;
+}
+
+/**
+ * Internal API: wipe and release the in-memory container.
+ */
+static void containerClear(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < container.count; i++) {
+		if (container.blob[i].record) {
+			if (memset_s(container.blob[i].record,
+				     container.blob[i].length, 0))
+				LOG(LOG_ERROR, "Failed to clear blob\n");
+			sdoFree(container.blob[i].record);
+		}
+		if (container.blob[i].name)
+			sdoFree(container.blob[i].name);
+		container.blob[i].length = 0;
+	}
+	container.count = 0;
+	container.dirty = false;
+	container.loaded = false;
+}
+
+/**
+ * Internal API: build the container and ".new" file paths.
+ * @return 0 on success, -1 on error
+ */
+static int containerPaths(char *path, char *newPath)
+{
+	if (getSDfilepath(path, (const char *)SDO_BLOB_CONTAINER) == -1 ||
+	    getSDfilepath(newPath, (const char *)SDO_BLOB_CONTAINER) == -1)
+		return -1;
+	if (strncat_s(newPath, MAX_FILE_PATH, CONTAINER_NEW_SUFFIX,
+		      sizeof(CONTAINER_NEW_SUFFIX)))
+		return -1;
+	return 0;
+}
+
+/**
+ * Internal API: parse and verify a container image into memory.
+ * @return 0 on success, -1 if the image is not a valid container
+ */
+static int containerParse(const uint8_t *image, size_t length)
+{
+	uint8_t mac[PLATFORM_HMAC_SIZE] = {0};
+	const uint8_t *p = image + CONTAINER_HDR_LEN;
+	const uint8_t *records;
+	const uint8_t *indexEnd;
+	containerBlob_t *blob;
+	uint32_t indexLength;
+	uint32_t offset;
+	uint32_t count;
+	int result = -1;
+
+	if (length < CONTAINER_HDR_LEN + PLATFORM_HMAC_SIZE ||
+	    containerGetU32(image) != CONTAINER_MAGIC)
+		return -1;
+	count = containerGetU32(image + BLOB_CONTENT_SIZE);
+	indexLength = containerGetU32(image + 2 * BLOB_CONTENT_SIZE);
+	if (count > CONTAINER_MAX_BLOBS ||
+	    indexLength > length - CONTAINER_HDR_LEN - PLATFORM_HMAC_SIZE)
+		return -1;
+	indexEnd = p + indexLength;
+	records = indexEnd + PLATFORM_HMAC_SIZE;
+
+	/* One MAC vouches for the whole index */
+	if (containerMac(image, CONTAINER_HDR_LEN + indexLength, mac) != 0)
+		return -1;
+	memcmp_s(indexEnd, PLATFORM_HMAC_SIZE, mac, PLATFORM_HMAC_SIZE,
+		 &result);
+	if (result != 0) {
+		LOG(LOG_ERROR, "Blob container index HMAC does not match!\n");
+		return -1;
+	}
+
+	while (container.count < count) {
+		blob = &container.blob[container.count];
+		if (indexEnd - p < CONTAINER_ENTRY_LEN)
+			return -1;
+		blob->nameLength = containerGetU32(p);
+		p += BLOB_CONTENT_SIZE;
+		if (blob->nameLength == 0 || blob->nameLength > MAX_FILE_PATH ||
+		    (size_t)(indexEnd - p) <
+			blob->nameLength + 3 * BLOB_CONTENT_SIZE)
+			return -1;
+		blob->name = (char *)sdoAlloc(blob->nameLength + 1);
+		if (!blob->name ||
+		    memcpy_s(blob->name, blob->nameLength + 1, p,
+			     blob->nameLength) != 0)
+			return -1;
+		p += blob->nameLength;
+		blob->flags = containerGetU32(p);
+		offset = containerGetU32(p + BLOB_CONTENT_SIZE);
+		blob->length = containerGetU32(p + 2 * BLOB_CONTENT_SIZE);
+		p += 3 * BLOB_CONTENT_SIZE;
+		container.count++;
+
+		if (blob->length == 0 ||
+		    offset > (size_t)(image + length - records) ||
+		    blob->length > (size_t)(image + length - records) - offset)
+			return -1;
+		blob->record = (uint8_t *)sdoAlloc(blob->length);
+		if (!blob->record ||
+		    memcpy_s(blob->record, blob->length, records + offset,
+			     blob->length) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Internal API: read the container into memory, once.
+ * @return 0 on success (an absent or damaged container is empty), -1 if
+ * its path cannot be built
+ */
+static int containerLoad(void)
+{
+	char path[MAX_FILE_PATH + 1] = {0};
+	char newPath[MAX_FILE_PATH + 1] = {0};
+	uint8_t *image = NULL;
+	FILE *f = NULL;
+	long length;
+	int ret = -1;
+
+	if (container.loaded)
+		return 0;
+	if (containerPaths(path, newPath) != 0)
+		return -1;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		/* Cut short between removing the old and naming the new */
+		if (rename(newPath, path) == 0)
+			f = fopen(path, "rb");
+	}
+	if (!f) {
+		container.loaded = true;
+		return 0;
+	}
+
+	if (fseek(f, 0, SEEK_END) != 0 || (length = ftell(f)) <= 0 ||
+	    fseek(f, 0, SEEK_SET) != 0)
+		goto end;
+	image = (uint8_t *)sdoAlloc((size_t)length);
+	if (!image || fread(image, 1, (size_t)length, f) != (size_t)length)
+		goto end;
+	sdoStorageStatsRead((size_t)length);
+	ret = containerParse(image, (size_t)length);
+
+end:
+	/*
+	 * A damaged container counts as empty, its blobs then fail to read
+	 * as a damaged blob file would, and the next write starts afresh.
+	 */
+	if (ret != 0) {
+		LOG(LOG_ERROR, "Invalid blob container %s\n", path);
+		containerClear();
+	}
+	container.loaded = true;
+	if (image)
+		sdoFree(image);
+	if (fclose(f) == EOF)
+		LOG(LOG_ERROR, "fclose() Failed for the blob container\n");
+	return 0;
+}
+
+/**
+ * Internal API: find a blob in the container.
+ * @return blob, NULL if it is not in the container
+ */
+static containerBlob_t *containerFind(const char *name, uint32_t flags)
+{
+	size_t nameLength = strnlen_s(name, MAX_FILE_PATH + 1);
+	unsigned int i;
+	int result;
+
+	if (containerLoad() != 0)
+		return NULL;
+
+	for (i = 0; i < container.count; i++) {
+		if (container.blob[i].nameLength != nameLength ||
+		    container.blob[i].flags != flags)
+			continue;
+		result = -1;
+		memcmp_s(container.blob[i].name, nameLength, name, nameLength,
+			 &result);
+		if (result == 0)
+			return &container.blob[i];
+	}
+	return NULL;
+}
+
+/**
+ * Internal API: write the in-memory container out, through the ".new"
+ * file.
+ * @return 0 on success, -1 on error
+ */
+static int containerStore(void)
+{
+	char path[MAX_FILE_PATH + 1] = {0};
+	char newPath[MAX_FILE_PATH + 1] = {0};
+	uint8_t *image = NULL;
+	size_t indexLength = 0;
+	size_t recordsLength = 0;
+	size_t length;
+	size_t n = CONTAINER_HDR_LEN;
+	uint32_t offset = 0;
+	unsigned int i;
+	FILE *f = NULL;
+	int ret = -1;
+
+	if (containerPaths(path, newPath) != 0)
+		return -1;
+
+	for (i = 0; i < container.count; i++) {
+		indexLength +=
+		    CONTAINER_ENTRY_LEN + container.blob[i].nameLength;
+		recordsLength += container.blob[i].length;
+	}
+	length = CONTAINER_HDR_LEN + indexLength + PLATFORM_HMAC_SIZE +
+		 recordsLength;
+
+	image = (uint8_t *)sdoAlloc(length);
+	if (!image) {
+		LOG(LOG_ERROR, "Malloc Failed for the blob container!\n");
+		return -1;
+	}
+
+	containerPutU32(image, CONTAINER_MAGIC);
+	containerPutU32(image + BLOB_CONTENT_SIZE, container.count);
+	containerPutU32(image + 2 * BLOB_CONTENT_SIZE, (uint32_t)indexLength);
+	for (i = 0; i < container.count; i++) {
+		containerPutU32(image + n, container.blob[i].nameLength);
+		n += BLOB_CONTENT_SIZE;
+		if (memcpy_s(image + n, length - n, container.blob[i].name,
+			     container.blob[i].nameLength) != 0)
+			goto end;
+		n += container.blob[i].nameLength;
+		containerPutU32(image + n, container.blob[i].flags);
+		containerPutU32(image + n + BLOB_CONTENT_SIZE, offset);
+		containerPutU32(image + n + 2 * BLOB_CONTENT_SIZE,
+				container.blob[i].length);
+		n += 3 * BLOB_CONTENT_SIZE;
+		offset += container.blob[i].length;
+	}
+
+	if (containerMac(image, (uint32_t)n, image + n) != 0)
+		goto end;
+	n += PLATFORM_HMAC_SIZE;
+	for (i = 0; i < container.count; i++) {
+		if (memcpy_s(image + n, length - n, container.blob[i].record,
+			     container.blob[i].length) != 0)
+			goto end;
+		n += container.blob[i].length;
+	}
+
+	f = fopen(newPath, "w");
+	if (!f) {
+		LOG(LOG_ERROR, "Could not open file: %s\n", newPath);
+		goto end;
+	}
+	if (fwrite(image, sizeof(char), length, f) != length) {
+		LOG(LOG_ERROR, "file:%s not written properly\n", newPath);
+		(void)fclose(f);
+		goto end;
+	}
+	if (fclose(f) == EOF) {
+		LOG(LOG_ERROR, "fclose() Failed for %s\n", newPath);
+		goto end;
+	}
+	sdoStorageStatsWrite(newPath, length);
+
+	/* FAT cannot rename over an existing file */
+	(void)remove(path);
+	if (rename(newPath, path) != 0) {
+		LOG(LOG_ERROR, "Could not rename %s\n", newPath);
+		goto end;
+	}
+	if (sdoSdCacheSync() != 0) {
+		LOG(LOG_ERROR, "Could not sync the SD card\n");
+		goto end;
+	}
+	sdoStorageStatsSync();
+	container.dirty = false;
+	ret = 0;
+
+end:
+	if (image) {
+		if (memset_s(image, length, 0))
+			LOG(LOG_ERROR, "Failed to clear container image\n");
+		sdoFree(image);
+	}
+	return ret;
+}
+
+/**
+ * Internal API: put the sealed record of a blob into the container and
+ * write it out, unless a transaction defers that to its commit.
+ * @param name - pointer to the blob/file name
+ * @param flags - descriptor telling type of file
+ * @param record - in, sealed record; taken over (and NULLed)
+ * @param length - size of the record
+ * @return 1 if the blob is new to the container, 0 if it replaced its
+ * record, -1 on error
+ */
+static int containerPut(const char *name, uint32_t flags, uint8_t **record,
+			uint32_t length)
+{
+	containerBlob_t *blob = containerFind(name, flags);
+	int inserted = 0;
+
+	if (!container.loaded) {
+		LOG(LOG_ERROR, "Blob container not readable\n");
+		return -1;
+	}
+
+	if (blob) {
+		if (memset_s(blob->record, blob->length, 0))
+			LOG(LOG_ERROR, "Failed to clear blob\n");
+		sdoFree(blob->record);
+	} else {
+		if (container.count == CONTAINER_MAX_BLOBS) {
+			LOG(LOG_ERROR, "Blob container is full\n");
+			return -1;
+		}
+		blob = &container.blob[container.count];
+		blob->nameLength = strnlen_s(name, MAX_FILE_PATH + 1);
+		blob->name = (char *)sdoAlloc(blob->nameLength + 1);
+		if (!blob->name ||
+		    memcpy_s(blob->name, blob->nameLength + 1, name,
+			     blob->nameLength) != 0) {
+			if (blob->name)
+				sdoFree(blob->name);
+			return -1;
+		}
+		blob->flags = flags;
+		container.count++;
+		inserted = 1;
+	}
+	blob->record = *record;
+	blob->length = length;
+	*record = NULL;
+
+	container.dirty = true;
+	if (!container.deferred && containerStore() != 0)
+		return -1;
+	return inserted;
+}
+#endif
+
 /****************************************************
  *
  * Note on secure blob storage implementation
@@ -73,6 +513,48 @@ static int getSDfilepath(char *filepath, const char *name)
  *
  **********************************************************/
 
+/**
+ * Internal API: read a file in full.
+ * @return 0 on success, -1 on error
+ */
+static int blobFileRead(const char *filepath, uint8_t *buf, size_t length)
+{
+	if (read_buffer_from_file(filepath, buf, length) != 0)
+		return -1;
+	sdoStorageStatsRead(length);
+	return 0;
+}
+
+/**
+ * Internal API: read the sealed record of a normal or secure blob, from the
+ * container or else from the blob's own file.
+ * @param name - pointer to the blob/file name
+ * @param flags - descriptor telling type of file
+ * @param filepath - the blob's own file
+ * @param record - out, sealed record
+ * @param length - bytes to read
+ * @return 0 on success, -1 on error
+ */
+static int blobRecordRead(const char *name, sdoSdkBlobFlags flags,
+			  const char *filepath, uint8_t *record, size_t length)
+{
+#ifdef SDO_BLOB_CONTAINER
+	containerBlob_t *blob = containerFind(name, flags);
+
+	if (blob) {
+		if (blob->length < length ||
+		    memcpy_s(record, length, blob->record, length) != 0)
+			return -1;
+		return 0;
+	}
+#else
+	(void)name;
+	(void)flags;
+#endif
+	/* Not in the container (yet) */
+	return blobFileRead(filepath, record, length);
+}
+
 /**
  * sdoBlobSize Get specified SDO blob(file) size
  *
@@ -85,38 +567,55 @@ int32_t sdoBlobSize(const char *name, sdoSdkBlobFlags flags)
 {
 	int32_t retval = -1;
 	char filepath[MAX_FILE_PATH + 1] = {0};
+	size_t recordSize;
+#ifdef SDO_BLOB_CONTAINER
+	containerBlob_t *blob;
+#endif
+	sdoStorageStatsApi(SDO_STORAGE_API_SIZE);
 	if (name == NULL)
 		return -1;
 
 	if (getSDfilepath(filepath, name) == -1)
 		return -1;
 
+#ifdef SDO_BLOB_CONTAINER
+	blob = containerFind(name, flags);
+	if (blob) {
+		recordSize = blob->length;
+		goto sized;
+	}
+#endif
+
 	if (file_exists(filepath) == false) {
 		LOG(LOG_DEBUG, "%s file does not exist!\n", filepath);
 		retval = 0;
 		goto end;
 	}
+	recordSize = get_file_size(filepath);
+
+#ifdef SDO_BLOB_CONTAINER
+sized:
+#endif
 
 	switch (flags) {
 	case SDO_SDK_RAW_DATA:
 		/* Raw Files are stored as plain files */
-		retval = (int32_t)(get_file_size(filepath));
+		retval = (int32_t)recordSize;
 		break;
 	case SDO_SDK_NORMAL_DATA:
 		/* Normal blob is stored as:
 		 * [HMAC(32bytes)||data-content-size(4bytes)||data-content(?)]
 		 */
-		retval = (int32_t)(get_file_size(filepath) -
-				   PLATFORM_HMAC_SIZE - BLOB_CONTENT_SIZE);
+		retval = (int32_t)(recordSize - PLATFORM_HMAC_SIZE -
+				   BLOB_CONTENT_SIZE);
 		break;
 	case SDO_SDK_SECURE_DATA:
 		/* Secure blob is stored as:
 		 * [IV_data(12byte)||TAG(16bytes)||
 		 * data-content-size(4bytes)||data-content(?)]
 		 */
-		retval =
-		    (int32_t)(get_file_size(filepath) - PLATFORM_GCM_TAG_SIZE -
-			      PLATFORM_IV_DEFAULT_LEN - BLOB_CONTENT_SIZE);
+		retval = (int32_t)(recordSize - PLATFORM_GCM_TAG_SIZE -
+				   PLATFORM_IV_DEFAULT_LEN - BLOB_CONTENT_SIZE);
 		break;
 	default:
 		LOG(LOG_ERROR, "Invalid storage flag:%d!\n", flags);
@@ -145,6 +644,7 @@ end:
 int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 		    uint32_t nBytes)
 {
+	sdoStorageStatsApi(SDO_STORAGE_API_READ);
 	if (!name || !buf)
 		return -1;
 
@@ -182,7 +682,7 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 	switch (flags) {
 	case SDO_SDK_RAW_DATA:
 		// Raw Files are stored as plain files
-		if (0 != read_buffer_from_file(filepath, buf, nBytes)) {
+		if (0 != blobFileRead(filepath, buf, nBytes)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", filepath);
 			goto exit;
 		}
@@ -202,8 +702,8 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 			goto exit;
 		}
 
-		if (0 != read_buffer_from_file(filepath, sealedData,
-					       sealedDataLen)) {
+		if (0 != blobRecordRead(name, flags, filepath, sealedData,
+					sealedDataLen)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", filepath);
 			goto exit;
 		}
@@ -239,10 +739,10 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 		}
 
 		// compute HMAC
-		if (0 != sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, data,
-				       dataLength, computedHmac,
-				       PLATFORM_HMAC_SIZE, hmac_key,
-				       HMACSHA256_KEY_SIZE)) {
+		if (0 != sdoStorageHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, data,
+					dataLength, computedHmac,
+					PLATFORM_HMAC_SIZE, hmac_key,
+					HMACSHA256_KEY_SIZE)) {
 			LOG(LOG_ERROR,
 			    "HMAC computation dailed during sdoBlobRead()!\n");
 			goto exit;
@@ -282,8 +782,8 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 			goto exit;
 		}
 
-		if (0 != read_buffer_from_file(filepath, encryptedData,
-					       encryptedDataLen)) {
+		if (0 != blobRecordRead(name, flags, filepath, encryptedData,
+					encryptedDataLen)) {
 			LOG(LOG_ERROR, "Failed to read %s file!\n", filepath);
 			goto exit;
 		}
@@ -329,10 +829,10 @@ int32_t sdoBlobRead(const char *name, sdoSdkBlobFlags flags, uint8_t *buf,
 
 		// decrypt and authenticate cipher-text content and fill the
 		// given buffer with clear-text
-		if (sdoCryptoAESGcmDecrypt(buf, nBytes, data, dataLength, iv,
-					   PLATFORM_IV_DEFAULT_LEN, aes_key,
-					   PLATFORM_AES_KEY_DEFAULT_LEN,
-					   storedTag, AES_GCM_TAG_LEN) < 0) {
+		if (sdoStorageGcmDecrypt(buf, nBytes, data, dataLength, iv,
+					 PLATFORM_IV_DEFAULT_LEN, aes_key,
+					 PLATFORM_AES_KEY_DEFAULT_LEN,
+					 storedTag, AES_GCM_TAG_LEN) < 0) {
 			LOG(LOG_ERROR, "Decryption failed during Secure "
 				       "Blob Read!\n");
 			goto exit;
@@ -377,6 +877,7 @@ exit:
 int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		     const uint8_t *buf, uint32_t nBytes)
 {
+	sdoStorageStatsApi(SDO_STORAGE_API_WRITE);
 	if (!buf || !name)
 		return -1;
 
@@ -404,6 +905,9 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 	uint8_t aes_key[PLATFORM_AES_KEY_DEFAULT_LEN] = {0};
 	uint8_t hmac_key[PLATFORM_HMAC_KEY_DEFAULT_LEN] = {0};
 	size_t datLen_offst = 0;
+#ifdef SDO_BLOB_CONTAINER
+	int inserted;
+#endif
 
 	if (nBytes > R_MAX_SIZE) {
 		LOG(LOG_ERROR, "file write buffer is more than R_MAX_SIZE in "
@@ -450,9 +954,10 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 			goto exit;
 		}
 
-		if (0 != sdoCryptoHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, buf,
-				       nBytes, writeContext, PLATFORM_HMAC_SIZE,
-				       hmac_key, HMACSHA256_KEY_SIZE)) {
+		if (0 != sdoStorageHMAC(SDO_CRYPTO_HMAC_TYPE_SHA_256, buf,
+					nBytes, writeContext,
+					PLATFORM_HMAC_SIZE, hmac_key,
+					HMACSHA256_KEY_SIZE)) {
 			LOG(LOG_ERROR, "Computing HMAC failed during Normal "
 				       "Blob write!\n");
 			goto exit;
@@ -502,7 +1007,7 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		}
 
 		// encrypt plain-text and copy cipher-text content
-		if (sdoCryptoAESGcmEncrypt(
+		if (sdoStorageGcmEncrypt(
 			buf, nBytes,
 			writeContext + PLATFORM_IV_DEFAULT_LEN +
 			    PLATFORM_GCM_TAG_SIZE + BLOB_CONTENT_SIZE,
@@ -544,6 +1049,20 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 		goto exit;
 	}
 
+#ifdef SDO_BLOB_CONTAINER
+	if (flags != SDO_SDK_RAW_DATA) {
+		inserted = containerPut(name, flags, &writeContext,
+					writeContextLen);
+		if (inserted < 0)
+			goto exit;
+		/* Moved into the container, the old file is not read again */
+		if (inserted && file_exists(filepath))
+			(void)remove(filepath);
+		retval = (int32_t)nBytes;
+		goto exit;
+	}
+#endif
+
 	f = fopen(filepath, "w");
 	if (f != NULL) {
 		bytesWritten =
@@ -553,6 +1072,7 @@ int32_t sdoBlobWrite(const char *name, sdoSdkBlobFlags flags,
 			    filepath);
 			goto exit;
 		}
+		sdoStorageStatsWrite(filepath, writeContextLen);
 	} else {
 		LOG(LOG_ERROR, "Could not open file: %s\n", filepath);
 		goto exit;
@@ -568,6 +1088,12 @@ exit:
 			LOG(LOG_ERROR, "fclose() Failed in sdoBlobWrite\n");
 			retval = -1;
 		}
+	if (retval >= 0 && sdoSdCacheSync() != 0) {
+		LOG(LOG_ERROR, "Could not sync the SD card\n");
+		retval = -1;
+	} else if (retval >= 0) {
+		sdoStorageStatsSync();
+	}
 	if (memset_s(hmac_key, PLATFORM_HMAC_KEY_DEFAULT_LEN, 0)) {
 		LOG(LOG_ERROR, "Failed to clear HMAC key\n");
 		retval = -1;
@@ -598,10 +1124,117 @@ int32_t sdoReadEPIDKey(uint8_t *buffer, uint32_t *size)
 	if (getSDfilepath(filepath, (char *)EPID_PRIVKEY) == -1)
 		return -1;
 
-	if (0 != read_buffer_from_file(filepath, buffer, *size)) {
+	if (0 != blobFileRead(filepath, buffer, *size)) {
 		LOG(LOG_ERROR, "Failed to read %s file!\n", EPID_PRIVKEY);
 		return -1;
 	}
 
 	return (int32_t)*size;
 }
+
+/**
+ * sdoBlobCacheFlush wipes and releases the in-memory blob container, at
+ * shutdown. There is no plaintext blob cache on this platform.
+ */
+void sdoBlobCacheFlush(void)
+{
+#ifdef SDO_BLOB_CONTAINER
+	if (!container.deferred)
+		containerClear();
+#endif
+}
+
+/**
+ * sdoConfigSnapshotLoad is a no-op, the raw configuration files are read
+ * from the SD card when needed on this platform.
+ */
+int32_t sdoConfigSnapshotLoad(void)
+{
+	return 0;
+}
+
+/**
+ * sdoBlobTxBegin opens a blob transaction. The container is only written
+ * out once, by sdoBlobTxCommit, with all the blobs written meanwhile.
+ * Without the container every sdoBlobWrite goes straight to its file.
+ * @return 0 on success, -1 if a transaction is already open
+ */
+int32_t sdoBlobTxBegin(void)
+{
+#ifdef SDO_BLOB_CONTAINER
+	if (container.deferred) {
+		LOG(LOG_ERROR, "Blob transaction already open\n");
+		return -1;
+	}
+	container.deferred = true;
+#endif
+	return 0;
+}
+
+/**
+ * sdoBlobTxCommit writes the container out with the blobs written since
+ * sdoBlobTxBegin.
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommit(void)
+{
+#ifdef SDO_BLOB_CONTAINER
+	container.deferred = false;
+	if (container.dirty && containerStore() != 0) {
+		/* Keep memory and storage in step */
+		containerClear();
+		return -1;
+	}
+#endif
+	return 0;
+}
+
+/**
+ * sdoBlobTxCommitAsync is sdoBlobTxCommit followed by done, blobs are not
+ * written in the background on this platform.
+ * @param done - called once the blobs are durable, may be NULL
+ * @return 0 on success, -1 on error
+ */
+int32_t sdoBlobTxCommitAsync(sdoBlobTxDoneCB done)
+{
+	int32_t ret = sdoBlobTxCommit();
+
+	if (ret == 0 && done)
+		done(0);
+	return ret;
+}
+
+/**
+ * sdoBlobTxSync has nothing to wait for on this platform.
+ * @return 0
+ */
+int32_t sdoBlobTxSync(void)
+{
+	return 0;
+}
+
+/**
+ * sdoBlobTxAbort drops the writes of the open blob transaction, the
+ * container is read back from storage when next needed.
+ */
+void sdoBlobTxAbort(void)
+{
+#ifdef SDO_BLOB_CONTAINER
+	container.deferred = false;
+	containerClear();
+#endif
+}
+
+/**
+ * sdoBlobJournalReplay reads the blob container in at startup, finishing
+ * an interrupted container update. There is no separate journal on this
+ * platform.
+ * @return 0
+ */
+int32_t sdoBlobJournalReplay(void)
+{
+#ifdef SDO_BLOB_CONTAINER
+	(void)containerLoad();
+#endif
+	return 0;
+}